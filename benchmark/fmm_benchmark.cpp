@@ -0,0 +1,488 @@
+/**
+ * Fast map matching.
+ *
+ * Micro benchmarks of the hot kernels, on synthetic grid networks whose
+ * UBODT is generated before the first benchmark using it.
+ *
+ * Built from this directory as the unit tests, and run in an empty
+ * directory where the networks are written. Run with
+ * --benchmark_filter=<regex> to select the benchmarks.
+ *
+ * The single threaded benchmarks also report the hardware counters of
+ * Linux perf_event per item, instructions, ipc, cache_misses,
+ * branch_misses and dtlb_misses, if the kernel allows them, which needs
+ * a perf_event_paranoid of 2 or less.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "benchmark/benchmark.h"
+#include "algorithm/geom_algorithm.hpp"
+#include "io/mm_writer.hpp"
+#include "mm/composite_graph.hpp"
+#include "mm/transition_graph.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/fmm/ubodt_gen_app.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+#include "util/perf_counters.hpp"
+
+#include <ogrsf_frmts.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+namespace {
+
+// Distance between two adjacent nodes of a grid network
+const double GRID_SPACING = 100;
+// Upper bound of the UBODT of a grid network
+const double UBODT_DELTA = 500;
+// Distance between two points of a trajectory
+const double POINT_SPACING = 40;
+const double GPS_ERROR = 10;
+
+// Expose the protected layer update of FMM
+class BenchFastMapMatch : public FastMapMatch {
+ public:
+  using FastMapMatch::FastMapMatch;
+  using FastMapMatch::update_layer;
+};
+
+// Expose the protected upper bounded routing of STMATCH
+class BenchSTMATCH : public STMATCH {
+ public:
+  using STMATCH::STMATCH;
+  using STMATCH::shortest_path_upperbound;
+};
+
+/**
+ * Grid network of n by n nodes, with an edge in each direction between
+ * adjacent nodes, and its UBODT
+ */
+struct GridNetwork {
+  std::unique_ptr<Network> network;
+  std::unique_ptr<NetworkGraph> graph;
+  std::shared_ptr<UBODT> ubodt;
+};
+
+// Write a grid network into a shapefile
+void write_grid_network(const std::string &filename, int n) {
+  GDALAllRegister();
+  GDALDriver *driver =
+      GetGDALDriverManager()->GetDriverByName("ESRI Shapefile");
+  GDALDataset *dataset =
+      driver->Create(filename.c_str(), 0, 0, 0, GDT_Unknown, nullptr);
+  OGRLayer *layer =
+      dataset->CreateLayer("grid", nullptr, wkbLineString, nullptr);
+  for (const char *name : {"id", "source", "target"}) {
+    OGRFieldDefn field(name, OFTInteger);
+    layer->CreateField(&field);
+  }
+  int id = 0;
+  auto add_edge = [&](int source, int target) {
+    OGRFeature *feature = OGRFeature::CreateFeature(layer->GetLayerDefn());
+    feature->SetField("id", id++);
+    feature->SetField("source", source);
+    feature->SetField("target", target);
+    OGRLineString line;
+    line.addPoint((source % n) * GRID_SPACING, (source / n) * GRID_SPACING);
+    line.addPoint((target % n) * GRID_SPACING, (target / n) * GRID_SPACING);
+    feature->SetGeometry(&line);
+    layer->CreateFeature(feature);
+    OGRFeature::DestroyFeature(feature);
+  };
+  for (int row = 0; row < n; ++row) {
+    for (int col = 0; col < n; ++col) {
+      int node = row * n + col;
+      if (col + 1 < n) {
+        add_edge(node, node + 1);
+        add_edge(node + 1, node);
+      }
+      if (row + 1 < n) {
+        add_edge(node, node + n);
+        add_edge(node + n, node);
+      }
+    }
+  }
+  GDALClose(dataset);
+}
+
+// Get the grid network of n by n nodes, created on the first call
+GridNetwork &get_grid_network(int n) {
+  static std::map<int, GridNetwork> grids;
+  GridNetwork &grid = grids[n];
+  if (grid.network != nullptr) return grid;
+  spdlog::set_level(spdlog::level::warn);
+  std::string name = "bench_grid_" + std::to_string(n);
+  std::string network_file = name + ".shp";
+  write_grid_network(network_file, n);
+  grid.network.reset(new Network(network_file));
+  grid.graph.reset(new NetworkGraph(*grid.network));
+  std::string ubodt_file = name + "_ubodt.txt";
+  const char *argv[] = {"ubodt_gen", "--network", network_file.c_str(),
+                        "--output", ubodt_file.c_str()};
+  UBODTGenAppConfig config(5, (char **) argv);
+  UBODTGenApp app(config);
+  app.precompute_ubodt(ubodt_file, UBODT_DELTA, false);
+  grid.ubodt = UBODT::read_ubodt_csv(ubodt_file,
+                                     grid.network->get_node_count());
+  return grid;
+}
+
+// Random walk along the edges of a grid network, sampled every
+// POINT_SPACING with a Gaussian noise of GPS_ERROR
+LineString make_trajectory(int n, int num_points) {
+  std::mt19937 rng(num_points);
+  std::normal_distribution<double> noise(0, GPS_ERROR);
+  std::uniform_int_distribution<int> turn(0, 3);
+  const int dx[] = {1, 0, -1, 0};
+  const int dy[] = {0, 1, 0, -1};
+  int col = n / 2, row = n / 2, dir = 0;
+  double offset = 0;
+  LineString geom;
+  while (geom.get_num_points() < num_points) {
+    if (offset >= GRID_SPACING) {
+      col += dx[dir];
+      row += dy[dir];
+      offset -= GRID_SPACING;
+      int next = turn(rng);
+      // Turn back at the border of the grid
+      while (col + dx[next] < 0 || col + dx[next] >= n ||
+             row + dy[next] < 0 || row + dy[next] >= n) {
+        next = (next + 1) % 4;
+      }
+      dir = next;
+    }
+    geom.add_point((col + dx[dir] * offset / GRID_SPACING) * GRID_SPACING +
+                       noise(rng),
+                   (row + dy[dir] * offset / GRID_SPACING) * GRID_SPACING +
+                       noise(rng));
+    offset += POINT_SPACING;
+  }
+  return geom;
+}
+
+// Pairs of nodes of a grid network at most three rows and columns apart
+std::vector<std::pair<NodeIndex, NodeIndex>> make_node_pairs(
+    const Network &network, int n, int num_pairs) {
+  std::mt19937 rng(n);
+  std::uniform_int_distribution<int> node(0, n - 1);
+  std::uniform_int_distribution<int> step(-3, 3);
+  std::vector<std::pair<NodeIndex, NodeIndex>> pairs;
+  while ((int) pairs.size() < num_pairs) {
+    int col = node(rng), row = node(rng);
+    int target_col = col + step(rng), target_row = row + step(rng);
+    if (target_col < 0 || target_col >= n || target_row < 0 ||
+        target_row >= n) continue;
+    pairs.push_back({network.get_node_index(row * n + col),
+                     network.get_node_index(target_row * n + target_col)});
+  }
+  return pairs;
+}
+
+/**
+ * Hardware counters of the iterations of a benchmark, read before and
+ * after its loop, so that the reads are not timed
+ */
+class BenchCounters {
+ public:
+  BenchCounters() {
+    UTIL::PerfCounters::local().read(&begin_);
+  }
+  // Report the counters per item processed, if any is available
+  void report(benchmark::State &state, double items) {
+    UTIL::PerfCounterValues end;
+    UTIL::PerfCounters::local().read(&end);
+    if (!UTIL::PerfCounters::local().is_open() || items <= 0) return;
+    UTIL::PerfCounterValues counters = end - begin_;
+    state.counters["instructions"] =
+        counters[UTIL::PERF_INSTRUCTIONS] / items;
+    state.counters["ipc"] = counters[UTIL::PERF_CYCLES] > 0 ?
+        (double) counters[UTIL::PERF_INSTRUCTIONS] /
+            counters[UTIL::PERF_CYCLES] : 0.0;
+    state.counters["cache_misses"] =
+        counters[UTIL::PERF_CACHE_MISSES] / items;
+    state.counters["branch_misses"] =
+        counters[UTIL::PERF_BRANCH_MISSES] / items;
+    state.counters["dtlb_misses"] = counters[UTIL::PERF_DTLB_MISSES] / items;
+  }
+ private:
+  UTIL::PerfCounterValues begin_;
+};
+
+} // namespace
+
+// Args: grid size
+void BM_ubodt_look_up(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  auto pairs = make_node_pairs(*grid.network, n, 1024);
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (const auto &pair : pairs) {
+      benchmark::DoNotOptimize(grid.ubodt->look_up(pair.first, pair.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+  counters.report(state, (double) state.iterations() * pairs.size());
+}
+BENCHMARK(BM_ubodt_look_up)->Arg(32)->Arg(128);
+
+// Args: grid size
+void BM_ubodt_look_sp_path(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  auto pairs = make_node_pairs(*grid.network, n, 1024);
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (const auto &pair : pairs) {
+      benchmark::DoNotOptimize(
+          grid.ubodt->look_sp_path(pair.first, pair.second));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+  counters.report(state, (double) state.iterations() * pairs.size());
+}
+BENCHMARK(BM_ubodt_look_sp_path)->Arg(32)->Arg(128);
+
+// Args: grid size, trajectory points, k, radius
+void BM_search_tr_cs_knn(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  LineString geom = make_trajectory(n, state.range(1));
+  CandidateSearchContext context;
+  BenchCounters counters;
+  for (auto _ : state) {
+    grid.network->search_tr_cs_knn(geom, state.range(2), state.range(3),
+                                   &context);
+    benchmark::DoNotOptimize(context.get_candidates().data());
+  }
+  state.SetItemsProcessed(state.iterations() * geom.get_num_points());
+  counters.report(state,
+                  (double) state.iterations() * geom.get_num_points());
+}
+BENCHMARK(BM_search_tr_cs_knn)
+    ->Args({32, 100, 8, 300})
+    ->Args({128, 100, 8, 300})
+    ->Args({128, 1000, 8, 300})
+    ->Args({128, 1000, 16, 300})
+    ->Args({128, 1000, 8, 100});
+
+// Args: points of the linestring
+void BM_linear_referencing(benchmark::State &state) {
+  LineString line = make_trajectory(1024, state.range(0));
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> coord(
+      500 * GRID_SPACING, 520 * GRID_SPACING);
+  std::vector<Point> points;
+  for (int i = 0; i < 256; ++i) {
+    points.push_back(Point(coord(rng), coord(rng)));
+  }
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (const Point &point : points) {
+      double dist, offset;
+      ALGORITHM::linear_referencing(boost::geometry::get<0>(point),
+                                    boost::geometry::get<1>(point), line,
+                                    &dist, &offset);
+      benchmark::DoNotOptimize(offset);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * points.size());
+  counters.report(state, (double) state.iterations() * points.size());
+}
+BENCHMARK(BM_linear_referencing)->Arg(4)->Arg(16)->Arg(64)->Arg(256);
+
+// Args: grid size, trajectory points, k, radius
+void BM_fmm_update_layer(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  LineString geom = make_trajectory(n, state.range(1));
+  Traj_Candidates tc = grid.network->search_tr_cs_knn(
+      geom, state.range(2), state.range(3));
+  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(geom);
+  BenchFastMapMatch model(*grid.network, *grid.graph, grid.ubodt);
+  TransitionGraph tg(tc, GPS_ERROR);
+  std::vector<TGLayer> &layers = tg.get_layers();
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (int i = 0; i + 1 < (int) layers.size(); ++i) {
+      model.update_layer(i, &layers[i], &layers[i + 1], eu_dists[i]);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * layers.size());
+  counters.report(state, (double) state.iterations() * layers.size());
+}
+BENCHMARK(BM_fmm_update_layer)
+    ->Args({32, 100, 8, 300})
+    ->Args({128, 1000, 8, 300})
+    ->Args({128, 1000, 16, 300})
+    ->Args({128, 1000, 8, 100});
+
+// Args: grid size, trajectories interleaved, 0 for match_traj_batch,
+// 1 to advance them in lockstep
+void BM_fmm_match_interleaved(benchmark::State &state) {
+  int n = state.range(0);
+  int group_size = state.range(1);
+  bool lockstep = state.range(2) > 0;
+  GridNetwork &grid = get_grid_network(n);
+  // Walks of different lengths, which are seeded differently
+  std::vector<Trajectory> trajs;
+  for (int i = 0; i < 64; ++i) {
+    trajs.push_back(Trajectory{i, make_trajectory(n, 100 + i), {}});
+  }
+  FastMapMatch model(*grid.network, *grid.graph, grid.ubodt);
+  FastMapMatchConfig config(8, 300, GPS_ERROR);
+  BenchCounters counters;
+  for (auto _ : state) {
+    std::vector<MatchResult> results = group_size == 0 ?
+        model.match_traj_batch(trajs, config, 1) : lockstep ?
+        model.match_traj_lockstep(trajs, config, group_size, 1) :
+        model.match_traj_interleaved(trajs, config, group_size, 1);
+    benchmark::DoNotOptimize(results.data());
+  }
+  state.SetItemsProcessed(state.iterations() * trajs.size());
+  counters.report(state, (double) state.iterations() * trajs.size());
+}
+BENCHMARK(BM_fmm_match_interleaved)
+    ->Args({128, 0, 0})
+    ->Args({128, 4, 0})
+    ->Args({128, 8, 0})
+    ->Args({128, 16, 0})
+    ->Args({128, 8, 1})
+    ->Args({128, 16, 1});
+
+// Args: grid size, trajectory points, k, delta
+void BM_stmatch_shortest_path_upperbound(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  LineString geom = make_trajectory(n, state.range(1));
+  Traj_Candidates tc = grid.network->search_tr_cs_knn(
+      geom, state.range(2), 300);
+  DummyGraph dg(tc);
+  CompositeGraph cg(*grid.graph, dg);
+  BenchSTMATCH model(*grid.network, *grid.graph);
+  double delta = state.range(3);
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (int i = 0; i + 1 < (int) tc.size(); ++i) {
+      std::vector<NodeIndex> targets;
+      for (const Candidate &c : tc[i + 1]) targets.push_back(c.index);
+      benchmark::DoNotOptimize(model.shortest_path_upperbound(
+          i, cg, tc[i][0].index, targets, delta));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * tc.size());
+  counters.report(state, (double) state.iterations() * tc.size());
+}
+BENCHMARK(BM_stmatch_shortest_path_upperbound)
+    ->Args({32, 100, 8, 300})
+    ->Args({128, 1000, 8, 300})
+    ->Args({128, 1000, 16, 300})
+    ->Args({128, 1000, 8, 1000});
+
+// Args: grid size, delta
+void BM_single_source_upperbound_dijkstra(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  auto pairs = make_node_pairs(*grid.network, n, 64);
+  SearchWorkspace workspace;
+  BenchCounters counters;
+  for (auto _ : state) {
+    for (const auto &pair : pairs) {
+      grid.graph->single_source_upperbound_dijkstra(
+          pair.first, state.range(1), &workspace);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+  counters.report(state, (double) state.iterations() * pairs.size());
+}
+BENCHMARK(BM_single_source_upperbound_dijkstra)
+    ->Args({32, 500})
+    ->Args({128, 500})
+    ->Args({128, 2000});
+
+// Args: grid size, delta. The maps of the routing are built and dropped
+// by all the threads, whose nodes come from the pools of the threads
+// unless built with POOL_ALLOCATOR off, and from MALLOC if linked.
+void BM_single_source_upperbound_maps(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  auto pairs = make_node_pairs(*grid.network, n, 64);
+  int num_pairs = pairs.size();
+  for (auto _ : state) {
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_pairs; ++i) {
+      PredecessorMap pmap;
+      DistanceMap dmap;
+      PathEndMap emap;
+      grid.graph->single_source_upperbound_dijkstra(
+          pairs[i].first, state.range(1), &pmap, &dmap, &emap);
+      benchmark::DoNotOptimize(pmap.size());
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+BENCHMARK(BM_single_source_upperbound_maps)
+    ->Args({128, 500})
+    ->Args({128, 2000})
+    ->UseRealTime();
+
+// Args: grid size, trajectory points
+void BM_complete_path_to_geometry(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  Trajectory traj{0, make_trajectory(n, state.range(1)), {}};
+  FastMapMatch model(*grid.network, *grid.graph, grid.ubodt);
+  MatchResult result = model.match_traj(traj, FastMapMatchConfig(8, 300,
+                                                                 GPS_ERROR));
+  BenchCounters counters;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        grid.network->complete_path_to_geometry(traj.geom, result.cpath));
+  }
+  state.SetItemsProcessed(state.iterations() * result.cpath.size());
+  counters.report(state,
+                  (double) state.iterations() * result.cpath.size());
+}
+BENCHMARK(BM_complete_path_to_geometry)
+    ->Args({32, 100})
+    ->Args({128, 1000});
+
+// Args: grid size, trajectory points
+void BM_csv_write_result(benchmark::State &state) {
+  int n = state.range(0);
+  GridNetwork &grid = get_grid_network(n);
+  Trajectory traj{0, make_trajectory(n, state.range(1)), {}};
+  FastMapMatch model(*grid.network, *grid.graph, grid.ubodt);
+  MatchResult result = model.match_traj(traj, FastMapMatchConfig(8, 300,
+                                                                 GPS_ERROR));
+  CONFIG::OutputConfig config;
+  config.write_opath = true;
+  config.write_offset = true;
+  config.write_error = true;
+  IO::CSVMatchResultWriter writer("bench_result.csv", config);
+  BenchCounters counters;
+  for (auto _ : state) {
+    writer.write_result(result);
+  }
+  state.SetItemsProcessed(state.iterations());
+  counters.report(state, (double) state.iterations());
+}
+BENCHMARK(BM_csv_write_result)
+    ->Args({32, 100})
+    ->Args({128, 1000});
+
+BENCHMARK_MAIN();
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+"""
+End-to-end throughput benchmark of fmm and stmatch.
+
+Synthetic trajectories are generated with gps_synth and a UBODT with
+ubodt_gen unless they are given. Each program matches them with several
+thread counts. The points matched per second excluding the input, the
+scaling efficiency relative to the first thread count and the maximum
+resident memory are reported.
+
+Example:
+    python3 throughput.py --bin ../build --network edges.shp \\
+        --threads 1,2,4,8 --trajectories 2000
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import time
+
+SPEED_PATTERN = re.compile(
+    r"Point match speed \(excluding input\): ([0-9.eE+-]+)")
+
+
+def run(command, threads=None):
+    """Run a program, returning its log, seconds and maximum RSS in MB"""
+    env = dict(os.environ)
+    if threads is not None:
+        env["OMP_NUM_THREADS"] = str(threads)
+    begin = time.time()
+    process = subprocess.Popen(command, env=env, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT,
+                               universal_newlines=True)
+    log = process.stdout.read()
+    _, status, usage = os.wait4(process.pid, 0)
+    seconds = time.time() - begin
+    if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+        sys.stderr.write(log)
+        raise RuntimeError("{} failed".format(" ".join(command)))
+    # ru_maxrss is in KB on Linux
+    return log, seconds, usage.ru_maxrss / 1024.0
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="End-to-end throughput benchmark of fmm and stmatch")
+    parser.add_argument("--bin", default=".",
+                        help="directory of the fmm programs")
+    parser.add_argument("--network", required=True, help="network file")
+    parser.add_argument("--ubodt", default="",
+                        help="UBODT file, generated if not given")
+    parser.add_argument("--delta", default="3000",
+                        help="delta of the UBODT generated")
+    parser.add_argument("--gps", default="",
+                        help="GPS file, generated with gps_synth if not "
+                             "given")
+    parser.add_argument("--trajectories", default="1000",
+                        help="number of trajectories generated")
+    parser.add_argument("--synth_args", default="",
+                        help="extra arguments of gps_synth, e.g. "
+                             "\"--interval 5 --error 20\"")
+    parser.add_argument("--programs", default="fmm,stmatch",
+                        help="programs benchmarked")
+    parser.add_argument("--threads", default="1,2,4",
+                        help="thread counts")
+    parser.add_argument("--match_args", default="-k 8 -r 300 -e 50",
+                        help="extra arguments of the matching programs")
+    parser.add_argument("--workdir", default="throughput_data",
+                        help="directory of the generated files")
+    args = parser.parse_args()
+
+    if not os.path.isdir(args.workdir):
+        os.makedirs(args.workdir)
+    gps = args.gps
+    if not gps:
+        gps = os.path.join(args.workdir, "synthetic.csv")
+        run([os.path.join(args.bin, "gps_synth"), "--network", args.network,
+             "--output", gps, "--trajectories", args.trajectories] +
+            args.synth_args.split())
+    ubodt = args.ubodt
+    programs = args.programs.split(",")
+    if not ubodt and "fmm" in programs:
+        ubodt = os.path.join(args.workdir, "ubodt.bin")
+        run([os.path.join(args.bin, "ubodt_gen"), "--network", args.network,
+             "--output", ubodt, "--delta", args.delta, "--use_omp"])
+
+    print("{:<10}{:>8}{:>10}{:>14}{:>12}{:>12}".format(
+        "program", "threads", "seconds", "points/s", "efficiency",
+        "max RSS MB"))
+    for program in programs:
+        command = [os.path.join(args.bin, program), "--network",
+                   args.network, "--gps", args.gps or gps,
+                   "--output", os.path.join(args.workdir, "mr.txt"),
+                   "--use_omp"] + args.match_args.split()
+        if program == "fmm":
+            command += ["--ubodt", ubodt]
+        base_speed = None
+        for threads in [int(t) for t in args.threads.split(",")]:
+            log, seconds, rss = run(command, threads)
+            match = SPEED_PATTERN.search(log)
+            speed = float(match.group(1)) if match else float("nan")
+            if base_speed is None:
+                base_speed = speed / threads
+            efficiency = speed / (threads * base_speed)
+            print("{:<10}{:>8}{:>10.1f}{:>14.0f}{:>12.2f}{:>12.0f}".format(
+                program, threads, seconds, speed, efficiency, rss))
+            sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    main()
@@ -1,15 +1,44 @@
-%module fmm
+%module(threads="1") fmm
 %include "std_string.i"
 %include "std_vector.i"
 %include "std_shared_ptr.i"
+%include "exception.i"
 %shared_ptr(FMM::MM::UBODT)
+// Only the counters of the look up caches are read from Python
+%ignore FMM::MM::UBODTLookupCache;
+
+// Invalid inputs such as a malformed wkt raise ValueError
+%exception {
+  try {
+    $action
+  } catch (const std::exception &e) {
+    SWIG_exception(SWIG_ValueError, e.what());
+  }
+}
+
+// The batches are matched with the GIL released, while the other calls
+// keep it as they may use Python objects
+%nothread;
+%thread FMM::MM::FastMapMatch::match_wkt_batch;
+%thread FMM::MM::FastMapMatch::match_traj_batch;
+%thread FMM::MM::FastMapMatch::match_traj_interleaved;
+%thread FMM::MM::FastMapMatch::match_traj_lockstep;
+%thread FMM::MM::STMATCH::match_wkt_batch;
+%thread FMM::MM::STMATCH::match_traj_batch;
+%thread FMM::MM::FastMapMatch::match_coords;
+%thread FMM::MM::STMATCH::match_coords;
+%thread FMM::NETWORK::NetworkGraph::shortest_paths;
+%thread FMM::NETWORK::Network::snap_nodes;
+%thread FMM::MM::UBODT::look_sp_paths;
 
 
 
 %{
 /* Put header files here or function declarations like below */
 #include "core/geometry.hpp"
+#include "core/gps.hpp"
 #include "network/type.hpp"
+#include "network/spatial_index.hpp"
 #include "network/network.hpp"
 #include "network/network_graph.hpp"
 #include "python/pyfmm.hpp"
@@ -23,21 +52,167 @@ using namespace FMM::NETWORK;
 using namespace FMM::MM;
 %}
 
+// Contiguous float64 arrays are read through the buffer protocol without
+// a copy, and the arrays of a result are returned as NumPy arrays
+%{
+namespace {
+
+bool get_double_buffer(PyObject *obj, int ndim, Py_buffer *view) {
+  if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+    return false;
+  }
+  if (view->ndim != ndim || view->itemsize != sizeof(double) ||
+      view->format == nullptr || std::string(view->format) != "d" ||
+      (ndim == 2 && view->shape[1] != 2)) {
+    PyBuffer_Release(view);
+    PyErr_SetString(PyExc_ValueError, ndim == 2 ?
+                    "coords should be a contiguous float64 (N,2) array" :
+                    "timestamps should be a contiguous float64 array");
+    return false;
+  }
+  return true;
+}
+
+// Node indices are read from contiguous int32 or uint32 arrays
+bool get_index_buffer(PyObject *obj, Py_buffer *view) {
+  if (PyObject_GetBuffer(obj, view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT) != 0) {
+    return false;
+  }
+  if (view->ndim != 1 || view->itemsize != sizeof(unsigned int) ||
+      view->format == nullptr ||
+      (std::string(view->format) != "i" && std::string(view->format) != "I")) {
+    PyBuffer_Release(view);
+    PyErr_SetString(PyExc_ValueError,
+                    "nodes should be a contiguous int32 or uint32 array");
+    return false;
+  }
+  return true;
+}
+
+// Set an item of a dict to a NumPy array wrapping a copy of the data
+template <typename T>
+bool set_array(PyObject *dict, const char *key, const std::vector<T> &data,
+               const char *dtype, int columns, PyObject *frombuffer) {
+  PyObject *bytes = PyBytes_FromStringAndSize(
+      (const char *) data.data(), data.size() * sizeof(T));
+  if (bytes == nullptr) return false;
+  PyObject *array = PyObject_CallFunction(frombuffer, (char *) "Os", bytes,
+                                          dtype);
+  Py_DECREF(bytes);
+  if (array == nullptr) return false;
+  if (columns > 1) {
+    PyObject *shaped = PyObject_CallMethod(array, (char *) "reshape",
+                                           (char *) "(ii)", -1, columns);
+    Py_DECREF(array);
+    if (shaped == nullptr) return false;
+    array = shaped;
+  }
+  int status = PyDict_SetItemString(dict, key, array);
+  Py_DECREF(array);
+  return status == 0;
+}
+
+}
+%}
+
+%typemap(in) (const double *coords, int num_points) (Py_buffer view) {
+  if (!get_double_buffer($input, 2, &view)) SWIG_fail;
+  $1 = (double *) view.buf;
+  $2 = (int) view.shape[0];
+}
+%typemap(freearg) (const double *coords, int num_points) {
+  PyBuffer_Release(&view$argnum);
+}
+%typemap(in) (const double *timestamps, int num_timestamps)
+    (Py_buffer view, bool has_view = false) {
+  if ($input == Py_None) {
+    $1 = nullptr;
+    $2 = 0;
+  } else {
+    if (!get_double_buffer($input, 1, &view)) SWIG_fail;
+    has_view = true;
+    $1 = (double *) view.buf;
+    $2 = (int) view.shape[0];
+  }
+}
+%typemap(freearg) (const double *timestamps, int num_timestamps) {
+  if (has_view$argnum) PyBuffer_Release(&view$argnum);
+}
+%typemap(in) (const unsigned int *sources, int num_sources) (Py_buffer view) {
+  if (!get_index_buffer($input, &view)) SWIG_fail;
+  $1 = (unsigned int *) view.buf;
+  $2 = (int) view.shape[0];
+}
+%typemap(freearg) (const unsigned int *sources, int num_sources) {
+  PyBuffer_Release(&view$argnum);
+}
+%apply (const unsigned int *sources, int num_sources) {
+  (const unsigned int *targets, int num_targets)
+};
+%typemap(out) FMM::PYTHON::PyPathArrays {
+  PyObject *numpy = PyImport_ImportModule("numpy");
+  if (numpy == nullptr) SWIG_fail;
+  PyObject *frombuffer = PyObject_GetAttrString(numpy, "frombuffer");
+  Py_DECREF(numpy);
+  if (frombuffer == nullptr) SWIG_fail;
+  $result = PyDict_New();
+  bool success = $result != nullptr &&
+      set_array($result, "distances", $1.distances, "float64", 1,
+                frombuffer) &&
+      set_array($result, "offsets", $1.offsets, "int32", 1, frombuffer) &&
+      set_array($result, "edges", $1.edges, "int32", 1, frombuffer);
+  Py_DECREF(frombuffer);
+  if (!success) {
+    Py_XDECREF($result);
+    SWIG_fail;
+  }
+}
+%typemap(out) FMM::PYTHON::PyMatchArrays {
+  PyObject *numpy = PyImport_ImportModule("numpy");
+  if (numpy == nullptr) SWIG_fail;
+  PyObject *frombuffer = PyObject_GetAttrString(numpy, "frombuffer");
+  Py_DECREF(numpy);
+  if (frombuffer == nullptr) SWIG_fail;
+  PyObject *id = PyLong_FromLong($1.id);
+  $result = PyDict_New();
+  bool success = id != nullptr && $result != nullptr &&
+      PyDict_SetItemString($result, "id", id) == 0 &&
+      set_array($result, "opath", $1.opath, "int32", 1, frombuffer) &&
+      set_array($result, "cpath", $1.cpath, "int32", 1, frombuffer) &&
+      set_array($result, "indices", $1.indices, "int32", 1, frombuffer) &&
+      set_array($result, "offsets", $1.offsets, "float64", 1, frombuffer) &&
+      set_array($result, "mgeom", $1.mgeom, "float64", 2, frombuffer) &&
+      set_array($result, "pgeom", $1.pgeom, "float64", 2, frombuffer);
+  Py_DECREF(frombuffer);
+  Py_XDECREF(id);
+  if (!success) {
+    Py_XDECREF($result);
+    SWIG_fail;
+  }
+}
+
 %template(IntVector) std::vector<int>;
 %template(UnsignedIntVector) std::vector<unsigned int>;
 %template(DoubleVector) std::vector<double>;
 %template(PyCandidateVector) std::vector<FMM::PYTHON::PyCandidate>;
+%template(StringVector) std::vector<std::string>;
+%template(TrajectoryVector) std::vector<FMM::CORE::Trajectory>;
+%template(MatchResultVector) std::vector<FMM::MM::MatchResult>;
+%template(PyMatchResultVector) std::vector<FMM::PYTHON::PyMatchResult>;
 // %template(DoubleVVector) vector<vector<double> >;
 // %template(DoubleVVVector) vector<vector<vector<double> > >;
 // %template(IntSet) set<int>;
 
 
 %include "core/geometry.hpp"
+%include "core/gps.hpp"
 %include "mm/mm_type.hpp"
 %include "network/type.hpp"
+%include "network/spatial_index.hpp"
 %include "network/network.hpp"
 %include "python/pyfmm.hpp"
 %include "mm/fmm/ubodt.hpp"
 %include "network/network_graph.hpp"
+%include "mm/fmm/ubodt_lookup_cache.hpp"
 %include "mm/fmm/fmm_algorithm.hpp"
 %include "mm/stmatch/stmatch_algorithm.hpp"
@@ -1,3 +1,4 @@
+import numpy
 from fmm import Network,NetworkGraph,STMATCH,STMATCHConfig
 network = Network("../example/data/edges.shp")
 graph = NetworkGraph(network)
@@ -14,3 +15,22 @@ result = model.match_wkt(wkt,config)
 print type(result)
 print "Opath ",list(result.opath)
 print "Cpath ",list(result.cpath)
+wkts = [wkt] * 4
+results = model.match_wkt_batch(wkts,config,2)
+print "Batch ",[list(r.cpath) for r in results]
+coords = numpy.array([[0.200812146892656,2.14088983050848],
+                     [1.44262005649717,2.14879943502825],
+                     [3.06408898305084,2.16066384180791],
+                     [3.06408898305084,2.7103813559322],
+                     [3.70872175141242,2.97930790960452],
+                     [4.11606638418078,2.62337570621469]])
+arrays = model.match_coords(coords,None,config)
+print "Cpath ",arrays["cpath"]
+print "Mgeom ",arrays["mgeom"].shape
+sources = numpy.array([0,1,2],dtype=numpy.int32)
+targets = numpy.array([3,3,2],dtype=numpy.int32)
+paths = graph.shortest_paths(sources,targets)
+print "Distances ",paths["distances"]
+print "Paths ",numpy.split(paths["edges"],paths["offsets"][1:-1])
+nodes = network.snap_nodes(coords,1.0)
+print "Nodes ",list(nodes)
@@ -1,27 +1,348 @@
 #include "algorithm/geom_algorithm.hpp"
+#include "algorithm/projection_kernel.hpp"
+#include "algorithm/geometry_kernel.hpp"
 #include "util/debug.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 
+namespace FMM {
+namespace ALGORITHM {
+namespace {
+static_assert(sizeof(FMM::CORE::Point) == 2 * sizeof(double),
+              "Points of a linestring are read as interleaved coordinates");
+
+// Coordinates of the points of a linestring as x0,y0,x1,y1...
+inline const double *point_coords(const FMM::CORE::LineString &linestring) {
+  return reinterpret_cast<const double *>(
+      linestring.get_geometry_const().data());
+}
+
+// Length of the segment from point i to i+1
+inline double segment_length(const FMM::CORE::LineString &linestring, int i) {
+  double x1 = linestring.get_x(i);
+  double y1 = linestring.get_y(i);
+  double x2 = linestring.get_x(i + 1);
+  double y2 = linestring.get_y(i + 1);
+  return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+}
+
+// A view looks up the precomputed cumulative lengths if any
+inline double segment_length(const FMM::CORE::LineStringView &linestring,
+                             int i) {
+  const double *cumlen = linestring.get_cumlen_data();
+  if (cumlen != nullptr) return cumlen[i + 1] - cumlen[i];
+  double x1 = linestring.get_x(i);
+  double y1 = linestring.get_y(i);
+  double x2 = linestring.get_x(i + 1);
+  double y2 = linestring.get_y(i + 1);
+  return std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+}
+
+// Implementations shared by the overloads of a linestring and a
+// linestring view
+template <typename Line>
+void boundingbox_geometry_impl(
+    const Line &linestring,
+    double *x1, double *y1,
+    double *x2, double *y2) {
+  int Npoints = linestring.get_num_points();
+  *x1 = DBL_MAX;
+  *y1 = DBL_MAX;
+  *x2 = -DBL_MAX;
+  *y2 = -DBL_MAX;
+  double x, y;
+  for (int i = 0; i < Npoints; ++i) {
+    x = linestring.get_x(i);
+    y = linestring.get_y(i);
+    if (x < *x1) *x1 = x;
+    if (y < *y1) *y1 = y;
+    if (x > *x2) *x2 = x;
+    if (y > *y2) *y2 = y;
+  }
+}
+
+template <typename Line>
+void linear_referencing_impl(
+    double px, double py, const Line &linestring,
+    double *result_dist, double *result_offset) {
+  int Npoints = linestring.get_num_points();
+  double min_dist = DBL_MAX;
+  double final_offset = DBL_MAX;
+  double length_parsed = 0;
+  int i = 0;
+  // Iterating to check p(i) == p(i+2)
+  // int seg_idx=0;
+  while (i < Npoints - 1) {
+    double x1 = linestring.get_x(i);
+    double y1 = linestring.get_y(i);
+    double x2 = linestring.get_x(i + 1);
+    double y2 = linestring.get_y(i + 1);
+    double temp_min_dist;
+    double temp_min_offset;
+    closest_point_on_segment(px, py, x1, y1, x2, y2,
+                             &temp_min_dist, &temp_min_offset);
+    if (temp_min_dist < min_dist) {
+      min_dist = temp_min_dist;
+      final_offset = length_parsed + temp_min_offset;
+    }
+    length_parsed += segment_length(linestring, i);
+    ++i;
+  }
+  *result_dist = min_dist;
+  *result_offset = final_offset;
+} // linear_referencing
+
+template <typename Line>
+void linear_referencing_impl(
+    double px, double py, const Line &linestring,
+    double *result_dist, double *result_offset,
+    double *proj_x, double *proj_y) {
+  int Npoints = linestring.get_num_points();
+  double min_dist = DBL_MAX;
+  double temp_x = 0, temp_y = 0;
+  double final_offset = DBL_MAX;
+  double length_parsed = 0;
+  int i = 0;
+  // Iterating to check p(i) == p(i+2)
+  // int seg_idx=0;
+  while (i < Npoints - 1) {
+    double x1 = linestring.get_x(i);
+    double y1 = linestring.get_y(i);
+    double x2 = linestring.get_x(i + 1);
+    double y2 = linestring.get_y(i + 1);
+    double temp_min_dist;
+    double temp_min_offset;
+    closest_point_on_segment(px, py, x1, y1, x2, y2,
+                             &temp_min_dist, &temp_min_offset,
+                             &temp_x, &temp_y);
+    if (temp_min_dist < min_dist) {
+      min_dist = temp_min_dist;
+      final_offset = length_parsed + temp_min_offset;
+      *proj_x = temp_x;
+      *proj_y = temp_y;
+    }
+    length_parsed += segment_length(linestring, i);
+    ++i;
+  }
+  *result_dist = min_dist;
+  *result_offset = final_offset;
+} // linear_referencing
+
+// Linear referencing of a view, where the closest segment is found by
+// the vectorized kernel and only that segment is projected exactly.
+void linear_referencing_view(
+    double px, double py, const FMM::CORE::LineStringView &linestring,
+    double *result_dist, double *result_offset,
+    double *proj_x, double *proj_y) {
+  int Npoints = linestring.get_num_points();
+  if (Npoints < 2) {
+    linear_referencing_impl(px, py, linestring, result_dist, result_offset,
+                            proj_x, proj_y);
+    return;
+  }
+  const double *xs = linestring.get_x_data();
+  const double *ys = linestring.get_y_data();
+  double min_dist2;
+  int seg = closest_segment(px, py, xs, ys, Npoints, &min_dist2);
+  const double *cumlen = linestring.get_cumlen_data();
+  double length_parsed = 0;
+  if (cumlen != nullptr) {
+    length_parsed = cumlen[seg];
+  } else {
+    for (int i = 0; i < seg; ++i) {
+      length_parsed += std::sqrt((xs[i + 1] - xs[i]) * (xs[i + 1] - xs[i]) +
+                                 (ys[i + 1] - ys[i]) * (ys[i + 1] - ys[i]));
+    }
+  }
+  double seg_offset;
+  closest_point_on_segment(px, py, xs[seg], ys[seg], xs[seg + 1], ys[seg + 1],
+                           result_dist, &seg_offset, proj_x, proj_y);
+  *result_offset = length_parsed + seg_offset;
+} // linear_referencing_view
+
+template <typename Line>
+void locate_point_by_offset_impl(
+    const Line &linestring, double offset,
+    double *x, double *y) {
+  int Npoints = linestring.get_num_points();
+  if (offset <= 0.0) {
+    *x = linestring.get_x(0);
+    *y = linestring.get_y(0);
+    return;
+  }
+  double L_processed = 0;       // length parsed
+  int i = 0;
+  double px = 0;
+  double py = 0;
+  bool found = false;
+  // Find the idx of the point to be exported close to p
+  while (i < Npoints - 1) {
+    double x1 = linestring.get_x(i);
+    double y1 = linestring.get_y(i);
+    double x2 = linestring.get_x(i + 1);
+    double y2 = linestring.get_y(i + 1);
+    double deltaL = segment_length(linestring, i);
+    double ratio = (offset - L_processed) / deltaL;
+    if (offset >= L_processed && offset <= L_processed + deltaL) {
+      px = x1 + ratio * (x2 - x1);
+      py = y1 + ratio * (y2 - y1);
+      found = true;
+      break;
+    }
+    ++i;
+    L_processed += deltaL;
+  }
+  if (found) {
+    *x = px;
+    *y = py;
+  } else {
+    *x = linestring.get_x(Npoints - 1);
+    *y = linestring.get_y(Npoints - 1);
+  }
+} // locate_point_by_offset
+
+// A view with cumulative lengths finds the segment of the offset by a
+// binary search, instead of summing the segments before it
+void locate_point_by_offset_view(
+    const FMM::CORE::LineStringView &linestring, double offset,
+    double *x, double *y) {
+  int Npoints = linestring.get_num_points();
+  const double *cumlen = linestring.get_cumlen_data();
+  if (cumlen == nullptr || Npoints < 2 || offset <= 0.0) {
+    locate_point_by_offset_impl(linestring, offset, x, y);
+    return;
+  }
+  // The segment starting at or before the offset and ending after it,
+  // which skips the segments of zero length
+  int i = std::upper_bound(cumlen, cumlen + Npoints, offset) - cumlen - 1;
+  if (i >= Npoints - 1) {
+    *x = linestring.get_x(Npoints - 1);
+    *y = linestring.get_y(Npoints - 1);
+    return;
+  }
+  double ratio = (offset - cumlen[i]) / (cumlen[i + 1] - cumlen[i]);
+  *x = linestring.get_x(i) +
+      ratio * (linestring.get_x(i + 1) - linestring.get_x(i));
+  *y = linestring.get_y(i) +
+      ratio * (linestring.get_y(i + 1) - linestring.get_y(i));
+} // locate_point_by_offset_view
+
+// Pass the points of a line cut at two offsets to add_point in order
+template <typename Line, typename AddPoint>
+void cutoffseg_points(const Line &linestring, double offset1, double offset2,
+                      AddPoint add_point) {
+  SPDLOG_TRACE("Offset1 {} Offset2 {}", offset1, offset2);
+  int Npoints = linestring.get_num_points();
+  if (Npoints == 2) {
+    // A single segment
+    double x1 = linestring.get_x(0);
+    double y1 = linestring.get_y(0);
+    double x2 = linestring.get_x(1);
+    double y2 = linestring.get_y(1);
+    double L = segment_length(linestring, 0);
+    double ratio1 = offset1 / L;
+    double new_x1 = x1 + ratio1 * (x2 - x1);
+    double new_y1 = y1 + ratio1 * (y2 - y1);
+    double ratio2 = offset2 / L;
+    double new_x2 = x1 + ratio2 * (x2 - x1);
+    double new_y2 = y1 + ratio2 * (y2 - y1);
+    add_point(new_x1, new_y1);
+    add_point(new_x2, new_y2);
+  } else {
+    // Multiple segments
+    double l1 = 0;
+    double l2 = 0;
+    int i = 0;
+    while (i < Npoints - 1) {
+      double x1 = linestring.get_x(i);
+      double y1 = linestring.get_y(i);
+      double x2 = linestring.get_x(i + 1);
+      double y2 = linestring.get_y(i + 1);
+      double deltaL = segment_length(linestring, i);
+      l2 = l1 + deltaL;
+      // Insert p1
+      SPDLOG_TRACE("  L1 {} L2 {} ", l1, l2);
+      if (l1 >= offset1 && l1 <= offset2) {
+        add_point(x1, y1);
+        SPDLOG_TRACE("  add p1 {} {}", x1, y1);
+      }
+
+      // Insert p between p1 and p2
+      if (offset1 > l1 && offset1 < l2) {
+        double ratio1 = (offset1 - l1) / deltaL;
+        double px = x1 + ratio1 * (x2 - x1);
+        double py = y1 + ratio1 * (y2 - y1);
+        add_point(px, py);
+        SPDLOG_TRACE("  add p {} {} between p1 p2", px, py);
+      }
+
+      if (offset2 > l1 && offset2 < l2) {
+        double ratio2 = (offset2 - l1) / deltaL;
+        double px = x1 + ratio2 * (x2 - x1);
+        double py = y1 + ratio2 * (y2 - y1);
+        add_point(px, py);
+        SPDLOG_TRACE("  add p {} {} between p1 p2", px, py);
+      }
+
+      // last point
+      if (i == Npoints - 2 && offset2 >= l2) {
+        add_point(x2, y2);
+        SPDLOG_TRACE("  add p2 {} {} for last point", x2, y2);
+      }
+
+      l1 = l2;
+      ++i;
+    }
+  }
+} // cutoffseg_points
+
+template <typename Line>
+FMM::CORE::LineString cutoffseg_unique_impl(
+    const Line &linestring,
+    double offset1, double offset2) {
+  FMM::CORE::LineString cutoffline;
+  cutoffseg_points(linestring, offset1, offset2,
+                   [&cutoffline](double x, double y) {
+                     cutoffline.add_point(x, y);
+                   });
+  return cutoffline;
+} //cutoffseg_twoparameters
+
+template <typename Line>
+FMM::CORE::LineString cutoffseg_impl(
+    const Line &linestring,
+    double offset, int mode) {
+  double L = linestring.get_length();
+  double offset1, offset2;
+  if (mode == 0) {
+    offset1 = offset;
+    offset2 = L;
+  } else {
+    offset1 = 0;
+    offset2 = offset;
+  }
+  return cutoffseg_unique_impl(linestring, offset1, offset2);
+}
+} // namespace
+} // ALGORITHM
+} // FMM
+
 std::vector<double> FMM::ALGORITHM::cal_eu_dist(
     const FMM::CORE::LineString &trajectory) {
-  int N = trajectory.get_num_points();
-  std::vector<double> lengths(N - 1);
-  double x0 = trajectory.get_x(0);
-  double y0 = trajectory.get_y(0);
-  for (int i = 1; i < N; ++i) {
-    double x1 = trajectory.get_x(i);
-    double y1 = trajectory.get_y(i);
-    double dx = x1 - x0;
-    double dy = y1 - y0;
-    lengths[i - 1] = sqrt(dx * dx + dy * dy);
-    x0 = x1;
-    y0 = y1;
-  }
+  std::vector<double> lengths;
+  cal_eu_dist(trajectory, &lengths);
   return lengths;
 }
 
+void FMM::ALGORITHM::cal_eu_dist(const FMM::CORE::LineString &trajectory,
+                                 std::vector<double> *lengths) {
+  int N = trajectory.get_num_points();
+  lengths->resize(N > 0 ? N - 1 : 0);
+  point_segment_lengths(point_coords(trajectory), N, lengths->data());
+}
+
 void FMM::ALGORITHM::append_segs_to_line(
     FMM::CORE::LineString *line, const FMM::CORE::LineString &segs,
     int offset) {
@@ -149,22 +470,42 @@ FMM::CORE::LineString FMM::ALGORITHM::interpolate_line_kpoints(
 }
 
 void FMM::ALGORITHM::boundingbox_geometry(
-    const FMM::CORE::LineString &linestring, double *x1, double *y1,
+    const FMM::CORE::LineString &linestring,
+    double *x1, double *y1,
     double *x2, double *y2) {
-  int Npoints = linestring.get_num_points();
-  *x1 = DBL_MAX;
-  *y1 = DBL_MAX;
-  *x2 = DBL_MIN;
-  *y2 = DBL_MIN;
-  double x, y;
-  for (int i = 0; i < Npoints; ++i) {
-    x = linestring.get_x(i);
-    y = linestring.get_y(i);
-    if (x < *x1) *x1 = x;
-    if (y < *y1) *y1 = y;
-    if (x > *x2) *x2 = x;
-    if (y > *y2) *y2 = y;
+  boundingbox_geometry_impl(linestring, x1, y1, x2, y2);
+}
+
+void FMM::ALGORITHM::boundingbox_geometry(
+    const FMM::CORE::LineStringView &linestring,
+    double *x1, double *y1,
+    double *x2, double *y2) {
+  if (linestring.get_num_points() == 0) {
+    boundingbox_geometry_impl(linestring, x1, y1, x2, y2);
+    return;
   }
+  bounding_box(linestring.get_x_data(), linestring.get_y_data(),
+               linestring.get_num_points(), x1, y1, x2, y2);
+}
+
+unsigned long long FMM::ALGORITHM::hilbert_index(unsigned int x,
+                                                unsigned int y) {
+  const unsigned int n = 1u << 16;
+  unsigned long long d = 0;
+  for (unsigned int s = n / 2; s > 0; s /= 2) {
+    unsigned int rx = (x & s) > 0;
+    unsigned int ry = (y & s) > 0;
+    d += (unsigned long long) s * s * ((3 * rx) ^ ry);
+    // Rotate the quadrant
+    if (ry == 0) {
+      if (rx == 1) {
+        x = n - 1 - x;
+        y = n - 1 - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return d;
 }
 
 std::vector<double> FMM::ALGORITHM::calc_length_to_end_vec(
@@ -172,17 +513,7 @@ std::vector<double> FMM::ALGORITHM::calc_length_to_end_vec(
   int N = geom.get_num_points();
   if (N < 2) return std::vector<double>();
   std::vector<double> result(N - 1);
-  double x0 = geom.get_x(0);
-  double y0 = geom.get_y(0);
-  for (int i = 1; i < N; ++i) {
-    double x1 = geom.get_x(i);
-    double y1 = geom.get_y(i);
-    double dx = x1 - x0;
-    double dy = y1 - y0;
-    result[i - 1] = sqrt(dx * dx + dy * dy);
-    x0 = x1;
-    y0 = y1;
-  }
+  point_segment_lengths(point_coords(geom), N, result.data());
   double temp = 0;
   for (int i = N - 2; i >= 0; --i) {
     result[i] = temp + result[i];
@@ -191,6 +522,24 @@ std::vector<double> FMM::ALGORITHM::calc_length_to_end_vec(
   return result;
 }
 
+std::vector<double> FMM::ALGORITHM::calc_length_to_end_vec(
+    const FMM::CORE::LineStringView &geom) {
+  int N = geom.get_num_points();
+  if (N < 2) return std::vector<double>();
+  std::vector<double> result(N - 1);
+  if (geom.get_cumlen_data() == nullptr) {
+    segment_lengths(geom.get_x_data(), geom.get_y_data(), N, result.data());
+  } else {
+    for (int i = 0; i < N - 1; ++i) result[i] = segment_length(geom, i);
+  }
+  double temp = 0;
+  for (int i = N - 2; i >= 0; --i) {
+    temp += result[i];
+    result[i] = temp;
+  }
+  return result;
+}
+
 void FMM::ALGORITHM::closest_point_on_segment(
     double x, double y, double x1, double y1, double x2, double y2,
     double *dist, double *offset) {
@@ -246,187 +595,79 @@ void FMM::ALGORITHM::closest_point_on_segment(
 void FMM::ALGORITHM::linear_referencing(
     double px, double py, const FMM::CORE::LineString &linestring,
     double *result_dist, double *result_offset) {
-  int Npoints = linestring.get_num_points();
-  double min_dist = DBL_MAX;
-  double final_offset = DBL_MAX;
-  double length_parsed = 0;
-  int i = 0;
-  // Iterating to check p(i) == p(i+2)
-  // int seg_idx=0;
-  while (i < Npoints - 1) {
-    double x1 = linestring.get_x(i);
-    double y1 = linestring.get_y(i);
-    double x2 = linestring.get_x(i + 1);
-    double y2 = linestring.get_y(i + 1);
-    double temp_min_dist;
-    double temp_min_offset;
-    closest_point_on_segment(px, py, x1, y1, x2, y2,
-                             &temp_min_dist, &temp_min_offset);
-    if (temp_min_dist < min_dist) {
-      min_dist = temp_min_dist;
-      final_offset = length_parsed + temp_min_offset;
-    }
-    length_parsed += std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-    ++i;
-  }
-  *result_dist = min_dist;
-  *result_offset = final_offset;
-} // linear_referencing
+  linear_referencing_impl(px, py, linestring, result_dist, result_offset);
+}
+
+void FMM::ALGORITHM::linear_referencing(
+    double px, double py, const FMM::CORE::LineStringView &linestring,
+    double *result_dist, double *result_offset) {
+  double proj_x, proj_y;
+  linear_referencing_view(px, py, linestring, result_dist, result_offset,
+                          &proj_x, &proj_y);
+}
 
 void FMM::ALGORITHM::linear_referencing(
     double px, double py, const FMM::CORE::LineString &linestring,
     double *result_dist, double *result_offset,
     double *proj_x, double *proj_y) {
-  int Npoints = linestring.get_num_points();
-  double min_dist = DBL_MAX;
-  double temp_x = 0, temp_y = 0;
-  double final_offset = DBL_MAX;
-  double length_parsed = 0;
-  int i = 0;
-  // Iterating to check p(i) == p(i+2)
-  // int seg_idx=0;
-  while (i < Npoints - 1) {
-    double x1 = linestring.get_x(i);
-    double y1 = linestring.get_y(i);
-    double x2 = linestring.get_x(i + 1);
-    double y2 = linestring.get_y(i + 1);
-    double temp_min_dist;
-    double temp_min_offset;
-    closest_point_on_segment(px, py, x1, y1, x2, y2,
-                             &temp_min_dist, &temp_min_offset,
-                             &temp_x, &temp_y);
-    if (temp_min_dist < min_dist) {
-      min_dist = temp_min_dist;
-      final_offset = length_parsed + temp_min_offset;
-      *proj_x = temp_x;
-      *proj_y = temp_y;
-    }
-    length_parsed += std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-    ++i;
-  }
-  *result_dist = min_dist;
-  *result_offset = final_offset;
-} // linear_referencing
+  linear_referencing_impl(px, py, linestring, result_dist, result_offset,
+                          proj_x, proj_y);
+}
+
+void FMM::ALGORITHM::linear_referencing(
+    double px, double py, const FMM::CORE::LineStringView &linestring,
+    double *result_dist, double *result_offset,
+    double *proj_x, double *proj_y) {
+  linear_referencing_view(px, py, linestring, result_dist, result_offset,
+                          proj_x, proj_y);
+}
 
 void FMM::ALGORITHM::locate_point_by_offset(
     const FMM::CORE::LineString &linestring, double offset,
     double *x, double *y) {
-  int Npoints = linestring.get_num_points();
-  if (offset <= 0.0) {
-    *x = linestring.get_x(0);
-    *y = linestring.get_y(0);
-    return;
-  }
-  double L_processed = 0;       // length parsed
-  int i = 0;
-  double px = 0;
-  double py = 0;
-  bool found = false;
-  // Find the idx of the point to be exported close to p
-  while (i < Npoints - 1) {
-    double x1 = linestring.get_x(i);
-    double y1 = linestring.get_y(i);
-    double x2 = linestring.get_x(i + 1);
-    double y2 = linestring.get_y(i + 1);
-    double deltaL = std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-    double ratio = (offset - L_processed) / deltaL;
-    if (offset >= L_processed && offset <= L_processed + deltaL) {
-      px = x1 + ratio * (x2 - x1);
-      py = y1 + ratio * (y2 - y1);
-      found = true;
-      break;
-    }
-    ++i;
-    L_processed += deltaL;
-  }
-  if (found) {
-    *x = px;
-    *y = py;
-  } else {
-    *x = linestring.get_x(Npoints - 1);
-    *y = linestring.get_y(Npoints - 1);
-  }
-} // calculate_offset_point
+  locate_point_by_offset_impl(linestring, offset, x, y);
+}
 
-FMM::CORE::LineString FMM::ALGORITHM::cutoffseg_unique(
-    const FMM::CORE::LineString &linestring, double offset1, double offset2) {
-  FMM::CORE::LineString cutoffline;
-  SPDLOG_TRACE("Offset1 {} Offset2 {}", offset1, offset2);
-  int Npoints = linestring.get_num_points();
-  if (Npoints == 2) {
-    // A single segment
-    double x1 = linestring.get_x(0);
-    double y1 = linestring.get_y(0);
-    double x2 = linestring.get_x(1);
-    double y2 = linestring.get_y(1);
-    double L = std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-    double ratio1 = offset1 / L;
-    double new_x1 = x1 + ratio1 * (x2 - x1);
-    double new_y1 = y1 + ratio1 * (y2 - y1);
-    double ratio2 = offset2 / L;
-    double new_x2 = x1 + ratio2 * (x2 - x1);
-    double new_y2 = y1 + ratio2 * (y2 - y1);
-    cutoffline.add_point(new_x1, new_y1);
-    cutoffline.add_point(new_x2, new_y2);
-  } else {
-    // Multiple segments
-    double l1 = 0;
-    double l2 = 0;
-    int i = 0;
-    while (i < Npoints - 1) {
-      double x1 = linestring.get_x(i);
-      double y1 = linestring.get_y(i);
-      double x2 = linestring.get_x(i + 1);
-      double y2 = linestring.get_y(i + 1);
-      double deltaL = std::sqrt((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
-      l2 = l1 + deltaL;
-      // Insert p1
-      SPDLOG_TRACE("  L1 {} L2 {} ", l1, l2);
-      if (l1 >= offset1 && l1 <= offset2) {
-        cutoffline.add_point(x1, y1);
-        SPDLOG_TRACE("  add p1 {} {}", x1, y1);
-      }
+void FMM::ALGORITHM::locate_point_by_offset(
+    const FMM::CORE::LineStringView &linestring, double offset,
+    double *x, double *y) {
+  locate_point_by_offset_view(linestring, offset, x, y);
+}
 
-      // Insert p between p1 and p2
-      if (offset1 > l1 && offset1 < l2) {
-        double ratio1 = (offset1 - l1) / deltaL;
-        double px = x1 + ratio1 * (x2 - x1);
-        double py = y1 + ratio1 * (y2 - y1);
-        cutoffline.add_point(px, py);
-        SPDLOG_TRACE("  add p {} {} between p1 p2", px, py);
-      }
+FMM::CORE::LineString FMM::ALGORITHM::cutoffseg_unique(
+    const FMM::CORE::LineString &linestring,
+    double offset1, double offset2) {
+  return cutoffseg_unique_impl(linestring, offset1, offset2);
+}
 
-      if (offset2 > l1 && offset2 < l2) {
-        double ratio2 = (offset2 - l1) / deltaL;
-        double px = x1 + ratio2 * (x2 - x1);
-        double py = y1 + ratio2 * (y2 - y1);
-        cutoffline.add_point(px, py);
-        SPDLOG_TRACE("  add p {} {} between p1 p2", px, py);
-      }
+FMM::CORE::LineString FMM::ALGORITHM::cutoffseg_unique(
+    const FMM::CORE::LineStringView &linestring,
+    double offset1, double offset2) {
+  return cutoffseg_unique_impl(linestring, offset1, offset2);
+}
 
-      // last point
-      if (i == Npoints - 2 && offset2 >= l2) {
-        cutoffline.add_point(x2, y2);
-        SPDLOG_TRACE("  add p2 {} {} for last point", x2, y2);
-      }
+int FMM::ALGORITHM::cutoffseg_unique(
+    const FMM::CORE::LineStringView &linestring,
+    double offset1, double offset2, FMM::CORE::Point *points) {
+  int num_points = 0;
+  cutoffseg_points(linestring, offset1, offset2,
+                   [points, &num_points](double x, double y) {
+                     if (points != nullptr) {
+                       points[num_points] = FMM::CORE::Point(x, y);
+                     }
+                     ++num_points;
+                   });
+  return num_points;
+}
 
-      l1 = l2;
-      ++i;
-    }
-  }
-  return cutoffline;
-} //cutoffseg_twoparameters
+FMM::CORE::LineString FMM::ALGORITHM::cutoffseg(
+    const FMM::CORE::LineString &linestring,
+    double offset, int mode) {
+  return cutoffseg_impl(linestring, offset, mode);
+}
 
 FMM::CORE::LineString FMM::ALGORITHM::cutoffseg(
-    const FMM::CORE::LineString &linestring, double offset, int mode) {
-  double L = linestring.get_length();
-  double offset1, offset2;
-  if (mode == 0) {
-    offset1 = offset;
-    offset2 = L;
-  } else {
-    offset1 = 0;
-    offset2 = offset;
-  }
-  return FMM::ALGORITHM::cutoffseg_unique(linestring, offset1, offset2);
+    const FMM::CORE::LineStringView &linestring,
+    double offset, int mode) {
+  return cutoffseg_impl(linestring, offset, mode);
 }
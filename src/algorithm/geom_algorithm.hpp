@@ -27,6 +27,14 @@ namespace ALGORITHM {
  */
 std::vector<double> cal_eu_dist(const FMM::CORE::LineString &trajectory);
 
+/**
+ * Calculate segment length of a trajectory into a buffer
+ * @param trajectory a trajectory as input
+ * @param lengths updated with the N-1 segment lengths
+ */
+void cal_eu_dist(const FMM::CORE::LineString &trajectory,
+                 std::vector<double> *lengths);
+
 /**
  * Concatenate a linestring segs to a linestring line, used in the
  * function network.complete_path_to_geometry
@@ -99,6 +107,21 @@ FMM::CORE::LineString interpolate_line_kpoints(
 void boundingbox_geometry(const FMM::CORE::LineString &linestring,
                           double *x1, double *y1, double *x2, double *y2);
 
+/**
+ * Calculate the bounding box of a linestring view
+ */
+void boundingbox_geometry(const FMM::CORE::LineStringView &linestring,
+                          double *x1, double *y1, double *x2, double *y2);
+
+/**
+ * Get the index of a cell on the Hilbert curve filling a grid of 2^16 by
+ * 2^16 cells, so that the cells close on the curve are close in space
+ * @param x column of the cell, below 2^16
+ * @param y row of the cell, below 2^16
+ * @return the index of the cell along the curve
+ */
+unsigned long long hilbert_index(unsigned int x, unsigned int y);
+
 /**
  * Calculate the distance from each point in a linestring to the end point
  * of a linestring
@@ -107,6 +130,13 @@ void boundingbox_geometry(const FMM::CORE::LineString &linestring,
  */
 std::vector<double> calc_length_to_end_vec(const FMM::CORE::LineString &geom);
 
+/**
+ * Calculate the distance from each point in a linestring view to the end
+ * point, using the precomputed cumulative lengths of the view if any
+ */
+std::vector<double> calc_length_to_end_vec(
+    const FMM::CORE::LineStringView &geom);
+
 /**
  * Calculate the closest point p' on a segment p1 (x1,y1) p2 (x2,y2) to a
  * specific point p (x,y)
@@ -162,6 +192,14 @@ void linear_referencing(double px, double py,
                         double *result_dist,
                         double *result_offset);
 
+/**
+ * Linear referencing of a point on a linestring view
+ */
+void linear_referencing(double px, double py,
+                        const FMM::CORE::LineStringView &linestring,
+                        double *result_dist,
+                        double *result_offset);
+
 /**
  * A linear referencing function
  *
@@ -181,6 +219,15 @@ void linear_referencing(double px, double py,
                         double *result_dist, double *result_offset,
                         double *proj_x, double *proj_y);
 
+/**
+ * Linear referencing of a point on a linestring view, which also returns
+ * the projected point
+ */
+void linear_referencing(double px, double py,
+                        const FMM::CORE::LineStringView &linestring,
+                        double *result_dist, double *result_offset,
+                        double *proj_x, double *proj_y);
+
 /**
  * Locate the point on a linestring according to the input of offset
  * The two pointer's target value will be updated.
@@ -195,6 +242,12 @@ void linear_referencing(double px, double py,
 void locate_point_by_offset(const FMM::CORE::LineString &linestring,
                             double offset, double *x, double *y);
 
+/**
+ * Locate a point on a linestring view according to an offset value
+ */
+void locate_point_by_offset(const FMM::CORE::LineStringView &linestring,
+                            double offset, double *x, double *y);
+
 /**
  * Cut a linestring at two offset values
  * @param linestring input line
@@ -206,6 +259,27 @@ void locate_point_by_offset(const FMM::CORE::LineString &linestring,
 FMM::CORE::LineString cutoffseg_unique(
     const FMM::CORE::LineString &linestring, double offset1, double offset2);
 
+/**
+ * Cut a linestring view at two offset values
+ */
+FMM::CORE::LineString cutoffseg_unique(
+    const FMM::CORE::LineStringView &linestring,
+    double offset1, double offset2);
+
+/**
+ * Cut a linestring view at two offset values into an array of points,
+ * so that the cut is written without a temporary linestring
+ * @param linestring input line
+ * @param offset1 starting offset
+ * @param offset2 ending offset
+ * @param points updated with the points of the cut if it is not nullptr,
+ * which should hold the number of points returned
+ * @return the number of points of the cut
+ */
+int cutoffseg_unique(const FMM::CORE::LineStringView &linestring,
+                     double offset1, double offset2,
+                     FMM::CORE::Point *points);
+
 /**
  * Added by Diao 18.01.17
  * modified by Can 18.01.19
@@ -222,6 +296,12 @@ FMM::CORE::LineString cutoffseg_unique(
 FMM::CORE::LineString cutoffseg(
     const FMM::CORE::LineString &linestring, double offset, int mode);
 
+/**
+ * Cut a linestring view at an offset value according to a mode value
+ */
+FMM::CORE::LineString cutoffseg(
+    const FMM::CORE::LineStringView &linestring, double offset, int mode);
+
 } // ALGORITHM
 } // FMM
 #endif /* FMM_ALGORITHM_HPP */
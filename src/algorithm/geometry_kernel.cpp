@@ -0,0 +1,235 @@
+#include "algorithm/geometry_kernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace FMM {
+namespace ALGORITHM {
+
+void segment_lengths(const double *x, const double *y, int num_points,
+                     double *lengths) {
+  int num_segs = num_points - 1;
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_segs; i += 4) {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 1),
+                               _mm256_loadu_pd(x + i));
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 1),
+                               _mm256_loadu_pd(y + i));
+    _mm256_storeu_pd(lengths + i, _mm256_sqrt_pd(_mm256_add_pd(
+        _mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 2 <= num_segs; i += 2) {
+    float64x2_t dx = vsubq_f64(vld1q_f64(x + i + 1), vld1q_f64(x + i));
+    float64x2_t dy = vsubq_f64(vld1q_f64(y + i + 1), vld1q_f64(y + i));
+    vst1q_f64(lengths + i, vsqrtq_f64(vaddq_f64(vmulq_f64(dx, dx),
+                                                vmulq_f64(dy, dy))));
+  }
+#endif
+  // Remaining segments, or all of them without SIMD support
+  for (; i < num_segs; ++i) {
+    double dx = x[i + 1] - x[i];
+    double dy = y[i + 1] - y[i];
+    lengths[i] = std::sqrt(dx * dx + dy * dy);
+  }
+} // segment_lengths
+
+void point_segment_lengths(const double *xy, int num_points,
+                           double *lengths) {
+  int num_segs = num_points - 1;
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_segs; i += 4) {
+    // Differences of the segments i,i+1 and i+2,i+3 as dx,dy pairs
+    __m256d d1 = _mm256_sub_pd(_mm256_loadu_pd(xy + 2 * i + 2),
+                               _mm256_loadu_pd(xy + 2 * i));
+    __m256d d2 = _mm256_sub_pd(_mm256_loadu_pd(xy + 2 * i + 6),
+                               _mm256_loadu_pd(xy + 2 * i + 4));
+    // The pairs are summed in the order i,i+2,i+1,i+3
+    __m256d sum = _mm256_hadd_pd(_mm256_mul_pd(d1, d1),
+                                 _mm256_mul_pd(d2, d2));
+    sum = _mm256_permute4x64_pd(sum, 0xD8);
+    _mm256_storeu_pd(lengths + i, _mm256_sqrt_pd(sum));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 2 <= num_segs; i += 2) {
+    // Points i,i+1 and i+1,i+2 loaded as x and y lanes
+    float64x2x2_t p1 = vld2q_f64(xy + 2 * i);
+    float64x2x2_t p2 = vld2q_f64(xy + 2 * i + 2);
+    float64x2_t dx = vsubq_f64(p2.val[0], p1.val[0]);
+    float64x2_t dy = vsubq_f64(p2.val[1], p1.val[1]);
+    vst1q_f64(lengths + i, vsqrtq_f64(vaddq_f64(vmulq_f64(dx, dx),
+                                                vmulq_f64(dy, dy))));
+  }
+#endif
+  for (; i < num_segs; ++i) {
+    double dx = xy[2 * i + 2] - xy[2 * i];
+    double dy = xy[2 * i + 3] - xy[2 * i + 1];
+    lengths[i] = std::sqrt(dx * dx + dy * dy);
+  }
+} // point_segment_lengths
+
+void bounding_box(const double *x, const double *y, int num_points,
+                  double *x1, double *y1, double *x2, double *y2) {
+  double min_x = x[0], min_y = y[0], max_x = x[0], max_y = y[0];
+  int i = 0;
+#if defined(__AVX2__)
+  if (num_points >= 4) {
+    __m256d vmin_x = _mm256_loadu_pd(x);
+    __m256d vmin_y = _mm256_loadu_pd(y);
+    __m256d vmax_x = vmin_x;
+    __m256d vmax_y = vmin_y;
+    for (i = 4; i + 4 <= num_points; i += 4) {
+      __m256d vx = _mm256_loadu_pd(x + i);
+      __m256d vy = _mm256_loadu_pd(y + i);
+      vmin_x = _mm256_min_pd(vmin_x, vx);
+      vmin_y = _mm256_min_pd(vmin_y, vy);
+      vmax_x = _mm256_max_pd(vmax_x, vx);
+      vmax_y = _mm256_max_pd(vmax_y, vy);
+    }
+    double lanes[4][4];
+    _mm256_storeu_pd(lanes[0], vmin_x);
+    _mm256_storeu_pd(lanes[1], vmin_y);
+    _mm256_storeu_pd(lanes[2], vmax_x);
+    _mm256_storeu_pd(lanes[3], vmax_y);
+    for (int l = 0; l < 4; ++l) {
+      min_x = std::min(min_x, lanes[0][l]);
+      min_y = std::min(min_y, lanes[1][l]);
+      max_x = std::max(max_x, lanes[2][l]);
+      max_y = std::max(max_y, lanes[3][l]);
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  if (num_points >= 2) {
+    float64x2_t vmin_x = vld1q_f64(x);
+    float64x2_t vmin_y = vld1q_f64(y);
+    float64x2_t vmax_x = vmin_x;
+    float64x2_t vmax_y = vmin_y;
+    for (i = 2; i + 2 <= num_points; i += 2) {
+      float64x2_t vx = vld1q_f64(x + i);
+      float64x2_t vy = vld1q_f64(y + i);
+      vmin_x = vminq_f64(vmin_x, vx);
+      vmin_y = vminq_f64(vmin_y, vy);
+      vmax_x = vmaxq_f64(vmax_x, vx);
+      vmax_y = vmaxq_f64(vmax_y, vy);
+    }
+    min_x = vminvq_f64(vmin_x);
+    min_y = vminvq_f64(vmin_y);
+    max_x = vmaxvq_f64(vmax_x);
+    max_y = vmaxvq_f64(vmax_y);
+  }
+#endif
+  for (; i < num_points; ++i) {
+    min_x = std::min(min_x, x[i]);
+    min_y = std::min(min_y, y[i]);
+    max_x = std::max(max_x, x[i]);
+    max_y = std::max(max_y, y[i]);
+  }
+  *x1 = min_x;
+  *y1 = min_y;
+  *x2 = max_x;
+  *y2 = max_y;
+} // bounding_box
+
+void segment_boxes(const double *x, const double *y, int num_points,
+                   double *min_x, double *min_y,
+                   double *max_x, double *max_y) {
+  int num_segs = num_points - 1;
+  int i = 0;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_segs; i += 4) {
+    __m256d x1 = _mm256_loadu_pd(x + i);
+    __m256d x2 = _mm256_loadu_pd(x + i + 1);
+    __m256d y1 = _mm256_loadu_pd(y + i);
+    __m256d y2 = _mm256_loadu_pd(y + i + 1);
+    _mm256_storeu_pd(min_x + i, _mm256_min_pd(x1, x2));
+    _mm256_storeu_pd(min_y + i, _mm256_min_pd(y1, y2));
+    _mm256_storeu_pd(max_x + i, _mm256_max_pd(x1, x2));
+    _mm256_storeu_pd(max_y + i, _mm256_max_pd(y1, y2));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 2 <= num_segs; i += 2) {
+    float64x2_t x1 = vld1q_f64(x + i);
+    float64x2_t x2 = vld1q_f64(x + i + 1);
+    float64x2_t y1 = vld1q_f64(y + i);
+    float64x2_t y2 = vld1q_f64(y + i + 1);
+    vst1q_f64(min_x + i, vminq_f64(x1, x2));
+    vst1q_f64(min_y + i, vminq_f64(y1, y2));
+    vst1q_f64(max_x + i, vmaxq_f64(x1, x2));
+    vst1q_f64(max_y + i, vmaxq_f64(y1, y2));
+  }
+#endif
+  for (; i < num_segs; ++i) {
+    min_x[i] = std::min(x[i], x[i + 1]);
+    min_y[i] = std::min(y[i], y[i + 1]);
+    max_x[i] = std::max(x[i], x[i + 1]);
+    max_y[i] = std::max(y[i], y[i + 1]);
+  }
+} // segment_boxes
+
+int boxes_intersect(const double *min_x, const double *min_y,
+                    const double *max_x, const double *max_y,
+                    int num_boxes, double x1, double y1,
+                    double x2, double y2, int *hits) {
+  int num_hits = 0;
+  int i = 0;
+#if defined(__AVX2__)
+  __m256d qx1 = _mm256_set1_pd(x1);
+  __m256d qy1 = _mm256_set1_pd(y1);
+  __m256d qx2 = _mm256_set1_pd(x2);
+  __m256d qy2 = _mm256_set1_pd(y2);
+  for (; i + 4 <= num_boxes; i += 4) {
+    __m256d in_x = _mm256_and_pd(
+        _mm256_cmp_pd(_mm256_loadu_pd(min_x + i), qx2, _CMP_LE_OQ),
+        _mm256_cmp_pd(_mm256_loadu_pd(max_x + i), qx1, _CMP_GE_OQ));
+    __m256d in_y = _mm256_and_pd(
+        _mm256_cmp_pd(_mm256_loadu_pd(min_y + i), qy2, _CMP_LE_OQ),
+        _mm256_cmp_pd(_mm256_loadu_pd(max_y + i), qy1, _CMP_GE_OQ));
+    int mask = _mm256_movemask_pd(_mm256_and_pd(in_x, in_y));
+    for (int l = 0; l < 4; ++l) {
+      if (mask >> l & 1) hits[num_hits++] = i + l;
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  float64x2_t qx1 = vdupq_n_f64(x1);
+  float64x2_t qy1 = vdupq_n_f64(y1);
+  float64x2_t qx2 = vdupq_n_f64(x2);
+  float64x2_t qy2 = vdupq_n_f64(y2);
+  for (; i + 2 <= num_boxes; i += 2) {
+    uint64x2_t in_x = vandq_u64(vcleq_f64(vld1q_f64(min_x + i), qx2),
+                                vcgeq_f64(vld1q_f64(max_x + i), qx1));
+    uint64x2_t in_y = vandq_u64(vcleq_f64(vld1q_f64(min_y + i), qy2),
+                                vcgeq_f64(vld1q_f64(max_y + i), qy1));
+    uint64x2_t in = vandq_u64(in_x, in_y);
+    if (vgetq_lane_u64(in, 0)) hits[num_hits++] = i;
+    if (vgetq_lane_u64(in, 1)) hits[num_hits++] = i + 1;
+  }
+#endif
+  for (; i < num_boxes; ++i) {
+    if (min_x[i] <= x2 && max_x[i] >= x1 &&
+        min_y[i] <= y2 && max_y[i] >= y1) {
+      hits[num_hits++] = i;
+    }
+  }
+  return num_hits;
+} // boxes_intersect
+
+const char *geometry_kernel() {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+} // ALGORITHM
+} // FMM
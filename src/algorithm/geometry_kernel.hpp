@@ -0,0 +1,93 @@
+/**
+ * Fast map matching.
+ *
+ * Vectorized kernels computing the lengths and the bounding boxes of
+ * polylines stored as coordinate arrays.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_GEOMETRY_KERNEL_HPP
+#define FMM_GEOMETRY_KERNEL_HPP
+
+namespace FMM {
+namespace ALGORITHM {
+
+/**
+ * Compute the length of each segment of a polyline stored as separate x
+ * and y coordinate arrays.
+ *
+ * The lengths are computed with AVX2 or NEON instructions when the library
+ * is compiled for them, otherwise with a scalar loop, and are equal to
+ * those of the scalar loop.
+ *
+ * @param x x coordinates of the points of the polyline
+ * @param y y coordinates of the points of the polyline
+ * @param num_points number of points
+ * @param lengths updated with the length of the segment from point i to
+ * i+1, which should hold num_points-1 values
+ */
+void segment_lengths(const double *x, const double *y, int num_points,
+                     double *lengths);
+
+/**
+ * Compute the length of each segment of a polyline stored as interleaved
+ * coordinates x0,y0,x1,y1..., as the points of a linestring are.
+ * @param xy coordinates of the points of the polyline
+ * @param num_points number of points
+ * @param lengths updated with the length of the segment from point i to
+ * i+1, which should hold num_points-1 values
+ */
+void point_segment_lengths(const double *xy, int num_points,
+                           double *lengths);
+
+/**
+ * Compute the bounding box of a polyline stored as separate x and y
+ * coordinate arrays
+ * @param x x coordinates of the points of the polyline
+ * @param y y coordinates of the points of the polyline
+ * @param num_points number of points, at least 1
+ * @param x1,y1,x2,y2 updated with the box
+ */
+void bounding_box(const double *x, const double *y, int num_points,
+                  double *x1, double *y1, double *x2, double *y2);
+
+/**
+ * Compute the bounding box of each segment of a polyline stored as
+ * separate x and y coordinate arrays
+ * @param x x coordinates of the points of the polyline
+ * @param y y coordinates of the points of the polyline
+ * @param num_points number of points
+ * @param min_x,min_y,max_x,max_y updated with the box of the segment from
+ * point i to i+1, which should hold num_points-1 values
+ */
+void segment_boxes(const double *x, const double *y, int num_points,
+                   double *min_x, double *min_y,
+                   double *max_x, double *max_y);
+
+/**
+ * Find the boxes intersecting a query box, where the boxes touching it
+ * on a border intersect it, as in boost geometry
+ * @param min_x,min_y,max_x,max_y coordinates of the boxes
+ * @param num_boxes number of boxes
+ * @param x1,y1,x2,y2 query box
+ * @param hits updated with the position of the boxes intersecting the
+ * query box in increasing order, which should hold num_boxes values
+ * @return the number of boxes intersecting the query box
+ */
+int boxes_intersect(const double *min_x, const double *min_y,
+                    const double *max_x, const double *max_y,
+                    int num_boxes, double x1, double y1,
+                    double x2, double y2, int *hits);
+
+/**
+ * Get the name of the instruction set used by the geometry kernels
+ * @return "avx2", "neon" or "scalar"
+ */
+const char *geometry_kernel();
+
+} // ALGORITHM
+} // FMM
+
+#endif // FMM_GEOMETRY_KERNEL_HPP
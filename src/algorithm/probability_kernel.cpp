@@ -0,0 +1,22 @@
+#include "algorithm/probability_kernel.hpp"
+
+namespace FMM {
+namespace ALGORITHM {
+
+void gaussian_probabilities(const double *dists, int n, double error,
+                            double *probs) {
+  double inv_error = 1.0 / error;
+  // The exponents are clamped in a first loop, as the selection followed
+  // by the polynomial in one loop is not vectorized
+  for (int i = 0; i < n; ++i) {
+    double a = dists[i] * inv_error;
+    double x = -0.5 * a * a;
+    probs[i] = x < -708.0 ? -708.0 : x;
+  }
+  for (int i = 0; i < n; ++i) {
+    probs[i] = fast_exp_in_range(probs[i]);
+  }
+}
+
+} // ALGORITHM
+} // FMM
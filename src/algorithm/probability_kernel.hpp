@@ -0,0 +1,79 @@
+/**
+ * Fast map matching.
+ *
+ * Approximate exponential and the kernel computing the emission
+ * probabilities of the candidates of a point.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_PROBABILITY_KERNEL_HPP
+#define FMM_PROBABILITY_KERNEL_HPP
+
+#include <cstdint>
+#include <cstring>
+
+namespace FMM {
+namespace ALGORITHM {
+
+/**
+ * Approximate exp(x) for x in [-708, 709], without calling the math
+ * library or branching, so that a loop calling it can be vectorized.
+ *
+ * x is split into n*ln(2)+r with |r| <= ln(2)/2, exp(r) is evaluated by
+ * its Taylor polynomial of degree 7 and 2^n is built from the exponent
+ * bits. The relative error is below 1e-8.
+ *
+ * @param x exponent in [-708, 709]
+ * @return approximation of exp(x)
+ */
+inline double fast_exp_in_range(double x) {
+  // n is rounded to the nearest integer by adding 1.5*2^52, whose
+  // mantissa has no fractional bit
+  double n = (x * 1.4426950408889634 + 6755399441055744.0) -
+      6755399441055744.0;
+  // ln(2) is split into a high part exact in n*ln2_hi and a low part
+  double r = x - n * 0.693145751953125 - n * 1.4286068203094173e-06;
+  double p = 1 + r * (1 + r * (1.0 / 2 + r * (1.0 / 6 + r * (
+      1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040)))))));
+  // The low bits of the mantissa of 1.5*2^52+n+1023 hold the biased
+  // exponent of 2^n, without converting to an integer
+  double biased = n + (6755399441055744.0 + 1023);
+  int64_t bits;
+  std::memcpy(&bits, &biased, sizeof(bits));
+  bits <<= 52;
+  double scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+/**
+ * Approximate exp(x), where x is clamped to [-708, 709]
+ *
+ * @param x exponent
+ * @return approximation of exp(x)
+ */
+inline double fast_exp(double x) {
+  x = x < -708.0 ? -708.0 : x;
+  x = x > 709.0 ? 709.0 : x;
+  return fast_exp_in_range(x);
+}
+
+/**
+ * Compute the Gaussian emission probabilities exp(-0.5*(d/e)^2) of
+ * several distances with the approximate exponential, in loops
+ * vectorized by the compiler
+ *
+ * @param dists distances to the observed point
+ * @param n     number of distances
+ * @param error GPS error e
+ * @param probs updated with the probability of each distance
+ */
+void gaussian_probabilities(const double *dists, int n, double error,
+                            double *probs);
+
+} // ALGORITHM
+} // FMM
+
+#endif // FMM_PROBABILITY_KERNEL_HPP
@@ -0,0 +1,148 @@
+#include "algorithm/projection_kernel.hpp"
+
+#include <cfloat>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace FMM {
+namespace ALGORITHM {
+namespace {
+// Squared distance from p to the segment starting at point i, computed
+// as closest_point_on_segment does.
+inline double segment_dist2(double px, double py,
+                            const double *x, const double *y, int i) {
+  double dx = x[i + 1] - x[i];
+  double dy = y[i + 1] - y[i];
+  double l2 = dx * dx + dy * dy;
+  double ratio = 0;
+  if (l2 != 0.0) {
+    ratio = ((px - x[i]) * dx + (py - y[i]) * dy) / l2;
+    ratio = (ratio > 1) ? 1 : ratio;
+    ratio = (ratio < 0) ? 0 : ratio;
+  }
+  double ex = x[i] + ratio * dx - px;
+  double ey = y[i] + ratio * dy - py;
+  return ex * ex + ey * ey;
+}
+
+// Reduce the lanes of the vectorized loop, keeping the first segment
+// among those with the minimum distance.
+inline void reduce_lanes(const double *lane_dist2, const double *lane_idx,
+                         int num_lanes, double *min_dist2, int *min_idx) {
+  for (int l = 0; l < num_lanes; ++l) {
+    if (lane_idx[l] < 0) continue;
+    int idx = static_cast<int>(lane_idx[l]);
+    if (lane_dist2[l] < *min_dist2 ||
+        (lane_dist2[l] == *min_dist2 && idx < *min_idx)) {
+      *min_dist2 = lane_dist2[l];
+      *min_idx = idx;
+    }
+  }
+}
+} // namespace
+
+int closest_segment(double px, double py, const double *x, const double *y,
+                    int num_points, double *dist2) {
+  int num_segs = num_points - 1;
+  double min_dist2 = DBL_MAX;
+  int min_idx = 0;
+  int i = 0;
+#if defined(__AVX2__)
+  const __m256d vpx = _mm256_set1_pd(px);
+  const __m256d vpy = _mm256_set1_pd(py);
+  const __m256d zero = _mm256_setzero_pd();
+  const __m256d one = _mm256_set1_pd(1.0);
+  const __m256d step = _mm256_set1_pd(4.0);
+  __m256d vidx = _mm256_set_pd(3.0, 2.0, 1.0, 0.0);
+  __m256d best_dist2 = _mm256_set1_pd(DBL_MAX);
+  __m256d best_idx = _mm256_set1_pd(-1.0);
+  for (; i + 4 <= num_segs; i += 4) {
+    __m256d x1 = _mm256_loadu_pd(x + i);
+    __m256d y1 = _mm256_loadu_pd(y + i);
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 1), x1);
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 1), y1);
+    __m256d l2 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    __m256d dot = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_sub_pd(vpx, x1), dx),
+        _mm256_mul_pd(_mm256_sub_pd(vpy, y1), dy));
+    __m256d ratio = _mm256_div_pd(dot, l2);
+    // A segment of zero length is projected on its start point
+    ratio = _mm256_blendv_pd(ratio, zero, _mm256_cmp_pd(l2, zero, _CMP_EQ_OQ));
+    ratio = _mm256_max_pd(_mm256_min_pd(ratio, one), zero);
+    __m256d ex = _mm256_sub_pd(_mm256_add_pd(x1, _mm256_mul_pd(ratio, dx)),
+                               vpx);
+    __m256d ey = _mm256_sub_pd(_mm256_add_pd(y1, _mm256_mul_pd(ratio, dy)),
+                               vpy);
+    __m256d d2 = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+    __m256d closer = _mm256_cmp_pd(d2, best_dist2, _CMP_LT_OQ);
+    best_dist2 = _mm256_blendv_pd(best_dist2, d2, closer);
+    best_idx = _mm256_blendv_pd(best_idx, vidx, closer);
+    vidx = _mm256_add_pd(vidx, step);
+  }
+  double lane_dist2[4], lane_idx[4];
+  _mm256_storeu_pd(lane_dist2, best_dist2);
+  _mm256_storeu_pd(lane_idx, best_idx);
+  reduce_lanes(lane_dist2, lane_idx, 4, &min_dist2, &min_idx);
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const float64x2_t vpx = vdupq_n_f64(px);
+  const float64x2_t vpy = vdupq_n_f64(py);
+  const float64x2_t zero = vdupq_n_f64(0.0);
+  const float64x2_t one = vdupq_n_f64(1.0);
+  const float64x2_t step = vdupq_n_f64(2.0);
+  const double first_idx[2] = {0.0, 1.0};
+  float64x2_t vidx = vld1q_f64(first_idx);
+  float64x2_t best_dist2 = vdupq_n_f64(DBL_MAX);
+  float64x2_t best_idx = vdupq_n_f64(-1.0);
+  for (; i + 2 <= num_segs; i += 2) {
+    float64x2_t x1 = vld1q_f64(x + i);
+    float64x2_t y1 = vld1q_f64(y + i);
+    float64x2_t dx = vsubq_f64(vld1q_f64(x + i + 1), x1);
+    float64x2_t dy = vsubq_f64(vld1q_f64(y + i + 1), y1);
+    float64x2_t l2 = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+    float64x2_t dot = vaddq_f64(vmulq_f64(vsubq_f64(vpx, x1), dx),
+                                vmulq_f64(vsubq_f64(vpy, y1), dy));
+    float64x2_t ratio = vdivq_f64(dot, l2);
+    // A segment of zero length is projected on its start point
+    ratio = vbslq_f64(vceqq_f64(l2, zero), zero, ratio);
+    ratio = vmaxq_f64(vminq_f64(ratio, one), zero);
+    float64x2_t ex = vsubq_f64(vaddq_f64(x1, vmulq_f64(ratio, dx)), vpx);
+    float64x2_t ey = vsubq_f64(vaddq_f64(y1, vmulq_f64(ratio, dy)), vpy);
+    float64x2_t d2 = vaddq_f64(vmulq_f64(ex, ex), vmulq_f64(ey, ey));
+    uint64x2_t closer = vcltq_f64(d2, best_dist2);
+    best_dist2 = vbslq_f64(closer, d2, best_dist2);
+    best_idx = vbslq_f64(closer, vidx, best_idx);
+    vidx = vaddq_f64(vidx, step);
+  }
+  double lane_dist2[2], lane_idx[2];
+  vst1q_f64(lane_dist2, best_dist2);
+  vst1q_f64(lane_idx, best_idx);
+  reduce_lanes(lane_dist2, lane_idx, 2, &min_dist2, &min_idx);
+#endif
+  // Remaining segments, or all of them without SIMD support
+  for (; i < num_segs; ++i) {
+    double d2 = segment_dist2(px, py, x, y, i);
+    if (d2 < min_dist2) {
+      min_dist2 = d2;
+      min_idx = i;
+    }
+  }
+  *dist2 = min_dist2;
+  return min_idx;
+} // closest_segment
+
+const char *closest_segment_kernel() {
+#if defined(__AVX2__)
+  return "avx2";
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+} // ALGORITHM
+} // FMM
@@ -0,0 +1,45 @@
+/**
+ * Fast map matching.
+ *
+ * Vectorized kernel projecting a point onto the segments of a polyline
+ * stored as separate x and y coordinate arrays.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_PROJECTION_KERNEL_HPP
+#define FMM_PROJECTION_KERNEL_HPP
+
+namespace FMM {
+namespace ALGORITHM {
+
+/**
+ * Find the segment of a polyline closest to a point p (px,py).
+ *
+ * The squared distances from p to the segments are computed with
+ * AVX2 or NEON instructions when the library is compiled for them,
+ * otherwise with a scalar loop. The first closest segment is returned,
+ * as the scalar linear referencing does.
+ *
+ * @param px x coordinate of p
+ * @param py y coordinate of p
+ * @param x x coordinates of the points of the polyline
+ * @param y y coordinates of the points of the polyline
+ * @param num_points number of points, at least 2
+ * @param dist2 the squared distance from p to the closest segment
+ * @return index of the closest segment, from the point index to index+1
+ */
+int closest_segment(double px, double py, const double *x, const double *y,
+                    int num_points, double *dist2);
+
+/**
+ * Get the name of the instruction set used by closest_segment
+ * @return "avx2", "neon" or "scalar"
+ */
+const char *closest_segment_kernel();
+
+} // ALGORITHM
+} // FMM
+
+#endif // FMM_PROJECTION_KERNEL_HPP
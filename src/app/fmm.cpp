@@ -21,6 +21,5 @@ int main(int argc, char **argv){
     return 0;
   }
   FMMApp app(config);
-  app.run();
-  return 0;
+  return app.run() ? 0 : 1;
 };
@@ -0,0 +1,105 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_coordinator command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/fmm_coordinator.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+#include <csignal>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+namespace {
+FMMCoordinator *running_coordinator = nullptr;
+
+void handle_signal(int signal) {
+  if (running_coordinator != nullptr) running_coordinator->stop();
+}
+
+void print_help() {
+  std::cout << "fmm_coordinator argument lists:\n";
+  std::cout << "--regions (required) <string>: Region file with the url "
+               "of the fmm_server\n";
+  std::cout << "  of each region, written by region_gen\n";
+  std::cout << "--port (optional) <int>: port listened (8080)\n";
+  std::cout << "--threads (optional) <int>: threads answering the "
+               "requests, 0 for the number of cores (0)\n";
+  std::cout << "--max_body (optional) <int>: largest request body "
+               "accepted in MB (64)\n";
+  std::cout << "--timeout (optional) <int>: seconds waited for a region "
+               "server (60)\n";
+  std::cout << "--output_precision (optional) <int>: decimals of the "
+               "coordinates of mgeom, negative for 12 significant "
+               "digits (-1)\n";
+  std::cout << "-l/--log_level (optional) <int>: log level (2)\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The requests are those of fmm_server. Each trajectory is "
+               "split into the\n";
+  std::cout << "spans of its regions, matched by the fmm_server of the "
+               "regions and\n";
+  std::cout << "stitched where two spans share a point.\n";
+}
+}
+
+int main(int argc, char **argv){
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("fmm_coordinator",
+                           "Distribute map matching over region servers");
+  options.add_options()
+    ("regions","Region file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("port","Port listened",cxxopts::value<int>()->default_value("8080"))
+    ("threads","Threads answering the requests",
+    cxxopts::value<int>()->default_value("0"))
+    ("max_body","Largest request body accepted in MB",
+    cxxopts::value<int>()->default_value("64"))
+    ("timeout","Seconds waited for a region server",
+    cxxopts::value<int>()->default_value("60"))
+    ("output_precision","Decimals of the coordinates written",
+    cxxopts::value<int>()->default_value("-1"))
+    ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
+    ("h,help","Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string region_file = result["regions"].as<std::string>();
+  if (result.count("help") > 0 || region_file.empty()) {
+    print_help();
+    return 0;
+  }
+  spdlog::set_level(
+      (spdlog::level::level_enum) result["log_level"].as<int>());
+  FMMCoordinatorOptions coordinator_options;
+  coordinator_options.port = result["port"].as<int>();
+  coordinator_options.threads = result["threads"].as<int>();
+  coordinator_options.max_body = result["max_body"].as<int>();
+  coordinator_options.timeout = result["timeout"].as<int>();
+  coordinator_options.output_precision =
+      result["output_precision"].as<int>();
+  NETWORK::RegionPartition partition;
+  if (!NETWORK::RegionPartition::read(region_file, &partition)) return 1;
+  if (partition.size() == 0) {
+    SPDLOG_CRITICAL("No region in {}", region_file);
+    return 1;
+  }
+  SPDLOG_INFO("Regions {} read from {}", partition.size(), region_file);
+  FMMCoordinator coordinator(partition, coordinator_options);
+  running_coordinator = &coordinator;
+  // Without SA_RESTART, accept is interrupted by the signals
+  struct sigaction action{};
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  coordinator.run();
+  running_coordinator = nullptr;
+  return 0;
+};
@@ -0,0 +1,112 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_export command line program main function, which writes the
+ * results of a match state file in any output format and fields without
+ * matching the trajectories again.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/match_state.hpp"
+#include "config/result_config.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::IO;
+
+void print_help() {
+  std::cout << "fmm_export argument lists:\n";
+  std::cout << "--network (required) <string>: Network file name, the one "
+               "matched on\n";
+  std::cout << "--network_id (optional) <string>: Network id name (id)\n";
+  std::cout << "--source (optional) <string>: Network source name "
+               "(source)\n";
+  std::cout << "--target (optional) <string>: Network target name "
+               "(target)\n";
+  std::cout << "--state (required) <string>: Match state file written "
+               "with --output_format state\n";
+  std::cout << "--output (required) <string>: Output file name\n";
+  std::cout << "--output_fields (optional) <string>: Output fields\n";
+  std::cout << "  opath,cpath,tpath,mgeom,pgeom,\n";
+  std::cout << "  offset,error,spdist,tp,ep,length,all\n";
+  std::cout << "--output_precision (optional) <int>: decimals of the "
+               "coordinates of pgeom and mgeom\n";
+  std::cout << "--output_format (optional) <string>: csv, arrow, edges "
+               "or index (csv)\n";
+  std::cout << "--output_shard_size (optional) <int>: rows written into "
+               "each shard of a csv output (0)\n";
+  std::cout << "--use_omp: decode and format the results with multiple "
+               "threads\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The segment and partial fields are written if they were "
+               "written with the state.\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("fmm_export",
+                           "Write the results of a match state file");
+  options.add_options()
+    ("network","Network file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("state","Match state file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("o,output","Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("output_fields","Output fields",
+    cxxopts::value<std::string>()->default_value(""))
+    ("output_precision","Decimals of the coordinates written",
+    cxxopts::value<int>())
+    ("output_format","Format of the output file, csv, arrow, edges or index",
+    cxxopts::value<std::string>())
+    ("output_shard_size","Rows written into each shard of the output",
+    cxxopts::value<int>())
+    ("use_omp","Use parallel computing if specified")
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string network_file = result["network"].as<std::string>();
+  std::string state_file = result["state"].as<std::string>();
+  if (result.count("help") > 0 || network_file.empty() ||
+      state_file.empty() || result["output"].as<std::string>().empty()) {
+    print_help();
+    return 0;
+  }
+  CONFIG::ResultConfig result_config =
+      CONFIG::ResultConfig::load_from_arg(result);
+  if (result_config.format == "state") {
+    SPDLOG_CRITICAL("A match state is not exported as a match state");
+    return 1;
+  }
+  if (!result_config.validate()) return 1;
+  std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+  Network network(network_file, result["network_id"].as<std::string>(),
+                  result["source"].as<std::string>(),
+                  result["target"].as<std::string>());
+  MatchStateReader reader(state_file);
+  long long written = export_match_state(reader, network, result_config,
+                                         result.count("use_omp") > 0);
+  if (written < 0) return 1;
+  std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now();
+  SPDLOG_INFO("Time takes {}",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  end - begin).count() / 1000.);
+  return 0;
+};
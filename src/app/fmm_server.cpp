@@ -0,0 +1,50 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_server command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/fmm_server.hpp"
+
+#include <csignal>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+namespace {
+FMMServer *running_server = nullptr;
+
+void handle_signal(int signal) {
+  if (running_server == nullptr) return;
+  if (signal == SIGHUP) {
+    running_server->request_reload();
+  } else {
+    running_server->stop();
+  }
+}
+}
+
+int main(int argc, char **argv){
+  FMMServerConfig config(argc,argv);
+  if (config.help_specified) {
+    FMMServerConfig::print_help();
+    return 0;
+  }
+  if (!config.validate()){
+    return 0;
+  }
+  FMMServer server(config);
+  running_server = &server;
+  // Without SA_RESTART, accept is interrupted by the signals
+  struct sigaction action{};
+  action.sa_handler = handle_signal;
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+  sigaction(SIGHUP, &action, nullptr);
+  server.run();
+  running_server = nullptr;
+  return 0;
+};
@@ -0,0 +1,104 @@
+/**
+ * Fast map matching.
+ *
+ * gps_convert command line program main function, which converts a GPS
+ * file into a binary trajectory file read without parsing text.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/binary_trajectory.hpp"
+#include "config/gps_config.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::CONFIG;
+using namespace FMM::IO;
+
+void print_help() {
+  std::cout << "gps_convert argument lists:\n";
+  std::cout << "--gps (required) <string>: GPS file name, as in fmm\n";
+  std::cout << "--gps_id (optional) <string>: GPS id name (id)\n";
+  std::cout << "--gps_x (optional) <string>: GPS x name (x)\n";
+  std::cout << "--gps_y (optional) <string>: GPS y name (y)\n";
+  std::cout << "--gps_timestamp (optional) <string>: "
+               "GPS timestamp name (timestamp)\n";
+  std::cout << "--gps_geom (optional) <string>: GPS geometry name (geom)\n";
+  std::cout << "--gps_point (optional): read a CSV file of points\n";
+  std::cout << "--gps_read_threads (optional) <int>: threads reading a\n";
+  std::cout << "  CSV, shapefile or GeoPackage GPS file in blocks (1)\n";
+  std::cout << "--gps_timestamp_format (optional) <string>: timestamps\n";
+  std::cout << "  of a CSV file in seconds, ms, us or iso8601 (seconds)\n";
+  std::cout << "--output (required) <string>: Output file name, with "
+               "traj extension\n";
+  std::cout << "--compress (optional): compress the blocks of the output\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The output is read by fmm, stmatch and hybrid as "
+               "--gps file\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("gps_convert",
+                           "Convert a GPS file into a binary trajectory "
+                           "file");
+  options.add_options()
+    ("gps","GPS file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("gps_id","GPS file id",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("gps_x","GPS x name",
+    cxxopts::value<std::string>()->default_value("x"))
+    ("gps_y","GPS y name",
+    cxxopts::value<std::string>()->default_value("y"))
+    ("gps_geom","GPS file geom column name",
+    cxxopts::value<std::string>()->default_value("geom"))
+    ("gps_timestamp","GPS file timestamp column name",
+    cxxopts::value<std::string>()->default_value("timestamp"))
+    ("gps_read_threads","Threads reading a GPS file",
+    cxxopts::value<int>())
+    ("gps_timestamp_format","Format of the timestamps of a CSV file",
+    cxxopts::value<std::string>())
+    ("gps_point","GPS point or not")
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("compress", "Compress the blocks of the output")
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || output.empty()) {
+    print_help();
+    return 0;
+  }
+  GPSConfig config = GPSConfig::load_from_arg(result);
+  config.print();
+  if (!config.validate()) return 1;
+  if (!UTIL::check_file_extension(output, "traj")) {
+    SPDLOG_CRITICAL("Output file {} should have traj extension", output);
+    return 1;
+  }
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  GPSReader reader(config);
+  BinaryTrajectoryWriter writer(output, result.count("compress") > 0);
+  long trajectories = 0;
+  long points = 0;
+  while (reader.has_next_trajectory()) {
+    CORE::Trajectory traj = reader.read_next_trajectory();
+    if (!writer.write_trajectory(traj)) break;
+    ++trajectories;
+    points += traj.geom.get_num_points();
+  }
+  if (!writer.close()) return 1;
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  SPDLOG_INFO("Convert trajectories {} points {} in {:.1f}s", trajectories,
+              points, elapsed);
+  return 0;
+};
@@ -0,0 +1,161 @@
+/**
+ * Fast map matching.
+ *
+ * gps_synth command line program main function, which generates
+ * synthetic trajectories on a network for benchmarking.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "network/trajectory_generator.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+#include <fstream>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+void print_help() {
+  std::cout << "gps_synth argument lists:\n";
+  std::cout << "--network (required) <string>: Network file name\n";
+  std::cout << "--network_id (optional) <string>: Network id name (id)\n";
+  std::cout << "--source (optional) <string>: Network source name "
+               "(source)\n";
+  std::cout << "--target (optional) <string>: Network target name "
+               "(target)\n";
+  std::cout << "--output (required) <string>: Output file name, a CSV file "
+               "of id;geom;timestamp;route\n";
+  std::cout << "--trajectories (optional) <int>: number of trajectories "
+               "(1000)\n";
+  std::cout << "--min_length (optional) <double>: minimum length of a "
+               "route (1000)\n";
+  std::cout << "--max_length (optional) <double>: maximum length of a "
+               "route (5000)\n";
+  std::cout << "--interval (optional) <double>: seconds between two "
+               "points (10)\n";
+  std::cout << "--speed (optional) <double>: speed along the route per "
+               "second (10)\n";
+  std::cout << "--error (optional) <double>: standard deviation of the "
+               "GPS noise (10)\n";
+  std::cout << "--outage_rate (optional) <double>: probability that an\n";
+  std::cout << "  outage without points starts at a point (0)\n";
+  std::cout << "--outage_duration (optional) <double>: mean seconds of an "
+               "outage (60)\n";
+  std::cout << "--seed (optional) <int>: seed of the random numbers (0)\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The distances are in the unit of the network. The output\n";
+  std::cout << "is read by fmm, stmatch and hybrid as --gps file, and the\n";
+  std::cout << "route column holds the ids of the edges driven.\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("gps_synth",
+                           "Generate synthetic trajectories on a network");
+  options.add_options()
+    ("network","Network file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("trajectories","Number of trajectories",
+    cxxopts::value<int>()->default_value("1000"))
+    ("min_length","Minimum length of a route",
+    cxxopts::value<double>()->default_value("1000"))
+    ("max_length","Maximum length of a route",
+    cxxopts::value<double>()->default_value("5000"))
+    ("interval","Seconds between two points",
+    cxxopts::value<double>()->default_value("10"))
+    ("speed","Speed along the route",
+    cxxopts::value<double>()->default_value("10"))
+    ("error","Standard deviation of the GPS noise",
+    cxxopts::value<double>()->default_value("10"))
+    ("outage_rate","Probability that an outage starts at a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("outage_duration","Mean seconds of an outage",
+    cxxopts::value<double>()->default_value("60"))
+    ("seed","Seed of the random numbers",
+    cxxopts::value<int>()->default_value("0"))
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string network_file = result["network"].as<std::string>();
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || network_file.empty() || output.empty()) {
+    print_help();
+    return 0;
+  }
+  TrajectoryGeneratorOptions generator_options;
+  generator_options.min_length = result["min_length"].as<double>();
+  generator_options.max_length = result["max_length"].as<double>();
+  generator_options.interval = result["interval"].as<double>();
+  generator_options.speed = result["speed"].as<double>();
+  generator_options.error = result["error"].as<double>();
+  generator_options.outage_rate = result["outage_rate"].as<double>();
+  generator_options.outage_duration = result["outage_duration"].as<double>();
+  int trajectories = result["trajectories"].as<int>();
+  if (generator_options.interval <= 0 || generator_options.speed <= 0 ||
+      generator_options.max_length < generator_options.min_length) {
+    SPDLOG_CRITICAL("Invalid interval, speed or route lengths");
+    return 1;
+  }
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  Network network(network_file, result["network_id"].as<std::string>(),
+                  result["source"].as<std::string>(),
+                  result["target"].as<std::string>());
+  NetworkGraph graph(network);
+  TrajectoryGenerator generator(network, graph, generator_options,
+                                result["seed"].as<int>());
+  std::ofstream stream(output);
+  if (!stream.is_open()) {
+    SPDLOG_CRITICAL("Failed to open file {}", output);
+    return 1;
+  }
+  stream.precision(12);
+  stream << "id;geom;timestamp;route\n";
+  long points = 0;
+  int generated = 0;
+  CORE::Trajectory traj;
+  std::vector<EdgeID> route;
+  for (; generated < trajectories; ++generated) {
+    if (!generator.generate(generated + 1, &traj, &route)) break;
+    stream << traj.id << ";LINESTRING(";
+    for (int i = 0; i < traj.geom.get_num_points(); ++i) {
+      if (i > 0) stream << ",";
+      stream << traj.geom.get_x(i) << " " << traj.geom.get_y(i);
+    }
+    stream << ");";
+    for (std::size_t i = 0; i < traj.timestamps.size(); ++i) {
+      if (i > 0) stream << ",";
+      stream << traj.timestamps[i];
+    }
+    stream << ";";
+    for (std::size_t i = 0; i < route.size(); ++i) {
+      if (i > 0) stream << ",";
+      stream << route[i];
+    }
+    stream << "\n";
+    points += traj.geom.get_num_points();
+  }
+  stream.close();
+  if (stream.fail()) {
+    SPDLOG_CRITICAL("Failed to write file {}", output);
+    return 1;
+  }
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  SPDLOG_INFO("Generate trajectories {} points {} in {:.1f}s", generated,
+              points, elapsed);
+  return generated == trajectories ? 0 : 1;
+};
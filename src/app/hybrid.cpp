@@ -0,0 +1,26 @@
+/**
+ * Fast map matching.
+ *
+ * hybrid command line program main function
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/hybrid/hybrid_app.hpp"
+
+using namespace FMM;
+using namespace FMM::MM;
+
+int main(int argc, char **argv){
+  HybridAppConfig config(argc,argv);
+  if (config.help_specified) {
+    HybridAppConfig::print_help();
+    return 0;
+  }
+  if (!config.validate()){
+    return 0;
+  }
+  HybridApp app(config);
+  return app.run() ? 0 : 1;
+};
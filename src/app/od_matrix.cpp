@@ -0,0 +1,168 @@
+/**
+ * Fast map matching.
+ *
+ * od_matrix command line program main function, which computes the
+ * network distances from a set of origins to a set of destinations.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/distance_matrix.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+void print_help() {
+  std::cout << "od_matrix argument lists:\n";
+  std::cout << "--network (required) <string>: Network file name\n";
+  std::cout << "--network_id (optional) <string>: Network id name (id)\n";
+  std::cout << "--source (optional) <string>: Network source name "
+               "(source)\n";
+  std::cout << "--target (optional) <string>: Network target name "
+               "(target)\n";
+  std::cout << "--ubodt (required) <string>: Ubodt file name\n";
+  std::cout << "--origins (required) <string>: CSV file of the origins "
+               "with x and y columns\n";
+  std::cout << "--destinations (optional) <string>: CSV file of the "
+               "destinations, the origins if not specified\n";
+  std::cout << "--delim (optional) <char>: delimiter of the CSV files "
+               "(;)\n";
+  std::cout << "--output (required) <string>: Binary matrix file name\n";
+  std::cout << "-r/--radius (optional) <double>: search radius of the "
+               "edge of each point (300)\n";
+  std::cout << "--max_distance (optional) <double>: upper bound of the "
+               "searches of the pairs\n";
+  std::cout << "  missing in ubodt, 0 for no bound (0)\n";
+  std::cout << "--snap_nodes: snap the points to their nearest nodes "
+               "instead of edges\n";
+  std::cout << "--use_omp: use OpenMP for multithreaded computation\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The matrix file starts with the magic FMMODMAT, a 32-bit "
+               "version, 4 bytes of\n";
+  std::cout << "padding and the numbers of rows and columns as 64-bit "
+               "integers, followed by\n";
+  std::cout << "the distances in row major order as 64-bit floats, "
+               "-1 where a point is not\n";
+  std::cout << "snapped or the destination is not reached.\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("od_matrix",
+                           "Network distances between two sets of points");
+  options.add_options()
+    ("network","Network file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("ubodt","Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("origins","CSV file of the origins",
+    cxxopts::value<std::string>()->default_value(""))
+    ("destinations","CSV file of the destinations",
+    cxxopts::value<std::string>()->default_value(""))
+    ("delim","Delimiter of the CSV files",
+    cxxopts::value<std::string>()->default_value(";"))
+    ("o,output", "Binary matrix file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("r,radius","Search radius",
+    cxxopts::value<double>()->default_value("300"))
+    ("max_distance","Upper bound of the searches",
+    cxxopts::value<double>()->default_value("0"))
+    ("snap_nodes","Snap the points to nodes if specified")
+    ("use_omp","Use parallel computing if specified")
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string network_file = result["network"].as<std::string>();
+  std::string ubodt_file = result["ubodt"].as<std::string>();
+  std::string origins_file = result["origins"].as<std::string>();
+  std::string destinations_file = result["destinations"].as<std::string>();
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || network_file.empty() ||
+      ubodt_file.empty() || origins_file.empty() || output.empty()) {
+    print_help();
+    return 0;
+  }
+  double radius = result["radius"].as<double>();
+  double max_distance = result["max_distance"].as<double>();
+  bool use_omp = result.count("use_omp") > 0;
+  bool snap_nodes = result.count("snap_nodes") > 0;
+  std::string delim = result["delim"].as<std::string>();
+  if (radius <= 0 || max_distance < 0 || delim.size() != 1) {
+    SPDLOG_CRITICAL("Invalid radius {}, max distance {} or delimiter {}",
+                    radius, max_distance, delim);
+    return 1;
+  }
+  std::vector<Point> origin_points, destination_points;
+  if (!DistanceMatrix::read_points(origins_file, delim[0], &origin_points)) {
+    return 1;
+  }
+  if (destinations_file.empty()) {
+    destination_points = origin_points;
+  } else if (!DistanceMatrix::read_points(destinations_file, delim[0],
+                                          &destination_points)) {
+    return 1;
+  }
+  std::chrono::steady_clock::time_point begin =
+      std::chrono::steady_clock::now();
+  Network network(network_file, result["network_id"].as<std::string>(),
+                  result["source"].as<std::string>(),
+                  result["target"].as<std::string>());
+  NetworkGraph graph(network);
+  std::shared_ptr<UBODT> ubodt = UBODT::read_ubodt_file(ubodt_file);
+  if (ubodt == nullptr) return 1;
+  DistanceMatrix matrix(network, graph, ubodt);
+  DistanceMatrixStatistics statistics;
+  std::vector<double> distances;
+  long rows = origin_points.size(), columns = destination_points.size();
+  long unsnapped = 0;
+  if (snap_nodes) {
+    std::vector<int> origins =
+        matrix.snap_nodes(origin_points, radius, use_omp);
+    std::vector<int> destinations =
+        matrix.snap_nodes(destination_points, radius, use_omp);
+    for (int u : origins) unsnapped += u < 0;
+    for (int v : destinations) unsnapped += v < 0;
+    distances = matrix.compute_nodes(origins, destinations, max_distance,
+                                     use_omp, &statistics);
+  } else {
+    std::vector<Candidate> origins =
+        matrix.snap_points(origin_points, radius, use_omp);
+    std::vector<Candidate> destinations =
+        matrix.snap_points(destination_points, radius, use_omp);
+    for (const Candidate &c : origins) unsnapped += c.edge == nullptr;
+    for (const Candidate &c : destinations) unsnapped += c.edge == nullptr;
+    distances = matrix.compute(origins, destinations, max_distance, use_omp,
+                               &statistics);
+  }
+  if (unsnapped > 0) {
+    SPDLOG_WARN("Points without {} within radius {}",
+                snap_nodes ? "node" : "edge", unsnapped);
+  }
+  SPDLOG_INFO("Node pairs {} found in ubodt {} by {} searches {}",
+              statistics.node_pairs, statistics.ubodt_pairs,
+              statistics.searches, statistics.searched_pairs);
+  if (!DistanceMatrix::write_matrix(output, rows, columns, distances)) {
+    return 1;
+  }
+  std::chrono::steady_clock::time_point end =
+      std::chrono::steady_clock::now();
+  SPDLOG_INFO("Time takes {}",
+              std::chrono::duration_cast<std::chrono::milliseconds>(
+                  end - begin).count() / 1000.);
+  return 0;
+};
@@ -0,0 +1,104 @@
+/**
+ * Fast map matching.
+ *
+ * region_gen command line program main function, which partitions a
+ * network into the regions matched by different fmm_server.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "network/network.hpp"
+#include "network/region_partition.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+void print_help() {
+  std::cout << "region_gen argument lists:\n";
+  std::cout << "--network (required) <string>: Network file name\n";
+  std::cout << "--network_id (optional) <string>: Network id name (id)\n";
+  std::cout << "--source (optional) <string>: Network source name "
+               "(source)\n";
+  std::cout << "--target (optional) <string>: Network target name "
+               "(target)\n";
+  std::cout << "--output (required) <string>: Region file name\n";
+  std::cout << "--rows (optional) <int>: rows of the grid of regions (1)\n";
+  std::cout << "--columns (optional) <int>: columns of the grid of "
+               "regions (2)\n";
+  std::cout << "--margin (optional) <double>: overlap of the regions, "
+               "larger than the\n";
+  std::cout << "  search radius and the distance between two points "
+               "(1000)\n";
+  std::cout << "--url (optional) <string>: url of the server of each "
+               "region, where {}\n";
+  std::cout << "  is replaced by the index of the region "
+               "(http://region{}:8080)\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The UBODT of a region is generated by ubodt_gen with "
+               "--regions and --region,\n";
+  std::cout << "and served by fmm_server behind fmm_coordinator.\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("region_gen",
+                           "Partition a network into regions");
+  options.add_options()
+    ("network","Network file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("o,output", "Region file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("rows","Rows of the grid",cxxopts::value<int>()->default_value("1"))
+    ("columns","Columns of the grid",
+    cxxopts::value<int>()->default_value("2"))
+    ("margin","Overlap of the regions",
+    cxxopts::value<double>()->default_value("1000"))
+    ("url","Url of the server of each region",
+    cxxopts::value<std::string>()->default_value("http://region{}:8080"))
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string network_file = result["network"].as<std::string>();
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || network_file.empty() || output.empty()) {
+    print_help();
+    return 0;
+  }
+  int rows = result["rows"].as<int>();
+  int columns = result["columns"].as<int>();
+  double margin = result["margin"].as<double>();
+  if (rows < 1 || columns < 1 || margin < 0) {
+    SPDLOG_CRITICAL("Invalid grid {} x {} or margin {}", rows, columns,
+                    margin);
+    return 1;
+  }
+  Network network(network_file, result["network_id"].as<std::string>(),
+                  result["source"].as<std::string>(),
+                  result["target"].as<std::string>());
+  RegionPartition partition = RegionPartition::create_grid(
+      network.get_vertex_points(), rows, columns, margin);
+  std::string url = result["url"].as<std::string>();
+  std::size_t placeholder = url.find("{}");
+  for (int i = 0; i < partition.size(); ++i) {
+    Region &region = partition.get_region(i);
+    region.url = url;
+    if (placeholder != std::string::npos) {
+      region.url.replace(placeholder, 2, std::to_string(i));
+    }
+  }
+  if (!partition.write(output)) return 1;
+  SPDLOG_INFO("Write regions {} to {}", partition.size(), output);
+  return 0;
+};
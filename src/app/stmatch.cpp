@@ -22,6 +22,5 @@ int main(int argc, char **argv){
     return 0;
   }
   STMATCHApp app(config);
-  app.run();
-  return 0;
+  return app.run() ? 0 : 1;
 };
@@ -0,0 +1,62 @@
+/**
+ * Fast map matching.
+ *
+ * ubodt_merge command line program main function, which merges the UBODT
+ * shards written by ubodt_gen into a single UBODT file.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/ubodt_shard.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::MM;
+
+void print_help() {
+  std::cout << "ubodt_merge argument lists:\n";
+  std::cout << "--shards (required) <string>: Shard file names "
+               "separated by ,\n";
+  std::cout << "--output (required) <string>: Output file name\n";
+  std::cout << "  csv or txt for CSV, bin for binary, with shards of the "
+               "same format,\n";
+  std::cout << "  mmap for memory mapped flat table,\n";
+  std::cout << "  ubz for block compressed table\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "Each shard is generated by ubodt_gen with --partition "
+               "or a source range\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("ubodt_merge",
+                           "Merge UBODT shards into a UBODT file");
+  options.add_options()
+    ("shards", "Shard file names",
+    cxxopts::value<std::string>()->default_value(""))
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::vector<std::string> shards =
+      UTIL::split_string(result["shards"].as<std::string>());
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || shards.empty() || output.empty()) {
+    print_help();
+    return 0;
+  }
+  for (const std::string &shard : shards) {
+    if (!UTIL::file_exists(shard)) {
+      SPDLOG_CRITICAL("Shard file not exists {}", shard);
+      return 1;
+    }
+  }
+  return UBODTShard::merge_shards(shards, output) ? 0 : 1;
+};
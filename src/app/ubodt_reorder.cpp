@@ -0,0 +1,81 @@
+/**
+ * Fast map matching.
+ *
+ * ubodt_reorder command line program main function, which rewrites a
+ * UBODT with the rows of the sources probed most stored first, from the
+ * probes counted by fmm with --ubodt_probe_file.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/ubodt.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::MM;
+
+void print_help() {
+  std::cout << "ubodt_reorder argument lists:\n";
+  std::cout << "--ubodt (required) <string>: Ubodt file name\n";
+  std::cout << "--probes (required) <string>: CSV file of the probes of "
+               "each source,\n";
+  std::cout << "  written by fmm with --ubodt_probe_file\n";
+  std::cout << "--output (required) <string>: Output file name, mmap for "
+               "memory\n";
+  std::cout << "  mapped flat table, whose slots keep the order\n";
+  std::cout << "--compact: write compact records with the cost in single "
+               "precision\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "The rows of the hottest sources take their home slots, so "
+               "that\n";
+  std::cout << "their look ups probe the fewest slots\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("ubodt_reorder",
+                           "Store the rows of a UBODT probed most first");
+  options.add_options()
+    ("ubodt", "Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("probes", "CSV file of the probes of each source",
+    cxxopts::value<std::string>()->default_value(""))
+    ("o,output", "Output file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("compact", "Write compact records if specified")
+    ("h,help", "Help information");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string ubodt_file = result["ubodt"].as<std::string>();
+  std::string probe_file = result["probes"].as<std::string>();
+  std::string output = result["output"].as<std::string>();
+  if (result.count("help") > 0 || ubodt_file.empty() ||
+      probe_file.empty() || output.empty()) {
+    print_help();
+    return 0;
+  }
+  if (!UTIL::file_exists(ubodt_file)) {
+    SPDLOG_CRITICAL("Ubodt file not exists {}", ubodt_file);
+    return 1;
+  }
+  if (!UTIL::check_file_extension(output, "mmap")) {
+    SPDLOG_CRITICAL("Output file should have mmap extension {}", output);
+    return 1;
+  }
+  std::vector<long long> counts;
+  if (!UBODT::read_probe_counts(probe_file, &counts)) return 1;
+  UBODTLayout layout = result.count("compact") > 0 ? COMPACT : FLAT;
+  std::shared_ptr<UBODT> ubodt =
+      UBODT::read_ubodt_file(ubodt_file, 50000, layout, true);
+  if (ubodt == nullptr) return 1;
+  std::shared_ptr<UBODT> reordered = ubodt->reorder_by_probes(counts);
+  if (reordered == nullptr) return 1;
+  ubodt.reset();
+  return reordered->write_ubodt_mmap(output) ? 0 : 1;
+};
@@ -0,0 +1,70 @@
+/**
+ * Fast map matching.
+ *
+ * ubodt_shm command line program main function, which publishes UBODT
+ * into POSIX shared memory to be attached by fmm processes.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/ubodt.hpp"
+#include "util/util.hpp"
+#include "cxxopts/cxxopts.hpp"
+
+using namespace FMM;
+using namespace FMM::MM;
+
+void print_help() {
+  std::cout << "ubodt_shm argument lists:\n";
+  std::cout << "--ubodt (required) <string>: Ubodt file name to publish\n";
+  std::cout << "--name (required) <string>: Shared memory name, "
+               "e.g., /ubodt\n";
+  std::cout << "--ubodt_layout (optional) <string>: flat or compact (flat)\n";
+  std::cout << "--remove: remove the shared memory instead of publishing\n";
+  std::cout << "-h/--help: help information\n";
+  std::cout << "fmm attaches the table with --ubodt shm:<name>\n";
+}
+
+int main(int argc, char **argv) {
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  cxxopts::Options options("ubodt_shm",
+                           "Publish UBODT into shared memory");
+  options.add_options()
+    ("ubodt", "Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("name", "Shared memory name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_layout", "Ubodt storage layout",
+    cxxopts::value<std::string>()->default_value("flat"))
+    ("h,help", "Help information")
+    ("remove", "Remove the shared memory");
+  if (argc == 1) {
+    print_help();
+    return 0;
+  }
+  auto result = options.parse(argc, argv);
+  std::string name = result["name"].as<std::string>();
+  if (result.count("help") > 0 || name.empty()) {
+    print_help();
+    return 0;
+  }
+  if (result.count("remove") > 0) {
+    return UBODT::remove_ubodt_shm(name) ? 0 : 1;
+  }
+  std::string ubodt_file = result["ubodt"].as<std::string>();
+  std::string layout_name = result["ubodt_layout"].as<std::string>();
+  UBODTLayout layout;
+  if (!UBODT::string2layout(layout_name, &layout) ||
+      (layout != FLAT && layout != COMPACT)) {
+    SPDLOG_CRITICAL("UBODT layout should be flat or compact");
+    return 1;
+  }
+  if (!UTIL::file_exists(ubodt_file)) {
+    SPDLOG_CRITICAL("UBODT file not exists {}", ubodt_file);
+    return 1;
+  }
+  std::shared_ptr<UBODT> ubodt =
+      UBODT::read_ubodt_file(ubodt_file, 50000, layout, true);
+  return ubodt->publish_ubodt_shm(name) ? 0 : 1;
+};
@@ -0,0 +1,246 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "capi/fmm_capi.h"
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <memory>
+#include <string>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+struct fmm_network {
+  std::unique_ptr<Network> network;
+  std::unique_ptr<NetworkGraph> graph;
+};
+
+struct fmm_ubodt {
+  std::shared_ptr<UBODT> ubodt;
+};
+
+struct fmm_model {
+  std::unique_ptr<FastMapMatch> fmm;
+  FastMapMatchConfig fmm_config;
+  std::unique_ptr<STMATCH> stmatch;
+  STMATCHConfig stmatch_config;
+};
+
+namespace {
+
+std::string &last_error() {
+  static thread_local std::string message;
+  return message;
+}
+
+fmm_status fail(fmm_status status, const std::string &message) {
+  last_error() = message;
+  return status;
+}
+
+// Copy the result into the buffers of the caller, setting the sizes even
+// if a buffer is too small
+fmm_status copy_result(const MatchResult &mr, int num_points,
+                       fmm_result *result) {
+  bool candidates = !mr.opt_candidate_path.empty();
+  int num_matched = candidates ? mr.opt_candidate_path.size()
+                               : mr.indices.size();
+  result->num_matched = num_matched;
+  result->cpath_size = mr.cpath.size();
+  result->mgeom_size = mr.mgeom.get_num_points();
+  if (num_matched > num_points ||
+      (result->cpath != nullptr &&
+       result->cpath_size > result->cpath_capacity) ||
+      (result->mgeom != nullptr &&
+       result->mgeom_size > result->mgeom_capacity)) {
+    return fail(FMM_BUFFER_TOO_SMALL, "result larger than its buffers");
+  }
+  for (int i = 0; i < num_matched; ++i) {
+    if (result->indices != nullptr) result->indices[i] = mr.indices[i];
+    if (!candidates) continue;
+    const MatchedCandidate &mc = mr.opt_candidate_path[i];
+    if (result->opath != nullptr) result->opath[i] = mr.opath[i];
+    if (result->offsets != nullptr) result->offsets[i] = mc.c.offset;
+    if (result->pgeom != nullptr) {
+      result->pgeom[2 * i] = boost::geometry::get<0>(mc.c.point);
+      result->pgeom[2 * i + 1] = boost::geometry::get<1>(mc.c.point);
+    }
+  }
+  if (result->cpath != nullptr) {
+    std::copy(mr.cpath.begin(), mr.cpath.end(), result->cpath);
+  }
+  if (result->mgeom != nullptr) {
+    for (int i = 0; i < result->mgeom_size; ++i) {
+      result->mgeom[2 * i] = mr.mgeom.get_x(i);
+      result->mgeom[2 * i + 1] = mr.mgeom.get_y(i);
+    }
+  }
+  return FMM_OK;
+}
+
+} // namespace
+
+extern "C" {
+
+int fmm_capi_version(void) {
+  return FMM_CAPI_VERSION;
+}
+
+const char *fmm_last_error(void) {
+  return last_error().c_str();
+}
+
+fmm_status fmm_network_load(const char *filename, const char *id_name,
+                            const char *source_name,
+                            const char *target_name,
+                            fmm_network **network) {
+  if (filename == nullptr || network == nullptr) {
+    return fail(FMM_INVALID_ARGUMENT, "null network file name");
+  }
+  // The network reader exits the process on a missing file
+  if (!UTIL::file_exists(filename)) {
+    return fail(FMM_ERROR, std::string("Network not found ") + filename);
+  }
+  try {
+    std::unique_ptr<fmm_network> output(new fmm_network);
+    output->network.reset(new Network(
+        filename, id_name != nullptr ? id_name : "id",
+        source_name != nullptr ? source_name : "source",
+        target_name != nullptr ? target_name : "target"));
+    output->graph.reset(new NetworkGraph(*output->network));
+    *network = output.release();
+    return FMM_OK;
+  } catch (const std::exception &e) {
+    return fail(FMM_ERROR, e.what());
+  }
+}
+
+void fmm_network_free(fmm_network *network) {
+  delete network;
+}
+
+int fmm_network_edge_count(const fmm_network *network) {
+  return network != nullptr ? network->network->get_edge_count() : 0;
+}
+
+int fmm_network_node_count(const fmm_network *network) {
+  return network != nullptr ? network->network->get_node_count() : 0;
+}
+
+fmm_status fmm_ubodt_load(const char *filename, fmm_ubodt **ubodt) {
+  if (filename == nullptr || ubodt == nullptr) {
+    return fail(FMM_INVALID_ARGUMENT, "null UBODT file name");
+  }
+  if (std::string(filename).compare(0, 4, "shm:") != 0 &&
+      !UTIL::file_exists(filename)) {
+    return fail(FMM_ERROR, std::string("UBODT not found ") + filename);
+  }
+  try {
+    std::shared_ptr<UBODT> table = UBODT::read_ubodt_file(filename);
+    if (table == nullptr) {
+      return fail(FMM_ERROR, std::string("UBODT not read from ") + filename);
+    }
+    *ubodt = new fmm_ubodt{table};
+    return FMM_OK;
+  } catch (const std::exception &e) {
+    return fail(FMM_ERROR, e.what());
+  }
+}
+
+void fmm_ubodt_free(fmm_ubodt *ubodt) {
+  delete ubodt;
+}
+
+fmm_status fmm_model_create_fmm(const fmm_network *network,
+                                const fmm_ubodt *ubodt, int k,
+                                double radius, double gps_error,
+                                fmm_model **model) {
+  if (network == nullptr || ubodt == nullptr || model == nullptr) {
+    return fail(FMM_INVALID_ARGUMENT, "null network or UBODT");
+  }
+  std::unique_ptr<fmm_model> output(new fmm_model);
+  output->fmm_config = FastMapMatchConfig(k, radius, gps_error);
+  if (!output->fmm_config.validate()) {
+    return fail(FMM_INVALID_ARGUMENT, "invalid fmm configuration");
+  }
+  try {
+    output->fmm.reset(new FastMapMatch(*network->network, *network->graph,
+                                       ubodt->ubodt));
+  } catch (const std::exception &e) {
+    return fail(FMM_ERROR, e.what());
+  }
+  *model = output.release();
+  return FMM_OK;
+}
+
+fmm_status fmm_model_create_stmatch(const fmm_network *network, int k,
+                                    double radius, double gps_error,
+                                    double vmax, double factor,
+                                    fmm_model **model) {
+  if (network == nullptr || model == nullptr) {
+    return fail(FMM_INVALID_ARGUMENT, "null network");
+  }
+  std::unique_ptr<fmm_model> output(new fmm_model);
+  output->stmatch_config =
+      STMATCHConfig(k, radius, gps_error, vmax, factor);
+  if (!output->stmatch_config.validate()) {
+    return fail(FMM_INVALID_ARGUMENT, "invalid stmatch configuration");
+  }
+  try {
+    output->stmatch.reset(new STMATCH(*network->network, *network->graph));
+  } catch (const std::exception &e) {
+    return fail(FMM_ERROR, e.what());
+  }
+  *model = output.release();
+  return FMM_OK;
+}
+
+void fmm_model_free(fmm_model *model) {
+  delete model;
+}
+
+fmm_status fmm_match(fmm_model *model, const double *coords,
+                     const double *timestamps, int num_points,
+                     fmm_result *result) {
+  if (model == nullptr || result == nullptr ||
+      (coords == nullptr && num_points > 0) || num_points < 0) {
+    return fail(FMM_INVALID_ARGUMENT, "null model, result or coordinates");
+  }
+  // The fields of the result which are not written are not computed
+  ResultFields fields;
+  fields.candidates = result->opath != nullptr ||
+      result->offsets != nullptr || result->pgeom != nullptr;
+  fields.mgeom = result->mgeom != nullptr;
+  try {
+    Trajectory traj{0, LineString(), {}};
+    for (int i = 0; i < num_points; ++i) {
+      traj.geom.add_point(coords[2 * i], coords[2 * i + 1]);
+    }
+    if (timestamps != nullptr) {
+      traj.timestamps.assign(timestamps, timestamps + num_points);
+    }
+    MatchResult mr;
+    if (model->fmm != nullptr) {
+      FastMapMatchConfig config = model->fmm_config;
+      config.result_fields = fields;
+      mr = model->fmm->match_traj(traj, config);
+    } else {
+      STMATCHConfig config = model->stmatch_config;
+      config.result_fields = fields;
+      mr = model->stmatch->match_traj(traj, config);
+    }
+    return copy_result(mr, num_points, result);
+  } catch (const std::exception &e) {
+    return fail(FMM_ERROR, e.what());
+  }
+}
+
+} // extern "C"
@@ -0,0 +1,179 @@
+/**
+ * Fast map matching.
+ *
+ * C API of the shared library libfmmc, which is embedded by other
+ * runtimes (JVM, Go, ...) to load a network once and match trajectories
+ * in process. The coordinates are read from buffers owned by the caller
+ * and the results are written into buffers provided by the caller.
+ *
+ * All the functions return FMM_OK on success. On failure, the message of
+ * the error is returned by fmm_last_error on the same thread.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_CAPI_H_
+#define FMM_CAPI_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(_WIN32)
+#define FMM_API __declspec(dllexport)
+#else
+#define FMM_API __attribute__((visibility("default")))
+#endif
+
+/** Version of the C API, increased when a function changes */
+#define FMM_CAPI_VERSION 1
+
+/**
+ * Status returned by the functions of the C API
+ */
+typedef enum {
+  FMM_OK = 0, /**< success */
+  FMM_ERROR = 1, /**< failure, described by fmm_last_error */
+  FMM_INVALID_ARGUMENT = 2, /**< an argument is null or out of range */
+  FMM_BUFFER_TOO_SMALL = 3 /**< a result does not fit in its buffer, the
+                                sizes of the result are still set */
+} fmm_status;
+
+/** Road network and its graph */
+typedef struct fmm_network fmm_network;
+/** Upperbounded origin destination table */
+typedef struct fmm_ubodt fmm_ubodt;
+/** Map matching model, either fmm or stmatch */
+typedef struct fmm_model fmm_model;
+
+/**
+ * Buffers receiving a match result, owned by the caller. A pointer set to
+ * null skips its field, which is then not computed if possible.
+ *
+ * The sizes are set on FMM_OK and on FMM_BUFFER_TOO_SMALL, so that the
+ * trajectory can be matched again with larger buffers. A trajectory not
+ * matched has all its sizes set to 0.
+ */
+typedef struct {
+  int *opath; /**< edge id matched to each point, num_points entries */
+  double *offsets; /**< offset of the position matched to each point on
+                        its edge, num_points entries */
+  double *pgeom; /**< x and y of the position matched to each point
+                      interleaved, 2 * num_points entries */
+  int *indices; /**< index in cpath of the edge matched to each point,
+                     num_points entries */
+  int *cpath; /**< edge ids of the complete path, cpath_capacity
+                   entries */
+  int cpath_capacity; /**< entries of cpath */
+  double *mgeom; /**< x and y of the matched path interleaved,
+                      2 * mgeom_capacity entries */
+  int mgeom_capacity; /**< points of mgeom */
+  int num_matched; /**< output, number of points matched */
+  int cpath_size; /**< output, number of edges of the complete path */
+  int mgeom_size; /**< output, number of points of the matched path */
+} fmm_result;
+
+/**
+ * Get the version of the C API of the library loaded
+ */
+FMM_API int fmm_capi_version(void);
+
+/**
+ * Get the message of the last error of the calling thread, which is
+ * empty if no error happened
+ */
+FMM_API const char *fmm_last_error(void);
+
+/**
+ * Load a network and build its graph
+ * @param  filename    network file name, read with GDAL
+ * @param  id_name     name of the id field, "id" if null
+ * @param  source_name name of the source field, "source" if null
+ * @param  target_name name of the target field, "target" if null
+ * @param  network     updated with the network loaded
+ */
+FMM_API fmm_status fmm_network_load(const char *filename,
+                                    const char *id_name,
+                                    const char *source_name,
+                                    const char *target_name,
+                                    fmm_network **network);
+/**
+ * Free a network, after the models created on it
+ */
+FMM_API void fmm_network_free(fmm_network *network);
+/**
+ * Get the number of edges of a network
+ */
+FMM_API int fmm_network_edge_count(const fmm_network *network);
+/**
+ * Get the number of nodes of a network
+ */
+FMM_API int fmm_network_node_count(const fmm_network *network);
+
+/**
+ * Load a UBODT, whose format is inferred from the file extension
+ * @param  filename UBODT file name, a name starting with shm: is
+ * attached from shared memory
+ * @param  ubodt    updated with the UBODT loaded
+ */
+FMM_API fmm_status fmm_ubodt_load(const char *filename, fmm_ubodt **ubodt);
+/**
+ * Free a UBODT, which is kept by the models created on it
+ */
+FMM_API void fmm_ubodt_free(fmm_ubodt *ubodt);
+
+/**
+ * Create a fmm model
+ * @param  network   network matched on, which should outlive the model
+ * @param  ubodt     UBODT of the network
+ * @param  k         number of candidates
+ * @param  radius    search radius, in map unit
+ * @param  gps_error gps error, in map unit
+ * @param  model     updated with the model created
+ */
+FMM_API fmm_status fmm_model_create_fmm(const fmm_network *network,
+                                        const fmm_ubodt *ubodt,
+                                        int k, double radius,
+                                        double gps_error,
+                                        fmm_model **model);
+/**
+ * Create a stmatch model
+ * @param  network   network matched on, which should outlive the model
+ * @param  k         number of candidates
+ * @param  radius    search radius, in map unit
+ * @param  gps_error gps error, in map unit
+ * @param  vmax      maximum speed of the vehicle, in map unit/second
+ * @param  factor    factor multiplied with vmax*deltaT to limit the
+ * search of the shortest paths
+ * @param  model     updated with the model created
+ */
+FMM_API fmm_status fmm_model_create_stmatch(const fmm_network *network,
+                                            int k, double radius,
+                                            double gps_error, double vmax,
+                                            double factor,
+                                            fmm_model **model);
+/**
+ * Free a model
+ */
+FMM_API void fmm_model_free(fmm_model *model);
+
+/**
+ * Match a trajectory. A model can be used by several threads at once.
+ * @param  model      model matching the trajectory
+ * @param  coords     x and y of the points interleaved, 2 * num_points
+ * entries
+ * @param  timestamps timestamps of the points, num_points entries, null
+ * if not available
+ * @param  num_points number of points
+ * @param  result     buffers receiving the result
+ */
+FMM_API fmm_status fmm_match(fmm_model *model, const double *coords,
+                             const double *timestamps, int num_points,
+                             fmm_result *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FMM_CAPI_H_
@@ -9,12 +9,42 @@ void FMM::CONFIG::GPSConfig::print() const{
     SPDLOG_INFO("File name: {} ",file);
     SPDLOG_INFO("ID name: {} ",id);
     SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Read threads: {} ",read_threads);
   } else if (format==1) {
     SPDLOG_INFO("GPS format: CSV trajectory");
     SPDLOG_INFO("File name: {} ",file);
     SPDLOG_INFO("ID name: {} ",id);
     SPDLOG_INFO("Geom name: {} ",geom);
     SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Timestamp format: {} ",timestamp_format);
+    SPDLOG_INFO("Read threads: {} ",read_threads);
+  } else if (format==4) {
+    SPDLOG_INFO("GPS format: CSV trajectory stream from stdin");
+    SPDLOG_INFO("ID name: {} ",id);
+    SPDLOG_INFO("Geom name: {} ",geom);
+    SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Timestamp format: {} ",timestamp_format);
+  } else if (format==5) {
+    SPDLOG_INFO("GPS format: Arrow {}", gps_point ? "point" : "trajectory");
+    SPDLOG_INFO("File name: {} ",file);
+    SPDLOG_INFO("ID name: {} ",id);
+    if (gps_point) {
+      SPDLOG_INFO("x name: {} ",x);
+      SPDLOG_INFO("y name: {} ",y);
+    } else {
+      SPDLOG_INFO("Geom name: {} ",geom);
+    }
+    SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Read threads: {} ",read_threads);
+  } else if (format==6) {
+    SPDLOG_INFO("GPS format: PostGIS trajectory");
+    SPDLOG_INFO("ID name: {} ",id);
+    SPDLOG_INFO("Geom name: {} ",geom);
+    SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Read threads: {} ",read_threads);
+  } else if (format==3) {
+    SPDLOG_INFO("GPS format: binary trajectory");
+    SPDLOG_INFO("File name: {} ",file);
   } else {
     SPDLOG_INFO("GPS format: CSV point");
     SPDLOG_INFO("File name: {} ",file);
@@ -22,6 +52,8 @@ void FMM::CONFIG::GPSConfig::print() const{
     SPDLOG_INFO("x name: {} ",x);
     SPDLOG_INFO("y name: {} ",y);
     SPDLOG_INFO("Timestamp name: {} ",timestamp);
+    SPDLOG_INFO("Timestamp format: {} ",timestamp_format);
+    SPDLOG_INFO("Read threads: {} ",read_threads);
   }
 };
 
@@ -37,6 +69,9 @@ FMM::CONFIG::GPSConfig FMM::CONFIG::GPSConfig::load_from_xml(
   config.y = xml_data.get("config.input.gps.y", "y");
   config.gps_point = !(!xml_data.get_child_optional(
       "config.input.gps.gps_point"));
+  config.read_threads = xml_data.get("config.input.gps.read_threads", 1);
+  config.timestamp_format = xml_data.get(
+      "config.input.gps.timestamp_format", std::string("seconds"));
   return config;
 };
 
@@ -51,10 +86,24 @@ FMM::CONFIG::GPSConfig FMM::CONFIG::GPSConfig::load_from_arg(
   config.y = arg_data["gps_y"].as<std::string>();
   if (arg_data.count("gps_point")>0)
     config.gps_point = true;
+  if (arg_data.count("gps_read_threads")>0)
+    config.read_threads = arg_data["gps_read_threads"].as<int>();
+  if (arg_data.count("gps_timestamp_format")>0)
+    config.timestamp_format =
+        arg_data["gps_timestamp_format"].as<std::string>();
   return config;
 };
 
 int FMM::CONFIG::GPSConfig::get_gps_format() const {
+  if (file == "-") return 4;
+  if (file.compare(0, 3, "PG:") == 0) {
+#ifdef FMM_WITH_POSTGIS
+    return 6;
+#else
+    SPDLOG_CRITICAL("PostGIS source read by fmm built without WITH_POSTGIS");
+    return -1;
+#endif
+  }
   std::string fn_extension = file.substr(
       file.find_last_of(".") + 1);
   if (fn_extension == "csv" || fn_extension == "txt") {
@@ -65,14 +114,33 @@ int FMM::CONFIG::GPSConfig::get_gps_format() const {
     }
   } else if (fn_extension == "gpkg" || fn_extension == "shp") {
     return 0;
+  } else if (fn_extension == "traj") {
+    return 3;
+  } else if (fn_extension == "arrow" || fn_extension == "feather" ||
+             fn_extension == "parquet") {
+#ifdef FMM_WITH_ARROW
+    return 5;
+#else
+    SPDLOG_CRITICAL("GPS file {} read by fmm built without WITH_ARROW",
+                    file);
+    return -1;
+#endif
   } else {
     SPDLOG_CRITICAL("GPS file extension {} unknown",fn_extension);
     return -1;
   }
 };
 
+FMM::UTIL::TimestampFormat
+FMM::CONFIG::GPSConfig::get_timestamp_format() const {
+  UTIL::TimestampFormat format = UTIL::EPOCH_SECONDS;
+  UTIL::string2timestamp_format(timestamp_format, &format);
+  return format;
+};
+
 bool FMM::CONFIG::GPSConfig::validate() const {
-  if (!UTIL::file_exists(file))
+  if (file != "-" && file.compare(0, 3, "PG:") != 0 &&
+      !UTIL::file_exists(file))
   {
     SPDLOG_CRITICAL("GPS file {} not found",file);
     return false;
@@ -81,5 +149,14 @@ bool FMM::CONFIG::GPSConfig::validate() const {
     SPDLOG_CRITICAL("Unknown GPS format");
     return false;
   }
+  if (read_threads<1) {
+    SPDLOG_CRITICAL("Invalid GPS read threads {}",read_threads);
+    return false;
+  }
+  UTIL::TimestampFormat format;
+  if (!UTIL::string2timestamp_format(timestamp_format, &format)) {
+    SPDLOG_CRITICAL("Invalid GPS timestamp format {}",timestamp_format);
+    return false;
+  }
   return true;
 }
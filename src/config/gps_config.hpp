@@ -9,6 +9,8 @@
 #ifndef FMM_SRC_CONFIG_GPS_CONFIG_HPP_
 #define FMM_SRC_CONFIG_GPS_CONFIG_HPP_
 
+#include "util/timestamp_parser.hpp"
+
 #include <string>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -24,13 +26,20 @@ namespace CONFIG {
  *  GPS configuration class for reading data from a file.
  */
 struct GPSConfig{
-  std::string file; /**< filename */
+  std::string file; /**< filename, or PG: followed by the connection
+                         string and the table of a PostGIS source */
   std::string id; /**< id field/column name */
   std::string geom; /**< geometry field/column name */
   std::string x; /**< x field/column name */
   std::string y; /**< y field/column name */
   std::string timestamp; /**< timestamp field/column name */
+  std::string timestamp_format = "seconds"; /**< format of the timestamps
+      of a CSV file, seconds, ms, us or iso8601 */
   bool gps_point = false; /**< gps point stored or not */
+  int read_threads = 1; /**< threads reading a CSV or GDAL file, 1 for
+                             a sequential reader, converting the
+                             columns of an Arrow file or connected to
+                             a PostGIS database */
   /**
    * Validate the GPS configuration for file existence, parameter validation
    * @return true if validate success, otherwise false returned
@@ -43,11 +52,19 @@ struct GPSConfig{
   /**
    * Find the GPS format.
    *
-   * @return 0 for GDAL trajectory file, 1 for CSV trajectory file
-   * and 2 for CSV point file, otherwise -1 is returned for unknown
-   * format.
+   * @return 0 for GDAL trajectory file, 1 for CSV trajectory file,
+   * 2 for CSV point file, 3 for binary trajectory file (traj), 4 for
+   * CSV trajectory rows read from stdin (-), 5 for Arrow IPC or Parquet
+   * file (arrow, feather, parquet), whose layout of points or trajectories
+   * is given by gps_point, and 6 for PostGIS table (PG:), otherwise -1 is
+   * returned for unknown format.
    */
   int get_gps_format() const;
+  /**
+   * Get the format of the timestamps of a CSV file
+   * @return the format, seconds if the name is invalid
+   */
+  UTIL::TimestampFormat get_timestamp_format() const;
   /**
    * Load GPSConfig from XML data.
    *
@@ -2,12 +2,40 @@
 #include "util/util.hpp"
 #include "util/debug.hpp"
 
+#include <cstdlib>
+
 void FMM::CONFIG::NetworkConfig::print() const{
   SPDLOG_INFO("NetworkConfig");
   SPDLOG_INFO("File name: {} ",file);
   SPDLOG_INFO("ID name: {} ",id);
   SPDLOG_INFO("Source name: {} ",source);
   SPDLOG_INFO("Target name: {} ",target);
+  SPDLOG_INFO("Network cache: {} ",(cache ? "true" : "false"));
+  SPDLOG_INFO("Rtree: {} max elements {} chunk segments {}",rtree,
+              rtree_max_elements,rtree_chunk_segments);
+  SPDLOG_INFO("Spatial index: {} grid cell size {}",spatial_index,
+              grid_cell_size);
+  SPDLOG_INFO("Search batch size: {} ",search_batch_size);
+  SPDLOG_INFO("Nearest search: {} ",(nearest_search ? "true" : "false"));
+  SPDLOG_INFO("Search initial radius: {} min candidates {} growth {}",
+              search_initial_radius,search_min_candidates,
+              search_radius_growth);
+  SPDLOG_INFO("Search snap resolution: {} items {}",
+              search_snap_resolution,search_snap_items);
+  SPDLOG_INFO("Reorder network: {} ",(reorder ? "true" : "false"));
+  SPDLOG_INFO("Project network: {} ",(project ? "true" : "false"));
+  SPDLOG_INFO("Compress geometry: {} ",
+              (compress_geometry ? "true" : "false"));
+  SPDLOG_INFO("Twin edges: {} ",(twin_edges ? "true" : "false"));
+  if (!clip.empty()) {
+    SPDLOG_INFO("Clip network: {} margin {}",clip,clip_margin);
+  }
+  if (!costs.empty()) {
+    SPDLOG_INFO("Cost columns: {} ",costs);
+  }
+  if (!edge_mask.empty()) {
+    SPDLOG_INFO("Edge mask: {} ",edge_mask);
+  }
 };
 
 FMM::CONFIG::NetworkConfig FMM::CONFIG::NetworkConfig::load_from_xml(
@@ -16,7 +44,57 @@ FMM::CONFIG::NetworkConfig FMM::CONFIG::NetworkConfig::load_from_xml(
   std::string id = xml_data.get("config.input.network.id", "id");
   std::string source = xml_data.get("config.input.network.source","source");
   std::string target = xml_data.get("config.input.network.target","target");
-  return FMM::CONFIG::NetworkConfig{file, id, source, target};
+  bool cache = xml_data.get("config.input.network.cache", true);
+  std::string rtree = xml_data.get("config.input.network.rtree",
+                                   std::string("packing"));
+  int rtree_max_elements =
+      xml_data.get("config.input.network.rtree_max_elements", 16);
+  int rtree_chunk_segments =
+      xml_data.get("config.input.network.rtree_chunk_segments", 0);
+  std::string spatial_index = xml_data.get(
+      "config.input.network.spatial_index", std::string("rtree"));
+  double grid_cell_size =
+      xml_data.get("config.input.network.grid_cell_size", 0.0);
+  int search_batch_size =
+      xml_data.get("config.input.network.search_batch_size", 1);
+  bool nearest_search =
+      xml_data.get("config.input.network.nearest_search", false);
+  double search_initial_radius =
+      xml_data.get("config.input.network.search_initial_radius", 0.0);
+  int search_min_candidates =
+      xml_data.get("config.input.network.search_min_candidates", 1);
+  double search_radius_growth =
+      xml_data.get("config.input.network.search_radius_growth", 2.0);
+  double search_snap_resolution =
+      xml_data.get("config.input.network.search_snap_resolution", 0.0);
+  long search_snap_items =
+      xml_data.get("config.input.network.search_snap_items",
+                   NETWORK::SnapCache::DEFAULT_CACHE_ITEMS);
+  bool reorder = xml_data.get("config.input.network.reorder", false);
+  bool project = xml_data.get("config.input.network.project", false);
+  bool compress_geometry =
+      xml_data.get("config.input.network.compress_geometry", false);
+  bool twin_edges = xml_data.get("config.input.network.twin_edges", false);
+  std::string clip = xml_data.get("config.input.network.clip",
+                                  std::string(""));
+  double clip_margin = xml_data.get("config.input.network.clip_margin", 0.0);
+  std::string costs = xml_data.get("config.input.network.costs",
+                                   std::string(""));
+  std::string edge_mask = xml_data.get("config.input.network.edge_mask",
+                                       std::string(""));
+  return FMM::CONFIG::NetworkConfig{file, id, source, target, cache,
+                                    rtree, rtree_max_elements,
+                                    rtree_chunk_segments,
+                                    spatial_index, grid_cell_size,
+                                    search_batch_size, nearest_search,
+                                    search_initial_radius,
+                                    search_min_candidates,
+                                    search_radius_growth,
+                                    search_snap_resolution,
+                                    search_snap_items,
+                                    reorder, project, compress_geometry,
+                                    twin_edges, clip, clip_margin, costs,
+                                    edge_mask};
 };
 
 FMM::CONFIG::NetworkConfig FMM::CONFIG::NetworkConfig::load_from_arg(
@@ -25,13 +103,151 @@ FMM::CONFIG::NetworkConfig FMM::CONFIG::NetworkConfig::load_from_arg(
   std::string id = arg_data["network_id"].as<std::string>();
   std::string source = arg_data["source"].as<std::string>();
   std::string target = arg_data["target"].as<std::string>();
-  return FMM::CONFIG::NetworkConfig{file, id, source, target};
+  bool cache = arg_data.count("no_network_cache")==0;
+  std::string rtree = arg_data["rtree"].as<std::string>();
+  int rtree_max_elements = arg_data["rtree_max_elements"].as<int>();
+  int rtree_chunk_segments = arg_data["rtree_chunk_segments"].as<int>();
+  std::string spatial_index = arg_data["spatial_index"].as<std::string>();
+  double grid_cell_size = arg_data["grid_cell_size"].as<double>();
+  int search_batch_size = arg_data["search_batch_size"].as<int>();
+  bool nearest_search = arg_data.count("nearest_search")>0;
+  double search_initial_radius =
+      arg_data["search_initial_radius"].as<double>();
+  int search_min_candidates = arg_data["search_min_candidates"].as<int>();
+  double search_radius_growth = arg_data["search_radius_growth"].as<double>();
+  double search_snap_resolution =
+      arg_data["search_snap_resolution"].as<double>();
+  long search_snap_items = arg_data["search_snap_items"].as<long>();
+  bool reorder = arg_data.count("reorder_network")>0;
+  bool project = arg_data.count("project_network")>0;
+  bool compress_geometry = arg_data.count("compress_geometry")>0;
+  bool twin_edges = arg_data.count("twin_edges")>0;
+  std::string clip = arg_data["network_clip"].as<std::string>();
+  double clip_margin = arg_data["network_clip_margin"].as<double>();
+  std::string costs = arg_data["network_costs"].as<std::string>();
+  std::string edge_mask = arg_data["network_edge_mask"].as<std::string>();
+  return FMM::CONFIG::NetworkConfig{file, id, source, target, cache,
+                                    rtree, rtree_max_elements,
+                                    rtree_chunk_segments,
+                                    spatial_index, grid_cell_size,
+                                    search_batch_size, nearest_search,
+                                    search_initial_radius,
+                                    search_min_candidates,
+                                    search_radius_growth,
+                                    search_snap_resolution,
+                                    search_snap_items,
+                                    reorder, project, compress_geometry,
+                                    twin_edges, clip, clip_margin, costs,
+                                    edge_mask};
 };
 
+FMM::NETWORK::SpatialIndexOptions
+FMM::CONFIG::NetworkConfig::get_spatial_index_options() const {
+  NETWORK::SpatialIndexOptions options;
+  NETWORK::Network::string2spatial_index_type(spatial_index, &options.type);
+  NETWORK::Network::string2rtree_algorithm(rtree, &options.algorithm);
+  options.max_elements = rtree_max_elements;
+  options.chunk_segments = rtree_chunk_segments;
+  options.cell_size = grid_cell_size;
+  options.query_batch_size = search_batch_size;
+  options.nearest_search = nearest_search;
+  options.initial_radius = search_initial_radius;
+  options.min_candidates = search_min_candidates;
+  options.radius_growth = search_radius_growth;
+  options.snap_resolution = search_snap_resolution;
+  options.snap_cache_items = search_snap_items;
+  options.twin_edges = twin_edges;
+  return options;
+}
+
+std::vector<std::string> FMM::CONFIG::NetworkConfig::get_cost_names()
+    const {
+  return costs.empty() ? std::vector<std::string>() :
+         UTIL::split_string(costs);
+}
+
+FMM::NETWORK::NetworkClip FMM::CONFIG::NetworkConfig::get_clip() const {
+  NETWORK::NetworkClip network_clip;
+  network_clip.region = clip;
+  network_clip.margin = clip_margin;
+  return network_clip;
+}
+
+std::shared_ptr<const FMM::NETWORK::EdgeMask>
+FMM::CONFIG::NetworkConfig::read_edge_mask(
+    const NETWORK::Network &network) const {
+  if (edge_mask.empty()) return nullptr;
+  std::shared_ptr<const NETWORK::EdgeMask> mask =
+      NETWORK::EdgeMask::read_edge_ids(edge_mask, network);
+  if (mask == nullptr) std::exit(EXIT_FAILURE);
+  return mask;
+}
+
 bool FMM::CONFIG::NetworkConfig::validate() const {
   if (!UTIL::file_exists(file)){
     SPDLOG_CRITICAL("Network file not found {}",file);
     return false;
   }
+  NETWORK::RtreeAlgorithm algorithm;
+  if (!NETWORK::Network::string2rtree_algorithm(rtree, &algorithm)) {
+    SPDLOG_CRITICAL("Invalid rtree algorithm {}",rtree);
+    return false;
+  }
+  if (rtree_max_elements < 4) {
+    SPDLOG_CRITICAL("Rtree max elements {} should be at least 4",
+                    rtree_max_elements);
+    return false;
+  }
+  if (rtree_chunk_segments < 0) {
+    SPDLOG_CRITICAL("Rtree chunk segments {} should not be negative",
+                    rtree_chunk_segments);
+    return false;
+  }
+  NETWORK::SpatialIndexType type;
+  if (!NETWORK::Network::string2spatial_index_type(spatial_index, &type)) {
+    SPDLOG_CRITICAL("Invalid spatial index {}",spatial_index);
+    return false;
+  }
+  if (grid_cell_size < 0) {
+    SPDLOG_CRITICAL("Grid cell size {} should not be negative",
+                    grid_cell_size);
+    return false;
+  }
+  if (search_batch_size < 1) {
+    SPDLOG_CRITICAL("Search batch size {} should be at least 1",
+                    search_batch_size);
+    return false;
+  }
+  if (nearest_search && (type == NETWORK::GRID || search_batch_size > 1)) {
+    SPDLOG_CRITICAL("Nearest search needs the rtree without batched "
+                    "queries");
+    return false;
+  }
+  if (search_initial_radius < 0 || search_min_candidates < 1 ||
+      search_radius_growth <= 1) {
+    SPDLOG_CRITICAL("Invalid search initial radius {} min candidates {} "
+                    "growth {}",search_initial_radius,search_min_candidates,
+                    search_radius_growth);
+    return false;
+  }
+  if (search_snap_resolution < 0 || search_snap_items < 1) {
+    SPDLOG_CRITICAL("Invalid search snap resolution {} items {}",
+                    search_snap_resolution,search_snap_items);
+    return false;
+  }
+  if (clip_margin < 0) {
+    SPDLOG_CRITICAL("Clip margin {} should not be negative",clip_margin);
+    return false;
+  }
+  if (!edge_mask.empty() && !UTIL::file_exists(edge_mask)) {
+    SPDLOG_CRITICAL("Edge mask file not found {}",edge_mask);
+    return false;
+  }
+  for (const std::string &name : get_cost_names()) {
+    if (name.empty() || name == "length") {
+      SPDLOG_CRITICAL("Invalid cost column {}",costs);
+      return false;
+    }
+  }
   return true;
 }
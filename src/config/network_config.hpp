@@ -10,6 +10,7 @@
 #define FMM_NETWORK_CONFIG_HPP_
 
 #include <string>
+#include "network/network.hpp"
 #include "cxxopts/cxxopts.hpp"
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -25,6 +26,62 @@ struct NetworkConfig{
   std::string id; /**< id field/column name */
   std::string source; /**< source field/column name */
   std::string target; /**< target field/column name */
+  bool cache; /**< whether read and write the network cache file */
+  std::string rtree; /**< rtree algorithm name */
+  int rtree_max_elements; /**< maximum number of elements in a rtree node */
+  int rtree_chunk_segments; /**< maximum number of segments of the edge
+                                 chunks indexed by the rtree, 0 for the
+                                 whole edges */
+  std::string spatial_index; /**< spatial index name, rtree, flat or grid */
+  double grid_cell_size; /**< cell size of the grid index */
+  int search_batch_size; /**< number of points searched with one query
+                              of the spatial index */
+  bool nearest_search; /**< whether search the candidates with the
+                            incremental nearest query of the rtree */
+  double search_initial_radius; /**< radius of the first search of a
+                                     point, 0 to search with the radius */
+  int search_min_candidates; /**< candidates of a point below which its
+                                  search radius grows */
+  double search_radius_growth; /**< factor of each growth of the search
+                                    radius */
+  double search_snap_resolution; /**< cell size of the snapping cache of
+                                      the searches, 0 for no cache */
+  long search_snap_items; /**< maximum number of edges cached by the
+                               snapping cache */
+  bool reorder; /**< whether renumber nodes along the Hilbert curve */
+  bool project; /**< whether project a network in longitude and latitude
+                     into metres */
+  bool compress_geometry; /**< whether keep the edge geometries compressed
+                               and decode them on demand */
+  bool twin_edges; /**< whether pair the twin edges of two-way roads,
+                        indexed once and sharing their geometry */
+  std::string clip; /**< region of the network read, as a box
+                         minx,miny,maxx,maxy or a polygon in WKT */
+  double clip_margin; /**< margin added around the clip region */
+  std::string costs; /**< extra cost fields/columns separated by comma,
+                          read as the costs of the edges under other
+                          metrics than their length */
+  std::string edge_mask; /**< file of the ids of the edges allowed to the
+                              profile matched, empty for all the edges */
+  /**
+   * Get the names of the extra cost fields
+   */
+  std::vector<std::string> get_cost_names() const;
+  /**
+   * Get the spatial index options of the configuration
+   */
+  NETWORK::SpatialIndexOptions get_spatial_index_options() const;
+  /**
+   * Get the region of the network read
+   */
+  NETWORK::NetworkClip get_clip() const;
+  /**
+   * Read the edge mask of the profile, which exits if it is not read
+   * @param  network network read with the configuration
+   * @return the mask, or nullptr if no mask is configured
+   */
+  std::shared_ptr<const NETWORK::EdgeMask> read_edge_mask(
+      const NETWORK::Network &network) const;
   /**
    * Validate the GPS configuration for file existence.
    * @return if file exists returns true, otherwise return false
@@ -27,15 +27,37 @@ void FMM::CONFIG::ResultConfig::print() const {
     ss << "tp ";
   if (output_config.write_length)
     ss << "length ";
+  if (output_config.write_segment)
+    ss << "segment ";
+  if (output_config.write_partial)
+    ss << "partial ";
   SPDLOG_INFO("ResultConfig");
   SPDLOG_INFO("File: {}",file);
+  SPDLOG_INFO("Format: {}",format);
+  if (shard_size > 0) {
+    SPDLOG_INFO("Shard size: {}",shard_size);
+  }
+  if (async_write) {
+    SPDLOG_INFO("Asynchronous write: true");
+  }
   SPDLOG_INFO("Fields: {}",ss.str());
+  if (output_config.precision >= 0) {
+    SPDLOG_INFO("Precision: {}",output_config.precision);
+  }
+  SPDLOG_INFO("Geometry encoding: {}",output_config.geometry_encoding);
 };
 
 FMM::CONFIG::ResultConfig FMM::CONFIG::ResultConfig::load_from_xml(
     const boost::property_tree::ptree &xml_data) {
   ResultConfig config;
   config.file = xml_data.get<std::string>("config.output.file");
+  config.format = xml_data.get("config.output.format", std::string("csv"));
+  config.shard_size = xml_data.get("config.output.shard_size", 0);
+  config.async_write =
+      !(!xml_data.get_child_optional("config.output.async_write"));
+  config.output_config.precision = xml_data.get("config.output.precision", -1);
+  config.output_config.geometry_encoding = xml_data.get(
+      "config.output.geometry_encoding", std::string("wkt"));
   if (xml_data.get_child_optional("config.output.fields")) {
     // Fields specified
     // close the default output fields (cpath,mgeom are true by default)
@@ -95,6 +117,20 @@ FMM::CONFIG::ResultConfig FMM::CONFIG::ResultConfig::load_from_arg(
     const cxxopts::ParseResult &arg_data) {
   FMM::CONFIG::ResultConfig config;
   config.file = arg_data["output"].as<std::string>();
+  if (arg_data.count("output_format") > 0) {
+    config.format = arg_data["output_format"].as<std::string>();
+  }
+  if (arg_data.count("output_shard_size") > 0) {
+    config.shard_size = arg_data["output_shard_size"].as<int>();
+  }
+  if (arg_data.count("output_precision") > 0) {
+    config.output_config.precision = arg_data["output_precision"].as<int>();
+  }
+  if (arg_data.count("output_geometry_encoding") > 0) {
+    config.output_config.geometry_encoding =
+        arg_data["output_geometry_encoding"].as<std::string>();
+  }
+  config.async_write = arg_data.count("output_async") > 0;
   if (arg_data.count("output_fields") > 0) {
     config.output_config.write_cpath = false;
     config.output_config.write_mgeom = false;
@@ -161,7 +197,77 @@ std::set<std::string> FMM::CONFIG::ResultConfig::string2set(
   }
   return result;
 }
+
+std::string FMM::CONFIG::ResultConfig::get_shard_file(
+    const std::string &file, int shard, int num_shards) {
+  if (file == "-") return file;
+  std::size_t name = file.find_last_of('/');
+  name = (name == std::string::npos) ? 0 : name + 1;
+  std::size_t extension = file.find('.', name + 1);
+  if (extension == std::string::npos) extension = file.size();
+  return file.substr(0, extension) + "." + std::to_string(shard) + "-of-" +
+      std::to_string(num_shards) + file.substr(extension);
+}
+
 bool FMM::CONFIG::ResultConfig::validate() const {
+#ifdef FMM_WITH_ARROW
+  if (format != "csv" && format != "arrow" && format != "edges" &&
+      format != "index" && format != "state") {
+    SPDLOG_CRITICAL("Invalid output format {}, which should be csv, arrow, "
+                    "edges, index or state", format);
+    return false;
+  }
+#else
+  if (format != "csv" && format != "edges" && format != "index" &&
+      format != "state") {
+    SPDLOG_CRITICAL("Invalid output format {}, which should be csv, edges, "
+                    "index or state as fmm is built without Arrow",format);
+    return false;
+  }
+#endif
+  if (shard_size < 0) {
+    SPDLOG_CRITICAL("Invalid output shard size {}",shard_size);
+    return false;
+  }
+  if (format != "csv" && (shard_size > 0 || UTIL::check_file_extension(file,"gz"))) {
+    SPDLOG_CRITICAL("Only the csv output can be sharded or compressed");
+    return false;
+  }
+  const std::string &encoding = output_config.geometry_encoding;
+  if (encoding != "wkt" && encoding != "hexwkb" && encoding != "polyline" &&
+      encoding != "delta" && encoding != "wkb") {
+    SPDLOG_CRITICAL("Invalid geometry encoding {}, which should be wkt, "
+                    "hexwkb, wkb, polyline or delta", encoding);
+    return false;
+  }
+  // The geometries of the arrow output are always binary WKB, which a
+  // csv file cannot hold
+  if (encoding == "wkb" ? format != "arrow" :
+      (format == "arrow" && encoding != "wkt")) {
+    SPDLOG_CRITICAL("Geometry encoding {} is not written in the {} output, "
+                    "where wkb is only written by the arrow output",
+                    encoding, format);
+    return false;
+  }
+  if ((encoding == "polyline" || encoding == "delta") &&
+      output_config.precision > 12) {
+    SPDLOG_CRITICAL("Invalid precision {} of the {} encoding, which "
+                    "should be at most 12", output_config.precision,
+                    encoding);
+    return false;
+  }
+  if (format != "csv" && async_write) {
+    SPDLOG_CRITICAL("Only the csv output can be written asynchronously");
+    return false;
+  }
+  if (file == "-") {
+    if (format != "csv" || shard_size > 0) {
+      SPDLOG_CRITICAL("Only the csv output can be written to stdout, "
+                      "without shards");
+      return false;
+    }
+    return true;
+  }
   if (UTIL::file_exists(file))
   {
     SPDLOG_WARN("Overwrite existing result file {}",file);
@@ -47,13 +47,41 @@ struct OutputConfig {
                               exported */
   bool write_length = false; /**< if true, length (length of each matched edge)
                                   will be exported */
+  bool write_segment = false; /**< if true, the first and last point of
+                                  each segment of a split trajectory will
+                                  be exported */
+  bool write_partial = false; /**< if true, whether the budget of a
+                                   trajectory ran out and only its first
+                                   points are matched will be exported */
+  int precision = -1; /**< number of decimals of the coordinates of the
+                          geometries exported, or negative to export
+                          them with 12 significant digits */
+  std::string geometry_encoding = "wkt"; /**< encoding of the mgeom and
+                          pgeom of a csv output, wkt, hexwkb for WKB in
+                          hexadecimal, polyline for a Google encoded
+                          polyline or delta for integer coordinates
+                          written as differences, where the precision
+                          is the decimals kept, 5 by default */
 };
 
 /**
  * Result Configuration class, defining output file and output fields
  */
 struct ResultConfig {
-  std::string file; /**< Output file to write the result */
+  std::string file; /**< Output file to write the result, compressed
+                         with gzip if it ends with .gz, or - for stdout */
+  std::string format = "csv"; /**< Format of the output file, csv,
+                                   arrow, edges for a table of the
+                                   edges traversed, index for an
+                                   inverted index of the trajectories
+                                   traversing each edge, or state for a
+                                   binary match state */
+  int shard_size = 0; /**< Rows written into each shard of a csv
+                           output with a manifest, or 0 to write a
+                           single file */
+  bool async_write = false; /**< If true, a csv output is written by a
+                                 thread of its own while the results are
+                                 formatted */
   OutputConfig output_config; /**< Output fields to export */
   /**
    * Check the validation of the configuration
@@ -73,6 +101,17 @@ struct ResultConfig {
    * @return a set of strings
    */
   static std::set<std::string> string2set(const std::string &s);
+  /**
+   * Get the result file of a shard of the input, where the shard is
+   * inserted before the extensions of the file name as .i-of-N, so that
+   * the shards matched by separate jobs do not share their output
+   * @param file       result file
+   * @param shard      index of the shard, from 0
+   * @param num_shards number of shards
+   * @return the file name, - for stdout being kept
+   */
+  static std::string get_shard_file(const std::string &file, int shard,
+                                    int num_shards);
   /**
    * Load result configuration data from xml file
    * @param xml_data xml data parsed by reading an xml file
@@ -1,8 +1,11 @@
 #include "core/geometry.hpp"
+#include "util/number_parser.hpp"
 
 #include <ogrsf_frmts.h> // C++ API for GDAL
 #include <boost/geometry.hpp>
 #include <boost/geometry/geometries/geometries.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iterator>
 #include <vector>
 #include <sstream>
@@ -41,10 +44,130 @@ FMM::CORE::LineString FMM::CORE::ogr2linestring(
 
 FMM::CORE::LineString FMM::CORE::wkt2linestring(const std::string &wkt){
   FMM::CORE::LineString line;
-  boost::geometry::read_wkt(wkt,line.get_geometry());
+  if (!parse_wkt_linestring(wkt.data(), wkt.data() + wkt.size(), &line)) {
+    // Other forms are left to boost, which throws if they are invalid
+    line.clear();
+    boost::geometry::read_wkt(wkt,line.get_geometry());
+  }
   return line;
 };
 
+namespace {
+
+const char *skip_spaces(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+    ++p;
+  }
+  return p;
+}
+
+// Match a keyword ignoring the case, return the position after it or
+// nullptr if it does not match
+const char *match_keyword(const char *p, const char *end,
+                          const char *keyword) {
+  for (; *keyword != '\0'; ++keyword, ++p) {
+    if (p == end || (*p | 0x20) != (*keyword | 0x20)) return nullptr;
+  }
+  return p;
+}
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Read a value of WKB in the byte order of the data
+template <typename T>
+T read_wkb_value(const unsigned char *data, bool swap) {
+  unsigned char bytes[sizeof(T)];
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    bytes[i] = data[swap ? sizeof(T) - 1 - i : i];
+  }
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return value;
+}
+
+} // namespace
+
+bool FMM::CORE::parse_wkt_linestring(const char *begin, const char *end,
+                                     FMM::CORE::LineString *line) {
+  line->clear();
+  const char *p = match_keyword(skip_spaces(begin, end), end, "LINESTRING");
+  if (p == nullptr) return false;
+  p = skip_spaces(p, end);
+  const char *empty = match_keyword(p, end, "EMPTY");
+  if (empty != nullptr) return skip_spaces(empty, end) == end;
+  if (p == end || *p != '(') return false;
+  // The points are counted from the separators to reserve them at once
+  const char *close = (const char *) memchr(p, ')', end - p);
+  if (close == nullptr) return false;
+  long commas = std::count(p, close, ',');
+  line->get_geometry().reserve(commas + 1);
+  ++p;
+  while (true) {
+    double x, y;
+    p = skip_spaces(p, close);
+    if ((p = UTIL::parse_double(p, close, &x)) == nullptr) return false;
+    const char *q = skip_spaces(p, close);
+    if (q == p) return false;
+    if ((p = UTIL::parse_double(q, close, &y)) == nullptr) return false;
+    line->add_point(x, y);
+    p = skip_spaces(p, close);
+    if (p == close) break;
+    if (*p != ',') return false;
+    ++p;
+  }
+  return skip_spaces(close + 1, end) == end;
+}
+
+bool FMM::CORE::parse_wkb_linestring(const unsigned char *data,
+                                     std::size_t size,
+                                     FMM::CORE::LineString *line) {
+  line->clear();
+  // Byte order, geometry type and number of points
+  if (size < 9 || data[0] > 1) return false;
+  static const unsigned int one = 1;
+  bool little_endian = *(const unsigned char *) &one == 1;
+  bool swap = (data[0] == 1) != little_endian;
+  if (read_wkb_value<unsigned int>(data + 1, swap) != 2) return false;
+  unsigned int num_points = read_wkb_value<unsigned int>(data + 5, swap);
+  if (size != 9 + 16 * (std::size_t) num_points) return false;
+  line->get_geometry().reserve(num_points);
+  for (unsigned int i = 0; i < num_points; ++i) {
+    const unsigned char *point = data + 9 + 16 * (std::size_t) i;
+    line->add_point(read_wkb_value<double>(point, swap),
+                    read_wkb_value<double>(point + 8, swap));
+  }
+  return true;
+}
+
+bool FMM::CORE::parse_hex_wkb_linestring(const char *begin, const char *end,
+                                         FMM::CORE::LineString *line) {
+  begin = skip_spaces(begin, end);
+  while (end > begin && (end[-1] == ' ' || end[-1] == '\r' ||
+      end[-1] == '\n' || end[-1] == '\t')) {
+    --end;
+  }
+  if ((end - begin) % 2 != 0) {
+    line->clear();
+    return false;
+  }
+  std::vector<unsigned char> data((end - begin) / 2);
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    int high = hex_value(begin[2 * i]);
+    int low = hex_value(begin[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      line->clear();
+      return false;
+    }
+    data[i] = (unsigned char) (high << 4 | low);
+  }
+  return parse_wkb_linestring(data.data(), data.size(), line);
+}
+
 OGRLineString *FMM::CORE::linestring2ogr(const FMM::CORE::LineString &line){
   std::vector<unsigned char> wkb;
   boost::geometry::write_wkb(line.get_geometry_const(),std::back_inserter(wkb));
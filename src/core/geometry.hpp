@@ -12,6 +12,7 @@
 
 #include <ogrsf_frmts.h> // C++ API for GDAL
 #include <boost/geometry.hpp>
+#include <cmath>
 #include <string>
 #include <sstream>
 
@@ -211,6 +212,93 @@ private:
 
 std::ostream& operator<<(std::ostream& os,const FMM::CORE::LineString& rhs);
 
+/**
+ * Read only view of a linestring whose coordinates are stored in
+ * separate x and y arrays owned by another object, such as the packed
+ * edge geometries of a network.
+ */
+class LineStringView {
+public:
+  /**
+   * Constructor
+   * @param x x coordinates of the points
+   * @param y y coordinates of the points
+   * @param num_points number of points
+   * @param cumlen length of the line from its start to each point, which
+   * is computed when needed if it is nullptr
+   */
+  LineStringView(const double *x, const double *y, int num_points,
+                 const double *cumlen = nullptr) :
+      x_(x), y_(y), num_points_(num_points), cumlen_(cumlen) {};
+  /**
+   * Get the x coordinate of i-th point in the line
+   */
+  inline double get_x(int i) const{
+    return x_[i];
+  };
+  /**
+   * Get the y coordinate of i-th point in the line
+   */
+  inline double get_y(int i) const{
+    return y_[i];
+  };
+  /**
+   * Get the number of points in a line
+   */
+  inline int get_num_points() const{
+    return num_points_;
+  };
+  /**
+   * Get the x coordinates of the points
+   */
+  inline const double *get_x_data() const{
+    return x_;
+  };
+  /**
+   * Get the y coordinates of the points
+   */
+  inline const double *get_y_data() const{
+    return y_;
+  };
+  /**
+   * Get the length from the start of the line to each point, or nullptr
+   * if it is not precomputed
+   */
+  inline const double *get_cumlen_data() const{
+    return cumlen_;
+  };
+  /**
+   * Get the length of the line
+   */
+  inline double get_length() const{
+    if (cumlen_ != nullptr) {
+      return num_points_ > 0 ? cumlen_[num_points_-1] : 0;
+    }
+    double length = 0;
+    for (int i=1;i<num_points_;++i){
+      double dx = x_[i]-x_[i-1];
+      double dy = y_[i]-y_[i-1];
+      length += std::sqrt(dx*dx+dy*dy);
+    }
+    return length;
+  };
+  /**
+   * Copy the points into a linestring
+   */
+  inline LineString to_linestring() const{
+    LineString line;
+    for (int i=0;i<num_points_;++i){
+      line.add_point(x_[i],y_[i]);
+    }
+    return line;
+  };
+private:
+  const double *x_;
+  const double *y_;
+  int num_points_;
+  const double *cumlen_;
+}; // LineStringView
+
 /**
  * Convert a OGRLineString to a linestring
  * @param line a pointer to OGRLineString
@@ -234,12 +322,45 @@ LineString ogr2linestring(const OGRLineString *line);
 LineString ogr2linestring(const OGRMultiLineString *mline);
 
 /**
- * Convert a wkt into a linestring
+ * Convert a wkt into a linestring. A 2D linestring is read by
+ * parse_wkt_linestring, other forms by boost geometry.
  * @param  wkt A wkt representation of a line
  * @return  a linestring
  */
 LineString wkt2linestring(const std::string &wkt);
 
+/**
+ * Parse a 2D WKT linestring, LINESTRING(x y,...) or LINESTRING EMPTY,
+ * with the coordinates written straight into the line
+ * @param  begin start of the text
+ * @param  end   end of the text, which is not read beyond
+ * @param  line  linestring updated, whose points are replaced
+ * @return false if the text is not a 2D WKT linestring
+ */
+bool parse_wkt_linestring(const char *begin, const char *end,
+                          LineString *line);
+
+/**
+ * Parse a 2D WKB linestring in either byte order
+ * @param  data WKB data
+ * @param  size number of bytes
+ * @param  line linestring updated, whose points are replaced
+ * @return false if the data is not a 2D WKB linestring
+ */
+bool parse_wkb_linestring(const unsigned char *data, std::size_t size,
+                          LineString *line);
+
+/**
+ * Parse a 2D WKB linestring written in hexadecimal, as exported by
+ * PostGIS and GDAL
+ * @param  begin start of the text
+ * @param  end   end of the text
+ * @param  line  linestring updated, whose points are replaced
+ * @return false if the text is not a hexadecimal 2D WKB linestring
+ */
+bool parse_hex_wkb_linestring(const char *begin, const char *end,
+                              LineString *line);
+
 /**
  * Convert a linestring into a OGRLineString
  * @param  line input line
@@ -0,0 +1,497 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#ifdef FMM_WITH_ARROW
+
+#include "io/arrow_reader.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::IO;
+
+namespace {
+
+// Indices of the columns read
+const int ID_COLUMN = 0;
+const int X_COLUMN = 1; // Or the geometry column of the trajectories
+const int Y_COLUMN = 2;
+const int TIMESTAMP_COLUMN = 3;
+
+bool is_parquet(const std::string &filename) {
+  std::string extension = filename.substr(filename.find_last_of(".") + 1);
+  return extension == "parquet";
+}
+
+// Copy the values [begin, end) of an array, where a null value is flagged
+// in nulls if given, and converted to NaN for a floating point value
+template <typename ArrayType, typename T>
+void copy_values(const arrow::Array &array, int64_t begin, int64_t end,
+                 double scale, T *out, unsigned char *nulls) {
+  const ArrayType &values = static_cast<const ArrayType &>(array);
+  bool has_nulls = array.null_count() > 0;
+  for (int64_t i = begin; i < end; ++i) {
+    if (has_nulls && values.IsNull(i)) {
+      if (nulls != nullptr) nulls[i - begin] = 1;
+      out[i - begin] = std::numeric_limits<T>::quiet_NaN();
+    } else if (scale == 1) {
+      out[i - begin] = static_cast<T>(values.Value(i));
+    } else {
+      out[i - begin] = static_cast<T>(values.Value(i) * scale);
+    }
+  }
+}
+
+double timestamp_scale(const arrow::DataType &type) {
+  switch (static_cast<const arrow::TimestampType &>(type).unit()) {
+    case arrow::TimeUnit::MILLI: return 1e-3;
+    case arrow::TimeUnit::MICRO: return 1e-6;
+    case arrow::TimeUnit::NANO: return 1e-9;
+    default: return 1;
+  }
+}
+
+// Convert the values [begin, end) of a numeric array
+// @return false if the array is not numeric
+template <typename T>
+bool convert_numbers(const arrow::Array &array, int64_t begin, int64_t end,
+                     T *out, unsigned char *nulls) {
+  switch (array.type_id()) {
+    case arrow::Type::DOUBLE:
+      copy_values<arrow::DoubleArray>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::FLOAT:
+      copy_values<arrow::FloatArray>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::INT64:
+      copy_values<arrow::Int64Array>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::INT32:
+      copy_values<arrow::Int32Array>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::INT16:
+      copy_values<arrow::Int16Array>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::UINT64:
+      copy_values<arrow::UInt64Array>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::UINT32:
+      copy_values<arrow::UInt32Array>(array, begin, end, 1, out, nulls);
+      return true;
+    case arrow::Type::TIMESTAMP:
+      copy_values<arrow::TimestampArray>(
+          array, begin, end, timestamp_scale(*array.type()), out, nulls);
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Convert a numeric column, with the rows of each chunk split between
+// the threads
+template <typename T>
+bool convert_column(const arrow::ChunkedArray &column, int num_threads,
+                    T *out, unsigned char *nulls) {
+  int64_t offset = 0;
+  for (const std::shared_ptr<arrow::Array> &chunk : column.chunks()) {
+    if (!convert_numbers<T>(*chunk, 0, 0, out, nulls)) return false;
+    int64_t length = chunk->length();
+    int64_t block = (length + num_threads - 1) / num_threads;
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (int t = 0; t < num_threads; ++t) {
+      int64_t begin = t * block;
+      int64_t end = std::min(length, begin + block);
+      if (begin >= end) continue;
+      convert_numbers<T>(*chunk, begin, end, out + offset + begin,
+                         nulls == nullptr ? nullptr : nulls + offset + begin);
+    }
+    offset += length;
+  }
+  return true;
+}
+
+// Row of a column located in its chunk
+struct ChunkRow {
+  const arrow::Array *array;
+  int64_t index;
+};
+
+std::vector<ChunkRow> locate_rows(const arrow::ChunkedArray &column) {
+  std::vector<ChunkRow> rows;
+  rows.reserve(column.length());
+  for (const std::shared_ptr<arrow::Array> &chunk : column.chunks()) {
+    for (int64_t i = 0; i < chunk->length(); ++i) {
+      rows.push_back({chunk.get(), i});
+    }
+  }
+  return rows;
+}
+
+// Parse the points [begin, end) of a GeoArrow linestring, either structs
+// of x and y or lists of interleaved coordinates
+bool parse_points(const arrow::Array &points, int64_t begin, int64_t end,
+                  LineString *line) {
+  if (points.type_id() == arrow::Type::STRUCT) {
+    const arrow::StructArray &structs =
+        static_cast<const arrow::StructArray &>(points);
+    if (structs.num_fields() < 2) return false;
+    std::shared_ptr<arrow::Array> xs = structs.GetFieldByName("x");
+    std::shared_ptr<arrow::Array> ys = structs.GetFieldByName("y");
+    if (xs == nullptr || ys == nullptr) {
+      xs = structs.field(0);
+      ys = structs.field(1);
+    }
+    if (xs->type_id() != arrow::Type::DOUBLE ||
+        ys->type_id() != arrow::Type::DOUBLE) {
+      return false;
+    }
+    const arrow::DoubleArray &x = static_cast<const arrow::DoubleArray &>(*xs);
+    const arrow::DoubleArray &y = static_cast<const arrow::DoubleArray &>(*ys);
+    for (int64_t j = begin; j < end; ++j) {
+      line->add_point(x.Value(j), y.Value(j));
+    }
+    return true;
+  }
+  if (points.type_id() == arrow::Type::FIXED_SIZE_LIST) {
+    const arrow::FixedSizeListArray &coords =
+        static_cast<const arrow::FixedSizeListArray &>(points);
+    if (coords.value_length() < 2 ||
+        coords.values()->type_id() != arrow::Type::DOUBLE) {
+      return false;
+    }
+    const arrow::DoubleArray &values =
+        static_cast<const arrow::DoubleArray &>(*coords.values());
+    for (int64_t j = begin; j < end; ++j) {
+      int64_t k = coords.value_offset(j);
+      line->add_point(values.Value(k), values.Value(k + 1));
+    }
+    return true;
+  }
+  return false;
+}
+
+template <typename ListArrayType>
+bool parse_list_linestring(const arrow::Array &array, int64_t i,
+                           LineString *line) {
+  const ListArrayType &list = static_cast<const ListArrayType &>(array);
+  int64_t begin = list.value_offset(i);
+  return parse_points(*list.values(), begin, begin + list.value_length(i),
+                      line);
+}
+
+bool parse_linestring(const arrow::Array &array, int64_t i,
+                      LineString *line) {
+  if (array.IsNull(i)) return false;
+  switch (array.type_id()) {
+    case arrow::Type::BINARY: {
+      int32_t size;
+      const uint8_t *data =
+          static_cast<const arrow::BinaryArray &>(array).GetValue(i, &size);
+      return parse_wkb_linestring(data, size, line);
+    }
+    case arrow::Type::LARGE_BINARY: {
+      int64_t size;
+      const uint8_t *data = static_cast<const arrow::LargeBinaryArray &>(
+          array).GetValue(i, &size);
+      return parse_wkb_linestring(data, size, line);
+    }
+    case arrow::Type::LIST:
+      return parse_list_linestring<arrow::ListArray>(array, i, line);
+    case arrow::Type::LARGE_LIST:
+      return parse_list_linestring<arrow::LargeListArray>(array, i, line);
+    default:
+      return false;
+  }
+}
+
+template <typename ListArrayType>
+bool parse_list_timestamps(const arrow::Array &array, int64_t i,
+                           std::vector<double> *timestamps) {
+  const ListArrayType &list = static_cast<const ListArrayType &>(array);
+  int64_t begin = list.value_offset(i);
+  int64_t length = list.value_length(i);
+  timestamps->resize(length);
+  return convert_numbers<double>(*list.values(), begin, begin + length,
+                                 timestamps->data(), nullptr);
+}
+
+bool parse_timestamps(const arrow::Array &array, int64_t i,
+                      std::vector<double> *timestamps) {
+  if (array.IsNull(i)) return false;
+  if (array.type_id() == arrow::Type::LIST) {
+    return parse_list_timestamps<arrow::ListArray>(array, i, timestamps);
+  }
+  if (array.type_id() == arrow::Type::LARGE_LIST) {
+    return parse_list_timestamps<arrow::LargeListArray>(array, i, timestamps);
+  }
+  return false;
+}
+
+} // namespace
+
+ArrowTrajectoryReader::ArrowTrajectoryReader(
+    const std::string &filename, const std::string &id_name,
+    const std::string &geom_name, const std::string &x_name,
+    const std::string &y_name, const std::string &time_name,
+    bool gps_point, int num_threads) :
+    gps_point(gps_point), num_threads(std::max(num_threads, 1)) {
+  column_names = {id_name, gps_point ? x_name : geom_name,
+                  gps_point ? y_name : "", time_name};
+  SPDLOG_INFO("Read trajectory from Arrow file {}", filename);
+  std::shared_ptr<arrow::Schema> schema;
+  if (is_parquet(filename)) {
+#ifdef FMM_WITH_PARQUET
+    auto file = arrow::io::ReadableFile::Open(filename);
+    arrow::Status status = file.ok() ?
+        parquet::arrow::OpenFile(file.ValueOrDie(),
+                                 arrow::default_memory_pool(),
+                                 &parquet_reader) : file.status();
+    if (status.ok()) status = parquet_reader->GetSchema(&schema);
+    if (!status.ok()) {
+      SPDLOG_CRITICAL("Fail to open Parquet file {}: {}", filename,
+                      status.ToString());
+      std::exit(EXIT_FAILURE);
+    }
+    // The column chunks of a row group are decoded in parallel
+    parquet_reader->set_use_threads(this->num_threads > 1);
+    num_groups = parquet_reader->num_row_groups();
+#else
+    SPDLOG_CRITICAL("Parquet file {} read by fmm built without "
+                    "WITH_PARQUET", filename);
+    std::exit(EXIT_FAILURE);
+#endif
+  } else {
+    // The file is mapped so that the record batches are read in place
+    auto file = arrow::io::MemoryMappedFile::Open(filename,
+                                                  arrow::io::FileMode::READ);
+    if (file.ok()) {
+      auto reader = arrow::ipc::RecordBatchFileReader::Open(file.ValueOrDie());
+      if (reader.ok()) ipc_reader = reader.ValueOrDie();
+    }
+    if (ipc_reader == nullptr) {
+      SPDLOG_CRITICAL("Fail to open Arrow file {}", filename);
+      std::exit(EXIT_FAILURE);
+    }
+    schema = ipc_reader->schema();
+    num_groups = ipc_reader->num_record_batches();
+  }
+  for (int c = 0; c < (int) column_names.size(); ++c) {
+    if (column_names[c].empty()) continue;
+    int index = schema->GetFieldIndex(column_names[c]);
+    if (index < 0 && c != TIMESTAMP_COLUMN) {
+      SPDLOG_CRITICAL("Column {} not found", column_names[c]);
+      std::exit(EXIT_FAILURE);
+    }
+    if (index < 0) {
+      SPDLOG_DEBUG("Timestamp column {} not found", column_names[c]);
+      column_names[c].clear();
+      continue;
+    }
+    timestamp_found = timestamp_found || c == TIMESTAMP_COLUMN;
+#ifdef FMM_WITH_PARQUET
+    if (parquet_reader != nullptr) {
+      // A list or struct column is stored in several leaf columns
+      std::vector<const parquet::arrow::SchemaField *> fields{
+          &parquet_reader->manifest().schema_fields[index]};
+      while (!fields.empty()) {
+        const parquet::arrow::SchemaField *field = fields.back();
+        fields.pop_back();
+        if (field->column_index >= 0) {
+          parquet_leaves.push_back(field->column_index);
+        }
+        for (const parquet::arrow::SchemaField &child : field->children) {
+          fields.push_back(&child);
+        }
+      }
+    }
+#endif
+  }
+  SPDLOG_INFO("Total number of row groups {}", num_groups);
+}
+
+bool ArrowTrajectoryReader::read_group(
+    int index, std::vector<std::shared_ptr<arrow::ChunkedArray>> *columns) {
+  columns->assign(column_names.size(), nullptr);
+#ifdef FMM_WITH_PARQUET
+  if (parquet_reader != nullptr) {
+    std::shared_ptr<arrow::Table> table;
+    arrow::Status status =
+        parquet_reader->ReadRowGroup(index, parquet_leaves, &table);
+    if (!status.ok()) {
+      SPDLOG_ERROR("Fail to read row group {}: {}", index, status.ToString());
+      return false;
+    }
+    for (size_t c = 0; c < column_names.size(); ++c) {
+      if (column_names[c].empty()) continue;
+      (*columns)[c] = table->GetColumnByName(column_names[c]);
+    }
+    return true;
+  }
+#endif
+  auto batch = ipc_reader->ReadRecordBatch(index);
+  if (!batch.ok()) {
+    SPDLOG_ERROR("Fail to read record batch {}: {}", index,
+                 batch.status().ToString());
+    return false;
+  }
+  for (size_t c = 0; c < column_names.size(); ++c) {
+    if (column_names[c].empty()) continue;
+    (*columns)[c] = std::make_shared<arrow::ChunkedArray>(
+        batch.ValueOrDie()->GetColumnByName(column_names[c]));
+  }
+  return true;
+}
+
+void ArrowTrajectoryReader::read_next_group() {
+  trajectories.clear();
+  cursor = 0;
+  std::vector<std::shared_ptr<arrow::ChunkedArray>> columns;
+  if (read_group(next_group, &columns)) {
+    ++next_group;
+    if (gps_point) {
+      convert_points(columns);
+    } else {
+      convert_linestrings(columns);
+    }
+  } else {
+    next_group = num_groups;
+  }
+  if (has_carried) {
+    if (!trajectories.empty() && trajectories[0].id == carried.id) {
+      Trajectory &first = trajectories[0];
+      for (int j = 0; j < first.geom.get_num_points(); ++j) {
+        carried.geom.add_point(first.geom.get_x(j), first.geom.get_y(j));
+      }
+      carried.timestamps.insert(carried.timestamps.end(),
+                                first.timestamps.begin(),
+                                first.timestamps.end());
+      first = std::move(carried);
+    } else {
+      trajectories.insert(trajectories.begin(), std::move(carried));
+    }
+    has_carried = false;
+  }
+  // The points of the last trajectory may continue in the next group
+  if (gps_point && next_group < num_groups && !trajectories.empty()) {
+    carried = std::move(trajectories.back());
+    trajectories.pop_back();
+    has_carried = true;
+  }
+}
+
+void ArrowTrajectoryReader::convert_points(
+    const std::vector<std::shared_ptr<arrow::ChunkedArray>> &columns) {
+  int64_t N = columns[ID_COLUMN]->length();
+  std::vector<long long> ids(N);
+  std::vector<double> xs(N), ys(N);
+  std::vector<double> timestamps(timestamp_found ? N : 0);
+  std::vector<unsigned char> skipped(N, 0);
+  bool converted =
+      convert_column<long long>(*columns[ID_COLUMN], num_threads, ids.data(),
+                                skipped.data()) &&
+      convert_column<double>(*columns[X_COLUMN], num_threads, xs.data(),
+                             skipped.data()) &&
+      convert_column<double>(*columns[Y_COLUMN], num_threads, ys.data(),
+                             skipped.data()) &&
+      (!timestamp_found ||
+       convert_column<double>(*columns[TIMESTAMP_COLUMN], num_threads,
+                              timestamps.data(), nullptr));
+  if (!converted) {
+    SPDLOG_CRITICAL("Id, x, y and timestamp columns should be numeric");
+    std::exit(EXIT_FAILURE);
+  }
+  std::vector<int64_t> starts;
+  for (int64_t i = 0; i < N; ++i) {
+    if (skipped[i]) continue;
+    if (starts.empty() || ids[i] != ids[starts.back()]) starts.push_back(i);
+  }
+  trajectories.resize(starts.size());
+  starts.push_back(N);
+  #pragma omp parallel for schedule(dynamic, 64) num_threads(num_threads)
+  for (int r = 0; r < (int) trajectories.size(); ++r) {
+    Trajectory &traj = trajectories[r];
+    traj.id = ids[starts[r]];
+    for (int64_t i = starts[r]; i < starts[r + 1]; ++i) {
+      if (skipped[i]) continue;
+      traj.geom.add_point(xs[i], ys[i]);
+      if (timestamp_found) traj.timestamps.push_back(timestamps[i]);
+    }
+  }
+}
+
+void ArrowTrajectoryReader::convert_linestrings(
+    const std::vector<std::shared_ptr<arrow::ChunkedArray>> &columns) {
+  int64_t N = columns[ID_COLUMN]->length();
+  std::vector<long long> ids(N);
+  std::vector<unsigned char> skipped(N, 0);
+  if (!convert_column<long long>(*columns[ID_COLUMN], num_threads,
+                                 ids.data(), skipped.data())) {
+    SPDLOG_CRITICAL("Id column should be numeric");
+    std::exit(EXIT_FAILURE);
+  }
+  std::vector<ChunkRow> geoms = locate_rows(*columns[X_COLUMN]);
+  std::vector<ChunkRow> times;
+  if (timestamp_found) times = locate_rows(*columns[TIMESTAMP_COLUMN]);
+  std::vector<Trajectory> rows(N);
+  #pragma omp parallel for schedule(dynamic, 64) num_threads(num_threads)
+  for (int64_t i = 0; i < N; ++i) {
+    if (skipped[i]) continue;
+    Trajectory &traj = rows[i];
+    traj.id = ids[i];
+    if (!parse_linestring(*geoms[i].array, geoms[i].index, &traj.geom) ||
+        (timestamp_found &&
+         !parse_timestamps(*times[i].array, times[i].index,
+                           &traj.timestamps))) {
+      skipped[i] = 1;
+    }
+  }
+  long num_skipped = 0;
+  trajectories.reserve(N);
+  for (int64_t i = 0; i < N; ++i) {
+    if (skipped[i]) {
+      ++num_skipped;
+    } else {
+      trajectories.push_back(std::move(rows[i]));
+    }
+  }
+  if (num_skipped > 0) {
+    SPDLOG_WARN("Skip {} rows of a null id or an unsupported geometry",
+                num_skipped);
+  }
+}
+
+Trajectory ArrowTrajectoryReader::read_next_trajectory() {
+  has_next_trajectory();
+  return std::move(trajectories[cursor++]);
+}
+
+bool ArrowTrajectoryReader::has_next_trajectory() {
+  while (cursor >= trajectories.size() && next_group < num_groups) {
+    read_next_group();
+  }
+  return cursor < trajectories.size();
+}
+
+bool ArrowTrajectoryReader::has_timestamp() {
+  return timestamp_found;
+}
+
+void ArrowTrajectoryReader::close() {
+  ipc_reader.reset();
+#ifdef FMM_WITH_PARQUET
+  parquet_reader.reset();
+#endif
+  next_group = num_groups;
+  trajectories.clear();
+  cursor = 0;
+  has_carried = false;
+}
+
+#endif // FMM_WITH_ARROW
@@ -0,0 +1,117 @@
+/**
+ * Fast map matching.
+ *
+ * Reader of the trajectories of an Arrow IPC or Parquet file, which is
+ * only built if fmm is configured with WITH_ARROW, and WITH_PARQUET for
+ * the Parquet files.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_ARROW_READER_HPP
+#define FMM_IO_ARROW_READER_HPP
+
+#ifdef FMM_WITH_ARROW
+
+#include "io/gps_reader.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/reader.h>
+
+#ifdef FMM_WITH_PARQUET
+#include <parquet/arrow/reader.h>
+#endif
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Trajectory Reader class for an Arrow IPC (Feather) or Parquet file.
+ *
+ * The file is read in groups of rows, the record batches of an IPC file
+ * or the row groups of a Parquet file, whose columns are converted into
+ * trajectories in parallel, without any text conversion. Two layouts are
+ * read:
+ *
+ * - points, with a row per GPS point and numeric columns of id, x, y and
+ *   timestamp (optional). As for a CSV point file, the rows must be
+ *   sorted by id and timestamp. A row whose id, x or y is null is skipped.
+ * - trajectories, with a row per trajectory, a numeric id column and a
+ *   linestring column of 2D WKB or GeoArrow (a list of x/y structs or of
+ *   interleaved coordinates), with an optional list column of timestamps.
+ *
+ * A timestamp column of the Arrow timestamp type is converted to seconds.
+ */
+class ArrowTrajectoryReader : public ITrajectoryReader {
+ public:
+  /**
+   * Open an Arrow IPC or Parquet file, given by its extension
+   * @param filename    file name, .parquet for a Parquet file
+   * @param id_name     id column name
+   * @param geom_name   geometry column name, read if gps_point is false
+   * @param x_name      x column name, read if gps_point is true
+   * @param y_name      y column name, read if gps_point is true
+   * @param time_name   timestamp column name. If the column is not found,
+   * an empty timestamp vector will be returned for every trajectory.
+   * @param gps_point   true for the points layout
+   * @param num_threads threads converting the columns
+   */
+  ArrowTrajectoryReader(const std::string &filename,
+                        const std::string &id_name,
+                        const std::string &geom_name,
+                        const std::string &x_name,
+                        const std::string &y_name,
+                        const std::string &time_name,
+                        bool gps_point, int num_threads = 1);
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  void close() override;
+ private:
+  /**
+   * Read the columns of a group of rows
+   * @param  index   index of the group
+   * @param  columns updated with the id, x/geom, y and timestamp columns,
+   * where a column not read is null
+   * @return false if the group cannot be read
+   */
+  bool read_group(int index,
+                  std::vector<std::shared_ptr<arrow::ChunkedArray>> *columns);
+  /**
+   * Read the next group of rows into the trajectories buffered
+   */
+  void read_next_group();
+  void convert_points(
+      const std::vector<std::shared_ptr<arrow::ChunkedArray>> &columns);
+  void convert_linestrings(
+      const std::vector<std::shared_ptr<arrow::ChunkedArray>> &columns);
+  std::vector<std::string> column_names;
+  bool gps_point;
+  bool timestamp_found = false;
+  int num_threads;
+  int num_groups = 0;
+  int next_group = 0;
+  std::shared_ptr<arrow::ipc::RecordBatchFileReader> ipc_reader;
+#ifdef FMM_WITH_PARQUET
+  std::unique_ptr<parquet::arrow::FileReader> parquet_reader;
+  std::vector<int> parquet_leaves; // Leaf columns of the columns read
+#endif
+  std::vector<FMM::CORE::Trajectory> trajectories;
+  size_t cursor = 0;
+  // Last trajectory of the points read, continued in the next group
+  FMM::CORE::Trajectory carried;
+  bool has_carried = false;
+}; // ArrowTrajectoryReader
+
+} // IO
+} // FMM
+
+#endif // FMM_WITH_ARROW
+
+#endif // FMM_IO_ARROW_READER_HPP
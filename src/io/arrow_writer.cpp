@@ -0,0 +1,277 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#ifdef FMM_WITH_ARROW
+
+#include "io/arrow_writer.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+template <typename T>
+void append_bytes(const T &value, std::string *buffer) {
+  buffer->append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+arrow::Status append_ints(arrow::ListBuilder *builder,
+                          const std::vector<int> &values) {
+  ARROW_RETURN_NOT_OK(builder->Append());
+  auto *value_builder =
+      static_cast<arrow::Int32Builder *>(builder->value_builder());
+  return value_builder->AppendValues(values.data(), values.size());
+}
+
+// Append a field of the candidates of the optimal path as a list
+template <typename Getter>
+arrow::Status append_doubles(arrow::ListBuilder *builder,
+                             const MatchedCandidatePath &path,
+                             Getter getter) {
+  ARROW_RETURN_NOT_OK(builder->Append());
+  auto *value_builder =
+      static_cast<arrow::DoubleBuilder *>(builder->value_builder());
+  for (const MatchedCandidate &mc : path) {
+    ARROW_RETURN_NOT_OK(value_builder->Append(getter(mc)));
+  }
+  return arrow::Status::OK();
+}
+
+// Append the WKB of a linestring, in the byte order of the host, which
+// is little endian on the platforms supported
+arrow::Status append_wkb(arrow::BinaryBuilder *builder,
+                         const LineString &line) {
+  static thread_local std::string wkb;
+  wkb.clear();
+  append_bytes<uint8_t>(1, &wkb);
+  append_bytes<uint32_t>(2, &wkb);
+  int N = line.get_num_points();
+  append_bytes<uint32_t>(N, &wkb);
+  for (int i = 0; i < N; ++i) {
+    append_bytes<double>(line.get_x(i), &wkb);
+    append_bytes<double>(line.get_y(i), &wkb);
+  }
+  return builder->Append(reinterpret_cast<const uint8_t *>(wkb.data()),
+                         wkb.size());
+}
+
+std::shared_ptr<arrow::DataType> int_list() {
+  return arrow::list(arrow::int32());
+}
+
+std::shared_ptr<arrow::DataType> double_list() {
+  return arrow::list(arrow::float64());
+}
+
+} // namespace
+
+ArrowMatchResultWriter::ArrowMatchResultWriter(
+    const std::string &result_file, const CONFIG::OutputConfig &config_arg,
+    int batch_rows) :
+    config_(config_arg), batch_rows_(std::max(batch_rows, 1)),
+    opath_(arrow::default_memory_pool(),
+           std::make_shared<arrow::Int32Builder>()),
+    error_(arrow::default_memory_pool(),
+           std::make_shared<arrow::DoubleBuilder>()),
+    offset_(arrow::default_memory_pool(),
+            std::make_shared<arrow::DoubleBuilder>()),
+    spdist_(arrow::default_memory_pool(),
+            std::make_shared<arrow::DoubleBuilder>()),
+    cpath_(arrow::default_memory_pool(),
+           std::make_shared<arrow::Int32Builder>()),
+    indices_(arrow::default_memory_pool(),
+             std::make_shared<arrow::Int32Builder>()),
+    ep_(arrow::default_memory_pool(),
+        std::make_shared<arrow::DoubleBuilder>()),
+    tp_(arrow::default_memory_pool(),
+        std::make_shared<arrow::DoubleBuilder>()),
+    length_(arrow::default_memory_pool(),
+            std::make_shared<arrow::DoubleBuilder>()) {
+  // The fields are in the order of the columns of the csv writer
+  std::vector<std::shared_ptr<arrow::Field>> fields;
+  fields.push_back(arrow::field("id", arrow::int64()));
+  if (config_.write_segment) {
+    fields.push_back(arrow::field("first", arrow::int32()));
+    fields.push_back(arrow::field("last", arrow::int32()));
+  }
+  if (config_.write_opath) fields.push_back(arrow::field("opath", int_list()));
+  if (config_.write_error) {
+    fields.push_back(arrow::field("error", double_list()));
+  }
+  if (config_.write_offset) {
+    fields.push_back(arrow::field("offset", double_list()));
+  }
+  if (config_.write_spdist) {
+    fields.push_back(arrow::field("spdist", double_list()));
+  }
+  if (config_.write_pgeom) {
+    fields.push_back(arrow::field("pgeom", arrow::binary()));
+  }
+  if (config_.write_cpath) fields.push_back(arrow::field("cpath", int_list()));
+  if (config_.write_tpath) {
+    fields.push_back(arrow::field("indices", int_list()));
+  }
+  if (config_.write_mgeom) {
+    fields.push_back(arrow::field("mgeom", arrow::binary()));
+  }
+  if (config_.write_ep) fields.push_back(arrow::field("ep", double_list()));
+  if (config_.write_tp) fields.push_back(arrow::field("tp", double_list()));
+  if (config_.write_length) {
+    fields.push_back(arrow::field("length", double_list()));
+  }
+  if (config_.write_partial) {
+    fields.push_back(arrow::field("partial", arrow::boolean()));
+  }
+  schema_ = arrow::schema(fields);
+  auto sink = arrow::io::FileOutputStream::Open(result_file);
+  if (!sink.ok()) {
+    SPDLOG_CRITICAL("Fail to open result file {}: {}", result_file,
+                    sink.status().ToString());
+    return;
+  }
+  sink_ = sink.ValueOrDie();
+  auto writer = arrow::ipc::MakeFileWriter(sink_, schema_);
+  if (!writer.ok()) {
+    SPDLOG_CRITICAL("Fail to write the schema of {}: {}", result_file,
+                    writer.status().ToString());
+    return;
+  }
+  writer_ = writer.ValueOrDie();
+}
+
+ArrowMatchResultWriter::~ArrowMatchResultWriter() {
+  close();
+}
+
+bool ArrowMatchResultWriter::close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (writer_ == nullptr) return false;
+  if (!closed_) {
+    closed_ = true;
+    flush();
+    check(writer_->Close());
+    check(sink_->Close());
+  }
+  return !failed_;
+}
+
+bool ArrowMatchResultWriter::check(const arrow::Status &status) {
+  if (status.ok()) return true;
+  if (!failed_) SPDLOG_CRITICAL("Arrow error {}", status.ToString());
+  failed_ = true;
+  return false;
+}
+
+void ArrowMatchResultWriter::write_result(const MatchResult &result) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  append_row(result, -1, -1);
+}
+
+void ArrowMatchResultWriter::write_result(const SegmentMatchResult &segment) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  append_row(segment.result, segment.first, segment.last);
+}
+
+void ArrowMatchResultWriter::append_row(const MatchResult &result,
+                                        int first, int last) {
+  if (writer_ == nullptr || closed_ || failed_) return;
+  const MatchedCandidatePath &path = result.opt_candidate_path;
+  check(id_.Append(result.id));
+  if (config_.write_segment) {
+    if (first >= 0) {
+      check(first_.Append(first));
+      check(last_.Append(last));
+    } else {
+      check(first_.AppendNull());
+      check(last_.AppendNull());
+    }
+  }
+  if (config_.write_opath) check(append_ints(&opath_, result.opath));
+  if (config_.write_error) {
+    check(append_doubles(&error_, path, [](const MatchedCandidate &mc) {
+      return mc.c.dist;
+    }));
+  }
+  if (config_.write_offset) {
+    check(append_doubles(&offset_, path, [](const MatchedCandidate &mc) {
+      return mc.c.offset;
+    }));
+  }
+  if (config_.write_spdist) {
+    check(append_doubles(&spdist_, path, [](const MatchedCandidate &mc) {
+      return mc.sp_dist;
+    }));
+  }
+  if (config_.write_pgeom) {
+    if (path.empty()) {
+      check(pgeom_.AppendNull());
+    } else {
+      LineString pline;
+      for (const MatchedCandidate &mc : path) {
+        pline.add_point(mc.c.point);
+      }
+      check(append_wkb(&pgeom_, pline));
+    }
+  }
+  if (config_.write_cpath) check(append_ints(&cpath_, result.cpath));
+  if (config_.write_tpath) check(append_ints(&indices_, result.indices));
+  if (config_.write_mgeom) check(append_wkb(&mgeom_, result.mgeom));
+  if (config_.write_ep) {
+    check(append_doubles(&ep_, path, [](const MatchedCandidate &mc) {
+      return mc.ep;
+    }));
+  }
+  if (config_.write_tp) {
+    check(append_doubles(&tp_, path, [](const MatchedCandidate &mc) {
+      return mc.tp;
+    }));
+  }
+  if (config_.write_length) {
+    check(append_doubles(&length_, path, [](const MatchedCandidate &mc) {
+      return mc.c.edge->length;
+    }));
+  }
+  if (config_.write_partial) check(partial_.Append(result.partial));
+  if (++rows_ >= batch_rows_) flush();
+}
+
+void ArrowMatchResultWriter::flush() {
+  if (rows_ == 0 || failed_) return;
+  std::vector<std::shared_ptr<arrow::Array>> arrays;
+  auto finish = [this, &arrays](arrow::ArrayBuilder *builder) {
+    std::shared_ptr<arrow::Array> array;
+    check(builder->Finish(&array));
+    arrays.push_back(array);
+  };
+  finish(&id_);
+  if (config_.write_segment) {
+    finish(&first_);
+    finish(&last_);
+  }
+  if (config_.write_opath) finish(&opath_);
+  if (config_.write_error) finish(&error_);
+  if (config_.write_offset) finish(&offset_);
+  if (config_.write_spdist) finish(&spdist_);
+  if (config_.write_pgeom) finish(&pgeom_);
+  if (config_.write_cpath) finish(&cpath_);
+  if (config_.write_tpath) finish(&indices_);
+  if (config_.write_mgeom) finish(&mgeom_);
+  if (config_.write_ep) finish(&ep_);
+  if (config_.write_tp) finish(&tp_);
+  if (config_.write_length) finish(&length_);
+  if (config_.write_partial) finish(&partial_);
+  std::shared_ptr<arrow::RecordBatch> batch =
+      arrow::RecordBatch::Make(schema_, rows_, arrays);
+  if (!failed_) check(writer_->WriteRecordBatch(*batch));
+  rows_ = 0;
+}
+
+#endif // FMM_WITH_ARROW
@@ -0,0 +1,108 @@
+/**
+ * Fast map matching.
+ *
+ * Writer of the map match results into an Arrow IPC file, which is only
+ * built if fmm is configured with WITH_ARROW.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_ARROW_WRITER_HPP
+#define FMM_IO_ARROW_WRITER_HPP
+
+#ifdef FMM_WITH_ARROW
+
+#include "io/mm_writer.hpp"
+#include "config/result_config.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * A writer of the match results into an Arrow IPC file, with a row per
+ * trajectory or segment and a column per field exported.
+ *
+ * The paths, indices and the fields of the candidates are list columns
+ * of int32 or float64, and the geometries are binary columns of WKB.
+ * The tpath field is exported as the indices column, from which the
+ * traversed paths are sliced out of cpath. The rows are buffered and
+ * written as a record batch once the batch is full or the writer is
+ * destroyed.
+ */
+class ArrowMatchResultWriter : public MatchResultWriter {
+ public:
+  /**
+   * Create the file and write its schema
+   * @param result_file the filename to write result
+   * @param config_arg the fields that will be exported, which should
+   * outlive the writer
+   * @param batch_rows number of rows of a record batch
+   */
+  ArrowMatchResultWriter(const std::string &result_file,
+                         const CONFIG::OutputConfig &config_arg,
+                         int batch_rows = DEFAULT_BATCH_ROWS);
+  /**
+   * Write the rows buffered and close the file
+   */
+  ~ArrowMatchResultWriter();
+  void write_result(const FMM::MM::MatchResult &result);
+  void write_result(const FMM::MM::SegmentMatchResult &segment);
+  bool close();
+  static const int DEFAULT_BATCH_ROWS = 65536; /**< Rows of a batch */
+ private:
+  /**
+   * Append the row of a result, whose segment fields are null if first
+   * is negative
+   */
+  void append_row(const FMM::MM::MatchResult &result, int first, int last);
+  /**
+   * Write the rows buffered as a record batch
+   */
+  void flush();
+  /**
+   * Check the status of an Arrow call, after whose failure the rows
+   * are no longer written
+   * @return false if the call failed
+   */
+  bool check(const arrow::Status &status);
+  const CONFIG::OutputConfig &config_;
+  int batch_rows_;
+  int rows_ = 0;
+  bool failed_ = false;
+  bool closed_ = false;
+  std::mutex mutex_;
+  std::shared_ptr<arrow::Schema> schema_;
+  std::shared_ptr<arrow::io::FileOutputStream> sink_;
+  std::shared_ptr<arrow::ipc::RecordBatchWriter> writer_;
+  arrow::Int64Builder id_;
+  arrow::Int32Builder first_;
+  arrow::Int32Builder last_;
+  arrow::ListBuilder opath_;
+  arrow::ListBuilder error_;
+  arrow::ListBuilder offset_;
+  arrow::ListBuilder spdist_;
+  arrow::BinaryBuilder pgeom_;
+  arrow::ListBuilder cpath_;
+  arrow::ListBuilder indices_;
+  arrow::BinaryBuilder mgeom_;
+  arrow::ListBuilder ep_;
+  arrow::ListBuilder tp_;
+  arrow::ListBuilder length_;
+  arrow::BooleanBuilder partial_;
+}; // ArrowMatchResultWriter
+
+} // IO
+} // FMM
+
+#endif // FMM_WITH_ARROW
+
+#endif // FMM_IO_ARROW_WRITER_HPP
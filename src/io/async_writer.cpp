@@ -0,0 +1,154 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/async_writer.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+namespace {
+
+// Statistics of the writers of the process, with the times in
+// nanoseconds
+std::atomic<long long> written_bytes(0);
+std::atomic<long long> written_blocks(0);
+std::atomic<long long> write_stalls(0);
+std::atomic<long long> write_nanoseconds(0);
+std::atomic<long long> stall_nanoseconds(0);
+
+long long elapsed_nanoseconds(const UTIL::TimePoint &begin) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - begin).count();
+}
+
+} // namespace
+
+AsyncFileWriter::AsyncFileWriter(const std::string &filename, bool append,
+                                 std::size_t block_size) :
+    filename_(filename), block_size_(std::max<std::size_t>(block_size, 1)) {
+  fd_ = open(filename.c_str(),
+             O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+  if (fd_ < 0) {
+    SPDLOG_CRITICAL("Fail to open result file {}", filename);
+    failed_ = true;
+    return;
+  }
+  if (append) offset_ = lseek(fd_, 0, SEEK_END);
+  current_.reserve(block_size_);
+  pending_.reserve(block_size_);
+  thread_ = std::thread(&AsyncFileWriter::run, this);
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  if (fd_ < 0) return;
+  submit();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cond_.notify_all();
+  thread_.join();
+  if (close(fd_) != 0) {
+    SPDLOG_ERROR("Fail to close result file {}", filename_);
+  }
+}
+
+void AsyncFileWriter::write(const char *data, std::size_t size) {
+  if (fd_ < 0) return;
+  current_.append(data, size);
+  if (current_.size() >= block_size_) submit();
+}
+
+void AsyncFileWriter::flush() {
+  if (fd_ < 0) return;
+  submit();
+  std::unique_lock<std::mutex> lock(mutex_);
+  cond_.wait(lock, [this] { return !has_pending_; });
+}
+
+void AsyncFileWriter::submit() {
+  if (current_.empty()) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (has_pending_) {
+    UTIL::TimePoint begin = std::chrono::steady_clock::now();
+    cond_.wait(lock, [this] { return !has_pending_; });
+    ++write_stalls;
+    stall_nanoseconds += elapsed_nanoseconds(begin);
+  }
+  // The block written before is reused as the next one
+  pending_.swap(current_);
+  has_pending_ = true;
+  lock.unlock();
+  cond_.notify_all();
+  current_.clear();
+}
+
+void AsyncFileWriter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    cond_.wait(lock, [this] { return has_pending_ || stopping_; });
+    if (!has_pending_) break;
+    // The block is not touched by the producer until it is released
+    lock.unlock();
+    UTIL::TimePoint begin = std::chrono::steady_clock::now();
+    const char *data = pending_.data();
+    std::size_t left = failed_ ? 0 : pending_.size();
+    while (left > 0) {
+      ssize_t n = pwrite(fd_, data, left, offset_);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        SPDLOG_ERROR("Fail to write result file {}: {}", filename_,
+                     std::strerror(errno));
+        failed_ = true;
+        break;
+      }
+      data += n;
+      left -= n;
+      offset_ += n;
+    }
+    write_nanoseconds += elapsed_nanoseconds(begin);
+    written_bytes += pending_.size() - left;
+    ++written_blocks;
+    lock.lock();
+    pending_.clear();
+    has_pending_ = false;
+    cond_.notify_all();
+  }
+}
+
+AsyncWriteStatistics IO::get_async_write_statistics() {
+  AsyncWriteStatistics statistics;
+  statistics.bytes = written_bytes;
+  statistics.blocks = written_blocks;
+  statistics.stalls = write_stalls;
+  statistics.write_seconds = write_nanoseconds / 1e9;
+  statistics.stall_seconds = stall_nanoseconds / 1e9;
+  return statistics;
+}
+
+void IO::append_async_write_metrics(UTIL::MetricsText *text) {
+  AsyncWriteStatistics statistics = get_async_write_statistics();
+  text->counter("fmm_async_write_bytes_total",
+                "Bytes written by the asynchronous writers",
+                statistics.bytes);
+  text->counter("fmm_async_write_blocks_total",
+                "Blocks written by the asynchronous writers",
+                statistics.blocks);
+  text->counter("fmm_async_write_seconds_total",
+                "Time of the writer threads in writes",
+                statistics.write_seconds);
+  text->counter("fmm_async_write_stalls_total",
+                "Blocks submitted before the previous one was written",
+                statistics.stalls);
+  text->counter("fmm_async_write_stall_seconds_total",
+                "Time the producers waited for a block to be written",
+                statistics.stall_seconds);
+}
@@ -0,0 +1,121 @@
+/**
+ * Fast map matching.
+ *
+ * Writer of an output file by a background thread, so that formatting
+ * the output overlaps with writing it to a slow or remote disk
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_ASYNC_WRITER_HPP
+#define FMM_IO_ASYNC_WRITER_HPP
+
+#include "util/metrics.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Statistics of the asynchronous writers of the process
+ */
+struct AsyncWriteStatistics {
+  long long bytes = 0; /**< Bytes written */
+  long long blocks = 0; /**< Blocks written */
+  long long stalls = 0; /**< Blocks submitted while the previous one
+                             was still being written */
+  double write_seconds = 0; /**< Time of the writer threads in writes */
+  double stall_seconds = 0; /**< Time the producers waited for a block
+                                 to be written */
+};
+
+/**
+ * A file written by a thread of its own with double buffering.
+ *
+ * The data written is appended to a block, and a full block is handed
+ * over to the thread, which writes it with pwrite while the next block
+ * is filled. A producer only waits when it fills a block before the
+ * previous one is written, which is counted as a stall in the
+ * statistics. The writer is used by a single producer at a time.
+ */
+class AsyncFileWriter {
+ public:
+  /**
+   * Open a file and start its thread
+   * @param filename   name of the file
+   * @param append     if true, the data is written after the content of
+   * the file instead of replacing it
+   * @param block_size size of the blocks handed over to the thread
+   */
+  explicit AsyncFileWriter(const std::string &filename, bool append = false,
+                           std::size_t block_size = BLOCK_SIZE);
+  /**
+   * Write the data buffered, stop the thread and close the file
+   */
+  ~AsyncFileWriter();
+  AsyncFileWriter(const AsyncFileWriter &) = delete;
+  AsyncFileWriter &operator=(const AsyncFileWriter &) = delete;
+  /**
+   * Check if the file is opened and written without error
+   */
+  bool good() const { return !failed_; }
+  /**
+   * Write data, which is handed over to the thread once the block is full
+   * @param data data written
+   * @param size number of bytes
+   */
+  void write(const char *data, std::size_t size);
+  /**
+   * Hand over the block and wait until the thread has written it, so
+   * that the file holds all the data written before
+   */
+  void flush();
+  /**
+   * Default size of the blocks
+   */
+  static const std::size_t BLOCK_SIZE = 4 << 20;
+ private:
+  /**
+   * Hand over the block filled, after the previous one is written
+   */
+  void submit();
+  /**
+   * Write the blocks handed over until the writer is stopped
+   */
+  void run();
+  std::string filename_;
+  int fd_ = -1;
+  long long offset_ = 0;
+  std::size_t block_size_;
+  std::string current_; // Filled by the producer
+  std::string pending_; // Written by the thread
+  bool has_pending_ = false;
+  bool stopping_ = false;
+  std::atomic<bool> failed_{false};
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+}; // AsyncFileWriter
+
+/**
+ * Get the statistics of all the asynchronous writers of the process
+ */
+AsyncWriteStatistics get_async_write_statistics();
+
+/**
+ * Add the bytes written and the stalls of the asynchronous writers to
+ * metrics
+ * @param text metrics updated
+ */
+void append_async_write_metrics(UTIL::MetricsText *text);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_ASYNC_WRITER_HPP
@@ -0,0 +1,314 @@
+/**
+ * Fast map matching.
+ *
+ * Implementation of the binary trajectory file
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+#include "io/binary_trajectory.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::IO;
+
+namespace {
+
+// Header of the binary trajectory file. The blocks follow the header and
+// the block index is stored at the end.
+struct TrajectoryFileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int flags;
+  long long num_trajectories;
+  long long num_blocks;
+  long long index_offset;
+};
+const char TRAJECTORY_MAGIC[8] = {'F', 'M', 'M', 'T', 'R', 'A', 'J', 'S'};
+const unsigned int TRAJECTORY_VERSION = 1;
+// Blocks are compressed with zlib
+const unsigned int TRAJECTORY_FLAG_COMPRESSED = 1;
+// Some trajectories are stored with timestamps
+const unsigned int TRAJECTORY_FLAG_TIMESTAMP = 2;
+// Id, number of points and number of timestamps of a trajectory
+const size_t RECORD_HEADER_SIZE = 3 * sizeof(long long);
+
+void append_bytes(const void *value, size_t bytes, std::string *buf) {
+  buf->append((const char *) value, bytes);
+}
+
+} // namespace
+
+BinaryTrajectoryWriter::BinaryTrajectoryWriter(const std::string &filename,
+                                               bool compress,
+                                               long block_bytes) :
+    filename(filename), compress(compress),
+    block_bytes(std::max(block_bytes, 1L)) {
+  stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  // The header is written once the blocks are known
+  TrajectoryFileHeader header;
+  memset(&header, 0, sizeof(header));
+  success = fwrite(&header, sizeof(header), 1, stream) == 1;
+  offset = sizeof(header);
+}
+
+BinaryTrajectoryWriter::~BinaryTrajectoryWriter() {
+  close();
+}
+
+bool BinaryTrajectoryWriter::write_trajectory(const Trajectory &traj) {
+  long long num_points = traj.geom.get_num_points();
+  long long num_timestamps =
+      traj.timestamps.size() == (size_t) num_points ? num_points : 0;
+  long long id = traj.id;
+  append_bytes(&id, sizeof(id), &block);
+  append_bytes(&num_points, sizeof(num_points), &block);
+  append_bytes(&num_timestamps, sizeof(num_timestamps), &block);
+  for (int i = 0; i < num_points; ++i) {
+    double x = traj.geom.get_x(i);
+    append_bytes(&x, sizeof(x), &block);
+  }
+  for (int i = 0; i < num_points; ++i) {
+    double y = traj.geom.get_y(i);
+    append_bytes(&y, sizeof(y), &block);
+  }
+  if (num_timestamps > 0) {
+    append_bytes(traj.timestamps.data(), num_timestamps * sizeof(double),
+                 &block);
+    timestamp = true;
+  }
+  ++block_trajectories;
+  ++num_trajectories;
+  if ((long) block.size() >= block_bytes) flush_block();
+  return success;
+}
+
+bool BinaryTrajectoryWriter::flush_block() {
+  if (block_trajectories == 0 || !success) return success;
+  std::string compressed;
+  const std::string *stored = &block;
+  if (compress) {
+    uLongf compressed_size = compressBound(block.size());
+    compressed.resize(compressed_size);
+    if (compress2((Bytef *) &compressed[0], &compressed_size,
+                  (const Bytef *) block.data(), block.size(),
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+      SPDLOG_CRITICAL("Failed to compress trajectories");
+      success = false;
+      return false;
+    }
+    compressed.resize(compressed_size);
+    stored = &compressed;
+  }
+  BinaryTrajectoryBlock entry;
+  entry.offset = offset;
+  entry.stored_size = stored->size();
+  entry.raw_size = block.size();
+  entry.num_trajectories = block_trajectories;
+  success = fwrite(stored->data(), 1, stored->size(), stream) ==
+      stored->size();
+  index.push_back(entry);
+  offset += stored->size();
+  block.clear();
+  block_trajectories = 0;
+  return success;
+}
+
+bool BinaryTrajectoryWriter::close() {
+  if (stream == nullptr) return success;
+  flush_block();
+  TrajectoryFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TRAJECTORY_MAGIC, sizeof(TRAJECTORY_MAGIC));
+  header.version = TRAJECTORY_VERSION;
+  header.flags = (compress ? TRAJECTORY_FLAG_COMPRESSED : 0) |
+      (timestamp ? TRAJECTORY_FLAG_TIMESTAMP : 0);
+  header.num_trajectories = num_trajectories;
+  header.num_blocks = index.size();
+  header.index_offset = offset;
+  if (success && !index.empty()) {
+    success = fwrite(index.data(), sizeof(BinaryTrajectoryBlock),
+                     index.size(), stream) == index.size();
+  }
+  if (success) {
+    success = fseek(stream, 0, SEEK_SET) == 0 &&
+        fwrite(&header, sizeof(header), 1, stream) == 1;
+  }
+  if (fclose(stream) != 0) success = false;
+  stream = nullptr;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write trajectory file {}", filename);
+  } else {
+    SPDLOG_INFO("Trajectories {} blocks {} bytes {}", num_trajectories,
+                index.size(),
+                offset + index.size() * sizeof(BinaryTrajectoryBlock));
+  }
+  return success;
+}
+
+BinaryTrajectoryReader::BinaryTrajectoryReader(const std::string &filename) :
+    filename(filename) {
+  SPDLOG_INFO("Read binary trajectory file {}", filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    SPDLOG_CRITICAL("Fail to open GPS file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  size = file_stat.st_size;
+  void *addr = nullptr;
+  if (size >= sizeof(TrajectoryFileHeader)) {
+    addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Fail to map GPS file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  data = (unsigned char *) addr;
+  madvise(data, size, MADV_SEQUENTIAL);
+  const TrajectoryFileHeader *header = (const TrajectoryFileHeader *) data;
+  compressed = (header->flags & TRAJECTORY_FLAG_COMPRESSED) != 0;
+  timestamp = (header->flags & TRAJECTORY_FLAG_TIMESTAMP) != 0;
+  num_trajectories = header->num_trajectories;
+  num_blocks = header->num_blocks;
+  bool valid = memcmp(header->magic, TRAJECTORY_MAGIC,
+                      sizeof(TRAJECTORY_MAGIC)) == 0 &&
+      header->version == TRAJECTORY_VERSION && num_blocks >= 0 &&
+      header->index_offset >= (long long) sizeof(TrajectoryFileHeader) &&
+      size == header->index_offset +
+          num_blocks * sizeof(BinaryTrajectoryBlock);
+  // The index is copied as it is not aligned after compressed blocks
+  if (valid) {
+    index.resize(num_blocks);
+    memcpy(index.data(), data + header->index_offset,
+           num_blocks * sizeof(BinaryTrajectoryBlock));
+  }
+  long long trajectories = 0;
+  for (long long i = 0; valid && i < num_blocks; ++i) {
+    const BinaryTrajectoryBlock &entry = index[i];
+    // A block read in place must be aligned for its coordinates
+    valid = entry.offset >= (long long) sizeof(TrajectoryFileHeader) &&
+        entry.stored_size >= 0 &&
+        entry.offset + entry.stored_size <= header->index_offset &&
+        entry.raw_size % sizeof(double) == 0 &&
+        (compressed || (entry.stored_size == entry.raw_size &&
+                        entry.offset % sizeof(double) == 0));
+    trajectories += entry.num_trajectories;
+  }
+  if (!valid || trajectories != num_trajectories) {
+    SPDLOG_CRITICAL("Invalid or incompatible trajectory file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  SPDLOG_INFO("Trajectories {} blocks {} compressed {}", num_trajectories,
+              num_blocks, compressed);
+}
+
+BinaryTrajectoryReader::~BinaryTrajectoryReader() {
+  close();
+}
+
+bool BinaryTrajectoryReader::next_block() {
+  while (block < num_blocks) {
+    const BinaryTrajectoryBlock &entry = index[block++];
+    if (compressed) {
+      buffer.resize(entry.raw_size / sizeof(double));
+      uLongf raw_size = entry.raw_size;
+      if (uncompress((Bytef *) buffer.data(), &raw_size,
+                     data + entry.offset, entry.stored_size) != Z_OK ||
+          raw_size != (uLongf) entry.raw_size) {
+        SPDLOG_CRITICAL("Corrupted trajectory file {}", filename);
+        std::exit(EXIT_FAILURE);
+      }
+      cursor = (const unsigned char *) buffer.data();
+    } else {
+      cursor = data + entry.offset;
+    }
+    block_end = cursor + entry.raw_size;
+    if (cursor < block_end) return true;
+  }
+  return false;
+}
+
+bool BinaryTrajectoryReader::has_next_trajectory() {
+  return cursor < block_end || next_block();
+}
+
+bool BinaryTrajectoryReader::read_next_span(TrajectorySpan *span) {
+  if (!has_next_trajectory()) return false;
+  long long values[3] = {0, -1, 0};
+  long long available = block_end - cursor;
+  if (available >= (long long) RECORD_HEADER_SIZE) {
+    memcpy(values, cursor, RECORD_HEADER_SIZE);
+  }
+  long long num_points = values[1];
+  long long num_timestamps = values[2];
+  if (num_points < 0 ||
+      (num_timestamps != 0 && num_timestamps != num_points) ||
+      (2 * num_points + num_timestamps) * (long long) sizeof(double) >
+          available - (long long) RECORD_HEADER_SIZE) {
+    SPDLOG_CRITICAL("Corrupted trajectory file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  const double *arrays = (const double *) (cursor + RECORD_HEADER_SIZE);
+  span->id = values[0];
+  span->num_points = num_points;
+  span->x = arrays;
+  span->y = arrays + num_points;
+  span->timestamps = num_timestamps > 0 ? arrays + 2 * num_points : nullptr;
+  cursor += RECORD_HEADER_SIZE +
+      (2 * num_points + num_timestamps) * sizeof(double);
+  return true;
+}
+
+Trajectory BinaryTrajectoryReader::read_next_trajectory() {
+  Trajectory traj{0, LineString(), {}};
+  TrajectorySpan span;
+  if (!read_next_span(&span)) return traj;
+  traj.id = span.id;
+  traj.geom.get_geometry().reserve(span.num_points);
+  for (int i = 0; i < span.num_points; ++i) {
+    traj.geom.add_point(span.x[i], span.y[i]);
+  }
+  if (span.timestamps != nullptr) {
+    traj.timestamps.assign(span.timestamps,
+                           span.timestamps + span.num_points);
+  }
+  return traj;
+}
+
+bool BinaryTrajectoryReader::has_timestamp() {
+  return timestamp;
+}
+
+long long BinaryTrajectoryReader::get_num_trajectories() const {
+  return num_trajectories;
+}
+
+void BinaryTrajectoryReader::reset_cursor() {
+  block = 0;
+  cursor = nullptr;
+  block_end = nullptr;
+}
+
+void BinaryTrajectoryReader::close() {
+  if (data != nullptr) munmap(data, size);
+  data = nullptr;
+  block = num_blocks;
+  cursor = nullptr;
+  block_end = nullptr;
+}
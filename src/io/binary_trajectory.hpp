@@ -0,0 +1,162 @@
+/**
+ * Fast map matching.
+ *
+ * Binary trajectory file, read without parsing text
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_BINARY_TRAJECTORY_HPP
+#define FMM_IO_BINARY_TRAJECTORY_HPP
+
+#include "io/gps_reader.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Trajectory of a binary file whose coordinates are read in place. The
+ * arrays are valid until the next block of the file is read, or until
+ * the file is closed if it is not compressed.
+ */
+struct TrajectorySpan {
+  int id = 0; /**< Id of the trajectory */
+  int num_points = 0; /**< Number of points */
+  const double *x = nullptr; /**< x coordinates of the points */
+  const double *y = nullptr; /**< y coordinates of the points */
+  const double *timestamps = nullptr; /**< Timestamps of the points, or
+                                           nullptr if not stored */
+};
+
+/**
+ * Entry of the block index of a binary trajectory file
+ */
+struct BinaryTrajectoryBlock {
+  long long offset; /**< Offset of the block in the file */
+  long long stored_size; /**< Bytes of the block stored */
+  long long raw_size; /**< Bytes of the block once decompressed */
+  long long num_trajectories; /**< Trajectories of the block */
+};
+
+/**
+ * Writer of a binary trajectory file (traj extension).
+ *
+ * The file starts with a header, followed by blocks of trajectories and
+ * ends with the index of the blocks. Each trajectory is stored as its
+ * id, number of points and number of timestamps, followed by the arrays
+ * of x, y and timestamps in double precision, so that a block can be
+ * read in place. The blocks may be compressed with zlib.
+ */
+class BinaryTrajectoryWriter {
+ public:
+  /**
+   * Default size of a block before compression, in bytes
+   */
+  static const long DEFAULT_BLOCK_BYTES = 4L << 20;
+  /**
+   * Create the file written, the program exits if it cannot be created
+   * @param filename    name of the file
+   * @param compress    compress the blocks if true
+   * @param block_bytes size of a block before compression, in bytes
+   */
+  BinaryTrajectoryWriter(const std::string &filename, bool compress = false,
+                         long block_bytes = DEFAULT_BLOCK_BYTES);
+  ~BinaryTrajectoryWriter();
+  /**
+   * Append a trajectory to the file
+   * @param traj trajectory, whose timestamps are stored only if there is
+   * one for each point
+   * @return false if the file cannot be written
+   */
+  bool write_trajectory(const FMM::CORE::Trajectory &traj);
+  /**
+   * Write the last block and the index of the blocks, then close the file
+   * @return false if the file cannot be written
+   */
+  bool close();
+  BinaryTrajectoryWriter(const BinaryTrajectoryWriter &) = delete;
+  BinaryTrajectoryWriter &operator=(
+      const BinaryTrajectoryWriter &) = delete;
+ private:
+  /**
+   * Write the trajectories buffered as a block
+   */
+  bool flush_block();
+  std::string filename;
+  FILE *stream = nullptr;
+  bool compress;
+  long block_bytes;
+  bool success = true;
+  bool timestamp = false; // Any trajectory stored with timestamps
+  long long num_trajectories = 0;
+  long long offset = 0; // Offset of the next block in the file
+  std::string block; // Trajectories buffered for the next block
+  long long block_trajectories = 0;
+  std::vector<BinaryTrajectoryBlock> index;
+};
+
+/**
+ * Reader of a binary trajectory file written by BinaryTrajectoryWriter.
+ *
+ * The file is mapped into memory. A block which is not compressed is
+ * read in place, otherwise it is decompressed when its first trajectory
+ * is read.
+ */
+class BinaryTrajectoryReader : public ITrajectoryReader {
+ public:
+  /**
+   * Open a binary trajectory file, the program exits if it is invalid
+   * @param filename name of the file
+   */
+  explicit BinaryTrajectoryReader(const std::string &filename);
+  ~BinaryTrajectoryReader();
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  void close() override;
+  /**
+   * Read the next trajectory without copying its coordinates
+   * @param span updated with the arrays of the trajectory
+   * @return false if all the trajectories are read
+   */
+  bool read_next_span(TrajectorySpan *span);
+  /**
+   * Get the number of trajectories in the file
+   */
+  long long get_num_trajectories() const;
+  /**
+   * Reset cursor of the reader
+   */
+  void reset_cursor();
+  BinaryTrajectoryReader(const BinaryTrajectoryReader &) = delete;
+  BinaryTrajectoryReader &operator=(
+      const BinaryTrajectoryReader &) = delete;
+ private:
+  /**
+   * Move to the next block which holds a trajectory
+   * @return false if there is no such block
+   */
+  bool next_block();
+  std::string filename;
+  unsigned char *data = nullptr; // Content of the file mapped
+  size_t size = 0;
+  bool compressed = false;
+  bool timestamp = false;
+  long long num_trajectories = 0;
+  long long num_blocks = 0;
+  std::vector<BinaryTrajectoryBlock> index;
+  long long block = 0; // Next block to read
+  std::vector<double> buffer; // Block decompressed
+  const unsigned char *cursor = nullptr; // Next trajectory to read
+  const unsigned char *block_end = nullptr;
+};
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_BINARY_TRAJECTORY_HPP
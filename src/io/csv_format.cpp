@@ -0,0 +1,264 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/csv_format.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::IO;
+
+namespace {
+
+const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+    1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Bound of the scaled values rounded with integer arithmetic, below
+// which the fraction of a double is exact
+const double MAX_SCALED = 4503599627370496.0;
+
+// Round value * 10^decimals to the nearest integer as printf does, from
+// the exact product, with the ties to even. Return false if the product
+// is too large.
+bool round_scaled(double value, int decimals, double *scaled) {
+  double p = POW10[decimals];
+  double product = value * p;
+  if (!(product < MAX_SCALED)) return false;
+  // The rounding error of the product is exact, and it only matters
+  // when the fraction is a half
+  double error = std::fma(value, p, -product);
+  double base = std::floor(product);
+  double fraction = product - base;
+  if (fraction > 0.5 || (fraction == 0.5 &&
+      (error > 0 || (error == 0 && std::fmod(base, 2) != 0)))) {
+    base += 1;
+  }
+  *scaled = base;
+  return true;
+}
+
+void append_unsigned(unsigned long long value, std::string *buffer) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0) buffer->push_back(digits[--n]);
+}
+
+// Append scaled / 10^decimals, without the trailing zeros of the
+// decimals
+void append_scaled(bool negative, unsigned long long scaled, int decimals,
+                   std::string *buffer) {
+  unsigned long long scale = 1;
+  for (int k = 0; k < decimals; ++k) scale *= 10;
+  unsigned long long integer = scaled / scale;
+  unsigned long long fraction = scaled % scale;
+  if (negative && scaled != 0) buffer->push_back('-');
+  append_unsigned(integer, buffer);
+  if (fraction == 0) return;
+  while (fraction % 10 == 0) {
+    fraction /= 10;
+    --decimals;
+  }
+  buffer->push_back('.');
+  std::size_t end = buffer->size() + decimals;
+  buffer->resize(end);
+  for (int k = 1; k <= decimals; ++k) {
+    (*buffer)[end - k] = '0' + fraction % 10;
+    fraction /= 10;
+  }
+}
+
+// Append a difference of scaled coordinates as the chunks of 5 bits of
+// a Google encoded polyline
+void append_polyline_value(long long delta, std::string *buffer) {
+  unsigned long long value = (unsigned long long) delta << 1;
+  if (delta < 0) value = ~value;
+  while (value >= 0x20) {
+    buffer->push_back((char) ((0x20 | (value & 0x1f)) + 63));
+    value >>= 5;
+  }
+  buffer->push_back((char) (value + 63));
+}
+
+void append_printf(const char *format, int precision, double value,
+                   std::string *buffer) {
+  char text[512];
+  int n = std::snprintf(text, sizeof(text), format, precision, value);
+  if (n > 0) buffer->append(text, std::min<int>(n, sizeof(text) - 1));
+}
+
+} // namespace
+
+void IO::append_int(long long value, std::string *buffer) {
+  if (value < 0) {
+    buffer->push_back('-');
+    append_unsigned(0ULL - (unsigned long long) value, buffer);
+  } else {
+    append_unsigned(value, buffer);
+  }
+}
+
+void IO::append_double(double value, int digits, std::string *buffer) {
+  if (!std::isfinite(value) || digits < 1 || digits > 15) {
+    append_printf("%.*g", digits, value, buffer);
+    return;
+  }
+  if (value == 0) {
+    buffer->append(std::signbit(value) ? "-0" : "0");
+    return;
+  }
+  double a = std::fabs(value);
+  int e = (int) std::floor(std::log10(a));
+  // The exponent is corrected once for the rounding of the logarithm or
+  // a rounding carried into a new digit
+  double scaled = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    if (e < -4 || e >= digits) break;
+    round_scaled(a, digits - 1 - e, &scaled);
+    if (scaled >= POW10[digits]) {
+      ++e;
+    } else if (scaled < POW10[digits - 1]) {
+      --e;
+    } else {
+      append_scaled(value < 0, (unsigned long long) scaled,
+                    digits - 1 - e, buffer);
+      return;
+    }
+  }
+  // Written with an exponent by printf
+  append_printf("%.*g", digits, value, buffer);
+}
+
+void IO::append_fixed(double value, int decimals, std::string *buffer) {
+  if (std::isfinite(value) && decimals >= 0 && decimals <= 17) {
+    double scaled = 0;
+    if (round_scaled(std::fabs(value), decimals, &scaled)) {
+      append_scaled(value < 0, (unsigned long long) scaled, decimals,
+                    buffer);
+      return;
+    }
+  }
+  std::size_t begin = buffer->size();
+  append_printf("%.*f", decimals, value, buffer);
+  if (buffer->find('.', begin) == std::string::npos) return;
+  while (buffer->back() == '0') buffer->pop_back();
+  if (buffer->back() == '.') buffer->pop_back();
+}
+
+void IO::append_wkt(const LineString &line, int precision,
+                    std::string *buffer) {
+  buffer->append("LINESTRING(");
+  int N = line.get_num_points();
+  for (int i = 0; i < N; ++i) {
+    if (i > 0) buffer->push_back(',');
+    if (precision < 0) {
+      append_double(line.get_x(i), COORDINATE_DIGITS, buffer);
+      buffer->push_back(' ');
+      append_double(line.get_y(i), COORDINATE_DIGITS, buffer);
+    } else {
+      append_fixed(line.get_x(i), precision, buffer);
+      buffer->push_back(' ');
+      append_fixed(line.get_y(i), precision, buffer);
+    }
+  }
+  buffer->push_back(')');
+}
+
+bool IO::string2geometry_encoding(const std::string &name,
+                                  GeometryEncoding *encoding) {
+  if (name == "wkt") {
+    *encoding = WKT_ENCODING;
+  } else if (name == "hexwkb") {
+    *encoding = HEX_WKB_ENCODING;
+  } else if (name == "polyline") {
+    *encoding = POLYLINE_ENCODING;
+  } else if (name == "delta") {
+    *encoding = DELTA_ENCODING;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void IO::append_hex_wkb(const LineString &line, std::string *buffer) {
+  static const char HEX[] = "0123456789ABCDEF";
+  int N = line.get_num_points();
+  // Byte order, type of a linestring and number of points
+  unsigned char bytes[16];
+  unsigned int header[2] = {2, (unsigned int) N};
+  bytes[0] = 1;
+  std::memcpy(bytes + 1, header, sizeof(header));
+  std::size_t begin = buffer->size();
+  buffer->resize(begin + 2 * (9 + 16 * N));
+  char *out = &(*buffer)[begin];
+  auto append_hex = [&out](const unsigned char *data, int size) {
+    for (int k = 0; k < size; ++k) {
+      *out++ = HEX[data[k] >> 4];
+      *out++ = HEX[data[k] & 15];
+    }
+  };
+  append_hex(bytes, 9);
+  for (int i = 0; i < N; ++i) {
+    double coords[2] = {line.get_x(i), line.get_y(i)};
+    std::memcpy(bytes, coords, sizeof(coords));
+    append_hex(bytes, 16);
+  }
+}
+
+void IO::append_polyline(const LineString &line, int decimals,
+                         std::string *buffer) {
+  double scale = POW10[decimals < 0 ? POLYLINE_DECIMALS : decimals];
+  long long last_x = 0, last_y = 0;
+  int N = line.get_num_points();
+  for (int i = 0; i < N; ++i) {
+    long long x = std::llround(line.get_x(i) * scale);
+    long long y = std::llround(line.get_y(i) * scale);
+    append_polyline_value(y - last_y, buffer);
+    append_polyline_value(x - last_x, buffer);
+    last_x = x;
+    last_y = y;
+  }
+}
+
+void IO::append_delta(const LineString &line, int decimals,
+                      std::string *buffer) {
+  double scale = POW10[decimals < 0 ? POLYLINE_DECIMALS : decimals];
+  long long last_x = 0, last_y = 0;
+  int N = line.get_num_points();
+  for (int i = 0; i < N; ++i) {
+    long long x = std::llround(line.get_x(i) * scale);
+    long long y = std::llround(line.get_y(i) * scale);
+    if (i > 0) buffer->push_back(',');
+    append_int(x - last_x, buffer);
+    buffer->push_back(',');
+    append_int(y - last_y, buffer);
+    last_x = x;
+    last_y = y;
+  }
+}
+
+void IO::append_geometry(const LineString &line, GeometryEncoding encoding,
+                         int precision, std::string *buffer) {
+  switch (encoding) {
+    case HEX_WKB_ENCODING:
+      append_hex_wkb(line, buffer);
+      break;
+    case POLYLINE_ENCODING:
+      append_polyline(line, precision, buffer);
+      break;
+    case DELTA_ENCODING:
+      append_delta(line, precision, buffer);
+      break;
+    default:
+      append_wkt(line, precision, buffer);
+  }
+}
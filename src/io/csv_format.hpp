@@ -0,0 +1,153 @@
+/**
+ * Fast map matching.
+ *
+ * Formatting of numbers and geometries appended to a character buffer,
+ * which is used for writing the results without iostream.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_CSV_FORMAT_HPP
+#define FMM_IO_CSV_FORMAT_HPP
+
+#include "core/geometry.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Significant digits of the coordinates written by default
+ */
+const int COORDINATE_DIGITS = 12;
+
+/**
+ * Significant digits of the other floating point fields written by
+ * default
+ */
+const int VALUE_DIGITS = 6;
+
+/**
+ * Append an integer
+ * @param value  integer appended
+ * @param buffer buffer updated
+ */
+void append_int(long long value, std::string *buffer);
+
+/**
+ * Append a double with a number of significant digits, as printf does
+ * with %.{digits}g. The values written without an exponent are formatted
+ * with integer arithmetic, others with snprintf.
+ * @param value  double appended
+ * @param digits number of significant digits, between 1 and 17
+ * @param buffer buffer updated
+ */
+void append_double(double value, int digits, std::string *buffer);
+
+/**
+ * Append a double with a number of decimals, where the trailing zeros
+ * of the decimals are removed
+ * @param value    double appended
+ * @param decimals number of decimals, between 0 and 17
+ * @param buffer   buffer updated
+ */
+void append_fixed(double value, int decimals, std::string *buffer);
+
+/**
+ * Append the WKT of a linestring
+ * @param line      linestring appended
+ * @param precision number of decimals of the coordinates, or negative to
+ * write them with COORDINATE_DIGITS significant digits
+ * @param buffer    buffer updated
+ */
+void append_wkt(const CORE::LineString &line, int precision,
+                std::string *buffer);
+
+/**
+ * Encoding of the geometries written into a csv file
+ */
+enum GeometryEncoding {
+  WKT_ENCODING, /**< WKT text */
+  HEX_WKB_ENCODING, /**< WKB in hexadecimal, as written by PostGIS */
+  POLYLINE_ENCODING, /**< Google encoded polyline, with the latitude or y
+                          before the longitude or x */
+  DELTA_ENCODING /**< Integer coordinates x,y of the first point then the
+                      differences to the previous point, separated by
+                      commas */
+};
+
+/**
+ * Decimals of the coordinates of an encoded polyline or of the integer
+ * coordinates if no precision is given, the one of Google
+ */
+const int POLYLINE_DECIMALS = 5;
+
+/**
+ * Parse the name of a geometry encoding
+ * @param name     wkt, hexwkb, polyline or delta
+ * @param encoding updated with the encoding of the name
+ * @return true if the name is valid
+ */
+bool string2geometry_encoding(const std::string &name,
+                              GeometryEncoding *encoding);
+
+/**
+ * Append the WKB of a linestring in hexadecimal, in little endian
+ * @param line   linestring appended
+ * @param buffer buffer updated
+ */
+void append_hex_wkb(const CORE::LineString &line, std::string *buffer);
+
+/**
+ * Append the Google encoded polyline of a linestring
+ * @param line     linestring appended
+ * @param decimals number of decimals of the coordinates kept, or
+ * negative for POLYLINE_DECIMALS
+ * @param buffer   buffer updated
+ */
+void append_polyline(const CORE::LineString &line, int decimals,
+                     std::string *buffer);
+
+/**
+ * Append the coordinates of a linestring scaled into integers, where the
+ * point after the first one is written as the difference to the previous
+ * point
+ * @param line     linestring appended
+ * @param decimals number of decimals of the coordinates kept, or
+ * negative for POLYLINE_DECIMALS
+ * @param buffer   buffer updated
+ */
+void append_delta(const CORE::LineString &line, int decimals,
+                  std::string *buffer);
+
+/**
+ * Append a linestring in an encoding
+ * @param line      linestring appended
+ * @param encoding  encoding of the geometry
+ * @param precision number of decimals of the coordinates, or negative
+ * for the default of the encoding
+ * @param buffer    buffer updated
+ */
+void append_geometry(const CORE::LineString &line, GeometryEncoding encoding,
+                     int precision, std::string *buffer);
+
+/**
+ * Append integers separated by commas
+ * @param values integers appended
+ * @param buffer buffer updated
+ */
+template <typename T>
+void append_ints(const std::vector<T> &values, std::string *buffer) {
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) buffer->push_back(',');
+    append_int(values[i], buffer);
+  }
+}
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_CSV_FORMAT_HPP
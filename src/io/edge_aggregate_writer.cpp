@@ -0,0 +1,154 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/edge_aggregate_writer.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+std::atomic<long> next_writer_serial(0);
+
+} // namespace
+
+EdgeAggregateWriter::EdgeAggregateWriter(const std::string &result_file,
+                                         const Network &network) :
+    result_file_(result_file), network_(network),
+    serial_(next_writer_serial++) {}
+
+EdgeAggregateWriter::TraversalTable &EdgeAggregateWriter::local_table() {
+  thread_local long serial = -1;
+  thread_local TraversalTable *table = nullptr;
+  if (serial != serial_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tables_.emplace_back(new TraversalTable(network_.get_edge_count()));
+    table = tables_.back().get();
+    serial = serial_;
+  }
+  return *table;
+}
+
+void EdgeAggregateWriter::write_result(const MatchResult &result) {
+  const C_Path &cpath = result.cpath;
+  if (cpath.empty()) return;
+  TraversalTable &table = local_table();
+  const std::vector<Edge> &edges = network_.get_edges();
+  std::vector<EdgeIndex> path(cpath.size());
+  for (std::size_t k = 0; k < cpath.size(); ++k) {
+    path[k] = network_.get_edge_index(cpath[k]);
+    ++table[path[k]].count;
+  }
+  // The distances are found from the offsets of the candidates, which are
+  // only built with them
+  int points = std::min(result.indices.size(),
+                        result.opt_candidate_path.size());
+  bool timed = result.timestamps.size() >= (std::size_t) points;
+  std::vector<double> pieces;
+  for (int i = 0; i + 1 < points; ++i) {
+    int a = result.indices[i];
+    int b = result.indices[i + 1];
+    if (a < 0 || b < a || b >= (int) cpath.size()) continue;
+    double offset_a = result.opt_candidate_path[i].c.offset;
+    double offset_b = result.opt_candidate_path[i + 1].c.offset;
+    pieces.assign(b - a + 1, 0);
+    double distance = 0;
+    for (int k = a; k <= b; ++k) {
+      double start = k == a ? offset_a : 0;
+      double end = k == b ? offset_b : edges[path[k]].length;
+      pieces[k - a] = std::max(end - start, 0.0);
+      distance += pieces[k - a];
+      table[path[k]].distance += pieces[k - a];
+    }
+    if (!timed) continue;
+    double duration = result.timestamps[i + 1] - result.timestamps[i];
+    if (duration < 0) continue;
+    // A point staying on its edge spends the duration on it
+    double enter = result.timestamps[i];
+    for (int k = a; k <= b; ++k) {
+      double share = distance > 0 ? duration * pieces[k - a] / distance :
+          (k == a ? duration : 0);
+      EdgeTraversals &traversals = table[path[k]];
+      traversals.first = std::min(traversals.first, enter);
+      traversals.last = std::max(traversals.last, enter + share);
+      traversals.time += share;
+      traversals.timed_distance += pieces[k - a];
+      enter += share;
+    }
+  }
+}
+
+void EdgeAggregateWriter::write_result(const SegmentMatchResult &segment) {
+  write_result(segment.result);
+}
+
+std::vector<EdgeTraversals> EdgeAggregateWriter::merge_traversals() const {
+  std::vector<EdgeTraversals> merged(network_.get_edge_count());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::unique_ptr<TraversalTable> &table : tables_) {
+    for (std::size_t e = 0; e < merged.size(); ++e) {
+      const EdgeTraversals &traversals = (*table)[e];
+      EdgeTraversals &total = merged[e];
+      total.count += traversals.count;
+      total.distance += traversals.distance;
+      total.first = std::min(total.first, traversals.first);
+      total.last = std::max(total.last, traversals.last);
+      total.time += traversals.time;
+      total.timed_distance += traversals.timed_distance;
+    }
+  }
+  return merged;
+}
+
+EdgeAggregateWriter::~EdgeAggregateWriter() {
+  std::vector<EdgeTraversals> merged = merge_traversals();
+  std::ofstream ofs(result_file_);
+  ofs.precision(12);
+  ofs << "id;count;first;last;time;distance;speed\n";
+  long rows = 0;
+  for (std::size_t e = 0; e < merged.size(); ++e) {
+    const EdgeTraversals &traversals = merged[e];
+    if (traversals.count == 0) continue;
+    ofs << network_.get_edge_id(e) << ';' << traversals.count << ';';
+    if (traversals.first <= traversals.last) {
+      ofs << traversals.first << ';' << traversals.last << ';'
+          << traversals.time << ';' << traversals.distance << ';';
+      if (traversals.time > 0) {
+        ofs << traversals.timed_distance / traversals.time;
+      }
+    } else {
+      ofs << ";;;" << traversals.distance << ';';
+    }
+    ofs << '\n';
+    ++rows;
+  }
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write edge table {}", result_file_);
+    return;
+  }
+  SPDLOG_INFO("Write the traversals of {} edges into {}", rows,
+              result_file_);
+}
+
+void FMM::IO::copy_timestamps(const Trajectory &trajectory,
+                              std::vector<SegmentMatchResult> *segments) {
+  const std::vector<double> &timestamps = trajectory.timestamps;
+  for (SegmentMatchResult &segment : *segments) {
+    if (segment.first < 0) {
+      segment.result.timestamps = timestamps;
+    } else if (segment.last < (int) timestamps.size()) {
+      segment.result.timestamps.assign(
+          timestamps.begin() + segment.first,
+          timestamps.begin() + segment.last + 1);
+    }
+  }
+}
@@ -0,0 +1,103 @@
+/**
+ * Fast map matching.
+ *
+ * Aggregation of the traversals of the edges by the match results, which
+ * are written as a table of the edges instead of a row per trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_EDGE_AGGREGATE_WRITER_HPP
+#define FMM_IO_EDGE_AGGREGATE_WRITER_HPP
+
+#include "core/gps.hpp"
+#include "io/mm_writer.hpp"
+
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Traversals of an edge aggregated over the match results
+ */
+struct EdgeTraversals {
+  long count = 0; /**< number of traversals of the edge in cpath */
+  double distance = 0; /**< distance travelled on the edge */
+  double first = std::numeric_limits<double>::infinity(); /**< earliest
+      time the edge is entered */
+  double last = -std::numeric_limits<double>::infinity(); /**< latest time
+      the edge is left */
+  double time = 0; /**< time spent on the edge */
+  double timed_distance = 0; /**< distance travelled in the time spent */
+};
+
+/**
+ * A writer of the traversals of the edges aggregated over the match
+ * results, which writes a csv table with a row per edge traversed,
+ * id;count;first;last;time;distance;speed, when it is destroyed.
+ *
+ * The distance between two consecutive points matched is split over the
+ * edges of the complete path between their candidates, and the time
+ * between them in proportion of the distance on each edge. The times are
+ * only known if the results hold the timestamps of their points, and the
+ * speed is the distance over the time of the edges whose points have
+ * timestamps. The first, last, time and speed fields are empty for the
+ * edges without time.
+ *
+ * The traversals are aggregated into an array indexed by edge of each
+ * thread writing results, and the arrays are merged when the table is
+ * written.
+ */
+class EdgeAggregateWriter : public MatchResultWriter {
+ public:
+  /**
+   * Constructor
+   * @param result_file the filename to write the table
+   * @param network     network of the match results
+   */
+  EdgeAggregateWriter(const std::string &result_file,
+                      const NETWORK::Network &network);
+  /**
+   * Merge the traversals and write the table
+   */
+  ~EdgeAggregateWriter();
+  void write_result(const FMM::MM::MatchResult &result);
+  void write_result(const FMM::MM::SegmentMatchResult &segment);
+  /**
+   * Merge the traversals aggregated by the threads
+   * @return traversals indexed by edge
+   */
+  std::vector<EdgeTraversals> merge_traversals() const;
+ private:
+  typedef std::vector<EdgeTraversals> TraversalTable;
+  /**
+   * Get the table of the calling thread, which is created at its first
+   * result
+   */
+  TraversalTable &local_table();
+  std::string result_file_;
+  const NETWORK::Network &network_;
+  long serial_; // Distinguishes the tables of the writers of a thread
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<TraversalTable>> tables_;
+}; // EdgeAggregateWriter
+
+/**
+ * Copy the timestamps of the points of a trajectory into the match
+ * results of its segments
+ * @param trajectory a trajectory with timestamps
+ * @param segments   match results of the trajectory updated
+ */
+void copy_timestamps(const CORE::Trajectory &trajectory,
+                     std::vector<FMM::MM::SegmentMatchResult> *segments);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_EDGE_AGGREGATE_WRITER_HPP
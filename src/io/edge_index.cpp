@@ -0,0 +1,255 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/edge_index.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+// Header of the index file, followed by the edge ids, the offsets and the
+// postings, each aligned on 8 bytes
+struct IndexHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int posting_size;
+  long long num_edges;
+  long long num_postings;
+};
+const char INDEX_MAGIC[8] = {'F', 'M', 'M', 'E', 'I', 'D', 'X', '1'};
+
+std::atomic<long> next_writer_serial(0);
+
+size_t get_ids_bytes(long long num_edges) {
+  return (num_edges * sizeof(EdgeID) + 7) / 8 * 8;
+}
+
+bool posting_less(const EdgePosting &a, const EdgePosting &b) {
+  return a.trajectory < b.trajectory ||
+      (a.trajectory == b.trajectory && a.point < b.point);
+}
+
+} // namespace
+
+EdgeIndexWriter::EdgeIndexWriter(const std::string &result_file,
+                                 const Network &network) :
+    result_file_(result_file), network_(network),
+    serial_(next_writer_serial++) {}
+
+EdgeIndexWriter::PostingList &EdgeIndexWriter::local_list() {
+  thread_local long serial = -1;
+  thread_local PostingList *list = nullptr;
+  if (serial != serial_) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lists_.emplace_back(new PostingList());
+    list = lists_.back().get();
+    serial = serial_;
+  }
+  return *list;
+}
+
+void EdgeIndexWriter::add_result(const MatchResult &result,
+                                 int first_point) {
+  const C_Path &cpath = result.cpath;
+  if (cpath.empty()) return;
+  PostingList &list = local_list();
+  const std::vector<int> &indices = result.indices;
+  int points = indices.size();
+  // The edge is entered from the last point matched before it
+  int i = 0;
+  for (int k = 0; k < (int) cpath.size(); ++k) {
+    while (i + 1 < points && indices[i + 1] < k) ++i;
+    list.push_back(Entry{network_.get_edge_index(cpath[k]),
+                         EdgePosting{result.id, first_point + i}});
+  }
+}
+
+void EdgeIndexWriter::write_result(const MatchResult &result) {
+  add_result(result, 0);
+}
+
+void EdgeIndexWriter::write_result(const SegmentMatchResult &segment) {
+  add_result(segment.result, std::max(segment.first, 0));
+}
+
+void EdgeIndexWriter::merge_postings(
+    std::vector<long long> *offsets,
+    std::vector<EdgePosting> *postings) const {
+  std::vector<long long> &starts = *offsets;
+  starts.assign(network_.get_edge_count() + 1, 0);
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const std::unique_ptr<PostingList> &list : lists_) {
+    for (const Entry &entry : *list) ++starts[entry.edge + 1];
+  }
+  for (std::size_t e = 1; e < starts.size(); ++e) {
+    starts[e] += starts[e - 1];
+  }
+  postings->resize(starts.back());
+  std::vector<long long> next(starts.begin(), starts.end() - 1);
+  for (const std::unique_ptr<PostingList> &list : lists_) {
+    for (const Entry &entry : *list) {
+      (*postings)[next[entry.edge]++] = entry.posting;
+    }
+  }
+  for (std::size_t e = 0; e + 1 < starts.size(); ++e) {
+    std::sort(postings->begin() + starts[e],
+              postings->begin() + starts[e + 1], posting_less);
+  }
+}
+
+EdgeIndexWriter::~EdgeIndexWriter() {
+  std::vector<long long> offsets;
+  std::vector<EdgePosting> postings;
+  merge_postings(&offsets, &postings);
+  // The edges traversed are written in the order of their ids
+  std::vector<EdgeIndex> edges;
+  for (std::size_t e = 0; e + 1 < offsets.size(); ++e) {
+    if (offsets[e + 1] > offsets[e]) edges.push_back(e);
+  }
+  std::sort(edges.begin(), edges.end(), [this](EdgeIndex a, EdgeIndex b) {
+    return network_.get_edge_id(a) < network_.get_edge_id(b);
+  });
+  std::vector<EdgeID> edge_ids;
+  std::vector<long long> edge_offsets{0};
+  std::vector<EdgePosting> sorted;
+  sorted.reserve(postings.size());
+  for (EdgeIndex e : edges) {
+    edge_ids.push_back(network_.get_edge_id(e));
+    sorted.insert(sorted.end(), postings.begin() + offsets[e],
+                  postings.begin() + offsets[e + 1]);
+    edge_offsets.push_back(sorted.size());
+  }
+  if (!EdgeTrajectoryIndex::write_edge_index(result_file_, edge_ids,
+                                             edge_offsets, sorted)) {
+    return;
+  }
+  SPDLOG_INFO("Write the postings of {} edges into {}", edge_ids.size(),
+              result_file_);
+}
+
+bool EdgeTrajectoryIndex::write_edge_index(const std::string &filename,
+                                 const std::vector<EdgeID> &edge_ids,
+                                 const std::vector<long long> &offsets,
+                                 const std::vector<EdgePosting> &postings) {
+  FILE *stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_ERROR("Fail to write edge index {}", filename);
+    return false;
+  }
+  IndexHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  header.version = 1;
+  header.posting_size = sizeof(EdgePosting);
+  header.num_edges = edge_ids.size();
+  header.num_postings = postings.size();
+  std::vector<char> ids(get_ids_bytes(header.num_edges), 0);
+  if (!edge_ids.empty()) {
+    std::memcpy(ids.data(), edge_ids.data(),
+                edge_ids.size() * sizeof(EdgeID));
+  }
+  bool success =
+      fwrite(&header, sizeof(header), 1, stream) == 1 &&
+      fwrite(ids.data(), 1, ids.size(), stream) == ids.size() &&
+      fwrite(offsets.data(), sizeof(long long), offsets.size(), stream) ==
+          offsets.size() &&
+      fwrite(postings.data(), sizeof(EdgePosting), postings.size(),
+             stream) == postings.size();
+  if (fclose(stream) != 0) success = false;
+  if (!success) SPDLOG_ERROR("Fail to write edge index {}", filename);
+  return success;
+}
+
+std::unique_ptr<EdgeTrajectoryIndex> EdgeTrajectoryIndex::read_edge_index(
+    const std::string &filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open edge index {}", filename);
+    return nullptr;
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  void *addr = nullptr;
+  if (file_size >= sizeof(IndexHeader)) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map edge index {}", filename);
+    return nullptr;
+  }
+  std::unique_ptr<EdgeTrajectoryIndex> index(new EdgeTrajectoryIndex());
+  index->mapped_addr_ = addr;
+  index->mapped_size_ = file_size;
+  const IndexHeader *header = (const IndexHeader *) addr;
+  if (std::memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+      header->version != 1 || header->posting_size != sizeof(EdgePosting) ||
+      header->num_edges < 0 || header->num_postings < 0) {
+    SPDLOG_CRITICAL("Invalid edge index {}", filename);
+    return nullptr;
+  }
+  size_t ids_bytes = get_ids_bytes(header->num_edges);
+  size_t expected = sizeof(IndexHeader) + ids_bytes +
+      (header->num_edges + 1) * sizeof(long long) +
+      header->num_postings * sizeof(EdgePosting);
+  if (file_size != expected) {
+    SPDLOG_CRITICAL("Invalid size {} of edge index {}, expect {}",
+                    file_size, filename, expected);
+    return nullptr;
+  }
+  const char *data = (const char *) addr + sizeof(IndexHeader);
+  index->num_edges_ = header->num_edges;
+  index->num_postings_ = header->num_postings;
+  index->edge_ids_ = (const EdgeID *) data;
+  index->offsets_ = (const long long *) (data + ids_bytes);
+  index->postings_ = (const EdgePosting *) (
+      data + ids_bytes + (header->num_edges + 1) * sizeof(long long));
+  SPDLOG_INFO("Map edge index {} with edges {} postings {}", filename,
+              index->num_edges_, index->num_postings_);
+  return index;
+}
+
+EdgeTrajectoryIndex::~EdgeTrajectoryIndex() {
+  if (mapped_addr_ != nullptr) munmap(mapped_addr_, mapped_size_);
+}
+
+long long EdgeTrajectoryIndex::find(EdgeID id, const EdgePosting **first,
+                          const EdgePosting **last) const {
+  const EdgeID *end = edge_ids_ + num_edges_;
+  const EdgeID *iter = std::lower_bound(edge_ids_, end, id);
+  if (iter == end || *iter != id) {
+    *first = *last = postings_;
+    return 0;
+  }
+  long long e = iter - edge_ids_;
+  *first = postings_ + offsets_[e];
+  *last = postings_ + offsets_[e + 1];
+  return offsets_[e + 1] - offsets_[e];
+}
+
+std::vector<int> EdgeTrajectoryIndex::get_trajectories(EdgeID id) const {
+  const EdgePosting *first, *last;
+  find(id, &first, &last);
+  std::vector<int> trajectories;
+  for (const EdgePosting *p = first; p != last; ++p) {
+    if (trajectories.empty() || trajectories.back() != p->trajectory) {
+      trajectories.push_back(p->trajectory);
+    }
+  }
+  return trajectories;
+}
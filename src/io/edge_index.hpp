@@ -0,0 +1,155 @@
+/**
+ * Fast map matching.
+ *
+ * Inverted index of the trajectories traversing each edge, built from the
+ * match results and written as a memory mapped binary file
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_EDGE_INDEX_HPP
+#define FMM_IO_EDGE_INDEX_HPP
+
+#include "io/mm_writer.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Traversal of an edge by a trajectory
+ */
+struct EdgePosting {
+  int trajectory; /**< id of the trajectory */
+  int point; /**< index of the last point of the trajectory matched
+                  before the edge, or of the first point if the edge is
+                  the first one */
+};
+
+/**
+ * A writer of the inverted index of the edges traversed by the match
+ * results, which writes the trajectories traversing each edge, sorted by
+ * trajectory and point, when it is destroyed.
+ *
+ * The traversals are appended to a posting list of each thread writing
+ * results, and the lists are merged by a counting sort on the edges. An
+ * edge traversed several times by a trajectory has a posting per
+ * traversal. The points are counted from the first point of the
+ * trajectory, so that the segments of a split trajectory share them.
+ *
+ * The file is made of a header, the ids of the edges traversed in
+ * increasing order, the offsets of their postings and the postings, each
+ * aligned on 8 bytes, and it is mapped by EdgeTrajectoryIndex without
+ * being parsed.
+ */
+class EdgeIndexWriter : public MatchResultWriter {
+ public:
+  /**
+   * Constructor
+   * @param result_file the filename to write the index
+   * @param network     network of the match results
+   */
+  EdgeIndexWriter(const std::string &result_file,
+                  const NETWORK::Network &network);
+  /**
+   * Merge the posting lists and write the index
+   */
+  ~EdgeIndexWriter();
+  void write_result(const FMM::MM::MatchResult &result);
+  void write_result(const FMM::MM::SegmentMatchResult &segment);
+  /**
+   * Merge the posting lists of the threads
+   * @param offsets  updated with the offsets of the postings of each edge
+   * index, of the number of edges plus one
+   * @param postings updated with the postings sorted by edge index,
+   * trajectory and point
+   */
+  void merge_postings(std::vector<long long> *offsets,
+                      std::vector<EdgePosting> *postings) const;
+ private:
+  struct Entry {
+    NETWORK::EdgeIndex edge;
+    EdgePosting posting;
+  };
+  typedef std::vector<Entry> PostingList;
+  /**
+   * Get the list of the calling thread, which is created at its first
+   * result
+   */
+  PostingList &local_list();
+  void add_result(const FMM::MM::MatchResult &result, int first_point);
+  std::string result_file_;
+  const NETWORK::Network &network_;
+  long serial_; // Distinguishes the lists of the writers of a thread
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<PostingList>> lists_;
+}; // EdgeIndexWriter
+
+/**
+ * Inverted index of the edges written by EdgeIndexWriter, which is
+ * memory mapped, so that the postings of an edge are read in place
+ */
+class EdgeTrajectoryIndex {
+ public:
+  /**
+   * Map an index file
+   * @param  filename index file
+   * @return the index, nullptr if the file is not a valid index
+   */
+  static std::unique_ptr<EdgeTrajectoryIndex> read_edge_index(
+      const std::string &filename);
+  /**
+   * Write an index file
+   * @param  filename file written
+   * @param  edge_ids ids of the edges, in increasing order
+   * @param  offsets  offsets of the postings of each edge, of the size of
+   * edge_ids plus one
+   * @param  postings postings of the edges
+   * @return true if written
+   */
+  static bool write_edge_index(const std::string &filename,
+                               const std::vector<NETWORK::EdgeID> &edge_ids,
+                               const std::vector<long long> &offsets,
+                               const std::vector<EdgePosting> &postings);
+  ~EdgeTrajectoryIndex();
+  /**
+   * Find the postings of an edge
+   * @param  id    id of the edge
+   * @param  first updated with the first posting of the edge
+   * @param  last  updated with the end of the postings of the edge
+   * @return number of postings, 0 if the edge is not traversed
+   */
+  long long find(NETWORK::EdgeID id, const EdgePosting **first,
+                 const EdgePosting **last) const;
+  /**
+   * Get the trajectories traversing an edge, each once
+   * @param  id id of the edge
+   * @return ids of the trajectories in increasing order
+   */
+  std::vector<int> get_trajectories(NETWORK::EdgeID id) const;
+  inline long long get_num_edges() const {
+    return num_edges_;
+  };
+  inline long long get_num_postings() const {
+    return num_postings_;
+  };
+ private:
+  EdgeTrajectoryIndex() = default;
+  void *mapped_addr_ = nullptr;
+  size_t mapped_size_ = 0;
+  long long num_edges_ = 0;
+  long long num_postings_ = 0;
+  const NETWORK::EdgeID *edge_ids_ = nullptr;
+  const long long *offsets_ = nullptr;
+  const EdgePosting *postings_ = nullptr;
+}; // EdgeTrajectoryIndex
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_EDGE_INDEX_HPP
@@ -5,15 +5,186 @@
  * @version: 2017.11.11
  */
 #include "io/gps_reader.hpp"
+#include "io/arrow_reader.hpp"
+#include "io/binary_trajectory.hpp"
+#include "io/postgis_reader.hpp"
 #include "util/debug.hpp"
+#include "util/number_parser.hpp"
+#include "util/timestamp_parser.hpp"
 #include "config/gps_config.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::IO;
 
+namespace {
+
+// Parse a number filling a field, false if the field is not a number
+bool parse_number(const char *begin, const char *end, double *value) {
+  while (begin < end && *begin == ' ') ++begin;
+  while (end > begin && end[-1] == ' ') --end;
+  return UTIL::parse_double(begin, end, value) == end && begin < end;
+}
+
+// Parse a timestamp filling a field, false if it is malformed
+bool parse_time(const char *begin, const char *end,
+                UTIL::TimestampFormat format, double *value) {
+  while (begin < end && *begin == ' ') ++begin;
+  while (end > begin && end[-1] == ' ') --end;
+  return UTIL::parse_timestamp(begin, end, format, value) == end &&
+      begin < end;
+}
+
+// Open the first layer of a vector dataset, exit if it cannot be opened
+OGRLayer *open_layer(const std::string &filename, GDALDataset **dataset) {
+  *dataset = (GDALDataset *) GDALOpenEx(filename.c_str(),
+                                        GDAL_OF_VECTOR, NULL, NULL, NULL);
+  if (*dataset == NULL) {
+    SPDLOG_CRITICAL("Open data source fail");
+    std::exit(EXIT_FAILURE);
+  }
+  return (*dataset)->GetLayer(0);
+}
+
+// Copy the points of a linestring, without converting it into WKB
+LineString read_linestring(const OGRGeometry *geometry) {
+  LineString line;
+  if (geometry == nullptr ||
+      wkbFlatten(geometry->getGeometryType()) != wkbLineString) {
+    return line;
+  }
+  const OGRLineString *ogr_line = (const OGRLineString *) geometry;
+  std::vector<OGRRawPoint> points(ogr_line->getNumPoints());
+  if (!points.empty()) ogr_line->getPoints(points.data());
+  line.get_geometry().reserve(points.size());
+  for (const OGRRawPoint &point : points) {
+    line.add_point(point.x, point.y);
+  }
+  return line;
+}
+
+// Parse the columns of a CSV trajectory row, false if a column is
+// missing or malformed
+bool parse_trajectory_row(const char *begin, const char *end, char delim,
+                          int id_idx, int geom_idx, int timestamp_idx,
+                          int max_idx, UTIL::TimestampFormat time_format,
+                          Trajectory *traj) {
+  const char *p = begin;
+  int index = 0;
+  bool success = true;
+  traj->timestamps.clear();
+  while (success && index <= max_idx && p <= end) {
+    const char *field_end = (const char *) memchr(p, delim, end - p);
+    if (field_end == nullptr) field_end = end;
+    if (index == id_idx) {
+      double value;
+      success = parse_number(p, field_end, &value) &&
+          value == (int) value;
+      traj->id = (int) value;
+    } else if (index == geom_idx) {
+      // Other forms than a 2D linestring are left to boost
+      if (!parse_wkt_linestring(p, field_end, &traj->geom) &&
+          !parse_hex_wkb_linestring(p, field_end, &traj->geom)) {
+        try {
+          traj->geom = wkt2linestring(std::string(p, field_end));
+        } catch (const std::exception &e) {
+          success = false;
+        }
+      }
+    } else if (index == timestamp_idx) {
+      const char *value_begin = p;
+      while (success && value_begin < field_end) {
+        const char *value_end = (const char *) memchr(
+            value_begin, ',', field_end - value_begin);
+        if (value_end == nullptr) value_end = field_end;
+        double value;
+        success = parse_time(value_begin, value_end, time_format, &value);
+        traj->timestamps.push_back(value);
+        value_begin = value_end + 1;
+      }
+    }
+    ++index;
+    p = field_end + 1;
+  }
+  return success && index > max_idx;
+}
+
+// Map a file into memory, nullptr for an empty file
+char *map_file(const std::string &filename, size_t *size) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    SPDLOG_CRITICAL("Fail to open GPS file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  *size = file_stat.st_size;
+  char *data = nullptr;
+  if (*size > 0) {
+    void *addr = mmap(nullptr, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      SPDLOG_CRITICAL("Fail to map GPS file {}", filename);
+      std::exit(EXIT_FAILURE);
+    }
+    data = (char *) addr;
+    madvise(data, *size, MADV_SEQUENTIAL);
+  }
+  ::close(fd);
+  return data;
+}
+
+// Find the end of the row starting at a position, excluding the line
+// break, and the start of the next row
+const char *find_row_end(const char *row, const char *end,
+                         const char **next) {
+  const char *line_end = (const char *) memchr(row, '\n', end - row);
+  if (line_end == nullptr) line_end = end;
+  *next = line_end < end ? line_end + 1 : end;
+  return line_end > row && line_end[-1] == '\r' ? line_end - 1 : line_end;
+}
+
+// Find the start of the row containing a position
+const char *find_row_start(const char *begin, const char *position) {
+  while (position > begin && position[-1] != '\n') --position;
+  return position;
+}
+
+// Skip the line breaks of blank rows
+const char *skip_blank_rows(const char *position, const char *end) {
+  while (position < end && (*position == '\n' || *position == '\r')) {
+    ++position;
+  }
+  return position;
+}
+
+// Read the column names of the header and find the first row after it
+std::vector<std::string> read_header(const char *data, size_t size,
+                                     char delim, const char **body) {
+  const char *end = data + size;
+  const char *header_end = data == nullptr ?
+                           end : find_row_end(data, end, body);
+  if (data == nullptr) *body = end;
+  std::vector<std::string> header;
+  std::stringstream check1(std::string(data, header_end - data));
+  std::string intermediate;
+  while (getline(check1, intermediate, delim)) {
+    header.push_back(intermediate);
+  }
+  return header;
+}
+
+} // namespace
+
 std::vector<Trajectory> ITrajectoryReader::read_next_N_trajectories(int N) {
   std::vector<Trajectory> trajectories;
   int i = 0;
@@ -39,13 +210,7 @@ GDALTrajectoryReader::GDALTrajectoryReader(const std::string &filename,
                                            const std::string &timestamp_name) {
   SPDLOG_INFO("Read trajectory from file {}",filename);
   OGRRegisterAll();
-  poDS = (GDALDataset *) GDALOpenEx(filename.c_str(),
-                                    GDAL_OF_VECTOR, NULL, NULL, NULL);
-  if (poDS == NULL) {
-    SPDLOG_CRITICAL("Open data source fail");
-    exit(1);
-  }
-  ogrlayer = poDS->GetLayer(0);
+  ogrlayer = open_layer(filename, &poDS);
   _cursor = 0;
   // Get the number of features first
   OGRFeatureDefn *ogrFDefn = ogrlayer->GetLayerDefn();
@@ -85,9 +250,8 @@ bool GDALTrajectoryReader::has_timestamp() {
 Trajectory GDALTrajectoryReader::read_next_trajectory() {
   OGRFeature *ogrFeature = ogrlayer->GetNextFeature();
   int trid = ogrFeature->GetFieldAsInteger(id_idx);
-  OGRGeometry *rawgeometry = ogrFeature->GetGeometryRef();
   FMM::CORE::LineString linestring =
-      FMM::CORE::ogr2linestring((OGRLineString *) rawgeometry);
+      read_linestring(ogrFeature->GetGeometryRef());
   OGRFeature::DestroyFeature(ogrFeature);
   ++_cursor;
   return Trajectory{trid, linestring};
@@ -104,25 +268,22 @@ void GDALTrajectoryReader::close() {
 CSVTrajectoryReader::CSVTrajectoryReader(const std::string &e_filename,
                                          const std::string &id_name,
                                          const std::string &geom_name,
-                                         const std::string &timestamp_name) :
-    ifs(e_filename) {
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream check1(line);
-  std::string intermediate;
-  // Tokenizing w.r.t. space ' '
-  int i = 0;
-  while (getline(check1, intermediate, delim)) {
-    if (intermediate == id_name) {
+                                         const std::string &timestamp_name,
+                                         UTIL::TimestampFormat time_format) :
+    time_format(time_format) {
+  data = map_file(e_filename, &size);
+  std::vector<std::string> header = read_header(data, size, delim, &body);
+  cursor = body;
+  for (int i = 0; i < (int) header.size(); ++i) {
+    if (header[i] == id_name) {
       id_idx = i;
     }
-    if (intermediate == geom_name) {
+    if (header[i] == geom_name) {
       geom_idx = i;
     }
-    if (intermediate == timestamp_name) {
+    if (header[i] == timestamp_name) {
       timestamp_idx = i;
     }
-    ++i;
   }
   if (id_idx < 0 || geom_idx < 0) {
     SPDLOG_CRITICAL("Id {} or Geometry column {} not found",
@@ -132,10 +293,15 @@ CSVTrajectoryReader::CSVTrajectoryReader(const std::string &e_filename,
   if (timestamp_idx < 0) {
     SPDLOG_WARN("Timestamp column {} not found", timestamp_name);
   }
+  max_idx = std::max(std::max(id_idx, geom_idx), timestamp_idx);
   SPDLOG_INFO("Id index {} Geometry index {} Timstamp index {}",
               id_idx, geom_idx, timestamp_idx);
 }
 
+CSVTrajectoryReader::~CSVTrajectoryReader() {
+  close();
+}
+
 std::vector<double> CSVTrajectoryReader::string2time(
     const std::string &str) {
   std::vector<double> values;
@@ -153,73 +319,103 @@ bool CSVTrajectoryReader::has_timestamp() {
   return timestamp_idx > 0;
 }
 
-Trajectory CSVTrajectoryReader::read_next_trajectory() {
-  // Read the geom idx column into a trajectory
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream ss(line);
-  int trid = 0;
-  int index = 0;
-  std::string intermediate;
-  FMM::CORE::LineString geom;
-  std::vector<double> timestamps;
-  while (std::getline(ss, intermediate, delim)) {
-    if (index == id_idx) {
-      trid = std::stoi(intermediate);
-    }
-    if (index == geom_idx) {
-      // intermediate
-      boost::geometry::read_wkt(intermediate, geom.get_geometry());
-    }
-    if (index == timestamp_idx) {
-      // intermediate
-      timestamps = string2time(intermediate);
+bool CSVTrajectoryReader::parse_row(const char *begin, const char *end,
+                                    Trajectory *traj) const {
+  return parse_trajectory_row(begin, end, delim, id_idx, geom_idx,
+                              timestamp_idx, max_idx, time_format, traj);
+}
+
+bool CSVTrajectoryReader::read_trajectory(const char **position,
+                                          const char *end,
+                                          Trajectory *traj) const {
+  const char *row = skip_blank_rows(*position, end);
+  while (row < end) {
+    const char *next;
+    const char *row_end = find_row_end(row, end, &next);
+    if (parse_row(row, row_end, traj)) {
+      *position = next;
+      return true;
     }
-    ++index;
+    SPDLOG_WARN("Skip malformed row {}", std::string(row, row_end));
+    row = skip_blank_rows(next, end);
   }
-  return Trajectory{trid, geom, timestamps};
+  *position = row;
+  return false;
+}
+
+Trajectory CSVTrajectoryReader::read_next_trajectory() {
+  Trajectory traj{0, FMM::CORE::LineString(), {}};
+  read_trajectory(&cursor, data + size, &traj);
+  return traj;
 }
 
 bool CSVTrajectoryReader::has_next_trajectory() {
-  return ifs.peek() != EOF;
+  cursor = skip_blank_rows(cursor, data + size);
+  return cursor < data + size;
 }
 
 void CSVTrajectoryReader::reset_cursor() {
-  ifs.clear();
-  ifs.seekg(0, std::ios::beg);
-  std::string line;
-  std::getline(ifs, line);
+  cursor = body;
 }
+
 void CSVTrajectoryReader::close() {
-  ifs.close();
+  if (data != nullptr) munmap(data, size);
+  data = nullptr;
+  size = 0;
+  body = nullptr;
+  cursor = nullptr;
+}
+
+const char *CSVTrajectoryReader::get_rows_begin() const {
+  return body;
+}
+
+const char *CSVTrajectoryReader::get_rows_end() const {
+  return data + size;
+}
+
+const char *CSVTrajectoryReader::align(const char *position) const {
+  const char *end = data + size;
+  if (position <= body) return body;
+  if (position >= end) return end;
+  const char *row = find_row_start(body, position);
+  // A trajectory starts at every row
+  if (row < position) find_row_end(row, end, &row);
+  return row;
+}
+
+void CSVTrajectoryReader::read_range(
+    const char *begin, const char *end,
+    std::vector<Trajectory> *trajectories) const {
+  Trajectory traj{0, FMM::CORE::LineString(), {}};
+  while (read_trajectory(&begin, end, &traj)) {
+    trajectories->push_back(std::move(traj));
+  }
 }
 
 CSVPointReader::CSVPointReader(const std::string &e_filename,
                                const std::string &id_name,
                                const std::string &x_name,
                                const std::string &y_name,
-                               const std::string &time_name) :
-    ifs(e_filename) {
-  std::string line;
-  std::getline(ifs, line);
-  std::stringstream check1(line);
-  std::string intermediate;
-  // Tokenizing w.r.t. space ' '
-  int i = 0;
-  while (getline(check1, intermediate, delim)) {
-    if (intermediate == id_name) {
+                               const std::string &time_name,
+                               UTIL::TimestampFormat time_format) :
+    time_format(time_format) {
+  data = map_file(e_filename, &size);
+  std::vector<std::string> header = read_header(data, size, delim, &body);
+  cursor = body;
+  for (int i = 0; i < (int) header.size(); ++i) {
+    if (header[i] == id_name) {
       id_idx = i;
     }
-    if (intermediate == x_name) {
+    if (header[i] == x_name) {
       x_idx = i;
     }
-    if (intermediate == y_name) {
+    if (header[i] == y_name) {
       y_idx = i;
     }
-    if (intermediate == time_name) {
+    if (header[i] == time_name) {
       timestamp_idx = i;
     }
-    ++i;
   }
   if (id_idx < 0 || x_idx < 0 || y_idx < 0) {
     if (id_idx < 0) {
@@ -236,102 +432,613 @@ CSVPointReader::CSVPointReader(const std::string &e_filename,
   if (timestamp_idx < 0) {
     SPDLOG_WARN("Time stamp {} not found, will be estimated ", time_name);
   }
+  max_idx = std::max(std::max(id_idx, timestamp_idx),
+                     std::max(x_idx, y_idx));
   SPDLOG_INFO("Id index {} x index {} y index {} time index {}",
               id_idx, x_idx, y_idx, timestamp_idx);
 }
 
-Trajectory CSVPointReader::read_next_trajectory() {
-  // Read the geom idx column into a trajectory
-  std::string intermediate;
-  FMM::CORE::LineString geom;
-  std::vector<double> timestamps;
-  bool on_same_trajectory = true;
-  bool first_observation = true;
-  int trid = -1;
-  int prev_id = -1;
-  double prev_timestamp = -1.0;
-  std::string line;
-  while (on_same_trajectory && has_next_trajectory()) {
-    if (prev_line.empty()) {
-      std::getline(ifs, line);
-    } else {
-      line = prev_line;
-      prev_line.clear();
+CSVPointReader::~CSVPointReader() {
+  close();
+}
+
+bool CSVPointReader::parse_row(const char *begin, const char *end, int *id,
+                               double *x, double *y,
+                               double *timestamp) const {
+  const char *p = begin;
+  int index = 0;
+  bool success = true;
+  while (success && index <= max_idx && p <= end) {
+    const char *field_end = (const char *) memchr(p, delim, end - p);
+    if (field_end == nullptr) field_end = end;
+    if (index == id_idx) {
+      double value;
+      success = parse_number(p, field_end, &value) &&
+          value == (int) value;
+      *id = (int) value;
+    } else if (index == x_idx) {
+      success = parse_number(p, field_end, x);
+    } else if (index == y_idx) {
+      success = parse_number(p, field_end, y);
+    } else if (index == timestamp_idx) {
+      success = parse_time(p, field_end, time_format, timestamp);
     }
-    std::stringstream ss(line);
+    ++index;
+    p = field_end + 1;
+  }
+  return success && index > max_idx;
+}
+
+bool CSVPointReader::read_trajectory(const char **position, const char *end,
+                                     Trajectory *traj) const {
+  const char *row = *position;
+  bool first_observation = true;
+  while ((row = skip_blank_rows(row, end)) < end) {
+    const char *next;
+    const char *row_end = find_row_end(row, end, &next);
     int id = 0;
     double x = 0, y = 0;
     double timestamp = 0;
-    int index = 0;
-    while (std::getline(ss, intermediate, delim)) {
-      if (index == id_idx) {
-        id = std::stoi(intermediate);
-      }
-      if (index == x_idx) {
-        x = std::stof(intermediate);
-      }
-      if (index == y_idx) {
-        y = std::stof(intermediate);
-      }
-      if (index == timestamp_idx) {
-        timestamp = std::stof(intermediate);
-      }
-      ++index;
-    }
-    if (prev_id == id || first_observation) {
-      geom.add_point(x, y);
-      if (has_timestamp())
-        timestamps.push_back(timestamp);
-    }
-    if (prev_id != id && !first_observation) {
-      on_same_trajectory = false;
-      trid = prev_id;
+    if (!parse_row(row, row_end, &id, &x, &y, &timestamp)) {
+      SPDLOG_WARN("Skip malformed row {}", std::string(row, row_end));
+      row = next;
+      continue;
     }
+    // The row of the next trajectory is read by the next call
+    if (!first_observation && id != traj->id) break;
     first_observation = false;
-    prev_id = id;
-    if (!on_same_trajectory) {
-      prev_line = line;
-    }
+    traj->id = id;
+    traj->geom.add_point(x, y);
+    if (timestamp_idx > 0)
+      traj->timestamps.push_back(timestamp);
+    row = next;
   }
-  if (!has_next_trajectory()){
-    trid = prev_id;
-  }
-  return Trajectory{trid, geom, timestamps};
+  *position = row;
+  return !first_observation;
+}
+
+Trajectory CSVPointReader::read_next_trajectory() {
+  Trajectory traj{-1, FMM::CORE::LineString(), {}};
+  read_trajectory(&cursor, data + size, &traj);
+  return traj;
 }
 
 bool CSVPointReader::has_next_trajectory() {
-  return ifs.peek() != EOF;
+  cursor = skip_blank_rows(cursor, data + size);
+  return cursor < data + size;
 }
 
 void CSVPointReader::reset_cursor() {
-  ifs.clear();
-  ifs.seekg(0, std::ios::beg);
-  std::string line;
-  std::getline(ifs, line);
+  cursor = body;
 }
 
 void CSVPointReader::close() {
-  ifs.close();
+  if (data != nullptr) munmap(data, size);
+  data = nullptr;
+  size = 0;
+  body = nullptr;
+  cursor = nullptr;
 }
 
 bool CSVPointReader::has_timestamp() {
   return timestamp_idx > 0;
 }
 
+const char *CSVPointReader::get_rows_begin() const {
+  return body;
+}
+
+const char *CSVPointReader::get_rows_end() const {
+  return data + size;
+}
+
+const char *CSVPointReader::align(const char *position) const {
+  const char *end = data + size;
+  if (position <= body) return body;
+  if (position >= end) return end;
+  const char *row = find_row_start(body, position);
+  if (row < position) find_row_end(row, end, &row);
+  int id = 0, prev_id = 0;
+  double x, y, timestamp;
+  // Id of the last row before which is not malformed
+  bool found = false;
+  const char *prev = row;
+  while (!found && prev > body) {
+    prev = find_row_start(body, prev - 1);
+    const char *next;
+    const char *row_end = find_row_end(prev, end, &next);
+    found = parse_row(prev, row_end, &prev_id, &x, &y, &timestamp);
+  }
+  if (!found) return row;
+  while (row < end) {
+    const char *next;
+    const char *row_end = find_row_end(row, end, &next);
+    if (parse_row(row, row_end, &id, &x, &y, &timestamp) && id != prev_id) {
+      return row;
+    }
+    row = next;
+  }
+  return end;
+}
+
+void CSVPointReader::read_range(
+    const char *begin, const char *end,
+    std::vector<Trajectory> *trajectories) const {
+  while (true) {
+    Trajectory traj{-1, FMM::CORE::LineString(), {}};
+    if (!read_trajectory(&begin, end, &traj)) break;
+    trajectories->push_back(std::move(traj));
+  }
+}
+
+StreamTrajectoryReader::StreamTrajectoryReader(
+    int fd, const std::string &id_name, const std::string &geom_name,
+    const std::string &timestamp_name, UTIL::TimestampFormat time_format) :
+    fd(fd), time_format(time_format) {
+  std::size_t row_end, next_row;
+  while (!find_row(&row_end, &next_row)) {
+    if (eof) {
+      SPDLOG_CRITICAL("Header of the GPS stream not found");
+      std::exit(EXIT_FAILURE);
+    }
+    fill_buffer();
+  }
+  const char *body;
+  std::vector<std::string> header =
+      read_header(buffer.data() + start, row_end - start, delim, &body);
+  start = next_row;
+  for (int i = 0; i < (int) header.size(); ++i) {
+    if (header[i] == id_name) {
+      id_idx = i;
+    }
+    if (header[i] == geom_name) {
+      geom_idx = i;
+    }
+    if (header[i] == timestamp_name) {
+      timestamp_idx = i;
+    }
+  }
+  if (id_idx < 0 || geom_idx < 0) {
+    SPDLOG_CRITICAL("Id {} or Geometry column {} not found",
+                    id_name, geom_name);
+    std::exit(EXIT_FAILURE);
+  }
+  if (timestamp_idx < 0) {
+    SPDLOG_WARN("Timestamp column {} not found", timestamp_name);
+  }
+  max_idx = std::max(std::max(id_idx, geom_idx), timestamp_idx);
+  SPDLOG_INFO("Read GPS stream with id index {} geometry index {} "
+              "timestamp index {}", id_idx, geom_idx, timestamp_idx);
+}
+
+bool StreamTrajectoryReader::fill_buffer() {
+  if (eof) return false;
+  // The rows parsed are dropped before the buffer grows
+  buffer.erase(0, start);
+  start = 0;
+  char chunk[65536];
+  ssize_t n;
+  do {
+    n = ::read(fd, chunk, sizeof(chunk));
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) SPDLOG_ERROR("Fail to read GPS stream: {}", strerror(errno));
+  if (n <= 0) {
+    eof = true;
+    return false;
+  }
+  buffer.append(chunk, n);
+  return true;
+}
+
+bool StreamTrajectoryReader::find_row(std::size_t *row_end,
+                                      std::size_t *next_row) const {
+  std::size_t line_end = buffer.find('\n', start);
+  if (line_end == std::string::npos) {
+    // The last row may not end with a line break
+    if (!eof || start == buffer.size()) return false;
+    line_end = buffer.size();
+    *next_row = line_end;
+  } else {
+    *next_row = line_end + 1;
+  }
+  if (line_end > start && buffer[line_end - 1] == '\r') --line_end;
+  *row_end = line_end;
+  return true;
+}
+
+bool StreamTrajectoryReader::has_next_trajectory() {
+  while (!has_next) {
+    std::size_t row_end, next_row;
+    if (!find_row(&row_end, &next_row)) {
+      if (eof) return false;
+      fill_buffer();
+      continue;
+    }
+    const char *row = buffer.data() + start;
+    ++rows;
+    if (row_end > start) {
+      has_next = parse_trajectory_row(row, buffer.data() + row_end, delim,
+                                      id_idx, geom_idx, timestamp_idx,
+                                      max_idx, time_format, &next);
+      if (!has_next) {
+        SPDLOG_WARN("Skip malformed row {} {}", rows,
+                    buffer.substr(start, row_end - start));
+      }
+    }
+    start = next_row;
+  }
+  return true;
+}
+
+Trajectory StreamTrajectoryReader::read_next_trajectory() {
+  if (!has_next_trajectory()) {
+    return Trajectory{-1, FMM::CORE::LineString(), {}};
+  }
+  has_next = false;
+  return std::move(next);
+}
+
+bool StreamTrajectoryReader::has_timestamp() {
+  return timestamp_idx >= 0;
+}
+
+bool StreamTrajectoryReader::is_ready() {
+  if (has_next || eof || buffer.find('\n', start) != std::string::npos) {
+    return true;
+  }
+  pollfd request{fd, POLLIN, 0};
+  return poll(&request, 1, 0) > 0;
+}
+
+void StreamTrajectoryReader::close() {
+  eof = true;
+  has_next = false;
+  buffer.clear();
+  start = 0;
+}
+
+ParallelCSVReader::ParallelCSVReader(const FMM::CONFIG::GPSConfig &config,
+                                     int num_threads, long block_bytes) :
+    block_bytes(std::max(block_bytes, 1L)),
+    max_blocks(2L * std::max(num_threads, 1)) {
+  if (config.get_gps_format() == 1) {
+    auto csv_reader = std::make_shared<CSVTrajectoryReader>(
+        config.file, config.id, config.geom, config.timestamp,
+        config.get_timestamp_format());
+    mapped = csv_reader.get();
+    reader = csv_reader;
+  } else {
+    auto csv_reader = std::make_shared<CSVPointReader>(
+        config.file, config.id, config.x, config.y, config.timestamp,
+        config.get_timestamp_format());
+    mapped = csv_reader.get();
+    reader = csv_reader;
+  }
+  next_begin = mapped->get_rows_begin();
+  SPDLOG_INFO("Read GPS file with threads {} block bytes {}",
+              std::max(num_threads, 1), this->block_bytes);
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    threads.emplace_back(&ParallelCSVReader::parse_blocks, this);
+  }
+}
+
+ParallelCSVReader::~ParallelCSVReader() {
+  close();
+}
+
+void ParallelCSVReader::parse_blocks() {
+  const char *rows_end = mapped->get_rows_end();
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv.wait(lock, [&]() {
+      return stopped || next_begin >= rows_end ||
+          issued - consumed < max_blocks;
+    });
+    if (stopped || next_begin >= rows_end) return;
+    const char *begin = next_begin;
+    // The boundary is found under the lock, it scans a few rows only
+    const char *end = rows_end - begin > block_bytes ?
+                      mapped->align(begin + block_bytes) : rows_end;
+    next_begin = end;
+    long index = issued++;
+    blocks[index];
+    lock.unlock();
+    std::vector<Trajectory> trajectories;
+    mapped->read_range(begin, end, &trajectories);
+    lock.lock();
+    Block &block = blocks[index];
+    block.trajectories = std::move(trajectories);
+    block.done = true;
+    cv.notify_all();
+  }
+}
+
+bool ParallelCSVReader::has_next_trajectory() {
+  while (position >= current.size()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    const char *rows_end = mapped->get_rows_end();
+    cv.wait(lock, [&]() {
+      auto iter = blocks.find(consumed);
+      return stopped || (iter != blocks.end() && iter->second.done) ||
+          (consumed == issued && next_begin >= rows_end);
+    });
+    auto iter = blocks.find(consumed);
+    if (iter == blocks.end() || !iter->second.done) return false;
+    current = std::move(iter->second.trajectories);
+    position = 0;
+    blocks.erase(iter);
+    ++consumed;
+    cv.notify_all();
+  }
+  return true;
+}
+
+Trajectory ParallelCSVReader::read_next_trajectory() {
+  if (!has_next_trajectory()) {
+    return Trajectory{-1, FMM::CORE::LineString(), {}};
+  }
+  return std::move(current[position++]);
+}
+
+bool ParallelCSVReader::has_timestamp() {
+  return reader->has_timestamp();
+}
+
+void ParallelCSVReader::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+  }
+  cv.notify_all();
+  for (std::thread &thread : threads) thread.join();
+  threads.clear();
+  reader->close();
+}
+
+ParallelGDALReader::ParallelGDALReader(const std::string &filename,
+                                       const std::string &id_name,
+                                       const std::string &timestamp_name,
+                                       int num_threads,
+                                       long block_features) :
+    reader(std::make_shared<GDALTrajectoryReader>(
+        filename, id_name, timestamp_name)),
+    filename(filename), block_features(std::max(block_features, 1L)),
+    max_blocks(2L * std::max(num_threads, 1)) {
+  GDALDataset *dataset = nullptr;
+  OGRLayer *layer = open_layer(filename, &dataset);
+  id_idx = layer->GetLayerDefn()->GetFieldIndex(id_name.c_str());
+  range_end = reader->get_num_trajectories();
+  std::string fid = layer->GetFIDColumn();
+  if (!layer->TestCapability(OLCFastSetNextByIndex) && !fid.empty()) {
+    // A GeoPackage skips the features before an index, so the blocks are
+    // ranges of FID, which is the primary key
+    std::string sql = "SELECT MIN(\"" + fid + "\"), MAX(\"" + fid +
+        "\") FROM \"" + layer->GetName() + "\"";
+    OGRLayer *result = dataset->ExecuteSQL(sql.c_str(), NULL, NULL);
+    OGRFeature *feature =
+        result == NULL ? NULL : result->GetNextFeature();
+    if (feature != NULL && feature->IsFieldSet(0) &&
+        feature->IsFieldSet(1)) {
+      next_begin = feature->GetFieldAsInteger64(0);
+      range_end = feature->GetFieldAsInteger64(1) + 1;
+      fid_name = fid;
+    }
+    if (feature != NULL) OGRFeature::DestroyFeature(feature);
+    if (result != NULL) dataset->ReleaseResultSet(result);
+  }
+  if (fid_name.empty() && !layer->TestCapability(OLCFastSetNextByIndex)) {
+    SPDLOG_WARN("Layer without fast random access, each block skips the "
+                "features before it");
+  }
+  GDALClose(dataset);
+  SPDLOG_INFO("Read GPS file with threads {} block features {} by {}",
+              std::max(num_threads, 1), this->block_features,
+              fid_name.empty() ? "index" : "FID");
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    threads.emplace_back(&ParallelGDALReader::read_blocks, this);
+  }
+}
+
+ParallelGDALReader::~ParallelGDALReader() {
+  close();
+}
+
+void ParallelGDALReader::read_blocks() {
+  // GDAL handles are not thread safe, each thread opens its own
+  GDALDataset *dataset = nullptr;
+  OGRLayer *layer = open_layer(filename, &dataset);
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv.wait(lock, [&]() {
+      return stopped || next_begin >= range_end ||
+          issued - consumed < max_blocks;
+    });
+    if (stopped || next_begin >= range_end) break;
+    long long begin = next_begin;
+    long long end = std::min(begin + block_features, range_end);
+    next_begin = end;
+    long index = issued++;
+    blocks[index];
+    lock.unlock();
+    std::vector<Trajectory> trajectories;
+    read_block(layer, begin, end, &trajectories);
+    lock.lock();
+    Block &block = blocks[index];
+    block.trajectories = std::move(trajectories);
+    block.done = true;
+    cv.notify_all();
+  }
+  lock.unlock();
+  GDALClose(dataset);
+}
+
+void ParallelGDALReader::read_block(
+    OGRLayer *layer, long long begin, long long end,
+    std::vector<Trajectory> *trajectories) const {
+  if (fid_name.empty()) {
+    if (layer->SetNextByIndex(begin) != OGRERR_NONE) {
+      SPDLOG_ERROR("Fail to seek feature {}", begin);
+      return;
+    }
+  } else {
+    std::string filter = "\"" + fid_name + "\" >= " +
+        std::to_string(begin) + " AND \"" + fid_name + "\" < " +
+        std::to_string(end);
+    layer->SetAttributeFilter(filter.c_str());
+    layer->ResetReading();
+  }
+  trajectories->reserve(end - begin);
+  // FIDs are unique, so a range holds at most end - begin features
+  for (long long i = begin; i < end; ++i) {
+    OGRFeature *feature = layer->GetNextFeature();
+    if (feature == NULL) break;
+    trajectories->push_back(Trajectory{
+        feature->GetFieldAsInteger(id_idx),
+        read_linestring(feature->GetGeometryRef()), {}});
+    OGRFeature::DestroyFeature(feature);
+  }
+}
+
+bool ParallelGDALReader::has_next_trajectory() {
+  while (position >= current.size()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() {
+      auto iter = blocks.find(consumed);
+      return stopped || (iter != blocks.end() && iter->second.done) ||
+          (consumed == issued && next_begin >= range_end);
+    });
+    auto iter = blocks.find(consumed);
+    if (iter == blocks.end() || !iter->second.done) return false;
+    current = std::move(iter->second.trajectories);
+    position = 0;
+    blocks.erase(iter);
+    ++consumed;
+    cv.notify_all();
+  }
+  return true;
+}
+
+Trajectory ParallelGDALReader::read_next_trajectory() {
+  if (!has_next_trajectory()) {
+    return Trajectory{-1, FMM::CORE::LineString(), {}};
+  }
+  return std::move(current[position++]);
+}
+
+bool ParallelGDALReader::has_timestamp() {
+  return reader->has_timestamp();
+}
+
+void ParallelGDALReader::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopped) return;
+    stopped = true;
+  }
+  cv.notify_all();
+  for (std::thread &thread : threads) thread.join();
+  threads.clear();
+  reader->close();
+}
+
 GPSReader::GPSReader(const FMM::CONFIG::GPSConfig &config) {
   mode = config.get_gps_format();
-  if (mode == 0) {
+  if (mode == 0 && config.read_threads > 1) {
+    reader = std::make_shared<ParallelGDALReader>(
+        config.file, config.id, config.timestamp, config.read_threads);
+  } else if (mode == 0) {
     reader = std::make_shared<GDALTrajectoryReader>
         (config.file, config.id,config.timestamp);
+  } else if ((mode == 1 || mode == 2) && config.read_threads > 1) {
+    reader = std::make_shared<ParallelCSVReader>(config, config.read_threads);
   } else if (mode == 1) {
     reader = std::make_shared<CSVTrajectoryReader>
-        (config.file, config.id, config.geom, config.timestamp);
+        (config.file, config.id, config.geom, config.timestamp,
+         config.get_timestamp_format());
   } else if (mode == 2) {
     reader = std::make_shared<CSVPointReader>
-        (config.file, config.id, config.x, config.y, config.timestamp);
+        (config.file, config.id, config.x, config.y, config.timestamp,
+         config.get_timestamp_format());
+  } else if (mode == 3) {
+    reader = std::make_shared<BinaryTrajectoryReader>(config.file);
+  } else if (mode == 4) {
+    reader = std::make_shared<StreamTrajectoryReader>(
+        STDIN_FILENO, config.id, config.geom, config.timestamp,
+        config.get_timestamp_format());
+#ifdef FMM_WITH_ARROW
+  } else if (mode == 5) {
+    reader = std::make_shared<ArrowTrajectoryReader>(
+        config.file, config.id, config.geom, config.x, config.y,
+        config.timestamp, config.gps_point, config.read_threads);
+#endif
+#ifdef FMM_WITH_POSTGIS
+  } else if (mode == 6) {
+    reader = std::make_shared<PostGISTrajectoryReader>(
+        config.file, config.id, config.geom, config.timestamp,
+        config.read_threads);
+#endif
   } else {
     SPDLOG_CRITICAL("Unrecognized GPS format");
     std::exit(EXIT_FAILURE);
   }
 };
 
+void GPSReader::set_filter(const TrajectoryFilter &filter) {
+  reader = std::make_shared<FilteredTrajectoryReader>(reader, filter);
+}
+
+void GPSReader::set_shard(int shard, int num_shards) {
+  if (num_shards <= 1) return;
+  set_filter([shard, num_shards](const Trajectory &trajectory) {
+    return get_trajectory_shard(trajectory.id, num_shards) == shard;
+  });
+}
+
+int GPSReader::get_trajectory_shard(int id, int num_shards) {
+  // The bits of the id are mixed, so that the consecutive ids are spread
+  // over the shards
+  uint64_t h = (uint64_t) (uint32_t) id;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (int) (h % (uint64_t) num_shards);
+}
+
+long GPSReader::get_filtered() const {
+  const FilteredTrajectoryReader *filtered =
+      dynamic_cast<const FilteredTrajectoryReader *>(reader.get());
+  return filtered != nullptr ? filtered->get_skipped() : 0;
+}
+
+FilteredTrajectoryReader::FilteredTrajectoryReader(
+    std::shared_ptr<ITrajectoryReader> reader,
+    const TrajectoryFilter &filter) : reader(reader), filter(filter) {}
+
+bool FilteredTrajectoryReader::has_next_trajectory() {
+  while (!has_next && reader->has_next_trajectory()) {
+    next = reader->read_next_trajectory();
+    has_next = filter(next);
+    if (!has_next) ++skipped;
+  }
+  return has_next;
+}
+
+Trajectory FilteredTrajectoryReader::read_next_trajectory() {
+  has_next_trajectory();
+  has_next = false;
+  return std::move(next);
+}
+
+bool FilteredTrajectoryReader::has_timestamp() {
+  return reader->has_timestamp();
+}
+
+void FilteredTrajectoryReader::close() {
+  reader->close();
+}
+
+bool FilteredTrajectoryReader::is_ready() {
+  return has_next || reader->is_ready();
+}
@@ -13,9 +13,15 @@
 #include "core/gps.hpp"
 #include "config/gps_config.hpp"
 
+#include <condition_variable>
+#include <functional>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 
 namespace FMM {
 /**
@@ -45,6 +51,11 @@ class ITrajectoryReader {
    * Close the file
    */
   virtual void close() = 0;
+  /**
+   * Check if the next trajectory can be read without waiting for its
+   * input, which is always the case for a file
+   */
+  virtual bool is_ready() { return true; }
   /**
    * Read the next N trajectories in the file.
    *
@@ -62,6 +73,39 @@ class ITrajectoryReader {
   std::vector<FMM::CORE::Trajectory> read_all_trajectories();
 };
 
+/**
+ * Interface of the CSV readers whose file is mapped into memory, so that
+ * the rows of separate byte ranges can be parsed concurrently.
+ */
+class IMappedCSVReader {
+ public:
+  virtual ~IMappedCSVReader() = default;
+  /**
+   * Get the start of the first row after the header
+   */
+  virtual const char *get_rows_begin() const = 0;
+  /**
+   * Get the end of the file mapped
+   */
+  virtual const char *get_rows_end() const = 0;
+  /**
+   * Find the first row at or after a position which starts a trajectory
+   * @param  position a position in the rows
+   * @return the start of the row, or the end of the rows
+   */
+  virtual const char *align(const char *position) const = 0;
+  /**
+   * Parse the trajectories of a range of rows, which is thread safe
+   * @param begin        start of a row starting a trajectory
+   * @param end          start of a row starting a trajectory, or the end
+   * of the rows
+   * @param trajectories updated with the trajectories of the range
+   */
+  virtual void read_range(
+      const char *begin, const char *end,
+      std::vector<FMM::CORE::Trajectory> *trajectories) const = 0;
+};
+
 /**
  *  Trajectory Reader Class for Shapefile.
  *
@@ -111,8 +155,11 @@ class GDALTrajectoryReader : public ITrajectoryReader {
  * Example:
  *    id;geom;timestamp
  *    1;LineString(1 0,1 1);1,1
+ *
+ * The file is mapped into memory and the rows are parsed in place.
  */
-class CSVTrajectoryReader : public ITrajectoryReader {
+class CSVTrajectoryReader : public ITrajectoryReader,
+                            public IMappedCSVReader {
  public:
   /**
    * Constructor of CSVTrajectoryReader
@@ -122,11 +169,14 @@ class CSVTrajectoryReader : public ITrajectoryReader {
    * @param timestamp_name Timestamp column name. If the timestamp column
    * is not found, an empty timestamp vector will be returned for
    * every trajectory.
+   * @param time_format Format of the timestamps
    */
   CSVTrajectoryReader(const std::string &e_filename,
                       const std::string &id_name,
                       const std::string &geom_name,
-                      const std::string &timestamp_name = "timestamp");
+                      const std::string &timestamp_name = "timestamp",
+                      UTIL::TimestampFormat time_format =
+                          UTIL::EPOCH_SECONDS);
   /**
    * Reset cursor of the reader
    */
@@ -156,12 +206,41 @@ class CSVTrajectoryReader : public ITrajectoryReader {
    * @return a vector of timestamps
    */
   static std::vector<double> string2time(const std::string &str);
+  const char *get_rows_begin() const override;
+  const char *get_rows_end() const override;
+  const char *align(const char *position) const override;
+  void read_range(
+      const char *begin, const char *end,
+      std::vector<FMM::CORE::Trajectory> *trajectories) const override;
+  ~CSVTrajectoryReader();
+  CSVTrajectoryReader(const CSVTrajectoryReader &) = delete;
+  CSVTrajectoryReader &operator=(const CSVTrajectoryReader &) = delete;
  private:
-  std::fstream ifs;
+  /**
+   * Read the trajectory of the next row which is not malformed
+   * @param position start of the rows read, updated to the row after
+   * @param end      end of the rows read
+   * @param traj     updated with the trajectory read
+   * @return false if no trajectory is found before the end
+   */
+  bool read_trajectory(const char **position, const char *end,
+                       FMM::CORE::Trajectory *traj) const;
+  /**
+   * Parse the columns of a row
+   * @return false if a column is missing or malformed
+   */
+  bool parse_row(const char *begin, const char *end,
+                 FMM::CORE::Trajectory *traj) const;
+  char *data = nullptr; // Content of the file mapped
+  size_t size = 0;
+  const char *body = nullptr; // First row after the header
+  const char *cursor = nullptr; // Next row to read
   int id_idx = -1;
   int geom_idx = -1;
   int timestamp_idx = -1; // Index of the id column in shapefile
+  int max_idx = -1; // Largest index of the columns read
   char delim = ';';
+  UTIL::TimestampFormat time_format;
 }; // TrajectoryCSVReader
 
 /**
@@ -177,8 +256,12 @@ class CSVTrajectoryReader : public ITrajectoryReader {
  *    id;x;y;timestamp
  *    1;1;1;1
  *    1;1;2;2
+ *
+ * The file is mapped into memory and the rows are parsed in place, with
+ * the coordinates and timestamps in double precision. The timestamps are
+ * read in the formats of CSVTrajectoryReader.
  */
-class CSVPointReader : public ITrajectoryReader {
+class CSVPointReader : public ITrajectoryReader, public IMappedCSVReader {
  public:
   /**
    *  Reader class for CSV point data.
@@ -188,13 +271,15 @@ class CSVPointReader : public ITrajectoryReader {
    * @param y_name y column name
    * @param time_name timestamp name. If the timestamp column is not found,
    * an empty timestamp vector will be returned for every trajectory.
+   * @param time_format format of the timestamps
    */
   CSVPointReader(
       const std::string &e_filename,
       const std::string &id_name,
       const std::string &x_name,
       const std::string &y_name,
-      const std::string &time_name);
+      const std::string &time_name,
+      UTIL::TimestampFormat time_format = UTIL::EPOCH_SECONDS);
   /**
    * Read the next trajectory in the file.
    * @return A trajectory object
@@ -218,16 +303,291 @@ class CSVPointReader : public ITrajectoryReader {
    * Close the reader object
    */
   void close() override;
+  const char *get_rows_begin() const override;
+  const char *get_rows_end() const override;
+  /**
+   * Find the first row at or after a position whose id differs from the
+   * one of the row before it
+   */
+  const char *align(const char *position) const override;
+  void read_range(
+      const char *begin, const char *end,
+      std::vector<FMM::CORE::Trajectory> *trajectories) const override;
+  ~CSVPointReader();
+  CSVPointReader(const CSVPointReader &) = delete;
+  CSVPointReader &operator=(const CSVPointReader &) = delete;
  private:
-  std::string prev_line = "";
-  std::fstream ifs;
+  /**
+   * Read the consecutive rows of the same id, skipping the malformed ones
+   * @param position start of the rows read, updated to the row after
+   * @param end      end of the rows read
+   * @param traj     updated with the trajectory read
+   * @return false if no trajectory is found before the end
+   */
+  bool read_trajectory(const char **position, const char *end,
+                       FMM::CORE::Trajectory *traj) const;
+  /**
+   * Parse the columns of a row
+   * @param begin start of the row
+   * @param end end of the row, excluding the line break
+   * @return false if a column is missing or is not a number
+   */
+  bool parse_row(const char *begin, const char *end, int *id,
+                 double *x, double *y, double *timestamp) const;
+  char *data = nullptr; // Content of the file mapped
+  size_t size = 0;
+  const char *body = nullptr; // First row after the header
+  const char *cursor = nullptr; // Next row to read
   int id_idx = -1;
   int x_idx = -1;
   int y_idx = -1;
   int timestamp_idx = -1;
+  int max_idx = -1; // Largest index of the columns read
   char delim = ';';
+  UTIL::TimestampFormat time_format;
 }; // CSVTemporalTrajectoryReader
 
+/**
+ * Trajectory Reader class for the CSV trajectory rows of a stream, such
+ * as stdin, so that the trajectories are matched as they arrive.
+ *
+ * The stream starts with a header and has the rows of a CSV trajectory
+ * file. A trajectory is read once its row is complete and the malformed
+ * rows are skipped with a warning.
+ */
+class StreamTrajectoryReader : public ITrajectoryReader {
+ public:
+  /**
+   * Constructor of StreamTrajectoryReader, which waits for the header
+   * @param fd file descriptor of the stream, 0 for stdin
+   * @param id_name ID column name
+   * @param geom_name Geometry column name
+   * @param timestamp_name Timestamp column name
+   * @param time_format Format of the timestamps
+   */
+  StreamTrajectoryReader(int fd, const std::string &id_name,
+                         const std::string &geom_name,
+                         const std::string &timestamp_name = "timestamp",
+                         UTIL::TimestampFormat time_format =
+                             UTIL::EPOCH_SECONDS);
+  /**
+   * Read the next trajectory of the stream, waiting for its row
+   * @return A trajectory object
+   */
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  /**
+   * Check if the stream has another trajectory, waiting for its row or
+   * the end of the stream
+   */
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  /**
+   * Stop reading the stream, which is not closed
+   */
+  void close() override;
+  /**
+   * Check if a complete row is buffered or the stream has data to read
+   */
+  bool is_ready() override;
+ private:
+  /**
+   * Read more data of the stream into the buffer
+   * @return false at the end of the stream or on error
+   */
+  bool fill_buffer();
+  /**
+   * Find the next complete row in the buffer, or the last row at the
+   * end of the stream
+   * @return false if no row is complete
+   */
+  bool find_row(std::size_t *row_end, std::size_t *next_row) const;
+  int fd;
+  std::string buffer; // Data read
+  std::size_t start = 0; // Start of the rows not parsed in the buffer
+  bool eof = false;
+  bool has_next = false; // The next trajectory is parsed
+  FMM::CORE::Trajectory next;
+  long rows = 0; // Rows read, for the warnings
+  int id_idx = -1;
+  int geom_idx = -1;
+  int timestamp_idx = -1;
+  int max_idx = -1; // Largest index of the columns read
+  char delim = ';';
+  UTIL::TimestampFormat time_format;
+};
+
+/**
+ * Reader of a CSV trajectory or point file parsed by a pool of threads.
+ *
+ * The rows are split into blocks of about block_bytes, whose boundaries
+ * are aligned to the rows and, for a point file, to the changes of id,
+ * so that no trajectory spans two blocks. The threads parse the blocks
+ * ahead of the one read, holding at most two blocks per thread, and the
+ * trajectories are returned in the order of the file.
+ */
+class ParallelCSVReader : public ITrajectoryReader {
+ public:
+  /**
+   * Default size of a block, in bytes
+   */
+  static const long DEFAULT_BLOCK_BYTES = 8L << 20;
+  /**
+   * Constructor of a parallel reader
+   * @param config      configuration of a CSV trajectory or point file
+   * @param num_threads number of threads parsing the blocks
+   * @param block_bytes size of a block, in bytes
+   */
+  ParallelCSVReader(const FMM::CONFIG::GPSConfig &config, int num_threads,
+                    long block_bytes = DEFAULT_BLOCK_BYTES);
+  ~ParallelCSVReader();
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  /**
+   * Stop the threads and close the file
+   */
+  void close() override;
+ private:
+  /**
+   * Block of rows parsed by a thread
+   */
+  struct Block {
+    std::vector<FMM::CORE::Trajectory> trajectories;
+    bool done = false;
+  };
+  /**
+   * Parse the next blocks until all of them are taken or it is stopped
+   */
+  void parse_blocks();
+  std::shared_ptr<ITrajectoryReader> reader;
+  const IMappedCSVReader *mapped = nullptr;
+  long block_bytes;
+  long max_blocks; // Blocks issued and not read
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable cv;
+  const char *next_begin = nullptr; // Start of the next block issued
+  long issued = 0;
+  long consumed = 0;
+  bool stopped = false;
+  std::map<long, Block> blocks; // Blocks issued and not read, by index
+  std::vector<FMM::CORE::Trajectory> current; // Trajectories being read
+  std::size_t position = 0;
+};
+
+/**
+ * Reader of a shapefile or GeoPackage trajectory file by a pool of
+ * threads, each with its own handle of the dataset.
+ *
+ * The features are split into blocks of block_features, read by feature
+ * index if the layer supports fast random access and otherwise by ranges
+ * of FID with an attribute filter. The threads read the blocks ahead of
+ * the one returned, holding at most two blocks per thread, and the
+ * trajectories are returned in the order of the blocks.
+ */
+class ParallelGDALReader : public ITrajectoryReader {
+ public:
+  /**
+   * Default number of features of a block
+   */
+  static const long DEFAULT_BLOCK_FEATURES = 4096;
+  /**
+   * Constructor of a parallel reader
+   * @param filename       a GPS shapefile or GeoPackage path
+   * @param id_name        the ID field name
+   * @param timestamp_name the timestamp field name
+   * @param num_threads    number of threads reading the blocks
+   * @param block_features number of features of a block
+   */
+  ParallelGDALReader(const std::string &filename,
+                     const std::string &id_name,
+                     const std::string &timestamp_name, int num_threads,
+                     long block_features = DEFAULT_BLOCK_FEATURES);
+  ~ParallelGDALReader();
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  /**
+   * Stop the threads and close the dataset
+   */
+  void close() override;
+ private:
+  /**
+   * Block of features read by a thread
+   */
+  struct Block {
+    std::vector<FMM::CORE::Trajectory> trajectories;
+    bool done = false;
+  };
+  /**
+   * Read the next blocks with a handle of the dataset until all of them
+   * are taken or it is stopped
+   */
+  void read_blocks();
+  /**
+   * Read the features of a block
+   * @param layer        layer of the handle of the thread
+   * @param begin        first feature index or FID of the block
+   * @param end          end of the block, excluded
+   * @param trajectories updated with the trajectories of the block
+   */
+  void read_block(OGRLayer *layer, long long begin, long long end,
+                  std::vector<FMM::CORE::Trajectory> *trajectories) const;
+  std::shared_ptr<GDALTrajectoryReader> reader; // Reader of the metadata
+  std::string filename;
+  std::string fid_name; // FID column filtered, empty to read by index
+  int id_idx = -1;
+  long block_features;
+  long max_blocks; // Blocks issued and not read
+  long long range_end = 0; // End of the feature indices or FIDs
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable cv;
+  long long next_begin = 0; // Start of the next block issued
+  long issued = 0;
+  long consumed = 0;
+  bool stopped = false;
+  std::map<long, Block> blocks; // Blocks issued and not read, by index
+  std::vector<FMM::CORE::Trajectory> current; // Trajectories being read
+  std::size_t position = 0;
+};
+
+/**
+ * Predicate selecting the trajectories returned by a reader
+ */
+typedef std::function<bool(const FMM::CORE::Trajectory &)>
+    TrajectoryFilter;
+
+/**
+ * Reader returning only the trajectories of another reader selected by
+ * a filter, which reads ahead until the next trajectory selected
+ */
+class FilteredTrajectoryReader : public ITrajectoryReader {
+ public:
+  /**
+   * Constructor
+   * @param reader reader of all the trajectories
+   * @param filter predicate of the trajectories returned
+   */
+  FilteredTrajectoryReader(std::shared_ptr<ITrajectoryReader> reader,
+                           const TrajectoryFilter &filter);
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  void close() override;
+  bool is_ready() override;
+  /**
+   * Get the number of trajectories read and not selected
+   */
+  long get_skipped() const { return skipped; }
+ private:
+  std::shared_ptr<ITrajectoryReader> reader;
+  TrajectoryFilter filter;
+  FMM::CORE::Trajectory next; // Trajectory selected and not returned
+  bool has_next = false;
+  long skipped = 0;
+};
+
 /**
  * %GPSReader class, a wrapper makes it easier to read data from
  * a file by specifying GPSConfig as input.
@@ -254,6 +614,12 @@ class GPSReader {
   inline bool has_next_trajectory() {
     return reader->has_next_trajectory();
   };
+  /**
+   * Check if the next trajectory can be read without waiting for input
+   */
+  inline bool is_ready() {
+    return reader->is_ready();
+  };
   /**
    * Read next N trajectories from the file. If there are k trajectories left
    * k<N, then only k trajectories will be returned.
@@ -271,6 +637,30 @@ class GPSReader {
   inline std::vector<FMM::CORE::Trajectory> read_all_trajectories() {
     return reader->read_all_trajectories();
   };
+  /**
+   * Return only the trajectories selected by a filter from now on
+   * @param filter predicate of the trajectories returned
+   */
+  void set_filter(const TrajectoryFilter &filter);
+  /**
+   * Return only the trajectories of a shard of the input from now on,
+   * which are selected by the hash of their id
+   * @param shard      index of the shard, from 0
+   * @param num_shards number of shards the input is split into
+   */
+  void set_shard(int shard, int num_shards);
+  /**
+   * Get the shard of a trajectory, which does not depend on the
+   * platform so that the shards of separate machines cover the input
+   * @param  id         id of the trajectory
+   * @param  num_shards number of shards
+   * @return index of the shard, from 0
+   */
+  static int get_trajectory_shard(int id, int num_shards);
+  /**
+   * Get the number of trajectories not selected by the filter
+   */
+  long get_filtered() const;
  private:
   std::shared_ptr<ITrajectoryReader> reader;
   int mode; /**< Mode marking the type of GPS data stored in the file */
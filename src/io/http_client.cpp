@@ -0,0 +1,180 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/http_client.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+namespace {
+
+// Close the socket when leaving the scope
+struct SocketGuard {
+  int fd;
+  ~SocketGuard() { if (fd >= 0) close(fd); }
+};
+
+std::string to_lower(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+int connect_to(const HttpUrl &url, int timeout, std::string *error) {
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses = nullptr;
+  int status = getaddrinfo(url.host.c_str(), std::to_string(url.port).c_str(),
+                           &hints, &addresses);
+  if (status != 0) {
+    *error = "cannot resolve " + url.host + ": " + gai_strerror(status);
+    return -1;
+  }
+  int fd = -1;
+  for (addrinfo *address = addresses; address != nullptr;
+       address = address->ai_next) {
+    fd = socket(address->ai_family, address->ai_socktype,
+                address->ai_protocol);
+    if (fd < 0) continue;
+    if (timeout > 0) {
+      timeval tv{};
+      tv.tv_sec = timeout;
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(addresses);
+  if (fd < 0) {
+    *error = "cannot connect to " + url.host + ":" +
+        std::to_string(url.port) + ": " + std::strerror(errno);
+  }
+  return fd;
+}
+
+} // namespace
+
+bool HttpUrl::parse(const std::string &text, HttpUrl *url) {
+  const std::string scheme = "http://";
+  if (text.compare(0, scheme.size(), scheme) != 0) return false;
+  std::size_t host_begin = scheme.size();
+  std::size_t slash = text.find('/', host_begin);
+  std::string authority = text.substr(host_begin, slash - host_begin);
+  std::size_t colon = authority.rfind(':');
+  url->port = 80;
+  if (colon != std::string::npos) {
+    char *end = nullptr;
+    std::string port = authority.substr(colon + 1);
+    url->port = std::strtol(port.c_str(), &end, 10);
+    if (port.empty() || *end != '\0' || url->port <= 0 ||
+        url->port > 65535) {
+      return false;
+    }
+    authority = authority.substr(0, colon);
+  }
+  if (authority.empty()) return false;
+  url->host = authority;
+  url->prefix = slash == std::string::npos ? "" : text.substr(slash);
+  while (!url->prefix.empty() && url->prefix.back() == '/') {
+    url->prefix.pop_back();
+  }
+  return true;
+}
+
+bool IO::parse_http_response(const std::string &text,
+                             HttpResponse *response) {
+  std::size_t header_end = text.find("\r\n\r\n");
+  if (header_end == std::string::npos) return false;
+  std::size_t line_end = text.find("\r\n");
+  std::string line = text.substr(0, line_end);
+  std::size_t space = line.find(' ');
+  if (line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+    return false;
+  }
+  char *end = nullptr;
+  response->status = std::strtol(line.c_str() + space + 1, &end, 10);
+  if (end == line.c_str() + space + 1) return false;
+  long length = -1;
+  std::size_t begin = line_end + 2;
+  while (begin < header_end) {
+    std::size_t next = text.find("\r\n", begin);
+    std::string header = text.substr(begin, next - begin);
+    begin = next + 2;
+    std::size_t colon = header.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = to_lower(header.substr(0, colon));
+    std::size_t value_begin = header.find_first_not_of(" \t", colon + 1);
+    std::string value = value_begin == std::string::npos ?
+                        "" : header.substr(value_begin);
+    if (name == "content-length") {
+      length = std::strtol(value.c_str(), nullptr, 10);
+    } else if (name == "content-type") {
+      response->content_type = value;
+    }
+  }
+  std::size_t body_begin = header_end + 4;
+  if (length < 0) {
+    response->body = text.substr(body_begin);
+    return true;
+  }
+  if (text.size() - body_begin < (std::size_t) length) return false;
+  response->body = text.substr(body_begin, length);
+  return true;
+}
+
+bool IO::http_post(const HttpUrl &url, const std::string &target,
+                   const std::string &body, int timeout,
+                   HttpResponse *response, std::string *error) {
+  SocketGuard guard{connect_to(url, timeout, error)};
+  if (guard.fd < 0) return false;
+  std::string request = "POST " + url.prefix + target + " HTTP/1.1\r\n" +
+      "Host: " + url.host + ":" + std::to_string(url.port) + "\r\n" +
+      "Content-Type: text/plain\r\n" +
+      "Content-Length: " + std::to_string(body.size()) + "\r\n" +
+      "Connection: close\r\n\r\n";
+  request += body;
+  std::size_t sent = 0;
+  while (sent < request.size()) {
+    ssize_t n = send(guard.fd, request.data() + sent, request.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0) {
+      *error = "cannot send to " + url.host + ": " + std::strerror(errno);
+      return false;
+    }
+    sent += n;
+  }
+  // The server closes the connection after the response
+  std::string text;
+  char chunk[16384];
+  while (true) {
+    ssize_t n = recv(guard.fd, chunk, sizeof(chunk), 0);
+    if (n == 0) break;
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      *error = "cannot receive from " + url.host + ": " +
+          std::strerror(errno);
+      return false;
+    }
+    text.append(chunk, n);
+  }
+  if (!parse_http_response(text, response)) {
+    *error = "malformed response from " + url.host;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,68 @@
+/**
+ * Fast map matching.
+ *
+ * Minimal blocking HTTP/1.1 client posting requests to other servers
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_HTTP_CLIENT_HPP
+#define FMM_IO_HTTP_CLIENT_HPP
+
+#include "io/http_server.hpp"
+
+#include <string>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Url of a server, as http://host:port/prefix
+ */
+struct HttpUrl {
+  std::string host; /**< Host name or address */
+  int port = 80; /**< Port */
+  std::string prefix; /**< Path prepended to the targets, without the
+                           trailing slash */
+  /**
+   * Parse a url, where only http is supported
+   * @param  text url
+   * @param  url  updated with the host, port and prefix
+   * @return false if the url is malformed
+   */
+  static bool parse(const std::string &text, HttpUrl *url);
+};
+
+/**
+ * Post a request on a new connection closed after the response, whose
+ * body is read until the connection is closed or its Content-Length.
+ * The client is meant for a few large requests between the servers of
+ * a cluster, without TLS or chunked bodies.
+ * @param  url      url of the server
+ * @param  target   path and query, such as /match?k=8
+ * @param  body     body of the request
+ * @param  timeout  seconds to wait for sending or receiving data, 0 for
+ * no limit
+ * @param  response updated with the status and body of the response
+ * @param  error    updated with the error if the request fails
+ * @return false if the server cannot be reached or the response is
+ * malformed, a response with an error status is returned as true
+ */
+bool http_post(const HttpUrl &url, const std::string &target,
+               const std::string &body, int timeout,
+               HttpResponse *response, std::string *error);
+
+/**
+ * Parse the status line, headers and body of a response
+ * @param  text     text received
+ * @param  response updated with the status, content type and body
+ * @return false if the status line is malformed or the body is
+ * shorter than its Content-Length
+ */
+bool parse_http_response(const std::string &text, HttpResponse *response);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_HTTP_CLIENT_HPP
@@ -0,0 +1,300 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/http_server.hpp"
+#include "util/bounded_queue.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+namespace {
+
+// Largest request line and headers accepted, in bytes
+const std::size_t MAX_HEADER_SIZE = 64 << 10;
+
+std::string to_lower(std::string text) {
+  std::transform(text.begin(), text.end(), text.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return text;
+}
+
+std::string trim(const std::string &text) {
+  std::size_t begin = text.find_first_not_of(" \t");
+  if (begin == std::string::npos) return "";
+  std::size_t end = text.find_last_not_of(" \t\r");
+  return text.substr(begin, end - begin + 1);
+}
+
+const char *get_reason(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    default: return "Internal Server Error";
+  }
+}
+
+bool send_all(int fd, const std::string &text) {
+  std::size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t n = send(fd, text.data() + sent, text.size() - sent,
+                     MSG_NOSIGNAL);
+    if (n <= 0) return false;
+    sent += n;
+  }
+  return true;
+}
+
+// Append the bytes received to the buffer, false once closed or idle
+bool receive(int fd, std::string *buffer) {
+  char chunk[16384];
+  ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+  if (n <= 0) return false;
+  buffer->append(chunk, n);
+  return true;
+}
+
+void send_error(int fd, int status, const std::string &message) {
+  HttpResponse response;
+  response.status = status;
+  response.body = "{\"error\":\"" + message + "\"}";
+  send_all(fd, HttpServer::format_response(response, false));
+}
+
+} // namespace
+
+bool HttpRequest::get_parameter(const std::string &name,
+                                std::string *value) const {
+  std::size_t begin = 0;
+  while (begin <= query.size()) {
+    std::size_t end = query.find('&', begin);
+    if (end == std::string::npos) end = query.size();
+    std::size_t equal = query.find('=', begin);
+    if (equal < end && query.compare(begin, equal - begin, name) == 0 &&
+        equal - begin == name.size()) {
+      *value = query.substr(equal + 1, end - equal - 1);
+      return true;
+    }
+    begin = end + 1;
+  }
+  return false;
+}
+
+HttpServer::HttpServer(const HttpServerOptions &options,
+                       const HttpHandler &handler) :
+    options_(options), handler_(handler) {
+  options_.num_threads = std::max(options_.num_threads, 1);
+}
+
+HttpServer::~HttpServer() {
+  int fd = listen_fd_.exchange(-1);
+  if (fd >= 0) close(fd);
+}
+
+bool HttpServer::parse_header(const std::string &header,
+                              HttpRequest *request, long *length) {
+  std::size_t line_end = header.find("\r\n");
+  std::string line = header.substr(0, line_end);
+  std::size_t first = line.find(' ');
+  std::size_t second = line.find(' ', first + 1);
+  if (first == std::string::npos || second == std::string::npos) {
+    return false;
+  }
+  request->method = line.substr(0, first);
+  std::string target = line.substr(first + 1, second - first - 1);
+  std::string version = line.substr(second + 1);
+  if (version.compare(0, 5, "HTTP/") != 0) return false;
+  std::size_t question = target.find('?');
+  request->path = target.substr(0, question);
+  request->query = question == std::string::npos ?
+                   "" : target.substr(question + 1);
+  request->keep_alive = version != "HTTP/1.0";
+  *length = 0;
+  while (line_end != std::string::npos) {
+    std::size_t begin = line_end + 2;
+    line_end = header.find("\r\n", begin);
+    line = header.substr(begin, line_end == std::string::npos ?
+                                std::string::npos : line_end - begin);
+    std::size_t colon = line.find(':');
+    if (colon == std::string::npos) continue;
+    std::string name = to_lower(trim(line.substr(0, colon)));
+    std::string value = trim(line.substr(colon + 1));
+    if (name == "content-length") {
+      char *end = nullptr;
+      *length = std::strtol(value.c_str(), &end, 10);
+      if (end == value.c_str() || *length < 0) return false;
+    } else if (name == "connection") {
+      std::string connection = to_lower(value);
+      if (connection == "close") request->keep_alive = false;
+      if (connection == "keep-alive") request->keep_alive = true;
+    } else if (name == "authorization") {
+      if (to_lower(value.substr(0, 7)) == "bearer ") {
+        request->token = trim(value.substr(7));
+      }
+    } else if (name == "transfer-encoding") {
+      // Chunked bodies are left to a reverse proxy
+      *length = -1;
+    }
+  }
+  return true;
+}
+
+std::string HttpServer::format_response(const HttpResponse &response,
+                                        bool keep_alive) {
+  std::string text = "HTTP/1.1 " + std::to_string(response.status) + " " +
+      get_reason(response.status) + "\r\n";
+  text += "Content-Type: " + response.content_type + "\r\n";
+  text += "Content-Length: " + std::to_string(response.body.size()) +
+      "\r\n";
+  text += keep_alive ? "Connection: keep-alive\r\n\r\n" :
+          "Connection: close\r\n\r\n";
+  text += response.body;
+  return text;
+}
+
+bool HttpServer::run() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Fail to create a socket: {}", std::strerror(errno));
+    return false;
+  }
+  int enable = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  if (inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1) {
+    SPDLOG_CRITICAL("Invalid host {}", options_.host);
+    close(fd);
+    return false;
+  }
+  address.sin_port = htons(options_.port);
+  if (bind(fd, (sockaddr *) &address, sizeof(address)) != 0 ||
+      listen(fd, 128) != 0) {
+    SPDLOG_CRITICAL("Fail to listen on {}:{}: {}", options_.host,
+                    options_.port, std::strerror(errno));
+    close(fd);
+    return false;
+  }
+  listen_fd_ = fd;
+  SPDLOG_INFO("Listen on {}:{} with threads {}", options_.host,
+              options_.port, options_.num_threads);
+  UTIL::BoundedQueue<int> connections(4 * options_.num_threads);
+  // The signals of the program are handled by the calling thread, so
+  // that they do not interrupt the workers
+  sigset_t signals, previous;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  std::vector<std::thread> workers;
+  for (int i = 0; i < options_.num_threads; ++i) {
+    workers.emplace_back([this, &connections]() {
+      int connection;
+      while (connections.pop(&connection)) {
+        serve(connection);
+        close(connection);
+      }
+    });
+  }
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+  while (!stopping_) {
+    int connection = accept(fd, nullptr, nullptr);
+    if (connection < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      if (!stopping_) {
+        SPDLOG_ERROR("Fail to accept a connection: {}",
+                     std::strerror(errno));
+      }
+      break;
+    }
+    timeval timeout{options_.idle_timeout, 0};
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+               sizeof(timeout));
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &enable,
+               sizeof(enable));
+    if (!connections.push(connection)) close(connection);
+  }
+  connections.close();
+  for (std::thread &worker : workers) worker.join();
+  fd = listen_fd_.exchange(-1);
+  if (fd >= 0) close(fd);
+  SPDLOG_INFO("Server stopped");
+  return true;
+}
+
+void HttpServer::stop() {
+  stopping_ = true;
+  int fd = listen_fd_;
+  // Wakes up the thread blocked in accept
+  if (fd >= 0) shutdown(fd, SHUT_RDWR);
+}
+
+void HttpServer::serve(int fd) {
+  std::string buffer;
+  while (!stopping_) {
+    std::size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (buffer.size() > MAX_HEADER_SIZE) {
+        send_error(fd, 400, "headers too large");
+        return;
+      }
+      if (!receive(fd, &buffer)) return;
+    }
+    HttpRequest request;
+    long length = 0;
+    if (!parse_header(buffer.substr(0, header_end), &request, &length)) {
+      send_error(fd, 400, "malformed request");
+      return;
+    }
+    if (length < 0) {
+      send_error(fd, 411, "chunked body is not supported");
+      return;
+    }
+    if (length > options_.max_body) {
+      send_error(fd, 413, "body too large");
+      return;
+    }
+    std::size_t request_end = header_end + 4 + length;
+    while (buffer.size() < request_end) {
+      if (!receive(fd, &buffer)) return;
+    }
+    request.body = buffer.substr(header_end + 4, length);
+    buffer.erase(0, request_end);
+    HttpResponse response;
+    try {
+      response = handler_(request);
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("Fail to answer {} {}: {}", request.method, request.path,
+                   e.what());
+      response.status = 500;
+      response.body = "{\"error\":\"internal error\"}";
+    }
+    bool keep_alive = request.keep_alive && !stopping_;
+    if (!send_all(fd, format_response(response, keep_alive)) ||
+        !keep_alive) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,135 @@
+/**
+ * Fast map matching.
+ *
+ * Minimal HTTP/1.1 server answering requests with a pool of threads
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_HTTP_SERVER_HPP
+#define FMM_IO_HTTP_SERVER_HPP
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Request received by a http server
+ */
+struct HttpRequest {
+  std::string method; /**< Method, such as GET or POST */
+  std::string path; /**< Path of the target, without the query */
+  std::string query; /**< Query of the target, after ? */
+  std::string body; /**< Body, read from its Content-Length */
+  bool keep_alive = true; /**< If false, the connection is closed after
+                               the response */
+  std::string token; /**< Token of an Authorization: Bearer header */
+  /**
+   * Get a parameter of the query
+   * @param  name  name of the parameter
+   * @param  value updated with the value of the parameter, which is not
+   * percent decoded
+   * @return true if the parameter is found
+   */
+  bool get_parameter(const std::string &name, std::string *value) const;
+};
+
+/**
+ * Response of a http server
+ */
+struct HttpResponse {
+  int status = 200; /**< Status code */
+  std::string content_type = "application/json"; /**< Type of the body */
+  std::string body; /**< Body */
+};
+
+/**
+ * Function answering a request, which is called by several threads at
+ * once
+ */
+typedef std::function<HttpResponse(const HttpRequest &)> HttpHandler;
+
+/**
+ * Options of a http server
+ */
+struct HttpServerOptions {
+  std::string host = "127.0.0.1"; /**< IPv4 address listened, 0.0.0.0
+                                      for all the interfaces */
+  int port = 8080; /**< Port listened */
+  int num_threads = 1; /**< Threads answering the connections */
+  long max_body = 64L << 20; /**< Largest body accepted, in bytes */
+  int idle_timeout = 5; /**< Seconds a connection is kept open without
+                             a request */
+};
+
+/**
+ * Server of HTTP/1.1 requests, with persistent connections and bodies
+ * given by their Content-Length.
+ *
+ * The calling thread accepts the connections and queues them to a pool
+ * of threads, each answering the requests of a connection one after the
+ * other with the handler until the connection is closed or idle. The
+ * server is meant to run behind a reverse proxy for TLS and chunked
+ * bodies.
+ */
+class HttpServer {
+ public:
+  /**
+   * Create a server
+   * @param options options of the server
+   * @param handler function answering the requests
+   */
+  HttpServer(const HttpServerOptions &options, const HttpHandler &handler);
+  ~HttpServer();
+  HttpServer(const HttpServer &) = delete;
+  HttpServer &operator=(const HttpServer &) = delete;
+  /**
+   * Listen on the port, accept the connections until stop is called,
+   * then wait for the connections opened
+   * @return false if the port cannot be listened
+   */
+  bool run();
+  /**
+   * Stop accepting the connections, which can be called from a signal
+   * handler
+   */
+  void stop();
+  /**
+   * Parse the request line and headers of a request
+   * @param  header  text before the empty line ending the headers
+   * @param  request updated with the method, target and keep alive
+   * @param  length  updated with the Content-Length, 0 if none
+   * @return false if the request line is malformed
+   */
+  static bool parse_header(const std::string &header, HttpRequest *request,
+                           long *length);
+  /**
+   * Format the status line, headers and body of a response
+   * @param  response   response formatted
+   * @param  keep_alive if false, the connection is closed
+   * @return the text sent
+   */
+  static std::string format_response(const HttpResponse &response,
+                                     bool keep_alive);
+ private:
+  /**
+   * Answer the requests of a connection until it is closed
+   * @param fd socket of the connection
+   */
+  void serve(int fd);
+  HttpServerOptions options_;
+  HttpHandler handler_;
+  std::atomic<int> listen_fd_{-1};
+  std::atomic<bool> stopping_{false};
+}; // HttpServer
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_HTTP_SERVER_HPP
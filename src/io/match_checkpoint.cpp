@@ -0,0 +1,116 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/match_checkpoint.hpp"
+#include "util/debug.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+MatchCheckpoint::MatchCheckpoint(const std::string &result_file,
+                                 CSVMatchResultWriter *writer,
+                                 double interval, long skipped) :
+    result_file_(result_file), writer_(writer), interval_(interval),
+    skipped_(skipped), last_save_(std::chrono::steady_clock::now()) {}
+
+std::string MatchCheckpoint::checkpoint_file(
+    const std::string &result_file) {
+  return result_file + ".checkpoint";
+}
+
+void MatchCheckpoint::update(long trajectories) {
+  UTIL::TimePoint now = std::chrono::steady_clock::now();
+  if (std::chrono::duration<double>(now - last_save_).count() < interval_) {
+    return;
+  }
+  save(trajectories);
+}
+
+bool MatchCheckpoint::save(long trajectories) {
+  last_save_ = std::chrono::steady_clock::now();
+  trajectories += skipped_;
+  writer_->flush();
+  long long bytes = UTIL::get_file_size(result_file_);
+  if (bytes < 0) {
+    SPDLOG_ERROR("Fail to get the size of result file {}", result_file_);
+    return false;
+  }
+  // The checkpoint is replaced at once, so that it is never read half
+  // written
+  std::string file = checkpoint_file(result_file_);
+  std::string temp_file = file + ".tmp";
+  {
+    std::ofstream ofs(temp_file);
+    ofs << "trajectories " << trajectories << "\n"
+        << "bytes " << bytes << "\n";
+    if (!ofs.good()) {
+      SPDLOG_ERROR("Fail to write checkpoint file {}", temp_file);
+      return false;
+    }
+  }
+  if (std::rename(temp_file.c_str(), file.c_str()) != 0) {
+    SPDLOG_ERROR("Fail to rename checkpoint file to {}", file);
+    return false;
+  }
+  SPDLOG_DEBUG("Checkpoint trajectories {} bytes {}", trajectories, bytes);
+  return true;
+}
+
+bool MatchCheckpoint::resume(const std::string &result_file,
+                             long *trajectories) {
+  std::string file = checkpoint_file(result_file);
+  std::ifstream ifs(file);
+  if (!ifs) {
+    SPDLOG_CRITICAL("Cannot read checkpoint file {}", file);
+    return false;
+  }
+  long done = -1;
+  long long bytes = -1;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    size_t split = line.find(' ');
+    if (split == std::string::npos) continue;
+    std::string key = line.substr(0, split);
+    std::istringstream value(line.substr(split + 1));
+    if (key == "trajectories") {
+      value >> done;
+    } else if (key == "bytes") {
+      value >> bytes;
+    }
+  }
+  if (done < 0 || bytes < 0) {
+    SPDLOG_CRITICAL("Invalid checkpoint file {}", file);
+    return false;
+  }
+  long long size = UTIL::get_file_size(result_file);
+  if (size < bytes) {
+    SPDLOG_CRITICAL("Result file {} of {} bytes is shorter than the "
+                    "checkpoint of {} bytes", result_file, size, bytes);
+    return false;
+  }
+  // The rows written after the checkpoint are written again
+  if (truncate(result_file.c_str(), bytes) != 0) {
+    SPDLOG_CRITICAL("Fail to truncate result file {}", result_file);
+    return false;
+  }
+  *trajectories = done;
+  SPDLOG_INFO("Resume after {} trajectories written in {} bytes",
+              done, bytes);
+  return true;
+}
+
+long MatchCheckpoint::skip_trajectories(GPSReader *reader,
+                                        long trajectories) {
+  long skipped = 0;
+  while (skipped < trajectories && reader->has_next_trajectory()) {
+    reader->read_next_trajectory();
+    ++skipped;
+  }
+  return skipped;
+}
@@ -0,0 +1,98 @@
+/**
+ * Fast map matching.
+ *
+ * Checkpoint of a matching job, from which an interrupted job is resumed
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_MATCH_CHECKPOINT_HPP
+#define FMM_IO_MATCH_CHECKPOINT_HPP
+
+#include "io/gps_reader.hpp"
+#include "io/mm_writer.hpp"
+#include "util/util.hpp"
+
+#include <string>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Checkpoint of the results written by a job into a csv file.
+ *
+ * The checkpoint records the number of trajectories of the input whose
+ * results are written, in the input order, with the size of the result
+ * file holding them. It is saved after the writer is flushed, into a
+ * file named after the result file followed by .checkpoint, which is
+ * replaced by a rename so that an interruption leaves either the
+ * previous checkpoint or the new one. A compressed file is flushed at
+ * the end of a gzip member.
+ *
+ * A job resumed truncates the result file to the size recorded, which
+ * drops the rows written after the checkpoint, appends to it and skips
+ * the trajectories recorded.
+ */
+class MatchCheckpoint {
+ public:
+  /**
+   * Create the checkpoint of a job
+   * @param result_file name of the result file written
+   * @param writer      writer of the result file
+   * @param interval    minimum time between two checkpoints saved by
+   * update, in seconds
+   * @param skipped     trajectories of the input skipped by a job
+   * resumed, which are counted before the ones of the job
+   */
+  MatchCheckpoint(const std::string &result_file,
+                  CSVMatchResultWriter *writer, double interval,
+                  long skipped = 0);
+  /**
+   * Save a checkpoint if the interval has elapsed since the last one,
+   * which should be called by the thread writing the results
+   * @param trajectories number of the first trajectories read by the job
+   * whose results are written
+   */
+  void update(long trajectories);
+  /**
+   * Flush the writer and save a checkpoint
+   * @param trajectories number of the first trajectories read by the job
+   * whose results are written
+   * @return true if saved
+   */
+  bool save(long trajectories);
+  /**
+   * Get the name of the checkpoint of a result file
+   */
+  static std::string checkpoint_file(const std::string &result_file);
+  /**
+   * Read the checkpoint of a result file and truncate the file to the
+   * size recorded
+   * @param  result_file  name of the result file
+   * @param  trajectories updated with the number of trajectories whose
+   * results are kept
+   * @return true if the job is resumed, false if the checkpoint is not
+   * valid or the file is not truncated
+   */
+  static bool resume(const std::string &result_file, long *trajectories);
+  /**
+   * Skip the trajectories of a reader already matched
+   * @param  reader       reader of the trajectories
+   * @param  trajectories number of trajectories skipped
+   * @return the number of trajectories skipped, which is smaller if the
+   * input ends before
+   */
+  static long skip_trajectories(GPSReader *reader, long trajectories);
+ private:
+  std::string result_file_;
+  CSVMatchResultWriter *writer_;
+  double interval_;
+  long skipped_;
+  UTIL::TimePoint last_save_;
+}; // MatchCheckpoint
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_MATCH_CHECKPOINT_HPP
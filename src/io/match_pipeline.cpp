@@ -0,0 +1,444 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/match_pipeline.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "io/result_stream.hpp"
+#include "util/bounded_queue.hpp"
+#include "util/stage_profile.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+// Trajectories taken at once by a matcher, with their index in the input
+struct TrajectoryBatch {
+  std::vector<Trajectory> trajectories;
+  std::vector<long> sequences;
+};
+
+// Results of a batch of trajectories with their counters. The lines are
+// formatted in the block for a csv writer, where the rows[k] lines of the
+// k-th trajectory end at ends[k], and the block is compressed if it is
+// written as it is into a compressed output. Otherwise the segments of
+// the k-th trajectory are kept in segments[k].
+struct ResultBatch {
+  std::string block;
+  bool compressed = false;
+  std::vector<long> sequences;
+  std::vector<std::size_t> ends;
+  std::vector<int> rows;
+  std::vector<std::vector<SegmentMatchResult>> segments;
+  long total_points = 0;
+  long points_matched = 0;
+};
+
+// Order the trajectories of a window along the Hilbert curve of the
+// centers of their bounding boxes, scaled to the extent of the window
+void order_by_hilbert_curve(const std::vector<Trajectory> &window,
+                            std::vector<std::size_t> *order) {
+  std::size_t N = window.size();
+  std::vector<double> xs(N, 0), ys(N, 0);
+  double min_x = DBL_MAX, min_y = DBL_MAX;
+  double max_x = -DBL_MAX, max_y = -DBL_MAX;
+  for (std::size_t k = 0; k < N; ++k) {
+    if (window[k].geom.get_num_points() == 0) continue;
+    double x1, y1, x2, y2;
+    ALGORITHM::boundingbox_geometry(window[k].geom, &x1, &y1, &x2, &y2);
+    xs[k] = (x1 + x2) / 2;
+    ys[k] = (y1 + y2) / 2;
+    min_x = std::min(min_x, xs[k]);
+    min_y = std::min(min_y, ys[k]);
+    max_x = std::max(max_x, xs[k]);
+    max_y = std::max(max_y, ys[k]);
+  }
+  double scale = 65535.0 / std::max(std::max(max_x - min_x, max_y - min_y),
+                                    DBL_MIN);
+  std::vector<unsigned long long> keys(N, 0);
+  for (std::size_t k = 0; k < N; ++k) {
+    if (window[k].geom.get_num_points() == 0) continue;
+    keys[k] = ALGORITHM::hilbert_index(
+        (unsigned int) ((xs[k] - min_x) * scale),
+        (unsigned int) ((ys[k] - min_y) * scale));
+  }
+  std::stable_sort(order->begin(), order->end(),
+                   [&keys](std::size_t a, std::size_t b) {
+                     return keys[a] < keys[b];
+                   });
+}
+
+} // namespace
+
+long IO::get_chunk_points(const MatchPipelineOptions &options) {
+  if (options.memory_budget <= 0) return 0;
+  // A window and the two queues of chunks per matcher, and the chunk
+  // matched by each matcher
+  long chunks = (2L * PIPELINE_QUEUE_CHUNKS + 2) *
+      std::max(options.num_matchers, 1);
+  return std::max(options.memory_budget / PIPELINE_BYTES_PER_POINT / chunks,
+                  1L);
+}
+
+int IO::count_points_matched(const std::vector<SegmentMatchResult> &segments,
+                             int num_points) {
+  int points_matched = 0;
+  for (const SegmentMatchResult &segment : segments) {
+    if (segment.result.cpath.empty()) continue;
+    points_matched += segment.first < 0 ?
+                      num_points : segment.last - segment.first + 1;
+  }
+  return points_matched;
+}
+
+MatchPipelineStatistics IO::run_match_pipeline(
+    GPSReader *reader, MatchResultWriter *writer,
+    const MatchFunction &match, const MatchPipelineOptions &options) {
+  UTIL::TimePoint start_time = std::chrono::steady_clock::now();
+  int num_matchers = std::max(options.num_matchers, 1);
+  int chunk_size = std::max(options.chunk_size, 1);
+  // With a memory budget the chunks are cut by their points
+  long chunk_points = get_chunk_points(options);
+  int step = options.step > 0 ? options.step : 100;
+  if (chunk_points > 0) {
+    SPDLOG_INFO("Run match pipeline with matchers {} chunk points {} "
+                "ordered {}", num_matchers, chunk_points, options.ordered);
+  } else {
+    SPDLOG_INFO("Run match pipeline with matchers {} chunk size {} "
+                "ordered {}", num_matchers, chunk_size, options.ordered);
+  }
+  auto is_full = [&](std::size_t trajectories, long points, int chunks) {
+    return chunk_points > 0 ? points >= chunk_points * chunks :
+           (long) trajectories >= (long) chunk_size * chunks;
+  };
+  // Only the csv writer formats its lines in the matchers
+  CSVMatchResultWriter *csv_writer =
+      dynamic_cast<CSVMatchResultWriter *>(writer);
+  std::size_t capacity = PIPELINE_QUEUE_CHUNKS * num_matchers;
+  UTIL::BoundedQueue<TrajectoryBatch> input(capacity);
+  UTIL::BoundedQueue<ResultBatch> output(capacity);
+  // If ordered, the trajectories written, up to which the reader may run
+  // ahead by as many windows as the queues and the matchers hold, so that
+  // the results held for a slow trajectory are bounded
+  long written = 0;
+  std::mutex written_mutex;
+  std::condition_variable written_cv;
+  const std::size_t max_windows = 2 * PIPELINE_QUEUE_CHUNKS + 2;
+  std::thread reader_thread([&]() {
+    long sequence = 0;
+    std::vector<Trajectory> window;
+    std::vector<std::size_t> order;
+    // Ends of the windows read and not written yet, if ordered
+    std::deque<long> window_ends;
+    while (reader->has_next_trajectory()) {
+      if (options.ordered) {
+        std::unique_lock<std::mutex> lock(written_mutex);
+        written_cv.wait(lock, [&]() {
+          while (!window_ends.empty() && window_ends.front() <= written) {
+            window_ends.pop_front();
+          }
+          return window_ends.size() < max_windows;
+        });
+      }
+      // A window holds a chunk per matcher
+      window.clear();
+      long window_points = 0;
+      while (reader->has_next_trajectory() &&
+             !is_full(window.size(), window_points, num_matchers)) {
+        window.push_back(reader->read_next_trajectory());
+        window_points += window.back().geom.get_num_points();
+        // A stream does not wait for a full window, to bound the latency
+        if (!reader->is_ready()) break;
+      }
+      order.resize(window.size());
+      for (std::size_t k = 0; k < window.size(); ++k) order[k] = k;
+      if (options.spatial_order) {
+        order_by_hilbert_curve(window, &order);
+      } else {
+        std::stable_sort(order.begin(), order.end(),
+                         [&window](std::size_t a, std::size_t b) {
+                           return window[a].geom.get_num_points() >
+                               window[b].geom.get_num_points();
+                         });
+      }
+      // Chunks of the window with their points
+      std::vector<std::pair<long, TrajectoryBatch>> batches;
+      TrajectoryBatch batch;
+      long batch_points = 0;
+      for (std::size_t k = 0; k < window.size(); ++k) {
+        batch_points += window[order[k]].geom.get_num_points();
+        batch.trajectories.push_back(std::move(window[order[k]]));
+        batch.sequences.push_back(sequence + order[k]);
+        if (k + 1 == window.size() ||
+            is_full(batch.trajectories.size(), batch_points, 1)) {
+          batches.emplace_back(batch_points, std::move(batch));
+          batch = TrajectoryBatch();
+          batch_points = 0;
+        }
+      }
+      // The chunks along the curve are started largest first, as the
+      // trajectories sorted by length are
+      if (options.spatial_order) {
+        std::stable_sort(batches.begin(), batches.end(),
+                         [](const std::pair<long, TrajectoryBatch> &a,
+                            const std::pair<long, TrajectoryBatch> &b) {
+                           return a.first > b.first;
+                         });
+      }
+      bool closed = false;
+      for (std::size_t b = 0; b < batches.size() && !closed; ++b) {
+        closed = !input.push(std::move(batches[b].second));
+      }
+      if (closed) break;
+      sequence += window.size();
+      if (options.ordered) window_ends.push_back(sequence);
+    }
+    input.close();
+  });
+  MatchPipelineStatistics statistics;
+  statistics.busy_times.assign(num_matchers, 0);
+  statistics.matcher_points.assign(num_matchers, 0);
+  statistics.matcher_nodes.assign(num_matchers, 0);
+  // The last matcher finishing closes the output
+  std::atomic<int> running{num_matchers};
+  std::vector<std::thread> matchers;
+  for (int i = 0; i < num_matchers; ++i) {
+    matchers.emplace_back([&, i]() {
+      statistics.matcher_nodes[i] = UTIL::place_thread(options.placement, i);
+#ifdef _OPENMP
+      // OpenMP takes each matcher as an initial thread of its own, whose
+      // regions would start a full team each. The matchers already share
+      // the cores, so their regions run on the matcher alone.
+      omp_set_num_threads(1);
+#endif
+      // The largest block of the thread gives the capacity reserved
+      std::size_t reserved = 0;
+      std::string member;
+      TrajectoryBatch batch;
+      while (input.pop(&batch)) {
+        UTIL::TimePoint begin = std::chrono::steady_clock::now();
+        ResultBatch results;
+        results.sequences = std::move(batch.sequences);
+        results.ends.reserve(batch.trajectories.size());
+        results.block.reserve(reserved);
+        for (const Trajectory &trajectory : batch.trajectories) {
+          int num_points = trajectory.geom.get_num_points();
+          std::vector<SegmentMatchResult> segments;
+          if (options.cache == nullptr ||
+              !options.cache->look_up(trajectory, &segments)) {
+            segments = match(trajectory);
+            if (options.cache != nullptr) {
+              options.cache->insert(trajectory, segments);
+            }
+          }
+          UTIL::StageClock clock;
+          results.total_points += num_points;
+          results.points_matched += count_points_matched(segments,
+                                                         num_points);
+          if (csv_writer != nullptr) {
+            for (const SegmentMatchResult &segment : segments) {
+              csv_writer->format_result(segment, &results.block);
+            }
+            results.ends.push_back(results.block.size());
+            results.rows.push_back(segments.size());
+          } else {
+            results.segments.push_back(std::move(segments));
+          }
+          clock.lap(UTIL::STAGE_WRITE);
+          if (UTIL::StageProfile::is_enabled()) {
+            UTIL::StageProfile::local().finish_trajectory(trajectory.id);
+          }
+        }
+        // The compression of the block is counted in the next trajectory
+        UTIL::StageClock clock;
+        reserved = std::max(reserved, results.block.size());
+        // The blocks written unordered are compressed by the matchers
+        if (csv_writer != nullptr && csv_writer->compressed() &&
+            !options.ordered &&
+            ResultStream::compress_block(results.block.data(),
+                                         results.block.size(), &member)) {
+          results.block.swap(member);
+          results.compressed = true;
+        }
+        clock.lap(UTIL::STAGE_WRITE);
+        statistics.busy_times[i] += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - begin).count();
+        statistics.matcher_points[i] += results.total_points;
+        output.push(std::move(results));
+      }
+      if (--running == 0) output.close();
+    });
+  }
+  long next_report = step;
+  // Results matched ahead of the next trajectory written, if ordered,
+  // with the lines and their number for a csv writer
+  std::map<long, std::pair<std::string, int>> pending_lines;
+  std::map<long, std::vector<SegmentMatchResult>> pending_segments;
+  long next_sequence = 0;
+  std::string block;
+  ResultBatch results;
+  while (output.pop(&results)) {
+    // Only the total time of the writes is profiled in this thread
+    UTIL::StageClock clock;
+    if (csv_writer != nullptr && !options.ordered) {
+      int rows = 0;
+      for (int trajectory_rows : results.rows) rows += trajectory_rows;
+      if (results.compressed) {
+        csv_writer->write_compressed_block(results.block, rows);
+      } else {
+        csv_writer->write_block(results.block, rows);
+      }
+    } else if (csv_writer != nullptr) {
+      std::size_t begin = 0;
+      for (std::size_t k = 0; k < results.ends.size(); ++k) {
+        pending_lines.emplace(results.sequences[k], std::make_pair(
+            results.block.substr(begin, results.ends[k] - begin),
+            results.rows[k]));
+        begin = results.ends[k];
+      }
+      block.clear();
+      int rows = 0;
+      auto iter = pending_lines.begin();
+      while (iter != pending_lines.end() && iter->first == next_sequence) {
+        block += iter->second.first;
+        rows += iter->second.second;
+        iter = pending_lines.erase(iter);
+        ++next_sequence;
+      }
+      if (!block.empty()) csv_writer->write_block(block, rows);
+    } else if (!options.ordered) {
+      for (const std::vector<SegmentMatchResult> &segments :
+           results.segments) {
+        for (const SegmentMatchResult &segment : segments) {
+          writer->write_result(segment);
+        }
+      }
+    } else {
+      for (std::size_t k = 0; k < results.segments.size(); ++k) {
+        pending_segments.emplace(results.sequences[k],
+                                 std::move(results.segments[k]));
+      }
+      auto iter = pending_segments.begin();
+      while (iter != pending_segments.end() &&
+             iter->first == next_sequence) {
+        for (const SegmentMatchResult &segment : iter->second) {
+          writer->write_result(segment);
+        }
+        iter = pending_segments.erase(iter);
+        ++next_sequence;
+      }
+    }
+    if (options.checkpoint != nullptr && options.ordered) {
+      options.checkpoint->update(next_sequence);
+    }
+    if (options.ordered) {
+      {
+        std::lock_guard<std::mutex> lock(written_mutex);
+        written = next_sequence;
+      }
+      written_cv.notify_one();
+    }
+    clock.lap(UTIL::STAGE_WRITE);
+    if (UTIL::StageProfile::is_enabled()) UTIL::StageProfile::local().flush();
+    statistics.trajectories += results.sequences.size();
+    statistics.total_points += results.total_points;
+    statistics.points_matched += results.points_matched;
+    if (options.progress != nullptr) {
+      options.progress->trajectories += results.sequences.size();
+      options.progress->total_points += results.total_points;
+      options.progress->points_matched += results.points_matched;
+      options.progress->input_queued = input.size();
+      options.progress->output_queued = output.size();
+    }
+    for (; next_report <= statistics.trajectories; next_report += step) {
+      SPDLOG_INFO("Progress {}", next_report);
+    }
+  }
+  reader_thread.join();
+  for (std::thread &matcher : matchers) {
+    matcher.join();
+  }
+  statistics.elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time).count();
+  return statistics;
+}
+
+void IO::append_pipeline_metrics(MatchPipelineProgress *progress,
+                                 UTIL::MetricsText *text) {
+  long trajectories = progress->trajectories;
+  long total_points = progress->total_points;
+  text->counter("fmm_trajectories_total", "Trajectories matched",
+                trajectories);
+  text->counter("fmm_points_total", "Points of the trajectories matched",
+                total_points);
+  text->counter("fmm_points_matched_total",
+                "Points in a segment with a complete path",
+                progress->points_matched);
+  text->gauge("fmm_trajectories_per_second",
+              "Trajectories matched per second since the previous export",
+              progress->trajectory_rate.update(trajectories));
+  text->gauge("fmm_points_per_second",
+              "Points matched per second since the previous export",
+              progress->point_rate.update(total_points));
+  text->family("fmm_pipeline_queue_depth", "gauge",
+               "Chunks queued between the stages of the pipeline");
+  text->sample("fmm_pipeline_queue_depth", progress->input_queued,
+               "queue=\"input\"");
+  text->sample("fmm_pipeline_queue_depth", progress->output_queued,
+               "queue=\"output\"");
+}
+
+void IO::print_pipeline_statistics(
+    const MatchPipelineStatistics &statistics) {
+  if (statistics.busy_times.empty()) return;
+  double total = 0;
+  for (std::size_t i = 0; i < statistics.busy_times.size(); ++i) {
+    double busy = statistics.busy_times[i];
+    SPDLOG_INFO("Matcher {} busy time {} utilization {}", i, busy,
+                statistics.elapsed > 0 ? busy / statistics.elapsed : 0.0);
+    total += busy;
+  }
+  auto range = std::minmax_element(statistics.busy_times.begin(),
+                                   statistics.busy_times.end());
+  SPDLOG_INFO("Matcher busy time min {} max {} mean {}", *range.first,
+              *range.second, total / statistics.busy_times.size());
+  // The matchers are only spread over the nodes if they are placed
+  int num_nodes = 1 + *std::max_element(statistics.matcher_nodes.begin(),
+                                        statistics.matcher_nodes.end());
+  if (num_nodes < 2) return;
+  const std::vector<UTIL::NumaNode> &nodes = UTIL::get_numa_nodes();
+  for (int node = 0; node < num_nodes; ++node) {
+    int matchers = 0;
+    long points = 0;
+    double busy = 0;
+    for (std::size_t i = 0; i < statistics.matcher_nodes.size(); ++i) {
+      if (statistics.matcher_nodes[i] != node) continue;
+      ++matchers;
+      points += statistics.matcher_points[i];
+      busy += statistics.busy_times[i];
+    }
+    SPDLOG_INFO("NUMA node {} matchers {} points {} speed {} busy time {}",
+                nodes[node].index, matchers, points,
+                statistics.elapsed > 0 ? points / statistics.elapsed : 0.0,
+                busy);
+  }
+}
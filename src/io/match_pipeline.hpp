@@ -0,0 +1,205 @@
+/**
+ * Fast map matching.
+ *
+ * Pipeline reading, matching and writing trajectories in parallel
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_MATCH_PIPELINE_HPP
+#define FMM_IO_MATCH_PIPELINE_HPP
+
+#include "io/gps_reader.hpp"
+#include "io/match_checkpoint.hpp"
+#include "io/mm_writer.hpp"
+#include "io/result_cache.hpp"
+#include "mm/mm_type.hpp"
+#include "util/affinity.hpp"
+#include "util/metrics.hpp"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Function matching a trajectory into the segments written. A trajectory
+ * not split is returned as a single segment whose first and last points
+ * are -1.
+ */
+typedef std::function<std::vector<MM::SegmentMatchResult>(
+    const CORE::Trajectory &)> MatchFunction;
+
+/**
+ * Counters of the trajectories processed by a pipeline
+ */
+struct MatchPipelineStatistics {
+  long trajectories = 0; /**< Trajectories matched */
+  long total_points = 0; /**< Points of the trajectories */
+  long points_matched = 0; /**< Points in a segment matched */
+  double elapsed = 0; /**< Time of the pipeline, in seconds */
+  std::vector<double> busy_times; /**< Time spent matching by each
+                                       matcher, in seconds */
+  std::vector<long> matcher_points; /**< Points matched by each
+                                         matcher */
+  std::vector<int> matcher_nodes; /**< NUMA node of each matcher, as an
+                                       index of UTIL::get_numa_nodes */
+};
+
+/**
+ * Progress of a pipeline, updated while it runs so that it can be read
+ * by another thread, such as the one of a metrics exporter. The queue
+ * depths are sampled by the writer each time it takes a block.
+ */
+struct MatchPipelineProgress {
+  std::atomic<long> trajectories{0}; /**< Trajectories matched */
+  std::atomic<long> total_points{0}; /**< Points of the trajectories */
+  std::atomic<long> points_matched{0}; /**< Points in a segment matched */
+  std::atomic<long> input_queued{0}; /**< Chunks waiting for a matcher */
+  std::atomic<long> output_queued{0}; /**< Blocks waiting for the
+                                           writer */
+  UTIL::RateMeter trajectory_rate; /**< Rate of the trajectories, used by
+                                        the reading thread only */
+  UTIL::RateMeter point_rate; /**< Rate of the points, used by the
+                                   reading thread only */
+};
+
+/**
+ * Default number of trajectories in a chunk taken by a matcher
+ */
+const int PIPELINE_CHUNK_SIZE = 64;
+
+/**
+ * Number of chunks queued per matcher thread
+ */
+const int PIPELINE_QUEUE_CHUNKS = 4;
+
+/**
+ * Estimate of the memory per point of a trajectory in a pipeline, in
+ * bytes, which covers its coordinates, candidates, transition graph and
+ * the results formatted
+ */
+const long PIPELINE_BYTES_PER_POINT = 2048;
+
+/**
+ * Options of a match pipeline
+ */
+struct MatchPipelineOptions {
+  int num_matchers = 1; /**< Number of matcher threads */
+  int step = 100; /**< Number of trajectories between progress reports */
+  int chunk_size = PIPELINE_CHUNK_SIZE; /**< Number of trajectories in a
+                                             chunk */
+  long memory_budget = 0; /**< Memory of the trajectories held by the
+                               pipeline, in bytes, from which the points
+                               of a chunk are set instead of chunk_size,
+                               0 for none */
+  bool ordered = false; /**< If true, the results are written in the
+                             order of the trajectories read */
+  bool spatial_order = false; /**< If true, the chunks of a window are
+                                   cut along the Hilbert curve of the
+                                   centers of the trajectories */
+  MatchPipelineProgress *progress = nullptr; /**< Progress updated by the
+                                                  pipeline, if not null */
+  ResultCache *cache = nullptr; /**< Results reused for the duplicates of
+                                     a trajectory, if not null */
+  UTIL::ThreadPlacement placement = UTIL::PLACEMENT_NONE; /**< Placement
+      of the matcher threads on the cores and NUMA nodes */
+  MatchCheckpoint *checkpoint = nullptr; /**< Checkpoint updated with the
+      trajectories written, if not null, which is only used if the output
+      is ordered */
+};
+
+/**
+ * Get the number of points of a chunk from the memory budget of a
+ * pipeline
+ * @param  options options of the pipeline
+ * @return the number of points of a chunk, or 0 if there is no budget
+ */
+long get_chunk_points(const MatchPipelineOptions &options);
+
+/**
+ * Count the points matched by the segments of a trajectory
+ * @param  segments   segments returned by a match function
+ * @param  num_points number of points of the trajectory
+ * @return the number of points in a segment with a complete path
+ */
+int count_points_matched(const std::vector<MM::SegmentMatchResult> &segments,
+                         int num_points);
+
+/**
+ * Match all the trajectories of a reader and write their results.
+ *
+ * A reader thread reads a window of chunk_size trajectories per matcher,
+ * sorts it by the number of points, longest first, and queues it in
+ * chunks. With a memory budget, the chunks are cut by their number of
+ * points instead, where the points of a chunk are the budget divided
+ * by the chunks held at once in the window, the queues and the
+ * matchers, so that the memory used follows the budget whatever the
+ * length of the trajectories. With spatial order, the window is sorted
+ * along the Hilbert curve of the centers of the bounding boxes of the
+ * trajectories instead, so that the trajectories of a chunk share the
+ * edges, candidates and UBODT rows cached by their matcher, and the
+ * chunks are queued by their number of points, largest first. A pool of
+ * matcher threads takes the chunks as they become free and formats their
+ * results into a block of lines per chunk, and the calling thread writes
+ * the blocks, so that the file is written by a single thread with one
+ * call per chunk. As the long trajectories of a window are started
+ * first, a thread taking one late does not finish long after the
+ * others. The queues are bounded, which bounds the
+ * trajectories held in memory, and reading and writing overlap with the
+ * matching.
+ *
+ * With a placement, matcher i is placed as worker i of
+ * UTIL::place_thread, so that the match function can find the node of
+ * its thread by UTIL::get_thread_node.
+ *
+ * With a result cache, a trajectory whose duplicate has been matched
+ * reuses its results instead of being matched again.
+ *
+ * The results are written in the order they are matched, or in the
+ * order of the trajectories read if the output is ordered, where the
+ * lines matched ahead are held until the ones before them are written.
+ * The reader then stops while the windows read and not written exceed
+ * the ones the queues and the matchers hold, so that a slow trajectory
+ * does not let the lines held grow without bound.
+ * Only a csv writer has its lines formatted by the matchers; the results
+ * for other writers are passed to the calling thread, which writes them
+ * one segment at a time. If the csv output is compressed, the blocks
+ * written unordered are also compressed by the matchers, so that the
+ * compression runs in parallel.
+ *
+ * With a checkpoint and an ordered output, the checkpoint is updated
+ * with the trajectories written after each block.
+ *
+ * @param  reader  reader of the trajectories
+ * @param  writer  writer of the results
+ * @param  match   match function, called by the matcher threads
+ * @param  options options of the pipeline
+ * @return counters of the trajectories processed
+ */
+MatchPipelineStatistics run_match_pipeline(
+    GPSReader *reader, MatchResultWriter *writer,
+    const MatchFunction &match, const MatchPipelineOptions &options);
+
+/**
+ * Add the counters, rates and queue depths of a pipeline to metrics
+ * @param progress progress of the pipeline
+ * @param text     metrics updated
+ */
+void append_pipeline_metrics(MatchPipelineProgress *progress,
+                             UTIL::MetricsText *text);
+
+/**
+ * Log the time spent matching by each matcher of a pipeline, and the
+ * throughput of each NUMA node if the matchers are placed
+ * @param statistics counters of a pipeline
+ */
+void print_pipeline_statistics(const MatchPipelineStatistics &statistics);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_MATCH_PIPELINE_HPP
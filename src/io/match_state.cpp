@@ -0,0 +1,336 @@
+/**
+ * Fast map matching.
+ *
+ * Implementation of the match state file
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+#include "io/match_state.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+struct MatchStateFileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int flags;
+};
+const char STATE_MAGIC[8] = {'F', 'M', 'M', 'S', 'T', 'A', 'T', 'E'};
+const unsigned int STATE_VERSION = 1;
+// The first and last points of the segments were written
+const unsigned int STATE_FLAG_SEGMENT = 1;
+// The partial flags of the results were written
+const unsigned int STATE_FLAG_PARTIAL = 2;
+// Id, first, last, partial and the sizes of the candidates, cpath,
+// indices and timestamps
+const int RECORD_FIELDS = 8;
+const size_t RECORD_HEADER_SIZE = RECORD_FIELDS * sizeof(int);
+// Doubles stored for each candidate matched
+const int CANDIDATE_DOUBLES = 7;
+// Records decoded and formatted at once by a thread of the export
+const int EXPORT_BLOCK_RECORDS = 256;
+
+void append_bytes(const void *value, size_t bytes, std::string *buf) {
+  buf->append((const char *) value, bytes);
+}
+
+inline long long record_size(long long candidates, long long cpath,
+                             long long indices, long long timestamps) {
+  return RECORD_HEADER_SIZE +
+      (CANDIDATE_DOUBLES * candidates + timestamps) * sizeof(double) +
+      (candidates + cpath + indices) * sizeof(int);
+}
+
+} // namespace
+
+MatchStateWriter::MatchStateWriter(const std::string &state_file,
+                                   const CONFIG::OutputConfig &config,
+                                   bool append) :
+    state_file_(state_file) {
+  stream_ = fopen(state_file.c_str(), append ? "ab" : "wb");
+  if (stream_ == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", state_file);
+    std::exit(EXIT_FAILURE);
+  }
+  // An appended file keeps its header
+  if (ftell(stream_) > 0) return;
+  MatchStateFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STATE_MAGIC, sizeof(STATE_MAGIC));
+  header.version = STATE_VERSION;
+  header.flags = (config.write_segment ? STATE_FLAG_SEGMENT : 0) |
+      (config.write_partial ? STATE_FLAG_PARTIAL : 0);
+  success_ = fwrite(&header, sizeof(header), 1, stream_) == 1;
+}
+
+MatchStateWriter::~MatchStateWriter() {
+  if (fclose(stream_) != 0) success_ = false;
+  if (!success_) {
+    SPDLOG_CRITICAL("Failed to write match state file {}", state_file_);
+  } else {
+    SPDLOG_INFO("Write the state of {} results into {}", records_,
+                state_file_);
+  }
+}
+
+void MatchStateWriter::write_result(const MatchResult &result) {
+  write_record(result, -1, -1);
+}
+
+void MatchStateWriter::write_result(const SegmentMatchResult &segment) {
+  write_record(segment.result, segment.first, segment.last);
+}
+
+void MatchStateWriter::write_record(const MatchResult &result, int first,
+                                    int last) {
+  const MatchedCandidatePath &path = result.opt_candidate_path;
+  int fields[RECORD_FIELDS] = {
+      result.id, first, last, result.partial ? 1 : 0, (int) path.size(),
+      (int) result.cpath.size(), (int) result.indices.size(),
+      (int) result.timestamps.size()};
+  long long size = record_size(fields[4], fields[5], fields[6], fields[7]);
+  thread_local std::string record;
+  record.clear();
+  record.reserve(sizeof(size) + size);
+  append_bytes(&size, sizeof(size), &record);
+  append_bytes(fields, sizeof(fields), &record);
+  for (const MatchedCandidate &mc : path) {
+    double values[CANDIDATE_DOUBLES] = {
+        mc.c.offset, mc.c.dist, mc.ep, mc.tp, mc.sp_dist,
+        boost::geometry::get<0>(mc.c.point),
+        boost::geometry::get<1>(mc.c.point)};
+    append_bytes(values, sizeof(values), &record);
+  }
+  append_bytes(result.timestamps.data(),
+               result.timestamps.size() * sizeof(double), &record);
+  for (const MatchedCandidate &mc : path) {
+    int edge_id = mc.c.edge != nullptr ? mc.c.edge->id : -1;
+    append_bytes(&edge_id, sizeof(edge_id), &record);
+  }
+  append_bytes(result.cpath.data(), result.cpath.size() * sizeof(int),
+               &record);
+  append_bytes(result.indices.data(), result.indices.size() * sizeof(int),
+               &record);
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!success_) return;
+  success_ = fwrite(record.data(), 1, record.size(), stream_) ==
+      record.size();
+  ++records_;
+}
+
+MatchStateReader::MatchStateReader(const std::string &state_file) :
+    state_file_(state_file) {
+  SPDLOG_INFO("Read match state file {}", state_file);
+  int fd = open(state_file.c_str(), O_RDONLY);
+  struct stat file_stat;
+  if (fd < 0 || fstat(fd, &file_stat) != 0) {
+    SPDLOG_CRITICAL("Fail to open match state file {}", state_file);
+    std::exit(EXIT_FAILURE);
+  }
+  size_ = file_stat.st_size;
+  void *addr = nullptr;
+  if (size_ >= sizeof(MatchStateFileHeader)) {
+    addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Fail to map match state file {}", state_file);
+    std::exit(EXIT_FAILURE);
+  }
+  data_ = (unsigned char *) addr;
+  const MatchStateFileHeader *header = (const MatchStateFileHeader *) data_;
+  flags_ = header->flags;
+  bool valid = memcmp(header->magic, STATE_MAGIC,
+                      sizeof(STATE_MAGIC)) == 0 &&
+      header->version == STATE_VERSION;
+  size_t offset = sizeof(MatchStateFileHeader);
+  while (valid && offset < size_) {
+    long long size = -1;
+    int fields[RECORD_FIELDS] = {0};
+    if (offset + sizeof(size) + RECORD_HEADER_SIZE <= size_) {
+      memcpy(&size, data_ + offset, sizeof(size));
+      memcpy(fields, data_ + offset + sizeof(size), RECORD_HEADER_SIZE);
+    }
+    valid = fields[4] >= 0 && fields[5] >= 0 && fields[6] >= 0 &&
+        fields[7] >= 0 &&
+        size == record_size(fields[4], fields[5], fields[6], fields[7]) &&
+        size <= (long long) (size_ - offset - sizeof(size));
+    offset += sizeof(size);
+    offsets_.push_back(offset);
+    offset += size;
+  }
+  if (!valid) {
+    SPDLOG_CRITICAL("Invalid or incompatible match state file {}",
+                    state_file);
+    std::exit(EXIT_FAILURE);
+  }
+  SPDLOG_INFO("Match state records {} segments {} partial {}",
+              offsets_.size(), has_segments(), has_partial());
+}
+
+MatchStateReader::~MatchStateReader() {
+  if (data_ != nullptr) munmap(data_, size_);
+}
+
+long long MatchStateReader::get_num_records() const {
+  return offsets_.size();
+}
+
+bool MatchStateReader::has_segments() const {
+  return (flags_ & STATE_FLAG_SEGMENT) != 0;
+}
+
+bool MatchStateReader::has_partial() const {
+  return (flags_ & STATE_FLAG_PARTIAL) != 0;
+}
+
+bool MatchStateReader::read_record(long long k, const Network &network,
+                                   bool mgeom,
+                                   SegmentMatchResult *segment) const {
+  const unsigned char *cursor = data_ + offsets_[k];
+  int fields[RECORD_FIELDS];
+  memcpy(fields, cursor, RECORD_HEADER_SIZE);
+  cursor += RECORD_HEADER_SIZE;
+  int num_candidates = fields[4];
+  int num_cpath = fields[5];
+  int num_indices = fields[6];
+  int num_timestamps = fields[7];
+  std::vector<double> values(CANDIDATE_DOUBLES * num_candidates);
+  memcpy(values.data(), cursor, values.size() * sizeof(double));
+  cursor += values.size() * sizeof(double);
+  MatchResult &result = segment->result;
+  segment->first = fields[1];
+  segment->last = fields[2];
+  result.id = fields[0];
+  result.partial = fields[3] != 0;
+  result.timestamps.resize(num_timestamps);
+  memcpy(result.timestamps.data(), cursor, num_timestamps * sizeof(double));
+  cursor += num_timestamps * sizeof(double);
+  result.opath.resize(num_candidates);
+  memcpy(result.opath.data(), cursor, num_candidates * sizeof(int));
+  cursor += num_candidates * sizeof(int);
+  result.cpath.resize(num_cpath);
+  memcpy(result.cpath.data(), cursor, num_cpath * sizeof(int));
+  cursor += num_cpath * sizeof(int);
+  result.indices.resize(num_indices);
+  memcpy(result.indices.data(), cursor, num_indices * sizeof(int));
+  const std::vector<Edge> &edges = network.get_edges();
+  result.opt_candidate_path.resize(num_candidates);
+  std::vector<EdgeIndex> path(num_cpath);
+  try {
+    for (int i = 0; i < num_candidates; ++i) {
+      const double *value = &values[CANDIDATE_DOUBLES * i];
+      Edge *edge = const_cast<Edge *>(
+          &edges[network.get_edge_index(result.opath[i])]);
+      // The candidate index is only meaningful within a transition graph
+      result.opt_candidate_path[i] = MatchedCandidate{
+          Candidate{0, value[0], value[1], edge, Point(value[5], value[6])},
+          value[2], value[3], value[4]};
+    }
+    for (int i = 0; i < num_cpath; ++i) {
+      path[i] = network.get_edge_index(result.cpath[i]);
+    }
+  } catch (const std::out_of_range &) {
+    return false;
+  }
+  // The first and last candidates lie on the ends of the cpath
+  if (mgeom && num_candidates > 0) {
+    result.mgeom = network.complete_path_to_geometry(
+        path, result.opt_candidate_path.front().c.offset,
+        result.opt_candidate_path.back().c.offset);
+  } else {
+    result.mgeom = LineString();
+  }
+  return true;
+}
+
+long long FMM::IO::export_match_state(const MatchStateReader &reader,
+                                      const Network &network,
+                                      const CONFIG::ResultConfig &config,
+                                      bool use_omp) {
+  // The writer keeps a reference to the fields of the copy
+  CONFIG::ResultConfig export_config = config;
+  export_config.output_config.write_segment = reader.has_segments();
+  export_config.output_config.write_partial = reader.has_partial();
+  std::unique_ptr<MatchResultWriter> writer =
+      MatchResultWriter::create(export_config, false, &network);
+  if (writer == nullptr) return -1;
+  bool mgeom = get_result_fields(export_config).mgeom;
+  // Only the csv writer formats its lines in parallel
+  CSVMatchResultWriter *csv_writer =
+      dynamic_cast<CSVMatchResultWriter *>(writer.get());
+  int num_threads = use_omp ? omp_get_max_threads() : 1;
+  long long num_records = reader.get_num_records();
+  long long batch_records = (long long) EXPORT_BLOCK_RECORDS * num_threads;
+  std::vector<std::vector<SegmentMatchResult>> segments(num_threads);
+  std::vector<std::string> blocks(num_threads);
+  std::vector<int> rows(num_threads);
+  std::vector<char> compressed(num_threads);
+  long long written = 0;
+  long long missing = 0;
+  for (long long begin = 0; begin < num_records; begin += batch_records) {
+    #pragma omp parallel for num_threads(num_threads) reduction(+:missing)
+    for (int b = 0; b < num_threads; ++b) {
+      long long first = begin + (long long) b * EXPORT_BLOCK_RECORDS;
+      long long last = std::min(first + EXPORT_BLOCK_RECORDS, num_records);
+      std::vector<SegmentMatchResult> &block_segments = segments[b];
+      block_segments.clear();
+      blocks[b].clear();
+      rows[b] = 0;
+      compressed[b] = false;
+      for (long long k = first; k < last; ++k) {
+        block_segments.emplace_back();
+        if (!reader.read_record(k, network, mgeom, &block_segments.back())) {
+          block_segments.pop_back();
+          ++missing;
+          continue;
+        }
+        if (csv_writer == nullptr) continue;
+        csv_writer->format_result(block_segments.back(), &blocks[b]);
+        ++rows[b];
+      }
+      std::string member;
+      if (csv_writer != nullptr && csv_writer->compressed() &&
+          ResultStream::compress_block(blocks[b].data(), blocks[b].size(),
+                                       &member)) {
+        blocks[b].swap(member);
+        compressed[b] = true;
+      }
+    }
+    for (int b = 0; b < num_threads; ++b) {
+      if (csv_writer == nullptr) {
+        for (const SegmentMatchResult &segment : segments[b]) {
+          writer->write_result(segment);
+        }
+      } else if (rows[b] == 0) {
+        continue;
+      } else if (compressed[b]) {
+        csv_writer->write_compressed_block(blocks[b], rows[b]);
+      } else {
+        csv_writer->write_block(blocks[b], rows[b]);
+      }
+      written += segments[b].size();
+    }
+  }
+  if (missing > 0) {
+    SPDLOG_WARN("Skip {} results with edges not in the network", missing);
+  }
+  SPDLOG_INFO("Export {} results into {}", written, config.file);
+  return written;
+}
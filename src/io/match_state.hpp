@@ -0,0 +1,137 @@
+/**
+ * Fast map matching.
+ *
+ * Binary file of the match state of the trajectories, from which the
+ * output files are written again without matching
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_MATCH_STATE_HPP
+#define FMM_IO_MATCH_STATE_HPP
+
+#include "io/mm_writer.hpp"
+
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Writer of a binary match state file (state format).
+ *
+ * The file starts with the magic FMMSTATE, a 32-bit version and 32-bit
+ * flags telling if the segments and the partial flags were written. Each
+ * result follows as a record prefixed by its size in bytes, holding the
+ * id, the first and last point of the segment, the partial flag and the
+ * sizes of its arrays as 32-bit integers, then the offset, dist, ep, tp,
+ * sp_dist, x and y of the candidates matched and the timestamps as
+ * doubles, and finally the edge ids of the candidates, the cpath and the
+ * indices as 32-bit integers.
+ *
+ * The mgeom is not stored, it is rebuilt from the cpath and the offsets
+ * of the first and last candidates. The results can be written by
+ * multiple threads, a record is encoded without the lock.
+ */
+class MatchStateWriter : public MatchResultWriter {
+ public:
+  /**
+   * Create the file written, the program exits if it cannot be created
+   * @param state_file name of the file
+   * @param config     fields of the results, whose segment and partial
+   * flags are recorded in the header
+   * @param append     if true, the records are written after those of an
+   * existing file
+   */
+  MatchStateWriter(const std::string &state_file,
+                   const CONFIG::OutputConfig &config, bool append = false);
+  ~MatchStateWriter();
+  void write_result(const FMM::MM::MatchResult &result);
+  void write_result(const FMM::MM::SegmentMatchResult &segment);
+  MatchStateWriter(const MatchStateWriter &) = delete;
+  MatchStateWriter &operator=(const MatchStateWriter &) = delete;
+ private:
+  /**
+   * Encode and write the record of a result
+   */
+  void write_record(const FMM::MM::MatchResult &result, int first,
+                    int last);
+  std::string state_file_;
+  FILE *stream_ = nullptr;
+  std::mutex mutex_;
+  bool success_ = true;
+  long long records_ = 0;
+};
+
+/**
+ * Reader of a match state file written by MatchStateWriter.
+ *
+ * The file is mapped into memory and the offsets of its records are
+ * indexed when it is opened, so that the records can be decoded by
+ * multiple threads in any order.
+ */
+class MatchStateReader {
+ public:
+  /**
+   * Open a match state file, the program exits if it is invalid
+   * @param state_file name of the file
+   */
+  explicit MatchStateReader(const std::string &state_file);
+  ~MatchStateReader();
+  /**
+   * Get the number of records in the file
+   */
+  long long get_num_records() const;
+  /**
+   * Check if the segments of the trajectories were written
+   */
+  bool has_segments() const;
+  /**
+   * Check if the partial flags of the results were written
+   */
+  bool has_partial() const;
+  /**
+   * Decode a record into a match result
+   * @param  k       index of the record
+   * @param  network network the results were matched on
+   * @param  mgeom   rebuild the mgeom of the result if true
+   * @param  segment updated with the match result of the record
+   * @return false if an edge of the record is not in the network
+   */
+  bool read_record(long long k, const NETWORK::Network &network,
+                   bool mgeom, FMM::MM::SegmentMatchResult *segment) const;
+  MatchStateReader(const MatchStateReader &) = delete;
+  MatchStateReader &operator=(const MatchStateReader &) = delete;
+ private:
+  std::string state_file_;
+  unsigned char *data_ = nullptr; // Content of the file mapped
+  size_t size_ = 0;
+  unsigned int flags_ = 0;
+  std::vector<size_t> offsets_; // Offset of the content of each record
+};
+
+/**
+ * Write the results of a match state file in the format and fields of a
+ * result configuration. The records are decoded and formatted in
+ * parallel and written in their order.
+ * @param  reader  match state file
+ * @param  network network the results were matched on
+ * @param  config  result configuration, whose segment and partial flags
+ * are taken from the state file
+ * @param  use_omp decode the records with multiple threads if true
+ * @return number of results written, or -1 if the output cannot be
+ * created
+ */
+long long export_match_state(const MatchStateReader &reader,
+                             const NETWORK::Network &network,
+                             const CONFIG::ResultConfig &config,
+                             bool use_omp);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_MATCH_STATE_HPP
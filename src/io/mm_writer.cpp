@@ -8,24 +8,138 @@
  */
 
 #include "io/mm_writer.hpp"
+#include "io/csv_format.hpp"
+#include "io/arrow_writer.hpp"
+#include "io/edge_aggregate_writer.hpp"
+#include "io/edge_index.hpp"
+#include "io/match_state.hpp"
 #include "util/util.hpp"
 #include "util/debug.hpp"
 #include "config/result_config.hpp"
 
+#include <algorithm>
+#include <cstdio>
 #include <sstream>
 
 namespace FMM {
 
 namespace IO {
 
+FMM::MM::ResultFields get_result_fields(const CONFIG::OutputConfig &config) {
+  FMM::MM::ResultFields fields;
+  fields.candidates = config.write_opath || config.write_error ||
+      config.write_offset || config.write_spdist || config.write_pgeom ||
+      config.write_ep || config.write_tp || config.write_length;
+  fields.mgeom = config.write_mgeom;
+  return fields;
+}
+
+FMM::MM::ResultFields get_result_fields(const CONFIG::ResultConfig &config) {
+  FMM::MM::ResultFields fields = get_result_fields(config.output_config);
+  // The edges are aggregated from the candidates and the timestamps
+  if (config.format == "edges") {
+    fields.candidates = true;
+    fields.timestamps = true;
+  }
+  // The state keeps everything but the mgeom, which is rebuilt from it
+  if (config.format == "state") {
+    fields.candidates = true;
+    fields.timestamps = true;
+    fields.mgeom = false;
+  }
+  return fields;
+}
+
+std::unique_ptr<MatchResultWriter> MatchResultWriter::create(
+    const CONFIG::ResultConfig &config, bool append,
+    const NETWORK::Network *network) {
+  if (config.format == "csv") {
+    return std::unique_ptr<MatchResultWriter>(
+        new CSVMatchResultWriter(config.file, config.output_config,
+                                 config.shard_size, append,
+                                 config.async_write));
+  }
+#ifdef FMM_WITH_ARROW
+  if (config.format == "arrow") {
+    return std::unique_ptr<MatchResultWriter>(
+        new ArrowMatchResultWriter(config.file, config.output_config));
+  }
+#endif
+  if (config.format == "edges" && network != nullptr) {
+    return std::unique_ptr<MatchResultWriter>(
+        new EdgeAggregateWriter(config.file, *network));
+  }
+  if (config.format == "index" && network != nullptr) {
+    return std::unique_ptr<MatchResultWriter>(
+        new EdgeIndexWriter(config.file, *network));
+  }
+  if (config.format == "state") {
+    return std::unique_ptr<MatchResultWriter>(
+        new MatchStateWriter(config.file, config.output_config, append));
+  }
+  SPDLOG_CRITICAL("Output format {} not supported", config.format);
+  return nullptr;
+}
+
 CSVMatchResultWriter::CSVMatchResultWriter(
-    const std::string &result_file, const CONFIG::OutputConfig &config_arg) :
-    m_fstream(result_file), config_(config_arg) {
+    const std::string &result_file, const CONFIG::OutputConfig &config_arg,
+    int shard_size, bool append, bool async) :
+    result_file_(result_file), config_(config_arg),
+    compressed_(ResultStream::is_compressed(result_file)),
+    shard_size_(std::max(shard_size, 0)), async_(async) {
+  // The name is checked by the validation of the configuration
+  string2geometry_encoding(config_.geometry_encoding, &encoding_);
+  if (shard_size_ > 0) {
+    open_shard();
+  } else {
+    m_fstream.reset(new ResultStream(result_file, append, async_));
+    if (!append) write_header();
+  }
+}
+
+CSVMatchResultWriter::~CSVMatchResultWriter() {
+  if (shard_size_ <= 0) return;
+  m_fstream.reset();
+  std::string manifest_file = result_file_ + ".manifest";
+  std::ofstream ofs(manifest_file);
+  ofs << "file;rows\n";
+  for (const auto &shard : shards_) {
+    ofs << shard.first << ';' << shard.second << '\n';
+  }
+  SPDLOG_INFO("Write {} shards listed in {}", shards_.size(),
+              manifest_file);
+}
+
+std::string CSVMatchResultWriter::shard_file(const std::string &result_file,
+                                             int k) {
+  std::size_t name = result_file.find_last_of('/');
+  name = (name == std::string::npos) ? 0 : name + 1;
+  std::size_t extension = result_file.find('.', name + 1);
+  if (extension == std::string::npos) extension = result_file.size();
+  char number[16];
+  std::snprintf(number, sizeof(number), ".%05d", k);
+  return result_file.substr(0, extension) + number +
+      result_file.substr(extension);
+}
+
+void CSVMatchResultWriter::open_shard() {
+  // The shard is closed before the next one is opened
+  m_fstream.reset();
+  std::string file = shard_file(result_file_, shards_.size());
+  m_fstream.reset(new ResultStream(file, false, async_));
+  shards_.push_back(std::make_pair(file, 0L));
   write_header();
 }
 
+void CSVMatchResultWriter::reserve_rows(int rows) {
+  if (shard_size_ <= 0) return;
+  if (shards_.back().second >= shard_size_) open_shard();
+  shards_.back().second += rows;
+}
+
 void CSVMatchResultWriter::write_header() {
   std::string header = "id";
+  if (config_.write_segment) header += ";first;last";
   if (config_.write_opath) header += ";opath";
   if (config_.write_error) header += ";error";
   if (config_.write_offset) header += ";offset";
@@ -37,63 +151,126 @@ void CSVMatchResultWriter::write_header() {
   if (config_.write_ep) header += ";ep";
   if (config_.write_tp) header += ";tp";
   if (config_.write_length) header += ";length";
-  m_fstream << header << '\n';
+  if (config_.write_partial) header += ";partial";
+  header.push_back('\n');
+  m_fstream->write(header.data(), header.size());
 }
 
 void CSVMatchResultWriter::write_result(const FMM::MM::MatchResult &result) {
-  std::stringstream buf;
-  buf << result.id;
+  write_result(result, -1, -1);
+}
+
+void CSVMatchResultWriter::write_result(
+    const FMM::MM::SegmentMatchResult &segment) {
+  write_result(segment.result, segment.first, segment.last);
+}
+
+void CSVMatchResultWriter::format_result(
+    const FMM::MM::SegmentMatchResult &segment, std::string *buffer) const {
+  format_result(segment.result, segment.first, segment.last, buffer);
+}
+
+void CSVMatchResultWriter::write_block(const std::string &block, int rows) {
+  #pragma omp critical
+  {
+    reserve_rows(rows);
+    m_fstream->write(block.data(), block.size());
+  }
+}
+
+void CSVMatchResultWriter::write_compressed_block(const std::string &member,
+                                                  int rows) {
+  #pragma omp critical
+  {
+    reserve_rows(rows);
+    m_fstream->write_compressed(member);
+  }
+}
+
+void CSVMatchResultWriter::flush() {
+  #pragma omp critical
+  {
+    m_fstream->flush();
+  }
+}
+
+void CSVMatchResultWriter::write_result(const FMM::MM::MatchResult &result,
+                                        int first, int last) {
+  static thread_local std::string buffer;
+  buffer.clear();
+  format_result(result, first, last, &buffer);
+  write_block(buffer, 1);
+}
+
+namespace {
+
+// Append a field of the candidates of the optimal path separated by
+// commas
+template <typename Getter>
+void append_candidate_field(const FMM::MM::MatchedCandidatePath &path,
+                            int digits, Getter getter,
+                            std::string *buffer) {
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    if (i > 0) buffer->push_back(',');
+    append_double(getter(path[i]), digits, buffer);
+  }
+}
+
+} // namespace
+
+void CSVMatchResultWriter::format_result(const FMM::MM::MatchResult &result,
+                                         int first, int last,
+                                         std::string *buffer) const {
+  typedef FMM::MM::MatchedCandidate MC;
+  const FMM::MM::MatchedCandidatePath &path = result.opt_candidate_path;
+  append_int(result.id, buffer);
+  if (config_.write_segment) {
+    buffer->push_back(';');
+    if (first >= 0) {
+      append_int(first, buffer);
+      buffer->push_back(';');
+      append_int(last, buffer);
+    } else {
+      buffer->push_back(';');
+    }
+  }
   if (config_.write_opath) {
-    buf << ";" << result.opath;
+    buffer->push_back(';');
+    append_ints(result.opath, buffer);
   }
   if (config_.write_error) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].c.dist << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].c.dist;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, VALUE_DIGITS,
+                           [](const MC &mc) { return mc.c.dist; }, buffer);
   }
   if (config_.write_offset) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].c.offset << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].c.offset;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, VALUE_DIGITS,
+                           [](const MC &mc) { return mc.c.offset; },
+                           buffer);
   }
   if (config_.write_spdist) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].sp_dist << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].sp_dist;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, VALUE_DIGITS,
+                           [](const MC &mc) { return mc.sp_dist; }, buffer);
   }
   if (config_.write_pgeom) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
+    buffer->push_back(';');
+    if (!path.empty()) {
       FMM::CORE::LineString pline;
-      for (int i = 0; i < N; ++i) {
-        const FMM::CORE::Point &point = result.opt_candidate_path[i].c.point;
-        pline.add_point(point);
+      for (const MC &mc : path) {
+        pline.add_point(mc.c.point);
       }
-      buf << pline;
+      append_geometry(pline, encoding_, config_.precision, buffer);
     }
   }
   // Write fields related with cpath
   if (config_.write_cpath) {
-    buf << ";" << result.cpath;
+    buffer->push_back(';');
+    append_ints(result.cpath, buffer);
   }
   if (config_.write_tpath) {
-    buf << ";";
+    buffer->push_back(';');
     if (!result.cpath.empty()) {
       // Iterate through consecutive indexes and write the traversed path
       int J = result.indices.size();
@@ -101,57 +278,43 @@ void CSVMatchResultWriter::write_result(const FMM::MM::MatchResult &result) {
         int a = result.indices[j];
         int b = result.indices[j + 1];
         for (int i = a; i < b; ++i) {
-          buf << result.cpath[i];
-          buf << ",";
+          append_int(result.cpath[i], buffer);
+          buffer->push_back(',');
         }
-        buf << result.cpath[b];
+        append_int(result.cpath[b], buffer);
         if (j < J - 2) {
           // Last element should not have a bar
-          buf << "|";
+          buffer->push_back('|');
         }
       }
     }
   }
   if (config_.write_mgeom) {
-    buf << ";" << result.mgeom;
+    buffer->push_back(';');
+    append_geometry(result.mgeom, encoding_, config_.precision, buffer);
   }
+  // The probabilities and lengths keep the digits of the coordinates
   if (config_.write_ep) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].ep << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].ep;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, COORDINATE_DIGITS,
+                           [](const MC &mc) { return mc.ep; }, buffer);
   }
   if (config_.write_tp) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      for (int i = 0; i < N - 1; ++i) {
-        buf << result.opt_candidate_path[i].tp << ",";
-      }
-      buf << result.opt_candidate_path[N - 1].tp;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, COORDINATE_DIGITS,
+                           [](const MC &mc) { return mc.tp; }, buffer);
   }
   if (config_.write_length) {
-    buf << ";";
-    if (!result.opt_candidate_path.empty()) {
-      int N = result.opt_candidate_path.size();
-      SPDLOG_TRACE("Write length {}",N);
-      for (int i = 0; i < N - 1; ++i) {
-        // SPDLOG_TRACE("Write length {}",i);
-        buf << result.opt_candidate_path[i].c.edge->length << ",";
-      }
-      // SPDLOG_TRACE("Write length {}",N-1);
-      buf << result.opt_candidate_path[N - 1].c.edge->length;
-    }
+    buffer->push_back(';');
+    append_candidate_field(path, COORDINATE_DIGITS,
+                           [](const MC &mc) { return mc.c.edge->length; },
+                           buffer);
   }
-  buf << '\n';
-  // Ensure that fstream is called corrected in OpenMP
-  #pragma omp critical
-  m_fstream << buf.rdbuf();
+  if (config_.write_partial) {
+    buffer->push_back(';');
+    append_int(result.partial ? 1 : 0, buffer);
+  }
+  buffer->push_back('\n');
 }
 
 } //IO
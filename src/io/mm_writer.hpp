@@ -17,9 +17,12 @@
 #include "util/debug.hpp"
 #include "network/network.hpp"
 #include "config/result_config.hpp"
+#include "io/result_stream.hpp"
+#include "io/csv_format.hpp"
 
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <omp.h>
 
 namespace FMM {
@@ -31,15 +34,63 @@ namespace IO {
  */
 class MatchResultWriter {
  public:
+  virtual ~MatchResultWriter() = default;
   /**
    * Write the match result to a file
    * @param result the match result of a trajectory
    */
   virtual void write_result(const FMM::MM::MatchResult &result) = 0;
+  /**
+   * Write the match result of a segment of a trajectory, where a segment
+   * whose first point is negative is a whole trajectory
+   * @param segment the match result of a segment
+   */
+  virtual void write_result(const FMM::MM::SegmentMatchResult &segment) = 0;
+  /**
+   * Write the results buffered and close the file, which is otherwise
+   * done when the writer is destroyed
+   * @return false if the results cannot be written
+   */
+  virtual bool close() { return true; }
+  /**
+   * Create the writer of the file and format of a result configuration
+   * @param  config result configuration, which should outlive the writer
+   * @param  append if true, a csv file is appended to without a header
+   * line, as when a job is resumed
+   * @param  network network of the results, needed by the edges format
+   * @return the writer, nullptr if the format is not supported
+   */
+  static std::unique_ptr<MatchResultWriter> create(
+      const CONFIG::ResultConfig &config, bool append = false,
+      const NETWORK::Network *network = nullptr);
 };
 
+/**
+ * Get the fields of the match results needed by the fields written, so
+ * that the matching algorithms skip the others
+ * @param  config the fields that will be exported
+ * @return fields of the match results built
+ */
+FMM::MM::ResultFields get_result_fields(const CONFIG::OutputConfig &config);
+
+/**
+ * Get the fields of the match results needed by the fields and the
+ * format written
+ * @param  config result configuration
+ * @return fields of the match results built
+ */
+FMM::MM::ResultFields get_result_fields(const CONFIG::ResultConfig &config);
+
 /**
  * A writer class for writing matche result to a CSV file.
+ *
+ * The file is compressed with gzip if its name ends with .gz. If a shard
+ * size is given, the rows are written into a sequence of shard files
+ * named after the result file, such as result.00000.csv.gz for
+ * result.csv.gz, each with a header line, and a manifest listing the
+ * shards and their rows is written to the result file name followed by
+ * .manifest when the writer is destroyed. A shard is closed at the first
+ * block written after it holds shard_size rows.
  */
 class CSVMatchResultWriter : public MatchResultWriter {
  public:
@@ -51,10 +102,22 @@ class CSVMatchResultWriter : public MatchResultWriter {
    *
    * @param result_file the filename to write result
    * @param config_arg the fields that will be exported
+   * @param shard_size rows written into each shard, or 0 to write a
+   * single file
+   * @param append if true, the rows are written after the content of a
+   * single file, which is not given a header line
+   * @param async if true, the files are written by a thread of their
+   * own while the rows are formatted
    *
    */
   CSVMatchResultWriter(const std::string &result_file,
-                       const CONFIG::OutputConfig &config_arg);
+                       const CONFIG::OutputConfig &config_arg,
+                       int shard_size = 0, bool append = false,
+                       bool async = false);
+  /**
+   * Write the manifest of the shards
+   */
+  ~CSVMatchResultWriter();
   /**
    * Write a header line for the fields exported
    */
@@ -64,9 +127,77 @@ class CSVMatchResultWriter : public MatchResultWriter {
    * @param result A map match result
    */
   void write_result(const FMM::MM::MatchResult &result);
+  /**
+   * Write match result of a segment of a trajectory
+   * @param segment A map match result of a segment
+   */
+  void write_result(const FMM::MM::SegmentMatchResult &segment);
+  /**
+   * Format the line written for a segment without writing it, which can
+   * be called by multiple threads. A segment whose first point is
+   * negative is formatted as the result of a whole trajectory.
+   * @param segment A map match result of a segment
+   * @param buffer  Buffer the line is appended to
+   */
+  void format_result(const FMM::MM::SegmentMatchResult &segment,
+                     std::string *buffer) const;
+  /**
+   * Write a block of lines formatted
+   * @param block lines formatted by format_result
+   * @param rows  number of lines of the block
+   */
+  void write_block(const std::string &block, int rows);
+  /**
+   * Write a block of lines compressed by ResultStream::compress_block,
+   * which should only be called if the output is compressed
+   * @param member lines formatted and compressed
+   * @param rows   number of lines of the block
+   */
+  void write_compressed_block(const std::string &member, int rows);
+  /**
+   * Write the rows buffered into the file, so that the file holds all
+   * the rows written before
+   */
+  void flush();
+  /**
+   * Check if the output is compressed
+   */
+  bool compressed() const { return compressed_; }
+  /**
+   * Name of the k-th shard of a result file, where the shard number is
+   * inserted before the extensions of the file name
+   */
+  static std::string shard_file(const std::string &result_file, int k);
  private:
-  std::ofstream m_fstream;
+  /**
+   * Write match result, whose segment fields are empty if first is
+   * negative
+   */
+  void write_result(const FMM::MM::MatchResult &result, int first, int last);
+  /**
+   * Format the line of a match result, whose segment fields are empty if
+   * first is negative
+   */
+  void format_result(const FMM::MM::MatchResult &result, int first,
+                     int last, std::string *buffer) const;
+  /**
+   * Open the next shard if the current one is full, and count the rows
+   * of a block written into it
+   */
+  void reserve_rows(int rows);
+  /**
+   * Close the current shard and open the next one with its header
+   */
+  void open_shard();
+  std::string result_file_;
+  std::unique_ptr<ResultStream> m_fstream;
   const CONFIG::OutputConfig &config_;
+  bool compressed_;
+  int shard_size_;
+  bool async_;
+  GeometryEncoding encoding_ = WKT_ENCODING; // Of the mgeom and pgeom
+  std::vector<std::pair<std::string, long>> shards_; /**< file and rows of
+                                                          each shard */
 }; // CSVMatchResultWriter
 
 };     //IO
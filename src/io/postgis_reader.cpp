@@ -0,0 +1,358 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#ifdef FMM_WITH_POSTGIS
+
+#include "io/postgis_reader.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::IO;
+
+namespace {
+
+// Read an integer of a binary COPY, which is in network byte order
+template <typename T>
+bool read_big_endian(const char **p, const char *end, T *value) {
+  if (end - *p < (std::ptrdiff_t) sizeof(T)) return false;
+  uint64_t bits = 0;
+  for (std::size_t i = 0; i < sizeof(T); ++i) {
+    bits = bits << 8 | (unsigned char) (*p)[i];
+  }
+  *value = (T) bits;
+  *p += sizeof(T);
+  return true;
+}
+
+bool read_float8(const char **p, const char *end, double *value) {
+  uint64_t bits;
+  if (!read_big_endian(p, end, &bits)) return false;
+  std::memcpy(value, &bits, sizeof(double));
+  return true;
+}
+
+// Skip the header of a binary COPY
+bool skip_header(const char **p, const char *end) {
+  static const char signature[] = "PGCOPY\n\377\r\n";
+  int32_t flags, extension;
+  if (end - *p < 11 || std::memcmp(*p, signature, 11) != 0) return false;
+  *p += 11;
+  if (!read_big_endian(p, end, &flags) ||
+      !read_big_endian(p, end, &extension) || extension < 0 ||
+      end - *p < extension) {
+    return false;
+  }
+  *p += extension;
+  return true;
+}
+
+// Parse the binary array of a float8[] field, whose null elements are NaN
+bool parse_float8_array(const char *p, const char *end,
+                        std::vector<double> *values) {
+  int32_t ndim, has_null, size, lower_bound;
+  uint32_t element_type;
+  if (!read_big_endian(&p, end, &ndim) ||
+      !read_big_endian(&p, end, &has_null) ||
+      !read_big_endian(&p, end, &element_type)) {
+    return false;
+  }
+  values->clear();
+  if (ndim == 0) return true;
+  if (ndim != 1 || !read_big_endian(&p, end, &size) ||
+      !read_big_endian(&p, end, &lower_bound) || size < 0) {
+    return false;
+  }
+  values->reserve(size);
+  for (int32_t i = 0; i < size; ++i) {
+    int32_t length;
+    double value = std::numeric_limits<double>::quiet_NaN();
+    if (!read_big_endian(&p, end, &length)) return false;
+    if (length >= 0 && (length != 8 || !read_float8(&p, end, &value))) {
+      return false;
+    }
+    values->push_back(value);
+  }
+  return true;
+}
+
+// Parse a tuple of id, WKB and optionally timestamps
+// @return 1 for a trajectory, 0 for the trailer and -1 for a tuple
+// which is malformed or holds a null or a geometry not supported
+int parse_tuple(const char **p, const char *end, bool timestamp,
+                Trajectory *traj) {
+  int16_t num_fields;
+  if (!read_big_endian(p, end, &num_fields)) return -1;
+  if (num_fields == -1) return 0;
+  if (num_fields != (timestamp ? 3 : 2)) return -1;
+  const char *fields[3];
+  int32_t lengths[3];
+  for (int f = 0; f < num_fields; ++f) {
+    if (!read_big_endian(p, end, &lengths[f])) return -1;
+    fields[f] = *p;
+    if (lengths[f] > 0) {
+      if (end - *p < lengths[f]) return -1;
+      *p += lengths[f];
+    }
+  }
+  int64_t id;
+  const char *id_field = fields[0];
+  if (lengths[0] != 8 || lengths[1] < 0 ||
+      !read_big_endian(&id_field, id_field + 8, &id)) {
+    return -1;
+  }
+  traj->id = id;
+  if (!parse_wkb_linestring((const unsigned char *) fields[1], lengths[1],
+                            &traj->geom)) {
+    return -1;
+  }
+  traj->timestamps.clear();
+  if (timestamp && lengths[2] >= 0 &&
+      !parse_float8_array(fields[2], fields[2] + lengths[2],
+                          &traj->timestamps)) {
+    return -1;
+  }
+  return 1;
+}
+
+std::string quote(const std::string &name) {
+  return "\"" + name + "\"";
+}
+
+PGconn *connect(const std::string &conninfo) {
+  PGconn *connection = PQconnectdb(conninfo.c_str());
+  if (PQstatus(connection) != CONNECTION_OK) {
+    SPDLOG_CRITICAL("Fail to connect to PostgreSQL: {}",
+                    PQerrorMessage(connection));
+    PQfinish(connection);
+    std::exit(EXIT_FAILURE);
+  }
+  return connection;
+}
+
+PGresult *execute(PGconn *connection, const std::string &sql) {
+  PGresult *result = PQexec(connection, sql.c_str());
+  if (PQresultStatus(result) != PGRES_TUPLES_OK) {
+    SPDLOG_CRITICAL("Fail to query {}: {}", sql,
+                    PQerrorMessage(connection));
+    PQclear(result);
+    PQfinish(connection);
+    std::exit(EXIT_FAILURE);
+  }
+  return result;
+}
+
+} // namespace
+
+PostGISTrajectoryReader::PostGISTrajectoryReader(
+    const std::string &source, const std::string &id_name,
+    const std::string &geom_name, const std::string &timestamp_name,
+    int num_threads, long block_trajectories) :
+    max_blocks(2L * std::max(num_threads, 1)) {
+  // The table is taken out of the connection string, which libpq rejects
+  std::istringstream tokens(source.substr(3));
+  std::string token, conninfo;
+  while (tokens >> token) {
+    if (token.compare(0, 6, "table=") == 0) {
+      table = token.substr(6);
+    } else {
+      conninfo += token + " ";
+    }
+  }
+  if (table.empty()) {
+    SPDLOG_CRITICAL("Table not given in PostGIS source {}", source);
+    std::exit(EXIT_FAILURE);
+  }
+  SPDLOG_INFO("Read trajectory from PostGIS table {}", table);
+  PGconn *connection = connect(conninfo);
+  PGresult *result = execute(connection,
+                             "SELECT * FROM " + table + " LIMIT 0");
+  if (PQfnumber(result, quote(id_name).c_str()) < 0) {
+    SPDLOG_CRITICAL("Id column {} not found", id_name);
+    std::exit(EXIT_FAILURE);
+  }
+  if (PQfnumber(result, quote(geom_name).c_str()) < 0) {
+    SPDLOG_CRITICAL("Geometry column {} not found", geom_name);
+    std::exit(EXIT_FAILURE);
+  }
+  timestamp_found = PQfnumber(result, quote(timestamp_name).c_str()) >= 0;
+  if (!timestamp_found) {
+    SPDLOG_DEBUG("Timestamp column {} not found", timestamp_name);
+  }
+  PQclear(result);
+  id_column = quote(id_name);
+  // The geometries are forced into 2D linestrings of WKB
+  select_list = id_column + "::int8, ST_AsBinary(ST_Force2D(" +
+      quote(geom_name) + "))";
+  if (timestamp_found) {
+    select_list += ", " + quote(timestamp_name) + "::float8[]";
+  }
+  // The width of a block is set from the number of trajectories, so that
+  // the sparse ids are spread over a few blocks only
+  result = execute(connection, "SELECT min(" + id_column + ")::int8, max(" +
+      id_column + ")::int8, count(*) FROM " + table);
+  long long count = std::atoll(PQgetvalue(result, 0, 2));
+  if (count > 0) {
+    next_begin = std::atoll(PQgetvalue(result, 0, 0));
+    range_end = std::atoll(PQgetvalue(result, 0, 1)) + 1;
+    long long num_blocks =
+        (count + std::max(block_trajectories, 1L) - 1) /
+        std::max(block_trajectories, 1L);
+    block_ids = std::max(1LL, (range_end - next_begin + num_blocks - 1) /
+        num_blocks);
+  }
+  PQclear(result);
+  PQfinish(connection);
+  SPDLOG_INFO("Read {} trajectories with connections {} block ids {}",
+              count, std::max(num_threads, 1), block_ids);
+  // The connections are opened before the threads, so that a failure
+  // stops the reader at once
+  std::vector<PGconn *> connections;
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    connections.push_back(connect(conninfo));
+  }
+  for (PGconn *thread_connection : connections) {
+    threads.emplace_back(&PostGISTrajectoryReader::read_blocks, this,
+                         thread_connection);
+  }
+}
+
+PostGISTrajectoryReader::~PostGISTrajectoryReader() {
+  close();
+}
+
+void PostGISTrajectoryReader::read_blocks(PGconn *connection) {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    cv.wait(lock, [&]() {
+      return stopped || next_begin >= range_end ||
+          issued - consumed < max_blocks;
+    });
+    if (stopped || next_begin >= range_end) break;
+    long long begin = next_begin;
+    long long end = range_end - begin > block_ids ?
+                    begin + block_ids : range_end;
+    next_begin = end;
+    long index = issued++;
+    blocks[index];
+    lock.unlock();
+    std::vector<Trajectory> trajectories;
+    read_block(connection, begin, end, &trajectories);
+    lock.lock();
+    Block &block = blocks[index];
+    block.trajectories = std::move(trajectories);
+    block.done = true;
+    cv.notify_all();
+  }
+  lock.unlock();
+  PQfinish(connection);
+}
+
+void PostGISTrajectoryReader::read_block(
+    PGconn *connection, long long begin, long long end,
+    std::vector<Trajectory> *trajectories) const {
+  std::string sql = "COPY (SELECT " + select_list + " FROM " + table +
+      " WHERE " + id_column + " >= " + std::to_string(begin) + " AND " +
+      id_column + " < " + std::to_string(end) + " ORDER BY " + id_column +
+      ") TO STDOUT (FORMAT binary)";
+  PGresult *result = PQexec(connection, sql.c_str());
+  bool started = PQresultStatus(result) == PGRES_COPY_OUT;
+  PQclear(result);
+  if (!started) {
+    SPDLOG_ERROR("Fail to copy ids {} to {}: {}", begin, end,
+                 PQerrorMessage(connection));
+    return;
+  }
+  long skipped = 0;
+  bool header = true;
+  char *buffer = nullptr;
+  int size;
+  // Each message holds a row, the first one preceded by the header
+  while ((size = PQgetCopyData(connection, &buffer, 0)) > 0) {
+    const char *p = buffer;
+    const char *message_end = buffer + size;
+    if (header && !skip_header(&p, message_end)) {
+      SPDLOG_ERROR("Invalid header of the copy of ids {} to {}", begin, end);
+      PQfreemem(buffer);
+      break;
+    }
+    header = false;
+    while (p < message_end) {
+      Trajectory traj{0, LineString(), {}};
+      int parsed = parse_tuple(&p, message_end, timestamp_found, &traj);
+      if (parsed == 1) {
+        trajectories->push_back(std::move(traj));
+      } else if (parsed < 0) {
+        // The rest of a malformed message is not parsed
+        ++skipped;
+        break;
+      } else {
+        break;
+      }
+    }
+    PQfreemem(buffer);
+  }
+  if (size == -2) {
+    SPDLOG_ERROR("Fail to copy ids {} to {}: {}", begin, end,
+                 PQerrorMessage(connection));
+  }
+  // The copy is finished by reading its result
+  while ((result = PQgetResult(connection)) != nullptr) {
+    PQclear(result);
+  }
+  if (skipped > 0) {
+    SPDLOG_WARN("Skip {} rows of ids {} to {} with a null or a geometry "
+                "not a linestring", skipped, begin, end);
+  }
+}
+
+bool PostGISTrajectoryReader::has_next_trajectory() {
+  while (position >= current.size()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() {
+      auto iter = blocks.find(consumed);
+      return stopped || (iter != blocks.end() && iter->second.done) ||
+          (consumed == issued && next_begin >= range_end);
+    });
+    auto iter = blocks.find(consumed);
+    if (iter == blocks.end() || !iter->second.done) return false;
+    current = std::move(iter->second.trajectories);
+    position = 0;
+    blocks.erase(iter);
+    ++consumed;
+    cv.notify_all();
+  }
+  return true;
+}
+
+Trajectory PostGISTrajectoryReader::read_next_trajectory() {
+  if (!has_next_trajectory()) {
+    return Trajectory{-1, FMM::CORE::LineString(), {}};
+  }
+  return std::move(current[position++]);
+}
+
+bool PostGISTrajectoryReader::has_timestamp() {
+  return timestamp_found;
+}
+
+void PostGISTrajectoryReader::close() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopped) return;
+    stopped = true;
+  }
+  cv.notify_all();
+  for (std::thread &thread : threads) thread.join();
+  threads.clear();
+}
+
+#endif // FMM_WITH_POSTGIS
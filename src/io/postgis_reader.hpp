@@ -0,0 +1,127 @@
+/**
+ * Fast map matching.
+ *
+ * Reader of the trajectories of a PostGIS table, which is only built if
+ * fmm is configured with WITH_POSTGIS.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_POSTGIS_READER_HPP
+#define FMM_IO_POSTGIS_READER_HPP
+
+#ifdef FMM_WITH_POSTGIS
+
+#include "io/gps_reader.hpp"
+
+#include <libpq-fe.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Trajectory Reader class for a PostGIS table, with a row per trajectory
+ * of a numeric id, a linestring geometry and optionally an array of
+ * timestamps.
+ *
+ * The source is given as a libpq connection string prefixed with PG: and
+ * holding the table, such as
+ *
+ *     PG:host=localhost dbname=gps table=public.traces
+ *
+ * The table is split into blocks of consecutive ids, which are read by
+ * several threads, each with its own connection. A block is transferred
+ * with a binary COPY, whose WKB geometries and float8 arrays are decoded
+ * directly into the trajectories, without any text conversion. As for
+ * the ParallelGDALReader, the threads read the blocks ahead of the one
+ * returned, holding at most two blocks per thread, and the trajectories
+ * are returned in the order of their ids.
+ */
+class PostGISTrajectoryReader : public ITrajectoryReader {
+ public:
+  /**
+   * Default number of trajectories of a block, on average
+   */
+  static const long DEFAULT_BLOCK_TRAJECTORIES = 4096;
+  /**
+   * Open the connections to the database
+   * @param source             PG: followed by the connection string and
+   * the table
+   * @param id_name            id column name
+   * @param geom_name          geometry column name
+   * @param timestamp_name     timestamp column name. If the column is not
+   * found, an empty timestamp vector will be returned for every trajectory.
+   * @param num_threads        number of connections reading the blocks
+   * @param block_trajectories number of trajectories of a block, on
+   * average
+   */
+  PostGISTrajectoryReader(const std::string &source,
+                          const std::string &id_name,
+                          const std::string &geom_name,
+                          const std::string &timestamp_name,
+                          int num_threads,
+                          long block_trajectories =
+                              DEFAULT_BLOCK_TRAJECTORIES);
+  ~PostGISTrajectoryReader();
+  FMM::CORE::Trajectory read_next_trajectory() override;
+  bool has_next_trajectory() override;
+  bool has_timestamp() override;
+  /**
+   * Stop the threads and close the connections
+   */
+  void close() override;
+ private:
+  /**
+   * Block of trajectories read by a thread
+   */
+  struct Block {
+    std::vector<FMM::CORE::Trajectory> trajectories;
+    bool done = false;
+  };
+  /**
+   * Read the next blocks with a connection until all of them are taken
+   * or it is stopped
+   */
+  void read_blocks(PGconn *connection);
+  /**
+   * Copy the rows of a block
+   * @param connection   connection of the thread
+   * @param begin        first id of the block
+   * @param end          end of the ids of the block, excluded
+   * @param trajectories updated with the trajectories of the block
+   */
+  void read_block(PGconn *connection, long long begin, long long end,
+                  std::vector<FMM::CORE::Trajectory> *trajectories) const;
+  std::string table;
+  std::string id_column; // Quoted names of the columns
+  std::string select_list; // Columns of the rows copied
+  bool timestamp_found = false;
+  long long block_ids = 1; // Width of the id range of a block
+  long max_blocks; // Blocks issued and not read
+  long long range_end = 0; // End of the ids
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable cv;
+  long long next_begin = 0; // Start of the next block issued
+  long issued = 0;
+  long consumed = 0;
+  bool stopped = false;
+  std::map<long, Block> blocks; // Blocks issued and not read, by index
+  std::vector<FMM::CORE::Trajectory> current; // Trajectories being read
+  std::size_t position = 0;
+}; // PostGISTrajectoryReader
+
+} // IO
+} // FMM
+
+#endif // FMM_WITH_POSTGIS
+
+#endif // FMM_IO_POSTGIS_READER_HPP
@@ -0,0 +1,201 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/rematch_filter.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_map>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::IO;
+
+namespace {
+
+// Split a line of a csv result file into its fields
+std::vector<std::string> split_fields(const std::string &line) {
+  std::vector<std::string> fields;
+  std::size_t begin = 0;
+  while (true) {
+    std::size_t end = line.find(';', begin);
+    if (end == std::string::npos) {
+      fields.push_back(line.substr(begin));
+      return fields;
+    }
+    fields.push_back(line.substr(begin, end - begin));
+    begin = end + 1;
+  }
+}
+
+// Id of the trajectory of a row, which is its first field
+inline int get_row_id(const std::string &line) {
+  return std::atoi(line.c_str());
+}
+
+// Box grown by a margin
+BoostBox grow_box(double x1, double y1, double x2, double y2,
+                  double margin) {
+  return BoostBox(Point(x1 - margin, y1 - margin),
+                  Point(x2 + margin, y2 + margin));
+}
+
+} // namespace
+
+RematchFilter::RematchFilter(const Network &network,
+                             const std::vector<EdgeID> &changed_edges,
+                             const std::vector<BoostBox> &areas,
+                             double margin) :
+    changed_edges_(changed_edges.begin(), changed_edges.end()) {
+  std::vector<BoostBox> boxes;
+  for (const BoostBox &area : areas) {
+    boxes.push_back(grow_box(area.min_corner().get<0>(),
+                             area.min_corner().get<1>(),
+                             area.max_corner().get<0>(),
+                             area.max_corner().get<1>(), margin));
+  }
+  // The edges removed from the network are only found in the paths
+  for (const Edge &edge : network.get_edges()) {
+    if (changed_edges_.find(edge.id) == changed_edges_.end()) continue;
+    double x1, y1, x2, y2;
+    ALGORITHM::boundingbox_geometry(network.get_edge_view(edge.index),
+                                    &x1, &y1, &x2, &y2);
+    boxes.push_back(grow_box(x1, y1, x2, y2, margin));
+  }
+  areas_ = AreaRtree(boxes.begin(), boxes.end());
+  SPDLOG_INFO("Rematch filter with {} changed edges and {} areas",
+              changed_edges_.size(), boxes.size());
+}
+
+bool RematchFilter::read_previous(const std::string &result_file) {
+  std::ifstream ifs(result_file);
+  std::string line;
+  if (!ifs || !std::getline(ifs, line)) {
+    SPDLOG_CRITICAL("Cannot read previous result file {}", result_file);
+    return false;
+  }
+  std::vector<std::string> header = split_fields(line);
+  int cpath_idx = -1;
+  for (std::size_t i = 0; i < header.size(); ++i) {
+    if (header[i] == "cpath") cpath_idx = i;
+  }
+  if (cpath_idx < 0) {
+    SPDLOG_WARN("No cpath in {}, only the areas changed are checked",
+                result_file);
+  }
+  while (std::getline(ifs, line)) {
+    int id = get_row_id(line);
+    previous_.insert(id);
+    if (cpath_idx < 0 || changed_edges_.empty()) continue;
+    std::vector<std::string> fields = split_fields(line);
+    if (cpath_idx >= (int) fields.size()) continue;
+    for (EdgeID edge : UTIL::string2vec<EdgeID>(fields[cpath_idx])) {
+      if (changed_edges_.find(edge) != changed_edges_.end()) {
+        passing_.insert(id);
+        break;
+      }
+    }
+  }
+  SPDLOG_INFO("Previous results of {} trajectories, {} passing a changed "
+              "edge", previous_.size(), passing_.size());
+  return true;
+}
+
+bool RematchFilter::select(const Trajectory &trajectory) {
+  bool affected = previous_.find(trajectory.id) == previous_.end() ||
+      passing_.find(trajectory.id) != passing_.end();
+  if (!affected && trajectory.geom.get_num_points() > 0) {
+    double x1, y1, x2, y2;
+    ALGORITHM::boundingbox_geometry(trajectory.geom, &x1, &y1, &x2, &y2);
+    BoostBox box(Point(x1, y1), Point(x2, y2));
+    affected = areas_.qbegin(boost::geometry::index::intersects(box)) !=
+        areas_.qend();
+  }
+  if (affected) selected_.insert(trajectory.id);
+  return affected;
+}
+
+bool RematchFilter::merge(const std::string &previous_file,
+                          const std::string &rematched_file,
+                          const std::string &result_file) const {
+  std::ifstream rematched(rematched_file);
+  std::ifstream previous(previous_file);
+  std::string header, previous_header;
+  if (!rematched || !std::getline(rematched, header) ||
+      !previous || !std::getline(previous, previous_header)) {
+    SPDLOG_CRITICAL("Cannot read result files {} and {}", previous_file,
+                    rematched_file);
+    return false;
+  }
+  if (header != previous_header) {
+    SPDLOG_CRITICAL("Fields of {} differ from the previous results",
+                    rematched_file);
+    return false;
+  }
+  // The rows of the trajectories selected, in the order written
+  std::unordered_map<int, std::string> rows;
+  std::vector<int> order;
+  std::string line;
+  while (std::getline(rematched, line)) {
+    int id = get_row_id(line);
+    std::string &trajectory_rows = rows[id];
+    if (trajectory_rows.empty()) order.push_back(id);
+    trajectory_rows += line;
+    trajectory_rows.push_back('\n');
+  }
+  // The file is replaced at once, so that the previous results are kept
+  // if the merge fails
+  std::string temp_file = result_file + ".tmp";
+  {
+    std::ofstream ofs(temp_file, std::ios::binary);
+    ofs << header << '\n';
+    std::unordered_set<int> written;
+    while (std::getline(previous, line)) {
+      int id = get_row_id(line);
+      if (selected_.find(id) == selected_.end()) {
+        ofs << line << '\n';
+      } else if (written.insert(id).second) {
+        ofs << rows[id];
+      }
+    }
+    for (int id : order) {
+      if (written.insert(id).second) ofs << rows[id];
+    }
+    if (!ofs.good()) {
+      SPDLOG_CRITICAL("Fail to write result file {}", temp_file);
+      return false;
+    }
+  }
+  if (std::rename(temp_file.c_str(), result_file.c_str()) != 0) {
+    SPDLOG_CRITICAL("Fail to rename result file to {}", result_file);
+    return false;
+  }
+  SPDLOG_INFO("Merge the results of {} trajectories into {}",
+              selected_.size(), result_file);
+  return true;
+}
+
+bool RematchFilter::parse_areas(const std::string &text,
+                                std::vector<BoostBox> *areas) {
+  std::size_t begin = 0;
+  while (begin < text.size()) {
+    std::size_t end = text.find(';', begin);
+    if (end == std::string::npos) end = text.size();
+    std::vector<double> box =
+        UTIL::string2vec<double>(text.substr(begin, end - begin));
+    if (box.size() != 4 || box[0] > box[2] || box[1] > box[3]) {
+      SPDLOG_CRITICAL("Invalid area {}, which should be minx,miny,maxx,"
+                      "maxy", text.substr(begin, end - begin));
+      return false;
+    }
+    areas->push_back(BoostBox(Point(box[0], box[1]), Point(box[2], box[3])));
+    begin = end + 1;
+  }
+  return true;
+}
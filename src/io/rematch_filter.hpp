@@ -0,0 +1,110 @@
+/**
+ * Fast map matching.
+ *
+ * Selection of the trajectories matched again after an update of the
+ * network, whose results are merged into the previous result file
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_REMATCH_FILTER_HPP
+#define FMM_IO_REMATCH_FILTER_HPP
+
+#include "core/gps.hpp"
+#include "network/network.hpp"
+
+#include <boost/geometry/index/rtree.hpp>
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Filter of the trajectories whose result may change after an update of
+ * the network, given the edges changed and the areas changed.
+ *
+ * A trajectory is selected if the complete path of its previous result
+ * passes a changed edge, if its bounding box grown by a margin, such as
+ * the search radius, intersects a changed area or the box of a changed
+ * edge in the new network, or if it has no previous result. The areas
+ * and the boxes of the edges are indexed by an rtree. The previous
+ * result file is a csv result file, whose complete paths are only used
+ * if it has a cpath field.
+ *
+ * The results of the trajectories selected, written into a separate
+ * file with the same fields, are merged into the previous results. The
+ * rows of a trajectory selected replace its previous rows in place, and
+ * the rows of the trajectories without previous rows are appended.
+ */
+class RematchFilter {
+ public:
+  /**
+   * Constructor
+   * @param network       the network updated
+   * @param changed_edges ID of the edges changed, including the edges
+   * removed
+   * @param areas         areas changed
+   * @param margin        distance from a trajectory to the changes
+   * affecting it
+   */
+  RematchFilter(const NETWORK::Network &network,
+                const std::vector<NETWORK::EdgeID> &changed_edges,
+                const std::vector<NETWORK::BoostBox> &areas,
+                double margin);
+  /**
+   * Read the trajectories of the previous results and the ones whose
+   * complete path passes a changed edge
+   * @param  result_file previous csv result file
+   * @return true if read
+   */
+  bool read_previous(const std::string &result_file);
+  /**
+   * Check if a trajectory is affected by the changes, which records it
+   * as matched again if so
+   * @param  trajectory a trajectory of the input
+   * @return true if the trajectory is matched again
+   */
+  bool select(const CORE::Trajectory &trajectory);
+  /**
+   * Merge the results of the trajectories selected into the previous
+   * results, which replaces the result file at once
+   * @param  previous_file  previous csv result file
+   * @param  rematched_file csv result file of the trajectories selected
+   * @param  result_file    csv result file written, which can be the
+   * previous one
+   * @return true if merged, false if the files cannot be read or written
+   * or their fields are different
+   */
+  bool merge(const std::string &previous_file,
+             const std::string &rematched_file,
+             const std::string &result_file) const;
+  /**
+   * Get the number of trajectories selected
+   */
+  long get_selected() const { return selected_.size(); }
+  /**
+   * Parse areas separated by ; as minx,miny,maxx,maxy
+   * @param  text  areas as text
+   * @param  areas updated with the areas parsed
+   * @return true if parsed
+   */
+  static bool parse_areas(const std::string &text,
+                          std::vector<NETWORK::BoostBox> *areas);
+ private:
+  typedef boost::geometry::index::rtree<
+      NETWORK::BoostBox, boost::geometry::index::quadratic<16>> AreaRtree;
+  std::unordered_set<NETWORK::EdgeID> changed_edges_;
+  AreaRtree areas_; // Areas and boxes of the edges changed, with margin
+  std::unordered_set<int> previous_; // Trajectories of the results
+  std::unordered_set<int> passing_; // Trajectories passing a changed edge
+  std::unordered_set<int> selected_;
+}; // RematchFilter
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_REMATCH_FILTER_HPP
@@ -0,0 +1,187 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/result_cache.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+namespace {
+
+// Mix a value into a well distributed 64 bit hash
+inline unsigned long long mix_key(unsigned long long h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Combine a value into a hash
+inline unsigned long long combine(unsigned long long h,
+                                  unsigned long long value) {
+  return mix_key(h ^ (value + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+inline unsigned long long double_bits(double value) {
+  unsigned long long bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+} // namespace
+
+ResultCache::ResultCache(long max_bytes, const std::string &context) :
+    shard_bytes(std::max<long>(max_bytes / CACHE_SHARDS, 1)) {
+  SPDLOG_INFO("Create result cache of {:.1f} MB",
+              max_bytes / (1024.0 * 1024.0));
+  seeds[0] = 0x243f6a8885a308d3ULL;
+  seeds[1] = 0x13198a2e03707344ULL;
+  for (char c : context) {
+    seeds[0] = combine(seeds[0], (unsigned char) c);
+    seeds[1] = combine(seeds[1], (unsigned char) c);
+  }
+  for (int i = 0; i < CACHE_SHARDS; ++i) {
+    shards.emplace_back(new Shard());
+  }
+}
+
+ResultCache::Key ResultCache::get_key(const Trajectory &traj) const {
+  Key key{seeds[0], seeds[1], traj.geom.get_num_points()};
+  for (int i = 0; i < key.num_points; ++i) {
+    unsigned long long x = double_bits(traj.geom.get_x(i));
+    unsigned long long y = double_bits(traj.geom.get_y(i));
+    key.first = combine(combine(key.first, x), y);
+    key.second = combine(combine(key.second, y), x);
+  }
+  for (double t : traj.timestamps) {
+    key.first = combine(key.first, double_bits(t));
+    key.second = combine(key.second, double_bits(t));
+  }
+  return key;
+}
+
+ResultCache::Shard &ResultCache::get_shard(const Key &key) const {
+  return *shards[key.second & (CACHE_SHARDS - 1)];
+}
+
+long ResultCache::estimate_bytes(
+    const std::vector<SegmentMatchResult> &segments) {
+  long bytes = sizeof(Entry) + sizeof(Key);
+  for (const SegmentMatchResult &segment : segments) {
+    const MatchResult &result = segment.result;
+    bytes += sizeof(SegmentMatchResult) +
+        result.opt_candidate_path.size() * sizeof(MatchedCandidate) +
+        (result.opath.size() + result.cpath.size() +
+         result.indices.size()) * sizeof(int) +
+        (result.mgeom.get_num_points() * 2 + result.timestamps.size()) *
+        sizeof(double);
+  }
+  return bytes;
+}
+
+bool ResultCache::look_up(const Trajectory &traj,
+                          std::vector<SegmentMatchResult> *segments) {
+  Key key = get_key(traj);
+  Shard &shard = get_shard(key);
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.entries.find(key);
+    if (iter == shard.entries.end()) {
+      ++shard.misses;
+      return false;
+    }
+    iter->second.referenced = true;
+    ++shard.hits;
+    *segments = iter->second.segments;
+  }
+  for (SegmentMatchResult &segment : *segments) {
+    segment.result.id = traj.id;
+  }
+  return true;
+}
+
+void ResultCache::insert(const Trajectory &traj,
+                         const std::vector<SegmentMatchResult> &segments) {
+  for (const SegmentMatchResult &segment : segments) {
+    if (segment.result.partial) return;
+  }
+  Key key = get_key(traj);
+  Shard &shard = get_shard(key);
+  long bytes = estimate_bytes(segments);
+  if (bytes > shard_bytes) return;
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  // Another matcher may have matched a duplicate at the same time
+  if (shard.entries.find(key) != shard.entries.end()) return;
+  shard.entries.emplace(key, Entry{segments, bytes, false});
+  shard.clock.push_back(key);
+  shard.bytes += bytes;
+  while (shard.bytes > shard_bytes && shard.clock.size() > 1) {
+    if (shard.hand >= shard.clock.size()) shard.hand = 0;
+    Key victim = shard.clock[shard.hand];
+    Entry &victim_entry = shard.entries[victim];
+    if (victim == key || victim_entry.referenced) {
+      victim_entry.referenced = false;
+      ++shard.hand;
+    } else {
+      shard.bytes -= victim_entry.bytes;
+      shard.entries.erase(victim);
+      shard.clock[shard.hand] = shard.clock.back();
+      shard.clock.pop_back();
+      ++shard.evictions;
+    }
+  }
+}
+
+ResultCacheStatistics ResultCache::get_statistics() const {
+  ResultCacheStatistics statistics;
+  for (const auto &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    statistics.hits += shard->hits;
+    statistics.misses += shard->misses;
+    statistics.evictions += shard->evictions;
+    statistics.entries += shard->entries.size();
+    statistics.bytes += shard->bytes;
+  }
+  return statistics;
+}
+
+void ResultCache::print_statistics() const {
+  ResultCacheStatistics statistics = get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  SPDLOG_INFO("Result cache hits {} misses {} hit rate {} evictions {}",
+              statistics.hits, statistics.misses,
+              queries > 0 ? statistics.hits / (double) queries : 0.0,
+              statistics.evictions);
+  SPDLOG_INFO("Result cache results {} size {:.1f} MB", statistics.entries,
+              statistics.bytes / (1024.0 * 1024.0));
+}
+
+void IO::append_result_cache_metrics(const ResultCache &cache,
+                                     UTIL::MetricsText *text) {
+  ResultCacheStatistics statistics = cache.get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  text->counter("fmm_result_cache_hits_total",
+                "Trajectories whose results are reused from the cache",
+                statistics.hits);
+  text->counter("fmm_result_cache_misses_total",
+                "Trajectories matched on a miss of the result cache",
+                statistics.misses);
+  text->counter("fmm_result_cache_evictions_total",
+                "Results evicted from the result cache",
+                statistics.evictions);
+  text->gauge("fmm_result_cache_bytes",
+              "Estimate of the memory of the results cached",
+              statistics.bytes);
+  text->gauge("fmm_result_cache_hit_ratio",
+              "Share of the trajectories found in the result cache",
+              queries > 0 ? statistics.hits / (double) queries : 0.0);
+}
@@ -0,0 +1,148 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the results of the trajectories matched, which are reused for
+ * the duplicates of a trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_RESULT_CACHE_HPP
+#define FMM_IO_RESULT_CACHE_HPP
+
+#include "core/gps.hpp"
+#include "mm/mm_type.hpp"
+#include "util/metrics.hpp"
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Counters of a result cache
+ */
+struct ResultCacheStatistics {
+  long hits = 0; /**< Trajectories whose results are reused */
+  long misses = 0; /**< Trajectories matched */
+  long evictions = 0; /**< Results evicted */
+  long entries = 0; /**< Results cached */
+  long bytes = 0; /**< Estimate of the memory of the results cached */
+};
+
+/**
+ * Results of trajectories keyed by a hash of their coordinates,
+ * timestamps and of the configuration they are matched with, so that a
+ * trajectory sent again or a vehicle repeating the same route on the
+ * same schedule is not matched again. The id of a result reused is the
+ * one of the duplicate.
+ *
+ * The key is made of two independent 64 bit hashes and the number of
+ * points, which makes a collision between different trajectories
+ * negligible. The cache is split into shards locked independently, and
+ * a shard evicts its results with the CLOCK algorithm when it holds more
+ * than its share of the memory. It can be queried by multiple threads.
+ */
+class ResultCache {
+ public:
+  /**
+   * Create an empty cache
+   * @param max_bytes maximum memory of the results cached, in bytes
+   * @param context   description of the configuration, network and
+   * UBODT of the results, which is part of the key
+   */
+  explicit ResultCache(long max_bytes, const std::string &context = "");
+  /**
+   * Look up the results of a trajectory
+   * @param  traj     trajectory to match
+   * @param  segments updated with the results of a duplicate, whose id
+   * is replaced by the one of the trajectory
+   * @return true if a duplicate is cached
+   */
+  bool look_up(const CORE::Trajectory &traj,
+               std::vector<MM::SegmentMatchResult> *segments);
+  /**
+   * Cache the results of a trajectory, except partial results whose
+   * matching depends on the time available
+   * @param traj     trajectory matched
+   * @param segments results of the trajectory
+   */
+  void insert(const CORE::Trajectory &traj,
+              const std::vector<MM::SegmentMatchResult> &segments);
+  /**
+   * Get the counters of the cache
+   */
+  ResultCacheStatistics get_statistics() const;
+  /**
+   * Log the hits, misses, evictions and size of the cache
+   */
+  void print_statistics() const;
+  /**
+   * Estimate the memory of the results of a trajectory
+   * @param  segments results of a trajectory
+   * @return the bytes held by the results
+   */
+  static long estimate_bytes(
+      const std::vector<MM::SegmentMatchResult> &segments);
+  static const int CACHE_SHARDS = 64; /**< Number of independently locked
+                                        parts of the cache */
+ private:
+  struct Key {
+    unsigned long long first; // hash of the trajectory and the context
+    unsigned long long second; // hash with another seed
+    int num_points;
+    bool operator==(const Key &rhs) const {
+      return first == rhs.first && second == rhs.second &&
+          num_points == rhs.num_points;
+    }
+  };
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const {
+      return (std::size_t) key.first;
+    }
+  };
+  struct Entry {
+    std::vector<MM::SegmentMatchResult> segments;
+    long bytes;
+    bool referenced; // cleared when the clock hand passes the entry
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::vector<Key> clock; // keys cached
+    size_t hand = 0;
+    long bytes = 0;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+  };
+  /**
+   * Hash the coordinates and timestamps of a trajectory
+   */
+  Key get_key(const CORE::Trajectory &traj) const;
+  /**
+   * Find the shard of a key
+   */
+  Shard &get_shard(const Key &key) const;
+  unsigned long long seeds[2]; // hashes of the context
+  long shard_bytes; // maximum memory of the results cached in a shard
+  std::vector<std::unique_ptr<Shard>> shards;
+}; // ResultCache
+
+/**
+ * Add the counters and the hit rate of a result cache to metrics
+ * @param cache result cache queried
+ * @param text  metrics updated
+ */
+void append_result_cache_metrics(const ResultCache &cache,
+                                 UTIL::MetricsText *text);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_RESULT_CACHE_HPP
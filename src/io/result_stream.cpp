@@ -0,0 +1,99 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "io/result_stream.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <zlib.h>
+
+using namespace FMM;
+using namespace FMM::IO;
+
+ResultStream::ResultStream(const std::string &filename, bool append,
+                           bool async) :
+    compressed_(is_compressed(filename)), streaming_(filename == "-") {
+  if (async && !streaming_) {
+    async_.reset(new AsyncFileWriter(filename, append));
+    return;
+  }
+  ofs_.open(streaming_ ? "/dev/stdout" : filename,
+            append ? std::ios::binary | std::ios::app : std::ios::binary);
+  if (!ofs_.good()) {
+    SPDLOG_CRITICAL("Fail to open result file {}", filename);
+  }
+}
+
+ResultStream::~ResultStream() {
+  flush_buffer();
+}
+
+bool ResultStream::is_compressed(const std::string &filename) {
+  return UTIL::check_file_extension(filename, "gz");
+}
+
+void ResultStream::write(const char *data, std::size_t size) {
+  if (!compressed_) {
+    write_file(data, size);
+    if (streaming_) ofs_.flush();
+    return;
+  }
+  buffer_.append(data, size);
+  if (buffer_.size() >= MEMBER_SIZE) flush_buffer();
+}
+
+void ResultStream::write_compressed(const std::string &member) {
+  flush_buffer();
+  write_file(member.data(), member.size());
+}
+
+void ResultStream::flush() {
+  flush_buffer();
+  if (async_ != nullptr) {
+    async_->flush();
+  } else {
+    ofs_.flush();
+  }
+}
+
+void ResultStream::write_file(const char *data, std::size_t size) {
+  if (async_ != nullptr) {
+    async_->write(data, size);
+  } else {
+    ofs_.write(data, size);
+  }
+}
+
+void ResultStream::flush_buffer() {
+  if (buffer_.empty()) return;
+  if (compress_block(buffer_.data(), buffer_.size(), &member_)) {
+    write_file(member_.data(), member_.size());
+  }
+  buffer_.clear();
+}
+
+bool ResultStream::compress_block(const char *data, std::size_t size,
+                                  std::string *member) {
+  z_stream stream{};
+  // A window of 15 bits plus 16 writes the gzip header and trailer
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    SPDLOG_ERROR("Fail to initialize gzip compression");
+    return false;
+  }
+  member->resize(deflateBound(&stream, size));
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = size;
+  stream.next_out = (Bytef *) &(*member)[0];
+  stream.avail_out = member->size();
+  int status = deflate(&stream, Z_FINISH);
+  member->resize(stream.total_out);
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    SPDLOG_ERROR("Fail to compress a block of {} bytes", size);
+    member->clear();
+    return false;
+  }
+  return true;
+}
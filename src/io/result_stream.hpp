@@ -0,0 +1,120 @@
+/**
+ * Fast map matching.
+ *
+ * Output stream of the result files, which are compressed with gzip if
+ * their name ends with .gz.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_RESULT_STREAM_HPP
+#define FMM_IO_RESULT_STREAM_HPP
+
+#include "io/async_writer.hpp"
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * A stream writing a result file, either as plain text or compressed
+ * with gzip.
+ *
+ * A gzip file is written as a sequence of gzip members, which gzip and
+ * zlib decompress as a single stream. The text written is buffered and
+ * compressed into a member once the buffer is full, while a member can
+ * also be compressed by another thread with compress_block and written
+ * with write_compressed, so that the compression of the blocks runs in
+ * parallel. A file opened as asynchronous is written by an
+ * AsyncFileWriter, so that the text is formatted while the previous
+ * blocks are written.
+ */
+class ResultStream {
+ public:
+  /**
+   * Open a result file, compressed if its name ends with .gz
+   * @param filename name of the file, or - to write to stdout, which is
+   * flushed after each write so that a streaming consumer reads the
+   * results as they are matched
+   * @param append if true, the text is written after the content of the
+   * file instead of replacing it
+   * @param async if true, the file is written by a thread of its own,
+   * unless it is stdout
+   */
+  explicit ResultStream(const std::string &filename, bool append = false,
+                        bool async = false);
+  /**
+   * Write the text buffered and close the file
+   */
+  ~ResultStream();
+  ResultStream(const ResultStream &) = delete;
+  ResultStream &operator=(const ResultStream &) = delete;
+  /**
+   * Check if the file is opened and written without error
+   */
+  bool good() const {
+    return async_ != nullptr ? async_->good() : ofs_.good();
+  }
+  /**
+   * Check if the file is compressed
+   */
+  bool compressed() const { return compressed_; }
+  /**
+   * Write text, which is compressed if the file is compressed
+   * @param data text written
+   * @param size number of characters
+   */
+  void write(const char *data, std::size_t size);
+  /**
+   * Write a gzip member compressed by compress_block into a compressed
+   * file, after the text buffered
+   * @param member gzip member
+   */
+  void write_compressed(const std::string &member);
+  /**
+   * Write the text buffered and flush the file, which ends a compressed
+   * file with a complete member
+   */
+  void flush();
+  /**
+   * Compress text into a gzip member
+   * @param data   text compressed
+   * @param size   number of characters
+   * @param member gzip member replaced
+   * @return true if compressed, false if zlib fails
+   */
+  static bool compress_block(const char *data, std::size_t size,
+                             std::string *member);
+  /**
+   * Check if a file is compressed from its name
+   */
+  static bool is_compressed(const std::string &filename);
+  /**
+   * Size of the text buffered before it is compressed into a member
+   */
+  static const std::size_t MEMBER_SIZE = 1 << 20;
+ private:
+  /**
+   * Compress the text buffered into a member and write it
+   */
+  void flush_buffer();
+  /**
+   * Write data to the file
+   */
+  void write_file(const char *data, std::size_t size);
+  std::ofstream ofs_;
+  std::unique_ptr<AsyncFileWriter> async_;
+  bool compressed_;
+  bool streaming_; // Written to stdout
+  std::string buffer_;
+  std::string member_;
+}; // ResultStream
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_RESULT_STREAM_HPP
@@ -0,0 +1,66 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the runner of a sweep
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "io/sweep_runner.hpp"
+#include "util/debug.hpp"
+
+#include <memory>
+#include <omp.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+using namespace FMM::IO;
+
+SweepReport IO::run_sweep(GPSReader *reader,
+                          const CONFIG::ResultConfig &result_config,
+                          const NETWORK::Network *network,
+                          const std::vector<SweepSetting> &settings,
+                          const SweepFunction &match,
+                          const SweepRunOptions &options) {
+  SweepReport report(settings);
+  // The configurations outlive their writers
+  std::vector<CONFIG::ResultConfig> configs(settings.size(), result_config);
+  std::vector<std::unique_ptr<MatchResultWriter>> writers;
+  for (std::size_t s = 0; s < settings.size(); ++s) {
+    configs[s].file = get_sweep_result_file(result_config.file, s);
+    writers.push_back(MatchResultWriter::create(configs[s], false, network));
+    if (writers.back() == nullptr) return report;
+  }
+  int num_threads = options.use_omp ? omp_get_max_threads() : 1;
+  std::vector<SweepReport> reports(num_threads, report);
+  long progress = 0;
+  long next_step = options.step;
+  while (reader->has_next_trajectory()) {
+    std::vector<Trajectory> trajectories =
+        reader->read_next_N_trajectories(options.chunk_size);
+    int n = trajectories.size();
+    std::vector<std::vector<MatchResult>> results(n);
+    #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (int i = 0; i < n; ++i) {
+      results[i] = match(trajectories[i], &reports[omp_get_thread_num()]);
+    }
+    for (int i = 0; i < n; ++i) {
+      for (std::size_t s = 0; s < settings.size(); ++s) {
+        writers[s]->write_result(results[i][s]);
+      }
+    }
+    progress += n;
+    if (progress >= next_step) {
+      SPDLOG_INFO("Progress {}", progress);
+      while (next_step <= progress) next_step += options.step;
+    }
+  }
+  for (const SweepReport &thread_report : reports) {
+    report.merge(thread_report);
+  }
+  report.print();
+  if (!options.report_file.empty()) report.write_csv(options.report_file);
+  return report;
+}
@@ -0,0 +1,66 @@
+/**
+ * Fast map matching.
+ *
+ * Runner of a sweep of the parameters of a matching algorithm, which
+ * writes the results of each setting into its own file
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_IO_SWEEP_RUNNER_HPP
+#define FMM_IO_SWEEP_RUNNER_HPP
+
+#include "io/gps_reader.hpp"
+#include "io/mm_writer.hpp"
+#include "mm/parameter_sweep.hpp"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace IO {
+
+/**
+ * Function matching a trajectory with all the settings of a sweep, which
+ * updates the report of the calling thread
+ */
+typedef std::function<std::vector<MM::MatchResult>(
+    const CORE::Trajectory &, MM::SweepReport *)> SweepFunction;
+
+/**
+ * Options of a sweep run
+ */
+struct SweepRunOptions {
+  bool use_omp = true; /**< Match the trajectories of a chunk in
+                            parallel */
+  int chunk_size = 1000; /**< Trajectories read at once */
+  int step = 100; /**< Trajectories between two progress reports */
+  std::string report_file; /**< CSV file of the report, empty for none */
+};
+
+/**
+ * Match the trajectories of a reader with all the settings of a sweep.
+ * The trajectories are read by chunks, which are matched in parallel and
+ * written in their input order into the result file of each setting,
+ * named by get_sweep_result_file.
+ * @param  reader        reader of the trajectories
+ * @param  result_config configuration of the result file of the sweep
+ * @param  network       network of the results
+ * @param  settings      settings of the sweep
+ * @param  match         function matching a trajectory
+ * @param  options       options of the run
+ * @return the report of the settings
+ */
+MM::SweepReport run_sweep(GPSReader *reader,
+                          const CONFIG::ResultConfig &result_config,
+                          const NETWORK::Network *network,
+                          const std::vector<MM::SweepSetting> &settings,
+                          const SweepFunction &match,
+                          const SweepRunOptions &options);
+
+} // IO
+} // FMM
+
+#endif // FMM_IO_SWEEP_RUNNER_HPP
@@ -1,6 +1,10 @@
 #include "mm/composite_graph.hpp"
 #include "util/debug.hpp"
 
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
@@ -10,47 +14,95 @@ DummyGraph::DummyGraph(){}
 
 DummyGraph::DummyGraph(const Traj_Candidates &traj_candidates){
   if (traj_candidates.empty()) return;
-  int N = traj_candidates.size();
-  std::unordered_map<EdgeIndex,const Candidate*> ca;
-  std::unordered_map<EdgeIndex,const Candidate*> cb;
-  std::unordered_map<EdgeIndex,const Candidate*> *prev_cmap = &ca;
-  std::unordered_map<EdgeIndex,const Candidate*> *cur_cmap = &cb;
-  for (int i=0; i<N; ++i) {
-    const Point_Candidates &pcs = traj_candidates[i];
-    for (const Candidate &c:pcs) {
-      NodeIndex n = c.index;
-      add_edge(c.edge->source, n, c.edge->index, c.offset);
-      add_edge(n,c.edge->target, c.edge->index, c.edge->length - c.offset);
-      cur_cmap->insert(std::make_pair(c.edge->index,&c));
-      auto iter = prev_cmap->find(c.edge->index);
-      if (iter!=prev_cmap->end()) {
-        if (iter->second->offset <= c.offset) {
-          add_edge(iter->second->index,
-                   n, c.edge->index, c.offset-iter->second->offset);
-        }
-      }
-    }
-    std::unordered_map<EdgeIndex,const Candidate*> *temp = prev_cmap;
-    prev_cmap = cur_cmap;
-    cur_cmap = temp;
-    cur_cmap->clear();
+  std::vector<CandidateRange> layers;
+  for (const Point_Candidates &pcs : traj_candidates) {
+    layers.push_back({pcs.data(), pcs.data() + pcs.size()});
   }
+  build(layers);
+}
+
+DummyGraph::DummyGraph(const CandidateSearchContext &context){
+  reset(context);
 }
 
-Graph_T *DummyGraph::get_graph_ptr(){
-  return &g;
+void DummyGraph::reset(const CandidateSearchContext &context){
+  external_index_vec.clear();
+  candidate_first = std::numeric_limits<NodeIndex>::max();
+  candidate_offset = 0;
+  layer_ranges.clear();
+  edge_vec.clear();
+  g.reset(0, edge_vec);
+  if (context.empty()) return;
+  for (std::size_t i=0; i<context.get_num_points(); ++i) {
+    CandidateSpan pcs = context.get_point_candidates(i);
+    layer_ranges.push_back({pcs.begin(), pcs.end()});
+  }
+  build(layer_ranges);
 }
 
-const Graph_T &DummyGraph::get_boost_graph() const {
+void DummyGraph::build(const std::vector<CandidateRange> &layers) {
+  NodeIndex first = std::numeric_limits<NodeIndex>::max();
+  for (const CandidateRange &layer : layers) {
+    for (const Candidate *c = layer.first; c != layer.second; ++c) {
+      external_index_vec.push_back(c->edge->source);
+      external_index_vec.push_back(c->edge->target);
+      external_index_vec.push_back(c->index);
+      first = std::min(first, c->index);
+    }
+  }
+  std::sort(external_index_vec.begin(), external_index_vec.end());
+  external_index_vec.erase(
+      std::unique(external_index_vec.begin(), external_index_vec.end()),
+      external_index_vec.end());
+  if (external_index_vec.empty()) return;
+  // The candidates are after the network nodes, and found by offset if
+  // they are numbered contiguously
+  DummyIndex offset = std::lower_bound(external_index_vec.begin(),
+                                       external_index_vec.end(), first) -
+      external_index_vec.begin();
+  if (external_index_vec.back() - first ==
+      external_index_vec.size() - 1 - offset) {
+    candidate_first = first;
+    candidate_offset = offset;
+  }
+  std::vector<EdgeProperty> &edges = edge_vec;
+  edges.clear();
+  const Candidate *prev_first = nullptr;
+  const Candidate *prev_last = nullptr;
+  for (const CandidateRange &layer : layers) {
+    for (const Candidate *c = layer.first; c != layer.second; ++c) {
+      DummyIndex n = get_internal_index(c->index);
+      edges.push_back({get_internal_index(c->edge->source), n,
+                       c->edge->index, c->offset});
+      edges.push_back({n, get_internal_index(c->edge->target),
+                       c->edge->index, c->edge->length - c->offset});
+      // The first candidate of the previous point on the same edge
+      const Candidate *prev = std::find_if(
+          prev_first, prev_last, [c](const Candidate &p) {
+            return p.edge->index == c->edge->index;
+          });
+      if (prev != prev_last && prev->offset <= c->offset) {
+        edges.push_back({get_internal_index(prev->index), n,
+                         c->edge->index, c->offset - prev->offset});
+      }
+    }
+    prev_first = layer.first;
+    prev_last = layer.second;
+  }
+  g.reset(external_index_vec.size(), edges);
+}
+
+const CSRGraph &DummyGraph::get_graph() const {
   return g;
 }
 
 int DummyGraph::get_num_vertices() const {
-  return boost::num_vertices(g);
+  return g.get_num_vertices();
 }
 
 bool DummyGraph::containNodeIndex(NodeIndex external_index) const {
-  return internal_index_map.find(external_index)!=internal_index_map.end();
+  DummyIndex internal_index;
+  return find_internal_index(external_index, &internal_index);
 }
 
 NodeIndex DummyGraph::get_external_index(DummyIndex inner_index) const {
@@ -58,66 +110,18 @@ NodeIndex DummyGraph::get_external_index(DummyIndex inner_index) const {
 }
 
 DummyIndex DummyGraph::get_internal_index(NodeIndex external_index) const {
-  return internal_index_map.at(external_index);
-}
-
-int DummyGraph::get_edge_index(NodeIndex source,NodeIndex target,double cost)
-const {
-  SPDLOG_TRACE("Dummy graph get edge index {} {} cost {}",source,target,cost);
-  EdgeDescriptor e;
-  OutEdgeIterator out_i, out_end;
-  NodeIndex source_idx = get_internal_index(source);
-  NodeIndex target_idx = get_internal_index(target);
-  for (boost::tie(out_i, out_end) = boost::out_edges(source_idx,g);
-       out_i != out_end; ++out_i) {
-    e = *out_i;
-    SPDLOG_TRACE("Target index {} {} id {} e length {} {}",
-                 target_idx, boost::target(e,g),
-                 g[e].index,
-                 g[e].length,
-                 std::abs(g[e].length - cost));
-    if (target_idx == boost::target(e,g) &&
-        (std::abs(g[e].length - cost) <= DOUBLE_MIN)) {
-      return g[e].index;
-    }
+  DummyIndex internal_index;
+  if (!find_internal_index(external_index, &internal_index)) {
+    throw std::out_of_range("Node not in dummy graph");
   }
-  return -1;
+  return internal_index;
 }
 
 void DummyGraph::print_node_index_map() const {
   std::cout<<"Inner index map\n";
-  for (auto const& pair:internal_index_map) {
-    std::cout << "{" << pair.first << ": " << pair.second << "}\n";
-  }
-}
-
-void DummyGraph::add_edge(NodeIndex source, NodeIndex target,
-                          EdgeIndex edge_index, double cost) {
-  // SPDLOG_TRACE("  Add edge {} {} e {} cost {}",
-  //               source,target,edge_index,cost);
-  auto search1 = internal_index_map.find(source);
-  auto search2 = internal_index_map.find(target);
-  DummyIndex source_idx, target_idx;
-  if (search1!=internal_index_map.end()) {
-    source_idx = search1->second;
-  } else {
-    source_idx = external_index_vec.size();
-    external_index_vec.push_back(source);
-    internal_index_map.insert({source,source_idx});
-  }
-  if (search2!=internal_index_map.end()) {
-    target_idx = search2->second;
-  } else {
-    target_idx = external_index_vec.size();
-    external_index_vec.push_back(target);
-    internal_index_map.insert({target,target_idx});
+  for (DummyIndex i = 0; i < external_index_vec.size(); ++i) {
+    std::cout << "{" << external_index_vec[i] << ": " << i << "}\n";
   }
-  EdgeDescriptor e;
-  bool inserted;
-  boost::tie(e, inserted) = boost::add_edge(source_idx,target_idx,g);
-  // id is the FID read, id_attr is the external property in SHP
-  g[e].index = edge_index;
-  g[e].length = cost;
 }
 
 CompositeGraph::CompositeGraph(const NetworkGraph &g,const DummyGraph &dg) :
@@ -129,45 +133,11 @@ unsigned int CompositeGraph::get_dummy_node_start_index() const {
   return num_vertices;
 }
 
-int CompositeGraph::get_edge_index(NodeIndex u, NodeIndex v, double cost)
-const {
-  if (u >= num_vertices || v >= num_vertices) {
-    return dg_.get_edge_index(u,v,cost);
-  } else {
-    return g_.get_edge_index(u,v,cost);
-  }
-}
-
-EdgeID CompositeGraph::get_edge_id(NodeIndex u, NodeIndex v, double cost)
-const {
-  return g_.get_edge_id(get_edge_index(u,v,cost));
-}
-
 std::vector<CompEdgeProperty> CompositeGraph::out_edges(NodeIndex u) const {
   std::vector<CompEdgeProperty> out_edges;
-  OutEdgeIterator out_i, out_end;
-  EdgeDescriptor e;
-  if (dg_.containNodeIndex(u)) {
-    const Graph_T &dg = dg_.get_boost_graph();
-    NodeIndex u_internal = dg_.get_internal_index(u);
-    for (boost::tie(out_i, out_end) = boost::out_edges(u_internal,dg);
-         out_i != out_end; ++out_i) {
-      e = *out_i;
-      NodeIndex v_internal = boost::target(e, dg);
-      NodeIndex v = dg_.get_external_index(v_internal);
-      out_edges.push_back(CompEdgeProperty{v,dg[e].length});
-    }
-  }
-  if (u < num_vertices) {
-    const Graph_T &g = g_.get_boost_graph();
-    for (boost::tie(out_i, out_end)=boost::out_edges(u,g);
-         out_i != out_end; ++out_i) {
-      e = *out_i;
-      NodeIndex v = boost::target(e, g);
-      // Export a pair of (v,cost)
-      out_edges.push_back(CompEdgeProperty{v,g[e].length});
-    }
-  }
+  for_each_out_edge(u, [&out_edges](const CompEdgeProperty &edge) {
+    out_edges.push_back(edge);
+  });
   return out_edges;
 }
 
@@ -12,6 +12,10 @@
 #define FMM_COMPOSITEGRAPH_HPP
 
 #include "network/network_graph.hpp"
+#include "network/candidate_search.hpp"
+
+#include <algorithm>
+#include <limits>
 
 namespace FMM {
 
@@ -43,18 +47,28 @@ class DummyGraph {
    * @param traj_candidates input information
    */
   DummyGraph(const Traj_Candidates &traj_candidates);
-
   /**
-   * Get the inner graph data
-   * @return A pointer to the inner boost graph.
+   * Constructor of dummy graph from the candidates stored in a candidate
+   * search context.
+   *
+   * @param context candidate search context
    */
-  NETWORK::Graph_T *get_graph_ptr();
+  DummyGraph(const NETWORK::CandidateSearchContext &context);
+  /**
+   * Rebuild the dummy graph from the candidates stored in a candidate
+   * search context, keeping the buffers allocated, so that a graph
+   * reused between trajectories does not allocate once they are large
+   * enough.
+   *
+   * @param context candidate search context
+   */
+  void reset(const NETWORK::CandidateSearchContext &context);
 
   /**
    * Get a const reference to the inner graph data
-   * @return A pointer to the inner boost graph.
+   * @return A reference to the inner graph.
    */
-  const NETWORK::Graph_T &get_boost_graph() const;
+  const NETWORK::CSRGraph &get_graph() const;
 
   /**
    * Get the number of vertices in the dummy graph
@@ -71,6 +85,31 @@ class DummyGraph {
    * @return true if a node is contained
    */
   bool containNodeIndex(NETWORK::NodeIndex external_index) const;
+  /**
+   * Find the internal index of a node, by offset for a candidate and by a
+   * binary search over the nodes sorted by index otherwise, which does
+   * not allocate
+   *
+   * @param  external_index The NodeIndex of a node
+   * @param  internal_index updated with the internal index if found
+   * @return true if the node is contained in the dummy graph
+   */
+  inline bool find_internal_index(NETWORK::NodeIndex external_index,
+                                  DummyIndex *internal_index) const {
+    if (external_index_vec.empty() ||
+        external_index > external_index_vec.back()) return false;
+    // The candidates are numbered contiguously after the network nodes
+    if (external_index >= candidate_first) {
+      *internal_index = candidate_offset + (external_index - candidate_first);
+      return true;
+    }
+    if (external_index < external_index_vec.front()) return false;
+    auto iter = std::lower_bound(external_index_vec.begin(),
+                                 external_index_vec.end(), external_index);
+    if (*iter != external_index) return false;
+    *internal_index = iter - external_index_vec.begin();
+    return true;
+  };
 
   /**
    * Get the NodeIndex of a node according to the inner index of the
@@ -90,36 +129,37 @@ class DummyGraph {
    *
    */
   DummyIndex get_internal_index(NETWORK::NodeIndex external_index) const;
-  /**
-   * Get the edge index in the original network graph.
-   * @param  source source NodeIndex in the original network graph
-   * @param  target target NodeIndex in the original network graph
-   * @param  cost   Cost value of the edge
-   * @return  the corresponding edge index in the origin network graph. If
-   * edge is not found, -1 is returned.
-   */
-  int get_edge_index(NETWORK::NodeIndex source,
-                     NETWORK::NodeIndex target, double cost) const;
   /**
    * Print the mapping from dummy index to node index
    */
   void print_node_index_map() const;
  protected:
   /**
-   * Add an edge to the dummy graph
-   * @param source source node index
-   * @param target target node index
-   * @param edge_index Edge index. It will be the same edge index where
-   * the dummy edge is located.
-   * @param cost cost of the edge
+   * Candidates of a point, which are stored contiguously
    */
-  void add_edge(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
-                NETWORK::EdgeIndex edge_index, double cost);
+  typedef std::pair<const Candidate *, const Candidate *> CandidateRange;
+  /**
+   * Build the nodes and the edges of the dummy graph from the candidates
+   * of the points. The nodes are sorted by external index, so that the
+   * internal index of a node is its position. Each candidate is connected
+   * to the ends of its edge and to a candidate of the previous point on
+   * the same edge before it.
+   * @param layers candidates of each point
+   */
+  void build(const std::vector<CandidateRange> &layers);
  private:
-  static constexpr double DOUBLE_MIN = 1e-6;
-  NETWORK::Graph_T g;
+  NETWORK::CSRGraph g;
+  // External index of the nodes, sorted
   std::vector<NETWORK::NodeIndex> external_index_vec;
-  std::unordered_map<NETWORK::NodeIndex, DummyIndex> internal_index_map;
+  // External index of the first candidate if the candidates are numbered
+  // contiguously, otherwise max value
+  NETWORK::NodeIndex candidate_first =
+      std::numeric_limits<NETWORK::NodeIndex>::max();
+  // Internal index of the first candidate
+  DummyIndex candidate_offset = 0;
+  // Buffers of the ranges of the candidates and of the edges built
+  std::vector<CandidateRange> layer_ranges;
+  std::vector<NETWORK::EdgeProperty> edge_vec;
 };
 
 /**
@@ -128,6 +168,8 @@ class DummyGraph {
 struct CompEdgeProperty {
   NETWORK::NodeIndex v; /**< Target node index */
   double cost; /**< Cost of an edge */
+  NETWORK::EdgeIndex edge; /**< Index of the network edge, which contains
+                                a dummy edge */
 };
 
 /**
@@ -147,21 +189,35 @@ class CompositeGraph {
    * the first dummy node in the dummy graph.
    */
   unsigned int get_dummy_node_start_index() const;
-  /**
-   * Get edge index from node index u,v and cost. If
-   * edge is not found, -1 is returned.
-   */
-  int get_edge_index(NETWORK::NodeIndex u,
-                     NETWORK::NodeIndex v, double cost) const;
-  /**
-   * Get edge id from node index u,v and cost
-   */
-  NETWORK::EdgeID get_edge_id(NETWORK::NodeIndex u,
-                     NETWORK::NodeIndex v, double cost) const;
   /**
    * Get out edges leaving a node u in the composite graph
    */
   std::vector<CompEdgeProperty> out_edges(NETWORK::NodeIndex u) const;
+  /**
+   * Call a function on each out edge leaving a node u in the composite
+   * graph, without allocating the edges as out_edges does
+   * @param u node index
+   * @param f function called with the CompEdgeProperty of each edge
+   */
+  template <typename Function>
+  inline void for_each_out_edge(NETWORK::NodeIndex u, Function f) const {
+    DummyIndex u_internal;
+    if (dg_.find_internal_index(u, &u_internal)) {
+      const NETWORK::CSRGraph &dg = dg_.get_graph();
+      for (unsigned int e = dg.begin(u_internal); e < dg.end(u_internal);
+           ++e) {
+        f(CompEdgeProperty{dg_.get_external_index(dg.get_target(e)),
+                           dg.get_length(e), dg.get_index(e)});
+      }
+    }
+    if (u < num_vertices) {
+      const NETWORK::CSRGraph &g = g_.get_graph();
+      for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+        f(CompEdgeProperty{g.get_target(e), g.get_length(e),
+                           g.get_index(e)});
+      }
+    }
+  };
   /**
    * Check if a node u is dummy node, namely representing
    * a candidate point
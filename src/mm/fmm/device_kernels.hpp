@@ -0,0 +1,94 @@
+/**
+ * Fast map matching.
+ *
+ * Kernels of the device UBODT, which are compiled by nvcc and only
+ * include this header
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_DEVICE_KERNELS_HPP_
+#define FMM_SRC_MM_FMM_DEVICE_KERNELS_HPP_
+
+#include <cstddef>
+
+#ifdef __CUDACC__
+#define FMM_HOST_DEVICE __host__ __device__
+#else
+#define FMM_HOST_DEVICE
+#endif
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Slot of the open addressing table of a device UBODT, which only keeps
+ * the OD pair and its distance
+ */
+struct CostSlot {
+  unsigned int source; /**< source node, UBODT::EMPTY_SLOT if empty */
+  unsigned int target; /**< target node */
+  double cost; /**< distance from source to target */
+};
+
+/**
+ * Hash of an OD pair of a device UBODT, shared by the host and the
+ * device
+ */
+FMM_HOST_DEVICE inline unsigned long long hash_cost_slot(
+    unsigned int source, unsigned int target) {
+  unsigned long long h = ((unsigned long long) source << 32) | target;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * Probe the slot of an OD pair
+ * @return the distance, negative if the pair is not found
+ */
+FMM_HOST_DEVICE inline double probe_cost_slot(
+    const CostSlot *slots, unsigned long long mask, unsigned int source,
+    unsigned int target) {
+  unsigned long long h = hash_cost_slot(source, target) & mask;
+  while (slots[h].source != 0xFFFFFFFF) {
+    if (slots[h].source == source && slots[h].target == target) {
+      return slots[h].cost;
+    }
+    h = (h + 1) & mask;
+  }
+  return -1;
+}
+
+#ifdef FMM_WITH_CUDA
+/**
+ * Check if a CUDA device is found
+ */
+bool cuda_device_available();
+/**
+ * Copy slots to the device
+ * @return the device memory, nullptr if it fails
+ */
+void *cuda_upload_slots(const CostSlot *slots, std::size_t n);
+/**
+ * Look up the distances of OD pairs on the device
+ * @return false if a CUDA call fails
+ */
+bool cuda_look_up_pairs(const void *device_slots, unsigned long long mask,
+                        const unsigned int *sources,
+                        const unsigned int *targets, long n,
+                        double *costs);
+/**
+ * Release the device memory of the slots
+ */
+void cuda_free_slots(void *device_slots);
+#endif
+
+} // MM
+} // FMM
+
+#endif // FMM_SRC_MM_FMM_DEVICE_KERNELS_HPP_
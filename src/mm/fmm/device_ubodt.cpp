@@ -0,0 +1,88 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/device_ubodt.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+std::unique_ptr<DeviceUBODT> DeviceUBODT::create(const UBODT &ubodt,
+                                                 bool use_device) {
+  if (ubodt.get_layout() == LAZY || ubodt.get_layout() == TILED) {
+    SPDLOG_CRITICAL("Device UBODT is not supported for lazy or tiled UBODT");
+    return nullptr;
+  }
+  if (ubodt.has_long_range()) {
+    SPDLOG_CRITICAL("Device UBODT is not supported with a long range tier");
+    return nullptr;
+  }
+  std::unique_ptr<DeviceUBODT> table(new DeviceUBODT());
+  // A load factor below one half keeps the probes short
+  unsigned long long capacity = 16;
+  while (capacity < 2ULL * ubodt.get_num_rows()) capacity <<= 1;
+  table->slots_.assign(capacity, CostSlot{UBODT::EMPTY_SLOT, 0, 0});
+  table->mask_ = capacity - 1;
+  table->delta_ = ubodt.get_delta();
+  CostSlot *slots = table->slots_.data();
+  unsigned long long mask = table->mask_;
+  ubodt.for_each_record([slots, mask](const Record &r) {
+    unsigned long long h = hash_cost_slot(r.source, r.target) & mask;
+    while (slots[h].source != UBODT::EMPTY_SLOT) h = (h + 1) & mask;
+    slots[h] = CostSlot{r.source, r.target, r.cost};
+  });
+  if (use_device && is_device_available()) {
+#ifdef FMM_WITH_CUDA
+    table->device_slots_ = cuda_upload_slots(slots, capacity);
+#endif
+  }
+  SPDLOG_INFO("Device UBODT slots {} size {:.1f} MB on {}", capacity,
+              table->get_bytes() / (1024.0 * 1024.0),
+              table->on_device() ? "device" : "host");
+  return table;
+}
+
+bool DeviceUBODT::is_device_available() {
+#ifdef FMM_WITH_CUDA
+  return cuda_device_available();
+#else
+  return false;
+#endif
+}
+
+DeviceUBODT::~DeviceUBODT() {
+#ifdef FMM_WITH_CUDA
+  if (device_slots_ != nullptr) cuda_free_slots(device_slots_);
+#endif
+}
+
+bool DeviceUBODT::look_up_pairs(const std::vector<NodeIndex> &sources,
+                                const std::vector<NodeIndex> &targets,
+                                std::vector<double> *costs) const {
+  long n = sources.size();
+  costs->resize(n);
+  if (n == 0) return true;
+#ifdef FMM_WITH_CUDA
+  if (device_slots_ != nullptr) {
+    if (cuda_look_up_pairs(device_slots_, mask_, sources.data(),
+                           targets.data(), n, costs->data())) {
+      return true;
+    }
+    look_up_host(sources.data(), targets.data(), n, costs->data());
+    return false;
+  }
+#endif
+  look_up_host(sources.data(), targets.data(), n, costs->data());
+  return true;
+}
+
+void DeviceUBODT::look_up_host(const NodeIndex *sources,
+                               const NodeIndex *targets, long n,
+                               double *costs) const {
+  #pragma omp parallel for schedule(static)
+  for (long i = 0; i < n; ++i) {
+    costs[i] = probe_cost_slot(slots_.data(), mask_, sources[i], targets[i]);
+  }
+}
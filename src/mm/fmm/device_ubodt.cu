@@ -0,0 +1,89 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+// Kernels of the device UBODT, compiled if fmm is built WITH_CUDA
+//
+
+#include "mm/fmm/device_kernels.hpp"
+
+#include <cstdio>
+#include <cuda_runtime.h>
+
+namespace FMM {
+namespace MM {
+
+namespace {
+
+// Threads of a block of the look up kernel
+const int BLOCK_THREADS = 256;
+
+bool check(cudaError_t status, const char *call) {
+  if (status == cudaSuccess) return true;
+  std::fprintf(stderr, "CUDA %s failed: %s\n", call,
+               cudaGetErrorString(status));
+  return false;
+}
+
+__global__ void look_up_kernel(const CostSlot *slots,
+                               unsigned long long mask,
+                               const unsigned int *sources,
+                               const unsigned int *targets, long n,
+                               double *costs) {
+  long i = (long) blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < n) costs[i] = probe_cost_slot(slots, mask, sources[i], targets[i]);
+}
+
+} // namespace
+
+bool cuda_device_available() {
+  int count = 0;
+  return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+}
+
+void *cuda_upload_slots(const CostSlot *slots, std::size_t n) {
+  void *device = nullptr;
+  if (!check(cudaMalloc(&device, n * sizeof(CostSlot)), "cudaMalloc")) {
+    return nullptr;
+  }
+  if (!check(cudaMemcpy(device, slots, n * sizeof(CostSlot),
+                        cudaMemcpyHostToDevice), "cudaMemcpy")) {
+    cudaFree(device);
+    return nullptr;
+  }
+  return device;
+}
+
+bool cuda_look_up_pairs(const void *device_slots, unsigned long long mask,
+                        const unsigned int *sources,
+                        const unsigned int *targets, long n,
+                        double *costs) {
+  // The pairs of a batch are copied in and the costs out in one go
+  unsigned int *pairs = nullptr;
+  double *device_costs = nullptr;
+  bool ok = check(cudaMalloc(&pairs, 2 * n * sizeof(unsigned int)),
+                  "cudaMalloc") &&
+      check(cudaMalloc(&device_costs, n * sizeof(double)), "cudaMalloc") &&
+      check(cudaMemcpy(pairs, sources, n * sizeof(unsigned int),
+                       cudaMemcpyHostToDevice), "cudaMemcpy") &&
+      check(cudaMemcpy(pairs + n, targets, n * sizeof(unsigned int),
+                       cudaMemcpyHostToDevice), "cudaMemcpy");
+  if (ok) {
+    long blocks = (n + BLOCK_THREADS - 1) / BLOCK_THREADS;
+    look_up_kernel<<<blocks, BLOCK_THREADS>>>(
+        (const CostSlot *) device_slots, mask, pairs, pairs + n, n,
+        device_costs);
+    ok = check(cudaGetLastError(), "look_up_kernel") &&
+        check(cudaMemcpy(costs, device_costs, n * sizeof(double),
+                         cudaMemcpyDeviceToHost), "cudaMemcpy");
+  }
+  cudaFree(pairs);
+  cudaFree(device_costs);
+  return ok;
+}
+
+void cuda_free_slots(void *device_slots) {
+  cudaFree(device_slots);
+}
+
+} // MM
+} // FMM
@@ -0,0 +1,92 @@
+/**
+ * Fast map matching.
+ *
+ * Copy of the distances of UBODT resident on a GPU, which scores the
+ * transitions of a batch of trajectories at once
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_DEVICE_UBODT_HPP_
+#define FMM_SRC_MM_FMM_DEVICE_UBODT_HPP_
+
+#include "mm/fmm/ubodt.hpp"
+#include "mm/fmm/device_kernels.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Distances of UBODT in a flat open addressing table of 16 byte slots,
+ * copied to the GPU if fmm is built with CUDA (WITH_CUDA) and a device
+ * is found. The distances of a batch of OD pairs are looked up by one
+ * kernel launch, a thread probing each pair. Otherwise the same table
+ * is probed on the host, which is also used to verify the device.
+ *
+ * The paths are still unrolled from the UBODT on the host, so only the
+ * scoring of the transitions is offloaded.
+ */
+class DeviceUBODT {
+ public:
+  /**
+   * Copy the distances of a UBODT whose rows are resident, which
+   * excludes the lazy and tiled layouts
+   * @param  ubodt     UBODT copied
+   * @param  use_device copy the table to the GPU if one is available
+   * @return the table, nullptr if the layout is not supported
+   */
+  static std::unique_ptr<DeviceUBODT> create(const UBODT &ubodt,
+                                             bool use_device = true);
+  /**
+   * Check if fmm is built with CUDA and a device is found
+   */
+  static bool is_device_available();
+  ~DeviceUBODT();
+  DeviceUBODT(const DeviceUBODT &) = delete;
+  DeviceUBODT &operator=(const DeviceUBODT &) = delete;
+  /**
+   * Look up the distances of OD pairs
+   * @param sources source node of each pair
+   * @param targets target node of each pair
+   * @param costs   updated with the distance of each pair, negative if
+   * the pair is not found
+   * @return false if the device fails, where the costs are looked up on
+   * the host instead
+   */
+  bool look_up_pairs(const std::vector<NETWORK::NodeIndex> &sources,
+                     const std::vector<NETWORK::NodeIndex> &targets,
+                     std::vector<double> *costs) const;
+  /**
+   * Check if the table is resident on the GPU
+   */
+  bool on_device() const { return device_slots_ != nullptr; }
+  /**
+   * Get the upper bound of the distances
+   */
+  double get_delta() const { return delta_; }
+  /**
+   * Get the bytes of the table
+   */
+  std::size_t get_bytes() const { return slots_.size() * sizeof(CostSlot); }
+ private:
+  DeviceUBODT() = default;
+  /**
+   * Look up the distances of OD pairs on the host
+   */
+  void look_up_host(const NETWORK::NodeIndex *sources,
+                    const NETWORK::NodeIndex *targets, long n,
+                    double *costs) const;
+  std::vector<CostSlot> slots_;
+  unsigned long long mask_ = 0; // number of slots minus one
+  double delta_ = 0;
+  void *device_slots_ = nullptr;
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_SRC_MM_FMM_DEVICE_UBODT_HPP_
@@ -0,0 +1,297 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/distance_matrix.hpp"
+#include "network/candidate_search.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+namespace {
+
+// Header of the matrix file, followed by the distances
+struct MatrixHeader {
+  char magic[8];
+  unsigned int version;
+  char padding[4];
+  long long rows;
+  long long columns;
+};
+
+const char MATRIX_MAGIC[8] = {'F', 'M', 'M', 'O', 'D', 'M', 'A', 'T'};
+
+// Index each distinct node in the order of its first appearance
+void index_nodes(const std::vector<NodeIndex> &nodes,
+                 std::vector<NodeIndex> *distinct,
+                 std::vector<long> *indices) {
+  std::unordered_map<NodeIndex, long> positions;
+  indices->resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    auto iter = positions.find(nodes[i]);
+    if (iter == positions.end()) {
+      iter = positions.insert({nodes[i], (long) distinct->size()}).first;
+      distinct->push_back(nodes[i]);
+    }
+    (*indices)[i] = iter->second;
+  }
+}
+
+} // namespace
+
+std::vector<Candidate> DistanceMatrix::snap_points(
+    const std::vector<Point> &points, double radius, bool use_omp) const {
+  std::vector<Candidate> candidates(points.size());
+  long n = points.size();
+#pragma omp parallel for schedule(dynamic, 256) if(use_omp)
+  for (long i = 0; i < n; ++i) {
+    LineString geom;
+    geom.add_point(points[i]);
+    CandidateSearchContext &context = CandidateSearchContext::local();
+    if (network_.search_tr_cs_knn(geom, 1, radius, &context, nullptr,
+                                  graph_.get_edge_mask())) {
+      candidates[i] = context.get_candidates()[0];
+    } else {
+      candidates[i] = Candidate{0, 0, 0, nullptr, points[i]};
+    }
+  }
+  return candidates;
+}
+
+std::vector<int> DistanceMatrix::snap_nodes(
+    const std::vector<Point> &points, double radius, bool use_omp) const {
+  std::vector<int> nodes(points.size(), -1);
+  long n = points.size();
+#pragma omp parallel for schedule(dynamic, 256) if(use_omp)
+  for (long i = 0; i < n; ++i) {
+    NodeIndex node;
+    if (network_.snap_to_node(points[i], radius, &node)) nodes[i] = node;
+  }
+  return nodes;
+}
+
+std::vector<double> DistanceMatrix::compute_node_costs(
+    const std::vector<NodeIndex> &origin_nodes,
+    const std::vector<NodeIndex> &destination_nodes, double max_distance,
+    bool use_omp, std::vector<long> *rows, std::vector<long> *columns,
+    long *width, DistanceMatrixStatistics *statistics) const {
+  std::vector<NodeIndex> sources, targets;
+  index_nodes(origin_nodes, &sources, rows);
+  index_nodes(destination_nodes, &targets, columns);
+  long m = targets.size();
+  *width = m;
+  double bound = max_distance > 0 ? max_distance :
+      std::numeric_limits<double>::infinity();
+  bool search = bound > ubodt_->get_delta();
+  std::vector<double> node_costs(sources.size() * m);
+  long ubodt_pairs = 0, searched_pairs = 0, searches = 0;
+  long num_sources = sources.size();
+#pragma omp parallel for schedule(dynamic) if(use_omp) \
+    reduction(+:ubodt_pairs,searched_pairs,searches)
+  for (long i = 0; i < num_sources; ++i) {
+    std::vector<double> row;
+    ubodt_->look_up_many(sources[i], targets, &row);
+    bool missing = false;
+    for (long j = 0; j < m; ++j) {
+      if (sources[i] == targets[j]) {
+        row[j] = 0;
+      } else if (row[j] >= 0) {
+        ++ubodt_pairs;
+      } else {
+        missing = true;
+      }
+    }
+    if (missing && search) {
+      SearchWorkspace &workspace = SearchWorkspace::local();
+      graph_.single_source_upperbound_dijkstra(sources[i], bound,
+                                               &workspace);
+      ++searches;
+      for (long j = 0; j < m; ++j) {
+        if (row[j] >= 0 || !workspace.visited(targets[j])) continue;
+        double dist = workspace.get_distance(targets[j]);
+        if (dist <= bound) {
+          row[j] = dist;
+          ++searched_pairs;
+        }
+      }
+    }
+    std::copy(row.begin(), row.end(), node_costs.begin() + i * m);
+  }
+  if (statistics != nullptr) {
+    statistics->node_pairs = sources.size() * m;
+    statistics->ubodt_pairs = ubodt_pairs;
+    statistics->searched_pairs = searched_pairs;
+    statistics->searches = searches;
+  }
+  return node_costs;
+}
+
+std::vector<double> DistanceMatrix::compute(
+    const std::vector<Candidate> &origins,
+    const std::vector<Candidate> &destinations, double max_distance,
+    bool use_omp, DistanceMatrixStatistics *statistics) const {
+  // An origin leaves its edge at the target node and a destination
+  // enters its edge at the source node
+  std::vector<NodeIndex> origin_nodes, destination_nodes;
+  for (const Candidate &c : origins) {
+    origin_nodes.push_back(c.edge == nullptr ? 0 : c.edge->target);
+  }
+  for (const Candidate &c : destinations) {
+    destination_nodes.push_back(c.edge == nullptr ? 0 : c.edge->source);
+  }
+  std::vector<long> rows, columns;
+  long m = 0;
+  std::vector<double> node_costs = compute_node_costs(
+      origin_nodes, destination_nodes, max_distance, use_omp, &rows,
+      &columns, &m, statistics);
+  long n = destinations.size();
+  std::vector<double> distances(origins.size() * n);
+  long num_origins = origins.size();
+#pragma omp parallel for if(use_omp)
+  for (long i = 0; i < num_origins; ++i) {
+    const Candidate &a = origins[i];
+    const double *row = node_costs.data() + rows[i] * m;
+    for (long j = 0; j < n; ++j) {
+      const Candidate &b = destinations[j];
+      double &dist = distances[i * n + j];
+      if (a.edge == nullptr || b.edge == nullptr) {
+        dist = -1;
+      } else if (a.edge == b.edge && a.offset <= b.offset) {
+        dist = b.offset - a.offset;
+      } else {
+        double cost = row[columns[j]];
+        dist = cost < 0 ? -1 : cost + a.edge->length - a.offset + b.offset;
+      }
+    }
+  }
+  return distances;
+}
+
+std::vector<double> DistanceMatrix::compute_nodes(
+    const std::vector<int> &origins, const std::vector<int> &destinations,
+    double max_distance, bool use_omp,
+    DistanceMatrixStatistics *statistics) const {
+  std::vector<NodeIndex> origin_nodes, destination_nodes;
+  for (int u : origins) origin_nodes.push_back(u < 0 ? 0 : u);
+  for (int v : destinations) destination_nodes.push_back(v < 0 ? 0 : v);
+  std::vector<long> rows, columns;
+  long m = 0;
+  std::vector<double> node_costs = compute_node_costs(
+      origin_nodes, destination_nodes, max_distance, use_omp, &rows,
+      &columns, &m, statistics);
+  long n = destinations.size();
+  std::vector<double> distances(origins.size() * n);
+  long num_origins = origins.size();
+#pragma omp parallel for if(use_omp)
+  for (long i = 0; i < num_origins; ++i) {
+    const double *row = node_costs.data() + rows[i] * m;
+    for (long j = 0; j < n; ++j) {
+      distances[i * n + j] = origins[i] < 0 || destinations[j] < 0 ?
+          -1 : row[columns[j]];
+    }
+  }
+  return distances;
+}
+
+bool DistanceMatrix::read_points(const std::string &filename, char delim,
+                                 std::vector<Point> *points) {
+  std::ifstream ifs(filename);
+  std::string line;
+  if (!std::getline(ifs, line)) {
+    SPDLOG_CRITICAL("Fail to read points from {}", filename);
+    return false;
+  }
+  // Find the columns of the coordinates in the header
+  int x_column = -1, y_column = -1, num_columns = 0;
+  std::string field;
+  std::istringstream header(line);
+  while (std::getline(header, field, delim)) {
+    if (!field.empty() && field.back() == '\r') field.pop_back();
+    if (field == "x") x_column = num_columns;
+    if (field == "y") y_column = num_columns;
+    ++num_columns;
+  }
+  if (x_column < 0 || y_column < 0) {
+    SPDLOG_CRITICAL("Columns x and y not found in {}", filename);
+    return false;
+  }
+  points->clear();
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line == "\r") continue;
+    std::istringstream fields(line);
+    double x = 0, y = 0;
+    int found = 0;
+    for (int column = 0; std::getline(fields, field, delim); ++column) {
+      if (column != x_column && column != y_column) continue;
+      char *end = nullptr;
+      double value = std::strtod(field.c_str(), &end);
+      if (end == field.c_str()) break;
+      (column == x_column ? x : y) = value;
+      ++found;
+    }
+    if (found != 2) {
+      SPDLOG_CRITICAL("Invalid point at line {} of {}", points->size() + 2,
+                      filename);
+      return false;
+    }
+    points->push_back(Point(x, y));
+  }
+  SPDLOG_INFO("Read {} points from {}", points->size(), filename);
+  return true;
+}
+
+bool DistanceMatrix::write_matrix(const std::string &filename, long rows,
+                                  long columns,
+                                  const std::vector<double> &distances) {
+  std::ofstream ofs(filename, std::ios::binary);
+  MatrixHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC));
+  header.version = MATRIX_VERSION;
+  header.rows = rows;
+  header.columns = columns;
+  ofs.write((const char *) &header, sizeof(header));
+  ofs.write((const char *) distances.data(),
+            sizeof(double) * distances.size());
+  if (!ofs.good()) {
+    SPDLOG_CRITICAL("Fail to write matrix {}", filename);
+    return false;
+  }
+  SPDLOG_INFO("Write matrix of {} x {} to {}", rows, columns, filename);
+  return true;
+}
+
+bool DistanceMatrix::read_matrix(const std::string &filename, long *rows,
+                                 long *columns,
+                                 std::vector<double> *distances) {
+  std::ifstream ifs(filename, std::ios::binary);
+  MatrixHeader header;
+  ifs.read((char *) &header, sizeof(header));
+  if (!ifs.good() ||
+      memcmp(header.magic, MATRIX_MAGIC, sizeof(MATRIX_MAGIC)) != 0 ||
+      header.version != MATRIX_VERSION || header.rows < 0 ||
+      header.columns < 0) {
+    SPDLOG_CRITICAL("Invalid matrix file {}", filename);
+    return false;
+  }
+  *rows = header.rows;
+  *columns = header.columns;
+  distances->resize(header.rows * header.columns);
+  ifs.read((char *) distances->data(), sizeof(double) * distances->size());
+  if (ifs.gcount() != (std::streamsize) (sizeof(double) * distances->size())) {
+    SPDLOG_CRITICAL("Truncated matrix file {}", filename);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,167 @@
+/**
+ * Fast map matching.
+ *
+ * Network distances between two sets of points snapped to the network
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_DISTANCE_MATRIX_HPP_
+#define FMM_SRC_MM_FMM_DISTANCE_MATRIX_HPP_
+
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "mm/fmm/ubodt.hpp"
+#include "mm/mm_type.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Counters of the computation of a distance matrix
+ */
+struct DistanceMatrixStatistics {
+  long node_pairs = 0; /**< Pairs of the nodes routed between */
+  long ubodt_pairs = 0; /**< Node pairs found in UBODT */
+  long searched_pairs = 0; /**< Node pairs found by the searches */
+  long searches = 0; /**< One to many searches run for the node pairs
+                          missing in UBODT */
+};
+
+/**
+ * Matrix of the network distances from a set of origins to a set of
+ * destinations, where each point is snapped to its nearest edge.
+ *
+ * The distances are routed between the end node of the edge of each
+ * origin and the start node of the edge of each destination, so that
+ * the points on the same edges share their routing. The node pairs are
+ * looked up in UBODT first, and a one to many search from a source
+ * finds all of its pairs missing at once.
+ */
+class DistanceMatrix {
+ public:
+  /**
+   * Create a distance matrix calculator
+   * @param network network
+   * @param graph   graph of the network
+   * @param ubodt   UBODT of the graph
+   */
+  DistanceMatrix(const NETWORK::Network &network,
+                 const NETWORK::NetworkGraph &graph,
+                 std::shared_ptr<UBODT> ubodt) :
+      network_(network), graph_(graph), ubodt_(ubodt) {};
+  /**
+   * Snap points to their nearest edges
+   * @param  points  points snapped
+   * @param  radius  search radius
+   * @param  use_omp whether snap the points parallelly
+   * @return the candidate of each point, whose edge is nullptr if no
+   * edge is found within the radius
+   */
+  std::vector<Candidate> snap_points(const std::vector<CORE::Point> &points,
+                                     double radius, bool use_omp) const;
+  /**
+   * Snap points to their nearest nodes with the node rtree of the
+   * network, which is faster than snapping them to edges when the points
+   * are at the junctions, such as the stops of a fleet
+   * @param  points  points snapped
+   * @param  radius  search radius
+   * @param  use_omp whether snap the points parallelly
+   * @return the node index of each point, -1 if no node is found within
+   * the radius
+   */
+  std::vector<int> snap_nodes(const std::vector<CORE::Point> &points,
+                              double radius, bool use_omp) const;
+  /**
+   * Compute the distances from origins to destinations
+   * @param  origins      candidates of the origins
+   * @param  destinations candidates of the destinations
+   * @param  max_distance upper bound of the searches of the node pairs
+   * missing in UBODT, 0 for no bound. No search is run if it is not
+   * larger than the delta of UBODT.
+   * @param  use_omp      whether compute parallelly
+   * @param  statistics   if not nullptr, updated with the counters
+   * @return the distance from origin i to destination j stored at
+   * i * destinations.size() + j, which is -1 if a point is not snapped
+   * or the destination is not reached
+   */
+  std::vector<double> compute(
+      const std::vector<Candidate> &origins,
+      const std::vector<Candidate> &destinations, double max_distance,
+      bool use_omp, DistanceMatrixStatistics *statistics = nullptr) const;
+  /**
+   * Compute the distances from origin nodes to destination nodes
+   * @param  origins      node index of the origins, -1 if not snapped
+   * @param  destinations node index of the destinations, -1 if not
+   * snapped
+   * @param  max_distance upper bound of the searches as in compute
+   * @param  use_omp      whether compute parallelly
+   * @param  statistics   if not nullptr, updated with the counters
+   * @return the distance from origin i to destination j stored at
+   * i * destinations.size() + j, which is -1 if a point is not snapped
+   * or the destination is not reached
+   */
+  std::vector<double> compute_nodes(
+      const std::vector<int> &origins, const std::vector<int> &destinations,
+      double max_distance, bool use_omp,
+      DistanceMatrixStatistics *statistics = nullptr) const;
+  /**
+   * Read points from a CSV file with a header, whose x and y columns
+   * store the coordinates
+   * @param  filename input file
+   * @param  delim    delimiter of the columns
+   * @param  points   updated with the points
+   * @return false if the file or its header is invalid
+   */
+  static bool read_points(const std::string &filename, char delim,
+                          std::vector<CORE::Point> *points);
+  /**
+   * Write a matrix to a binary file, with a header of the magic
+   * FMMODMAT, the version and the numbers of rows and columns followed by
+   * the distances in row major order as 64-bit floats
+   * @param  filename  output file
+   * @param  rows      number of rows
+   * @param  columns   number of columns
+   * @param  distances distances of the matrix
+   * @return true if the file is written successfully
+   */
+  static bool write_matrix(const std::string &filename, long rows,
+                           long columns, const std::vector<double> &distances);
+  /**
+   * Read a matrix written by write_matrix
+   * @param  filename  input file
+   * @param  rows      updated with the number of rows
+   * @param  columns   updated with the number of columns
+   * @param  distances updated with the distances
+   * @return false if the file is invalid
+   */
+  static bool read_matrix(const std::string &filename, long *rows,
+                          long *columns, std::vector<double> *distances);
+  static const unsigned int MATRIX_VERSION = 1; /**< Version of the matrix
+                                                  file format */
+ private:
+  /**
+   * Compute the costs between the distinct origin and destination nodes,
+   * where the cost of the pair of origin i and destination j is stored at
+   * rows[i] * width + columns[j]
+   */
+  std::vector<double> compute_node_costs(
+      const std::vector<NETWORK::NodeIndex> &origin_nodes,
+      const std::vector<NETWORK::NodeIndex> &destination_nodes,
+      double max_distance, bool use_omp, std::vector<long> *rows,
+      std::vector<long> *columns, long *width,
+      DistanceMatrixStatistics *statistics) const;
+  const NETWORK::Network &network_;
+  const NETWORK::NetworkGraph &graph_;
+  std::shared_ptr<UBODT> ubodt_;
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_SRC_MM_FMM_DISTANCE_MATRIX_HPP_
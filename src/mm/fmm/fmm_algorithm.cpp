@@ -3,10 +3,20 @@
 //
 
 #include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/transition_kernel.hpp"
 #include "algorithm/geom_algorithm.hpp"
 #include "util/util.hpp"
+#include "util/stage_profile.hpp"
+#include "util/tile_profile.hpp"
 #include "util/debug.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <omp.h>
+
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
@@ -21,6 +31,21 @@ FastMapMatchConfig::FastMapMatchConfig(int k_arg, double r_arg,
 void FastMapMatchConfig::print() const {
   SPDLOG_INFO("FMMAlgorithmConfig");
   SPDLOG_INFO("k {} radius {} gps_error {}", k, radius, gps_error);
+  SPDLOG_INFO("min_ep_ratio {} max_dist_ratio {} adaptive_k_spacing {}",
+              min_ep_ratio, max_dist_ratio, adaptive_k_spacing);
+  SPDLOG_INFO("max_heading_diff {} min_heading_distance {}",
+              max_heading_diff, min_heading_distance);
+  SPDLOG_INFO("beam_size {} beam_margin {}", beam_size, beam_margin);
+  SPDLOG_INFO("split {} max_time_gap {}", split, max_time_gap);
+  SPDLOG_INFO("parallel_viterbi {}", parallel_viterbi);
+  SPDLOG_INFO("stationary_radius {} min_distance {} min_interval {}",
+              stationary_radius, min_distance, min_interval);
+  SPDLOG_INFO("coarse_step {} corridor_buffer {} corridor_k {}",
+              coarse_step, corridor_buffer, corridor_k);
+  SPDLOG_INFO("approximate_ep {}", approximate_ep);
+  SPDLOG_INFO("max_seconds {} max_transitions {}",
+              max_seconds, max_transitions);
+  if (!metric.empty()) SPDLOG_INFO("metric {}", metric);
 };
 
 FastMapMatchConfig FastMapMatchConfig::load_from_xml(
@@ -28,7 +53,39 @@ FastMapMatchConfig FastMapMatchConfig::load_from_xml(
   int k = xml_data.get("config.parameters.k", 8);
   double radius = xml_data.get("config.parameters.r", 300.0);
   double gps_error = xml_data.get("config.parameters.gps_error", 50.0);
-  return FastMapMatchConfig{k, radius, gps_error};
+  FastMapMatchConfig config{k, radius, gps_error};
+  config.min_ep_ratio = xml_data.get("config.parameters.min_ep_ratio", 0.0);
+  config.max_dist_ratio =
+      xml_data.get("config.parameters.max_dist_ratio", 0.0);
+  config.adaptive_k_spacing =
+      xml_data.get("config.parameters.adaptive_k_spacing", 0.0);
+  config.max_heading_diff =
+      xml_data.get("config.parameters.max_heading_diff", 0.0);
+  config.min_heading_distance =
+      xml_data.get("config.parameters.min_heading_distance", 0.0);
+  config.beam_size = xml_data.get("config.parameters.beam_size", 0);
+  config.beam_margin = xml_data.get("config.parameters.beam_margin", 0.0);
+  config.split = !(!xml_data.get_child_optional("config.parameters.split"));
+  config.max_time_gap =
+      xml_data.get("config.parameters.max_time_gap", 0.0);
+  config.parallel_viterbi =
+      xml_data.get("config.parameters.parallel_viterbi", 0);
+  config.stationary_radius =
+      xml_data.get("config.parameters.stationary_radius", 0.0);
+  config.min_distance = xml_data.get("config.parameters.min_distance", 0.0);
+  config.min_interval = xml_data.get("config.parameters.min_interval", 0.0);
+  config.coarse_step = xml_data.get("config.parameters.coarse_step", 0);
+  config.corridor_buffer =
+      xml_data.get("config.parameters.corridor_buffer", 0.0);
+  config.corridor_k = xml_data.get("config.parameters.corridor_k", 0);
+  config.approximate_ep =
+      !(!xml_data.get_child_optional("config.parameters.approximate_ep"));
+  config.max_seconds = xml_data.get("config.parameters.max_seconds", 0.0);
+  config.max_transitions =
+      xml_data.get("config.parameters.max_transitions", 0L);
+  config.metric =
+      xml_data.get("config.parameters.metric", std::string(""));
+  return config;
 };
 
 FastMapMatchConfig FastMapMatchConfig::load_from_arg(
@@ -36,59 +93,423 @@ FastMapMatchConfig FastMapMatchConfig::load_from_arg(
   int k = arg_data["candidates"].as<int>();
   double radius = arg_data["radius"].as<double>();
   double gps_error = arg_data["error"].as<double>();
-  return FastMapMatchConfig{k, radius, gps_error};
+  FastMapMatchConfig config{k, radius, gps_error};
+  config.min_ep_ratio = arg_data["min_ep_ratio"].as<double>();
+  config.max_dist_ratio = arg_data["max_dist_ratio"].as<double>();
+  config.adaptive_k_spacing = arg_data["adaptive_k_spacing"].as<double>();
+  config.max_heading_diff = arg_data["max_heading_diff"].as<double>();
+  config.min_heading_distance =
+      arg_data["min_heading_distance"].as<double>();
+  config.beam_size = arg_data["beam_size"].as<int>();
+  config.beam_margin = arg_data["beam_margin"].as<double>();
+  config.split = arg_data.count("split") > 0;
+  config.max_time_gap = arg_data["max_time_gap"].as<double>();
+  config.parallel_viterbi = arg_data["parallel_viterbi"].as<int>();
+  config.stationary_radius = arg_data["stationary_radius"].as<double>();
+  config.min_distance = arg_data["min_distance"].as<double>();
+  config.min_interval = arg_data["min_interval"].as<double>();
+  config.coarse_step = arg_data["coarse_step"].as<int>();
+  config.corridor_buffer = arg_data["corridor_buffer"].as<double>();
+  config.corridor_k = arg_data["corridor_k"].as<int>();
+  config.approximate_ep = arg_data.count("approximate_ep") > 0;
+  config.max_seconds = arg_data["max_seconds"].as<double>();
+  config.max_transitions = arg_data["max_transitions"].as<long>();
+  if (arg_data.count("metric") > 0) {
+    config.metric = arg_data["metric"].as<std::string>();
+  }
+  return config;
 };
 
+NETWORK::CandidatePruning FastMapMatchConfig::get_candidate_pruning() const {
+  NETWORK::CandidatePruning pruning;
+  pruning.gps_error = gps_error;
+  pruning.min_ep_ratio = min_ep_ratio;
+  pruning.max_dist_ratio = max_dist_ratio;
+  pruning.adaptive_k_spacing = adaptive_k_spacing;
+  pruning.max_heading_diff = max_heading_diff;
+  pruning.min_heading_distance = min_heading_distance;
+  return pruning;
+}
+
+ViterbiBeam FastMapMatchConfig::get_viterbi_beam() const {
+  ViterbiBeam beam;
+  beam.beam_size = beam_size;
+  beam.beam_margin = beam_margin;
+  return beam;
+}
+
+TrajectorySplit FastMapMatchConfig::get_trajectory_split() const {
+  TrajectorySplit options;
+  options.enabled = split;
+  options.max_time_gap = max_time_gap;
+  return options;
+}
+
+PointFilter FastMapMatchConfig::get_point_filter() const {
+  PointFilter filter;
+  filter.stationary_radius = stationary_radius;
+  filter.min_distance = min_distance;
+  filter.min_interval = min_interval;
+  return filter;
+}
+
+MatchBudget FastMapMatchConfig::get_match_budget() const {
+  MatchBudget budget;
+  budget.max_seconds = max_seconds;
+  budget.max_transitions = max_transitions;
+  return budget;
+}
+
 bool FastMapMatchConfig::validate() const {
   if (gps_error <= 0 || radius <= 0 || k <= 0) {
     SPDLOG_CRITICAL("Invalid mm parameter k {} r {} gps error {}",
                     k, radius, gps_error);
     return false;
   }
+  if (min_ep_ratio < 0 || min_ep_ratio > 1 ||
+      (max_dist_ratio != 0 && max_dist_ratio < 1) ||
+      adaptive_k_spacing < 0) {
+    SPDLOG_CRITICAL("Invalid pruning parameter min_ep_ratio {} "
+                    "max_dist_ratio {} adaptive_k_spacing {}",
+                    min_ep_ratio, max_dist_ratio, adaptive_k_spacing);
+    return false;
+  }
+  if (max_heading_diff < 0 || max_heading_diff > 180 ||
+      min_heading_distance < 0) {
+    SPDLOG_CRITICAL("Invalid heading parameter max_heading_diff {} "
+                    "min_heading_distance {}",
+                    max_heading_diff, min_heading_distance);
+    return false;
+  }
+  if (stationary_radius < 0 || min_distance < 0 || min_interval < 0) {
+    SPDLOG_CRITICAL("Invalid filter parameter stationary_radius {} "
+                    "min_distance {} min_interval {}",
+                    stationary_radius, min_distance, min_interval);
+    return false;
+  }
+  if (coarse_step < 0 || corridor_buffer < 0 || corridor_k < 0) {
+    SPDLOG_CRITICAL("Invalid coarse to fine parameter coarse_step {} "
+                    "corridor_buffer {} corridor_k {}",
+                    coarse_step, corridor_buffer, corridor_k);
+    return false;
+  }
+  if (parallel_viterbi < 0) {
+    SPDLOG_CRITICAL("Invalid parallel_viterbi {}", parallel_viterbi);
+    return false;
+  }
+  if (beam_size < 0 || beam_margin < 0) {
+    SPDLOG_CRITICAL("Invalid beam parameter beam_size {} beam_margin {}",
+                    beam_size, beam_margin);
+    return false;
+  }
+  if (max_time_gap < 0) {
+    SPDLOG_CRITICAL("Invalid split parameter max_time_gap {}",
+                    max_time_gap);
+    return false;
+  }
+  if (max_seconds < 0 || max_transitions < 0) {
+    SPDLOG_CRITICAL("Invalid budget parameter max_seconds {} "
+                    "max_transitions {}", max_seconds, max_transitions);
+    return false;
+  }
   return true;
 }
 
 MatchResult FastMapMatch::match_traj(const Trajectory &traj,
-                       const FastMapMatchConfig &config) {
+                       const FastMapMatchConfig &config,
+                       MatchWorkspace *workspace) {
+  MatchWorkspace &ws =
+      workspace != nullptr ? *workspace : MatchWorkspace::local();
+  // Matched in the local projection of the network, if any
+  const LocalProjection &projection = network_.get_projection();
+  BudgetMeter meter(config.get_match_budget());
+  MatchResult result = match_filtered(
+      projection.forward(traj, &ws.projected), config, nullptr, &meter, &ws);
+  projection.inverse(&result);
+  return result;
+}
+
+std::vector<SegmentMatchResult> FastMapMatch::match_traj_segments(
+    const Trajectory &traj, const FastMapMatchConfig &config) {
+  const LocalProjection &projection = network_.get_projection();
+  Trajectory projected;
+  // The segments share the budget of the trajectory. They may be matched
+  // by other threads, each with its own workspace.
+  BudgetMeter meter(config.get_match_budget());
+  std::vector<SegmentMatchResult> segments = match_segments(
+      projection.forward(traj, &projected), config.get_trajectory_split(),
+      [this, &config, &meter](const Trajectory &segment,
+                              TrajectoryBreak *brk) {
+        return match_filtered(segment, config, brk, &meter,
+                              &MatchWorkspace::local());
+      });
+  for (SegmentMatchResult &segment : segments) {
+    projection.inverse(&segment.result);
+  }
+  return segments;
+}
+
+MatchResult FastMapMatch::match_filtered(const Trajectory &traj,
+                                         const FastMapMatchConfig &config,
+                                         TrajectoryBreak *brk,
+                                         BudgetMeter *meter,
+                                         MatchWorkspace *workspace) {
+  PointFilter filter = config.get_point_filter();
+  if (!filter.is_enabled()) {
+    return match_segment(traj, config, brk, meter, workspace);
+  }
+  FilteredTrajectory filtered = filter_points(traj, filter);
+  SPDLOG_TRACE("Points kept {} of {}", filtered.points.size(),
+               traj.geom.get_num_points());
+  MatchResult result = match_segment(filtered.traj, config, brk, meter,
+                                     workspace);
+  // The break is reported at the original point
+  if (brk != nullptr && brk->point >= 0) {
+    brk->point = filtered.points[brk->point];
+  }
+  return expand_result(result, filtered);
+}
+
+MatchResult FastMapMatch::match_segment(const Trajectory &traj,
+                                        const FastMapMatchConfig &config,
+                                        TrajectoryBreak *brk,
+                                        BudgetMeter *meter,
+                                        MatchWorkspace *workspace) {
   SPDLOG_TRACE("Count of points in trajectory {}", traj.geom.get_num_points());
+  // The coarse pass is profiled by its own clock
+  bool in_corridor = find_corridor(traj, config, meter, workspace);
   SPDLOG_TRACE("Search candidates");
-  Traj_Candidates tc = network_.search_tr_cs_knn(
-      traj.geom, config.k, config.radius);
-  SPDLOG_TRACE("Trajectory candidate {}", tc);
-  if (tc.empty()) return MatchResult{};
+  // The candidates are stored in the workspace, which is not reused
+  // before the end of the matching
+  UTIL::StageClock clock;
+  bool tiled = UTIL::TileProfile::is_enabled();
+  UTIL::TimePoint tile_begin;
+  if (tiled) tile_begin = std::chrono::steady_clock::now();
+  CandidateSearchContext &context = workspace->context;
+  int k = config.k;
+  bool found = false;
+  if (in_corridor) {
+    if (config.corridor_k > 0) k = config.corridor_k;
+    found = network_.search_tr_cs_knn(traj.geom, k, config.radius,
+                                      &context, &workspace->corridor,
+                                      graph_.get_edge_mask());
+    // A point out of the corridor, such as a detour skipped by the
+    // coarse pass, falls back to all the edges
+    if (!found) k = config.k;
+  }
+  if (!found &&
+      !network_.search_tr_cs_knn(traj.geom, k, config.radius, &context,
+                                 nullptr, graph_.get_edge_mask())) {
+    clock.lap(UTIL::STAGE_SEARCH);
+    if (brk != nullptr) {
+      brk->point = context.get_missing_point();
+      brk->skip = true;
+    }
+    return MatchResult{};
+  }
+  std::vector<UTIL::TileCounters> &tiles = workspace->tiles;
+  if (tiled) {
+    tiles.assign(context.get_num_points(), UTIL::TileCounters());
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+      tiles[i].points = 1;
+      tiles[i].candidates = context.get_point_candidates(i).size();
+    }
+  }
+  context.prune(traj.geom, k, config.get_candidate_pruning());
+  clock.lap(UTIL::STAGE_SEARCH);
+  SPDLOG_TRACE("Trajectory candidate {}", context.to_traj_candidates());
   SPDLOG_TRACE("Generate transition graph");
-  TransitionGraph tg(tc, config.gps_error);
+  TransitionGraph &tg = workspace->tg;
+  tg.reset(context, config.gps_error, config.approximate_ep);
+  clock.lap(UTIL::STAGE_TRANSITION_GRAPH);
+  if (tiled) {
+    // The search and the transition graph are shared by the points
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - tile_begin).count() /
+        tiles.size();
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+      tiles[i].kept = context.get_point_candidates(i).size();
+      tiles[i].seconds = seconds;
+    }
+  }
   SPDLOG_TRACE("Update cost in transition graph");
   // The network will be used internally to update transition graph
-  update_tg(&tg, traj, config);
+  bool partial = !update_tg(&tg, traj, config, meter, workspace);
+  collect_memo_statistics(&workspace->transitions);
+  if (tiled) UTIL::TileProfile::local().add(traj.geom, tiles);
+  if (partial) {
+    SPDLOG_DEBUG("Traj {} budget ran out at point {}", traj.id,
+                 tg.get_layers().size());
+  }
   SPDLOG_TRACE("Optimal path inference");
-  TGOpath tg_opath = tg.backtrack();
+  clock.lap(UTIL::STAGE_UPDATE_TG);
+  return build_result(&tg, traj, config, partial, brk, &clock, workspace);
+}
+
+std::vector<MatchResult> FastMapMatch::match_traj_sweep(
+    const Trajectory &traj, const FastMapMatchConfig &config,
+    const std::vector<SweepSetting> &settings, SweepReport *report) {
+  std::vector<MatchResult> results(settings.size());
+  if (settings.empty()) return results;
+  MatchWorkspace &ws = MatchWorkspace::local();
+  const LocalProjection &projection = network_.get_projection();
+  const Trajectory &projected = projection.forward(traj, &ws.projected);
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  int max_k = 0;
+  double max_radius = 0;
+  for (const SweepSetting &setting : settings) {
+    max_k = std::max(max_k, setting.k);
+    max_radius = std::max(max_radius, setting.radius);
+  }
+  int N = projected.geom.get_num_points();
+  std::vector<double> &eu_dists = ws.eu_dists;
+  ALGORITHM::cal_eu_dist(projected.geom, &eu_dists);
+  scale_eu_dists(&eu_dists);
+  // The distances of the largest setting are shared by the settings
+  CandidateSearchContext &context = ws.context;
+  static thread_local SweepDistances distances;
+  bool found = network_.search_tr_cs_knn(projected.geom, max_k, max_radius,
+                                         &context, nullptr,
+                                         graph_.get_edge_mask());
+  if (found) {
+    TransitionGraph &tg = ws.tg;
+    tg.reset(context, config.gps_error);
+    std::vector<TGLayer> &layers = tg.get_layers();
+    distances.reset(context);
+    for (int i = 0; i < N - 1; ++i) {
+      get_sp_dists(layers[i], layers[i + 1], distances.get_layer(i));
+    }
+  }
+  if (report != nullptr) {
+    report->add_shared(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count());
+  }
+  static thread_local CandidateSearchContext selected;
+  static thread_local TransitionGraph setting_tg;
+  for (std::size_t s = 0; s < settings.size(); ++s) {
+    begin = std::chrono::steady_clock::now();
+    const SweepSetting &setting = settings[s];
+    FastMapMatchConfig setting_config = config;
+    setting_config.k = setting.k;
+    setting_config.radius = setting.radius;
+    setting_config.gps_error = setting.gps_error;
+    MatchResult &result = results[s];
+    if (found && selected.select(context, setting.k, setting.radius)) {
+      selected.prune(projected.geom, setting.k,
+                     setting_config.get_candidate_pruning());
+      setting_tg.reset(selected, setting.gps_error,
+                       setting_config.approximate_ep);
+      // A node takes the last predecessor tied, as in update_tg
+      distances.relax(&setting_tg, eu_dists, nullptr,
+                      setting_config.get_viterbi_beam(), true);
+      UTIL::StageClock clock;
+      result = build_result(&setting_tg, projected, setting_config, false,
+                            nullptr, &clock, &ws);
+      projection.inverse(&result);
+    } else {
+      result = MatchResult{};
+      result.id = traj.id;
+    }
+    if (report != nullptr) {
+      report->add(s, result, N, std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - begin).count());
+    }
+  }
+  return results;
+}
+
+bool FastMapMatch::find_corridor(const Trajectory &traj,
+                                 const FastMapMatchConfig &config,
+                                 BudgetMeter *meter,
+                                 MatchWorkspace *workspace) {
+  int step = config.coarse_step;
+  int num_points = traj.geom.get_num_points();
+  if (step <= 1 || num_points <= 2 * step) return false;
+  Trajectory &coarse = workspace->coarse;
+  coarse.id = traj.id;
+  coarse.geom.clear();
+  coarse.timestamps.clear();
+  bool timed = (int) traj.timestamps.size() == num_points;
+  // The last point is kept, so that the path covers the whole trajectory
+  for (int i = 0; i < num_points; i += step) {
+    int j = i + step < num_points ? i : num_points - 1;
+    coarse.geom.add_point(traj.geom.get_x(j), traj.geom.get_y(j));
+    if (timed) coarse.timestamps.push_back(traj.timestamps[j]);
+  }
+  FastMapMatchConfig coarse_config = config;
+  coarse_config.coarse_step = 0;
+  // Only the complete path of the coarse pass is used
+  coarse_config.result_fields.candidates = false;
+  coarse_config.result_fields.mgeom = false;
+  coarse_config.result_fields.timestamps = false;
+  MatchResult result = match_segment(coarse, coarse_config, nullptr, meter,
+                                     workspace);
+  if (result.cpath.empty()) return false;
+  network_.get_corridor_edges(workspace->index_path, config.corridor_buffer,
+                              &workspace->corridor);
+  SPDLOG_TRACE("Traj {} corridor of {} edges around a path of {}",
+               traj.id, workspace->corridor.size(),
+               workspace->index_path.size());
+  return true;
+}
+
+MatchResult FastMapMatch::build_result(TransitionGraph *tg_ptr,
+                                       const Trajectory &traj,
+                                       const FastMapMatchConfig &config,
+                                       bool partial, TrajectoryBreak *brk,
+                                       UTIL::StageClock *clock_ptr,
+                                       MatchWorkspace *workspace) {
+  TransitionGraph &tg = *tg_ptr;
+  UTIL::StageClock &clock = *clock_ptr;
+  TGOpath &tg_opath = workspace->tg_opath;
+  tg.backtrack(&tg_opath);
   SPDLOG_TRACE("Optimal path size {}", tg_opath.size());
-  MatchedCandidatePath matched_candidate_path(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 matched_candidate_path.begin(),
-                 [](const TGNode *a) {
-                   return MatchedCandidate{
-                       *(a->c), a->ep, a->tp, a->sp_dist
-                   };
-                 });
-  O_Path opath(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 opath.begin(),
-                 [](const TGNode *a) {
-                   return a->c->edge->id;
-                 });
+  MatchedCandidatePath matched_candidate_path;
+  O_Path opath;
+  // The candidates are also needed to expand the result of the points
+  // filtered
+  if (config.result_fields.candidates ||
+      config.get_point_filter().is_enabled()) {
+    matched_candidate_path.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   matched_candidate_path.begin(),
+                   [](const TGNode *a) {
+                     return MatchedCandidate{
+                         *(a->c), a->ep, a->tp, a->sp_dist
+                     };
+                   });
+    opath.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   opath.begin(),
+                   [](const TGNode *a) {
+                     return a->c->edge->id;
+                   });
+  }
+  clock.lap(UTIL::STAGE_BACKTRACK);
   std::vector<int> indices;
+  std::vector<EdgeIndex> &index_path = workspace->index_path;
   const std::vector<Edge> &edges = network_.get_edges();
   C_Path cpath = ubodt_->construct_complete_path(tg_opath, edges,
-                                                 &indices);
+                                                 &indices, &index_path);
+  if (brk != nullptr && cpath.empty()) {
+    brk->point = tg_opath.empty() ? tg.find_unreachable_layer() :
+                 find_break(tg_opath);
+  }
   SPDLOG_TRACE("Cpath {}", cpath);
   SPDLOG_TRACE("Complete path inference");
-  LineString mgeom = network_.complete_path_to_geometry(
-      traj.geom, cpath);
+  clock.lap(UTIL::STAGE_CPATH);
+  LineString mgeom;
+  if (config.result_fields.mgeom) {
+    // A partial result ends at the last point matched
+    mgeom = partial ? network_.complete_path_to_geometry(
+        get_prefix(traj.geom, tg.get_layers().size()), index_path) :
+        network_.complete_path_to_geometry(traj.geom, index_path);
+  }
+  clock.lap(UTIL::STAGE_GEOMETRY);
   SPDLOG_TRACE("Complete path inference done");
   return MatchResult{
-      traj.id, matched_candidate_path, opath, cpath, indices, mgeom};
+      traj.id, matched_candidate_path, opath, cpath, indices, mgeom,
+      partial};
 }
 
 PyMatchResult FastMapMatch::match_wkt(
@@ -96,7 +517,478 @@ PyMatchResult FastMapMatch::match_wkt(
   LineString line = wkt2linestring(wkt);
   std::vector<double> timestamps;
   Trajectory traj{0, line, timestamps};
-  MatchResult result = match_traj(traj, config);
+  return to_py_result(match_traj(traj, config));
+};
+
+std::vector<MatchResult> FastMapMatch::match_traj_batch(
+    const std::vector<Trajectory> &trajs, const FastMapMatchConfig &config,
+    int num_threads) {
+  int N = trajs.size();
+  std::vector<MatchResult> results(N);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+  for (int i = 0; i < N; ++i) {
+    results[i] = match_traj(trajs[i], config);
+  }
+  return results;
+};
+
+// Matching of a trajectory advanced one layer at a time, which is a state
+// machine yielding between the planning of the probes of a layer and
+// their look up. The steps are the ones of match_traj.
+class FastMapMatch::InterleavedTask {
+ public:
+  InterleavedTask(FastMapMatch *model, const FastMapMatchConfig &config)
+      : model_(*model), config_(config) {
+  };
+  // Start the matching of a trajectory, up to the prefetch of the probes
+  // of its first layer
+  void start(const Trajectory &traj, int index) {
+    index_ = index;
+    finished_ = false;
+    partial_ = false;
+    meter_.reset(new BudgetMeter(config_.get_match_budget()));
+    workspace_.transitions.clear();
+    probes_.memo = &workspace_.transitions;
+    UTIL::StageClock clock;
+    const Trajectory &projected = model_.network_.get_projection().forward(
+        traj, &workspace_.projected);
+    PointFilter filter = config_.get_point_filter();
+    filtering_ = filter.is_enabled();
+    if (filtering_) filtered_ = filter_points(projected, filter);
+    traj_ = filtering_ ? &filtered_.traj : &projected;
+    CandidateSearchContext &context = workspace_.context;
+    if (!model_.network_.search_tr_cs_knn(traj_->geom, config_.k,
+                                          config_.radius, &context, nullptr,
+                                          model_.graph_.get_edge_mask())) {
+      clock.lap(UTIL::STAGE_SEARCH);
+      finish(MatchResult{});
+      return;
+    }
+    context.prune(traj_->geom, config_.k, config_.get_candidate_pruning());
+    clock.lap(UTIL::STAGE_SEARCH);
+    TransitionGraph &tg = workspace_.tg;
+    tg.reset(context, config_.gps_error, config_.approximate_ep);
+    ALGORITHM::cal_eu_dist(traj_->geom, &workspace_.eu_dists);
+    model_.scale_eu_dists(&workspace_.eu_dists);
+    beam_ = config_.get_viterbi_beam();
+    if (beam_.is_enabled()) tg.reset_log_space();
+    clock.lap(UTIL::STAGE_TRANSITION_GRAPH);
+    level_ = 0;
+    plan();
+  };
+  // Look up the probes of the layer planned and plan the next one
+  void step() {
+    UTIL::StageClock clock;
+    std::vector<TGLayer> &layers = workspace_.tg.get_layers();
+    model_.probe_layer(&(layers[level_ + 1]), workspace_.eu_dists[level_],
+                       workspace_.tg.is_log_space(), &probes_);
+    clock.lap(UTIL::STAGE_UPDATE_TG);
+    advance();
+  };
+  // Look up the probes of the layer planned, leaving layer b to update
+  void resolve() {
+    UTIL::StageClock clock;
+    model_.resolve_probes(workspace_.tg.get_layers()[level_ + 1],
+                          &probes_);
+    clock.lap(UTIL::STAGE_UPDATE_TG);
+  };
+  // Move to the next layer once layer b is updated and plan it
+  void advance() {
+    std::vector<TGLayer> &layers = workspace_.tg.get_layers();
+    meter_->add_transitions(layers[level_].size() *
+                            layers[level_ + 1].size());
+    ++level_;
+    plan();
+  };
+  // Update layers b of several tasks resolved together, with a lane for
+  // each task
+  static void relax_lanes(const std::vector<InterleavedTask *> &tasks);
+  bool is_finished() const {
+    return finished_;
+  };
+  // Check if the result of a trajectory finished is not taken yet
+  bool has_result() const {
+    return finished_ && index_ >= 0;
+  };
+  // Take the result into the results of the trajectories
+  void take_result(std::vector<MatchResult> *results) {
+    (*results)[index_] = std::move(result_);
+    result_ = MatchResult{};
+    index_ = -1;
+  };
+ private:
+  // Plan the probes of the current layer and prefetch their slots, or
+  // build the result after the last layer or when the budget runs out
+  void plan() {
+    UTIL::StageClock clock;
+    TransitionGraph &tg = workspace_.tg;
+    std::vector<TGLayer> &layers = tg.get_layers();
+    int N = layers.size();
+    if (level_ < N - 1 && meter_->is_exhausted()) {
+      SPDLOG_DEBUG("Traj {} budget ran out at point {}", traj_->id,
+                   level_ + 1);
+      layers.resize(level_ + 1);
+      partial_ = true;
+    }
+    if (level_ >= (int) layers.size() - 1) {
+      finish(model_.build_result(&tg, *traj_, config_, partial_, nullptr,
+                                 &clock, &workspace_));
+      return;
+    }
+    if (beam_.is_enabled()) tg.prune_layer(&(layers[level_]), beam_);
+    model_.plan_layer(layers[level_], layers[level_ + 1],
+                      workspace_.eu_dists[level_], tg.is_log_space(),
+                      &probes_);
+    model_.ubodt_->prefetch_batch(probes_.sources, probes_.targets);
+    clock.lap(UTIL::STAGE_UPDATE_TG);
+  };
+  void finish(const MatchResult &result) {
+    model_.collect_memo_statistics(&workspace_.transitions);
+    result_ = filtering_ ? expand_result(result, filtered_) : result;
+    model_.network_.get_projection().inverse(&result_);
+    finished_ = true;
+  };
+  FastMapMatch &model_;
+  const FastMapMatchConfig &config_;
+  MatchWorkspace workspace_;
+  LayerProbes probes_;
+  std::unique_ptr<BudgetMeter> meter_;
+  ViterbiBeam beam_;
+  FilteredTrajectory filtered_;
+  bool filtering_ = false;
+  const Trajectory *traj_ = nullptr;
+  int index_ = -1;
+  int level_ = 0;
+  bool partial_ = false;
+  bool finished_ = true;
+  MatchResult result_;
+};
+
+void FastMapMatch::InterleavedTask::relax_lanes(
+    const std::vector<InterleavedTask *> &tasks) {
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const double inf = std::numeric_limits<double>::infinity();
+  std::size_t L = tasks.size();
+  std::size_t n = 0, m = 0;
+  for (InterleavedTask *task : tasks) {
+    const TGLayer &lb = task->workspace_.tg.get_layers()[task->level_ + 1];
+    n = std::max(n, task->probes_.expanded.size());
+    m = std::max(m, lb.size());
+  }
+  // The tasks share the configuration, hence the space of the
+  // probabilities
+  bool log_space = tasks[0]->workspace_.tg.is_log_space();
+  static thread_local std::vector<double> cumu;
+  static thread_local std::vector<double> tps;
+  static thread_local std::vector<char> masked;
+  static thread_local std::vector<double> eu_dists;
+  static thread_local std::vector<double> eps;
+  static thread_local std::vector<double> best;
+  static thread_local std::vector<int> arg;
+  cumu.resize(n * L);
+  tps.resize(n * m * L);
+  masked.resize(n * m * L);
+  eu_dists.resize(L);
+  eps.resize(m * L);
+  best.resize(m * L);
+  arg.resize(m * L);
+  // The distances are gathered into the lanes, where the nodes missing
+  // in a lane and the pairs skipped are masked
+  for (std::size_t l = 0; l < L; ++l) {
+    InterleavedTask &task = *tasks[l];
+    const LayerProbes &probes = task.probes_;
+    const TGLayer &lb = task.workspace_.tg.get_layers()[task.level_ + 1];
+    eu_dists[l] = task.workspace_.eu_dists[task.level_];
+    std::size_t nl = probes.expanded.size(), ml = lb.size();
+    for (std::size_t i = 0; i < n; ++i) {
+      cumu[i * L + l] = i < nl ? probes.expanded[i]->cumu_prob : 0;
+    }
+    for (std::size_t j = 0; j < m; ++j) {
+      eps[j * L + l] = j >= ml ? 0 :
+                       log_space ? std::log(lb[j].ep) : lb[j].ep;
+      best[j * L + l] = j < ml ? lb[j].cumu_prob : -inf;
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t j = 0; j < m; ++j) {
+        std::size_t k = (i * m + j) * L + l;
+        masked[k] = i >= nl || j >= ml || probes.probed[i * ml + j] == 2;
+        tps[k] = masked[k] ? 1 : probes.sp_dists[i * ml + j];
+      }
+    }
+  }
+  // The probabilities are computed over the lanes in separate passes
+  // without branches, which are vectorized by the compiler. The two cases
+  // of TransitionGraph::calc_tp are selected before a single division.
+  for (std::size_t p = 0; p < n * m; ++p) {
+    double *tp = &tps[p * L];
+    for (std::size_t l = 0; l < L; ++l) {
+      bool shorter = eu_dists[l] >= tp[l];
+      double num = shorter ? tp[l] + 1e-6 : eu_dists[l];
+      double den = shorter ? eu_dists[l] + 1e-6 : tp[l];
+      tp[l] = num / den;
+    }
+  }
+  if (log_space) {
+    for (std::size_t k = 0; k < tps.size(); ++k) tps[k] = std::log(tps[k]);
+  }
+  for (std::size_t k = 0; k < tps.size(); ++k) {
+    tps[k] = masked[k] ? nan : tps[k];
+  }
+  // A node takes the last predecessor tied in linear space, as
+  // update_node does
+  max_plus_lanes(cumu.data(), n, tps.data(), eps.data(), m, L, log_space,
+                 !log_space, best.data(), arg.data());
+  for (std::size_t l = 0; l < L; ++l) {
+    InterleavedTask &task = *tasks[l];
+    const LayerProbes &probes = task.probes_;
+    TGLayer &lb = task.workspace_.tg.get_layers()[task.level_ + 1];
+    double eu_dist = task.workspace_.eu_dists[task.level_];
+    std::size_t ml = lb.size();
+    for (std::size_t j = 0; j < ml; ++j) {
+      int a = arg[j * L + l];
+      if (a < 0) continue;
+      double sp_dist = probes.sp_dists[a * ml + j];
+      lb[j].cumu_prob = best[j * L + l];
+      lb[j].prev = probes.expanded[a];
+      lb[j].tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
+      lb[j].sp_dist = sp_dist;
+    }
+  }
+}
+
+std::vector<MatchResult> FastMapMatch::match_traj_interleaved(
+    const std::vector<Trajectory> &trajs, const FastMapMatchConfig &config,
+    int group_size, int num_threads) {
+  int N = trajs.size();
+  std::vector<MatchResult> results(N);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  if (group_size < 1) group_size = 1;
+  std::atomic<int> next{0};
+  #pragma omp parallel num_threads(num_threads)
+  {
+    // Each task of the group takes a trajectory as soon as it finishes
+    // the previous one, and the tasks advance a layer in turn
+    std::vector<std::unique_ptr<InterleavedTask>> group;
+    for (int t = 0; t < group_size; ++t) {
+      group.emplace_back(new InterleavedTask(this, config));
+    }
+    int active = 0;
+    bool exhausted = false;
+    do {
+      for (std::unique_ptr<InterleavedTask> &task : group) {
+        if (!task->is_finished()) {
+          task->step();
+        } else if (!exhausted) {
+          int i = next.fetch_add(1);
+          if (i < N) {
+            task->start(trajs[i], i);
+            ++active;
+          } else {
+            exhausted = true;
+          }
+        }
+        if (task->has_result()) {
+          task->take_result(&results);
+          --active;
+        }
+      }
+    } while (active > 0 || !exhausted);
+  }
+  return results;
+};
+
+std::vector<MatchResult> FastMapMatch::match_traj_lockstep(
+    const std::vector<Trajectory> &trajs, const FastMapMatchConfig &config,
+    int lanes, int num_threads) {
+  int N = trajs.size();
+  std::vector<MatchResult> results(N);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  if (lanes < 1) lanes = 1;
+  std::atomic<int> next{0};
+  #pragma omp parallel num_threads(num_threads)
+  {
+    // A lane takes another trajectory as soon as its trajectory
+    // finishes, until none is left and the lanes are masked
+    std::vector<std::unique_ptr<InterleavedTask>> group;
+    for (int l = 0; l < lanes; ++l) {
+      group.emplace_back(new InterleavedTask(this, config));
+    }
+    std::vector<InterleavedTask *> active;
+    bool exhausted = false;
+    while (true) {
+      active.clear();
+      for (std::unique_ptr<InterleavedTask> &task : group) {
+        while (task->is_finished()) {
+          if (task->has_result()) task->take_result(&results);
+          if (exhausted) break;
+          int i = next.fetch_add(1);
+          if (i >= N) {
+            exhausted = true;
+            break;
+          }
+          task->start(trajs[i], i);
+        }
+        if (!task->is_finished()) active.push_back(task.get());
+      }
+      if (active.empty()) break;
+      // The probes of a lane are looked up while the slots of the other
+      // lanes prefetched arrive
+      for (InterleavedTask *task : active) task->resolve();
+      UTIL::StageClock clock;
+      InterleavedTask::relax_lanes(active);
+      clock.lap(UTIL::STAGE_UPDATE_TG);
+      for (InterleavedTask *task : active) task->advance();
+    }
+  }
+  return results;
+};
+
+std::vector<MatchResult> FastMapMatch::match_batch(
+    const std::vector<Trajectory> &trajs, const FastMapMatchConfig &config,
+    const DeviceUBODT &device) {
+  int N = trajs.size();
+  const LocalProjection &projection = network_.get_projection();
+  PointFilter filter = config.get_point_filter();
+  ViterbiBeam beam = config.get_viterbi_beam();
+  // The candidates and transition graph of each trajectory are kept
+  // until the transitions of the whole batch are scored
+  std::vector<Trajectory> projected(N);
+  std::vector<FilteredTrajectory> filtered(N);
+  std::vector<const Trajectory *> inputs(N);
+  std::vector<std::unique_ptr<CandidateSearchContext>> contexts(N);
+  std::vector<std::unique_ptr<TransitionGraph>> graphs(N);
+  #pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < N; ++t) {
+    inputs[t] = &projection.forward(trajs[t], &projected[t]);
+    if (filter.is_enabled()) {
+      filtered[t] = filter_points(*inputs[t], filter);
+      inputs[t] = &filtered[t].traj;
+    }
+    contexts[t].reset(new CandidateSearchContext());
+    if (!network_.search_tr_cs_knn(inputs[t]->geom, config.k,
+                                   config.radius, contexts[t].get(), nullptr,
+                                   graph_.get_edge_mask())) {
+      continue;
+    }
+    contexts[t]->prune(inputs[t]->geom, config.k,
+                       config.get_candidate_pruning());
+    graphs[t].reset(new TransitionGraph());
+    graphs[t]->reset(*contexts[t], config.gps_error, config.approximate_ep);
+    if (beam.is_enabled()) graphs[t]->reset_log_space();
+  }
+  // The OD pairs of all the transitions of the batch are looked up at
+  // once, those of trajectory t from offsets[t]
+  std::vector<long> offsets(N + 1, 0);
+  for (int t = 0; t < N; ++t) {
+    long pairs = 0;
+    if (graphs[t] != nullptr) {
+      const std::vector<TGLayer> &layers = graphs[t]->get_layers();
+      for (std::size_t i = 0; i + 1 < layers.size(); ++i) {
+        pairs += layers[i].size() * layers[i + 1].size();
+      }
+    }
+    offsets[t + 1] = offsets[t] + pairs;
+  }
+  std::vector<NodeIndex> sources(offsets[N]);
+  std::vector<NodeIndex> targets(offsets[N]);
+  #pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < N; ++t) {
+    if (graphs[t] == nullptr) continue;
+    const std::vector<TGLayer> &layers = graphs[t]->get_layers();
+    long k = offsets[t];
+    for (std::size_t i = 0; i + 1 < layers.size(); ++i) {
+      for (const TGNode &a : layers[i]) {
+        for (const TGNode &b : layers[i + 1]) {
+          sources[k] = a.c->edge->target;
+          targets[k] = b.c->edge->source;
+          ++k;
+        }
+      }
+    }
+  }
+  std::vector<double> costs;
+  // The device holds the distances of the records without the overlay
+  // of closed edges
+  if (metric_ != 0) {
+    costs.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+      if (!look_up_cost(sources[i], targets[i], &costs[i])) costs[i] = -1;
+    }
+  } else if (ubodt_->has_closures()) {
+    ubodt_->look_up_pairs(sources, targets, &costs);
+  } else if (!device.look_up_pairs(sources, targets, &costs)) {
+    SPDLOG_WARN("Device look up failed, costs looked up on the host");
+  }
+  std::vector<MatchResult> results(N);
+  #pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < N; ++t) {
+    if (graphs[t] == nullptr) continue;
+    TransitionGraph &tg = *graphs[t];
+    std::vector<TGLayer> &layers = tg.get_layers();
+    std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(inputs[t]->geom);
+    scale_eu_dists(&eu_dists);
+    const double *cost = costs.data() + offsets[t];
+    std::vector<CompactCandidate> compact_b;
+    for (std::size_t i = 0; i + 1 < layers.size(); ++i) {
+      if (beam.is_enabled()) TransitionGraph::prune_layer(&(layers[i]), beam);
+      TGLayer &la = layers[i];
+      TGLayer &lb = layers[i + 1];
+      compact_b.resize(lb.size());
+      for (std::size_t j = 0; j < lb.size(); ++j) {
+        compact_b[j] = CompactCandidate::from(*(lb[j].c));
+      }
+      for (auto iter_a = la.begin(); iter_a != la.end();
+           ++iter_a, cost += lb.size()) {
+        if (TransitionGraph::is_pruned(*iter_a)) continue;
+        CompactCandidate ca = CompactCandidate::from(*(iter_a->c));
+        for (std::size_t j = 0; j < lb.size(); ++j) {
+          update_node(iter_a, &(lb[j]),
+                      get_sp_dist(ca, compact_b[j], cost[j]),
+                      eu_dists[i], tg.is_log_space());
+        }
+      }
+    }
+    UTIL::StageClock clock;
+    MatchResult result = build_result(&tg, *inputs[t], config, false,
+                                      nullptr, &clock,
+                                      &MatchWorkspace::local());
+    if (filter.is_enabled()) result = expand_result(result, filtered[t]);
+    projection.inverse(&result);
+    results[t] = std::move(result);
+  }
+  return results;
+}
+
+std::vector<PyMatchResult> FastMapMatch::match_wkt_batch(
+    const std::vector<std::string> &wkts, const FastMapMatchConfig &config,
+    int num_threads) {
+  // Parsed before the parallel region, so that an invalid wkt throws
+  std::vector<Trajectory> trajs;
+  trajs.reserve(wkts.size());
+  for (int i = 0; i < (int) wkts.size(); ++i) {
+    trajs.push_back({i, wkt2linestring(wkts[i]), {}});
+  }
+  std::vector<MatchResult> results =
+      match_traj_batch(trajs, config, num_threads);
+  std::vector<PyMatchResult> outputs;
+  outputs.reserve(results.size());
+  for (const MatchResult &result : results) {
+    outputs.push_back(to_py_result(result));
+  }
+  return outputs;
+};
+
+PyMatchArrays FastMapMatch::match_coords(
+    const double *coords, int num_points,
+    const double *timestamps, int num_timestamps,
+    const FastMapMatchConfig &config) {
+  Trajectory traj = coords2trajectory(coords, num_points,
+                                      timestamps, num_timestamps);
+  return to_py_arrays(match_traj(traj, config));
+};
+
+PyMatchResult FastMapMatch::to_py_result(const MatchResult &result) const {
   PyMatchResult output;
   output.id = result.id;
   output.opath = result.opath;
@@ -122,55 +1014,457 @@ PyMatchResult FastMapMatch::match_wkt(
   return output;
 };
 
+int FastMapMatch::find_break(const TGOpath &opath) {
+  for (int i = 1; i < (int) opath.size(); ++i) {
+    const Candidate *a = opath[i - 1]->c;
+    const Candidate *b = opath[i]->c;
+    double cost;
+    if ((a->edge->id != b->edge->id || a->offset > b->offset) &&
+        a->edge->target != b->edge->source &&
+        !look_up_cost(a->edge->target, b->edge->source, &cost)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 double FastMapMatch::get_sp_dist(const Candidate *ca, const Candidate *cb) {
+  double cost = -1;
+  if ((ca->edge->id != cb->edge->id || ca->offset > cb->offset) &&
+      ca->edge->target != cb->edge->source) {
+    look_up_cost(ca->edge->target, cb->edge->source, &cost);
+  }
+  return get_sp_dist(ca, cb, cost);
+}
+
+bool FastMapMatch::set_metric(const std::string &name) {
+  int metric = network_.get_metric_index(name);
+  if (metric < 0) {
+    SPDLOG_CRITICAL("Cost column {} is not read from the network", name);
+    return false;
+  }
+  if (metric >= ubodt_->get_metric_count()) {
+    SPDLOG_CRITICAL("Metric costs of {} are not built in UBODT", name);
+    return false;
+  }
+  double pace = std::numeric_limits<double>::infinity();
+  for (const Edge &edge : network_.get_edges()) {
+    double cost = network_.get_edge_cost(metric, edge.index);
+    if (cost <= 0 && edge.length > 0) {
+      SPDLOG_CRITICAL("Cost {} of edge {} should be positive",
+                      cost, edge.id);
+      return false;
+    }
+    if (edge.length > 0) pace = std::min(pace, cost / edge.length);
+  }
+  metric_ = metric;
+  metric_pace_ = (metric == 0 || std::isinf(pace)) ? 1 : pace;
+  SPDLOG_INFO("Transitions scored by {} with pace {}",
+              metric == 0 ? "length" : name, metric_pace_);
+  return true;
+}
+
+void FastMapMatch::set_lookup_cache(int entries) {
+  cache_entries_ = entries > 0 ? entries : 0;
+}
+
+LookupCacheStatistics FastMapMatch::get_lookup_cache_statistics() const {
+  return UBODTLookupCache::collect(cache_owner_);
+}
+
+LookupCacheStatistics FastMapMatch::get_transition_memo_statistics() const {
+  LookupCacheStatistics statistics;
+  statistics.hits = memo_hits_.load(std::memory_order_relaxed);
+  statistics.misses = memo_misses_.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+bool FastMapMatch::look_up_cost(NodeIndex source, NodeIndex target,
+                                double *cost) const {
+  // The distances cached may cross the edges closed since
+  if (cache_entries_ == 0 || ubodt_->has_closures()) {
+    return ubodt_->look_up_cost(source, target, metric_, cost);
+  }
+  UBODTLookupCache &cache =
+      UBODTLookupCache::local(cache_owner_, cache_entries_);
+  double cached;
+  if (!cache.find(source, target, &cached)) {
+    if (!ubodt_->look_up_cost(source, target, metric_, &cached)) cached = -1;
+    cache.insert(source, target, cached);
+  }
+  if (cached < 0) return false;
+  *cost = cached;
+  return true;
+}
+
+void FastMapMatch::look_up_batch(const std::vector<NodeIndex> &sources,
+                                 const std::vector<NodeIndex> &targets,
+                                 std::vector<double> *costs,
+                                 TransitionMemo *memo) const {
+  size_t n = targets.size();
+  costs->resize(sources.size() * n);
+  // The distances cached may cross the edges closed since
+  bool cached = cache_entries_ > 0 && !ubodt_->has_closures();
+  if (memo == nullptr && !cached && metric_ == 0) {
+    ubodt_->look_up_batch(sources, targets, costs);
+    return;
+  }
+  UBODTLookupCache *cache = cached ?
+      &UBODTLookupCache::local(cache_owner_, cache_entries_) : nullptr;
+  static thread_local std::vector<NodeIndex> miss_sources;
+  static thread_local std::vector<NodeIndex> miss_targets;
+  static thread_local std::vector<size_t> miss_index;
+  static thread_local std::vector<double> miss_costs;
+  miss_sources.clear();
+  miss_targets.clear();
+  miss_index.clear();
+  // The pairs are answered by the memo of the trajectory, then by the
+  // cache of the thread
+  for (size_t i = 0; i < sources.size(); ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      double *cost = &(*costs)[i * n + j];
+      if (memo != nullptr && memo->find(sources[i], targets[j], cost)) {
+        continue;
+      }
+      if (cache != nullptr && cache->find(sources[i], targets[j], cost)) {
+        if (memo != nullptr) memo->insert(sources[i], targets[j], *cost);
+        continue;
+      }
+      miss_sources.push_back(sources[i]);
+      miss_targets.push_back(targets[j]);
+      miss_index.push_back(i * n + j);
+    }
+  }
+  if (miss_index.empty()) return;
+  if (metric_ != 0) {
+    // The metric costs are stored by row, without batched probes
+    miss_costs.resize(miss_index.size());
+    for (size_t k = 0; k < miss_index.size(); ++k) {
+      if (!ubodt_->look_up_cost(miss_sources[k], miss_targets[k], metric_,
+                                &miss_costs[k])) {
+        miss_costs[k] = -1;
+      }
+    }
+  } else {
+    ubodt_->look_up_pairs(miss_sources, miss_targets, &miss_costs);
+  }
+  for (size_t k = 0; k < miss_index.size(); ++k) {
+    (*costs)[miss_index[k]] = miss_costs[k];
+    if (cache != nullptr) {
+      cache->insert(miss_sources[k], miss_targets[k], miss_costs[k]);
+    }
+    if (memo != nullptr) {
+      memo->insert(miss_sources[k], miss_targets[k], miss_costs[k]);
+    }
+  }
+}
+
+void FastMapMatch::collect_memo_statistics(TransitionMemo *memo) const {
+  memo_hits_.fetch_add(memo->get_hits(), std::memory_order_relaxed);
+  memo_misses_.fetch_add(memo->get_misses(), std::memory_order_relaxed);
+  memo->reset_counters();
+}
+
+double FastMapMatch::get_sp_dist(const Candidate *ca, const Candidate *cb,
+                                 double cost) {
+  return get_sp_dist(CompactCandidate::from(*ca),
+                     CompactCandidate::from(*cb), cost);
+}
+
+double FastMapMatch::get_sp_dist(const CompactCandidate &ca,
+                                 const CompactCandidate &cb, double cost) {
+  if (metric_ != 0) return get_sp_cost(ca, cb, cost);
   double sp_dist = 0;
-  if (ca->edge->id == cb->edge->id && ca->offset <= cb->offset) {
-    sp_dist = cb->offset - ca->offset;
-  } else if (ca->edge->target == cb->edge->source) {
+  if (ca.edge == cb.edge && ca.offset <= cb.offset) {
+    sp_dist = cb.offset - ca.offset;
+  } else if (ca.target == cb.source) {
     // Transition on the same OD nodes
-    sp_dist = ca->edge->length - ca->offset + cb->offset;
+    sp_dist = ca.length - ca.offset + cb.offset;
   } else {
-    Record *r = ubodt_->look_up(ca->edge->target, cb->edge->source);
     // No sp path exist from O to D.
-    if (r == nullptr) return ubodt_->get_delta();
+    if (cost < 0) return ubodt_->get_delta();
     // calculate original SP distance
-    sp_dist = r->cost + ca->edge->length - ca->offset + cb->offset;
+    sp_dist = cost + ca.length - ca.offset + cb.offset;
   }
   return sp_dist;
 }
 
-void FastMapMatch::update_tg(
+double FastMapMatch::get_sp_cost(const CompactCandidate &ca,
+                                 const CompactCandidate &cb,
+                                 double cost) const {
+  if (ca.edge == cb.edge && ca.offset <= cb.offset) {
+    return get_part_cost(ca, cb.offset - ca.offset);
+  }
+  double ends = get_part_cost(ca, ca.length - ca.offset) +
+                get_part_cost(cb, cb.offset);
+  if (ca.target == cb.source) return ends;
+  // A pair missing in UBODT is longer than delta
+  if (cost < 0) return ubodt_->get_delta() * metric_pace_;
+  return cost + ends;
+}
+
+bool FastMapMatch::update_tg(
     TransitionGraph *tg,
-    const Trajectory &traj, const FastMapMatchConfig &config) {
+    const Trajectory &traj, const FastMapMatchConfig &config,
+    BudgetMeter *meter, MatchWorkspace *workspace) {
   SPDLOG_TRACE("Update transition graph");
   std::vector<TGLayer> &layers = tg->get_layers();
-  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
+  std::vector<double> &eu_dists = workspace->eu_dists;
+  ALGORITHM::cal_eu_dist(traj.geom, &eu_dists);
+  scale_eu_dists(&eu_dists);
+  ViterbiBeam beam = config.get_viterbi_beam();
+  if (beam.is_enabled()) tg->reset_log_space();
   int N = layers.size();
+  if (config.parallel_viterbi > 0 && N >= config.parallel_viterbi) {
+    return update_tg_parallel(tg, eu_dists, beam, meter);
+  }
+  TransitionMemo &memo = workspace->transitions;
+  memo.clear();
+  // The work of a transition is counted at the point it enters
+  bool tiled = UTIL::TileProfile::is_enabled() &&
+      (int) workspace->tiles.size() == N;
   for (int i = 0; i < N - 1; ++i) {
+    if (meter->is_exhausted()) {
+      layers.resize(i + 1);
+      return false;
+    }
+    if (beam.is_enabled()) tg->prune_layer(&(layers[i]), beam);
+    UTIL::TileCounters *tile = tiled ? &workspace->tiles[i + 1] : nullptr;
+    UTIL::TimePoint begin;
+    if (tiled) begin = std::chrono::steady_clock::now();
     update_layer(i, &(layers[i]), &(layers[i + 1]),
-                 eu_dists[i]);
+                 eu_dists[i], tg->is_log_space(), &memo, tile);
+    if (tiled) {
+      tile->seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - begin).count();
+    }
+    meter->add_transitions(layers[i].size() * layers[i + 1].size());
   }
   SPDLOG_TRACE("Update transition graph done");
+  return true;
+}
+
+bool FastMapMatch::update_tg_parallel(
+    TransitionGraph *tg, const std::vector<double> &eu_dists,
+    const ViterbiBeam &beam, BudgetMeter *meter) {
+  SPDLOG_TRACE("Update transition graph in parallel");
+  std::vector<TGLayer> &layers = tg->get_layers();
+  int N = layers.size();
+  // The distances of the pairs of layers i and i+1 of a chunk start at
+  // offsets[i-start]
+  std::vector<std::size_t> offsets;
+  std::vector<double> sp_dists;
+  for (int start = 0; start < N - 1;
+       start += TransitionGraph::PARALLEL_CHUNK_LAYERS) {
+    if (meter->is_exhausted()) {
+      layers.resize(start + 1);
+      return false;
+    }
+    int end = start + TransitionGraph::PARALLEL_CHUNK_LAYERS;
+    if (end > N - 1) end = N - 1;
+    offsets.assign(1, 0);
+    for (int i = start; i < end; ++i) {
+      offsets.push_back(offsets.back() +
+                        layers[i].size() * layers[i + 1].size());
+    }
+    sp_dists.resize(offsets.back());
+    // The distances only depend on the candidates, so the layers of a
+    // chunk are routed in parallel
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (int i = start; i < end; ++i) {
+      get_sp_dists(layers[i], layers[i + 1],
+                   sp_dists.data() + offsets[i - start]);
+    }
+    // The max-plus recurrence is resolved by a serial sweep
+    for (int i = start; i < end; ++i) {
+      if (beam.is_enabled()) tg->prune_layer(&(layers[i]), beam);
+      TGLayer &la = layers[i];
+      TGLayer &lb = layers[i + 1];
+      const double *row = sp_dists.data() + offsets[i - start];
+      for (auto iter_a = la.begin(); iter_a != la.end();
+           ++iter_a, row += lb.size()) {
+        if (TransitionGraph::is_pruned(*iter_a)) continue;
+        for (size_t j = 0; j < lb.size(); ++j) {
+          update_node(iter_a, &(lb[j]), row[j], eu_dists[i],
+                      tg->is_log_space());
+        }
+      }
+    }
+    meter->add_transitions(offsets.back());
+  }
+  SPDLOG_TRACE("Update transition graph in parallel done");
+  return true;
+}
+
+void FastMapMatch::get_sp_dists(const TGLayer &la, const TGLayer &lb,
+                                double *sp_dists) {
+  static thread_local std::vector<NodeIndex> sources;
+  static thread_local std::vector<NodeIndex> targets;
+  static thread_local std::vector<double> costs;
+  sources.resize(la.size());
+  for (size_t i = 0; i < la.size(); ++i) {
+    sources[i] = la[i].c->edge->target;
+  }
+  static thread_local std::vector<CompactCandidate> compact_b;
+  compact_b.resize(lb.size());
+  targets.resize(lb.size());
+  for (size_t j = 0; j < lb.size(); ++j) {
+    compact_b[j] = CompactCandidate::from(*(lb[j].c));
+    targets[j] = compact_b[j].source;
+  }
+  look_up_batch(sources, targets, &costs);
+  for (size_t i = 0; i < la.size(); ++i) {
+    const CompactCandidate ca = CompactCandidate::from(*(la[i].c));
+    for (size_t j = 0; j < lb.size(); ++j, ++sp_dists) {
+      *sp_dists = get_sp_dist(ca, compact_b[j], costs[i * lb.size() + j]);
+    }
+  }
 }
 
 void FastMapMatch::update_layer(int level,
                        TGLayer *la_ptr,
                        TGLayer *lb_ptr,
-                       double eu_dist) {
+                       double eu_dist,
+                       bool log_space,
+                       TransitionMemo *memo,
+                       UTIL::TileCounters *tile) {
   SPDLOG_TRACE("Update layer");
-  TGLayer &lb = *lb_ptr;
-  for (auto iter_a = la_ptr->begin(); iter_a != la_ptr->end(); ++iter_a) {
-    NodeIndex source = iter_a->c->index;
-    for (auto iter_b = lb_ptr->begin(); iter_b != lb_ptr->end(); ++iter_b) {
-      double sp_dist = get_sp_dist(iter_a->c, iter_b->c);
-      double tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
-      if (iter_a->cumu_prob + tp * iter_b->ep >= iter_b->cumu_prob) {
-        iter_b->cumu_prob = iter_a->cumu_prob + tp * iter_b->ep;
-        iter_b->prev = &(*iter_a);
-        iter_b->tp = tp;
-        iter_b->sp_dist = sp_dist;
+  static thread_local LayerProbes probes;
+  probes.memo = memo;
+  plan_layer(*la_ptr, *lb_ptr, eu_dist, log_space, &probes);
+  probe_layer(lb_ptr, eu_dist, log_space, &probes);
+  if (tile != nullptr) {
+    tile->probes += probes.probed_pairs;
+    tile->misses += probes.missing_pairs;
+  }
+  SPDLOG_TRACE("Update layer done");
+}
+
+void FastMapMatch::plan_layer(const TGLayer &la, const TGLayer &lb,
+                              double eu_dist, bool log_space,
+                              LayerProbes *probes) {
+  const double inf = std::numeric_limits<double>::infinity();
+  const double delta = ubodt_->get_delta();
+  // The distance of a pair is known without UBODT if the candidates are
+  // on the same or adjacent edges, or if the nodes between them are
+  // farther apart than delta in a straight line. Otherwise the pair is
+  // probed, unless a known transition to the same node of layer b is
+  // more probable than its upper bound. The nodes of layer a pruned by
+  // the beam are left out. The candidates are gathered into compact
+  // copies, so that the pairs are compared without reading the edges.
+  std::vector<TGNode *> &expanded = probes->expanded;
+  std::vector<CompactCandidate> &compact_a = probes->compact_a;
+  std::vector<CompactCandidate> &compact_b = probes->compact_b;
+  std::vector<double> &sp_dists = probes->sp_dists;
+  std::vector<char> &probed = probes->probed;
+  std::vector<double> &best = probes->best;
+  expanded.clear();
+  compact_a.clear();
+  for (auto iter_a = la.begin(); iter_a != la.end(); ++iter_a) {
+    if (TransitionGraph::is_pruned(*iter_a)) continue;
+    expanded.push_back(iter_a);
+    compact_a.push_back(CompactCandidate::from(*(iter_a->c)));
+  }
+  size_t M = lb.size();
+  compact_b.resize(M);
+  for (size_t j = 0; j < M; ++j) {
+    compact_b[j] = CompactCandidate::from(*(lb[j].c));
+  }
+  sp_dists.resize(expanded.size() * M);
+  probed.assign(expanded.size() * M, 0);
+  best.assign(M, -inf);
+  auto score = [log_space](const TGNode *a, const TGNode *b, double tp) {
+    return log_space ? a->cumu_prob + std::log(tp) + std::log(b->ep) :
+           a->cumu_prob + tp * b->ep;
+  };
+  for (size_t i = 0; i < expanded.size(); ++i) {
+    const CompactCandidate &ca = compact_a[i];
+    const CORE::Point &pa = graph_.get_vertex_point(ca.target);
+    for (size_t j = 0; j < M; ++j) {
+      const CompactCandidate &cb = compact_b[j];
+      double &sp_dist = sp_dists[i * M + j];
+      if ((ca.edge == cb.edge && ca.offset <= cb.offset) ||
+          ca.target == cb.source ||
+          boost::geometry::distance(
+              pa, graph_.get_vertex_point(cb.source)) *
+              (1 - 1e-9) > delta) {
+        sp_dist = get_sp_dist(ca, cb, -1);
+        best[j] = std::max(best[j], score(
+            expanded[i], &(lb[j]),
+            TransitionGraph::calc_tp(sp_dist, eu_dist)));
+      } else {
+        // A pair missing in UBODT takes delta as its distance
+        sp_dist = std::min(TransitionGraph::calc_sp_lower_bound(
+            expanded[i]->c, lb[j].c), delta) * metric_pace_;
+        probed[i * M + j] = 1;
       }
     }
   }
-  SPDLOG_TRACE("Update layer done");
+  // The pairs probed are gathered over the nodes having one, so that
+  // they are fetched in one batch
+  std::vector<int> &source_pos = probes->source_pos;
+  std::vector<int> &target_pos = probes->target_pos;
+  std::vector<NodeIndex> &sources = probes->sources;
+  std::vector<NodeIndex> &targets = probes->targets;
+  source_pos.assign(expanded.size(), -1);
+  target_pos.assign(M, -1);
+  sources.clear();
+  targets.clear();
+  for (size_t i = 0; i < expanded.size(); ++i) {
+    for (size_t j = 0; j < M; ++j) {
+      if (!probed[i * M + j]) continue;
+      double tp = TransitionGraph::calc_tp_upper_bound(
+          sp_dists[i * M + j], eu_dist);
+      if (score(expanded[i], &(lb[j]), tp) < best[j]) {
+        // The pair is not probed, and can not update node j
+        probed[i * M + j] = 2;
+        continue;
+      }
+      if (source_pos[i] < 0) {
+        source_pos[i] = sources.size();
+        sources.push_back(compact_a[i].target);
+      }
+      if (target_pos[j] < 0) {
+        target_pos[j] = targets.size();
+        targets.push_back(compact_b[j].source);
+      }
+    }
+  }
+}
+
+void FastMapMatch::probe_layer(TGLayer *lb_ptr, double eu_dist,
+                               bool log_space, LayerProbes *probes) {
+  resolve_probes(*lb_ptr, probes);
+  // The pairs left with a state of 2 are skipped. A node takes the last
+  // predecessor tied in linear space, as update_node does.
+  relax_layer(probes->expanded.data(), probes->expanded.size(), *lb_ptr,
+              probes->sp_dists.data(), probes->probed.data(), eu_dist,
+              log_space, !log_space);
+}
+
+void FastMapMatch::resolve_probes(const TGLayer &lb, LayerProbes *probes) {
+  const std::vector<TGNode *> &expanded = probes->expanded;
+  std::vector<double> &sp_dists = probes->sp_dists;
+  std::vector<char> &probed = probes->probed;
+  const std::vector<NodeIndex> &targets = probes->targets;
+  std::vector<double> &costs = probes->costs;
+  // The batch overlaps the cache misses of the probes
+  size_t M = lb.size();
+  if (!probes->sources.empty()) {
+    look_up_batch(probes->sources, targets, &costs, probes->memo);
+  }
+  probes->probed_pairs = 0;
+  probes->missing_pairs = 0;
+  for (size_t i = 0; i < expanded.size(); ++i) {
+    for (size_t j = 0; j < M; ++j) {
+      if (probed[i * M + j] != 1) continue;
+      double cost = costs[probes->source_pos[i] * targets.size() +
+                          probes->target_pos[j]];
+      sp_dists[i * M + j] = get_sp_dist(
+          probes->compact_a[i], probes->compact_b[j], cost);
+      probed[i * M + j] = 0;
+      ++probes->probed_pairs;
+      probes->missing_pairs += cost < 0;
+    }
+  }
 }
@@ -13,9 +13,17 @@
 #include "network/network.hpp"
 #include "network/network_graph.hpp"
 #include "mm/transition_graph.hpp"
+#include "mm/match_workspace.hpp"
+#include "mm/trajectory_split.hpp"
+#include "mm/point_filter.hpp"
+#include "mm/match_budget.hpp"
+#include "mm/parameter_sweep.hpp"
 #include "mm/fmm/ubodt.hpp"
+#include "mm/fmm/ubodt_lookup_cache.hpp"
+#include "mm/fmm/device_ubodt.hpp"
 #include "python/pyfmm.hpp"
 
+#include <atomic>
 #include <string>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -40,6 +48,76 @@ struct FastMapMatchConfig{
   int k; /**< Number of candidates */
   double radius; /**< Search radius*/
   double gps_error; /**< GPS error */
+  double min_ep_ratio = 0; /**< Minimum ratio of the emission probability
+                               of a candidate to the best one, 0 for all */
+  double max_dist_ratio = 0; /**< Maximum ratio of the distance of a
+                                 candidate to the best one, 0 for all */
+  double adaptive_k_spacing = 0; /**< Point spacing below which fewer
+                                     candidates are kept, 0 for k */
+  double max_heading_diff = 0; /**< Maximum angle in degrees between the
+                                    heading of a point and the edge of a
+                                    candidate, 0 for all */
+  double min_heading_distance = 0; /**< Distance between the neighbours
+                                        of a point below which its heading
+                                        is not used */
+  int beam_size = 0; /**< Maximum number of states expanded per layer by
+                          the beam search Viterbi, 0 for all */
+  double beam_margin = 0; /**< Maximum log probability difference of a
+                               state expanded to the best one, 0 for all */
+  bool split = false; /**< Split the trajectory at the breaks of its
+                           matching and match the segments */
+  double max_time_gap = 0; /**< Time gap splitting the trajectory, 0 for
+                                none */
+  int parallel_viterbi = 0; /**< Number of points from which the
+                                 transitions of a trajectory are computed
+                                 in parallel, 0 for none */
+  double stationary_radius = 0; /**< Radius of the stationary clusters of
+                                     points collapsed, 0 for none */
+  double min_distance = 0; /**< Minimum distance between the points
+                                matched, 0 for all */
+  double min_interval = 0; /**< Minimum time between the points matched,
+                                0 for all */
+  int coarse_step = 0; /**< Points per point of the coarse pass of
+                            match_traj, whose path restricts the
+                            candidates of all the points to its
+                            corridor, 0 for one pass */
+  double corridor_buffer = 0; /**< Distance around the boxes of the edges
+                                   of the coarse path within which edges
+                                   are in the corridor */
+  int corridor_k = 0; /**< Number of candidates of the points in the
+                           corridor, 0 for k */
+  bool approximate_ep = false; /**< Compute the emission probabilities
+                                    with an approximate exponential */
+  double max_seconds = 0; /**< Maximum seconds spent on the transitions
+                               of a trajectory, 0 for unlimited */
+  long max_transitions = 0; /**< Maximum pairs of candidates evaluated
+                                 for a trajectory, 0 for unlimited */
+  std::string metric; /**< Cost column of the network whose costs score
+                           the transitions, empty for the length, which
+                           is applied to a model by
+                           FastMapMatch::set_metric */
+  ResultFields result_fields; /**< Fields of the results built, set by
+                                   the apps from the fields written */
+  /**
+   * Get the options to prune the candidates found
+   */
+  NETWORK::CandidatePruning get_candidate_pruning() const;
+  /**
+   * Get the options of the beam search Viterbi
+   */
+  ViterbiBeam get_viterbi_beam() const;
+  /**
+   * Get the options of the splitting of a trajectory
+   */
+  TrajectorySplit get_trajectory_split() const;
+  /**
+   * Get the options of the prefilter of the points
+   */
+  PointFilter get_point_filter() const;
+  /**
+   * Get the budget of a trajectory, whose result is partial if it runs out
+   */
+  MatchBudget get_match_budget() const;
   /**
    * Check if the configuration is valid or not
    * @return true if valid
@@ -65,6 +143,38 @@ struct FastMapMatchConfig{
       const cxxopts::ParseResult &arg_data);
 };
 
+/**
+ * Pairs of two layers of a transition graph whose distances are probed in
+ * UBODT, planned before the probes so that their slots are prefetched
+ * while other work is done. The buffers keep their capacity between the
+ * layers.
+ */
+struct LayerProbes {
+  std::vector<TGNode *> expanded; /**< Nodes of layer a not pruned */
+  std::vector<CompactCandidate> compact_a; /**< Candidates of the nodes
+                                                expanded */
+  std::vector<CompactCandidate> compact_b; /**< Candidates of layer b */
+  std::vector<double> sp_dists; /**< Distance of node i expanded and node
+                                     j of layer b at i*lb.size()+j */
+  std::vector<char> probed; /**< State of each pair, 0 if its distance is
+                                 known, 1 if it is probed and 2 if it is
+                                 skipped */
+  std::vector<double> best; /**< Best score known of each node of layer
+                                 b */
+  std::vector<int> source_pos; /**< Index of each node expanded in the
+                                    sources, -1 if it has no probe */
+  std::vector<int> target_pos; /**< Index of each node of layer b in the
+                                    targets, -1 if it has no probe */
+  std::vector<NETWORK::NodeIndex> sources; /**< Source nodes probed */
+  std::vector<NETWORK::NodeIndex> targets; /**< Target nodes probed */
+  std::vector<double> costs; /**< Distances of the sources and targets
+                                  found in UBODT */
+  TransitionMemo *memo = nullptr; /**< Memo of the pairs probed in the
+                                       trajectory, nullptr for none */
+  long probed_pairs = 0; /**< Pairs probed by the last resolve */
+  long missing_pairs = 0; /**< Pairs probed but missing in UBODT */
+};
+
 /**
  * Fast map matching algorithm/model.
  *
@@ -81,16 +191,62 @@ class FastMapMatch {
   FastMapMatch(const NETWORK::Network &network,
       const  NETWORK::NetworkGraph &graph,
       std::shared_ptr<UBODT> ubodt)
-      : network_(network), graph_(graph), ubodt_(ubodt) {
+      : network_(network), graph_(graph), ubodt_(ubodt),
+        cache_owner_(UBODTLookupCache::new_owner()) {
   };
+  /**
+   * Cache the distances looked up in UBODT by each thread matching with
+   * the model, which suits trajectories probing the same od pairs over
+   * and over, such as the ones of a fleet
+   * @param entries entries of the cache of a thread, 0 for none
+   */
+  void set_lookup_cache(int entries);
+  /**
+   * Score the transitions by the costs of a metric of the network, such
+   * as a travel time, instead of the length. The path between two
+   * candidates stays the shortest one by length, whose cost is looked up
+   * in the metric costs of UBODT, and the candidates take the cost of
+   * the part of their edge covered. The Euclidean distance of two points
+   * is converted by the smallest cost per unit length of the edges, so
+   * that it stays a lower bound of the cost of a path.
+   * @param  name cost column of the network, empty or length for the
+   * length
+   * @return false if the network has no such cost, a cost is not
+   * positive, or the metric costs are not built in UBODT
+   */
+  bool set_metric(const std::string &name);
+  /**
+   * Get the hits and misses of the look up caches of all the threads
+   * since they were taken by the model
+   */
+  LookupCacheStatistics get_lookup_cache_statistics() const;
+  /**
+   * Get the hits and misses of the memos of the pairs probed in each
+   * trajectory, summed up over the trajectories matched by the model
+   */
+  LookupCacheStatistics get_transition_memo_statistics() const;
   /**
    * Match a trajectory to the road network
-   * @param  traj   input trajector data
-   * @param  config configuration of map matching algorithm
+   * @param  traj      input trajector data
+   * @param  config    configuration of map matching algorithm
+   * @param  workspace buffers reused between the trajectories, the
+   * workspace of the calling thread if nullptr
    * @return map matching result
    */
   MatchResult match_traj(const CORE::Trajectory &traj,
-                         const FastMapMatchConfig &config);
+                         const FastMapMatchConfig &config,
+                         MatchWorkspace *workspace = nullptr);
+  /**
+   * Match a trajectory split at the time gaps and at the breaks of its
+   * matching, where a point has no candidate or is not reached from the
+   * previous point. Long trajectories have their segments matched in
+   * parallel.
+   * @param  traj   input trajectory data
+   * @param  config configuration of map matching algorithm
+   * @return map matching results of the segments
+   */
+  std::vector<SegmentMatchResult> match_traj_segments(
+      const CORE::Trajectory &traj, const FastMapMatchConfig &config);
   /**
    * Match a wkt linestring to the road network.
    * @param wkt WKT representation of a trajectory
@@ -99,7 +255,147 @@ class FastMapMatch {
    */
   PYTHON::PyMatchResult match_wkt(
       const std::string &wkt,const FastMapMatchConfig &config);
+  /**
+   * Match trajectories in parallel, which releases the GIL in Python API
+   * @param  trajs       input trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in the order of the trajectories
+   */
+  std::vector<MatchResult> match_traj_batch(
+      const std::vector<CORE::Trajectory> &trajs,
+      const FastMapMatchConfig &config, int num_threads = 0);
+  /**
+   * Match trajectories in parallel, each thread interleaving the
+   * matching of a group of them to hide the latency of UBODT. A
+   * trajectory plans the probes of a layer and prefetches their slots,
+   * then yields to the other trajectories of its group before looking
+   * them up. The results are the ones of match_traj, except that the
+   * transitions of a trajectory are not computed in parallel and the
+   * time budget of a trajectory includes the work of its group.
+   * @param  trajs       input trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  group_size  trajectories interleaved by a thread
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in the order of the trajectories
+   */
+  std::vector<MatchResult> match_traj_interleaved(
+      const std::vector<CORE::Trajectory> &trajs,
+      const FastMapMatchConfig &config, int group_size = 8,
+      int num_threads = 0);
+  /**
+   * Match trajectories in parallel, each thread advancing a lane of
+   * trajectories layer by layer together, whose layers are updated at
+   * once by a kernel with a SIMD lane for each trajectory. A lane takes
+   * another trajectory when its trajectory finishes, and is masked when
+   * none is left. This suits large volumes of short trajectories with a
+   * small number of candidates. The results are the ones of
+   * match_traj_interleaved.
+   * @param  trajs       input trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  lanes       trajectories advanced together by a thread
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in the order of the trajectories
+   */
+  std::vector<MatchResult> match_traj_lockstep(
+      const std::vector<CORE::Trajectory> &trajs,
+      const FastMapMatchConfig &config, int lanes = 8,
+      int num_threads = 0);
+  /**
+   * Match a batch of trajectories in stages, where the candidates of all
+   * the trajectories are searched, the distances of all their
+   * transitions are looked up in one batch from a device UBODT, and the
+   * transition graphs are then updated, backtracked and completed in
+   * parallel. The results are the ones of match_traj, except that the
+   * budget of a trajectory is not applied.
+   * @param  trajs  input trajectories
+   * @param  config configuration of map matching algorithm
+   * @param  device distances of the UBODT of the model, on the GPU or
+   * on the host
+   * @return map matching results in the order of the trajectories
+   */
+  std::vector<MatchResult> match_batch(
+      const std::vector<CORE::Trajectory> &trajs,
+      const FastMapMatchConfig &config, const DeviceUBODT &device);
+  /**
+   * Match wkt linestrings in parallel, which releases the GIL in Python
+   * API. The id of a result is the index of its linestring.
+   * @param  wkts        WKT representation of the trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in POD format used in Python API
+   */
+  std::vector<PYTHON::PyMatchResult> match_wkt_batch(
+      const std::vector<std::string> &wkts, const FastMapMatchConfig &config,
+      int num_threads = 0);
+  /**
+   * Match a trajectory given as contiguous arrays, which is used by the
+   * NumPy Python API without formatting and parsing WKT.
+   * @param  coords         x and y of the points interleaved
+   * @param  num_points     number of points
+   * @param  timestamps     timestamps of the points, or nullptr
+   * @param  num_timestamps number of timestamps, 0 or num_points
+   * @param  config         configuration of map matching algorithm
+   * @return map matching result in contiguous arrays
+   */
+  PYTHON::PyMatchArrays match_coords(
+      const double *coords, int num_points,
+      const double *timestamps, int num_timestamps,
+      const FastMapMatchConfig &config);
+  /**
+   * Match a trajectory with each setting of a sweep. The candidates are
+   * searched once with the largest k and radius and their distances are
+   * looked up once in UBODT, whose delta bounds all the settings. Each
+   * setting then selects its candidates among them and runs Viterbi.
+   * The vmax and factor of the settings are not used. The trajectory is
+   * neither split nor filtered, and the coarse pass, the budget and the
+   * parallel Viterbi are not used.
+   * @param  traj     input trajectory data
+   * @param  config   configuration of the parameters not swept
+   * @param  settings settings of the sweep
+   * @param  report   if not nullptr, updated with the results and the
+   * time of the settings
+   * @return map matching result of each setting
+   */
+  std::vector<MatchResult> match_traj_sweep(
+      const CORE::Trajectory &traj, const FastMapMatchConfig &config,
+      const std::vector<SweepSetting> &settings,
+      SweepReport *report = nullptr);
  protected:
+  /**
+   * Convert a result into the POD format used in Python API
+   * @param  result map matching result
+   * @return result in POD format
+   */
+  PYTHON::PyMatchResult to_py_result(const MatchResult &result) const;
+  /**
+   * Look up the distance of an od pair in UBODT, through the look up
+   * cache of the thread if enabled
+   * @return true if the pair is found, otherwise cost is not updated
+   */
+  bool look_up_cost(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    double *cost) const;
+  /**
+   * Look up the distances of all the pairs of several source and target
+   * nodes as UBODT::look_up_batch does, through the memo of the
+   * trajectory and the look up cache of the thread if enabled, where the
+   * pairs missing in both are looked up in one batch
+   * @param memo memo of the pairs probed in the trajectory, nullptr for
+   * none
+   */
+  void look_up_batch(const std::vector<NETWORK::NodeIndex> &sources,
+                     const std::vector<NETWORK::NodeIndex> &targets,
+                     std::vector<double> *costs,
+                     TransitionMemo *memo = nullptr) const;
+  /**
+   * Add the counters of the memo of a trajectory to the ones of the model
+   * and reset them
+   */
+  void collect_memo_statistics(TransitionMemo *memo) const;
   /**
    * Get shortest path distance between two candidates
    * @param  ca from candidate
@@ -108,28 +404,238 @@ class FastMapMatch {
    */
   double get_sp_dist(const Candidate *ca,
                      const Candidate *cb);
+  /**
+   * Get shortest path distance between two candidates given the
+   * distance between their nodes found in UBODT
+   * @param  ca   from candidate
+   * @param  cb   to candidate
+   * @param  cost distance from the target of ca to the source of cb,
+   * negative if not found in UBODT
+   * @return  shortest path value
+   */
+  double get_sp_dist(const Candidate *ca,
+                     const Candidate *cb, double cost);
+  /**
+   * Get shortest path distance between the compact copies of two
+   * candidates given the distance between their nodes found in UBODT
+   * @param  ca   from candidate
+   * @param  cb   to candidate
+   * @param  cost distance from the target of ca to the source of cb,
+   * negative if not found in UBODT
+   * @return  shortest path value
+   */
+  double get_sp_dist(const CompactCandidate &ca, const CompactCandidate &cb,
+                     double cost);
+  /**
+   * Get the cost of the shortest path between the compact copies of two
+   * candidates under the metric of the model, as get_sp_dist
+   * @param  cost cost from the target of ca to the source of cb under
+   * the metric, negative if not found in UBODT
+   */
+  double get_sp_cost(const CompactCandidate &ca, const CompactCandidate &cb,
+                     double cost) const;
+  /**
+   * Get the cost under the metric of the model of a part of the edge of
+   * a candidate
+   * @param  c      candidate
+   * @param  length length of the part
+   */
+  inline double get_part_cost(const CompactCandidate &c,
+                              double length) const {
+    if (c.length <= 0) return 0;
+    return network_.get_edge_cost(metric_, c.edge) * length / c.length;
+  };
+  /**
+   * Convert the Euclidean distances between the points into the metric
+   * of the model, by its smallest cost per unit length
+   */
+  inline void scale_eu_dists(std::vector<double> *eu_dists) const {
+    if (metric_ == 0) return;
+    for (double &d : *eu_dists) d *= metric_pace_;
+  };
   /**
    * Update probabilities in a transition graph
    * @param tg transition graph
    * @param traj raw trajectory
    * @param config map match configuration
+   * @param meter  budget of the trajectory, checked before each layer
+   * @param workspace buffers of the matching
+   * @return false if the budget ran out, where the layers not updated
+   * are removed from the transition graph
    */
-  void update_tg(TransitionGraph *tg,
+  bool update_tg(TransitionGraph *tg,
                  const CORE::Trajectory &traj,
-                 const FastMapMatchConfig &config);
+                 const FastMapMatchConfig &config,
+                 BudgetMeter *meter, MatchWorkspace *workspace);
   /**
    * Update probabilities between two layers a and b in the transition graph
    * @param level   the index of layer a
    * @param la_ptr  layer a
    * @param lb_ptr  layer b next to a
    * @param eu_dist Euclidean distance between two observed point
+   * @param log_space accumulate log probabilities instead of probabilities.
+   * The nodes of layer a pruned by a beam are skipped in either case.
+   * A pair is not looked up in UBODT if it is farther apart than delta in
+   * a straight line, or if the upper bound of its transition is less
+   * probable than a transition known to the same node of layer b.
+   * @param memo memo of the pairs probed in the trajectory, nullptr for
+   * none
+   * @param tile if not nullptr, updated with the pairs probed and missing
    */
   void update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
-                    double eu_dist);
+                    double eu_dist, bool log_space = false,
+                    TransitionMemo *memo = nullptr,
+                    UTIL::TileCounters *tile = nullptr);
+  /**
+   * Plan the update of layer b from layer a, computing the distances
+   * known without UBODT and gathering the pairs to probe
+   * @param la        layer a
+   * @param lb        layer b next to a
+   * @param eu_dist   Euclidean distance between two observed point
+   * @param log_space accumulate log probabilities
+   * @param probes    updated with the pairs of the two layers
+   */
+  void plan_layer(const TGLayer &la, const TGLayer &lb, double eu_dist,
+                  bool log_space, LayerProbes *probes);
+  /**
+   * Probe the pairs planned in UBODT and update the nodes of layer b
+   * @param lb_ptr    layer b, whose pairs are planned
+   * @param eu_dist   Euclidean distance between two observed point
+   * @param log_space accumulate log probabilities
+   * @param probes    pairs planned of the two layers
+   */
+  void probe_layer(TGLayer *lb_ptr, double eu_dist, bool log_space,
+                   LayerProbes *probes);
+  /**
+   * Probe the pairs planned in UBODT, completing their distances without
+   * updating layer b
+   * @param lb     layer b, whose pairs are planned
+   * @param probes pairs planned of the two layers, updated with the
+   * distances probed
+   */
+  void resolve_probes(const TGLayer &lb, LayerProbes *probes);
+  /**
+   * Update probabilities in a transition graph, computing the distances
+   * of a chunk of layers in parallel before sweeping them serially
+   * @param tg       transition graph
+   * @param eu_dists Euclidean distances between consecutive points
+   * @param beam     options of the beam search Viterbi
+   * @param meter    budget of the trajectory, checked before each chunk
+   * @return false if the budget ran out, as in update_tg
+   */
+  bool update_tg_parallel(TransitionGraph *tg,
+                          const std::vector<double> &eu_dists,
+                          const ViterbiBeam &beam, BudgetMeter *meter);
+  /**
+   * Get the shortest path distances of all the pairs of nodes of two
+   * layers, including the nodes pruned by a beam
+   * @param la       layer a
+   * @param lb       layer b next to a
+   * @param sp_dists updated with the distance of node i of layer a and
+   * node j of layer b at i*lb.size()+j
+   */
+  void get_sp_dists(const TGLayer &la, const TGLayer &lb, double *sp_dists);
+  /**
+   * Update a node of layer b with the transition from a node of layer a
+   * if that is more probable
+   * @param a         node of layer a
+   * @param b         node of layer b
+   * @param sp_dist   shortest path distance of the transition
+   * @param eu_dist   Euclidean distance between the two observed points
+   * @param log_space accumulate log probabilities
+   */
+  static inline void update_node(TGNode *a, TGNode *b, double sp_dist,
+                                 double eu_dist, bool log_space) {
+    double tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
+    if (log_space) {
+      TransitionGraph::update_log(a, b, tp, sp_dist);
+    } else if (a->cumu_prob + tp * b->ep >= b->cumu_prob) {
+      b->cumu_prob = a->cumu_prob + tp * b->ep;
+      b->prev = a;
+      b->tp = tp;
+      b->sp_dist = sp_dist;
+    }
+  };
+  /**
+   * Match a trajectory, finding where its matching breaks if no
+   * complete path is found
+   * @param  traj   input trajectory data
+   * @param  config configuration of map matching algorithm
+   * @param  brk    updated with the break, which is not searched if null
+   * @param  meter  budget of the trajectory, the result is partial if it
+   * runs out
+   * @return map matching result
+   */
+  /**
+   * Match a trajectory whose points are filtered if enabled, mapping the
+   * result and the break back to the original points
+   * @param  traj   input trajectory data
+   * @param  config configuration of map matching algorithm
+   * @param  brk    updated with the break, which is not searched if null
+   * @param  meter  budget of the trajectory
+   * @param  workspace buffers of the matching
+   * @return map matching result
+   */
+  MatchResult match_filtered(const CORE::Trajectory &traj,
+                             const FastMapMatchConfig &config,
+                             TrajectoryBreak *brk, BudgetMeter *meter,
+                             MatchWorkspace *workspace);
+  MatchResult match_segment(const CORE::Trajectory &traj,
+                            const FastMapMatchConfig &config,
+                            TrajectoryBreak *brk, BudgetMeter *meter,
+                            MatchWorkspace *workspace);
+  /**
+   * Match the points of a trajectory sampled every coarse step, and find
+   * the corridor of edges around its complete path, in which the
+   * candidates of all the points are searched
+   * @param  traj      input trajectory data
+   * @param  config    configuration of map matching algorithm
+   * @param  meter     budget of the trajectory, shared with the coarse
+   * pass
+   * @param  workspace buffers of the matching, whose corridor is updated
+   * @return false if the trajectory is too short for a coarse pass or
+   * the coarse pass finds no complete path
+   */
+  bool find_corridor(const CORE::Trajectory &traj,
+                     const FastMapMatchConfig &config, BudgetMeter *meter,
+                     MatchWorkspace *workspace);
+  /**
+   * Backtrack the optimal path of a transition graph updated and build
+   * the complete path and geometry of the result
+   * @param  tg      transition graph updated
+   * @param  traj    trajectory matched
+   * @param  config  configuration of map matching algorithm
+   * @param  partial the budget ran out, so that the layers updated are
+   * the first points of the trajectory
+   * @param  brk     updated with the break, which is not searched if null
+   * @param  clock   clock of the stages profiled
+   * @param  workspace buffers of the optimal path and the complete path
+   * @return map matching result
+   */
+  MatchResult build_result(TransitionGraph *tg,
+                           const CORE::Trajectory &traj,
+                           const FastMapMatchConfig &config, bool partial,
+                           TrajectoryBreak *brk, UTIL::StageClock *clock,
+                           MatchWorkspace *workspace);
+  /**
+   * Find the first node of an optimal path not connected to the previous
+   * one in UBODT
+   * @param  opath optimal path
+   * @return index of the node, or -1 if the path is connected
+   */
+  int find_break(const TGOpath &opath);
  private:
+  class InterleavedTask;
+  friend class FastMapMatchStream;
   const NETWORK::Network &network_;
   const NETWORK::NetworkGraph &graph_;
   std::shared_ptr<UBODT> ubodt_;
+  const long cache_owner_; // id of the model in the look up caches
+  int cache_entries_ = 0; // entries of a look up cache, 0 for none
+  mutable std::atomic<long long> memo_hits_{0};
+  mutable std::atomic<long long> memo_misses_{0};
+  int metric_ = 0; // metric of the costs of the transitions
+  double metric_pace_ = 1; // smallest cost per unit length of the metric
 };
 }
 }
@@ -3,21 +3,335 @@
 //
 
 #include "mm/fmm/fmm_app.hpp"
+#include "io/async_writer.hpp"
+#include "io/edge_aggregate_writer.hpp"
 #include "io/gps_reader.hpp"
 #include "io/mm_writer.hpp"
+#include "io/match_pipeline.hpp"
+#include "io/rematch_filter.hpp"
+#include "io/result_cache.hpp"
+#include "io/sweep_runner.hpp"
+#include "network/chain_graph.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "util/metrics.hpp"
+#include "util/stage_profile.hpp"
+#include "util/tile_profile.hpp"
+#include "util/util.hpp"
+#include "util/affinity.hpp"
 #include <omp.h>
+#include <algorithm>
+#include <cstdio>
+#include <future>
+#include <limits>
+#include <sstream>
+#include <thread>
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
-void FMMApp::run() {
+
+namespace {
+
+// Match a trajectory into the segments written, a single one if the
+// trajectory is not split, with the timestamps of their points if used
+std::vector<SegmentMatchResult> match_trajectory(
+    FastMapMatch *mm_model, const Trajectory &trajectory,
+    const FastMapMatchConfig &config) {
+  std::vector<SegmentMatchResult> segments;
+  if (!config.split) {
+    segments.push_back(SegmentMatchResult{
+        -1, -1, mm_model->match_traj(trajectory, config)});
+  } else {
+    segments = mm_model->match_traj_segments(trajectory, config);
+  }
+  if (config.result_fields.timestamps) {
+    IO::copy_timestamps(trajectory, &segments);
+  }
+  return segments;
+}
+
+// Match the trajectories with all the settings of a sweep, into a result
+// file per setting
+void match_sweep(FastMapMatch *mm_model, IO::GPSReader *reader,
+                 const FMMAppConfig &app_config,
+                 const FastMapMatchConfig &config,
+                 const NETWORK::Network &network) {
+  ParameterSweep sweep;
+  if (!ParameterSweep::parse(app_config.sweep, &sweep)) return;
+  // vmax and factor are not used by fmm
+  std::vector<SweepSetting> settings = sweep.get_settings(SweepSetting{
+      config.k, config.radius, config.gps_error, 0, 0});
+  SPDLOG_INFO("Sweep {} settings", settings.size());
+  IO::SweepRunOptions options;
+  options.use_omp = app_config.use_omp;
+  if (app_config.step > 0) options.step = app_config.step;
+  options.report_file = app_config.sweep_file;
+  IO::run_sweep(
+      reader, app_config.result_config, &network, settings,
+      [&](const Trajectory &trajectory, SweepReport *report) {
+        std::vector<MatchResult> results = mm_model->match_traj_sweep(
+            trajectory, config, settings, report);
+        if (config.result_fields.timestamps) {
+          for (MatchResult &result : results) {
+            result.timestamps = trajectory.timestamps;
+          }
+        }
+        return results;
+      },
+      options);
+}
+
+// Describe the inputs and the configuration the results depend on, so
+// that the results cached are only reused under the same ones
+std::string get_cache_context(const FMMAppConfig &config,
+                              const FastMapMatchConfig &fmm_config) {
+  std::ostringstream context;
+  context.precision(17);
+  context << config.network_config.file << ';'
+          << config.network_config.edge_mask << ';' << config.ubodt_file << ';'
+          << config.ubodt_long_delta << ';'
+          << config.ubodt_generate << ';' << config.ubodt_delta << ';'
+          << fmm_config.k << ';' << fmm_config.radius << ';'
+          << fmm_config.gps_error << ';' << fmm_config.min_ep_ratio << ';'
+          << fmm_config.max_dist_ratio << ';'
+          << fmm_config.adaptive_k_spacing << ';'
+          << fmm_config.max_heading_diff << ';'
+          << fmm_config.min_heading_distance << ';' << fmm_config.beam_size
+          << ';' << fmm_config.beam_margin << ';' << fmm_config.split << ';'
+          << fmm_config.max_time_gap << ';'
+          << fmm_config.stationary_radius << ';' << fmm_config.min_distance
+          << ';' << fmm_config.min_interval << ';'
+          << fmm_config.coarse_step << ';' << fmm_config.corridor_buffer
+          << ';' << fmm_config.corridor_k << ';'
+          << fmm_config.approximate_ep << ';' << fmm_config.metric << ';'
+          << fmm_config.result_fields.candidates << ';'
+          << fmm_config.result_fields.mgeom;
+  return context.str();
+}
+
+} // namespace
+bool FMMApp::save_ubodt(const UBODT &ubodt, const std::string &filename) {
+  // The file is replaced at once, so that it is never read half written
+  std::string temp_file = filename + ".tmp";
+  bool written = UTIL::check_file_extension(filename, "ubz") ?
+      ubodt.write_ubodt_compressed(temp_file) :
+      ubodt.write_ubodt_mmap(temp_file);
+  if (!written || std::rename(temp_file.c_str(), filename.c_str()) != 0) {
+    SPDLOG_ERROR("Fail to save UBODT to {}", filename);
+    std::remove(temp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<UBODT> FMMApp::load_ubodt(const FMMAppConfig &config,
+                                         const NetworkGraph &graph) {
+  return prepare_ubodt(config, graph, read_ubodt(config));
+}
+
+std::shared_ptr<UBODT> FMMApp::read_ubodt(const FMMAppConfig &config) {
+  if (config.get_ubodt_layout() == LAZY) return nullptr;
+  if (UTIL::check_file_extension(config.ubodt_file, "tiles")) {
+    return UBODT::read_ubodt_tiled(config.ubodt_file,
+                                   config.ubodt_max_tiles);
+  }
+  // A UBODT clipped is read with the nodes of the network clipped
+  if (config.ubodt_generate || config.ubodt_clip) return nullptr;
+  return UBODT::read_ubodt_file(config.ubodt_file, 50000,
+                                config.get_ubodt_layout(), config.use_omp);
+}
+
+std::shared_ptr<UBODT> FMMApp::prepare_ubodt(const FMMAppConfig &config,
+                                            const NetworkGraph &graph,
+                                            std::shared_ptr<UBODT> ubodt) {
+  if (config.get_ubodt_layout() == LAZY) {
+    return UBODT::create_lazy_ubodt(graph, config.ubodt_delta,
+                                    config.ubodt_cache_rows);
+  }
+  if (UTIL::check_file_extension(config.ubodt_file, "tiles")) {
+    // The program exits here rather than on the thread reading the file
+    if (ubodt == nullptr) std::exit(EXIT_FAILURE);
+    if (config.ubodt_progressive &&
+        !ubodt->start_progressive_load(graph, UBODT::DEFAULT_LOAD_THREADS,
+                                       config.ubodt_cache_rows)) {
+      std::exit(EXIT_FAILURE);
+    }
+    return ubodt;
+  }
+  if (config.ubodt_generate) {
+    ubodt = UBODT::generate_ubodt(graph, config.ubodt_delta,
+                                  config.get_ubodt_layout(),
+                                  config.ubodt_symmetric, config.use_omp);
+  }
+  if (config.ubodt_clip) {
+    std::string ids_file = UBODT::get_network_ids_file(config.ubodt_file);
+    std::vector<char> nodes;
+    if (!UBODT::read_clipped_nodes(ids_file, graph.get_network(), &nodes)) {
+      std::exit(EXIT_FAILURE);
+    }
+    ubodt = UBODT::read_ubodt_file(config.ubodt_file, 50000,
+                                   config.get_ubodt_layout(),
+                                   config.use_omp, &nodes);
+    ubodt = ubodt->clip_to_network(ids_file, graph.get_network(),
+                                   config.get_ubodt_layout());
+    if (ubodt == nullptr) std::exit(EXIT_FAILURE);
+  }
+  if (config.ubodt_symmetric && !ubodt->set_symmetric(graph)) {
+    std::exit(EXIT_FAILURE);
+  }
+  if (config.ubodt_unroll) ubodt->unroll_paths();
+  if (config.ubodt_filter) ubodt->build_miss_filter();
+  return ubodt;
+}
+
+UTIL::MemoryReport FMMApp::get_memory_report() const {
+  UTIL::MemoryReport report;
+  network_.get_memory_usage(&report);
+  ng_.get_memory_usage(&report);
+  ubodt_->get_memory_usage(&report);
+  return report;
+}
+
+bool FMMApp::run() {
   UTIL::TimePoint start_time = std::chrono::steady_clock::now();
-  FastMapMatch mm_model(network_, ng_, ubodt_);
-  const FastMapMatchConfig &fmm_config = config_.fmm_config;
+  // A replica is loaded by a thread placed on each node, so that its
+  // pages are first touched on the node, and the first one replaces the
+  // UBODT loaded at startup
+  std::vector<std::shared_ptr<UBODT>> replicas{ubodt_};
+  if (config_.ubodt_replicas) {
+    int num_nodes = UTIL::get_numa_nodes().size();
+    replicas.assign(num_nodes, nullptr);
+    std::vector<std::thread> loaders;
+    for (int node = 0; node < num_nodes; ++node) {
+      loaders.emplace_back([this, node, &replicas]() {
+        UTIL::place_thread(UTIL::PLACEMENT_SOCKET, node);
+        replicas[node] = load_ubodt(config_, ng_);
+      });
+    }
+    for (std::thread &loader : loaders) loader.join();
+    ubodt_ = replicas[0];
+    SPDLOG_INFO("UBODT replicas loaded on {} NUMA nodes", num_nodes);
+  }
+  // The chains are shared by the replicas as well
+  if (config_.ubodt_chains) {
+    std::shared_ptr<const ChainGraph> chains =
+        std::make_shared<ChainGraph>(network_);
+    for (const std::shared_ptr<UBODT> &replica : replicas) {
+      if (!replica->set_chains(chains)) return false;
+    }
+  }
+  // The long range tier is shared by the replicas, as its queries touch
+  // few nodes of the hierarchy
+  const std::string &hierarchy_file = config_.ubodt_hierarchy;
+  if (!hierarchy_file.empty()) {
+    std::shared_ptr<ContractionHierarchy> hierarchy;
+    if (UTIL::file_exists(hierarchy_file)) {
+      hierarchy = ContractionHierarchy::read_hierarchy_file(hierarchy_file,
+                                                            network_);
+      if (hierarchy == nullptr) {
+        SPDLOG_CRITICAL("Fail to load contraction hierarchy, program stop");
+        return false;
+      }
+    } else {
+      hierarchy = std::make_shared<ContractionHierarchy>(
+          network_, std::numeric_limits<double>::infinity(),
+          config_.use_omp, false);
+      hierarchy->write_hierarchy_file(hierarchy_file);
+    }
+    for (const std::shared_ptr<UBODT> &replica : replicas) {
+      if (!replica->set_long_range(hierarchy, config_.ubodt_long_delta)) {
+        return false;
+      }
+    }
+  }
+  if (!config_.ubodt_probe_file.empty()) {
+    for (const std::shared_ptr<UBODT> &replica : replicas) {
+      replica->enable_probe_counts(ng_.get_num_vertices());
+    }
+  }
+  const std::string &metric = config_.fmm_config.metric;
+  if (network_.get_metric_index(metric) > 0) {
+    for (const std::shared_ptr<UBODT> &replica : replicas) {
+      if (!replica->build_metric_costs(network_)) return false;
+    }
+  }
+  std::vector<std::unique_ptr<FastMapMatch>> models;
+  for (const std::shared_ptr<UBODT> &replica : replicas) {
+    models.emplace_back(new FastMapMatch(network_, ng_, replica));
+    models.back()->set_lookup_cache(config_.ubodt_lookup_cache);
+    if (!models.back()->set_metric(metric)) return false;
+  }
+  // The UBODT generated is written while the trajectories are matched,
+  // and the future waits for it when the run ends
+  std::future<bool> ubodt_saved;
+  if (config_.ubodt_generate && !config_.ubodt_save.empty()) {
+    std::shared_ptr<const UBODT> table = ubodt_;
+    const std::string &file = config_.ubodt_save;
+    ubodt_saved = std::async(std::launch::async, [table, file]() {
+      return save_ubodt(*table, file);
+    });
+  }
+  FastMapMatch &mm_model = *models[0];
+  // Only the fields of the results written are built
+  FastMapMatchConfig fmm_config = config_.fmm_config;
+  fmm_config.result_fields =
+      IO::get_result_fields(config_.result_config);
   IO::GPSReader reader(config_.gps_config);
-  IO::CSVMatchResultWriter writer(config_.result_config.file,
-                                  config_.result_config.output_config);
+  reader.set_shard(config_.shard, config_.num_shards);
+  if (!config_.sweep.empty()) {
+    match_sweep(&mm_model, &reader, config_, fmm_config, network_);
+    if (ubodt_saved.valid() && ubodt_saved.get()) {
+      SPDLOG_INFO("UBODT generated is saved to {}", config_.ubodt_save);
+    }
+    SPDLOG_INFO("Time takes {}", std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_time).count());
+    return true;
+  }
+  // With a previous result file, only the trajectories affected by the
+  // changes of the network are matched, into a file merged afterwards
+  CONFIG::ResultConfig result_config = config_.result_config;
+  std::unique_ptr<IO::RematchFilter> rematch;
+  if (!config_.rematch_file.empty()) {
+    std::vector<BoostBox> areas;
+    if (!IO::RematchFilter::parse_areas(config_.changed_areas, &areas)) {
+      return false;
+    }
+    rematch.reset(new IO::RematchFilter(
+        network_, UTIL::string2vec<EdgeID>(config_.changed_edges), areas,
+        fmm_config.radius));
+    if (!rematch->read_previous(config_.rematch_file)) return false;
+    reader.set_filter([&rematch](const Trajectory &trajectory) {
+      return rematch->select(trajectory);
+    });
+    result_config.file += ".rematch";
+  }
+  // A job resumed appends to the results kept by its checkpoint and skips
+  // their trajectories
+  const std::string &result_file = config_.result_config.file;
+  long skipped = 0;
+  bool append = false;
+  if (config_.resume) {
+    if (UTIL::file_exists(IO::MatchCheckpoint::checkpoint_file(result_file))) {
+      if (!IO::MatchCheckpoint::resume(result_file, &skipped)) return false;
+      append = true;
+    } else {
+      SPDLOG_INFO("No checkpoint of {}, start from the beginning",
+                  result_file);
+    }
+  }
+  std::unique_ptr<IO::MatchResultWriter> writer =
+      IO::MatchResultWriter::create(result_config, append, &network_);
+  if (writer == nullptr) return false;
+  if (append) {
+    skipped = IO::MatchCheckpoint::skip_trajectories(&reader, skipped);
+  }
+  std::unique_ptr<IO::MatchCheckpoint> checkpoint;
+  if (config_.checkpoint_interval > 0) {
+    checkpoint.reset(new IO::MatchCheckpoint(
+        result_file, static_cast<IO::CSVMatchResultWriter *>(writer.get()),
+        config_.checkpoint_interval, skipped));
+  }
   // Start map matching
   int progress = 0;
   int points_matched = 0;
@@ -25,35 +339,152 @@ void FMMApp::run() {
   int step_size = 100;
   if (config_.step > 0) step_size = config_.step;
   SPDLOG_INFO("Progress report step {}", step_size);
+  get_memory_report().print();
+  SPDLOG_INFO("Routing workspace up to {:.1f} MB per thread",
+              ng_.get_workspace_bytes() / (1024.0 * 1024.0));
   UTIL::TimePoint corrected_begin = std::chrono::steady_clock::now();
   SPDLOG_INFO("Start to match trajectories");
-  if (config_.use_omp){
-    SPDLOG_INFO("Run map matching parallelly");
-    int buffer_trajectories_size = 100000;
+  UTIL::StageProfile::set_counters_enabled(config_.profile_counters);
+  UTIL::StageProfile::set_enabled(config_.profile ||
+                                  config_.profile_counters ||
+                                  !config_.profile_file.empty() ||
+                                  !config_.trace_file.empty());
+  if (!config_.trace_file.empty()) {
+    UTIL::StageTrace::start(config_.trace_sample, config_.trace_threshold);
+  }
+  if (!config_.tile_profile_file.empty()) {
+    UTIL::TileProfile::set_tile_size(config_.tile_size);
+  }
+  std::unique_ptr<IO::ResultCache> cache;
+  if (config_.result_cache > 0) {
+    cache.reset(new IO::ResultCache(config_.result_cache * 1024L * 1024L,
+                                    get_cache_context(config_, fmm_config)));
+  }
+  // The metrics are read by the thread of the exporter while matching
+  IO::MatchPipelineProgress pipeline_progress;
+  UTIL::MetricsExporter metrics(config_.metrics_file,
+                                config_.metrics_interval);
+  if (!config_.metrics_file.empty()) {
+    metrics.add_collector([&pipeline_progress](UTIL::MetricsText *text) {
+      IO::append_pipeline_metrics(&pipeline_progress, text);
+    });
+    metrics.add_collector([this](UTIL::MetricsText *text) {
+      append_ubodt_metrics(*ubodt_, text);
+      UTIL::append_memory_metrics(get_memory_report(), text);
+    });
+    if (cache != nullptr) {
+      metrics.add_collector([&cache](UTIL::MetricsText *text) {
+        IO::append_result_cache_metrics(*cache, text);
+      });
+    }
+    if (config_.result_config.async_write) {
+      metrics.add_collector([](UTIL::MetricsText *text) {
+        IO::append_async_write_metrics(text);
+      });
+    }
+    metrics.start();
+  }
+  if (config_.gpu) {
+    std::unique_ptr<DeviceUBODT> device = DeviceUBODT::create(*ubodt_);
+    if (device == nullptr) return false;
+    SPDLOG_INFO("Run map matching in batches of {} scored on {}",
+                config_.gpu_batch, device->on_device() ? "GPU" : "host");
+    std::vector<Trajectory> batch;
     while (reader.has_next_trajectory()) {
-      std::vector<Trajectory> trajectories =
-        reader.read_next_N_trajectories(buffer_trajectories_size);
-      int trajectories_fetched = trajectories.size();
-      #pragma omp parallel for
-      for (int i = 0; i < trajectories_fetched; ++i) {
-        Trajectory &trajectory = trajectories[i];
-        int points_in_tr = trajectory.geom.get_num_points();
-        MM::MatchResult result = mm_model.match_traj(
-            trajectory, fmm_config);
-        writer.write_result(result);
-        #pragma omp critical
-        if (!result.cpath.empty()) {
-          points_matched += points_in_tr;
+      batch.clear();
+      while (reader.has_next_trajectory() &&
+             batch.size() < (std::size_t) config_.gpu_batch) {
+        batch.push_back(reader.read_next_trajectory());
+      }
+      std::vector<MatchResult> results =
+          mm_model.match_batch(batch, fmm_config, *device);
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        std::vector<SegmentMatchResult> segments{
+            SegmentMatchResult{-1, -1, std::move(results[i])}};
+        if (fmm_config.result_fields.timestamps) {
+          IO::copy_timestamps(batch[i], &segments);
         }
+        writer->write_result(segments[0]);
+        int points_in_tr = batch[i].geom.get_num_points();
+        points_matched += IO::count_points_matched(segments, points_in_tr);
         total_points += points_in_tr;
-        ++progress;
-        if (progress % step_size == 0) {
-          std::stringstream buf;
-          buf << "Progress " << progress << '\n';
-          std::cout << buf.rdbuf();
+      }
+      progress += batch.size();
+      SPDLOG_INFO("Progress {}", progress);
+      if (checkpoint != nullptr) checkpoint->update(progress);
+      pipeline_progress.trajectories = progress;
+      pipeline_progress.total_points = total_points;
+      pipeline_progress.points_matched = points_matched;
+    }
+  } else if (config_.interleave > 0 || config_.lockstep > 0) {
+    // The batches give each thread enough trajectories to keep its group
+    // busy
+    int num_threads = config_.use_omp ? omp_get_max_threads() : 1;
+    int group_size = std::max(config_.interleave, config_.lockstep);
+    std::size_t batch_size =
+        (std::size_t) group_size * num_threads * config_.chunk_size;
+    SPDLOG_INFO("Run map matching {} {} trajectories in {} threads",
+                config_.lockstep > 0 ? "in lockstep" : "interleaving",
+                group_size, num_threads);
+    std::vector<Trajectory> batch;
+    while (reader.has_next_trajectory()) {
+      batch.clear();
+      while (reader.has_next_trajectory() && batch.size() < batch_size) {
+        batch.push_back(reader.read_next_trajectory());
+      }
+      std::vector<MatchResult> results = config_.lockstep > 0 ?
+          mm_model.match_traj_lockstep(batch, fmm_config, group_size,
+                                       num_threads) :
+          mm_model.match_traj_interleaved(batch, fmm_config, group_size,
+                                          num_threads);
+      for (std::size_t i = 0; i < batch.size(); ++i) {
+        std::vector<SegmentMatchResult> segments{
+            SegmentMatchResult{-1, -1, std::move(results[i])}};
+        if (fmm_config.result_fields.timestamps) {
+          IO::copy_timestamps(batch[i], &segments);
         }
+        writer->write_result(segments[0]);
+        int points_in_tr = batch[i].geom.get_num_points();
+        points_matched += IO::count_points_matched(segments, points_in_tr);
+        total_points += points_in_tr;
       }
+      progress += batch.size();
+      SPDLOG_INFO("Progress {}", progress);
+      if (checkpoint != nullptr) checkpoint->update(progress);
+      pipeline_progress.trajectories = progress;
+      pipeline_progress.total_points = total_points;
+      pipeline_progress.points_matched = points_matched;
     }
+  } else if (config_.use_omp){
+    SPDLOG_INFO("Run map matching parallelly");
+    IO::MatchPipelineOptions options;
+    options.num_matchers = omp_get_max_threads();
+    options.step = step_size;
+    options.chunk_size = config_.chunk_size;
+    options.memory_budget = config_.memory_budget * 1024L * 1024L;
+    // The results of the trajectories reordered are written back in the
+    // input order
+    // The trajectories of a checkpoint are written in the input order
+    options.ordered = config_.ordered_output || config_.spatial_order ||
+        checkpoint != nullptr;
+    options.spatial_order = config_.spatial_order;
+    options.progress = &pipeline_progress;
+    options.checkpoint = checkpoint.get();
+    options.cache = cache.get();
+    options.placement = config_.get_thread_placement();
+    IO::MatchPipelineStatistics statistics = IO::run_match_pipeline(
+        &reader, writer.get(),
+        [&](const Trajectory &trajectory) {
+          // The matchers use the replica of their node, if any
+          FastMapMatch *model = models.size() > 1 ?
+              models[UTIL::get_thread_node()].get() : &mm_model;
+          return match_trajectory(model, trajectory, fmm_config);
+        },
+        options);
+    progress = statistics.trajectories;
+    points_matched = statistics.points_matched;
+    total_points = statistics.total_points;
+    IO::print_pipeline_statistics(statistics);
   } else {
     SPDLOG_INFO("Run map matching in single thread");
     while (reader.has_next_trajectory()) {
@@ -62,17 +493,97 @@ void FMMApp::run() {
       }
       Trajectory trajectory = reader.read_next_trajectory();
       int points_in_tr = trajectory.geom.get_num_points();
-      MM::MatchResult result = mm_model.match_traj(
-          trajectory, fmm_config);
-      writer.write_result(result);
-      if (!result.cpath.empty()) {
-        points_matched += points_in_tr;
+      std::vector<SegmentMatchResult> segments;
+      if (cache == nullptr || !cache->look_up(trajectory, &segments)) {
+        segments = match_trajectory(&mm_model, trajectory, fmm_config);
+        if (cache != nullptr) cache->insert(trajectory, segments);
+      }
+      UTIL::StageClock clock;
+      for (const SegmentMatchResult &segment : segments) {
+        writer->write_result(segment);
       }
+      clock.lap(UTIL::STAGE_WRITE);
+      points_matched += IO::count_points_matched(segments, points_in_tr);
       total_points += points_in_tr;
       ++progress;
+      if (checkpoint != nullptr) checkpoint->update(progress);
+      pipeline_progress.trajectories = progress;
+      pipeline_progress.total_points = total_points;
+      pipeline_progress.points_matched = points_matched;
+      if (UTIL::StageProfile::is_enabled()) {
+        UTIL::StageProfile::local().finish_trajectory(trajectory.id);
+      }
+    }
+  }
+  // The rows buffered by a writer may still fail to be written
+  bool written = writer->close();
+  if (checkpoint != nullptr) checkpoint->save(progress);
+  if (rematch != nullptr && written) {
+    // The results are complete once the writer is closed
+    writer.reset();
+    SPDLOG_INFO("Rematch {} trajectories, {} not affected",
+                rematch->get_selected(), reader.get_filtered());
+    if (rematch->merge(config_.rematch_file, result_config.file,
+                       config_.result_config.file)) {
+      std::remove(result_config.file.c_str());
     }
   }
   SPDLOG_INFO("MM process finished");
+  metrics.stop();
+  UTIL::print_workspace_memory();
+  if (UTIL::StageProfile::is_enabled()) {
+    UTIL::StageStatistics stage_statistics = UTIL::StageProfile::collect();
+    UTIL::StageProfile::print(stage_statistics);
+    if (!config_.profile_file.empty()) {
+      UTIL::StageProfile::write_json(stage_statistics, config_.profile_file);
+    }
+    if (!config_.trace_file.empty()) {
+      UTIL::StageTrace::stop();
+      UTIL::StageTrace::write_json(config_.trace_file);
+    }
+  }
+  if (UTIL::TileProfile::is_enabled()) {
+    std::vector<UTIL::TileStatistics> tiles = UTIL::TileProfile::collect();
+    UTIL::TileProfile::print(tiles);
+    UTIL::TileProfile::write_file(tiles, config_.tile_profile_file);
+  }
+  ubodt_->print_cache_statistics();
+  network_.print_search_statistics();
+  if (config_.ubodt_lookup_cache > 0) {
+    LookupCacheStatistics lookups;
+    for (const std::unique_ptr<FastMapMatch> &model : models) {
+      LookupCacheStatistics statistics = model->get_lookup_cache_statistics();
+      lookups.hits += statistics.hits;
+      lookups.misses += statistics.misses;
+    }
+    long long total = lookups.hits + lookups.misses;
+    SPDLOG_INFO("UBODT lookup cache hits {} misses {} hit rate {:.4f}",
+                lookups.hits, lookups.misses,
+                total > 0 ? lookups.hits / (double) total : 0.0);
+  }
+  LookupCacheStatistics memo;
+  for (const std::unique_ptr<FastMapMatch> &model : models) {
+    LookupCacheStatistics statistics = model->get_transition_memo_statistics();
+    memo.hits += statistics.hits;
+    memo.misses += statistics.misses;
+  }
+  long long memo_total = memo.hits + memo.misses;
+  SPDLOG_INFO("Transition memo hits {} misses {} hit rate {:.4f}",
+              memo.hits, memo.misses,
+              memo_total > 0 ? memo.hits / (double) memo_total : 0.0);
+  if (!config_.ubodt_probe_file.empty()) {
+    // The probes of the replicas are summed up
+    std::vector<long long> counts(ng_.get_num_vertices(), 0);
+    for (const std::shared_ptr<UBODT> &replica : replicas) {
+      const std::vector<long long> &probes = replica->get_probe_counts();
+      for (size_t i = 0; i < probes.size(); ++i) counts[i] += probes[i];
+    }
+    UBODT::write_probe_counts(counts, config_.ubodt_probe_file);
+  }
+  if (cache != nullptr) cache->print_statistics();
+  if (ubodt_saved.valid() && ubodt_saved.get()) {
+    SPDLOG_INFO("UBODT generated is saved to {}", config_.ubodt_save);
+  }
   UTIL::TimePoint end_time = std::chrono::steady_clock::now();
   double time_spent = std::chrono::duration_cast<std::chrono::milliseconds>(
       end_time - start_time).count() / 1000.;
@@ -87,4 +598,5 @@ void FMMApp::run() {
   SPDLOG_INFO("Point match speed (excluding input): {}",
               points_matched / time_spent_exclude_input);
   SPDLOG_INFO("Time takes {}", time_spent);
+  return written;
 };
\ No newline at end of file
@@ -14,6 +14,9 @@
 #include "fmm_app_config.hpp"
 #include "fmm_algorithm.hpp"
 
+#include <functional>
+#include <future>
+
 namespace FMM{
 namespace MM{
 /**
@@ -22,24 +25,78 @@ namespace MM{
 class FMMApp {
  public:
   /**
-   * Create FMMApp from configuration data
+   * Create FMMApp from configuration data. The UBODT file is read on a
+   * background thread while the network is read and its graph built.
    * @param config Configuration of the FMMApp defining network, graph
    * and UBODT.
    */
   FMMApp(const FMMAppConfig &config) :
       config_(config),
+      ubodt_read_(std::async(std::launch::async, read_ubodt,
+                             std::cref(config_))),
       network_(config_.network_config.file,
                config_.network_config.id,
                config_.network_config.source,
-               config_.network_config.target),
-      ng_(network_),
-      ubodt_(UBODT::read_ubodt_file(config_.ubodt_file)){};
+               config_.network_config.target,
+               config_.network_config.cache,
+               config_.network_config.get_spatial_index_options(),
+               config_.network_config.reorder,
+               config_.network_config.project,
+               config_.network_config.get_clip(),
+               config_.network_config.compress_geometry,
+               config_.network_config.get_cost_names()),
+      ng_(network_, config_.network_config.read_edge_mask(network_)),
+      ubodt_(prepare_ubodt(config_, ng_, ubodt_read_.get())){};
   /**
    * Run the fmm program
+   * @return false if the program stops on an error or the results
+   * cannot be written
    */
-  void run();
+  bool run();
  private:
+  /**
+   * Load or create the UBODT defined in configuration
+   * @param config Configuration of the FMMApp
+   * @param graph  Network graph used by lazy UBODT, whose network is
+   * the one a UBODT is clipped to
+   * @return A shared pointer to the UBODT data
+   */
+  static std::shared_ptr<UBODT> load_ubodt(
+      const FMMAppConfig &config, const NETWORK::NetworkGraph &graph);
+  /**
+   * Read the UBODT file defined in configuration, which does not depend
+   * on the network
+   * @param config Configuration of the FMMApp
+   * @return the UBODT read, nullptr if it is created from the graph, it
+   * is clipped, as only the rows of the nodes of the network clipped are
+   * read, or the file is not read
+   */
+  static std::shared_ptr<UBODT> read_ubodt(const FMMAppConfig &config);
+  /**
+   * Create the UBODT from the graph if it is not read, and apply the
+   * options of the configuration depending on the network
+   * @param config Configuration of the FMMApp
+   * @param graph  Network graph
+   * @param ubodt  UBODT returned by read_ubodt
+   * @return A shared pointer to the UBODT data
+   */
+  static std::shared_ptr<UBODT> prepare_ubodt(
+      const FMMAppConfig &config, const NETWORK::NetworkGraph &graph,
+      std::shared_ptr<UBODT> ubodt);
+  /**
+   * Write a UBODT into a file of mmap or ubz format by its extension
+   * @param  ubodt    UBODT written
+   * @param  filename file written, replaced once complete
+   * @return true if written
+   */
+  static bool save_ubodt(const UBODT &ubodt, const std::string &filename);
+  /**
+   * Collect the memory of the structures loaded, which is collected
+   * again for each write of the metrics as the caches grow
+   */
+  UTIL::MemoryReport get_memory_report() const;
   const FMMAppConfig &config_;
+  std::future<std::shared_ptr<UBODT>> ubodt_read_;
   NETWORK::Network network_;
   NETWORK::NetworkGraph ng_;
   std::shared_ptr<UBODT> ubodt_;
@@ -5,6 +5,7 @@
 #include "mm/fmm/fmm_app_config.hpp"
 #include "util/debug.hpp"
 #include "util/util.hpp"
+#include "util/memory.hpp"
 
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
@@ -23,7 +24,13 @@ FMMAppConfig::FMMAppConfig(int argc, char **argv){
   } else {
     load_arg(argc,argv);
   }
+  // The results written to stdout are not mixed with the logs
+  if (result_config.file == "-") UTIL::log_to_stderr();
   spdlog::set_level((spdlog::level::level_enum) log_level);
+  UTIL::MemoryOptions memory_options;
+  memory_options.huge_pages = huge_pages;
+  memory_options.interleave = numa_interleave;
+  UTIL::set_memory_options(memory_options);
   if (!help_specified)
     print();
 };
@@ -37,11 +44,81 @@ void FMMAppConfig::load_xml(const std::string &file){
   gps_config = GPSConfig::load_from_xml(tree);
   result_config = CONFIG::ResultConfig::load_from_xml(tree);
   fmm_config = FastMapMatchConfig::load_from_xml(tree);
+  result_config.output_config.write_segment = fmm_config.split;
+  result_config.output_config.write_partial =
+      fmm_config.get_match_budget().is_enabled();
   // UBODT
-  ubodt_file = tree.get<std::string>("config.input.ubodt.file");
+  ubodt_layout = tree.get("config.input.ubodt.layout", std::string("chained"));
+  ubodt_file = tree.get("config.input.ubodt.file", std::string(""));
+  ubodt_delta = tree.get("config.input.ubodt.delta", 3000.0);
+  ubodt_cache_rows = tree.get("config.input.ubodt.cache_rows",
+                              UBODT::DEFAULT_CACHE_ROWS);
+  ubodt_max_tiles = tree.get("config.input.ubodt.max_tiles",
+                             UBODT::DEFAULT_RESIDENT_TILES);
+  ubodt_progressive =
+      !(!tree.get_child_optional("config.input.ubodt.progressive"));
+  ubodt_unroll = !(!tree.get_child_optional("config.input.ubodt.unroll"));
+  ubodt_symmetric =
+      !(!tree.get_child_optional("config.input.ubodt.symmetric"));
+  ubodt_chains = !(!tree.get_child_optional("config.input.ubodt.chains"));
+  ubodt_clip = !(!tree.get_child_optional("config.input.ubodt.clip"));
+  ubodt_filter = !(!tree.get_child_optional("config.input.ubodt.filter"));
+  ubodt_replicas =
+      !(!tree.get_child_optional("config.input.ubodt.replicas"));
+  ubodt_hierarchy = tree.get("config.input.ubodt.hierarchy",
+                             std::string(""));
+  ubodt_long_delta = tree.get("config.input.ubodt.long_delta", 0.0);
+  ubodt_lookup_cache = tree.get("config.input.ubodt.lookup_cache", 0);
+  ubodt_probe_file = tree.get("config.input.ubodt.probe_file",
+                              std::string(""));
+  ubodt_generate =
+      !(!tree.get_child_optional("config.input.ubodt.generate"));
+  ubodt_save = tree.get("config.input.ubodt.save", std::string(""));
   log_level = tree.get("config.other.log_level",2);
   step =  tree.get("config.other.step",100);
+  chunk_size = tree.get("config.other.chunk_size",64);
+  memory_budget = tree.get("config.other.memory_budget",0);
+  thread_placement = tree.get("config.other.thread_placement",
+                              std::string("none"));
+  result_cache = tree.get("config.other.result_cache",0);
+  gpu = !(!tree.get_child_optional("config.other.gpu"));
+  gpu_batch = tree.get("config.other.gpu_batch",1000);
+  interleave = tree.get("config.other.interleave",0);
+  lockstep = tree.get("config.other.lockstep",0);
   use_omp = !(!tree.get_child_optional("config.other.use_omp"));
+  ordered_output =
+      !(!tree.get_child_optional("config.other.ordered_output"));
+  spatial_order = !(!tree.get_child_optional("config.other.spatial_order"));
+  profile = !(!tree.get_child_optional("config.other.profile"));
+  profile_file = tree.get("config.other.profile_file", std::string(""));
+  profile_counters =
+      !(!tree.get_child_optional("config.other.profile_counters"));
+  trace_file = tree.get("config.other.trace.file", std::string(""));
+  trace_sample = tree.get("config.other.trace.sample", 1000L);
+  trace_threshold = tree.get("config.other.trace.threshold", 0.0);
+  tile_profile_file =
+      tree.get("config.other.tile_profile.file", std::string(""));
+  tile_size = tree.get("config.other.tile_profile.tile_size", 1000.0);
+  metrics_file = tree.get("config.other.metrics_file", std::string(""));
+  metrics_interval = tree.get("config.other.metrics_interval", 15);
+  checkpoint_interval = tree.get("config.other.checkpoint_interval", 0.0);
+  resume = !(!tree.get_child_optional("config.other.resume"));
+  rematch_file = tree.get("config.input.rematch.file", std::string(""));
+  changed_edges = tree.get("config.input.rematch.changed_edges",
+                           std::string(""));
+  changed_areas = tree.get("config.input.rematch.changed_areas",
+                           std::string(""));
+  shard = tree.get("config.input.shard", 0);
+  num_shards = tree.get("config.input.num_shards", 1);
+  sweep = tree.get("config.other.sweep.parameters", std::string(""));
+  sweep_file = tree.get("config.other.sweep.file", std::string(""));
+  if (num_shards > 1) {
+    result_config.file = CONFIG::ResultConfig::get_shard_file(
+        result_config.file, shard, num_shards);
+  }
+  huge_pages = !(!tree.get_child_optional("config.other.huge_pages"));
+  numa_interleave =
+      !(!tree.get_child_optional("config.other.numa_interleave"));
   SPDLOG_INFO("Finish with reading FMM xml configuration");
 };
 
@@ -51,6 +128,27 @@ void FMMAppConfig::load_arg(int argc, char **argv){
   options.add_options()
     ("ubodt","Ubodt file name",
     cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_layout","Ubodt storage layout",
+    cxxopts::value<std::string>()->default_value("chained"))
+    ("ubodt_delta","Upperbound of lazy or generated ubodt",
+    cxxopts::value<double>()->default_value("3000"))
+    ("ubodt_cache_rows","Maximum rows cached in lazy ubodt",
+    cxxopts::value<long>()->default_value(
+        std::to_string(UBODT::DEFAULT_CACHE_ROWS)))
+    ("ubodt_max_tiles","Maximum tiles mapped in tiled ubodt",
+    cxxopts::value<int>()->default_value(
+        std::to_string(UBODT::DEFAULT_RESIDENT_TILES)))
+    ("ubodt_progressive","Load the tiles of tiled ubodt while matching")
+    ("ubodt_hierarchy","Contraction hierarchy file of the long range ubodt",
+    cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_long_delta","Upperbound of the long range ubodt",
+    cxxopts::value<double>()->default_value("0"))
+    ("ubodt_lookup_cache","Entries of the ubodt look up cache of a thread",
+    cxxopts::value<int>()->default_value("0"))
+    ("ubodt_probe_file","CSV file of the ubodt probes of each source",
+    cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_save","File the generated ubodt is written to",
+    cxxopts::value<std::string>()->default_value(""))
     ("network","Network file name",
     cxxopts::value<std::string>()->default_value(""))
     ("network_id","Network id name",
@@ -59,6 +157,43 @@ void FMMAppConfig::load_arg(int argc, char **argv){
     cxxopts::value<std::string>()->default_value("source"))
     ("target","Network target name",
     cxxopts::value<std::string>()->default_value("target"))
+    ("no_network_cache","Do not read or write the network cache")
+    ("rtree","Rtree algorithm",
+    cxxopts::value<std::string>()->default_value("packing"))
+    ("rtree_max_elements","Rtree node capacity",
+    cxxopts::value<int>()->default_value("16"))
+    ("rtree_chunk_segments","Segments of the edge chunks in the rtree",
+    cxxopts::value<int>()->default_value("0"))
+    ("spatial_index","Spatial index of the edges",
+    cxxopts::value<std::string>()->default_value("rtree"))
+    ("grid_cell_size","Cell size of the grid index",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_batch_size","Points searched with one spatial index query",
+    cxxopts::value<int>()->default_value("1"))
+    ("nearest_search","Search the candidates with the nearest query")
+    ("search_initial_radius","Radius of the first search of a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_min_candidates","Candidates below which the radius grows",
+    cxxopts::value<int>()->default_value("1"))
+    ("search_radius_growth","Factor of each growth of the radius",
+    cxxopts::value<double>()->default_value("2"))
+    ("search_snap_resolution","Cell size of the snapping cache",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_snap_items","Maximum edges cached by the snapping cache",
+    cxxopts::value<long>()->default_value(
+        std::to_string(NETWORK::SnapCache::DEFAULT_CACHE_ITEMS)))
+    ("reorder_network","Renumber nodes along the Hilbert curve")
+    ("project_network","Project a lon/lat network into metres")
+    ("compress_geometry","Keep the edge geometries compressed")
+    ("twin_edges","Index the twin edges of two-way roads once")
+    ("network_clip","Region of the network read, box or WKT polygon",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_clip_margin","Margin around the network clip region",
+      cxxopts::value<double>()->default_value("0"))
+    ("network_costs","Extra cost columns of the network",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_edge_mask","File of the ids of the edges allowed",
+      cxxopts::value<std::string>()->default_value(""))
     ("gps","GPS file name",
     cxxopts::value<std::string>()->default_value(""))
     ("gps_id","GPS file id",
@@ -71,34 +206,203 @@ void FMMAppConfig::load_arg(int argc, char **argv){
     cxxopts::value<std::string>()->default_value("geom"))
     ("gps_timestamp",   "GPS file timestamp column name",
     cxxopts::value<std::string>()->default_value("timestamp"))
+    ("gps_read_threads","Threads reading a GPS file",
+    cxxopts::value<int>())
+    ("gps_timestamp_format","Format of the timestamps of a CSV file",
+    cxxopts::value<std::string>())
     ("k,candidates","Number of candidates",
     cxxopts::value<int>()->default_value("8"))
     ("r,radius","Search radius",
     cxxopts::value<double>()->default_value("300.0"))
     ("e,error","GPS error",
     cxxopts::value<double>()->default_value("50.0"))
+    ("min_ep_ratio","Minimum emission probability ratio to the best",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_dist_ratio","Maximum distance ratio to the best candidate",
+    cxxopts::value<double>()->default_value("0"))
+    ("adaptive_k_spacing","Point spacing below which k is reduced",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_heading_diff","Maximum angle between point heading and edge",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_heading_distance","Neighbour distance giving a reliable heading",
+    cxxopts::value<double>()->default_value("0"))
+    ("beam_size","Maximum number of states expanded per layer",
+    cxxopts::value<int>()->default_value("0"))
+    ("beam_margin","Maximum log probability difference to the best state",
+    cxxopts::value<double>()->default_value("0"))
+    ("split","Split the trajectories at the breaks of the matching")
+    ("max_time_gap","Time gap splitting the trajectories",
+    cxxopts::value<double>()->default_value("0"))
+    ("parallel_viterbi","Points from which a trajectory runs in parallel",
+    cxxopts::value<int>()->default_value("0"))
+    ("stationary_radius","Radius of the stationary clusters collapsed",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_distance","Minimum distance between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_interval","Minimum time between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("coarse_step","Points per point of the coarse pass",
+    cxxopts::value<int>()->default_value("0"))
+    ("corridor_buffer","Buffer of the corridor of the coarse path",
+    cxxopts::value<double>()->default_value("0"))
+    ("corridor_k","Number of candidates in the corridor",
+    cxxopts::value<int>()->default_value("0"))
+    ("approximate_ep","Approximate the emission probabilities")
+    ("max_seconds","Maximum seconds spent on a trajectory",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_transitions","Maximum transitions evaluated for a trajectory",
+    cxxopts::value<long>()->default_value("0"))
+    ("metric","Cost column of the network scoring the transitions",
+    cxxopts::value<std::string>()->default_value(""))
     ("o,output","Output file name",
     cxxopts::value<std::string>()->default_value(""))
     ("output_fields","Output fields",
     cxxopts::value<std::string>()->default_value(""))
+    ("output_precision","Decimals of the coordinates written",
+    cxxopts::value<int>())
+    ("output_geometry_encoding","Encoding of the geometries written, "
+     "wkt, hexwkb, wkb, polyline or delta",
+    cxxopts::value<std::string>())
+    ("output_format","Format of the output file, csv, arrow, edges, "
+     "index or state",
+    cxxopts::value<std::string>())
+    ("output_shard_size","Rows written into each shard of the output",
+    cxxopts::value<int>())
+    ("output_async","Write the output by a thread of its own")
     ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
     ("step","Step report",cxxopts::value<int>()->default_value("100"))
+    ("chunk_size","Trajectories taken at once by a matcher thread",
+    cxxopts::value<int>()->default_value("64"))
+    ("memory_budget","Memory of the trajectories held in MB",
+    cxxopts::value<int>()->default_value("0"))
+    ("thread_placement","Placement of the matcher threads",
+    cxxopts::value<std::string>()->default_value("none"))
+    ("result_cache","Memory of the results reused for duplicates in MB",
+    cxxopts::value<int>()->default_value("0"))
+    ("gpu","Score the transitions on a GPU if specified")
+    ("gpu_batch","Trajectories of a batch scored on a GPU",
+    cxxopts::value<int>()->default_value("1000"))
+    ("interleave","Trajectories interleaved by a matcher thread",
+    cxxopts::value<int>()->default_value("0"))
+    ("lockstep","Trajectories advanced in SIMD lanes by a matcher thread",
+    cxxopts::value<int>()->default_value("0"))
     ("h,help",   "Help information")
     ("gps_point","GPS point or not")
-    ("use_omp","Use parallel computing if specified");
+    ("ubodt_unroll","Unroll ubodt paths if specified")
+    ("ubodt_symmetric","Ubodt stores each unordered od pair once")
+    ("ubodt_chains","Ubodt stores the rows between junctions of chains")
+    ("ubodt_clip","Keep the ubodt rows inside the network clipped")
+    ("ubodt_filter","Build ubodt miss filter if specified")
+    ("ubodt_replicas","Load a ubodt on each NUMA node if specified")
+    ("ubodt_generate","Generate ubodt from the network if specified")
+    ("use_omp","Use parallel computing if specified")
+    ("ordered_output","Write the results in the input order if specified")
+    ("spatial_order","Match nearby trajectories together if specified")
+    ("profile","Report the time spent in each stage if specified")
+    ("profile_counters","Count hardware events of each stage if specified")
+    ("profile_file","JSON file of the time spent in each stage",
+    cxxopts::value<std::string>()->default_value(""))
+    ("trace_file","Chrome trace file of the trajectories sampled",
+    cxxopts::value<std::string>()->default_value(""))
+    ("trace_sample","1 in trace_sample trajectories traced",
+    cxxopts::value<long>()->default_value("1000"))
+    ("trace_threshold","Trajectories slower than it traced in seconds",
+    cxxopts::value<double>()->default_value("0"))
+    ("tile_profile_file","GeoJSON or CSV file of the work per tile",
+    cxxopts::value<std::string>()->default_value(""))
+    ("tile_size","Size of the tiles of the tile profile",
+    cxxopts::value<double>()->default_value("1000"))
+    ("metrics_file","Prometheus text file of the metrics of the job",
+    cxxopts::value<std::string>()->default_value(""))
+    ("metrics_interval","Seconds between two writes of the metrics file",
+    cxxopts::value<int>()->default_value("15"))
+    ("checkpoint_interval","Seconds between two checkpoints of the results",
+    cxxopts::value<double>()->default_value("0"))
+    ("resume","Resume from the checkpoint of the result file")
+    ("rematch","Previous result file whose affected trajectories rematch",
+    cxxopts::value<std::string>()->default_value(""))
+    ("changed_edges","ID of the edges changed separated by ,",
+    cxxopts::value<std::string>()->default_value(""))
+    ("changed_areas","Areas changed as minx,miny,maxx,maxy separated by ;",
+    cxxopts::value<std::string>()->default_value(""))
+    ("shard","Shard of the input matched, from 0",
+    cxxopts::value<int>()->default_value("0"))
+    ("num_shards","Number of shards the input is split into",
+    cxxopts::value<int>()->default_value("1"))
+    ("sweep","Values of the parameters swept, as k=4,8;radius=100,300",
+    cxxopts::value<std::string>()->default_value(""))
+    ("sweep_file","CSV file of the results and time of each setting",
+    cxxopts::value<std::string>()->default_value(""))
+    ("huge_pages","Use transparent huge pages if specified")
+    ("numa_interleave","Interleave tables over NUMA nodes if specified");
   if (argc==1) {
     help_specified = true;
     return;
   }
   auto result = options.parse(argc, argv);
   ubodt_file = result["ubodt"].as<std::string>();
+  ubodt_layout = result["ubodt_layout"].as<std::string>();
+  ubodt_delta = result["ubodt_delta"].as<double>();
+  ubodt_cache_rows = result["ubodt_cache_rows"].as<long>();
+  ubodt_max_tiles = result["ubodt_max_tiles"].as<int>();
+  ubodt_progressive = result.count("ubodt_progressive")>0;
+  ubodt_unroll = result.count("ubodt_unroll")>0;
+  ubodt_symmetric = result.count("ubodt_symmetric")>0;
+  ubodt_chains = result.count("ubodt_chains")>0;
+  ubodt_clip = result.count("ubodt_clip")>0;
+  ubodt_filter = result.count("ubodt_filter")>0;
+  ubodt_replicas = result.count("ubodt_replicas")>0;
+  ubodt_hierarchy = result["ubodt_hierarchy"].as<std::string>();
+  ubodt_long_delta = result["ubodt_long_delta"].as<double>();
+  ubodt_lookup_cache = result["ubodt_lookup_cache"].as<int>();
+  ubodt_probe_file = result["ubodt_probe_file"].as<std::string>();
+  ubodt_generate = result.count("ubodt_generate")>0;
+  ubodt_save = result["ubodt_save"].as<std::string>();
   network_config = NetworkConfig::load_from_arg(result);
   gps_config = GPSConfig::load_from_arg(result);
   result_config = CONFIG::ResultConfig::load_from_arg(result);
   fmm_config = FastMapMatchConfig::load_from_arg(result);
+  result_config.output_config.write_segment = fmm_config.split;
+  result_config.output_config.write_partial =
+      fmm_config.get_match_budget().is_enabled();
   log_level = result["log_level"].as<int>();
   step = result["step"].as<int>();
+  chunk_size = result["chunk_size"].as<int>();
+  memory_budget = result["memory_budget"].as<int>();
+  thread_placement = result["thread_placement"].as<std::string>();
+  result_cache = result["result_cache"].as<int>();
+  gpu = result.count("gpu")>0;
+  gpu_batch = result["gpu_batch"].as<int>();
+  interleave = result["interleave"].as<int>();
+  lockstep = result["lockstep"].as<int>();
   use_omp = result.count("use_omp")>0;
+  ordered_output = result.count("ordered_output")>0;
+  spatial_order = result.count("spatial_order")>0;
+  profile = result.count("profile")>0;
+  profile_file = result["profile_file"].as<std::string>();
+  profile_counters = result.count("profile_counters")>0;
+  trace_file = result["trace_file"].as<std::string>();
+  trace_sample = result["trace_sample"].as<long>();
+  trace_threshold = result["trace_threshold"].as<double>();
+  tile_profile_file = result["tile_profile_file"].as<std::string>();
+  tile_size = result["tile_size"].as<double>();
+  metrics_file = result["metrics_file"].as<std::string>();
+  metrics_interval = result["metrics_interval"].as<int>();
+  checkpoint_interval = result["checkpoint_interval"].as<double>();
+  resume = result.count("resume")>0;
+  rematch_file = result["rematch"].as<std::string>();
+  changed_edges = result["changed_edges"].as<std::string>();
+  changed_areas = result["changed_areas"].as<std::string>();
+  shard = result["shard"].as<int>();
+  num_shards = result["num_shards"].as<int>();
+  sweep = result["sweep"].as<std::string>();
+  sweep_file = result["sweep_file"].as<std::string>();
+  if (num_shards > 1) {
+    result_config.file = CONFIG::ResultConfig::get_shard_file(
+        result_config.file, shard, num_shards);
+  }
+  huge_pages = result.count("huge_pages")>0;
+  numa_interleave = result.count("numa_interleave")>0;
   if (result.count("help")>0) {
     help_specified = true;
   }
@@ -107,29 +411,303 @@ void FMMAppConfig::load_arg(int argc, char **argv){
 
 void FMMAppConfig::print_help(){
   std::cout<<"fmm argument lists:\n";
-  std::cout<<"--ubodt (required) <string>: Ubodt file name\n";
+  std::cout<<"--ubodt (required) <string>: Ubodt file name,\n";
+  std::cout<<"  shm:<name> attaches ubodt published by ubodt_shm,\n";
+  std::cout<<"  not used by lazy layout and ubodt_generate\n";
+  std::cout<<"--ubodt_layout (optional) <string>: Ubodt storage layout,\n";
+  std::cout<<"  chained, flat, compact, split, csr or lazy (chained)\n";
+  std::cout<<"  lazy calculates the rows of a source on its first query\n";
+  std::cout<<"--ubodt_delta (optional) <double>: upperbound of "
+             "lazy or generated ubodt (3000)\n";
+  std::cout<<"--ubodt_cache_rows (optional) <long>: maximum rows cached "
+             "in lazy ubodt (10000000)\n";
+  std::cout<<"--ubodt_max_tiles (optional) <int>: maximum tiles mapped "
+             "in tiled ubodt, whose file has tiles extension (64)\n";
+  std::cout<<"--ubodt_progressive: load all the tiles of tiled ubodt in\n";
+  std::cout<<"  background threads while matching, the tiles queried first,\n";
+  std::cout<<"  searching the rows of the tiles not loaded yet\n";
+  std::cout<<"--ubodt_unroll: store the complete path of each ubodt row,\n";
+  std::cout<<"  only for flat and csr layouts\n";
+  std::cout<<"--ubodt_symmetric: ubodt generated with symmetric, storing\n";
+  std::cout<<"  each unordered od pair once, only for chained, flat and\n";
+  std::cout<<"  csr layouts of a network symmetric in both directions\n";
+  std::cout<<"--ubodt_chains: ubodt generated with compress_chains, storing\n";
+  std::cout<<"  the rows between the junctions of the chains of degree\n";
+  std::cout<<"  two nodes, not for lazy ubodt\n";
+  std::cout<<"--ubodt_clip: keep only the ubodt rows whose paths are in\n";
+  std::cout<<"  the network read with network_clip, translated by the\n";
+  std::cout<<"  ids written by ubodt_gen with write_network_ids, where\n";
+  std::cout<<"  only the rows of the nodes clipped are read from a csv or\n";
+  std::cout<<"  binary file, not for lazy and tiled ubodt\n";
+  std::cout<<"--ubodt_filter: check a bloom filter before looking up\n";
+  std::cout<<"  ubodt, which speeds up missing od pairs,\n";
+  std::cout<<"  not for lazy and tiled ubodt\n";
+  std::cout<<"--ubodt_replicas: with thread_placement, load a ubodt on\n";
+  std::cout<<"  each NUMA node, read by the matchers of the node, which\n";
+  std::cout<<"  takes the memory of a ubodt per node\n";
+  std::cout<<"--ubodt_hierarchy (optional) <string>: contraction hierarchy\n";
+  std::cout<<"  file answering the od pairs missing in ubodt up to\n";
+  std::cout<<"  ubodt_long_delta, built and written if not exists\n";
+  std::cout<<"--ubodt_long_delta (optional) <double>: upperbound of the\n";
+  std::cout<<"  long range tier, larger than the ubodt delta\n";
+  std::cout<<"--ubodt_lookup_cache (optional) <int>: entries of the cache\n";
+  std::cout<<"  of the ubodt look ups of each thread, 0 for none, 32768\n";
+  std::cout<<"  taking 512 KB (0)\n";
+  std::cout<<"--ubodt_probe_file (optional) <string>: CSV file of the\n";
+  std::cout<<"  ubodt probes of each source counted while matching, read\n";
+  std::cout<<"  by ubodt_reorder to store the hottest rows first\n";
+  std::cout<<"--ubodt_generate: generate ubodt from the network with\n";
+  std::cout<<"  ubodt_delta in memory instead of reading ubodt, not for\n";
+  std::cout<<"  lazy layout, chains and clip\n";
+  std::cout<<"--ubodt_save (optional) <string>: file of mmap or ubz\n";
+  std::cout<<"  format the generated ubodt is written to while matching\n";
   std::cout<<"--network (required) <string>: Network file name\n";
   std::cout<<"--network_id (optional) <string>: Network id name (id)\n";
   std::cout<<"--source (optional) <string>: Network source name (source)\n";
   std::cout<<"--target (optional) <string>: Network target name (target)\n";
-  std::cout<<"--gps (required) <string>: GPS file name\n";
+  std::cout<<"--no_network_cache: do not read or write the network cache\n";
+  std::cout<<"  file, which is created next to the network file\n";
+  std::cout<<"--rtree (optional) <string>: Rtree algorithm of the edges,\n";
+  std::cout<<"  packing, linear, quadratic or rstar (packing)\n";
+  std::cout<<"--rtree_max_elements (optional) <int>: Maximum number of\n";
+  std::cout<<"  elements in a rtree node (16)\n";
+  std::cout<<"--rtree_chunk_segments (optional) <int>: Maximum number of\n";
+  std::cout<<"  segments of the chunks of a long edge indexed by the\n";
+  std::cout<<"  rtree, 0 for the whole edges (0)\n";
+  std::cout<<"--spatial_index (optional) <string>: Spatial index of the\n";
+  std::cout<<"  edges in candidate search, rtree, flat or grid (rtree)\n";
+  std::cout<<"--grid_cell_size (optional) <double>: Cell size of the grid\n";
+  std::cout<<"  index, close to the search radius, 0 for the mean extent\n";
+  std::cout<<"  of the edges (0)\n";
+  std::cout<<"--search_batch_size (optional) <int>: Number of consecutive\n";
+  std::cout<<"  points searched with one spatial index query (1)\n";
+  std::cout<<"--nearest_search: search the k candidates of a point with\n";
+  std::cout<<"  the incremental nearest query of the rtree\n";
+  std::cout<<"--search_initial_radius (optional) <double>: radius of the\n";
+  std::cout<<"  first search of a point, multiplied by the growth until the\n";
+  std::cout<<"  point has the minimum candidates or the radius is reached,\n";
+  std::cout<<"  0 to search with the radius directly (0)\n";
+  std::cout<<"--search_min_candidates (optional) <int>: candidates of a point\n";
+  std::cout<<"  below which its search radius grows (1)\n";
+  std::cout<<"--search_radius_growth (optional) <double>: factor of each\n";
+  std::cout<<"  growth of the search radius (2)\n";
+  std::cout<<"--search_snap_resolution (optional) <double>: cell size\n";
+  std::cout<<"  of the snapping cache of the edges near the points,\n";
+  std::cout<<"  which are reused by the points in the same cell (0)\n";
+  std::cout<<"--search_snap_items (optional) <long>: maximum edges\n";
+  std::cout<<"  cached by the snapping cache (10000000)\n";
+  std::cout<<"--reorder_network: renumber nodes along the Hilbert curve\n";
+  std::cout<<"  for memory locality, the ubodt must be generated with it\n";
+  std::cout<<"--project_network: project a network in longitude and\n";
+  std::cout<<"  latitude into metres, so that radius, gps_error and the\n";
+  std::cout<<"  distances are in metres, the ubodt must be generated with it\n";
+  std::cout<<"--compress_geometry: keep the edge geometries delta and\n";
+  std::cout<<"  varint encoded, decoded on demand, which saves memory\n";
+  std::cout<<"--twin_edges: pair the edges of two-way roads whose\n";
+  std::cout<<"  geometries are reversed, indexed once in the rtree and\n";
+  std::cout<<"  sharing their geometry\n";
+  std::cout<<"--network_clip (optional) <string>: read only the edges in\n";
+  std::cout<<"  a box minx,miny,maxx,maxy or a WKT polygon of the network\n";
+  std::cout<<"--network_clip_margin (optional) <double>: margin added\n";
+  std::cout<<"  around the clip region (0)\n";
+  std::cout<<"--network_costs (optional) <string>: numeric columns of\n";
+  std::cout<<"  the network read as the costs of the edges under other\n";
+  std::cout<<"  metrics, separated by comma, e.g., time\n";
+  std::cout<<"--network_edge_mask (optional) <string>: file of the ids\n";
+  std::cout<<"  of the edges allowed to the vehicles matched, such as the\n";
+  std::cout<<"  edges open to trucks, the others are not routed\n";
+  std::cout<<"--gps (required) <string>: GPS file name, or - to read\n";
+  std::cout<<"  the rows of a CSV trajectory file from stdin, or PG:\n";
+  std::cout<<"  followed by a connection string and table=<name> to read\n";
+  std::cout<<"  a PostGIS table\n";
   std::cout<<"--gps_id (optional) <string>: GPS id name (id)\n";
   std::cout<<"--gps_x (optional) <string>: GPS x name (x)\n";
   std::cout<<"--gps_y (optional) <string>: GPS y name (y)\n";
   std::cout<<"--gps_timestamp (optional) <string>: "
     "GPS timestamp name (timestamp)\n";
   std::cout<<"--gps_geom (optional) <string>: GPS geometry name (geom)\n";
+  std::cout<<"--gps_read_threads (optional) <int>: threads reading a\n";
+  std::cout<<"  CSV, shapefile or GeoPackage GPS file in blocks (1)\n";
+  std::cout<<"--gps_timestamp_format (optional) <string>: timestamps of\n";
+  std::cout<<"  a CSV file in seconds, ms, us or iso8601 (seconds)\n";
   std::cout<<"-r/--radius (optional) <double>: search "
              "radius (network data unit) (300)\n";
   std::cout<<"-e/--error (optional) <double>: GPS error "
              "(network data unit) (50)\n";
-  std::cout<<"--output (required) <string>: Output file name\n";
+  std::cout<<"--min_ep_ratio (optional) <double>: minimum ratio of the\n";
+  std::cout<<"  emission probability of a candidate to the best one (0)\n";
+  std::cout<<"--max_dist_ratio (optional) <double>: maximum ratio of the\n";
+  std::cout<<"  distance of a candidate to the best one, at least the\n";
+  std::cout<<"  GPS error, 0 to disable (0)\n";
+  std::cout<<"--adaptive_k_spacing (optional) <double>: points closer to\n";
+  std::cout<<"  their neighbours than this spacing keep proportionally\n";
+  std::cout<<"  fewer candidates, 0 to disable (0)\n";
+  std::cout<<"--max_heading_diff (optional) <double>: drop the candidates\n";
+  std::cout<<"  whose edge direction differs from the heading of their\n";
+  std::cout<<"  point by more than this angle in degrees, keeping the\n";
+  std::cout<<"  nearest one, 0 to disable (0)\n";
+  std::cout<<"--min_heading_distance (optional) <double>: distance\n";
+  std::cout<<"  between the previous and next points below which the\n";
+  std::cout<<"  heading of a point is not used (0)\n";
+  std::cout<<"--beam_size (optional) <int>: maximum number of states\n";
+  std::cout<<"  expanded per layer by a log space beam search Viterbi,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--beam_margin (optional) <double>: maximum difference of\n";
+  std::cout<<"  log probability of a state expanded to the best one,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--split (optional): split the trajectories where a point\n";
+  std::cout<<"  has no candidate or is not reached from the previous\n";
+  std::cout<<"  point, matching and writing the segments separately\n";
+  std::cout<<"--max_time_gap (optional) <double>: with --split, time gap\n";
+  std::cout<<"  between two points splitting the trajectory, 0 to\n";
+  std::cout<<"  disable (0)\n";
+  std::cout<<"--parallel_viterbi (optional) <int>: number of points from\n";
+  std::cout<<"  which the transitions of a trajectory are computed in\n";
+  std::cout<<"  parallel, 0 to disable (0)\n";
+  std::cout<<"--stationary_radius (optional) <double>: consecutive points\n";
+  std::cout<<"  within this radius of the first one are matched as their\n";
+  std::cout<<"  centroid, 0 to disable (0)\n";
+  std::cout<<"--min_distance (optional) <double>: points closer to the\n";
+  std::cout<<"  last point matched are not matched but take its result,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--min_interval (optional) <double>: points within this\n";
+  std::cout<<"  time of the last point matched are not matched but take\n";
+  std::cout<<"  its result, 0 to disable (0)\n";
+  std::cout<<"--coarse_step (optional) <int>: match 1 in coarse_step\n";
+  std::cout<<"  points first, and search the candidates of all the points\n";
+  std::cout<<"  in the corridor of its path, which suits dense\n";
+  std::cout<<"  trajectories, 0 to disable (0)\n";
+  std::cout<<"--corridor_buffer (optional) <double>: with coarse_step,\n";
+  std::cout<<"  distance around the edges of the coarse path within\n";
+  std::cout<<"  which the edges are in the corridor (0)\n";
+  std::cout<<"--corridor_k (optional) <int>: with coarse_step, number of\n";
+  std::cout<<"  candidates of a point in the corridor, 0 for k (0)\n";
+  std::cout<<"--approximate_ep: compute the emission probabilities with\n";
+  std::cout<<"  a vectorized approximate exponential\n";
+  std::cout<<"--max_seconds (optional) <double>: seconds after which\n";
+  std::cout<<"  the matching of a trajectory stops with a partial result\n";
+  std::cout<<"  of its first points, 0 to disable (0)\n";
+  std::cout<<"--max_transitions (optional) <int>: pairs of candidates\n";
+  std::cout<<"  evaluated after which the matching of a trajectory stops\n";
+  std::cout<<"  with a partial result, 0 to disable (0)\n";
+  std::cout<<"--metric (optional) <string>: cost column of the network\n";
+  std::cout<<"  read by --network_costs, whose costs score the transitions\n";
+  std::cout<<"  on the shortest paths by length, empty for the length\n";
+  std::cout<<"--output (required) <string>: Output file name,\n";
+  std::cout<<"  compressed with gzip if it ends with .gz, or - to write\n";
+  std::cout<<"  the results to stdout as they are matched\n";
   std::cout<<"--output_fields (optional) <string>: Output fields\n";
   std::cout<<"  opath,cpath,tpath,ogeom,mgeom,pgeom,\n";
   std::cout<<"  offset,error,spdist,tp,ep,length,all\n";
+  std::cout<<"--output_precision (optional) <int>: decimals of the\n";
+  std::cout<<"  coordinates of pgeom and mgeom (12 significant digits)\n";
+  std::cout<<"--output_geometry_encoding (optional) <string>: wkt\n";
+  std::cout<<"  (default), hexwkb, polyline for a Google encoded polyline\n";
+  std::cout<<"  or delta for integer coordinates as differences, with the\n";
+  std::cout<<"  precision as decimals (5), or wkb for the arrow output\n";
+  std::cout<<"--output_format (optional) <string>: csv, arrow for an\n";
+  std::cout<<"  Arrow IPC file if fmm is built with WITH_ARROW, or edges\n";
+  std::cout<<"  for a table of the traversals of the edges (csv), or\n";
+  std::cout<<"  index for a binary index of the trajectories traversing\n";
+  std::cout<<"  each edge, or state for a binary match state read by\n";
+  std::cout<<"  fmm_export\n";
+  std::cout<<"--output_shard_size (optional) <int>: rows written into\n";
+  std::cout<<"  each shard of a csv output listed in a manifest (0)\n";
+  std::cout<<"--output_async: write the csv output by a thread of its\n";
+  std::cout<<"  own while the results are formatted\n";
   std::cout<<"--log_level (optional) <int>: log level (2)\n";
   std::cout<<"--step (optional) <int>: progress report step (100)\n";
+  std::cout<<"--chunk_size (optional) <int>: trajectories taken at once\n";
+  std::cout<<"  by a matcher thread, longest first (64)\n";
+  std::cout<<"--memory_budget (optional) <int>: memory of the\n";
+  std::cout<<"  trajectories held in MB, which sets the points of a\n";
+  std::cout<<"  chunk instead of chunk_size (0)\n";
+  std::cout<<"--thread_placement (optional) <string>: with use_omp,\n";
+  std::cout<<"  none, core to pin each matcher to a core or socket to\n";
+  std::cout<<"  bind it to the cores of a NUMA node, the matchers\n";
+  std::cout<<"  spread over the nodes in turn (none)\n";
+  std::cout<<"--result_cache (optional) <int>: memory of the results\n";
+  std::cout<<"  reused for the trajectories with the same coordinates\n";
+  std::cout<<"  and timestamps as one matched in MB, 0 for none (0)\n";
+  std::cout<<"--gpu: score the transitions of batches of trajectories\n";
+  std::cout<<"  on a GPU, which needs fmm built WITH_CUDA and a UBODT\n";
+  std::cout<<"  whose rows are resident, falling back to the host\n";
+  std::cout<<"--gpu_batch (optional) <int>: trajectories of a batch\n";
+  std::cout<<"  scored on a GPU (1000)\n";
+  std::cout<<"--interleave (optional) <int>: trajectories whose matching\n";
+  std::cout<<"  is interleaved by a matcher thread, prefetching the UBODT\n";
+  std::cout<<"  probes of one while matching the others, 0 for none (0)\n";
+  std::cout<<"--lockstep (optional) <int>: trajectories advanced layer by\n";
+  std::cout<<"  layer together by a matcher thread, whose transitions are\n";
+  std::cout<<"  scored in SIMD lanes, such as 8 or 16, 0 for none (0)\n";
   std::cout<<"--use_omp: use OpenMP for multithreaded map matching\n";
+  std::cout<<"--ordered_output: with use_omp, write the results in the\n";
+  std::cout<<"  order of the input trajectories\n";
+  std::cout<<"--spatial_order: with use_omp, match the trajectories of a\n";
+  std::cout<<"  chunk along the Hilbert curve of their centers, writing\n";
+  std::cout<<"  the results in the input order\n";
+  std::cout<<"--profile: report the time spent in each stage of the\n";
+  std::cout<<"  matching, with its quantiles per trajectory\n";
+  std::cout<<"--profile_file (optional) <string>: JSON file of the time\n";
+  std::cout<<"  spent in each stage, which enables the profile\n";
+  std::cout<<"--profile_counters: count the instructions, cache, branch\n";
+  std::cout<<"  and TLB misses of each stage with the hardware counters\n";
+  std::cout<<"  of Linux perf_event, which enables the profile\n";
+  std::cout<<"--trace_file (optional) <string>: Chrome trace JSON file\n";
+  std::cout<<"  of the stages of the trajectories sampled, opened by\n";
+  std::cout<<"  chrome://tracing or Perfetto, which enables the profile\n";
+  std::cout<<"--trace_sample (optional) <int>: with trace_file, 1 in\n";
+  std::cout<<"  trace_sample trajectories of a thread traced, 0 for\n";
+  std::cout<<"  none (1000)\n";
+  std::cout<<"--trace_threshold (optional) <double>: with trace_file,\n";
+  std::cout<<"  trajectories slower than it traced in seconds, 0 for\n";
+  std::cout<<"  none (0)\n";
+  std::cout<<"--tile_profile_file (optional) <string>: GeoJSON or CSV\n";
+  std::cout<<"  file of the points, candidates, UBODT probes and misses,\n";
+  std::cout<<"  nodes settled and time of the matching per tile, GeoJSON\n";
+  std::cout<<"  if it ends with .geojson or .json\n";
+  std::cout<<"--tile_size (optional) <double>: with tile_profile_file,\n";
+  std::cout<<"  size of the tiles in the units of the network as matched\n";
+  std::cout<<"  (1000)\n";
+  std::cout<<"--metrics_file (optional) <string>: Prometheus text file\n";
+  std::cout<<"  of the throughput, queues, UBODT cache, memory and stage\n";
+  std::cout<<"  latencies, rewritten periodically for the textfile\n";
+  std::cout<<"  collector of the node exporter\n";
+  std::cout<<"--metrics_interval (optional) <int>: seconds between two\n";
+  std::cout<<"  writes of the metrics file (15)\n";
+  std::cout<<"--checkpoint_interval (optional) <double>: seconds between\n";
+  std::cout<<"  two checkpoints of the results written into a csv file,\n";
+  std::cout<<"  saved next to it with the extension .checkpoint, 0 for\n";
+  std::cout<<"  none (0)\n";
+  std::cout<<"--resume: skip the trajectories recorded by the checkpoint\n";
+  std::cout<<"  of the result file and append to it\n";
+  std::cout<<"--rematch (optional) <string>: previous csv result file,\n";
+  std::cout<<"  whose trajectories affected by changed_edges or\n";
+  std::cout<<"  changed_areas are matched again and merged into it,\n";
+  std::cout<<"  written as the output file\n";
+  std::cout<<"--changed_edges (optional) <string>: with rematch, ID of\n";
+  std::cout<<"  the edges changed or removed separated by ,\n";
+  std::cout<<"--changed_areas (optional) <string>: with rematch, areas\n";
+  std::cout<<"  changed as minx,miny,maxx,maxy separated by ;\n";
+  std::cout<<"--shard (optional) <int>: shard of the input matched, from\n";
+  std::cout<<"  0, whose trajectories are selected by the hash of their\n";
+  std::cout<<"  id (0)\n";
+  std::cout<<"--num_shards (optional) <int>: number of shards the input\n";
+  std::cout<<"  is split into, each written into the output file with\n";
+  std::cout<<"  .shard-of-num_shards inserted before its extension (1)\n";
+  std::cout<<"--sweep (optional) <string>: values of the parameters\n";
+  std::cout<<"  swept separated by ; such as k=4,8;radius=100,300, among\n";
+  std::cout<<"  k, radius and gps_error, whose combinations are each\n";
+  std::cout<<"  written into the output file with _setting inserted\n";
+  std::cout<<"  before its extension. The candidates and transitions are\n";
+  std::cout<<"  computed once for the largest setting.\n";
+  std::cout<<"--sweep_file (optional) <string>: with sweep, CSV file of\n";
+  std::cout<<"  the trajectories matched and time of each setting\n";
+  std::cout<<"--huge_pages: back ubodt and network edges by "
+             "transparent huge pages\n";
+  std::cout<<"--numa_interleave: spread ubodt pages over the NUMA nodes\n";
+  std::cout<<"  of the OpenMP threads, which should be bound with\n";
+  std::cout<<"  OMP_PROC_BIND=spread\n";
   std::cout<<"-h/--help:print help information\n";
   std::cout<<"For xml configuration, check example folder\n";
 };
@@ -140,12 +718,90 @@ void FMMAppConfig::print() const {
   gps_config.print();
   result_config.print();
   fmm_config.print();
+  SPDLOG_INFO("UBODT file {}",ubodt_file);
+  SPDLOG_INFO("UBODT layout {}",ubodt_layout);
+  SPDLOG_INFO("UBODT unroll {}",(ubodt_unroll ? "true" : "false"));
+  SPDLOG_INFO("UBODT symmetric {}",(ubodt_symmetric ? "true" : "false"));
+  SPDLOG_INFO("UBODT chains {}",(ubodt_chains ? "true" : "false"));
+  SPDLOG_INFO("UBODT clip {}",(ubodt_clip ? "true" : "false"));
+  SPDLOG_INFO("UBODT filter {}",(ubodt_filter ? "true" : "false"));
+  SPDLOG_INFO("UBODT replicas {}",(ubodt_replicas ? "true" : "false"));
+  if (ubodt_generate) {
+    SPDLOG_INFO("UBODT generated with delta {} saved to {}",ubodt_delta,
+                ubodt_save);
+  } else if (get_ubodt_layout() == LAZY) {
+    SPDLOG_INFO("UBODT delta {} cache rows {}",ubodt_delta,ubodt_cache_rows);
+  } else if (UTIL::check_file_extension(ubodt_file,"tiles")) {
+    SPDLOG_INFO("UBODT max tiles {} progressive {}",ubodt_max_tiles,
+                (ubodt_progressive ? "true" : "false"));
+  }
+  if (!ubodt_hierarchy.empty()) {
+    SPDLOG_INFO("UBODT hierarchy {} long delta {}",ubodt_hierarchy,
+                ubodt_long_delta);
+  }
+  SPDLOG_INFO("UBODT lookup cache {}",ubodt_lookup_cache);
+  if (!ubodt_probe_file.empty()) {
+    SPDLOG_INFO("UBODT probe file {}",ubodt_probe_file);
+  }
   SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
   SPDLOG_INFO("Step {}",step);
+  SPDLOG_INFO("Chunk size {}",chunk_size);
+  SPDLOG_INFO("Memory budget {} MB",memory_budget);
+  SPDLOG_INFO("Thread placement {}",thread_placement);
+  SPDLOG_INFO("Result cache {} MB",result_cache);
+  SPDLOG_INFO("GPU {} batch {}",(gpu ? "true" : "false"),gpu_batch);
+  SPDLOG_INFO("Interleave {}",interleave);
+  SPDLOG_INFO("Lockstep {}",lockstep);
   SPDLOG_INFO("Use omp {}",(use_omp ? "true" : "false"));
+  SPDLOG_INFO("Ordered output {}",(ordered_output ? "true" : "false"));
+  SPDLOG_INFO("Spatial order {}",(spatial_order ? "true" : "false"));
+  SPDLOG_INFO("Profile {}",(profile ? "true" : "false"));
+  SPDLOG_INFO("Profile counters {}",(profile_counters ? "true" : "false"));
+  if (!profile_file.empty()) {
+    SPDLOG_INFO("Profile file {}",profile_file);
+  }
+  if (!trace_file.empty()) {
+    SPDLOG_INFO("Trace file {} sample {} threshold {}",trace_file,
+                trace_sample,trace_threshold);
+  }
+  if (!tile_profile_file.empty()) {
+    SPDLOG_INFO("Tile profile file {} tile size {}",tile_profile_file,
+                tile_size);
+  }
+  if (!metrics_file.empty()) {
+    SPDLOG_INFO("Metrics file {} interval {}",metrics_file,metrics_interval);
+  }
+  if (checkpoint_interval > 0 || resume) {
+    SPDLOG_INFO("Checkpoint interval {} resume {}",checkpoint_interval,
+                (resume ? "true" : "false"));
+  }
+  if (!rematch_file.empty()) {
+    SPDLOG_INFO("Rematch {} changed edges {} areas {}",rematch_file,
+                changed_edges,changed_areas);
+  }
+  if (num_shards > 1) {
+    SPDLOG_INFO("Input shard {} of {}",shard,num_shards);
+  }
+  if (!sweep.empty()) {
+    SPDLOG_INFO("Sweep {} report {}",sweep,sweep_file);
+  }
+  SPDLOG_INFO("Huge pages {}",(huge_pages ? "true" : "false"));
+  SPDLOG_INFO("NUMA interleave {}",(numa_interleave ? "true" : "false"));
   SPDLOG_INFO("---- Print configuration done ----");
 };
 
+UBODTLayout FMMAppConfig::get_ubodt_layout() const {
+  UBODTLayout layout = CHAINED;
+  UBODT::string2layout(ubodt_layout, &layout);
+  return layout;
+};
+
+FMM::UTIL::ThreadPlacement FMMAppConfig::get_thread_placement() const {
+  UTIL::ThreadPlacement placement = UTIL::PLACEMENT_NONE;
+  UTIL::string2placement(thread_placement, &placement);
+  return placement;
+};
+
 bool FMMAppConfig::validate() const
 {
   SPDLOG_DEBUG("Validating configuration");
@@ -154,6 +810,128 @@ bool FMMAppConfig::validate() const
     SPDLOG_CRITICAL("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
     return false;
   }
+  if (chunk_size <= 0) {
+    SPDLOG_CRITICAL("Invalid chunk size {}, which should be positive",
+                    chunk_size);
+    return false;
+  }
+  if (memory_budget < 0) {
+    SPDLOG_CRITICAL("Invalid memory budget {}, which should be positive "
+                    "or 0",memory_budget);
+    return false;
+  }
+  UTIL::ThreadPlacement placement;
+  if (!UTIL::string2placement(thread_placement, &placement)) {
+    SPDLOG_CRITICAL("Invalid thread placement {}, which should be none, "
+                    "core or socket",thread_placement);
+    return false;
+  }
+  if (result_cache < 0) {
+    SPDLOG_CRITICAL("Invalid result cache {}, which should be positive "
+                    "or 0",result_cache);
+    return false;
+  }
+  if (gpu && gpu_batch <= 0) {
+    SPDLOG_CRITICAL("Invalid GPU batch {}, which should be positive",
+                    gpu_batch);
+    return false;
+  }
+  if (gpu && result_cache > 0) {
+    SPDLOG_CRITICAL("Result cache is not supported with GPU");
+    return false;
+  }
+  if (gpu && fmm_config.split) {
+    SPDLOG_CRITICAL("GPU is not supported with split");
+    return false;
+  }
+  if (interleave < 0) {
+    SPDLOG_CRITICAL("Invalid interleave {}, which should be positive "
+                    "or 0",interleave);
+    return false;
+  }
+  if (interleave > 0 && (gpu || result_cache > 0 || fmm_config.split)) {
+    SPDLOG_CRITICAL("Interleave is not supported with GPU, result cache "
+                    "or split");
+    return false;
+  }
+  if (lockstep < 0) {
+    SPDLOG_CRITICAL("Invalid lockstep {}, which should be positive "
+                    "or 0",lockstep);
+    return false;
+  }
+  if (lockstep > 0 && (gpu || interleave > 0 || result_cache > 0 ||
+                       fmm_config.split)) {
+    SPDLOG_CRITICAL("Lockstep is not supported with GPU, interleave, "
+                    "result cache or split");
+    return false;
+  }
+  if (!trace_file.empty() && (trace_sample < 0 || trace_threshold < 0 ||
+                              (trace_sample == 0 && trace_threshold == 0))) {
+    SPDLOG_CRITICAL("Invalid trace sample {} threshold {}, which should "
+                    "be positive or 0, not both 0",trace_sample,
+                    trace_threshold);
+    return false;
+  }
+  if (!tile_profile_file.empty() && tile_size <= 0) {
+    SPDLOG_CRITICAL("Invalid tile size {}, which should be positive",
+                    tile_size);
+    return false;
+  }
+  if (!metrics_file.empty() && metrics_interval <= 0) {
+    SPDLOG_CRITICAL("Invalid metrics interval {}, which should be "
+                    "positive",metrics_interval);
+    return false;
+  }
+  if (checkpoint_interval < 0) {
+    SPDLOG_CRITICAL("Invalid checkpoint interval {}, which should be "
+                    "positive or 0",checkpoint_interval);
+    return false;
+  }
+  if ((checkpoint_interval > 0 || resume) &&
+      (result_config.format != "csv" || result_config.shard_size > 0 ||
+       result_config.file == "-")) {
+    SPDLOG_CRITICAL("Checkpoint is only supported with a single csv "
+                    "result file");
+    return false;
+  }
+  if (!rematch_file.empty() &&
+      (checkpoint_interval > 0 || resume ||
+       result_config.format != "csv" || result_config.shard_size > 0 ||
+       result_config.file == "-" ||
+       UTIL::check_file_extension(result_config.file, "gz") ||
+       UTIL::check_file_extension(rematch_file, "gz"))) {
+    SPDLOG_CRITICAL("Rematch is only supported with uncompressed csv "
+                    "result files, without checkpoint");
+    return false;
+  }
+  if (num_shards < 1 || shard < 0 || shard >= num_shards) {
+    SPDLOG_CRITICAL("Invalid input shard {} of {}, which should be in "
+                    "[0, num_shards)",shard,num_shards);
+    return false;
+  }
+  if (num_shards > 1 && result_config.file == "-") {
+    SPDLOG_CRITICAL("Input shards are written into a result file, not "
+                    "stdout");
+    return false;
+  }
+  if (!sweep.empty()) {
+    MM::ParameterSweep parameter_sweep;
+    if (!MM::ParameterSweep::parse(sweep, &parameter_sweep)) return false;
+    if (!parameter_sweep.vmax.empty() || !parameter_sweep.factor.empty()) {
+      SPDLOG_CRITICAL("Only k, radius and gps_error are swept by fmm");
+      return false;
+    }
+    if (!rematch_file.empty() || checkpoint_interval > 0 || resume ||
+        result_config.file == "-") {
+      SPDLOG_CRITICAL("Sweep is written into a result file per setting, "
+                      "without rematch or checkpoint");
+      return false;
+    }
+  }
+  if (!rematch_file.empty() && !UTIL::file_exists(rematch_file)) {
+    SPDLOG_CRITICAL("Previous result file {} not found",rematch_file);
+    return false;
+  }
   if (!gps_config.validate()) {
     return false;
   }
@@ -166,10 +944,117 @@ bool FMMAppConfig::validate() const
   if (!fmm_config.validate()) {
     return false;
   }
-  if (!UTIL::file_exists(ubodt_file)) {
+  UBODTLayout layout;
+  if (!UBODT::string2layout(ubodt_layout, &layout)) {
+    SPDLOG_CRITICAL("Invalid UBODT layout {}", ubodt_layout);
+    SPDLOG_CRITICAL("UBODT layout should be chained, flat, "
+                    "compact, split, csr or lazy");
+    return false;
+  }
+  if (ubodt_generate) {
+    if (layout == LAZY || ubodt_chains || ubodt_clip || ubodt_delta <= 0) {
+      SPDLOG_CRITICAL("UBODT generation needs a positive delta {}, and is "
+                      "not supported with lazy layout, chains or clip",
+                      ubodt_delta);
+      return false;
+    }
+    if (!ubodt_save.empty() &&
+        (!UTIL::check_file_extension(ubodt_save, "mmap,ubz") ||
+         !UTIL::folder_exist(UTIL::get_file_directory(ubodt_save)))) {
+      SPDLOG_CRITICAL("Invalid UBODT save file {}, which should be of "
+                      "mmap or ubz format in an existing folder", ubodt_save);
+      return false;
+    }
+  } else if (layout == LAZY) {
+    if (ubodt_delta <= 0 || ubodt_cache_rows <= 0) {
+      SPDLOG_CRITICAL("Invalid lazy UBODT delta {} cache rows {}",
+                      ubodt_delta, ubodt_cache_rows);
+      return false;
+    }
+  } else if (ubodt_file.compare(0, UBODT::SHM_PREFIX.size(),
+                                UBODT::SHM_PREFIX) != 0 &&
+             !UTIL::file_exists(ubodt_file)) {
     SPDLOG_CRITICAL("UBODT file not exists {}", ubodt_file);
     return false;
   }
+  if (ubodt_symmetric &&
+      (layout == LAZY || UTIL::check_file_extension(ubodt_file, "tiles") ||
+       ubodt_unroll || gpu)) {
+    SPDLOG_CRITICAL("Symmetric UBODT is not supported with lazy or tiled "
+                    "UBODT, unroll or GPU");
+    return false;
+  }
+  if (ubodt_chains && (layout == LAZY || ubodt_symmetric || gpu)) {
+    SPDLOG_CRITICAL("UBODT chains is not supported with lazy or symmetric "
+                    "UBODT, or GPU");
+    return false;
+  }
+  if (ubodt_clip) {
+    if (layout == LAZY || UTIL::check_file_extension(ubodt_file, "tiles") ||
+        ubodt_symmetric || ubodt_chains) {
+      SPDLOG_CRITICAL("UBODT clip is not supported with lazy, tiled or "
+                      "symmetric UBODT, or UBODT chains");
+      return false;
+    }
+    if (!UTIL::file_exists(UBODT::get_network_ids_file(ubodt_file))) {
+      SPDLOG_CRITICAL("UBODT network ids not exists {}",
+                      UBODT::get_network_ids_file(ubodt_file));
+      return false;
+    }
+  }
+  if (ubodt_max_tiles <= 0) {
+    SPDLOG_CRITICAL("Invalid UBODT max tiles {}", ubodt_max_tiles);
+    return false;
+  }
+  if (ubodt_progressive && !UTIL::check_file_extension(ubodt_file,"tiles")) {
+    SPDLOG_CRITICAL("UBODT progressive load needs a tiled UBODT");
+    return false;
+  }
+  if (ubodt_replicas &&
+      (!use_omp || get_thread_placement() == UTIL::PLACEMENT_NONE)) {
+    SPDLOG_CRITICAL("UBODT replicas need use_omp and thread placement");
+    return false;
+  }
+  if (ubodt_replicas && ubodt_file.compare(0, UBODT::SHM_PREFIX.size(),
+                                           UBODT::SHM_PREFIX) == 0) {
+    SPDLOG_CRITICAL("UBODT replicas are not supported for shared memory");
+    return false;
+  }
+  if (gpu && (layout == LAZY ||
+              UTIL::check_file_extension(ubodt_file,"tiles"))) {
+    SPDLOG_CRITICAL("GPU is not supported with lazy or tiled UBODT");
+    return false;
+  }
+  if (ubodt_hierarchy.empty() != (ubodt_long_delta <= 0)) {
+    SPDLOG_CRITICAL("UBODT hierarchy and long delta {} should be "
+                    "specified together", ubodt_long_delta);
+    return false;
+  }
+  if (!ubodt_hierarchy.empty() && !UTIL::file_exists(ubodt_hierarchy) &&
+      !UTIL::folder_exist(UTIL::get_file_directory(ubodt_hierarchy))) {
+    SPDLOG_CRITICAL("UBODT hierarchy folder {} not exists",
+                    UTIL::get_file_directory(ubodt_hierarchy));
+    return false;
+  }
+  if (gpu && !ubodt_hierarchy.empty()) {
+    SPDLOG_CRITICAL("GPU is not supported with the long range UBODT");
+    return false;
+  }
+  if (ubodt_lookup_cache < 0) {
+    SPDLOG_CRITICAL("Invalid UBODT lookup cache entries {}",
+                    ubodt_lookup_cache);
+    return false;
+  }
+  if (gpu && !ubodt_probe_file.empty()) {
+    SPDLOG_CRITICAL("GPU is not supported with the UBODT probe file");
+    return false;
+  }
+  if (!ubodt_probe_file.empty() &&
+      !UTIL::folder_exist(UTIL::get_file_directory(ubodt_probe_file))) {
+    SPDLOG_CRITICAL("UBODT probe file folder {} not exists",
+                    UTIL::get_file_directory(ubodt_probe_file));
+    return false;
+  }
   SPDLOG_DEBUG("Validating done");
   return true;
 };
@@ -13,6 +13,7 @@
 #include "config/gps_config.hpp"
 #include "config/network_config.hpp"
 #include "config/result_config.hpp"
+#include "util/affinity.hpp"
 #include "mm/fmm/fmm_algorithm.hpp"
 
 namespace FMM{
@@ -57,16 +58,138 @@ class FMMAppConfig
    * Print help information
    */
   static void print_help();
+  /**
+   * Get the storage layout of UBODT
+   * @return storage layout, chained if the name is invalid
+   */
+  UBODTLayout get_ubodt_layout() const;
+  /**
+   * Get the placement of the matcher threads
+   * @return thread placement, none if the name is invalid
+   */
+  UTIL::ThreadPlacement get_thread_placement() const;
   CONFIG::NetworkConfig network_config;/**< Network data configuraiton */
   CONFIG::GPSConfig gps_config; /**< GPS data configuraiton */
   CONFIG::ResultConfig result_config;  /**< Result configuraiton */
   FastMapMatchConfig fmm_config; /**< Map matching configuraiton */
   std::string ubodt_file; /**< UBODT file name */
+  std::string ubodt_layout = "chained"; /**< UBODT storage layout */
+  double ubodt_delta = 3000; /**< Upperbound of lazy UBODT */
+  long ubodt_cache_rows = UBODT::DEFAULT_CACHE_ROWS; /**< Maximum number of
+                                                     rows cached in lazy
+                                                     UBODT */
+  bool ubodt_unroll = false; /**< If true, UBODT paths are unrolled */
+  bool ubodt_symmetric = false; /**< If true, UBODT stores each unordered
+                                    od pair once, from its smaller node */
+  bool ubodt_chains = false; /**< If true, UBODT is generated between the
+                                 junctions of the chains of the network */
+  bool ubodt_clip = false; /**< If true, UBODT generated on a larger
+                               network is translated into the network
+                               clipped by the ids written next to it */
+  bool ubodt_filter = false; /**< If true, UBODT miss filter is built */
+  bool ubodt_replicas = false; /**< If true, a UBODT is loaded on each
+                                   NUMA node for its matchers */
+  int ubodt_max_tiles = UBODT::DEFAULT_RESIDENT_TILES; /**< Maximum number
+                                                       of tiles mapped in
+                                                       tiled UBODT */
+  bool ubodt_progressive = false; /**< If true, the tiles of tiled UBODT
+                                      are loaded while matching, and the
+                                      rows of the tiles not loaded yet are
+                                      searched */
+  std::string ubodt_hierarchy; /**< Contraction hierarchy file of the
+                                    long range tier of UBODT, built if
+                                    not exists, empty for none */
+  double ubodt_long_delta = 0; /**< Upperbound of the long range tier */
+  int ubodt_lookup_cache = 0; /**< Entries of the UBODT look up cache of
+                                   each thread, 0 for none */
+  std::string ubodt_probe_file; /**< CSV file of the UBODT probes of each
+                                     source counted while matching, empty
+                                     for none */
+  bool ubodt_generate = false; /**< If true, UBODT is generated from the
+                                   network with ubodt_delta instead of
+                                   being read */
+  std::string ubodt_save; /**< File of mmap or ubz format the UBODT
+                               generated is written to while matching,
+                               empty for none */
   bool use_omp = false; /**< If true, parallel map matching performed */
+  bool ordered_output = false; /**< If true, the results of parallel map
+                                   matching keep the input order */
+  bool spatial_order = false; /**< If true, the trajectories of parallel
+                                  map matching are chunked along the
+                                  Hilbert curve, keeping the input order
+                                  of the results */
+  bool profile = false; /**< If true, the time spent in each stage of
+                            the matching is reported */
+  std::string profile_file; /**< JSON file of the time spent in each
+                                 stage, which enables the profile */
+  bool profile_counters = false; /**< If true, the hardware counters of
+                                      each stage are also reported, which
+                                      enables the profile */
+  std::string trace_file; /**< Chrome trace JSON file of the stages of
+                               the trajectories sampled, empty for none */
+  long trace_sample = 1000; /**< 1 in trace_sample trajectories of a
+                                 thread traced, 0 for none */
+  double trace_threshold = 0; /**< Trajectories slower than it traced,
+                                   in seconds, 0 for none */
+  std::string tile_profile_file; /**< GeoJSON or CSV file of the work
+                                       of the matching per tile, empty for
+                                       none */
+  double tile_size = 1000; /**< Size of the tiles of the tile profile, in
+                                the units of the network as matched */
+  std::string metrics_file; /**< Prometheus text file of the metrics of
+                                 the job, empty for none */
+  int metrics_interval = 15; /**< Time between two writes of the metrics
+                                 file, in seconds */
+  double checkpoint_interval = 0; /**< Time between two checkpoints of
+                                       the results written, in seconds,
+                                       0 for none */
+  bool resume = false; /**< If true, the job is resumed from the
+                            checkpoint of its result file */
+  std::string rematch_file; /**< Previous csv result file, whose
+                                 trajectories affected by the changes of
+                                 the network are matched again, empty to
+                                 match all of them */
+  std::string changed_edges; /**< ID of the edges changed, separated
+                                  by , */
+  std::string changed_areas; /**< Areas changed, separated by ; as
+                                  minx,miny,maxx,maxy */
+  int shard = 0; /**< Shard of the input matched, from 0 */
+  int num_shards = 1; /**< Number of shards the input is split into by
+                           the hash of the trajectory id, each written
+                           into its own result file */
+  bool huge_pages = false; /**< If true, large tables are backed by
+                               transparent huge pages */
+  bool numa_interleave = false; /**< If true, large tables are spread
+                                    over the NUMA nodes */
+  std::string sweep; /**< Values of the parameters swept, such as
+                          k=4,8;radius=100,300, each combination of which
+                          is written into its own result file, empty for
+                          none */
+  std::string sweep_file; /**< CSV file of the results and time of each
+                               setting of the sweep, empty for none */
   bool help_specified = false;  /**< Help is specified or not */
   int log_level = 2;  /**< log level, 0-trace,1-debug,2-info,
                           3-warn,4-err,5-critical,6-off */
   int step = 100; /**< progress report step */
+  int chunk_size = 64; /**< trajectories taken at once by a matcher
+                           thread */
+  int memory_budget = 0; /**< memory of the trajectories held by the
+                              matcher threads in MB, which cuts the
+                              chunks by their points, 0 for none */
+  std::string thread_placement = "none"; /**< Placement of the matcher
+                                            threads, none, core or
+                                            socket */
+  int result_cache = 0; /**< memory of the results reused for the
+                             duplicates of a trajectory in MB, 0 for
+                             none */
+  bool gpu = false; /**< If true, the transitions of batches of
+                        trajectories are scored on a GPU */
+  int gpu_batch = 1000; /**< trajectories of a batch scored on a GPU */
+  int interleave = 0; /**< trajectories whose matching is interleaved by
+                            each thread to hide the latency of UBODT, 0
+                            for none */
+  int lockstep = 0; /**< trajectories advanced together in SIMD lanes by
+                          each thread, 0 for none */
 }; // FMMAppConfig
 }
 }
@@ -0,0 +1,276 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/fmm_coordinator.hpp"
+#include "mm/fmm/fmm_server.hpp"
+#include "io/csv_format.hpp"
+#include "util/debug.hpp"
+
+#include <cstdlib>
+#include <thread>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+namespace {
+
+IO::HttpResponse error_response(int status, const std::string &message) {
+  IO::HttpResponse response;
+  response.status = status;
+  response.body = "{\"error\":\"";
+  for (char c : message) {
+    if (c == '"' || c == '\\') response.body.push_back('\\');
+    response.body.push_back((unsigned char) c < 0x20 ? ' ' : c);
+  }
+  response.body += "\"}";
+  return response;
+}
+
+// Parse the integers of the array "name":[...] after pos, which is moved
+// past the array
+template <typename T>
+bool parse_array(const std::string &body, const std::string &name,
+                 std::size_t *pos, std::vector<T> *values) {
+  std::string key = "\"" + name + "\":[";
+  std::size_t begin = body.find(key, *pos);
+  if (begin == std::string::npos) return false;
+  const char *p = body.c_str() + begin + key.size();
+  while (*p != ']') {
+    char *end = nullptr;
+    long value = std::strtol(p, &end, 10);
+    if (end == p) return false;
+    values->push_back((T) value);
+    p = end;
+    if (*p == ',') ++p;
+  }
+  *pos = p + 1 - body.c_str();
+  return true;
+}
+
+} // namespace
+
+FMMCoordinator::FMMCoordinator(const RegionPartition &partition,
+                               const FMMCoordinatorOptions &options) :
+    partition_(partition), options_(options) {
+  for (const Region &region : partition_.get_regions()) {
+    IO::HttpUrl url;
+    if (!IO::HttpUrl::parse(region.url, &url)) {
+      SPDLOG_CRITICAL("Invalid url {} of region {}", region.url,
+                      region.index);
+      std::exit(EXIT_FAILURE);
+    }
+    urls_.push_back(url);
+  }
+}
+
+void FMMCoordinator::run() {
+  IO::HttpServerOptions options;
+  options.port = options_.port;
+  options.num_threads = options_.threads > 0 ?
+                        options_.threads : std::thread::hardware_concurrency();
+  options.max_body = options_.max_body * 1024L * 1024L;
+  server_.reset(new IO::HttpServer(
+      options, [this](const IO::HttpRequest &request) {
+        return handle(request);
+      }));
+  server_->run();
+  SPDLOG_INFO("Requests {} errors {} trajectories {} spans {}",
+              requests_.load(), errors_.load(), trajectories_.load(),
+              spans_.load());
+}
+
+void FMMCoordinator::stop() {
+  if (server_ != nullptr) server_->stop();
+}
+
+IO::HttpResponse FMMCoordinator::handle(const IO::HttpRequest &request) {
+  if (request.path == "/match") {
+    if (request.method != "POST") {
+      return error_response(405, "use POST for /match");
+    }
+    return match(request);
+  }
+  if (request.path == "/health") {
+    IO::HttpResponse response;
+    response.body = "{\"status\":\"ok\",\"regions\":" +
+        std::to_string(partition_.size()) + "}";
+    return response;
+  }
+  return error_response(404, "unknown path " + request.path);
+}
+
+IO::HttpResponse FMMCoordinator::match(const IO::HttpRequest &request) {
+  ++requests_;
+  std::vector<Trajectory> trajectories;
+  std::string error;
+  if (!FMMServer::parse_trajectories(request.body, &trajectories, &error)) {
+    ++errors_;
+    return error_response(400, error);
+  }
+  // A span is identified by its position among the spans of the request
+  int num_regions = partition_.size();
+  std::vector<std::vector<RegionSpan>> spans(trajectories.size());
+  std::vector<std::string> bodies(num_regions);
+  int num_spans = 0;
+  for (std::size_t i = 0; i < trajectories.size(); ++i) {
+    const LineString &geom = trajectories[i].geom;
+    spans[i] = partition_.split(geom);
+    for (const RegionSpan &span : spans[i]) {
+      LineString part;
+      for (int j = span.first; j <= span.last; ++j) {
+        part.add_point(geom.get_x(j), geom.get_y(j));
+      }
+      std::string *body = &bodies[span.region];
+      IO::append_int(num_spans, body);
+      body->push_back(';');
+      IO::append_wkt(part, -1, body);
+      body->push_back('\n');
+      ++num_spans;
+    }
+  }
+  // The k, r and e of the query are passed to the region servers
+  std::string target = "/match";
+  if (!request.query.empty()) target += "?" + request.query;
+  std::vector<IO::HttpResponse> responses(num_regions);
+  std::vector<std::string> errors(num_regions);
+  std::vector<char> posted(num_regions, 0);
+  std::vector<std::thread> threads;
+  for (int r = 0; r < num_regions; ++r) {
+    if (bodies[r].empty()) continue;
+    threads.emplace_back([&, r]() {
+      posted[r] = IO::http_post(urls_[r], target, bodies[r],
+                                options_.timeout, &responses[r],
+                                &errors[r]);
+    });
+  }
+  for (std::thread &thread : threads) thread.join();
+  std::vector<MatchResult> span_results(num_spans);
+  for (int r = 0; r < num_regions; ++r) {
+    if (bodies[r].empty()) continue;
+    if (posted[r] && responses[r].status != 200) {
+      errors[r] = "status " + std::to_string(responses[r].status) + " " +
+          responses[r].body;
+    }
+    std::vector<MatchResult> results;
+    if (errors[r].empty() && !parse_results(responses[r].body, &results)) {
+      errors[r] = "malformed results";
+    }
+    if (!errors[r].empty()) {
+      ++errors_;
+      SPDLOG_ERROR("Region {} failed: {}", r, errors[r]);
+      return error_response(502, "region " + std::to_string(r) + ": " +
+          errors[r]);
+    }
+    for (MatchResult &result : results) {
+      if (result.id >= 0 && result.id < num_spans) {
+        span_results[result.id] = std::move(result);
+      }
+    }
+  }
+  IO::HttpResponse response;
+  response.body = "{\"results\":[";
+  int span_index = 0;
+  for (std::size_t i = 0; i < trajectories.size(); ++i) {
+    std::vector<MatchResult> results(
+        span_results.begin() + span_index,
+        span_results.begin() + span_index + spans[i].size());
+    span_index += spans[i].size();
+    MatchResult result = stitch_results(trajectories[i].id, spans[i],
+                                        results);
+    if (i > 0) response.body.push_back(',');
+    FMMServer::append_result(result, options_.output_precision,
+                             &response.body);
+  }
+  response.body += "]}";
+  trajectories_ += trajectories.size();
+  spans_ += num_spans;
+  return response;
+}
+
+bool FMMCoordinator::parse_results(const std::string &body,
+                                   std::vector<MatchResult> *results) {
+  const std::string id_key = "{\"id\":";
+  const std::string mgeom_key = "\"mgeom\":\"";
+  std::size_t pos = body.find(id_key);
+  while (pos != std::string::npos) {
+    MatchResult result{};
+    char *end = nullptr;
+    result.id = std::strtol(body.c_str() + pos + id_key.size(), &end, 10);
+    if (end == body.c_str() + pos + id_key.size()) return false;
+    if (!parse_array(body, "cpath", &pos, &result.cpath) ||
+        !parse_array(body, "opath", &pos, &result.opath) ||
+        !parse_array(body, "indices", &pos, &result.indices)) {
+      return false;
+    }
+    std::size_t mgeom = body.find(mgeom_key, pos);
+    if (mgeom == std::string::npos) return false;
+    mgeom += mgeom_key.size();
+    std::size_t mgeom_end = body.find('"', mgeom);
+    if (mgeom_end == std::string::npos) return false;
+    if (mgeom_end > mgeom &&
+        !parse_wkt_linestring(body.c_str() + mgeom,
+                              body.c_str() + mgeom_end, &result.mgeom)) {
+      return false;
+    }
+    std::size_t next = body.find(id_key, mgeom_end);
+    result.partial =
+        body.find("\"partial\":true", mgeom_end) < next;
+    results->push_back(std::move(result));
+    pos = next;
+  }
+  return true;
+}
+
+MatchResult FMMCoordinator::stitch_results(
+    int id, const std::vector<RegionSpan> &spans,
+    const std::vector<MatchResult> &results) {
+  MatchResult stitched{};
+  stitched.id = id;
+  for (const MatchResult &result : results) {
+    if (result.cpath.empty()) return MatchResult{id};
+  }
+  for (std::size_t k = 0; k < results.size(); ++k) {
+    const MatchResult &result = results[k];
+    int offset = stitched.cpath.size();
+    std::size_t first_edge = 0;
+    if (k > 0) {
+      // The shared point is matched by the later span
+      if (spans[k].first == spans[k - 1].last && !stitched.opath.empty()) {
+        stitched.opath.pop_back();
+        stitched.indices.pop_back();
+      }
+      if (stitched.cpath.back() == result.cpath.front()) {
+        --offset;
+        first_edge = 1;
+      }
+    }
+    stitched.cpath.insert(stitched.cpath.end(),
+                          result.cpath.begin() + first_edge,
+                          result.cpath.end());
+    stitched.opath.insert(stitched.opath.end(), result.opath.begin(),
+                          result.opath.end());
+    for (int index : result.indices) {
+      stitched.indices.push_back(index + offset);
+    }
+    int num_points = result.mgeom.get_num_points();
+    for (int j = 0; j < num_points; ++j) {
+      int last = stitched.mgeom.get_num_points() - 1;
+      if (j == 0 && last >= 0 &&
+          stitched.mgeom.get_x(last) == result.mgeom.get_x(0) &&
+          stitched.mgeom.get_y(last) == result.mgeom.get_y(0)) {
+        continue;
+      }
+      stitched.mgeom.add_point(result.mgeom.get_x(j),
+                               result.mgeom.get_y(j));
+    }
+    // The points after a span cut by its budget are left unmatched
+    if (result.partial) {
+      stitched.partial = true;
+      break;
+    }
+  }
+  return stitched;
+}
@@ -0,0 +1,115 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_coordinator command line program, which distributes the matching
+ * over the fmm_server of the regions of a network
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_FMM_COORDINATOR_HPP_
+#define FMM_FMM_COORDINATOR_HPP_
+
+#include "mm/mm_type.hpp"
+#include "network/region_partition.hpp"
+#include "io/http_client.hpp"
+#include "io/http_server.hpp"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FMM{
+namespace MM{
+
+/**
+ * Options of a coordinator
+ */
+struct FMMCoordinatorOptions {
+  int port = 8080; /**< Port listened */
+  int threads = 0; /**< Threads answering the requests, 0 for the
+                        number of cores */
+  int max_body = 64; /**< Largest request body accepted, in MB */
+  int timeout = 60; /**< Seconds waited for a region server */
+  int output_precision = -1; /**< Decimals of the coordinates of mgeom,
+                                  negative for 12 significant digits */
+};
+
+/**
+ * Coordinator of the fmm_server matching the regions of a partitioned
+ * network, which answers the same POST /match requests as fmm_server.
+ *
+ * Each trajectory is split into the spans of its regions, the spans
+ * are posted to the servers of their regions in parallel and the
+ * results of a trajectory are stitched at the points shared by two
+ * spans. A server loads the whole network with the UBODT of its region,
+ * generated by ubodt_gen with the region file, so that it routes the
+ * candidates of the points within the margin of its region.
+ */
+class FMMCoordinator {
+ public:
+  /**
+   * Create the coordinator
+   * @param partition regions with the urls of their servers
+   * @param options   options of the coordinator
+   */
+  FMMCoordinator(const NETWORK::RegionPartition &partition,
+                 const FMMCoordinatorOptions &options);
+  /**
+   * Answer the requests until the coordinator is stopped
+   */
+  void run();
+  /**
+   * Stop the coordinator, which can be called from a signal handler
+   */
+  void stop();
+  /**
+   * Answer a request
+   * @param  request http request
+   * @return the http response
+   */
+  IO::HttpResponse handle(const IO::HttpRequest &request);
+  /**
+   * Parse the results returned by fmm_server
+   * @param  body    JSON body of a match response
+   * @param  results updated with the id, cpath, opath, indices, mgeom
+   * and partial flag of the results
+   * @return false if the body is malformed
+   */
+  static bool parse_results(const std::string &body,
+                            std::vector<MatchResult> *results);
+  /**
+   * Stitch the results of the spans of a trajectory. The result of a
+   * span starting at the last point of the previous span replaces the
+   * match of that point, and the edge matched there is shared by both
+   * complete paths if they agree. The complete path is not connected
+   * between spans without a shared point.
+   * @param  id      id of the trajectory
+   * @param  spans   spans of the trajectory
+   * @param  results results of the spans
+   * @return the result of the trajectory, unmatched if a span is
+   * unmatched
+   */
+  static MatchResult stitch_results(
+      int id, const std::vector<NETWORK::RegionSpan> &spans,
+      const std::vector<MatchResult> &results);
+ private:
+  /**
+   * Match the trajectories of a request on the region servers
+   */
+  IO::HttpResponse match(const IO::HttpRequest &request);
+  NETWORK::RegionPartition partition_;
+  FMMCoordinatorOptions options_;
+  std::vector<IO::HttpUrl> urls_;
+  std::unique_ptr<IO::HttpServer> server_;
+  std::atomic<long> requests_{0};
+  std::atomic<long> errors_{0};
+  std::atomic<long> trajectories_{0};
+  std::atomic<long> spans_{0};
+};
+}
+}
+
+#endif // FMM_FMM_COORDINATOR_HPP_
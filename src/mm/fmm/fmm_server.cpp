@@ -0,0 +1,626 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/fmm_server.hpp"
+#include "io/csv_format.hpp"
+#include "util/memory.hpp"
+#include "util/metrics.hpp"
+#include "util/util.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <sstream>
+#include <thread>
+#include <pthread.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+namespace {
+
+std::string escape_json(const std::string &text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped.push_back('\\');
+      escaped.push_back(c);
+    } else if ((unsigned char) c < 0x20) {
+      escaped.push_back(' ');
+    } else {
+      escaped.push_back(c);
+    }
+  }
+  return escaped;
+}
+
+IO::HttpResponse error_response(int status, const std::string &message) {
+  IO::HttpResponse response;
+  response.status = status;
+  response.body = "{\"error\":\"" + escape_json(message) + "\"}";
+  return response;
+}
+
+// Parse a number of the query, false if it is not a positive number
+template <typename T>
+bool parse_number(const IO::HttpRequest &request, const std::string &name,
+                  T *value, std::string *error) {
+  std::string text;
+  if (!request.get_parameter(name, &text)) return true;
+  char *end = nullptr;
+  double number = std::strtod(text.c_str(), &end);
+  if (end == text.c_str() || *end != '\0' || number <= 0) {
+    *error = "invalid parameter " + name + " " + text;
+    return false;
+  }
+  *value = (T) number;
+  return true;
+}
+
+// Request admitted by a scheduler until it is answered
+class AdmittedRequest {
+ public:
+  AdmittedRequest(MatchScheduler *scheduler, RequestPriority priority) :
+      scheduler_(scheduler), priority_(priority) {}
+  ~AdmittedRequest() { scheduler_->finish_request(priority_); }
+ private:
+  MatchScheduler *scheduler_;
+  RequestPriority priority_;
+};
+
+// Slot of a scheduler held while a trajectory is matched
+class ScheduledSlot {
+ public:
+  explicit ScheduledSlot(MatchScheduler *scheduler) :
+      scheduler_(scheduler) {}
+  ~ScheduledSlot() { scheduler_->release(); }
+ private:
+  MatchScheduler *scheduler_;
+};
+
+} // namespace
+
+FMMServer::FMMServer(const FMMServerConfig &config) :
+    config_(config), generation_(load_generation(config_, 1)) {
+  if (generation_ == nullptr) std::exit(EXIT_FAILURE);
+  match_threads_ = config_.threads > 0 ?
+                   config_.threads : std::thread::hardware_concurrency();
+  match_threads_ = std::max(match_threads_, 1);
+  int bulk_requests = config_.bulk_requests > 0 ?
+                      config_.bulk_requests : match_threads_;
+  scheduler_.reset(new MatchScheduler(match_threads_, bulk_requests));
+}
+
+UTIL::MemoryReport FMMServerGeneration::get_memory_report() const {
+  UTIL::MemoryReport report;
+  network.get_memory_usage(&report);
+  graph.get_memory_usage(&report);
+  ubodt->get_memory_usage(&report);
+  return report;
+}
+
+std::shared_ptr<FMMServerGeneration> FMMServer::load_generation(
+    const FMMServerConfig &config, int version) {
+  std::shared_ptr<FMMServerGeneration> generation =
+      std::make_shared<FMMServerGeneration>(config, version);
+  if (config.get_ubodt_layout() == LAZY) {
+    generation->ubodt = UBODT::create_lazy_ubodt(
+        generation->graph, config.ubodt_delta, config.ubodt_cache_rows);
+  } else if (UTIL::check_file_extension(config.ubodt_file, "tiles")) {
+    generation->ubodt =
+        UBODT::read_ubodt_tiled(config.ubodt_file, config.ubodt_max_tiles);
+  } else {
+    generation->ubodt = UBODT::read_ubodt_file(
+        config.ubodt_file, 50000, config.get_ubodt_layout());
+  }
+  if (generation->ubodt == nullptr) return nullptr;
+  const std::string &metric = config.fmm_config.metric;
+  if (generation->network.get_metric_index(metric) > 0 &&
+      !generation->ubodt->build_metric_costs(generation->network)) {
+    return nullptr;
+  }
+  generation->model.reset(new FastMapMatch(
+      generation->network, generation->graph, generation->ubodt));
+  if (!generation->model->set_metric(metric)) return nullptr;
+  generation->closures =
+      std::make_shared<EdgeClosures>(generation->graph);
+  generation->ubodt->set_closures(generation->closures);
+  if (config.tile_cache > 0) {
+    generation->tiles.reset(new NetworkTiles(
+        generation->network, config.tile_cache * 1024L * 1024L));
+  }
+  generation->get_memory_report().print();
+  return generation;
+}
+
+std::shared_ptr<const FMMServerGeneration> FMMServer::get_generation() const {
+  return std::atomic_load(&generation_);
+}
+
+void FMMServer::run() {
+  IO::HttpServerOptions options;
+  options.host = config_.host;
+  options.port = config_.port;
+  // The connections of the bulk requests are answered by threads of
+  // their own, so that they cannot take all the threads while waiting
+  options.num_threads = match_threads_ + (config_.bulk_requests > 0 ?
+                                          config_.bulk_requests :
+                                          match_threads_);
+  options.max_body = config_.max_body * 1024L * 1024L;
+  server_.reset(new IO::HttpServer(
+      options, [this](const IO::HttpRequest &request) {
+        return handle(request);
+      }));
+  // The reloader reads files, which must not be interrupted by signals
+  sigset_t signals, previous;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &signals, &previous);
+  std::thread reloader(&FMMServer::reload_loop, this);
+  pthread_sigmask(SIG_SETMASK, &previous, nullptr);
+  server_->run();
+  {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    reload_stopped_ = true;
+  }
+  reload_cv_.notify_all();
+  reloader.join();
+  get_generation()->ubodt->print_cache_statistics();
+  SPDLOG_INFO("Requests {} errors {} trajectories {} points {} reloads {}",
+              requests_.load(), errors_.load(), trajectories_.load(),
+              points_.load(), reloads_.load());
+}
+
+void FMMServer::stop() {
+  if (server_ != nullptr) server_->stop();
+}
+
+void FMMServer::request_reload() {
+  // Only an atomic store, the reloader polls the flag every second
+  reload_requested_ = true;
+}
+
+void FMMServer::reload_loop() {
+  std::unique_lock<std::mutex> lock(reload_mutex_);
+  while (!reload_stopped_) {
+    reload_cv_.wait_for(lock, std::chrono::seconds(1));
+    if (reload_stopped_ || !reload_requested_.exchange(false)) continue;
+    lock.unlock();
+    reload();
+    lock.lock();
+  }
+}
+
+bool FMMServer::reload() {
+  int version = get_generation()->version + 1;
+  SPDLOG_INFO("Start to load generation {}", version);
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  std::shared_ptr<FMMServerGeneration> generation;
+  if (config_.validate()) {
+    try {
+      generation = load_generation(config_, version);
+    } catch (const std::exception &e) {
+      SPDLOG_ERROR("Fail to load generation {}: {}", version, e.what());
+    }
+  }
+  if (generation == nullptr) {
+    ++reload_failures_;
+    SPDLOG_ERROR("Keep generation {}", version - 1);
+    return false;
+  }
+  std::shared_ptr<const FMMServerGeneration> loaded = generation;
+  {
+    // The edges closed meanwhile are applied to one generation or both
+    std::lock_guard<std::mutex> lock(closures_mutex_);
+    long unknown = apply_closures(*loaded);
+    if (unknown > 0) {
+      SPDLOG_WARN("Closed edges not in generation {}: {}", version, unknown);
+    }
+    // The previous generation is released by the last request using it
+    std::atomic_store(&generation_, loaded);
+  }
+  ++reloads_;
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  SPDLOG_INFO("Swap in generation {} loaded in {:.1f}s", version, elapsed);
+  return true;
+}
+
+IO::HttpResponse FMMServer::handle(const IO::HttpRequest &request) {
+  if (request.path == "/match") {
+    if (request.method != "POST") {
+      return error_response(405, "use POST for /match");
+    }
+    return match(request);
+  }
+  if (request.path == "/reload") {
+    if (request.method != "POST") {
+      return error_response(405, "use POST for /reload");
+    }
+    if (!authorized(request)) {
+      return error_response(403, "set --admin_token and its bearer token");
+    }
+    {
+      std::lock_guard<std::mutex> lock(reload_mutex_);
+      reload_requested_ = true;
+    }
+    reload_cv_.notify_all();
+    IO::HttpResponse response;
+    response.body = "{\"status\":\"reloading\"}";
+    return response;
+  }
+  if (request.path == "/health") {
+    IO::HttpResponse response;
+    response.body = "{\"status\":\"ok\",\"generation\":" +
+        std::to_string(get_generation()->version) + "}";
+    return response;
+  }
+  if (request.path == "/metrics") return metrics();
+  if (request.path == "/closures") {
+    if (request.method != "GET" && request.method != "POST") {
+      return error_response(405, "use GET or POST for /closures");
+    }
+    if (request.method == "POST" && !authorized(request)) {
+      return error_response(403, "set --admin_token and its bearer token");
+    }
+    return closures(request);
+  }
+  if (request.path.compare(0, 7, "/tiles/") == 0) {
+    if (request.method != "GET") {
+      return error_response(405, "use GET for /tiles");
+    }
+    return tile(request);
+  }
+  return error_response(404, "unknown path " + request.path);
+}
+
+IO::HttpResponse FMMServer::match(const IO::HttpRequest &request) {
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  ++requests_;
+  FastMapMatchConfig fmm_config = config_.fmm_config;
+  std::vector<Trajectory> trajectories;
+  std::string error;
+  RequestPriority priority;
+  double seconds = 0;
+  if (!parse_parameters(request, &fmm_config, &error) ||
+      !parse_schedule(request, &priority, &seconds, &error) ||
+      !parse_trajectories(request.body, &trajectories, &error)) {
+    ++errors_;
+    return error_response(400, error);
+  }
+  if (!scheduler_->admit_request(priority)) {
+    ++errors_;
+    return error_response(503, "too many bulk requests");
+  }
+  AdmittedRequest admitted(scheduler_.get(), priority);
+  UTIL::TimePoint deadline = seconds > 0 ?
+      begin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(seconds)) :
+      UTIL::TimePoint::max();
+  // Held until the response is built, even if a reload swaps it out
+  std::shared_ptr<const FMMServerGeneration> generation = get_generation();
+  IO::HttpResponse response;
+  response.body = "{\"results\":[";
+  long points = 0;
+  bool cancelled = false;
+  for (std::size_t i = 0; i < trajectories.size(); ++i) {
+    MatchResult result{trajectories[i].id};
+    // Once the deadline passes, the trajectories left are not started
+    cancelled = cancelled || !scheduler_->acquire(priority, deadline);
+    if (cancelled) {
+      result.partial = true;
+      ++cancelled_;
+    } else {
+      ScheduledSlot slot(scheduler_.get());
+      FastMapMatchConfig scheduled = fmm_config;
+      if (seconds > 0) {
+        // The deadline caps the budget of the trajectory
+        double left = std::chrono::duration<double>(
+            deadline - std::chrono::steady_clock::now()).count();
+        left = std::max(left, 1e-6);
+        scheduled.max_seconds = scheduled.max_seconds > 0 ?
+            std::min(scheduled.max_seconds, left) : left;
+      }
+      result = generation->model->match_traj(trajectories[i], scheduled);
+    }
+    if (i > 0) response.body.push_back(',');
+    append_result(result, config_.output_precision, &response.body);
+    points += trajectories[i].geom.get_num_points();
+  }
+  response.body += "]}";
+  trajectories_ += trajectories.size();
+  points_ += points;
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - begin).count();
+  std::lock_guard<std::mutex> lock(latency_mutex_);
+  latency_.add(elapsed);
+  return response;
+}
+
+IO::HttpResponse FMMServer::tile(const IO::HttpRequest &request) {
+  std::shared_ptr<const FMMServerGeneration> generation = get_generation();
+  if (generation->tiles == nullptr) {
+    return error_response(404, "tiles are disabled");
+  }
+  int z, x, y;
+  IO::HttpResponse response;
+  if (!parse_tile_path(request.path, &z, &x, &y) ||
+      !generation->tiles->get_tile(z, x, y, &response.body)) {
+    return error_response(404, "invalid tile " + request.path);
+  }
+  response.content_type = "application/vnd.mapbox-vector-tile";
+  return response;
+}
+
+bool FMMServer::authorized(const IO::HttpRequest &request) const {
+  const std::string &token = config_.admin_token;
+  if (token.empty() || request.token.size() != token.size()) return false;
+  // Compared in full so that the time does not tell the matching prefix
+  unsigned char diff = 0;
+  for (std::size_t i = 0; i < token.size(); ++i) {
+    diff |= token[i] ^ request.token[i];
+  }
+  return diff == 0;
+}
+
+IO::HttpResponse FMMServer::closures(const IO::HttpRequest &request) {
+  IO::HttpResponse response;
+  if (request.method == "GET") {
+    std::shared_ptr<const FMMServerGeneration> generation = get_generation();
+    response.body = "{\"closed\":[";
+    std::vector<EdgeIndex> closed = generation->closures->get_closed();
+    for (std::size_t i = 0; i < closed.size(); ++i) {
+      if (i > 0) response.body.push_back(',');
+      response.body += std::to_string(generation->network.get_edge_id(
+          closed[i]));
+    }
+    response.body += "]}";
+    return response;
+  }
+  std::vector<EdgeID> ids;
+  std::string error;
+  if (!parse_edge_ids(request.body, &ids, &error)) {
+    return error_response(400, error);
+  }
+  long unknown, closed;
+  {
+    std::lock_guard<std::mutex> lock(closures_mutex_);
+    closed_ids_ = ids;
+    std::shared_ptr<const FMMServerGeneration> generation = get_generation();
+    unknown = apply_closures(*generation);
+    closed = generation->closures->get_num_closed();
+  }
+  response.body = "{\"closed\":" + std::to_string(closed) +
+      ",\"unknown\":" + std::to_string(unknown) + "}";
+  return response;
+}
+
+long FMMServer::apply_closures(const FMMServerGeneration &generation) const {
+  std::vector<EdgeIndex> edges;
+  long unknown = 0;
+  for (EdgeID id : closed_ids_) {
+    try {
+      edges.push_back(generation.network.get_edge_index(id));
+    } catch (const std::out_of_range &) {
+      ++unknown;
+    }
+  }
+  generation.closures->set_closed(edges);
+  return unknown;
+}
+
+bool FMMServer::parse_edge_ids(const std::string &body,
+                               std::vector<EdgeID> *ids,
+                               std::string *error) {
+  ids->clear();
+  std::size_t i = 0;
+  while (i < body.size()) {
+    if (body[i] == ',' || std::isspace((unsigned char) body[i])) {
+      ++i;
+      continue;
+    }
+    std::size_t end = i;
+    while (end < body.size() && body[end] != ',' &&
+           !std::isspace((unsigned char) body[end])) {
+      ++end;
+    }
+    std::string text = body.substr(i, end - i);
+    char *stop = nullptr;
+    long id = std::strtol(text.c_str(), &stop, 10);
+    if (*stop != '\0' || id < std::numeric_limits<EdgeID>::min() ||
+        id > std::numeric_limits<EdgeID>::max()) {
+      *error = "invalid edge id " + text;
+      return false;
+    }
+    ids->push_back((EdgeID) id);
+    i = end;
+  }
+  return true;
+}
+
+IO::HttpResponse FMMServer::metrics() {
+  UTIL::MetricsText text;
+  text.counter("fmm_server_requests_total", "Match requests received",
+               requests_);
+  text.counter("fmm_server_errors_total", "Match requests rejected",
+               errors_);
+  text.counter("fmm_trajectories_total", "Trajectories matched",
+               trajectories_);
+  text.counter("fmm_points_total", "Points of the trajectories matched",
+               points_);
+  text.counter("fmm_server_cancelled_trajectories_total",
+               "Trajectories not started before their deadline",
+               cancelled_);
+  MatchSchedulerStatistics schedule = scheduler_->get_statistics();
+  text.gauge("fmm_server_waiting_trajectories",
+             "Interactive trajectories waiting for a thread",
+             schedule.waiting_interactive);
+  text.gauge("fmm_server_waiting_bulk_trajectories",
+             "Bulk trajectories waiting for a thread",
+             schedule.waiting_bulk);
+  text.gauge("fmm_server_bulk_requests", "Bulk requests in flight",
+             schedule.bulk_requests);
+  text.counter("fmm_server_rejected_bulk_requests_total",
+               "Bulk requests rejected as too many were in flight",
+               schedule.rejected);
+  text.counter("fmm_server_preemptions_total",
+               "Threads given to an interactive trajectory ahead of "
+               "bulk ones", schedule.preempted);
+  text.counter("fmm_server_expired_requests_total",
+               "Match requests cancelled at their deadline",
+               schedule.expired);
+  {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    const std::string name = "fmm_server_request_seconds";
+    text.family(name, "summary", "Time to answer a match request");
+    text.sample(name, latency_.quantile(0.5), "quantile=\"0.5\"");
+    text.sample(name, latency_.quantile(0.99), "quantile=\"0.99\"");
+    text.sample(name + "_count", latency_.count);
+  }
+  std::shared_ptr<const FMMServerGeneration> generation = get_generation();
+  text.gauge("fmm_server_generation", "Generation of the network and UBODT",
+             generation->version);
+  text.counter("fmm_server_reloads_total", "Generations swapped in",
+               reloads_);
+  text.counter("fmm_server_reload_failures_total", "Reloads which failed",
+               reload_failures_);
+  append_ubodt_metrics(*generation->ubodt, &text);
+  CandidateSearchStatistics search =
+      generation->network.get_search_statistics();
+  text.counter("fmm_server_search_points_total",
+               "Points searched with the adaptive radius", search.points);
+  text.counter("fmm_server_search_expanded_points_total",
+               "Points whose search radius grew", search.expanded_points);
+  text.counter("fmm_server_search_expansions_total",
+               "Growths of the search radius", search.expansions);
+  text.counter("fmm_server_search_full_radius_points_total",
+               "Points whose search radius grew up to the radius",
+               search.full_radius_points);
+  if (generation->network.get_snap_cache() != nullptr) {
+    append_snap_cache_metrics(*generation->network.get_snap_cache(), &text);
+  }
+  text.gauge("fmm_server_closed_edges", "Edges closed",
+             generation->closures->get_num_closed());
+  text.counter("fmm_server_closure_searches_total",
+               "Transitions routed around the closed edges",
+               generation->closures->get_searches());
+  if (generation->tiles != nullptr) {
+    NetworkTileStatistics tiles = generation->tiles->get_statistics();
+    text.counter("fmm_server_tile_hits_total", "Tiles found in the cache",
+                 tiles.hits);
+    text.counter("fmm_server_tile_misses_total", "Tiles encoded",
+                 tiles.misses);
+    text.gauge("fmm_server_tile_cache_bytes", "Bytes of the tiles cached",
+               tiles.bytes);
+  }
+  UTIL::append_memory_metrics(generation->get_memory_report(), &text);
+  text.gauge("fmm_resident_memory_bytes", "Resident memory of the process",
+             UTIL::get_resident_memory());
+  IO::HttpResponse response;
+  response.content_type = "text/plain; version=0.0.4";
+  response.body = text.str();
+  return response;
+}
+
+bool FMMServer::parse_trajectories(const std::string &body,
+                                   std::vector<Trajectory> *trajectories,
+                                   std::string *error) {
+  std::istringstream iss(body);
+  std::string line;
+  int index = 0;
+  while (std::getline(iss, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    Trajectory trajectory{index, LineString(), {}};
+    std::size_t separator = line.find(';');
+    const char *geom_begin = line.data();
+    const char *geom_end = line.data() + line.size();
+    if (separator != std::string::npos) {
+      char *end = nullptr;
+      std::string id = line.substr(0, separator);
+      trajectory.id = std::strtol(id.c_str(), &end, 10);
+      if (end == id.c_str() || *end != '\0') {
+        *error = "invalid id " + id;
+        return false;
+      }
+      geom_begin += separator + 1;
+    }
+    // Other forms than a 2D linestring are left to boost
+    if (!parse_wkt_linestring(geom_begin, geom_end, &trajectory.geom) &&
+        !parse_hex_wkb_linestring(geom_begin, geom_end, &trajectory.geom)) {
+      try {
+        trajectory.geom = wkt2linestring(std::string(geom_begin, geom_end));
+      } catch (const std::exception &e) {
+        *error = "invalid WKT at line " + std::to_string(index) + ": " +
+            e.what();
+        return false;
+      }
+    }
+    trajectories->push_back(std::move(trajectory));
+    ++index;
+  }
+  return true;
+}
+
+bool FMMServer::parse_parameters(const IO::HttpRequest &request,
+                                 FastMapMatchConfig *config,
+                                 std::string *error) {
+  return parse_number(request, "k", &config->k, error) &&
+      parse_number(request, "r", &config->radius, error) &&
+      parse_number(request, "e", &config->gps_error, error);
+}
+
+bool FMMServer::parse_schedule(const IO::HttpRequest &request,
+                               RequestPriority *priority, double *deadline,
+                               std::string *error) {
+  *priority = RequestPriority::INTERACTIVE;
+  std::string name;
+  if (request.get_parameter("priority", &name) &&
+      !MatchScheduler::string2priority(name, priority)) {
+    *error = "invalid parameter priority " + name;
+    return false;
+  }
+  *deadline = 0;
+  return parse_number(request, "deadline", deadline, error);
+}
+
+void FMMServer::append_result(const MatchResult &result, int precision,
+                              std::string *buffer) {
+  buffer->append("{\"id\":");
+  IO::append_int(result.id, buffer);
+  buffer->append(",\"cpath\":[");
+  IO::append_ints(result.cpath, buffer);
+  buffer->append("],\"opath\":[");
+  IO::append_ints(result.opath, buffer);
+  buffer->append("],\"indices\":[");
+  IO::append_ints(result.indices, buffer);
+  buffer->append("],\"mgeom\":\"");
+  if (result.mgeom.get_num_points() > 0) {
+    IO::append_wkt(result.mgeom, precision, buffer);
+  }
+  buffer->append("\"");
+  // Only a result cut by the budget is flagged
+  if (result.partial) buffer->append(",\"partial\":true");
+  buffer->append("}");
+}
+
+bool FMMServer::parse_tile_path(const std::string &path, int *z, int *x,
+                                int *y) {
+  int end = 0;
+  char extension[4] = {0};
+  if (std::sscanf(path.c_str(), "/tiles/%d/%d/%d.%3s%n", z, x, y,
+                  extension, &end) != 4 || end != (int) path.size()) {
+    return false;
+  }
+  std::string name(extension);
+  return name == "mvt" || name == "pbf";
+}
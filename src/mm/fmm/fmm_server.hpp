@@ -0,0 +1,271 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_server command line program
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_FMM_SERVER_HPP_
+#define FMM_FMM_SERVER_HPP_
+
+#include "mm/fmm/fmm_server_config.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/fmm/match_scheduler.hpp"
+#include "io/http_server.hpp"
+#include "network/edge_closures.hpp"
+#include "network/network_tiles.hpp"
+#include "util/stage_profile.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace FMM{
+namespace MM{
+/**
+ * Network, graph and UBODT of a server, which are loaded together and
+ * replaced together when they are reloaded.
+ */
+struct FMMServerGeneration {
+  /**
+   * Load the network and graph defined in configuration, the UBODT and
+   * model are created by FMMServer::load_generation.
+   * @param config  Configuration of the server
+   * @param version_arg Number of the generation, starting from 1
+   */
+  FMMServerGeneration(const FMMServerConfig &config, int version_arg) :
+      version(version_arg),
+      network(config.network_config.file,
+              config.network_config.id,
+              config.network_config.source,
+              config.network_config.target,
+              config.network_config.cache,
+              config.network_config.get_spatial_index_options(),
+              config.network_config.reorder,
+              config.network_config.project,
+              config.network_config.get_clip(),
+              config.network_config.compress_geometry,
+              config.network_config.get_cost_names()),
+      graph(network, config.network_config.read_edge_mask(network)) {};
+  /**
+   * Collect the memory of the network, graph and UBODT
+   */
+  UTIL::MemoryReport get_memory_report() const;
+  int version; /**< Number of the generation */
+  NETWORK::Network network; /**< Road network */
+  NETWORK::NetworkGraph graph; /**< Graph of the network */
+  std::shared_ptr<UBODT> ubodt; /**< UBODT of the graph */
+  std::unique_ptr<FastMapMatch> model; /**< Model matching against them */
+  std::unique_ptr<NETWORK::NetworkTiles> tiles; /**< Vector tiles of the
+                                                     network, nullptr if
+                                                     disabled */
+  std::shared_ptr<NETWORK::EdgeClosures> closures; /**< Closed edges
+      attached to the UBODT */
+};
+
+/**
+ * Class of fmm_server command line program, which loads the network and
+ * UBODT once and matches the trajectories of http requests.
+ *
+ * A request POST /match carries a trajectory per line of its body, as
+ * id;WKT or WKT where the id is the index of the line, so that small
+ * trajectories are batched into one request. The geometry may also be
+ * written in hexadecimal WKB. The query may override the
+ * parameters k, r and e of the default configuration. The results are
+ * returned in JSON with the complete path, optimal path, indices and
+ * matched geometry of each trajectory.
+ *
+ * The query may also set the priority of a match request, interactive
+ * by default or bulk, and its deadline in seconds. The trajectories are
+ * matched by a MatchScheduler, so that a bulk request yields to the
+ * interactive ones between its trajectories. The matching of a
+ * trajectory stops at its deadline as it does when its budget runs out,
+ * and the trajectories not started by then are cancelled, returned
+ * unmatched and partial.
+ *
+ * A request GET /tiles/{z}/{x}/{y}.mvt returns the edges of the network
+ * in a mapbox vector tile, so that a web map only loads the edges
+ * visible. The tiles are cached with the generation.
+ *
+ * A request POST /closures replaces the closed edges with the edge ids
+ * of its body, separated by commas or whitespace, and GET /closures
+ * lists them. The transitions crossing a closed edge are routed around
+ * it without regenerating the UBODT. The closures are kept when the
+ * generation is reloaded.
+ *
+ * The files of the network and UBODT are reloaded in the background on
+ * POST /reload or SIGHUP. The new generation is swapped in once loaded,
+ * while the requests in flight finish on the generation they started
+ * with, which is released after the last of them. Both generations are
+ * resident during a reload.
+ *
+ * POST /closures and POST /reload change the server, so they are
+ * answered only with the bearer token of the admin_token option.
+ */
+class FMMServer {
+ public:
+  /**
+   * Create the server from configuration data
+   * @param config Configuration defining network, graph and UBODT
+   */
+  explicit FMMServer(const FMMServerConfig &config);
+  /**
+   * Answer the requests until the server is stopped
+   */
+  void run();
+  /**
+   * Stop the server, which can be called from a signal handler
+   */
+  void stop();
+  /**
+   * Ask for a reload of the network and UBODT, which is done in the
+   * background by run. It can be called from a signal handler.
+   */
+  void request_reload();
+  /**
+   * Load a new generation from the files of the configuration and swap it
+   * in, the current one is kept if the loading fails.
+   * @return true if the new generation is swapped in
+   */
+  bool reload();
+  /**
+   * Get the generation which new requests are matched against
+   */
+  std::shared_ptr<const FMMServerGeneration> get_generation() const;
+  /**
+   * Answer a request
+   * @param  request http request
+   * @return the http response
+   */
+  IO::HttpResponse handle(const IO::HttpRequest &request);
+  /**
+   * Parse the trajectories of the body of a match request
+   * @param  body         a trajectory per line, as id;WKT or WKT
+   * @param  trajectories updated with the trajectories parsed
+   * @param  error        updated with the error of an invalid line
+   * @return false if a line is invalid
+   */
+  static bool parse_trajectories(const std::string &body,
+                                 std::vector<CORE::Trajectory> *trajectories,
+                                 std::string *error);
+  /**
+   * Override a configuration with the parameters k, r and e of the
+   * query of a request
+   * @param  request http request
+   * @param  config  configuration updated
+   * @param  error   updated with the error of an invalid parameter
+   * @return false if a parameter is invalid
+   */
+  static bool parse_parameters(const IO::HttpRequest &request,
+                               FastMapMatchConfig *config,
+                               std::string *error);
+  /**
+   * Parse the parameters priority and deadline of the query of a request
+   * @param  request  http request
+   * @param  priority updated with the priority, interactive by default
+   * @param  deadline updated with the seconds given to the request, 0
+   * for none
+   * @param  error    updated with the error of an invalid parameter
+   * @return false if a parameter is invalid
+   */
+  static bool parse_schedule(const IO::HttpRequest &request,
+                             RequestPriority *priority, double *deadline,
+                             std::string *error);
+  /**
+   * Append the JSON object of a result
+   * @param result    result of a trajectory
+   * @param precision decimals of the coordinates of mgeom, or negative
+   * @param buffer    buffer updated
+   */
+  static void append_result(const MatchResult &result, int precision,
+                            std::string *buffer);
+  /**
+   * Parse the path of a tile request, /tiles/{z}/{x}/{y}.mvt where the
+   * extension may also be pbf
+   * @param  path path of a request
+   * @param  z    updated with the zoom level
+   * @param  x    updated with the column
+   * @param  y    updated with the row
+   * @return false if the path is not a tile
+   */
+  static bool parse_tile_path(const std::string &path, int *z, int *x,
+                              int *y);
+  /**
+   * Parse the edge ids of the body of a closures request
+   * @param  body  edge ids separated by commas or whitespace
+   * @param  ids   updated with the ids parsed
+   * @param  error updated with the error of an invalid id
+   * @return false if an id is invalid
+   */
+  static bool parse_edge_ids(const std::string &body,
+                             std::vector<NETWORK::EdgeID> *ids,
+                             std::string *error);
+ private:
+  /**
+   * Load a generation from the files defined in configuration
+   * @param config  Configuration of the server
+   * @param version Number of the generation
+   * @return the generation, nullptr if the UBODT cannot be loaded
+   */
+  static std::shared_ptr<FMMServerGeneration> load_generation(
+      const FMMServerConfig &config, int version);
+  /**
+   * Reload the generation whenever it is requested, until stopped
+   */
+  void reload_loop();
+  /**
+   * Match the trajectories of a request
+   */
+  IO::HttpResponse match(const IO::HttpRequest &request);
+  /**
+   * Answer a tile request
+   */
+  IO::HttpResponse tile(const IO::HttpRequest &request);
+  /**
+   * Check the bearer token of a request changing the server
+   * @return false if the admin token is not set or does not match
+   */
+  bool authorized(const IO::HttpRequest &request) const;
+  /**
+   * Answer a closures request
+   */
+  IO::HttpResponse closures(const IO::HttpRequest &request);
+  /**
+   * Close the edges of the ids kept in a generation, which should be
+   * called with closures_mutex_ held
+   * @return number of the ids not in the network
+   */
+  long apply_closures(const FMMServerGeneration &generation) const;
+  /**
+   * Format the counters of the requests and of UBODT as metrics
+   */
+  IO::HttpResponse metrics();
+  const FMMServerConfig &config_;
+  // Read and replaced with std::atomic_load and std::atomic_store
+  std::shared_ptr<const FMMServerGeneration> generation_;
+  std::unique_ptr<IO::HttpServer> server_;
+  int match_threads_; // Trajectories matched at once
+  std::unique_ptr<MatchScheduler> scheduler_;
+  std::atomic<bool> reload_requested_{false};
+  bool reload_stopped_ = false;
+  std::mutex reload_mutex_;
+  std::condition_variable reload_cv_;
+  std::atomic<long> reloads_{0};
+  std::atomic<long> reload_failures_{0};
+  std::atomic<long> requests_{0};
+  std::atomic<long> errors_{0};
+  std::atomic<long> trajectories_{0};
+  std::atomic<long> points_{0};
+  std::atomic<long> cancelled_{0};
+  std::mutex closures_mutex_; // Held while the closures are applied
+  std::vector<NETWORK::EdgeID> closed_ids_;
+  std::mutex latency_mutex_;
+  UTIL::StageHistogram latency_; // Time to answer a match request
+};
+}
+}
+
+#endif // FMM_FMM_SERVER_HPP_
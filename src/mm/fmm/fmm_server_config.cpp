@@ -0,0 +1,355 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/fmm_server_config.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::CONFIG;
+using namespace FMM::MM;
+
+FMMServerConfig::FMMServerConfig(int argc, char **argv){
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  if (argc==2) {
+    std::string configfile(argv[1]);
+    if (UTIL::check_file_extension(configfile,"xml,XML"))
+      load_xml(configfile);
+    else {
+      load_arg(argc,argv);
+    }
+  } else {
+    load_arg(argc,argv);
+  }
+  spdlog::set_level((spdlog::level::level_enum) log_level);
+  if (!help_specified)
+    print();
+};
+
+void FMMServerConfig::load_xml(const std::string &file){
+  SPDLOG_INFO("Start with reading fmm_server configuration {}",file);
+  boost::property_tree::ptree tree;
+  boost::property_tree::read_xml(file, tree);
+  network_config = NetworkConfig::load_from_xml(tree);
+  fmm_config = FastMapMatchConfig::load_from_xml(tree);
+  // UBODT
+  ubodt_layout = tree.get("config.input.ubodt.layout", std::string("chained"));
+  ubodt_file = tree.get("config.input.ubodt.file", std::string(""));
+  ubodt_delta = tree.get("config.input.ubodt.delta", 3000.0);
+  ubodt_cache_rows = tree.get("config.input.ubodt.cache_rows",
+                              UBODT::DEFAULT_CACHE_ROWS);
+  ubodt_max_tiles = tree.get("config.input.ubodt.max_tiles",
+                             UBODT::DEFAULT_RESIDENT_TILES);
+  host = tree.get("config.server.host",std::string("127.0.0.1"));
+  port = tree.get("config.server.port",8080);
+  admin_token = tree.get("config.server.admin_token",std::string(""));
+  threads = tree.get("config.server.threads",0);
+  bulk_requests = tree.get("config.server.bulk_requests",0);
+  max_body = tree.get("config.server.max_body",64);
+  tile_cache = tree.get("config.server.tile_cache",64);
+  output_precision = tree.get("config.output.precision",-1);
+  log_level = tree.get("config.other.log_level",2);
+  SPDLOG_INFO("Finish with reading fmm_server xml configuration");
+};
+
+void FMMServerConfig::load_arg(int argc, char **argv){
+  SPDLOG_INFO("Start reading fmm_server configuration from arguments");
+  cxxopts::Options options("fmm_server_config",
+                           "Configuration parser of fmm_server");
+  options.add_options()
+    ("ubodt","Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_layout","Ubodt storage layout",
+    cxxopts::value<std::string>()->default_value("chained"))
+    ("ubodt_delta","Upperbound of lazy ubodt",
+    cxxopts::value<double>()->default_value("3000"))
+    ("ubodt_cache_rows","Maximum rows cached in lazy ubodt",
+    cxxopts::value<long>()->default_value(
+        std::to_string(UBODT::DEFAULT_CACHE_ROWS)))
+    ("ubodt_max_tiles","Maximum tiles mapped in tiled ubodt",
+    cxxopts::value<int>()->default_value(
+        std::to_string(UBODT::DEFAULT_RESIDENT_TILES)))
+    ("network","Network file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("no_network_cache","Do not read or write the network cache")
+    ("rtree","Rtree algorithm",
+    cxxopts::value<std::string>()->default_value("packing"))
+    ("rtree_max_elements","Rtree node capacity",
+    cxxopts::value<int>()->default_value("16"))
+    ("rtree_chunk_segments","Segments of the edge chunks in the rtree",
+    cxxopts::value<int>()->default_value("0"))
+    ("spatial_index","Spatial index of the edges",
+    cxxopts::value<std::string>()->default_value("rtree"))
+    ("grid_cell_size","Cell size of the grid index",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_batch_size","Points searched with one spatial index query",
+    cxxopts::value<int>()->default_value("1"))
+    ("nearest_search","Search the candidates with the nearest query")
+    ("search_initial_radius","Radius of the first search of a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_min_candidates","Candidates below which the radius grows",
+    cxxopts::value<int>()->default_value("1"))
+    ("search_radius_growth","Factor of each growth of the radius",
+    cxxopts::value<double>()->default_value("2"))
+    ("search_snap_resolution","Cell size of the snapping cache",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_snap_items","Maximum edges cached by the snapping cache",
+    cxxopts::value<long>()->default_value(
+        std::to_string(NETWORK::SnapCache::DEFAULT_CACHE_ITEMS)))
+    ("reorder_network","Renumber nodes along the Hilbert curve")
+    ("project_network","Project a lon/lat network into metres")
+    ("compress_geometry","Keep the edge geometries compressed")
+    ("twin_edges","Index the twin edges of two-way roads once")
+    ("network_clip","Region of the network read, box or WKT polygon",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_clip_margin","Margin around the network clip region",
+      cxxopts::value<double>()->default_value("0"))
+    ("network_costs","Extra cost columns of the network",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_edge_mask","File of the ids of the edges allowed",
+      cxxopts::value<std::string>()->default_value(""))
+    ("k,candidates","Number of candidates",
+    cxxopts::value<int>()->default_value("8"))
+    ("r,radius","Search radius",
+    cxxopts::value<double>()->default_value("300.0"))
+    ("e,error","GPS error",
+    cxxopts::value<double>()->default_value("50.0"))
+    ("min_ep_ratio","Minimum emission probability ratio to the best",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_dist_ratio","Maximum distance ratio to the best candidate",
+    cxxopts::value<double>()->default_value("0"))
+    ("adaptive_k_spacing","Point spacing below which k is reduced",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_heading_diff","Maximum angle between point heading and edge",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_heading_distance","Neighbour distance giving a reliable heading",
+    cxxopts::value<double>()->default_value("0"))
+    ("beam_size","Maximum number of states expanded per layer",
+    cxxopts::value<int>()->default_value("0"))
+    ("beam_margin","Maximum log probability difference to the best state",
+    cxxopts::value<double>()->default_value("0"))
+    ("split","Split the trajectories at the breaks of the matching")
+    ("max_time_gap","Time gap splitting the trajectories",
+    cxxopts::value<double>()->default_value("0"))
+    ("parallel_viterbi","Points from which a trajectory runs in parallel",
+    cxxopts::value<int>()->default_value("0"))
+    ("stationary_radius","Radius of the stationary clusters collapsed",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_distance","Minimum distance between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_interval","Minimum time between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("coarse_step","Points per point of the coarse pass",
+    cxxopts::value<int>()->default_value("0"))
+    ("corridor_buffer","Buffer of the corridor of the coarse path",
+    cxxopts::value<double>()->default_value("0"))
+    ("corridor_k","Number of candidates in the corridor",
+    cxxopts::value<int>()->default_value("0"))
+    ("approximate_ep","Approximate the emission probabilities")
+    ("max_seconds","Maximum seconds spent on a trajectory",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_transitions","Maximum transitions evaluated for a trajectory",
+    cxxopts::value<long>()->default_value("0"))
+    ("metric","Cost column of the network scoring the transitions",
+    cxxopts::value<std::string>()->default_value(""))
+    ("host","IPv4 address listened",
+    cxxopts::value<std::string>()->default_value("127.0.0.1"))
+    ("port","Port listened",cxxopts::value<int>()->default_value("8080"))
+    ("admin_token","Bearer token of the requests changing the server",
+    cxxopts::value<std::string>()->default_value(""))
+    ("threads","Threads answering the requests",
+    cxxopts::value<int>()->default_value("0"))
+    ("bulk_requests","Bulk match requests in flight",
+    cxxopts::value<int>()->default_value("0"))
+    ("max_body","Largest request body accepted in MB",
+    cxxopts::value<int>()->default_value("64"))
+    ("tile_cache","Memory of the vector tiles cached in MB",
+    cxxopts::value<int>()->default_value("64"))
+    ("output_precision","Decimals of the coordinates written",
+    cxxopts::value<int>()->default_value("-1"))
+    ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
+    ("h,help","Help information");
+  if (argc==1) {
+    help_specified = true;
+    return;
+  }
+  auto result = options.parse(argc, argv);
+  ubodt_file = result["ubodt"].as<std::string>();
+  ubodt_layout = result["ubodt_layout"].as<std::string>();
+  ubodt_delta = result["ubodt_delta"].as<double>();
+  ubodt_cache_rows = result["ubodt_cache_rows"].as<long>();
+  ubodt_max_tiles = result["ubodt_max_tiles"].as<int>();
+  network_config = NetworkConfig::load_from_arg(result);
+  fmm_config = FastMapMatchConfig::load_from_arg(result);
+  host = result["host"].as<std::string>();
+  port = result["port"].as<int>();
+  admin_token = result["admin_token"].as<std::string>();
+  threads = result["threads"].as<int>();
+  bulk_requests = result["bulk_requests"].as<int>();
+  max_body = result["max_body"].as<int>();
+  tile_cache = result["tile_cache"].as<int>();
+  output_precision = result["output_precision"].as<int>();
+  log_level = result["log_level"].as<int>();
+  if (result.count("help")>0) {
+    help_specified = true;
+  }
+  SPDLOG_INFO("Finish with reading fmm_server arg configuration");
+};
+
+void FMMServerConfig::print_help(){
+  std::cout<<"fmm_server argument lists:\n";
+  std::cout<<"--ubodt (required) <string>: Ubodt file name\n";
+  std::cout<<"--ubodt_layout (optional) <string>: storage layout of ubodt,\n";
+  std::cout<<"  chained, flat, compact, split, csr or lazy (chained)\n";
+  std::cout<<"--ubodt_delta (optional) <double>: upperbound of lazy ubodt\n";
+  std::cout<<"  (3000)\n";
+  std::cout<<"--ubodt_cache_rows (optional) <long>: maximum rows cached\n";
+  std::cout<<"  in lazy ubodt\n";
+  std::cout<<"--ubodt_max_tiles (optional) <int>: maximum tiles mapped\n";
+  std::cout<<"  in tiled ubodt\n";
+  std::cout<<"--network (required) <string>: Network file name\n";
+  std::cout<<"--network_id (optional) <string>: Network id name (id)\n";
+  std::cout<<"--source (optional) <string>: Network source name (source)\n";
+  std::cout<<"--target (optional) <string>: Network target name (target)\n";
+  std::cout<<"--no_network_cache: do not read or write the network\n";
+  std::cout<<"  cache file\n";
+  std::cout<<"--rtree, --rtree_max_elements, --rtree_chunk_segments,\n";
+  std::cout<<"  --spatial_index, --grid_cell_size, --search_batch_size,\n";
+  std::cout<<"  --nearest_search, --search_initial_radius,\n";
+  std::cout<<"  --search_min_candidates, --search_radius_growth,\n";
+  std::cout<<"  --search_snap_resolution, --search_snap_items,\n";
+  std::cout<<"  --reorder_network, --project_network, --compress_geometry,\n";
+  std::cout<<"  --twin_edges,\n";
+  std::cout<<"  --network_clip, --network_clip_margin, --network_costs,\n";
+  std::cout<<"  --network_edge_mask\n";
+  std::cout<<"  (optional):\n";
+  std::cout<<"  network options as in fmm\n";
+  std::cout<<"-k/--candidates, -r/--radius, -e/--error and the other\n";
+  std::cout<<"  map matching parameters of fmm (optional): default\n";
+  std::cout<<"  configuration, where k, r and e can be overridden by the\n";
+  std::cout<<"  query of a request\n";
+  std::cout<<"--host (optional) <string>: IPv4 address listened,\n";
+  std::cout<<"  0.0.0.0 for all the interfaces (127.0.0.1)\n";
+  std::cout<<"--port (optional) <int>: port listened (8080)\n";
+  std::cout<<"--admin_token (optional) <string>: bearer token of\n";
+  std::cout<<"  POST /closures and POST /reload, which are rejected\n";
+  std::cout<<"  if it is not set (unset)\n";
+  std::cout<<"--threads (optional) <int>: threads answering the\n";
+  std::cout<<"  requests, 0 for the number of cores (0)\n";
+  std::cout<<"--bulk_requests (optional) <int>: bulk match requests in\n";
+  std::cout<<"  flight, the others are rejected, 0 for the threads (0)\n";
+  std::cout<<"--max_body (optional) <int>: largest request body\n";
+  std::cout<<"  accepted in MB (64)\n";
+  std::cout<<"--tile_cache (optional) <int>: memory of the vector tiles\n";
+  std::cout<<"  of the network cached in MB, 0 disables them (64)\n";
+  std::cout<<"--output_precision (optional) <int>: decimals of the\n";
+  std::cout<<"  coordinates of mgeom (12 significant digits)\n";
+  std::cout<<"--log_level (optional) <int>: log level (2)\n";
+  std::cout<<"-h/--help:print help information\n";
+  std::cout<<"Requests:\n";
+  std::cout<<"  POST /match?k=8&r=300&e=50 with a trajectory per line of\n";
+  std::cout<<"  the body, as id;WKT or WKT, returns the results in JSON,\n";
+  std::cout<<"  where the geometry may also be hexadecimal WKB\n";
+  std::cout<<"  The query may add priority=interactive (default) or\n";
+  std::cout<<"  priority=bulk and deadline=<seconds>, after which the\n";
+  std::cout<<"  trajectories left are cancelled and returned partial\n";
+  std::cout<<"  GET /health and GET /metrics (Prometheus text format)\n";
+  std::cout<<"  GET /tiles/{z}/{x}/{y}.mvt returns the edges of the\n";
+  std::cout<<"  network as a mapbox vector tile\n";
+  std::cout<<"  POST /closures with the edge ids closed in the body\n";
+  std::cout<<"  routes the transitions around them, GET lists them\n";
+  std::cout<<"  POST /reload or SIGHUP reloads the network and ubodt\n";
+  std::cout<<"  files in the background and swaps them in once loaded\n";
+  std::cout<<"  Both POST requests need Authorization: Bearer <token>\n";
+  std::cout<<"For xml configuration, check example folder\n";
+};
+
+void FMMServerConfig::print() const {
+  SPDLOG_INFO("----   Print configuration    ----");
+  network_config.print();
+  fmm_config.print();
+  SPDLOG_INFO("UBODT file {}",ubodt_file);
+  SPDLOG_INFO("UBODT layout {}",ubodt_layout);
+  if (get_ubodt_layout() == LAZY) {
+    SPDLOG_INFO("UBODT delta {} cache rows {}",ubodt_delta,ubodt_cache_rows);
+  } else if (UTIL::check_file_extension(ubodt_file,"tiles")) {
+    SPDLOG_INFO("UBODT max tiles {}",ubodt_max_tiles);
+  }
+  SPDLOG_INFO("Host {} port {}",host,port);
+  SPDLOG_INFO("Admin token {}",admin_token.empty() ? "unset" : "set");
+  SPDLOG_INFO("Threads {}",threads);
+  SPDLOG_INFO("Bulk requests {}",bulk_requests);
+  SPDLOG_INFO("Max body {} MB",max_body);
+  SPDLOG_INFO("Tile cache {} MB",tile_cache);
+  SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
+  SPDLOG_INFO("---- Print configuration done ----");
+};
+
+UBODTLayout FMMServerConfig::get_ubodt_layout() const {
+  UBODTLayout layout = CHAINED;
+  UBODT::string2layout(ubodt_layout, &layout);
+  return layout;
+};
+
+bool FMMServerConfig::validate() const
+{
+  SPDLOG_DEBUG("Validating configuration");
+  if (log_level<0 || log_level>(int) UTIL::LOG_LEVESLS.size()) {
+    SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6",log_level);
+    SPDLOG_CRITICAL("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
+    return false;
+  }
+  if (port <= 0 || port > 65535) {
+    SPDLOG_CRITICAL("Invalid port {}",port);
+    return false;
+  }
+  if (threads < 0 || max_body <= 0) {
+    SPDLOG_CRITICAL("Invalid threads {} or max body {}",threads,max_body);
+    return false;
+  }
+  if (bulk_requests < 0) {
+    SPDLOG_CRITICAL("Invalid bulk requests {}",bulk_requests);
+    return false;
+  }
+  if (tile_cache < 0) {
+    SPDLOG_CRITICAL("Invalid tile cache {} MB",tile_cache);
+    return false;
+  }
+  if (!network_config.validate()) {
+    return false;
+  }
+  if (!fmm_config.validate()) {
+    return false;
+  }
+  UBODTLayout layout;
+  if (!UBODT::string2layout(ubodt_layout, &layout)) {
+    SPDLOG_CRITICAL("Invalid UBODT layout {}", ubodt_layout);
+    return false;
+  }
+  if (layout == LAZY) {
+    if (ubodt_delta <= 0 || ubodt_cache_rows <= 0) {
+      SPDLOG_CRITICAL("Invalid lazy UBODT delta {} cache rows {}",
+                      ubodt_delta, ubodt_cache_rows);
+      return false;
+    }
+  } else if (ubodt_file.compare(0, UBODT::SHM_PREFIX.size(),
+                                UBODT::SHM_PREFIX) != 0 &&
+             !UTIL::file_exists(ubodt_file)) {
+    SPDLOG_CRITICAL("UBODT file not exists {}", ubodt_file);
+    return false;
+  }
+  if (ubodt_max_tiles <= 0) {
+    SPDLOG_CRITICAL("Invalid UBODT max tiles {}", ubodt_max_tiles);
+    return false;
+  }
+  SPDLOG_DEBUG("Validating done");
+  return true;
+};
@@ -0,0 +1,93 @@
+/**
+ * Fast map matching.
+ *
+ * fmm_server command line program configuration
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_FMM_SERVER_CONFIG_HPP_
+#define FMM_FMM_SERVER_CONFIG_HPP_
+
+#include "config/network_config.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+
+namespace FMM{
+namespace MM{
+/**
+ * Configuration class of fmm_server command line program
+ */
+class FMMServerConfig
+{
+ public:
+  /**
+   * Constructor of the configuration from command line arguments or
+   * an xml file
+   *
+   * @param argc number of arguments
+   * @param argv raw argument data
+   */
+  FMMServerConfig(int argc, char **argv);
+  /**
+   * Load configuration from an XML file
+   * @param file xml file name
+   */
+  void load_xml(const std::string &file);
+  /**
+   * Load configuration from arguments
+   * @param argc number of arguments
+   * @param argv raw argument data
+   */
+  void load_arg(int argc, char **argv);
+  /**
+   * Validate the configuration
+   * @return true if valid
+   */
+  bool validate() const;
+  /**
+   * Print configuration data
+   */
+  void print() const;
+  /**
+   * Print help information
+   */
+  static void print_help();
+  /**
+   * Get the storage layout of UBODT
+   * @return storage layout, chained if the name is invalid
+   */
+  UBODTLayout get_ubodt_layout() const;
+  CONFIG::NetworkConfig network_config; /**< Network data configuraiton */
+  FastMapMatchConfig fmm_config; /**< Default map matching configuration,
+                                     overridden by the requests */
+  std::string ubodt_file; /**< UBODT file name */
+  std::string ubodt_layout = "chained"; /**< UBODT storage layout */
+  double ubodt_delta = 3000; /**< Upperbound of lazy UBODT */
+  long ubodt_cache_rows = UBODT::DEFAULT_CACHE_ROWS; /**< Maximum number of
+                                                     rows cached in lazy
+                                                     UBODT */
+  int ubodt_max_tiles = UBODT::DEFAULT_RESIDENT_TILES; /**< Maximum number
+                                                       of tiles mapped in
+                                                       tiled UBODT */
+  std::string host = "127.0.0.1"; /**< IPv4 address listened */
+  int port = 8080; /**< Port listened */
+  std::string admin_token; /**< Bearer token of POST /reload and POST
+                               /closures, which are rejected if empty */
+  int threads = 0; /**< Threads answering the requests, 0 for the
+                       number of cores */
+  int bulk_requests = 0; /**< Bulk match requests in flight, the others
+                             are rejected, 0 for the threads */
+  int max_body = 64; /**< Largest request body accepted, in MB */
+  int tile_cache = 64; /**< Memory of the vector tiles of the network
+                           cached, in MB, 0 disables GET /tiles */
+  int output_precision = -1; /**< Decimals of the coordinates of mgeom,
+                                 negative for 12 significant digits */
+  bool help_specified = false; /**< Help is specified or not */
+  int log_level = 2; /**< log level, 0-trace,1-debug,2-info,
+                         3-warn,4-err,5-critical,6-off */
+}; // FMMServerConfig
+}
+}
+
+#endif //FMM_FMM_SERVER_CONFIG_HPP_
@@ -0,0 +1,57 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the fast map matching stream matcher
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/fmm/fmm_stream.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+FastMapMatchStream::FastMapMatchStream(FastMapMatch &model,
+                                       const FastMapMatchConfig &config,
+                                       int max_lag) :
+    StreamMatcher(config.gps_error, max_lag, config.get_viterbi_beam(),
+                  model.network_.get_projection()),
+    model_(model), config_(config) {
+}
+
+bool FastMapMatchStream::search_candidates(
+    const Point &point, std::vector<Candidate> *candidates) {
+  LineString geom;
+  geom.add_point(point);
+  CandidateSearchContext &context = CandidateSearchContext::local();
+  if (!model_.network_.search_tr_cs_knn(geom, config_.k, config_.radius,
+                                        &context, nullptr,
+                                        model_.graph_.get_edge_mask())) {
+    return false;
+  }
+  context.prune(geom, config_.k, config_.get_candidate_pruning());
+  CandidateSpan cs = context.get_point_candidates(0);
+  candidates->assign(cs.begin(), cs.end());
+  return true;
+}
+
+void FastMapMatchStream::update_layer(StreamLayer *la_ptr,
+                                      StreamLayer *lb_ptr, bool log_space) {
+  TGLayer la = la_ptr->get_layer();
+  TGLayer lb = lb_ptr->get_layer();
+  model_.update_layer(la_ptr->index, &la, &lb,
+                      lb_ptr->eu_dist * model_.metric_pace_, log_space);
+}
+
+C_Path FastMapMatchStream::complete_path(const Candidate &a,
+                                         const Candidate &b) {
+  TGNode na{&a, nullptr, 0, 0, 0, 0};
+  TGNode nb{&b, &na, 0, 0, 0, 0};
+  std::vector<int> indices;
+  return model_.ubodt_->construct_complete_path(
+      TGOpath{&na, &nb}, model_.network_.get_edges(), &indices);
+}
@@ -0,0 +1,47 @@
+/**
+ * Fast map matching.
+ *
+ * Fixed lag matching of a stream of points with the fast map matching
+ * model
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_FMM_STREAM_HPP
+#define FMM_FMM_STREAM_HPP
+
+#include "mm/stream_matcher.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Stream matcher using the candidates, transitions and complete paths of
+ * a fast map matching model, such as one vehicle of a real time feed.
+ */
+class FastMapMatchStream : public StreamMatcher {
+ public:
+  /**
+   * Create a stream matcher of a model, which should outlive it
+   * @param model   fast map matching model
+   * @param config  configuration of the model
+   * @param max_lag maximum number of points not finalized
+   */
+  FastMapMatchStream(FastMapMatch &model, const FastMapMatchConfig &config,
+                     int max_lag = DEFAULT_MAX_LAG);
+ protected:
+  bool search_candidates(const CORE::Point &point,
+                         std::vector<Candidate> *candidates) override;
+  void update_layer(StreamLayer *la_ptr, StreamLayer *lb_ptr,
+                    bool log_space) override;
+  C_Path complete_path(const Candidate &a, const Candidate &b) override;
+ private:
+  FastMapMatch &model_;
+  FastMapMatchConfig config_;
+};
+
+}
+}
+#endif /* FMM_FMM_STREAM_HPP */
@@ -0,0 +1,105 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/match_scheduler.hpp"
+
+#include <algorithm>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+MatchScheduler::MatchScheduler(int slots, int max_bulk) :
+    max_bulk_(std::max(max_bulk, 1)), free_slots_(std::max(slots, 1)) {
+}
+
+bool MatchScheduler::admit_request(RequestPriority priority) {
+  if (priority != RequestPriority::BULK) return true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (statistics_.bulk_requests >= max_bulk_) {
+    ++statistics_.rejected;
+    return false;
+  }
+  ++statistics_.bulk_requests;
+  return true;
+}
+
+void MatchScheduler::finish_request(RequestPriority priority) {
+  if (priority != RequestPriority::BULK) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  --statistics_.bulk_requests;
+}
+
+bool MatchScheduler::acquire(RequestPriority priority,
+                             const UTIL::TimePoint &deadline) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (std::chrono::steady_clock::now() >= deadline) {
+    ++statistics_.expired;
+    return false;
+  }
+  // The free slots are granted at once, so none is free while a
+  // trajectory is waiting
+  if (free_slots_ > 0) {
+    --free_slots_;
+    ++statistics_.running;
+    return true;
+  }
+  WaiterQueue &queue = queues_[(int) priority];
+  Waiter waiter;
+  WaiterKey key(deadline, next_ticket_++);
+  queue.emplace(key, &waiter);
+  if (deadline == UTIL::TimePoint::max()) {
+    waiter.cv.wait(lock, [&waiter] { return waiter.granted; });
+  } else {
+    waiter.cv.wait_until(lock, deadline, [&waiter] {
+      return waiter.granted;
+    });
+  }
+  if (waiter.granted) return true;
+  queue.erase(key);
+  ++statistics_.expired;
+  return false;
+}
+
+void MatchScheduler::release() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++free_slots_;
+  --statistics_.running;
+  grant();
+}
+
+void MatchScheduler::grant() {
+  WaiterQueue &interactive = queues_[(int) RequestPriority::INTERACTIVE];
+  WaiterQueue &bulk = queues_[(int) RequestPriority::BULK];
+  while (free_slots_ > 0 && (!interactive.empty() || !bulk.empty())) {
+    WaiterQueue &queue = interactive.empty() ? bulk : interactive;
+    if (&queue == &interactive && !bulk.empty()) ++statistics_.preempted;
+    Waiter *waiter = queue.begin()->second;
+    queue.erase(queue.begin());
+    waiter->granted = true;
+    --free_slots_;
+    ++statistics_.running;
+    waiter->cv.notify_one();
+  }
+}
+
+MatchSchedulerStatistics MatchScheduler::get_statistics() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MatchSchedulerStatistics statistics = statistics_;
+  statistics.waiting_interactive =
+      queues_[(int) RequestPriority::INTERACTIVE].size();
+  statistics.waiting_bulk = queues_[(int) RequestPriority::BULK].size();
+  return statistics;
+}
+
+bool MatchScheduler::string2priority(const std::string &name,
+                                     RequestPriority *priority) {
+  if (name == "interactive") {
+    *priority = RequestPriority::INTERACTIVE;
+  } else if (name == "bulk") {
+    *priority = RequestPriority::BULK;
+  } else {
+    return false;
+  }
+  return true;
+}
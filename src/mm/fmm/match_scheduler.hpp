@@ -0,0 +1,133 @@
+/**
+ * Fast map matching.
+ *
+ * Scheduler of the trajectories matched by the requests of a server,
+ * by priority and deadline
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_SCHEDULER_HPP_
+#define FMM_MATCH_SCHEDULER_HPP_
+
+#include "util/util.hpp"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
+namespace FMM{
+namespace MM{
+
+/**
+ * Priority of a match request
+ */
+enum class RequestPriority {
+  INTERACTIVE = 0, /**< Latency critical request, served first */
+  BULK = 1 /**< Backfill request, served by the slots left */
+};
+
+/**
+ * Counters of a scheduler
+ */
+struct MatchSchedulerStatistics {
+  long waiting_interactive = 0; /**< Interactive trajectories waiting
+                                     for a slot */
+  long waiting_bulk = 0; /**< Bulk trajectories waiting for a slot */
+  long running = 0; /**< Trajectories holding a slot */
+  long bulk_requests = 0; /**< Bulk requests admitted and not finished */
+  long rejected = 0; /**< Bulk requests rejected */
+  long preempted = 0; /**< Slots given to an interactive trajectory
+                           while bulk ones were waiting */
+  long expired = 0; /**< Slots given up as their deadline passed, once
+                         per request cancelled */
+};
+
+/**
+ * Scheduler of the trajectories of the match requests over a fixed
+ * number of slots, one per thread matching.
+ *
+ * A request takes a slot for each of its trajectories and gives it back
+ * after, so that a bulk request is preempted at the boundaries of its
+ * trajectories. The trajectories waiting are kept in a queue per
+ * priority, ordered by deadline then arrival, and a slot released goes
+ * to the first interactive one, or to the first bulk one if none. A
+ * trajectory whose deadline passes while waiting gives up, so that its
+ * request is cancelled. Once a trajectory holds a slot, its deadline is
+ * enforced by the budget of its matching.
+ *
+ * The bulk requests in flight are bounded, so that the connections of
+ * the interactive requests are not all taken by bulk ones waiting.
+ */
+class MatchScheduler {
+ public:
+  /**
+   * Create a scheduler
+   * @param slots     trajectories matched at once
+   * @param max_bulk  bulk requests in flight, the others are rejected
+   */
+  MatchScheduler(int slots, int max_bulk);
+  MatchScheduler(const MatchScheduler &) = delete;
+  MatchScheduler &operator=(const MatchScheduler &) = delete;
+  /**
+   * Admit a request, which is finished by finish_request
+   * @param  priority priority of the request
+   * @return false if it is a bulk request over the bound
+   */
+  bool admit_request(RequestPriority priority);
+  /**
+   * Finish a request admitted
+   */
+  void finish_request(RequestPriority priority);
+  /**
+   * Wait for a slot to match a trajectory, which is given back with
+   * release
+   * @param  priority priority of the request
+   * @param  deadline time given up at, TimePoint::max() for none
+   * @return false if the deadline passed before a slot is free
+   */
+  bool acquire(RequestPriority priority, const UTIL::TimePoint &deadline);
+  /**
+   * Give back a slot acquired
+   */
+  void release();
+  /**
+   * Get the counters of the scheduler
+   */
+  MatchSchedulerStatistics get_statistics();
+  /**
+   * Parse the name of a priority, interactive or bulk
+   * @param  name     name of the priority
+   * @param  priority updated with the priority
+   * @return false if the name is unknown
+   */
+  static bool string2priority(const std::string &name,
+                              RequestPriority *priority);
+ private:
+  /**
+   * Trajectory waiting for a slot
+   */
+  struct Waiter {
+    std::condition_variable cv;
+    bool granted = false;
+  };
+  typedef std::pair<UTIL::TimePoint, long> WaiterKey;
+  typedef std::map<WaiterKey, Waiter *> WaiterQueue;
+  /**
+   * Give the free slots to the first waiters, with the mutex held
+   */
+  void grant();
+  int max_bulk_;
+  int free_slots_;
+  long next_ticket_ = 0;
+  WaiterQueue queues_[2]; // Waiters by priority
+  std::mutex mutex_;
+  MatchSchedulerStatistics statistics_;
+}; // MatchScheduler
+}
+}
+
+#endif // FMM_MATCH_SCHEDULER_HPP_
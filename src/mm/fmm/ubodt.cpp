@@ -4,165 +4,3223 @@
 
 #include "mm/fmm/ubodt.hpp"
 #include "util/util.hpp"
+#include "util/memory.hpp"
 #include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
-UBODT::UBODT(int buckets_arg, int multiplier_arg) :
-    buckets(buckets_arg), multiplier(multiplier_arg) {
+namespace {
+// Header of the memory mapped UBODT file, followed by the slots
+struct MmapHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int record_size;
+  unsigned long long num_slots;
+  long long num_rows;
+  long long multiplier;
+  long long buckets;
+  double delta;
+  unsigned int layout;
+  char padding[4];
+};
+const char MMAP_MAGIC[8] = {'F', 'M', 'M', 'U', 'B', 'O', 'D', 'T'};
+
+// Header of the block compressed UBODT file. The compressed blocks
+// follow the header and the block index is stored at the end.
+struct BlockHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int flags;
+  long long num_rows;
+  long long num_blocks;
+  long long multiplier;
+  long long buckets;
+  double delta;
+  long long index_offset;
+};
+const char BLOCK_MAGIC[8] = {'F', 'M', 'M', 'U', 'B', 'O', 'D', 'Z'};
+// Rows are stored without prev_n
+const unsigned int BLOCK_FLAG_NO_PREV = 1;
+
+// Header of the tile index file, followed by the tile of each node and
+// the number of rows of each tile
+struct TileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int num_tiles;
+  long long num_nodes;
+  long long num_rows;
+  double delta;
+  char padding[8];
+};
+const char TILE_MAGIC[8] = {'F', 'M', 'M', 'T', 'I', 'L', 'E', 'S'};
+
+// Header of the network ids file, followed by the id of each node and
+// the id of each edge
+struct IdsHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int padding;
+  long long num_nodes;
+  long long num_edges;
+};
+const char IDS_MAGIC[8] = {'F', 'M', 'M', 'N', 'O', 'D', 'E', 'S'};
+
+// Entry of the block index. A block stores the rows of the sources
+// from first_source to last_source and a source is never split.
+struct BlockIndexEntry {
+  NodeIndex first_source;
+  NodeIndex last_source;
+  long long offset;
+  long long compressed_size;
+  long long raw_size;
+  long long num_rows;
+};
+
+inline void put_varint(unsigned long long v, std::string *buf) {
+  while (v >= 0x80) {
+    buf->push_back((char) (v | 0x80));
+    v >>= 7;
+  }
+  buf->push_back((char) v);
+}
+
+// Decode a varint, return nullptr if the buffer ends before it
+inline const unsigned char *get_varint(const unsigned char *p,
+                                       const unsigned char *end,
+                                       unsigned long long *v) {
+  unsigned long long result = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    unsigned char byte = *p++;
+    result |= (unsigned long long) (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *v = result;
+      return p;
+    }
+  }
+  return nullptr;
+}
+
+// Map a signed difference of node ids to an unsigned varint value
+inline unsigned long long zigzag(NodeIndex value, NodeIndex base) {
+  long long d = (long long) value - (long long) base;
+  return d < 0 ? ((unsigned long long) (-d) << 1) - 1
+               : (unsigned long long) d << 1;
+}
+
+inline NodeIndex unzigzag(unsigned long long v, NodeIndex base) {
+  long long d = (v & 1) ? -(long long) ((v + 1) >> 1) : (long long) (v >> 1);
+  return (NodeIndex) (base + d);
+}
+
+// Encode rows sorted by source and target. Each source group stores
+// the gap to the previous source and the number of rows, each row
+// stores the gap to the previous target, first_n and prev_n relative to
+// the source and target, next_e and the cost, so that the ids are small
+// varints before compression.
+void encode_block(const Record *rows, long n, NodeIndex first_source,
+                  bool no_prev, std::string *buf) {
+  NodeIndex prev_source = first_source;
+  long i = 0;
+  while (i < n) {
+    NodeIndex source = rows[i].source;
+    long j = i;
+    while (j < n && rows[j].source == source) ++j;
+    put_varint(source - prev_source, buf);
+    put_varint(j - i, buf);
+    NodeIndex prev_target = 0;
+    for (long k = i; k < j; ++k) {
+      const Record &r = rows[k];
+      put_varint(r.target - prev_target, buf);
+      put_varint(zigzag(r.first_n, source), buf);
+      if (!no_prev) put_varint(zigzag(r.prev_n, r.target), buf);
+      put_varint(r.next_e, buf);
+      buf->append((const char *) &r.cost, sizeof(double));
+      prev_target = r.target;
+    }
+    prev_source = source;
+    i = j;
+  }
+}
+
+// Decode the rows of a block into rows, return false if it is corrupted
+bool decode_block(const unsigned char *p, const unsigned char *end,
+                  NodeIndex first_source, bool no_prev, long n,
+                  Record *rows) {
+  NodeIndex source = first_source;
+  long i = 0;
+  unsigned long long v;
+  while (i < n) {
+    unsigned long long count;
+    if ((p = get_varint(p, end, &v)) == nullptr) return false;
+    source += v;
+    if ((p = get_varint(p, end, &count)) == nullptr) return false;
+    if (count > (unsigned long long) (n - i)) return false;
+    NodeIndex target = 0;
+    for (unsigned long long k = 0; k < count; ++k, ++i) {
+      Record &r = rows[i];
+      r.source = source;
+      if ((p = get_varint(p, end, &v)) == nullptr) return false;
+      target += v;
+      r.target = target;
+      if ((p = get_varint(p, end, &v)) == nullptr) return false;
+      r.first_n = unzigzag(v, source);
+      r.prev_n = UBODT::EMPTY_SLOT;
+      if (!no_prev) {
+        if ((p = get_varint(p, end, &v)) == nullptr) return false;
+        r.prev_n = unzigzag(v, target);
+      }
+      if ((p = get_varint(p, end, &v)) == nullptr) return false;
+      r.next_e = v;
+      if (end - p < (long) sizeof(double)) return false;
+      memcpy(&r.cost, p, sizeof(double));
+      p += sizeof(double);
+      r.next = nullptr;
+    }
+  }
+  return p == end;
+}
+
+// Mix the OD pair into a well distributed 64 bit hash
+inline unsigned long long hash_od(NodeIndex source, NodeIndex target) {
+  unsigned long long h = ((unsigned long long) source << 32) | target;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// A block of the miss filter fills a cache line and an OD pair sets
+// FILTER_HASHES bits in the block selected by its hash.
+const int FILTER_BLOCK_WORDS = 8;
+const int FILTER_HASHES = 6;
+
+// Find the block of the miss filter storing an OD pair and the bits of
+// the pair in each word of the block. The block index uses the high bits
+// of the hash, which are not used by the slot index of small tables.
+inline unsigned long long filter_block(unsigned long long h,
+                                       unsigned long long mask,
+                                       unsigned long long *bits) {
+  std::fill(bits, bits + FILTER_BLOCK_WORDS, 0ULL);
+  unsigned long long g = h * 0x9e3779b97f4a7c15ULL;
+  for (int i = 0; i < FILTER_HASHES; ++i) {
+    unsigned int bit = (g >> (i * 9)) & 511;
+    bits[bit >> 6] |= 1ULL << (bit & 63);
+  }
+  return ((h >> 32) | (h << 32)) & mask;
+}
+
+// Find the slot of an OD pair in an open addressing table by linear
+// probing, which is either the slot storing the pair or the first
+// empty slot.
+template<typename T>
+inline T *probe_slot(T *slots, unsigned long long mask,
+                     NodeIndex source, NodeIndex target) {
+  unsigned long long h = hash_od(source, target) & mask;
+  while (slots[h].source != UBODT::EMPTY_SLOT &&
+      (slots[h].source != source || slots[h].target != target)) {
+    h = (h + 1) & mask;
+  }
+  return slots + h;
+}
+
+// Claim an empty slot for an OD pair with compare and swap on the
+// source node, so that several threads can insert concurrently.
+template<typename T>
+inline T *claim_slot(T *slots, unsigned long long mask,
+                     NodeIndex source, NodeIndex target) {
+  unsigned long long h = hash_od(source, target) & mask;
+  while (!__sync_bool_compare_and_swap(
+      &slots[h].source, UBODT::EMPTY_SLOT, source)) {
+    h = (h + 1) & mask;
+  }
+  return slots + h;
+}
+
+// Parse an unsigned integer field ended by a semicolon and return the
+// position after the semicolon, or nullptr if the field is empty or has
+// another character than digits
+inline const char *parse_uint(const char *p, unsigned int *value) {
+  const char *start = p;
+  unsigned int v = 0;
+  while (*p >= '0' && *p <= '9') {
+    v = v * 10 + (*p - '0');
+    ++p;
+  }
+  if (p == start || *p != ';') return nullptr;
+  *value = v;
+  return p + 1;
+}
+
+// Parse a double and return the position after it, or p if the field is
+// empty or malformed. Plain decimals with at most 15 significant digits
+// are converted exactly with a single division, other forms fall back to
+// strtod on a copy of the field.
+inline const char *parse_double(const char *p, double *value) {
+  static const double POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char *start = p;
+  bool negative = (*p == '-');
+  if (negative) ++p;
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int decimals = 0;
+  while (*p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10 + (*p - '0');
+    ++digits;
+    ++p;
+  }
+  if (*p == '.') {
+    ++p;
+    while (*p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10 + (*p - '0');
+      ++digits;
+      ++decimals;
+      ++p;
+    }
+  }
+  if (digits > 15 || *p == 'e' || *p == 'E' || digits == 0) {
+    // strtod would skip a line end as whitespace and read the cost of the
+    // next row, so it only parses the field up to its end
+    char field[64];
+    size_t n = 0;
+    for (p = start; *p != ';' && *p != '\n' && *p != '\r' && *p != '\0';
+         ++p) {
+      if (n + 1 == sizeof(field)) return start;
+      field[n++] = *p;
+    }
+    field[n] = '\0';
+    char *stop;
+    *value = strtod(field, &stop);
+    return (n == 0 || stop != field + n) ? start : p;
+  }
+  double v = (double) mantissa / POW10[decimals];
+  *value = negative ? -v : v;
+  return p;
+}
+
+// Parse a row of UBODT CSV, return false if the row is malformed
+inline bool parse_row(const char *p, bool compact_file, Record *r) {
+  const char *stop;
+  if ((p = parse_uint(p, &r->source)) == nullptr) return false;
+  if ((p = parse_uint(p, &r->target)) == nullptr) return false;
+  if ((p = parse_uint(p, &r->first_n)) == nullptr) return false;
+  if (compact_file) {
+    r->prev_n = UBODT::EMPTY_SLOT;
+  } else if ((p = parse_uint(p, &r->prev_n)) == nullptr) {
+    return false;
+  }
+  if ((p = parse_uint(p, &r->next_e)) == nullptr) return false;
+  stop = parse_double(p, &r->cost);
+  r->next = nullptr;
+  return stop != p;
+}
+
+// Check if a row is read with the nodes allowed, nullptr for all nodes
+inline bool keep_row(const std::vector<char> *nodes, const Record &r) {
+  return nodes == nullptr ||
+      (r.source < nodes->size() && (*nodes)[r.source] &&
+       r.target < nodes->size() && (*nodes)[r.target]);
+}
+
+// Size of a row of a binary UBODT, whose fields are written by the boost
+// binary archive in native byte order without padding
+const long long BINARY_ROW_SIZE =
+    4 * sizeof(NodeIndex) + sizeof(EdgeIndex) + sizeof(double);
+
+// Decode a row of a binary UBODT
+inline void decode_binary_row(const char *p, Record *r) {
+  memcpy(&r->source, p, sizeof(NodeIndex));
+  memcpy(&r->target, p + 4, sizeof(NodeIndex));
+  memcpy(&r->first_n, p + 8, sizeof(NodeIndex));
+  memcpy(&r->prev_n, p + 12, sizeof(NodeIndex));
+  memcpy(&r->next_e, p + 16, sizeof(EdgeIndex));
+  memcpy(&r->cost, p + 20, sizeof(double));
+  r->next = nullptr;
+}
+
+// Get the header of a binary archive written by this version of boost,
+// which is followed by the rows of a binary UBODT
+const std::string &get_archive_header() {
+  static const std::string header = [] {
+    std::stringstream empty_archive;
+    {
+      boost::archive::binary_oarchive oa(empty_archive);
+    }
+    return empty_archive.str();
+  }();
+  return header;
+}
+
+// Scale the rows estimated by the share of the nodes allowed, as the
+// rows of a source are to the nodes close to it
+long estimate_kept_rows(long rows, const std::vector<char> *nodes) {
+  if (nodes == nullptr || nodes->empty()) return rows;
+  long allowed = std::count_if(nodes->begin(), nodes->end(),
+                               [](char c) { return c != 0; });
+  return (long) ((double) rows * allowed / nodes->size()) + 1;
+}
+
+// Read the ids of the nodes and edges of the network of a UBODT
+bool read_ids_file(const std::string &ids_file, std::vector<NodeID> *node_ids,
+                   std::vector<EdgeID> *edge_ids) {
+  SPDLOG_INFO("Read UBODT network ids from {}", ids_file);
+  FILE *stream = fopen(ids_file.c_str(), "rb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open UBODT network ids {}", ids_file);
+    return false;
+  }
+  IdsHeader header;
+  bool success = fread(&header, sizeof(header), 1, stream) == 1 &&
+      memcmp(header.magic, IDS_MAGIC, sizeof(IDS_MAGIC)) == 0 &&
+      header.version == UBODT::IDS_VERSION && header.num_nodes >= 0 &&
+      header.num_edges >= 0;
+  if (success) {
+    node_ids->resize(header.num_nodes);
+    edge_ids->resize(header.num_edges);
+    success = fread(node_ids->data(), sizeof(NodeID), node_ids->size(),
+                    stream) == node_ids->size() &&
+        fread(edge_ids->data(), sizeof(EdgeID), edge_ids->size(), stream) ==
+            edge_ids->size();
+  }
+  fclose(stream);
+  if (!success) {
+    SPDLOG_CRITICAL("Invalid UBODT network ids {}", ids_file);
+  }
+  return success;
+}
+
+// Allocate a table of empty slots and move the records of the old table
+template<typename T>
+T *resize_slots(T *old_slots, unsigned long long old_capacity,
+                unsigned long long capacity) {
+  T *new_slots = (T *) UTIL::allocate_large(sizeof(T) * capacity);
+  if (new_slots == nullptr) {
+    SPDLOG_CRITICAL("Failed to allocate {} slots for UBODT", capacity);
+    std::exit(EXIT_FAILURE);
+  }
+  for (unsigned long long i = 0; i < capacity; ++i) {
+    new_slots[i].source = UBODT::EMPTY_SLOT;
+  }
+  for (unsigned long long i = 0; i < old_capacity; ++i) {
+    if (old_slots[i].source != UBODT::EMPTY_SLOT) {
+      *probe_slot(new_slots, capacity - 1, old_slots[i].source,
+                  old_slots[i].target) = old_slots[i];
+    }
+  }
+  free(old_slots);
+  return new_slots;
+}
+
+// Allocate the hot and cold arrays of a split table with empty slots and
+// move the records of the old arrays, keeping each cold record at the
+// index of its hot record
+void resize_split_slots(HotRecord **hot, ColdRecord **cold,
+                        unsigned long long old_capacity,
+                        unsigned long long capacity) {
+  HotRecord *new_hot =
+      (HotRecord *) UTIL::allocate_large(sizeof(HotRecord) * capacity);
+  ColdRecord *new_cold =
+      (ColdRecord *) UTIL::allocate_large(sizeof(ColdRecord) * capacity);
+  if (new_hot == nullptr || new_cold == nullptr) {
+    SPDLOG_CRITICAL("Failed to allocate {} slots for UBODT", capacity);
+    std::exit(EXIT_FAILURE);
+  }
+  for (unsigned long long i = 0; i < capacity; ++i) {
+    new_hot[i].source = UBODT::EMPTY_SLOT;
+  }
+  for (unsigned long long i = 0; i < old_capacity; ++i) {
+    const HotRecord &h = (*hot)[i];
+    if (h.source != UBODT::EMPTY_SLOT) {
+      HotRecord *slot = probe_slot(new_hot, capacity - 1, h.source, h.target);
+      *slot = h;
+      new_cold[slot - new_hot] = (*cold)[i];
+    }
+  }
+  free(*hot);
+  free(*cold);
+  *hot = new_hot;
+  *cold = new_cold;
+}
+}
+
+/**
+ * Records of a source in a lazy UBODT
+ */
+struct UBODT::LazyGroup {
+  std::vector<Record> rows; // records sorted by target
+  std::vector<EdgeIndex> last_edges; // last edge of the path to each target
+  /**
+   * Find the record of a target
+   * @return index of the record or -1 if not found
+   */
+  long find(NodeIndex target) const {
+    auto iter = std::lower_bound(
+        rows.begin(), rows.end(), target,
+        [](const Record &r, NodeIndex t) { return r.target < t; });
+    if (iter == rows.end() || iter->target != target) return -1;
+    return iter - rows.begin();
+  }
+};
+
+/**
+ * Part of the cache of a lazy UBODT protected by its own mutex
+ */
+struct UBODT::LazyShard {
+  struct Entry {
+    std::shared_ptr<const LazyGroup> group;
+    bool referenced; // cleared when the clock hand passes the entry
+  };
+  std::mutex mutex;
+  std::unordered_map<NodeIndex, Entry> groups;
+  std::vector<NodeIndex> clock; // sources cached, visited by the hand
+  size_t hand = 0;
+  long rows = 0;
+  long hits = 0;
+  long misses = 0;
+  long evictions = 0;
+};
+
+/**
+ * Tiles of a tiled UBODT and the tables of the resident tiles
+ */
+struct UBODT::TileSet {
+  std::string filename; // tile index file
+  std::vector<unsigned int> node_tiles; // tile of each node
+  std::vector<long long> tile_rows; // number of rows of each tile
+  std::vector<std::shared_ptr<UBODT>> tables; // nullptr if not resident
+  std::vector<long> last_used; // time of the last query of each tile
+  std::vector<char> failed; // tile whose file failed to map
+  long clock = 0;
+  int max_tiles = 0;
+  int resident = 0;
+  long loads = 0;
+  long evictions = 0;
+  std::mutex mutex;
+  // Progressive load, set while some tiles are not loaded yet
+  std::atomic<bool> progressive{false};
+  std::vector<char> claimed; // tile loaded or being loaded
+  std::vector<char> demanded; // tile queried before being loaded
+  std::deque<unsigned int> demand; // tiles queried, loaded first
+  unsigned int next_tile = 0; // next tile loaded in order
+  long pending = 0; // tiles with rows not loaded yet
+  long searched = 0; // queries searched while their tile was loading
+  bool stopping = false;
+  std::condition_variable loaded;
+  std::vector<std::thread> loaders;
+  ~TileSet() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    for (std::thread &loader : loaders) loader.join();
+  }
+};
+
+const std::string UBODT::SHM_PREFIX = "shm:";
+
+UBODT::UBODT(long long buckets_arg, int multiplier_arg, long capacity_arg,
+             UBODTLayout layout_arg) :
+    buckets(find_bucket_number(buckets_arg)), multiplier(multiplier_arg),
+    layout(layout_arg),
+    slab_rows(capacity_arg > 0 ? capacity_arg : DEFAULT_SLAB_ROWS) {
   SPDLOG_TRACE("Intialization UBODT with buckets {} multiplier {}",
                buckets, multiplier);
-  hashtable = (Record **) malloc(sizeof(Record *) * buckets);
-  for (int i = 0; i < buckets; i++) {
-    hashtable[i] = nullptr;
+  if (layout == FLAT || layout == COMPACT || layout == SPLIT) {
+    unsigned long long capacity = 1024;
+    while (capacity * FLAT_LOAD_FACTOR < capacity_arg) capacity <<= 1;
+    rehash_flat(capacity);
+  } else {
+    hashtable = (Record **) UTIL::allocate_large(sizeof(Record *) * buckets);
+    if (hashtable == nullptr) {
+      SPDLOG_CRITICAL("Failed to allocate {} buckets for UBODT", buckets);
+      std::exit(EXIT_FAILURE);
+    }
+    for (long long i = 0; i < buckets; i++) {
+      hashtable[i] = nullptr;
+    }
+  }
+  SPDLOG_TRACE("Intialization UBODT finished");
+}
+
+UBODT::~UBODT() {
+  /* Clean hashtable */
+  SPDLOG_TRACE("Clean UBODT");
+  // Records are stored in slabs, which are released as a whole
+  for (Record *slab : slabs) {
+    free(slab);
+  }
+  // Destory hash table pointer
+  free(hashtable);
+  free(filter_words);
+  if (mapped_addr != nullptr) {
+    munmap(mapped_addr, mapped_size);
+  } else {
+    free(slots);
+    free(compact_slots);
+    free(hot_slots);
+    free(cold_slots);
+  }
+  SPDLOG_TRACE("Clean UBODT finished");
+}
+
+Record *UBODT::look_up(NodeIndex source, NodeIndex target) const {
+  Record *r = look_up_stored(source, target);
+  if (r == nullptr || r->source == source) return r;
+  // The record of the pair reversed is turned into the one of the pair,
+  // whose path starts with the edge to the last node of the reversed path
+  int e = graph->get_shortest_edge_index(source, r->prev_n);
+  if (e < 0) return nullptr;
+  static thread_local Record reversed;
+  reversed = {source, target, r->prev_n, r->first_n, (EdgeIndex) e, r->cost,
+              nullptr};
+  return &reversed;
+}
+
+Record *UBODT::look_up_stored(NodeIndex source, NodeIndex target) const {
+  if (layout == LAZY || tile_pending(source)) {
+    std::shared_ptr<const LazyGroup> group = lazy_group(source);
+    long i = group->find(target);
+    if (i < 0) return nullptr;
+    static thread_local Record r;
+    r = group->rows[i];
+    return &r;
+  }
+  if (layout == TILED) {
+    std::shared_ptr<UBODT> tile = tile_table(source);
+    Record *found = tile == nullptr ? nullptr : tile->look_up(source, target);
+    if (found == nullptr) return nullptr;
+    // The tile may be unmapped by another thread after the look up
+    static thread_local Record r;
+    r = *found;
+    return &r;
+  }
+  if (symmetric && source > target) std::swap(source, target);
+  if (!may_contain(source, target)) return nullptr;
+  if (layout == FLAT) {
+    Record *r = probe_slot(slots, slot_mask, source, target);
+    return r->source == EMPTY_SLOT ? nullptr : r;
+  } else if (layout == COMPACT) {
+    const CompactRecord *c =
+        probe_slot(compact_slots, slot_mask, source, target);
+    if (c->source == EMPTY_SLOT) return nullptr;
+    static thread_local Record r;
+    r = {c->source, c->target, c->first_n, EMPTY_SLOT, c->next_e, c->cost,
+         nullptr};
+    return &r;
+  } else if (layout == SPLIT) {
+    const HotRecord *h = probe_slot(hot_slots, slot_mask, source, target);
+    if (h->source == EMPTY_SLOT) return nullptr;
+    const ColdRecord &c = cold_slots[h - hot_slots];
+    static thread_local Record r;
+    r = {h->source, h->target, c.first_n, EMPTY_SLOT, c.next_e, h->cost,
+         nullptr};
+    return &r;
+  }
+  if (layout == CSR) return look_up_csr(source, target);
+  unsigned long long h = cal_bucket_index(source, target);
+  Record *r = hashtable[h];
+  while (r != nullptr) {
+    if (r->source == source && r->target == target) {
+      return r;
+    } else {
+      r = r->next;
+    }
+  }
+  return r;
+}
+
+bool UBODT::look_up_cost(NodeIndex source, NodeIndex target,
+                         double *cost) const {
+  count_probes(source, 1);
+  if (!look_up_any_cost(source, target, cost)) return false;
+  return !has_closures() || reroute_closed(source, target, cost);
+}
+
+bool UBODT::look_up_cost(NodeIndex source, NodeIndex target, int metric,
+                         double *cost) const {
+  if (metric == 0) return look_up_cost(source, target, cost);
+  if (metric < 0 || metric > num_metric_costs) return false;
+  count_probes(source, 1);
+  long i = find_row_index(source, target);
+  if (i < 0) return false;
+  double value = metric_costs[i * num_metric_costs + metric - 1];
+  if (std::isnan(value)) return false;
+  *cost = value;
+  return true;
+}
+
+bool UBODT::look_up_any_cost(NodeIndex source, NodeIndex target,
+                             double *cost) const {
+  if (chains != nullptr) {
+    ChainRoute route;
+    double dist = find_chain_route(source, target, &route);
+    if (dist >= 0) {
+      *cost = dist;
+      return true;
+    }
+  } else if (look_up_table_cost(source, target, cost)) {
+    return true;
+  }
+  if (long_range == nullptr) return false;
+  double dist = long_range->shortest_path(source, target, nullptr);
+  if (dist < 0 || dist > long_delta) return false;
+  *cost = dist;
+  return true;
+}
+
+bool UBODT::look_up_table_cost(NodeIndex source, NodeIndex target,
+                               double *cost) const {
+  if (layout == LAZY || tile_pending(source)) {
+    std::shared_ptr<const LazyGroup> group = lazy_group(source);
+    long i = group->find(target);
+    if (i < 0) return false;
+    *cost = group->rows[i].cost;
+    return true;
+  }
+  if (layout == TILED) {
+    std::shared_ptr<UBODT> tile = tile_table(source);
+    return tile != nullptr && tile->look_up_cost(source, target, cost);
+  }
+  if (layout == COMPACT) {
+    if (!may_contain(source, target)) return false;
+    const CompactRecord *c =
+        probe_slot(compact_slots, slot_mask, source, target);
+    if (c->source == EMPTY_SLOT) return false;
+    *cost = c->cost;
+    return true;
+  }
+  if (layout == SPLIT) {
+    // Only the hot slots are touched
+    if (!may_contain(source, target)) return false;
+    const HotRecord *h = probe_slot(hot_slots, slot_mask, source, target);
+    if (h->source == EMPTY_SLOT) return false;
+    *cost = h->cost;
+    return true;
+  }
+  Record *r = look_up_stored(source, target);
+  if (r == nullptr) return false;
+  *cost = r->cost;
+  return true;
+}
+
+Record *UBODT::look_up_csr(NodeIndex source, NodeIndex target) const {
+  if ((size_t) source + 1 >= csr_offsets.size()) return nullptr;
+  auto first = csr_rows.begin() + csr_offsets[source];
+  auto last = csr_rows.begin() + csr_offsets[source + 1];
+  auto iter = std::lower_bound(
+      first, last, target,
+      [](const Record &r, NodeIndex t) { return r.target < t; });
+  if (iter == last || iter->target != target) return nullptr;
+  return const_cast<Record *>(&(*iter));
+}
+
+void UBODT::look_up_many(NodeIndex source,
+                         const std::vector<NodeIndex> &targets,
+                         std::vector<double> *costs) const {
+  count_probes(source, targets.size());
+  auto pair_at = [source, &targets](size_t i, NodeIndex *s, NodeIndex *t) {
+    *s = source;
+    *t = targets[i];
+  };
+  if (chains != nullptr) {
+    costs->resize(targets.size());
+    look_up_chain_costs(targets.size(), pair_at, costs->data());
+  } else {
+    look_up_table_many(source, targets, costs);
+    if (long_range != nullptr) fill_long_range({source}, targets, costs);
+  }
+  if (has_closures()) {
+    reroute_closed_costs(targets.size(), pair_at, costs->data());
+  }
+}
+
+void UBODT::look_up_table_many(NodeIndex source,
+                               const std::vector<NodeIndex> &targets,
+                               std::vector<double> *costs) const {
+  costs->resize(targets.size());
+  if (layout == LAZY || tile_pending(source)) {
+    // The group is fetched once for all the targets
+    std::shared_ptr<const LazyGroup> group = lazy_group(source);
+    for (size_t i = 0; i < targets.size(); ++i) {
+      long j = group->find(targets[i]);
+      (*costs)[i] = j < 0 ? -1 : group->rows[j].cost;
+    }
+    return;
+  }
+  if (layout == TILED) {
+    std::shared_ptr<UBODT> tile = tile_table(source);
+    if (tile == nullptr) {
+      std::fill(costs->begin(), costs->end(), -1);
+    } else {
+      tile->look_up_many(source, targets, costs);
+    }
+    return;
+  }
+  if (layout != CSR || symmetric) {
+    for (size_t i = 0; i < targets.size(); ++i) {
+      if (!look_up_table_cost(source, targets[i], &(*costs)[i])) {
+        (*costs)[i] = -1;
+      }
+    }
+    return;
+  }
+  if ((size_t) source + 1 >= csr_offsets.size()) {
+    std::fill(costs->begin(), costs->end(), -1);
+    return;
+  }
+  auto first = csr_rows.begin() + csr_offsets[source];
+  auto last = csr_rows.begin() + csr_offsets[source + 1];
+  for (size_t i = 0; i < targets.size(); ++i) {
+    NodeIndex target = targets[i];
+    if (!may_contain(source, target)) {
+      (*costs)[i] = -1;
+      continue;
+    }
+    auto iter = std::lower_bound(
+        first, last, target,
+        [](const Record &r, NodeIndex t) { return r.target < t; });
+    (*costs)[i] = (iter == last || iter->target != target) ? -1 : iter->cost;
+  }
+}
+
+template<typename PairAt>
+void UBODT::look_up_grouped(size_t total, PairAt pair_at,
+                            double *costs) const {
+  unsigned long long hashes[PROBE_GROUP];
+  for (size_t first = 0; first < total; first += PROBE_GROUP) {
+    int count = (int) std::min<size_t>(PROBE_GROUP, total - first);
+    // Issue the loads of the whole group before waiting on any of them
+    for (int k = 0; k < count; ++k) {
+      NodeIndex source, target;
+      pair_at(first + k, &source, &target);
+      if (symmetric && source > target) std::swap(source, target);
+      unsigned long long h = hash_od(source, target);
+      hashes[k] = h;
+      prefetch_slot(h);
+    }
+    if (layout == CHAINED) {
+      // The head record of a chain is another dependent miss
+      for (int k = 0; k < count; ++k) {
+        const Record *r = hashtable[hashes[k] & (buckets - 1)];
+        if (r != nullptr) __builtin_prefetch(r);
+      }
+    }
+    for (int k = 0; k < count; ++k) {
+      size_t i = first + k;
+      NodeIndex source, target;
+      pair_at(i, &source, &target);
+      if (symmetric && source > target) std::swap(source, target);
+      double *cost = costs + i;
+      if (!may_contain(source, target)) {
+        *cost = -1;
+      } else if (layout == FLAT) {
+        const Record *r = probe_slot(slots, slot_mask, source, target);
+        *cost = r->source == EMPTY_SLOT ? -1 : r->cost;
+      } else if (layout == COMPACT) {
+        const CompactRecord *c =
+            probe_slot(compact_slots, slot_mask, source, target);
+        *cost = c->source == EMPTY_SLOT ? -1 : c->cost;
+      } else if (layout == SPLIT) {
+        const HotRecord *h =
+            probe_slot(hot_slots, slot_mask, source, target);
+        *cost = h->source == EMPTY_SLOT ? -1 : h->cost;
+      } else {
+        const Record *r = hashtable[hashes[k] & (buckets - 1)];
+        while (r != nullptr &&
+            (r->source != source || r->target != target)) {
+          r = r->next;
+        }
+        *cost = r == nullptr ? -1 : r->cost;
+      }
+    }
+  }
+}
+
+template<typename PairAt>
+void UBODT::look_up_chain_costs(size_t total, PairAt pair_at,
+                                double *costs) const {
+  for (size_t i = 0; i < total; ++i) {
+    NodeIndex source, target;
+    pair_at(i, &source, &target);
+    ChainRoute route;
+    costs[i] = find_chain_route(source, target, &route);
+    if (costs[i] >= 0) continue;
+    costs[i] = -1;
+    if (long_range == nullptr) continue;
+    double dist = long_range->shortest_path(source, target, nullptr);
+    if (dist >= 0 && dist <= long_delta) costs[i] = dist;
+  }
+}
+
+double UBODT::find_chain_route(NodeIndex source, NodeIndex target,
+                               ChainRoute *route) const {
+  if (source == target) return -1;
+  double best = -1;
+  ChainPosition from, to;
+  double direct = chains->find_direct(source, target, &from, &to);
+  if (direct >= 0) {
+    best = direct;
+    route->direct = true;
+    route->exit = {source, 0, from.chain, from.edge};
+    route->entry = {target, 0, to.chain, to.edge};
+  }
+  // A node inside a chain leaves it at up to two junctions and is
+  // reached from up to two junctions
+  ChainEnd exits[2], entries[2];
+  int num_exits = chains->get_exits(source, exits);
+  int num_entries = chains->get_entries(target, entries);
+  for (int i = 0; i < num_exits; ++i) {
+    for (int j = 0; j < num_entries; ++j) {
+      double cost = 0;
+      if (exits[i].junction != entries[j].junction &&
+          !look_up_table_cost(exits[i].junction, entries[j].junction,
+                              &cost)) {
+        continue;
+      }
+      cost += exits[i].cost + entries[j].cost;
+      if (best < 0 || cost < best) {
+        best = cost;
+        route->direct = false;
+        route->exit = exits[i];
+        route->entry = entries[j];
+      }
+    }
+  }
+  return best;
+}
+
+void UBODT::look_up_chain_path(NodeIndex source, NodeIndex target,
+                               std::vector<EdgeIndex> *edges) const {
+  edges->clear();
+  ChainRoute route;
+  if (find_chain_route(source, target, &route) < 0) return;
+  if (route.direct) {
+    chains->append_edges(route.exit.chain, route.exit.edge,
+                         route.entry.edge, edges);
+    return;
+  }
+  if (route.exit.chain >= 0) {
+    chains->append_edges(route.exit.chain, route.exit.edge, -1, edges);
+  }
+  if (route.exit.junction != route.entry.junction) {
+    // The edges of the records are chains
+    static thread_local std::vector<EdgeIndex> arcs;
+    look_up_table_path(route.exit.junction, route.entry.junction, &arcs);
+    for (EdgeIndex chain : arcs) chains->append_edges(chain, 0, -1, edges);
+  }
+  if (route.entry.chain >= 0) {
+    chains->append_edges(route.entry.chain, 0, route.entry.edge, edges);
+  }
+}
+
+void UBODT::look_up_batch(const std::vector<NodeIndex> &sources,
+                          const std::vector<NodeIndex> &targets,
+                          std::vector<double> *costs) const {
+  size_t n = targets.size();
+  costs->resize(sources.size() * n);
+  if (!probe_counts.empty()) {
+    for (NodeIndex source : sources) count_probes(source, n);
+  }
+  auto pair_at = [&sources, &targets, n](size_t i, NodeIndex *source,
+                                         NodeIndex *target) {
+    *source = sources[i / n];
+    *target = targets[i % n];
+  };
+  if (chains != nullptr) {
+    look_up_chain_costs(costs->size(), pair_at, costs->data());
+  } else if (layout != CHAINED && layout != FLAT && layout != COMPACT &&
+             layout != SPLIT) {
+    // The other layouts fetch the rows of a source together
+    std::vector<double> row;
+    for (size_t i = 0; i < sources.size(); ++i) {
+      look_up_table_many(sources[i], targets, &row);
+      std::copy(row.begin(), row.end(), costs->begin() + i * n);
+    }
+    if (long_range != nullptr) fill_long_range(sources, targets, costs);
+  } else {
+    look_up_grouped(costs->size(), pair_at, costs->data());
+    if (long_range != nullptr) fill_long_range(sources, targets, costs);
+  }
+  if (has_closures()) {
+    reroute_closed_costs(costs->size(), pair_at, costs->data());
+  }
+}
+
+void UBODT::look_up_pairs(const std::vector<NodeIndex> &sources,
+                          const std::vector<NodeIndex> &targets,
+                          std::vector<double> *costs) const {
+  size_t n = sources.size();
+  costs->resize(n);
+  if (!probe_counts.empty()) {
+    for (NodeIndex source : sources) count_probes(source, 1);
+  }
+  auto pair_at = [&sources, &targets](size_t i, NodeIndex *source,
+                                      NodeIndex *target) {
+    *source = sources[i];
+    *target = targets[i];
+  };
+  if (chains != nullptr) {
+    look_up_chain_costs(n, pair_at, costs->data());
+  } else {
+    if (layout != CHAINED && layout != FLAT && layout != COMPACT &&
+        layout != SPLIT) {
+      for (size_t i = 0; i < n; ++i) {
+        if (!look_up_table_cost(sources[i], targets[i], &(*costs)[i])) {
+          (*costs)[i] = -1;
+        }
+      }
+    } else {
+      look_up_grouped(n, pair_at, costs->data());
+    }
+    for (size_t i = 0; long_range != nullptr && i < n; ++i) {
+      if ((*costs)[i] >= 0) continue;
+      double dist =
+          long_range->shortest_path(sources[i], targets[i], nullptr);
+      if (dist >= 0 && dist <= long_delta) (*costs)[i] = dist;
+    }
+  }
+  if (has_closures()) reroute_closed_costs(n, pair_at, costs->data());
+}
+
+void UBODT::prefetch_batch(const std::vector<NodeIndex> &sources,
+                           const std::vector<NodeIndex> &targets) const {
+  if ((layout != CHAINED && layout != FLAT && layout != COMPACT &&
+      layout != SPLIT) || chains != nullptr) {
+    return;
+  }
+  for (NodeIndex source : sources) {
+    for (NodeIndex target : targets) {
+      if (symmetric && source > target) {
+        prefetch_slot(hash_od(target, source));
+      } else {
+        prefetch_slot(hash_od(source, target));
+      }
+    }
+  }
+}
+
+void UBODT::prefetch_slot(unsigned long long h) const {
+  if (filter_words != nullptr) {
+    unsigned long long bits[FILTER_BLOCK_WORDS];
+    __builtin_prefetch(filter_words + FILTER_BLOCK_WORDS *
+        filter_block(h, filter_mask, bits));
+  }
+  if (layout == FLAT) {
+    __builtin_prefetch(slots + (h & slot_mask));
+  } else if (layout == COMPACT) {
+    __builtin_prefetch(compact_slots + (h & slot_mask));
+  } else if (layout == SPLIT) {
+    __builtin_prefetch(hot_slots + (h & slot_mask));
+  } else {
+    __builtin_prefetch(hashtable + (h & (buckets - 1)));
+  }
+}
+
+void UBODT::fill_long_range(const std::vector<NodeIndex> &sources,
+                            const std::vector<NodeIndex> &targets,
+                            std::vector<double> *costs) const {
+  size_t n = targets.size();
+  // Only the sources and targets of a pair missing are searched
+  std::vector<NodeIndex> miss_sources, miss_targets;
+  std::vector<size_t> rows;
+  std::vector<long> columns(n, -1);
+  for (size_t i = 0; i < sources.size(); ++i) {
+    bool missing = false;
+    for (size_t j = 0; j < n; ++j) {
+      if ((*costs)[i * n + j] >= 0) continue;
+      missing = true;
+      if (columns[j] < 0) {
+        columns[j] = miss_targets.size();
+        miss_targets.push_back(targets[j]);
+      }
+    }
+    if (missing) {
+      rows.push_back(i);
+      miss_sources.push_back(sources[i]);
+    }
+  }
+  if (rows.empty()) return;
+  std::vector<std::vector<double>> dists =
+      long_range->many_to_many(miss_sources, miss_targets, long_delta);
+  for (size_t k = 0; k < rows.size(); ++k) {
+    double *row = costs->data() + rows[k] * n;
+    for (size_t j = 0; j < n; ++j) {
+      if (row[j] >= 0) continue;
+      double dist = dists[k][columns[j]];
+      if (dist <= long_delta) row[j] = dist;
+    }
+  }
+}
+
+bool UBODT::look_up_next(NodeIndex source, NodeIndex target,
+                         NodeIndex *first_n, EdgeIndex *next_e) const {
+  count_probes(source, 1);
+  if (layout == COMPACT) {
+    if (!may_contain(source, target)) return false;
+    const CompactRecord *c =
+        probe_slot(compact_slots, slot_mask, source, target);
+    if (c->source == EMPTY_SLOT) return false;
+    *first_n = c->first_n;
+    *next_e = c->next_e;
+    return true;
+  }
+  if (layout == SPLIT) {
+    if (!may_contain(source, target)) return false;
+    const HotRecord *h = probe_slot(hot_slots, slot_mask, source, target);
+    if (h->source == EMPTY_SLOT) return false;
+    *first_n = cold_slots[h - hot_slots].first_n;
+    *next_e = cold_slots[h - hot_slots].next_e;
+    return true;
+  }
+  Record *r = look_up_stored(source, target);
+  if (r == nullptr) return false;
+  if (r->source != source) {
+    // The record of a symmetric UBODT is stored from the target, whose
+    // path is walked back through the edge to its last node
+    int e = graph->get_shortest_edge_index(source, r->prev_n);
+    if (e < 0) return false;
+    *first_n = r->prev_n;
+    *next_e = e;
+    return true;
+  }
+  *first_n = r->first_n;
+  *next_e = r->next_e;
+  return true;
+}
+
+long UBODT::find_row_index(NodeIndex source, NodeIndex target) const {
+  if (layout == FLAT) {
+    const Record *r = probe_slot(slots, slot_mask, source, target);
+    return r->source == EMPTY_SLOT ? -1 : r - slots;
+  }
+  const Record *r = look_up_csr(source, target);
+  return r == nullptr ? -1 : r - csr_rows.data();
+}
+
+bool UBODT::unroll_paths() {
+  long n;
+  if (layout == FLAT) {
+    n = slot_mask + 1;
+  } else if (layout == CSR) {
+    n = csr_rows.size();
+  } else {
+    SPDLOG_WARN("Path unrolling is only supported for flat and csr layouts");
+    return false;
+  }
+  if (symmetric) {
+    SPDLOG_WARN("Path unrolling is not supported for a symmetric UBODT");
+    return false;
+  }
+  SPDLOG_INFO("Unroll paths of UBODT rows {}", num_rows);
+  path_offsets.clear();
+  path_edges.clear();
+  const Record *rows = (layout == FLAT) ? slots : csr_rows.data();
+  // Count the edges of each path first to find its place in the pool
+  std::vector<long> offsets(n + 1, 0);
+#pragma omp parallel for schedule(dynamic, 4096)
+  for (long i = 0; i < n; ++i) {
+    if (rows[i].source != EMPTY_SLOT) {
+      offsets[i + 1] = look_sp_path(rows[i].source, rows[i].target).size();
+    }
+  }
+  for (long i = 0; i < n; ++i) offsets[i + 1] += offsets[i];
+  std::vector<EdgeIndex> edges(offsets[n]);
+#pragma omp parallel for schedule(dynamic, 4096)
+  for (long i = 0; i < n; ++i) {
+    if (rows[i].source != EMPTY_SLOT) {
+      std::vector<EdgeIndex> path =
+          look_sp_path(rows[i].source, rows[i].target);
+      std::copy(path.begin(), path.end(), edges.begin() + offsets[i]);
+    }
+  }
+  path_offsets.swap(offsets);
+  path_edges.swap(edges);
+  SPDLOG_INFO("Unroll paths done with edges {}", path_edges.size());
+  return true;
+}
+
+bool UBODT::build_metric_costs(const Network &network) {
+  long n;
+  if (layout == FLAT) {
+    n = slot_mask + 1;
+  } else if (layout == CSR) {
+    n = csr_rows.size();
+  } else {
+    SPDLOG_WARN("Metric costs are only supported for flat and csr layouts");
+    return false;
+  }
+  if (symmetric || chains != nullptr) {
+    SPDLOG_WARN("Metric costs are not supported for a symmetric UBODT "
+                "or a UBODT of chains");
+    return false;
+  }
+  int m = network.get_cost_names().size();
+  if (m == 0) {
+    SPDLOG_WARN("Network has no cost column");
+    return false;
+  }
+  SPDLOG_INFO("Build metric costs of UBODT rows {} metrics {}", num_rows, m);
+  const Record *rows = (layout == FLAT) ? slots : csr_rows.data();
+  std::vector<double> costs(n * m, std::numeric_limits<double>::quiet_NaN());
+  std::vector<char> done(n, 0);
+  std::vector<long> walk;
+  std::vector<double> tail(m);
+  for (long i = 0; i < n; ++i) {
+    if (rows[i].source == EMPTY_SLOT || done[i]) continue;
+    // Walk along the path to the target or to a record resolved, then
+    // add the edges back to the first record of the walk
+    walk.clear();
+    long j = i;
+    std::fill(tail.begin(), tail.end(), 0.0);
+    while (true) {
+      walk.push_back(j);
+      const Record &r = rows[j];
+      if (r.first_n == r.target) break;
+      long k = find_row_index(r.first_n, r.target);
+      if (k < 0) {
+        // The path can not be walked, whose costs are left NaN
+        std::fill(tail.begin(), tail.end(),
+                  std::numeric_limits<double>::quiet_NaN());
+        break;
+      }
+      if (done[k]) {
+        std::copy(costs.begin() + k * m, costs.begin() + (k + 1) * m,
+                  tail.begin());
+        break;
+      }
+      j = k;
+    }
+    for (auto iter = walk.rbegin(); iter != walk.rend(); ++iter) {
+      for (int c = 0; c < m; ++c) {
+        tail[c] += network.get_edge_cost(c + 1, rows[*iter].next_e);
+        costs[*iter * m + c] = tail[c];
+      }
+      done[*iter] = 1;
+    }
+  }
+  metric_costs.swap(costs);
+  num_metric_costs = m;
+  SPDLOG_INFO("Build metric costs done");
+  return true;
+}
+
+int UBODT::get_metric_count() const {
+  return num_metric_costs + 1;
+}
+
+bool UBODT::build_miss_filter(int bits_per_row) {
+  if (layout == LAZY || layout == TILED) {
+    SPDLOG_WARN("Miss filter is not supported for lazy and tiled layouts");
+    return false;
+  }
+  if (bits_per_row <= 0) {
+    SPDLOG_CRITICAL("Invalid miss filter bits per row {}", bits_per_row);
+    return false;
+  }
+  const long long block_bits = FILTER_BLOCK_WORDS * 64;
+  unsigned long long num_blocks = 1;
+  while ((long long) num_blocks * block_bits <
+      (long long) num_rows * bits_per_row) {
+    num_blocks <<= 1;
+  }
+  free(filter_words);
+  filter_words = nullptr;
+  void *words = nullptr;
+  size_t size = sizeof(unsigned long long) * FILTER_BLOCK_WORDS * num_blocks;
+  if (posix_memalign(&words, 64, size) != 0) {
+    SPDLOG_CRITICAL("Failed to allocate miss filter of {} blocks",
+                    num_blocks);
+    return false;
+  }
+  std::memset(words, 0, size);
+  unsigned long long *blocks = (unsigned long long *) words;
+  unsigned long long mask = num_blocks - 1;
+  for_each_record([blocks, mask](const Record &r) {
+    unsigned long long bits[FILTER_BLOCK_WORDS];
+    unsigned long long *block = blocks + FILTER_BLOCK_WORDS *
+        filter_block(hash_od(r.source, r.target), mask, bits);
+    for (int i = 0; i < FILTER_BLOCK_WORDS; ++i) block[i] |= bits[i];
+  });
+  filter_words = blocks;
+  filter_mask = mask;
+  SPDLOG_INFO("Build UBODT miss filter of {} blocks ({} MB)", num_blocks,
+              size / (1024 * 1024));
+  return true;
+}
+
+bool UBODT::may_contain(NodeIndex source, NodeIndex target) const {
+  if (filter_words == nullptr) return true;
+  unsigned long long bits[FILTER_BLOCK_WORDS];
+  const unsigned long long *block = filter_words + FILTER_BLOCK_WORDS *
+      filter_block(hash_od(source, target), filter_mask, bits);
+  for (int i = 0; i < FILTER_BLOCK_WORDS; ++i) {
+    if ((block[i] & bits[i]) != bits[i]) return false;
+  }
+  return true;
+}
+
+std::vector<EdgeIndex> UBODT::look_sp_path(NodeIndex source,
+                                           NodeIndex target) const {
+  std::vector<EdgeIndex> edges;
+  look_sp_path(source, target, &edges);
+  return edges;
+}
+
+PYTHON::PyPathArrays UBODT::look_sp_paths(
+    const unsigned int *sources, int num_sources,
+    const unsigned int *targets, int num_targets, int num_threads) const {
+  PYTHON::check_od_pairs(sources, num_sources, targets, num_targets);
+  std::vector<double> distances(num_sources);
+  std::vector<std::vector<EdgeIndex>> paths(num_sources);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  #pragma omp parallel for schedule(dynamic, 256) num_threads(num_threads)
+  for (int i = 0; i < num_sources; ++i) {
+    double cost = 0;
+    if (sources[i] != targets[i] &&
+        !look_up_cost(sources[i], targets[i], &cost)) {
+      distances[i] = std::numeric_limits<double>::infinity();
+      continue;
+    }
+    distances[i] = cost;
+    look_sp_path(sources[i], targets[i], &paths[i]);
+  }
+  return PYTHON::to_py_paths(std::move(distances), paths);
+}
+
+void UBODT::look_sp_path(NodeIndex source, NodeIndex target,
+                         std::vector<EdgeIndex> *edges) const {
+  look_up_any_path(source, target, edges);
+  if (!has_closures() || !closures->crosses(*edges)) return;
+  if (closures->search(source, target, get_delta(), edges) < 0) {
+    edges->clear();
+  }
+}
+
+void UBODT::look_up_any_path(NodeIndex source, NodeIndex target,
+                             std::vector<EdgeIndex> *edges) const {
+  if (chains != nullptr) {
+    look_up_chain_path(source, target, edges);
+  } else {
+    look_up_table_path(source, target, edges);
+  }
+  if (!edges->empty() || source == target || long_range == nullptr) return;
+  double dist = long_range->shortest_path(source, target, edges);
+  if (dist < 0 || dist > long_delta) edges->clear();
+}
+
+void UBODT::look_up_table_path(NodeIndex source, NodeIndex target,
+                               std::vector<EdgeIndex> *edges) const {
+  edges->clear();
+  if (source == target) return;
+  if (!path_offsets.empty()) {
+    count_probes(source, 1);
+    long i = find_row_index(source, target);
+    if (i < 0) return;
+    edges->assign(path_edges.begin() + path_offsets[i],
+                  path_edges.begin() + path_offsets[i + 1]);
+    return;
+  }
+  if (layout == LAZY) {
+    // Walk back from the target within the group of the source, so
+    // that no other source is calculated.
+    std::shared_ptr<const LazyGroup> group = lazy_group(source);
+    NodeIndex v = target;
+    while (v != source) {
+      long i = group->find(v);
+      if (i < 0) {
+        edges->clear();
+        return;
+      }
+      edges->push_back(group->last_edges[i]);
+      v = group->rows[i].prev_n;
+    }
+    std::reverse(edges->begin(), edges->end());
+    return;
+  }
+  NodeIndex first_n;
+  EdgeIndex next_e;
+  // No transition exist from source to target
+  if (!look_up_next(source, target, &first_n, &next_e)) return;
+  while (first_n != target) {
+    edges->push_back(next_e);
+    // A partial table may miss the row of an intermediate node
+    if (!look_up_next(first_n, target, &first_n, &next_e)) {
+      edges->clear();
+      return;
+    }
+  }
+  edges->push_back(next_e);
+}
+
+C_Path UBODT::construct_complete_path(const TGOpath &path,
+                                      const std::vector<Edge> &edges,
+                                      std::vector<int> *indices,
+                                      std::vector<EdgeIndex> *index_path)
+    const {
+  C_Path cpath;
+  if (!indices->empty()) indices->clear();
+  if (index_path != nullptr) index_path->clear();
+  if (path.empty()) return cpath;
+  int N = path.size();
+  cpath.push_back(path[0]->c->edge->id);
+  if (index_path != nullptr) index_path->push_back(path[0]->c->edge->index);
+  int current_idx = 0;
+  indices->push_back(current_idx);
+  for (int i = 0; i < N - 1; ++i) {
+    const Candidate *a = path[i]->c;
+    const Candidate *b = path[i + 1]->c;
+    if ((a->edge->id != b->edge->id) || (a->offset > b->offset)) {
+      // segs stores edge index, in a buffer kept by the thread
+      static thread_local std::vector<EdgeIndex> segs;
+      look_sp_path(a->edge->target, b->edge->source, &segs);
+      // No transition exist in UBODT
+      if (segs.empty() && a->edge->target != b->edge->source) {
+        indices->clear();
+        if (index_path != nullptr) index_path->clear();
+        return C_Path();
+      }
+      for (int e:segs) {
+        cpath.push_back(edges[e].id);
+        ++current_idx;
+      }
+      cpath.push_back(b->edge->id);
+      if (index_path != nullptr) {
+        index_path->insert(index_path->end(), segs.begin(), segs.end());
+        index_path->push_back(b->edge->index);
+      }
+      ++current_idx;
+      indices->push_back(current_idx);
+    } else {
+      indices->push_back(current_idx);
+    }
+  }
+  return cpath;
+}
+
+double UBODT::get_delta() const {
+  return long_range == nullptr ? delta : long_delta;
+}
+
+bool UBODT::set_long_range(
+    std::shared_ptr<const ContractionHierarchy> hierarchy,
+    double long_delta_arg) {
+  if (long_delta_arg <= delta) {
+    SPDLOG_CRITICAL("Long range delta {} is not larger than UBODT delta {}",
+                    long_delta_arg, delta);
+    return false;
+  }
+  if (long_delta_arg > hierarchy->get_delta()) {
+    SPDLOG_CRITICAL("Long range delta {} is larger than hierarchy delta {}",
+                    long_delta_arg, hierarchy->get_delta());
+    return false;
+  }
+  long_range = hierarchy;
+  long_delta = long_delta_arg;
+  SPDLOG_INFO("UBODT long range tier up to {} over records up to {}",
+              long_delta, delta);
+  return true;
+}
+
+bool UBODT::has_long_range() const {
+  return long_range != nullptr;
+}
+
+void UBODT::set_closures(std::shared_ptr<const EdgeClosures> closures_arg) {
+  closures = closures_arg;
+}
+
+bool UBODT::reroute_closed(NodeIndex source, NodeIndex target,
+                           double *cost) const {
+  static thread_local std::vector<EdgeIndex> path;
+  look_up_any_path(source, target, &path);
+  if (!closures->crosses(path)) return true;
+  // The path skipping the closed edges is not shorter, so a pair missing
+  // in the records is not searched
+  double dist = closures->search(source, target, get_delta(), nullptr);
+  if (dist < 0) return false;
+  *cost = dist;
+  return true;
+}
+
+template<typename PairAt>
+void UBODT::reroute_closed_costs(size_t total, PairAt pair_at,
+                                 double *costs) const {
+  for (size_t i = 0; i < total; ++i) {
+    if (costs[i] < 0) continue;
+    NodeIndex source, target;
+    pair_at(i, &source, &target);
+    if (!reroute_closed(source, target, costs + i)) costs[i] = -1;
+  }
+}
+
+bool UBODT::set_symmetric(const NetworkGraph &graph_arg) {
+  if (layout != CHAINED && layout != FLAT && layout != CSR) {
+    SPDLOG_CRITICAL("Symmetric UBODT is only supported for chained, flat "
+                    "and csr layouts");
+    return false;
+  }
+  if (!path_offsets.empty()) {
+    SPDLOG_CRITICAL("Symmetric UBODT does not support unrolled paths");
+    return false;
+  }
+  if (num_metric_costs > 0) {
+    SPDLOG_CRITICAL("Symmetric UBODT does not support metric costs");
+    return false;
+  }
+  if (!graph_arg.is_symmetric()) {
+    SPDLOG_CRITICAL("Symmetric UBODT requires the edges of the network "
+                    "in both directions with the same length");
+    return false;
+  }
+  if (chains != nullptr) {
+    SPDLOG_CRITICAL("Symmetric UBODT does not support chains");
+    return false;
+  }
+  graph = &graph_arg;
+  symmetric = true;
+  return true;
+}
+
+bool UBODT::is_symmetric() const {
+  return symmetric;
+}
+
+bool UBODT::set_chains(std::shared_ptr<const ChainGraph> chains_arg) {
+  if (layout == LAZY) {
+    SPDLOG_CRITICAL("Lazy UBODT does not support chains");
+    return false;
+  }
+  if (symmetric) {
+    SPDLOG_CRITICAL("Symmetric UBODT does not support chains");
+    return false;
+  }
+  if (num_metric_costs > 0) {
+    SPDLOG_CRITICAL("UBODT of chains does not support metric costs");
+    return false;
+  }
+  chains = chains_arg;
+  SPDLOG_INFO("UBODT records between {} junctions of {} nodes",
+              chains->get_num_junctions(), chains->get_num_vertices());
+  return true;
+}
+
+bool UBODT::has_chains() const {
+  return chains != nullptr;
+}
+
+long long UBODT::get_num_buckets() const {
+  return buckets;
+}
+
+long UBODT::get_num_rows() const {
+  if (layout == LAZY) {
+    long rows = 0;
+    for (const auto &shard : lazy_shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      rows += shard->rows;
+    }
+    return rows;
+  }
+  return num_rows;
+}
+
+UBODTLayout UBODT::get_layout() const {
+  return layout;
+}
+
+void UBODT::enable_probe_counts(int num_nodes) {
+  probe_counts.assign(num_nodes > 0 ? num_nodes : 0, 0);
+}
+
+const std::vector<long long> &UBODT::get_probe_counts() const {
+  return probe_counts;
+}
+
+std::shared_ptr<UBODT> UBODT::reorder_by_probes(
+    const std::vector<long long> &counts) const {
+  if (layout != CHAINED && layout != FLAT && layout != COMPACT &&
+      layout != SPLIT) {
+    SPDLOG_CRITICAL("Reordering is only supported for chained, flat, "
+                    "compact and split layouts");
+    return nullptr;
+  }
+  std::vector<Record> rows;
+  rows.reserve(num_rows);
+  for_each_record([&rows](const Record &r) { rows.push_back(r); });
+  auto probes = [&counts](NodeIndex source) {
+    return source < counts.size() ? counts[source] : 0;
+  };
+  std::sort(rows.begin(), rows.end(),
+            [&probes](const Record &a, const Record &b) {
+              long long pa = probes(a.source), pb = probes(b.source);
+              if (pa != pb) return pa > pb;
+              if (a.source != b.source) return a.source < b.source;
+              return a.target < b.target;
+            });
+  long n = rows.size();
+  std::shared_ptr<UBODT> table =
+      std::make_shared<UBODT>(buckets, multiplier, n, layout);
+  if (layout == CHAINED) {
+    Record *block = table->allocate_block(n);
+    std::copy(rows.begin(), rows.end(), block);
+    // A record is linked at the head of its chain, so the coldest
+    // records are linked first
+    for (long i = n - 1; i >= 0; --i) table->insert(block + i);
+  } else {
+    // The hottest records are inserted first into their home slots,
+    // the colder ones probe past them
+    for (const Record &r : rows) table->insert(r);
+  }
+  table->delta = delta;
+  SPDLOG_INFO("Reorder UBODT rows {} by probes", n);
+  return table;
+}
+
+bool UBODT::write_probe_counts(const std::vector<long long> &counts,
+                               const std::string &filename) {
+  std::ofstream ofs(filename);
+  if (!ofs) {
+    SPDLOG_CRITICAL("Cannot write probe counts {}", filename);
+    return false;
+  }
+  ofs << "source;probes\n";
+  for (size_t i = 0; i < counts.size(); ++i) {
+    if (counts[i] > 0) ofs << i << ";" << counts[i] << "\n";
+  }
+  return ofs.good();
+}
+
+bool UBODT::read_probe_counts(const std::string &filename,
+                              std::vector<long long> *counts) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    SPDLOG_CRITICAL("Cannot read probe counts {}", filename);
+    return false;
+  }
+  counts->clear();
+  std::string line;
+  std::getline(ifs, line);
+  while (std::getline(ifs, line)) {
+    if (line.empty()) continue;
+    unsigned long long source;
+    long long probes;
+    if (sscanf(line.c_str(), "%llu;%lld", &source, &probes) != 2 ||
+        source >= EMPTY_SLOT) {
+      SPDLOG_CRITICAL("Malformed probe counts line {}", line);
+      return false;
+    }
+    if (source >= counts->size()) counts->resize(source + 1, 0);
+    (*counts)[source] = probes;
+  }
+  return true;
+}
+
+unsigned long long UBODT::cal_bucket_index(NodeIndex source,
+                                           NodeIndex target) const {
+  return hash_od(source, target) & (buckets - 1);
+}
+
+
+Record *UBODT::allocate_record() {
+  if (slabs.empty() || slab_used == slab_rows) {
+    // The first slab is sized from the capacity, later ones are used
+    // only when the capacity is underestimated.
+    if (!slabs.empty()) slab_rows = DEFAULT_SLAB_ROWS;
+    Record *slab =
+        (Record *) UTIL::allocate_large(sizeof(Record) * slab_rows);
+    if (slab == nullptr) {
+      SPDLOG_CRITICAL("Failed to allocate {} records for UBODT", slab_rows);
+      std::exit(EXIT_FAILURE);
+    }
+    SPDLOG_TRACE("Allocate slab of {} records", slab_rows);
+    slabs.push_back(slab);
+    slab_capacity += slab_rows;
+    slab_used = 0;
+  }
+  return slabs.back() + (slab_used++);
+}
+
+void UBODT::insert(Record *r) {
+  if (layout != CHAINED) {
+    insert(*r);
+    return;
+  }
+  if (filter_words != nullptr) {
+    free(filter_words);
+    filter_words = nullptr;
+  }
+  unsigned long long h = cal_bucket_index(r->source, r->target);
+  r->next = hashtable[h];
+  hashtable[h] = r;
+  ++num_rows;
+  if (r->cost > delta) delta = r->cost;
+}
+
+void UBODT::insert(const Record &r) {
+  if (mapped_addr != nullptr) {
+    SPDLOG_CRITICAL("Insert into a memory mapped UBODT is not supported");
+    return;
+  }
+  if (layout == LAZY || layout == TILED) {
+    SPDLOG_CRITICAL("Insert into a lazy or tiled UBODT is not supported");
+    return;
+  }
+  if (!path_offsets.empty()) {
+    std::vector<long>().swap(path_offsets);
+    std::vector<EdgeIndex>().swap(path_edges);
+  }
+  if (num_metric_costs > 0) {
+    std::vector<double>().swap(metric_costs);
+    num_metric_costs = 0;
+  }
+  if (filter_words != nullptr) {
+    free(filter_words);
+    filter_words = nullptr;
+  }
+  if (layout == CHAINED) {
+    Record *copy = allocate_record();
+    *copy = r;
+    insert(copy);
+    return;
+  }
+  if (layout == CSR) {
+    csr_rows.push_back(r);
+    csr_rows.back().next = nullptr;
+    ++num_rows;
+    if (r.cost > delta) delta = r.cost;
+    return;
+  }
+  if (num_rows + 1 > (slot_mask + 1) * FLAT_LOAD_FACTOR) {
+    rehash_flat((slot_mask + 1) << 1);
+  }
+  if (layout == FLAT) {
+    Record *slot = probe_slot(slots, slot_mask, r.source, r.target);
+    if (slot->source == EMPTY_SLOT) ++num_rows;
+    *slot = r;
+    slot->next = nullptr;
+  } else if (layout == COMPACT) {
+    CompactRecord *slot =
+        probe_slot(compact_slots, slot_mask, r.source, r.target);
+    if (slot->source == EMPTY_SLOT) ++num_rows;
+    *slot = {r.source, r.target, r.first_n, r.next_e, (float) r.cost};
+  } else if (layout == SPLIT) {
+    HotRecord *slot = probe_slot(hot_slots, slot_mask, r.source, r.target);
+    if (slot->source == EMPTY_SLOT) ++num_rows;
+    *slot = {r.source, r.target, (float) r.cost};
+    cold_slots[slot - hot_slots] = {r.first_n, r.next_e};
+  }
+  if (r.cost > delta) delta = r.cost;
+}
+
+void UBODT::finish_insert() {
+  if (layout != CSR) return;
+  SPDLOG_TRACE("Build CSR index of UBODT");
+  // Counting sort by source, rows with an empty source are dropped
+  NodeIndex max_source = 0;
+  long valid_rows = 0;
+  for (const Record &r : csr_rows) {
+    if (r.source == EMPTY_SLOT) continue;
+    if (r.source > max_source) max_source = r.source;
+    ++valid_rows;
+  }
+  csr_offsets.assign(valid_rows > 0 ? (size_t) max_source + 2 : 0, 0);
+  for (const Record &r : csr_rows) {
+    if (r.source != EMPTY_SLOT) ++csr_offsets[r.source + 1];
+  }
+  for (size_t i = 1; i < csr_offsets.size(); ++i) {
+    csr_offsets[i] += csr_offsets[i - 1];
+  }
+  std::vector<Record> sorted;
+  sorted.reserve(valid_rows);
+  UTIL::advise_huge_pages(sorted.data(), sizeof(Record) * valid_rows);
+  sorted.resize(valid_rows);
+  std::vector<long> position(csr_offsets);
+  for (const Record &r : csr_rows) {
+    if (r.source != EMPTY_SLOT) sorted[position[r.source]++] = r;
+  }
+  csr_rows.swap(sorted);
+  std::vector<Record>().swap(sorted);
+  long num_groups = (long) csr_offsets.size() - 1;
+#pragma omp parallel for schedule(dynamic, 1024)
+  for (long i = 0; i < num_groups; ++i) {
+    std::sort(csr_rows.begin() + csr_offsets[i],
+              csr_rows.begin() + csr_offsets[i + 1],
+              [](const Record &a, const Record &b) {
+                return a.target < b.target;
+              });
+  }
+  num_rows = valid_rows;
+  SPDLOG_TRACE("Build CSR index of UBODT done");
+}
+
+Record *UBODT::allocate_block(long n) {
+  Record *block =
+      (Record *) UTIL::allocate_large(sizeof(Record) * (n > 0 ? n : 1));
+  if (block == nullptr) {
+    SPDLOG_CRITICAL("Failed to allocate {} records for UBODT", n);
+    std::exit(EXIT_FAILURE);
+  }
+  // Keep the current slab at the back so that allocate_record
+  // continues to use it.
+  slabs.insert(slabs.begin(), block);
+  slab_capacity += n > 0 ? n : 1;
+  return block;
+}
+
+void UBODT::insert_parallel(Record *r) {
+  if (layout == CHAINED) {
+    Record **head = hashtable + cal_bucket_index(r->source, r->target);
+    Record *old_head;
+    do {
+      old_head = *head;
+      r->next = old_head;
+    } while (!__sync_bool_compare_and_swap(head, old_head, r));
+  } else if (layout == CSR) {
+    // Records are parsed into their rows directly and grouped later
+    return;
+  } else if (layout == FLAT) {
+    Record *slot = claim_slot(slots, slot_mask, r->source, r->target);
+    slot->target = r->target;
+    slot->first_n = r->first_n;
+    slot->prev_n = r->prev_n;
+    slot->next_e = r->next_e;
+    slot->cost = r->cost;
+    slot->next = nullptr;
+  } else if (layout == COMPACT) {
+    CompactRecord *slot =
+        claim_slot(compact_slots, slot_mask, r->source, r->target);
+    slot->target = r->target;
+    slot->first_n = r->first_n;
+    slot->next_e = r->next_e;
+    slot->cost = r->cost;
+  } else {
+    HotRecord *slot = claim_slot(hot_slots, slot_mask, r->source, r->target);
+    slot->target = r->target;
+    slot->cost = r->cost;
+    cold_slots[slot - hot_slots] = {r->first_n, r->next_e};
+  }
+}
+
+void UBODT::rehash_flat(unsigned long long capacity) {
+  SPDLOG_TRACE("Resize flat UBODT to {} slots", capacity);
+  if (layout == FLAT) {
+    unsigned long long old_capacity = slots == nullptr ? 0 : slot_mask + 1;
+    slots = resize_slots(slots, old_capacity, capacity);
+  } else if (layout == COMPACT) {
+    unsigned long long old_capacity =
+        compact_slots == nullptr ? 0 : slot_mask + 1;
+    compact_slots = resize_slots(compact_slots, old_capacity, capacity);
+  } else {
+    unsigned long long old_capacity =
+        hot_slots == nullptr ? 0 : slot_mask + 1;
+    resize_split_slots(&hot_slots, &cold_slots, old_capacity, capacity);
+  }
+  slot_mask = capacity - 1;
+}
+
+long UBODT::estimate_ubodt_rows(const std::string &filename) {
+  struct stat stat_buf;
+  long rc = stat(filename.c_str(), &stat_buf);
+  if (rc == 0) {
+    long long file_bytes = stat_buf.st_size;
+    SPDLOG_TRACE("UBODT file size is {} bytes", file_bytes);
+    std::string fn_extension = filename.substr(filename.find_last_of(".") + 1);
+    std::transform(fn_extension.begin(),
+                   fn_extension.end(),
+                   fn_extension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    if (fn_extension == "csv" || fn_extension == "txt") {
+      int row_size = 36;
+      return file_bytes / row_size;
+    } else if (fn_extension == "gz") {
+      // The rows are compressed about four times by gzip
+      int row_size = 9;
+      return file_bytes / row_size;
+    } else if (fn_extension == "bin" || fn_extension == "binary") {
+      // When exporting to a file using boost binary writer,
+      // the padding is removed.
+      return file_bytes / BINARY_ROW_SIZE;
+    }
+  }
+  return -1;
+}
+
+int UBODT::find_prime_number(double value) {
+  std::vector<int> prime_numbers = {
+      5003, 10039, 20029, 50047, 100669, 200003, 500000,
+      1000039, 2000083, 5000101, 10000103, 20000033};
+  int N = prime_numbers.size();
+  for (int i = 0; i < N; ++i) {
+    if (value <= prime_numbers[i]) {
+      return prime_numbers[i];
+    }
+  }
+  return prime_numbers[N - 1];
+}
+
+long long UBODT::find_bucket_number(double value) {
+  long long buckets = 1;
+  while (buckets < value) buckets <<= 1;
+  return buckets;
+}
+
+std::vector<long> UBODT::get_chain_distribution(long max_samples) const {
+  std::vector<long> distribution;
+  if (layout != CHAINED) return distribution;
+  // Buckets are visited with a stride that covers the whole table
+  long long stride = buckets / max_samples + 1;
+  for (long long i = 0; i < buckets; i += stride) {
+    size_t length = 0;
+    for (Record *r = hashtable[i]; r != nullptr; r = r->next) ++length;
+    if (length >= distribution.size()) distribution.resize(length + 1, 0);
+    ++distribution[length];
+  }
+  return distribution;
+}
+
+void UBODT::print_chain_distribution() const {
+  std::vector<long> distribution = get_chain_distribution();
+  if (distribution.empty()) return;
+  long samples = 0;
+  double total_length = 0;
+  for (size_t i = 0; i < distribution.size(); ++i) {
+    samples += distribution[i];
+    total_length += i * distribution[i];
+  }
+  std::stringstream ss;
+  for (size_t i = 0; i < distribution.size() && i < 8; ++i) {
+    ss << " " << i << ":" << distribution[i] * 100.0 / samples << "%";
+  }
+  long longer = 0;
+  for (size_t i = 8; i < distribution.size(); ++i) longer += distribution[i];
+  if (longer > 0) ss << " >=8:" << longer * 100.0 / samples << "%";
+  SPDLOG_INFO("UBODT buckets {} rows {} load factor {}",
+              buckets, num_rows, num_rows / (double) buckets);
+  SPDLOG_INFO("Chain length in {} sampled buckets: mean {} max {}",
+              samples, total_length / samples, distribution.size() - 1);
+  SPDLOG_INFO("Chain length distribution{}", ss.str());
+  if (distribution.size() > 32) {
+    SPDLOG_WARN("Long chains found in UBODT, check the hash distribution.");
+  }
+}
+
+std::shared_ptr<UBODT> UBODT::create_lazy_ubodt(
+    const NetworkGraph &graph, double delta, long max_rows) {
+  SPDLOG_INFO("Create lazy UBODT with delta {} cache rows {}",
+              delta, max_rows);
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      1, graph.get_num_vertices(), 0, LAZY);
+  table->graph = &graph;
+  table->delta = delta;
+  table->shard_rows = std::max<long>(max_rows / CACHE_SHARDS, 1);
+  for (int i = 0; i < CACHE_SHARDS; ++i) {
+    table->lazy_shards.emplace_back(new LazyShard());
+  }
+  return table;
+}
+
+std::shared_ptr<UBODT> UBODT::generate_ubodt(
+    const NetworkGraph &graph, double delta, UBODTLayout layout,
+    bool symmetric, bool parallel) {
+  SPDLOG_INFO("Generate UBODT with delta {}", delta);
+  int num_vertices = graph.get_num_vertices();
+  std::vector<std::vector<Record>> source_rows(num_vertices);
+#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+  for (int s = 0; s < num_vertices; ++s) {
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    PathEndMap emap;
+    graph.single_source_upperbound_dijkstra(s, delta, &pmap, &dmap, &emap);
+    std::vector<Record> &rows = source_rows[s];
+    rows.reserve(emap.size());
+    for (auto iter = emap.begin(); iter != emap.end(); ++iter) {
+      NodeIndex v = iter->first;
+      // The row to a smaller node is the one from it reversed
+      if (symmetric && v < (NodeIndex) s) continue;
+      const PathEnds &ends = iter->second;
+      rows.push_back({(NodeIndex) s, v, ends.first_n, pmap[v],
+                      ends.first_e, dmap[v], nullptr});
+    }
+  }
+  std::vector<long> offsets(num_vertices + 1, 0);
+  for (int s = 0; s < num_vertices; ++s) {
+    offsets[s + 1] = offsets[s] + source_rows[s].size();
+  }
+  long rows = offsets[num_vertices];
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      find_bucket_number(rows / LOAD_FACTOR), num_vertices, rows, layout);
+  Record *storage = nullptr;
+  if (layout == CHAINED) {
+    storage = table->allocate_block(rows);
+  } else if (layout == CSR) {
+    table->csr_rows.resize(rows);
+    storage = table->csr_rows.data();
+  }
+  // The buffer of a source is released once its rows are inserted
+#pragma omp parallel for schedule(dynamic, 64) if(parallel)
+  for (int s = 0; s < num_vertices; ++s) {
+    std::vector<Record> &source = source_rows[s];
+    for (std::size_t i = 0; i < source.size(); ++i) {
+      Record *r = &source[i];
+      if (storage != nullptr) {
+        r = storage + offsets[s] + i;
+        *r = source[i];
+      }
+      table->insert_parallel(r);
+    }
+    std::vector<Record>().swap(source);
+  }
+  table->num_rows = rows;
+  table->delta = delta;
+  table->finish_insert();
+  SPDLOG_INFO("Finish generating UBODT with rows {}", rows);
+  return table;
+}
+
+std::shared_ptr<const UBODT::LazyGroup> UBODT::lazy_group(
+    NodeIndex source) const {
+  LazyShard &shard = *lazy_shards[hash_od(source, source) &
+      (CACHE_SHARDS - 1)];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto iter = shard.groups.find(source);
+    if (iter != shard.groups.end()) {
+      iter->second.referenced = true;
+      ++shard.hits;
+      return iter->second.group;
+    }
+    ++shard.misses;
+  }
+  // The search runs without the lock, so that other sources of the
+  // shard can be queried meanwhile.
+  PredecessorMap pmap;
+  DistanceMap dmap;
+  PathEndMap emap;
+  graph->single_source_upperbound_dijkstra(source, delta, &pmap, &dmap,
+                                           &emap);
+  std::shared_ptr<LazyGroup> group = std::make_shared<LazyGroup>();
+  group->rows.reserve(emap.size());
+  for (auto iter = emap.begin(); iter != emap.end(); ++iter) {
+    NodeIndex v = iter->first;
+    const PathEnds &ends = iter->second;
+    group->rows.push_back(
+        {source, v, ends.first_n, pmap[v], ends.first_e, dmap[v], nullptr});
+  }
+  std::sort(group->rows.begin(), group->rows.end(),
+            [](const Record &a, const Record &b) {
+              return a.target < b.target;
+            });
+  group->last_edges.reserve(group->rows.size());
+  for (const Record &r : group->rows) {
+    group->last_edges.push_back(emap[r.target].last_e);
+  }
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto inserted = shard.groups.insert({source, {group, true}});
+  // Another thread may have calculated the same source
+  if (!inserted.second) return inserted.first->second.group;
+  shard.clock.push_back(source);
+  shard.rows += group->rows.size() + 1;
+  while (shard.rows > shard_rows && shard.clock.size() > 1) {
+    if (shard.hand >= shard.clock.size()) shard.hand = 0;
+    NodeIndex victim = shard.clock[shard.hand];
+    LazyShard::Entry &entry = shard.groups[victim];
+    if (victim == source || entry.referenced) {
+      entry.referenced = false;
+      ++shard.hand;
+    } else {
+      shard.rows -= entry.group->rows.size() + 1;
+      shard.groups.erase(victim);
+      shard.clock[shard.hand] = shard.clock.back();
+      shard.clock.pop_back();
+      ++shard.evictions;
+    }
+  }
+  return group;
+}
+
+void UBODT::for_each_lazy_record(
+    const std::function<void(const Record &)> &visitor) const {
+  for (const auto &shard : lazy_shards) {
+    std::vector<std::shared_ptr<const LazyGroup>> groups;
+    {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      for (const auto &item : shard->groups) {
+        groups.push_back(item.second.group);
+      }
+    }
+    for (const auto &group : groups) {
+      for (const Record &r : group->rows) visitor(r);
+    }
+  }
+}
+
+void UBODT::print_cache_statistics() const {
+  if (layout == TILED) {
+    std::lock_guard<std::mutex> lock(tile_set->mutex);
+    SPDLOG_INFO("Tiled UBODT tiles {} loaded {} evicted {} resident {}",
+                tile_set->tile_rows.size(), tile_set->loads,
+                tile_set->evictions, tile_set->resident);
+    if (!tile_set->loaders.empty()) {
+      SPDLOG_INFO("Tiled UBODT queries searched before their tile loaded "
+                  "{}", tile_set->searched);
+    }
+    return;
+  }
+  if (layout != LAZY) return;
+  long hits = 0, misses = 0, evictions = 0, rows = 0, sources = 0;
+  for (const auto &shard : lazy_shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    hits += shard->hits;
+    misses += shard->misses;
+    evictions += shard->evictions;
+    rows += shard->rows;
+    sources += shard->groups.size();
+  }
+  SPDLOG_INFO("Lazy UBODT hits {} misses {} evictions {}",
+              hits, misses, evictions);
+  SPDLOG_INFO("Lazy UBODT sources cached {} rows cached {}", sources, rows);
+}
+
+UBODTCacheStatistics UBODT::get_cache_statistics() const {
+  UBODTCacheStatistics statistics;
+  if (layout == TILED) {
+    std::lock_guard<std::mutex> lock(tile_set->mutex);
+    statistics.misses = tile_set->loads;
+    statistics.evictions = tile_set->evictions;
+    statistics.resident = tile_set->resident;
+  } else if (layout == LAZY) {
+    for (const auto &shard : lazy_shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      statistics.hits += shard->hits;
+      statistics.misses += shard->misses;
+      statistics.evictions += shard->evictions;
+      statistics.resident += shard->rows;
+    }
+  }
+  return statistics;
+}
+
+void UBODT::get_memory_usage(UTIL::MemoryReport *report) const {
+  if (hashtable != nullptr) {
+    report->add("ubodt", "buckets", sizeof(Record *) * buckets);
+  }
+  size_t record_bytes = sizeof(Record) * slab_capacity +
+      UTIL::get_vector_bytes(csr_rows) + UTIL::get_vector_bytes(csr_offsets);
+  if (mapped_addr != nullptr) {
+    report->add("ubodt", "mapped", mapped_size);
+  } else if (slots != nullptr) {
+    record_bytes += sizeof(Record) * (slot_mask + 1);
+  } else if (compact_slots != nullptr) {
+    record_bytes += sizeof(CompactRecord) * (slot_mask + 1);
+  } else if (hot_slots != nullptr) {
+    record_bytes += (sizeof(HotRecord) + sizeof(ColdRecord)) *
+        (slot_mask + 1);
+  }
+  report->add("ubodt", "records", record_bytes);
+  if (!path_offsets.empty()) {
+    report->add("ubodt", "paths", UTIL::get_vector_bytes(path_offsets) +
+        UTIL::get_vector_bytes(path_edges));
+  }
+  if (num_metric_costs > 0) {
+    report->add("ubodt", "metric_costs",
+                UTIL::get_vector_bytes(metric_costs));
+  }
+  if (chains != nullptr) {
+    report->add("ubodt", "chains", chains->get_memory_bytes());
+  }
+  if (filter_words != nullptr) {
+    report->add("ubodt", "filter", sizeof(unsigned long long) *
+        FILTER_BLOCK_WORDS * (filter_mask + 1));
+  }
+  if (layout == TILED) {
+    std::lock_guard<std::mutex> lock(tile_set->mutex);
+    size_t tile_bytes = UTIL::get_vector_bytes(tile_set->node_tiles) +
+        UTIL::get_vector_bytes(tile_set->tile_rows);
+    for (const std::shared_ptr<UBODT> &table : tile_set->tables) {
+      if (table != nullptr) tile_bytes += table->mapped_size;
+    }
+    report->add("ubodt", "cache", tile_bytes);
+  } else if (layout == LAZY) {
+    size_t cache_bytes = 0;
+    for (const auto &shard : lazy_shards) {
+      std::lock_guard<std::mutex> lock(shard->mutex);
+      cache_bytes += UTIL::get_hash_map_bytes(shard->groups) +
+          UTIL::get_vector_bytes(shard->clock);
+      for (const auto &entry : shard->groups) {
+        cache_bytes += sizeof(LazyGroup) +
+            UTIL::get_vector_bytes(entry.second.group->rows) +
+            UTIL::get_vector_bytes(entry.second.group->last_edges);
+      }
+    }
+    report->add("ubodt", "cache", cache_bytes);
+  }
+}
+
+void MM::append_ubodt_metrics(const UBODT &ubodt, UTIL::MetricsText *text) {
+  UBODTCacheStatistics statistics = ubodt.get_cache_statistics();
+  long queries = statistics.hits + statistics.misses;
+  text->counter("fmm_ubodt_cache_hits_total",
+                "Queries of a source cached in a lazy UBODT",
+                statistics.hits);
+  text->counter("fmm_ubodt_cache_misses_total",
+                "Sources computed by a lazy UBODT or tiles loaded",
+                statistics.misses);
+  text->counter("fmm_ubodt_cache_evictions_total",
+                "Sources or tiles evicted from a UBODT",
+                statistics.evictions);
+  text->gauge("fmm_ubodt_cache_resident",
+              "Rows cached by a lazy UBODT or tiles mapped",
+              statistics.resident);
+  text->gauge("fmm_ubodt_cache_hit_ratio",
+              "Share of the queries of a lazy UBODT found in its cache",
+              queries > 0 ? statistics.hits / (double) queries : 0.0);
+  if (ubodt.get_layout() != CHAINED) return;
+  // A small sample keeps the collection cheap on large tables
+  std::vector<long> distribution = ubodt.get_chain_distribution(10000);
+  long samples = 0;
+  double total_length = 0;
+  for (size_t i = 0; i < distribution.size(); ++i) {
+    samples += distribution[i];
+    total_length += i * distribution[i];
+  }
+  text->gauge("fmm_ubodt_load_factor",
+              "Rows per bucket of a chained UBODT",
+              ubodt.get_num_rows() / (double) ubodt.get_num_buckets());
+  text->gauge("fmm_ubodt_chain_length_mean",
+              "Mean chain length in sampled buckets of a chained UBODT",
+              samples > 0 ? total_length / samples : 0.0);
+  text->gauge("fmm_ubodt_chain_length_max",
+              "Maximum chain length in sampled buckets of a chained UBODT",
+              distribution.empty() ? 0 : distribution.size() - 1);
+}
+
+std::string UBODT::get_tile_file(const std::string &filename,
+                                 unsigned int tile) {
+  return filename + "." + std::to_string(tile) + ".mmap";
+}
+
+std::string UBODT::get_network_ids_file(const std::string &filename) {
+  return filename + ".ids";
+}
+
+bool UBODT::write_network_ids(const std::string &filename,
+                              const Network &network) {
+  std::string ids_file = get_network_ids_file(filename);
+  SPDLOG_INFO("Write UBODT network ids to {}", ids_file);
+  FILE *stream = fopen(ids_file.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", ids_file);
+    return false;
+  }
+  std::vector<NodeID> node_ids(network.get_node_count());
+  for (NodeIndex u = 0; u < node_ids.size(); ++u) {
+    node_ids[u] = network.get_node_id(u);
+  }
+  std::vector<EdgeID> edge_ids;
+  edge_ids.reserve(network.get_edge_count());
+  for (const Edge &e : network.get_edges()) edge_ids.push_back(e.id);
+  IdsHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, IDS_MAGIC, sizeof(IDS_MAGIC));
+  header.version = IDS_VERSION;
+  header.num_nodes = node_ids.size();
+  header.num_edges = edge_ids.size();
+  bool success = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+      fwrite(node_ids.data(), sizeof(NodeID), node_ids.size(), stream) ==
+          node_ids.size() &&
+      fwrite(edge_ids.data(), sizeof(EdgeID), edge_ids.size(), stream) ==
+          edge_ids.size();
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write UBODT network ids {}", ids_file);
+  }
+  return success;
+}
+
+std::shared_ptr<UBODT> UBODT::clip_to_network(const std::string &ids_file,
+                                              const Network &network,
+                                              UBODTLayout layout_arg) const {
+  if (layout == LAZY || layout == TILED || layout_arg == LAZY ||
+      layout_arg == TILED) {
+    SPDLOG_CRITICAL("Clipping is not supported for lazy and tiled UBODT");
+    return nullptr;
+  }
+  if (symmetric || chains != nullptr) {
+    SPDLOG_CRITICAL("Clipping is not supported for symmetric UBODT or "
+                    "UBODT of chains");
+    return nullptr;
+  }
+  std::vector<NodeID> node_ids;
+  std::vector<EdgeID> edge_ids;
+  if (!read_ids_file(ids_file, &node_ids, &edge_ids)) return nullptr;
+  // Indices of the network of the UBODT in the clipped network
+  std::unordered_map<NodeID, NodeIndex> node_map;
+  for (NodeIndex u = 0; u < (NodeIndex) network.get_node_count(); ++u) {
+    node_map[network.get_node_id(u)] = u;
+  }
+  std::vector<NodeIndex> node_index(node_ids.size(), (NodeIndex) EMPTY_SLOT);
+  for (size_t u = 0; u < node_ids.size(); ++u) {
+    auto iter = node_map.find(node_ids[u]);
+    if (iter != node_map.end()) node_index[u] = iter->second;
+  }
+  std::unordered_map<EdgeID, EdgeIndex> edge_map;
+  for (const Edge &e : network.get_edges()) edge_map[e.id] = e.index;
+  std::vector<EdgeIndex> edge_index(edge_ids.size(), (EdgeIndex) EMPTY_SLOT);
+  for (size_t e = 0; e < edge_ids.size(); ++e) {
+    auto iter = edge_map.find(edge_ids[e]);
+    if (iter != edge_map.end()) edge_index[e] = iter->second;
+  }
+  auto node_in = [&node_index](NodeIndex u) {
+    return u < node_index.size() && node_index[u] != EMPTY_SLOT;
+  };
+  auto edge_in = [&edge_index](EdgeIndex e) {
+    return e < edge_index.size() && edge_index[e] != EMPTY_SLOT;
+  };
+  std::vector<Record> rows;
+  long long skipped = 0;
+  for_each_record([&](const Record &r) {
+    bool inside = node_in(r.source) && node_in(r.target);
+    // The path is walked through the rows of the nodes on it, which are
+    // only copied if their paths are inside as well
+    NodeIndex first_n = r.first_n;
+    EdgeIndex next_e = r.next_e;
+    for (long steps = 0; inside; ++steps) {
+      if (!node_in(first_n) || !edge_in(next_e) ||
+          steps > (long) node_ids.size()) {
+        inside = false;
+      } else if (first_n == r.target) {
+        break;
+      } else {
+        inside = look_up_next(first_n, r.target, &first_n, &next_e);
+      }
+    }
+    if (!inside) {
+      ++skipped;
+      return;
+    }
+    NodeIndex prev_n = r.prev_n == EMPTY_SLOT ? (NodeIndex) EMPTY_SLOT :
+                       node_index[r.prev_n];
+    rows.push_back({node_index[r.source], node_index[r.target],
+                    node_index[r.first_n], prev_n, edge_index[r.next_e],
+                    r.cost, nullptr});
+  });
+  long n = rows.size();
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      find_bucket_number(n / LOAD_FACTOR), network.get_node_count(), n,
+      layout_arg);
+  for (const Record &r : rows) table->insert(r);
+  table->finish_insert();
+  table->delta = delta;
+  SPDLOG_INFO("Clip UBODT rows {} skipped {}", n, skipped);
+  return table;
+}
+
+bool UBODT::read_clipped_nodes(const std::string &ids_file,
+                               const Network &network,
+                               std::vector<char> *nodes) {
+  std::vector<NodeID> node_ids;
+  std::vector<EdgeID> edge_ids;
+  if (!read_ids_file(ids_file, &node_ids, &edge_ids)) return false;
+  std::unordered_set<NodeID> clipped_ids;
+  for (NodeIndex u = 0; u < (NodeIndex) network.get_node_count(); ++u) {
+    clipped_ids.insert(network.get_node_id(u));
+  }
+  nodes->assign(node_ids.size(), 0);
+  for (size_t u = 0; u < node_ids.size(); ++u) {
+    (*nodes)[u] = clipped_ids.count(node_ids[u]) > 0;
+  }
+  return true;
+}
+
+bool UBODT::write_ubodt_tile_index(
+    const std::string &filename, const std::vector<unsigned int> &node_tiles,
+    const std::vector<long long> &tile_rows, double delta) {
+  SPDLOG_INFO("Write UBODT tile index to {}", filename);
+  FILE *stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return false;
+  }
+  TileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC));
+  header.version = TILE_VERSION;
+  header.num_tiles = tile_rows.size();
+  header.num_nodes = node_tiles.size();
+  for (long long rows : tile_rows) header.num_rows += rows;
+  header.delta = delta;
+  bool success = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+      fwrite(node_tiles.data(), sizeof(unsigned int), node_tiles.size(),
+             stream) == node_tiles.size() &&
+      fwrite(tile_rows.data(), sizeof(long long), tile_rows.size(),
+             stream) == tile_rows.size();
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write UBODT file {}", filename);
+  }
+  return success;
+}
+
+std::shared_ptr<UBODT> UBODT::read_ubodt_tiled(const std::string &filename,
+                                               int max_tiles) {
+  SPDLOG_INFO("Reading UBODT tile index from {}", filename);
+  FILE *stream = fopen(filename.c_str(), "rb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    return nullptr;
+  }
+  TileHeader header;
+  bool success = fread(&header, sizeof(header), 1, stream) == 1 &&
+      memcmp(header.magic, TILE_MAGIC, sizeof(TILE_MAGIC)) == 0 &&
+      header.version == TILE_VERSION && header.num_nodes >= 0;
+  std::unique_ptr<TileSet> tiles(new TileSet());
+  if (success) {
+    tiles->node_tiles.resize(header.num_nodes);
+    tiles->tile_rows.resize(header.num_tiles);
+    success = fread(tiles->node_tiles.data(), sizeof(unsigned int),
+                    header.num_nodes, stream) == (size_t) header.num_nodes &&
+        fread(tiles->tile_rows.data(), sizeof(long long),
+              header.num_tiles, stream) == header.num_tiles;
+  }
+  fclose(stream);
+  for (unsigned int tile : tiles->node_tiles) {
+    if (tile >= header.num_tiles) success = false;
   }
-  SPDLOG_TRACE("Intialization UBODT finished");
+  if (!success) {
+    SPDLOG_CRITICAL("Invalid or incompatible UBODT file {}", filename);
+    return nullptr;
+  }
+  tiles->filename = filename;
+  tiles->tables.resize(header.num_tiles);
+  tiles->last_used.assign(header.num_tiles, 0);
+  tiles->failed.assign(header.num_tiles, 0);
+  tiles->max_tiles = std::max(max_tiles, 1);
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      1, header.num_nodes, 0, TILED);
+  table->tile_set = std::move(tiles);
+  table->num_rows = header.num_rows;
+  table->delta = header.delta;
+  SPDLOG_INFO("Finish reading UBODT tile index with tiles {} rows {}",
+              header.num_tiles, header.num_rows);
+  return table;
 }
 
-UBODT::~UBODT() {
-  /* Clean hashtable */
-  SPDLOG_TRACE("Clean UBODT");
-  int i;
-  for (i = 0; i < buckets; ++i) {
-    Record *head = hashtable[i];
-    Record *curr;
-    while ((curr = head) != nullptr) {
-      head = head->next;
-      free(curr);
+std::shared_ptr<UBODT> UBODT::tile_table(NodeIndex source) const {
+  TileSet &tiles = *tile_set;
+  if (source >= tiles.node_tiles.size()) return nullptr;
+  unsigned int tile = tiles.node_tiles[source];
+  if (tiles.tile_rows[tile] == 0) return nullptr;
+  {
+    std::lock_guard<std::mutex> lock(tiles.mutex);
+    tiles.last_used[tile] = ++tiles.clock;
+    if (tiles.tables[tile] != nullptr) return tiles.tables[tile];
+    if (tiles.failed[tile]) return nullptr;
+  }
+  // The tile is mapped outside the lock, so that the queries of the
+  // resident tiles are not stalled. The pairs of a tile failing to map
+  // are not reached.
+  std::shared_ptr<UBODT> table =
+      read_ubodt_mmap(get_tile_file(tiles.filename, tile));
+  std::lock_guard<std::mutex> lock(tiles.mutex);
+  if (table == nullptr) {
+    tiles.failed[tile] = 1;
+    return nullptr;
+  }
+  // Another query may have mapped the tile meanwhile
+  if (tiles.tables[tile] != nullptr) return tiles.tables[tile];
+  // Unmap the least recently used tile, whose table is released when
+  // the last query holding it finishes
+  if (tiles.resident >= tiles.max_tiles) {
+    long victim = -1;
+    for (size_t i = 0; i < tiles.tables.size(); ++i) {
+      if (tiles.tables[i] != nullptr &&
+          (victim < 0 || tiles.last_used[i] < tiles.last_used[victim])) {
+        victim = i;
+      }
     }
+    tiles.tables[victim] = nullptr;
+    --tiles.resident;
+    ++tiles.evictions;
   }
-  // Destory hash table pointer
-  free(hashtable);
-  SPDLOG_TRACE("Clean UBODT finished");
+  tiles.tables[tile] = table;
+  ++tiles.resident;
+  ++tiles.loads;
+  return table;
 }
 
-Record *UBODT::look_up(NodeIndex source, NodeIndex target) const {
-  unsigned int h = cal_bucket_index(source, target);
-  Record *r = hashtable[h];
-  while (r != nullptr) {
-    if (r->source == source && r->target == target) {
-      return r;
+bool UBODT::tile_pending(NodeIndex source) const {
+  if (layout != TILED ||
+      !tile_set->progressive.load(std::memory_order_acquire)) {
+    return false;
+  }
+  TileSet &tiles = *tile_set;
+  if (source >= tiles.node_tiles.size()) return false;
+  unsigned int tile = tiles.node_tiles[source];
+  if (tiles.tile_rows[tile] == 0) return false;
+  std::lock_guard<std::mutex> lock(tiles.mutex);
+  if (tiles.tables[tile] != nullptr) return false;
+  if (!tiles.claimed[tile] && !tiles.demanded[tile]) {
+    tiles.demanded[tile] = 1;
+    tiles.demand.push_back(tile);
+  }
+  ++tiles.searched;
+  return true;
+}
+
+bool UBODT::start_progressive_load(const NetworkGraph &graph_arg,
+                                   int num_threads, long cache_rows) {
+  if (layout != TILED) {
+    SPDLOG_CRITICAL("Progressive load is only supported for tiled UBODT");
+    return false;
+  }
+  TileSet &tiles = *tile_set;
+  std::lock_guard<std::mutex> lock(tiles.mutex);
+  if (!tiles.loaders.empty()) {
+    SPDLOG_CRITICAL("UBODT tiles are already loading");
+    return false;
+  }
+  // The sources of the tiles not loaded are searched as in a lazy UBODT
+  graph = &graph_arg;
+  shard_rows = std::max<long>(cache_rows / CACHE_SHARDS, 1);
+  for (int i = 0; i < CACHE_SHARDS; ++i) {
+    lazy_shards.emplace_back(new LazyShard());
+  }
+  size_t num_tiles = tiles.tile_rows.size();
+  tiles.max_tiles = std::max<int>(tiles.max_tiles, num_tiles);
+  tiles.claimed.assign(num_tiles, 0);
+  tiles.demanded.assign(num_tiles, 0);
+  tiles.pending = 0;
+  for (size_t i = 0; i < num_tiles; ++i) {
+    tiles.claimed[i] = tiles.tile_rows[i] == 0 || tiles.tables[i] != nullptr;
+    if (!tiles.claimed[i]) ++tiles.pending;
+  }
+  if (tiles.pending == 0) return true;
+  tiles.progressive.store(true, std::memory_order_release);
+  SPDLOG_INFO("Load {} UBODT tiles progressively with {} threads",
+              tiles.pending, num_threads);
+  for (int i = 0; i < std::max(num_threads, 1); ++i) {
+    tiles.loaders.emplace_back(load_tiles, &tiles);
+  }
+  return true;
+}
+
+void UBODT::load_tiles(TileSet *tiles) {
+  long page = sysconf(_SC_PAGESIZE);
+  while (true) {
+    unsigned int tile = 0;
+    {
+      std::lock_guard<std::mutex> lock(tiles->mutex);
+      // The tiles queried are loaded first, then the others in order
+      bool found = false;
+      while (!tiles->stopping && !found) {
+        if (!tiles->demand.empty()) {
+          tile = tiles->demand.front();
+          tiles->demand.pop_front();
+        } else if (tiles->next_tile < tiles->tile_rows.size()) {
+          tile = tiles->next_tile++;
+        } else {
+          break;
+        }
+        found = !tiles->claimed[tile];
+      }
+      if (!found) return;
+      tiles->claimed[tile] = 1;
+    }
+    std::shared_ptr<UBODT> table =
+        read_ubodt_mmap(get_tile_file(tiles->filename, tile));
+    if (table != nullptr) {
+      // The pages are read here, so that the queries do not fault them
+      const volatile char *bytes =
+          (const volatile char *) table->mapped_addr;
+      for (size_t i = 0; i < table->mapped_size; i += page) (void) bytes[i];
+    }
+    std::lock_guard<std::mutex> lock(tiles->mutex);
+    // The pairs of a tile failing to map are not reached
+    if (table != nullptr) {
+      tiles->tables[tile] = table;
+      tiles->last_used[tile] = ++tiles->clock;
+      ++tiles->resident;
+      ++tiles->loads;
     } else {
-      r = r->next;
+      tiles->failed[tile] = 1;
+    }
+    if (--tiles->pending == 0) {
+      tiles->progressive.store(false, std::memory_order_release);
+      SPDLOG_INFO("UBODT tiles loaded, {} queries searched meanwhile",
+                  tiles->searched);
+      tiles->loaded.notify_all();
     }
   }
-  return r;
 }
 
-std::vector<EdgeIndex> UBODT::look_sp_path(NodeIndex source,
-                                           NodeIndex target) const {
-  std::vector<EdgeIndex> edges;
-  if (source == target) { return edges; }
-  Record *r = look_up(source, target);
-  // No transition exist from source to target
-  if (r == nullptr) { return edges; }
-  while (r->first_n != target) {
-    edges.push_back(r->next_e);
-    r = look_up(r->first_n, target);
+void UBODT::wait_progressive_load() const {
+  if (layout != TILED) return;
+  TileSet &tiles = *tile_set;
+  std::unique_lock<std::mutex> lock(tiles.mutex);
+  tiles.loaded.wait(lock, [&tiles]() { return tiles.pending == 0; });
+}
+
+bool UBODT::is_loading() const {
+  return layout == TILED &&
+      tile_set->progressive.load(std::memory_order_acquire);
+}
+
+void UBODT::for_each_tiled_record(
+    const std::function<void(const Record &)> &visitor) const {
+  for (size_t i = 0; i < tile_set->tile_rows.size(); ++i) {
+    if (tile_set->tile_rows[i] == 0) continue;
+    std::shared_ptr<UBODT> table =
+        read_ubodt_mmap(get_tile_file(tile_set->filename, i));
+    if (table == nullptr) {
+      SPDLOG_ERROR("Rows of UBODT tile {} skipped", i);
+      continue;
+    }
+    table->for_each_record(visitor);
   }
-  edges.push_back(r->next_e);
-  return edges;
 }
 
-C_Path UBODT::construct_complete_path(const TGOpath &path,
-                                      const std::vector<Edge> &edges,
-                                      std::vector<int> *indices) const {
-  C_Path cpath;
-  if (!indices->empty()) indices->clear();
-  if (path.empty()) return cpath;
-  int N = path.size();
-  cpath.push_back(path[0]->c->edge->id);
-  int current_idx = 0;
-  indices->push_back(current_idx);
-  for (int i = 0; i < N - 1; ++i) {
-    const Candidate *a = path[i]->c;
-    const Candidate *b = path[i + 1]->c;
-    if ((a->edge->id != b->edge->id) || (a->offset > b->offset)) {
-      // segs stores edge index
-      auto segs = look_sp_path(a->edge->target, b->edge->source);
-      // No transition exist in UBODT
-      if (segs.empty() && a->edge->target != b->edge->source) {
-        indices->clear();
-        return C_Path();
+std::shared_ptr<UBODT> UBODT::read_ubodt_mmap(const std::string &filename) {
+  SPDLOG_INFO("Reading UBODT file (mmap format) from {}", filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    return nullptr;
+  }
+  return map_ubodt_image(fd, filename);
+}
+
+std::shared_ptr<UBODT> UBODT::attach_ubodt_shm(const std::string &name) {
+  SPDLOG_INFO("Attach UBODT in shared memory {}", name);
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open shared memory {}", name);
+    return nullptr;
+  }
+  return map_ubodt_image(fd, name);
+}
+
+bool UBODT::publish_ubodt_shm(const std::string &name) const {
+  SPDLOG_INFO("Publish UBODT to shared memory {}", name);
+  // Processes attached to an old object keep their mapping after it
+  // is unlinked, so the object is always created again.
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  FILE *stream = (fd < 0) ? nullptr : fdopen(fd, "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to create shared memory {}", name);
+    if (fd >= 0) close(fd);
+    return false;
+  }
+  bool success = write_mmap_image(stream);
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write shared memory {}", name);
+    shm_unlink(name.c_str());
+  }
+  return success;
+}
+
+bool UBODT::remove_ubodt_shm(const std::string &name) {
+  SPDLOG_INFO("Remove UBODT in shared memory {}", name);
+  return shm_unlink(name.c_str()) == 0;
+}
+
+std::shared_ptr<UBODT> UBODT::map_ubodt_image(int fd,
+                                              const std::string &filename) {
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  void *addr = nullptr;
+  if (file_size >= sizeof(MmapHeader)) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map UBODT file {}", filename);
+    return nullptr;
+  }
+  const MmapHeader *header = (const MmapHeader *) addr;
+  unsigned long long num_slots = header->num_slots;
+  UBODTLayout layout = (UBODTLayout) header->layout;
+  size_t record_size =
+      layout == COMPACT ? sizeof(CompactRecord) : sizeof(Record);
+  if (memcmp(header->magic, MMAP_MAGIC, sizeof(MMAP_MAGIC)) != 0 ||
+      header->version != MMAP_VERSION ||
+      (layout != FLAT && layout != COMPACT) ||
+      header->record_size != record_size ||
+      (num_slots & (num_slots - 1)) != 0 ||
+      file_size != sizeof(MmapHeader) + num_slots * record_size) {
+    SPDLOG_CRITICAL("Invalid or incompatible UBODT file {}", filename);
+    munmap(addr, file_size);
+    return nullptr;
+  }
+  // Lookups are random, so read ahead is useless
+  madvise(addr, file_size, MADV_RANDOM);
+  UTIL::advise_huge_pages(addr, file_size);
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      header->buckets, header->multiplier, 0, layout);
+  void *data = (char *) addr + sizeof(MmapHeader);
+  if (layout == FLAT) {
+    free(table->slots);
+    table->slots = (Record *) data;
+  } else {
+    free(table->compact_slots);
+    table->compact_slots = (CompactRecord *) data;
+  }
+  table->slot_mask = num_slots - 1;
+  table->num_rows = header->num_rows;
+  table->delta = header->delta;
+  table->mapped_addr = addr;
+  table->mapped_size = file_size;
+  SPDLOG_INFO("Finish reading UBODT with rows {}", table->num_rows);
+  return table;
+}
+
+bool UBODT::write_ubodt_mmap(const std::string &filename) const {
+  SPDLOG_INFO("Write UBODT (mmap format) to {}", filename);
+  FILE *stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return false;
+  }
+  bool success = write_mmap_image(stream);
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write UBODT file {}", filename);
+  }
+  return success;
+}
+
+bool UBODT::write_mmap_image(FILE *stream) const {
+  const UBODT *flat = this;
+  std::shared_ptr<UBODT> copy;
+  if (layout != FLAT && layout != COMPACT) {
+    copy = std::make_shared<UBODT>(buckets, multiplier, num_rows, FLAT);
+    for_each_record([&copy](const Record &r) { copy->insert(r); });
+    flat = copy.get();
+  }
+  MmapHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MMAP_MAGIC, sizeof(MMAP_MAGIC));
+  header.version = MMAP_VERSION;
+  header.layout = flat->layout;
+  header.record_size =
+      flat->layout == COMPACT ? sizeof(CompactRecord) : sizeof(Record);
+  header.num_slots = flat->slot_mask + 1;
+  header.num_rows = flat->num_rows;
+  header.multiplier = multiplier;
+  header.buckets = buckets;
+  header.delta = delta;
+  bool success = fwrite(&header, sizeof(header), 1, stream) == 1;
+  unsigned long long num_slots = header.num_slots;
+  if (flat->layout == COMPACT && success) {
+    success = fwrite(flat->compact_slots, sizeof(CompactRecord), num_slots,
+                     stream) == num_slots;
+  }
+  // Next pointers are meaningless in the file, so slots are written
+  // in blocks with the pointer cleared.
+  std::vector<Record> block;
+  for (unsigned long long i = 0;
+       flat->layout == FLAT && i < num_slots && success;
+       i += DEFAULT_SLAB_ROWS) {
+    unsigned long long n = std::min<unsigned long long>(
+        DEFAULT_SLAB_ROWS, num_slots - i);
+    block.assign(flat->slots + i, flat->slots + i + n);
+    for (Record &r : block) r.next = nullptr;
+    success = fwrite(block.data(), sizeof(Record), n, stream) == n;
+  }
+  return success;
+}
+
+namespace {
+
+// Rows read or written at once through a spill file
+const long SPILL_BLOCK_ROWS = 1 << 16;
+
+inline void set_slot(const Record &r, Record *slot) {
+  *slot = r;
+  slot->next = nullptr;
+}
+
+inline void set_slot(const Record &r, CompactRecord *slot) {
+  *slot = {r.source, r.target, r.first_n, r.next_e, (float) r.cost};
+}
+
+bool read_spill_file(const std::string &filename, std::vector<Record> *rows) {
+  rows->clear();
+  FILE *stream = fopen(filename.c_str(), "rb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open spill file {}", filename);
+    return false;
+  }
+  size_t n;
+  do {
+    size_t size = rows->size();
+    rows->resize(size + SPILL_BLOCK_ROWS);
+    n = fread(rows->data() + size, sizeof(Record), SPILL_BLOCK_ROWS, stream);
+    rows->resize(size + n);
+  } while (n == (size_t) SPILL_BLOCK_ROWS);
+  fclose(stream);
+  return true;
+}
+
+// Write the slots of a table whose rows are partitioned into files of
+// consecutive slot ranges. A row probing past the end of its range
+// moves on to the next one, and the rows probing past the last range
+// wrap around to the first one, which is updated in the output.
+template<typename T>
+bool write_slot_ranges(FILE *output, const std::vector<std::string> &files,
+                       unsigned long long num_slots) {
+  unsigned long long mask = num_slots - 1;
+  unsigned long long range = num_slots / files.size();
+  std::vector<T> slots(range);
+  std::vector<Record> rows, carry, next_carry;
+  for (size_t p = 0; p < files.size(); ++p) {
+    unsigned long long first = p * range;
+    for (T &slot : slots) slot.source = UBODT::EMPTY_SLOT;
+    if (!read_spill_file(files[p], &rows)) return false;
+    next_carry.clear();
+    auto place = [&](const Record &r, unsigned long long i) {
+      while (i < range && slots[i].source != UBODT::EMPTY_SLOT) ++i;
+      if (i == range) {
+        next_carry.push_back(r);
+      } else {
+        set_slot(r, &slots[i]);
       }
-      for (int e:segs) {
-        cpath.push_back(edges[e].id);
-        ++current_idx;
+    };
+    for (const Record &r : carry) place(r, 0);
+    for (const Record &r : rows) {
+      place(r, (hash_od(r.source, r.target) & mask) - first);
+    }
+    carry.swap(next_carry);
+    if (fwrite(slots.data(), sizeof(T), range, output) != range) {
+      return false;
+    }
+  }
+  unsigned long long i = 0;
+  for (const Record &r : carry) {
+    T slot;
+    do {
+      if (i == num_slots ||
+          fseeko(output, sizeof(MmapHeader) + i * sizeof(T), SEEK_SET) != 0 ||
+          fread(&slot, sizeof(T), 1, output) != 1) {
+        return false;
       }
-      cpath.push_back(b->edge->id);
-      ++current_idx;
-      indices->push_back(current_idx);
-    } else {
-      indices->push_back(current_idx);
+      ++i;
+    } while (slot.source != UBODT::EMPTY_SLOT);
+    set_slot(r, &slot);
+    if (fseeko(output, sizeof(MmapHeader) + (i - 1) * sizeof(T),
+               SEEK_SET) != 0 ||
+        fwrite(&slot, sizeof(T), 1, output) != 1) {
+      return false;
     }
   }
-  return cpath;
+  return true;
 }
 
-double UBODT::get_delta() const {
-  return delta;
+} // namespace
+
+UBODTImageWriter::UBODTImageWriter(const std::string &filename_arg,
+                                   int multiplier_arg, bool compact_arg,
+                                   long long memory_bytes_arg) :
+    filename(filename_arg), multiplier(multiplier_arg),
+    compact(compact_arg), memory_bytes(memory_bytes_arg) {
+  spill_files.push_back(filename + ".spill");
+  spill = fopen(spill_files[0].c_str(), "w+b");
+  if (spill == nullptr) {
+    SPDLOG_CRITICAL("Failed to open spill file {}", spill_files[0]);
+  }
 }
 
-unsigned int UBODT::cal_bucket_index(NodeIndex source, NodeIndex target) const {
-  return (source * multiplier + target) % buckets;
+UBODTImageWriter::~UBODTImageWriter() {
+  if (spill != nullptr) fclose(spill);
+  for (const std::string &file : spill_files) std::remove(file.c_str());
 }
 
+bool UBODTImageWriter::add(const std::vector<Record> &records) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (spill == nullptr) return false;
+  if (fwrite(records.data(), sizeof(Record), records.size(), spill) !=
+      records.size()) {
+    SPDLOG_CRITICAL("Failed to write spill file {}", spill_files[0]);
+    fclose(spill);
+    spill = nullptr;
+    return false;
+  }
+  num_rows += records.size();
+  for (const Record &r : records) {
+    if (r.cost > delta) delta = r.cost;
+  }
+  return true;
+}
 
-void UBODT::insert(Record *r) {
-  //int h = (r->source*multiplier+r->target)%buckets ;
-  int h = cal_bucket_index(r->source, r->target);
-  r->next = hashtable[h];
-  hashtable[h] = r;
-  if (r->cost > delta) delta = r->cost;
+long UBODTImageWriter::get_num_rows() const {
+  return num_rows;
 }
 
-long UBODT::estimate_ubodt_rows(const std::string &filename) {
-  struct stat stat_buf;
-  long rc = stat(filename.c_str(), &stat_buf);
-  if (rc == 0) {
-    int file_bytes = stat_buf.st_size;
-    SPDLOG_TRACE("UBODT file size is {} bytes", file_bytes);
-    std::string fn_extension = filename.substr(filename.find_last_of(".") + 1);
-    std::transform(fn_extension.begin(),
-                   fn_extension.end(),
-                   fn_extension.begin(),
-                   [](unsigned char c) { return std::tolower(c); });
-    if (fn_extension == "csv" || fn_extension == "txt") {
-      int row_size = 36;
-      return file_bytes / row_size;
-    } else if (fn_extension == "bin" || fn_extension == "binary") {
-      Record r;
-      // When exporting to a file using boost binary writer,
-      // the padding is removed.
-      int row_size = 28;
-      return file_bytes / row_size;
+bool UBODTImageWriter::scatter(unsigned long long num_slots,
+                               const std::vector<std::string> &files) {
+  unsigned long long mask = num_slots - 1;
+  unsigned long long range = num_slots / files.size();
+  std::vector<FILE *> streams;
+  bool success = true;
+  for (const std::string &file : files) {
+    spill_files.push_back(file);
+    streams.push_back(fopen(file.c_str(), "wb"));
+    if (streams.back() == nullptr) {
+      SPDLOG_CRITICAL("Failed to open spill file {}", file);
+      success = false;
     }
   }
-  return -1;
+  std::vector<Record> block(SPILL_BLOCK_ROWS);
+  rewind(spill);
+  size_t n;
+  while (success &&
+         (n = fread(block.data(), sizeof(Record), SPILL_BLOCK_ROWS,
+                    spill)) > 0) {
+    for (size_t i = 0; i < n && success; ++i) {
+      const Record &r = block[i];
+      FILE *stream = streams[(hash_od(r.source, r.target) & mask) / range];
+      success = fwrite(&r, sizeof(Record), 1, stream) == 1;
+    }
+  }
+  for (FILE *stream : streams) {
+    if (stream != nullptr && fclose(stream) != 0) success = false;
+  }
+  // The spilled rows are no longer needed
+  fclose(spill);
+  spill = nullptr;
+  std::remove(spill_files[0].c_str());
+  return success;
 }
 
-int UBODT::find_prime_number(double value) {
-  std::vector<int> prime_numbers = {
-      5003, 10039, 20029, 50047, 100669, 200003, 500000,
-      1000039, 2000083, 5000101, 10000103, 20000033};
-  int N = prime_numbers.size();
-  for (int i = 0; i < N; ++i) {
-    if (value <= prime_numbers[i]) {
-      return prime_numbers[i];
+bool UBODTImageWriter::finish() {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (spill == nullptr || fflush(spill) != 0) return false;
+  unsigned long long num_slots = 1024;
+  while (num_slots * UBODT::FLAT_LOAD_FACTOR < num_rows) num_slots <<= 1;
+  size_t slot_size = compact ? sizeof(CompactRecord) : sizeof(Record);
+  // A partition holds its slots and its rows
+  unsigned long long range = num_slots;
+  unsigned long long budget = memory_bytes;
+  while (range > MIN_PARTITION_SLOTS &&
+         range * (slot_size + sizeof(Record)) > budget) {
+    range >>= 1;
+  }
+  long num_partitions = num_slots / range;
+  SPDLOG_INFO("Write UBODT (mmap format) of rows {} slots {} in {} "
+              "partitions to {}", num_rows, num_slots, num_partitions,
+              filename);
+  std::vector<std::string> files;
+  if (num_partitions == 1) {
+    files.push_back(spill_files[0]);
+  } else {
+    for (long p = 0; p < num_partitions; ++p) {
+      files.push_back(filename + ".spill." + std::to_string(p));
     }
+    if (!scatter(num_slots, files)) return false;
   }
-  return prime_numbers[N - 1];
+  FILE *output = fopen(filename.c_str(), "w+b");
+  if (output == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return false;
+  }
+  MmapHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, MMAP_MAGIC, sizeof(MMAP_MAGIC));
+  header.version = UBODT::MMAP_VERSION;
+  header.layout = compact ? COMPACT : FLAT;
+  header.record_size = slot_size;
+  header.num_slots = num_slots;
+  header.num_rows = num_rows;
+  header.multiplier = multiplier;
+  header.buckets = UBODT::find_bucket_number(multiplier);
+  header.delta = delta;
+  bool success = fwrite(&header, sizeof(header), 1, output) == 1;
+  if (success) {
+    success = compact ?
+        write_slot_ranges<CompactRecord>(output, files, num_slots) :
+        write_slot_ranges<Record>(output, files, num_slots);
+  }
+  if (fclose(output) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write file {}", filename);
+    std::remove(filename.c_str());
+  }
+  return success;
+}
+
+bool UBODT::write_ubodt_compressed(const std::string &filename) const {
+  SPDLOG_INFO("Write UBODT (block compressed format) to {}", filename);
+  std::vector<Record> rows;
+  rows.reserve(num_rows);
+  bool no_prev = true;
+  for_each_record([&rows, &no_prev](const Record &r) {
+    rows.push_back(r);
+    if (r.prev_n != EMPTY_SLOT) no_prev = false;
+  });
+  std::sort(rows.begin(), rows.end(), [](const Record &a, const Record &b) {
+    return a.source < b.source ||
+        (a.source == b.source && a.target < b.target);
+  });
+  // Split the rows into blocks of whole sources
+  std::vector<long> bounds = {0};
+  long n = rows.size();
+  while (bounds.back() < n) {
+    long end = std::min(bounds.back() + COMPRESS_BLOCK_ROWS, n);
+    while (end < n && rows[end].source == rows[end - 1].source) ++end;
+    bounds.push_back(end);
+  }
+  long num_blocks = bounds.size() - 1;
+  std::vector<std::string> blocks(num_blocks);
+  std::vector<BlockIndexEntry> index(num_blocks);
+  bool success = true;
+#pragma omp parallel for schedule(dynamic) reduction(&&:success)
+  for (long i = 0; i < num_blocks; ++i) {
+    const Record *first = rows.data() + bounds[i];
+    long block_rows = bounds[i + 1] - bounds[i];
+    std::string raw;
+    encode_block(first, block_rows, first->source, no_prev, &raw);
+    uLongf compressed_size = compressBound(raw.size());
+    blocks[i].resize(compressed_size);
+    if (compress2((Bytef *) &blocks[i][0], &compressed_size,
+                  (const Bytef *) raw.data(), raw.size(),
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+      success = false;
+    }
+    blocks[i].resize(compressed_size);
+    index[i].first_source = first->source;
+    index[i].last_source = first[block_rows - 1].source;
+    index[i].compressed_size = compressed_size;
+    index[i].raw_size = raw.size();
+    index[i].num_rows = block_rows;
+  }
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to compress UBODT");
+    return false;
+  }
+  FILE *stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return false;
+  }
+  BlockHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+  header.version = COMPRESS_VERSION;
+  header.flags = no_prev ? BLOCK_FLAG_NO_PREV : 0;
+  header.num_rows = n;
+  header.num_blocks = num_blocks;
+  header.multiplier = multiplier;
+  header.buckets = buckets;
+  header.delta = delta;
+  long long offset = sizeof(BlockHeader);
+  for (long i = 0; i < num_blocks; ++i) {
+    index[i].offset = offset;
+    offset += index[i].compressed_size;
+  }
+  header.index_offset = offset;
+  success = fwrite(&header, sizeof(header), 1, stream) == 1;
+  for (long i = 0; i < num_blocks && success; ++i) {
+    success = fwrite(blocks[i].data(), 1, blocks[i].size(), stream) ==
+        blocks[i].size();
+  }
+  if (success && num_blocks > 0) {
+    success = fwrite(index.data(), sizeof(BlockIndexEntry), num_blocks,
+                     stream) == (size_t) num_blocks;
+  }
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write UBODT file {}", filename);
+  } else {
+    SPDLOG_INFO("Rows {} blocks {} bytes {}", n, num_blocks,
+                offset + num_blocks * sizeof(BlockIndexEntry));
+  }
+  return success;
+}
+
+std::shared_ptr<UBODT> UBODT::read_ubodt_compressed(
+    const std::string &filename, UBODTLayout layout) {
+  SPDLOG_INFO("Reading UBODT file (block compressed format) from {}",
+              filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    return nullptr;
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  void *addr = nullptr;
+  if (file_size >= sizeof(BlockHeader)) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map UBODT file {}", filename);
+    return nullptr;
+  }
+  const BlockHeader *header = (const BlockHeader *) addr;
+  const unsigned char *data = (const unsigned char *) addr;
+  long num_blocks = header->num_blocks;
+  if (memcmp(header->magic, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0 ||
+      header->version != COMPRESS_VERSION || num_blocks < 0 ||
+      header->index_offset < (long long) sizeof(BlockHeader) ||
+      file_size != header->index_offset +
+          num_blocks * sizeof(BlockIndexEntry)) {
+    SPDLOG_CRITICAL("Invalid or incompatible UBODT file {}", filename);
+    munmap(addr, file_size);
+    return nullptr;
+  }
+  const BlockIndexEntry *index =
+      (const BlockIndexEntry *) (data + header->index_offset);
+  // Find where the records of each block are stored
+  std::vector<long> offsets(num_blocks + 1, 0);
+  for (long i = 0; i < num_blocks; ++i) {
+    offsets[i + 1] = offsets[i] + index[i].num_rows;
+  }
+  long rows = offsets[num_blocks];
+  if (rows != header->num_rows) {
+    SPDLOG_CRITICAL("Corrupted UBODT file {}", filename);
+    munmap(addr, file_size);
+    return nullptr;
+  }
+  bool no_prev = (header->flags & BLOCK_FLAG_NO_PREV) != 0;
+  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(
+      find_bucket_number(rows / LOAD_FACTOR), header->multiplier, rows,
+      layout);
+  Record *storage = nullptr;
+  if (layout == CHAINED) {
+    storage = table->allocate_block(rows);
+  } else if (layout == CSR) {
+    table->csr_rows.resize(rows);
+    storage = table->csr_rows.data();
+  }
+  // Inside the loop, success is the copy of a thread, which is only
+  // reduced once the loop ends
+  bool success = true;
+#pragma omp parallel for schedule(dynamic) reduction(&&:success)
+  for (long i = 0; i < num_blocks; ++i) {
+    const BlockIndexEntry &entry = index[i];
+    if (entry.offset < (long long) sizeof(BlockHeader) ||
+        entry.offset + entry.compressed_size > header->index_offset) {
+      success = false;
+      continue;
+    }
+    std::vector<unsigned char> raw(entry.raw_size);
+    uLongf raw_size = entry.raw_size;
+    std::vector<Record> local;
+    Record *block_rows = storage + offsets[i];
+    if (storage == nullptr) {
+      local.resize(entry.num_rows);
+      block_rows = local.data();
+    }
+    if (uncompress(raw.data(), &raw_size, data + entry.offset,
+                   entry.compressed_size) != Z_OK ||
+        raw_size != (uLongf) entry.raw_size ||
+        !decode_block(raw.data(), raw.data() + raw_size, entry.first_source,
+                      no_prev, entry.num_rows, block_rows)) {
+      success = false;
+      continue;
+    }
+    for (long j = 0; j < entry.num_rows; ++j) {
+      table->insert_parallel(block_rows + j);
+    }
+  }
+  table->num_rows = rows;
+  table->delta = header->delta;
+  munmap(addr, file_size);
+  if (!success) {
+    SPDLOG_CRITICAL("Corrupted UBODT file {}", filename);
+    return nullptr;
+  }
+  table->finish_insert();
+  table->print_chain_distribution();
+  SPDLOG_INFO("Finish reading UBODT with rows {}", rows);
+  return table;
+}
+
+bool UBODT::string2layout(const std::string &name, UBODTLayout *layout) {
+  if (name == "chained") {
+    *layout = CHAINED;
+  } else if (name == "flat") {
+    *layout = FLAT;
+  } else if (name == "compact") {
+    *layout = COMPACT;
+  } else if (name == "split") {
+    *layout = SPLIT;
+  } else if (name == "csr") {
+    *layout = CSR;
+  } else if (name == "lazy") {
+    *layout = LAZY;
+  } else {
+    return false;
+  }
+  return true;
 }
 
 std::shared_ptr<UBODT> UBODT::read_ubodt_file(const std::string &filename,
-    int multiplier) {
+    int multiplier, UBODTLayout layout, bool parallel,
+    const std::vector<char> *nodes) {
+  if (layout == LAZY) {
+    SPDLOG_CRITICAL("Lazy UBODT is created from a network graph");
+    std::exit(EXIT_FAILURE);
+  }
   if (UTIL::check_file_extension(filename,"bin")){
-    return read_ubodt_binary(filename,multiplier);
-  } else if (UTIL::check_file_extension(filename,"csv,txt")) {
-    return read_ubodt_csv(filename,multiplier);
+    return read_ubodt_binary(filename,multiplier,layout,nodes,parallel);
+  } else if (UTIL::check_file_extension(filename,"csv,txt,gz")) {
+    // A gzip file is decompressed as a stream
+    if (parallel && !UTIL::check_file_extension(filename,"gz")) {
+      std::shared_ptr<UBODT> table =
+          read_ubodt_csv_parallel(filename,multiplier,layout,nodes);
+      if (table == nullptr) std::exit(EXIT_FAILURE);
+      return table;
+    }
+    return read_ubodt_csv(filename,multiplier,layout,nodes);
+  } else if (UTIL::check_file_extension(filename,"mmap")) {
+    std::shared_ptr<UBODT> table = read_ubodt_mmap(filename);
+    if (table == nullptr) std::exit(EXIT_FAILURE);
+    return table;
+  } else if (UTIL::check_file_extension(filename,"ubz")) {
+    std::shared_ptr<UBODT> table = read_ubodt_compressed(filename, layout);
+    if (table == nullptr) std::exit(EXIT_FAILURE);
+    return table;
+  } else if (filename.compare(0, SHM_PREFIX.size(), SHM_PREFIX) == 0) {
+    std::shared_ptr<UBODT> table =
+        attach_ubodt_shm(filename.substr(SHM_PREFIX.size()));
+    if (table == nullptr) std::exit(EXIT_FAILURE);
+    return table;
+  } else if (UTIL::check_file_extension(filename,"tiles")) {
+    std::shared_ptr<UBODT> table = read_ubodt_tiled(filename);
+    if (table == nullptr) std::exit(EXIT_FAILURE);
+    return table;
   } else {
     SPDLOG_CRITICAL("File format not support: {}",filename);
     std::exit(EXIT_FAILURE);
@@ -172,55 +3230,331 @@ std::shared_ptr<UBODT> UBODT::read_ubodt_file(const std::string &filename,
 
 
 std::shared_ptr<UBODT> UBODT::read_ubodt_csv(const std::string &filename,
-                                             int multiplier) {
+                                             int multiplier,
+                                             UBODTLayout layout,
+                                             const std::vector<char> *nodes) {
   SPDLOG_INFO("Reading UBODT file (CSV format) from {}", filename);
-  long rows = estimate_ubodt_rows(filename);
-  int buckets = find_prime_number(rows / LOAD_FACTOR);
+  long rows = estimate_kept_rows(estimate_ubodt_rows(filename), nodes);
+  long long buckets = find_bucket_number(rows / LOAD_FACTOR);
   SPDLOG_TRACE("Estimated buckets {}", buckets);
   int progress_step = 1000000;
-  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(buckets, multiplier);
-  FILE *stream = fopen(filename.c_str(), "r");
+  std::shared_ptr<UBODT> table =
+      std::make_shared<UBODT>(buckets, multiplier, rows, layout);
+  // A file not compressed with gzip is read as it is
+  gzFile stream = gzopen(filename.c_str(), "rb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  gzbuffer(stream, 1 << 20);
   long NUM_ROWS = 0;
+  long skipped = 0;
   char line[BUFFER_LINE];
-  if (fgets(line, BUFFER_LINE, stream)) {
+  // A compact file written without prev_n has five columns
+  bool compact_file = false;
+  if (gzgets(stream, line, BUFFER_LINE)) {
+    compact_file = strstr(line, "prev_n") == nullptr;
     SPDLOG_TRACE("Header line skipped.");
   }
-  while (fgets(line, BUFFER_LINE, stream)) {
+  while (gzgets(stream, line, BUFFER_LINE)) {
     ++NUM_ROWS;
-    Record *r = (Record *) malloc(sizeof(Record));
+    Record r;
     /* Parse line into a Record */
-    sscanf(
-        line, "%d;%d;%d;%d;%d;%lf",
-        &r->source,
-        &r->target,
-        &r->first_n,
-        &r->prev_n,
-        &r->next_e,
-        &r->cost
-    );
-    r->next = nullptr;
-    table->insert(r);
+    if (compact_file) {
+      sscanf(
+          line, "%d;%d;%d;%d;%lf",
+          &r.source,
+          &r.target,
+          &r.first_n,
+          &r.next_e,
+          &r.cost
+      );
+      r.prev_n = EMPTY_SLOT;
+    } else {
+      sscanf(
+          line, "%d;%d;%d;%d;%d;%lf",
+          &r.source,
+          &r.target,
+          &r.first_n,
+          &r.prev_n,
+          &r.next_e,
+          &r.cost
+      );
+    }
+    r.next = nullptr;
+    if (keep_row(nodes, r)) {
+      table->insert(r);
+    } else {
+      ++skipped;
+    }
     if (NUM_ROWS % progress_step == 0) {
       SPDLOG_INFO("Read rows {}", NUM_ROWS);
     }
   }
-  fclose(stream);
-  double lf = NUM_ROWS / (double) buckets;
-  SPDLOG_TRACE("Estimated load factor #elements/#tablebuckets {}", lf);
-  if (lf > 10) { SPDLOG_WARN("Load factor is too large.") }
-  SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS);
+  gzclose(stream);
+  table->finish_insert();
+  table->print_chain_distribution();
+  if (nodes != nullptr) {
+    SPDLOG_INFO("Skip rows outside the nodes {}", skipped);
+  }
+  SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS - skipped);
+  return table;
+}
+
+std::shared_ptr<UBODT> UBODT::read_ubodt_csv_parallel(
+    const std::string &filename, int multiplier, UBODTLayout layout,
+    const std::vector<char> *nodes) {
+  SPDLOG_INFO("Reading UBODT file (CSV format) parallelly from {}", filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    return nullptr;
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  void *addr = nullptr;
+  if (file_size > 0) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map UBODT file {}", filename);
+    return nullptr;
+  }
+  madvise(addr, file_size, MADV_SEQUENTIAL);
+  const char *begin = (const char *) addr;
+  const char *end = begin + file_size;
+  const char *body = (const char *) memchr(begin, '\n', file_size);
+  body = (body == nullptr) ? end : body + 1;
+  // A compact file written without prev_n has five columns
+  const char *prev_n_column = "prev_n";
+  bool compact_file = std::search(begin, body, prev_n_column,
+                                  prev_n_column + 6) == body;
+  int num_threads = 1;
+#ifdef _OPENMP
+  num_threads = omp_get_max_threads();
+#endif
+  // Split the body into chunks starting at the beginning of a line
+  int num_chunks = num_threads * 4;
+  std::vector<const char *> bounds(num_chunks + 1);
+  bounds[0] = body;
+  bounds[num_chunks] = end;
+  for (int i = 1; i < num_chunks; ++i) {
+    const char *p = body + (end - body) * i / num_chunks;
+    if (p < bounds[i - 1]) p = bounds[i - 1];
+    const char *eol = (const char *) memchr(p, '\n', end - p);
+    bounds[i] = (eol == nullptr) ? end : eol + 1;
+  }
+  // Count the rows in each chunk to find where its records are stored,
+  // where a malformed row is counted to be reported when it is parsed
+  std::vector<long> offsets(num_chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < num_chunks; ++i) {
+    long rows = 0;
+    Record r;
+    const char *p = bounds[i];
+    while (p < bounds[i + 1]) {
+      const char *eol = (const char *) memchr(p, '\n', bounds[i + 1] - p);
+      if (eol == nullptr) eol = bounds[i + 1];
+      if (eol > p && nodes == nullptr) {
+        ++rows;
+      } else if (eol > p) {
+        std::string last_line;
+        const char *line = p;
+        if (eol == end) {
+          last_line.assign(p, eol);
+          line = last_line.c_str();
+        }
+        if (!parse_row(line, compact_file, &r) || keep_row(nodes, r)) ++rows;
+      }
+      p = eol + 1;
+    }
+    offsets[i + 1] = rows;
+  }
+  for (int i = 0; i < num_chunks; ++i) offsets[i + 1] += offsets[i];
+  long rows = offsets[num_chunks];
+  long long buckets = find_bucket_number(rows / LOAD_FACTOR);
+  SPDLOG_TRACE("Rows {} buckets {}", rows, buckets);
+  std::shared_ptr<UBODT> table =
+      std::make_shared<UBODT>(buckets, multiplier, rows, layout);
+  Record *storage = nullptr;
+  if (layout == CHAINED) {
+    storage = table->allocate_block(rows);
+  } else if (layout == CSR) {
+    table->csr_rows.resize(rows);
+    storage = table->csr_rows.data();
+  }
+  long num_rows = 0;
+  double delta = 0;
+  long malformed = 0;
+  long skipped = 0;
+#pragma omp parallel for schedule(dynamic) \
+    reduction(+:num_rows, malformed, skipped) reduction(max:delta)
+  for (int i = 0; i < num_chunks; ++i) {
+    long index = offsets[i];
+    Record local;
+    const char *p = bounds[i];
+    while (p < bounds[i + 1]) {
+      const char *eol = (const char *) memchr(p, '\n', bounds[i + 1] - p);
+      if (eol == nullptr) eol = bounds[i + 1];
+      if (eol > p) {
+        // The last line without a newline is copied, so that the
+        // parser never reads past the end of the mapping.
+        std::string last_line;
+        const char *line = p;
+        if (eol == end) {
+          last_line.assign(p, eol);
+          line = last_line.c_str();
+        }
+        bool parsed = parse_row(line, compact_file, &local);
+        if (parsed && !keep_row(nodes, local)) {
+          ++skipped;
+        } else {
+          Record *r = (storage == nullptr) ? &local : storage + index;
+          ++index;
+          if (r != &local) *r = local;
+          if (parsed) {
+            table->insert_parallel(r);
+            ++num_rows;
+            if (r->cost > delta) delta = r->cost;
+          } else {
+            r->source = EMPTY_SLOT;
+            ++malformed;
+          }
+        }
+      }
+      p = eol + 1;
+    }
+  }
+  munmap(addr, file_size);
+  table->num_rows = num_rows;
+  table->delta = delta;
+  table->finish_insert();
+  if (malformed > 0) {
+    SPDLOG_WARN("Skip malformed rows {}", malformed);
+  }
+  if (nodes != nullptr) {
+    SPDLOG_INFO("Skip rows outside the nodes {}", skipped);
+  }
+  table->print_chain_distribution();
+  SPDLOG_INFO("Finish reading UBODT with rows {}", num_rows);
   return table;
 }
 
-std::shared_ptr<UBODT> UBODT::read_ubodt_binary(const std::string &filename,
-                                                 int multiplier) {
+std::shared_ptr<UBODT> UBODT::read_ubodt_binary(
+    const std::string &filename, int multiplier, UBODTLayout layout,
+    const std::vector<char> *nodes, bool parallel) {
   SPDLOG_INFO("Reading UBODT file (binary format) from {}", filename);
-  long rows = estimate_ubodt_rows(filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open UBODT file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  const std::string &archive_header = get_archive_header();
+  void *addr = nullptr;
+  if (file_size >= archive_header.size()) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map UBODT file {}", filename);
+    std::exit(EXIT_FAILURE);
+  }
+  // An archive written by another version of boost is read field by field
+  if (std::memcmp(addr, archive_header.data(), archive_header.size()) != 0) {
+    munmap(addr, file_size);
+    SPDLOG_WARN("Unknown archive header of {}, read it with boost",
+                filename);
+    return read_ubodt_archive(filename, multiplier, layout, nodes);
+  }
+  madvise(addr, file_size, MADV_SEQUENTIAL);
+  const char *body = (const char *) addr + archive_header.size();
+  long long file_rows = (file_size - archive_header.size()) /
+      BINARY_ROW_SIZE;
+  if (file_rows * BINARY_ROW_SIZE + archive_header.size() != file_size) {
+    SPDLOG_WARN("Skip the trailing bytes of a partial row in {}", filename);
+  }
+  int num_threads = 1;
+#ifdef _OPENMP
+  if (parallel) num_threads = omp_get_max_threads();
+#endif
+  // The rows are split into chunks, where the rows kept in each chunk are
+  // counted first to find where its records are stored
+  long long num_chunks = std::min<long long>(num_threads * 4,
+                                             std::max(file_rows, 1LL));
+  std::vector<long long> offsets(num_chunks + 1, 0);
+#pragma omp parallel for schedule(dynamic) if(parallel)
+  for (long long i = 0; i < num_chunks; ++i) {
+    long long first = file_rows * i / num_chunks;
+    long long last = file_rows * (i + 1) / num_chunks;
+    long long rows = last - first;
+    if (nodes != nullptr) {
+      Record r;
+      rows = 0;
+      for (long long j = first; j < last; ++j) {
+        decode_binary_row(body + j * BINARY_ROW_SIZE, &r);
+        if (keep_row(nodes, r)) ++rows;
+      }
+    }
+    offsets[i + 1] = rows;
+  }
+  for (long long i = 0; i < num_chunks; ++i) offsets[i + 1] += offsets[i];
+  long long rows = offsets[num_chunks];
+  long long buckets = find_bucket_number(rows / LOAD_FACTOR);
+  SPDLOG_TRACE("Rows {} buckets {}", rows, buckets);
+  std::shared_ptr<UBODT> table =
+      std::make_shared<UBODT>(buckets, multiplier, rows, layout);
+  Record *storage = nullptr;
+  if (layout == CHAINED) {
+    storage = table->allocate_block(rows);
+  } else if (layout == CSR) {
+    table->csr_rows.resize(rows);
+    storage = table->csr_rows.data();
+  }
+  double delta = 0;
+#pragma omp parallel for schedule(dynamic) reduction(max:delta) if(parallel)
+  for (long long i = 0; i < num_chunks; ++i) {
+    long long index = offsets[i];
+    long long last = file_rows * (i + 1) / num_chunks;
+    Record local;
+    for (long long j = file_rows * i / num_chunks; j < last; ++j) {
+      decode_binary_row(body + j * BINARY_ROW_SIZE, &local);
+      if (!keep_row(nodes, local)) continue;
+      Record *r = (storage == nullptr) ? &local : storage + index;
+      ++index;
+      if (r != &local) *r = local;
+      table->insert_parallel(r);
+      if (r->cost > delta) delta = r->cost;
+    }
+  }
+  munmap(addr, file_size);
+  table->num_rows = rows;
+  table->delta = delta;
+  table->finish_insert();
+  table->print_chain_distribution();
+  if (nodes != nullptr) {
+    SPDLOG_INFO("Skip rows outside the nodes {}", file_rows - rows);
+  }
+  SPDLOG_INFO("Finish reading UBODT with rows {}", rows);
+  return table;
+}
+
+std::shared_ptr<UBODT> UBODT::read_ubodt_archive(
+    const std::string &filename, int multiplier, UBODTLayout layout,
+    const std::vector<char> *nodes) {
+  SPDLOG_INFO("Reading UBODT file (boost archive) from {}", filename);
+  long rows = estimate_kept_rows(estimate_ubodt_rows(filename), nodes);
   int progress_step = 1000000;
   SPDLOG_TRACE("Estimated rows is {}", rows);
-  int buckets = find_prime_number(rows / LOAD_FACTOR);
-  std::shared_ptr<UBODT> table = std::make_shared<UBODT>(buckets, multiplier);
+  long long buckets = find_bucket_number(rows / LOAD_FACTOR);
+  std::shared_ptr<UBODT> table =
+      std::make_shared<UBODT>(buckets, multiplier, rows, layout);
   long NUM_ROWS = 0;
+  long skipped = 0;
   std::ifstream ifs(filename.c_str());
   // Check byte offset
   std::streampos archiveOffset = ifs.tellg();
@@ -229,25 +3563,29 @@ std::shared_ptr<UBODT> UBODT::read_ubodt_binary(const std::string &filename,
   boost::archive::binary_iarchive ia(ifs);
   while (ifs.tellg() < streamEnd) {
     ++NUM_ROWS;
-    Record *r = (Record *) malloc(sizeof(Record));
-    ia >> r->source;
-    ia >> r->target;
-    ia >> r->first_n;
-    ia >> r->prev_n;
-    ia >> r->next_e;
-    ia >> r->cost;
-    r->next = nullptr;
-    table->insert(r);
+    Record r;
+    ia >> r.source;
+    ia >> r.target;
+    ia >> r.first_n;
+    ia >> r.prev_n;
+    ia >> r.next_e;
+    ia >> r.cost;
+    r.next = nullptr;
+    if (keep_row(nodes, r)) {
+      table->insert(r);
+    } else {
+      ++skipped;
+    }
     if (NUM_ROWS % progress_step == 0) {
       SPDLOG_INFO("Read rows {}", NUM_ROWS);
     }
   }
   ifs.close();
-  double lf = NUM_ROWS / (double) buckets;
-  SPDLOG_TRACE("Estimated load factor #elements/#tablebuckets {}", lf);
-  if (lf > 10) {
-    SPDLOG_WARN("Load factor is too large.")
+  table->finish_insert();
+  table->print_chain_distribution();
+  if (nodes != nullptr) {
+    SPDLOG_INFO("Skip rows outside the nodes {}", skipped);
   }
-  SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS)
+  SPDLOG_INFO("Finish reading UBODT with rows {}", NUM_ROWS - skipped)
   return table;
 }
@@ -11,8 +11,19 @@
 #define FMM_UBODT_H_
 
 #include "network/type.hpp"
+#include "network/network_graph.hpp"
+#include "network/chain_graph.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "network/edge_closures.hpp"
 #include "mm/transition_graph.hpp"
+#include "python/pyfmm.hpp"
 #include "util/debug.hpp"
+#include "util/metrics.hpp"
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 namespace FMM {
 namespace MM {
@@ -30,6 +41,67 @@ struct Record {
   Record *next; /**< the next record stored in hashtable */
 };
 
+/**
+ * Compact record of UBODT, which keeps only the fields used in map
+ * matching and stores the cost in single precision.
+ */
+struct CompactRecord {
+  NETWORK::NodeIndex source; /**< source node*/
+  NETWORK::NodeIndex target; /**< target node*/
+  NETWORK::NodeIndex first_n; /**< next node visited from source to target */
+  NETWORK::EdgeIndex next_e; /**< next edge visited from source to target */
+  float cost; /**< distance from source to target */
+};
+
+/**
+ * Hot part of a record of the split layout, which keeps the fields
+ * probed when the cost of an od pair is queried, with the cost in single
+ * precision.
+ */
+struct HotRecord {
+  NETWORK::NodeIndex source; /**< source node*/
+  NETWORK::NodeIndex target; /**< target node*/
+  float cost; /**< distance from source to target */
+};
+
+/**
+ * Cold part of a record of the split layout, stored at the index of its
+ * hot part and only read when a path is unrolled.
+ */
+struct ColdRecord {
+  NETWORK::NodeIndex first_n; /**< next node visited from source to target */
+  NETWORK::EdgeIndex next_e; /**< next edge visited from source to target */
+};
+
+/**
+ * Storage layout of the records in UBODT
+ */
+enum UBODTLayout {
+  CHAINED = 0, /**< Buckets of records linked by the next pointer */
+  FLAT = 1, /**< Open addressing table with records stored inline */
+  COMPACT = 2, /**< Open addressing table with compact records stored inline */
+  CSR = 3, /**< Records grouped by source in compressed sparse rows,
+               sorted by target within each group */
+  LAZY = 4, /**< Records of a source computed on the first query with
+                the network graph and kept in a bounded cache */
+  TILED = 5, /**< Records split by the spatial tile of the source into
+                 memory mapped files, which are mapped on demand */
+  SPLIT = 6 /**< Open addressing table with the od pair and cost of the
+                records, and a parallel array with their next node and
+                edge */
+};
+
+/**
+ * Counters of the cache of a lazy UBODT, or of the tiles of a tiled
+ * UBODT, where a tile loaded is counted as a miss
+ */
+struct UBODTCacheStatistics {
+  long hits = 0; /**< Queries of a source cached */
+  long misses = 0; /**< Sources computed or tiles loaded */
+  long evictions = 0; /**< Sources or tiles evicted */
+  long resident = 0; /**< Rows cached or tiles mapped */
+};
+
 /**
  * Upperbounded origin destination table
  */
@@ -39,21 +111,108 @@ class UBODT {
   UBODT &operator=(const UBODT &) = delete;
   /**
    * Constructor of UBODT from bucket number and multiplier
-   * @param buckets_arg    Bucket number
-   * @param multiplier_arg A multiplier used for querying, recommended to be
-   * the number of nodes in the graph.
+   * @param buckets_arg    Bucket number, which is rounded up to a power
+   * of two
+   * @param multiplier_arg A multiplier kept for compatibility, the bucket
+   * index is calculated with a mixing hash of the OD pair instead.
+   * @param capacity_arg   Expected number of records, used to size the
+   * first slab of record storage or the flat table. If not positive,
+   * a default size is used.
+   * @param layout_arg     Storage layout of the records
    */
-  UBODT(int buckets_arg, int multiplier_arg);
+  UBODT(long long buckets_arg, int multiplier_arg, long capacity_arg = 0,
+        UBODTLayout layout_arg = CHAINED);
   ~UBODT();
   /**
    * Look up the row according to a source node and a target node
    * @param  source source node
    * @param  target target node
    * @return  A row in the ubodt if the od pair is found, otherwise nullptr
-   * is returned.
+   * is returned. For the compact, split, lazy and tiled layouts, the row
+   * is a copy owned by the calling thread, which is valid until its next
+   * look up. The compact and split layouts have no prev_n stored. For a
+   * pair of a symmetric UBODT stored from its target, the row is also a
+   * copy, whose first_n, prev_n and next_e describe the path from the
+   * source.
    */
   Record *look_up(NETWORK::NodeIndex source, NETWORK::NodeIndex target) const;
 
+  /**
+   * Look up the shortest path distance from a source node to a target node
+   * @param  source source node
+   * @param  target target node
+   * @param  cost   the distance found
+   * @return true if the od pair is found
+   */
+  bool look_up_cost(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    double *cost) const;
+
+  /**
+   * Look up the cost of the shortest path from a source node to a target
+   * node under a metric, where the path is the one by length
+   * @param  source source node
+   * @param  target target node
+   * @param  metric index of the metric, 0 for the length and i for the
+   * extra cost i-1 stored by build_metric_costs
+   * @param  cost   the cost found
+   * @return true if the od pair is found. The extra costs are only
+   * stored for the records, so the long range tier and the closed edges
+   * are not consulted for them.
+   */
+  bool look_up_cost(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    int metric, double *cost) const;
+
+  /**
+   * Look up the shortest path distances from a source node to several
+   * target nodes. For the CSR layout, all the probes fall in the
+   * contiguous group of the source.
+   * @param  source  source node
+   * @param  targets target nodes
+   * @param  costs   the distance to each target, which is negative if
+   * the od pair is not found
+   */
+  void look_up_many(NETWORK::NodeIndex source,
+                    const std::vector<NETWORK::NodeIndex> &targets,
+                    std::vector<double> *costs) const;
+
+  /**
+   * Look up the shortest path distances of all the pairs of several
+   * source and target nodes. The hash slots of a group of pairs are
+   * computed and prefetched before any of them is resolved, so that the
+   * cache misses of the group overlap.
+   * @param  sources source nodes
+   * @param  targets target nodes
+   * @param  costs   the distance of source i to target j stored at
+   * i * targets.size() + j, which is negative if the od pair is not found
+   */
+  void look_up_batch(const std::vector<NETWORK::NodeIndex> &sources,
+                     const std::vector<NETWORK::NodeIndex> &targets,
+                     std::vector<double> *costs) const;
+
+  /**
+   * Look up the shortest path distances of od pairs given one by one,
+   * whose hash slots are prefetched in groups as in look_up_batch
+   * @param  sources source node of each pair
+   * @param  targets target node of each pair
+   * @param  costs   the distance of each pair, which is negative if the
+   * od pair is not found
+   */
+  void look_up_pairs(const std::vector<NETWORK::NodeIndex> &sources,
+                     const std::vector<NETWORK::NodeIndex> &targets,
+                     std::vector<double> *costs) const;
+
+  /**
+   * Prefetch the hash slots of all the pairs of several source and
+   * target nodes, without waiting for them. A matcher interleaving
+   * several trajectories issues the prefetches of one of them and works
+   * on the other ones while the lines arrive, before look_up_batch.
+   * The layouts without hash slots are left as they are.
+   * @param  sources source nodes
+   * @param  targets target nodes
+   */
+  void prefetch_batch(const std::vector<NETWORK::NodeIndex> &sources,
+                      const std::vector<NETWORK::NodeIndex> &targets) const;
+
   /**
    * Look up a shortest path (SP) containing edges from source to target.
    * In case that SP is not found, empty is returned.
@@ -63,6 +222,31 @@ class UBODT {
    */
   std::vector<NETWORK::EdgeIndex> look_sp_path(NETWORK::NodeIndex source,
       NETWORK::NodeIndex target) const;
+  /**
+   * Look up a shortest path into a buffer, which keeps its capacity
+   * between the look ups
+   * @param source source node
+   * @param target target node
+   * @param edges  updated with the edges of the path, empty if the path
+   * is not found
+   */
+  void look_sp_path(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    std::vector<NETWORK::EdgeIndex> *edges) const;
+  /**
+   * Look up the distances and the shortest paths of od pairs given as
+   * contiguous arrays, which are run in parallel for the NumPy Python API
+   * @param  sources     source node of each pair
+   * @param  num_sources number of sources
+   * @param  targets     target node of each pair
+   * @param  num_targets number of targets, which should be num_sources
+   * @param  num_threads number of threads, 0 for the number of cores
+   * @return the distance and the edges of the path of each pair, whose
+   * distance is infinity if the pair is not found
+   */
+  PYTHON::PyPathArrays look_sp_paths(
+      const unsigned int *sources, int num_sources,
+      const unsigned int *targets, int num_targets,
+      int num_threads = 0) const;
 
   /**
    * Construct the complete path (a vector of edge ID) from an optimal path
@@ -71,6 +255,8 @@ class UBODT {
    * @param path an optimal path
    * @param edges a vector of edges
    * @param indices the index of each optimal edge in the complete path
+   * @param index_path if not nullptr, updated with the complete path
+   * stored with edge index
    * @return a complete path (topologically connected).
    * If there is a large gap in the optimal
    * path implying complete path cannot be found in UBDOT,
@@ -78,53 +264,519 @@ class UBODT {
    */
   C_Path construct_complete_path(const TGOpath &path,
                                  const std::vector<NETWORK::Edge> &edges,
-                                 std::vector<int> *indices) const;
+                                 std::vector<int> *indices,
+                                 std::vector<NETWORK::EdgeIndex> *index_path =
+                                     nullptr) const;
   /**
-   * Get the upperbound of the UBODT
+   * Get the upperbound of the UBODT, which is the one of the long range
+   * tier if it is attached
    * @return upperbound value
    */
   double get_delta() const;
+  /**
+   * Attach a long range tier answering the OD pairs missing in the
+   * records up to a larger upperbound, with the queries of a contraction
+   * hierarchy. The look ups of costs and paths consult the records first
+   * and the hierarchy on a miss, so that the records only need a small
+   * delta covering the frequent short transitions.
+   * @param  hierarchy  hierarchy of the network, built with a delta not
+   * smaller than long_delta
+   * @param  long_delta upperbound of the long range tier
+   * @return false if long_delta is not larger than the delta of the
+   * records
+   */
+  bool set_long_range(
+      std::shared_ptr<const NETWORK::ContractionHierarchy> hierarchy,
+      double long_delta);
+  /**
+   * Check if a long range tier is attached
+   */
+  bool has_long_range() const;
+  /**
+   * Mark the records as stored once for each unordered od pair, from the
+   * smaller node to the larger one, as generated by ubodt_gen with
+   * symmetric on a network whose edges are the same in both directions.
+   * The look ups of a pair from the larger node are answered by the
+   * record of the pair reversed, whose path is walked back through the
+   * prev_n of the records and the shortest edges of the graph.
+   * @param  graph graph of the network, which should outlive the UBODT
+   * @return false if the graph is not symmetric, or the layout is not
+   * chained, flat or csr, which are the ones storing prev_n, or the
+   * paths are unrolled or metric costs are stored
+   */
+  bool set_symmetric(const NETWORK::NetworkGraph &graph);
+  /**
+   * Check if the records are stored once for each unordered od pair
+   */
+  bool is_symmetric() const;
+  /**
+   * Mark the records as generated by ubodt_gen with compress_chains on
+   * the graph of the chains of the network, so that they only connect
+   * junctions and their edges are chains. The look ups of a node inside
+   * a chain walk along the chain to the junctions at its ends, and the
+   * paths found are expanded into the edges of the network.
+   * @param  chains chains of the network
+   * @return false if the UBODT is lazy or symmetric, or metric costs
+   * are stored
+   */
+  bool set_chains(std::shared_ptr<const NETWORK::ChainGraph> chains);
+  /**
+   * Check if the records are generated on the graph of the chains
+   */
+  bool has_chains() const;
+  /**
+   * Attach an overlay of closed edges. The look ups of costs and paths
+   * whose shortest path crosses a closed edge treat it as a miss and
+   * search the path again on the graph skipping the closed edges, up to
+   * the upperbound of the UBODT. The edges can be closed and opened
+   * while the UBODT is looked up, and the look ups are unchanged while
+   * no edge is closed. The raw record accessors look_up and look_up_next
+   * ignore the overlay.
+   * @param closures overlay of the edges of the network, nullptr to
+   * detach it
+   */
+  void set_closures(std::shared_ptr<const NETWORK::EdgeClosures> closures);
+  /**
+   * Check if an overlay is attached with an edge closed
+   */
+  inline bool has_closures() const {
+    return closures != nullptr && !closures->empty();
+  };
+  /**
+   * Get the number of records stored
+   * @return number of records
+   */
+  long get_num_rows() const;
+  /**
+   * Get the number of buckets of a chained table
+   * @return number of buckets
+   */
+  long long get_num_buckets() const;
+  /**
+   * Get the storage layout of the records
+   * @return storage layout
+   */
+  UBODTLayout get_layout() const;
+  /**
+   * Log the hits, misses and evictions of the cache of a lazy UBODT,
+   * or the tiles loaded and evicted of a tiled UBODT
+   */
+  void print_cache_statistics() const;
+  /**
+   * Add the memory of the buckets, the records, the unrolled paths and
+   * the miss filter to a report. The files mapped are counted as
+   * mapped, whose pages are resident only once read, and the cache of
+   * a lazy or tiled UBODT as cache, which grows while matching.
+   * @param report memory report updated
+   */
+  void get_memory_usage(UTIL::MemoryReport *report) const;
+  /**
+   * Get the counters of the cache of a lazy UBODT or of the tiles of a
+   * tiled UBODT, which are all 0 for the other layouts
+   * @return cache counters
+   */
+  UBODTCacheStatistics get_cache_statistics() const;
+  /**
+   * Count the probes of each source node from now on, which are the od
+   * pairs queried by look_up_cost, look_up_many, look_up_batch and the
+   * path look ups. The counters are shared by the threads and updated
+   * atomically, so counting is meant for a representative sample.
+   * @param num_nodes number of nodes of the network, sources beyond it
+   * are not counted
+   */
+  void enable_probe_counts(int num_nodes);
+  /**
+   * Get the probes of each source node counted, empty if not enabled
+   */
+  const std::vector<long long> &get_probe_counts() const;
+  /**
+   * Copy the table with the rows of the sources probed most stored
+   * first, which are the heads of their chains in the chained layout,
+   * stored together in a single block, and the first ones probed from
+   * their home slots in the flat, compact and split layouts.
+   * @param  counts probes of each source node
+   * @return the table reordered, nullptr if the layout is not chained,
+   * flat, compact or split
+   */
+  std::shared_ptr<UBODT> reorder_by_probes(
+      const std::vector<long long> &counts) const;
+  /**
+   * Write the probes of each source node to a CSV file, with the
+   * sources never probed left out
+   * @param  counts   probes of each source node
+   * @param  filename output file name
+   * @return true if the file is written successfully
+   */
+  static bool write_probe_counts(const std::vector<long long> &counts,
+                                 const std::string &filename);
+  /**
+   * Read the probes of each source node from a CSV file written by
+   * write_probe_counts
+   * @param  filename input file name
+   * @param  counts   updated with the probes of each source node
+   * @return true if the file is read successfully
+   */
+  static bool read_probe_counts(const std::string &filename,
+                                std::vector<long long> *counts);
   /**
    * Find the bucket index for an OD pair
    * @param  source origin/source node
    * @param  target destination/target node
    * @return  bucket index
    */
-  unsigned int cal_bucket_index(NETWORK::NodeIndex source,
+  unsigned long long cal_bucket_index(NETWORK::NodeIndex source,
       NETWORK::NodeIndex target) const;
 
+  /**
+   * Allocate a record from the slab storage owned by the UBODT.
+   * The record is released when the UBODT is destroyed.
+   * @return pointer to an uninitialized record
+   */
+  Record *allocate_record();
+
   /**
    *  Insert a record into the hash table
-   * @param r a record to be inserted
+   * @param r a record to be inserted, which should be allocated
+   * by allocate_record. For the flat layout, the record is copied.
    */
   void insert(Record *r);
 
+  /**
+   * Insert a copy of a record into the hash table
+   * @param r a record to be inserted
+   */
+  void insert(const Record &r);
+
+  /**
+   * Finish inserting records. For the CSR layout, the records are
+   * grouped and sorted here and the table can only be queried after it.
+   * Other layouts are not affected.
+   */
+  void finish_insert();
+
+  /**
+   * Store the complete edge sequence of every record in a shared pool,
+   * so that look_sp_path copies the path found with a single look up
+   * instead of looking up every node on the path. It should be called
+   * after all the records are inserted, the pool is dropped by a later
+   * insert.
+   * @return true if the paths are stored, which is only supported for
+   * the flat and csr layouts
+   */
+  bool unroll_paths();
+
+  /**
+   * Store the costs of the path of every record under the extra metrics
+   * of a network, such as a travel time, next to the records, so that
+   * the od pairs and paths of a single generation serve all the metrics.
+   * The cost of a path is the cost of its first edge added to the one of
+   * the record from its next node. It should be called after all the
+   * records are inserted, the costs are dropped by a later insert.
+   * @param network network the UBODT is generated on, with cost columns
+   * @return true if the costs are stored, which is only supported for
+   * the flat and csr layouts of a UBODT generated on the network
+   */
+  bool build_metric_costs(const NETWORK::Network &network);
+
+  /**
+   * Get the number of metrics whose costs can be looked up, which is 1
+   * for the length plus the extra metrics stored
+   */
+  int get_metric_count() const;
+
+  /**
+   * Build a blocked Bloom filter of the OD pairs stored, which is checked
+   * before the table so that most look ups of a missing pair read a
+   * single cache line. It should be called after all the records are
+   * inserted, the filter is dropped by a later insert.
+   * @param bits_per_row number of filter bits per record, which controls
+   * the false positive rate
+   * @return true if the filter is built, which is not supported for the
+   * lazy and tiled layouts
+   */
+  bool build_miss_filter(int bits_per_row = DEFAULT_FILTER_BITS);
+
   /**
    * Read UBODT from a file.
-   * The format will be infered from the file extension.
+   * The format will be infered from the file extension. A name starting
+   * with shm: is attached from shared memory, e.g., shm:/ubodt.
    * @param  filename   input file name
    * @param  multiplier A value used for inserting rows to the UBODT
+   * @param  layout     Storage layout of the records
+   * @param  parallel   If true, CSV file is read with multiple threads
+   * @param  nodes      If not nullptr, only the rows whose source and
+   * target are nonzero in it by node index are read from a CSV or binary
+   * file, the other formats are read whole
    * @return  A shared pointer to the UBODT data.
    */
-  static std::shared_ptr<UBODT> read_ubodt_file(const std::string &filename,
-                                                int multiplier = 50000);
+  static std::shared_ptr<UBODT> read_ubodt_file(
+      const std::string &filename, int multiplier = 50000,
+      UBODTLayout layout = CHAINED, bool parallel = false,
+      const std::vector<char> *nodes = nullptr);
   /**
-   * Read UBODT from a CSV file
+   * Read UBODT from a CSV file, which may be compressed with gzip
    * @param  filename   input file name
    * @param  multiplier A value used for inserting rows to the UBODT
+   * @param  layout     Storage layout of the records
+   * @param  nodes      If not nullptr, only the rows whose source and
+   * target are nonzero in it by node index are read, e.g., the nodes of
+   * a region, which should cover the region queried and a margin of the
+   * delta so that the paths of the rows read can be walked
    * @return  A shared pointer to the UBODT data.
    */
-  static std::shared_ptr<UBODT> read_ubodt_csv(const std::string &filename,
-                                               int multiplier = 50000);
+  static std::shared_ptr<UBODT> read_ubodt_csv(
+      const std::string &filename, int multiplier = 50000,
+      UBODTLayout layout = CHAINED,
+      const std::vector<char> *nodes = nullptr);
+
+  /**
+   * Read UBODT from a CSV file with multiple threads. The file is split
+   * into byte ranges which are parsed and inserted concurrently.
+   * Each OD pair is expected to appear only once in the file.
+   * @param  filename   input file name
+   * @param  multiplier A value used for inserting rows to the UBODT
+   * @param  layout     Storage layout of the records
+   * @param  nodes      If not nullptr, only the rows whose source and
+   * target are nonzero in it by node index are read
+   * @return  A shared pointer to the UBODT data, nullptr if the file
+   * cannot be read.
+   */
+  static std::shared_ptr<UBODT> read_ubodt_csv_parallel(
+      const std::string &filename, int multiplier = 50000,
+      UBODTLayout layout = CHAINED,
+      const std::vector<char> *nodes = nullptr);
 
   /**
-   * Read UBODT from a binary file
+   * Read UBODT from a binary file written with a boost binary archive.
+   * The file is memory mapped and its rows of 28 bytes are decoded in
+   * place, without reading them through the archive, unless the archive
+   * header is not the one of this version of boost.
+   * @param  filename   input file name
+   * @param  multiplier A value used for inserting rows to the UBODT
+   * @param  layout     Storage layout of the records
+   * @param  nodes      If not nullptr, only the rows whose source and
+   * target are nonzero in it by node index are read
+   * @param  parallel   If true, the rows are inserted with multiple threads
+   * @return  A shared pointer to the UBODT data.
+   */
+  static std::shared_ptr<UBODT> read_ubodt_binary(
+      const std::string &filename, int multiplier = 50000,
+      UBODTLayout layout = CHAINED,
+      const std::vector<char> *nodes = nullptr, bool parallel = true);
+  /**
+   * Read UBODT from a binary file field by field with a boost binary
+   * archive
    * @param  filename   input file name
    * @param  multiplier A value used for inserting rows to the UBODT
+   * @param  layout     Storage layout of the records
+   * @param  nodes      If not nullptr, only the rows whose source and
+   * target are nonzero in it by node index are read
    * @return  A shared pointer to the UBODT data.
    */
-  static std::shared_ptr<UBODT> read_ubodt_binary(const std::string &filename,
-                                                  int multiplier = 50000);
+  static std::shared_ptr<UBODT> read_ubodt_archive(
+      const std::string &filename, int multiplier = 50000,
+      UBODTLayout layout = CHAINED,
+      const std::vector<char> *nodes = nullptr);
+  /**
+   * Convert a layout name to the storage layout
+   * @param  name layout name, chained, flat, compact, split, csr or lazy
+   * @param  layout the storage layout converted
+   * @return true if the name is valid
+   */
+  static bool string2layout(const std::string &name, UBODTLayout *layout);
+  /**
+   * Create a lazy UBODT, where the records of a source are calculated
+   * with an upperbounded Dijkstra search on the first query and cached.
+   * When the cache is full, sources are evicted with the CLOCK
+   * algorithm. The table can be queried by multiple threads.
+   * @param  graph    network graph, which should outlive the UBODT
+   * @param  delta    upperbound of the Dijkstra search
+   * @param  max_rows maximum number of records cached, where each
+   * source also counts as one record
+   * @return A shared pointer to the UBODT data
+   */
+  static std::shared_ptr<UBODT> create_lazy_ubodt(
+      const NETWORK::NetworkGraph &graph, double delta,
+      long max_rows = DEFAULT_CACHE_ROWS);
+  /**
+   * Generate a UBODT in memory with an upperbounded Dijkstra search from
+   * each node, as ubodt_gen does without writing a file. The rows of
+   * each source are routed in parallel into buffers, which size the
+   * table before they are inserted concurrently.
+   * @param  graph     network graph
+   * @param  delta     upperbound of the Dijkstra search
+   * @param  layout    storage layout of the records, which is not lazy
+   * @param  symmetric if true, only the rows to larger nodes are kept
+   * @param  parallel  if true, the sources are routed by OpenMP threads
+   * @return A shared pointer to the UBODT data
+   */
+  static std::shared_ptr<UBODT> generate_ubodt(
+      const NETWORK::NetworkGraph &graph, double delta, UBODTLayout layout,
+      bool symmetric = false, bool parallel = true);
+  /**
+   * Read UBODT split into spatial tiles from a tile index file written
+   * by write_ubodt_tile_index. Only the index is read here, the memory
+   * mapped file of a tile is mapped when one of its sources is queried
+   * and unmapped when too many tiles are resident.
+   * @param  filename  tile index file name
+   * @param  max_tiles maximum number of tiles mapped at the same time
+   * @return A shared pointer to the UBODT data, nullptr if the index
+   * is invalid.
+   */
+  static std::shared_ptr<UBODT> read_ubodt_tiled(
+      const std::string &filename, int max_tiles = DEFAULT_RESIDENT_TILES);
+  /**
+   * Start loading all the tiles of a tiled UBODT by background threads,
+   * so that the matching starts before the table is loaded. The tiles
+   * queried are loaded first, then the others in the order of the tiles.
+   * Until its tile is loaded, a source is searched on the graph up to
+   * delta and cached as in a lazy UBODT, which gives the same distances.
+   * The tiles loaded stay resident.
+   * @param  graph       graph the UBODT is generated on, which must
+   * outlive the UBODT
+   * @param  num_threads threads loading the tiles
+   * @param  cache_rows  maximum number of rows of the sources searched
+   * @return false if the UBODT is not tiled or already loading
+   */
+  bool start_progressive_load(const NETWORK::NetworkGraph &graph,
+                              int num_threads = DEFAULT_LOAD_THREADS,
+                              long cache_rows = DEFAULT_CACHE_ROWS);
+  /**
+   * Wait until the tiles of a progressive load are all loaded, which
+   * returns at once if no load is in progress
+   */
+  void wait_progressive_load() const;
+  /**
+   * Check if some tiles of a progressive load are not loaded yet
+   */
+  bool is_loading() const;
+  /**
+   * Write the tile index of a tiled UBODT, where the rows of each tile
+   * are stored in the file named by get_tile_file.
+   * @param  filename   tile index file name
+   * @param  node_tiles tile of each node
+   * @param  tile_rows  number of rows of each tile, a tile without rows
+   * has no file
+   * @param  delta      upperbound of the UBODT
+   * @return true if the file is written successfully
+   */
+  static bool write_ubodt_tile_index(
+      const std::string &filename,
+      const std::vector<unsigned int> &node_tiles,
+      const std::vector<long long> &tile_rows, double delta);
+  /**
+   * Get the memory mapped file storing a tile of a tiled UBODT
+   * @param  filename tile index file name
+   * @param  tile     tile index
+   * @return file name of the tile
+   */
+  static std::string get_tile_file(const std::string &filename,
+                                   unsigned int tile);
+  /**
+   * Write the ids of the nodes and edges of the network of a UBODT next
+   * to its file, so that the UBODT can be loaded with a clipped network
+   * by clip_to_network
+   * @param  filename UBODT file name
+   * @param  network  network the UBODT is generated on
+   * @return true if the file is written successfully
+   */
+  static bool write_network_ids(const std::string &filename,
+                                const NETWORK::Network &network);
+  /**
+   * Get the file storing the ids of the network of a UBODT
+   * @param  filename UBODT file name
+   * @return file name of the ids
+   */
+  static std::string get_network_ids_file(const std::string &filename);
+  /**
+   * Copy the rows of a UBODT generated on a larger network into the
+   * indices of a network clipped from it, which are translated by the
+   * ids written by write_network_ids. A row is skipped unless all the
+   * nodes and edges of its path are in the clipped network, so that the
+   * paths of the rows copied can be walked.
+   * @param  ids_file   ids of the network the UBODT is generated on
+   * @param  network    clipped network
+   * @param  layout_arg layout of the copy
+   * @return the copy, nullptr if the ids do not match the UBODT or the
+   * layout is lazy or tiled
+   */
+  std::shared_ptr<UBODT> clip_to_network(const std::string &ids_file,
+                                         const NETWORK::Network &network,
+                                         UBODTLayout layout_arg) const;
+  /**
+   * Mark the nodes of the network of a UBODT which are in a network
+   * clipped from it, by the ids written by write_network_ids, so that
+   * only their rows are read before the UBODT is clipped
+   * @param  ids_file ids of the network the UBODT is generated on
+   * @param  network  clipped network
+   * @param  nodes    nonzero for each node index of the UBODT in the
+   * clipped network
+   * @return true if the ids are read
+   */
+  static bool read_clipped_nodes(const std::string &ids_file,
+                                 const NETWORK::Network &network,
+                                 std::vector<char> *nodes);
+  /**
+   * Read UBODT from a memory mapped file written by write_ubodt_mmap.
+   * The flat table stored in the file is used in place without
+   * copying and is shared with other processes through the page cache.
+   * @param  filename input file name
+   * @return A shared pointer to the UBODT data, nullptr if the file
+   * is invalid.
+   */
+  static std::shared_ptr<UBODT> read_ubodt_mmap(const std::string &filename);
+  /**
+   * Attach UBODT published in POSIX shared memory by publish_ubodt_shm.
+   * The table is mapped read only and shared by all the processes
+   * attached to it.
+   * @param  name name of the shared memory object, e.g., /ubodt
+   * @return A shared pointer to the UBODT data, nullptr if the object
+   * does not exist or is invalid.
+   */
+  static std::shared_ptr<UBODT> attach_ubodt_shm(const std::string &name);
+  /**
+   * Publish UBODT into POSIX shared memory in the same image as the
+   * memory mapped file. The object stays after the process exits until
+   * it is removed. An existing object with the same name is replaced,
+   * processes already attached keep the old table.
+   * @param  name name of the shared memory object, e.g., /ubodt
+   * @return true if the table is published successfully
+   */
+  bool publish_ubodt_shm(const std::string &name) const;
+  /**
+   * Remove UBODT published in POSIX shared memory. The memory is freed
+   * when the last process attached detaches.
+   * @param  name name of the shared memory object
+   * @return true if the object is removed
+   */
+  static bool remove_ubodt_shm(const std::string &name);
+  /**
+   * Write UBODT to a file storing the flat table image, which can be
+   * loaded with read_ubodt_mmap. Layouts other than flat and compact
+   * are converted to a flat table first.
+   * @param  filename output file name
+   * @return true if the file is written successfully
+   */
+  bool write_ubodt_mmap(const std::string &filename) const;
+  /**
+   * Read UBODT from a block compressed file written by
+   * write_ubodt_compressed. The blocks are decompressed in parallel.
+   * @param  filename input file name
+   * @param  layout   Storage layout of the records
+   * @return A shared pointer to the UBODT data, nullptr if the file
+   * is invalid.
+   */
+  static std::shared_ptr<UBODT> read_ubodt_compressed(
+      const std::string &filename, UBODTLayout layout = CHAINED);
+  /**
+   * Write UBODT to a block compressed file. Rows are grouped by source
+   * into blocks, the node ids are delta encoded and each block is
+   * compressed with zlib, so that the file is much smaller than the CSV
+   * and binary formats.
+   * @param  filename output file name
+   * @return true if the file is written successfully
+   */
+  bool write_ubodt_compressed(const std::string &filename) const;
   /**
    * Estimate the number of rows in a file
    * @param  filename input file name
@@ -137,17 +789,457 @@ class UBODT {
    * @return  a large prime number
    */
   static int find_prime_number(double value);
+  /**
+   * Find the number of buckets for a chained table, which is the
+   * smallest power of two not less than the input value
+   * @param  value input value, e.g., number of rows divided by load factor
+   * @return a power of two
+   */
+  static long long find_bucket_number(double value);
+  /**
+   * Report the distribution of chain lengths in the chained layout,
+   * estimated from a sample of buckets
+   * @param  max_samples maximum number of buckets visited
+   * @return number of sampled buckets with each chain length,
+   * indexed by length. Empty for other layouts.
+   */
+  std::vector<long> get_chain_distribution(long max_samples = 1000000) const;
+  /**
+   * Log a summary of the chain length distribution
+   */
+  void print_chain_distribution() const;
   constexpr static double LOAD_FACTOR = 2.0; /**< factor measuring the
                                               average number of elements in
                                               a bucket. */
   static const int BUFFER_LINE = 1024; /**< Number of characters to store in
                                             a line */
+  static const long DEFAULT_SLAB_ROWS = 1 << 20; /**< Number of records
+                                                  in a slab when the
+                                                  capacity is unknown */
+  constexpr static double FLAT_LOAD_FACTOR = 0.7; /**< maximum ratio of
+                                                   occupied slots in the
+                                                   flat table */
+  static const unsigned int MMAP_VERSION = 1; /**< Version of the memory
+                                                mapped file format */
+  static const unsigned int COMPRESS_VERSION = 1; /**< Version of the block
+                                                    compressed file format */
+  static const long COMPRESS_BLOCK_ROWS = 1 << 16; /**< Minimum number of
+                                                   rows in a compressed
+                                                   block */
+  static const long DEFAULT_CACHE_ROWS = 10000000; /**< Maximum number
+                                                 of records cached in a
+                                                 lazy UBODT by default */
+  static const int CACHE_SHARDS = 64; /**< Number of independently locked
+                                        parts of the lazy cache */
+  static const int DEFAULT_RESIDENT_TILES = 64; /**< Maximum number of
+                                                tiles mapped by default */
+  static const int DEFAULT_LOAD_THREADS = 2; /**< Number of threads
+                                              loading the tiles of a
+                                              progressive load */
+  static const unsigned int TILE_VERSION = 1; /**< Version of the tile
+                                                index file format */
+  static const unsigned int IDS_VERSION = 1; /**< Version of the network
+                                             ids file format */
+  static const int DEFAULT_FILTER_BITS = 10; /**< Number of miss filter
+                                             bits per record by default */
+  static const int PROBE_GROUP = 16; /**< Number of od pairs whose
+                                      slots are prefetched together in
+                                      a batched look up */
+  static const std::string SHM_PREFIX; /**< Prefix of a UBODT name
+                                        in shared memory */
+  static const NETWORK::NodeIndex EMPTY_SLOT = 0xFFFFFFFF; /**< Source node
+                                   of an empty slot in the flat table, also
+                                   used as prev_n of compact records */
+  /**
+   * Visit every record stored in the table, where the records of
+   * the compact and split layouts are visited with prev_n set to
+   * EMPTY_SLOT
+   * @param visitor function called with each record
+   */
+  template<typename Visitor>
+  void for_each_record(Visitor visitor) const {
+    if (layout == FLAT) {
+      for (unsigned long long i = 0; i <= slot_mask; ++i) {
+        if (slots[i].source != EMPTY_SLOT) visitor(slots[i]);
+      }
+    } else if (layout == COMPACT) {
+      for (unsigned long long i = 0; i <= slot_mask; ++i) {
+        const CompactRecord &c = compact_slots[i];
+        if (c.source != EMPTY_SLOT) {
+          visitor(Record{c.source, c.target, c.first_n, EMPTY_SLOT, c.next_e,
+                         c.cost, nullptr});
+        }
+      }
+    } else if (layout == SPLIT) {
+      for (unsigned long long i = 0; i <= slot_mask; ++i) {
+        const HotRecord &h = hot_slots[i];
+        if (h.source != EMPTY_SLOT) {
+          visitor(Record{h.source, h.target, cold_slots[i].first_n,
+                         EMPTY_SLOT, cold_slots[i].next_e, h.cost, nullptr});
+        }
+      }
+    } else if (layout == CSR) {
+      for (const Record &r : csr_rows) {
+        if (r.source != EMPTY_SLOT) visitor(r);
+      }
+    } else if (layout == LAZY) {
+      for_each_lazy_record(visitor);
+    } else if (layout == TILED) {
+      for_each_tiled_record(visitor);
+    } else {
+      for (long long i = 0; i < buckets; ++i) {
+        for (Record *r = hashtable[i]; r != nullptr; r = r->next) visitor(*r);
+      }
+    }
+  }
+ private:
+  struct LazyGroup;
+  struct LazyShard;
+  struct TileSet;
+  /**
+   * Find the table of the tile of a source in a tiled UBODT, which is
+   * mapped if not resident
+   * @param source source node
+   * @return table of the tile, nullptr if the tile has no rows or fails
+   * to map
+   */
+  std::shared_ptr<UBODT> tile_table(NETWORK::NodeIndex source) const;
+  /**
+   * Check if the tile of a source is not loaded yet by a progressive
+   * load, in which case the tile is queued to be loaded first
+   * @param source source node
+   * @return true if the source is to be searched instead
+   */
+  bool tile_pending(NETWORK::NodeIndex source) const;
+  /**
+   * Load the tiles of a progressive load until all are loaded, run by
+   * each loading thread
+   * @param tiles tiles of the UBODT
+   */
+  static void load_tiles(TileSet *tiles);
+  /**
+   * Find the records of a source in a lazy UBODT, which are calculated
+   * and cached on a miss
+   * @param source source node
+   * @return records of the source sorted by target
+   */
+  std::shared_ptr<const LazyGroup> lazy_group(
+      NETWORK::NodeIndex source) const;
+  /**
+   * Visit every record cached in a lazy UBODT
+   * @param visitor function called with each record
+   */
+  void for_each_lazy_record(
+      const std::function<void(const Record &)> &visitor) const;
+  /**
+   * Visit every record stored in the tiles of a tiled UBODT, where each
+   * tile is mapped temporarily
+   * @param visitor function called with each record
+   */
+  void for_each_tiled_record(
+      const std::function<void(const Record &)> &visitor) const;
+  /**
+   * Look up the cost of an OD pair in the records only
+   * @return true if the od pair is found
+   */
+  bool look_up_table_cost(NETWORK::NodeIndex source,
+                          NETWORK::NodeIndex target, double *cost) const;
+  /**
+   * Look up the costs from a source to several targets in the records
+   * only, which are negative for the od pairs not found
+   */
+  void look_up_table_many(NETWORK::NodeIndex source,
+                          const std::vector<NETWORK::NodeIndex> &targets,
+                          std::vector<double> *costs) const;
+  /**
+   * Look up a shortest path in the records only
+   * @param edges updated with the path, empty if the od pair is not found
+   */
+  void look_up_table_path(NETWORK::NodeIndex source,
+                          NETWORK::NodeIndex target,
+                          std::vector<NETWORK::EdgeIndex> *edges) const;
+  /**
+   * Fill the costs of the od pairs missing in the records with the long
+   * range tier, where a single many to many query covers the sources and
+   * targets of the pairs missing
+   * @param sources source nodes
+   * @param targets target nodes
+   * @param costs   the distance of source i to target j stored at
+   * i * targets.size() + j, negative if missing, which stays negative if
+   * the pair is farther than the long range upperbound
+   */
+  void fill_long_range(const std::vector<NETWORK::NodeIndex> &sources,
+                       const std::vector<NETWORK::NodeIndex> &targets,
+                       std::vector<double> *costs) const;
+  /**
+   * Look up the distance of an od pair in the records, the chains and
+   * the long range tier, ignoring the closed edges
+   */
+  bool look_up_any_cost(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                        double *cost) const;
+  /**
+   * Look up the shortest path of an od pair in the records, the chains
+   * and the long range tier, ignoring the closed edges
+   */
+  void look_up_any_path(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                        std::vector<NETWORK::EdgeIndex> *edges) const;
+  /**
+   * Check the shortest path of an od pair found against the closed
+   * edges, searching it again if it crosses one
+   * @param  cost distance found, updated with the distance searched
+   * @return false if no path skipping the closed edges is within delta
+   */
+  bool reroute_closed(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                      double *cost) const;
+  /**
+   * Reroute the od pairs found whose shortest path crosses a closed
+   * edge, where pair_at(i, &source, &target) gives pair i
+   * @param costs distance of each pair, set negative if no path skipping
+   * the closed edges is within delta
+   */
+  template<typename PairAt>
+  void reroute_closed_costs(size_t total, PairAt pair_at,
+                            double *costs) const;
+  /**
+   * Look up the next node and edge on the shortest path
+   * @return true if the od pair is found
+   */
+  bool look_up_next(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                    NETWORK::NodeIndex *first_n,
+                    NETWORK::EdgeIndex *next_e) const;
+  /**
+   * Add probes of a source node when the probes are counted
+   */
+  inline void count_probes(NETWORK::NodeIndex source, long n) const {
+    if (source < probe_counts.size()) {
+      __sync_fetch_and_add(&probe_counts[source], (long long) n);
+    }
+  }
+  /**
+   * Check the miss filter for an OD pair
+   * @return false if the pair is not stored for sure, true if it may be
+   * stored or no filter is built
+   */
+  bool may_contain(NETWORK::NodeIndex source,
+                   NETWORK::NodeIndex target) const;
+  /**
+   * Look up the costs of od pairs in the chained, flat, compact or split
+   * layout, prefetching the slots of PROBE_GROUP pairs at once
+   * @param total   number of pairs
+   * @param pair_at called with the index of a pair and pointers to its
+   * source and target nodes, which it sets
+   * @param costs   the distance of each pair, negative if not found
+   */
+  template<typename PairAt>
+  void look_up_grouped(size_t total, PairAt pair_at, double *costs) const;
+  // Shortest path between two nodes of a UBODT of chains
+  struct ChainRoute {
+    NETWORK::ChainEnd exit; // from the source to a junction
+    NETWORK::ChainEnd entry; // from a junction to the target
+    bool direct; // along a single chain, from the edge of exit to the
+                 // edge of entry
+  };
+  /**
+   * Find the shortest path between two nodes of a UBODT of chains,
+   * joining the ends of their chains with the records between junctions
+   * @return the distance, negative if no path is found in the records
+   */
+  double find_chain_route(NETWORK::NodeIndex source,
+                          NETWORK::NodeIndex target,
+                          ChainRoute *route) const;
+  /**
+   * Look up the edges of the path found by find_chain_route
+   * @param edges updated with the path, empty if the od pair is not found
+   */
+  void look_up_chain_path(NETWORK::NodeIndex source,
+                          NETWORK::NodeIndex target,
+                          std::vector<NETWORK::EdgeIndex> *edges) const;
+  /**
+   * Look up the costs of od pairs of a UBODT of chains pair by pair,
+   * the long range tier included
+   * @param total   number of pairs
+   * @param pair_at called with the index of a pair and pointers to its
+   * source and target nodes, which it sets
+   * @param costs   the distance of each pair, -1 if not found
+   */
+  template<typename PairAt>
+  void look_up_chain_costs(size_t total, PairAt pair_at,
+                           double *costs) const;
+  /**
+   * Prefetch the miss filter block and the hash slot of an OD pair in
+   * the chained, flat, compact or split layout
+   * @param h hash of the pair
+   */
+  void prefetch_slot(unsigned long long h) const;
+  /**
+   * Map the flat table image in a file or shared memory object
+   * @param fd       descriptor of the file, which is closed here
+   * @param filename name of the file for logging
+   * @return A shared pointer to the UBODT data, nullptr if the image
+   * is invalid.
+   */
+  static std::shared_ptr<UBODT> map_ubodt_image(int fd,
+                                                const std::string &filename);
+  /**
+   * Write the flat table image into a stream, where other layouts are
+   * converted to a flat table first
+   * @param stream output stream
+   * @return true if the image is written successfully
+   */
+  bool write_mmap_image(FILE *stream) const;
+  /**
+   * Grow the flat, compact or split table to the given number of slots
+   * and reinsert records
+   * @param capacity number of slots, a power of two
+   */
+  void rehash_flat(unsigned long long capacity);
+  /**
+   * Allocate a dedicated slab storing a block of records
+   * @param n number of records
+   * @return pointer to the first record
+   */
+  Record *allocate_block(long n);
+  /**
+   * Insert a record into the table concurrently with other threads.
+   * The table must have enough capacity and the number of rows and
+   * delta are not updated.
+   * @param r a record to be inserted, which is linked directly for
+   * the chained layout and copied otherwise
+   */
+  void insert_parallel(Record *r);
+  /**
+   * Find the slot or row storing an OD pair in the flat or csr layout
+   * @return index of the slot or row, -1 if not found
+   */
+  long find_row_index(NETWORK::NodeIndex source,
+                      NETWORK::NodeIndex target) const;
+  /**
+   * Look up the record stored for an OD pair, which is the record of the
+   * pair reversed if it is stored from its target in a symmetric UBODT
+   * @return the record found or nullptr
+   */
+  Record *look_up_stored(NETWORK::NodeIndex source,
+                         NETWORK::NodeIndex target) const;
+  /**
+   * Look up the record of an OD pair in the CSR layout
+   * @return the record found or nullptr
+   */
+  Record *look_up_csr(NETWORK::NodeIndex source,
+                      NETWORK::NodeIndex target) const;
+  const long long multiplier;   // multiplier kept for compatibility
+  const long long buckets;   // number of buckets, a power of two
+  double delta = 0.0;
+  long num_rows = 0;
+  const UBODTLayout layout;
+  Record **hashtable = nullptr;
+  Record *slots = nullptr; // flat table, empty slots have an invalid source
+  CompactRecord *compact_slots = nullptr; // compact table
+  HotRecord *hot_slots = nullptr; // od pairs and costs of the split table
+  ColdRecord *cold_slots = nullptr; // next nodes and edges of hot_slots
+  std::vector<Record> csr_rows; // records sorted by source and target
+  std::vector<long> csr_offsets; // first row of each source in csr_rows
+  unsigned long long slot_mask = 0; // number of slots minus one
+  void *mapped_addr = nullptr; // memory mapped file storing the slots
+  size_t mapped_size = 0;
+  std::vector<Record *> slabs; // contiguous blocks storing the records
+  long slab_rows; // capacity of the current slab
+  long slab_used = 0; // records used in the current slab
+  long long slab_capacity = 0; // records allocated in all the slabs
+  const NETWORK::NetworkGraph *graph = nullptr; // graph of a lazy or
+                                                // symmetric UBODT
+  long shard_rows = 0; // maximum number of records cached in a shard
+  std::vector<std::unique_ptr<LazyShard>> lazy_shards;
+  std::unique_ptr<TileSet> tile_set; // tiles of a tiled UBODT
+  // Edges of the path of the record in each slot or row are stored in
+  // path_edges from path_offsets[i] to path_offsets[i + 1]
+  std::vector<long> path_offsets;
+  std::vector<NETWORK::EdgeIndex> path_edges;
+  // Extra cost k of the path of the record in each slot or row i at
+  // metric_costs[i * num_metric_costs + k], NaN if its path is not found
+  std::vector<double> metric_costs;
+  int num_metric_costs = 0;
+  // Blocks of the miss filter, each holding FILTER_BLOCK_WORDS words in
+  // one cache line, nullptr if no filter is built
+  unsigned long long *filter_words = nullptr;
+  unsigned long long filter_mask = 0; // number of filter blocks minus one
+  // Hierarchy answering the od pairs missing in the records up to
+  // long_delta, nullptr if no long range tier is attached
+  std::shared_ptr<const NETWORK::ContractionHierarchy> long_range;
+  double long_delta = 0.0;
+  bool symmetric = false; // records stored from the smaller node only
+  // Chains of the network whose junctions the records connect, nullptr
+  // if the records are generated on the network
+  std::shared_ptr<const NETWORK::ChainGraph> chains;
+  // Overlay of the closed edges, nullptr if none is attached
+  std::shared_ptr<const NETWORK::EdgeClosures> closures;
+  // Probes of each source node, empty if they are not counted
+  mutable std::vector<long long> probe_counts;
+};
+
+/**
+ * Writer of the memory mapped UBODT file of a table larger than the
+ * memory. The rows added are spilled to a file next to the output and
+ * distributed into partitions of consecutive slots of the final table,
+ * an external sort by slot. The slots of each partition are placed in
+ * memory and written in order, so that the output is written
+ * sequentially and read_ubodt_mmap maps it without any insertion.
+ */
+class UBODTImageWriter {
+ public:
+  /**
+   * Create a writer
+   * @param filename     output file, whose spill files are named
+   * filename.spill and filename.spill.<partition>
+   * @param multiplier   number of nodes of the network
+   * @param compact      if true, compact records are written
+   * @param memory_bytes memory of the slots and rows of a partition
+   */
+  UBODTImageWriter(const std::string &filename, int multiplier,
+                   bool compact, long long memory_bytes);
+  ~UBODTImageWriter();
+  /**
+   * Add rows to the table, which can be called by several threads
+   * @param  records rows added, with distinct od pairs
+   * @return false if the rows cannot be spilled
+   */
+  bool add(const std::vector<Record> &records);
+  /**
+   * Write the file of the rows added and remove the spill files
+   * @return true if the file is written successfully
+   */
+  bool finish();
+  /**
+   * Get the number of rows added
+   */
+  long get_num_rows() const;
+  static const int MIN_PARTITION_SLOTS = 1024; /**< Minimum number of
+                                                slots of a partition */
  private:
-  const long long multiplier;   // multiplier to get a unique ID
-  const int buckets;   // number of buckets
+  /**
+   * Distribute the spilled rows into the files of the partitions
+   * @return false if a file cannot be written
+   */
+  bool scatter(unsigned long long num_slots,
+               const std::vector<std::string> &files);
+  const std::string filename;
+  const int multiplier;
+  const bool compact;
+  const long long memory_bytes;
+  std::mutex mutex;
+  FILE *spill = nullptr; // rows added, in the order of the calls
+  long num_rows = 0;
   double delta = 0.0;
-  Record **hashtable;
+  std::vector<std::string> spill_files; // files removed when finished
 };
+
+/**
+ * Add the counters and the hit rate of the cache of a lazy or tiled
+ * UBODT, and the load factor and chain lengths of a chained UBODT, to
+ * metrics
+ * @param ubodt UBODT queried
+ * @param text  metrics updated
+ */
+void append_ubodt_metrics(const UBODT &ubodt, UTIL::MetricsText *text);
 }
 }
 
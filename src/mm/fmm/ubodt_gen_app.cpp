@@ -4,17 +4,113 @@
 
 #include "mm/fmm/ubodt_gen_app.hpp"
 #include "mm/fmm/ubodt.hpp"
+#include "mm/fmm/ubodt_profile.hpp"
+#include "mm/fmm/ubodt_shard.hpp"
+#include "io/async_writer.hpp"
+#include "io/csv_format.hpp"
+#include "io/gps_reader.hpp"
+#include "io/result_stream.hpp"
 #include "network/network.hpp"
 #include "network/network_graph.hpp"
+#include "network/region_partition.hpp"
 #include <boost/archive/binary_oarchive.hpp>
+#include "util/util.hpp"
 #include "util/debug.hpp"
+#include "util/metrics.hpp"
 #include <omp.h>
+#include <unistd.h>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
-void UBODTGenApp::run() const {
+namespace {
+// Number of sources written into a buffer by parallel generation
+const int CHUNK_SOURCES = 256;
+
+// Size of the blocks of rows written by serial generation
+const std::size_t OUTPUT_BLOCK_BYTES = 4 << 20;
+
+// Append the bytes of a field of a binary row
+template <typename T>
+void append_raw(const T &value, std::string *buffer) {
+  buffer->append((const char *) &value, sizeof(T));
+}
+
+// Mark the nodes within a radius of the points, with the nodes bucketed
+// by the square cell of side radius containing them
+void mark_nodes_near(const std::vector<Point> &nodes,
+                     const std::vector<Point> &points, double radius,
+                     std::vector<char> *marked) {
+  if (radius <= 0 || points.empty()) return;
+  auto cell_key = [](long long cx, long long cy) {
+    return cx * 4294967296LL + (cy & 0xffffffffLL);
+  };
+  std::unordered_map<long long, std::vector<NodeIndex>> cells;
+  for (std::size_t u = 0; u < nodes.size(); ++u) {
+    long long cx = std::floor(nodes[u].get<0>() / radius);
+    long long cy = std::floor(nodes[u].get<1>() / radius);
+    cells[cell_key(cx, cy)].push_back(u);
+  }
+  for (const Point &p : points) {
+    long long cx = std::floor(p.get<0>() / radius);
+    long long cy = std::floor(p.get<1>() / radius);
+    for (long long x = cx - 1; x <= cx + 1; ++x) {
+      for (long long y = cy - 1; y <= cy + 1; ++y) {
+        auto iter = cells.find(cell_key(x, y));
+        if (iter == cells.end()) continue;
+        for (NodeIndex u : iter->second) {
+          if (boost::geometry::distance(nodes[u], p) <= radius) {
+            (*marked)[u] = 1;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Mark the nodes reaching a target node within delta, with a Dijkstra
+// search on the reversed graph
+void mark_reaching_nodes(const CSRGraph &reverse_graph,
+                         NodeIndex target, double delta,
+                         std::vector<char> *marked) {
+  typedef std::pair<double, NodeIndex> QueueNode;
+  std::priority_queue<QueueNode, std::vector<QueueNode>,
+                      std::greater<QueueNode>> queue;
+  std::unordered_map<NodeIndex, double> dist;
+  queue.push({0, target});
+  dist[target] = 0;
+  while (!queue.empty()) {
+    QueueNode node = queue.top();
+    queue.pop();
+    NodeIndex v = node.second;
+    if (node.first > dist[v]) continue;
+    (*marked)[v] = 1;
+    for (unsigned int e = reverse_graph.begin(v); e < reverse_graph.end(v);
+         ++e) {
+      double d = node.first + reverse_graph.get_length(e);
+      if (d > delta) continue;
+      NodeIndex u = reverse_graph.get_target(e);
+      auto iter = dist.find(u);
+      if (iter == dist.end() || iter->second > d) {
+        dist[u] = d;
+        queue.push({d, u});
+      }
+    }
+  }
+}
+}
+
+void UBODTGenApp::run() {
   if (!config_.validate()) {
     SPDLOG_CRITICAL("Validation fail, program stop");
     return;
@@ -22,12 +118,64 @@ void UBODTGenApp::run() const {
   config_.print();
   std::chrono::steady_clock::time_point begin =
       std::chrono::steady_clock::now();
+  double delta = config_.delta;
+  if (config_.is_profile()) {
+    if (!profile_delta(&delta)) return;
+    if (config_.result_file.empty()) return;
+  }
+  if (config_.symmetric && !graph_.is_symmetric()) {
+    SPDLOG_CRITICAL("Symmetric output requires the edges of the network "
+                    "in both directions with the same length");
+    return;
+  }
+  if (config_.compress_chains) {
+    chains_.reset(new ChainGraph(network_));
+    chain_graph_.reset(new NetworkGraph(network_, chains_->get_arcs()));
+  }
+  if (config_.is_hierarchy_engine()) {
+    hierarchy_.reset(new ContractionHierarchy(network_, delta,
+                                              config_.use_omp));
+  }
   SPDLOG_INFO("Write UBODT to file {}", config_.result_file);
+  UTIL::RateMeter source_rate;
+  UTIL::MetricsExporter metrics(config_.metrics_file,
+                                config_.metrics_interval);
+  if (!config_.metrics_file.empty()) {
+    metrics.add_collector([this, &source_rate](UTIL::MetricsText *text) {
+      long sources = sources_routed_;
+      text->gauge("fmm_ubodt_gen_nodes", "Nodes of the network",
+                  graph_.get_num_vertices());
+      text->counter("fmm_ubodt_gen_sources_total", "Sources routed",
+                    sources);
+      text->counter("fmm_ubodt_gen_rows_total",
+                    "Rows found by the sources routed", rows_routed_);
+      text->gauge("fmm_ubodt_gen_sources_per_second",
+                  "Sources routed per second since the previous export",
+                  source_rate.update(sources));
+      if (config_.async_write) IO::append_async_write_metrics(text);
+    });
+    metrics.start();
+  }
   bool binary = config_.is_binary_output();
-  if (config_.use_omp){
-    precompute_ubodt_omp(config_.result_file, config_.delta, binary);
+  if (config_.is_shard()) {
+    precompute_ubodt_shard(config_.result_file, delta, binary,
+                           config_.use_omp);
+  } else if (config_.is_update()) {
+    update_ubodt(config_.result_file, delta, config_.use_omp);
+  } else if (config_.is_tiled_output()) {
+    precompute_ubodt_tiles(config_.result_file, delta,
+                           config_.tile_size, config_.use_omp);
+  } else if (config_.is_mmap_output() || config_.is_compressed_output()) {
+    precompute_ubodt_table(config_.result_file, delta,
+                           config_.use_omp);
+  } else if (config_.use_omp){
+    precompute_ubodt_omp(config_.result_file, delta, binary);
   } else {
-    precompute_ubodt(config_.result_file, config_.delta, binary);
+    precompute_ubodt(config_.result_file, delta, binary);
+  }
+  metrics.stop();
+  if (config_.network_ids) {
+    UBODT::write_network_ids(config_.result_file, network_);
   }
   std::chrono::steady_clock::time_point end =
       std::chrono::steady_clock::now();
@@ -37,36 +185,66 @@ void UBODTGenApp::run() const {
   SPDLOG_INFO("Time takes {}", time_spent);
 }
 
+bool UBODTGenApp::profile_delta(double *delta) const {
+  double max_delta = (config_.profile_delta > 0) ? config_.profile_delta :
+                     4 * config_.delta;
+  SPDLOG_INFO("Profile distances requested up to {}", max_delta);
+  UBODTProfile profile(network_, graph_, max_delta);
+  IO::GPSReader reader(config_.gps_config);
+  int trajectories = 0;
+  while (reader.has_next_trajectory() &&
+      trajectories < config_.profile_trajectories) {
+    Trajectory trajectory = reader.read_next_trajectory();
+    profile.add_trajectory(trajectory, config_.fmm_config);
+    ++trajectories;
+  }
+  profile.sample_sources(config_.profile_sources);
+  SPDLOG_INFO("Trajectories profiled {}", trajectories);
+  profile.print();
+  if (!config_.profile_file.empty() &&
+      !profile.write_profile(config_.profile_file)) {
+    return false;
+  }
+  if (config_.hit_rate > 0) {
+    double selected = profile.find_delta(config_.hit_rate);
+    if (selected < 0) {
+      SPDLOG_CRITICAL("Hit rate {} is not reached within {}, increase "
+                      "profile_delta", config_.hit_rate, max_delta);
+      return false;
+    }
+    SPDLOG_INFO("Delta {} selected for hit rate {}, rows estimated {}",
+                selected, config_.hit_rate, profile.estimate_rows(selected));
+    *delta = selected;
+  }
+  return true;
+}
+
 void UBODTGenApp::precompute_ubodt(
     const std::string &filename, double delta, bool binary) const {
   int num_vertices = graph_.get_num_vertices();
   int step_size = num_vertices / 10;
   if (step_size < 10) step_size = 10;
-  std::ofstream myfile(filename);
+  IO::ResultStream output(filename, false, config_.async_write);
   SPDLOG_INFO("Start to generate UBODT with delta {}", delta);
   SPDLOG_INFO("Output format {}", (binary ? "binary" : "csv"));
-  if (binary) {
-    boost::archive::binary_oarchive oa(myfile);
-    for (NodeIndex source = 0; source < num_vertices; ++source) {
-      if (source % step_size == 0)
-        SPDLOG_INFO("Progress {} / {}", source, num_vertices);
-      PredecessorMap pmap;
-      DistanceMap dmap;
-      graph_.single_source_upperbound_dijkstra(source, delta, &pmap, &dmap);
-      write_result_binary(oa, source, pmap, dmap);
-    }
-  } else {
-    myfile << "source;target;next_n;prev_n;next_e;distance\n";
-    for (NodeIndex source = 0; source < num_vertices; ++source) {
-      if (source % step_size == 0)
-        SPDLOG_INFO("Progress {} / {}", source, num_vertices);
-      PredecessorMap pmap;
-      DistanceMap dmap;
-      graph_.single_source_upperbound_dijkstra(source, delta, &pmap, &dmap);
-      write_result_csv(myfile, source, pmap, dmap);
+  // The rows are formatted into a buffer written by blocks
+  std::string buffer;
+  buffer.reserve(OUTPUT_BLOCK_BYTES * 2);
+  write_output_header(binary, &buffer);
+  for (NodeIndex source = 0; source < num_vertices; ++source) {
+    if (source % step_size == 0)
+      SPDLOG_INFO("Progress {} / {}", source, num_vertices);
+    write_sources(&buffer, source, source + 1, delta, binary);
+    if (buffer.size() >= OUTPUT_BLOCK_BYTES) {
+      output.write(buffer.data(), buffer.size());
+      buffer.clear();
     }
   }
-  myfile.close();
+  output.write(buffer.data(), buffer.size());
+  output.flush();
+  if (!output.good()) {
+    SPDLOG_CRITICAL("Cannot write UBODT {}", filename);
+  }
 }
 
 // Parallelly generate ubodt using OpenMP
@@ -76,135 +254,625 @@ void UBODTGenApp::precompute_ubodt_omp(
   int num_vertices = graph_.get_num_vertices();
   int step_size = num_vertices / 10;
   if (step_size < 10) step_size = 10;
-  std::ofstream myfile(filename);
+  IO::ResultStream output(filename, false, config_.async_write);
   SPDLOG_INFO("Start to generate UBODT with delta {}", delta);
   SPDLOG_INFO("Output format {}", (binary ? "binary" : "csv"));
-  if (binary) {
-    boost::archive::binary_oarchive oa(myfile);
-    int progress = 0;
-#pragma omp parallel
+  std::string header;
+  write_output_header(binary, &header);
+  output.write(header.data(), header.size());
+  // Each chunk of sources is written into a buffer of its thread and the
+  // buffers are appended in the order of the chunks, so that no lock is
+  // taken per source and the output is the same as the serial one.
+  int num_chunks = (num_vertices + CHUNK_SOURCES - 1) / CHUNK_SOURCES;
+#pragma omp parallel for ordered schedule(dynamic)
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    std::string buffer;
+    int first = chunk * CHUNK_SOURCES;
+    int last = std::min(num_vertices, first + CHUNK_SOURCES);
+    write_sources(&buffer, first, last, delta, binary);
+    // A compressed chunk is compressed by its thread
+    std::string member;
+    bool compressed = output.compressed() && !buffer.empty() &&
+        IO::ResultStream::compress_block(buffer.data(), buffer.size(),
+                                         &member);
+#pragma omp ordered
     {
-#pragma omp for
-      for (int source = 0; source < num_vertices; ++source) {
-        ++progress;
-        if (progress % step_size == 0) {
-          SPDLOG_INFO("Progress {} / {}", progress, num_vertices);
-        }
-        PredecessorMap pmap;
-        DistanceMap dmap;
-        std::stringstream node_output_buf;
-        graph_.single_source_upperbound_dijkstra(source, delta, &pmap, &dmap);
-        write_result_binary(oa, source, pmap, dmap);
+      if (compressed) {
+        output.write_compressed(member);
+      } else {
+        output.write(buffer.data(), buffer.size());
+      }
+      if (last / step_size != first / step_size) {
+        SPDLOG_INFO("Progress {} / {}", last, num_vertices);
       }
     }
+  }
+  output.flush();
+  if (!output.good()) {
+    SPDLOG_CRITICAL("Cannot write UBODT {}", filename);
+  }
+}
+
+void UBODTGenApp::precompute_ubodt_shard(
+    const std::string &filename, double delta, bool binary,
+    bool use_omp) const {
+  int num_vertices = graph_.get_num_vertices();
+  UBODTShard shard;
+  shard.network_file = config_.network_config.file;
+  shard.delta = delta;
+  shard.num_vertices = num_vertices;
+  shard.partition = config_.partition;
+  shard.num_partitions = config_.num_partitions;
+  if (config_.num_partitions > 1) {
+    shard.first_source = (long long) num_vertices * config_.partition /
+        config_.num_partitions;
+    shard.last_source = (long long) num_vertices * (config_.partition + 1) /
+        config_.num_partitions;
   } else {
-    myfile << "source;target;next_n;prev_n;next_e;distance\n";
-    int progress = 0;
-#pragma omp parallel
-    {
-#pragma omp for
-      for (int source = 0; source < num_vertices; ++source) {
-        ++progress;
-        if (progress % step_size == 0) {
-          SPDLOG_INFO("Progress {} / {}", progress, num_vertices);
-        }
-        PredecessorMap pmap;
-        DistanceMap dmap;
-        std::stringstream node_output_buf;
-        graph_.single_source_upperbound_dijkstra(source, delta, &pmap, &dmap);
-        write_result_csv(myfile, source, pmap, dmap);
-      }
+    shard.first_source = std::min(std::max(config_.first_source, 0),
+                                  num_vertices);
+    shard.last_source = config_.last_source < 0 ? num_vertices :
+                        std::min(config_.last_source, num_vertices);
+  }
+  shard.next_source = shard.first_source;
+  shard.binary = binary;
+  shard.compact = config_.compact;
+  SPDLOG_INFO("Start to generate UBODT shard with delta {}", delta);
+  SPDLOG_INFO("Output format {}", (binary ? "binary" : "csv"));
+  SPDLOG_INFO("Sources from {} to {}", shard.first_source,
+              shard.last_source);
+  bool resumed = false;
+  if (config_.resume &&
+      UTIL::file_exists(UBODTShard::get_manifest_file(filename))) {
+    UBODTShard previous;
+    if (!UBODTShard::read_manifest(filename, &previous)) return;
+    if (!previous.is_compatible(shard)) {
+      SPDLOG_CRITICAL("Shard {} is generated with different parameters",
+                      filename);
+      return;
+    }
+    // Rows written after the last manifest update are discarded
+    if (UTIL::get_file_size(filename) < previous.bytes ||
+        truncate(filename.c_str(), previous.bytes) != 0) {
+      SPDLOG_CRITICAL("Shard {} is shorter than its manifest", filename);
+      return;
+    }
+    shard = previous;
+    resumed = true;
+    SPDLOG_INFO("Resume shard from source {} with rows {}",
+                shard.next_source, shard.rows);
+  }
+  std::fstream myfile;
+  if (resumed) {
+    myfile.open(filename, std::ios::in | std::ios::out);
+    myfile.seekp(0, std::ios::end);
+  } else {
+    myfile.open(filename, std::ios::out | std::ios::trunc);
+    std::string header;
+    write_output_header(binary, &header);
+    myfile.write(header.data(), header.size());
+    myfile.flush();
+    shard.bytes = myfile.tellp();
+    if (!myfile || !shard.write_manifest(filename)) {
+      SPDLOG_CRITICAL("Cannot write shard {}", filename);
+      return;
+    }
+  }
+  // Each chunk is appended and checkpointed in the manifest in order,
+  // so that the manifest never covers a source not in the file.
+  int first_source = shard.next_source;
+  int num_sources = shard.last_source - first_source;
+  int num_chunks = (num_sources + CHUNK_SOURCES - 1) / CHUNK_SOURCES;
+  // Written in the ordered section and read by the other threads
+  std::atomic<bool> failed{false};
+#pragma omp parallel for ordered schedule(dynamic) if(use_omp)
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    std::string buffer;
+    int first = first_source + chunk * CHUNK_SOURCES;
+    int last = std::min((int) shard.last_source, first + CHUNK_SOURCES);
+    long long rows = failed ? 0 :
+                     write_sources(&buffer, first, last, delta, binary);
+#pragma omp ordered
+    if (!failed) {
+      myfile.write(buffer.data(), buffer.size());
+      myfile.flush();
+      shard.next_source = last;
+      shard.bytes = myfile.tellp();
+      shard.rows += rows;
+      failed = !myfile || !shard.write_manifest(filename);
+      SPDLOG_INFO("Progress {} / {}", last - first_source, num_sources);
     }
   }
   myfile.close();
+  if (failed) {
+    SPDLOG_CRITICAL("Cannot write shard {}, resume it from source {}",
+                    filename, shard.next_source);
+    return;
+  }
+  SPDLOG_INFO("Shard complete with rows {}", shard.rows);
 }
 
-/**
-   * Write the result of routing from a single source node
-   * @param stream output stream
-   * @param s      source node
-   * @param pmap   predecessor map
-   * @param dmap   distance map
-   */
-void UBODTGenApp::write_result_csv(
-    std::ostream &stream, NodeIndex s,
-                                   PredecessorMap &pmap, DistanceMap &dmap) const {
-  std::vector<Record> source_map;
+void UBODTGenApp::precompute_ubodt_table(
+    const std::string &filename, double delta, bool use_omp) const {
+  int num_vertices = graph_.get_num_vertices();
+  bool compressed = config_.is_compressed_output();
+  SPDLOG_INFO("Start to generate UBODT with delta {}", delta);
+  SPDLOG_INFO("Output format {}", (compressed ? "ubz" : "mmap"));
+  std::vector<NodeIndex> sources(num_vertices);
+  for (int source = 0; source < num_vertices; ++source) {
+    sources[source] = source;
+  }
+  if (config_.is_region()) {
+    RegionPartition partition;
+    if (!RegionPartition::read(config_.region_file, &partition)) return;
+    if (config_.region >= partition.size()) {
+      SPDLOG_CRITICAL("Region {} not found in {}", config_.region,
+                      config_.region_file);
+      return;
+    }
+    sources = partition.get_sources(network_.get_vertex_points(),
+                                    config_.region);
+    SPDLOG_INFO("Region {} sources {} / {}", config_.region,
+                sources.size(), num_vertices);
+  }
+  std::vector<char> routed;
+  if (config_.is_demand()) {
+    sources = find_demand_sources();
+    SPDLOG_INFO("Demand sources {} / {}", sources.size(), num_vertices);
+    routed.assign(num_vertices, 0);
+    for (NodeIndex u : sources) routed[u] = 1;
+  }
+  if (config_.memory_budget > 0 && !compressed) {
+    // The rows are spilled and written in the order of their slots
+    UBODTImageWriter writer(filename, num_vertices, config_.compact,
+                            config_.memory_budget * 1024LL * 1024LL);
+    std::atomic<bool> failed{false};
+    route_rows(sources, delta, use_omp,
+               [&writer, &failed](std::vector<Record> *rows) {
+                 if (!writer.add(*rows)) failed = true;
+               });
+    SPDLOG_INFO("Rows generated {}", writer.get_num_rows());
+    if (!failed) writer.finish();
+    return;
+  }
+  // The compressed file keeps the cost in double precision, so compact
+  // output only drops prev_n there.
+  UBODT table(UBODT::find_bucket_number(num_vertices), num_vertices,
+              num_vertices, (config_.compact && !compressed) ? COMPACT : FLAT);
+  if (config_.is_demand()) {
+    // The rows walked from the nodes not routed overwrite the copies
+    // collected from other sources, which have the same distance.
+    route_rows(sources, delta, use_omp, [&table](std::vector<Record> *rows) {
+#pragma omp critical
+      for (const Record &r : *rows) table.insert(r);
+    }, &routed);
+  } else {
+    fill_table(sources, delta, use_omp, &table);
+  }
+  SPDLOG_INFO("Rows generated {}", table.get_num_rows());
+  if (compressed) {
+    table.write_ubodt_compressed(filename);
+  } else {
+    table.write_ubodt_mmap(filename);
+  }
+}
+
+void UBODTGenApp::precompute_ubodt_tiles(
+    const std::string &filename, double delta, double tile_size,
+    bool use_omp) const {
+  int num_vertices = graph_.get_num_vertices();
+  SPDLOG_INFO("Start to generate UBODT with delta {}", delta);
+  SPDLOG_INFO("Output format tiles with tile size {}", tile_size);
+  // Tiles are numbered in the order of their grid cell
+  std::map<std::pair<long long, long long>, std::vector<NodeIndex>> cells;
+  for (int u = 0; u < num_vertices; ++u) {
+    const Point &p = graph_.get_vertex_point(u);
+    cells[{(long long) std::floor(p.get<0>() / tile_size),
+           (long long) std::floor(p.get<1>() / tile_size)}]
+        .push_back(u);
+  }
+  std::vector<unsigned int> node_tiles(num_vertices);
+  std::vector<long long> tile_rows;
+  int progress = 0;
+  for (auto iter = cells.begin(); iter != cells.end(); ++iter) {
+    unsigned int tile = tile_rows.size();
+    const std::vector<NodeIndex> &sources = iter->second;
+    for (NodeIndex u : sources) node_tiles[u] = tile;
+    UBODT table(sources.size(), num_vertices, sources.size(),
+                config_.compact ? COMPACT : FLAT);
+    fill_table(sources, delta, use_omp, &table);
+    tile_rows.push_back(table.get_num_rows());
+    if (table.get_num_rows() > 0 &&
+        !table.write_ubodt_mmap(UBODT::get_tile_file(filename, tile))) {
+      return;
+    }
+    progress += sources.size();
+    SPDLOG_INFO("Tile {} sources {} rows {} progress {} / {}", tile,
+                sources.size(), table.get_num_rows(), progress, num_vertices);
+  }
+  UBODT::write_ubodt_tile_index(filename, node_tiles, tile_rows, delta);
+}
+
+void UBODTGenApp::update_ubodt(
+    const std::string &filename, double delta, bool use_omp) const {
+  SPDLOG_INFO("Start to update UBODT {} with delta {}",
+              config_.update_file, delta);
+  Network old_network(config_.update_network,
+                      config_.network_config.id,
+                      config_.network_config.source,
+                      config_.network_config.target,
+                      config_.network_config.cache,
+                      config_.network_config.get_spatial_index_options(),
+                      config_.network_config.reorder,
+                      config_.network_config.project,
+                      config_.network_config.get_clip(),
+                      config_.network_config.compress_geometry,
+                      config_.network_config.get_cost_names());
+  int old_vertices = old_network.get_node_count();
+  std::shared_ptr<UBODT> old_table =
+      UBODT::read_ubodt_file(config_.update_file, old_vertices, FLAT);
+  if (old_table == nullptr) return;
+  // Translate the indices of the previous network by node and edge id
+  int num_vertices = graph_.get_num_vertices();
+  std::unordered_map<NodeID, NodeIndex> node_ids;
+  for (int u = 0; u < num_vertices; ++u) {
+    node_ids[network_.get_node_id(u)] = u;
+  }
+  std::vector<NodeIndex> node_index(old_vertices, UBODT::EMPTY_SLOT);
+  for (int u = 0; u < old_vertices; ++u) {
+    auto iter = node_ids.find(old_network.get_node_id(u));
+    if (iter != node_ids.end()) node_index[u] = iter->second;
+  }
+  std::unordered_set<EdgeID> changed(config_.changed_edges.begin(),
+                                     config_.changed_edges.end());
+  const std::vector<Edge> &edges = network_.get_edges();
+  std::unordered_map<EdgeID, EdgeIndex> edge_ids;
+  for (const Edge &e : edges) edge_ids[e.id] = e.index;
+  const std::vector<Edge> &old_edges = old_network.get_edges();
+  std::vector<EdgeIndex> edge_index(old_edges.size(), UBODT::EMPTY_SLOT);
+  std::vector<char> changed_source(old_vertices, 0);
+  std::vector<char> affected(num_vertices, 0);
+  for (const Edge &e : old_edges) {
+    auto iter = edge_ids.find(e.id);
+    if (iter != edge_ids.end()) edge_index[e.index] = iter->second;
+    if (changed.count(e.id) > 0) {
+      changed_source[e.source] = 1;
+      if (node_index[e.source] != UBODT::EMPTY_SLOT) {
+        affected[node_index[e.source]] = 1;
+      }
+    }
+  }
+  // A path passing a changed edge in the previous network contains the
+  // row to the source node of that edge.
+  old_table->for_each_record([&](const Record &r) {
+    NodeIndex s = node_index[r.source];
+    if (s == UBODT::EMPTY_SLOT) return;
+    if (changed_source[r.target] ||
+        node_index[r.target] == UBODT::EMPTY_SLOT ||
+        node_index[r.first_n] == UBODT::EMPTY_SLOT ||
+        (r.prev_n != UBODT::EMPTY_SLOT &&
+            node_index[r.prev_n] == UBODT::EMPTY_SLOT) ||
+        edge_index[r.next_e] == UBODT::EMPTY_SLOT) {
+      affected[s] = 1;
+    }
+  });
+  // A path passing a changed edge in the current network starts from
+  // a node reaching the source node of that edge within delta.
+  CSRGraph reverse_graph = graph_.get_reverse_graph();
+  for (const Edge &e : edges) {
+    if (changed.count(e.id) > 0) {
+      mark_reaching_nodes(reverse_graph, e.source, delta, &affected);
+    }
+  }
+  std::vector<NodeIndex> sources;
+  for (int u = 0; u < num_vertices; ++u) {
+    if (affected[u]) sources.push_back(u);
+  }
+  SPDLOG_INFO("Sources affected {} / {}", sources.size(), num_vertices);
+  bool compressed = config_.is_compressed_output();
+  UBODT table(UBODT::find_bucket_number(num_vertices), num_vertices,
+              old_table->get_num_rows(),
+              (config_.compact && !compressed) ? COMPACT : FLAT);
+  old_table->for_each_record([&](const Record &r) {
+    NodeIndex s = node_index[r.source];
+    if (s == UBODT::EMPTY_SLOT || affected[s]) return;
+    NodeIndex prev_n = (r.prev_n == UBODT::EMPTY_SLOT || config_.compact)
+                       ? UBODT::EMPTY_SLOT : node_index[r.prev_n];
+    table.insert(Record{s, node_index[r.target], node_index[r.first_n],
+                        prev_n, edge_index[r.next_e], r.cost, nullptr});
+  });
+  SPDLOG_INFO("Rows copied {}", table.get_num_rows());
+  old_table.reset();
+  fill_table(sources, delta, use_omp, &table);
+  SPDLOG_INFO("Rows generated {}", table.get_num_rows());
+  if (compressed) {
+    table.write_ubodt_compressed(filename);
+  } else {
+    table.write_ubodt_mmap(filename);
+  }
+}
+
+std::vector<NodeIndex> UBODTGenApp::find_demand_sources() const {
+  int num_vertices = graph_.get_num_vertices();
+  std::vector<char> marked(num_vertices, 0);
+  std::vector<Point> points;
+  IO::GPSReader reader(config_.gps_config);
+  int trajectories = 0;
+  while (reader.has_next_trajectory()) {
+    Trajectory trajectory = reader.read_next_trajectory();
+    // Rows are looked up from the target of a candidate edge to the
+    // source of the next one
+    Traj_Candidates tr_cs = network_.search_tr_cs_knn(
+        trajectory.geom, config_.fmm_config.k, config_.fmm_config.radius);
+    for (const Point_Candidates &pcs : tr_cs) {
+      for (const Candidate &c : pcs) {
+        marked[c.edge->source] = 1;
+        marked[c.edge->target] = 1;
+      }
+    }
+    for (int i = 0; i < trajectory.geom.get_num_points(); ++i) {
+      points.push_back(trajectory.geom.get_point(i));
+    }
+    ++trajectories;
+  }
+  mark_nodes_near(network_.get_vertex_points(), points,
+                  config_.demand_radius, &marked);
+  SPDLOG_INFO("Trajectories of the demand {} points {}", trajectories,
+              points.size());
+  std::vector<NodeIndex> sources;
+  for (int u = 0; u < num_vertices; ++u) {
+    if (marked[u]) sources.push_back(u);
+  }
+  return sources;
+}
+
+void UBODTGenApp::fill_table(const std::vector<NodeIndex> &sources,
+                             double delta, bool use_omp,
+                             UBODT *table) const {
+  route_rows(sources, delta, use_omp, [table](std::vector<Record> *rows) {
+#pragma omp critical
+    for (const Record &r : *rows) table->insert(r);
+  });
+}
+
+void UBODTGenApp::route_rows(
+    const std::vector<NodeIndex> &sources, double delta, bool use_omp,
+    const std::function<void(std::vector<Record> *)> &consumer,
+    const std::vector<char> *routed) const {
+  int num_sources = sources.size();
+  int step_size = num_sources / 10;
+  if (step_size < 10) step_size = 10;
+  int progress = 0;
+#pragma omp parallel for if(use_omp)
+  for (int i = 0; i < num_sources; ++i) {
+#pragma omp atomic
+    ++progress;
+    if (progress % step_size == 0) {
+      SPDLOG_INFO("Progress {} / {}", progress, num_sources);
+    }
+    NodeIndex source = sources[i];
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    PathEndMap emap;
+    route(source, delta, &pmap, &dmap, &emap);
+    std::vector<Record> source_map;
+    collect_records(source, pmap, dmap, emap, &source_map);
+    if (routed != nullptr) {
+      collect_path_records(source, pmap, dmap, emap, *routed, &source_map);
+    }
+    if (config_.compact) {
+      for (Record &r:source_map) r.prev_n = UBODT::EMPTY_SLOT;
+    }
+    consumer(&source_map);
+  }
+}
+
+void UBODTGenApp::route(NodeIndex source, double delta,
+                        PredecessorMap *pmap, DistanceMap *dmap,
+                        PathEndMap *emap) const {
+  if (chain_graph_ != nullptr) {
+    if (chains_->is_junction(source)) {
+      chain_graph_->single_source_upperbound_dijkstra(source, delta, pmap,
+                                                      dmap, emap);
+    }
+  } else if (hierarchy_ != nullptr) {
+    hierarchy_->single_source_upperbound(source, delta, pmap, dmap, emap);
+  } else {
+    graph_.single_source_upperbound_dijkstra(source, delta, pmap, dmap,
+                                             emap);
+  }
+  ++sources_routed_;
+  rows_routed_ += emap->size();
+}
+
+long long UBODTGenApp::write_sources(std::string *buffer, NodeIndex first,
+                                     NodeIndex last, double delta,
+                                     bool binary) const {
+  long long rows = 0;
+  for (NodeIndex source = first; source < last; ++source) {
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    PathEndMap emap;
+    route(source, delta, &pmap, &dmap, &emap);
+    if (binary) {
+      write_result_binary(buffer, source, pmap, dmap, emap);
+    } else {
+      write_result_csv(buffer, source, pmap, dmap, emap);
+    }
+    if (config_.symmetric) {
+      for (const auto &ends : emap) rows += ends.first > source;
+    } else {
+      rows += emap.size();
+    }
+  }
+  return rows;
+}
+
+void UBODTGenApp::collect_records(NodeIndex s,
+                                  PredecessorMap &pmap,
+                                  DistanceMap &dmap,
+                                  PathEndMap &emap,
+                                  std::vector<Record> *source_map) const {
+  source_map->reserve(source_map->size() + pmap.size());
   for (auto iter = pmap.begin(); iter != pmap.end(); ++iter) {
     NodeIndex cur_node = iter->first;
+    // The row to a smaller node is the one from it reversed
+    if (config_.symmetric && cur_node < s) continue;
     if (cur_node != s) {
-      NodeIndex prev_node = iter->second;
-      NodeIndex v = cur_node;
-      NodeIndex u;
-      while ((u = pmap[v]) != s) {
-        v = u;
-      }
-      NodeIndex successor = v;
+      const PathEnds &ends = emap[cur_node];
       // Write the result to source map
-      double cost = dmap[successor];
-      EdgeIndex edge_index = graph_.get_edge_index(s, successor, cost);
-      source_map.push_back(
+      source_map->push_back(
           {s,
            cur_node,
-           successor,
-           prev_node,
-           edge_index,
+           ends.first_n,
+           iter->second,
+           ends.first_e,
            dmap[cur_node],
            nullptr});
     }
   }
-#pragma omp critical
+}
+
+void UBODTGenApp::collect_path_records(NodeIndex s,
+                                       PredecessorMap &pmap,
+                                       DistanceMap &dmap,
+                                       PathEndMap &emap,
+                                       const std::vector<char> &routed,
+                                       std::vector<Record> *source_map)
+    const {
+  for (auto iter = pmap.begin(); iter != pmap.end(); ++iter) {
+    NodeIndex target = iter->first;
+    if (target == s) continue;
+    NodeIndex prev_n = iter->second;
+    // Walk back from the target, where next is the node after v
+    NodeIndex next = target;
+    NodeIndex v = prev_n;
+    while (v != s) {
+      if (!routed[v]) {
+        source_map->push_back(
+            {v, target, next, prev_n, emap[next].last_e,
+             dmap[target] - dmap[v], nullptr});
+      }
+      next = v;
+      v = pmap[v];
+    }
+  }
+}
+
+/**
+   * Write the result of routing from a single source node
+   * @param buffer output buffer
+   * @param s      source node
+   * @param pmap   predecessor map
+   * @param dmap   distance map
+   * @param emap   path end map
+   */
+void UBODTGenApp::write_result_csv(
+    std::string *buffer, NodeIndex s,
+                                   PredecessorMap &pmap, DistanceMap &dmap,
+                                   PathEndMap &emap) const {
+  std::vector<Record> source_map;
+  collect_records(s, pmap, dmap, emap, &source_map);
+  bool compact = config_.compact;
+  int num_costs = network_.get_cost_names().size();
+  // The extra costs of the nodes are summed along the predecessors, from
+  // the source where they are 0
+  std::unordered_map<NodeIndex, std::vector<double>> costs;
+  if (num_costs > 0) costs[s] = std::vector<double>(num_costs, 0);
+  std::vector<NodeIndex> walk;
   for (Record &r:source_map) {
-    stream << r.source << ";"
-           << r.target << ";"
-           << r.first_n << ";"
-           << r.prev_n << ";"
-           << r.next_e << ";"
-           << r.cost << "\n";
+    IO::append_int(r.source, buffer);
+    buffer->push_back(';');
+    IO::append_int(r.target, buffer);
+    buffer->push_back(';');
+    IO::append_int(r.first_n, buffer);
+    buffer->push_back(';');
+    if (!compact) {
+      IO::append_int(r.prev_n, buffer);
+      buffer->push_back(';');
+    }
+    IO::append_int(r.next_e, buffer);
+    buffer->push_back(';');
+    append_cost(r.cost, buffer);
+    if (num_costs > 0) {
+      NodeIndex v = r.target;
+      while (costs.find(v) == costs.end()) {
+        walk.push_back(v);
+        v = pmap[v];
+      }
+      while (!walk.empty()) {
+        NodeIndex u = walk.back();
+        walk.pop_back();
+        std::vector<double> cost = costs[pmap[u]];
+        for (int k = 0; k < num_costs; ++k) {
+          cost[k] += network_.get_edge_cost(k + 1, emap[u].last_e);
+        }
+        costs[u] = std::move(cost);
+      }
+      for (double cost:costs[r.target]) {
+        buffer->push_back(';');
+        append_cost(cost, buffer);
+      }
+    }
+    buffer->push_back('\n');
+  }
+}
+
+void UBODTGenApp::append_cost(double cost, std::string *buffer) const {
+  if (config_.cost_precision < 0) {
+    IO::append_double(cost, IO::VALUE_DIGITS, buffer);
+  } else {
+    IO::append_fixed(cost, config_.cost_precision, buffer);
+  }
+}
+
+void UBODTGenApp::write_output_header(bool binary,
+                                      std::string *buffer) const {
+  if (binary) {
+    // The rows follow the header of the archive as raw values
+    std::stringstream archive;
+    {
+      boost::archive::binary_oarchive oa(archive);
+    }
+    buffer->append(archive.str());
+    return;
+  }
+  if (config_.compact) {
+    buffer->append("source;target;next_n;next_e;distance");
+  } else {
+    buffer->append("source;target;next_n;prev_n;next_e;distance");
+  }
+  for (const std::string &name:network_.get_cost_names()) {
+    buffer->push_back(';');
+    buffer->append(name);
   }
+  buffer->push_back('\n');
 }
 
 /**
  * Write the result of routing from a single source node in
  * binary format
  *
- * @param stream output stream
+ * @param buffer output buffer
  * @param s      source node
  * @param pmap   predecessor map
  * @param dmap   distance map
+ * @param emap   path end map
  */
-void UBODTGenApp::write_result_binary(boost::archive::binary_oarchive &stream,
+void UBODTGenApp::write_result_binary(std::string *buffer,
                                       NodeIndex s,
                                       PredecessorMap &pmap,
-                                      DistanceMap &dmap) const {
+                                      DistanceMap &dmap,
+                                      PathEndMap &emap) const {
   std::vector<Record> source_map;
-  for (auto iter = pmap.begin(); iter != pmap.end(); ++iter) {
-    NodeIndex cur_node = iter->first;
-    if (cur_node != s) {
-      NodeIndex prev_node = iter->second;
-      NodeIndex v = cur_node;
-      NodeIndex u;
-      // When u=s, v is the next node visited
-      while ((u = pmap[v]) != s) {
-        v = u;
-      }
-      NodeIndex successor = v;
-      // Write the result
-      double cost = dmap[successor];
-      EdgeIndex edge_index = graph_.get_edge_index(s, successor, cost);
-      source_map.push_back(
-          {s,
-           cur_node,
-           successor,
-           prev_node,
-           edge_index,
-           dmap[cur_node],
-           nullptr});
-    }
-  }
-#pragma omp critical
+  collect_records(s, pmap, dmap, emap, &source_map);
+  // The fields are written as a boost binary archive writes them
   for (Record &r:source_map) {
-    stream << r.source << r.target
-           << r.first_n << r.prev_n << r.next_e << r.cost;
+    append_raw(r.source, buffer);
+    append_raw(r.target, buffer);
+    append_raw(r.first_n, buffer);
+    append_raw(r.prev_n, buffer);
+    append_raw(r.next_e, buffer);
+    append_raw(r.cost, buffer);
   }
 }
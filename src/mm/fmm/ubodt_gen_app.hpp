@@ -12,8 +12,15 @@
 
 #include <boost/archive/binary_oarchive.hpp>
 #include "mm/fmm/ubodt_gen_app_config.hpp"
+#include "mm/fmm/ubodt.hpp"
 #include "network/network.hpp"
 #include "network/network_graph.hpp"
+#include "network/chain_graph.hpp"
+#include "network/contraction_hierarchy.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
 
 namespace FMM {
 namespace MM{
@@ -31,12 +38,29 @@ class UBODTGenApp {
       network_(config_.network_config.file,
                config_.network_config.id,
                config_.network_config.source,
-               config_.network_config.target),
-      graph_(network_) {};
+               config_.network_config.target,
+               config_.network_config.cache,
+               config_.network_config.get_spatial_index_options(),
+               config_.network_config.reorder,
+               config_.network_config.project,
+               config_.network_config.get_clip(),
+               config_.network_config.compress_geometry,
+               config_.network_config.get_cost_names()),
+      graph_(network_, config_.network_config.read_edge_mask(network_)) {
+  };
+  /**
+   * Run the precomputation, with delta selected by the profile of
+   * the GPS data if a hit rate is configured
+   */
+  void run();
   /**
-   * Run the precomputation
+   * Profile the distances requested by matching the GPS data
+   * configured, which is reported and written to the profile file
+   * @param delta delta configured, which is replaced by the one
+   * reaching the hit rate if configured
+   * @return false if the profile fails or the hit rate is not reached
    */
-  void run() const;
+  bool profile_delta(double *delta) const;
   /**
    * Run precomputation in a single thread and save result to a file
    * @param filename output file name
@@ -53,33 +77,202 @@ class UBODTGenApp {
    */
   void precompute_ubodt_omp(const std::string &filename, double delta,
                             bool binary = true) const;
+  /**
+   * Run precomputation of the sources in a partition or a range and save
+   * the result to a shard file, next to a manifest updated after each
+   * chunk of sources. A shard is resumed from its manifest if resume is
+   * configured, and the shards are merged by ubodt_merge.
+   * @param filename output shard file name
+   * @param delta    upper bound value
+   * @param binary   whether store binary data or not
+   * @param use_omp  whether run the routing parallelly
+   */
+  void precompute_ubodt_shard(const std::string &filename, double delta,
+                              bool binary, bool use_omp) const;
+  /**
+   * Run precomputation into a flat table in memory and save it to a
+   * memory mapped file (mmap extension), which can be loaded by fmm
+   * without parsing, or a block compressed file (ubz extension). Only
+   * the sources of the region are routed if a region file is configured,
+   * or the sources near the traffic if a demand radius is configured.
+   * @param filename output file name
+   * @param delta    upper bound value
+   * @param use_omp  whether run the routing parallelly
+   */
+  void precompute_ubodt_table(const std::string &filename, double delta,
+                              bool use_omp) const;
+  /**
+   * Run precomputation tile by tile, where the source nodes are grouped
+   * by the square tile containing them. The rows of each tile are saved
+   * to a memory mapped file next to a tile index file, which can be
+   * loaded by fmm keeping only the tiles queried in memory.
+   * @param filename  output tile index file name
+   * @param delta     upper bound value
+   * @param tile_size side length of a tile
+   * @param use_omp   whether run the routing parallelly
+   */
+  void precompute_ubodt_tiles(const std::string &filename, double delta,
+                              double tile_size, bool use_omp) const;
+  /**
+   * Update the UBODT generated from a previous version of the network,
+   * where only the sources whose shortest paths within delta may pass a
+   * changed edge are routed again. The other rows are copied with the
+   * node and edge indices translated to the current network. The result
+   * is saved to a memory mapped file (mmap extension) or a block
+   * compressed file (ubz extension).
+   * @param filename output file name
+   * @param delta    upper bound value, which should be the one used to
+   * generate the previous UBODT
+   * @param use_omp  whether run the routing parallelly
+   */
+  void update_ubodt(const std::string &filename, double delta,
+                    bool use_omp) const;
+  /**
+   * Find the sources of a UBODT generated on demand, which are the
+   * nodes of the candidates of the points of the GPS file and the nodes
+   * within the demand radius of the points
+   * @return the sources in ascending order
+   */
+  std::vector<NETWORK::NodeIndex> find_demand_sources() const;
 
  private:
   const UBODTGenAppConfig &config_;
   NETWORK::Network network_;
   NETWORK::NetworkGraph graph_;
+  std::unique_ptr<NETWORK::ContractionHierarchy> hierarchy_;
+  // Chains of the network and the graph of the chains routed instead of
+  // the network, nullptr if chains are not compressed
+  std::unique_ptr<NETWORK::ChainGraph> chains_;
+  std::unique_ptr<NETWORK::NetworkGraph> chain_graph_;
+  // Counters of the routing, read by the thread of the metrics exporter
+  mutable std::atomic<long> sources_routed_{0};
+  mutable std::atomic<long> rows_routed_{0};
   /**
-   * Write the routing result to a binary stream
-   * @param stream output binary stream
+   * Run the routing from a single source node with the engine
+   * configured, or on the graph of the chains if they are compressed,
+   * where a node inside a chain has no rows
+   * @param source source node
+   * @param delta  upper bound value
+   * @param pmap   predecessor map
+   * @param dmap   distance map
+   * @param emap   path end map
+   */
+  void route(NETWORK::NodeIndex source, double delta,
+             NETWORK::PredecessorMap *pmap, NETWORK::DistanceMap *dmap,
+             NETWORK::PathEndMap *emap) const;
+  /**
+   * Run the routing from several source nodes and insert the rows
+   * into a table
+   * @param sources source nodes
+   * @param delta   upper bound value
+   * @param use_omp whether run the routing parallelly
+   * @param table   table where the rows are inserted
+   */
+  void fill_table(const std::vector<NETWORK::NodeIndex> &sources,
+                  double delta, bool use_omp, UBODT *table) const;
+  /**
+   * Run the routing from several source nodes and pass the rows of
+   * each source to a consumer
+   * @param sources  source nodes
+   * @param delta    upper bound value
+   * @param use_omp  whether run the routing parallelly
+   * @param consumer function called with the rows of a source, which
+   * may be called by several threads at the same time
+   * @param routed   if not nullptr, nodes routed as sources are non zero
+   * and the rows walked by the paths of a source from the nodes not
+   * routed are passed as well
+   */
+  void route_rows(
+      const std::vector<NETWORK::NodeIndex> &sources, double delta,
+      bool use_omp,
+      const std::function<void(std::vector<Record> *)> &consumer,
+      const std::vector<char> *routed = nullptr) const;
+  /**
+   * Run the routing from a range of source nodes and append the rows
+   * to a buffer, where binary rows are written without archive header
+   * @param buffer output buffer
+   * @param first  first source node
+   * @param last   source node after the last one
+   * @param delta  upper bound value
+   * @param binary whether store binary data or not
+   * @return number of rows written
+   */
+  long long write_sources(std::string *buffer, NETWORK::NodeIndex first,
+                          NETWORK::NodeIndex last, double delta,
+                          bool binary) const;
+  /**
+   * Collect the rows of routing result from a single source node
+   * @param s          source node
+   * @param pmap       predecessor map
+   * @param dmap       distance map
+   * @param emap       path end map
+   * @param source_map rows collected
+   */
+  void collect_records(NETWORK::NodeIndex s,
+                       NETWORK::PredecessorMap &pmap,
+                       NETWORK::DistanceMap &dmap,
+                       NETWORK::PathEndMap &emap,
+                       std::vector<Record> *source_map) const;
+  /**
+   * Collect the rows from the nodes on the shortest paths of a source
+   * node to their targets, for the nodes not routed. The suffix of a
+   * shortest path is a shortest path, so that the paths of a UBODT
+   * whose sources are a subset of the nodes can still be walked.
+   * @param s          source node
+   * @param pmap       predecessor map
+   * @param dmap       distance map
+   * @param emap       path end map
+   * @param routed     nodes routed as sources are non zero
+   * @param source_map rows collected
+   */
+  void collect_path_records(NETWORK::NodeIndex s,
+                            NETWORK::PredecessorMap &pmap,
+                            NETWORK::DistanceMap &dmap,
+                            NETWORK::PathEndMap &emap,
+                            const std::vector<char> &routed,
+                            std::vector<Record> *source_map) const;
+  /**
+   * Append the routing result to a buffer as the rows of a boost binary
+   * archive
+   * @param buffer output buffer
    * @param s      source node
    * @param pmap   predecessor map
    * @param dmap   distance map
+   * @param emap   path end map
    */
-  void write_result_binary(boost::archive::binary_oarchive &stream,
+  void write_result_binary(std::string *buffer,
                            NETWORK::NodeIndex s,
                            NETWORK::PredecessorMap &pmap,
-                           NETWORK::DistanceMap &dmap) const;
+                           NETWORK::DistanceMap &dmap,
+                           NETWORK::PathEndMap &emap) const;
+  /**
+   * Append the header of the output, which is the header of a boost
+   * binary archive, or the csv column names with a column per extra cost
+   * of the network after the distance
+   * @param binary whether store binary data or not
+   * @param buffer output buffer
+   */
+  void write_output_header(bool binary, std::string *buffer) const;
+  /**
+   * Append a cost of a csv row, with the cost precision of the
+   * configuration
+   * @param cost   cost appended
+   * @param buffer output buffer
+   */
+  void append_cost(double cost, std::string *buffer) const;
   /**
-   * Write the routing result to a csv stream
-   * @param stream output csv stream
+   * Append the routing result to a buffer as csv rows
+   * @param buffer output buffer
    * @param s      source node
    * @param pmap   predecessor map
    * @param dmap   distance map
+   * @param emap   path end map
    */
-  void write_result_csv(std::ostream &stream,
+  void write_result_csv(std::string *buffer,
                         NETWORK::NodeIndex s,
                         NETWORK::PredecessorMap &pmap,
-                        NETWORK::DistanceMap &dmap) const;
+                        NETWORK::DistanceMap &dmap,
+                        NETWORK::PathEndMap &emap) const;
 };
 }
 }
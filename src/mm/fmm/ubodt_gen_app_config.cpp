@@ -31,10 +31,43 @@ void UBODTGenAppConfig::load_xml(const std::string &file) {
   boost::property_tree::read_xml(file, tree);
   network_config = NetworkConfig::load_from_xml(tree);
   delta = tree.get("config.parameters.delta", 3000.0);
+  engine = tree.get("config.parameters.engine", std::string("dijkstra"));
   result_file = tree.get<std::string>("config.output.file");
+  compact = !(!tree.get_child_optional("config.output.compact"));
+  symmetric = !(!tree.get_child_optional("config.output.symmetric"));
+  compress_chains =
+      !(!tree.get_child_optional("config.output.compress_chains"));
+  network_ids = !(!tree.get_child_optional("config.output.network_ids"));
+  tile_size = tree.get("config.output.tile_size", 10000.0);
+  memory_budget = tree.get("config.output.memory_budget", 0);
+  cost_precision = tree.get("config.output.cost_precision", -1);
+  async_write = !(!tree.get_child_optional("config.output.async_write"));
+  update_file = tree.get("config.update.ubodt", std::string(""));
+  update_network = tree.get("config.update.network", std::string(""));
+  changed_edges = UTIL::string2vec<EdgeID>(
+      tree.get("config.update.changed_edges", std::string("")));
+  if (tree.get_child_optional("config.input.gps")) {
+    gps_config = GPSConfig::load_from_xml(tree);
+  }
+  fmm_config = FastMapMatchConfig::load_from_xml(tree);
+  profile_trajectories = tree.get("config.profile.trajectories", 1000);
+  profile_sources = tree.get("config.profile.sources", 1000);
+  profile_delta = tree.get("config.profile.max_delta", -1.0);
+  hit_rate = tree.get("config.profile.hit_rate", 0.0);
+  profile_file = tree.get("config.profile.file", std::string(""));
+  demand_radius = tree.get("config.demand.radius", -1.0);
+  partition = tree.get("config.partition.id", 0);
+  num_partitions = tree.get("config.partition.num", 1);
+  first_source = tree.get("config.partition.first_source", -1);
+  last_source = tree.get("config.partition.last_source", -1);
+  resume = !(!tree.get_child_optional("config.partition.resume"));
+  region_file = tree.get("config.region.file", std::string(""));
+  region = tree.get("config.region.index", 0);
   // 0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off
   log_level = tree.get("config.other.log_level", 2);
   use_omp = !(!tree.get_child_optional("config.other.use_omp"));
+  metrics_file = tree.get("config.other.metrics_file", std::string(""));
+  metrics_interval = tree.get("config.other.metrics_interval", 15);
   SPDLOG_INFO("Read configuration from xml file done");
 }
 
@@ -51,13 +84,153 @@ void UBODTGenAppConfig::load_arg(int argc, char **argv) {
     cxxopts::value<std::string>()->default_value("source"))
     ("target", "Network target name",
     cxxopts::value<std::string>()->default_value("target"))
+    ("no_network_cache", "Do not read or write the network cache")
+    ("rtree", "Rtree algorithm",
+    cxxopts::value<std::string>()->default_value("packing"))
+    ("rtree_max_elements", "Rtree node capacity",
+    cxxopts::value<int>()->default_value("16"))
+    ("rtree_chunk_segments", "Segments of the edge chunks in the rtree",
+    cxxopts::value<int>()->default_value("0"))
+    ("spatial_index", "Spatial index of the edges",
+    cxxopts::value<std::string>()->default_value("rtree"))
+    ("grid_cell_size", "Cell size of the grid index",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_batch_size", "Points searched with one spatial index query",
+    cxxopts::value<int>()->default_value("1"))
+    ("nearest_search", "Search the candidates with the nearest query")
+    ("search_initial_radius", "Radius of the first search of a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_min_candidates", "Candidates below which the radius grows",
+    cxxopts::value<int>()->default_value("1"))
+    ("search_radius_growth", "Factor of each growth of the radius",
+    cxxopts::value<double>()->default_value("2"))
+    ("search_snap_resolution", "Cell size of the snapping cache",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_snap_items", "Maximum edges cached by the snapping cache",
+    cxxopts::value<long>()->default_value(
+        std::to_string(NETWORK::SnapCache::DEFAULT_CACHE_ITEMS)))
+    ("reorder_network", "Renumber nodes along the Hilbert curve")
+    ("project_network", "Project a lon/lat network into metres")
+    ("compress_geometry", "Keep the edge geometries compressed")
+    ("twin_edges", "Index the twin edges of two-way roads once")
+    ("network_clip", "Region of the network read, box or WKT polygon",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_clip_margin", "Margin around the network clip region",
+    cxxopts::value<double>()->default_value("0"))
+    ("network_costs", "Extra cost columns of the network",
+    cxxopts::value<std::string>()->default_value(""))
+    ("network_edge_mask", "File of the ids of the edges allowed",
+    cxxopts::value<std::string>()->default_value(""))
     ("delta", "Upperbound distance",
     cxxopts::value<double>()->default_value("3000.0"))
+    ("engine", "Routing engine",
+    cxxopts::value<std::string>()->default_value("dijkstra"))
     ("o,output", "Output file name",
     cxxopts::value<std::string>()->default_value(""))
+    ("tile_size", "Side length of spatial tiles",
+    cxxopts::value<double>()->default_value("10000.0"))
+    ("memory_budget", "Memory of the mmap output written in MB",
+    cxxopts::value<int>()->default_value("0"))
+    ("cost_precision", "Number of decimals of the costs of csv output",
+    cxxopts::value<int>()->default_value("-1"))
+    ("async_write", "Write the output by a thread of its own")
+    ("update", "Ubodt file to update",
+    cxxopts::value<std::string>()->default_value(""))
+    ("update_network", "Network file of the ubodt to update",
+    cxxopts::value<std::string>()->default_value(""))
+    ("changed_edges", "Ids of the edges changed",
+    cxxopts::value<std::string>()->default_value(""))
+    ("gps", "GPS file name profiled",
+    cxxopts::value<std::string>()->default_value(""))
+    ("gps_id", "GPS file id",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("gps_x", "GPS x name",
+    cxxopts::value<std::string>()->default_value("x"))
+    ("gps_y", "GPS y name",
+    cxxopts::value<std::string>()->default_value("y"))
+    ("gps_geom", "GPS file geom column name",
+    cxxopts::value<std::string>()->default_value("geom"))
+    ("gps_timestamp", "GPS file timestamp column name",
+    cxxopts::value<std::string>()->default_value("timestamp"))
+    ("gps_point", "GPS point or not")
+    ("k,candidates", "Number of candidates",
+    cxxopts::value<int>()->default_value("8"))
+    ("r,radius", "Search radius",
+    cxxopts::value<double>()->default_value("300.0"))
+    ("e,error", "GPS error",
+    cxxopts::value<double>()->default_value("50.0"))
+    ("min_ep_ratio", "Minimum emission probability ratio to the best",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_dist_ratio", "Maximum distance ratio to the best candidate",
+    cxxopts::value<double>()->default_value("0"))
+    ("adaptive_k_spacing", "Point spacing below which k is reduced",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_heading_diff", "Maximum angle between point heading and edge",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_heading_distance", "Neighbour distance giving a reliable heading",
+    cxxopts::value<double>()->default_value("0"))
+    ("beam_size", "Maximum number of states expanded per layer",
+    cxxopts::value<int>()->default_value("0"))
+    ("beam_margin", "Maximum log probability difference to the best state",
+    cxxopts::value<double>()->default_value("0"))
+    ("split", "Split the trajectories at the breaks of the matching")
+    ("max_time_gap", "Time gap splitting the trajectories",
+    cxxopts::value<double>()->default_value("0"))
+    ("parallel_viterbi", "Points from which a trajectory runs in parallel",
+    cxxopts::value<int>()->default_value("0"))
+    ("stationary_radius", "Radius of the stationary clusters collapsed",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_distance", "Minimum distance between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_interval", "Minimum time between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("coarse_step", "Points per point of the coarse pass",
+    cxxopts::value<int>()->default_value("0"))
+    ("corridor_buffer", "Buffer of the corridor of the coarse path",
+    cxxopts::value<double>()->default_value("0"))
+    ("corridor_k", "Number of candidates in the corridor",
+    cxxopts::value<int>()->default_value("0"))
+    ("approximate_ep","Approximate the emission probabilities")
+    ("max_seconds","Maximum seconds spent on a trajectory",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_transitions","Maximum transitions evaluated for a trajectory",
+    cxxopts::value<long>()->default_value("0"))
+    ("profile_trajectories", "Maximum number of trajectories profiled",
+    cxxopts::value<int>()->default_value("1000"))
+    ("profile_sources", "Number of sources routed in the profile",
+    cxxopts::value<int>()->default_value("1000"))
+    ("profile_delta", "Upper bound of the distances profiled",
+    cxxopts::value<double>()->default_value("-1"))
+    ("hit_rate", "Fraction of transitions covered by the delta selected",
+    cxxopts::value<double>()->default_value("0"))
+    ("profile_output", "Output file of the profile",
+    cxxopts::value<std::string>()->default_value(""))
+    ("demand_radius", "Radius of the GPS points whose nodes are generated",
+    cxxopts::value<double>()->default_value("-1"))
+    ("partition", "Index of the partition generated",
+    cxxopts::value<int>()->default_value("0"))
+    ("num_partitions", "Number of partitions of the sources",
+    cxxopts::value<int>()->default_value("1"))
+    ("first_source", "First source generated",
+    cxxopts::value<int>()->default_value("-1"))
+    ("last_source", "Source after the last one generated",
+    cxxopts::value<int>()->default_value("-1"))
+    ("resume", "Resume the shard from its manifest if specified")
+    ("regions", "Region file written by region_gen",
+    cxxopts::value<std::string>()->default_value(""))
+    ("region", "Index of the region generated",
+    cxxopts::value<int>()->default_value("0"))
     ("l,log_level", "Log level", cxxopts::value<int>()->default_value("2"))
     ("h,help",   "Help information")
     ("use_omp","Use parallel computing if specified")
+    ("metrics_file","Prometheus text file of the metrics of the generation",
+    cxxopts::value<std::string>()->default_value(""))
+    ("metrics_interval","Seconds between two writes of the metrics file",
+    cxxopts::value<int>()->default_value("15"))
+    ("compact","Write compact rows without prev_n if specified")
+    ("symmetric","Write the rows from the smaller node of each od pair")
+    ("compress_chains","Write the rows between the junctions of chains")
+    ("write_network_ids","Write the node and edge ids next to the output")
     ("projected","Data is projected or not");
   if (argc==1) {
     help_specified = true;
@@ -69,7 +242,37 @@ void UBODTGenAppConfig::load_arg(int argc, char **argv) {
   network_config =  NetworkConfig::load_from_arg(result);
   log_level = result["log_level"].as<int>();
   delta = result["delta"].as<double>();
+  engine = result["engine"].as<std::string>();
   use_omp = result.count("use_omp")>0;
+  metrics_file = result["metrics_file"].as<std::string>();
+  metrics_interval = result["metrics_interval"].as<int>();
+  compact = result.count("compact")>0;
+  symmetric = result.count("symmetric")>0;
+  compress_chains = result.count("compress_chains")>0;
+  network_ids = result.count("write_network_ids")>0;
+  tile_size = result["tile_size"].as<double>();
+  memory_budget = result["memory_budget"].as<int>();
+  cost_precision = result["cost_precision"].as<int>();
+  async_write = result.count("async_write")>0;
+  update_file = result["update"].as<std::string>();
+  update_network = result["update_network"].as<std::string>();
+  changed_edges = UTIL::string2vec<EdgeID>(
+      result["changed_edges"].as<std::string>());
+  gps_config = GPSConfig::load_from_arg(result);
+  fmm_config = FastMapMatchConfig::load_from_arg(result);
+  profile_trajectories = result["profile_trajectories"].as<int>();
+  profile_sources = result["profile_sources"].as<int>();
+  profile_delta = result["profile_delta"].as<double>();
+  hit_rate = result["hit_rate"].as<double>();
+  profile_file = result["profile_output"].as<std::string>();
+  demand_radius = result["demand_radius"].as<double>();
+  partition = result["partition"].as<int>();
+  num_partitions = result["num_partitions"].as<int>();
+  first_source = result["first_source"].as<int>();
+  last_source = result["last_source"].as<int>();
+  resume = result.count("resume")>0;
+  region_file = result["regions"].as<std::string>();
+  region = result["region"].as<int>();
   if (result.count("help")>0) {
     help_specified = true;
   }
@@ -80,22 +283,212 @@ void UBODTGenAppConfig::print() const {
   SPDLOG_INFO("----    Print configuration   ----");
   network_config.print();
   SPDLOG_INFO("Delta {}",delta);
+  SPDLOG_INFO("Engine {}",engine);
   SPDLOG_INFO("Output file {}",result_file);
+  SPDLOG_INFO("Compact output {}",(compact ? "true" : "false"));
+  SPDLOG_INFO("Symmetric output {}",(symmetric ? "true" : "false"));
+  SPDLOG_INFO("Compress chains {}",(compress_chains ? "true" : "false"));
+  SPDLOG_INFO("Write network ids {}",(network_ids ? "true" : "false"));
+  if (is_tiled_output()) {
+    SPDLOG_INFO("Tile size {}",tile_size);
+  }
+  if (memory_budget > 0) {
+    SPDLOG_INFO("Memory budget {} MB",memory_budget);
+  }
+  if (cost_precision >= 0) {
+    SPDLOG_INFO("Cost precision {}",cost_precision);
+  }
+  SPDLOG_INFO("Asynchronous write {}",(async_write ? "true" : "false"));
+  if (is_update()) {
+    SPDLOG_INFO("Update file {}",update_file);
+    SPDLOG_INFO("Update network {}",update_network);
+    SPDLOG_INFO("Changed edges {}",changed_edges.size());
+  }
+  if (is_profile() || is_demand()) {
+    gps_config.print();
+    fmm_config.print();
+  }
+  if (is_profile()) {
+    SPDLOG_INFO("Profile trajectories {} sources {} max delta {}",
+                profile_trajectories, profile_sources, profile_delta);
+    SPDLOG_INFO("Hit rate {}",hit_rate);
+    SPDLOG_INFO("Profile file {}",profile_file);
+  }
+  if (is_demand()) {
+    SPDLOG_INFO("Demand radius {}",demand_radius);
+  }
+  if (is_shard()) {
+    SPDLOG_INFO("Partition {} / {}",partition,num_partitions);
+    SPDLOG_INFO("Source range {} {}",first_source,last_source);
+    SPDLOG_INFO("Resume {}",(resume ? "true" : "false"));
+  }
+  if (is_region()) {
+    SPDLOG_INFO("Region {} of {}",region,region_file);
+  }
   SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
   SPDLOG_INFO("Use omp {}",(use_omp ? "true" : "false"));
+  if (!metrics_file.empty()) {
+    SPDLOG_INFO("Metrics file {} interval {}",metrics_file,metrics_interval);
+  }
   SPDLOG_INFO("---- Print configuration done ----");
 }
 
 void UBODTGenAppConfig::print_help() {
   std::cout << "ubodt_gen argument lists:\n";
   std::cout << "--network (required) <string>: Network file name\n";
-  std::cout << "--output (required) <string>: Output file name\n";
+  std::cout << "--output (required) <string>: Output file name, csv or "
+               "txt output ending with gz is compressed with gzip\n";
+  std::cout << "  csv or txt for CSV, bin for binary,\n";
+  std::cout << "  mmap for memory mapped flat table,\n";
+  std::cout << "  ubz for block compressed table,\n";
+  std::cout << "  tiles for memory mapped tables split by source tile\n";
   std::cout << "--id (optional) <string>: Network id name (id)\n";
   std::cout << "--source (optional) <string>: Network source name (source)\n";
   std::cout << "--target (optional) <string>: Network target name (target)\n";
+  std::cout << "--no_network_cache: do not read or write the network\n";
+  std::cout << "  cache file, which is created next to the network file\n";
+  std::cout << "--rtree (optional) <string>: Rtree algorithm of the edges,\n";
+  std::cout << "  packing, linear, quadratic or rstar (packing)\n";
+  std::cout << "--rtree_max_elements (optional) <int>: Maximum number of\n";
+  std::cout << "  elements in a rtree node (16)\n";
+  std::cout << "--rtree_chunk_segments (optional) <int>: Maximum number\n";
+  std::cout << "  of segments of the chunks of a long edge indexed by the\n";
+  std::cout << "  rtree, 0 for the whole edges (0)\n";
+  std::cout << "--spatial_index (optional) <string>: Spatial index of the\n";
+  std::cout << "  edges in candidate search, rtree, flat or grid (rtree)\n";
+  std::cout << "--grid_cell_size (optional) <double>: Cell size of the grid\n";
+  std::cout << "  index, close to the search radius, 0 for the mean extent\n";
+  std::cout << "  of the edges (0)\n";
+  std::cout << "--search_batch_size (optional) <int>: Number of\n";
+  std::cout << "  consecutive points searched with one spatial index\n";
+  std::cout << "  query (1)\n";
+  std::cout << "--nearest_search: search the k candidates of a point with\n";
+  std::cout << "  the incremental nearest query of the rtree\n";
+  std::cout << "--search_initial_radius (optional) <double>: radius of the\n";
+  std::cout << "  first search of a point, multiplied by the growth until the\n";
+  std::cout << "  point has the minimum candidates or the radius is reached,\n";
+  std::cout << "  0 to search with the radius directly (0)\n";
+  std::cout << "--search_min_candidates (optional) <int>: candidates of a point\n";
+  std::cout << "  below which its search radius grows (1)\n";
+  std::cout << "--search_radius_growth (optional) <double>: factor of each\n";
+  std::cout << "  growth of the search radius (2)\n";
+  std::cout << "--search_snap_resolution (optional) <double>: cell size\n";
+  std::cout << "  of the snapping cache of the edges near the points (0)\n";
+  std::cout << "--search_snap_items (optional) <long>: maximum edges\n";
+  std::cout << "  cached by the snapping cache (10000000)\n";
+  std::cout << "--reorder_network: renumber nodes along the Hilbert curve\n";
+  std::cout << "  for memory locality, fmm must be run with it\n";
+  std::cout << "--project_network: project a network in longitude and\n";
+  std::cout << "  latitude into metres, so that delta is in metres, fmm\n";
+  std::cout << "  must be run with it\n";
+  std::cout << "--compress_geometry: keep the edge geometries delta\n";
+  std::cout << "  and varint encoded, decoded on demand\n";
+  std::cout << "--twin_edges: pair the edges of two-way roads whose\n";
+  std::cout << "  geometries are reversed, indexed once in the rtree\n";
+  std::cout << "--network_clip (optional) <string>: read only the edges\n";
+  std::cout << "  in a box minx,miny,maxx,maxy or a WKT polygon, so that\n";
+  std::cout << "  the ubodt covers the region, fmm must be run with it\n";
+  std::cout << "--network_clip_margin (optional) <double>: margin added\n";
+  std::cout << "  around the clip region (0)\n";
+  std::cout << "--network_costs (optional) <string>: numeric columns of\n";
+  std::cout << "  the network read as the costs of the edges under other\n";
+  std::cout << "  metrics, separated by comma, e.g., time\n";
+  std::cout << "--network_edge_mask (optional) <string>: file of the ids\n";
+  std::cout << "  of the edges allowed to the vehicles matched, such as the\n";
+  std::cout << "  edges open to trucks, the others are not routed\n";
   std::cout << "--delta (optional) <double>: upperbound (3000.0)\n";
+  std::cout << "--engine (optional) <string>: dijkstra for a search per "
+               "source or ch for bucket many-to-many search\n";
+  std::cout << "  on a contraction hierarchy, faster for large delta "
+               "(dijkstra)\n";
+  std::cout << "--tile_size (optional) <double>: side length of spatial "
+               "tiles, only for tiles output (10000.0)\n";
+  std::cout << "--memory_budget (optional) <int>: if positive, the rows "
+               "of mmap output are spilled next to\n";
+  std::cout << "  the output file and written in the order of their "
+               "slots, holding about this memory in MB (0)\n";
+  std::cout << "--cost_precision (optional) <int>: number of decimals of "
+               "the costs of csv output,\n";
+  std::cout << "  -1 for 6 significant digits (-1)\n";
+  std::cout << "--async_write: write the csv, txt or bin output by a "
+               "thread of its own while the rows are generated\n";
+  std::cout << "--update (optional) <string>: ubodt file to update "
+               "instead of generating all the rows,\n";
+  std::cout << "  only for mmap and ubz output\n";
+  std::cout << "--update_network (optional) <string>: network file "
+               "where the updated ubodt was generated\n";
+  std::cout << "--changed_edges (optional) <string>: ids of the edges "
+               "added, removed or modified, separated by ,\n";
+  std::cout << "--gps (optional) <string>: GPS file profiled for the "
+               "distances requested by fmm,\n";
+  std::cout << "  without output file only the profile is reported\n";
+  std::cout << "--gps_id, --gps_geom, --gps_x, --gps_y, --gps_timestamp, "
+               "--gps_point (optional): GPS fields as in fmm\n";
+  std::cout << "-k/--candidates, -r/--radius, -e/--error, "
+               "--min_ep_ratio,\n";
+  std::cout << "  --max_dist_ratio, --adaptive_k_spacing, "
+               "--max_heading_diff,\n";
+  std::cout << "  --min_heading_distance, --beam_size, --beam_margin\n";
+  std::cout << "  (optional): map matching parameters as in fmm\n";
+  std::cout << "--profile_trajectories (optional) <int>: maximum number "
+               "of trajectories profiled (1000)\n";
+  std::cout << "--profile_sources (optional) <int>: number of sources "
+               "routed to estimate the rows (1000)\n";
+  std::cout << "--profile_delta (optional) <double>: upper bound of the "
+               "distances profiled (4 times delta)\n";
+  std::cout << "--hit_rate (optional) <double>: generate with the "
+               "smallest delta covering this fraction\n";
+  std::cout << "  of the transitions matched (0, disabled)\n";
+  std::cout << "--profile_output (optional) <string>: csv file of the "
+               "coverage and memory against delta\n";
+  std::cout << "--demand_radius (optional) <double>: if not negative, "
+               "only the nodes of the candidates\n";
+  std::cout << "  of the GPS points and the nodes within this radius of "
+               "the points are generated\n";
+  std::cout << "  as sources, together with the rows walked by their "
+               "paths, only for mmap and ubz\n";
+  std::cout << "  output. The GPS file is then a sample of the traffic, "
+               "which is profiled only\n";
+  std::cout << "  with hit_rate or profile_output (-1, disabled)\n";
+  std::cout << "--partition (optional) <int>: index of the partition "
+               "of the sources generated (0)\n";
+  std::cout << "--num_partitions (optional) <int>: number of partitions "
+               "of the sources (1)\n";
+  std::cout << "--first_source (optional) <int>: first source index "
+               "generated instead of a partition,\n";
+  std::cout << "--last_source (optional) <int>: source index after the "
+               "last one generated instead of a partition,\n";
+  std::cout << "  a shard of csv, txt or bin output is written with a "
+               "manifest, merged by ubodt_merge\n";
+  std::cout << "--resume: resume the shard from its manifest\n";
+  std::cout << "--regions (optional) <string>: region file written by "
+               "region_gen, where only\n";
+  std::cout << "  the sources of a region are generated into mmap or ubz "
+               "output\n";
+  std::cout << "--region (optional) <int>: index of the region "
+               "generated (0)\n";
   std::cout << "--log_level (optional) <int>: log level (2)\n";
   std::cout << "--use_omp: use OpenMP or not\n";
+  std::cout << "--metrics_file (optional) <string>: Prometheus text file "
+               "of the sources routed and memory,\n";
+  std::cout << "  rewritten periodically for the textfile collector of "
+               "the node exporter\n";
+  std::cout << "--metrics_interval (optional) <int>: seconds between two "
+               "writes of the metrics file (15)\n";
+  std::cout << "--compact: write rows without prev_n, "
+               "only for csv, mmap, ubz and tiles output\n";
+  std::cout << "--symmetric: write only the rows from the smaller node "
+               "of each od pair, for a network\n";
+  std::cout << "  whose edges are the same in both directions, loaded "
+               "by fmm with ubodt_symmetric\n";
+  std::cout << "--compress_chains: write only the rows between the "
+               "junctions of the chains\n";
+  std::cout << "  of degree two nodes, whose edges are chains, loaded "
+               "by fmm with ubodt_chains\n";
+  std::cout << "--write_network_ids: write the node and edge ids of the "
+               "network next to the output,\n";
+  std::cout << "  so that fmm with ubodt_clip loads the rows inside a "
+               "clipped network\n";
   std::cout << "-h/--help: help information\n";
   std::cout << "For xml configuration, check example folder\n";
 }
@@ -105,23 +498,183 @@ bool UBODTGenAppConfig::validate() const {
   if (!network_config.validate()) {
     return false;
   }
-  if (UTIL::file_exists(result_file)) {
-    SPDLOG_WARN("Overwrite result file {}", result_file);
+  if (is_profile() || is_demand()) {
+    if (!gps_config.validate() || !fmm_config.validate()) {
+      return false;
+    }
   }
-  std::string output_folder = UTIL::get_file_directory(result_file);
-  if (!UTIL::folder_exist(output_folder)) {
-    SPDLOG_CRITICAL("Output folder {} not exists", output_folder);
-    return false;
+  if (is_profile()) {
+    if (hit_rate < 0 || hit_rate > 1) {
+      SPDLOG_CRITICAL("Hit rate {} should be in [0, 1]", hit_rate);
+      return false;
+    }
+    if (profile_trajectories <= 0 || profile_sources <= 0) {
+      SPDLOG_CRITICAL("Profile trajectories {} and sources {} should be "
+                      "positive", profile_trajectories, profile_sources);
+      return false;
+    }
+  }
+  // Only the profile is reported without output file
+  if (!is_profile() || !result_file.empty()) {
+    if (UTIL::file_exists(result_file) && !resume) {
+      SPDLOG_WARN("Overwrite result file {}", result_file);
+    }
+    std::string output_folder = UTIL::get_file_directory(result_file);
+    if (!UTIL::folder_exist(output_folder)) {
+      SPDLOG_CRITICAL("Output folder {} not exists", output_folder);
+      return false;
+    }
   }
   if (log_level < 0 || log_level > UTIL::LOG_LEVESLS.size()) {
     SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6", log_level);
     SPDLOG_INFO("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
     return false;
   }
+  if (symmetric && compact) {
+    SPDLOG_CRITICAL("Symmetric output keeps prev_n, which is not "
+                    "supported with compact");
+    return false;
+  }
+  if (symmetric && (is_update() || is_demand())) {
+    SPDLOG_CRITICAL("Symmetric output is not supported with update or "
+                    "demand");
+    return false;
+  }
+  if (compress_chains &&
+      (symmetric || is_update() || is_demand() || is_hierarchy_engine())) {
+    SPDLOG_CRITICAL("Compress chains is not supported with symmetric, "
+                    "update, demand or engine ch");
+    return false;
+  }
+  // The extra costs are summed along the trees of the network, which
+  // are only written as csv rows
+  if (!network_config.get_cost_names().empty() &&
+      (is_binary_output() || is_mmap_output() || is_compressed_output() ||
+       is_tiled_output() || is_update() || symmetric || compress_chains ||
+       is_hierarchy_engine())) {
+    SPDLOG_CRITICAL("Network costs are only supported for csv output, "
+                    "without symmetric, update, compress chains or "
+                    "engine ch");
+    return false;
+  }
+  if (compact && is_binary_output()) {
+    SPDLOG_CRITICAL(
+        "Compact output is only supported for csv, mmap, ubz and tiles");
+    return false;
+  }
+  if (memory_budget < 0) {
+    SPDLOG_CRITICAL("Memory budget {} should not be negative",
+                    memory_budget);
+    return false;
+  }
+  if (cost_precision < -1 || cost_precision > 17) {
+    SPDLOG_CRITICAL("Cost precision {} should be -1 to 17", cost_precision);
+    return false;
+  }
+  if (is_gzip_output() && is_shard()) {
+    SPDLOG_CRITICAL("Shard is not supported for gz output");
+    return false;
+  }
+  if (async_write && (is_mmap_output() || is_compressed_output() ||
+                      is_tiled_output() || is_update() || is_shard())) {
+    SPDLOG_CRITICAL("Asynchronous write is only supported for csv, txt "
+                    "and bin output without shard");
+    return false;
+  }
+  if (memory_budget > 0 && (!is_mmap_output() || is_update())) {
+    SPDLOG_CRITICAL("Memory budget is only supported for mmap output");
+    return false;
+  }
+  if (is_tiled_output() && tile_size <= 0) {
+    SPDLOG_CRITICAL("Tile size {} should be positive", tile_size);
+    return false;
+  }
+  if (is_update()) {
+    if (!UTIL::file_exists(update_file)) {
+      SPDLOG_CRITICAL("Update file {} not exists", update_file);
+      return false;
+    }
+    if (!UTIL::file_exists(update_network)) {
+      SPDLOG_CRITICAL("Update network {} not exists", update_network);
+      return false;
+    }
+    if (update_file == result_file) {
+      SPDLOG_CRITICAL("Update file should differ from the output file");
+      return false;
+    }
+    if (!is_mmap_output() && !is_compressed_output()) {
+      SPDLOG_CRITICAL("Update is only supported for mmap and ubz output");
+      return false;
+    }
+    if (changed_edges.empty()) {
+      SPDLOG_WARN("No changed edges, the rows are copied");
+    }
+  }
+  if (is_shard()) {
+    if (is_mmap_output() || is_compressed_output() || is_tiled_output() ||
+        is_update()) {
+      SPDLOG_CRITICAL("Shard is only supported for csv, txt and bin output");
+      return false;
+    }
+    if (num_partitions < 1 || partition < 0 || partition >= num_partitions) {
+      SPDLOG_CRITICAL("Invalid partition {} of {}", partition,
+                      num_partitions);
+      return false;
+    }
+    if (num_partitions > 1 && (first_source >= 0 || last_source >= 0)) {
+      SPDLOG_CRITICAL("Specify either a partition or a source range");
+      return false;
+    }
+    if (last_source >= 0 && last_source <= first_source) {
+      SPDLOG_CRITICAL("Last source {} should be larger than first source {}",
+                      last_source, first_source);
+      return false;
+    }
+  }
+  if (is_region()) {
+    if (!UTIL::file_exists(region_file)) {
+      SPDLOG_CRITICAL("Region file {} not exists", region_file);
+      return false;
+    }
+    if ((!is_mmap_output() && !is_compressed_output()) || is_update() ||
+        is_shard()) {
+      SPDLOG_CRITICAL("Region is only supported for mmap and ubz output");
+      return false;
+    }
+    if (region < 0) {
+      SPDLOG_CRITICAL("Region {} should not be negative", region);
+      return false;
+    }
+  }
+  if (is_demand()) {
+    if (gps_config.file.empty()) {
+      SPDLOG_CRITICAL("Demand radius requires a GPS file of the traffic");
+      return false;
+    }
+    if ((!is_mmap_output() && !is_compressed_output()) || is_update() ||
+        is_shard() || is_region()) {
+      SPDLOG_CRITICAL("Demand is only supported for mmap and ubz output");
+      return false;
+    }
+    if (memory_budget > 0) {
+      SPDLOG_CRITICAL("Memory budget is not supported with demand");
+      return false;
+    }
+  }
+  if (engine != "dijkstra" && engine != "ch") {
+    SPDLOG_CRITICAL("Invalid engine {}, which should be dijkstra or ch",
+                    engine);
+    return false;
+  }
   if (delta <= 0) {
     SPDLOG_CRITICAL("Delta {} should be positive");
     return false;
   }
+  if (!metrics_file.empty() && metrics_interval <= 0) {
+    SPDLOG_CRITICAL("Metrics interval {} should be positive",
+                    metrics_interval);
+    return false;
+  }
   SPDLOG_INFO("Validating done.");
   return true;
 }
@@ -132,3 +685,45 @@ bool UBODTGenAppConfig::is_binary_output() const {
   }
   return false;
 }
+
+bool UBODTGenAppConfig::is_gzip_output() const {
+  return UTIL::check_file_extension(result_file,"gz");
+}
+
+bool UBODTGenAppConfig::is_mmap_output() const {
+  return UTIL::check_file_extension(result_file,"mmap");
+}
+
+bool UBODTGenAppConfig::is_compressed_output() const {
+  return UTIL::check_file_extension(result_file,"ubz");
+}
+
+bool UBODTGenAppConfig::is_tiled_output() const {
+  return UTIL::check_file_extension(result_file,"tiles");
+}
+
+bool UBODTGenAppConfig::is_update() const {
+  return !update_file.empty();
+}
+
+bool UBODTGenAppConfig::is_shard() const {
+  return num_partitions > 1 || first_source >= 0 || last_source >= 0 ||
+      resume;
+}
+
+bool UBODTGenAppConfig::is_region() const {
+  return !region_file.empty();
+}
+
+bool UBODTGenAppConfig::is_hierarchy_engine() const {
+  return engine == "ch";
+}
+
+bool UBODTGenAppConfig::is_profile() const {
+  return !gps_config.file.empty() &&
+      (!is_demand() || hit_rate > 0 || !profile_file.empty());
+}
+
+bool UBODTGenAppConfig::is_demand() const {
+  return demand_radius >= 0;
+}
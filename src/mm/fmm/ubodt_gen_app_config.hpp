@@ -11,7 +11,12 @@
 #ifndef MM_FMM_UBODT_CONFIG
 #define MM_FMM_UBODT_CONFIG
 
+#include "config/gps_config.hpp"
 #include "config/network_config.hpp"
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "network/type.hpp"
+
+#include <vector>
 
 namespace FMM{
 namespace MM{
@@ -52,16 +57,126 @@ class UBODTGenAppConfig
    * @return true if binary and otherwise false
    */
   bool is_binary_output() const;
+  /**
+   * Check if the csv output is compressed with gzip
+   * @return true if the output file has gz extension
+   */
+  bool is_gzip_output() const;
+  /**
+   * Check if the output is a memory mapped flat table
+   * @return true if the output file has mmap extension
+   */
+  bool is_mmap_output() const;
+  /**
+   * Check if the output is in block compressed format
+   * @return true if the output file has ubz extension
+   */
+  bool is_compressed_output() const;
+  /**
+   * Check if the output is split into spatial tiles
+   * @return true if the output file has tiles extension
+   */
+  bool is_tiled_output() const;
+  /**
+   * Check if an existing UBODT is updated instead of generated
+   * @return true if the UBODT file to update is specified
+   */
+  bool is_update() const;
+  /**
+   * Check if only a range of sources is generated into a shard
+   * @return true if a partition, a source range or resume is specified
+   */
+  bool is_shard() const;
+  /**
+   * Check if only the sources of a region are generated
+   * @return true if the region file is specified
+   */
+  bool is_region() const;
+  /**
+   * Check if the distances requested by map matching are profiled
+   * @return true if the GPS file is specified, unless it is only the
+   * sample of a demand driven generation
+   */
+  bool is_profile() const;
+  /**
+   * Check if only the sources near the traffic of the GPS file are
+   * generated
+   * @return true if the demand radius is specified
+   */
+  bool is_demand() const;
+  /**
+   * Check if the rows are generated with the contraction hierarchy
+   * @return true if the engine is ch
+   */
+  bool is_hierarchy_engine() const;
   /**
    * Print help information
    */
   static void print_help();
   CONFIG::NetworkConfig network_config; /**< Network configuration */
   double delta; /**< Upper-bound of the routing result */
+  std::string engine = "dijkstra"; /**< Routing engine, dijkstra or ch */
   std::string result_file; /**< Result file */
   int log_level = 2; /**< Level level. 0-trace,1-debug,2-info,3-warn,4-err,
                          5-critical,6-off */
   bool use_omp = false; /**< If true, parallel computing performed */
+  std::string metrics_file; /**< Prometheus text file of the metrics of
+                                the generation, empty for none */
+  int metrics_interval = 15; /**< Time between two writes of the metrics
+                                 file, in seconds */
+  bool compact = false; /**< If true, rows are written without prev_n */
+  bool symmetric = false; /**< If true, rows are written only from the
+                              smaller node of each od pair, for a
+                              network symmetric in both directions */
+  bool compress_chains = false; /**< If true, rows are generated only
+                                    between the junctions of the chains
+                                    of degree two nodes, whose edges
+                                    are chains */
+  bool network_ids = false; /**< If true, the ids of the nodes and edges
+                                of the network are written next to the
+                                output, for fmm with ubodt_clip */
+  double tile_size = 10000; /**< Side length of the spatial tiles */
+  int memory_budget = 0; /**< If positive, the rows of the mmap output
+                             are spilled and written in the order of
+                             their slots within this memory in MB */
+  int cost_precision = -1; /**< Number of decimals of the costs of csv
+                               output, -1 for 6 significant digits */
+  bool async_write = false; /**< If true, the csv or binary output is
+                                written by a thread of its own */
+  std::string update_file; /**< UBODT file to update, generated from
+                               update_network */
+  std::string update_network; /**< Network file where update_file was
+                                  generated, read with the same fields
+                                  as network_config */
+  std::vector<NETWORK::EdgeID> changed_edges; /**< Edges added, removed
+                                                  or modified since
+                                                  update_network */
+  int partition = 0; /**< Index of the partition generated */
+  int num_partitions = 1; /**< Number of partitions of the sources */
+  int first_source = -1; /**< First source generated, -1 for the first
+                             source of the partition */
+  int last_source = -1; /**< Source after the last one generated, -1 for
+                            the end of the partition */
+  bool resume = false; /**< If true, a shard is resumed from its manifest */
+  std::string region_file; /**< Region file written by region_gen, empty
+                               to generate all the sources */
+  int region = 0; /**< Index of the region generated */
+  CONFIG::GPSConfig gps_config; /**< GPS data profiled */
+  FastMapMatchConfig fmm_config; /**< Map matching configuration of the
+                                     profile */
+  int profile_trajectories = 1000; /**< Maximum number of trajectories
+                                       profiled */
+  int profile_sources = 1000; /**< Number of sources routed to estimate
+                                  the rows */
+  double profile_delta = -1; /**< Upper bound of the distances profiled,
+                                 -1 for 4 times delta */
+  double hit_rate = 0; /**< If positive, delta is set to the smallest
+                           one covering this fraction of transitions */
+  std::string profile_file; /**< Output file of the profile */
+  double demand_radius = -1; /**< If not negative, only the nodes of the
+                                 candidates of the GPS points and the
+                                 nodes within this radius of the points
+                                 are generated as sources */
   bool help_specified = false; /**< Help is specified or not */
 }; // UBODT_Config
 }
@@ -0,0 +1,84 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/ubodt_lookup_cache.hpp"
+#include "util/debug.hpp"
+
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+using namespace FMM;
+using namespace FMM::MM;
+
+namespace {
+
+// Caches of all the threads, which are kept after the threads exit
+std::mutex caches_mutex;
+std::vector<std::shared_ptr<UBODTLookupCache>> caches;
+
+std::shared_ptr<UBODTLookupCache> register_cache() {
+  std::shared_ptr<UBODTLookupCache> cache =
+      std::make_shared<UBODTLookupCache>();
+  std::lock_guard<std::mutex> lock(caches_mutex);
+  caches.push_back(cache);
+  return cache;
+}
+
+std::atomic<long> next_owner{0};
+
+} // namespace
+
+void UBODTLookupCache::FreeDeleter::operator()(Entry *p) const {
+  free(p);
+}
+
+UBODTLookupCache &UBODTLookupCache::local(long owner, int entries) {
+  static thread_local std::shared_ptr<UBODTLookupCache> cache =
+      register_cache();
+  int num_sets = 2;
+  while (num_sets * 2 * WAYS <= entries) num_sets <<= 1;
+  if (cache->owner_.load(std::memory_order_relaxed) != owner ||
+      cache->num_sets_ != num_sets) {
+    cache->reset(owner, num_sets);
+  }
+  return *cache;
+}
+
+long UBODTLookupCache::new_owner() {
+  return next_owner.fetch_add(1);
+}
+
+LookupCacheStatistics UBODTLookupCache::collect(long owner) {
+  LookupCacheStatistics statistics;
+  std::lock_guard<std::mutex> lock(caches_mutex);
+  for (const auto &cache : caches) {
+    if (cache->owner_.load(std::memory_order_relaxed) != owner) continue;
+    statistics.hits += cache->hits_.load(std::memory_order_relaxed);
+    statistics.misses += cache->misses_.load(std::memory_order_relaxed);
+  }
+  return statistics;
+}
+
+void UBODTLookupCache::reset(long owner, int num_sets) {
+  if (num_sets != num_sets_) {
+    // The sets of a cache line are allocated together
+    void *addr = nullptr;
+    if (posix_memalign(&addr, 64, sizeof(Entry) * WAYS * num_sets) != 0) {
+      SPDLOG_CRITICAL("Failed to allocate {} sets of lookup cache",
+                      num_sets);
+      std::exit(EXIT_FAILURE);
+    }
+    sets_.reset((Entry *) addr);
+    num_sets_ = num_sets;
+    set_shift_ = 64;
+    for (int n = num_sets; n > 1; n >>= 1) --set_shift_;
+  }
+  for (long i = 0; i < (long) num_sets * WAYS; ++i) {
+    sets_[i] = Entry{EMPTY_KEY, 0};
+  }
+  owner_.store(owner, std::memory_order_relaxed);
+  hits_.store(0, std::memory_order_relaxed);
+  misses_.store(0, std::memory_order_relaxed);
+}
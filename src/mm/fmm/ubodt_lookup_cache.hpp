@@ -0,0 +1,141 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the UBODT look ups kept by each thread of map matching
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_UBODT_LOOKUP_CACHE_HPP_
+#define FMM_SRC_MM_FMM_UBODT_LOOKUP_CACHE_HPP_
+
+#include "network/type.hpp"
+
+#include <atomic>
+#include <memory>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Counters of the look up caches of a model
+ */
+struct LookupCacheStatistics {
+  long long hits = 0; /**< Look ups answered by the caches */
+  long long misses = 0; /**< Look ups forwarded to UBODT */
+};
+
+/**
+ * Two way set associative cache of the distances of od pairs looked up
+ * in UBODT, missing pairs included. The trajectories matched by a
+ * thread, such as the ones of a fleet, probe the same pairs over and
+ * over, which are then answered from a table small enough to stay in
+ * the L2 cache instead of the slots of UBODT spread over memory.
+ *
+ * Each thread has its own cache, which belongs to one model at a time
+ * and is cleared when the thread looks up the pairs of another model.
+ */
+class UBODTLookupCache {
+ public:
+  static const int DEFAULT_ENTRIES = 1 << 15; /**< Entries of a cache by
+                                                   default, 512 KB */
+  /**
+   * Get the cache of the calling thread for a model
+   * @param owner   id of the model, from new_owner
+   * @param entries number of entries, rounded down to a power of two of
+   * at least 4
+   * @return the cache, cleared if it belonged to another model or had
+   * another size
+   */
+  static UBODTLookupCache &local(long owner, int entries);
+  /**
+   * Get a new id of a model whose look ups are cached
+   */
+  static long new_owner();
+  /**
+   * Sum up the counters of the caches of all the threads for a model
+   * @param owner id of the model
+   */
+  static LookupCacheStatistics collect(long owner);
+  /**
+   * Find the distance of an od pair
+   * @param  source source node
+   * @param  target target node
+   * @param  cost   updated with the distance cached, negative if the
+   * pair is missing in UBODT
+   * @return true if the pair is cached
+   */
+  inline bool find(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                   double *cost) {
+    unsigned long long key = make_key(source, target);
+    Entry *set = sets_.get() + set_index(key) * WAYS;
+    if (set[0].key == key) {
+      *cost = set[0].cost;
+      add(&hits_);
+      return true;
+    }
+    if (set[1].key == key) {
+      // The entry used last is kept in the first way
+      Entry entry = set[1];
+      set[1] = set[0];
+      set[0] = entry;
+      *cost = entry.cost;
+      add(&hits_);
+      return true;
+    }
+    add(&misses_);
+    return false;
+  };
+  /**
+   * Store the distance of an od pair, evicting the entry of its set
+   * used least recently
+   * @param source source node
+   * @param target target node
+   * @param cost   distance looked up, negative if the pair is missing
+   */
+  inline void insert(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                     double cost) {
+    unsigned long long key = make_key(source, target);
+    Entry *set = sets_.get() + set_index(key) * WAYS;
+    set[1] = set[0];
+    set[0] = Entry{key, cost};
+  };
+ private:
+  struct Entry {
+    unsigned long long key;
+    double cost;
+  };
+  struct FreeDeleter {
+    void operator()(Entry *p) const;
+  };
+  static const int WAYS = 2;
+  static const unsigned long long EMPTY_KEY = ~0ULL;
+  /**
+   * Clear the cache and assign it to a model
+   */
+  void reset(long owner, int num_sets);
+  static inline unsigned long long make_key(NETWORK::NodeIndex source,
+                                            NETWORK::NodeIndex target) {
+    return ((unsigned long long) source << 32) | target;
+  };
+  inline unsigned long long set_index(unsigned long long key) const {
+    return (key * 0x9E3779B97F4A7C15ULL) >> set_shift_;
+  };
+  // Counters are only written by the thread of the cache
+  static inline void add(std::atomic<long long> *counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  };
+  std::unique_ptr<Entry[], FreeDeleter> sets_;
+  int num_sets_ = 0;
+  int set_shift_ = 64;
+  std::atomic<long> owner_{-1};
+  std::atomic<long long> hits_{0};
+  std::atomic<long long> misses_{0};
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_SRC_MM_FMM_UBODT_LOOKUP_CACHE_HPP_
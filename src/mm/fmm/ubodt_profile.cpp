@@ -0,0 +1,215 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/ubodt_profile.hpp"
+#include "mm/transition_graph.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+namespace {
+// Fraction of the values not larger than delta
+double fraction_within(const std::vector<double> &values, double delta) {
+  if (values.empty()) return 0;
+  long long count = std::count_if(values.begin(), values.end(),
+                                  [delta](double v) { return v <= delta; });
+  return (double) count / values.size();
+}
+}
+
+UBODTProfile::UBODTProfile(const Network &network,
+                           const NetworkGraph &graph, double max_delta) :
+    network_(network), graph_(graph), max_delta_(max_delta) {
+}
+
+double UBODTProfile::request_distance(
+    const Candidate *ca, const Candidate *cb,
+    std::unordered_map<NodeIndex, DistanceMap> *cache) const {
+  // Same conditions as FastMapMatch::get_sp_dist
+  if ((ca->edge->id == cb->edge->id && ca->offset <= cb->offset) ||
+      ca->edge->target == cb->edge->source) {
+    return -1;
+  }
+  NodeIndex source = ca->edge->target;
+  auto iter = cache->find(source);
+  if (iter == cache->end()) {
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    graph_.single_source_upperbound_dijkstra(source, max_delta_, &pmap,
+                                             &dmap);
+    iter = cache->insert({source, std::move(dmap)}).first;
+  }
+  auto dist = iter->second.find(cb->edge->source);
+  if (dist == iter->second.end()) {
+    return std::numeric_limits<double>::infinity();
+  }
+  return dist->second;
+}
+
+void UBODTProfile::add_trajectory(const Trajectory &input,
+                                  const FastMapMatchConfig &config) {
+  Trajectory projected;
+  const Trajectory &traj =
+      network_.get_projection().forward(input, &projected);
+  CandidateSearchContext &context = CandidateSearchContext::local();
+  if (!network_.search_tr_cs_knn(traj.geom, config.k, config.radius,
+                                 &context, nullptr,
+                                 graph_.get_edge_mask())) return;
+  context.prune(traj.geom, config.k, config.get_candidate_pruning());
+  TransitionGraph &tg = TransitionGraph::local();
+  tg.reset(context, config.gps_error, config.approximate_ep);
+  std::vector<TGLayer> &layers = tg.get_layers();
+  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
+  std::unordered_map<NodeIndex, DistanceMap> cache;
+  // The states pruned by the beam request no distances
+  ViterbiBeam beam = config.get_viterbi_beam();
+  if (beam.is_enabled()) tg.reset_log_space();
+  for (size_t i = 0; i + 1 < layers.size(); ++i) {
+    if (beam.is_enabled()) tg.prune_layer(&(layers[i]), beam);
+    for (TGNode &a : layers[i]) {
+      if (tg.is_log_space() && TransitionGraph::is_pruned(a)) continue;
+      for (TGNode &b : layers[i + 1]) {
+        double dist = request_distance(a.c, b.c, &cache);
+        double sp_dist;
+        if (dist < 0) {
+          sp_dist = (a.c->edge->id == b.c->edge->id &&
+              a.c->offset <= b.c->offset) ?
+                    b.c->offset - a.c->offset :
+                    a.c->edge->length - a.c->offset + b.c->offset;
+        } else {
+          requests.push_back(dist);
+          // A request beyond delta gets the penalty of get_delta
+          sp_dist = (dist > max_delta_) ? max_delta_ :
+                    dist + a.c->edge->length - a.c->offset + b.c->offset;
+        }
+        double tp = TransitionGraph::calc_tp(sp_dist, eu_dists[i]);
+        if (tg.is_log_space()) {
+          TransitionGraph::update_log(&a, &b, tp, sp_dist);
+        } else if (a.cumu_prob + tp * b.ep >= b.cumu_prob) {
+          b.cumu_prob = a.cumu_prob + tp * b.ep;
+          b.prev = &a;
+          b.tp = tp;
+          b.sp_dist = sp_dist;
+        }
+      }
+    }
+  }
+  TGOpath opath = tg.backtrack();
+  for (size_t i = 0; i + 1 < opath.size(); ++i) {
+    double dist = request_distance(opath[i]->c, opath[i + 1]->c, &cache);
+    if (dist >= 0) transitions.push_back(dist);
+  }
+}
+
+void UBODTProfile::sample_sources(int num_sources) {
+  int num_vertices = graph_.get_num_vertices();
+  if (num_vertices == 0 || num_sources <= 0) return;
+  num_sources = std::min(num_sources, num_vertices);
+  SearchWorkspace &ws = SearchWorkspace::local();
+  for (int i = 0; i < num_sources; ++i) {
+    NodeIndex source = (long long) i * num_vertices / num_sources;
+    graph_.single_source_upperbound_dijkstra(source, max_delta_, &ws);
+    for (NodeIndex v : ws.get_visited()) {
+      if (v != source) source_dists.push_back(ws.get_distance(v));
+    }
+  }
+  num_sampled_sources += num_sources;
+}
+
+double UBODTProfile::get_request_coverage(double delta) const {
+  return fraction_within(requests, delta);
+}
+
+double UBODTProfile::get_transition_coverage(double delta) const {
+  return fraction_within(transitions, delta);
+}
+
+long long UBODTProfile::estimate_rows(double delta) const {
+  if (num_sampled_sources == 0) return 0;
+  long long count = std::count_if(
+      source_dists.begin(), source_dists.end(),
+      [delta](double v) { return v <= delta; });
+  return std::llround((double) count * graph_.get_num_vertices() /
+      num_sampled_sources);
+}
+
+double UBODTProfile::find_delta(double hit_rate) const {
+  if (transitions.empty()) return -1;
+  std::vector<double> sorted(transitions);
+  std::sort(sorted.begin(), sorted.end());
+  size_t index = (size_t) std::ceil(hit_rate * sorted.size());
+  if (index > 0) --index;
+  index = std::min(index, sorted.size() - 1);
+  if (sorted[index] > max_delta_) return -1;
+  return std::max(sorted[index], std::numeric_limits<double>::epsilon());
+}
+
+std::vector<double> UBODTProfile::get_profile_deltas(int steps) const {
+  std::vector<double> deltas;
+  for (int i = 1; i <= steps; ++i) {
+    deltas.push_back(max_delta_ * i / steps);
+  }
+  for (double q : {0.5, 0.9, 0.95, 0.99, 0.999}) {
+    double delta = find_delta(q);
+    if (delta > 0) deltas.push_back(delta);
+  }
+  std::sort(deltas.begin(), deltas.end());
+  deltas.erase(std::unique(deltas.begin(), deltas.end()), deltas.end());
+  return deltas;
+}
+
+double UBODTProfile::estimate_memory(long long rows, UBODTLayout layout) {
+  // Slots of an open addressing table, as allocated by UBODT
+  long long capacity = 1024;
+  while (capacity * UBODT::FLAT_LOAD_FACTOR < rows) capacity <<= 1;
+  double slot_size = sizeof(Record);
+  if (layout == COMPACT) {
+    slot_size = sizeof(CompactRecord);
+  } else if (layout == SPLIT) {
+    slot_size = sizeof(HotRecord) + sizeof(ColdRecord);
+  }
+  return capacity * slot_size;
+}
+
+void UBODTProfile::print() const {
+  SPDLOG_INFO("Requests {} transitions {} sampled sources {}",
+              requests.size(), transitions.size(), num_sampled_sources);
+  SPDLOG_INFO("delta;request_coverage;transition_coverage;rows;"
+              "flat_mb;compact_mb");
+  for (double delta : get_profile_deltas()) {
+    long long rows = estimate_rows(delta);
+    SPDLOG_INFO("{};{:.4f};{:.4f};{};{:.1f};{:.1f}", delta,
+                get_request_coverage(delta),
+                get_transition_coverage(delta), rows,
+                estimate_memory(rows, FLAT) / 1048576,
+                estimate_memory(rows, COMPACT) / 1048576);
+  }
+}
+
+bool UBODTProfile::write_profile(const std::string &filename) const {
+  std::ofstream ofs(filename);
+  if (!ofs) {
+    SPDLOG_CRITICAL("Cannot write profile {}", filename);
+    return false;
+  }
+  ofs << "delta;request_coverage;transition_coverage;rows;"
+         "flat_bytes;compact_bytes\n";
+  for (double delta : get_profile_deltas()) {
+    long long rows = estimate_rows(delta);
+    ofs << delta << ";" << get_request_coverage(delta) << ";"
+        << get_transition_coverage(delta) << ";" << rows << ";"
+        << (long long) estimate_memory(rows, FLAT) << ";"
+        << (long long) estimate_memory(rows, COMPACT) << "\n";
+  }
+  return true;
+}
@@ -0,0 +1,129 @@
+/**
+ * Fast map matching.
+ *
+ * Profile of the shortest path distances requested by map matching,
+ * which is used to select delta of UBODT
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_UBODT_PROFILE_HPP_
+#define FMM_SRC_MM_FMM_UBODT_PROFILE_HPP_
+
+#include "mm/fmm/fmm_algorithm.hpp"
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+/**
+ * Profile of UBODT coverage and size against delta.
+ *
+ * The trajectories added are matched as in FMM, except that the node to
+ * node distances are routed up to max_delta instead of being looked up
+ * in UBODT. Every distance looked up is a request, and the requests on
+ * the optimal path are transitions, which are lost as get_delta
+ * penalties and broken complete paths when beyond delta. The rows of
+ * UBODT are estimated from the routing of sample sources.
+ */
+class UBODTProfile {
+ public:
+  /**
+   * Constructor
+   * @param network   network data
+   * @param graph     graph of the network
+   * @param max_delta upper bound of the distances routed, beyond which
+   * a request is not covered by any delta profiled
+   */
+  UBODTProfile(const NETWORK::Network &network,
+               const NETWORK::NetworkGraph &graph, double max_delta);
+  /**
+   * Match a trajectory and record the distances requested
+   * @param traj   trajectory
+   * @param config map matching configuration
+   */
+  void add_trajectory(const CORE::Trajectory &traj,
+                      const FastMapMatchConfig &config);
+  /**
+   * Route from sources evenly spaced in the node index to estimate
+   * the number of rows of UBODT
+   * @param num_sources number of sources routed
+   */
+  void sample_sources(int num_sources);
+  /**
+   * Get the fraction of requests within delta
+   */
+  double get_request_coverage(double delta) const;
+  /**
+   * Get the fraction of transitions within delta
+   */
+  double get_transition_coverage(double delta) const;
+  /**
+   * Estimate the number of rows of UBODT generated with delta
+   */
+  long long estimate_rows(double delta) const;
+  /**
+   * Find the smallest delta whose transition coverage reaches a hit rate
+   * @param hit_rate fraction of transitions to cover, in (0, 1]
+   * @return delta, or a negative value if the hit rate is not reached
+   * within max_delta
+   */
+  double find_delta(double hit_rate) const;
+  /**
+   * Get the deltas reported, which are evenly spaced up to max_delta
+   * together with quantiles of the transitions
+   * @param steps number of evenly spaced deltas
+   */
+  std::vector<double> get_profile_deltas(int steps = 20) const;
+  /**
+   * Print the coverage and memory curve against delta
+   */
+  void print() const;
+  /**
+   * Write the coverage and memory curve against delta to a csv file
+   * @param filename output file name
+   * @return true if success
+   */
+  bool write_profile(const std::string &filename) const;
+  /**
+   * Get the number of requests recorded
+   */
+  inline long long get_num_requests() const {
+    return requests.size();
+  };
+  /**
+   * Get the number of transitions recorded
+   */
+  inline long long get_num_transitions() const {
+    return transitions.size();
+  };
+  /**
+   * Estimate the memory in bytes of a UBODT with a number of rows
+   * stored in the flat, compact or split layout
+   */
+  static double estimate_memory(long long rows, UBODTLayout layout);
+ private:
+  // Node distance requested from candidate a to b, or a negative value
+  // if no lookup is made for the pair. The routing result of each
+  // source node is kept in the cache.
+  double request_distance(
+      const Candidate *ca, const Candidate *cb,
+      std::unordered_map<NETWORK::NodeIndex, NETWORK::DistanceMap> *cache)
+      const;
+  const NETWORK::Network &network_;
+  const NETWORK::NetworkGraph &graph_;
+  double max_delta_;
+  std::vector<double> requests; // beyond max_delta stored as infinity
+  std::vector<double> transitions;
+  std::vector<double> source_dists; // distances reached from samples
+  int num_sampled_sources = 0;
+}; // UBODTProfile
+}
+}
+
+#endif //FMM_SRC_MM_FMM_UBODT_PROFILE_HPP_
@@ -0,0 +1,224 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/fmm/ubodt_shard.hpp"
+#include "mm/fmm/ubodt.hpp"
+#include "util/util.hpp"
+#include "util/debug.hpp"
+
+#include <boost/archive/binary_oarchive.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+bool UBODTShard::is_compatible(const UBODTShard &other) const {
+  return network_file == other.network_file && delta == other.delta &&
+      num_vertices == other.num_vertices && partition == other.partition &&
+      num_partitions == other.num_partitions &&
+      first_source == other.first_source &&
+      last_source == other.last_source && binary == other.binary &&
+      compact == other.compact;
+}
+
+std::string UBODTShard::get_manifest_file(const std::string &filename) {
+  return filename + ".manifest";
+}
+
+bool UBODTShard::write_manifest(const std::string &filename) const {
+  std::string manifest = get_manifest_file(filename);
+  std::string temp_file = manifest + ".tmp";
+  std::ofstream ofs(temp_file);
+  if (!ofs) {
+    SPDLOG_CRITICAL("Cannot write shard manifest {}", temp_file);
+    return false;
+  }
+  ofs << std::setprecision(17);
+  ofs << "version " << MANIFEST_VERSION << "\n"
+      << "network " << network_file << "\n"
+      << "delta " << delta << "\n"
+      << "num_vertices " << num_vertices << "\n"
+      << "partition " << partition << "\n"
+      << "num_partitions " << num_partitions << "\n"
+      << "first_source " << first_source << "\n"
+      << "last_source " << last_source << "\n"
+      << "next_source " << next_source << "\n"
+      << "bytes " << bytes << "\n"
+      << "rows " << rows << "\n"
+      << "binary " << binary << "\n"
+      << "compact " << compact << "\n";
+  ofs.close();
+  if (!ofs || std::rename(temp_file.c_str(), manifest.c_str()) != 0) {
+    SPDLOG_CRITICAL("Cannot write shard manifest {}", manifest);
+    return false;
+  }
+  return true;
+}
+
+bool UBODTShard::read_manifest(const std::string &filename,
+                               UBODTShard *shard) {
+  std::string manifest = get_manifest_file(filename);
+  std::ifstream ifs(manifest);
+  if (!ifs) {
+    SPDLOG_CRITICAL("Cannot read shard manifest {}", manifest);
+    return false;
+  }
+  unsigned int version = 0;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    size_t split = line.find(' ');
+    if (split == std::string::npos) continue;
+    std::string key = line.substr(0, split);
+    std::istringstream value(line.substr(split + 1));
+    if (key == "version") {
+      value >> version;
+    } else if (key == "network") {
+      shard->network_file = line.substr(split + 1);
+    } else if (key == "delta") {
+      value >> shard->delta;
+    } else if (key == "num_vertices") {
+      value >> shard->num_vertices;
+    } else if (key == "partition") {
+      value >> shard->partition;
+    } else if (key == "num_partitions") {
+      value >> shard->num_partitions;
+    } else if (key == "first_source") {
+      value >> shard->first_source;
+    } else if (key == "last_source") {
+      value >> shard->last_source;
+    } else if (key == "next_source") {
+      value >> shard->next_source;
+    } else if (key == "bytes") {
+      value >> shard->bytes;
+    } else if (key == "rows") {
+      value >> shard->rows;
+    } else if (key == "binary") {
+      value >> shard->binary;
+    } else if (key == "compact") {
+      value >> shard->compact;
+    }
+  }
+  if (version != MANIFEST_VERSION) {
+    SPDLOG_CRITICAL("Shard manifest {} version {} not supported",
+                    manifest, version);
+    return false;
+  }
+  return true;
+}
+
+bool UBODTShard::merge_shards(const std::vector<std::string> &filenames,
+                              const std::string &output) {
+  if (filenames.empty()) {
+    SPDLOG_CRITICAL("No shard to merge");
+    return false;
+  }
+  std::vector<std::pair<UBODTShard, std::string>> shards;
+  long long rows = 0;
+  for (const std::string &filename : filenames) {
+    UBODTShard shard;
+    if (!read_manifest(filename, &shard)) return false;
+    if (!shard.is_complete()) {
+      SPDLOG_CRITICAL("Shard {} is not complete, next source {} / {}",
+                      filename, shard.next_source, shard.last_source);
+      return false;
+    }
+    if (UTIL::get_file_size(filename) != shard.bytes) {
+      SPDLOG_CRITICAL("Shard {} size differs from its manifest", filename);
+      return false;
+    }
+    rows += shard.rows;
+    shards.push_back({shard, filename});
+  }
+  std::sort(shards.begin(), shards.end(),
+            [](const std::pair<UBODTShard, std::string> &a,
+               const std::pair<UBODTShard, std::string> &b) {
+              return a.first.first_source < b.first.first_source;
+            });
+  // The shards should come from the same generation and cover each
+  // source exactly once.
+  const UBODTShard &head = shards.front().first;
+  NodeIndex next_source = 0;
+  for (auto &item : shards) {
+    const UBODTShard &shard = item.first;
+    if (shard.network_file != head.network_file ||
+        shard.delta != head.delta ||
+        shard.num_vertices != head.num_vertices ||
+        shard.binary != head.binary || shard.compact != head.compact) {
+      SPDLOG_CRITICAL("Shard {} is generated with different parameters",
+                      item.second);
+      return false;
+    }
+    if (shard.first_source != next_source) {
+      SPDLOG_CRITICAL("Sources from {} to {} are not covered by one shard",
+                      next_source, shard.first_source);
+      return false;
+    }
+    next_source = shard.last_source;
+  }
+  if (next_source != (NodeIndex) head.num_vertices) {
+    SPDLOG_CRITICAL("Sources from {} to {} are not covered by one shard",
+                    next_source, head.num_vertices);
+    return false;
+  }
+  SPDLOG_INFO("Merge {} shards with rows {} into {}",
+              shards.size(), rows, output);
+  bool binary_output = UTIL::check_file_extension(output, "bin");
+  if (binary_output || UTIL::check_file_extension(output, "csv,txt")) {
+    if (binary_output != head.binary) {
+      SPDLOG_CRITICAL("Shards should be {} to merge into {}",
+                      (binary_output ? "binary" : "csv"), output);
+      return false;
+    }
+    // The header of the shards after the first one is skipped, which
+    // is the csv column names or the header of the binary archive.
+    std::stringstream empty_archive;
+    {
+      boost::archive::binary_oarchive oa(empty_archive);
+    }
+    long long archive_header = empty_archive.str().size();
+    std::ofstream ofs(output);
+    for (size_t i = 0; i < shards.size(); ++i) {
+      std::ifstream ifs(shards[i].second);
+      if (i > 0) {
+        if (binary_output) {
+          ifs.seekg(archive_header);
+        } else {
+          std::string line;
+          std::getline(ifs, line);
+        }
+      }
+      if (ifs.peek() != EOF) ofs << ifs.rdbuf();
+    }
+    ofs.close();
+    if (!ofs) {
+      SPDLOG_CRITICAL("Cannot write merged UBODT {}", output);
+      return false;
+    }
+    return true;
+  }
+  bool compressed = UTIL::check_file_extension(output, "ubz");
+  if (!compressed && !UTIL::check_file_extension(output, "mmap")) {
+    SPDLOG_CRITICAL("Merged UBODT should be csv, txt, bin, mmap or ubz");
+    return false;
+  }
+  UBODT table(UBODT::find_bucket_number(head.num_vertices), head.num_vertices,
+              rows, (head.compact && !compressed) ? COMPACT : FLAT);
+  for (auto &item : shards) {
+    std::shared_ptr<UBODT> shard_table =
+        UBODT::read_ubodt_file(item.second, head.num_vertices, FLAT);
+    shard_table->for_each_record([&](const Record &r) {
+      table.insert(r);
+    });
+  }
+  SPDLOG_INFO("Rows merged {}", table.get_num_rows());
+  if (compressed) {
+    return table.write_ubodt_compressed(output);
+  }
+  return table.write_ubodt_mmap(output);
+}
@@ -0,0 +1,87 @@
+/**
+ * Fast map matching.
+ *
+ * Shard of UBODT generated from a range of source nodes
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SRC_MM_FMM_UBODT_SHARD_HPP_
+#define FMM_SRC_MM_FMM_UBODT_SHARD_HPP_
+
+#include "network/type.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+/**
+ * Manifest of a UBODT shard, which stores the rows of the sources in
+ * [first_source, last_source) in a csv or binary file. The manifest is
+ * saved next to the shard file and updated after each chunk of sources
+ * is written, so that a killed generation resumes from next_source.
+ */
+struct UBODTShard {
+  std::string network_file; /**< Network file of the routing */
+  double delta = 0; /**< Upper bound of the routing */
+  int num_vertices = 0; /**< Number of nodes in the network */
+  int partition = 0; /**< Index of the partition */
+  int num_partitions = 1; /**< Number of partitions */
+  NETWORK::NodeIndex first_source = 0; /**< First source of the shard */
+  NETWORK::NodeIndex last_source = 0; /**< Source after the last one */
+  NETWORK::NodeIndex next_source = 0; /**< First source not written */
+  long long bytes = 0; /**< Size of the shard file written */
+  long long rows = 0; /**< Number of rows written */
+  bool binary = false; /**< Whether the shard file is binary */
+  bool compact = false; /**< Whether the rows are written without prev_n */
+  /**
+   * Check if all the sources of the shard are written
+   */
+  inline bool is_complete() const {
+    return next_source >= last_source;
+  };
+  /**
+   * Check if the shard is written with the same parameters, which is
+   * required to resume it
+   */
+  bool is_compatible(const UBODTShard &other) const;
+  /**
+   * Get the manifest file of a shard file
+   * @param filename shard file name
+   * @return manifest file name
+   */
+  static std::string get_manifest_file(const std::string &filename);
+  /**
+   * Save the manifest of a shard file, which replaces the previous
+   * manifest only after it is completely written
+   * @param filename shard file name
+   * @return true if success
+   */
+  bool write_manifest(const std::string &filename) const;
+  /**
+   * Read the manifest of a shard file
+   * @param filename shard file name
+   * @param shard    manifest read
+   * @return true if success
+   */
+  static bool read_manifest(const std::string &filename, UBODTShard *shard);
+  /**
+   * Merge the shards covering all the sources of a network into a UBODT
+   * file. The csv and binary shards are concatenated into an output of
+   * the same format, and are loaded into a table to write a memory
+   * mapped (mmap extension) or block compressed (ubz extension) file.
+   * @param filenames shard file names, in any order
+   * @param output    output file name
+   * @return true if success
+   */
+  static bool merge_shards(const std::vector<std::string> &filenames,
+                           const std::string &output);
+  static const unsigned int MANIFEST_VERSION = 1; /**< Version of the
+                                                       manifest */
+}; // UBODTShard
+}
+}
+
+#endif //FMM_SRC_MM_FMM_UBODT_SHARD_HPP_
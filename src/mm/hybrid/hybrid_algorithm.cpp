@@ -0,0 +1,334 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/hybrid/hybrid_algorithm.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "util/util.hpp"
+#include "util/stage_profile.hpp"
+#include "util/debug.hpp"
+
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::PYTHON;
+using namespace FMM::MM;
+
+HybridMatchConfig::HybridMatchConfig(int k_arg, double r_arg,
+                                     double gps_error_arg, double vmax_arg,
+                                     double factor_arg) :
+    k(k_arg), radius(r_arg), gps_error(gps_error_arg),
+    vmax(vmax_arg), factor(factor_arg) {
+};
+
+void HybridMatchConfig::print() const {
+  SPDLOG_INFO("HybridMatchAlgorithmConfig");
+  SPDLOG_INFO("k {} radius {} gps_error {} vmax {} factor {}",
+              k, radius, gps_error, vmax, factor);
+};
+
+HybridMatchConfig HybridMatchConfig::load_from_xml(
+    const boost::property_tree::ptree &xml_data) {
+  int k = xml_data.get("config.parameters.k", 8);
+  double radius = xml_data.get("config.parameters.r", 300.0);
+  double gps_error = xml_data.get("config.parameters.gps_error", 50.0);
+  double vmax = xml_data.get("config.parameters.vmax", 80.0);
+  double factor = xml_data.get("config.parameters.factor", 1.5);
+  return HybridMatchConfig{k, radius, gps_error, vmax, factor};
+};
+
+HybridMatchConfig HybridMatchConfig::load_from_arg(
+    const cxxopts::ParseResult &arg_data) {
+  int k = arg_data["candidates"].as<int>();
+  double radius = arg_data["radius"].as<double>();
+  double gps_error = arg_data["error"].as<double>();
+  double vmax = arg_data["vmax"].as<double>();
+  double factor = arg_data["factor"].as<double>();
+  return HybridMatchConfig{k, radius, gps_error, vmax, factor};
+};
+
+bool HybridMatchConfig::validate() const {
+  if (gps_error <= 0 || radius <= 0 || k <= 0 || vmax <= 0 || factor <= 0) {
+    SPDLOG_CRITICAL("Invalid mm parameter k {} r {} gps error {} vmax {} f {}",
+                    k, radius, gps_error, vmax, factor);
+    return false;
+  }
+  return true;
+};
+
+HybridMatch::HybridMatch(const Network &network, const NetworkGraph &graph,
+                         std::shared_ptr<UBODT> ubodt, long cache_rows) :
+    network_(network), graph_(graph), ubodt_(ubodt),
+    cache_(graph, cache_rows) {
+};
+
+MatchResult HybridMatch::match_traj(const Trajectory &traj,
+                                    const HybridMatchConfig &config) {
+  // Matched in the local projection of the network, if any
+  const LocalProjection &projection = network_.get_projection();
+  Trajectory projected;
+  MatchResult result =
+      match_projected(projection.forward(traj, &projected), config);
+  projection.inverse(&result);
+  return result;
+}
+
+MatchResult HybridMatch::match_projected(const Trajectory &traj,
+                                         const HybridMatchConfig &config) {
+  SPDLOG_TRACE("Count of points in trajectory {}", traj.geom.get_num_points());
+  SPDLOG_TRACE("Search candidates");
+  UTIL::StageClock clock;
+  CandidateSearchContext &context = CandidateSearchContext::local();
+  bool found = network_.search_tr_cs_knn(traj.geom, config.k, config.radius,
+                                         &context, nullptr,
+                                         graph_.get_edge_mask());
+  clock.lap(UTIL::STAGE_SEARCH);
+  if (!found) return MatchResult{};
+  SPDLOG_TRACE("Trajectory candidate {}", context.to_traj_candidates());
+  TransitionGraph &tg = TransitionGraph::local();
+  tg.reset(context, config.gps_error);
+  clock.lap(UTIL::STAGE_TRANSITION_GRAPH);
+  SPDLOG_TRACE("Update cost in transition graph");
+  update_tg(&tg, traj, config);
+  SPDLOG_TRACE("Optimal path inference");
+  clock.lap(UTIL::STAGE_UPDATE_TG);
+  TGOpath tg_opath = tg.backtrack();
+  SPDLOG_TRACE("Optimal path size {}", tg_opath.size());
+  MatchedCandidatePath matched_candidate_path;
+  O_Path opath;
+  if (config.result_fields.candidates) {
+    matched_candidate_path.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   matched_candidate_path.begin(),
+                   [](const TGNode *a) {
+                     return MatchedCandidate{
+                         *(a->c), a->ep, a->tp, a->sp_dist
+                     };
+                   });
+    opath.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   opath.begin(),
+                   [](const TGNode *a) {
+                     return a->c->edge->id;
+                   });
+  }
+  clock.lap(UTIL::STAGE_BACKTRACK);
+  std::vector<int> indices;
+  std::vector<EdgeIndex> index_path;
+  C_Path cpath = build_cpath(tg_opath, &indices, &index_path);
+  SPDLOG_TRACE("Cpath {}", cpath);
+  clock.lap(UTIL::STAGE_CPATH);
+  LineString mgeom;
+  if (config.result_fields.mgeom) {
+    mgeom = network_.complete_path_to_geometry(traj.geom, index_path);
+  }
+  clock.lap(UTIL::STAGE_GEOMETRY);
+  return MatchResult{
+      traj.id, matched_candidate_path, opath, cpath, indices, mgeom};
+}
+
+PyMatchResult HybridMatch::match_wkt(
+    const std::string &wkt, const HybridMatchConfig &config) {
+  LineString line = wkt2linestring(wkt);
+  std::vector<double> timestamps;
+  Trajectory traj{0, line, timestamps};
+  MatchResult result = match_traj(traj, config);
+  PyMatchResult output;
+  output.id = result.id;
+  output.opath = result.opath;
+  output.cpath = result.cpath;
+  output.mgeom = result.mgeom;
+  output.indices = result.indices;
+  for (size_t i = 0; i < result.opt_candidate_path.size(); ++i) {
+    const MatchedCandidate &mc = result.opt_candidate_path[i];
+    output.candidates.push_back(
+        {(int) i,
+         mc.c.edge->id,
+         graph_.get_node_id(mc.c.edge->source),
+         graph_.get_node_id(mc.c.edge->target),
+         mc.c.dist,
+         mc.c.offset,
+         mc.c.edge->length,
+         mc.ep,
+         mc.tp,
+         mc.sp_dist}
+    );
+    output.pgeom.add_point(mc.c.point);
+  }
+  return output;
+};
+
+HybridMatchStatistics HybridMatch::get_statistics() const {
+  HybridMatchStatistics statistics;
+  statistics.ubodt_pairs = ubodt_pairs_;
+  statistics.skipped_pairs = skipped_pairs_;
+  statistics.searched_pairs = searched_pairs_;
+  statistics.found_pairs = found_pairs_;
+  return statistics;
+}
+
+void HybridMatch::print_statistics() const {
+  HybridMatchStatistics statistics = get_statistics();
+  long pairs = statistics.ubodt_pairs + statistics.skipped_pairs +
+      statistics.searched_pairs;
+  SPDLOG_INFO("Hybrid transitions {} by UBODT {} searched {} found {} "
+              "skipped {}", pairs, statistics.ubodt_pairs,
+              statistics.searched_pairs, statistics.found_pairs,
+              statistics.skipped_pairs);
+  SPDLOG_INFO("Hybrid UBODT rate {}",
+              pairs > 0 ? statistics.ubodt_pairs / (double) pairs : 0.0);
+  cache_.print_statistics();
+}
+
+void HybridMatch::update_tg(TransitionGraph *tg, const Trajectory &traj,
+                            const HybridMatchConfig &config) {
+  SPDLOG_TRACE("Update transition graph");
+  std::vector<TGLayer> &layers = tg->get_layers();
+  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
+  int N = layers.size();
+  for (int i = 0; i < N - 1; ++i) {
+    double delta;
+    if ((int) traj.timestamps.size() != N) {
+      delta = eu_dists[i] * config.factor * 4;
+    } else {
+      double duration = traj.timestamps[i + 1] - traj.timestamps[i];
+      delta = config.factor * config.vmax * duration;
+    }
+    update_layer(&(layers[i]), &(layers[i + 1]), eu_dists[i], delta);
+  }
+  SPDLOG_TRACE("Update transition graph done");
+}
+
+void HybridMatch::update_layer(TGLayer *la_ptr, TGLayer *lb_ptr,
+                               double eu_dist, double delta) {
+  TGLayer &la = *la_ptr;
+  TGLayer &lb = *lb_ptr;
+  const double inf = std::numeric_limits<double>::max();
+  static thread_local std::vector<NodeIndex> sources;
+  static thread_local std::vector<NodeIndex> targets;
+  static thread_local std::vector<double> costs;
+  static thread_local std::vector<NodeIndex> missing_nodes;
+  static thread_local std::vector<size_t> missing;
+  // The candidates of layer b are gathered into compact copies, so that
+  // the pairs are compared without reading the edges
+  static thread_local std::vector<CompactCandidate> compact_b;
+  sources.resize(la.size());
+  for (size_t i = 0; i < la.size(); ++i) {
+    sources[i] = la[i].c->edge->target;
+  }
+  compact_b.resize(lb.size());
+  targets.resize(lb.size());
+  for (size_t j = 0; j < lb.size(); ++j) {
+    compact_b[j] = CompactCandidate::from(*(lb[j].c));
+    targets[j] = compact_b[j].source;
+  }
+  ubodt_->look_up_batch(sources, targets, &costs);
+  // A pair missing in UBODT is farther than its bound, so it is only
+  // searched if the bound of the layer is larger
+  bool search = delta > ubodt_->get_delta();
+  long ubodt_pairs = 0, skipped_pairs = 0, searched_pairs = 0,
+      found_pairs = 0;
+  for (size_t i = 0; i < la.size(); ++i) {
+    const CompactCandidate ca = CompactCandidate::from(*(la[i].c));
+    double *row = costs.data() + i * lb.size();
+    missing.clear();
+    missing_nodes.clear();
+    for (size_t j = 0; j < lb.size(); ++j) {
+      const CompactCandidate &cb = compact_b[j];
+      if (ca.edge == cb.edge && ca.offset <= cb.offset) {
+        row[j] = cb.offset - ca.offset;
+      } else if (ca.target == cb.source) {
+        row[j] = ca.length - ca.offset + cb.offset;
+      } else if (row[j] >= 0) {
+        row[j] += ca.length - ca.offset + cb.offset;
+      } else if (search) {
+        missing.push_back(j);
+        missing_nodes.push_back(targets[j]);
+        continue;
+      } else {
+        row[j] = inf;
+        ++skipped_pairs;
+        continue;
+      }
+      ++ubodt_pairs;
+    }
+    if (missing.empty()) continue;
+    std::vector<double> distances =
+        cache_.one_to_many(sources[i], missing_nodes, delta);
+    searched_pairs += missing.size();
+    for (size_t m = 0; m < missing.size(); ++m) {
+      size_t j = missing[m];
+      if (distances[m] == inf) {
+        row[j] = inf;
+      } else {
+        row[j] = distances[m] + ca.length - ca.offset +
+            compact_b[j].offset;
+        ++found_pairs;
+      }
+    }
+  }
+  ubodt_pairs_ += ubodt_pairs;
+  skipped_pairs_ += skipped_pairs;
+  searched_pairs_ += searched_pairs;
+  found_pairs_ += found_pairs;
+  for (size_t i = 0; i < la.size(); ++i) {
+    TGNode *a = &(la[i]);
+    const double *row = costs.data() + i * lb.size();
+    for (size_t j = 0; j < lb.size(); ++j) {
+      TGNode *b = &(lb[j]);
+      double tp = TransitionGraph::calc_tp(row[j], eu_dist);
+      if (a->cumu_prob + tp * b->ep >= b->cumu_prob) {
+        b->cumu_prob = a->cumu_prob + tp * b->ep;
+        b->prev = a;
+        b->tp = tp;
+        b->sp_dist = row[j];
+      }
+    }
+  }
+}
+
+C_Path HybridMatch::build_cpath(const TGOpath &opath,
+                                std::vector<int> *indices,
+                                std::vector<EdgeIndex> *index_path) {
+  C_Path cpath;
+  if (!indices->empty()) indices->clear();
+  if (index_path != nullptr) index_path->clear();
+  if (opath.empty()) return cpath;
+  const std::vector<Edge> &edges = network_.get_edges();
+  int N = opath.size();
+  cpath.push_back(opath[0]->c->edge->id);
+  if (index_path != nullptr) index_path->push_back(opath[0]->c->edge->index);
+  int current_idx = 0;
+  indices->push_back(current_idx);
+  for (int i = 0; i < N - 1; ++i) {
+    const Candidate *a = opath[i]->c;
+    const Candidate *b = opath[i + 1]->c;
+    if ((a->edge->id != b->edge->id) || (a->offset > b->offset)) {
+      std::vector<EdgeIndex> segs;
+      if (a->edge->target != b->edge->source) {
+        // The path of a pair missing in UBODT was kept by its search
+        segs = ubodt_->look_sp_path(a->edge->target, b->edge->source);
+        if (segs.empty() &&
+            !cache_.get_path(a->edge->target, b->edge->source, &segs)) {
+          indices->clear();
+          if (index_path != nullptr) index_path->clear();
+          return {};
+        }
+      }
+      for (int e : segs) {
+        cpath.push_back(edges[e].id);
+        ++current_idx;
+      }
+      cpath.push_back(b->edge->id);
+      if (index_path != nullptr) {
+        index_path->insert(index_path->end(), segs.begin(), segs.end());
+        index_path->push_back(b->edge->index);
+      }
+      ++current_idx;
+    }
+    indices->push_back(current_idx);
+  }
+  return cpath;
+}
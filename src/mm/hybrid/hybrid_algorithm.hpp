@@ -0,0 +1,189 @@
+/**
+ * Fast map matching.
+ *
+ * Hybrid algorithm, which looks up the transitions in UBODT and searches
+ * the ones missing with the bound of stmatch.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_HYBRID_ALGORITHM_HPP_
+#define FMM_HYBRID_ALGORITHM_HPP_
+
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "network/path_cache.hpp"
+#include "mm/transition_graph.hpp"
+#include "mm/fmm/ubodt.hpp"
+#include "python/pyfmm.hpp"
+
+#include <atomic>
+#include <string>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+
+#include "cxxopts/cxxopts.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Configuration of the hybrid algorithm
+ */
+struct HybridMatchConfig {
+  /**
+   * Constructor of hybrid algorithm configuration
+   * @param k_arg the number of candidates
+   * @param r_arg the search radius, in map unit
+   * @param gps_error_arg the gps error, in map unit
+   * @param vmax_arg the maximum speed of the vehicle in map unit/second
+   * @param factor_arg a factor multiplied with vmax*deltaT to bound the
+   * search of the transitions missing in UBODT
+   */
+  HybridMatchConfig(int k_arg = 8, double r_arg = 300,
+                    double gps_error_arg = 50, double vmax_arg = 30,
+                    double factor_arg = 1.5);
+  int k; /**< number of candidates */
+  double radius; /**< search radius for candidates, unit is map_unit*/
+  double gps_error; /**< GPS error, unit is map_unit */
+  double vmax; /**< maximum speed of the vehicle, unit is map_unit/second */
+  double factor; /**< factor multiplied to vmax*deltaT to
+                      limit the search of shortest path */
+  ResultFields result_fields; /**< Fields of the results built, set by
+                                   the apps from the fields written */
+  /**
+   * Check the validity of the configuration
+   */
+  bool validate() const;
+  /**
+   * Print configuration data
+   */
+  void print() const;
+  /**
+   * Load from xml data
+   */
+  static HybridMatchConfig load_from_xml(
+      const boost::property_tree::ptree &xml_data);
+  /**
+   * Load from argument parsed data
+   */
+  static HybridMatchConfig load_from_arg(
+      const cxxopts::ParseResult &arg_data);
+};
+
+/**
+ * Counters of the transitions resolved by a hybrid model
+ */
+struct HybridMatchStatistics {
+  long ubodt_pairs = 0; /**< Pairs found in UBODT */
+  long skipped_pairs = 0; /**< Pairs missing in UBODT whose bound is not
+                               larger than the one of UBODT */
+  long searched_pairs = 0; /**< Pairs missing in UBODT and searched */
+  long found_pairs = 0; /**< Pairs searched and reached */
+};
+
+/**
+ * Hybrid map matching algorithm.
+ *
+ * The transitions between two layers are looked up in UBODT as fmm does.
+ * A pair missing in UBODT is farther than its upper bound, so it is only
+ * searched if the bound of stmatch, vmax times the duration between the
+ * two points, is larger. The searches go through a path cache, which is
+ * shared by the trajectories. The short hops, which are the most
+ * frequent, keep the cost of a table look up while the long gaps are
+ * still matched.
+ */
+class HybridMatch {
+ public:
+  /**
+   * Constructor of the hybrid model
+   * @param network    road network
+   * @param graph      road network graph
+   * @param ubodt      upper bounded origin destination table
+   * @param cache_rows maximum number of records in the cache of the
+   * searches
+   */
+  HybridMatch(const NETWORK::Network &network,
+              const NETWORK::NetworkGraph &graph,
+              std::shared_ptr<UBODT> ubodt,
+              long cache_rows = NETWORK::PathCache::DEFAULT_CACHE_ROWS);
+  /**
+   * Match a trajectory to the road network
+   * @param  traj   input trajectory data
+   * @param  config configuration of map matching algorithm
+   * @return map matching result
+   */
+  MatchResult match_traj(const CORE::Trajectory &traj,
+                         const HybridMatchConfig &config);
+  /**
+   * Match a wkt linestring to the road network.
+   * @param wkt WKT representation of a trajectory
+   * @param config Map matching configuration
+   * @return Map matching result in POD format used in Python API
+   */
+  PYTHON::PyMatchResult match_wkt(
+      const std::string &wkt, const HybridMatchConfig &config);
+  /**
+   * Get the counters of the transitions resolved
+   */
+  HybridMatchStatistics get_statistics() const;
+  /**
+   * Log the counters of the transitions and of the path cache
+   */
+  void print_statistics() const;
+  /**
+   * Get the path cache searched for the transitions
+   */
+  const NETWORK::PathCache &get_path_cache() const { return cache_; }
+ protected:
+  /**
+   * Update probabilities in a transition graph
+   * @param tg     transition graph
+   * @param traj   raw trajectory
+   * @param config map match configuration
+   */
+  void update_tg(TransitionGraph *tg, const CORE::Trajectory &traj,
+                 const HybridMatchConfig &config);
+  /**
+   * Update probabilities between two layers a and b in the transition
+   * graph
+   * @param la      layer a
+   * @param lb      layer b next to a
+   * @param eu_dist Euclidean distance between two observed point
+   * @param delta   upper bound of the search of the pairs missing in
+   * UBODT
+   */
+  void update_layer(TGLayer *la, TGLayer *lb, double eu_dist, double delta);
+  /**
+   * Build the complete path from an optimal path, where the paths are
+   * looked up in UBODT then in the path cache
+   * @param  opath   optimal path
+   * @param  indices updated with the index of each optimal edge in the
+   * complete path
+   * @param  index_path if not nullptr, updated with the complete path
+   * stored with edge index
+   * @return the complete path, empty if a transition is not found
+   */
+  C_Path build_cpath(const TGOpath &opath, std::vector<int> *indices,
+                     std::vector<NETWORK::EdgeIndex> *index_path = nullptr);
+ private:
+  /**
+   * Match a trajectory in the coordinates of the network
+   */
+  MatchResult match_projected(const CORE::Trajectory &traj,
+                              const HybridMatchConfig &config);
+  const NETWORK::Network &network_;
+  const NETWORK::NetworkGraph &graph_;
+  std::shared_ptr<UBODT> ubodt_;
+  NETWORK::PathCache cache_;
+  std::atomic<long> ubodt_pairs_{0};
+  std::atomic<long> skipped_pairs_{0};
+  std::atomic<long> searched_pairs_{0};
+  std::atomic<long> found_pairs_{0};
+};
+
+}
+}
+
+#endif // FMM_HYBRID_ALGORITHM_HPP_
@@ -0,0 +1,191 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/hybrid/hybrid_app.hpp"
+#include "io/async_writer.hpp"
+#include "io/edge_aggregate_writer.hpp"
+#include "io/gps_reader.hpp"
+#include "io/mm_writer.hpp"
+#include "io/match_pipeline.hpp"
+#include "util/metrics.hpp"
+#include "util/stage_profile.hpp"
+#include "util/util.hpp"
+
+#include <omp.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+HybridApp::HybridApp(const HybridAppConfig &config) :
+    config_(config),
+    network_(config_.network_config.file,
+             config_.network_config.id,
+             config_.network_config.source,
+             config_.network_config.target,
+             config_.network_config.cache,
+             config_.network_config.get_spatial_index_options(),
+             config_.network_config.reorder,
+             config_.network_config.project,
+             config_.network_config.get_clip(),
+             config_.network_config.compress_geometry,
+             config_.network_config.get_cost_names()),
+    ng_(network_, config_.network_config.read_edge_mask(network_)),
+    ubodt_(load_ubodt(config_, ng_)) {};
+
+std::shared_ptr<UBODT> HybridApp::load_ubodt(const HybridAppConfig &config,
+                                            const NetworkGraph &graph) {
+  if (config.get_ubodt_layout() == LAZY) {
+    return UBODT::create_lazy_ubodt(graph, config.ubodt_delta,
+                                    config.ubodt_cache_rows);
+  }
+  if (UTIL::check_file_extension(config.ubodt_file, "tiles")) {
+    std::shared_ptr<UBODT> ubodt = UBODT::read_ubodt_tiled(
+        config.ubodt_file, UBODT::DEFAULT_RESIDENT_TILES);
+    if (ubodt == nullptr) std::exit(EXIT_FAILURE);
+    return ubodt;
+  }
+  return UBODT::read_ubodt_file(
+      config.ubodt_file, 50000, config.get_ubodt_layout(), config.use_omp);
+}
+
+UTIL::MemoryReport HybridApp::get_memory_report() const {
+  UTIL::MemoryReport report;
+  network_.get_memory_usage(&report);
+  ng_.get_memory_usage(&report);
+  ubodt_->get_memory_usage(&report);
+  return report;
+}
+
+bool HybridApp::run() {
+  UTIL::TimePoint start_time = std::chrono::steady_clock::now();
+  HybridMatch mm_model(network_, ng_, ubodt_, config_.path_cache_rows);
+  // Only the fields of the results written are built
+  HybridMatchConfig hybrid_config = config_.hybrid_config;
+  hybrid_config.result_fields =
+      IO::get_result_fields(config_.result_config);
+  IO::GPSReader reader(config_.gps_config);
+  std::unique_ptr<IO::MatchResultWriter> writer =
+      IO::MatchResultWriter::create(config_.result_config, false, &network_);
+  if (writer == nullptr) return false;
+  // Start map matching
+  int progress = 0;
+  int points_matched = 0;
+  int total_points = 0;
+  int step_size = 100;
+  if (config_.step > 0) step_size = config_.step;
+  SPDLOG_INFO("Progress report step {}", step_size);
+  get_memory_report().print();
+  SPDLOG_INFO("Routing workspace up to {:.1f} MB per thread",
+              ng_.get_workspace_bytes() / (1024.0 * 1024.0));
+  UTIL::TimePoint corrected_begin = std::chrono::steady_clock::now();
+  SPDLOG_INFO("Start to match trajectories");
+  UTIL::StageProfile::set_counters_enabled(config_.profile_counters);
+  UTIL::StageProfile::set_enabled(config_.profile ||
+                                  config_.profile_counters ||
+                                  !config_.profile_file.empty());
+  // The metrics are read by the thread of the exporter while matching
+  IO::MatchPipelineProgress pipeline_progress;
+  UTIL::MetricsExporter metrics(config_.metrics_file,
+                                config_.metrics_interval);
+  if (!config_.metrics_file.empty()) {
+    metrics.add_collector([&pipeline_progress](UTIL::MetricsText *text) {
+      IO::append_pipeline_metrics(&pipeline_progress, text);
+    });
+    metrics.add_collector([this, &mm_model](UTIL::MetricsText *text) {
+      append_ubodt_metrics(*ubodt_, text);
+      NETWORK::append_path_cache_metrics(mm_model.get_path_cache(), text);
+      UTIL::append_memory_metrics(get_memory_report(), text);
+    });
+    if (config_.result_config.async_write) {
+      metrics.add_collector([](UTIL::MetricsText *text) {
+        IO::append_async_write_metrics(text);
+      });
+    }
+    metrics.start();
+  }
+  if (config_.use_omp){
+    SPDLOG_INFO("Run map matching parallelly");
+    IO::MatchPipelineOptions options;
+    options.num_matchers = omp_get_max_threads();
+    options.step = step_size;
+    options.chunk_size = config_.chunk_size;
+    options.memory_budget = config_.memory_budget * 1024L * 1024L;
+    options.ordered = config_.ordered_output;
+    options.progress = &pipeline_progress;
+    IO::MatchPipelineStatistics statistics = IO::run_match_pipeline(
+        &reader, writer.get(),
+        [&](const Trajectory &trajectory) {
+          std::vector<SegmentMatchResult> segments{SegmentMatchResult{
+              -1, -1, mm_model.match_traj(trajectory, hybrid_config)}};
+          if (hybrid_config.result_fields.timestamps) {
+            IO::copy_timestamps(trajectory, &segments);
+          }
+          return segments;
+        },
+        options);
+    progress = statistics.trajectories;
+    points_matched = statistics.points_matched;
+    total_points = statistics.total_points;
+    IO::print_pipeline_statistics(statistics);
+  } else {
+    SPDLOG_INFO("Run map matching in single thread");
+    while (reader.has_next_trajectory()) {
+      if (progress % step_size == 0) {
+        SPDLOG_INFO("Progress {}", progress);
+      }
+      Trajectory trajectory = reader.read_next_trajectory();
+      int points_in_tr = trajectory.geom.get_num_points();
+      MatchResult result = mm_model.match_traj(trajectory, hybrid_config);
+      if (hybrid_config.result_fields.timestamps) {
+        result.timestamps = trajectory.timestamps;
+      }
+      UTIL::StageClock clock;
+      writer->write_result(result);
+      clock.lap(UTIL::STAGE_WRITE);
+      if (!result.cpath.empty()) {
+        points_matched += points_in_tr;
+      }
+      total_points += points_in_tr;
+      ++progress;
+      pipeline_progress.trajectories = progress;
+      pipeline_progress.total_points = total_points;
+      pipeline_progress.points_matched = points_matched;
+      if (UTIL::StageProfile::is_enabled()) {
+        UTIL::StageProfile::local().finish_trajectory(trajectory.id);
+      }
+    }
+  }
+  // The rows buffered by a writer may still fail to be written
+  bool written = writer->close();
+  SPDLOG_INFO("MM process finished");
+  metrics.stop();
+  UTIL::print_workspace_memory();
+  if (UTIL::StageProfile::is_enabled()) {
+    UTIL::StageStatistics stage_statistics = UTIL::StageProfile::collect();
+    UTIL::StageProfile::print(stage_statistics);
+    if (!config_.profile_file.empty()) {
+      UTIL::StageProfile::write_json(stage_statistics, config_.profile_file);
+    }
+  }
+  ubodt_->print_cache_statistics();
+  network_.print_search_statistics();
+  mm_model.print_statistics();
+  UTIL::TimePoint end_time = std::chrono::steady_clock::now();
+  double time_spent = std::chrono::duration_cast<std::chrono::milliseconds>(
+      end_time - start_time).count() / 1000.;
+  double time_spent_exclude_input = std::chrono::duration_cast<
+      std::chrono::milliseconds>(end_time - corrected_begin).count() / 1000.;
+  SPDLOG_INFO("Time takes {}", time_spent);
+  SPDLOG_INFO("Time takes excluding input {}", time_spent_exclude_input);
+  SPDLOG_INFO("Finish map match total points {} matched {}",
+              total_points, points_matched);
+  SPDLOG_INFO("Matched percentage: {}", points_matched / (double) total_points);
+  SPDLOG_INFO("Point match speed: {}", points_matched / time_spent);
+  SPDLOG_INFO("Point match speed (excluding input): {}",
+              points_matched / time_spent_exclude_input);
+  SPDLOG_INFO("Time takes {}", time_spent);
+  return written;
+};
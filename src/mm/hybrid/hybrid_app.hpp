@@ -0,0 +1,56 @@
+/**
+ * Fast map matching.
+ *
+ * Hybrid command line program.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_HYBRID_APP_H_
+#define FMM_HYBRID_APP_H_
+
+#include "mm/hybrid/hybrid_app_config.hpp"
+#include "mm/hybrid/hybrid_algorithm.hpp"
+
+namespace FMM {
+namespace MM {
+/**
+ * Class of hybrid command line program
+ */
+class HybridApp {
+ public:
+  /**
+   * Create hybrid command application from configuration
+   * @param config configuration of the command line app
+   */
+  HybridApp(const HybridAppConfig &config);
+  /**
+   * Run the hybrid program
+   * @return false if the program stops on an error or the results
+   * cannot be written
+   */
+  bool run();
+ private:
+  /**
+   * Load or create the UBODT defined in configuration
+   * @param config Configuration of the HybridApp
+   * @param graph  Network graph used by lazy UBODT
+   * @return A shared pointer to the UBODT data
+   */
+  static std::shared_ptr<UBODT> load_ubodt(
+      const HybridAppConfig &config, const NETWORK::NetworkGraph &graph);
+  /**
+   * Collect the memory of the structures loaded, which is collected
+   * again for each write of the metrics as the caches grow
+   */
+  UTIL::MemoryReport get_memory_report() const;
+  const HybridAppConfig &config_;
+  NETWORK::Network network_;
+  NETWORK::NetworkGraph ng_;
+  std::shared_ptr<UBODT> ubodt_;
+};
+}
+}
+
+#endif
@@ -0,0 +1,453 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "mm/hybrid/hybrid_app_config.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+using namespace FMM::CONFIG;
+
+HybridAppConfig::HybridAppConfig(int argc, char **argv){
+  spdlog::set_pattern("[%^%l%$][%s:%-3#] %v");
+  if (argc==2) {
+    std::string configfile(argv[1]);
+    if (UTIL::check_file_extension(configfile,"xml,XML"))
+      load_xml(configfile);
+    else {
+      load_arg(argc,argv);
+    }
+  } else {
+    load_arg(argc,argv);
+  }
+  // The results written to stdout are not mixed with the logs
+  if (result_config.file == "-") UTIL::log_to_stderr();
+  spdlog::set_level((spdlog::level::level_enum) log_level);
+  if (!help_specified)
+    print();
+};
+
+void HybridAppConfig::load_xml(const std::string &file){
+  SPDLOG_INFO("Start with reading hybrid xml configuration {}", file);
+  // Create empty property tree object
+  boost::property_tree::ptree tree;
+  boost::property_tree::read_xml(file, tree);
+  network_config = NetworkConfig::load_from_xml(tree);
+  gps_config = GPSConfig::load_from_xml(tree);
+  result_config = CONFIG::ResultConfig::load_from_xml(tree);
+  hybrid_config = HybridMatchConfig::load_from_xml(tree);
+  // UBODT
+  ubodt_layout = tree.get("config.input.ubodt.layout", std::string("chained"));
+  ubodt_file = tree.get("config.input.ubodt.file", std::string(""));
+  ubodt_delta = tree.get("config.input.ubodt.delta", 3000.0);
+  ubodt_cache_rows = tree.get("config.input.ubodt.cache_rows",
+                              UBODT::DEFAULT_CACHE_ROWS);
+  path_cache_rows = tree.get("config.parameters.path_cache_rows",
+                             PathCache::DEFAULT_CACHE_ROWS);
+  log_level = tree.get("config.other.log_level",2);
+  step =  tree.get("config.other.step",100);
+  chunk_size = tree.get("config.other.chunk_size",64);
+  memory_budget = tree.get("config.other.memory_budget",0);
+  use_omp = !(!tree.get_child_optional("config.other.use_omp"));
+  ordered_output =
+      !(!tree.get_child_optional("config.other.ordered_output"));
+  profile = !(!tree.get_child_optional("config.other.profile"));
+  profile_file = tree.get("config.other.profile_file", std::string(""));
+  profile_counters =
+      !(!tree.get_child_optional("config.other.profile_counters"));
+  metrics_file = tree.get("config.other.metrics_file", std::string(""));
+  metrics_interval = tree.get("config.other.metrics_interval", 15);
+  SPDLOG_INFO("Finish with reading hybrid xml configuration");
+};
+
+void HybridAppConfig::load_arg(int argc, char **argv){
+  SPDLOG_INFO("Start reading hybrid configuration from arguments");
+  cxxopts::Options options("hybrid_config", "Configuration parser");
+  options.add_options()
+    ("ubodt","Ubodt file name",
+    cxxopts::value<std::string>()->default_value(""))
+    ("ubodt_layout","Ubodt storage layout",
+    cxxopts::value<std::string>()->default_value("chained"))
+    ("ubodt_delta","Upperbound of lazy ubodt",
+    cxxopts::value<double>()->default_value("3000"))
+    ("ubodt_cache_rows","Maximum rows cached in lazy ubodt",
+    cxxopts::value<long>()->default_value(
+        std::to_string(UBODT::DEFAULT_CACHE_ROWS)))
+    ("network","Network file name",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_id","Network id name",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("source","Network source name",
+    cxxopts::value<std::string>()->default_value("source"))
+    ("target","Network target name",
+    cxxopts::value<std::string>()->default_value("target"))
+    ("no_network_cache","Do not read or write the network cache")
+    ("rtree","Rtree algorithm",
+    cxxopts::value<std::string>()->default_value("packing"))
+    ("rtree_max_elements","Rtree node capacity",
+    cxxopts::value<int>()->default_value("16"))
+    ("rtree_chunk_segments","Segments of the edge chunks in the rtree",
+    cxxopts::value<int>()->default_value("0"))
+    ("spatial_index","Spatial index of the edges",
+    cxxopts::value<std::string>()->default_value("rtree"))
+    ("grid_cell_size","Cell size of the grid index",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_batch_size","Points searched with one spatial index query",
+    cxxopts::value<int>()->default_value("1"))
+    ("nearest_search","Search the candidates with the nearest query")
+    ("search_initial_radius","Radius of the first search of a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_min_candidates","Candidates below which the radius grows",
+    cxxopts::value<int>()->default_value("1"))
+    ("search_radius_growth","Factor of each growth of the radius",
+    cxxopts::value<double>()->default_value("2"))
+    ("search_snap_resolution","Cell size of the snapping cache",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_snap_items","Maximum edges cached by the snapping cache",
+    cxxopts::value<long>()->default_value(
+        std::to_string(NETWORK::SnapCache::DEFAULT_CACHE_ITEMS)))
+    ("reorder_network","Renumber nodes along the Hilbert curve")
+    ("project_network","Project a lon/lat network into metres")
+    ("compress_geometry","Keep the edge geometries compressed")
+    ("twin_edges","Index the twin edges of two-way roads once")
+    ("network_clip","Region of the network read, box or WKT polygon",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_clip_margin","Margin around the network clip region",
+      cxxopts::value<double>()->default_value("0"))
+    ("network_costs","Extra cost columns of the network",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_edge_mask","File of the ids of the edges allowed",
+      cxxopts::value<std::string>()->default_value(""))
+    ("gps","GPS file name",
+      cxxopts::value<std::string>()->default_value(""))
+    ("gps_id","GPS file id",
+    cxxopts::value<std::string>()->default_value("id"))
+    ("gps_x","GPS x name",
+    cxxopts::value<std::string>()->default_value("x"))
+    ("gps_y","GPS y name",
+    cxxopts::value<std::string>()->default_value("y"))
+    ("gps_geom","GPS file geom column name",
+    cxxopts::value<std::string>()->default_value("geom"))
+    ("gps_timestamp",   "GPS file timestamp column name",
+    cxxopts::value<std::string>()->default_value("timestamp"))
+    ("gps_read_threads","Threads reading a GPS file",
+    cxxopts::value<int>())
+    ("gps_timestamp_format","Format of the timestamps of a CSV file",
+    cxxopts::value<std::string>())
+    ("k,candidates","Number of candidates",
+    cxxopts::value<int>()->default_value("8"))
+    ("r,radius","Search radius",
+    cxxopts::value<double>()->default_value("300.0"))
+    ("e,error","GPS error",
+    cxxopts::value<double>()->default_value("50.0"))
+    ("vmax","Maximum speed",
+    cxxopts::value<double>()->default_value("80.0"))
+    ("factor","Scale factor",
+    cxxopts::value<double>()->default_value("1.5"))
+    ("path_cache_rows","Maximum rows in the shortest path cache",
+      cxxopts::value<long>()->default_value(
+          std::to_string(PathCache::DEFAULT_CACHE_ROWS)))
+    ("o,output","Output file name",
+      cxxopts::value<std::string>()->default_value(""))
+    ("m,output_fields","Output fields",
+      cxxopts::value<std::string>()->default_value(""))
+    ("output_precision","Decimals of the coordinates written",
+      cxxopts::value<int>())
+    ("output_geometry_encoding","Encoding of the geometries written, "
+     "wkt, hexwkb, wkb, polyline or delta",
+      cxxopts::value<std::string>())
+    ("output_format","Format of the output file, csv, arrow, edges, "
+     "index or state",
+      cxxopts::value<std::string>())
+    ("output_shard_size","Rows written into each shard of the output",
+      cxxopts::value<int>())
+    ("output_async","Write the output by a thread of its own")
+    ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
+    ("s,step","Step report",cxxopts::value<int>()->default_value("100"))
+    ("chunk_size","Trajectories taken at once by a matcher thread",
+    cxxopts::value<int>()->default_value("64"))
+    ("memory_budget","Memory of the trajectories held in MB",
+    cxxopts::value<int>()->default_value("0"))
+    ("h,help","Help information")
+    ("gps_point","GPS point or not")
+    ("use_omp","Use omp or not")
+    ("ordered_output","Write the results in the input order if specified")
+    ("profile","Report the time spent in each stage if specified")
+    ("profile_counters","Count hardware events of each stage if specified")
+    ("profile_file","JSON file of the time spent in each stage",
+    cxxopts::value<std::string>()->default_value(""))
+    ("metrics_file","Prometheus text file of the metrics of the job",
+    cxxopts::value<std::string>()->default_value(""))
+    ("metrics_interval","Seconds between two writes of the metrics file",
+    cxxopts::value<int>()->default_value("15"));
+  if (argc==1) {
+    help_specified = true;
+    return;
+  }
+  auto result = options.parse(argc, argv);
+  ubodt_file = result["ubodt"].as<std::string>();
+  ubodt_layout = result["ubodt_layout"].as<std::string>();
+  ubodt_delta = result["ubodt_delta"].as<double>();
+  ubodt_cache_rows = result["ubodt_cache_rows"].as<long>();
+  network_config = NetworkConfig::load_from_arg(result);
+  gps_config = GPSConfig::load_from_arg(result);
+  result_config = CONFIG::ResultConfig::load_from_arg(result);
+  hybrid_config = HybridMatchConfig::load_from_arg(result);
+  path_cache_rows = result["path_cache_rows"].as<long>();
+  log_level = result["log_level"].as<int>();
+  step = result["step"].as<int>();
+  chunk_size = result["chunk_size"].as<int>();
+  memory_budget = result["memory_budget"].as<int>();
+  use_omp = result.count("use_omp")>0;
+  ordered_output = result.count("ordered_output")>0;
+  profile = result.count("profile")>0;
+  profile_file = result["profile_file"].as<std::string>();
+  profile_counters = result.count("profile_counters")>0;
+  metrics_file = result["metrics_file"].as<std::string>();
+  metrics_interval = result["metrics_interval"].as<int>();
+  if (result.count("help")>0){
+    help_specified = true;
+  }
+  SPDLOG_INFO("Finish with reading hybrid arg configuration");
+};
+
+void HybridAppConfig::print() const {
+  SPDLOG_INFO("----   Print configuration    ----");
+  network_config.print();
+  gps_config.print();
+  result_config.print();
+  hybrid_config.print();
+  SPDLOG_INFO("UBODT file {}",ubodt_file);
+  SPDLOG_INFO("UBODT layout {}",ubodt_layout);
+  if (get_ubodt_layout() == LAZY) {
+    SPDLOG_INFO("UBODT delta {} cache rows {}",ubodt_delta,ubodt_cache_rows);
+  }
+  SPDLOG_INFO("Path cache rows {}",path_cache_rows);
+  SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level]);
+  SPDLOG_INFO("Step {}",step);
+  SPDLOG_INFO("Chunk size {}",chunk_size);
+  SPDLOG_INFO("Memory budget {} MB",memory_budget);
+  SPDLOG_INFO("Use omp {}",(use_omp ? "true" : "false"));
+  SPDLOG_INFO("Ordered output {}",(ordered_output ? "true" : "false"));
+  SPDLOG_INFO("Profile {}",(profile ? "true" : "false"));
+  SPDLOG_INFO("Profile counters {}",(profile_counters ? "true" : "false"));
+  if (!profile_file.empty()) {
+    SPDLOG_INFO("Profile file {}",profile_file);
+  }
+  if (!metrics_file.empty()) {
+    SPDLOG_INFO("Metrics file {} interval {}",metrics_file,metrics_interval);
+  }
+  SPDLOG_INFO("---- Print configuration done ----");
+};
+
+void HybridAppConfig::print_help(){
+  std::cout<<"hybrid argument lists:\n";
+  std::cout<<"--ubodt (required) <string>: Ubodt file name,\n";
+  std::cout<<"  shm:<name> attaches ubodt published by ubodt_shm,\n";
+  std::cout<<"  not used by lazy layout\n";
+  std::cout<<"--ubodt_layout (optional) <string>: Ubodt storage layout,\n";
+  std::cout<<"  chained, flat, compact, split, csr or lazy (chained)\n";
+  std::cout<<"--ubodt_delta (optional) <double>: upperbound of "
+             "lazy ubodt (3000)\n";
+  std::cout<<"--ubodt_cache_rows (optional) <long>: maximum rows cached "
+             "in lazy ubodt (10000000)\n";
+  std::cout<<"--network (required) <string>: Network file name\n";
+  std::cout<<"--network_id (optional) <string>: Network id name (id)\n";
+  std::cout<<"--source (optional) <string>: Network source name (source)\n";
+  std::cout<<"--target (optional) <string>: Network target name (target)\n";
+  std::cout<<"--no_network_cache: do not read or write the network cache\n";
+  std::cout<<"  file, which is created next to the network file\n";
+  std::cout<<"--rtree (optional) <string>: Rtree algorithm of the edges,\n";
+  std::cout<<"  packing, linear, quadratic or rstar (packing)\n";
+  std::cout<<"--rtree_max_elements (optional) <int>: Maximum number of\n";
+  std::cout<<"  elements in a rtree node (16)\n";
+  std::cout<<"--rtree_chunk_segments (optional) <int>: Maximum number of\n";
+  std::cout<<"  segments of the chunks of a long edge indexed by the\n";
+  std::cout<<"  rtree, 0 for the whole edges (0)\n";
+  std::cout<<"--spatial_index (optional) <string>: Spatial index of the\n";
+  std::cout<<"  edges in candidate search, rtree, flat or grid (rtree)\n";
+  std::cout<<"--grid_cell_size (optional) <double>: Cell size of the grid\n";
+  std::cout<<"  index, close to the search radius, 0 for the mean extent\n";
+  std::cout<<"  of the edges (0)\n";
+  std::cout<<"--search_batch_size (optional) <int>: Number of consecutive\n";
+  std::cout<<"  points searched with one spatial index query (1)\n";
+  std::cout<<"--nearest_search: search the k candidates of a point with\n";
+  std::cout<<"  the incremental nearest query of the rtree\n";
+  std::cout<<"--search_initial_radius (optional) <double>: radius of the\n";
+  std::cout<<"  first search of a point, multiplied by the growth until the\n";
+  std::cout<<"  point has the minimum candidates or the radius is reached,\n";
+  std::cout<<"  0 to search with the radius directly (0)\n";
+  std::cout<<"--search_min_candidates (optional) <int>: candidates of a point\n";
+  std::cout<<"  below which its search radius grows (1)\n";
+  std::cout<<"--search_radius_growth (optional) <double>: factor of each\n";
+  std::cout<<"  growth of the search radius (2)\n";
+  std::cout<<"--search_snap_resolution (optional) <double>: cell size\n";
+  std::cout<<"  of the snapping cache of the edges near the points,\n";
+  std::cout<<"  which are reused by the points in the same cell (0)\n";
+  std::cout<<"--search_snap_items (optional) <long>: maximum edges\n";
+  std::cout<<"  cached by the snapping cache (10000000)\n";
+  std::cout<<"--reorder_network: renumber nodes along the Hilbert curve\n";
+  std::cout<<"  for memory locality, the ubodt must be generated with it\n";
+  std::cout<<"--project_network: project a network in longitude and\n";
+  std::cout<<"  latitude into metres, so that radius, gps_error and the\n";
+  std::cout<<"  distances are in metres, the ubodt must be generated with it\n";
+  std::cout<<"--compress_geometry: keep the edge geometries delta and\n";
+  std::cout<<"  varint encoded, decoded on demand, which saves memory\n";
+  std::cout<<"--twin_edges: pair the edges of two-way roads whose\n";
+  std::cout<<"  geometries are reversed, indexed once in the rtree and\n";
+  std::cout<<"  sharing their geometry\n";
+  std::cout<<"--network_clip (optional) <string>: read only the edges in\n";
+  std::cout<<"  a box minx,miny,maxx,maxy or a WKT polygon of the network\n";
+  std::cout<<"--network_clip_margin (optional) <double>: margin added\n";
+  std::cout<<"  around the clip region (0)\n";
+  std::cout<<"--network_costs (optional) <string>: numeric columns of\n";
+  std::cout<<"  the network read as the costs of the edges under other\n";
+  std::cout<<"  metrics, separated by comma, e.g., time\n";
+  std::cout<<"--network_edge_mask (optional) <string>: file of the ids\n";
+  std::cout<<"  of the edges allowed to the vehicles matched, such as the\n";
+  std::cout<<"  edges open to trucks, the others are not routed\n";
+  std::cout<<"--gps (required) <string>: GPS file name, or - to read\n";
+  std::cout<<"  the rows of a CSV trajectory file from stdin, or PG:\n";
+  std::cout<<"  followed by a connection string and table=<name> to read\n";
+  std::cout<<"  a PostGIS table\n";
+  std::cout<<"--gps_id (optional) <string>: GPS id name (id)\n";
+  std::cout<<"--gps_x (optional) <string>: GPS x name (x)\n";
+  std::cout<<"--gps_y (optional) <string>: GPS y name (y)\n";
+  std::cout<<"--gps_timestamp (optional) <string>: "
+             "GPS timestamp name (timestamp)\n";
+  std::cout<<"--gps_geom (optional) <string>: GPS geometry name (geom)\n";
+  std::cout<<"--gps_read_threads (optional) <int>: threads reading a\n";
+  std::cout<<"  CSV, shapefile or GeoPackage GPS file in blocks (1)\n";
+  std::cout<<"--gps_timestamp_format (optional) <string>: timestamps of\n";
+  std::cout<<"  a CSV file in seconds, ms, us or iso8601 (seconds)\n";
+  std::cout<<"-k/--candidates (optional) <int>: number of candidates (8)\n";
+  std::cout<<"-r/--radius (optional) <double>: search "
+    "radius (network data unit) (300)\n";
+  std::cout<<"-e/--error (optional) <double>: GPS error "
+             "(network data unit) (50)\n";
+  std::cout<<"--factor (optional) <double>: scale factor (1.5)\n";
+  std::cout<<"--vmax (optional) <double>: "
+             " Maximum speed (unit: network_data_unit/s) (80)\n";
+  std::cout<<"  the transitions missing in ubodt are searched within\n";
+  std::cout<<"  factor * vmax * duration if larger than the ubodt delta\n";
+  std::cout<<"--path_cache_rows (optional) <long>: maximum rows of the "
+             "cache of the searches\n";
+  std::cout<<"  shared by the trajectories (10000000)\n";
+  std::cout<<"-o/--output (required) <string>: Output file name,\n";
+  std::cout<<"  compressed with gzip if it ends with .gz, or - to write\n";
+  std::cout<<"  the results to stdout as they are matched\n";
+  std::cout<<"-m/--output_fields (optional) <string>: Output fields\n";
+  std::cout<<"  opath,cpath,tpath,ogeom,mgeom,pgeom,\n";
+  std::cout<<"  offset,error,spdist,tp,ep,length,all\n";
+  std::cout<<"--output_precision (optional) <int>: decimals of the\n";
+  std::cout<<"  coordinates of pgeom and mgeom (12 significant digits)\n";
+  std::cout<<"--output_geometry_encoding (optional) <string>: wkt\n";
+  std::cout<<"  (default), hexwkb, polyline for a Google encoded polyline\n";
+  std::cout<<"  or delta for integer coordinates as differences, with the\n";
+  std::cout<<"  precision as decimals (5), or wkb for the arrow output\n";
+  std::cout<<"--output_format (optional) <string>: csv, arrow for an\n";
+  std::cout<<"  Arrow IPC file if fmm is built with WITH_ARROW, or edges\n";
+  std::cout<<"  for a table of the traversals of the edges (csv), or\n";
+  std::cout<<"  index for a binary index of the trajectories traversing\n";
+  std::cout<<"  each edge, or state for a binary match state read by\n";
+  std::cout<<"  fmm_export\n";
+  std::cout<<"--output_shard_size (optional) <int>: rows written into\n";
+  std::cout<<"  each shard of a csv output listed in a manifest (0)\n";
+  std::cout<<"--output_async: write the csv output by a thread of its\n";
+  std::cout<<"  own while the results are formatted\n";
+  std::cout<<"--log_level (optional) <int>: log level (2)\n";
+  std::cout<<"--step (optional) <int>: progress report step (100)\n";
+  std::cout<<"--chunk_size (optional) <int>: trajectories taken at once\n";
+  std::cout<<"  by a matcher thread, longest first (64)\n";
+  std::cout<<"--memory_budget (optional) <int>: memory of the\n";
+  std::cout<<"  trajectories held in MB, which sets the points of a\n";
+  std::cout<<"  chunk instead of chunk_size (0)\n";
+  std::cout<<"--use_omp: use OpenMP for multithreaded map matching\n";
+  std::cout<<"--ordered_output: with use_omp, write the results in the\n";
+  std::cout<<"  order of the input trajectories\n";
+  std::cout<<"--profile: report the time spent in each stage of the\n";
+  std::cout<<"  matching, with its quantiles per trajectory\n";
+  std::cout<<"--profile_file (optional) <string>: JSON file of the time\n";
+  std::cout<<"  spent in each stage, which enables the profile\n";
+  std::cout<<"--profile_counters: count the instructions, cache, branch\n";
+  std::cout<<"  and TLB misses of each stage with the hardware counters\n";
+  std::cout<<"  of Linux perf_event, which enables the profile\n";
+  std::cout<<"--metrics_file (optional) <string>: Prometheus text file\n";
+  std::cout<<"  of the throughput, queues, UBODT cache, memory and stage\n";
+  std::cout<<"  latencies, rewritten periodically for the textfile\n";
+  std::cout<<"  collector of the node exporter\n";
+  std::cout<<"--metrics_interval (optional) <int>: seconds between two\n";
+  std::cout<<"  writes of the metrics file (15)\n";
+  std::cout<<"-h/--help:print help information\n";
+  std::cout<<"For xml configuration, check example folder\n";
+}
+
+UBODTLayout HybridAppConfig::get_ubodt_layout() const {
+  UBODTLayout layout = CHAINED;
+  UBODT::string2layout(ubodt_layout, &layout);
+  return layout;
+};
+
+bool HybridAppConfig::validate() const {
+  if (log_level<0 || log_level>(int) UTIL::LOG_LEVESLS.size()) {
+    SPDLOG_CRITICAL("Invalid log_level {}, which should be 0 - 6",log_level);
+    SPDLOG_CRITICAL("0-trace,1-debug,2-info,3-warn,4-err,5-critical,6-off");
+    return false;
+  }
+  if (chunk_size <= 0) {
+    SPDLOG_CRITICAL("Invalid chunk size {}, which should be positive",
+                    chunk_size);
+    return false;
+  }
+  if (memory_budget < 0) {
+    SPDLOG_CRITICAL("Invalid memory budget {}, which should be positive "
+                    "or 0",memory_budget);
+    return false;
+  }
+  if (!metrics_file.empty() && metrics_interval <= 0) {
+    SPDLOG_CRITICAL("Invalid metrics interval {}, which should be "
+                    "positive",metrics_interval);
+    return false;
+  }
+  if (!gps_config.validate()) {
+    return false;
+  }
+  if (!result_config.validate()) {
+    return false;
+  }
+  if (!network_config.validate()) {
+    return false;
+  }
+  if (!hybrid_config.validate()) {
+    return false;
+  }
+  UBODTLayout layout;
+  if (!UBODT::string2layout(ubodt_layout, &layout)) {
+    SPDLOG_CRITICAL("Invalid UBODT layout {}", ubodt_layout);
+    SPDLOG_CRITICAL("UBODT layout should be chained, flat, "
+                    "compact, split, csr or lazy");
+    return false;
+  }
+  if (layout == LAZY) {
+    if (ubodt_delta <= 0 || ubodt_cache_rows <= 0) {
+      SPDLOG_CRITICAL("Invalid lazy UBODT delta {} cache rows {}",
+                      ubodt_delta, ubodt_cache_rows);
+      return false;
+    }
+  } else if (ubodt_file.compare(0, UBODT::SHM_PREFIX.size(),
+                                UBODT::SHM_PREFIX) != 0 &&
+             !UTIL::file_exists(ubodt_file)) {
+    SPDLOG_CRITICAL("UBODT file not exists {}", ubodt_file);
+    return false;
+  }
+  if (path_cache_rows <= 0) {
+    SPDLOG_CRITICAL("Path cache rows {} should be positive",
+                    path_cache_rows);
+    return false;
+  }
+  return true;
+};
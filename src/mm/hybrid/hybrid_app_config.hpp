@@ -0,0 +1,105 @@
+/**
+ * Fast map matching.
+ *
+ * Hybrid command line program configuration.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_HYBRID_APP_CONFIG_HPP_
+#define FMM_HYBRID_APP_CONFIG_HPP_
+
+#include "config/gps_config.hpp"
+#include "config/network_config.hpp"
+#include "config/result_config.hpp"
+#include "mm/hybrid/hybrid_algorithm.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Configuration class of hybrid command line program
+ */
+class HybridAppConfig
+{
+ public:
+  /**
+   * Constructor of the configuration from command line arguments.
+   * The argument data are fetched from the main function directly.
+   *
+   * @param argc number of arguments
+   * @param argv raw argument data
+   *
+   */
+  HybridAppConfig(int argc, char **argv);
+  /**
+   * Load configuration from an XML file
+   * @param file xml file name
+   */
+  void load_xml(const std::string &file);
+  /**
+   * Load configuration from arguments. The argument data
+   * are fetched from the main function directly.
+   * @param argc number of arguments
+   * @param argv raw argument data
+   */
+  void load_arg(int argc, char **argv);
+  /**
+   * Print help information
+   */
+  static void print_help();
+  /**
+   * Print configuration data
+   */
+  void print() const;
+  /**
+   * Check the validity of the configuration
+   */
+  bool validate() const;
+  /**
+   * Get the storage layout of UBODT
+   * @return storage layout, chained if the name is invalid
+   */
+  UBODTLayout get_ubodt_layout() const;
+  CONFIG::NetworkConfig network_config; /**< Network data configuraiton */
+  CONFIG::GPSConfig gps_config; /**< GPS data configuraiton */
+  CONFIG::ResultConfig result_config; /**< Result configuraiton */
+  HybridMatchConfig hybrid_config; /**< Map matching configuraiton */
+  std::string ubodt_file; /**< UBODT file name */
+  std::string ubodt_layout = "chained"; /**< UBODT storage layout */
+  double ubodt_delta = 3000; /**< Upperbound of lazy UBODT */
+  long ubodt_cache_rows = UBODT::DEFAULT_CACHE_ROWS; /**< Maximum number of
+                                                     rows cached in lazy
+                                                     UBODT */
+  long path_cache_rows = NETWORK::PathCache::DEFAULT_CACHE_ROWS; /**<
+      Maximum number of records in the cache of the searches of the pairs
+      missing in UBODT */
+  bool use_omp = false; /**< If true, parallel map matching performed */
+  bool ordered_output = false; /**< If true, the results of parallel map
+                                   matching keep the input order */
+  bool profile = false; /**< If true, the time spent in each stage of
+                            the matching is reported */
+  std::string profile_file; /**< JSON file of the time spent in each
+                                 stage, which enables the profile */
+  bool profile_counters = false; /**< If true, the hardware counters of
+                                      each stage are also reported, which
+                                      enables the profile */
+  std::string metrics_file; /**< Prometheus text file of the metrics of
+                                 the job, empty for none */
+  int metrics_interval = 15; /**< Time between two writes of the metrics
+                                 file, in seconds */
+  bool help_specified = false; /**< Help is specified or not */
+  int log_level = 2; /**< log level, 0-trace,1-debug,2-info,
+                          3-warn,4-err,5-critical,6-off */
+  int step = 100; /**< progress report step */
+  int chunk_size = 64; /**< trajectories taken at once by a matcher
+                           thread */
+  int memory_budget = 0; /**< memory of the trajectories held by the
+                              matcher threads in MB, which cuts the
+                              chunks by their points, 0 for none */
+}; // HybridAppConfig
+}
+}
+
+#endif // FMM_HYBRID_APP_CONFIG_HPP_
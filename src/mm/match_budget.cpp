@@ -0,0 +1,44 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the budget of the work spent on a trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/match_budget.hpp"
+
+#include <algorithm>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+
+BudgetMeter::BudgetMeter(const MatchBudget &budget) :
+    budget(budget), start(std::chrono::steady_clock::now()),
+    transitions(0), settled(0) {
+}
+
+bool BudgetMeter::is_exhausted() const {
+  if (budget.max_transitions > 0 &&
+      transitions.load(std::memory_order_relaxed) >=
+          budget.max_transitions) {
+    return true;
+  }
+  if (budget.max_settled > 0 &&
+      settled.load(std::memory_order_relaxed) >= budget.max_settled) {
+    return true;
+  }
+  return budget.max_seconds > 0 &&
+      std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count() >=
+          budget.max_seconds;
+}
+
+LineString FMM::MM::get_prefix(const LineString &geom, int num_points) {
+  LineString prefix;
+  int N = std::min(num_points, geom.get_num_points());
+  for (int i = 0; i < N; ++i) prefix.add_point(geom.get_point(i));
+  return prefix;
+}
@@ -0,0 +1,78 @@
+/**
+ * Fast map matching.
+ *
+ * Budget of the work spent on matching a trajectory, which caps the
+ * latency of the pathological trajectories.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_BUDGET_HPP
+#define FMM_MATCH_BUDGET_HPP
+
+#include "core/geometry.hpp"
+#include "util/util.hpp"
+
+#include <atomic>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Options of the budget of a trajectory, where 0 is unlimited
+ */
+struct MatchBudget {
+  double max_seconds = 0; /**< Maximum seconds spent on the transitions */
+  long max_transitions = 0; /**< Maximum pairs of candidates evaluated */
+  long max_settled = 0; /**< Maximum nodes visited by the searches of
+                             the transitions, used by STMATCH only */
+  /**
+   * Check if any limit is set
+   */
+  inline bool is_enabled() const {
+    return max_seconds > 0 || max_transitions > 0 || max_settled > 0;
+  };
+};
+
+/**
+ * Work spent on a trajectory against its budget. The counters are
+ * atomic, so that a meter is shared by the segments and the layers of a
+ * trajectory matched in parallel. The clock starts at the construction.
+ */
+class BudgetMeter {
+ public:
+  explicit BudgetMeter(const MatchBudget &budget);
+  inline void add_transitions(long n) {
+    transitions.fetch_add(n, std::memory_order_relaxed);
+  };
+  inline void add_settled(long n) {
+    settled.fetch_add(n, std::memory_order_relaxed);
+  };
+  inline bool is_enabled() const {
+    return budget.is_enabled();
+  };
+  /**
+   * Check if any limit of the budget is reached
+   */
+  bool is_exhausted() const;
+ private:
+  MatchBudget budget;
+  UTIL::TimePoint start;
+  std::atomic<long> transitions;
+  std::atomic<long> settled;
+};
+
+/**
+ * Get the first points of a line, which is the part of a trajectory
+ * matched by a partial result
+ * @param  geom       line
+ * @param  num_points number of points kept
+ * @return the prefix of the line
+ */
+CORE::LineString get_prefix(const CORE::LineString &geom, int num_points);
+
+} // MM
+} // FMM
+
+#endif // FMM_MATCH_BUDGET_HPP
@@ -0,0 +1,73 @@
+/**
+ * Fast map matching.
+ *
+ * Buffers reused by the matching of the trajectories of a thread
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_MATCH_WORKSPACE_HPP
+#define FMM_MATCH_WORKSPACE_HPP
+
+#include "core/gps.hpp"
+#include "network/candidate_search.hpp"
+#include "mm/transition_graph.hpp"
+#include "mm/composite_graph.hpp"
+#include "mm/transition_memo.hpp"
+#include "util/tile_profile.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Workspace of the matching of a trajectory, owning the candidates, the
+ * transition graph and the buffers of the intermediate results. The
+ * buffers are cleared but keep their capacity between the trajectories,
+ * so that a thread matching trajectories of similar sizes allocates only
+ * the vectors of the results returned.
+ *
+ * A workspace is used by one trajectory at a time. The results refer to
+ * none of its buffers, so that it is reused as soon as a match returns.
+ */
+struct MatchWorkspace {
+  MatchWorkspace() = default;
+  MatchWorkspace(const MatchWorkspace &) = delete;
+  MatchWorkspace &operator=(const MatchWorkspace &) = delete;
+  NETWORK::CandidateSearchContext context; /**< Candidates of the points */
+  TransitionGraph tg; /**< Transition graph of the candidates */
+  DummyGraph dg; /**< Dummy graph of the candidates, used by STMATCH */
+  CORE::Trajectory projected; /**< Trajectory in the local projection of
+                                   the network */
+  std::vector<double> eu_dists; /**< Euclidean distances between the
+                                     consecutive points */
+  std::vector<double> deltas; /**< Upper bounds of the searches of the
+                                   transitions, used by STMATCH */
+  TGOpath tg_opath; /**< Optimal path of the transition graph */
+  std::vector<NETWORK::EdgeIndex> index_path; /**< Edge indices of the
+                                                   complete path */
+  CORE::Trajectory coarse{0, CORE::LineString(), {}}; /**< Points of the
+                                                          coarse pass */
+  std::vector<NETWORK::EdgeIndex> corridor; /**< Edges around the path of
+                                                 the coarse pass, sorted */
+  TransitionMemo transitions; /**< Distances of the od pairs probed in the
+                                   trajectory, used by FMM */
+  std::vector<UTIL::TileCounters> tiles; /**< Counters of the points,
+                                             kept if the tile profile is
+                                             enabled */
+  /**
+   * Get the workspace of the calling thread
+   * @return a workspace owned by the thread
+   */
+  static MatchWorkspace &local() {
+    static thread_local MatchWorkspace workspace;
+    return workspace;
+  };
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_MATCH_WORKSPACE_HPP
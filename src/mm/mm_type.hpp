@@ -34,6 +34,29 @@ struct Candidate
   FMM::CORE::Point point; /**< boost point */
 };
 
+/**
+ * Compact copy of the fields of a candidate read by the transitions of
+ * Viterbi, holding 32-bit indices instead of a pointer to the edge. The
+ * candidates of a layer are gathered into an array of them, so that the
+ * pairs of two layers are compared without reading the edges.
+ */
+struct CompactCandidate
+{
+  NETWORK::EdgeIndex edge; /**< index of the candidate edge */
+  NETWORK::NodeIndex source; /**< source node of the edge */
+  NETWORK::NodeIndex target; /**< target node of the edge */
+  unsigned int padding;
+  double offset; /**< offset distance from the start of the edge */
+  double length; /**< length of the edge */
+  /**
+   * Copy the fields of a candidate
+   */
+  static inline CompactCandidate from(const Candidate &c) {
+    return CompactCandidate{c.edge->index, c.edge->source, c.edge->target, 0,
+                            c.offset, c.edge->length};
+  };
+};
+
 typedef std::vector<Candidate> Point_Candidates; /**< Point candidates */
 typedef std::vector<Point_Candidates> Traj_Candidates;
 /**< trajectory  candidates */
@@ -79,6 +102,34 @@ struct MatchResult {
                      trajectory.  */
   std::vector<int> indices; /**< index of opath edge in cpath */
   CORE::LineString mgeom; /**< the geometry of the matched path */
+  bool partial; /**< if true, the budget of the trajectory ran out and
+                     only its first points are matched */
+  std::vector<double> timestamps; /**< timestamps of the points, only
+                                       copied for the writers using them */
+};
+
+/**
+ * Fields of a match result built by a matching algorithm, so that the
+ * fields which are not written are not computed. The cpath and indices
+ * are always built, as the breaks of a trajectory and the points matched
+ * are found from them.
+ */
+struct ResultFields {
+  bool candidates = true; /**< if false, opt_candidate_path and opath are
+                               left empty */
+  bool mgeom = true; /**< if false, mgeom is left empty */
+  bool timestamps = false; /**< if true, the timestamps of the points are
+                                copied into the result */
+};
+
+/**
+ * Map matched result of a segment of a trajectory, whose point indices
+ * are counted from the first point of the segment
+ */
+struct SegmentMatchResult {
+  int first; /**< index of the first point of the segment */
+  int last; /**< index of the last point of the segment, included */
+  MatchResult result; /**< map matched result of the segment */
 };
 
 };
@@ -0,0 +1,243 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the sweep of the parameters of a matching algorithm
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/parameter_sweep.hpp"
+#include "mm/transition_kernel.hpp"
+#include "util/debug.hpp"
+#include "util/util.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::MM;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// Parse the values of a parameter, which are all positive
+template <typename T>
+bool parse_values(const std::string &name, const std::string &text,
+                  std::vector<T> *values) {
+  *values = UTIL::string2vec<T>(text);
+  std::size_t expected = std::count(text.begin(), text.end(), ',') + 1;
+  if (values->size() != expected ||
+      std::any_of(values->begin(), values->end(),
+                  [](T value) { return !(value > 0); })) {
+    SPDLOG_CRITICAL("Invalid values {} of sweep parameter {}", text, name);
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+std::vector<SweepSetting> ParameterSweep::get_settings(
+    const SweepSetting &base) const {
+  std::vector<int> ks = k.empty() ? std::vector<int>{base.k} : k;
+  std::vector<double> radiuses =
+      radius.empty() ? std::vector<double>{base.radius} : radius;
+  std::vector<double> errors =
+      gps_error.empty() ? std::vector<double>{base.gps_error} : gps_error;
+  std::vector<double> speeds =
+      vmax.empty() ? std::vector<double>{base.vmax} : vmax;
+  std::vector<double> factors =
+      factor.empty() ? std::vector<double>{base.factor} : factor;
+  std::vector<SweepSetting> settings;
+  for (int k_value : ks) {
+    for (double radius_value : radiuses) {
+      for (double error : errors) {
+        for (double speed : speeds) {
+          for (double factor_value : factors) {
+            settings.push_back(SweepSetting{
+                k_value, radius_value, error, speed, factor_value});
+          }
+        }
+      }
+    }
+  }
+  return settings;
+}
+
+bool ParameterSweep::parse(const std::string &text, ParameterSweep *sweep) {
+  *sweep = ParameterSweep();
+  std::stringstream ss(text);
+  std::string item;
+  while (std::getline(ss, item, ';')) {
+    if (item.empty()) continue;
+    std::size_t equal = item.find('=');
+    if (equal == std::string::npos) {
+      SPDLOG_CRITICAL("Sweep parameter {} has no values", item);
+      return false;
+    }
+    std::string name = item.substr(0, equal);
+    std::string values = item.substr(equal + 1);
+    bool valid;
+    if (name == "k") {
+      valid = parse_values(name, values, &sweep->k);
+    } else if (name == "radius") {
+      valid = parse_values(name, values, &sweep->radius);
+    } else if (name == "gps_error") {
+      valid = parse_values(name, values, &sweep->gps_error);
+    } else if (name == "vmax") {
+      valid = parse_values(name, values, &sweep->vmax);
+    } else if (name == "factor") {
+      valid = parse_values(name, values, &sweep->factor);
+    } else {
+      SPDLOG_CRITICAL("Unknown sweep parameter {}", name);
+      return false;
+    }
+    if (!valid) return false;
+  }
+  return true;
+}
+
+SweepReport::SweepReport(const std::vector<SweepSetting> &settings) :
+    settings_(settings), statistics_(settings.size()) {}
+
+void SweepReport::add(int setting, const MatchResult &result,
+                      int num_points, double seconds) {
+  SweepStatistics &statistics = statistics_[setting];
+  ++statistics.trajectories;
+  statistics.points += num_points;
+  statistics.seconds += seconds;
+  if (!result.cpath.empty()) {
+    ++statistics.matched;
+    statistics.points_matched += num_points;
+    statistics.cpath_edges += result.cpath.size();
+  }
+}
+
+void SweepReport::merge(const SweepReport &other) {
+  for (std::size_t i = 0; i < statistics_.size(); ++i) {
+    const SweepStatistics &o = other.statistics_[i];
+    SweepStatistics &s = statistics_[i];
+    s.trajectories += o.trajectories;
+    s.matched += o.matched;
+    s.points += o.points;
+    s.points_matched += o.points_matched;
+    s.cpath_edges += o.cpath_edges;
+    s.seconds += o.seconds;
+  }
+  shared_seconds_ += other.shared_seconds_;
+}
+
+void SweepReport::print() const {
+  SPDLOG_INFO("Sweep of {} settings, search and routing shared time {}",
+              settings_.size(), shared_seconds_);
+  for (std::size_t i = 0; i < settings_.size(); ++i) {
+    const SweepSetting &p = settings_[i];
+    const SweepStatistics &s = statistics_[i];
+    SPDLOG_INFO("Setting {} k {} radius {} gps_error {} vmax {} factor {} "
+                "matched {}/{} points {}/{} time {}", i, p.k, p.radius,
+                p.gps_error, p.vmax, p.factor, s.matched, s.trajectories,
+                s.points_matched, s.points, s.seconds);
+  }
+}
+
+bool SweepReport::write_csv(const std::string &filename) const {
+  std::ofstream ofs(filename);
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write sweep report {}", filename);
+    return false;
+  }
+  ofs << std::setprecision(12);
+  ofs << "setting;k;radius;gps_error;vmax;factor;trajectories;matched;"
+         "points;points_matched;cpath_edges;seconds;shared_seconds\n";
+  for (std::size_t i = 0; i < settings_.size(); ++i) {
+    const SweepSetting &p = settings_[i];
+    const SweepStatistics &s = statistics_[i];
+    ofs << i << ";" << p.k << ";" << p.radius << ";" << p.gps_error << ";"
+        << p.vmax << ";" << p.factor << ";" << s.trajectories << ";"
+        << s.matched << ";" << s.points << ";" << s.points_matched << ";"
+        << s.cpath_edges << ";" << s.seconds << ";" << shared_seconds_
+        << "\n";
+  }
+  SPDLOG_INFO("Write sweep report to {}", filename);
+  return true;
+}
+
+void SweepDistances::reset(const CandidateSearchContext &context) {
+  context_ = &context;
+  std::size_t num_points = context.get_num_points();
+  offsets_.assign(1, 0);
+  for (std::size_t i = 0; i + 1 < num_points; ++i) {
+    offsets_.push_back(offsets_.back() +
+                       context.get_point_candidates(i).size() *
+                       context.get_point_candidates(i + 1).size());
+  }
+  distances_.assign(offsets_.back(),
+                    std::numeric_limits<double>::infinity());
+}
+
+void SweepDistances::find_positions(const TGLayer &layer, std::size_t point,
+                                    std::vector<int> *positions) const {
+  // A point has a single candidate per edge
+  CandidateSpan full = context_->get_point_candidates(point);
+  positions->resize(layer.size());
+  for (std::size_t j = 0; j < layer.size(); ++j) {
+    const Candidate *c = std::find_if(
+        full.begin(), full.end(), [&layer, j](const Candidate &a) {
+          return a.edge == layer[j].c->edge;
+        });
+    (*positions)[j] = c - full.begin();
+  }
+}
+
+void SweepDistances::relax(TransitionGraph *tg,
+                           const std::vector<double> &eu_dists,
+                           const std::vector<double> *deltas,
+                           const ViterbiBeam &beam, bool last_tie) {
+  std::vector<TGLayer> &layers = tg->get_layers();
+  int N = layers.size();
+  if (beam.is_enabled()) tg->reset_log_space();
+  static thread_local std::vector<int> positions_a;
+  static thread_local std::vector<int> positions_b;
+  static thread_local std::vector<TGNode *> expanded;
+  static thread_local std::vector<double> sp_dists;
+  const double inf = std::numeric_limits<double>::infinity();
+  if (N > 0) find_positions(layers[0], 0, &positions_a);
+  for (int i = 0; i < N - 1; ++i) {
+    if (beam.is_enabled()) tg->prune_layer(&(layers[i]), beam);
+    TGLayer &la = layers[i];
+    TGLayer &lb = layers[i + 1];
+    find_positions(lb, i + 1, &positions_b);
+    std::size_t m = context_->get_point_candidates(i + 1).size();
+    const double *full = get_layer(i);
+    double delta = deltas != nullptr ? (*deltas)[i] : inf;
+    expanded.clear();
+    sp_dists.clear();
+    for (std::size_t a = 0; a < la.size(); ++a) {
+      if (TransitionGraph::is_pruned(la[a])) continue;
+      expanded.push_back(&la[a]);
+      const double *row = full + positions_a[a] * m;
+      for (int b : positions_b) {
+        sp_dists.push_back(row[b] > delta ? inf : row[b]);
+      }
+    }
+    relax_layer(expanded.data(), expanded.size(), lb, sp_dists.data(),
+                nullptr, eu_dists[i], tg->is_log_space(), last_tie);
+    positions_a.swap(positions_b);
+  }
+}
+
+std::string MM::get_sweep_result_file(const std::string &filename,
+                                      int setting) {
+  std::size_t dot = filename.find_last_of('.');
+  std::size_t slash = filename.find_last_of('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return filename + "_" + std::to_string(setting);
+  }
+  return filename.substr(0, dot) + "_" + std::to_string(setting) +
+      filename.substr(dot);
+}
@@ -0,0 +1,209 @@
+/**
+ * Fast map matching.
+ *
+ * Sweep of the parameters of a matching algorithm, which matches each
+ * trajectory with several settings. The candidates and the distances of
+ * the transitions are computed once for the largest setting, and only
+ * the filtering of the candidates and Viterbi are run per setting.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_PARAMETER_SWEEP_HPP
+#define FMM_PARAMETER_SWEEP_HPP
+
+#include "mm/mm_type.hpp"
+#include "mm/transition_graph.hpp"
+#include "network/candidate_search.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Values of the parameters of a setting of a sweep
+ */
+struct SweepSetting {
+  int k; /**< number of candidates */
+  double radius; /**< search radius */
+  double gps_error; /**< GPS error */
+  double vmax; /**< maximum speed, only used by STMATCH */
+  double factor; /**< factor of the bound of the searches, only used by
+                      STMATCH */
+};
+
+/**
+ * Values swept of each parameter, whose settings are all their
+ * combinations. A parameter without values keeps the one configured.
+ */
+struct ParameterSweep {
+  std::vector<int> k; /**< numbers of candidates */
+  std::vector<double> radius; /**< search radiuses */
+  std::vector<double> gps_error; /**< GPS errors */
+  std::vector<double> vmax; /**< maximum speeds */
+  std::vector<double> factor; /**< factors of the bound of the searches */
+  /**
+   * Check if any parameter is swept
+   */
+  inline bool is_enabled() const {
+    return !k.empty() || !radius.empty() || !gps_error.empty() ||
+        !vmax.empty() || !factor.empty();
+  };
+  /**
+   * Get the settings of the sweep, with k varying the slowest
+   * @param  base values of the parameters not swept
+   * @return the combinations of the values
+   */
+  std::vector<SweepSetting> get_settings(const SweepSetting &base) const;
+  /**
+   * Parse the values swept from a string such as
+   * "k=4,8;radius=100,300;gps_error=20,50", where the parameters are k,
+   * radius, gps_error, vmax and factor
+   * @param  text  values of the parameters separated by ;
+   * @param  sweep updated with the values
+   * @return false if a parameter is unknown or has no valid value
+   */
+  static bool parse(const std::string &text, ParameterSweep *sweep);
+};
+
+/**
+ * Statistics of the trajectories matched with a setting
+ */
+struct SweepStatistics {
+  long trajectories = 0; /**< Trajectories matched */
+  long matched = 0; /**< Trajectories with a complete path */
+  long points = 0; /**< Points of the trajectories */
+  long points_matched = 0; /**< Points of the trajectories matched */
+  long cpath_edges = 0; /**< Edges of the complete paths */
+  double seconds = 0; /**< Time of the filtering, Viterbi and the result
+                           of the setting */
+};
+
+/**
+ * Report of a sweep, with the statistics of each setting and the time
+ * shared by the settings. A report is updated by a single thread, and
+ * the reports of several threads are merged.
+ */
+class SweepReport {
+ public:
+  /**
+   * Create an empty report
+   * @param settings settings of the sweep
+   */
+  explicit SweepReport(const std::vector<SweepSetting> &settings);
+  /**
+   * Add the result of a trajectory matched with a setting
+   * @param setting    index of the setting
+   * @param result     result of the trajectory
+   * @param num_points number of points of the trajectory
+   * @param seconds    time of the setting for the trajectory
+   */
+  void add(int setting, const MatchResult &result, int num_points,
+           double seconds);
+  /**
+   * Add the time of the search and the routing shared by the settings
+   */
+  inline void add_shared(double seconds) {
+    shared_seconds_ += seconds;
+  };
+  /**
+   * Add the statistics of another report of the same settings
+   */
+  void merge(const SweepReport &other);
+  /**
+   * Get the settings of the sweep
+   */
+  inline const std::vector<SweepSetting> &get_settings() const {
+    return settings_;
+  };
+  /**
+   * Get the statistics of a setting
+   */
+  inline const SweepStatistics &get_statistics(int setting) const {
+    return statistics_[setting];
+  };
+  /**
+   * Get the time shared by the settings
+   */
+  inline double get_shared_seconds() const {
+    return shared_seconds_;
+  };
+  /**
+   * Log the statistics of the settings
+   */
+  void print() const;
+  /**
+   * Write the statistics of the settings into a CSV file separated by ;
+   * @param  filename output file
+   * @return false if the file cannot be written
+   */
+  bool write_csv(const std::string &filename) const;
+ private:
+  std::vector<SweepSetting> settings_;
+  std::vector<SweepStatistics> statistics_;
+  double shared_seconds_ = 0;
+}; // SweepReport
+
+/**
+ * Distances of the transitions between the candidates of the largest
+ * setting of a sweep, from which the transitions of each setting are
+ * relaxed without routing again
+ */
+class SweepDistances {
+ public:
+  /**
+   * Allocate the distances of the candidates of a context
+   * @param context candidates of the largest setting, which is kept
+   * until the distances are no longer used
+   */
+  void reset(const NETWORK::CandidateSearchContext &context);
+  /**
+   * Get the distances between the candidates of point i and point i+1,
+   * with candidate a of point i and b of point i+1 at a * m + b where m
+   * is the number of candidates of point i+1
+   */
+  inline double *get_layer(int i) {
+    return distances_.data() + offsets_[i];
+  };
+  /**
+   * Update the probabilities of a transition graph of a setting, whose
+   * candidates are among the ones of the largest setting
+   * @param tg       transition graph of the setting
+   * @param eu_dists Euclidean distances between consecutive points
+   * @param deltas   if not nullptr, bound of the distances between
+   * consecutive points, above which a transition is not reached
+   * @param beam     options of the beam search Viterbi
+   * @param last_tie a node takes the last predecessor tied, as FMM does,
+   * instead of the first
+   */
+  void relax(TransitionGraph *tg, const std::vector<double> &eu_dists,
+             const std::vector<double> *deltas, const ViterbiBeam &beam,
+             bool last_tie);
+ private:
+  /**
+   * Find the position of the candidate of each node of a layer among the
+   * candidates of its point in the largest setting
+   */
+  void find_positions(const TGLayer &layer, std::size_t point,
+                      std::vector<int> *positions) const;
+  const NETWORK::CandidateSearchContext *context_ = nullptr;
+  std::vector<std::size_t> offsets_;
+  std::vector<double> distances_;
+}; // SweepDistances
+
+/**
+ * Get the result file of a setting, with the index of the setting
+ * inserted before the extension of the result file of the sweep
+ * @param  filename result file of the sweep
+ * @param  setting  index of the setting
+ * @return result file of the setting
+ */
+std::string get_sweep_result_file(const std::string &filename, int setting);
+
+} // MM
+} // FMM
+
+#endif // FMM_PARAMETER_SWEEP_HPP
@@ -0,0 +1,102 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the prefilter of the points of a trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/point_filter.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+
+FilteredTrajectory FMM::MM::filter_points(const Trajectory &traj,
+                                          const PointFilter &filter) {
+  FilteredTrajectory filtered;
+  filtered.traj.id = traj.id;
+  int N = traj.geom.get_num_points();
+  bool has_time = (int) traj.timestamps.size() == N;
+  // Collapse the stationary clusters, where cluster[i] is the cluster of
+  // point i
+  std::vector<Point> centers;
+  std::vector<int> firsts;
+  std::vector<int> cluster(N);
+  int i = 0;
+  while (i < N) {
+    const Point &first = traj.geom.at(i);
+    double sx = traj.geom.get_x(i);
+    double sy = traj.geom.get_y(i);
+    int j = i + 1;
+    while (filter.stationary_radius > 0 && j < N &&
+           boost::geometry::distance(first, traj.geom.at(j)) <=
+               filter.stationary_radius) {
+      sx += traj.geom.get_x(j);
+      sy += traj.geom.get_y(j);
+      ++j;
+    }
+    for (int k = i; k < j; ++k) cluster[k] = centers.size();
+    centers.push_back(Point(sx / (j - i), sy / (j - i)));
+    firsts.push_back(i);
+    i = j;
+  }
+  // Drop the clusters too close to the last one kept, where kept[c] is
+  // the point kept for cluster c
+  int M = centers.size();
+  std::vector<int> kept(M);
+  for (int c = 0; c < M; ++c) {
+    bool keep = c == 0;
+    if (!keep) {
+      int last = filtered.points.size() - 1;
+      keep = boost::geometry::distance(
+          filtered.traj.geom.at(last), centers[c]) >= filter.min_distance;
+      if (has_time) {
+        keep = keep && traj.timestamps[firsts[c]] -
+            filtered.traj.timestamps[last] >= filter.min_interval;
+      }
+    }
+    if (keep) {
+      filtered.traj.geom.add_point(centers[c]);
+      if (has_time) {
+        filtered.traj.timestamps.push_back(traj.timestamps[firsts[c]]);
+      }
+      filtered.points.push_back(firsts[c]);
+    }
+    kept[c] = filtered.points.size() - 1;
+  }
+  filtered.mapping.resize(N);
+  for (int k = 0; k < N; ++k) filtered.mapping[k] = kept[cluster[k]];
+  return filtered;
+}
+
+MatchResult FMM::MM::expand_result(const MatchResult &result,
+                                   const FilteredTrajectory &filtered) {
+  // An unmatched result has no candidate per point, and a partial one
+  // has the candidates of the first points only
+  int M = result.opt_candidate_path.size();
+  if (M == 0 || (!result.partial && M != (int) filtered.points.size())) {
+    return result;
+  }
+  MatchResult expanded{result.id, {}, {}, result.cpath, {}, result.mgeom,
+                       result.partial};
+  int N = filtered.mapping.size();
+  for (int k = 0; k < N; ++k) {
+    int j = filtered.mapping[k];
+    // The points are mapped in order
+    if (j >= M) break;
+    MatchedCandidate mc = result.opt_candidate_path[j];
+    if (k != filtered.points[j]) {
+      // The point stays on the candidate of the point kept
+      mc.tp = 1;
+      mc.sp_dist = 0;
+    }
+    expanded.opt_candidate_path.push_back(mc);
+    expanded.opath.push_back(result.opath[j]);
+    if (!result.indices.empty()) {
+      expanded.indices.push_back(result.indices[j]);
+    }
+  }
+  return expanded;
+}
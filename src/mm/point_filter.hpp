@@ -0,0 +1,82 @@
+/**
+ * Fast map matching.
+ *
+ * Prefilter of the points of a trajectory, which drops the near
+ * duplicate points before matching and maps the result back to all the
+ * points.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_POINT_FILTER_HPP
+#define FMM_POINT_FILTER_HPP
+
+#include "mm/mm_type.hpp"
+#include "core/gps.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Options of the prefilter of the points of a trajectory
+ */
+struct PointFilter {
+  double stationary_radius = 0; /**< Radius of the clusters of consecutive
+                                     points collapsed into their centroid,
+                                     0 for none */
+  double min_distance = 0; /**< Minimum distance of a point to the last
+                                point kept, 0 for all */
+  double min_interval = 0; /**< Minimum time from the last point kept,
+                                0 for all */
+  /**
+   * Check if any point can be dropped
+   */
+  inline bool is_enabled() const {
+    return stationary_radius > 0 || min_distance > 0 || min_interval > 0;
+  };
+};
+
+/**
+ * A trajectory whose points are filtered
+ */
+struct FilteredTrajectory {
+  CORE::Trajectory traj; /**< Trajectory of the points kept */
+  std::vector<int> points; /**< Original index of each point kept, which
+                                is the first point of its cluster */
+  std::vector<int> mapping; /**< Point kept for each original point */
+};
+
+/**
+ * Filter the points of a trajectory.
+ *
+ * The stationary clusters, where the consecutive points are within the
+ * radius of the first one, are collapsed into their centroid first. A
+ * point is then dropped if it is closer than the minimum distance or the
+ * minimum interval to the last point kept. The first point is always
+ * kept, and a dropped point is mapped to the last point kept before it.
+ *
+ * @param  traj   trajectory
+ * @param  filter filter options
+ * @return the filtered trajectory
+ */
+FilteredTrajectory filter_points(const CORE::Trajectory &traj,
+                                 const PointFilter &filter);
+
+/**
+ * Map the result of a filtered trajectory back to its original points,
+ * where a point dropped gets the candidate of the point it is mapped to
+ * without transition from it. A partial result is expanded to the
+ * points mapped to its candidates.
+ *
+ * @param  result   map matching result of the filtered trajectory
+ * @param  filtered the filtered trajectory
+ * @return the result of the original trajectory
+ */
+MatchResult expand_result(const MatchResult &result,
+                          const FilteredTrajectory &filtered);
+
+} // MM
+} // FMM
+
+#endif // FMM_POINT_FILTER_HPP
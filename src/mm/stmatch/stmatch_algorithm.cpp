@@ -1,9 +1,17 @@
 #include "mm/stmatch/stmatch_algorithm.hpp"
+#include "mm/transition_kernel.hpp"
 #include "algorithm/geom_algorithm.hpp"
+#include "network/landmarks.hpp"
 #include "util/debug.hpp"
 #include "util/util.hpp"
+#include "util/stage_profile.hpp"
+#include "util/tile_profile.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <omp.h>
+#include <unordered_map>
 
 using namespace FMM;
 using namespace FMM::CORE;
@@ -11,6 +19,54 @@ using namespace FMM::NETWORK;
 using namespace FMM::MM;
 using namespace FMM::PYTHON;
 
+namespace {
+
+// Bound of the search from a candidate of layer a, lowered to its
+// Euclidean distance to the farthest candidate of layer b multiplied by
+// the factor
+double calc_source_delta(const Candidate *a, const TGLayer &lb,
+                         double delta, double source_factor) {
+  if (source_factor <= 0) return delta;
+  double farthest = 0;
+  for (const TGNode &b : lb) {
+    farthest = std::max(farthest,
+                        boost::geometry::distance(a->point, b.c->point));
+  }
+  return std::min(delta, farthest * source_factor);
+}
+
+// Lower bound of the distance from a point to the nearest target
+double calc_goal_lower_bound(const Point &p,
+                             const std::vector<Point> &points) {
+  if (points.empty()) return 0;
+  double bound = std::numeric_limits<double>::max();
+  for (const Point &q : points) {
+    bound = std::min(bound, boost::geometry::distance(p, q));
+  }
+  return bound * (1 - 1e-9);
+}
+
+// Distance from a candidate to another one known without routing, when
+// they are on the same edge or on adjacent edges, negative otherwise
+double calc_known_distance(const Candidate *a, const Candidate *b) {
+  if (a->edge == b->edge && a->offset <= b->offset) {
+    return b->offset - a->offset;
+  }
+  if (a->edge->target == b->edge->source) {
+    return a->edge->length - a->offset + b->offset;
+  }
+  return -1;
+}
+
+// Score of a transition to a node of layer b, as relaxed by relax_layer
+double calc_score(const TGNode &a, const TGNode &b, double tp,
+                  bool log_space) {
+  return log_space ? a.cumu_prob + std::log(tp) + std::log(b.ep) :
+         a.cumu_prob + tp * b.ep;
+}
+
+} // namespace
+
 STMATCHConfig::STMATCHConfig(
     int k_arg, double r_arg, double gps_error_arg,
     double vmax_arg, double factor_arg) :
@@ -22,6 +78,19 @@ void STMATCHConfig::print() const {
   SPDLOG_INFO("STMATCHAlgorithmConfig");
   SPDLOG_INFO("k {} radius {} gps_error {} vmax {} factor {}",
               k, radius, gps_error, vmax, factor);
+  SPDLOG_INFO("min_ep_ratio {} max_dist_ratio {} adaptive_k_spacing {}",
+              min_ep_ratio, max_dist_ratio, adaptive_k_spacing);
+  SPDLOG_INFO("max_heading_diff {} min_heading_distance {}",
+              max_heading_diff, min_heading_distance);
+  SPDLOG_INFO("beam_size {} beam_margin {}", beam_size, beam_margin);
+  SPDLOG_INFO("split {} max_time_gap {}", split, max_time_gap);
+  SPDLOG_INFO("parallel_viterbi {}", parallel_viterbi);
+  SPDLOG_INFO("stationary_radius {} min_distance {} min_interval {}",
+              stationary_radius, min_distance, min_interval);
+  SPDLOG_INFO("approximate_ep {} goal_directed {}", approximate_ep,
+              goal_directed);
+  SPDLOG_INFO("max_seconds {} max_transitions {} max_settled {}",
+              max_seconds, max_transitions, max_settled);
 };
 
 STMATCHConfig STMATCHConfig::load_from_xml(
@@ -31,7 +100,36 @@ STMATCHConfig STMATCHConfig::load_from_xml(
   double gps_error = xml_data.get("config.parameters.gps_error", 50.0);
   double vmax = xml_data.get("config.parameters.vmax", 80.0);;
   double factor = xml_data.get("config.parameters.factor", 1.5);;
-  return STMATCHConfig{k, radius, gps_error, vmax, factor};
+  STMATCHConfig config{k, radius, gps_error, vmax, factor};
+  config.min_ep_ratio = xml_data.get("config.parameters.min_ep_ratio", 0.0);
+  config.max_dist_ratio =
+      xml_data.get("config.parameters.max_dist_ratio", 0.0);
+  config.adaptive_k_spacing =
+      xml_data.get("config.parameters.adaptive_k_spacing", 0.0);
+  config.max_heading_diff =
+      xml_data.get("config.parameters.max_heading_diff", 0.0);
+  config.min_heading_distance =
+      xml_data.get("config.parameters.min_heading_distance", 0.0);
+  config.beam_size = xml_data.get("config.parameters.beam_size", 0);
+  config.beam_margin = xml_data.get("config.parameters.beam_margin", 0.0);
+  config.split = !(!xml_data.get_child_optional("config.parameters.split"));
+  config.max_time_gap =
+      xml_data.get("config.parameters.max_time_gap", 0.0);
+  config.parallel_viterbi =
+      xml_data.get("config.parameters.parallel_viterbi", 0);
+  config.stationary_radius =
+      xml_data.get("config.parameters.stationary_radius", 0.0);
+  config.min_distance = xml_data.get("config.parameters.min_distance", 0.0);
+  config.min_interval = xml_data.get("config.parameters.min_interval", 0.0);
+  config.approximate_ep =
+      !(!xml_data.get_child_optional("config.parameters.approximate_ep"));
+  config.goal_directed =
+      !(!xml_data.get_child_optional("config.parameters.goal_directed"));
+  config.max_seconds = xml_data.get("config.parameters.max_seconds", 0.0);
+  config.max_transitions =
+      xml_data.get("config.parameters.max_transitions", 0L);
+  config.max_settled = xml_data.get("config.parameters.max_settled", 0L);
+  return config;
 };
 
 STMATCHConfig STMATCHConfig::load_from_arg(
@@ -41,15 +139,117 @@ STMATCHConfig STMATCHConfig::load_from_arg(
   double gps_error = arg_data["error"].as<double>();
   double vmax = arg_data["vmax"].as<double>();
   double factor = arg_data["factor"].as<double>();
-  return STMATCHConfig{k, radius, gps_error, vmax, factor};
+  STMATCHConfig config{k, radius, gps_error, vmax, factor};
+  config.min_ep_ratio = arg_data["min_ep_ratio"].as<double>();
+  config.max_dist_ratio = arg_data["max_dist_ratio"].as<double>();
+  config.adaptive_k_spacing = arg_data["adaptive_k_spacing"].as<double>();
+  config.max_heading_diff = arg_data["max_heading_diff"].as<double>();
+  config.min_heading_distance =
+      arg_data["min_heading_distance"].as<double>();
+  config.beam_size = arg_data["beam_size"].as<int>();
+  config.beam_margin = arg_data["beam_margin"].as<double>();
+  config.split = arg_data.count("split") > 0;
+  config.max_time_gap = arg_data["max_time_gap"].as<double>();
+  config.parallel_viterbi = arg_data["parallel_viterbi"].as<int>();
+  config.stationary_radius = arg_data["stationary_radius"].as<double>();
+  config.min_distance = arg_data["min_distance"].as<double>();
+  config.min_interval = arg_data["min_interval"].as<double>();
+  config.approximate_ep = arg_data.count("approximate_ep") > 0;
+  config.goal_directed = arg_data.count("goal_directed") > 0;
+  config.max_seconds = arg_data["max_seconds"].as<double>();
+  config.max_transitions = arg_data["max_transitions"].as<long>();
+  config.max_settled = arg_data["max_settled"].as<long>();
+  return config;
 };
 
+NETWORK::CandidatePruning STMATCHConfig::get_candidate_pruning() const {
+  NETWORK::CandidatePruning pruning;
+  pruning.gps_error = gps_error;
+  pruning.min_ep_ratio = min_ep_ratio;
+  pruning.max_dist_ratio = max_dist_ratio;
+  pruning.adaptive_k_spacing = adaptive_k_spacing;
+  pruning.max_heading_diff = max_heading_diff;
+  pruning.min_heading_distance = min_heading_distance;
+  return pruning;
+}
+
+ViterbiBeam STMATCHConfig::get_viterbi_beam() const {
+  ViterbiBeam beam;
+  beam.beam_size = beam_size;
+  beam.beam_margin = beam_margin;
+  return beam;
+}
+
+TrajectorySplit STMATCHConfig::get_trajectory_split() const {
+  TrajectorySplit options;
+  options.enabled = split;
+  options.max_time_gap = max_time_gap;
+  return options;
+}
+
+PointFilter STMATCHConfig::get_point_filter() const {
+  PointFilter filter;
+  filter.stationary_radius = stationary_radius;
+  filter.min_distance = min_distance;
+  filter.min_interval = min_interval;
+  return filter;
+}
+
+MatchBudget STMATCHConfig::get_match_budget() const {
+  MatchBudget budget;
+  budget.max_seconds = max_seconds;
+  budget.max_transitions = max_transitions;
+  budget.max_settled = max_settled;
+  return budget;
+}
+
 bool STMATCHConfig::validate() const {
   if (gps_error <= 0 || radius <= 0 || k <= 0 || vmax <= 0 || factor <= 0) {
     SPDLOG_CRITICAL("Invalid mm parameter k {} r {} gps error {} vmax {} f {}",
                     k, radius, gps_error, vmax, factor);
     return false;
   }
+  if (min_ep_ratio < 0 || min_ep_ratio > 1 ||
+      (max_dist_ratio != 0 && max_dist_ratio < 1) ||
+      adaptive_k_spacing < 0) {
+    SPDLOG_CRITICAL("Invalid pruning parameter min_ep_ratio {} "
+                    "max_dist_ratio {} adaptive_k_spacing {}",
+                    min_ep_ratio, max_dist_ratio, adaptive_k_spacing);
+    return false;
+  }
+  if (max_heading_diff < 0 || max_heading_diff > 180 ||
+      min_heading_distance < 0) {
+    SPDLOG_CRITICAL("Invalid heading parameter max_heading_diff {} "
+                    "min_heading_distance {}",
+                    max_heading_diff, min_heading_distance);
+    return false;
+  }
+  if (stationary_radius < 0 || min_distance < 0 || min_interval < 0) {
+    SPDLOG_CRITICAL("Invalid filter parameter stationary_radius {} "
+                    "min_distance {} min_interval {}",
+                    stationary_radius, min_distance, min_interval);
+    return false;
+  }
+  if (parallel_viterbi < 0) {
+    SPDLOG_CRITICAL("Invalid parallel_viterbi {}", parallel_viterbi);
+    return false;
+  }
+  if (beam_size < 0 || beam_margin < 0) {
+    SPDLOG_CRITICAL("Invalid beam parameter beam_size {} beam_margin {}",
+                    beam_size, beam_margin);
+    return false;
+  }
+  if (max_time_gap < 0) {
+    SPDLOG_CRITICAL("Invalid split parameter max_time_gap {}",
+                    max_time_gap);
+    return false;
+  }
+  if (max_seconds < 0 || max_transitions < 0 || max_settled < 0) {
+    SPDLOG_CRITICAL("Invalid budget parameter max_seconds {} "
+                    "max_transitions {} max_settled {}",
+                    max_seconds, max_transitions, max_settled);
+    return false;
+  }
   return true;
 }
 
@@ -58,7 +258,51 @@ PyMatchResult STMATCH::match_wkt(
   LineString line = wkt2linestring(wkt);
   std::vector<double> timestamps;
   Trajectory traj{0, line, timestamps};
-  MatchResult result = match_traj(traj, config);
+  return to_py_result(match_traj(traj, config));
+};
+
+std::vector<MatchResult> STMATCH::match_traj_batch(
+    const std::vector<Trajectory> &trajs, const STMATCHConfig &config,
+    int num_threads) {
+  int N = trajs.size();
+  std::vector<MatchResult> results(N);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+  for (int i = 0; i < N; ++i) {
+    results[i] = match_traj(trajs[i], config);
+  }
+  return results;
+};
+
+std::vector<PyMatchResult> STMATCH::match_wkt_batch(
+    const std::vector<std::string> &wkts, const STMATCHConfig &config,
+    int num_threads) {
+  // Parsed before the parallel region, so that an invalid wkt throws
+  std::vector<Trajectory> trajs;
+  trajs.reserve(wkts.size());
+  for (int i = 0; i < (int) wkts.size(); ++i) {
+    trajs.push_back({i, wkt2linestring(wkts[i]), {}});
+  }
+  std::vector<MatchResult> results =
+      match_traj_batch(trajs, config, num_threads);
+  std::vector<PyMatchResult> outputs;
+  outputs.reserve(results.size());
+  for (const MatchResult &result : results) {
+    outputs.push_back(to_py_result(result));
+  }
+  return outputs;
+};
+
+PyMatchArrays STMATCH::match_coords(
+    const double *coords, int num_points,
+    const double *timestamps, int num_timestamps,
+    const STMATCHConfig &config) {
+  Trajectory traj = coords2trajectory(coords, num_points,
+                                      timestamps, num_timestamps);
+  return to_py_arrays(match_traj(traj, config));
+};
+
+PyMatchResult STMATCH::to_py_result(const MatchResult &result) const {
   PyMatchResult output;
   output.id = result.id;
   output.opath = result.opath;
@@ -86,128 +330,781 @@ PyMatchResult STMATCH::match_wkt(
 
 // Procedure of HMM based map matching algorithm.
 MatchResult STMATCH::match_traj(const Trajectory &traj,
-                                const STMATCHConfig &config) {
+                                const STMATCHConfig &config,
+                                MatchWorkspace *workspace) {
+  MatchWorkspace &ws =
+      workspace != nullptr ? *workspace : MatchWorkspace::local();
+  // Matched in the local projection of the network, if any
+  const LocalProjection &projection = network_.get_projection();
+  BudgetMeter meter(config.get_match_budget());
+  MatchResult result = match_filtered(
+      projection.forward(traj, &ws.projected), config, nullptr, &meter, &ws);
+  projection.inverse(&result);
+  return result;
+}
+
+std::vector<SegmentMatchResult> STMATCH::match_traj_segments(
+    const Trajectory &traj, const STMATCHConfig &config) {
+  const LocalProjection &projection = network_.get_projection();
+  Trajectory projected;
+  // The segments share the budget of the trajectory. They may be matched
+  // by other threads, each with its own workspace.
+  BudgetMeter meter(config.get_match_budget());
+  std::vector<SegmentMatchResult> segments = match_segments(
+      projection.forward(traj, &projected), config.get_trajectory_split(),
+      [this, &config, &meter](const Trajectory &segment,
+                              TrajectoryBreak *brk) {
+        return match_filtered(segment, config, brk, &meter,
+                              &MatchWorkspace::local());
+      });
+  for (SegmentMatchResult &segment : segments) {
+    projection.inverse(&segment.result);
+  }
+  return segments;
+}
+
+MatchResult STMATCH::match_filtered(const Trajectory &traj,
+                                    const STMATCHConfig &config,
+                                    TrajectoryBreak *brk,
+                                    BudgetMeter *meter,
+                                    MatchWorkspace *workspace) {
+  PointFilter filter = config.get_point_filter();
+  if (!filter.is_enabled()) {
+    return match_segment(traj, config, brk, meter, workspace);
+  }
+  FilteredTrajectory filtered = filter_points(traj, filter);
+  SPDLOG_TRACE("Points kept {} of {}", filtered.points.size(),
+               traj.geom.get_num_points());
+  MatchResult result = match_segment(filtered.traj, config, brk, meter,
+                                     workspace);
+  // The break is reported at the original point
+  if (brk != nullptr && brk->point >= 0) {
+    brk->point = filtered.points[brk->point];
+  }
+  return expand_result(result, filtered);
+}
+
+std::vector<MatchResult> STMATCH::match_traj_sweep(
+    const Trajectory &traj, const STMATCHConfig &config,
+    const std::vector<SweepSetting> &settings, SweepReport *report) {
+  std::vector<MatchResult> results(settings.size());
+  if (settings.empty()) return results;
+  MatchWorkspace &ws = MatchWorkspace::local();
+  const LocalProjection &projection = network_.get_projection();
+  const Trajectory &projected = projection.forward(traj, &ws.projected);
+  UTIL::TimePoint begin = std::chrono::steady_clock::now();
+  int max_k = 0;
+  double max_radius = 0;
+  for (const SweepSetting &setting : settings) {
+    max_k = std::max(max_k, setting.k);
+    max_radius = std::max(max_radius, setting.radius);
+  }
+  int N = projected.geom.get_num_points();
+  std::vector<double> &eu_dists = ws.eu_dists;
+  ALGORITHM::cal_eu_dist(projected.geom, &eu_dists);
+  // The distances of the largest setting are shared by the settings
+  CandidateSearchContext &context = ws.context;
+  static thread_local SweepDistances distances;
+  static thread_local std::vector<TransitionPaths> layer_paths;
+  static thread_local std::vector<double> setting_deltas;
+  bool found = network_.search_tr_cs_knn(projected.geom, max_k, max_radius,
+                                         &context, nullptr,
+                                         graph_.get_edge_mask());
+  if (found) {
+    std::vector<double> &deltas = ws.deltas;
+    deltas.assign(N > 0 ? N - 1 : 0, 0);
+    for (const SweepSetting &setting : settings) {
+      calc_deltas(projected, eu_dists, setting.vmax, setting.factor,
+                  &setting_deltas);
+      for (int i = 0; i < N - 1; ++i) {
+        deltas[i] = std::max(deltas[i], setting_deltas[i]);
+      }
+    }
+    DummyGraph &dg = ws.dg;
+    dg.reset(context);
+    CompositeGraph cg(graph_, dg);
+    TransitionGraph &tg = ws.tg;
+    tg.reset(context, config.gps_error);
+    std::vector<TGLayer> &layers = tg.get_layers();
+    distances.reset(context);
+    layer_paths.resize(N > 0 ? N - 1 : 0);
+    for (int i = 0; i < N - 1; ++i) {
+      std::vector<std::vector<double>> rows = layer_distances(
+          i, layers[i], layers[i + 1], cg, deltas[i], false,
+          &layer_paths[i]);
+      double *layer = distances.get_layer(i);
+      for (const std::vector<double> &row : rows) {
+        layer = std::copy(row.begin(), row.end(), layer);
+      }
+    }
+  }
+  if (report != nullptr) {
+    report->add_shared(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - begin).count());
+  }
+  static thread_local CandidateSearchContext selected;
+  static thread_local TransitionGraph setting_tg;
+  for (std::size_t s = 0; s < settings.size(); ++s) {
+    begin = std::chrono::steady_clock::now();
+    const SweepSetting &setting = settings[s];
+    STMATCHConfig setting_config = config;
+    setting_config.k = setting.k;
+    setting_config.radius = setting.radius;
+    setting_config.gps_error = setting.gps_error;
+    setting_config.vmax = setting.vmax;
+    setting_config.factor = setting.factor;
+    MatchResult &result = results[s];
+    if (found && selected.select(context, setting.k, setting.radius)) {
+      selected.prune(projected.geom, setting.k,
+                     setting_config.get_candidate_pruning());
+      setting_tg.reset(selected, setting.gps_error,
+                       setting_config.approximate_ep);
+      calc_deltas(projected, eu_dists, setting.vmax, setting.factor,
+                  &setting_deltas);
+      distances.relax(&setting_tg, eu_dists, &setting_deltas,
+                      setting_config.get_viterbi_beam(), false);
+      result = build_sweep_result(projected, setting_config, &setting_tg,
+                                  context, layer_paths, &ws);
+      projection.inverse(&result);
+    } else {
+      result = MatchResult{};
+      result.id = traj.id;
+    }
+    if (report != nullptr) {
+      report->add(s, result, N, std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - begin).count());
+    }
+  }
+  return results;
+}
+
+MatchResult STMATCH::build_sweep_result(
+    const Trajectory &traj, const STMATCHConfig &config,
+    TransitionGraph *tg, const CandidateSearchContext &context,
+    const std::vector<TransitionPaths> &layer_paths,
+    MatchWorkspace *workspace) {
+  TGOpath &tg_opath = workspace->tg_opath;
+  tg->backtrack(&tg_opath);
+  MatchedCandidatePath matched_candidate_path;
+  O_Path opath;
+  if (config.result_fields.candidates) {
+    for (const TGNode *a : tg_opath) {
+      matched_candidate_path.push_back(
+          MatchedCandidate{*(a->c), a->ep, a->tp, a->sp_dist});
+      opath.push_back(a->c->edge->id);
+    }
+  }
+  // The paths of the transitions chosen are taken from the searches of
+  // the largest setting, by the positions of their candidates there
+  static thread_local TransitionPaths paths;
+  paths.reset(1, tg->get_layers().empty() ? 0 :
+              tg->get_layers().back().end() - tg->get_layers()[0].begin());
+  std::vector<EdgeIndex> path;
+  for (std::size_t i = 0; i + 1 < tg_opath.size(); ++i) {
+    const TransitionPaths &layer = layer_paths[i];
+    if (layer.rows.empty()) continue;
+    CandidateSpan ca = context.get_point_candidates(i);
+    CandidateSpan cb = context.get_point_candidates(i + 1);
+    const Candidate *a = tg_opath[i]->c;
+    const Candidate *b = tg_opath[i + 1]->c;
+    int pa = std::find_if(ca.begin(), ca.end(), [a](const Candidate &c) {
+      return c.edge == a->edge;
+    }) - ca.begin();
+    int pb = std::find_if(cb.begin(), cb.end(), [b](const Candidate &c) {
+      return c.edge == b->edge;
+    }) - cb.begin();
+    if (layer.get_path(layer.rows[pa], pb, &path)) {
+      paths.set_path(0, b->index - graph_.get_num_vertices(), path);
+    }
+  }
+  std::vector<int> indices;
+  std::vector<EdgeIndex> &index_path = workspace->index_path;
+  C_Path cpath = build_cpath(tg_opath, &indices, &paths, &index_path);
+  LineString mgeom;
+  if (config.result_fields.mgeom) {
+    mgeom = network_.complete_path_to_geometry(traj.geom, index_path);
+  }
+  return MatchResult{
+      traj.id, matched_candidate_path, opath, cpath, indices, mgeom, false};
+}
+
+MatchResult STMATCH::match_segment(const Trajectory &traj,
+                                   const STMATCHConfig &config,
+                                   TrajectoryBreak *brk,
+                                   BudgetMeter *meter,
+                                   MatchWorkspace *workspace) {
   SPDLOG_TRACE("Count of points in trajectory {}", traj.geom.get_num_points());
   SPDLOG_TRACE("Search candidates");
-  Traj_Candidates tc = network_.search_tr_cs_knn(
-      traj.geom, config.k, config.radius);
-  SPDLOG_TRACE("Trajectory candidate {}", tc);
-  if (tc.empty()) return MatchResult{};
+  // The candidates are stored in the workspace, which is not reused
+  // before the end of the matching
+  UTIL::StageClock clock;
+  bool tiled = UTIL::TileProfile::is_enabled();
+  UTIL::TimePoint tile_begin;
+  if (tiled) tile_begin = std::chrono::steady_clock::now();
+  CandidateSearchContext &context = workspace->context;
+  if (!network_.search_tr_cs_knn(traj.geom, config.k, config.radius,
+                                 &context, nullptr,
+                                 graph_.get_edge_mask())) {
+    clock.lap(UTIL::STAGE_SEARCH);
+    if (brk != nullptr) {
+      brk->point = context.get_missing_point();
+      brk->skip = true;
+    }
+    return MatchResult{};
+  }
+  std::vector<UTIL::TileCounters> &tiles = workspace->tiles;
+  if (tiled) {
+    tiles.assign(context.get_num_points(), UTIL::TileCounters());
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+      tiles[i].points = 1;
+      tiles[i].candidates = context.get_point_candidates(i).size();
+    }
+  }
+  context.prune(traj.geom, config.k, config.get_candidate_pruning());
+  clock.lap(UTIL::STAGE_SEARCH);
+  SPDLOG_TRACE("Trajectory candidate {}", context.to_traj_candidates());
   SPDLOG_TRACE("Generate dummy graph");
-  DummyGraph dg(tc);
+  DummyGraph &dg = workspace->dg;
+  dg.reset(context);
   SPDLOG_TRACE("Generate composite_graph");
   CompositeGraph cg(graph_, dg);
   SPDLOG_TRACE("Generate composite_graph");
-  TransitionGraph tg(tc, config.gps_error);
+  TransitionGraph &tg = workspace->tg;
+  tg.reset(context, config.gps_error, config.approximate_ep);
+  // The paths of the transitions chosen are kept for the complete path
+  static thread_local TransitionPaths paths;
+  paths.reset(1, context.get_candidates().size());
+  clock.lap(UTIL::STAGE_TRANSITION_GRAPH);
+  if (tiled) {
+    // The search and the graphs are shared by the points
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - tile_begin).count() /
+        tiles.size();
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+      tiles[i].kept = context.get_point_candidates(i).size();
+      tiles[i].seconds = seconds;
+    }
+  }
   SPDLOG_TRACE("Update cost in transition graph");
   // The network will be used internally to update transition graph
-  update_tg(&tg, cg, traj, config);
+  bool partial = !update_tg(&tg, cg, traj, config, meter, workspace,
+                            &paths);
+  if (tiled) UTIL::TileProfile::local().add(traj.geom, tiles);
+  if (partial) {
+    SPDLOG_DEBUG("Traj {} budget ran out at point {}", traj.id,
+                 tg.get_layers().size());
+  }
   SPDLOG_TRACE("Optimal path inference");
-  TGOpath tg_opath = tg.backtrack();
+  clock.lap(UTIL::STAGE_UPDATE_TG);
+  TGOpath &tg_opath = workspace->tg_opath;
+  tg.backtrack(&tg_opath);
   SPDLOG_TRACE("Optimal path size {}", tg_opath.size());
-  MatchedCandidatePath matched_candidate_path(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 matched_candidate_path.begin(),
-                 [](const TGNode *a) {
-                   return MatchedCandidate{
-                       *(a->c), a->ep, a->tp, a->sp_dist
-                   };
-                 });
-  O_Path opath(tg_opath.size());
-  std::transform(tg_opath.begin(), tg_opath.end(),
-                 opath.begin(),
-                 [](const TGNode *a) {
-                   return a->c->edge->id;
-                 });
+  MatchedCandidatePath matched_candidate_path;
+  O_Path opath;
+  // The candidates are also needed to expand the result of the points
+  // filtered
+  if (config.result_fields.candidates ||
+      config.get_point_filter().is_enabled()) {
+    matched_candidate_path.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   matched_candidate_path.begin(),
+                   [](const TGNode *a) {
+                     return MatchedCandidate{
+                         *(a->c), a->ep, a->tp, a->sp_dist
+                     };
+                   });
+    opath.resize(tg_opath.size());
+    std::transform(tg_opath.begin(), tg_opath.end(),
+                   opath.begin(),
+                   [](const TGNode *a) {
+                     return a->c->edge->id;
+                   });
+  }
+  clock.lap(UTIL::STAGE_BACKTRACK);
   std::vector<int> indices;
-  C_Path cpath = build_cpath(tg_opath, &indices);
+  std::vector<EdgeIndex> &index_path = workspace->index_path;
+  C_Path cpath = build_cpath(tg_opath, &indices, &paths, &index_path);
+  if (brk != nullptr && cpath.empty()) {
+    brk->point = tg_opath.empty() ? tg.find_unreachable_layer() :
+                 find_break(tg_opath);
+  }
   SPDLOG_TRACE("Opath is {}", opath);
   SPDLOG_TRACE("Indices is {}", indices);
   SPDLOG_TRACE("Complete path is {}", cpath);
-  LineString mgeom = network_.complete_path_to_geometry(
-      traj.geom, cpath);
+  clock.lap(UTIL::STAGE_CPATH);
+  LineString mgeom;
+  if (config.result_fields.mgeom) {
+    // A partial result ends at the last point matched
+    mgeom = partial ? network_.complete_path_to_geometry(
+        get_prefix(traj.geom, tg.get_layers().size()), index_path) :
+        network_.complete_path_to_geometry(traj.geom, index_path);
+  }
+  clock.lap(UTIL::STAGE_GEOMETRY);
   return MatchResult{
-      traj.id, matched_candidate_path, opath, cpath, indices, mgeom};
+      traj.id, matched_candidate_path, opath, cpath, indices, mgeom,
+      partial};
 }
 
-void STMATCH::update_tg(TransitionGraph *tg,
+void STMATCH::calc_deltas(const Trajectory &traj,
+                          const std::vector<double> &eu_dists,
+                          double vmax, double factor,
+                          std::vector<double> *deltas) {
+  int N = traj.geom.get_num_points();
+  deltas->resize(N > 0 ? N - 1 : 0);
+  for (int i = 0; i < N - 1; ++i) {
+    if (traj.timestamps.size() != N) {
+      (*deltas)[i] = eu_dists[i] * factor * 4;
+    } else {
+      double duration = traj.timestamps[i + 1] - traj.timestamps[i];
+      (*deltas)[i] = factor * vmax * duration;
+    }
+  }
+}
+
+bool STMATCH::update_tg(TransitionGraph *tg,
                         const CompositeGraph &cg,
                         const Trajectory &traj,
-                        const STMATCHConfig &config) {
+                        const STMATCHConfig &config,
+                        BudgetMeter *meter,
+                        MatchWorkspace *workspace,
+                        TransitionPaths *paths) {
   SPDLOG_TRACE("Update transition graph");
   std::vector<TGLayer> &layers = tg->get_layers();
-  std::vector<double> eu_dists = ALGORITHM::cal_eu_dist(traj.geom);
+  std::vector<double> &eu_dists = workspace->eu_dists;
+  ALGORITHM::cal_eu_dist(traj.geom, &eu_dists);
+  ViterbiBeam beam = config.get_viterbi_beam();
+  if (beam.is_enabled()) tg->reset_log_space();
   int N = layers.size();
+  std::vector<double> &deltas = workspace->deltas;
+  calc_deltas(traj, eu_dists, config.vmax, config.factor, &deltas);
+  // Without timestamps, the bound of a candidate follows its own distance
+  // to the next candidates instead of the distance between the points
+  double source_factor = config.goal_directed &&
+      (int) traj.timestamps.size() != N ? config.factor * 4 : 0;
+  if (config.parallel_viterbi > 0 && N >= config.parallel_viterbi) {
+    return update_tg_parallel(tg, cg, eu_dists, deltas, beam, source_factor,
+                              config.goal_directed, meter, paths);
+  }
+  // The work of a transition is counted at the point it enters
+  bool tiled = UTIL::TileProfile::is_enabled() &&
+      (int) workspace->tiles.size() == N;
   for (int i = 0; i < N - 1; ++i) {
+    if (meter->is_exhausted()) {
+      layers.resize(i + 1);
+      return false;
+    }
+    if (beam.is_enabled()) tg->prune_layer(&(layers[i]), beam);
     // Routing from current_layer to next_layer
     SPDLOG_TRACE("Update layer {} ", i);
-    double delta = 0;
-    if (traj.timestamps.size() != N) {
-      delta = eu_dists[i] * config.factor * 4;
-    } else {
-      double duration = traj.timestamps[i + 1] - traj.timestamps[i];
-      delta = config.factor * config.vmax * duration;
-    }
+    UTIL::TileCounters *tile = tiled ? &workspace->tiles[i + 1] : nullptr;
+    UTIL::TimePoint begin;
+    if (tiled) begin = std::chrono::steady_clock::now();
     update_layer(i, &(layers[i]), &(layers[i + 1]),
-                 cg, eu_dists[i], delta);
+                 cg, eu_dists[i], deltas[i], tg->is_log_space(), paths,
+                 meter, source_factor, config.goal_directed, tile);
+    if (tiled) {
+      tile->seconds += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - begin).count();
+    }
+    meter->add_transitions(layers[i].size() * layers[i + 1].size());
   }
   SPDLOG_TRACE("Update transition graph done");
+  return true;
+}
+
+bool STMATCH::update_tg_parallel(TransitionGraph *tg,
+                                 const CompositeGraph &cg,
+                                 const std::vector<double> &eu_dists,
+                                 const std::vector<double> &deltas,
+                                 const ViterbiBeam &beam,
+                                 double source_factor, bool goal_directed,
+                                 BudgetMeter *meter,
+                                 TransitionPaths *paths) {
+  SPDLOG_TRACE("Update transition graph in parallel");
+  std::vector<TGLayer> &layers = tg->get_layers();
+  int N = layers.size();
+  std::vector<std::vector<std::vector<double>>> distances;
+  std::vector<TransitionPaths> chunk_paths;
+  for (int start = 0; start < N - 1;
+       start += TransitionGraph::PARALLEL_CHUNK_LAYERS) {
+    if (meter->is_exhausted()) {
+      layers.resize(start + 1);
+      return false;
+    }
+    int end = start + TransitionGraph::PARALLEL_CHUNK_LAYERS;
+    if (end > N - 1) end = N - 1;
+    distances.resize(end - start);
+    if (paths != nullptr) chunk_paths.resize(end - start);
+    // The distances only depend on the candidates, so the layers of a
+    // chunk are routed in parallel
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = start; i < end; ++i) {
+      distances[i - start] = layer_distances(
+          i, layers[i], layers[i + 1], cg, deltas[i], false,
+          paths != nullptr ? &chunk_paths[i - start] : nullptr, meter,
+          source_factor, goal_directed);
+    }
+    // The max-plus recurrence is resolved by a serial sweep
+    for (int i = start; i < end; ++i) {
+      if (beam.is_enabled()) tg->prune_layer(&(layers[i]), beam);
+      update_layer(&(layers[i]), &(layers[i + 1]), distances[i - start],
+                   eu_dists[i], tg->is_log_space());
+      if (paths != nullptr) {
+        keep_transition_paths(layers[i], layers[i + 1],
+                              chunk_paths[i - start], paths);
+      }
+      meter->add_transitions(layers[i].size() * layers[i + 1].size());
+    }
+  }
+  SPDLOG_TRACE("Update transition graph in parallel done");
+  return true;
 }
 
 void STMATCH::update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
                            const CompositeGraph &cg,
                            double eu_dist,
-                           double delta) {
+                           double delta,
+                           bool log_space,
+                           TransitionPaths *paths,
+                           BudgetMeter *meter,
+                           double source_factor,
+                           bool goal_directed,
+                           UTIL::TileCounters *tile) {
   // SPDLOG_TRACE("Update layer");
+  static thread_local TransitionPaths layer_paths;
+  std::vector<std::vector<double>> distances = layer_distances(
+      level, *la_ptr, *lb_ptr, cg, delta, true,
+      paths != nullptr ? &layer_paths : nullptr, meter, source_factor,
+      goal_directed, eu_dist, log_space, tile);
+  update_layer(la_ptr, lb_ptr, distances, eu_dist, log_space);
+  if (paths != nullptr) {
+    keep_transition_paths(*la_ptr, *lb_ptr, layer_paths, paths);
+  }
+  SPDLOG_TRACE("Update layer done");
+}
+
+void STMATCH::keep_transition_paths(const TGLayer &la, const TGLayer &lb,
+                                    const TransitionPaths &layer_paths,
+                                    TransitionPaths *paths) const {
+  if (layer_paths.rows.empty()) return;
+  std::vector<EdgeIndex> path;
+  for (int j = 0; j < (int) lb.size(); ++j) {
+    const TGNode *prev = lb[j].prev;
+    if (prev == nullptr) continue;
+    int row = layer_paths.rows[prev - la.begin()];
+    if (layer_paths.get_path(row, j, &path)) {
+      paths->set_path(0, lb[j].c->index - graph_.get_num_vertices(), path);
+    }
+  }
+}
+
+void STMATCH::update_layer(TGLayer *la_ptr, TGLayer *lb_ptr,
+                           const std::vector<std::vector<double>> &distances,
+                           double eu_dist, bool log_space) {
   TGLayer &lb = *lb_ptr;
+  // The rows of the nodes not pruned by the beam are gathered into a
+  // matrix relaxed by the kernel shared with FMM. A node takes the first
+  // predecessor tied.
+  static thread_local std::vector<TGNode *> expanded;
+  static thread_local std::vector<double> sp_dists;
+  expanded.clear();
+  sp_dists.clear();
   for (auto iter = la_ptr->begin(); iter != la_ptr->end(); ++iter) {
-    NodeIndex source = iter->c->index;
-    SPDLOG_TRACE("  Calculate distance from source {}", source);
-    // single source upper bound routing
-    std::vector<NodeIndex> targets(lb.size());
-    std::transform(lb.begin(), lb.end(), targets.begin(),
-                   [](TGNode &a) {
-                     return a.c->index;
-                   });
-    SPDLOG_TRACE("  Upperbound shortest path {} ", delta);
-    std::vector<double> distances = shortest_path_upperbound(
-        level, cg, source, targets, delta);
-    SPDLOG_TRACE("  Update property of transition graph ");
-    for (int i = 0; i < distances.size(); ++i) {
-      double tp = TransitionGraph::calc_tp(distances[i], eu_dist);
-      if (lb[i].cumu_prob < iter->cumu_prob + tp * lb[i].ep) {
-        lb[i].cumu_prob = iter->cumu_prob + tp * lb[i].ep;
-        lb[i].prev = &(*iter);
-        lb[i].tp = tp;
-        lb[i].sp_dist = distances[i];
+    // No routing from the nodes pruned by the beam
+    if (TransitionGraph::is_pruned(*iter)) continue;
+    const std::vector<double> &row = distances[iter - la_ptr->begin()];
+    expanded.push_back(iter);
+    sp_dists.insert(sp_dists.end(), row.begin(), row.end());
+  }
+  relax_layer(expanded.data(), expanded.size(), lb, sp_dists.data(),
+              nullptr, eu_dist, log_space, false);
+}
+
+std::vector<std::vector<double>> STMATCH::layer_distances(
+    int level, const TGLayer &la, const TGLayer &lb,
+    const CompositeGraph &cg, double delta, bool skip_pruned,
+    TransitionPaths *paths, BudgetMeter *meter, double source_factor,
+    bool goal_directed, double eu_dist, bool log_space,
+    UTIL::TileCounters *tile) {
+  if (paths != nullptr) paths->reset(0, lb.size());
+  if (hierarchy_ != nullptr || cache_ != nullptr) {
+    return shortest_path_upperbound_nodes(la, lb, delta, skip_pruned,
+                                          source_factor);
+  }
+  // A path reaching a candidate of layer b enters its edge from the
+  // source node
+  std::vector<NodeIndex> entries;
+  for (const TGNode &b : lb) entries.push_back(b.c->edge->source);
+  std::vector<NodeIndex> targets(lb.size());
+  std::transform(lb.begin(), lb.end(), targets.begin(),
+                 [](const TGNode &a) {
+                   return a.c->index;
+                 });
+  std::vector<Point> points;
+  if (goal_directed) {
+    for (const TGNode &b : lb) points.push_back(b.c->point);
+  }
+  std::vector<std::vector<double>> distances(la.size());
+  std::vector<std::size_t> expanded;
+  std::vector<NodeIndex> sources;
+  std::vector<double> source_deltas;
+  // A pair farther apart than delta in a straight line is not reached,
+  // and a node of layer a without any other pair is not searched
+  std::vector<char> needed;
+  std::vector<char> row(lb.size());
+  std::vector<double> deltas_a(la.size(), 0);
+  for (std::size_t i = 0; i < la.size(); ++i) {
+    if (skip_pruned && TransitionGraph::is_pruned(la[i])) continue;
+    deltas_a[i] = calc_source_delta(la[i].c, lb, delta, source_factor);
+  }
+  // As tp and ep are at most 1, a pair whose upper bound is below the
+  // score of a pair to the same node of layer b known without routing
+  // cannot update the node, and is not searched. The score known is
+  // lowered against the rounding of the distance searched.
+  const double inf = std::numeric_limits<double>::infinity();
+  std::vector<double> best;
+  if (eu_dist >= 0) {
+    best.assign(lb.size(), -inf);
+    for (std::size_t i = 0; i < la.size(); ++i) {
+      if (skip_pruned && TransitionGraph::is_pruned(la[i])) continue;
+      for (std::size_t j = 0; j < lb.size(); ++j) {
+        double dist = calc_known_distance(la[i].c, lb[j].c);
+        if (dist < 0 || dist * (1 + 1e-6) >= deltas_a[i]) continue;
+        double tp = TransitionGraph::calc_tp(dist, eu_dist) * (1 - 1e-9);
+        best[j] = std::max(best[j], calc_score(la[i], lb[j], tp, log_space));
       }
     }
   }
-  SPDLOG_TRACE("Update layer done");
+  for (std::size_t i = 0; i < la.size(); ++i) {
+    if (skip_pruned && TransitionGraph::is_pruned(la[i])) continue;
+    double source_delta = deltas_a[i];
+    bool any = false;
+    for (std::size_t j = 0; j < lb.size(); ++j) {
+      double sp_lower_bound =
+          TransitionGraph::calc_sp_lower_bound(la[i].c, lb[j].c);
+      row[j] = sp_lower_bound <= source_delta &&
+          (best.empty() || calc_score(
+              la[i], lb[j],
+              TransitionGraph::calc_tp_upper_bound(sp_lower_bound, eu_dist),
+              log_space) >= best[j]);
+      any = any || row[j];
+    }
+    if (!any) {
+      distances[i].assign(lb.size(), std::numeric_limits<double>::max());
+      continue;
+    }
+    expanded.push_back(i);
+    sources.push_back(la[i].c->index);
+    source_deltas.push_back(source_delta);
+    needed.insert(needed.end(), row.begin(), row.end());
+  }
+  if (paths != nullptr) {
+    paths->reset(sources.size(), targets.size());
+    paths->rows.assign(la.size(), -1);
+    for (std::size_t n = 0; n < expanded.size(); ++n) {
+      paths->rows[expanded[n]] = n;
+    }
+  }
+  SPDLOG_TRACE("  Upperbound shortest path {} ", delta);
+  if (sources.size() == 1 && paths == nullptr) {
+    // single source upper bound routing, to the targets needed
+    std::vector<NodeIndex> reached;
+    std::vector<Point> reached_points;
+    for (std::size_t j = 0; j < targets.size(); ++j) {
+      if (!needed[j]) continue;
+      reached.push_back(targets[j]);
+      if (goal_directed) reached_points.push_back(points[j]);
+    }
+    std::vector<double> row_distances = shortest_path_upperbound(
+        level, cg, sources[0], reached, source_deltas[0], &entries,
+        goal_directed ? &reached_points : nullptr);
+    std::vector<double> &distance = distances[expanded[0]];
+    distance.assign(targets.size(), std::numeric_limits<double>::max());
+    for (std::size_t j = 0, n = 0; j < targets.size(); ++j) {
+      if (needed[j]) distance[j] = row_distances[n++];
+    }
+  } else if (!sources.empty()) {
+    // The searches of the sources are merged into one
+    std::vector<std::vector<double>> rows = shortest_path_upperbound_multi(
+        cg, sources, targets, delta, &entries, paths, &needed,
+        source_factor > 0 ? &source_deltas : nullptr,
+        goal_directed ? &points : nullptr);
+    for (std::size_t n = 0; n < expanded.size(); ++n) {
+      distances[expanded[n]].swap(rows[n]);
+    }
+  }
+  // The workspace of the thread still holds the nodes of the search
+  if (!sources.empty()) {
+    long settled = SearchWorkspace::local().get_visited().size();
+    if (meter != nullptr) meter->add_settled(settled);
+    if (tile != nullptr) tile->settled += settled;
+  }
+  return distances;
+}
+
+std::vector<std::vector<double>> STMATCH::shortest_path_upperbound_multi(
+    const CompositeGraph &cg, const std::vector<NodeIndex> &sources,
+    const std::vector<NodeIndex> &targets, double delta,
+    const std::vector<NodeIndex> *entries, TransitionPaths *paths,
+    const std::vector<char> *needed,
+    const std::vector<double> *source_deltas,
+    const std::vector<Point> *points) {
+  const double inf = std::numeric_limits<double>::max();
+  const Landmarks *landmarks = graph_.get_landmarks();
+  if (entries == nullptr || entries->empty()) landmarks = nullptr;
+  const std::size_t K = sources.size();
+  if (source_deltas != nullptr) {
+    delta = *std::max_element(source_deltas->begin(), source_deltas->end());
+  }
+  // Key of a node queued, which adds the lower bound to the targets
+  auto queue_key = [&](NodeIndex v, double dist) {
+    if (points == nullptr || cg.check_dummy_node(v)) return dist;
+    return dist + calc_goal_lower_bound(graph_.get_vertex_point(v), *points);
+  };
+  // The distances from the K sources to a visited node are stored in a
+  // slot of K labels. The workspace keeps the slot of a node in place of
+  // its predecessor, and the smallest label to propagate as its distance.
+  // The predecessor of each label is stored with the edge reaching it.
+  static thread_local std::vector<double> labels;
+  static thread_local std::vector<std::pair<NodeIndex, EdgeIndex>> preds;
+  labels.clear();
+  preds.clear();
+  SearchWorkspace &ws = SearchWorkspace::local();
+  ws.reset(cg.get_dummy_node_start_index());
+  auto visit = [&](NodeIndex v) {
+    if (!ws.visited(v)) {
+      ws.set(v, inf, labels.size() / K);
+      labels.resize(labels.size() + K, inf);
+      preds.resize(labels.size());
+    }
+    return (std::size_t) ws.get_predecessor(v);
+  };
+  for (std::size_t k = 0; k < K; ++k) {
+    std::size_t slot = visit(sources[k]);
+    labels[slot * K + k] = 0;
+    ws.set(sources[k], 0, slot);
+    ws.decrease_key(sources[k], 0);
+  }
+  // Largest label of the targets, once all of them are reached. The
+  // pairs not needed are left out.
+  auto target_bound = [&]() {
+    double bound = 0;
+    for (std::size_t j = 0; j < targets.size(); ++j) {
+      NodeIndex t = targets[j];
+      std::size_t slot = ws.visited(t) ? ws.get_predecessor(t) : 0;
+      for (std::size_t k = 0; k < K; ++k) {
+        if (needed != nullptr && !(*needed)[k * targets.size() + j]) {
+          continue;
+        }
+        if (!ws.visited(t)) return inf;
+        bound = std::max(bound, labels[slot * K + k]);
+      }
+    }
+    return bound;
+  };
+  // Label correcting search ordered by the smallest label changed, where
+  // a node is queued again whenever one of its labels decreases
+  while (!ws.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
+    NodeIndex u = node.index;
+    if (node.value > delta) break;
+    std::size_t su = ws.get_predecessor(u);
+    double dist_u = ws.get_distance(u);
+    ws.set(u, inf, su);
+    if (std::find(targets.begin(), targets.end(), u) != targets.end() &&
+        node.value >= target_bound()) {
+      // No label of a target can decrease below the labels queued
+      break;
+    }
+    if (landmarks != nullptr && !cg.check_dummy_node(u)) {
+      double bound = std::numeric_limits<double>::max();
+      for (NodeIndex entry : *entries) {
+        bound = std::min(bound, landmarks->lower_bound(u, entry));
+      }
+      if (dist_u + bound > delta) continue;
+    }
+    cg.for_each_out_edge(u, [&](const CompEdgeProperty &edge) {
+      NodeIndex v = edge.v;
+      std::size_t sv = visit(v);
+      double changed = inf;
+      for (std::size_t k = 0; k < K; ++k) {
+        double dist = labels[su * K + k] + edge.cost;
+        double bound = source_deltas != nullptr ? (*source_deltas)[k] : delta;
+        if (dist <= bound && labels[sv * K + k] - dist > 1e-6) {
+          labels[sv * K + k] = dist;
+          preds[sv * K + k] = {u, edge.edge};
+          changed = std::min(changed, dist);
+        }
+      }
+      if (changed < ws.get_distance(v)) {
+        ws.set(v, changed, sv);
+        ws.decrease_key(v, queue_key(v, changed));
+      }
+    });
+  }
+  std::vector<std::vector<double>> distances(
+      K, std::vector<double>(targets.size(), inf));
+  const NodeIndex num_vertices = cg.get_dummy_node_start_index();
+  std::vector<EdgeIndex> path;
+  for (std::size_t j = 0; j < targets.size(); ++j) {
+    if (!ws.visited(targets[j])) continue;
+    std::size_t slot = ws.get_predecessor(targets[j]);
+    for (std::size_t k = 0; k < K; ++k) {
+      distances[k][j] = labels[slot * K + k];
+      if (paths == nullptr || distances[k][j] == inf) continue;
+      // A network edge is entered from a network node, as the edges
+      // leaving a dummy node continue the edge containing it. The last
+      // edge entered is the candidate edge of the target.
+      path.clear();
+      for (NodeIndex v = targets[j]; v != sources[k];) {
+        const std::pair<NodeIndex, EdgeIndex> &pred =
+            preds[ws.get_predecessor(v) * K + k];
+        if (pred.first < num_vertices) path.push_back(pred.second);
+        v = pred.first;
+      }
+      if (!path.empty()) path.erase(path.begin());
+      std::reverse(path.begin(), path.end());
+      paths->set_path(k, j, path);
+    }
+  }
+  return distances;
 }
 
 std::vector<double> STMATCH::shortest_path_upperbound(
     int level, const CompositeGraph &cg, NodeIndex source,
-    const std::vector<NodeIndex> &targets, double delta) {
+    const std::vector<NodeIndex> &targets, double delta,
+    const std::vector<NodeIndex> *entries,
+    const std::vector<Point> *points) {
   SPDLOG_TRACE("Upperbound shortest path source {}", source);
+  const Landmarks *landmarks = graph_.get_landmarks();
+  if (entries == nullptr || entries->empty()) landmarks = nullptr;
   SPDLOG_TRACE("Upperbound shortest path targets {}", targets);
   std::unordered_set<NodeIndex> unreached_targets;
   for (auto &node:targets) {
     unreached_targets.insert(node);
   }
-  DistanceMap dmap;
-  PredecessorMap pmap;
-  Heap Q;
-  Q.push(source, 0);
-  pmap.insert({source, source});
-  dmap.insert({source, 0});
+  // Dummy nodes of the composite graph follow the network nodes and
+  // grow the workspace on their first visit.
+  SearchWorkspace &ws = SearchWorkspace::local();
+  ws.reset(cg.get_dummy_node_start_index());
+  ws.set(source, 0, source);
+  ws.push(source, 0);
   double temp_dist = 0;
-  // Dijkstra search
-  while (!Q.empty() && !unreached_targets.empty()) {
-    HeapNode node = Q.top();
-    Q.pop();
-    SPDLOG_TRACE("  Node u {} dist {}", node.index, node.value);
+  // Key of a node queued, which adds the lower bound to the targets. A
+  // node is queued again when a shorter distance is found after it is
+  // settled, as the dummy nodes take no bound.
+  auto queue_key = [&](NodeIndex v, double dist) {
+    if (points == nullptr || cg.check_dummy_node(v)) return dist;
+    return dist + calc_goal_lower_bound(graph_.get_vertex_point(v), *points);
+  };
+  // Dijkstra search, or A* search with the points of the targets
+  while (!ws.empty() && !unreached_targets.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
     NodeIndex u = node.index;
+    double dist_u = ws.get_distance(u);
+    SPDLOG_TRACE("  Node u {} dist {}", u, dist_u);
     auto iter = unreached_targets.find(u);
     if (iter != unreached_targets.end()) {
       // Remove u
@@ -215,41 +1112,45 @@ std::vector<double> STMATCH::shortest_path_upperbound(
       unreached_targets.erase(iter);
     }
     if (node.value > delta) break;
-    std::vector<CompEdgeProperty> out_edges = cg.out_edges(u);
-    for (auto node_iter = out_edges.begin(); node_iter != out_edges.end();
-         ++node_iter) {
-      NodeIndex v = node_iter->v;
-      temp_dist = node.value + node_iter->cost;
+    if (landmarks != nullptr && !cg.check_dummy_node(u)) {
+      // No target is reached within delta through u
+      double bound = std::numeric_limits<double>::max();
+      for (NodeIndex entry : *entries) {
+        bound = std::min(bound, landmarks->lower_bound(u, entry));
+      }
+      if (dist_u + bound > delta) continue;
+    }
+    // The out edges are visited in place, without allocating them
+    cg.for_each_out_edge(u, [&](const CompEdgeProperty &edge) {
+      NodeIndex v = edge.v;
+      temp_dist = dist_u + edge.cost;
       SPDLOG_TRACE("  Examine node v {} temp dist {}", v, temp_dist);
-      auto v_iter = dmap.find(v);
-      if (v_iter != dmap.end()) {
-        // dmap contains node v
-        if (v_iter->second - temp_dist > 1e-6) {
+      if (ws.visited(v)) {
+        // v is visited
+        if (ws.get_distance(v) - temp_dist > 1e-6) {
           // a smaller distance is found for v
           SPDLOG_TRACE("    Update key {} {} in pdmap prev dist {}",
-                       v, temp_dist, v_iter->second);
-          pmap[v] = u;
-          dmap[v] = temp_dist;
-          Q.decrease_key(v, temp_dist);
+                       v, temp_dist, ws.get_distance(v));
+          ws.set(v, temp_dist, u);
+          ws.decrease_key(v, queue_key(v, temp_dist));
         }
       } else {
-        // dmap does not contain v
+        // v is not visited
         if (temp_dist <= delta) {
           SPDLOG_TRACE("    Insert key {} {} into pmap and dmap",
                        v, temp_dist);
-          Q.push(v, temp_dist);
-          pmap.insert({v, u});
-          dmap.insert({v, temp_dist});
+          ws.set(v, temp_dist, u);
+          ws.push(v, queue_key(v, temp_dist));
         }
       }
-    }
+    });
   }
   // Update distances
   SPDLOG_TRACE("  Update distances");
   std::vector<double> distances;
   for (int i = 0; i < targets.size(); ++i) {
-    if (dmap.find(targets[i]) != dmap.end()) {
-      distances.push_back(dmap[targets[i]]);
+    if (ws.visited(targets[i])) {
+      distances.push_back(ws.get_distance(targets[i]));
     } else {
       distances.push_back(std::numeric_limits<double>::max());
     }
@@ -258,14 +1159,89 @@ std::vector<double> STMATCH::shortest_path_upperbound(
   return distances;
 }
 
-C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices) {
+std::vector<std::vector<double>> STMATCH::shortest_path_upperbound_nodes(
+    const TGLayer &la, const TGLayer &lb, double delta,
+    bool skip_pruned, double source_factor) const {
+  // A path leaves candidate a through the target node of its edge and
+  // enters candidate b through the source node of its edge, unless b is
+  // reached directly on the edge of a.
+  std::vector<NodeIndex> sources, targets;
+  std::unordered_map<NodeIndex, int> source_index, target_index;
+  // The nodes pruned by the beam are not expanded, nor the nodes farther
+  // than delta in a straight line from all the nodes of layer b
+  std::vector<char> expanded(la.size(), 0);
+  std::vector<double> source_deltas(la.size(), delta);
+  for (size_t i = 0; i < la.size(); ++i) {
+    const TGNode &a = la[i];
+    if (skip_pruned && TransitionGraph::is_pruned(a)) continue;
+    source_deltas[i] = calc_source_delta(a.c, lb, delta, source_factor);
+    for (const TGNode &b : lb) {
+      if (TransitionGraph::calc_sp_lower_bound(a.c, b.c) <=
+          source_deltas[i]) {
+        expanded[i] = 1;
+        break;
+      }
+    }
+    if (!expanded[i]) continue;
+    if (source_index.insert({a.c->edge->target, sources.size()}).second)
+      sources.push_back(a.c->edge->target);
+  }
+  for (const TGNode &b : lb) {
+    if (target_index.insert({b.c->edge->source, targets.size()}).second)
+      targets.push_back(b.c->edge->source);
+  }
+  std::vector<std::vector<double>> node_distances;
+  if (hierarchy_ != nullptr) {
+    node_distances = hierarchy_->many_to_many(sources, targets, delta);
+  } else {
+    for (NodeIndex source : sources) {
+      node_distances.push_back(cache_->one_to_many(source, targets, delta));
+    }
+  }
+  std::vector<std::vector<double>> distances(
+      la.size(), std::vector<double>(lb.size(),
+                                     std::numeric_limits<double>::max()));
+  for (size_t i = 0; i < la.size(); ++i) {
+    if (!expanded[i]) continue;
+    const Candidate *a = la[i].c;
+    const std::vector<double> &row =
+        node_distances[source_index[a->edge->target]];
+    for (size_t j = 0; j < lb.size(); ++j) {
+      const Candidate *b = lb[j].c;
+      double dist = std::numeric_limits<double>::max();
+      if (a->edge->id == b->edge->id && a->offset <= b->offset) {
+        dist = b->offset - a->offset;
+      }
+      double node_dist = row[target_index[b->edge->source]];
+      if (node_dist != std::numeric_limits<double>::max()) {
+        dist = std::min(dist, a->edge->length - a->offset + node_dist +
+            b->offset);
+      }
+      if (dist <= source_deltas[i]) distances[i][j] = dist;
+    }
+  }
+  return distances;
+}
+
+int STMATCH::find_break(const TGOpath &opath) {
+  for (int i = 1; i < (int) opath.size(); ++i) {
+    if (opath[i]->sp_dist == std::numeric_limits<double>::max()) return i;
+  }
+  return -1;
+}
+
+C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices,
+                            const TransitionPaths *paths,
+                            std::vector<EdgeIndex> *index_path) {
   SPDLOG_DEBUG("Build cpath from optimal candidate path");
   C_Path cpath;
   if (!indices->empty()) indices->clear();
+  if (index_path != nullptr) index_path->clear();
   if (opath.empty()) return cpath;
   const std::vector<Edge> &edges = network_.get_edges();
   int N = opath.size();
   cpath.push_back(opath[0]->c->edge->id);
+  if (index_path != nullptr) index_path->push_back(opath[0]->c->edge->index);
   int current_idx = 0;
   SPDLOG_TRACE("Insert index {}", current_idx);
   indices->push_back(current_idx);
@@ -274,11 +1250,27 @@ C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices) {
     const Candidate *b = opath[i + 1]->c;
     SPDLOG_TRACE("Check a {} b {}", a->edge->id, b->edge->id);
     if ((a->edge->id != b->edge->id) || (a->offset > b->offset)) {
-      auto segs = graph_.shortest_path_dijkstra(a->edge->target,
-                                                b->edge->source);
+      std::vector<EdgeIndex> segs;
+      // The path of the transition is searched again unless it is kept
+      bool kept = paths != nullptr && opath[i + 1]->prev == opath[i] &&
+          paths->get_path(0, b->index - graph_.get_num_vertices(), &segs);
+      if (kept) {
+        SPDLOG_TRACE("Path kept from the transition search");
+      } else if (hierarchy_ == nullptr && cache_ != nullptr &&
+                 cache_->get_path(a->edge->target, b->edge->source, &segs)) {
+        SPDLOG_TRACE("Path found in the path cache");
+      } else if (hierarchy_ != nullptr) {
+        hierarchy_->shortest_path(a->edge->target, b->edge->source, &segs);
+      } else if (graph_.get_landmarks() != nullptr) {
+        segs = graph_.shortest_path_astar(a->edge->target, b->edge->source);
+      } else {
+        segs = graph_.shortest_path_dijkstra(a->edge->target,
+                                             b->edge->source);
+      }
       // No transition found
       if (segs.empty() && a->edge->target != b->edge->source) {
         indices->clear();
+        if (index_path != nullptr) index_path->clear();
         return {};
       }
       SPDLOG_TRACE("Edges found {}", segs);
@@ -287,6 +1279,10 @@ C_Path STMATCH::build_cpath(const TGOpath &opath, std::vector<int> *indices) {
         ++current_idx;
       }
       cpath.push_back(b->edge->id);
+      if (index_path != nullptr) {
+        index_path->insert(index_path->end(), segs.begin(), segs.end());
+        index_path->push_back(b->edge->index);
+      }
       ++current_idx;
       SPDLOG_TRACE("Insert index {}", current_idx);
       indices->push_back(current_idx);
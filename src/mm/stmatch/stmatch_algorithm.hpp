@@ -11,8 +11,15 @@
 
 #include "network/network.hpp"
 #include "network/network_graph.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "network/path_cache.hpp"
 #include "mm/composite_graph.hpp"
 #include "mm/transition_graph.hpp"
+#include "mm/match_workspace.hpp"
+#include "mm/trajectory_split.hpp"
+#include "mm/point_filter.hpp"
+#include "mm/match_budget.hpp"
+#include "mm/parameter_sweep.hpp"
 #include "mm/mm_type.hpp"
 #include "python/pyfmm.hpp"
 
@@ -47,6 +54,69 @@ struct STMATCHConfig {
   double vmax; /**< maximum speed of the vehicle, unit is map_unit/second */
   double factor; /**< factor multiplied to vmax*deltaT to
                       limit the search of shortest path */
+  double min_ep_ratio = 0; /**< Minimum ratio of the emission probability
+                               of a candidate to the best one, 0 for all */
+  double max_dist_ratio = 0; /**< Maximum ratio of the distance of a
+                                 candidate to the best one, 0 for all */
+  double adaptive_k_spacing = 0; /**< Point spacing below which fewer
+                                     candidates are kept, 0 for k */
+  double max_heading_diff = 0; /**< Maximum angle in degrees between the
+                                    heading of a point and the edge of a
+                                    candidate, 0 for all */
+  double min_heading_distance = 0; /**< Distance between the neighbours
+                                        of a point below which its heading
+                                        is not used */
+  int beam_size = 0; /**< Maximum number of states expanded per layer by
+                          the beam search Viterbi, 0 for all */
+  double beam_margin = 0; /**< Maximum log probability difference of a
+                               state expanded to the best one, 0 for all */
+  bool split = false; /**< Split the trajectory at the breaks of its
+                           matching and match the segments */
+  double max_time_gap = 0; /**< Time gap splitting the trajectory, 0 for
+                                none */
+  int parallel_viterbi = 0; /**< Number of points from which the
+                                 transitions of a trajectory are computed
+                                 in parallel, 0 for none */
+  double stationary_radius = 0; /**< Radius of the stationary clusters of
+                                     points collapsed, 0 for none */
+  double min_distance = 0; /**< Minimum distance between the points
+                                matched, 0 for all */
+  double min_interval = 0; /**< Minimum time between the points matched,
+                                0 for all */
+  bool approximate_ep = false; /**< Compute the emission probabilities
+                                    with an approximate exponential */
+  bool goal_directed = false; /**< Direct the searches of the transitions
+                                   toward their targets, and bound the
+                                   search of each candidate by its
+                                   distance to the next candidates */
+  double max_seconds = 0; /**< Maximum seconds spent on the transitions
+                               of a trajectory, 0 for unlimited */
+  long max_transitions = 0; /**< Maximum pairs of candidates evaluated
+                                 for a trajectory, 0 for unlimited */
+  long max_settled = 0; /**< Maximum nodes visited by the searches of
+                             a trajectory, 0 for unlimited */
+  ResultFields result_fields; /**< Fields of the results built, set by
+                                   the apps from the fields written */
+  /**
+   * Get the options to prune the candidates found
+   */
+  NETWORK::CandidatePruning get_candidate_pruning() const;
+  /**
+   * Get the options of the beam search Viterbi
+   */
+  ViterbiBeam get_viterbi_beam() const;
+  /**
+   * Get the options of the splitting of a trajectory
+   */
+  TrajectorySplit get_trajectory_split() const;
+  /**
+   * Get the options of the prefilter of the points
+   */
+  PointFilter get_point_filter() const;
+  /**
+   * Get the budget of a trajectory, whose result is partial if it runs out
+   */
+  MatchBudget get_match_budget() const;
   /**
    * Check the validity of the configuration
    */
@@ -67,6 +137,61 @@ struct STMATCHConfig {
       const cxxopts::ParseResult &arg_data);
 };
 
+/**
+ * Paths of the transitions found by the searches of a layer, which are
+ * kept to build the complete path without searching them again. The
+ * network edges of the paths are stored in one flat array.
+ */
+struct TransitionPaths {
+  std::vector<int> rows; /**< Row of each node of the layer searched, -1
+                              if no search starts from the node */
+  int num_targets = 0; /**< Number of targets of a row */
+  std::vector<int> begins; /**< First edge of the path of each pair of a
+                                row and a target, -1 if not found */
+  std::vector<int> ends; /**< Past the last edge of the path of a pair */
+  std::vector<NETWORK::EdgeIndex> edges; /**< Edges of all the paths */
+  /**
+   * Remove the paths, keeping the buffers allocated
+   * @param num_rows        number of rows
+   * @param num_targets_arg number of targets of a row
+   */
+  inline void reset(int num_rows, int num_targets_arg) {
+    rows.clear();
+    num_targets = num_targets_arg;
+    begins.assign(num_rows * num_targets, -1);
+    ends.assign(num_rows * num_targets, -1);
+    edges.clear();
+  };
+  /**
+   * Set the path of a pair
+   * @param row    row of the pair
+   * @param target target of the pair
+   * @param path   network edges of the path
+   */
+  inline void set_path(int row, int target,
+                       const std::vector<NETWORK::EdgeIndex> &path) {
+    int pair = row * num_targets + target;
+    begins[pair] = edges.size();
+    edges.insert(edges.end(), path.begin(), path.end());
+    ends[pair] = edges.size();
+  };
+  /**
+   * Get the path of a pair
+   * @param  row    row of the pair
+   * @param  target target of the pair
+   * @param  path   updated with the network edges of the path
+   * @return true if the path of the pair is found
+   */
+  inline bool get_path(int row, int target,
+                       std::vector<NETWORK::EdgeIndex> *path) const {
+    if (row < 0 || target < 0 || target >= num_targets) return false;
+    std::size_t pair = (std::size_t) row * num_targets + target;
+    if (pair >= begins.size() || begins[pair] < 0) return false;
+    path->assign(edges.begin() + begins[pair], edges.begin() + ends[pair]);
+    return true;
+  };
+};
+
 /**
  * %STMATCH algorithm/model
  */
@@ -74,9 +199,19 @@ class STMATCH {
  public:
   /**
    * Create a stmatch model from network and graph
+   * @param network   road network
+   * @param graph     graph of the road network
+   * @param hierarchy if not nullptr, the contraction hierarchy of the
+   * network used to compute the transitions and the complete path
+   * @param cache     if not nullptr, the cache of the shortest paths
+   * shared with other trajectories, which is used to compute the
+   * transitions and the complete path unless a hierarchy is given
    */
-  STMATCH(const NETWORK::Network &network, const NETWORK::NetworkGraph &graph) :
-      network_(network), graph_(graph) {
+  STMATCH(const NETWORK::Network &network, const NETWORK::NetworkGraph &graph,
+          const NETWORK::ContractionHierarchy *hierarchy = nullptr,
+          NETWORK::PathCache *cache = nullptr) :
+      network_(network), graph_(graph), hierarchy_(hierarchy),
+      cache_(cache) {
   };
   /**
    * Match a wkt linestring to the road network.
@@ -88,24 +223,141 @@ class STMATCH {
     const std::string &wkt,const STMATCHConfig &config);
   /**
    * Match a trajectory to the road network
-   * @param  traj   input trajector data
-   * @param  config configuration of stmatch algorithm
+   * @param  traj      input trajector data
+   * @param  config    configuration of stmatch algorithm
+   * @param  workspace buffers reused between the trajectories, the
+   * workspace of the calling thread if nullptr
    * @return map matching result
    */
   MatchResult match_traj(const CORE::Trajectory &traj,
-                         const STMATCHConfig &config);
+                         const STMATCHConfig &config,
+                         MatchWorkspace *workspace = nullptr);
+  /**
+   * Match a trajectory split at the time gaps and at the breaks of its
+   * matching, where a point has no candidate or is not reached from the
+   * previous point. Long trajectories have their segments matched in
+   * parallel.
+   * @param  traj   input trajectory data
+   * @param  config configuration of stmatch algorithm
+   * @return map matching results of the segments
+   */
+  std::vector<SegmentMatchResult> match_traj_segments(
+      const CORE::Trajectory &traj, const STMATCHConfig &config);
+  /**
+   * Match trajectories in parallel, which releases the GIL in Python API
+   * @param  trajs       input trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in the order of the trajectories
+   */
+  std::vector<MatchResult> match_traj_batch(
+      const std::vector<CORE::Trajectory> &trajs, const STMATCHConfig &config,
+      int num_threads = 0);
+  /**
+   * Match wkt linestrings in parallel, which releases the GIL in Python
+   * API. The id of a result is the index of its linestring.
+   * @param  wkts        WKT representation of the trajectories
+   * @param  config      configuration of map matching algorithm
+   * @param  num_threads threads matching the trajectories, 0 for the
+   * number of cores
+   * @return map matching results in POD format used in Python API
+   */
+  std::vector<PYTHON::PyMatchResult> match_wkt_batch(
+      const std::vector<std::string> &wkts, const STMATCHConfig &config,
+      int num_threads = 0);
+  /**
+   * Match a trajectory given as contiguous arrays, which is used by the
+   * NumPy Python API without formatting and parsing WKT.
+   * @param  coords         x and y of the points interleaved
+   * @param  num_points     number of points
+   * @param  timestamps     timestamps of the points, or nullptr
+   * @param  num_timestamps number of timestamps, 0 or num_points
+   * @param  config         configuration of map matching algorithm
+   * @return map matching result in contiguous arrays
+   */
+  PYTHON::PyMatchArrays match_coords(
+      const double *coords, int num_points,
+      const double *timestamps, int num_timestamps,
+      const STMATCHConfig &config);
+  /**
+   * Match a trajectory with each setting of a sweep. The candidates are
+   * searched once with the largest k and radius, and the transitions
+   * are routed once with the largest bound of the settings. Each setting
+   * then selects its candidates among them and runs Viterbi on the
+   * distances within its own bound. The trajectory is neither split nor
+   * filtered, and the budget, the parallel Viterbi and the goal directed
+   * search are not used.
+   * @param  traj     input trajectory data
+   * @param  config   configuration of the parameters not swept
+   * @param  settings settings of the sweep
+   * @param  report   if not nullptr, updated with the results and the
+   * time of the settings
+   * @return map matching result of each setting
+   */
+  std::vector<MatchResult> match_traj_sweep(
+      const CORE::Trajectory &traj, const STMATCHConfig &config,
+      const std::vector<SweepSetting> &settings,
+      SweepReport *report = nullptr);
  protected:
+  /**
+   * Convert a result into the POD format used in Python API
+   * @param  result map matching result
+   * @return result in POD format
+   */
+  PYTHON::PyMatchResult to_py_result(const MatchResult &result) const;
   /**
    * Update probabilities in a transition graph
    * @param tg transition graph
    * @param cg composition graph
    * @param traj raw trajectory
    * @param config map match configuration
+   * @param meter  budget of the trajectory, checked before each layer
+   * @param workspace buffers of the matching
+   * @param paths  if not nullptr, updated with the path of the transition
+   * chosen for each candidate, indexed by the candidate from the first
+   * dummy node
+   * @return false if the budget ran out, where the layers not updated
+   * are removed from the transition graph
    */
-  void update_tg(TransitionGraph *tg,
+  bool update_tg(TransitionGraph *tg,
                  const CompositeGraph &cg,
                  const CORE::Trajectory &traj,
-                 const STMATCHConfig &config);
+                 const STMATCHConfig &config,
+                 BudgetMeter *meter,
+                 MatchWorkspace *workspace,
+                 TransitionPaths *paths = nullptr);
+  /**
+   * Calculate the upper bounds of the searches between consecutive
+   * points, from their time interval, or from their distance without
+   * timestamps
+   * @param traj     raw trajectory
+   * @param eu_dists Euclidean distances between consecutive points
+   * @param vmax     maximum speed of the vehicle
+   * @param factor   factor multiplied with vmax*deltaT or with four
+   * times the Euclidean distance
+   * @param deltas   updated with the bound of each pair of points
+   */
+  static void calc_deltas(const CORE::Trajectory &traj,
+                          const std::vector<double> &eu_dists,
+                          double vmax, double factor,
+                          std::vector<double> *deltas);
+  /**
+   * Build the result of a setting of a sweep from its transition graph
+   * @param  traj        input trajectory data
+   * @param  config      configuration of the setting
+   * @param  tg          transition graph of the setting, updated
+   * @param  context     candidates of the largest setting
+   * @param  layer_paths paths of the transitions between the candidates
+   * of the largest setting, one per pair of consecutive points
+   * @param  workspace   buffers of the matching
+   * @return map matching result
+   */
+  MatchResult build_sweep_result(
+      const CORE::Trajectory &traj, const STMATCHConfig &config,
+      TransitionGraph *tg, const NETWORK::CandidateSearchContext &context,
+      const std::vector<TransitionPaths> &layer_paths,
+      MatchWorkspace *workspace);
   /**
    * Update probabilities between two layers a and b in the transition graph
    * @param level   the index of layer a
@@ -114,11 +366,147 @@ class STMATCH {
    * @param cg      Composition graph
    * @param eu_dist Euclidean distance between two observed point
    * @param delta   An upper bound to limit the search
+   * @param log_space accumulate log probabilities instead of probabilities.
+   * The nodes of layer a pruned by a beam are skipped in either case.
+   * @param paths   if not nullptr, updated with the path of the transition
+   * chosen for each node of layer b
+   * @param meter   if not nullptr, updated with the nodes visited
+   * @param source_factor if positive, the bound of the search from each
+   * node of layer a is lowered to the Euclidean distance to the farthest
+   * node of layer b multiplied by the factor
+   * @param goal_directed direct the searches toward the nodes of layer b
+   * @param tile    if not nullptr, updated with the nodes visited
    */
   void update_layer(int level, TGLayer *la_ptr, TGLayer *lb_ptr,
                     const CompositeGraph &cg,
                     double eu_dist,
-                    double delta);
+                    double delta,
+                    bool log_space = false,
+                    TransitionPaths *paths = nullptr,
+                    BudgetMeter *meter = nullptr,
+                    double source_factor = 0,
+                    bool goal_directed = false,
+                    UTIL::TileCounters *tile = nullptr);
+  /**
+   * Update probabilities between two layers a and b in the transition
+   * graph from the distances of their nodes
+   * @param la_ptr    layer a
+   * @param lb_ptr    layer b next to a
+   * @param distances distances from each node of layer a to the nodes of
+   * layer b, which are not used for the nodes pruned by a beam
+   * @param eu_dist   Euclidean distance between two observed point
+   * @param log_space accumulate log probabilities instead of probabilities
+   */
+  void update_layer(TGLayer *la_ptr, TGLayer *lb_ptr,
+                    const std::vector<std::vector<double>> &distances,
+                    double eu_dist, bool log_space);
+  /**
+   * Update probabilities in a transition graph, routing a chunk of
+   * layers in parallel before sweeping them serially
+   * @param tg       transition graph
+   * @param cg       composition graph
+   * @param eu_dists Euclidean distances between consecutive points
+   * @param deltas   upper bounds of the search between consecutive points
+   * @param beam     options of the beam search Viterbi
+   * @param source_factor factor of the bound of each candidate, as in
+   * update_layer
+   * @param goal_directed direct the searches toward their targets
+   * @param meter    budget of the trajectory, checked before each chunk
+   * @param paths    if not nullptr, updated with the path of the
+   * transition chosen for each candidate
+   * @return false if the budget ran out, as in update_tg
+   */
+  bool update_tg_parallel(TransitionGraph *tg, const CompositeGraph &cg,
+                          const std::vector<double> &eu_dists,
+                          const std::vector<double> &deltas,
+                          const ViterbiBeam &beam,
+                          double source_factor, bool goal_directed,
+                          BudgetMeter *meter,
+                          TransitionPaths *paths = nullptr);
+  /**
+   * Keep the path of the transition chosen for each node of layer b
+   * @param la          layer a
+   * @param lb          layer b next to a, whose nodes are updated
+   * @param layer_paths paths from the nodes of layer a to layer b
+   * @param paths       updated with the path of each node of layer b,
+   * indexed by its candidate from the first dummy node
+   */
+  void keep_transition_paths(const TGLayer &la, const TGLayer &lb,
+                             const TransitionPaths &layer_paths,
+                             TransitionPaths *paths) const;
+  /**
+   * Return distances from each candidate of layer a to each candidate of
+   * layer b with an upper bound of delta
+   * @param  level       the index of layer a
+   * @param  la          layer a
+   * @param  lb          layer b next to a
+   * @param  cg          Composition graph
+   * @param  delta       An upper bound value to constrain the search
+   * @param  skip_pruned leave out the nodes of layer a pruned by a beam,
+   * whose distances are empty
+   * @param  paths       if not nullptr, updated with the paths found,
+   * which are not kept with the contraction hierarchy or the path cache
+   * @param  meter       if not nullptr, updated with the nodes visited by
+   * the search, which are not counted with the contraction hierarchy or
+   * the path cache
+   * @param  source_factor if positive, the bound of each node of layer a
+   * is lowered to the Euclidean distance to the farthest node of layer b
+   * multiplied by the factor
+   * @param  goal_directed direct the searches toward the nodes of layer b,
+   * which is not used with the contraction hierarchy or the path cache
+   * @param  eu_dist     if not negative, the Euclidean distance between
+   * the points of the layers, with which the pairs that cannot update
+   * their node of layer b are not searched. The probabilities of layer a
+   * must be final.
+   * @param  log_space   the probabilities are in log space
+   * @param  tile        if not nullptr, updated with the nodes visited as
+   * the meter
+   * @return distances indexed by the node of layer a and then the node of
+   * layer b, where infinity distance is returned for a pair not reached
+   * or not searched
+   */
+  std::vector<std::vector<double>> layer_distances(
+      int level, const TGLayer &la, const TGLayer &lb,
+      const CompositeGraph &cg, double delta, bool skip_pruned,
+      TransitionPaths *paths = nullptr, BudgetMeter *meter = nullptr,
+      double source_factor = 0, bool goal_directed = false,
+      double eu_dist = -1, bool log_space = false,
+      UTIL::TileCounters *tile = nullptr);
+  /**
+   * Match a trajectory, finding where its matching breaks if no
+   * complete path is found
+   * @param  traj   input trajectory data
+   * @param  config configuration of stmatch algorithm
+   * @param  brk    updated with the break, which is not searched if null
+   * @param  meter  budget of the trajectory, the result is partial if it
+   * runs out
+   * @return map matching result
+   */
+  /**
+   * Match a trajectory whose points are filtered if enabled, mapping the
+   * result and the break back to the original points
+   * @param  traj   input trajectory data
+   * @param  config configuration of map matching algorithm
+   * @param  brk    updated with the break, which is not searched if null
+   * @param  meter  budget of the trajectory
+   * @param  workspace buffers of the matching
+   * @return map matching result
+   */
+  MatchResult match_filtered(const CORE::Trajectory &traj,
+                             const STMATCHConfig &config,
+                             TrajectoryBreak *brk, BudgetMeter *meter,
+                             MatchWorkspace *workspace);
+  MatchResult match_segment(const CORE::Trajectory &traj,
+                            const STMATCHConfig &config,
+                            TrajectoryBreak *brk, BudgetMeter *meter,
+                            MatchWorkspace *workspace);
+  /**
+   * Find the first node of an optimal path which is not reached from the
+   * previous one within the upper bound of the search
+   * @param  opath optimal path
+   * @return index of the node, or -1 if the path is connected
+   */
+  static int find_break(const TGOpath &opath);
 
   /**
    * Return distances from source to all targets and with an upper bound of
@@ -129,13 +517,75 @@ class STMATCH {
    * @param  source  Source node
    * @param  targets A vector of target nodes
    * @param  delta   An upper bound value to constrain the search
+   * @param  entries If not nullptr, network nodes passed by every path
+   * reaching a target, which prune the search with the landmarks of the
+   * network graph
+   * @param  points  If not nullptr, the points of the targets. The search
+   * is an A* search ordered by the distance plus the Euclidean distance
+   * to the nearest target, which assumes that the edges are not shorter
+   * than the straight line between their nodes.
    * @return A vector of distances to the target nodes, if any target node
    * is not reached, infinity distance will be returned for that node.
    */
   std::vector<double> shortest_path_upperbound(
       int level,
       const CompositeGraph &cg, NETWORK::NodeIndex source,
-      const std::vector<NETWORK::NodeIndex> &targets, double delta);
+      const std::vector<NETWORK::NodeIndex> &targets, double delta,
+      const std::vector<NETWORK::NodeIndex> *entries = nullptr,
+      const std::vector<CORE::Point> *points = nullptr);
+
+  /**
+   * Return distances from several sources to all targets with an upper
+   * bound of delta, in one search which keeps a label per source at each
+   * node, so that the region shared by the sources is explored once
+   * @param  cg      Composition graph
+   * @param  sources A vector of source nodes
+   * @param  targets A vector of target nodes
+   * @param  delta   An upper bound value to constrain the search
+   * @param  entries If not nullptr, network nodes passed by every path
+   * reaching a target, which prune the search with the landmarks of the
+   * network graph
+   * @param  paths   If not nullptr, updated with the network edges between
+   * the candidate edges of each source and target reached, in the row of
+   * the source
+   * @param  needed  If not nullptr, whether source k and target j, at
+   * k*targets.size()+j, may be reached within delta. The search stops
+   * once the pairs needed are settled.
+   * @param  source_deltas If not nullptr, the upper bound of each source,
+   * at most delta
+   * @param  points  If not nullptr, the points of the targets, which
+   * direct the search toward the nearest target as in
+   * shortest_path_upperbound
+   * @return distances indexed by the source and then the target, where
+   * infinity distance is returned for a target not reached
+   */
+  std::vector<std::vector<double>> shortest_path_upperbound_multi(
+      const CompositeGraph &cg,
+      const std::vector<NETWORK::NodeIndex> &sources,
+      const std::vector<NETWORK::NodeIndex> &targets, double delta,
+      const std::vector<NETWORK::NodeIndex> *entries = nullptr,
+      TransitionPaths *paths = nullptr,
+      const std::vector<char> *needed = nullptr,
+      const std::vector<double> *source_deltas = nullptr,
+      const std::vector<CORE::Point> *points = nullptr);
+
+  /**
+   * Return distances from each candidate of layer a to each candidate of
+   * layer b with an upper bound of delta, which are computed between the
+   * end nodes of the candidate edges with the contraction hierarchy, or
+   * with the path cache if no hierarchy is given
+   * @param  la    layer a
+   * @param  lb    layer b next to a
+   * @param  delta An upper bound value to constrain the search
+   * @param  skip_pruned leave out the nodes of layer a pruned by a beam
+   * @param  source_factor factor of the bound of each node of layer a, as
+   * in layer_distances
+   * @return distances indexed by the node of layer a and then the node of
+   * layer b, where infinity distance is returned for a pair not reached
+   */
+  std::vector<std::vector<double>> shortest_path_upperbound_nodes(
+      const TGLayer &la, const TGLayer &lb, double delta,
+      bool skip_pruned = true, double source_factor = 0) const;
 
   /**
    * Create a topologically connected path according to each matched
@@ -143,12 +593,21 @@ class STMATCH {
    * @param  tg_opath A sequence of optimal candidate nodes
    * @param  indices  the indices to be updated to store the index of matched
    * edge or candidate in the returned path.
+   * @param  paths    if not nullptr, the paths of the transitions kept by
+   * update_tg, which are not searched again
+   * @param  index_path if not nullptr, updated with the returned path
+   * stored with edge index
    * @return A vector of edge id representing the traversed path
    */
-  C_Path build_cpath(const TGOpath &tg_opath, std::vector<int> *indices);
+  C_Path build_cpath(const TGOpath &tg_opath, std::vector<int> *indices,
+                     const TransitionPaths *paths = nullptr,
+                     std::vector<NETWORK::EdgeIndex> *index_path = nullptr);
  private:
+  friend class STMATCHStream;
   const NETWORK::Network &network_;
   const NETWORK::NetworkGraph &graph_;
+  const NETWORK::ContractionHierarchy *hierarchy_;
+  NETWORK::PathCache *cache_;
 };// STMATCH
 }
 } // FMM
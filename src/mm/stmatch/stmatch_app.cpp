@@ -3,27 +3,184 @@
 //
 
 #include "mm/stmatch/stmatch_app.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "io/async_writer.hpp"
+#include "io/edge_aggregate_writer.hpp"
+#include "io/match_pipeline.hpp"
+#include "io/rematch_filter.hpp"
+#include "io/sweep_runner.hpp"
+#include "util/metrics.hpp"
+#include "util/stage_profile.hpp"
+#include "util/tile_profile.hpp"
+
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <omp.h>
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
+
+namespace {
+
+// Match a trajectory into the segments written, a single one if the
+// trajectory is not split, with the timestamps of their points if used
+std::vector<SegmentMatchResult> match_trajectory(
+    STMATCH *mm_model, const Trajectory &trajectory,
+    const STMATCHConfig &config) {
+  std::vector<SegmentMatchResult> segments;
+  if (!config.split) {
+    segments.push_back(SegmentMatchResult{
+        -1, -1, mm_model->match_traj(trajectory, config)});
+  } else {
+    segments = mm_model->match_traj_segments(trajectory, config);
+  }
+  if (config.result_fields.timestamps) {
+    IO::copy_timestamps(trajectory, &segments);
+  }
+  return segments;
+}
+
+// Match the trajectories with all the settings of a sweep, into a result
+// file per setting
+void match_sweep(STMATCH *mm_model, IO::GPSReader *reader,
+                 const STMATCHAppConfig &app_config,
+                 const STMATCHConfig &config,
+                 const NETWORK::Network &network) {
+  ParameterSweep sweep;
+  if (!ParameterSweep::parse(app_config.sweep, &sweep)) return;
+  std::vector<SweepSetting> settings = sweep.get_settings(SweepSetting{
+      config.k, config.radius, config.gps_error, config.vmax,
+      config.factor});
+  SPDLOG_INFO("Sweep {} settings", settings.size());
+  IO::SweepRunOptions options;
+  options.use_omp = app_config.use_omp;
+  if (app_config.step > 0) options.step = app_config.step;
+  options.report_file = app_config.sweep_file;
+  IO::run_sweep(
+      reader, app_config.result_config, &network, settings,
+      [&](const Trajectory &trajectory, SweepReport *report) {
+        std::vector<MatchResult> results = mm_model->match_traj_sweep(
+            trajectory, config, settings, report);
+        if (config.result_fields.timestamps) {
+          for (MatchResult &result : results) {
+            result.timestamps = trajectory.timestamps;
+          }
+        }
+        return results;
+      },
+      options);
+}
+
+} // namespace
 STMATCHApp::STMATCHApp(const STMATCHAppConfig &config) :
     config_(config),
     network_(config_.network_config.file,
              config_.network_config.id,
              config_.network_config.source,
-             config_.network_config.target),
-    ng_(network_) {};
+             config_.network_config.target,
+             config_.network_config.cache,
+             config_.network_config.get_spatial_index_options(),
+             config_.network_config.reorder,
+             config_.network_config.project,
+             config_.network_config.get_clip(),
+             config_.network_config.compress_geometry,
+             config_.network_config.get_cost_names()),
+    ng_(network_, config_.network_config.read_edge_mask(network_)) {};
+
+UTIL::MemoryReport STMATCHApp::get_memory_report() const {
+  UTIL::MemoryReport report;
+  network_.get_memory_usage(&report);
+  ng_.get_memory_usage(&report);
+  return report;
+}
 
-void STMATCHApp::run() {
+bool STMATCHApp::run() {
   UTIL::TimePoint start_time = std::chrono::steady_clock::now();
-  STMATCH mm_model(network_, ng_);
-  const STMATCHConfig &stmatch_config =
-      config_.stmatch_config;
+  std::shared_ptr<ContractionHierarchy> hierarchy;
+  const std::string &hierarchy_file = config_.hierarchy_file;
+  if (!hierarchy_file.empty()) {
+    if (UTIL::file_exists(hierarchy_file)) {
+      hierarchy = ContractionHierarchy::read_hierarchy_file(hierarchy_file,
+                                                            network_);
+      if (hierarchy == nullptr) {
+        SPDLOG_CRITICAL("Fail to load contraction hierarchy, program stop");
+        return false;
+      }
+    } else {
+      hierarchy = std::make_shared<ContractionHierarchy>(
+          network_, std::numeric_limits<double>::infinity(),
+          config_.use_omp, false);
+      hierarchy->write_hierarchy_file(hierarchy_file);
+    }
+  }
+  if (config_.num_landmarks > 0) {
+    landmarks_.reset(new Landmarks(ng_, config_.num_landmarks));
+    ng_.set_landmarks(landmarks_.get());
+  }
+  std::unique_ptr<PathCache> cache;
+  if (config_.path_cache_rows > 0) {
+    cache.reset(new PathCache(ng_, config_.path_cache_rows));
+  }
+  STMATCH mm_model(network_, ng_, hierarchy.get(), cache.get());
+  // Only the fields of the results written are built
+  STMATCHConfig stmatch_config = config_.stmatch_config;
+  stmatch_config.result_fields =
+      IO::get_result_fields(config_.result_config);
   IO::GPSReader reader(config_.gps_config);
-  IO::CSVMatchResultWriter writer(config_.result_config.file,
-                                  config_.result_config.output_config);
+  reader.set_shard(config_.shard, config_.num_shards);
+  if (!config_.sweep.empty()) {
+    match_sweep(&mm_model, &reader, config_, stmatch_config, network_);
+    SPDLOG_INFO("Time takes {}", std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start_time).count());
+    return true;
+  }
+  // With a previous result file, only the trajectories affected by the
+  // changes of the network are matched, into a file merged afterwards
+  CONFIG::ResultConfig result_config = config_.result_config;
+  std::unique_ptr<IO::RematchFilter> rematch;
+  if (!config_.rematch_file.empty()) {
+    std::vector<BoostBox> areas;
+    if (!IO::RematchFilter::parse_areas(config_.changed_areas, &areas)) {
+      return false;
+    }
+    rematch.reset(new IO::RematchFilter(
+        network_, UTIL::string2vec<EdgeID>(config_.changed_edges), areas,
+        stmatch_config.radius));
+    if (!rematch->read_previous(config_.rematch_file)) return false;
+    reader.set_filter([&rematch](const Trajectory &trajectory) {
+      return rematch->select(trajectory);
+    });
+    result_config.file += ".rematch";
+  }
+  // A job resumed appends to the results kept by its checkpoint and skips
+  // their trajectories
+  const std::string &result_file = config_.result_config.file;
+  long skipped = 0;
+  bool append = false;
+  if (config_.resume) {
+    if (UTIL::file_exists(IO::MatchCheckpoint::checkpoint_file(result_file))) {
+      if (!IO::MatchCheckpoint::resume(result_file, &skipped)) return false;
+      append = true;
+    } else {
+      SPDLOG_INFO("No checkpoint of {}, start from the beginning",
+                  result_file);
+    }
+  }
+  std::unique_ptr<IO::MatchResultWriter> writer =
+      IO::MatchResultWriter::create(result_config, append, &network_);
+  if (writer == nullptr) return false;
+  if (append) {
+    skipped = IO::MatchCheckpoint::skip_trajectories(&reader, skipped);
+  }
+  std::unique_ptr<IO::MatchCheckpoint> checkpoint;
+  if (config_.checkpoint_interval > 0) {
+    checkpoint.reset(new IO::MatchCheckpoint(
+        result_file, static_cast<IO::CSVMatchResultWriter *>(writer.get()),
+        config_.checkpoint_interval, skipped));
+  }
   // Start map matching
   int progress = 0;
   int points_matched = 0;
@@ -31,35 +188,71 @@ void STMATCHApp::run() {
   int step_size = 100;
   if (config_.step > 0) step_size = config_.step;
   SPDLOG_INFO("Progress report step {}", step_size);
+  get_memory_report().print();
+  SPDLOG_INFO("Routing workspace up to {:.1f} MB per thread",
+              ng_.get_workspace_bytes() / (1024.0 * 1024.0));
   UTIL::TimePoint corrected_begin = std::chrono::steady_clock::now();
   SPDLOG_INFO("Start to match trajectories");
+  UTIL::StageProfile::set_counters_enabled(config_.profile_counters);
+  UTIL::StageProfile::set_enabled(config_.profile ||
+                                  config_.profile_counters ||
+                                  !config_.profile_file.empty() ||
+                                  !config_.trace_file.empty());
+  if (!config_.trace_file.empty()) {
+    UTIL::StageTrace::start(config_.trace_sample, config_.trace_threshold);
+  }
+  if (!config_.tile_profile_file.empty()) {
+    UTIL::TileProfile::set_tile_size(config_.tile_size);
+  }
+  // The metrics are read by the thread of the exporter while matching
+  IO::MatchPipelineProgress pipeline_progress;
+  UTIL::MetricsExporter metrics(config_.metrics_file,
+                                config_.metrics_interval);
+  if (!config_.metrics_file.empty()) {
+    metrics.add_collector([&pipeline_progress](UTIL::MetricsText *text) {
+      IO::append_pipeline_metrics(&pipeline_progress, text);
+    });
+    metrics.add_collector([this](UTIL::MetricsText *text) {
+      UTIL::append_memory_metrics(get_memory_report(), text);
+    });
+    if (cache != nullptr) {
+      metrics.add_collector([&cache](UTIL::MetricsText *text) {
+        NETWORK::append_path_cache_metrics(*cache, text);
+      });
+    }
+    if (config_.result_config.async_write) {
+      metrics.add_collector([](UTIL::MetricsText *text) {
+        IO::append_async_write_metrics(text);
+      });
+    }
+    metrics.start();
+  }
   if (config_.use_omp){
     SPDLOG_INFO("Run map matching parallelly");
-    int buffer_trajectories_size = 100000;
-    while (reader.has_next_trajectory()) {
-      std::vector<Trajectory> trajectories =
-        reader.read_next_N_trajectories(buffer_trajectories_size);
-      int trajectories_fetched = trajectories.size();
-      #pragma omp parallel for
-      for (int i = 0; i < trajectories_fetched; ++i) {
-        Trajectory &trajectory = trajectories[i];
-        int points_in_tr = trajectory.geom.get_num_points();
-        MM::MatchResult result = mm_model.match_traj(
-            trajectory, stmatch_config);
-        writer.write_result(result);
-        #pragma omp critical
-        if (!result.cpath.empty()) {
-          points_matched += points_in_tr;
-        }
-        total_points += points_in_tr;
-        ++progress;
-        if (progress % step_size == 0) {
-          std::stringstream buf;
-          buf << "Progress " << progress << '\n';
-          std::cout << buf.rdbuf();
-        }
-      }
-    }
+    IO::MatchPipelineOptions options;
+    options.num_matchers = omp_get_max_threads();
+    options.step = step_size;
+    options.chunk_size = config_.chunk_size;
+    options.memory_budget = config_.memory_budget * 1024L * 1024L;
+    // The results of the trajectories reordered are written back in the
+    // input order
+    // The trajectories of a checkpoint are written in the input order
+    options.ordered = config_.ordered_output || config_.spatial_order ||
+        checkpoint != nullptr;
+    options.spatial_order = config_.spatial_order;
+    options.progress = &pipeline_progress;
+    options.checkpoint = checkpoint.get();
+    options.placement = config_.get_thread_placement();
+    IO::MatchPipelineStatistics statistics = IO::run_match_pipeline(
+        &reader, writer.get(),
+        [&](const Trajectory &trajectory) {
+          return match_trajectory(&mm_model, trajectory, stmatch_config);
+        },
+        options);
+    progress = statistics.trajectories;
+    points_matched = statistics.points_matched;
+    total_points = statistics.total_points;
+    IO::print_pipeline_statistics(statistics);
   } else {
     SPDLOG_INFO("Run map matching in single thread");
     while (reader.has_next_trajectory()) {
@@ -68,17 +261,57 @@ void STMATCHApp::run() {
       }
       Trajectory trajectory = reader.read_next_trajectory();
       int points_in_tr = trajectory.geom.get_num_points();
-      MM::MatchResult result = mm_model.match_traj(
-          trajectory, stmatch_config);
-      writer.write_result(result);
-      if (!result.cpath.empty()) {
-        points_matched += points_in_tr;
+      std::vector<SegmentMatchResult> segments =
+          match_trajectory(&mm_model, trajectory, stmatch_config);
+      UTIL::StageClock clock;
+      for (const SegmentMatchResult &segment : segments) {
+        writer->write_result(segment);
       }
+      clock.lap(UTIL::STAGE_WRITE);
+      points_matched += IO::count_points_matched(segments, points_in_tr);
       total_points += points_in_tr;
       ++progress;
+      if (checkpoint != nullptr) checkpoint->update(progress);
+      pipeline_progress.trajectories = progress;
+      pipeline_progress.total_points = total_points;
+      pipeline_progress.points_matched = points_matched;
+      if (UTIL::StageProfile::is_enabled()) {
+        UTIL::StageProfile::local().finish_trajectory(trajectory.id);
+      }
+    }
+  }
+  // The rows buffered by a writer may still fail to be written
+  bool written = writer->close();
+  if (checkpoint != nullptr) checkpoint->save(progress);
+  if (rematch != nullptr && written) {
+    // The results are complete once the writer is closed
+    writer.reset();
+    SPDLOG_INFO("Rematch {} trajectories, {} not affected",
+                rematch->get_selected(), reader.get_filtered());
+    if (rematch->merge(config_.rematch_file, result_config.file,
+                       config_.result_config.file)) {
+      std::remove(result_config.file.c_str());
     }
   }
   SPDLOG_INFO("MM process finished");
+  metrics.stop();
+  UTIL::print_workspace_memory();
+  if (UTIL::StageProfile::is_enabled()) {
+    UTIL::StageStatistics stage_statistics = UTIL::StageProfile::collect();
+    UTIL::StageProfile::print(stage_statistics);
+    if (!config_.profile_file.empty()) {
+      UTIL::StageProfile::write_json(stage_statistics, config_.profile_file);
+    }
+    if (!config_.trace_file.empty()) {
+      UTIL::StageTrace::stop();
+      UTIL::StageTrace::write_json(config_.trace_file);
+    }
+  }
+  if (UTIL::TileProfile::is_enabled()) {
+    std::vector<UTIL::TileStatistics> tiles = UTIL::TileProfile::collect();
+    UTIL::TileProfile::print(tiles);
+    UTIL::TileProfile::write_file(tiles, config_.tile_profile_file);
+  }
   UTIL::TimePoint end_time = std::chrono::steady_clock::now();
   double time_spent = std::chrono::duration_cast<std::chrono::milliseconds>(
       end_time - start_time).count() / 1000.;
@@ -92,5 +325,8 @@ void STMATCHApp::run() {
   SPDLOG_INFO("Point match speed: {}", points_matched / time_spent);
   SPDLOG_INFO("Point match speed (excluding input): {}",
               points_matched / time_spent_exclude_input);
+  network_.print_search_statistics();
+  if (cache != nullptr) cache->print_statistics();
   SPDLOG_INFO("Time takes {}", time_spent);
+  return written;
 };
@@ -14,6 +14,9 @@
 #include "mm/stmatch/stmatch_algorithm.hpp"
 #include "io/gps_reader.hpp"
 #include "io/mm_writer.hpp"
+#include "network/landmarks.hpp"
+
+#include <memory>
 
 namespace FMM {
 namespace MM{
@@ -29,12 +32,19 @@ public:
   STMATCHApp(const STMATCHAppConfig &config);
   /**
    * Run the stmatch program
+   * @return false if the program stops on an error or the results
+   * cannot be written
    */
-  void run();
+  bool run();
  private:
+  /**
+   * Collect the memory of the structures loaded
+   */
+  UTIL::MemoryReport get_memory_report() const;
   const STMATCHAppConfig &config_;
   NETWORK::Network network_;
   NETWORK::NetworkGraph ng_;
+  std::unique_ptr<NETWORK::Landmarks> landmarks_;
 };
 }
 }
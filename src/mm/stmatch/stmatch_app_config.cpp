@@ -23,6 +23,8 @@ STMATCHAppConfig::STMATCHAppConfig(int argc, char **argv){
   } else {
     load_arg(argc,argv);
   }
+  // The results written to stdout are not mixed with the logs
+  if (result_config.file == "-") UTIL::log_to_stderr();
   spdlog::set_level((spdlog::level::level_enum) log_level);
   if (!help_specified)
     print();
@@ -38,9 +40,49 @@ void STMATCHAppConfig::load_xml(const std::string &file){
   gps_config = GPSConfig::load_from_xml(tree);
   result_config = CONFIG::ResultConfig::load_from_xml(tree);
   stmatch_config = STMATCHConfig::load_from_xml(tree);
+  result_config.output_config.write_segment = stmatch_config.split;
+  result_config.output_config.write_partial =
+      stmatch_config.get_match_budget().is_enabled();
+  hierarchy_file = tree.get("config.input.hierarchy.file", std::string(""));
+  num_landmarks = tree.get("config.parameters.landmarks", 0);
+  path_cache_rows = tree.get("config.parameters.path_cache_rows", 0L);
   log_level = tree.get("config.other.log_level",2);
   step =  tree.get("config.other.step",100);
+  chunk_size = tree.get("config.other.chunk_size",64);
+  memory_budget = tree.get("config.other.memory_budget",0);
+  thread_placement = tree.get("config.other.thread_placement",
+                              std::string("none"));
   use_omp = !(!tree.get_child_optional("config.other.use_omp"));
+  ordered_output =
+      !(!tree.get_child_optional("config.other.ordered_output"));
+  spatial_order = !(!tree.get_child_optional("config.other.spatial_order"));
+  profile = !(!tree.get_child_optional("config.other.profile"));
+  profile_file = tree.get("config.other.profile_file", std::string(""));
+  profile_counters =
+      !(!tree.get_child_optional("config.other.profile_counters"));
+  trace_file = tree.get("config.other.trace.file", std::string(""));
+  trace_sample = tree.get("config.other.trace.sample", 1000L);
+  trace_threshold = tree.get("config.other.trace.threshold", 0.0);
+  tile_profile_file =
+      tree.get("config.other.tile_profile.file", std::string(""));
+  tile_size = tree.get("config.other.tile_profile.tile_size", 1000.0);
+  metrics_file = tree.get("config.other.metrics_file", std::string(""));
+  metrics_interval = tree.get("config.other.metrics_interval", 15);
+  checkpoint_interval = tree.get("config.other.checkpoint_interval", 0.0);
+  resume = !(!tree.get_child_optional("config.other.resume"));
+  rematch_file = tree.get("config.input.rematch.file", std::string(""));
+  changed_edges = tree.get("config.input.rematch.changed_edges",
+                           std::string(""));
+  changed_areas = tree.get("config.input.rematch.changed_areas",
+                           std::string(""));
+  shard = tree.get("config.input.shard", 0);
+  num_shards = tree.get("config.input.num_shards", 1);
+  sweep = tree.get("config.other.sweep.parameters", std::string(""));
+  sweep_file = tree.get("config.other.sweep.file", std::string(""));
+  if (num_shards > 1) {
+    result_config.file = CONFIG::ResultConfig::get_shard_file(
+        result_config.file, shard, num_shards);
+  }
   SPDLOG_INFO("Finish with reading stmatch xml configuration");
 };
 
@@ -56,6 +98,43 @@ void STMATCHAppConfig::load_arg(int argc, char **argv){
     cxxopts::value<std::string>()->default_value("source"))
     ("target","Network target name",
     cxxopts::value<std::string>()->default_value("target"))
+    ("no_network_cache","Do not read or write the network cache")
+    ("rtree","Rtree algorithm",
+    cxxopts::value<std::string>()->default_value("packing"))
+    ("rtree_max_elements","Rtree node capacity",
+    cxxopts::value<int>()->default_value("16"))
+    ("rtree_chunk_segments","Segments of the edge chunks in the rtree",
+    cxxopts::value<int>()->default_value("0"))
+    ("spatial_index","Spatial index of the edges",
+    cxxopts::value<std::string>()->default_value("rtree"))
+    ("grid_cell_size","Cell size of the grid index",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_batch_size","Points searched with one spatial index query",
+    cxxopts::value<int>()->default_value("1"))
+    ("nearest_search","Search the candidates with the nearest query")
+    ("search_initial_radius","Radius of the first search of a point",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_min_candidates","Candidates below which the radius grows",
+    cxxopts::value<int>()->default_value("1"))
+    ("search_radius_growth","Factor of each growth of the radius",
+    cxxopts::value<double>()->default_value("2"))
+    ("search_snap_resolution","Cell size of the snapping cache",
+    cxxopts::value<double>()->default_value("0"))
+    ("search_snap_items","Maximum edges cached by the snapping cache",
+    cxxopts::value<long>()->default_value(
+        std::to_string(NETWORK::SnapCache::DEFAULT_CACHE_ITEMS)))
+    ("reorder_network","Renumber nodes along the Hilbert curve")
+    ("project_network","Project a lon/lat network into metres")
+    ("compress_geometry","Keep the edge geometries compressed")
+    ("twin_edges","Index the twin edges of two-way roads once")
+    ("network_clip","Region of the network read, box or WKT polygon",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_clip_margin","Margin around the network clip region",
+      cxxopts::value<double>()->default_value("0"))
+    ("network_costs","Extra cost columns of the network",
+      cxxopts::value<std::string>()->default_value(""))
+    ("network_edge_mask","File of the ids of the edges allowed",
+      cxxopts::value<std::string>()->default_value(""))
     ("gps","GPS file name",
       cxxopts::value<std::string>()->default_value(""))
     ("gps_id","GPS file id",
@@ -68,25 +147,122 @@ void STMATCHAppConfig::load_arg(int argc, char **argv){
     cxxopts::value<std::string>()->default_value("geom"))
     ("gps_timestamp",   "GPS file timestamp column name",
     cxxopts::value<std::string>()->default_value("timestamp"))
+    ("gps_read_threads","Threads reading a GPS file",
+    cxxopts::value<int>())
+    ("gps_timestamp_format","Format of the timestamps of a CSV file",
+    cxxopts::value<std::string>())
     ("k,candidates","Number of candidates",
     cxxopts::value<int>()->default_value("8"))
     ("r,radius","Search radius",
     cxxopts::value<double>()->default_value("300.0"))
     ("e,error","GPS error",
     cxxopts::value<double>()->default_value("50.0"))
+    ("min_ep_ratio","Minimum emission probability ratio to the best",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_dist_ratio","Maximum distance ratio to the best candidate",
+    cxxopts::value<double>()->default_value("0"))
+    ("adaptive_k_spacing","Point spacing below which k is reduced",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_heading_diff","Maximum angle between point heading and edge",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_heading_distance","Neighbour distance giving a reliable heading",
+    cxxopts::value<double>()->default_value("0"))
+    ("beam_size","Maximum number of states expanded per layer",
+    cxxopts::value<int>()->default_value("0"))
+    ("beam_margin","Maximum log probability difference to the best state",
+    cxxopts::value<double>()->default_value("0"))
+    ("split","Split the trajectories at the breaks of the matching")
+    ("max_time_gap","Time gap splitting the trajectories",
+    cxxopts::value<double>()->default_value("0"))
+    ("parallel_viterbi","Points from which a trajectory runs in parallel",
+    cxxopts::value<int>()->default_value("0"))
+    ("stationary_radius","Radius of the stationary clusters collapsed",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_distance","Minimum distance between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("min_interval","Minimum time between the points matched",
+    cxxopts::value<double>()->default_value("0"))
+    ("approximate_ep","Approximate the emission probabilities")
+    ("goal_directed","Direct the searches toward their targets")
+    ("max_seconds","Maximum seconds spent on a trajectory",
+    cxxopts::value<double>()->default_value("0"))
+    ("max_transitions","Maximum transitions evaluated for a trajectory",
+    cxxopts::value<long>()->default_value("0"))
+    ("max_settled","Maximum nodes visited for a trajectory",
+    cxxopts::value<long>()->default_value("0"))
     ("vmax","Maximum speed",
     cxxopts::value<double>()->default_value("80.0"))
     ("factor","Scale factor",
     cxxopts::value<double>()->default_value("1.5"))
+    ("hierarchy","Contraction hierarchy file name",
+      cxxopts::value<std::string>()->default_value(""))
+    ("landmarks","Number of landmarks",
+      cxxopts::value<int>()->default_value("0"))
+    ("path_cache_rows","Maximum rows in the shortest path cache",
+      cxxopts::value<long>()->default_value("0"))
     ("o,output","Output file name",
       cxxopts::value<std::string>()->default_value(""))
     ("m,output_fields","Output fields",
       cxxopts::value<std::string>()->default_value(""))
+    ("output_precision","Decimals of the coordinates written",
+      cxxopts::value<int>())
+    ("output_geometry_encoding","Encoding of the geometries written, "
+     "wkt, hexwkb, wkb, polyline or delta",
+      cxxopts::value<std::string>())
+    ("output_format","Format of the output file, csv, arrow, edges, "
+     "index or state",
+      cxxopts::value<std::string>())
+    ("output_shard_size","Rows written into each shard of the output",
+      cxxopts::value<int>())
+    ("output_async","Write the output by a thread of its own")
     ("l,log_level","Log level",cxxopts::value<int>()->default_value("2"))
     ("s,step","Step report",cxxopts::value<int>()->default_value("100"))
+    ("chunk_size","Trajectories taken at once by a matcher thread",
+    cxxopts::value<int>()->default_value("64"))
+    ("memory_budget","Memory of the trajectories held in MB",
+    cxxopts::value<int>()->default_value("0"))
+    ("thread_placement","Placement of the matcher threads",
+    cxxopts::value<std::string>()->default_value("none"))
     ("h,help","Help information")
     ("gps_point","GPS point or not")
-    ("use_omp","Use omp or not");
+    ("use_omp","Use omp or not")
+    ("ordered_output","Write the results in the input order if specified")
+    ("spatial_order","Match nearby trajectories together if specified")
+    ("profile","Report the time spent in each stage if specified")
+    ("profile_counters","Count hardware events of each stage if specified")
+    ("profile_file","JSON file of the time spent in each stage",
+    cxxopts::value<std::string>()->default_value(""))
+    ("trace_file","Chrome trace file of the trajectories sampled",
+    cxxopts::value<std::string>()->default_value(""))
+    ("trace_sample","1 in trace_sample trajectories traced",
+    cxxopts::value<long>()->default_value("1000"))
+    ("trace_threshold","Trajectories slower than it traced in seconds",
+    cxxopts::value<double>()->default_value("0"))
+    ("tile_profile_file","GeoJSON or CSV file of the work per tile",
+    cxxopts::value<std::string>()->default_value(""))
+    ("tile_size","Size of the tiles of the tile profile",
+    cxxopts::value<double>()->default_value("1000"))
+    ("metrics_file","Prometheus text file of the metrics of the job",
+    cxxopts::value<std::string>()->default_value(""))
+    ("metrics_interval","Seconds between two writes of the metrics file",
+    cxxopts::value<int>()->default_value("15"))
+    ("checkpoint_interval","Seconds between two checkpoints of the results",
+    cxxopts::value<double>()->default_value("0"))
+    ("resume","Resume from the checkpoint of the result file")
+    ("rematch","Previous result file whose affected trajectories rematch",
+    cxxopts::value<std::string>()->default_value(""))
+    ("changed_edges","ID of the edges changed separated by ,",
+    cxxopts::value<std::string>()->default_value(""))
+    ("changed_areas","Areas changed as minx,miny,maxx,maxy separated by ;",
+    cxxopts::value<std::string>()->default_value(""))
+    ("shard","Shard of the input matched, from 0",
+    cxxopts::value<int>()->default_value("0"))
+    ("num_shards","Number of shards the input is split into",
+    cxxopts::value<int>()->default_value("1"))
+    ("sweep","Values of the parameters swept, as k=4,8;radius=100,300",
+    cxxopts::value<std::string>()->default_value(""))
+    ("sweep_file","CSV file of the results and time of each setting",
+    cxxopts::value<std::string>()->default_value(""));
   if (argc==1) {
     help_specified = true;
     return;
@@ -96,9 +272,43 @@ void STMATCHAppConfig::load_arg(int argc, char **argv){
   gps_config = GPSConfig::load_from_arg(result);
   result_config = CONFIG::ResultConfig::load_from_arg(result);
   stmatch_config = STMATCHConfig::load_from_arg(result);
+  result_config.output_config.write_segment = stmatch_config.split;
+  result_config.output_config.write_partial =
+      stmatch_config.get_match_budget().is_enabled();
+  hierarchy_file = result["hierarchy"].as<std::string>();
+  num_landmarks = result["landmarks"].as<int>();
+  path_cache_rows = result["path_cache_rows"].as<long>();
   log_level = result["log_level"].as<int>();
   step = result["step"].as<int>();
+  chunk_size = result["chunk_size"].as<int>();
+  memory_budget = result["memory_budget"].as<int>();
+  thread_placement = result["thread_placement"].as<std::string>();
   use_omp = result.count("use_omp")>0;
+  ordered_output = result.count("ordered_output")>0;
+  spatial_order = result.count("spatial_order")>0;
+  profile = result.count("profile")>0;
+  profile_file = result["profile_file"].as<std::string>();
+  profile_counters = result.count("profile_counters")>0;
+  trace_file = result["trace_file"].as<std::string>();
+  trace_sample = result["trace_sample"].as<long>();
+  trace_threshold = result["trace_threshold"].as<double>();
+  tile_profile_file = result["tile_profile_file"].as<std::string>();
+  tile_size = result["tile_size"].as<double>();
+  metrics_file = result["metrics_file"].as<std::string>();
+  metrics_interval = result["metrics_interval"].as<int>();
+  checkpoint_interval = result["checkpoint_interval"].as<double>();
+  resume = result.count("resume")>0;
+  rematch_file = result["rematch"].as<std::string>();
+  changed_edges = result["changed_edges"].as<std::string>();
+  changed_areas = result["changed_areas"].as<std::string>();
+  shard = result["shard"].as<int>();
+  num_shards = result["num_shards"].as<int>();
+  sweep = result["sweep"].as<std::string>();
+  sweep_file = result["sweep_file"].as<std::string>();
+  if (num_shards > 1) {
+    result_config.file = CONFIG::ResultConfig::get_shard_file(
+        result_config.file, shard, num_shards);
+  }
   if (result.count("help")>0){
     help_specified = true;
   }
@@ -111,9 +321,49 @@ void STMATCHAppConfig::print() const {
   gps_config.print();
   result_config.print();
   stmatch_config.print();
+  if (!hierarchy_file.empty()) {
+    SPDLOG_INFO("Contraction hierarchy file {}",hierarchy_file);
+  }
+  SPDLOG_INFO("Landmarks {}",num_landmarks);
+  SPDLOG_INFO("Path cache rows {}",path_cache_rows);
   SPDLOG_INFO("Log level {}",UTIL::LOG_LEVESLS[log_level])
   SPDLOG_INFO("Step {}",step)
+  SPDLOG_INFO("Chunk size {}",chunk_size)
+  SPDLOG_INFO("Memory budget {} MB",memory_budget)
+  SPDLOG_INFO("Thread placement {}",thread_placement)
   SPDLOG_INFO("Use omp {}",(use_omp ? "true" : "false"))
+  SPDLOG_INFO("Ordered output {}",(ordered_output ? "true" : "false"))
+  SPDLOG_INFO("Spatial order {}",(spatial_order ? "true" : "false"))
+  SPDLOG_INFO("Profile {}",(profile ? "true" : "false"))
+  SPDLOG_INFO("Profile counters {}",(profile_counters ? "true" : "false"))
+  if (!profile_file.empty()) {
+    SPDLOG_INFO("Profile file {}",profile_file)
+  }
+  if (!trace_file.empty()) {
+    SPDLOG_INFO("Trace file {} sample {} threshold {}",trace_file,
+                trace_sample,trace_threshold)
+  }
+  if (!tile_profile_file.empty()) {
+    SPDLOG_INFO("Tile profile file {} tile size {}",tile_profile_file,
+                tile_size)
+  }
+  if (!metrics_file.empty()) {
+    SPDLOG_INFO("Metrics file {} interval {}",metrics_file,metrics_interval)
+  }
+  if (checkpoint_interval > 0 || resume) {
+    SPDLOG_INFO("Checkpoint interval {} resume {}",checkpoint_interval,
+                (resume ? "true" : "false"))
+  }
+  if (!rematch_file.empty()) {
+    SPDLOG_INFO("Rematch {} changed edges {} areas {}",rematch_file,
+                changed_edges,changed_areas)
+  }
+  if (num_shards > 1) {
+    SPDLOG_INFO("Input shard {} of {}",shard,num_shards);
+  }
+  if (!sweep.empty()) {
+    SPDLOG_INFO("Sweep {} report {}",sweep,sweep_file);
+  }
   SPDLOG_INFO("---- Print configuration done ----")
 };
 
@@ -123,32 +373,324 @@ void STMATCHAppConfig::print_help(){
   std::cout<<"--network_id (optional) <string>: Network id name (id)\n";
   std::cout<<"--source (optional) <string>: Network source name (source)\n";
   std::cout<<"--target (optional) <string>: Network target name (target)\n";
-  std::cout<<"--gps (required) <string>: GPS file name\n";
+  std::cout<<"--no_network_cache: do not read or write the network cache\n";
+  std::cout<<"  file, which is created next to the network file\n";
+  std::cout<<"--rtree (optional) <string>: Rtree algorithm of the edges,\n";
+  std::cout<<"  packing, linear, quadratic or rstar (packing)\n";
+  std::cout<<"--rtree_max_elements (optional) <int>: Maximum number of\n";
+  std::cout<<"  elements in a rtree node (16)\n";
+  std::cout<<"--rtree_chunk_segments (optional) <int>: Maximum number of\n";
+  std::cout<<"  segments of the chunks of a long edge indexed by the\n";
+  std::cout<<"  rtree, 0 for the whole edges (0)\n";
+  std::cout<<"--spatial_index (optional) <string>: Spatial index of the\n";
+  std::cout<<"  edges in candidate search, rtree, flat or grid (rtree)\n";
+  std::cout<<"--grid_cell_size (optional) <double>: Cell size of the grid\n";
+  std::cout<<"  index, close to the search radius, 0 for the mean extent\n";
+  std::cout<<"  of the edges (0)\n";
+  std::cout<<"--search_batch_size (optional) <int>: Number of consecutive\n";
+  std::cout<<"  points searched with one spatial index query (1)\n";
+  std::cout<<"--nearest_search: search the k candidates of a point with\n";
+  std::cout<<"  the incremental nearest query of the rtree\n";
+  std::cout<<"--search_initial_radius (optional) <double>: radius of the\n";
+  std::cout<<"  first search of a point, multiplied by the growth until the\n";
+  std::cout<<"  point has the minimum candidates or the radius is reached,\n";
+  std::cout<<"  0 to search with the radius directly (0)\n";
+  std::cout<<"--search_min_candidates (optional) <int>: candidates of a point\n";
+  std::cout<<"  below which its search radius grows (1)\n";
+  std::cout<<"--search_radius_growth (optional) <double>: factor of each\n";
+  std::cout<<"  growth of the search radius (2)\n";
+  std::cout<<"--search_snap_resolution (optional) <double>: cell size\n";
+  std::cout<<"  of the snapping cache of the edges near the points,\n";
+  std::cout<<"  which are reused by the points in the same cell (0)\n";
+  std::cout<<"--search_snap_items (optional) <long>: maximum edges\n";
+  std::cout<<"  cached by the snapping cache (10000000)\n";
+  std::cout<<"--reorder_network: renumber nodes along the Hilbert curve\n";
+  std::cout<<"--project_network: project a network in longitude and\n";
+  std::cout<<"  latitude into metres, so that radius, gps_error, vmax and\n";
+  std::cout<<"  the distances are in metres\n";
+  std::cout<<"--compress_geometry: keep the edge geometries delta and\n";
+  std::cout<<"  varint encoded, decoded on demand, which saves memory\n";
+  std::cout<<"--twin_edges: pair the edges of two-way roads whose\n";
+  std::cout<<"  geometries are reversed, indexed once in the rtree and\n";
+  std::cout<<"  sharing their geometry\n";
+  std::cout<<"--network_clip (optional) <string>: read only the edges in\n";
+  std::cout<<"  a box minx,miny,maxx,maxy or a WKT polygon of the network\n";
+  std::cout<<"--network_clip_margin (optional) <double>: margin added\n";
+  std::cout<<"  around the clip region (0)\n";
+  std::cout<<"--network_costs (optional) <string>: numeric columns of\n";
+  std::cout<<"  the network read as the costs of the edges under other\n";
+  std::cout<<"  metrics, separated by comma, e.g., time\n";
+  std::cout<<"--network_edge_mask (optional) <string>: file of the ids\n";
+  std::cout<<"  of the edges allowed to the vehicles matched, such as the\n";
+  std::cout<<"  edges open to trucks, the others are not routed\n";
+  std::cout<<"--gps (required) <string>: GPS file name, or - to read\n";
+  std::cout<<"  the rows of a CSV trajectory file from stdin, or PG:\n";
+  std::cout<<"  followed by a connection string and table=<name> to read\n";
+  std::cout<<"  a PostGIS table\n";
   std::cout<<"--gps_id (optional) <string>: GPS id name (id)\n";
   std::cout<<"--gps_x (optional) <string>: GPS x name (x)\n";
   std::cout<<"--gps_y (optional) <string>: GPS y name (y)\n";
   std::cout<<"--gps_timestamp (optional) <string>: "
              "GPS timestamp name (timestamp)\n";
   std::cout<<"--gps_geom (optional) <string>: GPS geometry name (geom)\n";
+  std::cout<<"--gps_read_threads (optional) <int>: threads reading a\n";
+  std::cout<<"  CSV, shapefile or GeoPackage GPS file in blocks (1)\n";
+  std::cout<<"--gps_timestamp_format (optional) <string>: timestamps of\n";
+  std::cout<<"  a CSV file in seconds, ms, us or iso8601 (seconds)\n";
   std::cout<<"-k/--candidates (optional) <int>: number of candidates (8)\n";
   std::cout<<"-r/--radius (optional) <double>: search "
     "radius (network data unit) (300)\n";
   std::cout<<"-e/--error (optional) <double>: GPS error "
              "(network data unit) (50)\n";
+  std::cout<<"--min_ep_ratio (optional) <double>: minimum ratio of the\n";
+  std::cout<<"  emission probability of a candidate to the best one (0)\n";
+  std::cout<<"--max_dist_ratio (optional) <double>: maximum ratio of the\n";
+  std::cout<<"  distance of a candidate to the best one, at least the\n";
+  std::cout<<"  GPS error, 0 to disable (0)\n";
+  std::cout<<"--adaptive_k_spacing (optional) <double>: points closer to\n";
+  std::cout<<"  their neighbours than this spacing keep proportionally\n";
+  std::cout<<"  fewer candidates, 0 to disable (0)\n";
+  std::cout<<"--max_heading_diff (optional) <double>: drop the candidates\n";
+  std::cout<<"  whose edge direction differs from the heading of their\n";
+  std::cout<<"  point by more than this angle in degrees, keeping the\n";
+  std::cout<<"  nearest one, 0 to disable (0)\n";
+  std::cout<<"--min_heading_distance (optional) <double>: distance\n";
+  std::cout<<"  between the previous and next points below which the\n";
+  std::cout<<"  heading of a point is not used (0)\n";
+  std::cout<<"--beam_size (optional) <int>: maximum number of states\n";
+  std::cout<<"  expanded per layer by a log space beam search Viterbi,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--beam_margin (optional) <double>: maximum difference of\n";
+  std::cout<<"  log probability of a state expanded to the best one,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--split (optional): split the trajectories where a point\n";
+  std::cout<<"  has no candidate or is not reached from the previous\n";
+  std::cout<<"  point, matching and writing the segments separately\n";
+  std::cout<<"--max_time_gap (optional) <double>: with --split, time gap\n";
+  std::cout<<"  between two points splitting the trajectory, 0 to\n";
+  std::cout<<"  disable (0)\n";
+  std::cout<<"--parallel_viterbi (optional) <int>: number of points from\n";
+  std::cout<<"  which the transitions of a trajectory are computed in\n";
+  std::cout<<"  parallel, 0 to disable (0)\n";
+  std::cout<<"--stationary_radius (optional) <double>: consecutive points\n";
+  std::cout<<"  within this radius of the first one are matched as their\n";
+  std::cout<<"  centroid, 0 to disable (0)\n";
+  std::cout<<"--min_distance (optional) <double>: points closer to the\n";
+  std::cout<<"  last point matched are not matched but take its result,\n";
+  std::cout<<"  0 to disable (0)\n";
+  std::cout<<"--min_interval (optional) <double>: points within this\n";
+  std::cout<<"  time of the last point matched are not matched but take\n";
+  std::cout<<"  its result, 0 to disable (0)\n";
+  std::cout<<"--approximate_ep: compute the emission probabilities with\n";
+  std::cout<<"  a vectorized approximate exponential\n";
+  std::cout<<"--goal_directed: direct the searches of the transitions\n";
+  std::cout<<"  toward their targets and, without timestamps, bound the\n";
+  std::cout<<"  search of each candidate by its distance to the next\n";
+  std::cout<<"  candidates\n";
+  std::cout<<"--max_seconds (optional) <double>: seconds after which\n";
+  std::cout<<"  the matching of a trajectory stops with a partial result\n";
+  std::cout<<"  of its first points, 0 to disable (0)\n";
+  std::cout<<"--max_transitions (optional) <int>: pairs of candidates\n";
+  std::cout<<"  evaluated after which the matching of a trajectory stops\n";
+  std::cout<<"  with a partial result, 0 to disable (0)\n";
+  std::cout<<"--max_settled (optional) <int>: nodes visited by the\n";
+  std::cout<<"  searches after which the matching of a trajectory stops\n";
+  std::cout<<"  with a partial result, 0 to disable (0)\n";
   std::cout<<"-f/--factor (optional) <double>: scale factor (1.5)\n";
   std::cout<<"-v/--vmax (optional) <double>: "
              " Maximum speed (unit: network_data_unit/s) (30)\n";
-  std::cout<<"-o/--output (required) <string>: Output file name\n";
+  std::cout<<"--hierarchy (optional) <string>: contraction hierarchy "
+             "file used for routing,\n";
+  std::cout<<"  which is built and saved if not exists\n";
+  std::cout<<"--landmarks (optional) <int>: number of landmarks whose "
+             "lower bounds guide the routing (0)\n";
+  std::cout<<"--path_cache_rows (optional) <long>: maximum rows of the "
+             "cache of shortest paths\n";
+  std::cout<<"  shared by the trajectories, 0 to disable (0)\n";
+  std::cout<<"-o/--output (required) <string>: Output file name,\n";
+  std::cout<<"  compressed with gzip if it ends with .gz, or - to write\n";
+  std::cout<<"  the results to stdout as they are matched\n";
   std::cout<<"-m/--output_fields (optional) <string>: Output fields\n";
   std::cout<<"  opath,cpath,tpath,ogeom,mgeom,pgeom,\n";
   std::cout<<"  offset,error,spdist,tp,ep,length,all\n";
+  std::cout<<"--output_precision (optional) <int>: decimals of the\n";
+  std::cout<<"  coordinates of pgeom and mgeom (12 significant digits)\n";
+  std::cout<<"--output_geometry_encoding (optional) <string>: wkt\n";
+  std::cout<<"  (default), hexwkb, polyline for a Google encoded polyline\n";
+  std::cout<<"  or delta for integer coordinates as differences, with the\n";
+  std::cout<<"  precision as decimals (5), or wkb for the arrow output\n";
+  std::cout<<"--output_format (optional) <string>: csv, arrow for an\n";
+  std::cout<<"  Arrow IPC file if fmm is built with WITH_ARROW, or edges\n";
+  std::cout<<"  for a table of the traversals of the edges (csv), or\n";
+  std::cout<<"  index for a binary index of the trajectories traversing\n";
+  std::cout<<"  each edge, or state for a binary match state read by\n";
+  std::cout<<"  fmm_export\n";
+  std::cout<<"--output_shard_size (optional) <int>: rows written into\n";
+  std::cout<<"  each shard of a csv output listed in a manifest (0)\n";
+  std::cout<<"--output_async: write the csv output by a thread of its\n";
+  std::cout<<"  own while the results are formatted\n";
   std::cout<<"--log_level (optional) <int>: log level (2)\n";
   std::cout<<"--step (optional) <int>: progress report step (100)\n";
+  std::cout<<"--chunk_size (optional) <int>: trajectories taken at once\n";
+  std::cout<<"  by a matcher thread, longest first (64)\n";
+  std::cout<<"--memory_budget (optional) <int>: memory of the\n";
+  std::cout<<"  trajectories held in MB, which sets the points of a\n";
+  std::cout<<"  chunk instead of chunk_size (0)\n";
+  std::cout<<"--thread_placement (optional) <string>: with use_omp,\n";
+  std::cout<<"  none, core to pin each matcher to a core or socket to\n";
+  std::cout<<"  bind it to the cores of a NUMA node, the matchers\n";
+  std::cout<<"  spread over the nodes in turn (none)\n";
   std::cout<<"--use_omp: use OpenMP for multithreaded map matching\n";
+  std::cout<<"--ordered_output: with use_omp, write the results in the\n";
+  std::cout<<"  order of the input trajectories\n";
+  std::cout<<"--spatial_order: with use_omp, match the trajectories of a\n";
+  std::cout<<"  chunk along the Hilbert curve of their centers, writing\n";
+  std::cout<<"  the results in the input order\n";
+  std::cout<<"--profile: report the time spent in each stage of the\n";
+  std::cout<<"  matching, with its quantiles per trajectory\n";
+  std::cout<<"--profile_file (optional) <string>: JSON file of the time\n";
+  std::cout<<"  spent in each stage, which enables the profile\n";
+  std::cout<<"--profile_counters: count the instructions, cache, branch\n";
+  std::cout<<"  and TLB misses of each stage with the hardware counters\n";
+  std::cout<<"  of Linux perf_event, which enables the profile\n";
+  std::cout<<"--trace_file (optional) <string>: Chrome trace JSON file\n";
+  std::cout<<"  of the stages of the trajectories sampled, opened by\n";
+  std::cout<<"  chrome://tracing or Perfetto, which enables the profile\n";
+  std::cout<<"--trace_sample (optional) <int>: with trace_file, 1 in\n";
+  std::cout<<"  trace_sample trajectories of a thread traced, 0 for\n";
+  std::cout<<"  none (1000)\n";
+  std::cout<<"--trace_threshold (optional) <double>: with trace_file,\n";
+  std::cout<<"  trajectories slower than it traced in seconds, 0 for\n";
+  std::cout<<"  none (0)\n";
+  std::cout<<"--tile_profile_file (optional) <string>: GeoJSON or CSV\n";
+  std::cout<<"  file of the points, candidates, UBODT probes and misses,\n";
+  std::cout<<"  nodes settled and time of the matching per tile, GeoJSON\n";
+  std::cout<<"  if it ends with .geojson or .json\n";
+  std::cout<<"--tile_size (optional) <double>: with tile_profile_file,\n";
+  std::cout<<"  size of the tiles in the units of the network as matched\n";
+  std::cout<<"  (1000)\n";
+  std::cout<<"--metrics_file (optional) <string>: Prometheus text file\n";
+  std::cout<<"  of the throughput, queues, memory and stage latencies,\n";
+  std::cout<<"  rewritten periodically for the textfile collector of\n";
+  std::cout<<"  the node exporter\n";
+  std::cout<<"--metrics_interval (optional) <int>: seconds between two\n";
+  std::cout<<"  writes of the metrics file (15)\n";
+  std::cout<<"--checkpoint_interval (optional) <double>: seconds between\n";
+  std::cout<<"  two checkpoints of the results written into a csv file,\n";
+  std::cout<<"  saved next to it with the extension .checkpoint, 0 for\n";
+  std::cout<<"  none (0)\n";
+  std::cout<<"--resume: skip the trajectories recorded by the checkpoint\n";
+  std::cout<<"  of the result file and append to it\n";
+  std::cout<<"--rematch (optional) <string>: previous csv result file,\n";
+  std::cout<<"  whose trajectories affected by changed_edges or\n";
+  std::cout<<"  changed_areas are matched again and merged into it,\n";
+  std::cout<<"  written as the output file\n";
+  std::cout<<"--changed_edges (optional) <string>: with rematch, ID of\n";
+  std::cout<<"  the edges changed or removed separated by ,\n";
+  std::cout<<"--changed_areas (optional) <string>: with rematch, areas\n";
+  std::cout<<"  changed as minx,miny,maxx,maxy separated by ;\n";
+  std::cout<<"--shard (optional) <int>: shard of the input matched, from\n";
+  std::cout<<"  0, whose trajectories are selected by the hash of their\n";
+  std::cout<<"  id (0)\n";
+  std::cout<<"--num_shards (optional) <int>: number of shards the input\n";
+  std::cout<<"  is split into, each written into the output file with\n";
+  std::cout<<"  .shard-of-num_shards inserted before its extension (1)\n";
+  std::cout<<"--sweep (optional) <string>: values of the parameters\n";
+  std::cout<<"  swept separated by ; such as k=4,8;radius=100,300, among\n";
+  std::cout<<"  k, radius, gps_error, vmax and factor, whose combinations\n";
+  std::cout<<"  are each written into the output file with _setting\n";
+  std::cout<<"  inserted before its extension. The candidates and\n";
+  std::cout<<"  transitions are computed once for the largest setting.\n";
+  std::cout<<"--sweep_file (optional) <string>: with sweep, CSV file of\n";
+  std::cout<<"  the trajectories matched and time of each setting\n";
   std::cout<<"-h/--help:print help information\n";
   std::cout<<"For xml configuration, check example folder\n";
 }
+UTIL::ThreadPlacement STMATCHAppConfig::get_thread_placement() const {
+  UTIL::ThreadPlacement placement = UTIL::PLACEMENT_NONE;
+  UTIL::string2placement(thread_placement, &placement);
+  return placement;
+}
 bool STMATCHAppConfig::validate() const {
+  if (chunk_size <= 0) {
+    SPDLOG_CRITICAL("Invalid chunk size {}, which should be positive",
+                    chunk_size);
+    return false;
+  }
+  if (memory_budget < 0) {
+    SPDLOG_CRITICAL("Invalid memory budget {}, which should be positive "
+                    "or 0",memory_budget);
+    return false;
+  }
+  UTIL::ThreadPlacement placement;
+  if (!UTIL::string2placement(thread_placement, &placement)) {
+    SPDLOG_CRITICAL("Invalid thread placement {}, which should be none, "
+                    "core or socket",thread_placement);
+    return false;
+  }
+  if (!trace_file.empty() && (trace_sample < 0 || trace_threshold < 0 ||
+                              (trace_sample == 0 && trace_threshold == 0))) {
+    SPDLOG_CRITICAL("Invalid trace sample {} threshold {}, which should "
+                    "be positive or 0, not both 0",trace_sample,
+                    trace_threshold);
+    return false;
+  }
+  if (!tile_profile_file.empty() && tile_size <= 0) {
+    SPDLOG_CRITICAL("Invalid tile size {}, which should be positive",
+                    tile_size);
+    return false;
+  }
+  if (!metrics_file.empty() && metrics_interval <= 0) {
+    SPDLOG_CRITICAL("Invalid metrics interval {}, which should be "
+                    "positive",metrics_interval);
+    return false;
+  }
+  if (checkpoint_interval < 0) {
+    SPDLOG_CRITICAL("Invalid checkpoint interval {}, which should be "
+                    "positive or 0",checkpoint_interval);
+    return false;
+  }
+  if ((checkpoint_interval > 0 || resume) &&
+      (result_config.format != "csv" || result_config.shard_size > 0 ||
+       result_config.file == "-")) {
+    SPDLOG_CRITICAL("Checkpoint is only supported with a single csv "
+                    "result file");
+    return false;
+  }
+  if (!rematch_file.empty() &&
+      (checkpoint_interval > 0 || resume ||
+       result_config.format != "csv" || result_config.shard_size > 0 ||
+       result_config.file == "-" ||
+       UTIL::check_file_extension(result_config.file, "gz") ||
+       UTIL::check_file_extension(rematch_file, "gz"))) {
+    SPDLOG_CRITICAL("Rematch is only supported with uncompressed csv "
+                    "result files, without checkpoint");
+    return false;
+  }
+  if (num_shards < 1 || shard < 0 || shard >= num_shards) {
+    SPDLOG_CRITICAL("Invalid input shard {} of {}, which should be in "
+                    "[0, num_shards)",shard,num_shards);
+    return false;
+  }
+  if (num_shards > 1 && result_config.file == "-") {
+    SPDLOG_CRITICAL("Input shards are written into a result file, not "
+                    "stdout");
+    return false;
+  }
+  if (!sweep.empty()) {
+    MM::ParameterSweep parameter_sweep;
+    if (!MM::ParameterSweep::parse(sweep, &parameter_sweep)) return false;
+    if (!rematch_file.empty() || checkpoint_interval > 0 || resume ||
+        result_config.file == "-") {
+      SPDLOG_CRITICAL("Sweep is written into a result file per setting, "
+                      "without rematch or checkpoint");
+      return false;
+    }
+  }
+  if (!rematch_file.empty() && !UTIL::file_exists(rematch_file)) {
+    SPDLOG_CRITICAL("Previous result file {} not found",rematch_file);
+    return false;
+  }
   if (!gps_config.validate()) {
     return false;
   }
@@ -161,6 +703,22 @@ bool STMATCHAppConfig::validate() const {
   if (!stmatch_config.validate()) {
     return false;
   }
+  if (num_landmarks < 0) {
+    SPDLOG_CRITICAL("Number of landmarks {} should not be negative",
+                    num_landmarks);
+    return false;
+  }
+  if (path_cache_rows < 0) {
+    SPDLOG_CRITICAL("Path cache rows {} should not be negative",
+                    path_cache_rows);
+    return false;
+  }
+  if (!hierarchy_file.empty() && !UTIL::file_exists(hierarchy_file) &&
+      !UTIL::folder_exist(UTIL::get_file_directory(hierarchy_file))) {
+    SPDLOG_CRITICAL("Contraction hierarchy folder {} not exists",
+                    UTIL::get_file_directory(hierarchy_file));
+    return false;
+  }
   return true;
 };
 
@@ -13,6 +13,7 @@
 #include "config/gps_config.hpp"
 #include "config/network_config.hpp"
 #include "config/result_config.hpp"
+#include "util/affinity.hpp"
 #include "mm/stmatch/stmatch_algorithm.hpp"
 
 namespace FMM {
@@ -57,15 +58,86 @@ class STMATCHAppConfig
    * Check the validity of the configuration
    */
   bool validate() const;
+  /**
+   * Get the placement of the matcher threads
+   * @return thread placement, none if the name is invalid
+   */
+  UTIL::ThreadPlacement get_thread_placement() const;
   CONFIG::NetworkConfig network_config; /**< Network data configuraiton */
   CONFIG::GPSConfig gps_config; /**< GPS data configuraiton */
   CONFIG::ResultConfig result_config; /**< Result configuraiton */
   STMATCHConfig stmatch_config; /**< Map matching configuraiton */
+  std::string hierarchy_file; /**< Contraction hierarchy file used for
+                                  routing, built if not exists */
+  int num_landmarks = 0; /**< Number of landmarks guiding the routing,
+                              0 for none */
+  long path_cache_rows = 0; /**< Maximum number of records in the cache
+                                 of shortest paths shared by the
+                                 trajectories, 0 for none */
   bool use_omp = false; /**< If true, parallel map matching performed */
+  bool ordered_output = false; /**< If true, the results of parallel map
+                                   matching keep the input order */
+  bool spatial_order = false; /**< If true, the trajectories of parallel
+                                  map matching are chunked along the
+                                  Hilbert curve, keeping the input order
+                                  of the results */
+  bool profile = false; /**< If true, the time spent in each stage of
+                            the matching is reported */
+  std::string profile_file; /**< JSON file of the time spent in each
+                                 stage, which enables the profile */
+  bool profile_counters = false; /**< If true, the hardware counters of
+                                      each stage are also reported, which
+                                      enables the profile */
+  std::string trace_file; /**< Chrome trace JSON file of the stages of
+                               the trajectories sampled, empty for none */
+  long trace_sample = 1000; /**< 1 in trace_sample trajectories of a
+                                 thread traced, 0 for none */
+  double trace_threshold = 0; /**< Trajectories slower than it traced,
+                                   in seconds, 0 for none */
+  std::string tile_profile_file; /**< GeoJSON or CSV file of the work
+                                       of the matching per tile, empty for
+                                       none */
+  double tile_size = 1000; /**< Size of the tiles of the tile profile, in
+                                the units of the network as matched */
+  std::string metrics_file; /**< Prometheus text file of the metrics of
+                                 the job, empty for none */
+  int metrics_interval = 15; /**< Time between two writes of the metrics
+                                 file, in seconds */
+  double checkpoint_interval = 0; /**< Time between two checkpoints of
+                                       the results written, in seconds,
+                                       0 for none */
+  bool resume = false; /**< If true, the job is resumed from the
+                            checkpoint of its result file */
+  std::string rematch_file; /**< Previous csv result file, whose
+                                 trajectories affected by the changes of
+                                 the network are matched again, empty to
+                                 match all of them */
+  std::string changed_edges; /**< ID of the edges changed, separated
+                                  by , */
+  std::string changed_areas; /**< Areas changed, separated by ; as
+                                  minx,miny,maxx,maxy */
+  int shard = 0; /**< Shard of the input matched, from 0 */
+  int num_shards = 1; /**< Number of shards the input is split into by
+                           the hash of the trajectory id, each written
+                           into its own result file */
+  std::string sweep; /**< Values of the parameters swept, such as
+                          k=4,8;radius=100,300, each combination of which
+                          is written into its own result file, empty for
+                          none */
+  std::string sweep_file; /**< CSV file of the results and time of each
+                               setting of the sweep, empty for none */
   bool help_specified = false; /**< Help is specified or not */
   int log_level = 2; /**< log level, 0-trace,1-debug,2-info,
                           3-warn,4-err,5-critical,6-off */
   int step = 100; /**< progress report step */
+  int chunk_size = 64; /**< trajectories taken at once by a matcher
+                           thread */
+  int memory_budget = 0; /**< memory of the trajectories held by the
+                              matcher threads in MB, which cuts the
+                              chunks by their points, 0 for none */
+  std::string thread_placement = "none"; /**< Placement of the matcher
+                                            threads, none, core or
+                                            socket */
 }; // STMATCHAppConfig
 }
 }
@@ -0,0 +1,69 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the stmatch stream matcher
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/stmatch/stmatch_stream.hpp"
+#include "util/debug.hpp"
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+STMATCHStream::STMATCHStream(STMATCH &model, const STMATCHConfig &config,
+                             int max_lag) :
+    StreamMatcher(config.gps_error, max_lag, config.get_viterbi_beam(),
+                  model.network_.get_projection()),
+    model_(model), config_(config) {
+}
+
+bool STMATCHStream::search_candidates(
+    const Point &point, std::vector<Candidate> *candidates) {
+  LineString geom;
+  geom.add_point(point);
+  CandidateSearchContext &context = CandidateSearchContext::local();
+  if (!model_.network_.search_tr_cs_knn(geom, config_.k, config_.radius,
+                                        &context, nullptr,
+                                        model_.graph_.get_edge_mask())) {
+    return false;
+  }
+  context.prune(geom, config_.k, config_.get_candidate_pruning());
+  CandidateSpan cs = context.get_point_candidates(0);
+  candidates->assign(cs.begin(), cs.end());
+  return true;
+}
+
+void STMATCHStream::update_layer(StreamLayer *la_ptr, StreamLayer *lb_ptr,
+                                 bool log_space) {
+  // The candidates of the two points are the dummy nodes, numbered after
+  // the vertices of the network
+  NodeIndex index = model_.graph_.get_num_vertices();
+  for (Candidate &c : la_ptr->candidates) c.index = index++;
+  for (Candidate &c : lb_ptr->candidates) c.index = index++;
+  Traj_Candidates tc{la_ptr->candidates, lb_ptr->candidates};
+  DummyGraph dg(tc);
+  CompositeGraph cg(model_.graph_, dg);
+  double delta;
+  if (la_ptr->timestamp < 0 || lb_ptr->timestamp < 0) {
+    delta = lb_ptr->eu_dist * config_.factor * 4;
+  } else {
+    double duration = lb_ptr->timestamp - la_ptr->timestamp;
+    delta = config_.factor * config_.vmax * duration;
+  }
+  TGLayer la = la_ptr->get_layer();
+  TGLayer lb = lb_ptr->get_layer();
+  model_.update_layer(la_ptr->index, &la, &lb, cg, lb_ptr->eu_dist, delta,
+                      log_space);
+}
+
+C_Path STMATCHStream::complete_path(const Candidate &a, const Candidate &b) {
+  TGNode na{&a, nullptr, 0, 0, 0, 0};
+  TGNode nb{&b, &na, 0, 0, 0, 0};
+  std::vector<int> indices;
+  return model_.build_cpath(TGOpath{&na, &nb}, &indices);
+}
@@ -0,0 +1,47 @@
+/**
+ * Fast map matching.
+ *
+ * Fixed lag matching of a stream of points with the stmatch model
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_STMATCH_STREAM_HPP
+#define FMM_STMATCH_STREAM_HPP
+
+#include "mm/stream_matcher.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Stream matcher using the candidates, transitions and complete paths of
+ * a stmatch model. The transitions between two points are routed in a
+ * dummy graph of their candidates only.
+ */
+class STMATCHStream : public StreamMatcher {
+ public:
+  /**
+   * Create a stream matcher of a model, which should outlive it
+   * @param model   stmatch model
+   * @param config  configuration of the model
+   * @param max_lag maximum number of points not finalized
+   */
+  STMATCHStream(STMATCH &model, const STMATCHConfig &config,
+                int max_lag = DEFAULT_MAX_LAG);
+ protected:
+  bool search_candidates(const CORE::Point &point,
+                         std::vector<Candidate> *candidates) override;
+  void update_layer(StreamLayer *la_ptr, StreamLayer *lb_ptr,
+                    bool log_space) override;
+  C_Path complete_path(const Candidate &a, const Candidate &b) override;
+ private:
+  STMATCH &model_;
+  STMATCHConfig config_;
+};
+
+}
+}
+#endif /* FMM_STMATCH_STREAM_HPP */
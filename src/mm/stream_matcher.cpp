@@ -0,0 +1,230 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the fixed lag stream matcher
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/stream_matcher.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+using namespace FMM::MM;
+
+StreamMatcher::StreamMatcher(double gps_error, int max_lag,
+                             const ViterbiBeam &beam,
+                             const LocalProjection &projection) :
+    gps_error(gps_error), max_lag(max_lag), beam(beam),
+    projection(projection) {
+}
+
+bool StreamMatcher::push_point(double x, double y, double timestamp) {
+  int index = num_points++;
+  projection.forward(&x, &y);
+  Point point(x, y);
+  StreamLayer layer;
+  if (!search_candidates(point, &layer.candidates)) {
+    SPDLOG_DEBUG("No candidate found for point {}", index);
+    return false;
+  }
+  layer.index = index;
+  layer.point = point;
+  layer.timestamp = timestamp;
+  layer.eu_dist = 0;
+  if (!window.empty()) {
+    layer.eu_dist = boost::geometry::distance(window.back().point, point);
+  }
+  for (const Candidate &c : layer.candidates) {
+    layer.nodes.push_back(
+        TGNode{&c, nullptr, TransitionGraph::calc_ep(c.dist, gps_error), 0});
+  }
+  window.push_back(std::move(layer));
+  std::size_t k = window.size() - 1;
+  init_layer(&window[k], k == 0);
+  if (k > 0) {
+    update(k);
+    restart();
+  }
+  TGNode *node;
+  long converged = find_converged(&node);
+  if (converged >= 0) commit(converged, node);
+  while (get_num_pending() > max_lag && force_commit()) {
+    restart();
+  }
+  return true;
+}
+
+void StreamMatcher::flush() {
+  if (window.empty()) return;
+  restart();
+  std::size_t k = window.size() - 1;
+  TGNode *node = find_best(k);
+  if (node != nullptr) commit(k, node);
+  window.clear();
+  root_committed = false;
+}
+
+StreamMatchResult StreamMatcher::poll() {
+  StreamMatchResult output;
+  std::swap(output, result);
+  return output;
+}
+
+void StreamMatcher::reset() {
+  window.clear();
+  root_committed = false;
+  num_points = 0;
+  has_last = false;
+  num_edges = 0;
+  result = StreamMatchResult{};
+}
+
+int StreamMatcher::get_num_points() const {
+  return num_points;
+}
+
+int StreamMatcher::get_num_pending() const {
+  return window.size() - first_pending();
+}
+
+void StreamMatcher::init_layer(StreamLayer *layer, bool root) {
+  bool log_space = beam.is_enabled();
+  for (TGNode &node : layer->nodes) {
+    node.prev = nullptr;
+    if (root) {
+      node.cumu_prob = log_space ? std::log(node.ep) : node.ep;
+    } else {
+      node.cumu_prob = log_space ?
+                       -std::numeric_limits<double>::infinity() : 0;
+    }
+  }
+}
+
+void StreamMatcher::update(std::size_t k) {
+  if (beam.is_enabled()) {
+    TGLayer layer = window[k - 1].get_layer();
+    TransitionGraph::prune_layer(&layer, beam);
+  }
+  update_layer(&window[k - 1], &window[k], beam.is_enabled());
+}
+
+bool StreamMatcher::is_alive(std::size_t k, const TGNode &node) const {
+  // The nodes of the root are alive unless pruned or left out by the
+  // point finalized, the other nodes if reached from the root
+  return k == 0 ? !TransitionGraph::is_pruned(node) : node.prev != nullptr;
+}
+
+TGNode *StreamMatcher::find_best(std::size_t k) {
+  TGNode *best = nullptr;
+  for (TGNode &node : window[k].nodes) {
+    if (is_alive(k, node) &&
+        (best == nullptr || best->cumu_prob < node.cumu_prob)) {
+      best = &node;
+    }
+  }
+  return best;
+}
+
+long StreamMatcher::find_converged(TGNode **node) {
+  std::size_t k = window.size() - 1;
+  std::vector<TGNode *> nodes;
+  for (TGNode &n : window[k].nodes) {
+    if (is_alive(k, n)) nodes.push_back(&n);
+  }
+  while (!nodes.empty()) {
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    if (nodes.size() == 1) {
+      *node = nodes[0];
+      return k;
+    }
+    if (k == first_pending()) break;
+    for (TGNode *&n : nodes) n = n->prev;
+    --k;
+  }
+  return -1;
+}
+
+void StreamMatcher::commit(std::size_t k, TGNode *node) {
+  // The nodes on the path from the first pending layer to layer k
+  std::vector<const TGNode *> path(k + 1 - first_pending());
+  const TGNode *n = node;
+  for (std::size_t i = path.size(); i > 0; --i) {
+    path[i - 1] = n;
+    n = n->prev;
+  }
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    emit(*path[i], window[first_pending() + i].index);
+  }
+  // Layer k is the new root, where only the node finalized is kept
+  for (std::size_t i = 0; i < k; ++i) window.pop_front();
+  for (TGNode &root : window[0].nodes) {
+    root.prev = nullptr;
+    if (&root != node) {
+      root.cumu_prob = -std::numeric_limits<double>::infinity();
+    }
+  }
+  root_committed = true;
+}
+
+void StreamMatcher::emit(const TGNode &node, int point) {
+  const Candidate &c = *(node.c);
+  result.points.push_back(point);
+  result.opt_candidate_path.push_back(
+      MatchedCandidate{c, node.ep, node.tp, node.sp_dist});
+  result.opath.push_back(c.edge->id);
+  C_Path segs;
+  if (has_last) segs = complete_path(last, c);
+  if (segs.empty()) {
+    if (has_last) result.breaks.push_back(point);
+    segs.push_back(c.edge->id);
+  } else {
+    // The edge of the last candidate is in the complete path already
+    segs.erase(segs.begin());
+  }
+  result.cpath.insert(result.cpath.end(), segs.begin(), segs.end());
+  num_edges += segs.size();
+  result.indices.push_back(num_edges - 1);
+  last = c;
+  has_last = true;
+}
+
+bool StreamMatcher::force_commit() {
+  std::size_t first = first_pending();
+  TGNode *node = find_best(window.size() - 1);
+  if (node == nullptr) return false;
+  for (std::size_t k = window.size() - 1; k > first; --k) node = node->prev;
+  commit(first, node);
+  // The later layers are updated again from the node finalized
+  for (std::size_t k = 1; k < window.size(); ++k) {
+    init_layer(&window[k], false);
+    update(k);
+  }
+  return true;
+}
+
+void StreamMatcher::restart() {
+  while (window.size() > 1 && find_best(window.size() - 1) == nullptr) {
+    // Finalize the path ending at the last layer reached from the root
+    std::size_t k = window.size() - 1;
+    while (k > 0 && find_best(k) == nullptr) --k;
+    TGNode *node = find_best(k);
+    if (node != nullptr) commit(k, node);
+    // The next layer becomes a root which is not finalized
+    window.pop_front();
+    init_layer(&window[0], true);
+    root_committed = false;
+    for (std::size_t i = 1; i < window.size(); ++i) {
+      init_layer(&window[i], false);
+      update(i);
+    }
+  }
+}
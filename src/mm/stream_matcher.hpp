@@ -0,0 +1,196 @@
+/**
+ * Fast map matching.
+ *
+ * Fixed lag matching of a stream of points, which finalizes the matched
+ * candidates of the points incrementally instead of matching a complete
+ * trajectory.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_STREAM_MATCHER_HPP
+#define FMM_STREAM_MATCHER_HPP
+
+#include "mm/mm_type.hpp"
+#include "mm/transition_graph.hpp"
+#include "network/local_projection.hpp"
+
+#include <deque>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Matching result of the points finalized by a stream matcher since it
+ * was last polled
+ */
+struct StreamMatchResult {
+  std::vector<int> points; /**< index of each finalized point in the
+                                stream */
+  MatchedCandidatePath opt_candidate_path; /**< candidate matched to
+                                                each finalized point */
+  O_Path opath; /**< edge matched to each finalized point */
+  C_Path cpath; /**< edges appended to the complete path of the stream */
+  std::vector<int> indices; /**< index of each opath edge in the complete
+                                 path of the stream, counted from its
+                                 first edge */
+  std::vector<int> breaks; /**< finalized points from which the complete
+                                path restarts, as no path connects them
+                                with the previous point */
+};
+
+/**
+ * Fixed lag map matching of a stream of points.
+ *
+ * The points are pushed one by one and a layer of the transition graph
+ * is added for each of them. A point is finalized once the optimal paths
+ * ending at all the nodes of the last layer pass the same candidate of
+ * the point, or when more than max_lag points are pending, in which case
+ * the candidate on the current optimal path is taken and the pending
+ * layers are updated again from it. Finalized layers are dropped, so the
+ * memory of a stream does not grow with the number of points, except for
+ * the result which is not polled yet.
+ *
+ * The candidate search, the transition probabilities and the complete
+ * path are provided by the matcher of a subclass.
+ */
+class StreamMatcher {
+ public:
+  /**
+   * Create a stream matcher
+   * @param gps_error GPS error
+   * @param max_lag   maximum number of points not finalized
+   * @param beam      options of the beam search Viterbi, which is
+   * applied in log space if enabled
+   * @param projection local projection of the network, applied to the
+   * points pushed
+   */
+  StreamMatcher(double gps_error, int max_lag, const ViterbiBeam &beam,
+                const NETWORK::LocalProjection &projection =
+                    NETWORK::LocalProjection());
+  virtual ~StreamMatcher() = default;
+  StreamMatcher(const StreamMatcher &) = delete;
+  StreamMatcher &operator=(const StreamMatcher &) = delete;
+  /**
+   * Push a point to the stream
+   * @param  x         x coordinate of the point
+   * @param  y         y coordinate of the point
+   * @param  timestamp timestamp of the point, negative if unknown
+   * @return false if no candidate is found for the point, which is
+   * skipped, otherwise true
+   */
+  bool push_point(double x, double y, double timestamp = -1);
+  /**
+   * Finalize all the pending points, at the end of the stream
+   */
+  void flush();
+  /**
+   * Take the result of the points finalized since the last poll
+   */
+  StreamMatchResult poll();
+  /**
+   * Clear the stream, dropping the pending points and the result not
+   * polled
+   */
+  void reset();
+  /**
+   * Get the number of points pushed, including the skipped points
+   */
+  int get_num_points() const;
+  /**
+   * Get the number of points matched but not finalized yet
+   */
+  int get_num_pending() const;
+  static const int DEFAULT_MAX_LAG = 10; /**< Maximum number of points
+                                           not finalized by default */
+ protected:
+  /**
+   * A layer of the transition graph storing the candidates of a point
+   */
+  struct StreamLayer {
+    int index; /**< index of the point in the stream */
+    CORE::Point point; /**< the point */
+    double timestamp; /**< timestamp, negative if unknown */
+    double eu_dist; /**< distance to the point of the previous layer */
+    std::vector<Candidate> candidates; /**< candidates of the point */
+    std::vector<TGNode> nodes; /**< nodes of the candidates */
+    /**
+     * Get the nodes as a layer of a transition graph
+     */
+    inline TGLayer get_layer() {
+      return TGLayer{nodes.data(), nodes.data() + nodes.size()};
+    };
+  };
+  /**
+   * Search the candidates of a point
+   * @param  point      the point
+   * @param  candidates updated with the candidates found
+   * @return false if no candidate is found
+   */
+  virtual bool search_candidates(const CORE::Point &point,
+                                 std::vector<Candidate> *candidates) = 0;
+  /**
+   * Update the probabilities of the nodes of layer b from layer a, as
+   * the matcher updates the layers of a transition graph
+   * @param la_ptr    layer a
+   * @param lb_ptr    layer b next to a
+   * @param log_space accumulate log probabilities, skipping the pruned
+   * nodes of layer a
+   */
+  virtual void update_layer(StreamLayer *la_ptr, StreamLayer *lb_ptr,
+                            bool log_space) = 0;
+  /**
+   * Find the complete path between two candidates
+   * @return the edges from the edge of a to the edge of b, which is
+   * empty if they are not connected
+   */
+  virtual C_Path complete_path(const Candidate &a, const Candidate &b) = 0;
+ private:
+  // Reset the probabilities of a layer, which has no previous layer if
+  // it is a root
+  void init_layer(StreamLayer *layer, bool root);
+  // Update layer k of the window from its previous layer
+  void update(std::size_t k);
+  // Check if a node of layer k of the window is on a path from the root
+  bool is_alive(std::size_t k, const TGNode &node) const;
+  // Find the best node of layer k of the window on a path from the root
+  TGNode *find_best(std::size_t k);
+  // Find the last layer of the window where the paths ending at the
+  // last layer converge, and the node they pass, or -1.
+  long find_converged(TGNode **node);
+  // Finalize the pending points up to layer k of the window on the
+  // path of a node, which becomes the root of the window
+  void commit(std::size_t k, TGNode *node);
+  // Add a finalized node of a point to the result
+  void emit(const TGNode &node, int point);
+  // Finalize the oldest pending point on the current optimal path,
+  // returning false if no node of the last layer is reached
+  bool force_commit();
+  // Start the paths again after the last layer reached from the root,
+  // if the last layer of the window is not reached
+  void restart();
+  // First layer of the window not finalized
+  inline std::size_t first_pending() const {
+    return root_committed ? 1 : 0;
+  };
+  double gps_error;
+  int max_lag;
+  ViterbiBeam beam;
+  NETWORK::LocalProjection projection;
+  std::deque<StreamLayer> window;
+  // the first layer of the window is finalized, keeping only its node
+  // on the path
+  bool root_committed = false;
+  int num_points = 0;
+  // last candidate finalized, which starts the next complete path
+  bool has_last = false;
+  Candidate last;
+  // number of edges in the complete path of the stream
+  int num_edges = 0;
+  StreamMatchResult result;
+};
+
+}
+}
+#endif /* FMM_STREAM_MATCHER_HPP */
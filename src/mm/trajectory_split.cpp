@@ -0,0 +1,92 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the splitting of a trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "mm/trajectory_split.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <utility>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::MM;
+
+Trajectory FMM::MM::sub_trajectory(const Trajectory &traj,
+                                   int first, int last) {
+  Trajectory sub;
+  sub.id = traj.id;
+  for (int i = first; i <= last; ++i) {
+    sub.geom.add_point(traj.geom.at(i));
+  }
+  if ((int) traj.timestamps.size() == traj.geom.get_num_points()) {
+    sub.timestamps.assign(traj.timestamps.begin() + first,
+                          traj.timestamps.begin() + last + 1);
+  }
+  return sub;
+}
+
+std::vector<SegmentMatchResult> FMM::MM::match_segments(
+    const Trajectory &traj, const TrajectorySplit &split,
+    const SegmentMatchFunction &match) {
+  int N = traj.geom.get_num_points();
+  std::vector<SegmentMatchResult> segments;
+  if (N == 0) return segments;
+  // Segments to match, from their first to their last point
+  std::vector<std::pair<int, int>> pending;
+  bool has_time = split.max_time_gap > 0 && (int) traj.timestamps.size() == N;
+  int first = 0;
+  for (int i = 1; i < N; ++i) {
+    if (has_time &&
+        traj.timestamps[i] - traj.timestamps[i - 1] > split.max_time_gap) {
+      pending.push_back({first, i - 1});
+      first = i;
+    }
+  }
+  pending.push_back({first, N - 1});
+  // The segments of a trajectory matched in parallel with the others
+  // are matched sequentially, as nested parallelism is not enabled and
+  // the matchers of a pipeline limit their regions to one thread.
+  bool parallel = N >= split.parallel_points;
+  while (!pending.empty()) {
+    int num_pending = pending.size();
+    std::vector<MatchResult> results(num_pending);
+    std::vector<TrajectoryBreak> breaks(num_pending);
+    #pragma omp parallel for schedule(dynamic) if(parallel && num_pending > 1)
+    for (int i = 0; i < num_pending; ++i) {
+      Trajectory sub = sub_trajectory(traj, pending[i].first,
+                                      pending[i].second);
+      results[i] = match(sub, &breaks[i]);
+      results[i].id = traj.id;
+    }
+    std::vector<std::pair<int, int>> next;
+    for (int i = 0; i < num_pending; ++i) {
+      int a = pending[i].first;
+      int b = pending[i].second;
+      const TrajectoryBreak &brk = breaks[i];
+      int size = b - a + 1;
+      bool valid = brk.skip ? (brk.point >= 0 && brk.point < size) :
+                   (brk.point > 0 && brk.point < size);
+      if (!results[i].cpath.empty() || !valid) {
+        segments.push_back(SegmentMatchResult{a, b, std::move(results[i])});
+        continue;
+      }
+      SPDLOG_DEBUG("Traj {} split at point {}", traj.id, a + brk.point);
+      int end = a + brk.point - 1;
+      int start = brk.skip ? a + brk.point + 1 : a + brk.point;
+      if (end >= a) next.push_back({a, end});
+      if (start <= b) next.push_back({start, b});
+    }
+    pending.swap(next);
+  }
+  std::sort(segments.begin(), segments.end(),
+            [](const SegmentMatchResult &lhs, const SegmentMatchResult &rhs) {
+              return lhs.first < rhs.first;
+            });
+  return segments;
+}
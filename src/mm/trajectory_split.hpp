@@ -0,0 +1,88 @@
+/**
+ * Fast map matching.
+ *
+ * Splitting of a trajectory at the breaks of its matching, so that the
+ * parts which can be matched are reported instead of failing the whole
+ * trajectory.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TRAJECTORY_SPLIT_HPP
+#define FMM_TRAJECTORY_SPLIT_HPP
+
+#include "mm/mm_type.hpp"
+#include "core/gps.hpp"
+
+#include <functional>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Options of the splitting of a trajectory
+ */
+struct TrajectorySplit {
+  bool enabled = false; /**< Split the trajectory at the breaks of its
+                             matching */
+  double max_time_gap = 0; /**< Time gap between two points above which
+                                the trajectory is split before matching,
+                                0 for none */
+  int parallel_points = 1000; /**< Number of points of a trajectory from
+                                   which its segments are matched in
+                                   parallel */
+};
+
+/**
+ * Where the matching of a trajectory breaks
+ */
+struct TrajectoryBreak {
+  int point = -1; /**< Index of the point where the trajectory is split,
+                       -1 if no break is found */
+  bool skip = false; /**< The point has no candidate and is left out,
+                          otherwise no path reaches it from the previous
+                          point and it starts the next segment */
+};
+
+/**
+ * Function matching a trajectory, which reports where the matching
+ * breaks if no complete path is found
+ */
+typedef std::function<MatchResult(const CORE::Trajectory &,
+                                  TrajectoryBreak *)> SegmentMatchFunction;
+
+/**
+ * Extract the points first to last of a trajectory
+ * @param  traj  trajectory
+ * @param  first index of the first point
+ * @param  last  index of the last point, included
+ * @return the sub trajectory, with the id of the trajectory
+ */
+CORE::Trajectory sub_trajectory(const CORE::Trajectory &traj,
+                                int first, int last);
+
+/**
+ * Match a trajectory split into segments.
+ *
+ * The trajectory is first split at the time gaps larger than the
+ * maximum. A segment whose matching breaks is then split at the point
+ * without candidate or at the unreachable transition reported by the
+ * match function, and the two parts are matched again. The segments of
+ * a round are matched in parallel if the trajectory is long enough.
+ *
+ * @param  traj  trajectory
+ * @param  split split options
+ * @param  match function matching a segment
+ * @return the results of the segments ordered by their first point,
+ * leaving out the points without candidate. A segment which breaks
+ * without a break found is reported with its unmatched result.
+ */
+std::vector<SegmentMatchResult> match_segments(
+    const CORE::Trajectory &traj, const TrajectorySplit &split,
+    const SegmentMatchFunction &match);
+
+} // MM
+} // FMM
+
+#endif // FMM_TRAJECTORY_SPLIT_HPP
@@ -8,30 +8,152 @@
  */
 
 #include "mm/transition_graph.hpp"
+#include "algorithm/probability_kernel.hpp"
 #include "network/type.hpp"
 #include "util/debug.hpp"
 
+#include <algorithm>
+
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
 
 TransitionGraph::TransitionGraph(const Traj_Candidates &tc, double gps_error){
+  reset(tc,gps_error);
+}
+
+TransitionGraph::TransitionGraph(const CandidateSearchContext &context,
+                                 double gps_error){
+  reset(context,gps_error);
+}
+
+void TransitionGraph::reset(const Traj_Candidates &tc, double gps_error,
+                            bool approximate_ep){
+  log_space = false;
+  nodes.clear();
+  offsets.assign(1,0);
   for (auto cs = tc.begin(); cs!=tc.end(); ++cs) {
-    TGLayer layer;
-    for (auto iter = cs->begin(); iter!=cs->end(); ++iter) {
+    add_layer(cs->data(),cs->data()+cs->size(),gps_error,approximate_ep);
+  }
+  build_layers();
+}
+
+void TransitionGraph::reset(const CandidateSearchContext &context,
+                            double gps_error, bool approximate_ep){
+  log_space = false;
+  nodes.clear();
+  offsets.assign(1,0);
+  nodes.reserve(context.get_candidates().size());
+  for (std::size_t i = 0; i < context.get_num_points(); ++i) {
+    CandidateSpan cs = context.get_point_candidates(i);
+    add_layer(cs.begin(),cs.end(),gps_error,approximate_ep);
+  }
+  build_layers();
+}
+
+TransitionGraph &TransitionGraph::local(){
+  static thread_local TransitionGraph tg;
+  return tg;
+}
+
+void TransitionGraph::reset_log_space(){
+  log_space = true;
+  for (TGNode &node : nodes) {
+    node.cumu_prob = -std::numeric_limits<double>::infinity();
+    node.prev = nullptr;
+  }
+  if (!layers.empty()) {
+    for (TGNode &node : layers[0]) {
+      node.cumu_prob = std::log(node.ep);
+    }
+  }
+}
+
+bool TransitionGraph::is_log_space() const {
+  return log_space;
+}
+
+std::size_t TransitionGraph::prune_layer(TGLayer *layer,
+                                         const ViterbiBeam &beam){
+  const double pruned = -std::numeric_limits<double>::infinity();
+  double threshold = pruned;
+  for (const TGNode &node : *layer) {
+    threshold = std::max(threshold, node.cumu_prob);
+  }
+  if (beam.beam_margin > 0) {
+    threshold -= beam.beam_margin;
+  } else {
+    threshold = pruned;
+  }
+  if (beam.beam_size > 0 && layer->size() > (std::size_t) beam.beam_size) {
+    // Score of the last node in the beam
+    static thread_local std::vector<double> scores;
+    scores.clear();
+    for (const TGNode &node : *layer) scores.push_back(node.cumu_prob);
+    std::nth_element(scores.begin(), scores.begin() + beam.beam_size - 1,
+                     scores.end(), std::greater<double>());
+    threshold = std::max(threshold, scores[beam.beam_size - 1]);
+  }
+  std::size_t kept = 0;
+  for (TGNode &node : *layer) {
+    // Nodes tied with the last one of the beam are kept
+    if (node.cumu_prob < threshold || node.cumu_prob == pruned) {
+      node.cumu_prob = pruned;
+      node.prev = nullptr;
+    } else {
+      ++kept;
+    }
+  }
+  return kept;
+}
+
+void TransitionGraph::add_layer(const Candidate *first, const Candidate *last,
+                                double gps_error, bool approximate_ep){
+  if (!approximate_ep) {
+    for (const Candidate *iter = first; iter!=last; ++iter) {
       double ep = calc_ep(iter->dist,gps_error);
-      layer.push_back(TGNode{&(*iter),nullptr,ep,0});
+      nodes.push_back(TGNode{iter,nullptr,ep,0});
+    }
+  } else {
+    // The distances are gathered for the vectorized kernel
+    static thread_local std::vector<double> dists;
+    static thread_local std::vector<double> eps;
+    dists.clear();
+    for (const Candidate *iter = first; iter!=last; ++iter) {
+      dists.push_back(iter->dist);
+    }
+    eps.resize(dists.size());
+    ALGORITHM::gaussian_probabilities(dists.data(),dists.size(),gps_error,
+                                      eps.data());
+    for (std::size_t i = 0; i < eps.size(); ++i) {
+      nodes.push_back(TGNode{first+i,nullptr,eps[i],0});
     }
-    layers.push_back(layer);
   }
-  if (!tc.empty()) {
+  offsets.push_back(nodes.size());
+}
+
+void TransitionGraph::build_layers(){
+  // The nodes are not added anymore, so the layers can point to them
+  layers.resize(offsets.size()-1);
+  for (std::size_t i = 0; i < layers.size(); ++i) {
+    layers[i] = TGLayer{nodes.data()+offsets[i],nodes.data()+offsets[i+1]};
+  }
+  if (!layers.empty()) {
     reset_layer(&(layers[0]));
   }
 }
 
-double TransitionGraph::calc_tp(double sp_dist,double eu_dist){
-  return eu_dist>=sp_dist ? (sp_dist+1e-6)/(eu_dist+1e-6) : eu_dist/sp_dist;
+double TransitionGraph::calc_sp_lower_bound(const Candidate *a,
+                                            const Candidate *b){
+  return boost::geometry::distance(a->point,b->point) * (1 - 1e-9);
+}
+
+double TransitionGraph::calc_tp_upper_bound(double sp_lower_bound,
+                                            double eu_dist){
+  // The probability grows with the distance up to the Euclidean
+  // distance and decreases after it
+  return eu_dist>=sp_lower_bound ? 1 : eu_dist/sp_lower_bound;
 }
 
 double TransitionGraph::calc_ep(double dist,double error){
@@ -49,7 +171,8 @@ void TransitionGraph::reset_layer(TGLayer *layer){
 
 const TGNode *TransitionGraph::find_optimal_candidate(const TGLayer &layer){
   const TGNode *opt_c=nullptr;
-  double final_prob = -0.001;
+  double final_prob = log_space ?
+      -std::numeric_limits<double>::infinity() : -0.001;
   for (auto c = layer.begin(); c!=layer.end(); ++c) {
     if(final_prob < c->cumu_prob) {
       final_prob = c->cumu_prob;
@@ -60,27 +183,50 @@ const TGNode *TransitionGraph::find_optimal_candidate(const TGLayer &layer){
 }
 
 TGOpath TransitionGraph::backtrack(){
+  TGOpath opath;
+  backtrack(&opath);
+  return opath;
+}
+
+void TransitionGraph::backtrack(TGOpath *opath){
   SPDLOG_TRACE("Backtrack on transition graph");
+  opath->clear();
   TGNode* track_cand=nullptr;
-  double final_prob = -0.001;
-  std::vector<TGNode>& last_layer = layers.back();
+  // A node is reachable if its probability is positive, or its log
+  // probability is finite in log space
+  const double min_prob = log_space ?
+      -std::numeric_limits<double>::infinity() : 0;
+  double final_prob = log_space ? min_prob : -0.001;
+  TGLayer &last_layer = layers.back();
   for (auto c = last_layer.begin(); c!=last_layer.end(); ++c) {
     if(final_prob < c->cumu_prob) {
       final_prob = c->cumu_prob;
       track_cand = &(*c);
     }
   }
-  TGOpath opath;
-  if (final_prob>0) {
-    opath.push_back(track_cand);
+  if (final_prob>min_prob) {
+    opath->push_back(track_cand);
     // Iterate from tail to head to assign path
     while ((track_cand=track_cand->prev)!=nullptr) {
-      opath.push_back(track_cand);
+      opath->push_back(track_cand);
     }
-    std::reverse(opath.begin(), opath.end());
+    std::reverse(opath->begin(), opath->end());
   }
   SPDLOG_TRACE("Backtrack on transition graph done");
-  return opath;
+}
+
+int TransitionGraph::find_unreachable_layer() const {
+  for (std::size_t i = 0; i < layers.size(); ++i) {
+    bool reached = false;
+    for (const TGNode &node : layers[i]) {
+      if (log_space ? !is_pruned(node) : node.cumu_prob > 0) {
+        reached = true;
+        break;
+      }
+    }
+    if (!reached) return i;
+  }
+  return -1;
 }
 
 std::vector<TGLayer> &TransitionGraph::get_layers(){
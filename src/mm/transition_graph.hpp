@@ -15,8 +15,11 @@
 
 #include "network/type.hpp"
 #include "mm/mm_type.hpp"
+#include "network/candidate_search.hpp"
 
 #include <float.h>
+#include <cmath>
+#include <limits>
 
 namespace FMM
 {
@@ -37,9 +40,45 @@ struct TGNode {
 };
 
 /**
- * A layer of nodes in the transition graph.
+ * A layer of nodes in the transition graph, which is a range of the
+ * nodes stored contiguously in the graph.
  */
-typedef std::vector<TGNode> TGLayer;
+struct TGLayer {
+  TGNode *first; /**< First node */
+  TGNode *last; /**< Past the last node */
+  inline TGNode *begin() const {
+    return first;
+  };
+  inline TGNode *end() const {
+    return last;
+  };
+  inline std::size_t size() const {
+    return last - first;
+  };
+  inline bool empty() const {
+    return first == last;
+  };
+  inline TGNode &operator[](std::size_t i) const {
+    return first[i];
+  };
+};
+/**
+ * Options of the beam search Viterbi, which accumulates the log
+ * probabilities of the nodes and only expands the best nodes of a layer.
+ */
+struct ViterbiBeam {
+  int beam_size = 0; /**< Maximum number of nodes kept in a layer,
+                          0 for all */
+  double beam_margin = 0; /**< Maximum difference of log probability to
+                               the best node of a layer, 0 for all */
+  /**
+   * Check if any of the nodes can be pruned
+   */
+  inline bool is_enabled() const {
+    return beam_size > 0 || beam_margin > 0;
+  };
+};
+
 /**
  * The optimal path of nodes in the transition graph
  */
@@ -50,10 +89,20 @@ typedef std::vector<const TGNode*> TGOpath;
  *
  * The class stores the underlying transition graph of a HMM, which stores
  * the probabilities of candidates matched to a trajectories.
+ *
+ * The nodes of all the layers are stored in one array, which keeps its
+ * capacity when the graph is reset for another trajectory. A matcher
+ * resets the graph of its thread instead of creating one per trajectory.
  */
 class TransitionGraph
 {
 public:
+  /**
+   * Create an empty transition graph, to be reset with candidates
+   */
+  TransitionGraph() = default;
+  TransitionGraph(const TransitionGraph &) = delete;
+  TransitionGraph &operator=(const TransitionGraph &) = delete;
   /**
    * Transition graph constructor.
    *
@@ -65,6 +114,92 @@ public:
    * @param gps_error GPS error
    */
   TransitionGraph(const Traj_Candidates &tc, double gps_error);
+  /**
+   * Transition graph constructor from the candidates stored in a
+   * candidate search context, which should not be reused while the
+   * graph is in use.
+   *
+   * @param context   Candidate search context
+   * @param gps_error GPS error
+   */
+  TransitionGraph(const NETWORK::CandidateSearchContext &context,
+                  double gps_error);
+  /**
+   * Replace the nodes with the candidates of another trajectory, keeping
+   * the memory allocated
+   *
+   * @param tc        Trajectory candidates
+   * @param gps_error GPS error
+   * @param approximate_ep compute the emission probabilities with the
+   * approximate exponential of ALGORITHM::gaussian_probabilities
+   */
+  void reset(const Traj_Candidates &tc, double gps_error,
+             bool approximate_ep = false);
+  /**
+   * Replace the nodes with the candidates stored in a candidate search
+   * context, keeping the memory allocated
+   *
+   * @param context   Candidate search context
+   * @param gps_error GPS error
+   * @param approximate_ep compute the emission probabilities with the
+   * approximate exponential of ALGORITHM::gaussian_probabilities
+   */
+  void reset(const NETWORK::CandidateSearchContext &context,
+             double gps_error, bool approximate_ep = false);
+  /**
+   * Get the transition graph of the calling thread, which is reused by
+   * the trajectories matched in the thread
+   */
+  static TransitionGraph &local();
+  /**
+   * Accumulate log probabilities instead of probabilities until the graph
+   * is reset. The first layer gets the log of its emission probabilities
+   * and the other layers negative infinity.
+   */
+  void reset_log_space();
+  /**
+   * Check if the graph accumulates log probabilities
+   */
+  bool is_log_space() const;
+  /**
+   * Prune the nodes of a layer in log space which are out of the beam,
+   * setting their accumulative probability to negative infinity so that
+   * their transitions are skipped.
+   * @param  layer A layer in the transition graph, updated by its
+   * previous layer
+   * @param  beam  Beam options
+   * @return the number of nodes kept
+   */
+  static std::size_t prune_layer(TGLayer *layer, const ViterbiBeam &beam);
+  /**
+   * Update a node of layer b with the transition from a node of layer a
+   * in log space, if that is more probable.
+   * @param a       Node of layer a, which is not pruned
+   * @param b       Node of layer b
+   * @param tp      Transition probability
+   * @param sp_dist Shortest path distance of the transition
+   */
+  static inline void update_log(TGNode *a, TGNode *b, double tp,
+                                double sp_dist) {
+    double score = a->cumu_prob + std::log(tp) + std::log(b->ep);
+    if (score > b->cumu_prob) {
+      b->cumu_prob = score;
+      b->prev = a;
+      b->tp = tp;
+      b->sp_dist = sp_dist;
+    }
+  };
+  /**
+   * Check if a node is pruned or unreachable in log space
+   */
+  static inline bool is_pruned(const TGNode &node) {
+    return node.cumu_prob == -std::numeric_limits<double>::infinity();
+  };
+  /**
+   * Number of layers whose transitions are computed together when a
+   * transition graph is updated in parallel
+   */
+  static const int PARALLEL_CHUNK_LAYERS = 1024;
 
   /**
    * Calculate transition probability
@@ -72,7 +207,30 @@ public:
    * @param  eu_dist Euclidean distance between two candidates
    * @return transition probability in HMM
    */
-  static double calc_tp(double sp_dist,double eu_dist);
+  static inline double calc_tp(double sp_dist,double eu_dist){
+    return eu_dist>=sp_dist ? (sp_dist+1e-6)/(eu_dist+1e-6) :
+           eu_dist/sp_dist;
+  };
+
+  /**
+   * Calculate a lower bound of the shortest path distance between two
+   * candidates, which is the straight line distance of their points,
+   * as a path is not shorter than its chord
+   * @param  a from candidate
+   * @param  b to candidate
+   * @return lower bound, slightly reduced against the rounding of the
+   * lengths of the edges
+   */
+  static double calc_sp_lower_bound(const Candidate *a, const Candidate *b);
+
+  /**
+   * Calculate an upper bound of the transition probability of the
+   * distances not smaller than a lower bound
+   * @param  sp_lower_bound lower bound of the shortest path distance
+   * @param  eu_dist Euclidean distance between two candidates
+   * @return upper bound of the transition probability
+   */
+  static double calc_tp_upper_bound(double sp_lower_bound, double eu_dist);
 
   /**
    * Calculate emission probability
@@ -101,13 +259,37 @@ public:
    * has the highest accumulative probability value.
    */
   TGOpath backtrack();
+  /**
+   * Backtrack the transition graph into a buffer, which keeps its
+   * capacity between the trajectories
+   * @param opath updated with the optimal path, empty if no node of the
+   * last layer is reached
+   */
+  void backtrack(TGOpath *opath);
+  /**
+   * Find the first layer where no node is reached, which is where the
+   * optimal path breaks if backtrack finds none.
+   * @return index of the layer, or -1 if all the layers are reached
+   */
+  int find_unreachable_layer() const;
   /**
    * Get a reference to the inner layers of the transition graph.
    */
   std::vector<TGLayer> &get_layers();
 private:
-  // candidates of a trajectory
+  // Add the nodes of the candidates of a point, whose emission
+  // probabilities are approximated if approximate_ep is true
+  void add_layer(const Candidate *first, const Candidate *last,
+                 double gps_error, bool approximate_ep);
+  // Create the layers once all the nodes are added
+  void build_layers();
+  // nodes of all the candidates of a trajectory
+  std::vector<TGNode> nodes;
+  // nodes of layer i are nodes[offsets[i]:offsets[i+1]]
+  std::vector<std::size_t> offsets;
   std::vector<TGLayer> layers;
+  // whether cumu_prob stores log probabilities
+  bool log_space = false;
 };
 
 }
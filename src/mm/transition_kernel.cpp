@@ -0,0 +1,194 @@
+#include "mm/transition_kernel.hpp"
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace FMM {
+namespace MM {
+
+void max_plus_layer(const double *cumu, std::size_t n, const double *tps,
+                    const double *eps, std::size_t m, bool log_space,
+                    bool last_tie, double *best, int *arg) {
+  std::size_t j = 0;
+#if defined(__AVX2__)
+  // Four nodes of layer b, scanning the nodes of layer a in order
+  for (; j + 4 <= m; j += 4) {
+    __m256d e = _mm256_loadu_pd(eps + j);
+    __m256d b = _mm256_loadu_pd(best + j);
+    __m256d a = _mm256_set1_pd(-1);
+    for (std::size_t i = 0; i < n; ++i) {
+      __m256d c = _mm256_set1_pd(cumu[i]);
+      __m256d t = _mm256_loadu_pd(tps + i * m + j);
+      __m256d s = log_space ? _mm256_add_pd(_mm256_add_pd(c, t), e) :
+                  _mm256_add_pd(c, _mm256_mul_pd(t, e));
+      __m256d mask = last_tie ? _mm256_cmp_pd(s, b, _CMP_GE_OQ) :
+                     _mm256_cmp_pd(s, b, _CMP_GT_OQ);
+      b = _mm256_blendv_pd(b, s, mask);
+      a = _mm256_blendv_pd(a, _mm256_set1_pd((double) i), mask);
+    }
+    _mm256_storeu_pd(best + j, b);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(arg + j),
+                     _mm256_cvtpd_epi32(a));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; j + 2 <= m; j += 2) {
+    float64x2_t e = vld1q_f64(eps + j);
+    float64x2_t b = vld1q_f64(best + j);
+    float64x2_t a = vdupq_n_f64(-1);
+    for (std::size_t i = 0; i < n; ++i) {
+      float64x2_t c = vdupq_n_f64(cumu[i]);
+      float64x2_t t = vld1q_f64(tps + i * m + j);
+      float64x2_t s = log_space ? vaddq_f64(vaddq_f64(c, t), e) :
+                      vaddq_f64(c, vmulq_f64(t, e));
+      uint64x2_t mask = last_tie ? vcgeq_f64(s, b) : vcgtq_f64(s, b);
+      b = vbslq_f64(mask, s, b);
+      a = vbslq_f64(mask, vdupq_n_f64((double) i), a);
+    }
+    vst1q_f64(best + j, b);
+    arg[j] = (int) vgetq_lane_f64(a, 0);
+    arg[j + 1] = (int) vgetq_lane_f64(a, 1);
+  }
+#endif
+  // Remaining nodes, or all of them without SIMD support
+  for (; j < m; ++j) {
+    double b = best[j];
+    int a = -1;
+    for (std::size_t i = 0; i < n; ++i) {
+      double t = tps[i * m + j];
+      double s = log_space ? cumu[i] + t + eps[j] : cumu[i] + t * eps[j];
+      if (last_tie ? s >= b : s > b) {
+        b = s;
+        a = (int) i;
+      }
+    }
+    best[j] = b;
+    arg[j] = a;
+  }
+} // max_plus_layer
+
+void max_plus_lanes(const double *cumu, std::size_t n, const double *tps,
+                    const double *eps, std::size_t m, std::size_t lanes,
+                    bool log_space, bool last_tie, double *best, int *arg) {
+  for (std::size_t j = 0; j < m; ++j) {
+    const double *e = eps + j * lanes;
+    double *b = best + j * lanes;
+    int *a = arg + j * lanes;
+    std::size_t l = 0;
+#if defined(__AVX2__)
+    // Four lanes, scanning the nodes of layers a in order
+    for (; l + 4 <= lanes; l += 4) {
+      __m256d ev = _mm256_loadu_pd(e + l);
+      __m256d bv = _mm256_loadu_pd(b + l);
+      __m256d av = _mm256_set1_pd(-1);
+      for (std::size_t i = 0; i < n; ++i) {
+        __m256d c = _mm256_loadu_pd(cumu + i * lanes + l);
+        __m256d t = _mm256_loadu_pd(tps + (i * m + j) * lanes + l);
+        __m256d s = log_space ? _mm256_add_pd(_mm256_add_pd(c, t), ev) :
+                    _mm256_add_pd(c, _mm256_mul_pd(t, ev));
+        __m256d mask = last_tie ? _mm256_cmp_pd(s, bv, _CMP_GE_OQ) :
+                       _mm256_cmp_pd(s, bv, _CMP_GT_OQ);
+        bv = _mm256_blendv_pd(bv, s, mask);
+        av = _mm256_blendv_pd(av, _mm256_set1_pd((double) i), mask);
+      }
+      _mm256_storeu_pd(b + l, bv);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(a + l),
+                       _mm256_cvtpd_epi32(av));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; l + 2 <= lanes; l += 2) {
+      float64x2_t ev = vld1q_f64(e + l);
+      float64x2_t bv = vld1q_f64(b + l);
+      float64x2_t av = vdupq_n_f64(-1);
+      for (std::size_t i = 0; i < n; ++i) {
+        float64x2_t c = vld1q_f64(cumu + i * lanes + l);
+        float64x2_t t = vld1q_f64(tps + (i * m + j) * lanes + l);
+        float64x2_t s = log_space ? vaddq_f64(vaddq_f64(c, t), ev) :
+                        vaddq_f64(c, vmulq_f64(t, ev));
+        uint64x2_t mask = last_tie ? vcgeq_f64(s, bv) : vcgtq_f64(s, bv);
+        bv = vbslq_f64(mask, s, bv);
+        av = vbslq_f64(mask, vdupq_n_f64((double) i), av);
+      }
+      vst1q_f64(b + l, bv);
+      a[l] = (int) vgetq_lane_f64(av, 0);
+      a[l + 1] = (int) vgetq_lane_f64(av, 1);
+    }
+#endif
+    // Remaining lanes, or all of them without SIMD support
+    for (; l < lanes; ++l) {
+      double bs = b[l];
+      int as = -1;
+      for (std::size_t i = 0; i < n; ++i) {
+        double c = cumu[i * lanes + l];
+        double t = tps[(i * m + j) * lanes + l];
+        double s = log_space ? c + t + e[l] : c + t * e[l];
+        if (last_tie ? s >= bs : s > bs) {
+          bs = s;
+          as = (int) i;
+        }
+      }
+      b[l] = bs;
+      a[l] = as;
+    }
+  }
+} // max_plus_lanes
+
+void relax_layer(TGNode *const *expanded, std::size_t n, const TGLayer &lb,
+                 const double *sp_dists, const char *skipped,
+                 double eu_dist, bool log_space, bool last_tie) {
+  const double skip = std::numeric_limits<double>::quiet_NaN();
+  const std::size_t m = lb.size();
+  static thread_local std::vector<double> cumu;
+  static thread_local std::vector<double> tps;
+  static thread_local std::vector<double> eps;
+  static thread_local std::vector<double> best;
+  static thread_local std::vector<int> arg;
+  cumu.resize(n);
+  tps.resize(n * m);
+  eps.resize(m);
+  best.resize(m);
+  arg.resize(m);
+  for (std::size_t i = 0; i < n; ++i) cumu[i] = expanded[i]->cumu_prob;
+  for (std::size_t j = 0; j < m; ++j) {
+    eps[j] = log_space ? std::log(lb[j].ep) : lb[j].ep;
+    best[j] = lb[j].cumu_prob;
+  }
+  // The probabilities are computed in separate passes without branches,
+  // which are vectorized by the compiler. The two cases of
+  // TransitionGraph::calc_tp are selected before a single division.
+  for (std::size_t k = 0; k < n * m; ++k) {
+    double sp_dist = sp_dists[k];
+    bool shorter = eu_dist >= sp_dist;
+    double num = shorter ? sp_dist + 1e-6 : eu_dist;
+    double den = shorter ? eu_dist + 1e-6 : sp_dist;
+    tps[k] = num / den;
+  }
+  if (log_space) {
+    for (std::size_t k = 0; k < n * m; ++k) tps[k] = std::log(tps[k]);
+  }
+  if (skipped != nullptr) {
+    for (std::size_t k = 0; k < n * m; ++k) {
+      tps[k] = skipped[k] ? skip : tps[k];
+    }
+  }
+  max_plus_layer(cumu.data(), n, tps.data(), eps.data(), m, log_space,
+                 last_tie, best.data(), arg.data());
+  for (std::size_t j = 0; j < m; ++j) {
+    if (arg[j] < 0) continue;
+    TGNode &b = lb[j];
+    double sp_dist = sp_dists[arg[j] * m + j];
+    b.cumu_prob = best[j];
+    b.prev = expanded[arg[j]];
+    b.tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
+    b.sp_dist = sp_dist;
+  }
+} // relax_layer
+
+} // MM
+} // FMM
@@ -0,0 +1,112 @@
+/**
+ * Fast map matching.
+ *
+ * Kernels relaxing the nodes of a layer of the transition graph from the
+ * nodes of the previous layer, vectorized over the layers stored as
+ * arrays.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TRANSITION_KERNEL_HPP
+#define FMM_TRANSITION_KERNEL_HPP
+
+#include "mm/transition_graph.hpp"
+
+#include <cstddef>
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Find the most probable predecessor of each node of layer b, with the
+ * layers stored as structure of arrays. The score of node i of layer a
+ * and node j of layer b is
+ *
+ * - in linear space, cumu[i] + tps[i * m + j] * eps[j]
+ * - in log space, cumu[i] + tps[i * m + j] + eps[j], where tps and eps
+ *   hold the logarithms of the probabilities
+ *
+ * and the pairs which do not update layer b have a tp of NaN, whose score
+ * fails all the comparisons. The nodes of layer b are processed in lanes
+ * with AVX2 or NEON instructions when the library is compiled for them,
+ * otherwise with a scalar loop, in both cases comparing the predecessors
+ * in their order as the pairwise update does.
+ *
+ * @param cumu      cumulative probabilities of the n nodes of layer a
+ * @param n         number of nodes of layer a
+ * @param tps       transition probabilities of the pairs
+ * @param eps       emission probabilities of the m nodes of layer b
+ * @param m         number of nodes of layer b
+ * @param log_space the probabilities are logarithms
+ * @param last_tie  a score equal to the best one replaces it, so that a
+ * node takes the last predecessor tied, otherwise the first
+ * @param best      cumulative probabilities of layer b, updated with the
+ * scores of the predecessors found
+ * @param arg       updated with the index of the predecessor found for
+ * each node of layer b, or -1 if none beats its best
+ */
+void max_plus_layer(const double *cumu, std::size_t n, const double *tps,
+                    const double *eps, std::size_t m, bool log_space,
+                    bool last_tie, double *best, int *arg);
+
+/**
+ * Find the most probable predecessor of each node of layer b for several
+ * layer pairs at once, one for each lane, which are the layers of
+ * different trajectories advanced together. The arrays interleave the
+ * lanes: the value of lane l is at
+ *
+ * - cumu[i * lanes + l] for node i of layer a
+ * - tps[(i * m + j) * lanes + l] for node i of layer a and node j of
+ *   layer b
+ * - eps, best and arg[j * lanes + l] for node j of layer b
+ *
+ * where n and m are the largest numbers of nodes of the lanes. The scores
+ * are the ones of max_plus_layer, and the nodes missing in a lane are
+ * masked by a tp of NaN. The lanes are processed with AVX2 or NEON
+ * instructions when the library is compiled for them, otherwise with a
+ * scalar loop.
+ *
+ * @param cumu      cumulative probabilities of layers a
+ * @param n         number of nodes of layers a
+ * @param tps       transition probabilities of the pairs
+ * @param eps       emission probabilities of layers b
+ * @param m         number of nodes of layers b
+ * @param lanes     number of layer pairs
+ * @param log_space the probabilities are logarithms
+ * @param last_tie  a node takes the last predecessor tied, otherwise the
+ * first
+ * @param best      cumulative probabilities of layers b, updated with the
+ * scores of the predecessors found
+ * @param arg       updated with the index of the predecessor found for
+ * each node of layers b, or -1 if none beats its best
+ */
+void max_plus_lanes(const double *cumu, std::size_t n, const double *tps,
+                    const double *eps, std::size_t m, std::size_t lanes,
+                    bool log_space, bool last_tie, double *best, int *arg);
+
+/**
+ * Relax the nodes of layer b from the nodes of layer a with
+ * max_plus_layer, gathering the layers into arrays reused by the thread
+ *
+ * @param expanded  nodes of layer a
+ * @param n         number of nodes of layer a
+ * @param lb        layer b
+ * @param sp_dists  distance of node i of layer a and node j of layer b at
+ * i * lb.size() + j
+ * @param skipped   if not nullptr, pairs which do not update layer b are
+ * non zero, in the layout of the distances
+ * @param eu_dist   Euclidean distance between the two observed points
+ * @param log_space accumulate log probabilities
+ * @param last_tie  a node takes the last predecessor tied with the best
+ * one instead of the first
+ */
+void relax_layer(TGNode *const *expanded, std::size_t n, const TGLayer &lb,
+                 const double *sp_dists, const char *skipped,
+                 double eu_dist, bool log_space, bool last_tie);
+
+} // MM
+} // FMM
+
+#endif // FMM_TRANSITION_KERNEL_HPP
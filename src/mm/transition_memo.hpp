@@ -0,0 +1,113 @@
+/**
+ * Fast map matching.
+ *
+ * Memo of the distances of the od pairs probed in a trajectory
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TRANSITION_MEMO_HPP
+#define FMM_TRANSITION_MEMO_HPP
+
+#include "network/type.hpp"
+
+namespace FMM {
+namespace MM {
+
+/**
+ * Direct mapped table of the distances of the od pairs probed in the
+ * matching of a trajectory, missing pairs included. The consecutive
+ * layers of a trajectory share most of their candidate edges, so that
+ * the same pairs are probed over and over, which are answered from a
+ * table of 4 KB staying in the L1 cache instead of the slots of UBODT.
+ *
+ * A memo belongs to the workspace of one trajectory at a time and is
+ * cleared when the next one is matched. Its counters add up until they
+ * are reset.
+ */
+class TransitionMemo {
+ public:
+  static const int ENTRIES = 256; /**< Entries of the table */
+  TransitionMemo() {
+    clear();
+  };
+  /**
+   * Remove all the pairs, keeping the counters
+   */
+  inline void clear() {
+    for (Entry &entry : entries_) entry.key = EMPTY_KEY;
+  };
+  /**
+   * Find the distance of an od pair
+   * @param  source source node
+   * @param  target target node
+   * @param  cost   updated with the distance memoized, negative if the
+   * pair is missing in UBODT
+   * @return true if the pair is memoized
+   */
+  inline bool find(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                   double *cost) {
+    unsigned long long key = make_key(source, target);
+    const Entry &entry = entries_[slot(key)];
+    if (entry.key == key) {
+      *cost = entry.cost;
+      ++hits_;
+      return true;
+    }
+    ++misses_;
+    return false;
+  };
+  /**
+   * Store the distance of an od pair, replacing the pair of its slot
+   * @param source source node
+   * @param target target node
+   * @param cost   distance looked up, negative if the pair is missing
+   */
+  inline void insert(NETWORK::NodeIndex source, NETWORK::NodeIndex target,
+                     double cost) {
+    unsigned long long key = make_key(source, target);
+    entries_[slot(key)] = Entry{key, cost};
+  };
+  /**
+   * Get the probes answered by the memo
+   */
+  inline long long get_hits() const {
+    return hits_;
+  };
+  /**
+   * Get the probes forwarded to UBODT
+   */
+  inline long long get_misses() const {
+    return misses_;
+  };
+  /**
+   * Reset the counters
+   */
+  inline void reset_counters() {
+    hits_ = 0;
+    misses_ = 0;
+  };
+ private:
+  struct Entry {
+    unsigned long long key;
+    double cost;
+  };
+  static const unsigned long long EMPTY_KEY = ~0ULL;
+  static inline unsigned long long make_key(NETWORK::NodeIndex source,
+                                            NETWORK::NodeIndex target) {
+    return ((unsigned long long) source << 32) | target;
+  };
+  // The top 8 bits of the hash index the 256 entries
+  static inline int slot(unsigned long long key) {
+    return (int) ((key * 0x9E3779B97F4A7C15ULL) >> 56);
+  };
+  Entry entries_[ENTRIES];
+  long long hits_ = 0;
+  long long misses_ = 0;
+};
+
+} // MM
+} // FMM
+
+#endif // FMM_TRANSITION_MEMO_HPP
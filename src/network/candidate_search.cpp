@@ -0,0 +1,168 @@
+#include "network/candidate_search.hpp"
+#include "network/network.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+void CandidateSearchContext::gather_query_boxes(
+    const std::vector<double> &box_coords) {
+  std::size_t n = query_edges.size();
+  box_min_x.resize(n);
+  box_min_y.resize(n);
+  box_max_x.resize(n);
+  box_max_y.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    const double *b = box_coords.data() + 4 * query_edges[i];
+    box_min_x[i] = b[0];
+    box_min_y[i] = b[1];
+    box_max_x[i] = b[2];
+    box_max_y[i] = b[3];
+  }
+}
+
+void CandidateSearchContext::filter_query_edges(double px, double py,
+                                                double radius) {
+  std::size_t n = query_edges.size();
+  double x1 = px - radius;
+  double y1 = py - radius;
+  double x2 = px + radius;
+  double y2 = py + radius;
+  box_mask.resize(n);
+  const double *min_x = box_min_x.data();
+  const double *min_y = box_min_y.data();
+  const double *max_x = box_max_x.data();
+  const double *max_y = box_max_y.data();
+  unsigned char *mask = box_mask.data();
+  // Without branches, the loop is vectorized by the compiler
+  for (std::size_t i = 0; i < n; ++i) {
+    mask[i] = (min_x[i] <= x2) & (max_x[i] >= x1) &
+        (min_y[i] <= y2) & (max_y[i] >= y1);
+  }
+  point_edges.clear();
+  for (std::size_t i = 0; i < n; ++i) {
+    if (mask[i]) point_edges.push_back(query_edges[i]);
+  }
+}
+
+void CandidateSearchContext::prune(const CORE::LineString &geom, int k,
+                                   const CandidatePruning &pruning) {
+  std::size_t num_points = get_num_points();
+  if (num_points == 0 || !pruning.is_enabled()) return;
+  double sigma2 = pruning.gps_error * pruning.gps_error;
+  // The candidates of a point are sorted by distance, so a candidate is
+  // kept if its distance is within a threshold and its rank below k.
+  // The ratio of emission probabilities exp(-0.5*(d^2-d0^2)/sigma^2) is
+  // compared in squared distances to avoid the exponentials.
+  double ep_margin = pruning.min_ep_ratio > 0 ?
+      -2 * sigma2 * std::log(std::min(pruning.min_ep_ratio, 1.0)) : DBL_MAX;
+  // The headings are compared by the cosine of their angle
+  bool heading = pruning.max_heading_diff > 0 && network != nullptr;
+  double min_heading_cos =
+      std::cos(std::min(pruning.max_heading_diff, 180.0) * M_PI / 180);
+  NodeIndex next_index = candidates[0].index;
+  std::size_t kept = 0;
+  for (std::size_t i = 0; i < num_points; ++i) {
+    std::size_t first = offsets[i];
+    std::size_t last = offsets[i + 1];
+    // Heading of the point from its previous to its next point, or to
+    // itself at the ends of the trajectory
+    double hx = 0, hy = 0;
+    if (heading) {
+      int prev = std::max((int) i - 1, 0);
+      int next = std::min((int) i + 1, geom.get_num_points() - 1);
+      hx = geom.get_x(next) - geom.get_x(prev);
+      hy = geom.get_y(next) - geom.get_y(prev);
+      double h = std::sqrt(hx * hx + hy * hy);
+      if (h > 0 && h >= pruning.min_heading_distance) {
+        hx /= h;
+        hy /= h;
+      } else {
+        hx = 0;
+        hy = 0;
+      }
+    }
+    bool check_heading = hx != 0 || hy != 0;
+    double d0 = candidates[first].dist;
+    double max_dist2 = ep_margin == DBL_MAX ? DBL_MAX : d0 * d0 + ep_margin;
+    if (pruning.max_dist_ratio > 0) {
+      double max_dist = pruning.max_dist_ratio *
+          std::max(d0, pruning.gps_error);
+      max_dist2 = std::min(max_dist2, max_dist * max_dist);
+    }
+    std::size_t point_k = last - first;
+    if (pruning.adaptive_k_spacing > 0) {
+      double spacing = DBL_MAX;
+      for (int j : {(int) i - 1, (int) i + 1}) {
+        if (j < 0 || j >= geom.get_num_points()) continue;
+        double dx = geom.get_x(j) - geom.get_x(i);
+        double dy = geom.get_y(j) - geom.get_y(i);
+        spacing = std::min(spacing, std::sqrt(dx * dx + dy * dy));
+      }
+      if (spacing < pruning.adaptive_k_spacing) {
+        std::size_t adaptive_k = (std::size_t) std::ceil(
+            k * spacing / pruning.adaptive_k_spacing);
+        point_k = std::min(point_k, std::max(adaptive_k, (std::size_t) 1));
+      }
+    }
+    offsets[i] = kept;
+    std::size_t point_kept = 0;
+    for (std::size_t j = first; j < last && point_kept < point_k; ++j) {
+      double d = candidates[j].dist;
+      // The best candidate is always kept
+      if (j > first && d * d > max_dist2) break;
+      if (check_heading) {
+        double ex, ey;
+        if (network->get_edge_direction(candidates[j].edge->index,
+                                        candidates[j].offset, &ex, &ey) &&
+            hx * ex + hy * ey < min_heading_cos) {
+          continue;
+        }
+      }
+      candidates[kept] = candidates[j];
+      candidates[kept].index = next_index++;
+      ++kept;
+      ++point_kept;
+    }
+    // The nearest candidate is kept if no candidate has the heading
+    if (point_kept == 0) {
+      candidates[kept] = candidates[first];
+      candidates[kept].index = next_index++;
+      ++kept;
+    }
+  }
+  offsets[num_points] = kept;
+  candidates.resize(kept);
+}
+
+bool CandidateSearchContext::select(const CandidateSearchContext &source,
+                                    int k, double radius) {
+  clear();
+  network = source.network;
+  std::size_t num_points = source.get_num_points();
+  if (num_points == 0) {
+    missing_point = source.missing_point;
+    return false;
+  }
+  NodeIndex next_index = source.candidates[0].index;
+  for (std::size_t i = 0; i < num_points; ++i) {
+    std::size_t first = source.offsets[i];
+    std::size_t last = std::min(source.offsets[i + 1], first + k);
+    std::size_t point_first = candidates.size();
+    for (std::size_t j = first; j < last; ++j) {
+      if (source.candidates[j].dist > radius) break;
+      candidates.push_back(source.candidates[j]);
+      candidates.back().index = next_index++;
+    }
+    if (candidates.size() == point_first) {
+      clear();
+      missing_point = i;
+      return false;
+    }
+    offsets.push_back(candidates.size());
+  }
+  return true;
+}
@@ -0,0 +1,227 @@
+/**
+ * Fast map matching.
+ *
+ * Reusable context of candidate search
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_CANDIDATE_SEARCH_HPP
+#define FMM_CANDIDATE_SEARCH_HPP
+
+#include "network/type.hpp"
+#include "mm/mm_type.hpp"
+#include "util/memory.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+class Network;
+/**
+ * Options to drop the weak candidates of a point after the KNN search,
+ * before the transition graph is built. A value of 0 disables an option.
+ */
+struct CandidatePruning {
+  double gps_error = 50; /**< GPS error used in the emission probability */
+  double min_ep_ratio = 0; /**< Minimum ratio of the emission probability
+      of a candidate to the one of the best candidate of its point */
+  double max_dist_ratio = 0; /**< Maximum ratio of the distance of a
+      candidate to the one of the best candidate, where the best distance
+      is taken as at least the GPS error */
+  double adaptive_k_spacing = 0; /**< Spacing of the points below which
+      the number of candidates of a point is reduced proportionally to the
+      distance to its closest neighbouring point */
+  double max_heading_diff = 0; /**< Maximum angle in degrees between the
+      heading of a point, from its previous to its next point, and the
+      direction of the edge of a candidate at its offset */
+  double min_heading_distance = 0; /**< Distance between the previous and
+      the next points below which the heading of a point is unreliable
+      and its candidates are kept whatever their direction */
+  /**
+   * Check if an option is enabled
+   */
+  inline bool is_enabled() const {
+    return min_ep_ratio > 0 || max_dist_ratio > 0 ||
+        adaptive_k_spacing > 0 || max_heading_diff > 0;
+  };
+};
+
+/**
+ * Candidates of a point, which is a range of the flat candidate array of
+ * a CandidateSearchContext
+ */
+struct CandidateSpan {
+  const MM::Candidate *first; /**< First candidate */
+  const MM::Candidate *last; /**< Past the last candidate */
+  inline const MM::Candidate *begin() const {
+    return first;
+  };
+  inline const MM::Candidate *end() const {
+    return last;
+  };
+  inline std::size_t size() const {
+    return last - first;
+  };
+  inline bool empty() const {
+    return first == last;
+  };
+  inline const MM::Candidate &operator[](std::size_t i) const {
+    return first[i];
+  };
+};
+
+/**
+ * State of a candidate search, which is reused by the searches of a
+ * thread to avoid allocating per point.
+ *
+ * The candidates of a trajectory are stored in one flat array, where the
+ * candidates of point i are in [offsets[i], offsets[i+1]). The buffers of
+ * the spatial index query and of the candidates of a point are kept
+ * between searches, so that a search only allocates when a trajectory
+ * has more points or candidates than the previous ones.
+ *
+ * When the spatial index is queried once for several points, the boxes
+ * of the edges returned are kept by coordinate, so that the edges of
+ * each point are selected by a branch free loop over them.
+ */
+class CandidateSearchContext {
+ public:
+  /**
+   * Remove the candidates, keeping the buffers allocated
+   */
+  inline void clear() {
+    candidates.clear();
+    offsets.assign(1, 0);
+    missing_point = -1;
+    // The buffers grow during the previous search
+    tracker.update(get_bytes());
+  };
+  /**
+   * Get the number of points whose candidates are stored
+   */
+  inline std::size_t get_num_points() const {
+    return offsets.empty() ? 0 : offsets.size() - 1;
+  };
+  /**
+   * Check if no candidate is stored, which is the case when a point of
+   * the last trajectory searched has no candidate
+   */
+  inline bool empty() const {
+    return get_num_points() == 0;
+  };
+  /**
+   * Get the index of the point without candidate which stopped the last
+   * search, or -1 if the search succeeded
+   */
+  inline int get_missing_point() const {
+    return missing_point;
+  };
+  /**
+   * Get the candidates of a point
+   * @param i index of the point
+   */
+  inline CandidateSpan get_point_candidates(std::size_t i) const {
+    return CandidateSpan{candidates.data() + offsets[i],
+                         candidates.data() + offsets[i + 1]};
+  };
+  /**
+   * Get the candidates of all the points
+   */
+  inline const std::vector<MM::Candidate> &get_candidates() const {
+    return candidates;
+  };
+  /**
+   * Get the offsets of the candidates of each point, followed by the
+   * number of candidates
+   */
+  inline const std::vector<std::size_t> &get_offsets() const {
+    return offsets;
+  };
+  /**
+   * Copy the candidates into a candidate set per point
+   */
+  inline MM::Traj_Candidates to_traj_candidates() const {
+    MM::Traj_Candidates tr_cs(get_num_points());
+    for (std::size_t i = 0; i < tr_cs.size(); ++i) {
+      tr_cs[i].assign(candidates.begin() + offsets[i],
+                      candidates.begin() + offsets[i + 1]);
+    }
+    return tr_cs;
+  };
+  /**
+   * Drop the weak candidates of each point, keeping at least the best
+   * one. The candidates remaining are renumbered contiguously. The
+   * directions of the edges are read from the network of the last
+   * search.
+   * @param geom    trajectory whose candidates are stored
+   * @param k       number of candidates searched
+   * @param pruning pruning options
+   */
+  void prune(const CORE::LineString &geom, int k,
+             const CandidatePruning &pruning);
+  /**
+   * Copy the candidates of another context found within a smaller number
+   * and radius, which are the first candidates of each point as they are
+   * sorted by distance. The candidates copied are renumbered
+   * contiguously. If a point has no candidate left, the context is
+   * cleared and the point is kept as the missing point.
+   * @param  source context searched with at least k and radius
+   * @param  k      number of candidates of a point
+   * @param  radius search radius
+   * @return false if a point has no candidate
+   */
+  bool select(const CandidateSearchContext &source, int k, double radius);
+  /**
+   * Get the context of the calling thread
+   * @return a context owned by the thread
+   */
+  static CandidateSearchContext &local() {
+    static thread_local CandidateSearchContext context;
+    return context;
+  };
+ private:
+  friend class Network;
+  /**
+   * Copy the boxes of the edges returned by the spatial index
+   * @param box_coords x1,y1,x2,y2 of the box of each edge in the network
+   */
+  void gather_query_boxes(const std::vector<double> &box_coords);
+  /**
+   * Keep the edges returned by the spatial index whose boxes intersect
+   * the search box of a point
+   * @param px x coordinate of the point
+   * @param py y coordinate of the point
+   * @param radius search radius
+   */
+  void filter_query_edges(double px, double py, double radius);
+  inline size_t get_bytes() const {
+    return UTIL::get_vector_bytes(query_edges) +
+        UTIL::get_vector_bytes(box_min_x) + UTIL::get_vector_bytes(box_min_y) +
+        UTIL::get_vector_bytes(box_max_x) + UTIL::get_vector_bytes(box_max_y) +
+        UTIL::get_vector_bytes(box_mask) +
+        UTIL::get_vector_bytes(point_edges) +
+        UTIL::get_vector_bytes(point_candidates) +
+        UTIL::get_vector_bytes(candidates) + UTIL::get_vector_bytes(offsets);
+  };
+  std::vector<EdgeIndex> query_edges; // edges returned by spatial index
+  // Boxes of the query edges, stored by coordinate for the filter
+  std::vector<double> box_min_x;
+  std::vector<double> box_min_y;
+  std::vector<double> box_max_x;
+  std::vector<double> box_max_y;
+  std::vector<unsigned char> box_mask;
+  std::vector<EdgeIndex> point_edges; // query edges kept for a point
+  std::vector<MM::Candidate> point_candidates; // candidates of a point
+  std::vector<MM::Candidate> candidates;
+  std::vector<std::size_t> offsets;
+  int missing_point = -1; // point without candidate of the last search
+  const Network *network = nullptr; // network of the last search
+  // Bytes of the context in the totals of the candidate workspaces
+  UTIL::WorkspaceTracker tracker{UTIL::CANDIDATE_WORKSPACE};
+}; // CandidateSearchContext
+} // NETWORK
+} // FMM
+
+#endif // FMM_CANDIDATE_SEARCH_HPP
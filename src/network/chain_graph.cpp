@@ -0,0 +1,177 @@
+#include "network/chain_graph.hpp"
+#include "network/network.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+ChainGraph::ChainGraph(const Network &network) {
+  const std::vector<Edge> &edges = network.get_edges();
+  unsigned int num_vertices = network.get_node_count();
+  for (const Edge &edge : edges) {
+    num_vertices = std::max(num_vertices,
+                            std::max(edge.source, edge.target) + 1);
+  }
+  std::vector<EdgeProperty> properties;
+  properties.reserve(edges.size());
+  for (const Edge &edge : edges) {
+    properties.push_back({edge.source, edge.target, edge.index, edge.length});
+  }
+  CSRGraph out_graph(num_vertices, properties);
+  CSRGraph in_graph(num_vertices, properties, true);
+  // A node inside a chain has one edge in and out, or the two edges of a
+  // two way road on each side
+  junctions_.assign(num_vertices, 1);
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    unsigned int out_first = out_graph.begin(u);
+    unsigned int in_first = in_graph.begin(u);
+    unsigned int degree = out_graph.end(u) - out_first;
+    if (degree != in_graph.end(u) - in_first || degree < 1 || degree > 2) {
+      continue;
+    }
+    NodeIndex a = out_graph.get_target(out_first);
+    NodeIndex b = in_graph.get_target(in_first);
+    if (a == u || b == u) continue;
+    if (degree == 1) {
+      junctions_[u] = (a == b);
+      continue;
+    }
+    NodeIndex c = out_graph.get_target(out_first + 1);
+    NodeIndex d = in_graph.get_target(in_first + 1);
+    junctions_[u] = !(a != c && c != u &&
+        ((a == b && c == d) || (a == d && c == b)));
+  }
+  positions_.assign(2 * num_vertices, ChainPosition{-1, 0, 0});
+  std::vector<char> walked(edges.size(), 0);
+  chain_offsets_.push_back(0);
+  // Walk the chains of a junction along each of its edges
+  auto walk_chains = [&](NodeIndex source) {
+    for (unsigned int i = out_graph.begin(source); i < out_graph.end(source);
+         ++i) {
+      EdgeIndex e = out_graph.get_index(i);
+      if (walked[e]) continue;
+      int chain = chain_sources_.size();
+      NodeIndex prev = source;
+      NodeIndex v = out_graph.get_target(i);
+      double length = out_graph.get_length(i);
+      walked[e] = 1;
+      chain_edges_.push_back(e);
+      while (!junctions_[v]) {
+        ChainPosition &position = positions_[2 * v].chain < 0 ?
+                                  positions_[2 * v] : positions_[2 * v + 1];
+        position = {chain,
+                    (int) (chain_edges_.size() - chain_offsets_.back()),
+                    length};
+        // Continue away from the node the chain came from
+        unsigned int j = out_graph.begin(v);
+        if (out_graph.end(v) - j == 2 && out_graph.get_target(j) == prev) {
+          ++j;
+        }
+        walked[out_graph.get_index(j)] = 1;
+        chain_edges_.push_back(out_graph.get_index(j));
+        length += out_graph.get_length(j);
+        prev = v;
+        v = out_graph.get_target(j);
+      }
+      chain_sources_.push_back(source);
+      chain_targets_.push_back(v);
+      chain_lengths_.push_back(length);
+      chain_offsets_.push_back(chain_edges_.size());
+    }
+  };
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    if (junctions_[u]) walk_chains(u);
+  }
+  // The edges left are on cycles of nodes inside chains, each broken at
+  // the source of an edge
+  for (const Edge &edge : edges) {
+    if (walked[edge.index]) continue;
+    junctions_[edge.source] = 1;
+    walk_chains(edge.source);
+  }
+  num_junctions_ = std::count(junctions_.begin(), junctions_.end(), 1);
+  SPDLOG_INFO("Chains {} of edges {}, junctions {} of nodes {}",
+              chain_sources_.size(), edges.size(), num_junctions_,
+              num_vertices);
+}
+
+std::vector<EdgeProperty> ChainGraph::get_arcs() const {
+  std::vector<EdgeProperty> arcs;
+  arcs.reserve(chain_sources_.size());
+  for (unsigned int c = 0; c < chain_sources_.size(); ++c) {
+    arcs.push_back({chain_sources_[c], chain_targets_[c], c,
+                    chain_lengths_[c]});
+  }
+  return arcs;
+}
+
+int ChainGraph::get_exits(NodeIndex u, ChainEnd *ends) const {
+  if (junctions_[u]) {
+    ends[0] = {u, 0, -1, 0};
+    return 1;
+  }
+  int n = 0;
+  for (int k = 0; k < 2; ++k) {
+    const ChainPosition &position = positions_[2 * u + k];
+    if (position.chain < 0) break;
+    ends[n++] = {chain_targets_[position.chain],
+                 chain_lengths_[position.chain] - position.offset,
+                 position.chain, position.edge};
+  }
+  return n;
+}
+
+int ChainGraph::get_entries(NodeIndex u, ChainEnd *ends) const {
+  if (junctions_[u]) {
+    ends[0] = {u, 0, -1, 0};
+    return 1;
+  }
+  int n = 0;
+  for (int k = 0; k < 2; ++k) {
+    const ChainPosition &position = positions_[2 * u + k];
+    if (position.chain < 0) break;
+    ends[n++] = {chain_sources_[position.chain], position.offset,
+                 position.chain, position.edge};
+  }
+  return n;
+}
+
+double ChainGraph::find_direct(NodeIndex source, NodeIndex target,
+                               ChainPosition *from,
+                               ChainPosition *to) const {
+  if (junctions_[source] || junctions_[target]) return -1;
+  for (int i = 0; i < 2; ++i) {
+    const ChainPosition &a = positions_[2 * source + i];
+    if (a.chain < 0) break;
+    for (int j = 0; j < 2; ++j) {
+      const ChainPosition &b = positions_[2 * target + j];
+      if (b.chain == a.chain && b.edge > a.edge) {
+        *from = a;
+        *to = b;
+        return b.offset - a.offset;
+      }
+    }
+  }
+  return -1;
+}
+
+void ChainGraph::append_edges(int chain, int first, int last,
+                              std::vector<EdgeIndex> *edges) const {
+  unsigned int begin = chain_offsets_[chain] + first;
+  unsigned int end = last < 0 ? chain_offsets_[chain + 1] :
+                     chain_offsets_[chain] + last;
+  edges->insert(edges->end(), chain_edges_.begin() + begin,
+                chain_edges_.begin() + end);
+}
+
+size_t ChainGraph::get_memory_bytes() const {
+  return junctions_.capacity() +
+      positions_.capacity() * sizeof(ChainPosition) +
+      (chain_sources_.capacity() + chain_targets_.capacity()) *
+          sizeof(NodeIndex) +
+      chain_lengths_.capacity() * sizeof(double) +
+      chain_offsets_.capacity() * sizeof(unsigned int) +
+      chain_edges_.capacity() * sizeof(EdgeIndex);
+}
@@ -0,0 +1,153 @@
+/**
+ * Fast map matching.
+ *
+ * Chains of degree two nodes of the network, contracted into single arcs
+ * between the other nodes
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_CHAIN_GRAPH_HPP
+#define FMM_CHAIN_GRAPH_HPP
+
+#include "network/graph.hpp"
+#include "network/type.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+class Network;
+
+/**
+ * Position of a node inside a chain
+ */
+struct ChainPosition {
+  int chain; /**< Index of the chain, -1 if none */
+  int edge; /**< Number of edges of the chain before the node */
+  double offset; /**< Length of the chain before the node */
+};
+
+/**
+ * End of a path walked along a chain between a node and the junction
+ * at one end of the chain
+ */
+struct ChainEnd {
+  NodeIndex junction; /**< Junction reached or left */
+  double cost; /**< Length walked along the chain */
+  int chain; /**< Chain walked, -1 if the node is the junction */
+  int edge; /**< Position of the node on the chain */
+};
+
+/**
+ * Chains of the network between junctions. A node is inside a chain if
+ * it only splits a road, at a point where the road was digitized: it has
+ * a single edge in and out to two different nodes, or the edges of a
+ * two way road in and out to two different nodes. The other nodes are
+ * the junctions, together with a node of each cycle made only of nodes
+ * inside chains.
+ *
+ * Every edge belongs to exactly one chain, which is a path from a
+ * junction to a junction through nodes inside chains only. The chains
+ * are the arcs of a graph on the junctions, whose shortest paths are the
+ * ones of the network, so that routing and UBODT only need the
+ * junctions. A path from or to a node inside a chain walks along its
+ * chains to their ends.
+ */
+class ChainGraph {
+ public:
+  /**
+   * Find the chains of a network
+   * @param network network data
+   */
+  explicit ChainGraph(const Network &network);
+  /**
+   * Check if a node is a junction, at the end of chains
+   */
+  inline bool is_junction(NodeIndex u) const {
+    return junctions_[u] != 0;
+  };
+  /**
+   * Get the number of nodes of the network
+   */
+  inline unsigned int get_num_vertices() const {
+    return junctions_.size();
+  };
+  /**
+   * Get the number of junctions
+   */
+  inline unsigned int get_num_junctions() const {
+    return num_junctions_;
+  };
+  /**
+   * Get the number of chains
+   */
+  inline unsigned int get_num_chains() const {
+    return chain_sources_.size();
+  };
+  /**
+   * Get the chains as arcs between junctions, whose index is the index
+   * of the chain
+   */
+  std::vector<EdgeProperty> get_arcs() const;
+  /**
+   * Get the ends of the paths leaving a node, at the targets of its
+   * chains
+   * @param  u    node
+   * @param  ends updated with up to two ends, the node itself with no
+   * cost if it is a junction
+   * @return number of ends
+   */
+  int get_exits(NodeIndex u, ChainEnd *ends) const;
+  /**
+   * Get the ends of the paths reaching a node, at the sources of its
+   * chains
+   * @param  u    node
+   * @param  ends updated with up to two ends, the node itself with no
+   * cost if it is a junction
+   * @return number of ends
+   */
+  int get_entries(NodeIndex u, ChainEnd *ends) const;
+  /**
+   * Find the path from a node to a node ahead on the same chain
+   * @param  source source node inside a chain
+   * @param  target target node inside a chain
+   * @param  from   updated with the position of the source on the chain
+   * @param  to     updated with the position of the target on the chain
+   * @return the length of the path, or a negative value if the target is
+   * not ahead of the source on one of its chains
+   */
+  double find_direct(NodeIndex source, NodeIndex target,
+                     ChainPosition *from, ChainPosition *to) const;
+  /**
+   * Append the edges of a chain between two positions
+   * @param chain index of the chain
+   * @param first position of the first edge appended
+   * @param last  position after the last edge appended, -1 for the end
+   * of the chain
+   * @param edges edges updated
+   */
+  void append_edges(int chain, int first, int last,
+                    std::vector<EdgeIndex> *edges) const;
+  /**
+   * Get the bytes of the chains
+   */
+  size_t get_memory_bytes() const;
+ private:
+  std::vector<char> junctions_;
+  unsigned int num_junctions_ = 0;
+  // Positions of each node on the two chains passing it at most, at
+  // 2 * u and 2 * u + 1
+  std::vector<ChainPosition> positions_;
+  std::vector<NodeIndex> chain_sources_;
+  std::vector<NodeIndex> chain_targets_;
+  std::vector<double> chain_lengths_;
+  // Edges of chain c are from chain_offsets_[c] to chain_offsets_[c + 1]
+  std::vector<unsigned int> chain_offsets_;
+  std::vector<EdgeIndex> chain_edges_;
+}; // ChainGraph
+} // NETWORK
+} // FMM
+
+#endif // FMM_CHAIN_GRAPH_HPP
@@ -0,0 +1,150 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/compressed_geometry.hpp"
+#include "algorithm/geometry_kernel.hpp"
+
+#include <atomic>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// Edge decoded in the cache of a thread, where key 0 is an empty slot
+struct DecodedEdge {
+  unsigned long long key = 0;
+  unsigned long long stamp = 0;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> cumlen;
+};
+
+struct DecodeCache {
+  DecodedEdge slots[2 * CompressedGeometry::CACHE_SETS];
+  unsigned long long clock = 0;
+};
+
+DecodeCache &decode_cache() {
+  static thread_local DecodeCache cache;
+  return cache;
+}
+
+std::atomic<unsigned long long> next_owner{1};
+
+inline unsigned long long to_bits(double value) {
+  unsigned long long bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline double from_bits(unsigned long long bits) {
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// The difference of the bits is zigzag encoded, so that small negative
+// differences also take few bytes
+inline void put_delta(unsigned long long bits, unsigned long long previous,
+                      std::vector<unsigned char> *codes) {
+  long long delta = (long long) (bits - previous);
+  unsigned long long value =
+      ((unsigned long long) delta << 1) ^ (unsigned long long) (delta >> 63);
+  while (value >= 0x80) {
+    codes->push_back((unsigned char) (value | 0x80));
+    value >>= 7;
+  }
+  codes->push_back((unsigned char) value);
+}
+
+inline unsigned long long get_delta(const unsigned char **p,
+                                    unsigned long long previous) {
+  unsigned long long value = 0;
+  int shift = 0;
+  unsigned char byte;
+  do {
+    byte = *(*p)++;
+    value |= (unsigned long long) (byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return previous + ((value >> 1) ^ (0 - (value & 1)));
+}
+
+} // namespace
+
+CompressedGeometry::CompressedGeometry(
+    const std::vector<double> &geom_x, const std::vector<double> &geom_y,
+    const std::vector<long long> &geom_offsets,
+    const std::vector<Point> &refs) :
+    owner_(next_owner.fetch_add(1, std::memory_order_relaxed)) {
+  long long num_edges = geom_offsets.empty() ? 0 : geom_offsets.size() - 1;
+  code_offsets_.resize(num_edges + 1);
+  // A coordinate close to the previous one mostly takes 4 to 6 bytes
+  codes_.reserve(geom_x.size() * 10);
+  for (long long i = 0; i < num_edges; ++i) {
+    code_offsets_[i] = codes_.size();
+    unsigned long long px = to_bits(boost::geometry::get<0>(refs[i]));
+    unsigned long long py = to_bits(boost::geometry::get<1>(refs[i]));
+    for (long long j = geom_offsets[i]; j < geom_offsets[i + 1]; ++j) {
+      unsigned long long x = to_bits(geom_x[j]);
+      unsigned long long y = to_bits(geom_y[j]);
+      put_delta(x, px, &codes_);
+      put_delta(y, py, &codes_);
+      px = x;
+      py = y;
+    }
+  }
+  code_offsets_[num_edges] = codes_.size();
+  codes_.shrink_to_fit();
+}
+
+LineStringView CompressedGeometry::decode(EdgeIndex index, int num_points,
+                                          const Point &ref) const {
+  DecodeCache &cache = decode_cache();
+  unsigned long long key = (owner_ << 32) | index;
+  DecodedEdge *slots = &cache.slots[2 * (index % CACHE_SETS)];
+  DecodedEdge *edge;
+  if (slots[0].key == key) {
+    edge = &slots[0];
+  } else if (slots[1].key == key) {
+    edge = &slots[1];
+  } else {
+    // The least recently used edge of the set is replaced, which is
+    // never the one returned by the last call
+    edge = slots[0].stamp <= slots[1].stamp ? &slots[0] : &slots[1];
+    edge->key = key;
+    edge->x.resize(num_points);
+    edge->y.resize(num_points);
+    edge->cumlen.resize(num_points);
+    const unsigned char *p = codes_.data() + code_offsets_[index];
+    unsigned long long px = to_bits(boost::geometry::get<0>(ref));
+    unsigned long long py = to_bits(boost::geometry::get<1>(ref));
+    for (int j = 0; j < num_points; ++j) {
+      px = get_delta(&p, px);
+      py = get_delta(&p, py);
+      edge->x[j] = from_bits(px);
+      edge->y[j] = from_bits(py);
+    }
+    // The cumulative lengths are summed as the ones of the packed store
+    if (num_points > 0) {
+      ALGORITHM::segment_lengths(edge->x.data(), edge->y.data(), num_points,
+                                 edge->cumlen.data() + 1);
+      edge->cumlen[0] = 0;
+      for (int j = 1; j < num_points; ++j) {
+        edge->cumlen[j] += edge->cumlen[j - 1];
+      }
+    }
+  }
+  edge->stamp = ++cache.clock;
+  return LineStringView(edge->x.data(), edge->y.data(), num_points,
+                        edge->cumlen.data());
+}
+
+size_t CompressedGeometry::get_memory_bytes() const {
+  return codes_.capacity() * sizeof(unsigned char) +
+      code_offsets_.capacity() * sizeof(long long);
+}
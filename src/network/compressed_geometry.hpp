@@ -0,0 +1,86 @@
+/**
+ * Fast map matching.
+ *
+ * Edge geometries stored delta and varint encoded, which are decoded on
+ * demand into a small cache kept by each thread
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_NETWORK_COMPRESSED_GEOMETRY_HPP
+#define FMM_NETWORK_COMPRESSED_GEOMETRY_HPP
+
+#include "network/type.hpp"
+#include "core/geometry.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Compressed copy of the packed geometry store of a network.
+ *
+ * Each coordinate is encoded as the zigzag varint of the difference of
+ * its IEEE 754 bits to the ones of the previous point of its edge, and
+ * the first point of an edge as the difference to a reference point,
+ * usually its source node. The encoding is lossless, so that a decoded
+ * edge has exactly the coordinates and the cumulative lengths of the
+ * packed store.
+ *
+ * An edge is decoded into a set associative cache of the calling
+ * thread, which keeps the hot edges decoded. A view returned stays valid
+ * at least until the next call on the thread.
+ */
+class CompressedGeometry {
+ public:
+  CompressedGeometry() = default;
+  /**
+   * Encode the edge geometries of a packed store
+   * @param geom_x       x coordinates of the packed edge geometries
+   * @param geom_y       y coordinates of the packed edge geometries
+   * @param geom_offsets first point of each edge, followed by the number
+   * of points
+   * @param refs         reference point of each edge
+   */
+  CompressedGeometry(const std::vector<double> &geom_x,
+                     const std::vector<double> &geom_y,
+                     const std::vector<long long> &geom_offsets,
+                     const std::vector<CORE::Point> &refs);
+  /**
+   * Check if no geometry is stored
+   */
+  inline bool empty() const {
+    return code_offsets_.empty();
+  };
+  /**
+   * Decode an edge into the cache of the calling thread
+   * @param  index      index of the edge
+   * @param  num_points number of points of the edge
+   * @param  ref        reference point of the edge given when encoded
+   * @return view of the edge with its cumulative lengths, valid at least
+   * until the next call on the thread
+   */
+  CORE::LineStringView decode(EdgeIndex index, int num_points,
+                              const CORE::Point &ref) const;
+  /**
+   * Get the bytes of the encoded geometries
+   */
+  size_t get_memory_bytes() const;
+  /**
+   * Number of sets of the cache of a thread, of two edges each
+   */
+  static const int CACHE_SETS = 64;
+ private:
+  // Codes of edge i are from code_offsets_[i] to code_offsets_[i+1]
+  std::vector<unsigned char> codes_;
+  std::vector<long long> code_offsets_;
+  // Distinguishes the geometries decoded in the caches of the threads
+  unsigned long long owner_ = 0;
+}; // CompressedGeometry
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_NETWORK_COMPRESSED_GEOMETRY_HPP
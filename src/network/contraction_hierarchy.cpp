@@ -0,0 +1,639 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/contraction_hierarchy.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+namespace {
+typedef ContractionHierarchy::Arc Arc;
+
+// Dynamic graph of the nodes not contracted yet, which contracts them
+// one by one into the arcs of the hierarchy
+class HierarchyBuilder {
+ public:
+  HierarchyBuilder(const Network &network, double delta) :
+      delta(delta),
+      num_vertices(network.get_node_count()),
+      out(num_vertices), in(num_vertices),
+      deleted(num_vertices, 0), contracted(num_vertices, 0) {
+    for (const Edge &e : network.get_edges()) {
+      if (e.source == e.target || e.length > delta) continue;
+      add_arc(e.source, {e.target, ContractionHierarchy::NO_VIA, e.length,
+                         e.target, e.index, e.index, e.source});
+    }
+  };
+  // Contract all the nodes, where up stores the arcs from a node to the
+  // nodes contracted after it and down stores the arcs into a node from
+  // the nodes contracted after it.
+  long long contract(std::vector<std::vector<Arc>> *up,
+                     std::vector<std::vector<Arc>> *down) {
+    typedef std::pair<int, NodeIndex> QueueNode;
+    std::priority_queue<QueueNode, std::vector<QueueNode>,
+                        std::greater<QueueNode>> queue;
+    std::vector<std::pair<NodeIndex, Arc>> shortcuts;
+    for (NodeIndex v = 0; v < num_vertices; ++v) {
+      queue.push({priority(v, &shortcuts), v});
+    }
+    up->resize(num_vertices);
+    down->resize(num_vertices);
+    long long num_shortcuts = 0;
+    unsigned int progress = 0;
+    unsigned int step_size = std::max(num_vertices / 10, 10u);
+    while (!queue.empty()) {
+      NodeIndex v = queue.top().second;
+      queue.pop();
+      if (contracted[v]) continue;
+      // The priority is updated lazily when the node is popped
+      int value = priority(v, &shortcuts);
+      if (!queue.empty() && value > queue.top().first) {
+        queue.push({value, v});
+        continue;
+      }
+      (*up)[v] = out[v];
+      (*down)[v] = in[v];
+      for (const Arc &a : in[v]) remove_arc(&out[a.node], v);
+      for (const Arc &b : out[v]) remove_arc(&in[b.node], v);
+      for (const Arc &a : in[v]) ++deleted[a.node];
+      for (const Arc &b : out[v]) ++deleted[b.node];
+      std::vector<Arc>().swap(out[v]);
+      std::vector<Arc>().swap(in[v]);
+      contracted[v] = 1;
+      for (const auto &shortcut : shortcuts) {
+        add_arc(shortcut.first, shortcut.second);
+      }
+      num_shortcuts += shortcuts.size();
+      if (++progress % step_size == 0) {
+        SPDLOG_INFO("Contract progress {} / {} shortcuts {}",
+                    progress, num_vertices, num_shortcuts);
+      }
+    }
+    return num_shortcuts;
+  };
+ private:
+  // Insert an arc from u unless a shorter one exists
+  void add_arc(NodeIndex u, const Arc &arc) {
+    NodeIndex w = arc.node;
+    for (Arc &a : out[u]) {
+      if (a.node != w) continue;
+      if (a.cost <= arc.cost) return;
+      a = arc;
+      for (Arc &b : in[w]) {
+        if (b.node == u) {
+          b = arc;
+          b.node = u;
+        }
+      }
+      return;
+    }
+    out[u].push_back(arc);
+    Arc reverse = arc;
+    reverse.node = u;
+    in[w].push_back(reverse);
+  };
+  static void remove_arc(std::vector<Arc> *arcs, NodeIndex v) {
+    arcs->erase(std::remove_if(arcs->begin(), arcs->end(),
+                               [v](const Arc &a) { return a.node == v; }),
+                arcs->end());
+  };
+  // Find the shortcuts needed to contract v and return its priority
+  int priority(NodeIndex v,
+               std::vector<std::pair<NodeIndex, Arc>> *shortcuts) {
+    shortcuts->clear();
+    for (const Arc &a : in[v]) {
+      NodeIndex u = a.node;
+      double max_cost = -1;
+      for (const Arc &b : out[v]) {
+        if (b.node != u && a.cost + b.cost <= delta)
+          max_cost = std::max(max_cost, a.cost + b.cost);
+      }
+      if (max_cost < 0) continue;
+      witness_search(u, v, max_cost);
+      for (const Arc &b : out[v]) {
+        NodeIndex w = b.node;
+        double cost = a.cost + b.cost;
+        if (w == u || cost > delta) continue;
+        if (ws.visited(w) && ws.get_distance(w) <= cost) continue;
+        shortcuts->push_back(
+            {u, {w, v, cost, a.first_n, a.first_e, b.last_e, b.prev_n}});
+      }
+    }
+    return (int) shortcuts->size() - (int) in[v].size() -
+        (int) out[v].size() + deleted[v];
+  };
+  // Dijkstra search from u avoiding v, bounded by max_cost
+  void witness_search(NodeIndex u, NodeIndex v, double max_cost) {
+    ws.reset(num_vertices);
+    ws.set(u, 0, u);
+    ws.push(u, 0);
+    int settled = 0;
+    while (!ws.empty()) {
+      HeapNode node = ws.top();
+      if (node.value > max_cost ||
+          ++settled > ContractionHierarchy::WITNESS_SETTLE_LIMIT)
+        break;
+      ws.pop();
+      for (const Arc &a : out[node.index]) {
+        if (a.node == v) continue;
+        double dist = node.value + a.cost;
+        if (dist > max_cost) continue;
+        if (!ws.visited(a.node)) {
+          ws.set(a.node, dist, node.index);
+          ws.push(a.node, dist);
+        } else if (ws.get_distance(a.node) > dist) {
+          ws.set(a.node, dist, node.index);
+          ws.decrease_key(a.node, dist);
+        }
+      }
+    }
+  };
+  double delta;
+  unsigned int num_vertices;
+  std::vector<std::vector<Arc>> out;
+  std::vector<std::vector<Arc>> in;
+  std::vector<int> deleted; // number of neighbors contracted
+  std::vector<char> contracted;
+  SearchWorkspace ws;
+};
+
+// Store the lists of arcs in offsets and a single array
+void flatten_arcs(std::vector<std::vector<Arc>> *lists,
+                  std::vector<long long> *offsets,
+                  std::vector<Arc> *arcs) {
+  offsets->assign(lists->size() + 1, 0);
+  for (size_t i = 0; i < lists->size(); ++i) {
+    (*offsets)[i + 1] = (*offsets)[i] + (*lists)[i].size();
+  }
+  arcs->clear();
+  arcs->reserve(offsets->back());
+  for (std::vector<Arc> &list : *lists) {
+    arcs->insert(arcs->end(), list.begin(), list.end());
+    std::vector<Arc>().swap(list);
+  }
+}
+
+// Upward search on the arcs in offsets and arcs bounded by delta, where
+// the predecessor of a node keeps the node before the last edge and the
+// path ends keep the first and the last edges of its path from s. For
+// a backward search on the reversed arcs, the first edge is the one
+// leaving the node and the last edge is the one entering s. A node is
+// stalled when a shorter path to it comes down from a higher node on the
+// opposite arcs, and only the nodes not stalled are added to settled.
+void upward_search(NodeIndex s, double delta,
+                   const std::vector<long long> &offsets,
+                   const std::vector<Arc> &arcs,
+                   const std::vector<long long> &stall_offsets,
+                   const std::vector<Arc> &stall_arcs, bool backward,
+                   SearchWorkspace *ws, std::vector<NodeIndex> *settled) {
+  ws->reset(offsets.size() - 1);
+  ws->set(s, 0, s);
+  ws->push(s, 0);
+  settled->clear();
+  while (!ws->empty()) {
+    HeapNode node = ws->top();
+    ws->pop();
+    NodeIndex u = node.index;
+    bool stalled = false;
+    for (long long i = stall_offsets[u]; i < stall_offsets[u + 1]; ++i) {
+      const Arc &a = stall_arcs[i];
+      if (ws->visited(a.node) &&
+          ws->get_distance(a.node) + a.cost < node.value) {
+        stalled = true;
+        break;
+      }
+    }
+    if (stalled) continue;
+    settled->push_back(u);
+    for (long long i = offsets[u]; i < offsets[u + 1]; ++i) {
+      const Arc &a = arcs[i];
+      double dist = node.value + a.cost;
+      if (dist > delta) continue;
+      bool reached = ws->visited(a.node);
+      if (reached && ws->get_distance(a.node) <= dist) continue;
+      PathEnds ends{a.first_n, a.first_e, a.last_e};
+      NodeIndex prev_n = a.prev_n;
+      if (u != s) {
+        const PathEnds &u_ends = ws->get_ends(u);
+        if (backward) {
+          ends.last_e = u_ends.last_e;
+          prev_n = ws->get_predecessor(u);
+        } else {
+          ends.first_n = u_ends.first_n;
+          ends.first_e = u_ends.first_e;
+        }
+      }
+      ws->set(a.node, dist, prev_n);
+      ws->set_ends(a.node, ends);
+      if (reached) {
+        ws->decrease_key(a.node, dist);
+      } else {
+        ws->push(a.node, dist);
+      }
+    }
+  }
+}
+
+// Upward search of a query bounded by delta, where the predecessor of a
+// node is its parent in the hierarchy. The stalled nodes are not added
+// to settled.
+void query_search(NodeIndex s, double delta,
+                  const std::vector<long long> &offsets,
+                  const std::vector<Arc> &arcs,
+                  const std::vector<long long> &stall_offsets,
+                  const std::vector<Arc> &stall_arcs,
+                  SearchWorkspace *ws, std::vector<NodeIndex> *settled) {
+  ws->reset(offsets.size() - 1);
+  ws->set(s, 0, s);
+  ws->push(s, 0);
+  settled->clear();
+  while (!ws->empty()) {
+    HeapNode node = ws->top();
+    ws->pop();
+    NodeIndex u = node.index;
+    bool stalled = false;
+    for (long long i = stall_offsets[u]; i < stall_offsets[u + 1]; ++i) {
+      const Arc &a = stall_arcs[i];
+      if (ws->visited(a.node) &&
+          ws->get_distance(a.node) + a.cost < node.value) {
+        stalled = true;
+        break;
+      }
+    }
+    if (stalled) continue;
+    settled->push_back(u);
+    for (long long i = offsets[u]; i < offsets[u + 1]; ++i) {
+      const Arc &a = arcs[i];
+      double dist = node.value + a.cost;
+      if (dist > delta) continue;
+      if (!ws->visited(a.node)) {
+        ws->set(a.node, dist, u);
+        ws->push(a.node, dist);
+      } else if (ws->get_distance(a.node) > dist) {
+        ws->set(a.node, dist, u);
+        ws->decrease_key(a.node, dist);
+      }
+    }
+  }
+}
+
+// Workspace of the backward search of a query, next to the one of the
+// forward search returned by SearchWorkspace::local
+SearchWorkspace &backward_workspace() {
+  static thread_local SearchWorkspace ws;
+  return ws;
+}
+
+// Arc from u in the arcs stored for node v
+const Arc *find_arc(const std::vector<long long> &offsets,
+                    const std::vector<Arc> &arcs, NodeIndex v, NodeIndex u) {
+  for (long long i = offsets[v]; i < offsets[v + 1]; ++i) {
+    if (arcs[i].node == u) return &arcs[i];
+  }
+  return nullptr;
+}
+
+// Arc of a path in the hierarchy, where the node stored in the arc is
+// the other end from the node indexing it
+struct HierarchyStep {
+  NodeIndex from;
+  NodeIndex to;
+  const Arc *arc;
+};
+
+// Header of the hierarchy file, followed by the offsets and the arcs of
+// the upward and then the downward arcs
+struct HierarchyHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int num_vertices;
+  unsigned int num_edges;
+  unsigned int arc_size;
+  long long num_shortcuts;
+  long long num_up_arcs;
+  long long num_down_arcs;
+  double delta;
+};
+
+const char HIERARCHY_MAGIC[8] = {'F', 'M', 'M', 'C', 'H', 'I', 'E', 'R'};
+}
+
+ContractionHierarchy::ContractionHierarchy(
+    const Network &network, double delta, bool use_omp, bool buckets) :
+    delta_(delta), num_vertices(network.get_node_count()),
+    num_edges(network.get_edge_count()) {
+  SPDLOG_INFO("Build contraction hierarchy with delta {}", delta);
+  std::vector<std::vector<Arc>> up, down;
+  {
+    HierarchyBuilder builder(network, delta);
+    num_shortcuts = builder.contract(&up, &down);
+  }
+  flatten_arcs(&up, &up_offsets, &up_arcs);
+  flatten_arcs(&down, &down_offsets, &down_arcs);
+  SPDLOG_INFO("Shortcuts {} upward arcs {} downward arcs {}",
+              num_shortcuts, up_arcs.size(), down_arcs.size());
+  if (buckets) build_buckets(use_omp);
+}
+
+void ContractionHierarchy::build_buckets(bool use_omp) {
+  double delta = delta_;
+  // Backward search from every target, collected by the node reached
+  std::vector<long long> counts(num_vertices + 1, 0);
+  std::vector<std::pair<NodeIndex, Arc>> entries;
+#pragma omp parallel if(use_omp)
+  {
+    std::vector<std::pair<NodeIndex, Arc>> local_entries;
+    std::vector<NodeIndex> settled;
+    SearchWorkspace &ws = SearchWorkspace::local();
+#pragma omp for schedule(dynamic, 256)
+    for (int t = 0; t < (int) num_vertices; ++t) {
+      upward_search(t, delta, down_offsets, down_arcs, up_offsets, up_arcs,
+                    true, &ws, &settled);
+      for (NodeIndex x : settled) {
+        const PathEnds &ends = ws.get_ends(x);
+        local_entries.push_back(
+            {x, {(NodeIndex) t, ContractionHierarchy::NO_VIA,
+                 ws.get_distance(x), ends.first_n, ends.first_e,
+                 ends.last_e, ws.get_predecessor(x)}});
+      }
+    }
+#pragma omp critical
+    entries.insert(entries.end(), local_entries.begin(),
+                   local_entries.end());
+  }
+  for (const auto &entry : entries) ++counts[entry.first + 1];
+  for (unsigned int x = 0; x < num_vertices; ++x) {
+    counts[x + 1] += counts[x];
+  }
+  bucket_offsets = counts;
+  bucket_entries.resize(entries.size());
+  for (const auto &entry : entries) {
+    bucket_entries[counts[entry.first]++] = entry.second;
+  }
+  // Sorted by cost, the scan of a bucket stops at the first entry
+  // beyond delta
+  for (unsigned int x = 0; x < num_vertices; ++x) {
+    std::sort(bucket_entries.begin() + bucket_offsets[x],
+              bucket_entries.begin() + bucket_offsets[x + 1],
+              [](const Arc &a, const Arc &b) { return a.cost < b.cost; });
+  }
+  SPDLOG_INFO("Bucket entries {}", bucket_entries.size());
+}
+
+void ContractionHierarchy::single_source_upperbound(
+    NodeIndex s, double delta, PredecessorMap *pmap, DistanceMap *dmap,
+    PathEndMap *emap) const {
+  static thread_local SearchWorkspace targets;
+  static thread_local std::vector<NodeIndex> settled;
+  SearchWorkspace &ws = SearchWorkspace::local();
+  upward_search(s, delta, up_offsets, up_arcs, down_offsets, down_arcs,
+                false, &ws, &settled);
+  // A shortest path goes up from s to its highest node x and down to
+  // the target t, where the part from x to t is in the bucket of x.
+  targets.reset(num_vertices);
+  for (NodeIndex x : settled) {
+    double forward = ws.get_distance(x);
+    for (long long i = bucket_offsets[x]; i < bucket_offsets[x + 1]; ++i) {
+      const Arc &entry = bucket_entries[i];
+      NodeIndex t = entry.node;
+      double dist = forward + entry.cost;
+      if (dist > delta) break;
+      if (t == s) continue;
+      if (targets.visited(t) && targets.get_distance(t) <= dist) continue;
+      PathEnds ends{entry.first_n, entry.first_e, entry.last_e};
+      NodeIndex prev_n = entry.prev_n;
+      if (x != s) {
+        ends.first_n = ws.get_ends(x).first_n;
+        ends.first_e = ws.get_ends(x).first_e;
+      }
+      if (x == t) {
+        ends.last_e = ws.get_ends(x).last_e;
+        prev_n = ws.get_predecessor(x);
+      }
+      targets.set(t, dist, prev_n);
+      targets.set_ends(t, ends);
+    }
+  }
+  pmap->insert({s, s});
+  dmap->insert({s, 0});
+  for (NodeIndex t : targets.get_visited()) {
+    pmap->insert({t, targets.get_predecessor(t)});
+    dmap->insert({t, targets.get_distance(t)});
+    if (emap != nullptr) emap->insert({t, targets.get_ends(t)});
+  }
+}
+
+double ContractionHierarchy::shortest_path(
+    NodeIndex source, NodeIndex target, std::vector<EdgeIndex> *path) const {
+  if (path != nullptr) path->clear();
+  if (source >= num_vertices || target >= num_vertices) return -1;
+  if (source == target) return 0;
+  std::vector<NodeIndex> forward_settled, backward_settled;
+  SearchWorkspace &fws = SearchWorkspace::local();
+  SearchWorkspace &bws = backward_workspace();
+  query_search(source, delta_, up_offsets, up_arcs, down_offsets,
+               down_arcs, &fws, &forward_settled);
+  query_search(target, delta_, down_offsets, down_arcs, up_offsets,
+               up_arcs, &bws, &backward_settled);
+  // The highest node of the shortest path is reached by both searches
+  double best = -1;
+  NodeIndex meet = source;
+  for (NodeIndex x : forward_settled) {
+    if (!bws.visited(x)) continue;
+    double dist = fws.get_distance(x) + bws.get_distance(x);
+    if (best < 0 || dist < best) {
+      best = dist;
+      meet = x;
+    }
+  }
+  if (best < 0 || path == nullptr) return best;
+  // Arcs of the path in the hierarchy, up from source to the meeting
+  // node and down to target
+  std::vector<HierarchyStep> steps;
+  for (NodeIndex v = meet; v != source; v = fws.get_predecessor(v)) {
+    NodeIndex u = fws.get_predecessor(v);
+    steps.push_back({u, v, find_arc(up_offsets, up_arcs, u, v)});
+  }
+  std::reverse(steps.begin(), steps.end());
+  for (NodeIndex u = meet; u != target; u = bws.get_predecessor(u)) {
+    NodeIndex v = bws.get_predecessor(u);
+    steps.push_back({u, v, find_arc(down_offsets, down_arcs, v, u)});
+  }
+  for (const HierarchyStep &step : steps) {
+    unpack_arc(step.from, step.to, *step.arc, path);
+  }
+  return best;
+}
+
+void ContractionHierarchy::unpack_arc(NodeIndex u, NodeIndex w,
+                                      const Arc &arc,
+                                      std::vector<EdgeIndex> *path) const {
+  // A shortcut from u to w contracting v is unpacked into the arc from u
+  // stored in the downward arcs of v and the arc to w stored in its
+  // upward arcs.
+  std::vector<HierarchyStep> stack{{u, w, &arc}};
+  while (!stack.empty()) {
+    HierarchyStep step = stack.back();
+    stack.pop_back();
+    if (step.arc->via == NO_VIA) {
+      path->push_back(step.arc->first_e);
+      continue;
+    }
+    NodeIndex v = step.arc->via;
+    stack.push_back({v, step.to, find_arc(up_offsets, up_arcs, v, step.to)});
+    stack.push_back(
+        {step.from, v, find_arc(down_offsets, down_arcs, v, step.from)});
+  }
+}
+
+std::vector<double> ContractionHierarchy::one_to_many(
+    NodeIndex source, const std::vector<NodeIndex> &targets,
+    double delta) const {
+  return many_to_many({source}, targets, delta).front();
+}
+
+std::vector<std::vector<double>> ContractionHierarchy::many_to_many(
+    const std::vector<NodeIndex> &sources,
+    const std::vector<NodeIndex> &targets, double delta) const {
+  std::vector<std::vector<double>> result(
+      sources.size(), std::vector<double>(
+          targets.size(), std::numeric_limits<double>::max()));
+  if (delta < 0) return result;
+  delta = std::min(delta, delta_);
+  typedef std::pair<size_t, double> BucketEntry;
+  std::unordered_map<NodeIndex, std::vector<BucketEntry>> buckets;
+  std::vector<NodeIndex> settled;
+  SearchWorkspace &ws = SearchWorkspace::local();
+  for (size_t j = 0; j < targets.size(); ++j) {
+    if (targets[j] >= num_vertices) continue;
+    query_search(targets[j], delta, down_offsets, down_arcs, up_offsets,
+                 up_arcs, &ws, &settled);
+    for (NodeIndex x : settled) {
+      buckets[x].push_back({j, ws.get_distance(x)});
+    }
+  }
+  for (size_t i = 0; i < sources.size(); ++i) {
+    if (sources[i] >= num_vertices) continue;
+    query_search(sources[i], delta, up_offsets, up_arcs, down_offsets,
+                 down_arcs, &ws, &settled);
+    std::vector<double> &row = result[i];
+    for (NodeIndex x : settled) {
+      auto iter = buckets.find(x);
+      if (iter == buckets.end()) continue;
+      double forward = ws.get_distance(x);
+      for (const BucketEntry &entry : iter->second) {
+        double dist = forward + entry.second;
+        if (dist <= delta && dist < row[entry.first]) {
+          row[entry.first] = dist;
+        }
+      }
+    }
+  }
+  return result;
+}
+
+bool ContractionHierarchy::write_hierarchy_file(
+    const std::string &filename) const {
+  SPDLOG_INFO("Write contraction hierarchy to {}", filename);
+  FILE *stream = fopen(filename.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return false;
+  }
+  HierarchyHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, HIERARCHY_MAGIC, sizeof(HIERARCHY_MAGIC));
+  header.version = FILE_VERSION;
+  header.num_vertices = num_vertices;
+  header.num_edges = num_edges;
+  header.arc_size = sizeof(Arc);
+  header.num_shortcuts = num_shortcuts;
+  header.num_up_arcs = up_arcs.size();
+  header.num_down_arcs = down_arcs.size();
+  header.delta = delta_;
+  bool success = fwrite(&header, sizeof(header), 1, stream) == 1;
+  size_t num_offsets = num_vertices + 1;
+  success = success &&
+      fwrite(up_offsets.data(), sizeof(long long), num_offsets, stream) ==
+          num_offsets &&
+      fwrite(up_arcs.data(), sizeof(Arc), up_arcs.size(), stream) ==
+          up_arcs.size() &&
+      fwrite(down_offsets.data(), sizeof(long long), num_offsets, stream) ==
+          num_offsets &&
+      fwrite(down_arcs.data(), sizeof(Arc), down_arcs.size(), stream) ==
+          down_arcs.size();
+  if (fclose(stream) != 0) success = false;
+  if (!success) {
+    SPDLOG_CRITICAL("Failed to write contraction hierarchy {}", filename);
+  }
+  return success;
+}
+
+std::shared_ptr<ContractionHierarchy>
+ContractionHierarchy::read_hierarchy_file(const std::string &filename,
+                                          const Network &network) {
+  SPDLOG_INFO("Read contraction hierarchy from {}", filename);
+  FILE *stream = fopen(filename.c_str(), "rb");
+  if (stream == nullptr) {
+    SPDLOG_CRITICAL("Failed to open file {}", filename);
+    return nullptr;
+  }
+  HierarchyHeader header;
+  bool success = fread(&header, sizeof(header), 1, stream) == 1;
+  if (!success ||
+      memcmp(header.magic, HIERARCHY_MAGIC, sizeof(HIERARCHY_MAGIC)) != 0 ||
+      header.version != FILE_VERSION || header.arc_size != sizeof(Arc)) {
+    SPDLOG_CRITICAL("Invalid contraction hierarchy file {}", filename);
+    fclose(stream);
+    return nullptr;
+  }
+  if (header.num_vertices != (unsigned int) network.get_node_count() ||
+      header.num_edges != (unsigned int) network.get_edge_count()) {
+    SPDLOG_CRITICAL("Contraction hierarchy {} is built from a network of "
+                    "nodes {} edges {}, not nodes {} edges {}", filename,
+                    header.num_vertices, header.num_edges,
+                    network.get_node_count(), network.get_edge_count());
+    fclose(stream);
+    return nullptr;
+  }
+  std::shared_ptr<ContractionHierarchy> hierarchy(new ContractionHierarchy());
+  hierarchy->delta_ = header.delta;
+  hierarchy->num_vertices = header.num_vertices;
+  hierarchy->num_edges = header.num_edges;
+  hierarchy->num_shortcuts = header.num_shortcuts;
+  size_t num_offsets = header.num_vertices + 1;
+  hierarchy->up_offsets.resize(num_offsets);
+  hierarchy->up_arcs.resize(header.num_up_arcs);
+  hierarchy->down_offsets.resize(num_offsets);
+  hierarchy->down_arcs.resize(header.num_down_arcs);
+  success =
+      fread(hierarchy->up_offsets.data(), sizeof(long long), num_offsets,
+            stream) == num_offsets &&
+      fread(hierarchy->up_arcs.data(), sizeof(Arc), header.num_up_arcs,
+            stream) == (size_t) header.num_up_arcs &&
+      fread(hierarchy->down_offsets.data(), sizeof(long long), num_offsets,
+            stream) == num_offsets &&
+      fread(hierarchy->down_arcs.data(), sizeof(Arc), header.num_down_arcs,
+            stream) == (size_t) header.num_down_arcs;
+  fclose(stream);
+  if (!success || hierarchy->up_offsets.back() != header.num_up_arcs ||
+      hierarchy->down_offsets.back() != header.num_down_arcs) {
+    SPDLOG_CRITICAL("Contraction hierarchy file {} is truncated", filename);
+    return nullptr;
+  }
+  SPDLOG_INFO("Contraction hierarchy delta {} shortcuts {}",
+              header.delta, header.num_shortcuts);
+  return hierarchy;
+}
@@ -0,0 +1,192 @@
+/**
+ * Fast map matching.
+ *
+ * Contraction hierarchy of the network for bulk upper bounded routing
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_CONTRACTION_HIERARCHY_HPP
+#define FMM_CONTRACTION_HIERARCHY_HPP
+
+#include "network/graph.hpp"
+#include "network/network.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+/**
+ * Contraction hierarchy of a network, which answers the upper bounded
+ * routing from every source with a bucket based many-to-many search.
+ *
+ * The nodes are contracted in the order of their edge difference, where
+ * a shortcut is only added for a path not longer than delta. The
+ * backward upward search from every node is run once and stored in the
+ * buckets of the nodes it reaches, so that the routing from a source is
+ * a forward upward search scanning the buckets of the nodes settled.
+ * Each arc keeps the ends of the original path it represents, hence
+ * the paths are never unpacked in the bulk routing.
+ *
+ * Without the buckets, the hierarchy answers point to point and many to
+ * many queries with bidirectional upward searches, where a path is
+ * unpacked through the node contracted by each shortcut. A hierarchy
+ * built with an infinite delta answers queries of any length, which can
+ * be saved to a file and loaded without the contraction.
+ */
+class ContractionHierarchy {
+ public:
+  /**
+   * Construct the hierarchy and the buckets of the network
+   * @param network network data
+   * @param delta   upper bound of the routing
+   * @param use_omp whether build the buckets parallelly
+   * @param buckets whether build the buckets, which are only needed by
+   * single_source_upperbound
+   */
+  ContractionHierarchy(const Network &network, double delta,
+                       bool use_omp = false, bool buckets = true);
+  /**
+   * Read a hierarchy from a file written by write_hierarchy_file, which
+   * has no buckets
+   * @param filename input file name
+   * @param network  network the hierarchy is built from
+   * @return the hierarchy or nullptr if the file cannot be read or is
+   * built from another network
+   */
+  static std::shared_ptr<ContractionHierarchy> read_hierarchy_file(
+      const std::string &filename, const Network &network);
+  /**
+   * Write the hierarchy to a binary file, without the buckets
+   * @param filename output file name
+   * @return true if success
+   */
+  bool write_hierarchy_file(const std::string &filename) const;
+  /**
+   * Build the buckets of the backward searches from every node
+   * @param use_omp whether build the buckets parallelly
+   */
+  void build_buckets(bool use_omp = false);
+  /**
+   * Check if the buckets are built
+   */
+  inline bool has_buckets() const {
+    return !bucket_offsets.empty();
+  };
+  /**
+   * Routing from a single source to the nodes within delta, with the
+   * result stored in the same way as
+   * NetworkGraph::single_source_upperbound_dijkstra. Among paths of the
+   * same length, the one found may differ from that of Dijkstra and the
+   * distance may differ by rounding.
+   * @param s     source node
+   * @param delta upper bound, which should not be larger than the one
+   * of the hierarchy
+   * @param pmap  predecessor map updated, which stores the node before
+   * the last edge of the path
+   * @param dmap  distance map updated
+   * @param emap  path end map updated, not storing the source node
+   */
+  void single_source_upperbound(NodeIndex s, double delta,
+                                PredecessorMap *pmap,
+                                DistanceMap *dmap,
+                                PathEndMap *emap) const;
+  /**
+   * Shortest path query from source to target with a bidirectional
+   * search
+   * @param source source node
+   * @param target target node
+   * @param path   if not nullptr, updated to store the edges of the path
+   * @return distance of the path, or -1 if the target is not reached
+   * within the delta of the hierarchy
+   */
+  double shortest_path(NodeIndex source, NodeIndex target,
+                       std::vector<EdgeIndex> *path = nullptr) const;
+  /**
+   * Distances from a source to several targets
+   * @param source  source node
+   * @param targets target nodes
+   * @param delta   upper bound of the distances
+   * @return distance to each target, which is the maximum double value
+   * for a target not reached within delta
+   */
+  std::vector<double> one_to_many(NodeIndex source,
+                                  const std::vector<NodeIndex> &targets,
+                                  double delta) const;
+  /**
+   * Distances from several sources to several targets, where the
+   * upward search from each source and from each target runs once
+   * @param sources source nodes
+   * @param targets target nodes
+   * @param delta   upper bound of the distances
+   * @return distance indexed by source and then target, which is the
+   * maximum double value for a pair not reached within delta
+   */
+  std::vector<std::vector<double>> many_to_many(
+      const std::vector<NodeIndex> &sources,
+      const std::vector<NodeIndex> &targets, double delta) const;
+  /**
+   * Get the upper bound of the hierarchy
+   */
+  inline double get_delta() const {
+    return delta_;
+  };
+  /**
+   * Get the number of shortcuts added by the contraction
+   */
+  inline long long get_num_shortcuts() const {
+    return num_shortcuts;
+  };
+  /**
+   * Get the number of entries stored in the buckets
+   */
+  inline long long get_num_bucket_entries() const {
+    return bucket_entries.size();
+  };
+  /**
+   * An original edge or a shortcut, storing the ends of the path
+   * between the nodes
+   */
+  struct Arc {
+    NodeIndex node; /**< Node at the other end */
+    NodeIndex via; /**< Node contracted by a shortcut, or NO_VIA for an
+                        original edge */
+    double cost; /**< Length of the path */
+    NodeIndex first_n; /**< Second node of the path */
+    EdgeIndex first_e; /**< First edge of the path */
+    EdgeIndex last_e; /**< Last edge of the path */
+    NodeIndex prev_n; /**< Node before the last edge of the path */
+  };
+  static const NodeIndex NO_VIA = 0xFFFFFFFF; /**< Via node of an arc
+      which is not a shortcut */
+  static const unsigned int FILE_VERSION = 1; /**< Version of the
+      hierarchy file */
+  static const int WITNESS_SETTLE_LIMIT = 200; /**< Maximum number of
+      nodes settled in a witness search, beyond which a shortcut is added */
+ private:
+  ContractionHierarchy() = default;
+  // Append the original edges of an arc from u to w
+  void unpack_arc(NodeIndex u, NodeIndex w, const Arc &arc,
+                  std::vector<EdgeIndex> *path) const;
+  double delta_ = 0;
+  unsigned int num_vertices = 0;
+  unsigned int num_edges = 0; // edges of the network, checked on reading
+  long long num_shortcuts = 0;
+  // Arcs to higher nodes, indexed by the lower source node
+  std::vector<long long> up_offsets;
+  std::vector<Arc> up_arcs;
+  // Arcs from higher nodes, indexed by the lower target node
+  std::vector<long long> down_offsets;
+  std::vector<Arc> down_arcs;
+  // Paths from a node to the targets of the backward searches reaching
+  // it, where the node of an entry is the target
+  std::vector<long long> bucket_offsets;
+  std::vector<Arc> bucket_entries;
+}; // ContractionHierarchy
+} // NETWORK
+} // FMM
+
+#endif // FMM_CONTRACTION_HIERARCHY_HPP
@@ -0,0 +1,105 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/edge_closures.hpp"
+#include "network/network.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// The searches are run inside the look ups, which may themselves use the
+// workspace returned by SearchWorkspace::local
+SearchWorkspace &closure_workspace() {
+  static thread_local SearchWorkspace ws;
+  return ws;
+}
+
+} // namespace
+
+EdgeClosures::EdgeClosures(const NetworkGraph &graph) :
+    graph_(graph), num_edges_(graph.get_network().get_edge_count()),
+    words_(new std::atomic<unsigned long long>[(num_edges_ + 63) / 64]) {
+  for (EdgeIndex w = 0; w < (num_edges_ + 63) / 64; ++w) {
+    words_[w].store(0, std::memory_order_relaxed);
+  }
+}
+
+void EdgeClosures::set_closed(const std::vector<EdgeIndex> &edges) {
+  std::vector<unsigned long long> words((num_edges_ + 63) / 64, 0);
+  for (EdgeIndex e : edges) {
+    if (e < num_edges_) words[e >> 6] |= 1ULL << (e & 63);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  long closed = 0;
+  for (std::size_t w = 0; w < words.size(); ++w) {
+    words_[w].store(words[w], std::memory_order_relaxed);
+    closed += __builtin_popcountll(words[w]);
+  }
+  num_closed_.store(closed, std::memory_order_relaxed);
+  SPDLOG_INFO("Closed edges {}", closed);
+}
+
+std::vector<EdgeIndex> EdgeClosures::get_closed() const {
+  std::vector<EdgeIndex> edges;
+  for (EdgeIndex e = 0; e < num_edges_; ++e) {
+    if (is_closed(e)) edges.push_back(e);
+  }
+  return edges;
+}
+
+bool EdgeClosures::crosses(const std::vector<EdgeIndex> &path) const {
+  for (EdgeIndex e : path) {
+    if (is_closed(e)) return true;
+  }
+  return false;
+}
+
+double EdgeClosures::search(NodeIndex source, NodeIndex target,
+                            double bound,
+                            std::vector<EdgeIndex> *path) const {
+  searches_.fetch_add(1, std::memory_order_relaxed);
+  if (path != nullptr) path->clear();
+  if (source == target) return 0;
+  const CSRGraph &g = graph_.get_graph();
+  SearchWorkspace &ws = closure_workspace();
+  ws.reset(g.get_num_vertices());
+  ws.set(source, 0, source);
+  ws.push(source, 0);
+  while (!ws.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
+    NodeIndex u = node.index;
+    if (node.value > bound) break;
+    if (u == target) {
+      if (path != nullptr) {
+        // The last edge of each node is the arc it was reached by
+        for (NodeIndex v = target; v != source;
+             v = ws.get_predecessor(v)) {
+          path->push_back(ws.get_ends(v).last_e);
+        }
+        std::reverse(path->begin(), path->end());
+      }
+      return node.value;
+    }
+    for (unsigned int i = g.begin(u); i < g.end(u); ++i) {
+      EdgeIndex e = g.get_index(i);
+      if (is_closed(e)) continue;
+      NodeIndex v = g.get_target(i);
+      double dist = node.value + g.get_length(i);
+      if (dist > bound) continue;
+      if (!ws.visited(v) || dist < ws.get_distance(v)) {
+        ws.set(v, dist, u);
+        ws.set_ends(v, PathEnds{v, e, e});
+        ws.decrease_key(v, dist);
+      }
+    }
+  }
+  return -1;
+}
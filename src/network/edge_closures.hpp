@@ -0,0 +1,105 @@
+/**
+ * Fast map matching.
+ *
+ * Overlay of the edges closed at query time, which reroutes the shortest
+ * paths crossing them without regenerating the UBODT
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_NETWORK_EDGE_CLOSURES_HPP
+#define FMM_NETWORK_EDGE_CLOSURES_HPP
+
+#include "network/network_graph.hpp"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * A bitmap of the closed edges of a network, consulted by the look ups
+ * of a UBODT it is attached to. A shortest path found in the UBODT which
+ * crosses a closed edge is treated as a miss and searched again on the
+ * graph, skipping the closed edges, up to the upperbound of the UBODT.
+ *
+ * The closed edges can be replaced while other threads match, a look up
+ * sees each edge either open or closed. When no edge is closed, a look
+ * up only reads an atomic counter.
+ */
+class EdgeClosures {
+ public:
+  /**
+   * Create an overlay where all the edges are open
+   * @param graph graph of the network, whose edge indices are the ones
+   * of the network, which should outlive the overlay
+   */
+  explicit EdgeClosures(const NetworkGraph &graph);
+  /**
+   * Replace the closed edges
+   * @param edges index of the edges closed, the others are opened
+   */
+  void set_closed(const std::vector<EdgeIndex> &edges);
+  /**
+   * Get the index of the closed edges in increasing order
+   */
+  std::vector<EdgeIndex> get_closed() const;
+  /**
+   * Check if no edge is closed
+   */
+  inline bool empty() const {
+    return num_closed_.load(std::memory_order_relaxed) == 0;
+  };
+  /**
+   * Get the number of closed edges
+   */
+  inline long get_num_closed() const {
+    return num_closed_.load(std::memory_order_relaxed);
+  };
+  /**
+   * Check if an edge is closed
+   */
+  inline bool is_closed(EdgeIndex e) const {
+    return e < num_edges_ &&
+        (words_[e >> 6].load(std::memory_order_relaxed) >> (e & 63) & 1);
+  };
+  /**
+   * Check if a path crosses a closed edge
+   * @param path edges of the path
+   */
+  bool crosses(const std::vector<EdgeIndex> &path) const;
+  /**
+   * Search the shortest path between two nodes skipping the closed edges
+   * @param  source source node
+   * @param  target target node
+   * @param  bound  upperbound of the distance searched
+   * @param  path   updated with the edges of the path if not nullptr,
+   * empty if the path is not found
+   * @return the distance of the path, negative if it is longer than the
+   * bound or not found
+   */
+  double search(NodeIndex source, NodeIndex target, double bound,
+                std::vector<EdgeIndex> *path) const;
+  /**
+   * Get the number of searches of the paths crossing a closed edge
+   */
+  inline long get_searches() const {
+    return searches_.load(std::memory_order_relaxed);
+  };
+ private:
+  const NetworkGraph &graph_;
+  EdgeIndex num_edges_;
+  std::unique_ptr<std::atomic<unsigned long long>[]> words_;
+  std::atomic<long> num_closed_{0};
+  mutable std::atomic<long> searches_{0};
+  std::mutex mutex_; // Serializes the updates
+}; // EdgeClosures
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_NETWORK_EDGE_CLOSURES_HPP
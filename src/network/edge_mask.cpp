@@ -0,0 +1,62 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/edge_mask.hpp"
+#include "network/network.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+EdgeMask::EdgeMask(EdgeIndex num_edges,
+                   const std::vector<EdgeIndex> &allowed) :
+    num_edges_(num_edges), words_((num_edges + 63) / 64, 0) {
+  for (EdgeIndex e : allowed) {
+    if (e < num_edges_) words_[e >> 6] |= 1ULL << (e & 63);
+  }
+  for (unsigned long long word : words_) {
+    num_allowed_ += __builtin_popcountll(word);
+  }
+}
+
+std::shared_ptr<EdgeMask> EdgeMask::read_edge_ids(
+    const std::string &filename, const Network &network) {
+  std::ifstream ifs(filename);
+  if (!ifs.good()) {
+    SPDLOG_CRITICAL("Edge mask file not found {}", filename);
+    return nullptr;
+  }
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  std::string text = buffer.str();
+  std::replace(text.begin(), text.end(), ',', ' ');
+  std::istringstream iss(text);
+  std::vector<EdgeIndex> allowed;
+  long unknown = 0;
+  std::string token;
+  while (iss >> token) {
+    char *stop = nullptr;
+    long id = std::strtol(token.c_str(), &stop, 10);
+    if (*stop != '\0') {
+      SPDLOG_CRITICAL("Invalid edge id {} in edge mask {}", token, filename);
+      return nullptr;
+    }
+    try {
+      allowed.push_back(network.get_edge_index((EdgeID) id));
+    } catch (const std::out_of_range &) {
+      ++unknown;
+    }
+  }
+  std::shared_ptr<EdgeMask> mask =
+      std::make_shared<EdgeMask>(network.get_edge_count(), allowed);
+  SPDLOG_INFO("Edge mask {} allows {} of {} edges, {} ids not in the "
+              "network", filename, mask->get_num_allowed(),
+              mask->get_num_edges(), unknown);
+  return mask;
+}
@@ -0,0 +1,87 @@
+/**
+ * Fast map matching.
+ *
+ * Mask of the edges of a network allowed to a profile of vehicles, such
+ * as the edges open to trucks, which filters a view of the network
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_NETWORK_EDGE_MASK_HPP
+#define FMM_NETWORK_EDGE_MASK_HPP
+
+#include "network/type.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+class Network;
+
+/**
+ * A bitmap of the edges of a network allowed to a profile. A graph built
+ * with a mask only has the arcs of the edges allowed, so that the routing
+ * and the UBODT generated on it avoid the others, and the candidate
+ * search of the models matching on that graph skips them. The network,
+ * its geometries and spatial index are shared by all the profiles.
+ *
+ * A mask is not changed once built, so that it is read by any number of
+ * threads.
+ */
+class EdgeMask {
+ public:
+  /**
+   * Create a mask of the edges allowed
+   * @param num_edges number of edges of the network
+   * @param allowed   index of the edges allowed, the others are masked
+   */
+  EdgeMask(EdgeIndex num_edges, const std::vector<EdgeIndex> &allowed);
+  /**
+   * Check if an edge is allowed
+   */
+  inline bool is_allowed(EdgeIndex e) const {
+    return e < num_edges_ && (words_[e >> 6] >> (e & 63) & 1);
+  };
+  /**
+   * Get the number of edges allowed
+   */
+  inline EdgeIndex get_num_allowed() const {
+    return num_allowed_;
+  };
+  /**
+   * Get the number of edges of the network
+   */
+  inline EdgeIndex get_num_edges() const {
+    return num_edges_;
+  };
+  /**
+   * Get the bytes of the bitmap
+   */
+  inline std::size_t get_memory_bytes() const {
+    return words_.size() * sizeof(unsigned long long);
+  };
+  /**
+   * Read the ids of the edges allowed, separated by commas or whitespace.
+   * The ids missing in the network, such as the ones clipped, are
+   * skipped.
+   * @param  filename file of the edge ids
+   * @param  network  network of the edges
+   * @return the mask, or nullptr if the file is not read or an id is
+   * invalid
+   */
+  static std::shared_ptr<EdgeMask> read_edge_ids(
+      const std::string &filename, const Network &network);
+ private:
+  EdgeIndex num_edges_;
+  EdgeIndex num_allowed_ = 0;
+  std::vector<unsigned long long> words_;
+}; // EdgeMask
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_NETWORK_EDGE_MASK_HPP
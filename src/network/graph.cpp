@@ -0,0 +1,84 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/graph.hpp"
+#include "util/parallel.hpp"
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+CSRGraph::CSRGraph(unsigned int num_vertices,
+                   const std::vector<EdgeProperty> &edges, bool reverse) {
+  reset(num_vertices, edges, reverse);
+}
+
+void CSRGraph::reset(unsigned int num_vertices,
+                     const std::vector<EdgeProperty> &edges, bool reverse) {
+  reverse_ = reverse;
+  offsets.assign(num_vertices + 1, 0);
+  targets.resize(edges.size());
+  lengths.resize(edges.size());
+  indices.resize(edges.size());
+  int threads = UTIL::get_parallel_threads(edges.size());
+  if (threads > 1) {
+    reset_parallel(num_vertices, edges, threads);
+    return;
+  }
+  // Counting sort of the edges by the node they are stored in, which
+  // keeps the order of the edges of the same node
+  for (const EdgeProperty &e : edges) {
+    ++offsets[(reverse ? e.target : e.source) + 1];
+  }
+  for (unsigned int u = 0; u < num_vertices; ++u) {
+    offsets[u + 1] += offsets[u];
+  }
+  // The offset of a node is advanced past its edges while they are
+  // placed, and shifted back afterwards
+  for (const EdgeProperty &e : edges) {
+    unsigned int i = offsets[reverse ? e.target : e.source]++;
+    targets[i] = reverse ? e.source : e.target;
+    lengths[i] = e.length;
+    indices[i] = e.index;
+  }
+  for (unsigned int u = num_vertices; u > 0; --u) {
+    offsets[u] = offsets[u - 1];
+  }
+  offsets[0] = 0;
+}
+
+void CSRGraph::reset_parallel(unsigned int num_vertices,
+                              const std::vector<EdgeProperty> &edges,
+                              int threads) {
+  long long num_edges = edges.size();
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_edges; ++k) {
+    const EdgeProperty &e = edges[k];
+    #pragma omp atomic
+    ++offsets[(reverse_ ? e.target : e.source) + 1];
+  }
+  UTIL::parallel_inclusive_scan(&offsets);
+  // The edges are placed in any order and their positions in the edges
+  // given are sorted back within each node
+  std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+  std::vector<unsigned int> positions(num_edges);
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_edges; ++k) {
+    const EdgeProperty &e = edges[k];
+    unsigned int i;
+    #pragma omp atomic capture
+    i = next[reverse_ ? e.target : e.source]++;
+    positions[i] = k;
+  }
+  #pragma omp parallel for schedule(dynamic, 4096) num_threads(threads)
+  for (long long u = 0; u < (long long) num_vertices; ++u) {
+    std::sort(positions.begin() + offsets[u],
+              positions.begin() + offsets[u + 1]);
+    for (unsigned int i = offsets[u]; i < offsets[u + 1]; ++i) {
+      const EdgeProperty &e = edges[positions[i]];
+      targets[i] = reverse_ ? e.source : e.target;
+      lengths[i] = e.length;
+      indices[i] = e.index;
+    }
+  }
+}
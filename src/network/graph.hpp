@@ -1,7 +1,7 @@
 /**
  * Fast map matching.
  *
- * Boost graph types
+ * Graph types
  *
  * @author: Can Yang
  * @version: 2017.11.11
@@ -11,54 +11,173 @@
 #ifndef FMM_GRAPH_TYPE_HPP
 #define FMM_GRAPH_TYPE_HPP
 
-#include <boost/graph/graph_traits.hpp>
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/property_map/property_map.hpp>
-
 #include "network/type.hpp"
+#include "util/pool_allocator.hpp"
 
 namespace FMM{
 namespace NETWORK{
 
 /**
- *  Road edge property.
+ *  Road edge property, which is a directed arc of the graph
  */
 struct EdgeProperty
 {
+  NodeIndex source; /**< source node of the edge */
+  NodeIndex target; /**< target node of the edge */
   EdgeIndex index; /**< Index of the edge */
   double length; /**< length of the edge */
 };
 
 /**
- *  Boost graph type
+ * Graph stored in the compressed sparse row format, where the out arcs of
+ * a node are contiguous in the packed target, length and edge index
+ * arrays, between the offsets of the node and the next one. The arcs of
+ * a node keep the order they are given.
+ *
+ * A reversed graph stores the in arcs of each node instead, where the
+ * target of an arc is the source node of the edge.
  */
-typedef boost::adjacency_list <boost::vecS, boost::vecS, boost::directedS,
-                               boost::no_property, EdgeProperty> Graph_T;
+class CSRGraph {
+ public:
+  /**
+   * Construct an empty graph
+   */
+  CSRGraph() : offsets(1, 0) {};
+  /**
+   * Construct a graph from edges
+   * @param num_vertices number of nodes, which should be larger than the
+   * node indices of the edges
+   * @param edges   edges of the graph
+   * @param reverse whether store the in arcs of each node instead
+   */
+  CSRGraph(unsigned int num_vertices, const std::vector<EdgeProperty> &edges,
+           bool reverse = false);
+  /**
+   * Rebuild the graph from edges, keeping the arrays allocated
+   * @param num_vertices number of nodes
+   * @param edges   edges of the graph
+   * @param reverse whether store the in arcs of each node instead
+   */
+  void reset(unsigned int num_vertices, const std::vector<EdgeProperty> &edges,
+             bool reverse = false);
+  /**
+   * Get the position of the first arc of a node
+   */
+  inline unsigned int begin(NodeIndex u) const {
+    return offsets[u];
+  };
+  /**
+   * Get the position after the last arc of a node
+   */
+  inline unsigned int end(NodeIndex u) const {
+    return offsets[u + 1];
+  };
+  /**
+   * Get the node at the other end of an arc
+   */
+  inline NodeIndex get_target(unsigned int i) const {
+    return targets[i];
+  };
+  /**
+   * Get the length of an arc
+   */
+  inline double get_length(unsigned int i) const {
+    return lengths[i];
+  };
+  /**
+   * Get the edge index of an arc
+   */
+  inline EdgeIndex get_index(unsigned int i) const {
+    return indices[i];
+  };
+  /**
+   * Get the number of nodes
+   */
+  inline unsigned int get_num_vertices() const {
+    return offsets.size() - 1;
+  };
+  /**
+   * Get the number of arcs
+   */
+  inline unsigned int get_num_edges() const {
+    return targets.size();
+  };
+  /**
+   * Check if the in arcs are stored for each node
+   */
+  inline bool is_reverse() const {
+    return reverse_;
+  };
+  /**
+   * Get the bytes of the arrays of the graph
+   */
+  inline size_t get_memory_bytes() const {
+    return offsets.capacity() * sizeof(unsigned int) +
+        targets.capacity() * sizeof(NodeIndex) +
+        lengths.capacity() * sizeof(double) +
+        indices.capacity() * sizeof(EdgeIndex);
+  };
+ private:
+  /**
+   * Rebuild the graph with the counts, their prefix sum and the placement
+   * of the arcs run in parallel
+   * @param threads number of threads
+   */
+  void reset_parallel(unsigned int num_vertices,
+                      const std::vector<EdgeProperty> &edges, int threads);
+  std::vector<unsigned int> offsets;
+  std::vector<NodeIndex> targets;
+  std::vector<double> lengths;
+  std::vector<EdgeIndex> indices;
+  bool reverse_ = false;
+};
 
+#ifdef FMM_NO_POOL_ALLOCATOR
 /**
- * Boost graph edge type
+ * Hash map from a node to a value, allocated by the global allocator
  */
-typedef Graph_T::edge_descriptor EdgeDescriptor;
+template <typename T>
+using NodeMap = std::unordered_map<NodeIndex,T>;
+#else
 /**
- * Boost graph node iterator
+ * Hash map from a node to a value, whose nodes are allocated from the
+ * pool of the thread, as the maps of the routing are built and dropped
+ * by every thread for every source
  */
-typedef boost::graph_traits<Graph_T>::vertex_iterator NodeIterator;
-/**
- * Boost graph out edge iterator
- */
-typedef boost::graph_traits<Graph_T>::out_edge_iterator OutEdgeIterator;
+template <typename T>
+using NodeMap = std::unordered_map<
+    NodeIndex,T,std::hash<NodeIndex>,std::equal_to<NodeIndex>,
+    UTIL::PoolAllocator<std::pair<const NodeIndex,T>>>;
+#endif
 
 /**
  * Predecessor Map. It stores for each node, the previous node
  * visited, which is part of the shortest path routing result.
  */
-typedef std::unordered_map<NodeIndex,NodeIndex> PredecessorMap;
+typedef NodeMap<NodeIndex> PredecessorMap;
 
 /**
  * Distance map. It stores for each node, the distance visited from a source
  * node, which is part of the shortest path routing result.
  */
-typedef std::unordered_map<NodeIndex,double> DistanceMap;
+typedef NodeMap<double> DistanceMap;
+
+/**
+ * The next node and the edges at both ends of the shortest path from a
+ * source node to a node
+ */
+struct PathEnds {
+  NodeIndex first_n; /**< next node visited from the source */
+  EdgeIndex first_e; /**< first edge visited from the source */
+  EdgeIndex last_e; /**< last edge visited before the node */
+};
+
+/**
+ * Path end map. It stores for each node except the source, the ends of
+ * its shortest path, which are carried forward during the routing so that
+ * no path is walked back.
+ */
+typedef NodeMap<PathEnds> PathEndMap;
 }
 }
 
@@ -12,6 +12,7 @@
 #define FMM_HEAP_HPP
 
 #include "network/type.hpp"
+#include "network/graph.hpp"
 #include "fiboheap/fiboheap.h"
 
 namespace FMM {
@@ -98,7 +99,7 @@ public:
 private:
   typedef FibHeap<HeapNode>::FibNode *HeapNodeHandle;
   FibHeap<HeapNode> heap;
-  std::unordered_map<NodeIndex,HeapNodeHandle> handle_data;
+  NodeMap<HeapNodeHandle> handle_data;
 }; // Heap
 }; // NETWORK
 }; //FMM
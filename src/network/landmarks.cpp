@@ -0,0 +1,101 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/landmarks.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+namespace {
+// Relative rounding error of a distance stored as float, doubled to
+// stay on the safe side
+const double FLOAT_ERROR = 1.0 / (1 << 23);
+
+// Distances from s to every node of the graph, infinity if not reached
+void full_dijkstra(const CSRGraph &g, NodeIndex s, SearchWorkspace *ws,
+                   std::vector<double> *dist) {
+  dist->assign(g.get_num_vertices(), std::numeric_limits<double>::infinity());
+  ws->reset(g.get_num_vertices());
+  ws->set(s, 0, s);
+  ws->push(s, 0);
+  while (!ws->empty()) {
+    HeapNode node = ws->top();
+    ws->pop();
+    NodeIndex u = node.index;
+    (*dist)[u] = node.value;
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      double temp_dist = node.value + g.get_length(e);
+      if (!ws->visited(v)) {
+        ws->set(v, temp_dist, u);
+        ws->push(v, temp_dist);
+      } else if (ws->get_distance(v) > temp_dist) {
+        ws->set(v, temp_dist, u);
+        ws->decrease_key(v, temp_dist);
+      }
+    }
+  }
+}
+}
+
+Landmarks::Landmarks(const NetworkGraph &graph, int num_landmarks) :
+    num_vertices(graph.get_num_vertices()) {
+  num_landmarks = std::max(0, std::min(num_landmarks, (int) num_vertices));
+  SPDLOG_INFO("Select landmarks {}", num_landmarks);
+  const CSRGraph &g = graph.get_graph();
+  CSRGraph reverse_graph = graph.get_reverse_graph();
+  from_landmarks.assign((size_t) num_vertices * num_landmarks, 0);
+  to_landmarks.assign((size_t) num_vertices * num_landmarks, 0);
+  // Sum of the round trip distances to the landmarks selected, where a
+  // node not connected with a landmark is the farthest
+  std::vector<double> score(num_vertices, 0);
+  std::vector<double> from, to;
+  SearchWorkspace ws;
+  NodeIndex next = 0;
+  for (int i = 0; i < num_landmarks; ++i) {
+    landmarks.push_back(next);
+    full_dijkstra(g, next, &ws, &from);
+    full_dijkstra(reverse_graph, next, &ws, &to);
+    for (NodeIndex v = 0; v < num_vertices; ++v) {
+      from_landmarks[(size_t) v * num_landmarks + i] = from[v];
+      to_landmarks[(size_t) v * num_landmarks + i] = to[v];
+      double round_trip = from[v] + to[v];
+      score[v] = std::isinf(round_trip) ?
+                 std::numeric_limits<double>::max() : score[v] + round_trip;
+    }
+    for (NodeIndex l : landmarks) score[l] = -1;
+    next = std::max_element(score.begin(), score.end()) - score.begin();
+  }
+}
+
+double Landmarks::lower_bound(NodeIndex u, NodeIndex t) const {
+  size_t k = landmarks.size();
+  if (u >= num_vertices || t >= num_vertices) return 0;
+  const float *from_u = &from_landmarks[u * k];
+  const float *from_t = &from_landmarks[t * k];
+  const float *to_u = &to_landmarks[u * k];
+  const float *to_t = &to_landmarks[t * k];
+  double bound = 0;
+  for (size_t i = 0; i < k; ++i) {
+    // d(L,t) <= d(L,u) + d(u,t)
+    if (!std::isinf(from_u[i]) && !std::isinf(from_t[i])) {
+      double value = (double) from_t[i] - from_u[i] -
+          ((double) from_t[i] + from_u[i]) * FLOAT_ERROR;
+      bound = std::max(bound, value);
+    }
+    // d(u,L) <= d(u,t) + d(t,L)
+    if (!std::isinf(to_u[i]) && !std::isinf(to_t[i])) {
+      double value = (double) to_u[i] - to_t[i] -
+          ((double) to_u[i] + to_t[i]) * FLOAT_ERROR;
+      bound = std::max(bound, value);
+    }
+  }
+  return bound;
+}
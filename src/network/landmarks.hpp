@@ -0,0 +1,77 @@
+/**
+ * Fast map matching.
+ *
+ * Landmarks of the network, which give the lower bounds of ALT search
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_LANDMARKS_HPP
+#define FMM_LANDMARKS_HPP
+
+#include "network/graph.hpp"
+#include "network/network_graph.hpp"
+
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+/**
+ * Distances from and to a few landmark nodes, which bound the distance
+ * between any two nodes with the triangle inequality. For a landmark L,
+ * the distance from u to t is at least d(L,t) - d(L,u) and
+ * d(u,L) - d(t,L).
+ *
+ * The landmarks are selected one by one as the node farthest from the
+ * ones selected. The distances are stored as float, one vector of the
+ * landmarks per node, and the bound is reduced by the rounding error so
+ * that it never exceeds the distance.
+ */
+class Landmarks {
+ public:
+  /**
+   * Select the landmarks and compute their distances
+   * @param graph         graph of the network
+   * @param num_landmarks number of landmarks, not larger than the number
+   * of nodes
+   */
+  Landmarks(const NetworkGraph &graph, int num_landmarks);
+  /**
+   * Lower bound of the distance from u to t
+   * @param u source node
+   * @param t target node
+   * @return lower bound, which is 0 if no landmark bounds the pair
+   */
+  double lower_bound(NodeIndex u, NodeIndex t) const;
+  /**
+   * Get the nodes selected as landmarks
+   */
+  inline const std::vector<NodeIndex> &get_landmarks() const {
+    return landmarks;
+  };
+  /**
+   * Get the number of landmarks
+   */
+  inline int get_num_landmarks() const {
+    return landmarks.size();
+  };
+  /**
+   * Get the bytes of the distance tables
+   */
+  inline size_t get_memory_bytes() const {
+    return landmarks.capacity() * sizeof(NodeIndex) +
+        (from_landmarks.capacity() + to_landmarks.capacity()) *
+            sizeof(float);
+  };
+ private:
+  std::vector<NodeIndex> landmarks;
+  unsigned int num_vertices;
+  // Distances indexed by node and then landmark, infinity if not reached
+  std::vector<float> from_landmarks;
+  std::vector<float> to_landmarks;
+}; // Landmarks
+} // NETWORK
+} // FMM
+
+#endif // FMM_LANDMARKS_HPP
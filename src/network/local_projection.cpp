@@ -0,0 +1,57 @@
+#include "network/local_projection.hpp"
+
+#include <cmath>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+constexpr double LocalProjection::EARTH_RADIUS;
+
+LocalProjection::LocalProjection(double lon0, double lat0) :
+    enabled(true), lon0(lon0), lat0(lat0) {
+  ky = EARTH_RADIUS * M_PI / 180.0;
+  kx = ky * std::cos(lat0 * M_PI / 180.0);
+}
+
+void LocalProjection::forward(LineString *geom) const {
+  if (!enabled) return;
+  for (Point &p : geom->get_geometry()) {
+    double x = p.get<0>();
+    double y = p.get<1>();
+    forward(&x, &y);
+    p.set<0>(x);
+    p.set<1>(y);
+  }
+}
+
+const Trajectory &LocalProjection::forward(const Trajectory &traj,
+                                           Trajectory *buffer) const {
+  if (!enabled) return traj;
+  *buffer = traj;
+  forward(&buffer->geom);
+  return *buffer;
+}
+
+void LocalProjection::inverse(LineString *geom) const {
+  if (!enabled) return;
+  for (Point &p : geom->get_geometry()) {
+    double x = p.get<0>();
+    double y = p.get<1>();
+    inverse(&x, &y);
+    p.set<0>(x);
+    p.set<1>(y);
+  }
+}
+
+void LocalProjection::inverse(MM::MatchResult *result) const {
+  if (!enabled) return;
+  inverse(&result->mgeom);
+  for (MM::MatchedCandidate &mc : result->opt_candidate_path) {
+    double x = mc.c.point.get<0>();
+    double y = mc.c.point.get<1>();
+    inverse(&x, &y);
+    mc.c.point.set<0>(x);
+    mc.c.point.set<1>(y);
+  }
+}
@@ -0,0 +1,112 @@
+/**
+ * Fast map matching.
+ *
+ * Local projection of a network in longitude and latitude, so that the
+ * distances are computed in metres
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_LOCAL_PROJECTION_HPP
+#define FMM_LOCAL_PROJECTION_HPP
+
+#include "core/gps.hpp"
+#include "mm/mm_type.hpp"
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Equirectangular projection of longitude and latitude in degrees into
+ * metres around an origin.
+ *
+ * The scale of x is the one at the latitude of the origin, so that the
+ * distances are exact along the meridians and within about 0.2% up to
+ * 10 km north or south of the origin at mid latitudes. A projection
+ * which is not enabled keeps the coordinates unchanged.
+ */
+class LocalProjection {
+ public:
+  static constexpr double EARTH_RADIUS = 6371008.8; /**< Mean radius of
+                                                         the earth */
+  /**
+   * Create a projection which is not enabled
+   */
+  LocalProjection() = default;
+  /**
+   * Create a projection around an origin
+   * @param lon0 longitude of the origin in degrees
+   * @param lat0 latitude of the origin in degrees
+   */
+  LocalProjection(double lon0, double lat0);
+  /**
+   * Check if the coordinates are projected
+   */
+  inline bool is_enabled() const {
+    return enabled;
+  };
+  /**
+   * Get the longitude of the origin
+   */
+  inline double get_origin_x() const {
+    return lon0;
+  };
+  /**
+   * Get the latitude of the origin
+   */
+  inline double get_origin_y() const {
+    return lat0;
+  };
+  /**
+   * Project a longitude and latitude into metres
+   */
+  inline void forward(double *x, double *y) const {
+    if (!enabled) return;
+    *x = (*x - lon0) * kx;
+    *y = (*y - lat0) * ky;
+  };
+  /**
+   * Project metres back into a longitude and latitude
+   */
+  inline void inverse(double *x, double *y) const {
+    if (!enabled) return;
+    *x = *x / kx + lon0;
+    *y = *y / ky + lat0;
+  };
+  /**
+   * Project the points of a linestring into metres
+   */
+  void forward(FMM::CORE::LineString *geom) const;
+  /**
+   * Project a trajectory into metres
+   * @param traj trajectory in longitude and latitude
+   * @param buffer updated with the projected trajectory if the projection
+   * is enabled
+   * @return the projected trajectory, which is traj itself if the
+   * projection is not enabled
+   */
+  const FMM::CORE::Trajectory &forward(const FMM::CORE::Trajectory &traj,
+                                       FMM::CORE::Trajectory *buffer) const;
+  /**
+   * Project the points of a linestring back into longitude and latitude
+   */
+  void inverse(FMM::CORE::LineString *geom) const;
+  /**
+   * Project the geometries of a match result back into longitude and
+   * latitude, which are the matched geometry and the points of the
+   * candidates. The distances are kept in metres.
+   */
+  void inverse(MM::MatchResult *result) const;
+ private:
+  bool enabled = false;
+  double lon0 = 0;
+  double lat0 = 0;
+  double kx = 1; // Metres per degree of longitude
+  double ky = 1; // Metres per degree of latitude
+}; // LocalProjection
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_LOCAL_PROJECTION_HPP
@@ -1,22 +1,170 @@
 #include "network/network.hpp"
+#include "network/osm_reader.hpp"
 #include "util/debug.hpp"
 #include "util/util.hpp"
+#include "util/memory.hpp"
+#include "util/parallel.hpp"
 #include "algorithm/geom_algorithm.hpp"
+#include "algorithm/geometry_kernel.hpp"
 
 #include <ogrsf_frmts.h> // C++ API for GDAL
 #include <math.h> // Calulating probability
 #include <algorithm> // Partial sort copy
- // Partial sort copy
-
-// Data structures for Rtree
-#include <boost/geometry/index/rtree.hpp>
-#include <boost/function_output_iterator.hpp>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::MM;
 using namespace FMM::NETWORK;
 
+namespace {
+// Header of the network cache file, followed by the edges, the points
+// of the edge geometries, the node points, the edge boxes and the node
+// ids. The size and modification time of the network file, and a hash of
+// the ones of all its files, are stored to detect a cache written from
+// another version of the network. A flat
+// rtree may follow at an offset aligned for its mapping, which is built
+// with the max elements, the chunk segments and the twin edges of the
+// header.
+struct CacheHeader {
+  char magic[8];
+  unsigned int version;
+  int srid;
+  long long num_edges;
+  long long num_vertices;
+  long long num_points;
+  long long source_size;
+  long long source_mtime;
+  unsigned long long files_hash;
+  unsigned long long fields_hash;
+  unsigned long long checksum;
+  double origin_x; // Origin of the local projection, if projected
+  double origin_y;
+  long long index_offset; // Offset and size of the flat rtree, 0 if none
+  long long index_size;
+  int index_max_elements;
+  int index_chunk_segments;
+  int index_twin_edges;
+  int padding;
+};
+const char CACHE_MAGIC[8] = {'F', 'M', 'M', 'N', 'E', 'T', 'W', 'K'};
+// Alignment of the flat rtree in the cache file, a multiple of the page
+// sizes of the usual systems
+const long long CACHE_INDEX_ALIGNMENT = 65536;
+// Number of features fetched from GDAL before their geometries are
+// converted in parallel
+const std::size_t FEATURE_BATCH_SIZE = 65536;
+
+// Edge stored in the cache, whose geometry is the points from
+// first_point to the first point of the next edge
+struct CacheEdge {
+  EdgeID id;
+  NodeIndex source;
+  NodeIndex target;
+  unsigned int padding;
+  double length;
+  long long first_point;
+};
+
+size_t get_cache_payload_size(const CacheHeader &header) {
+  size_t size = sizeof(CacheEdge) * header.num_edges +
+      sizeof(double) * (2 * header.num_points + 2 * header.num_vertices +
+          4 * header.num_edges) +
+      sizeof(NodeID) * header.num_vertices;
+  // Padded to whole words for the checksum
+  return (size + 7) / 8 * 8;
+}
+
+// FNV-1a hash over the 8 byte words of the data, whose size is a
+// multiple of 8
+unsigned long long cache_checksum(const char *data, size_t size) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; i += 8) {
+    unsigned long long word;
+    memcpy(&word, data + i, 8);
+    hash = (hash ^ word) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+unsigned long long get_fields_hash(const std::string &id_name,
+                                   const std::string &source_name,
+                                   const std::string &target_name,
+                                   bool reordered, bool projected) {
+  std::string fields = id_name + '\0' + source_name + '\0' + target_name +
+      (reordered ? std::string("\0hilbert", 8) : std::string()) +
+      (projected ? std::string("\0local", 6) : std::string());
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned char c : fields) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Round a coordinate of a segment box so that the box stored in
+// BoxCoord still contains the segment
+BoxCoord round_box_down(double value) {
+  BoxCoord coord = value;
+  return coord > value ? std::nextafter(coord, (BoxCoord) -INFINITY) : coord;
+}
+
+BoxCoord round_box_up(double value) {
+  BoxCoord coord = value;
+  return coord < value ? std::nextafter(coord, (BoxCoord) INFINITY) : coord;
+}
+
+long long get_mtime_ns(const struct stat &buf) {
+  return (long long) buf.st_mtim.tv_sec * 1000000000LL +
+      buf.st_mtim.tv_nsec;
+}
+
+// FNV-1a hash of the names, sizes and modification times of the files
+// of a network listed by GDAL, such as the .dbf, .shx and .prj of a
+// shapefile, which may change without its main file
+unsigned long long get_files_hash(const std::string &filename) {
+  std::vector<std::string> files{filename};
+  if (!OSMReader::is_osm_file(filename)) {
+    OGRRegisterAll();
+    GDALDataset *poDS = (GDALDataset*) GDALOpenEx(
+      filename.c_str(), GDAL_OF_VECTOR, NULL, NULL, NULL );
+    if (poDS != NULL) {
+      char **file_list = poDS->GetFileList();
+      for (char **file = file_list; file != NULL && *file != NULL; ++file) {
+        files.push_back(*file);
+      }
+      CSLDestroy(file_list);
+      GDALClose(poDS);
+    }
+  }
+  std::sort(files.begin(), files.end());
+  files.erase(std::unique(files.begin(), files.end()), files.end());
+  std::string key;
+  for (const std::string &file : files) {
+    struct stat buf;
+    long long values[2] = {-1, -1};
+    if (stat(file.c_str(), &buf) == 0) {
+      values[0] = buf.st_size;
+      values[1] = get_mtime_ns(buf);
+    }
+    key += file + '\0';
+    key.append((const char *) values, sizeof(values));
+  }
+  unsigned long long hash = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    hash = (hash ^ c) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+}
+
 bool Network::candidate_compare(const Candidate &a, const Candidate &b)
 {
   if (a.dist!=b.dist)
@@ -32,7 +180,64 @@ bool Network::candidate_compare(const Candidate &a, const Candidate &b)
 Network::Network(const std::string &filename,
                  const std::string &id_name,
                  const std::string &source_name,
-                 const std::string &target_name)
+                 const std::string &target_name,
+                 bool use_cache,
+                 const SpatialIndexOptions &index_options,
+                 bool reorder,
+                 bool project,
+                 const NetworkClip &clip,
+                 bool compress_geometry,
+                 const std::vector<std::string> &cost_names) :
+  index_options(index_options), reordered(reorder), projected(project),
+  clip(clip), cost_names(cost_names)
+{
+  std::string cache_file = get_cache_file(filename);
+  // The cache file stores the whole network without the costs
+  if (is_clipped() || !cost_names.empty()) use_cache = false;
+  if (use_cache && UTIL::file_exists(cache_file) &&
+      read_network_cache(filename,id_name,source_name,target_name)) {
+    // A flat rtree built from the cache is written into it to be mapped
+    // the next time
+    if (index_options.type == FLAT_RTREE &&
+        !static_cast<const FlatRtreeIndex &>(*spatial_index).is_mapped() &&
+        !write_network_cache(filename,id_name,source_name,target_name)) {
+      SPDLOG_WARN("Network cache {} is not written",cache_file);
+    }
+    if (compress_geometry) compress_geometry_store();
+    SPDLOG_INFO("Read network done.");
+    return;
+  }
+  if (OSMReader::is_osm_file(filename)) {
+    read_osm_file(filename);
+  } else {
+    read_network_file(filename,id_name,source_name,target_name);
+  }
+  if (projected) project_network();
+  if (reordered) reorder_by_hilbert_curve();
+  build_id_maps();
+  build_geometry_store();
+  build_segment_store();
+  build_spatial_index();
+  if (use_cache &&
+      !write_network_cache(filename,id_name,source_name,target_name)) {
+    SPDLOG_WARN("Network cache {} is not written",cache_file);
+  }
+  if (compress_geometry) compress_geometry_store();
+  SPDLOG_INFO("Read network done.");
+}    // Network constructor
+
+std::string Network::get_cache_file(const std::string &filename) {
+  return filename + ".fmmnet";
+}
+
+bool Network::is_clipped() const {
+  return !clip.region.empty();
+}
+
+void Network::read_network_file(const std::string &filename,
+                                const std::string &id_name,
+                                const std::string &source_name,
+                                const std::string &target_name)
 {
   SPDLOG_INFO("Read network from file {}",filename);
   OGRRegisterAll();
@@ -43,6 +248,40 @@ Network::Network(const std::string &filename,
     exit( 1 );
   }
   OGRLayer  *ogrlayer = poDS->GetLayer(0);
+  if (is_clipped()) {
+    // The filter is evaluated by the driver, with the spatial index of
+    // the file if it has one
+    std::vector<double> box = UTIL::string2vec<double>(clip.region);
+    if (box.size() == 4) {
+      ogrlayer->SetSpatialFilterRect(box[0] - clip.margin,
+                                     box[1] - clip.margin,
+                                     box[2] + clip.margin,
+                                     box[3] + clip.margin);
+    } else {
+      OGRGeometry *region = nullptr;
+      if (OGRGeometryFactory::createFromWkt(
+          clip.region.c_str(), nullptr, &region) != OGRERR_NONE) {
+        SPDLOG_CRITICAL("Invalid clip region {}",clip.region);
+        GDALClose( poDS );
+        std::exit(EXIT_FAILURE);
+      }
+      if (clip.margin > 0) {
+        OGRGeometry *buffered = region->Buffer(clip.margin);
+        OGRGeometryFactory::destroyGeometry(region);
+        region = buffered;
+      }
+      if (region == nullptr) {
+        SPDLOG_CRITICAL("Failed to add margin {} to clip region",
+                        clip.margin);
+        GDALClose( poDS );
+        std::exit(EXIT_FAILURE);
+      }
+      ogrlayer->SetSpatialFilter(region);
+      OGRGeometryFactory::destroyGeometry(region);
+    }
+    SPDLOG_INFO("Clip network to {} with margin {}",clip.region,
+                clip.margin);
+  }
   int NUM_FEATURES = ogrlayer->GetFeatureCount();
   // edges= std::vector<Edge>(NUM_FEATURES);
   // Initialize network edges
@@ -58,6 +297,15 @@ Network::Network(const std::string &filename,
     GDALClose( poDS );
     std::exit(EXIT_FAILURE);
   }
+  std::vector<int> cost_idx;
+  for (const std::string &name : cost_names) {
+    cost_idx.push_back(ogrFDefn->GetFieldIndex(name.c_str()));
+    if (cost_idx.back()<0) {
+      SPDLOG_CRITICAL("Cost column {} not found",name);
+      GDALClose( poDS );
+      std::exit(EXIT_FAILURE);
+    }
+  }
 
   if (wkbFlatten(ogrFDefn->GetGeomType()) != wkbLineString)
   {
@@ -84,55 +332,489 @@ Network::Network(const std::string &filename,
     SPDLOG_WARN("SRID is not found, set to 4326 by default");
   }
   // Read data from shapefile
-  EdgeIndex index = 0;
-  while( (ogrFeature = ogrlayer->GetNextFeature()) != NULL){
-    EdgeID id = ogrFeature->GetFieldAsInteger(id_idx);
-    NodeID source = ogrFeature->GetFieldAsInteger(source_idx);
-    NodeID target = ogrFeature->GetFieldAsInteger(target_idx);
-    OGRGeometry *rawgeometry = ogrFeature->GetGeometryRef();
-    LineString geom;
-    if (rawgeometry->getGeometryType()==wkbLineString) {
-      geom = ogr2linestring((OGRLineString*) rawgeometry);
-    } else if (rawgeometry->getGeometryType()==wkbMultiLineString) {
-      SPDLOG_TRACE("Feature id {} s {} t {} is multilinestring",
-                   id, source, target);
-      SPDLOG_TRACE("Read only the first linestring");
-      geom = ogr2linestring((OGRMultiLineString*) rawgeometry);
-    } else {
-      SPDLOG_CRITICAL("Unknown geometry type for feature id {} s {} t {}",
-                      id, source, target);
-    }
-    NodeIndex s_idx,t_idx;
-    if (node_map.find(source)==node_map.end()) {
-      s_idx = node_id_vec.size();
-      node_id_vec.push_back(source);
-      node_map.insert({source,s_idx});
-      vertex_points.push_back(geom.get_point(0));
-    } else {
-      s_idx = node_map[source];
-    }
-    if (node_map.find(target)==node_map.end()) {
-      t_idx = node_id_vec.size();
-      node_id_vec.push_back(target);
-      node_map.insert({target,t_idx});
-      int npoints = geom.get_num_points();
-      vertex_points.push_back(geom.get_point(npoints-1));
-    } else {
-      t_idx = node_map[target];
+  GIntBig feature_count = ogrlayer->GetFeatureCount();
+  if (feature_count > 0) {
+    edges.reserve(feature_count);
+    UTIL::advise_huge_pages(edges.data(), sizeof(Edge) * feature_count);
+  }
+  // The features are fetched serially by GDAL in batches, whose
+  // geometries are converted in parallel
+  std::vector<NodeID> endpoints;
+  endpoints.reserve(2 * edges.capacity());
+  std::vector<OGRFeature *> batch;
+  std::vector<LineString> geoms;
+  bool done = false;
+  while (!done) {
+    batch.clear();
+    while (batch.size() < FEATURE_BATCH_SIZE) {
+      ogrFeature = ogrlayer->GetNextFeature();
+      if (ogrFeature == NULL) {
+        done = true;
+        break;
+      }
+      batch.push_back(ogrFeature);
+    }
+    long long num_features = batch.size();
+    geoms.assign(num_features, LineString());
+    #pragma omp parallel for schedule(dynamic, 256) \
+        if(num_features >= 4096)
+    for (long long i = 0; i < num_features; ++i) {
+      OGRGeometry *rawgeometry = batch[i]->GetGeometryRef();
+      if (rawgeometry->getGeometryType()==wkbLineString) {
+        geoms[i] = ogr2linestring((OGRLineString*) rawgeometry);
+      } else if (rawgeometry->getGeometryType()==wkbMultiLineString) {
+        SPDLOG_TRACE("Feature id {} is multilinestring, read only the "
+                     "first linestring",batch[i]->GetFieldAsInteger(id_idx));
+        geoms[i] = ogr2linestring((OGRMultiLineString*) rawgeometry);
+      } else {
+        SPDLOG_CRITICAL("Unknown geometry type for feature id {}",
+                        batch[i]->GetFieldAsInteger(id_idx));
+      }
+    }
+    for (long long i = 0; i < num_features; ++i) {
+      ogrFeature = batch[i];
+      EdgeID id = ogrFeature->GetFieldAsInteger(id_idx);
+      NodeID source = ogrFeature->GetFieldAsInteger(source_idx);
+      NodeID target = ogrFeature->GetFieldAsInteger(target_idx);
+      add_edge(id,source,target,std::move(geoms[i]),&endpoints);
+      for (int idx : cost_idx) {
+        edge_costs.push_back(ogrFeature->GetFieldAsDouble(idx));
+      }
+      OGRFeature::DestroyFeature(ogrFeature);
     }
-    edges.push_back({index,id,s_idx,t_idx,geom.get_length(),geom});
-    edge_map.insert({id,index});
-    ++index;
-    OGRFeature::DestroyFeature(ogrFeature);
   }
+  index_edge_nodes(endpoints);
   GDALClose( poDS );
   num_vertices = node_id_vec.size();
   SPDLOG_INFO("Number of edges {} nodes {}",edges.size(),num_vertices);
   SPDLOG_INFO("Field index: id {} source {} target {}",
       id_idx,source_idx,target_idx);
-  build_rtree_index();
-  SPDLOG_INFO("Read network done.");
-}    // Network constructor
+}
+
+void Network::read_osm_file(const std::string &filename)
+{
+  if (!cost_names.empty()) {
+    SPDLOG_CRITICAL("Cost columns are not read from an OSM network");
+    std::exit(EXIT_FAILURE);
+  }
+  std::vector<OSMEdge> osm_edges;
+  if (!OSMReader::read_edges(filename, &osm_edges)) {
+    std::exit(EXIT_FAILURE);
+  }
+  srid = 4326;
+  BoostBox region;
+  if (is_clipped()) {
+    // Only a box is supported, as the spatial filter is not evaluated by
+    // GDAL
+    std::vector<double> box = UTIL::string2vec<double>(clip.region);
+    if (box.size() != 4) {
+      SPDLOG_CRITICAL("Clip region of an OSM network should be a box, "
+                      "not {}",clip.region);
+      std::exit(EXIT_FAILURE);
+    }
+    region = BoostBox(Point(box[0] - clip.margin, box[1] - clip.margin),
+                      Point(box[2] + clip.margin, box[3] + clip.margin));
+    SPDLOG_INFO("Clip network to {} with margin {}",clip.region,
+                clip.margin);
+  }
+  edges.reserve(osm_edges.size());
+  std::vector<NodeID> endpoints;
+  for (OSMEdge &edge : osm_edges) {
+    if (is_clipped() && !boost::geometry::intersects(
+        boost::geometry::return_envelope<BoostBox>(edge.geom.get_geometry()),
+        region)) {
+      continue;
+    }
+    add_edge(edge.id,edge.source,edge.target,std::move(edge.geom),
+             &endpoints);
+  }
+  index_edge_nodes(endpoints);
+  num_vertices = node_id_vec.size();
+  SPDLOG_INFO("Number of edges {} nodes {}",edges.size(),num_vertices);
+}
+
+void Network::add_edge(EdgeID id, NodeID source, NodeID target,
+                       LineString geom, std::vector<NodeID> *endpoints)
+{
+  endpoints->push_back(source);
+  endpoints->push_back(target);
+  edges.push_back({(EdgeIndex) edges.size(),id,0,0,0,std::move(geom)});
+}
+
+void Network::index_edge_nodes(const std::vector<NodeID> &endpoints)
+{
+  // The endpoints are sorted by id, where the first endpoint of each run
+  // of the same id is the one read first
+  long long num_endpoints = endpoints.size();
+  int threads = UTIL::get_parallel_threads(num_endpoints);
+  std::vector<std::pair<NodeID,long long>> sorted(num_endpoints);
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_endpoints; ++k) {
+    sorted[k] = {endpoints[k],k};
+  }
+  UTIL::parallel_stable_sort(sorted.begin(),sorted.end(),
+                             [](const std::pair<NodeID,long long> &a,
+                                const std::pair<NodeID,long long> &b) {
+                               return a.first<b.first;
+                             });
+  // Run of each sorted endpoint, counted from 1
+  std::vector<long long> runs(num_endpoints);
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_endpoints; ++k) {
+    runs[k] = (k==0 || sorted[k].first!=sorted[k-1].first) ? 1 : 0;
+  }
+  UTIL::parallel_inclusive_scan(&runs);
+  long long num_nodes = num_endpoints > 0 ? runs.back() : 0;
+  std::vector<long long> run_first(num_nodes);
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_endpoints; ++k) {
+    if (k==0 || runs[k]!=runs[k-1]) run_first[runs[k]-1] = sorted[k].second;
+  }
+  // The nodes are indexed in the order they are read, from the source
+  // of the first edge
+  std::vector<long long> run_order(num_nodes);
+  #pragma omp parallel for num_threads(threads)
+  for (long long r = 0; r < num_nodes; ++r) run_order[r] = r;
+  UTIL::parallel_stable_sort(run_order.begin(),run_order.end(),
+                             [&run_first](long long a, long long b) {
+                               return run_first[a]<run_first[b];
+                             });
+  std::vector<NodeIndex> run_node(num_nodes);
+  node_id_vec.resize(num_nodes);
+  vertex_points.resize(num_nodes);
+  #pragma omp parallel for num_threads(threads)
+  for (long long i = 0; i < num_nodes; ++i) {
+    long long first = run_first[run_order[i]];
+    const LineString &geom = edges[first/2].geom;
+    run_node[run_order[i]] = i;
+    node_id_vec[i] = endpoints[first];
+    vertex_points[i] = geom.get_point(
+        first%2==0 ? 0 : geom.get_num_points()-1);
+  }
+  #pragma omp parallel for num_threads(threads)
+  for (long long k = 0; k < num_endpoints; ++k) {
+    long long endpoint = sorted[k].second;
+    Edge &edge = edges[endpoint/2];
+    if (endpoint%2==0) {
+      edge.source = run_node[runs[k]-1];
+      edge.length = edge.geom.get_length();
+    } else {
+      edge.target = run_node[runs[k]-1];
+    }
+  }
+}
+
+bool Network::read_network_cache(const std::string &filename,
+                                 const std::string &id_name,
+                                 const std::string &source_name,
+                                 const std::string &target_name)
+{
+  std::string cache_file = get_cache_file(filename);
+  SPDLOG_INFO("Read network from cache file {}",cache_file);
+  struct stat source_stat;
+  if (stat(filename.c_str(), &source_stat) != 0) return false;
+  int fd = open(cache_file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_WARN("Failed to open network cache {}",cache_file);
+    return false;
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  size_t file_size = stat_buf.st_size;
+  void *addr = nullptr;
+  if (file_size >= sizeof(CacheHeader)) {
+    addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  close(fd);
+  if (addr == nullptr || addr == MAP_FAILED) {
+    SPDLOG_WARN("Failed to map network cache {}",cache_file);
+    return false;
+  }
+  // The whole file is read in order
+  madvise(addr, file_size, MADV_SEQUENTIAL);
+  const CacheHeader *header = (const CacheHeader *) addr;
+  const char *data = (const char *) addr + sizeof(CacheHeader);
+  long long num_edges = header->num_edges;
+  long long num_nodes = header->num_vertices;
+  long long num_points = header->num_points;
+  size_t payload_size = get_cache_payload_size(*header);
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->source_size != (long long) source_stat.st_size ||
+      header->source_mtime != get_mtime_ns(source_stat) ||
+      header->files_hash != get_files_hash(filename) ||
+      header->fields_hash !=
+          get_fields_hash(id_name, source_name, target_name, reordered,
+                          projected) ||
+      (header->index_size == 0 ?
+          file_size != sizeof(CacheHeader) + payload_size :
+          (header->index_offset <
+               (long long) (sizeof(CacheHeader) + payload_size) ||
+           file_size != (size_t) (header->index_offset +
+                                  header->index_size))) ||
+      header->checksum != cache_checksum(data, payload_size)) {
+    SPDLOG_WARN("Network cache {} is outdated or invalid",cache_file);
+    munmap(addr, file_size);
+    return false;
+  }
+  const CacheEdge *cache_edges = (const CacheEdge *) data;
+  const double *coords = (const double *) (cache_edges + num_edges);
+  const double *vertex_coords = coords + 2 * num_points;
+  const double *box_coords = vertex_coords + 2 * num_nodes;
+  const NodeID *node_ids = (const NodeID *) (box_coords + 4 * num_edges);
+  srid = header->srid;
+  if (projected) {
+    projection = LocalProjection(header->origin_x, header->origin_y);
+  }
+  geom_x.resize(num_points);
+  geom_y.resize(num_points);
+  for (long long j = 0; j < num_points; ++j) {
+    geom_x[j] = coords[2 * j];
+    geom_y[j] = coords[2 * j + 1];
+  }
+  geom_offsets.resize(num_edges + 1);
+  for (long long i = 0; i < num_edges; ++i) {
+    geom_offsets[i] = cache_edges[i].first_point;
+  }
+  geom_offsets[num_edges] = num_points;
+  edges.reserve(num_edges);
+  UTIL::advise_huge_pages(edges.data(), sizeof(Edge) * num_edges);
+  std::vector<boost_box> boxes;
+  boxes.reserve(num_edges);
+  for (long long i = 0; i < num_edges; ++i) {
+    const CacheEdge &ce = cache_edges[i];
+    edges.push_back({(EdgeIndex) i,ce.id,ce.source,ce.target,ce.length,
+                     LineString()});
+    const double *b = box_coords + 4 * i;
+    boxes.push_back(boost_box(Point(b[0],b[1]),Point(b[2],b[3])));
+  }
+  node_id_vec.assign(node_ids, node_ids + num_nodes);
+  vertex_points.reserve(num_nodes);
+  for (long long i = 0; i < num_nodes; ++i) {
+    vertex_points.push_back(
+        Point(vertex_coords[2 * i],vertex_coords[2 * i + 1]));
+  }
+  // The number of items of the flat rtree is checked once the chunks
+  // are split
+  std::unique_ptr<FlatRtreeIndex> flat_rtree;
+  if (index_options.type == FLAT_RTREE && header->index_size > 0 &&
+      header->index_max_elements == index_options.max_elements &&
+      header->index_chunk_segments == index_options.chunk_segments &&
+      header->index_twin_edges == (int) index_options.twin_edges) {
+    flat_rtree = FlatRtreeIndex::map_file(
+        cache_file, header->index_offset, header->index_size,
+        index_options.max_elements);
+  }
+  munmap(addr, file_size);
+  num_vertices = node_id_vec.size();
+  SPDLOG_INFO("Number of edges {} nodes {}",edges.size(),num_vertices);
+  build_id_maps();
+  build_segment_store();
+  build_spatial_index(boxes, std::move(flat_rtree));
+  return true;
+}
+
+bool Network::write_network_cache(const std::string &filename,
+                                  const std::string &id_name,
+                                  const std::string &source_name,
+                                  const std::string &target_name) const
+{
+  std::string cache_file = get_cache_file(filename);
+  SPDLOG_INFO("Write network cache file {}",cache_file);
+  struct stat source_stat;
+  if (stat(filename.c_str(), &source_stat) != 0) return false;
+  CacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  header.version = CACHE_VERSION;
+  header.srid = srid;
+  header.num_edges = edges.size();
+  header.num_vertices = num_vertices;
+  header.source_size = source_stat.st_size;
+  header.source_mtime = get_mtime_ns(source_stat);
+  header.files_hash = get_files_hash(filename);
+  header.fields_hash = get_fields_hash(id_name, source_name, target_name,
+                                       reordered, projected);
+  header.origin_x = projection.get_origin_x();
+  header.origin_y = projection.get_origin_y();
+  // The payload is copied to a buffer for the checksum in the header
+  std::vector<CacheEdge> cache_edges;
+  cache_edges.reserve(edges.size());
+  std::vector<double> box_coords;
+  box_coords.reserve(4 * edges.size());
+  for (const Edge &edge : edges) {
+    cache_edges.push_back({edge.id,edge.source,edge.target,0,edge.length,
+                           geom_offsets[edge.index]});
+    double x1,y1,x2,y2;
+    ALGORITHM::boundingbox_geometry(get_edge_view(edge.index),
+                                    &x1,&y1,&x2,&y2);
+    box_coords.insert(box_coords.end(),{x1,y1,x2,y2});
+  }
+  std::vector<double> coords;
+  coords.reserve(2 * geom_x.size());
+  for (size_t j = 0; j < geom_x.size(); ++j) {
+    coords.push_back(geom_x[j]);
+    coords.push_back(geom_y[j]);
+  }
+  header.num_points = geom_x.size();
+  const FlatRtreeIndex *flat_rtree =
+      dynamic_cast<const FlatRtreeIndex *>(spatial_index.get());
+  if (flat_rtree != nullptr) {
+    header.index_offset = (sizeof(CacheHeader) + get_cache_payload_size(
+        header) + CACHE_INDEX_ALIGNMENT - 1) / CACHE_INDEX_ALIGNMENT *
+        CACHE_INDEX_ALIGNMENT;
+    header.index_size = flat_rtree->get_data_size();
+    header.index_max_elements = index_options.max_elements;
+    header.index_chunk_segments = index_options.chunk_segments;
+    header.index_twin_edges = index_options.twin_edges;
+  }
+  std::vector<double> vertex_coords;
+  vertex_coords.reserve(2 * vertex_points.size());
+  for (const Point &p : vertex_points) {
+    vertex_coords.push_back(boost::geometry::get<0>(p));
+    vertex_coords.push_back(boost::geometry::get<1>(p));
+  }
+  std::vector<char> payload(get_cache_payload_size(header), 0);
+  char *pos = payload.data();
+  auto append = [&pos](const void *src, size_t size) {
+    if (size > 0) memcpy(pos, src, size);
+    pos += size;
+  };
+  append(cache_edges.data(), sizeof(CacheEdge) * cache_edges.size());
+  append(coords.data(), sizeof(double) * coords.size());
+  append(vertex_coords.data(), sizeof(double) * vertex_coords.size());
+  append(box_coords.data(), sizeof(double) * box_coords.size());
+  append(node_id_vec.data(), sizeof(NodeID) * node_id_vec.size());
+  header.checksum = cache_checksum(payload.data(), payload.size());
+  // Written to a temporary file first, so that a process starting at
+  // the same time never reads a partial cache
+  std::string temp_file = cache_file + "." + std::to_string(getpid());
+  FILE *stream = fopen(temp_file.c_str(), "wb");
+  if (stream == nullptr) {
+    SPDLOG_WARN("Failed to open file {}",temp_file);
+    return false;
+  }
+  bool success = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+      fwrite(payload.data(), 1, payload.size(), stream) == payload.size();
+  if (success && flat_rtree != nullptr) {
+    // The gap before the flat rtree is filled with zeros
+    std::vector<char> gap(header.index_offset - sizeof(header) -
+                          payload.size(), 0);
+    success = fwrite(gap.data(), 1, gap.size(), stream) == gap.size() &&
+        fwrite(flat_rtree->get_data(), 1, flat_rtree->get_data_size(),
+               stream) == flat_rtree->get_data_size();
+  }
+  if (fclose(stream) != 0) success = false;
+  if (success) success = rename(temp_file.c_str(), cache_file.c_str()) == 0;
+  if (!success) std::remove(temp_file.c_str());
+  return success;
+}
+
+void Network::project_network() {
+  if (edges.empty()) return;
+  double min_x = DBL_MAX, min_y = DBL_MAX;
+  double max_x = -DBL_MAX, max_y = -DBL_MAX;
+  for (const Edge &edge : edges) {
+    for (const Point &p : edge.geom.get_geometry_const()) {
+      min_x = std::min(min_x, boost::geometry::get<0>(p));
+      min_y = std::min(min_y, boost::geometry::get<1>(p));
+      max_x = std::max(max_x, boost::geometry::get<0>(p));
+      max_y = std::max(max_y, boost::geometry::get<1>(p));
+    }
+  }
+  if (min_x < -180 || max_x > 180 || min_y < -90 || max_y > 90) {
+    SPDLOG_CRITICAL("Network extent {} {} {} {} is not in longitude and "
+                    "latitude, it cannot be projected",
+                    min_x, min_y, max_x, max_y);
+    std::exit(EXIT_FAILURE);
+  }
+  projection = LocalProjection((min_x + max_x) / 2, (min_y + max_y) / 2);
+  SPDLOG_INFO("Project network into metres around {} {}",
+              projection.get_origin_x(), projection.get_origin_y());
+  if (max_y - min_y > 1 || max_x - min_x > 1) {
+    SPDLOG_WARN("Network extent is larger than one degree, the distances "
+                "far from its center are approximate");
+  }
+  for (Edge &edge : edges) {
+    projection.forward(&edge.geom);
+    edge.length = edge.geom.get_length();
+  }
+  for (Point &p : vertex_points) {
+    double x = boost::geometry::get<0>(p);
+    double y = boost::geometry::get<1>(p);
+    projection.forward(&x, &y);
+    p = Point(x, y);
+  }
+}
+
+void Network::reorder_by_hilbert_curve() {
+  SPDLOG_INFO("Reorder nodes and edges along the Hilbert curve");
+  if (vertex_points.empty()) return;
+  double min_x = DBL_MAX, min_y = DBL_MAX;
+  double max_x = -DBL_MAX, max_y = -DBL_MAX;
+  for (const Point &p : vertex_points) {
+    min_x = std::min(min_x, boost::geometry::get<0>(p));
+    min_y = std::min(min_y, boost::geometry::get<1>(p));
+    max_x = std::max(max_x, boost::geometry::get<0>(p));
+    max_y = std::max(max_y, boost::geometry::get<1>(p));
+  }
+  double scale = 65535.0 / std::max(std::max(max_x - min_x, max_y - min_y),
+                                    DBL_MIN);
+  std::vector<unsigned long long> keys(num_vertices);
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    const Point &p = vertex_points[u];
+    keys[u] = ALGORITHM::hilbert_index(
+        (unsigned int) ((boost::geometry::get<0>(p) - min_x) * scale),
+        (unsigned int) ((boost::geometry::get<1>(p) - min_y) * scale));
+  }
+  std::vector<NodeIndex> order(num_vertices);
+  for (NodeIndex u = 0; u < num_vertices; ++u) order[u] = u;
+  std::stable_sort(order.begin(), order.end(),
+                   [&keys](NodeIndex a, NodeIndex b) {
+                     return keys[a] < keys[b];
+                   });
+  std::vector<NodeIndex> new_index(num_vertices);
+  NodeIDVec new_ids(num_vertices);
+  std::vector<Point> new_points(num_vertices);
+  for (NodeIndex i = 0; i < num_vertices; ++i) {
+    new_index[order[i]] = i;
+    new_ids[i] = node_id_vec[order[i]];
+    new_points[i] = vertex_points[order[i]];
+  }
+  node_id_vec.swap(new_ids);
+  vertex_points.swap(new_points);
+  // Edges are grouped by source node, so that the edges of nodes close
+  // in space are close in memory
+  for (Edge &edge : edges) {
+    edge.source = new_index[edge.source];
+    edge.target = new_index[edge.target];
+  }
+  std::stable_sort(edges.begin(), edges.end(),
+                   [](const Edge &a, const Edge &b) {
+                     return a.source < b.source;
+                   });
+  // The costs follow their edges, found by the index before the sort
+  size_t num_costs = cost_names.size();
+  std::vector<double> new_costs(edge_costs.size());
+  for (EdgeIndex i = 0; i < edges.size(); ++i) {
+    std::copy(edge_costs.begin() + edges[i].index * num_costs,
+              edge_costs.begin() + (edges[i].index + 1) * num_costs,
+              new_costs.begin() + i * num_costs);
+    edges[i].index = i;
+  }
+  edge_costs.swap(new_costs);
+}
+
+void Network::build_id_maps() {
+  long long num_edges = edges.size();
+  std::vector<EdgeID> edge_ids(num_edges);
+  #pragma omp parallel for if(num_edges >= UTIL::PARALLEL_MIN_SIZE)
+  for (long long i = 0; i < num_edges; ++i) {
+    edge_ids[i] = edges[i].id;
+  }
+  edge_map = EdgeIndexMap(edge_ids);
+  node_map = NodeIndexMap(node_id_vec);
+}
 
 int Network::get_node_count() const {
   return node_id_vec.size();
@@ -142,12 +824,79 @@ int Network::get_edge_count() const {
   return edges.size();
 }
 
+const std::vector<std::string> &Network::get_cost_names() const {
+  return cost_names;
+}
+
+int Network::get_metric_index(const std::string &name) const {
+  if (name.empty() || name == "length") return 0;
+  auto iter = std::find(cost_names.begin(), cost_names.end(), name);
+  if (iter == cost_names.end()) return -1;
+  return iter - cost_names.begin() + 1;
+}
+
+const LocalProjection &Network::get_projection() const {
+  return projection;
+}
+
+void Network::query_edges(const BoostBox &box,
+                          std::vector<EdgeIndex> *edges) const {
+  if (chunk_edges.empty()) {
+    spatial_index->query(box, edges);
+    return;
+  }
+  std::vector<EdgeIndex> chunks;
+  spatial_index->query(box, &chunks);
+  std::sort(chunks.begin(), chunks.end());
+  std::size_t begin = edges->size();
+  for (EdgeIndex chunk : chunks) {
+    EdgeIndex edge = chunk_edges[chunk];
+    if (edges->size() > begin && edges->back() == edge) continue;
+    edges->push_back(edge);
+  }
+  if (edge_twins.empty()) return;
+  std::size_t end = edges->size();
+  for (std::size_t i = begin; i < end; ++i) {
+    EdgeIndex twin = edge_twins[(*edges)[i]];
+    if (twin != NO_TWIN) edges->push_back(twin);
+  }
+}
+
 // Get the edge vector
 const std::vector<Edge> &Network::get_edges() const
 {
   return edges;
 }
 
+void Network::get_memory_usage(UTIL::MemoryReport *report) const {
+  size_t edge_bytes = UTIL::get_vector_bytes(edges) +
+      UTIL::get_vector_bytes(edge_costs);
+  report->add("network", "edges", edge_bytes);
+  report->add("network", "geometry",
+              UTIL::get_vector_bytes(geom_x) + UTIL::get_vector_bytes(geom_y) +
+              UTIL::get_vector_bytes(geom_offsets) +
+              UTIL::get_vector_bytes(geom_cumlen) +
+              geometry_codes.get_memory_bytes());
+  report->add("network", "boxes",
+              UTIL::get_vector_bytes(seg_min_x) +
+              UTIL::get_vector_bytes(seg_min_y) +
+              UTIL::get_vector_bytes(seg_max_x) +
+              UTIL::get_vector_bytes(seg_max_y) +
+              UTIL::get_vector_bytes(edge_box_coords));
+  report->add("network", "id_maps",
+              UTIL::get_vector_bytes(node_id_vec) +
+              node_map.get_memory_bytes() + edge_map.get_memory_bytes());
+  report->add("network", "vertices", UTIL::get_vector_bytes(vertex_points));
+  report->add("network", "node_rtree", node_tree.get_memory_bytes());
+  report->add("network", "spatial_index",
+              (spatial_index ? spatial_index->get_memory_bytes() : 0) +
+              UTIL::get_vector_bytes(chunk_edges) +
+              UTIL::get_vector_bytes(chunk_first) +
+              UTIL::get_vector_bytes(chunk_last) +
+              UTIL::get_vector_bytes(chunk_box_coords) +
+              UTIL::get_vector_bytes(edge_twins));
+}
+
 // Get the ID attribute of an edge according to its index
 EdgeID Network::get_edge_id(EdgeIndex index) const
 {
@@ -170,20 +919,193 @@ Point Network::get_node_geom_from_idx(NodeIndex index) const {
   return vertex_points[index];
 }
 
-// Construct a Rtree using the vector of edges
-void Network::build_rtree_index() {
-  // Build an rtree for candidate search
-  SPDLOG_DEBUG("Create boost rtree");
-  // create some Items
+bool Network::snap_to_node(const Point &p, double radius,
+                           NodeIndex *node, double *dist) const {
+  return node_tree.nearest(p,radius,node,dist);
+}
+
+std::vector<int> Network::snap_nodes(const double *coords, int num_points,
+                                     double radius) const {
+  std::vector<int> nodes(num_points > 0 ? num_points : 0, -1);
+  for (int i = 0; i < num_points; ++i) {
+    NodeIndex node;
+    if (snap_to_node(Point(coords[2 * i],coords[2 * i + 1]),radius,&node)) {
+      nodes[i] = node;
+    }
+  }
+  return nodes;
+}
+
+bool Network::string2rtree_algorithm(const std::string &name,
+                                     RtreeAlgorithm *algorithm) {
+  if (name == "packing") {
+    *algorithm = PACKING;
+  } else if (name == "linear") {
+    *algorithm = LINEAR;
+  } else if (name == "quadratic") {
+    *algorithm = QUADRATIC;
+  } else if (name == "rstar") {
+    *algorithm = RSTAR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Network::string2spatial_index_type(const std::string &name,
+                                        SpatialIndexType *type) {
+  if (name == "rtree") {
+    *type = RTREE;
+  } else if (name == "flat") {
+    *type = FLAT_RTREE;
+  } else if (name == "grid") {
+    *type = GRID;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Network::build_spatial_index(
+    const std::vector<boost_box> &boxes,
+    std::unique_ptr<FlatRtreeIndex> flat_rtree) {
+  // The nodes are bulk loaded whatever the index of the edges
+  node_tree = NodeTree(vertex_points);
+  snap_cache.reset(index_options.snap_resolution > 0 ?
+                   new SnapCache(index_options.snap_resolution,
+                                 index_options.snap_cache_items) : nullptr);
+  // The boxes of the edges are also kept for the batched queries
+  edge_box_coords.resize(4 * edges.size());
+  std::vector<boost_box> edge_boxes;
+  long long num_edges = edges.size();
+  int threads = UTIL::get_parallel_threads(num_edges);
+  if (boxes.size() != edges.size()) {
+    edge_boxes.resize(num_edges);
+    #pragma omp parallel for schedule(dynamic, 1024) num_threads(threads)
+    for (long long i = 0; i < num_edges; ++i) {
+      double x1,y1,x2,y2;
+      ALGORITHM::boundingbox_geometry(get_edge_view(i),&x1,&y1,&x2,&y2);
+      edge_boxes[i] = boost_box(Point(x1,y1), Point(x2,y2));
+    }
+  }
+  const std::vector<boost_box> &all_boxes =
+      edge_boxes.empty() ? boxes : edge_boxes;
+  #pragma omp parallel for num_threads(threads)
+  for (long long i = 0; i < (long long) all_boxes.size(); ++i) {
+    edge_box_coords[4 * i] = all_boxes[i].min_corner().get<0>();
+    edge_box_coords[4 * i + 1] = all_boxes[i].min_corner().get<1>();
+    edge_box_coords[4 * i + 2] = all_boxes[i].max_corner().get<0>();
+    edge_box_coords[4 * i + 3] = all_boxes[i].max_corner().get<1>();
+  }
+  chunk_edges.clear();
+  chunk_first.clear();
+  chunk_last.clear();
+  chunk_box_coords.clear();
+  edge_twins.clear();
+  if (index_options.type == GRID) {
+    // The grid is built from the segments, not the boxes of the edges
+    spatial_index.reset(new GridIndex(geom_x,geom_y,geom_offsets,
+                                      index_options.cell_size));
+    return;
+  }
+  if (index_options.twin_edges) find_edge_twins();
+  // The first edges of the twins are indexed as chunks of whole edges if
+  // they are not split
+  bool chunked = index_options.chunk_segments > 0 || !edge_twins.empty();
+  std::vector<boost_box> chunk_boxes;
+  if (chunked) build_edge_chunks(&chunk_boxes);
+  const std::vector<boost_box> &items = chunked ? chunk_boxes : all_boxes;
+  if (index_options.type == FLAT_RTREE) {
+    if (flat_rtree && flat_rtree->get_num_items() == (long long) items.size()) {
+      SPDLOG_INFO("Flat rtree mapped from the network cache");
+      spatial_index = std::move(flat_rtree);
+    } else {
+      spatial_index.reset(
+          new FlatRtreeIndex(items,index_options.max_elements));
+    }
+    return;
+  }
+  spatial_index.reset(new RtreeIndex(items,index_options));
+}
+
+void Network::find_edge_twins() {
+  // The edges are grouped by their pair of nodes in any direction
+  std::vector<EdgeIndex> order(edges.size());
+  for (std::size_t i = 0; i < edges.size(); ++i) order[i] = i;
+  auto key = [this](EdgeIndex e) {
+    const Edge &edge = edges[e];
+    return std::make_pair(std::min(edge.source, edge.target),
+                          std::max(edge.source, edge.target));
+  };
+  std::sort(order.begin(), order.end(), [&key](EdgeIndex a, EdgeIndex b) {
+    return key(a) < key(b) || (key(a) == key(b) && a < b);
+  });
+  edge_twins.assign(edges.size(), NO_TWIN);
+  long long pairs = 0;
+  for (std::size_t begin = 0, end = 0; begin < order.size(); begin = end) {
+    end = begin + 1;
+    while (end < order.size() && key(order[end]) == key(order[begin])) {
+      ++end;
+    }
+    for (std::size_t a = begin; a < end; ++a) {
+      EdgeIndex e = order[a];
+      for (std::size_t b = a + 1; b < end && edge_twins[e] == NO_TWIN; ++b) {
+        EdgeIndex f = order[b];
+        if (edge_twins[f] != NO_TWIN || edges[e].source != edges[f].target ||
+            edges[e].target != edges[f].source) {
+          continue;
+        }
+        long long first_e = geom_offsets[e], first_f = geom_offsets[f];
+        long long n = geom_offsets[e + 1] - first_e;
+        if (n == 0 || geom_offsets[f + 1] - first_f != n) continue;
+        bool reversed = true;
+        for (long long j = 0; j < n && reversed; ++j) {
+          reversed = geom_x[first_e + j] == geom_x[first_f + n - 1 - j] &&
+              geom_y[first_e + j] == geom_y[first_f + n - 1 - j];
+        }
+        if (!reversed) continue;
+        edge_twins[e] = f;
+        edge_twins[f] = e;
+        ++pairs;
+      }
+    }
+  }
+  SPDLOG_INFO("Pair {} twin edges of {} edges", pairs, edges.size());
+  if (pairs == 0) edge_twins.clear();
+}
+
+void Network::build_edge_chunks(std::vector<boost_box> *boxes) {
+  long long segments = index_options.chunk_segments;
   for (std::size_t i = 0; i < edges.size(); ++i) {
-    // create a boost_box
-    Edge *edge = &edges[i];
-    double x1,y1,x2,y2;
-    ALGORITHM::boundingbox_geometry(edge->geom,&x1,&y1,&x2,&y2);
-    boost_box b(Point(x1,y1), Point(x2,y2));
-    rtree.insert(std::make_pair(b,edge));
+    long long first = geom_offsets[i];
+    long long last = geom_offsets[i + 1] - 1;
+    if (last < first) continue;
+    if (!edge_twins.empty() && edge_twins[i] < i) continue;
+    // Consecutive chunks share their end point, an edge of a single point
+    // has a chunk of that point
+    long long begin = first;
+    while (true) {
+      long long end = segments > 0 ? std::min(begin + segments, last) : last;
+      double x1 = geom_x[begin], y1 = geom_y[begin];
+      double x2 = x1, y2 = y1;
+      for (long long j = begin + 1; j <= end; ++j) {
+        x1 = std::min(x1,geom_x[j]);
+        y1 = std::min(y1,geom_y[j]);
+        x2 = std::max(x2,geom_x[j]);
+        y2 = std::max(y2,geom_y[j]);
+      }
+      chunk_edges.push_back(i);
+      chunk_first.push_back(begin);
+      chunk_last.push_back(end);
+      chunk_box_coords.insert(chunk_box_coords.end(),{x1,y1,x2,y2});
+      boxes->push_back(boost_box(Point(x1,y1),Point(x2,y2)));
+      if (end >= last) break;
+      begin = end;
+    }
   }
-  SPDLOG_DEBUG("Create boost rtree done");
+  SPDLOG_INFO("Index {} chunks of at most {} segments of {} edges",
+              chunk_edges.size(),segments > 0 ? segments : -1,
+              edges.size());
 }
 
 Traj_Candidates Network::search_tr_cs_knn(Trajectory &trajectory, std::size_t k,
@@ -193,109 +1115,445 @@ Traj_Candidates Network::search_tr_cs_knn(Trajectory &trajectory, std::size_t k,
 
 Traj_Candidates Network::search_tr_cs_knn(const LineString &geom, std::size_t k,
                                           double radius) const
+{
+  CandidateSearchContext &context = CandidateSearchContext::local();
+  if (!search_tr_cs_knn(geom,k,radius,&context)) {
+    return Traj_Candidates();
+  }
+  return context.to_traj_candidates();
+}
+
+bool Network::search_tr_cs_knn(const LineString &geom, std::size_t k,
+                               double radius,
+                               CandidateSearchContext *context,
+                               const std::vector<EdgeIndex> *corridor,
+                               const EdgeMask *mask) const
 {
   int NumberPoints = geom.get_num_points();
-  Traj_Candidates tr_cs(NumberPoints);
+  context->clear();
+  context->network = this;
+  int batch_size = std::max(index_options.query_batch_size,1);
+  const std::vector<EdgeIndex> &temp =
+      batch_size > 1 ? context->point_edges : context->query_edges;
+  Point_Candidates &pcs = context->point_candidates;
+  std::vector<Candidate> &candidates = context->candidates;
   unsigned int current_candidate_index = num_vertices;
+  // The snapping cache replaces the queries of the index, except in the
+  // adaptive mode where the radius depends on the point
+  bool snap = snap_cache != nullptr &&
+      !(index_options.initial_radius > 0 &&
+        index_options.initial_radius < radius);
+  // The nearest items may all be out of the corridor or masked
+  bool nearest = !snap && index_options.nearest_search &&
+      index_options.type != GRID && batch_size == 1 && corridor == nullptr &&
+      mask == nullptr;
+  // The first search of a point in the adaptive mode uses the initial
+  // radius, which grows for the points with too few candidates
+  bool adaptive = !nearest && index_options.initial_radius > 0 &&
+      index_options.initial_radius < radius;
+  double search_radius = adaptive ? index_options.initial_radius : radius;
+  std::size_t min_candidates =
+      std::min<std::size_t>(std::max(index_options.min_candidates,1),k);
+  long long expanded_points = 0, expansions = 0, full_radius_points = 0;
+  auto record_statistics = [&](int points) {
+    if (!adaptive) return;
+    search_points.fetch_add(points,std::memory_order_relaxed);
+    search_expanded_points.fetch_add(expanded_points,
+                                     std::memory_order_relaxed);
+    search_expansions.fetch_add(expansions,std::memory_order_relaxed);
+    search_full_radius_points.fetch_add(full_radius_points,
+                                        std::memory_order_relaxed);
+  };
   for (int i=0; i<NumberPoints; ++i) {
     // SPDLOG_DEBUG("Search candidates for point index {}",i);
-    // Construct a bounding boost_box
     double px = geom.get_x(i);
     double py = geom.get_y(i);
-    Point_Candidates pcs;
-    boost_box b(Point(geom.get_x(i)-radius,geom.get_y(i)-radius),
-                Point(geom.get_x(i)+radius,geom.get_y(i)+radius));
-    std::vector<Item> temp;
-    // Rtree can only detect intersect with a the bounding box of
-    // the geometry stored.
-    rtree.query(boost::geometry::index::intersects(b),
-                std::back_inserter(temp));
-    int Nitems = temp.size();
-    for (unsigned int j=0; j<Nitems; ++j) {
-      // Check for detailed intersection
-      // The two edges are all in OGR_linestring
-      Edge *edge = temp[j].second;
-      double offset;
-      double dist;
-      double closest_x,closest_y;
-      ALGORITHM::linear_referencing(px,py,edge->geom,
-                                    &dist,&offset,&closest_x,&closest_y);
-      if (dist<=radius) {
-        // index, offset, dist, edge, pseudo id, point
-        Candidate c = {0,
-                       offset,
-                       dist,
-                       edge,
-                       Point(closest_x,closest_y)};
-        pcs.push_back(c);
+    pcs.clear();
+    if (snap) {
+      // The edges near the cell of the point contain the ones within the
+      // radius, and the point is projected exactly on them
+      std::vector<EdgeIndex> &point_edges = context->point_edges;
+      if (!snap_cache->look_up(px,py,radius,&point_edges)) {
+        point_edges.clear();
+        spatial_index->query(snap_cache->get_query_box(px,py,radius),
+                             &point_edges);
+        // Sorted to make the chunks of an edge adjacent
+        std::sort(point_edges.begin(),point_edges.end());
+        snap_cache->insert(px,py,radius,point_edges);
+      }
+      project_items(point_edges,px,py,radius,&pcs,corridor,mask);
+    } else if (nearest) {
+      search_nearest(px,py,k,radius,&pcs);
+    } else {
+      if (i % batch_size == 0) {
+        // Construct the bounding box of the points of the batch expanded
+        // by the radius
+        int last = std::min(i+batch_size,NumberPoints);
+        double x1 = px, y1 = py, x2 = px, y2 = py;
+        for (int j=i+1; j<last; ++j) {
+          x1 = std::min(x1,geom.get_x(j));
+          y1 = std::min(y1,geom.get_y(j));
+          x2 = std::max(x2,geom.get_x(j));
+          y2 = std::max(y2,geom.get_y(j));
+        }
+        boost_box b(Point(x1-search_radius,y1-search_radius),
+                    Point(x2+search_radius,y2+search_radius));
+        context->query_edges.clear();
+        // The spatial index only detects the edges whose boxes or
+        // segments may intersect the box.
+        spatial_index->query(b,&context->query_edges);
+        // The chunks of an edge are made adjacent to merge their candidates
+        if (!chunk_edges.empty()) {
+          std::sort(context->query_edges.begin(),context->query_edges.end());
+        }
+        if (batch_size > 1) {
+          context->gather_query_boxes(
+              chunk_edges.empty() ? edge_box_coords : chunk_box_coords);
+        }
+      }
+      if (batch_size > 1) context->filter_query_edges(px,py,search_radius);
+      project_items(temp,px,py,search_radius,&pcs,corridor,mask);
+      if (adaptive && pcs.size() < min_candidates) {
+        ++expanded_points;
+        // The point is queried alone into the point edges, which are
+        // refilled for each point of a batch
+        double r = search_radius;
+        while (pcs.size() < min_candidates && r < radius) {
+          r = std::min(r*index_options.radius_growth,radius);
+          ++expansions;
+          std::vector<EdgeIndex> &point_edges = context->point_edges;
+          point_edges.clear();
+          spatial_index->query(boost_box(Point(px-r,py-r),Point(px+r,py+r)),
+                               &point_edges);
+          if (!chunk_edges.empty()) {
+            std::sort(point_edges.begin(),point_edges.end());
+          }
+          pcs.clear();
+          project_items(point_edges,px,py,r,&pcs,corridor,mask);
+        }
+        if (r >= radius) ++full_radius_points;
       }
     }
     if (pcs.empty()) {
-      return Traj_Candidates();
+      record_statistics(i+1);
+      context->clear();
+      context->missing_point = i;
+      return false;
     }
-    // KNN part
+    // KNN part. The candidates are sorted in both cases, so that they
+    // do not depend on the order of the edges in the spatial index.
     if (pcs.size()<=k) {
-      tr_cs[i]=pcs;
+      std::sort(pcs.begin(),pcs.end(),candidate_compare);
     } else {
-      tr_cs[i]=Point_Candidates(k);
-      std::partial_sort_copy(
-        pcs.begin(),pcs.end(),
-        tr_cs[i].begin(),tr_cs[i].end(),
-        candidate_compare);
+      std::partial_sort(pcs.begin(),pcs.begin()+k,pcs.end(),
+                        candidate_compare);
+      pcs.resize(k);
     }
-    for (int m=0; m<tr_cs[i].size(); ++m) {
-      tr_cs[i][m].index = current_candidate_index+m;
+    for (int m=0; m<pcs.size(); ++m) {
+      pcs[m].index = current_candidate_index+m;
     }
-    current_candidate_index+=tr_cs[i].size();
+    current_candidate_index+=pcs.size();
+    candidates.insert(candidates.end(),pcs.begin(),pcs.end());
+    context->offsets.push_back(candidates.size());
     // SPDLOG_TRACE("current_candidate_index {}",current_candidate_index);
   }
-  return tr_cs;
+  record_statistics(NumberPoints);
+  return true;
+}
+
+void Network::project_items(const std::vector<EdgeIndex> &items, double px,
+                            double py, double radius,
+                            Point_Candidates *pcs,
+                            const std::vector<EdgeIndex> *corridor,
+                            const EdgeMask *mask) const {
+  Candidate c;
+  std::size_t begin = pcs->size();
+  bool twins = !edge_twins.empty();
+  for (EdgeIndex item : items) {
+    EdgeIndex e = chunk_edges.empty() ? item : chunk_edges[item];
+    // The projection on an edge gives the one on its twin
+    if (!is_edge_allowed(e,corridor,mask) &&
+        (!twins || !is_edge_allowed(edge_twins[e],corridor,mask))) {
+      continue;
+    }
+    if (!project_item(item,px,py,radius,&c)) continue;
+    // An edge keeps the closest projection of its chunks
+    if (pcs->size() > begin && pcs->back().edge == c.edge) {
+      if (c.dist < pcs->back().dist) pcs->back() = c;
+      continue;
+    }
+    pcs->push_back(c);
+  }
+  if (twins) add_twin_candidates(begin,pcs,corridor,mask);
+}
+
+bool Network::is_edge_allowed(EdgeIndex e,
+                              const std::vector<EdgeIndex> *corridor,
+                              const EdgeMask *mask) const {
+  if (e == NO_TWIN) return false;
+  if (mask != nullptr && !mask->is_allowed(e)) return false;
+  return corridor == nullptr ||
+      std::binary_search(corridor->begin(),corridor->end(),e);
+}
+
+Candidate Network::get_twin_candidate(const Candidate &c) const {
+  // The twin is travelled in the other direction from the same point
+  const Edge &edge = edges[edge_twins[c.edge->index]];
+  double offset = std::min(std::max(edge.length - c.offset,0.0),
+                           edge.length);
+  return {0,offset,c.dist,const_cast<Edge *>(&edge),c.point};
+}
+
+void Network::add_twin_candidates(std::size_t begin, Point_Candidates *pcs,
+                                  const std::vector<EdgeIndex> *corridor,
+                                  const EdgeMask *mask) const {
+  std::size_t end = pcs->size();
+  std::size_t kept = begin;
+  for (std::size_t i = begin; i < end; ++i) {
+    Candidate c = (*pcs)[i];
+    EdgeIndex twin = edge_twins[c.edge->index];
+    if (is_edge_allowed(twin,corridor,mask)) {
+      pcs->push_back(get_twin_candidate(c));
+    }
+    if (is_edge_allowed(c.edge->index,corridor,mask)) (*pcs)[kept++] = c;
+  }
+  pcs->erase(pcs->begin() + kept, pcs->begin() + end);
+}
+
+void Network::get_corridor_edges(const std::vector<EdgeIndex> &path,
+                                 double buffer,
+                                 std::vector<EdgeIndex> *corridor) const {
+  corridor->clear();
+  std::vector<EdgeIndex> items;
+  for (EdgeIndex e : path) {
+    const double *box = &edge_box_coords[4 * e];
+    items.clear();
+    spatial_index->query(boost_box(Point(box[0]-buffer,box[1]-buffer),
+                                   Point(box[2]+buffer,box[3]+buffer)),
+                         &items);
+    for (EdgeIndex item : items) {
+      EdgeIndex e = chunk_edges.empty() ? item : chunk_edges[item];
+      corridor->push_back(e);
+      if (!edge_twins.empty() && edge_twins[e] != NO_TWIN) {
+        corridor->push_back(edge_twins[e]);
+      }
+    }
+  }
+  std::sort(corridor->begin(),corridor->end());
+  corridor->erase(std::unique(corridor->begin(),corridor->end()),
+                  corridor->end());
+}
+
+CandidateSearchStatistics Network::get_search_statistics() const {
+  CandidateSearchStatistics statistics;
+  statistics.points = search_points.load(std::memory_order_relaxed);
+  statistics.expanded_points =
+      search_expanded_points.load(std::memory_order_relaxed);
+  statistics.expansions = search_expansions.load(std::memory_order_relaxed);
+  statistics.full_radius_points =
+      search_full_radius_points.load(std::memory_order_relaxed);
+  return statistics;
+}
+
+void Network::print_search_statistics() const {
+  if (snap_cache != nullptr) snap_cache->print_statistics();
+  if (index_options.initial_radius <= 0) return;
+  CandidateSearchStatistics statistics = get_search_statistics();
+  SPDLOG_INFO("Candidate search points {} expanded {} ({:.4f}) "
+              "expansions {} reaching the radius {}",
+              statistics.points, statistics.expanded_points,
+              statistics.points > 0 ?
+                  statistics.expanded_points / (double) statistics.points :
+                  0.0,
+              statistics.expansions, statistics.full_radius_points);
+}
+
+bool Network::project_item(EdgeIndex item, double px, double py,
+                           double radius, Candidate *candidate) const {
+  Edge *edge;
+  double offset;
+  double dist;
+  double closest_x,closest_y;
+  if (chunk_edges.empty()) {
+    edge = const_cast<Edge *>(&edges[item]);
+    // Reject the edges whose segments are all out of the radius,
+    // before projecting the point
+    if (!is_edge_near(item,px,py,radius)) return false;
+    ALGORITHM::linear_referencing(px,py,get_edge_view(item),
+                                  &dist,&offset,&closest_x,&closest_y);
+  } else {
+    edge = const_cast<Edge *>(&edges[chunk_edges[item]]);
+    long long first = chunk_first[item];
+    long long last = chunk_last[item];
+    if (!is_range_near(first,last,px,py,radius)) return false;
+    // The cumulative lengths of the store give the offsets on the edge
+    const double *x, *y, *cumlen;
+    if (geometry_codes.empty()) {
+      x = geom_x.data() + first;
+      y = geom_y.data() + first;
+      cumlen = geom_cumlen.data() + first;
+    } else {
+      LineStringView view = get_edge_view(chunk_edges[item]);
+      long long skip = first - geom_offsets[chunk_edges[item]];
+      x = view.get_x_data() + skip;
+      y = view.get_y_data() + skip;
+      cumlen = view.get_cumlen_data() + skip;
+    }
+    LineStringView chunk(x, y, last - first + 1, cumlen);
+    ALGORITHM::linear_referencing(px,py,chunk,
+                                  &dist,&offset,&closest_x,&closest_y);
+  }
+  if (dist>radius) return false;
+  // index, offset, dist, edge, pseudo id, point
+  *candidate = {0, offset, dist, edge, Point(closest_x,closest_y)};
+  return true;
+}
+
+void Network::search_nearest(double px, double py, std::size_t k,
+                             double radius, Point_Candidates *pcs) const {
+  Candidate c;
+  spatial_index->visit_nearest(px,py,[&](EdgeIndex item, double box_dist) {
+    // The items left are not closer than their boxes, so the search stops
+    // once k candidates are strictly closer, which keeps the ties
+    if (box_dist > radius ||
+        (k > 0 && pcs->size() >= k && (*pcs)[k-1].dist < box_dist)) {
+      return false;
+    }
+    if (!project_item(item,px,py,radius,&c)) return true;
+    // The chunks of an edge are visited in any order
+    auto insert = [pcs](const Candidate &candidate) {
+      auto same = std::find_if(pcs->begin(),pcs->end(),
+                               [&candidate](const Candidate &other) {
+                                 return other.edge == candidate.edge;
+                               });
+      if (same != pcs->end()) {
+        if (candidate.dist >= same->dist) return;
+        pcs->erase(same);
+      }
+      pcs->insert(std::upper_bound(pcs->begin(),pcs->end(),candidate,
+                                   candidate_compare),candidate);
+    };
+    insert(c);
+    if (!edge_twins.empty() && edge_twins[c.edge->index] != NO_TWIN) {
+      insert(get_twin_candidate(c));
+    }
+    return true;
+  });
+  if (pcs->size() > k) pcs->resize(k);
 }
 
 const LineString &Network::get_edge_geom(int edge_id) const {
-  return edges[get_edge_index(edge_id)].geom;
+  static thread_local LineString geom;
+  geom = get_edge_view(get_edge_index(edge_id)).to_linestring();
+  return geom;
+}
+
+bool Network::get_edge_direction(EdgeIndex index, double offset,
+                                 double *dx, double *dy) const {
+  LineStringView view = get_edge_view(index);
+  const double *cumlen = view.get_cumlen_data();
+  int n = view.get_num_points();
+  // The first segment ending after the offset, skipping the segments of
+  // zero length
+  int found = -1;
+  for (int i = 1; i < n; ++i) {
+    if (cumlen[i] <= cumlen[i-1]) continue;
+    found = i;
+    if (cumlen[i] >= offset) break;
+  }
+  if (found < 0) return false;
+  double x = view.get_x(found) - view.get_x(found-1);
+  double y = view.get_y(found) - view.get_y(found-1);
+  double length = std::sqrt(x*x+y*y);
+  if (length <= 0) return false;
+  *dx = x/length;
+  *dy = y/length;
+  return true;
 }
 
 LineString Network::complete_path_to_geometry(
   const LineString &traj, const C_Path &complete_path) const
 {
-  // if (complete_path->empty()) return nullptr;
+  std::vector<EdgeIndex> path(complete_path.size());
+  for (std::size_t i = 0; i < complete_path.size(); ++i) {
+    path[i] = get_edge_index(complete_path[i]);
+  }
+  return complete_path_to_geometry(traj, path);
+}
+
+LineString Network::complete_path_to_geometry(
+  const LineString &traj, const std::vector<EdgeIndex> &complete_path) const
+{
+  if (complete_path.empty()) return LineString();
+  int Npts = traj.get_num_points();
+  int NCsegs = complete_path.size();
+  double dist;
+  double firstoffset;
+  double lastoffset;
+  ALGORITHM::linear_referencing(traj.get_x(0),traj.get_y(0),
+                                get_edge_view(complete_path[0]),
+                                &dist,&firstoffset);
+  ALGORITHM::linear_referencing(traj.get_x(Npts-1),traj.get_y(Npts-1),
+                                get_edge_view(complete_path[NCsegs-1]),
+                                &dist,&lastoffset);
+  return complete_path_to_geometry(complete_path, firstoffset, lastoffset);
+}
+
+LineString Network::complete_path_to_geometry(
+  const std::vector<EdgeIndex> &complete_path, double firstoffset,
+  double lastoffset) const
+{
   LineString line;
   if (complete_path.empty()) return line;
-  int Npts = traj.get_num_points();
   int NCsegs = complete_path.size();
-  if (NCsegs ==1) {
-    double dist;
-    double firstoffset;
-    double lastoffset;
-    const LineString &firstseg = get_edge_geom(complete_path[0]);
-    ALGORITHM::linear_referencing(traj.get_x(0),traj.get_y(0),firstseg,
-                                  &dist,&firstoffset);
-    ALGORITHM::linear_referencing(traj.get_x(Npts-1),traj.get_y(Npts-1),
-                                  firstseg,&dist,&lastoffset);
-    LineString firstlineseg= ALGORITHM::cutoffseg_unique(firstseg, firstoffset,
-                                                         lastoffset);
-    append_segs_to_line(&line,firstlineseg,0);
-  } else {
-    const LineString &firstseg = get_edge_geom(complete_path[0]);
-    const LineString &lastseg = get_edge_geom(complete_path[NCsegs-1]);
-    double dist;
-    double firstoffset;
-    double lastoffset;
-    ALGORITHM::linear_referencing(traj.get_x(0),traj.get_y(0),firstseg,
-                                  &dist,&firstoffset);
-    ALGORITHM::linear_referencing(traj.get_x(Npts-1),traj.get_y(Npts-1),
-                                  lastseg,&dist,&lastoffset);
-    LineString firstlineseg= ALGORITHM::cutoffseg(firstseg, firstoffset, 0);
-    LineString lastlineseg= ALGORITHM::cutoffseg(lastseg, lastoffset, 1);
-    append_segs_to_line(&line,firstlineseg,0);
-    if (NCsegs>2) {
-      for(int i=1; i<NCsegs-1; ++i) {
-        const LineString &middleseg =  get_edge_geom(complete_path[i]);
-        append_segs_to_line(&line,middleseg,1);
-      }
+  LineStringView firstseg = get_edge_view(complete_path[0]);
+  LineString::linestring_t &points = line.get_geometry();
+  if (NCsegs==1) {
+    points.resize(ALGORITHM::cutoffseg_unique(firstseg, firstoffset,
+                                              lastoffset, nullptr));
+    if (!points.empty()) {
+      ALGORITHM::cutoffseg_unique(firstseg, firstoffset, lastoffset,
+                                  &points[0]);
+    }
+    return line;
+  }
+  // The first point of every edge after the first one is skipped, as it
+  // is the last point of the previous edge
+  double firstlength = firstseg.get_length();
+  int firstpoints = ALGORITHM::cutoffseg_unique(firstseg, firstoffset,
+                                                firstlength, nullptr);
+  // A view of compressed geometries may be replaced by the next one, so
+  // that the views are taken again before each use
+  int lastpoints = ALGORITHM::cutoffseg_unique(
+      get_edge_view(complete_path[NCsegs-1]), 0, lastoffset, nullptr);
+  long long total = firstpoints + std::max(lastpoints - 1, 0);
+  for (int i = 1; i < NCsegs - 1; ++i) {
+    total += geom_offsets[complete_path[i] + 1] -
+        geom_offsets[complete_path[i]] - 1;
+  }
+  points.resize(total);
+  long long pos = 0;
+  if (firstpoints > 0) {
+    ALGORITHM::cutoffseg_unique(get_edge_view(complete_path[0]),
+                                firstoffset, firstlength, &points[0]);
+    pos = firstpoints;
+  }
+  for (int i = 1; i < NCsegs - 1; ++i) {
+    LineStringView seg = get_edge_view(complete_path[i]);
+    for (int j = 1; j < seg.get_num_points(); ++j) {
+      points[pos++] = Point(seg.get_x(j), seg.get_y(j));
     }
-    append_segs_to_line(&line,lastlineseg,1);
+  }
+  LineStringView lastseg = get_edge_view(complete_path[NCsegs-1]);
+  if (lastpoints > 0 && pos > 0) {
+    // The cut is written over the last point, which is restored
+    Point previous = points[pos - 1];
+    ALGORITHM::cutoffseg_unique(lastseg, 0, lastoffset, &points[pos - 1]);
+    points[pos - 1] = previous;
+  } else if (lastpoints > 0) {
+    std::vector<Point> cut(lastpoints);
+    ALGORITHM::cutoffseg_unique(lastseg, 0, lastoffset, &cut[0]);
+    std::copy(cut.begin() + 1, cut.end(), points.begin());
   }
   return line;
 }
@@ -310,50 +1568,135 @@ const Point &Network::get_vertex_point(NodeIndex u) const {
 
 LineString Network::route2geometry(const std::vector<EdgeID> &path) const
 {
-  LineString line;
-  if (path.empty()) return line;
-  // if (complete_path->empty()) return nullptr;
-  int NCsegs = path.size();
-  for(int i=0; i<NCsegs; ++i) {
-    EdgeIndex e = get_edge_index(path[i]);
-    const LineString &seg = edges[e].geom;
-    if (i==0) {
-      append_segs_to_line(&line,seg,0);
-    } else {
-      append_segs_to_line(&line,seg,1);
-    }
+  std::vector<EdgeIndex> indices(path.size());
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    indices[i] = get_edge_index(path[i]);
   }
-  //SPDLOG_DEBUG("Path geometry is {}",line.exportToWkt());
-  return line;
+  return route2geometry(indices);
 }
 
 LineString Network::route2geometry(const std::vector<EdgeIndex> &path) const
 {
   LineString line;
   if (path.empty()) return line;
-  // if (complete_path->empty()) return nullptr;
-  int NCsegs = path.size();
-  for(int i=0; i<NCsegs; ++i)
-  {
-    const LineString &seg = edges[path[i]].geom;
-    if (i==0) {
-      append_segs_to_line(&line,seg,0);
-    } else {
-      append_segs_to_line(&line,seg,1);
+  // The first point of every edge after the first one is skipped
+  long long total = 1;
+  for (EdgeIndex e : path) {
+    total += geom_offsets[e + 1] - geom_offsets[e] - 1;
+  }
+  LineString::linestring_t &points = line.get_geometry();
+  points.reserve(total);
+  for (std::size_t i = 0; i < path.size(); ++i) {
+    LineStringView seg = get_edge_view(path[i]);
+    for (int j = (i == 0 ? 0 : 1); j < seg.get_num_points(); ++j) {
+      points.push_back(Point(seg.get_x(j), seg.get_y(j)));
     }
   }
-  //SPDLOG_DEBUG("Path geometry is {}",line.exportToWkt());
   return line;
 }
 
-void Network::append_segs_to_line(LineString *line,
-                                  const LineString &segs, int offset)
-{
-  int Npoints = segs.get_num_points();
-  for(int i=0; i<Npoints; ++i) {
-    if (i>=offset) {
-      line->add_point(segs.get_x(i),segs.get_y(i));
+void Network::build_geometry_store() {
+  long long num_edges = edges.size();
+  int threads = UTIL::get_parallel_threads(num_edges);
+  // The offsets are the prefix sum of the numbers of points
+  geom_offsets.assign(num_edges + 1, 0);
+  #pragma omp parallel for num_threads(threads)
+  for (long long i = 0; i < num_edges; ++i) {
+    geom_offsets[i + 1] = edges[i].geom.get_num_points();
+  }
+  UTIL::parallel_inclusive_scan(&geom_offsets);
+  long long num_points = geom_offsets[num_edges];
+  geom_x.resize(num_points);
+  geom_y.resize(num_points);
+  #pragma omp parallel for schedule(dynamic, 1024) num_threads(threads)
+  for (long long i = 0; i < num_edges; ++i) {
+    LineString &geom = edges[i].geom;
+    long long first = geom_offsets[i];
+    int npoints = geom.get_num_points();
+    for (int j = 0; j < npoints; ++j) {
+      geom_x[first + j] = geom.get_x(j);
+      geom_y[first + j] = geom.get_y(j);
     }
+    // The packed store is the only copy of the points from now on
+    geom = LineString();
+  }
+}
+
+void Network::build_segment_store() {
+  long long num_points = geom_x.size();
+  geom_cumlen.resize(num_points);
+  seg_min_x.resize(num_points);
+  seg_min_y.resize(num_points);
+  seg_max_x.resize(num_points);
+  seg_max_y.resize(num_points);
+  long long num_edges = edges.size();
+  #pragma omp parallel num_threads(UTIL::get_parallel_threads(num_edges))
+  {
+  std::vector<double> boxes; // Segment boxes of an edge in double precision
+  #pragma omp for schedule(dynamic, 1024)
+  for (long long i = 0; i < num_edges; ++i) {
+    long long first = geom_offsets[i];
+    long long last = geom_offsets[i + 1];
+    if (first == last) continue;
+    int num_points = last - first;
+    // The segment lengths are summed in place into the cumulative lengths
+    ALGORITHM::segment_lengths(&geom_x[first], &geom_y[first], num_points,
+                               &geom_cumlen[first + 1]);
+    geom_cumlen[first] = 0;
+    for (long long j = first + 1; j < last; ++j) {
+      geom_cumlen[j] += geom_cumlen[j - 1];
+    }
+    boxes.resize(4 * num_points);
+    double *min_x = &boxes[0];
+    double *min_y = min_x + num_points;
+    double *max_x = min_y + num_points;
+    double *max_y = max_x + num_points;
+    ALGORITHM::segment_boxes(&geom_x[first], &geom_y[first], num_points,
+                             min_x, min_y, max_x, max_y);
+    for (int j = 0; j < num_points - 1; ++j) {
+      seg_min_x[first + j] = round_box_down(min_x[j]);
+      seg_min_y[first + j] = round_box_down(min_y[j]);
+      seg_max_x[first + j] = round_box_up(max_x[j]);
+      seg_max_y[first + j] = round_box_up(max_y[j]);
+    }
+  }
+  }
+}
+
+void Network::compress_geometry_store() {
+  std::vector<Point> refs(edges.size());
+  for (std::size_t i = 0; i < edges.size(); ++i) {
+    refs[i] = vertex_points[edges[i].source];
+  }
+  geometry_codes = CompressedGeometry(geom_x, geom_y, geom_offsets, refs);
+  size_t bytes = UTIL::get_vector_bytes(geom_x) +
+      UTIL::get_vector_bytes(geom_y) + UTIL::get_vector_bytes(geom_cumlen);
+  std::vector<double>().swap(geom_x);
+  std::vector<double>().swap(geom_y);
+  std::vector<double>().swap(geom_cumlen);
+  SPDLOG_INFO("Compress edge geometries from {} to {} bytes", bytes,
+              geometry_codes.get_memory_bytes());
+}
+
+bool Network::is_edge_near(EdgeIndex index, double px, double py,
+                           double radius) const {
+  return is_range_near(geom_offsets[index], geom_offsets[index + 1] - 1,
+                       px, py, radius);
+}
+
+bool Network::is_range_near(long long first, long long last, double px,
+                            double py, double radius) const {
+  // The radius is slightly enlarged, so that a segment at exactly the
+  // radius is not rejected because of rounding
+  double r = radius * (1 + 1e-9);
+  double r2 = r * r;
+  bool near = false;
+  // Without branches, the loop is vectorized by the compiler
+  for (long long j = first; j < last; ++j) {
+    double dx = std::max(std::max(seg_min_x[j] - px, px - seg_max_x[j]), 0.0);
+    double dy = std::max(std::max(seg_min_y[j] - py, py - seg_max_y[j]), 0.0);
+    near |= (dx * dx + dy * dy <= r2);
   }
+  return near;
 }
 
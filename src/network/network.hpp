@@ -11,6 +11,13 @@
 #define FMM_NETWORK_HPP
 
 #include "network/type.hpp"
+#include "network/spatial_index.hpp"
+#include "network/rtree.hpp"
+#include "network/candidate_search.hpp"
+#include "network/edge_mask.hpp"
+#include "network/local_projection.hpp"
+#include "network/compressed_geometry.hpp"
+#include "network/snap_cache.hpp"
 #include "core/gps.hpp"
 #include "mm/mm_type.hpp"
 #include <ogrsf_frmts.h> // C++ API for GDAL
@@ -19,17 +26,39 @@
 #include <iomanip>
 #include <algorithm> // Partial sort copy
 #include <unordered_set> // Partial sort copy
+#include <unordered_map>
+#include <atomic>
+#include <memory>
 
-// Data structures for Rtree
-#include <boost/geometry/geometries/box.hpp>
-#include <boost/geometry/index/rtree.hpp>
-#include <boost/function_output_iterator.hpp>
 
 namespace FMM {
 /**
  * Classes related with network and graph
  */
 namespace NETWORK {
+/**
+ * Region of a network file read by Network, where only the edges
+ * intersecting the region grown by a margin are read
+ */
+struct NetworkClip {
+  std::string region; /**< Box as minx,miny,maxx,maxy or polygon in WKT,
+                           in the coordinates of the network file, empty
+                           to read the whole network */
+  double margin = 0; /**< Margin added around the region */
+};
+
+/**
+ * Counters of the adaptive radius of candidate search, which are only
+ * updated when SpatialIndexOptions::initial_radius is enabled
+ */
+struct CandidateSearchStatistics {
+  long long points = 0; /**< Points searched */
+  long long expanded_points = 0; /**< Points whose radius grew */
+  long long expansions = 0; /**< Growths of the radius */
+  long long full_radius_points = 0; /**< Points whose radius grew up to the
+                                         search radius */
+};
+
 /**
  * Road network class
  */
@@ -38,29 +67,60 @@ class Network {
   /**
    * Box of a edge
    */
-  typedef boost::geometry::model::box<FMM::CORE::Point> boost_box;
-  /**
-   * Item stored in a node of Rtree
-   */
-  typedef std::pair<boost_box, Edge *> Item;
-  /**
-   * Rtree of road edges
-   */
-  typedef boost::geometry::index::rtree<
-      Item, boost::geometry::index::quadratic<16> > Rtree;
+  typedef BoostBox boost_box;
   /**
    *  Constructor of Network
    *
-   *  @param filename: the path to a network file in ESRI shapefile format
+   *  @param filename: the path to a network file in ESRI shapefile format,
+   *  or to an OpenStreetMap PBF file (.pbf) whose highways are split into
+   *  edges at the intersections, in which case the fields are not read
    *  @param id_name: the name of the id field
    *  @param source_name: the name of the source field
    *  @param target_name: the name of the target field
+   *  @param use_cache: if true, the network is read from the cache file
+   *  next to the network file when it is valid, otherwise the cache file
+   *  is written after reading the network file
+   *  @param index_options: options of the spatial index of edges
+   *  @param reorder: if true, the nodes are renumbered along a Hilbert
+   *  curve and the edges are grouped by source node, so that nodes and
+   *  edges close in space are close in memory. A UBODT must be generated
+   *  with the same option as it stores node indices.
+   *  @param project: if true, the network in longitude and latitude is
+   *  projected into metres with a local projection around the center of
+   *  its extent. The trajectories are projected by the matchers and the
+   *  geometries of the results are projected back. A UBODT must be
+   *  generated with the same option as it stores distances.
+   *  @param clip: region of the network read, whose spatial filter is
+   *  passed to GDAL, so that the edges out of the region are not read.
+   *  The nodes are numbered among the edges read, and the cache file is
+   *  not used. A UBODT generated on another network can be translated
+   *  with UBODT::clip_to_network.
+   *  @param compress_geometry: if true, the edge geometries are kept delta
+   *  and varint encoded once the network is read, and decoded on demand
+   *  by each thread into a small cache of the hot edges.
+   *  @param cost_names: names of the numeric fields read as the costs of
+   *  the edges under extra metrics, such as a travel time, in addition to
+   *  their length. The cache file is not used if any is read.
    *
    */
   Network(const std::string &filename,
           const std::string &id_name = "id",
           const std::string &source_name = "source",
-          const std::string &target_name = "target");   // Network constructor
+          const std::string &target_name = "target",
+          bool use_cache = false,
+          const SpatialIndexOptions &index_options = SpatialIndexOptions(),
+          bool reorder = false,
+          bool project = false,
+          const NetworkClip &clip = NetworkClip(),
+          bool compress_geometry = false,
+          const std::vector<std::string> &cost_names = {});
+  // Network constructor
+  /**
+   * Get the name of the cache file of a network file
+   * @param filename network file name
+   * @return cache file name
+   */
+  static std::string get_cache_file(const std::string &filename);
   /**
    * Get number of nodes in the network
    * @return number of nodes
@@ -71,11 +131,60 @@ class Network {
    * @return number of edges
    */
   int get_edge_count() const;
+  /**
+   * Get the names of the extra cost fields read, where the cost named
+   * i is the one of metric i+1, metric 0 being the length
+   */
+  const std::vector<std::string> &get_cost_names() const;
+  /**
+   * Get the metric of a cost field read
+   * @param name name of the cost field, empty or length for the length
+   * @return index of the metric, 0 for the length and -1 if the cost is
+   * not read
+   */
+  int get_metric_index(const std::string &name) const;
+  /**
+   * Get the cost of an edge under a metric
+   * @param metric index of the metric, 0 for the length
+   * @param index  index of edge
+   * @return cost of the edge
+   */
+  inline double get_edge_cost(int metric, EdgeIndex index) const {
+    if (metric == 0) return edges[index].length;
+    return edge_costs[(size_t) index * cost_names.size() + metric - 1];
+  };
+  /**
+   * Get the local projection of the network, which is not enabled if the
+   * network is not projected
+   */
+  const LocalProjection &get_projection() const;
+  /**
+   * Query the edges which may intersect a box with the spatial index
+   * @param box   query box, in the coordinates of the network
+   * @param edges updated with the indices of the edges found
+   */
+  void query_edges(const BoostBox &box, std::vector<EdgeIndex> *edges) const;
   /**
    * Get edges in the network
    * @return a constant reference to the edges
    */
   const std::vector<Edge> &get_edges() const;
+  /**
+   * Add the memory of the edges, the geometry stores, the id maps and
+   * the spatial index to a report
+   * @param report memory report updated
+   */
+  void get_memory_usage(UTIL::MemoryReport *report) const;
+  /**
+   * Get the twin of an edge, going between the same nodes in the other
+   * direction along the reversed geometry, if the twin edges are paired
+   * by the index options
+   * @param index index of edge
+   * @return index of the twin, or NO_TWIN
+   */
+  inline EdgeIndex get_edge_twin(EdgeIndex index) const {
+    return edge_twins.empty() ? NO_TWIN : edge_twins[index];
+  };
   /**
    * Get edge ID from index
    * @param index index of edge
@@ -134,12 +243,90 @@ class Network {
   FMM::MM::Traj_Candidates search_tr_cs_knn(const FMM::CORE::LineString &geom,
                                             std::size_t k,
                                             double radius) const;
+  /**
+   * Search for k nearest neighboring (KNN) candidates of a
+   * linestring within a search radius, reusing the buffers of a context
+   *
+   * @param geom
+   * @param k number of candidates
+   * @param radius search radius
+   * @param context updated to store the candidates of each point, which
+   * is emptied if a point has no candidate
+   * @param corridor sorted edges the candidates are restricted to, or
+   * nullptr for all the edges
+   * @param mask    edges allowed to the candidates, such as the mask of
+   * the graph matched on, or nullptr for all the edges
+   * @return true if every point has a candidate
+   */
+  bool search_tr_cs_knn(const FMM::CORE::LineString &geom, std::size_t k,
+                        double radius,
+                        CandidateSearchContext *context,
+                        const std::vector<EdgeIndex> *corridor = nullptr,
+                        const EdgeMask *mask = nullptr) const;
+  /**
+   * Get the edges whose boxes are within a buffer of the boxes of the
+   * edges of a path, which is the corridor searched by the fine pass of
+   * a coarse to fine matching
+   * @param path     edges of the path
+   * @param buffer   distance added around the boxes of the path
+   * @param corridor updated with the edges found, sorted
+   */
+  void get_corridor_edges(const std::vector<EdgeIndex> &path, double buffer,
+                          std::vector<EdgeIndex> *corridor) const;
+  /**
+   * Get the counters of the adaptive radius of the candidate searches
+   */
+  CandidateSearchStatistics get_search_statistics() const;
+  /**
+   * Log the counters of the adaptive radius and the hit rate of the
+   * snapping cache, if they are enabled
+   */
+  void print_search_statistics() const;
+  /**
+   * Get the snapping cache of the candidate searches
+   * @return the cache, or nullptr if the snap resolution is 0
+   */
+  inline const SnapCache *get_snap_cache() const {
+    return snap_cache.get();
+  };
   /**
    * Get edge geometry
    * @param edge_id edge id
-   * @return Geometry of edge
+   * @return Geometry of edge, which is copied from the packed store into
+   * a buffer of the calling thread valid until the next call
    */
   const FMM::CORE::LineString &get_edge_geom(EdgeID edge_id) const;
+  /**
+   * Get a view of an edge geometry in the packed geometry store, where
+   * the points of all the edges are stored contiguously with their
+   * cumulative lengths
+   * @param index index of edge
+   * @return view of the geometry, valid as long as the network, or at
+   * least until the next call on the thread if the geometries are
+   * compressed
+   */
+  inline FMM::CORE::LineStringView get_edge_view(EdgeIndex index) const {
+    long long first = geom_offsets[index];
+    if (!geometry_codes.empty()) {
+      return geometry_codes.decode(index, geom_offsets[index + 1] - first,
+                                   vertex_points[edges[index].source]);
+    }
+    return FMM::CORE::LineStringView(geom_x.data() + first,
+                                     geom_y.data() + first,
+                                     geom_offsets[index + 1] - first,
+                                     geom_cumlen.data() + first);
+  };
+  /**
+   * Get the direction of an edge at an offset, which is the one of the
+   * segment containing the offset
+   * @param index  index of edge
+   * @param offset length from the start of the edge
+   * @param dx     updated with the x component of the unit direction
+   * @param dy     updated with the y component of the unit direction
+   * @return false if the edge has no segment of positive length
+   */
+  bool get_edge_direction(EdgeIndex index, double offset,
+                          double *dx, double *dy) const;
   /**
    * Extract the geometry of a complete path, whose two end segment will be
    * clipped according to the input trajectory
@@ -149,6 +336,27 @@ class Network {
   FMM::CORE::LineString complete_path_to_geometry(
       const FMM::CORE::LineString &traj,
       const MM::C_Path &complete_path) const;
+  /**
+   * Extract the geometry of a complete path stored with edge index, whose
+   * size is computed first so that the points are copied into a single
+   * allocation
+   * @param traj input trajectory
+   * @param complete_path complete path stored with edge index
+   */
+  FMM::CORE::LineString complete_path_to_geometry(
+      const FMM::CORE::LineString &traj,
+      const std::vector<EdgeIndex> &complete_path) const;
+  /**
+   * Extract the geometry of a complete path stored with edge index, whose
+   * two end segments are clipped at the offsets of the first and last
+   * points matched
+   * @param complete_path complete path stored with edge index
+   * @param first_offset  offset of the start on the first edge
+   * @param last_offset   offset of the end on the last edge
+   */
+  FMM::CORE::LineString complete_path_to_geometry(
+      const std::vector<EdgeIndex> &complete_path, double first_offset,
+      double last_offset) const;
   /**
    * Get all node geometry
    * @return a vector of points
@@ -160,6 +368,26 @@ class Network {
    * @return geometry of node
    */
   const FMM::CORE::Point &get_vertex_point(NodeIndex u) const;
+  /**
+   * Snap a point to its nearest node with the node rtree
+   * @param p point to be snapped
+   * @param radius search radius, negative for no limit
+   * @param node updated with the index of the nearest node
+   * @param dist updated with the distance to the node if not nullptr
+   * @return true if a node is found within the radius
+   */
+  bool snap_to_node(const FMM::CORE::Point &p, double radius,
+                    NodeIndex *node, double *dist = nullptr) const;
+  /**
+   * Snap points to their nearest nodes
+   * @param coords x and y of the points, interleaved
+   * @param num_points number of points
+   * @param radius search radius, negative for no limit
+   * @return the index of the nearest node of each point, -1 if no node is
+   * found within the radius
+   */
+  std::vector<int> snap_nodes(const double *coords, int num_points,
+                              double radius) const;
   /**
    * Extract the geometry of a route in the network
    * @param path a route stored with edge ID
@@ -180,30 +408,254 @@ class Network {
    * @return true if a.dist<b.dist
    */
   static bool candidate_compare(const MM::Candidate &a, const MM::Candidate &b);
+  /**
+   * Parse the name of an rtree algorithm
+   * @param name packing, linear, quadratic or rstar
+   * @param algorithm updated with the algorithm of the name
+   * @return true if the name is valid
+   */
+  static bool string2rtree_algorithm(const std::string &name,
+                                     RtreeAlgorithm *algorithm);
+  /**
+   * Parse the name of a spatial index type
+   * @param name rtree, flat or grid
+   * @param type updated with the type of the name
+   * @return true if the name is valid
+   */
+  static bool string2spatial_index_type(const std::string &name,
+                                        SpatialIndexType *type);
+  /**
+   * Check if only a region of the network file is read
+   */
+  bool is_clipped() const;
+  static const unsigned int CACHE_VERSION = 5; /**< Version of the
+      network cache file */
+  static const EdgeIndex NO_TWIN = 0xFFFFFFFF; /**< Twin of an edge
+      without twin */
  private:
   /**
-   * Concatenate a linestring segs to a linestring line, used in the
-   * function complete_path_to_geometry
-   *
-   * @param line: linestring which will be updated
-   * @param segs: segs that will be appended to line
-   * @param offset: the number of points skipped in segs.
+   * Read the edges and nodes from a network file with GDAL
+   */
+  void read_network_file(const std::string &filename,
+                         const std::string &id_name,
+                         const std::string &source_name,
+                         const std::string &target_name);
+  /**
+   * Read the edges and nodes from the highways of an OSM PBF file, in
+   * longitude and latitude
+   */
+  void read_osm_file(const std::string &filename);
+  /**
+   * Add an edge read, whose nodes are indexed by index_edge_nodes
+   * @param endpoints ids of the source and target of each edge read,
+   * updated
+   */
+  void add_edge(EdgeID id, NodeID source, NodeID target,
+                CORE::LineString geom, std::vector<NodeID> *endpoints);
+  /**
+   * Index the nodes of the edges read in the order they are first read,
+   * by a parallel sort of the ids of the endpoints, and set the nodes
+   * and the lengths of the edges
+   * @param endpoints ids of the source and target of each edge read
+   */
+  void index_edge_nodes(const std::vector<NodeID> &endpoints);
+  /**
+   * Read the network and the boxes of the rtree from a cache file, which
+   * is rejected if it is written from another version of the network
+   * file, with other field names or is corrupted. A flat rtree of the
+   * same options in the cache file is mapped instead of being built.
+   * @return true if success
+   */
+  bool read_network_cache(const std::string &filename,
+                          const std::string &id_name,
+                          const std::string &source_name,
+                          const std::string &target_name);
+  /**
+   * Write the network and the boxes of the rtree to a cache file, with
+   * the flat rtree if it is the spatial index
+   * @return true if success
+   */
+  bool write_network_cache(const std::string &filename,
+                           const std::string &id_name,
+                           const std::string &source_name,
+                           const std::string &target_name) const;
+  /**
+   * Renumber the nodes in the order of their Hilbert curve index and
+   * sort the edges by source node
+   */
+  void reorder_by_hilbert_curve();
+  /**
+   * Project the edges and nodes read in longitude and latitude into
+   * metres around the center of the network extent
+   */
+  void project_network();
+  /**
+   * Build the maps of node and edge ids
+   */
+  void build_id_maps();
+  /**
+   * Copy the edge geometries into the packed geometry store
+   */
+  void build_geometry_store();
+  /**
+   * Compute the cumulative lengths and the bounding boxes of the segments
+   * of the packed geometry store
+   */
+  void build_segment_store();
+  /**
+   * Encode the packed geometry store, and release the store and the
+   * geometries of the edges
+   */
+  void compress_geometry_store();
+  /**
+   * Check if a segment of an edge may be within a radius of a point,
+   * according to the bounding boxes of the segments
+   * @param index index of edge
+   * @param px x coordinate of the point
+   * @param py y coordinate of the point
+   * @param radius search radius
+   * @return false if all the segments are farther than the radius
+   */
+  bool is_edge_near(EdgeIndex index, double px, double py,
+                    double radius) const;
+  /**
+   * Check if a segment from point first to last of the store may be
+   * within a radius of a point, as is_edge_near
+   */
+  bool is_range_near(long long first, long long last, double px,
+                     double py, double radius) const;
+  /**
+   * Project a point on an item of the spatial index, which is an edge or
+   * a chunk of an edge
+   * @param  item      index of the item
+   * @param  px        x coordinate of the point
+   * @param  py        y coordinate of the point
+   * @param  radius    search radius
+   * @param  candidate updated with the projection on the edge
+   * @return false if the item is farther than the radius
+   */
+  bool project_item(EdgeIndex item, double px, double py, double radius,
+                    MM::Candidate *candidate) const;
+  /**
+   * Project a point on items of the spatial index, where the chunks of an
+   * edge are adjacent and merged into its closest candidate
+   * @param items    items of the spatial index
+   * @param pcs      candidates of the items within the radius appended
+   * @param corridor sorted edges the candidates are restricted to, or
+   * nullptr for all the edges
+   * @param mask     edges allowed to the candidates, or nullptr for all
+   */
+  void project_items(const std::vector<EdgeIndex> &items, double px,
+                     double py, double radius,
+                     MM::Point_Candidates *pcs,
+                     const std::vector<EdgeIndex> *corridor = nullptr,
+                     const EdgeMask *mask = nullptr) const;
+  /**
+   * Search the k nearest candidates of a point with the incremental
+   * nearest query of the spatial index
+   * @param pcs updated with at most k candidates sorted by distance
+   */
+  void search_nearest(double px, double py, std::size_t k, double radius,
+                      MM::Point_Candidates *pcs) const;
+  /**
+   * Split the edges into chunks of the chunk segments of the index
+   * options, whose boxes are indexed instead of the edge boxes. The
+   * second edges of the twins have no chunk, and the edges are not split
+   * if the chunk segments are 0.
+   * @param boxes updated with the boxes of the chunks
+   */
+  void build_edge_chunks(std::vector<boost_box> *boxes);
+  /**
+   * Pair the edges whose geometries are the reverse of each other
+   * between the same nodes, and release the geometry of the second edge
+   * of each pair
+   */
+  void find_edge_twins();
+  /**
+   * Check if an edge may be a candidate in a corridor and a mask
+   */
+  bool is_edge_allowed(EdgeIndex e, const std::vector<EdgeIndex> *corridor,
+                       const EdgeMask *mask) const;
+  /**
+   * Get the candidate of the twin of the edge of a candidate, at the
+   * same point
+   */
+  MM::Candidate get_twin_candidate(const MM::Candidate &c) const;
+  /**
+   * Add the candidates of the twins of the candidates from begin, which
+   * are projected on the first edges of the twins, and remove the ones
+   * not allowed
    */
-  static void append_segs_to_line(FMM::CORE::LineString *line,
-                                  const FMM::CORE::LineString &segs,
-                                  int offset = 0);
+  void add_twin_candidates(std::size_t begin, MM::Point_Candidates *pcs,
+                           const std::vector<EdgeIndex> *corridor,
+                           const EdgeMask *mask) const;
   /**
-   * Build rtree for the network
+   * Build the spatial index of the edges with the index options
+   * @param boxes bounding boxes of the edges, computed from the edge
+   * geometries if empty
+   * @param flat_rtree flat rtree mapped from the cache file, used instead
+   * of building the flat rtree if not nullptr
    */
-  void build_rtree_index();
+  void build_spatial_index(
+      const std::vector<boost_box> &boxes = {},
+      std::unique_ptr<FlatRtreeIndex> flat_rtree = nullptr);
   int srid;   // Spatial reference id
-  Rtree rtree;   // Network rtree structure
+  SpatialIndexOptions index_options;
+  bool reordered = false; // Whether renumbered along the Hilbert curve
+  bool projected = false; // Whether projected into metres
+  NetworkClip clip; // Region read from the network file
+  LocalProjection projection;
+  // Spatial index of the edges used in candidate search
+  std::unique_ptr<SpatialIndex> spatial_index;
+  // Rtree of the vertices used to snap points to nodes
+  NodeTree node_tree;
   std::vector<Edge> edges;   // all edges in the network
+  std::vector<std::string> cost_names; // extra cost fields read
+  // Cost k of edge i at edge_costs[i * cost_names.size() + k]
+  std::vector<double> edge_costs;
   NodeIDVec node_id_vec;
   unsigned int num_vertices;
   NodeIndexMap node_map;
   EdgeIndexMap edge_map;
   std::vector<FMM::CORE::Point> vertex_points;
+  // Packed geometry store, where the points of edge i are from
+  // geom_offsets[i] to geom_offsets[i+1]
+  std::vector<double> geom_x;
+  std::vector<double> geom_y;
+  std::vector<long long> geom_offsets;
+  // Length from the start of its edge to each point of the store
+  std::vector<double> geom_cumlen;
+  // Encoded packed store, which replaces geom_x, geom_y and geom_cumlen
+  // if the geometries are compressed
+  CompressedGeometry geometry_codes;
+  // Bounding box of the segment from point j to j+1 of the store, where
+  // the last point of an edge has no segment. In single precision, the
+  // boxes are rounded outwards.
+  std::vector<BoxCoord> seg_min_x;
+  std::vector<BoxCoord> seg_min_y;
+  std::vector<BoxCoord> seg_max_x;
+  std::vector<BoxCoord> seg_max_y;
+  // Bounding box x1,y1,x2,y2 of edge i from edge_box_coords[4*i]
+  std::vector<double> edge_box_coords;
+  // Chunks of the edges indexed by the rtree if chunk_segments > 0 or the
+  // twins are paired, where chunk c covers edge chunk_edges[c] from point
+  // chunk_first[c] to chunk_last[c] of the store, and the chunks of an
+  // edge are consecutive. Its box is in chunk_box_coords as edge_box_coords.
+  std::vector<EdgeIndex> chunk_edges;
+  std::vector<long long> chunk_first;
+  std::vector<long long> chunk_last;
+  std::vector<double> chunk_box_coords;
+  // Twin of each edge if the twin edges are paired, where the second edge
+  // of a pair, of the larger index, is not indexed and its Edge has no
+  // geometry
+  std::vector<EdgeIndex> edge_twins;
+  // Edges near the quantized locations of the points searched
+  std::unique_ptr<SnapCache> snap_cache;
+  // Counters of the adaptive radius, added once per trajectory
+  mutable std::atomic<long long> search_points{0};
+  mutable std::atomic<long long> search_expanded_points{0};
+  mutable std::atomic<long long> search_expansions{0};
+  mutable std::atomic<long long> search_full_radius_points{0};
 }; // Network
 } // NETWORK
 } // FMM
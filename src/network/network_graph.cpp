@@ -1,11 +1,15 @@
 #include "network/network_graph.hpp"
 #include "network/heap.hpp"
+#include "network/landmarks.hpp"
 #include "network/network.hpp"
 #include "util/debug.hpp"
+#include "util/parallel.hpp"
 
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <algorithm>
+#include <omp.h>
 #include <unordered_map>
 #include <queue>
 
@@ -15,85 +19,158 @@ using namespace FMM::NETWORK;
 NetworkGraph::NetworkGraph(const Network &network_arg) : network(network_arg) {
   const std::vector<Edge> &edges = network.get_edges();
   SPDLOG_INFO("Construct graph from network edges start");
-  EdgeDescriptor e;
-  bool inserted;
-  g = Graph_T();
-  int N = edges.size();
-  for (int i = 0; i < N; ++i) {
+  long long num_edges = edges.size();
+  std::vector<EdgeProperty> properties(num_edges);
+  unsigned int vertices = 0;
+  #pragma omp parallel for reduction(max:vertices) \
+      if(num_edges >= UTIL::PARALLEL_MIN_SIZE)
+  for (long long i = 0; i < num_edges; ++i) {
     const Edge &edge = edges[i];
-    boost::tie(e, inserted) = boost::add_edge(edge.source, edge.target, g);
-    // id is the FID read, id_attr is the external property in SHP
-    g[e].index = edge.index;
-    g[e].length = edge.length;
+    properties[i] = {edge.source, edge.target, edge.index, edge.length};
+    vertices = std::max(vertices, std::max(edge.source, edge.target) + 1);
   }
-  num_vertices = boost::num_vertices(g);
-  SPDLOG_INFO("Graph nodes {} edges {}", num_vertices, boost::num_edges(g));
+  num_vertices = vertices;
+  g = CSRGraph(num_vertices, properties);
+  SPDLOG_INFO("Graph nodes {} edges {}", num_vertices, g.get_num_edges());
   SPDLOG_INFO("Construct graph from network edges end");
 }
 
+NetworkGraph::NetworkGraph(const Network &network_arg,
+                           const std::vector<EdgeProperty> &arcs)
+    : network(network_arg) {
+  num_vertices = network.get_node_count();
+  for (const EdgeProperty &arc : arcs) {
+    num_vertices = std::max(num_vertices,
+                            std::max(arc.source, arc.target) + 1);
+  }
+  g = CSRGraph(num_vertices, arcs);
+  SPDLOG_INFO("Graph nodes {} arcs {}", num_vertices, g.get_num_edges());
+}
+
+NetworkGraph::NetworkGraph(const Network &network_arg,
+                           std::shared_ptr<const EdgeMask> mask)
+    : network(network_arg), mask_(mask) {
+  const std::vector<Edge> &edges = network.get_edges();
+  std::vector<EdgeProperty> properties;
+  properties.reserve(mask_ == nullptr ? edges.size() :
+                     mask_->get_num_allowed());
+  for (const Edge &edge : edges) {
+    num_vertices = std::max(num_vertices,
+                            std::max(edge.source, edge.target) + 1);
+    if (mask_ != nullptr && !mask_->is_allowed(edge.index)) continue;
+    properties.push_back({edge.source, edge.target, edge.index, edge.length});
+  }
+  g = CSRGraph(num_vertices, properties);
+  SPDLOG_INFO("Graph nodes {} edges {} of {}", num_vertices,
+              g.get_num_edges(), edges.size());
+}
+
 void NetworkGraph::print_graph() const {
-  boost::graph_traits<Graph_T>::edge_iterator it, end;
-  for (boost::tie(it, end) = boost::edges(g); it != end; ++it)
-    std::cout << " index " << g[*it].index << " edge " <<
-              network.get_edge_id(g[*it].index) << " "
-              << network.get_node_id(boost::source(*it, g)) << " -> "
-              << network.get_node_id(boost::target(*it, g)) << '\n';
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    for (unsigned int i = g.begin(u); i < g.end(u); ++i) {
+      std::cout << " index " << g.get_index(i) << " edge " <<
+                network.get_edge_id(g.get_index(i)) << " "
+                << network.get_node_id(u) << " -> "
+                << network.get_node_id(g.get_target(i)) << '\n';
+    }
+  }
 }
 
-const Graph_T &NetworkGraph::get_boost_graph() const {
+const CSRGraph &NetworkGraph::get_graph() const {
   return g;
 }
 
-const Network &NetworkGraph::get_network() {
+CSRGraph NetworkGraph::get_reverse_graph() const {
+  std::vector<EdgeProperty> properties;
+  properties.reserve(g.get_num_edges());
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    for (unsigned int i = g.begin(u); i < g.end(u); ++i) {
+      properties.push_back({u, g.get_target(i), g.get_index(i),
+                            g.get_length(i)});
+    }
+  }
+  return CSRGraph(num_vertices, properties, true);
+}
+
+const Network &NetworkGraph::get_network() const {
   return network;
 }
 unsigned int NetworkGraph::get_num_vertices() const {
   return num_vertices;
 }
 
+void NetworkGraph::get_memory_usage(UTIL::MemoryReport *report) const {
+  report->add("graph", "arcs", g.get_memory_bytes());
+  if (landmarks_ != nullptr) {
+    report->add("graph", "landmarks", landmarks_->get_memory_bytes());
+  }
+  if (mask_ != nullptr) {
+    report->add("graph", "edge mask", mask_->get_memory_bytes());
+  }
+}
+
+size_t NetworkGraph::get_workspace_bytes() const {
+  return SearchWorkspace::get_node_bytes() * num_vertices;
+}
+
 std::vector<EdgeIndex> NetworkGraph::shortest_path_dijkstra(
     NodeIndex source, NodeIndex target) const {
   SPDLOG_TRACE("Shortest path starts");
   if (source == target) return {};
-  Heap Q;
-  PredecessorMap pmap;
-  DistanceMap dmap;
+  SearchWorkspace &ws = SearchWorkspace::local();
+  ws.reset(num_vertices);
   // Initialization
-  Q.push(source, 0);
-  pmap.insert({source, source});
-  dmap.insert({source, 0});
-  OutEdgeIterator out_i, out_end;
+  ws.set(source, 0, source);
+  ws.push(source, 0);
   double temp_dist = 0;
   // Dijkstra search
-  while (!Q.empty()) {
-    HeapNode node = Q.top();
-    Q.pop();
+  while (!ws.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
     NodeIndex u = node.index;
     if (u == target) break;
-    for (boost::tie(out_i, out_end) = boost::out_edges(u, g);
-         out_i != out_end; ++out_i) {
-      EdgeDescriptor e = *out_i;
-      NodeIndex v = boost::target(e, g);
-      temp_dist = node.value + g[e].length;
-      auto iter = dmap.find(v);
-      if (iter != dmap.end()) {
-        // dmap contains node v
-        if (iter->second > temp_dist) {
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      temp_dist = node.value + g.get_length(e);
+      if (ws.visited(v)) {
+        // v is visited
+        if (ws.get_distance(v) > temp_dist) {
           // a smaller distance is found for v
-          pmap[v] = u;
-          dmap[v] = temp_dist;
-          Q.decrease_key(v, temp_dist);
+          ws.set(v, temp_dist, u);
+          ws.decrease_key(v, temp_dist);
+        } else {
+          continue;
         }
       } else {
-        // dmap does not contain v
-        Q.push(v, temp_dist);
-        pmap.insert({v, u});
-        dmap.insert({v, temp_dist});
+        // v is not visited
+        ws.set(v, temp_dist, u);
+        ws.push(v, temp_dist);
       }
+      set_relaxed_edge(source, u, v, g.get_index(e), &ws);
     }
   }
   // Backtrack from target to source
-  return back_track(source, target, pmap, dmap);
+  return back_track(source, target, ws);
+}
+
+PYTHON::PyPathArrays NetworkGraph::shortest_paths(
+    const unsigned int *sources, int num_sources,
+    const unsigned int *targets, int num_targets, int num_threads) const {
+  PYTHON::check_od_pairs(sources, num_sources, targets, num_targets,
+                         num_vertices);
+  const std::vector<Edge> &edges = network.get_edges();
+  std::vector<double> distances(num_sources);
+  std::vector<std::vector<EdgeIndex>> paths(num_sources);
+  if (num_threads <= 0) num_threads = omp_get_max_threads();
+  #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+  for (int i = 0; i < num_sources; ++i) {
+    paths[i] = shortest_path_dijkstra(sources[i], targets[i]);
+    double distance = 0;
+    for (EdgeIndex e : paths[i]) distance += edges[e].length;
+    distances[i] = (paths[i].empty() && sources[i] != targets[i]) ?
+        std::numeric_limits<double>::infinity() : distance;
+  }
+  return PYTHON::to_py_paths(std::move(distances), paths);
 }
 
 double NetworkGraph::calc_heuristic_dist(
@@ -102,82 +179,99 @@ double NetworkGraph::calc_heuristic_dist(
       (p2.get<1>() - p1.get<1>()) * (p2.get<1>() - p1.get<1>()));
 }
 
+void NetworkGraph::set_landmarks(const Landmarks *landmarks) {
+  landmarks_ = landmarks;
+}
+
 std::vector<EdgeIndex> NetworkGraph::shortest_path_astar(
     NodeIndex source, NodeIndex target) const {
   SPDLOG_TRACE("Shortest path astar starts");
   if (source == target) return {};
   const std::vector<Point> &vertex_points =
       network.get_vertex_points();
-  Heap Q;
-  PredecessorMap pmap;
-  DistanceMap dmap;
+  SearchWorkspace &ws = SearchWorkspace::local();
+  ws.reset(num_vertices);
   // Initialization
   double h = calc_heuristic_dist(vertex_points[source],
                                  vertex_points[target]);
-  Q.push(source, h);
-  pmap.insert({source, source});
-  dmap.insert({source, 0});
-  OutEdgeIterator out_i, out_end;
+  if (landmarks_ != nullptr) {
+    h = std::max(h, landmarks_->lower_bound(source, target));
+  }
+  ws.set(source, 0, source);
+  ws.push(source, h);
   double temp_dist = 0;
   // Dijkstra search
-  while (!Q.empty()) {
-    HeapNode node = Q.top();
-    Q.pop();
+  while (!ws.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
     NodeIndex u = node.index;
     if (u == target) break;
-    for (boost::tie(out_i, out_end) = boost::out_edges(u, g);
-         out_i != out_end; ++out_i) {
-      EdgeDescriptor e = *out_i;
-      NodeIndex v = boost::target(e, g);
-      temp_dist = dmap.at(u) + g[e].length;
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      temp_dist = ws.get_distance(u) + g.get_length(e);
       h = calc_heuristic_dist(vertex_points[v], vertex_points[target]);
-      auto iter = dmap.find(v);
-      if (iter != dmap.end()) {
-        // dmap contains node v
-        if (iter->second > temp_dist) {
-          // a smaller distance is found for v
-          pmap[v] = u;
-          dmap[v] = temp_dist;
-          // Unsure if v is still in Q or not
-          if (Q.contain_node(v)) {
-            Q.decrease_key(v, temp_dist + h);
-          } else {
-            Q.push(v, temp_dist + h);
-          }
+      if (landmarks_ != nullptr) {
+        h = std::max(h, landmarks_->lower_bound(v, target));
+      }
+      if (ws.visited(v)) {
+        // v is visited
+        if (ws.get_distance(v) > temp_dist) {
+          // a smaller distance is found for v, which is inserted again
+          // if it is not in the queue
+          ws.set(v, temp_dist, u);
+          ws.decrease_key(v, temp_dist + h);
+        } else {
+          continue;
         }
       } else {
-        // dmap does not contain v
-        Q.push(v, temp_dist + h);
-        pmap.insert({v, u});
-        dmap.insert({v, temp_dist});
+        // v is not visited
+        ws.set(v, temp_dist, u);
+        ws.push(v, temp_dist + h);
       }
+      set_relaxed_edge(source, u, v, g.get_index(e), &ws);
     }
   }
   // Backtrack from target to source
-  return back_track(source, target, pmap, dmap);
+  return back_track(source, target, ws);
 }
 
 std::vector<EdgeIndex> NetworkGraph::back_track(
     NodeIndex source, NodeIndex target, const PredecessorMap &pmap,
-    const DistanceMap &dmap) const {
+    const PathEndMap &emap) const {
+  SPDLOG_TRACE("Backtrack starts");
+  if (target != source && emap.find(target) == emap.end()) return {};
+  std::vector<EdgeIndex> path;
+  NodeIndex v = target;
+  while (v != source) {
+    path.push_back(emap.at(v).last_e);
+    v = pmap.at(v);
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+std::vector<EdgeIndex> NetworkGraph::back_track(
+    NodeIndex source, NodeIndex target, const SearchWorkspace &ws) const {
   SPDLOG_TRACE("Backtrack starts");
-  if (dmap.find(target) == dmap.end()) {
-    return {};
+  if (!ws.visited(target)) return {};
+  std::vector<EdgeIndex> path;
+  NodeIndex v = target;
+  while (v != source) {
+    path.push_back(ws.get_ends(v).last_e);
+    v = ws.get_predecessor(v);
+  }
+  std::reverse(path.begin(), path.end());
+  return path;
+}
+
+void NetworkGraph::set_relaxed_edge(NodeIndex source, NodeIndex u,
+                                    NodeIndex v, EdgeIndex e,
+                                    SearchWorkspace *ws) {
+  if (u == source) {
+    ws->set_ends(v, PathEnds{v, e, e});
   } else {
-    std::vector<EdgeIndex> path;
-    NodeIndex v = target;
-    NodeIndex u = pmap.at(v);
-    while (v != source) {
-      double cost = dmap.at(v) - dmap.at(u);
-      SPDLOG_TRACE("u {} d {} v {} d {} cost {}",
-                   get_node_id(u), dmap.at(u),
-                   get_node_id(v), dmap.at(v), cost);
-      path.push_back(get_edge_index(u, v, cost));
-      v = u;
-      u = pmap.at(v);
-    }
-    std::reverse(path.begin(), path.end());
-    return path;
+    const PathEnds &u_ends = ws->get_ends(u);
+    ws->set_ends(v, PathEnds{u_ends.first_n, u_ends.first_e, e});
   }
 }
 
@@ -189,62 +283,123 @@ int NetworkGraph::get_edge_index(NodeIndex source, NodeIndex target,
                                  double cost) const {
   SPDLOG_TRACE("Find edge from {} to {} cost {}", source, target, cost);
   if (source >= num_vertices || target >= num_vertices) return -1;
-  EdgeDescriptor e;
-  OutEdgeIterator out_i, out_end;
-  for (boost::tie(out_i, out_end) = boost::out_edges(source, g);
-       out_i != out_end; ++out_i) {
-    e = *out_i;
+  for (unsigned int e = g.begin(source); e < g.end(source); ++e) {
     SPDLOG_TRACE("  Check Edge from {} to {} cost {}",
-                 source, boost::target(e, g), g[e].length);
-    if (target == boost::target(e, g) &&
-        (std::abs(g[e].length - cost) <= DOUBLE_MIN)) {
+                 source, g.get_target(e), g.get_length(e));
+    if (target == g.get_target(e) &&
+        (std::abs(g.get_length(e) - cost) <= DOUBLE_MIN)) {
       SPDLOG_TRACE("  Found edge idx {} id {}",
-                   g[e].index, get_edge_id(g[e].index));
-      return g[e].index;
+                   g.get_index(e), get_edge_id(g.get_index(e)));
+      return g.get_index(e);
     }
   }
   SPDLOG_ERROR("Edge not found");
   return -1;
 }
+
+int NetworkGraph::get_shortest_edge_index(NodeIndex source,
+                                          NodeIndex target) const {
+  if (source >= num_vertices || target >= num_vertices) return -1;
+  int index = -1;
+  double length = std::numeric_limits<double>::max();
+  for (unsigned int e = g.begin(source); e < g.end(source); ++e) {
+    if (g.get_target(e) == target && g.get_length(e) < length) {
+      index = g.get_index(e);
+      length = g.get_length(e);
+    }
+  }
+  return index;
+}
+
+bool NetworkGraph::is_symmetric() const {
+  // Length of the shortest edge between two nodes, negative if none
+  auto shortest_length = [this](NodeIndex source, NodeIndex target) {
+    double length = -1;
+    for (unsigned int e = g.begin(source); e < g.end(source); ++e) {
+      if (g.get_target(e) == target &&
+          (length < 0 || g.get_length(e) < length)) {
+        length = g.get_length(e);
+      }
+    }
+    return length;
+  };
+  for (NodeIndex u = 0; u < num_vertices; ++u) {
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      double backward = shortest_length(v, u);
+      if (backward < 0 ||
+          std::abs(shortest_length(u, v) - backward) > DOUBLE_MIN) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 void NetworkGraph::single_source_upperbound_dijkstra(NodeIndex s,
                                                      double delta,
                                                      PredecessorMap *pmap,
                                                      DistanceMap *dmap) const {
-  Heap Q;
+  single_source_upperbound_dijkstra(s, delta, pmap, dmap, nullptr);
+}
+
+void NetworkGraph::single_source_upperbound_dijkstra(NodeIndex s,
+                                                     double delta,
+                                                     PredecessorMap *pmap,
+                                                     DistanceMap *dmap,
+                                                     PathEndMap *emap) const {
+  SearchWorkspace &ws = SearchWorkspace::local();
+  single_source_upperbound_dijkstra(s, delta, &ws);
+  const std::vector<NodeIndex> &visited = ws.get_visited();
+  pmap->reserve(visited.size());
+  dmap->reserve(visited.size());
+  if (emap != nullptr) emap->reserve(visited.size());
+  for (NodeIndex v : visited) {
+    pmap->insert({v, ws.get_predecessor(v)});
+    dmap->insert({v, ws.get_distance(v)});
+    if (emap != nullptr && v != s) emap->insert({v, ws.get_ends(v)});
+  }
+}
+
+void NetworkGraph::single_source_upperbound_dijkstra(
+    NodeIndex s, double delta, SearchWorkspace *ws) const {
+  ws->reset(num_vertices);
   // Initialization
-  Q.push(s, 0);
-  pmap->insert({s, s});
-  dmap->insert({s, 0});
-  OutEdgeIterator out_i, out_end;
+  ws->set(s, 0, s);
+  ws->push(s, 0);
   double temp_dist = 0;
+  PathEnds u_ends{s, 0, 0};
   // Dijkstra search
-  while (!Q.empty()) {
-    HeapNode node = Q.top();
-    Q.pop();
+  while (!ws->empty()) {
+    HeapNode node = ws->top();
+    ws->pop();
     NodeIndex u = node.index;
     if (node.value > delta) break;
-    for (boost::tie(out_i, out_end) = boost::out_edges(u, g);
-         out_i != out_end; ++out_i) {
-      EdgeDescriptor e = *out_i;
-      NodeIndex v = boost::target(e, g);
-      temp_dist = node.value + g[e].length;
-      auto iter = dmap->find(v);
-      if (iter != dmap->end()) {
-        // dmap contains node v
-        if (iter->second > temp_dist) {
+    if (u != s) u_ends = ws->get_ends(u);
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      temp_dist = node.value + g.get_length(e);
+      if (ws->visited(v)) {
+        // v is visited
+        if (ws->get_distance(v) > temp_dist) {
           // a smaller distance is found for v
-          (*pmap)[v] = u;
-          (*dmap)[v] = temp_dist;
-          Q.decrease_key(v, temp_dist);
-        };
+          ws->set(v, temp_dist, u);
+          ws->decrease_key(v, temp_dist);
+        } else {
+          continue;
+        }
       } else {
-        // dmap does not contain v
+        // v is not visited
         if (temp_dist <= delta) {
-          Q.push(v, temp_dist);
-          pmap->insert({v, u});
-          dmap->insert({v, temp_dist});
+          ws->set(v, temp_dist, u);
+          ws->push(v, temp_dist);
+        } else {
+          continue;
         }
       }
+      // The path to v extends the path to u by edge e
+      ws->set_ends(v, (u == s) ? PathEnds{v, g.get_index(e), g.get_index(e)}
+                               : PathEnds{u_ends.first_n, u_ends.first_e,
+                                          g.get_index(e)});
     }
   }
 }
@@ -22,11 +22,14 @@
 #define FMM_NETWORK_GRAPH_HPP
 
 #include "network/heap.hpp"
+#include "network/search_workspace.hpp"
 #include "network/graph.hpp"
 #include "network/network.hpp"
+#include "python/pyfmm.hpp"
 
 namespace FMM {
 namespace NETWORK {
+class Landmarks;
 /**
  * Graph class of the network
  */
@@ -37,6 +40,25 @@ class NetworkGraph {
    *  @param network_arg network data
    */
   explicit NetworkGraph(const Network &network_arg);
+  /**
+   *  Construct a graph of arcs other than the edges of a network, such
+   *  as the chains of a ChainGraph, where the edge index of a path is
+   *  the index of an arc
+   *  @param network_arg network data
+   *  @param arcs        arcs between the nodes of the network
+   */
+  NetworkGraph(const Network &network_arg,
+               const std::vector<EdgeProperty> &arcs);
+  /**
+   *  Construct a view of a network filtered by an edge mask, which only
+   *  has the arcs of the edges allowed, keeping the node and edge indices
+   *  of the network. The network is shared by the views of all the
+   *  masks, only the arcs are per view.
+   *  @param network_arg network data
+   *  @param mask        edges allowed, nullptr for all the edges
+   */
+  NetworkGraph(const Network &network_arg,
+               std::shared_ptr<const EdgeMask> mask);
   /**
    * Dijkstra Shortest path query from source to target
    * @param source
@@ -45,6 +67,20 @@ class NetworkGraph {
    */
   std::vector<EdgeIndex> shortest_path_dijkstra(
       NodeIndex source, NodeIndex target) const;
+  /**
+   * Dijkstra shortest path queries of od pairs given as contiguous
+   * arrays, which are run in parallel for the NumPy Python API
+   * @param  sources     source node of each pair
+   * @param  num_sources number of sources
+   * @param  targets     target node of each pair
+   * @param  num_targets number of targets, which should be num_sources
+   * @param  num_threads number of threads, 0 for the number of cores
+   * @return the distance and the edges of the path of each pair
+   */
+  PYTHON::PyPathArrays shortest_paths(
+      const unsigned int *sources, int num_sources,
+      const unsigned int *targets, int num_targets,
+      int num_threads = 0) const;
   /**
    * Calculate heuristic distance from p1 to p2,which is used in Astar routing.
    * @param p1
@@ -53,6 +89,19 @@ class NetworkGraph {
    */
   double calc_heuristic_dist(
       const CORE::Point &p1, const CORE::Point &p2) const;
+  /**
+   * Set the landmarks whose lower bounds guide the A* search, together
+   * with the Euclidean distance
+   * @param landmarks landmarks of the graph, or nullptr for the
+   * Euclidean distance only. It should outlive the graph.
+   */
+  void set_landmarks(const Landmarks *landmarks);
+  /**
+   * Get the landmarks set, or nullptr if not set
+   */
+  inline const Landmarks *get_landmarks() const {
+    return landmarks_;
+  };
   /**
    * AStar Shortest path query from source to target
    * @param source
@@ -62,17 +111,18 @@ class NetworkGraph {
   std::vector<EdgeIndex> shortest_path_astar(NodeIndex source,
                                              NodeIndex target) const;
   /**
-   * Backtrack the routing result to find a path from source to target
+   * Backtrack the routing result to find a path from source to target,
+   * with the last edge of each path recorded in the path end map
    * @param source
    * @param target
    * @param pmap predecessor map
-   * @param dmap distance map
+   * @param emap path end map
    * @return a vector of edge index representing the path from source to target
    */
   std::vector<EdgeIndex> back_track(NodeIndex source,
                                     NodeIndex target,
                                     const PredecessorMap &pmap,
-                                    const DistanceMap &dmap) const;
+                                    const PathEndMap &emap) const;
   /**
    * Single source shortest path query with an uppper bound
    * @param source source node queried
@@ -84,12 +134,52 @@ class NetworkGraph {
                                          double delta,
                                          PredecessorMap *pmap,
                                          DistanceMap *dmap) const;
+  /**
+   * Single source shortest path query with an uppper bound, which also
+   * finds the next node and the first and last edges of the path to each
+   * node visited
+   * @param source source node queried
+   * @param delta upper bound to stop early
+   * @param pmap predecessor map updated to store the routing result
+   * @param dmap distance map updated to store the routing result
+   * @param emap path end map updated to store the routing result,
+   * which has no entry of the source
+   */
+  void single_source_upperbound_dijkstra(NodeIndex source,
+                                         double delta,
+                                         PredecessorMap *pmap,
+                                         DistanceMap *dmap,
+                                         PathEndMap *emap) const;
+  /**
+   * Single source shortest path query with an uppper bound, where the
+   * routing result is kept in a workspace instead of hash maps
+   * @param source source node queried
+   * @param delta upper bound to stop early
+   * @param workspace workspace reset to store the distance, predecessor
+   * and path ends of each node visited within delta
+   */
+  void single_source_upperbound_dijkstra(NodeIndex source,
+                                         double delta,
+                                         SearchWorkspace *workspace) const;
   /**
    *  Find the edge ID given a pair of nodes and its cost,
    *  if not found, return -1
    */
   int get_edge_index(NodeIndex source, NodeIndex target,
                      double cost) const;
+  /**
+   * Find the shortest edge from a node to an adjacent node
+   * @param  source source node
+   * @param  target target node
+   * @return the edge index, or -1 if no edge connects the nodes
+   */
+  int get_shortest_edge_index(NodeIndex source, NodeIndex target) const;
+  /**
+   * Check if the shortest edge from each node to each adjacent node has
+   * the length of the shortest edge back, so that a shortest path
+   * reversed is a shortest path
+   */
+  bool is_symmetric() const;
   /**
    * Get the edge ID from edge index
    * @param idx edge index
@@ -138,28 +228,76 @@ class NetworkGraph {
    */
   void print_graph() const;
   /**
-   * Get inner boost graph
+   * Get inner graph storing the out arcs of each node
    * @return graph reference
    */
-  const Graph_T &get_boost_graph() const;
+  const CSRGraph &get_graph() const;
+  /**
+   * Build the reversed graph storing the in arcs of each node
+   * @return reversed graph
+   */
+  CSRGraph get_reverse_graph() const;
   /**
    * Get inner network reference
    * @return reference to the road network
    */
-  const Network &get_network();
+  const Network &get_network() const;
+  /**
+   * Get the edge mask of the graph, which the candidate search of the
+   * models matching on the graph honours
+   * @return the mask, or nullptr if all the edges are allowed
+   */
+  inline const EdgeMask *get_edge_mask() const {
+    return mask_.get();
+  };
   /**
    * Get number of vertices in the graph
    * @return number of vertices
    */
   unsigned int get_num_vertices() const;
+  /**
+   * Add the memory of the graph and of its landmarks to a report
+   * @param report memory report updated
+   */
+  void get_memory_usage(UTIL::MemoryReport *report) const;
+  /**
+   * Get the bytes of the routing workspace of a matching thread when it
+   * has visited every node of the graph
+   */
+  size_t get_workspace_bytes() const;
  protected:
-  Graph_T g; /**< The member storing a boost graph */
+  CSRGraph g; /**< The member storing the graph */
   /**
    * A value used in checking edge from source,target and cost
    */
   static constexpr double DOUBLE_MIN = 1.e-6;
   const Network &network; /**< Road network */
   unsigned int num_vertices = 0; /**< number of vertices  */
+  const Landmarks *landmarks_ = nullptr; /**< Landmarks of A* search */
+  std::shared_ptr<const EdgeMask> mask_; /**< Edges allowed, nullptr for
+                                              all */
+  /**
+   * Backtrack the routing result kept in a workspace to find a path
+   * from source to target, with the edges relaxed recorded in the path
+   * ends
+   * @param source
+   * @param target
+   * @param workspace workspace of the routing
+   * @return a vector of edge index representing the path from source
+   * to target
+   */
+  std::vector<EdgeIndex> back_track(NodeIndex source, NodeIndex target,
+                                    const SearchWorkspace &workspace) const;
+  /**
+   * Record the edge relaxed from u to v in the path ends of v
+   * @param source source node of the search
+   * @param u node settled
+   * @param v node relaxed
+   * @param e edge from u to v
+   * @param workspace workspace of the routing
+   */
+  static void set_relaxed_edge(NodeIndex source, NodeIndex u, NodeIndex v,
+                               EdgeIndex e, SearchWorkspace *workspace);
 }; // NetworkGraph
 }; // NETWORK
 } // FMM
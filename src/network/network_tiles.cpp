@@ -0,0 +1,244 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/network_tiles.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+namespace {
+
+typedef LineString::linestring_t TileLine;
+
+// Latitude limit of the web mercator square
+const double MAX_LATITUDE = 85.0511287798;
+// Half a pixel of a 256 pixels tile
+const double SIMPLIFY_TOLERANCE = NetworkTiles::EXTENT / 512.0;
+
+inline long long tile_key(int z, int x, int y) {
+  return ((long long) z << 50) | ((long long) x << 25) | (long long) y;
+}
+
+void append_varint(uint64_t value, std::string *buffer) {
+  while (value >= 0x80) {
+    buffer->push_back((char) ((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back((char) value);
+}
+
+inline void append_tag(int field, int wire_type, std::string *buffer) {
+  append_varint(((uint64_t) field << 3) | wire_type, buffer);
+}
+
+void append_bytes(int field, const std::string &bytes, std::string *buffer) {
+  append_tag(field, 2, buffer);
+  append_varint(bytes.size(), buffer);
+  buffer->append(bytes);
+}
+
+inline uint32_t zigzag(int value) {
+  return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+inline uint32_t command(int id, int count) {
+  return (uint32_t) (id & 0x7) | ((uint32_t) count << 3);
+}
+
+// Fractional column of a longitude at a zoom level
+inline double lon2tile(double lon, double n) {
+  return (lon + 180.0) / 360.0 * n;
+}
+
+// Fractional row of a latitude at a zoom level, from the north
+inline double lat2tile(double lat, double n) {
+  lat = std::max(-MAX_LATITUDE, std::min(MAX_LATITUDE, lat));
+  double rad = lat * M_PI / 180.0;
+  return (1.0 - std::asinh(std::tan(rad)) / M_PI) / 2.0 * n;
+}
+
+inline double tile2lat(double row, double n) {
+  return std::atan(std::sinh(M_PI * (1.0 - 2.0 * row / n))) * 180.0 / M_PI;
+}
+
+// Append the commands of a line in tile coordinates, where the cursor is
+// kept between the lines of a feature
+void append_line(const TileLine &line, int *cursor_x, int *cursor_y,
+                 std::vector<uint32_t> *geometry) {
+  std::vector<std::pair<int, int>> points;
+  for (const Point &p : line) {
+    int px = (int) std::lround(boost::geometry::get<0>(p));
+    int py = (int) std::lround(boost::geometry::get<1>(p));
+    if (!points.empty() && points.back().first == px &&
+        points.back().second == py) continue;
+    points.push_back(std::make_pair(px, py));
+  }
+  if (points.size() < 2) return;
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    if (i == 0) geometry->push_back(command(1, 1));
+    if (i == 1) geometry->push_back(command(2, points.size() - 1));
+    geometry->push_back(zigzag(points[i].first - *cursor_x));
+    geometry->push_back(zigzag(points[i].second - *cursor_y));
+    *cursor_x = points[i].first;
+    *cursor_y = points[i].second;
+  }
+}
+
+} // namespace
+
+NetworkTiles::NetworkTiles(const Network &network, long max_bytes) :
+    network_(network), max_bytes_(max_bytes) {}
+
+bool NetworkTiles::is_valid_tile(int z, int x, int y) {
+  if (z < 0 || z > MAX_ZOOM) return false;
+  long n = 1L << z;
+  return x >= 0 && x < n && y >= 0 && y < n;
+}
+
+bool NetworkTiles::get_tile(int z, int x, int y, std::string *tile) {
+  if (!is_valid_tile(z, x, y)) return false;
+  long long key = tile_key(z, x, y);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+      ++statistics_.hits;
+      tiles_.splice(tiles_.begin(), tiles_, found->second);
+      *tile = found->second->second;
+      return true;
+    }
+    ++statistics_.misses;
+  }
+  *tile = encode_tile(z, x, y);
+  if ((long) tile->size() > max_bytes_) return true;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another thread may have encoded the same tile meanwhile
+  if (index_.find(key) != index_.end()) return true;
+  tiles_.emplace_front(key, *tile);
+  index_[key] = tiles_.begin();
+  statistics_.bytes += tile->size();
+  ++statistics_.tiles;
+  while (statistics_.bytes > max_bytes_) {
+    statistics_.bytes -= tiles_.back().second.size();
+    index_.erase(tiles_.back().first);
+    tiles_.pop_back();
+    --statistics_.tiles;
+    ++statistics_.evictions;
+  }
+  return true;
+}
+
+std::string NetworkTiles::encode_tile(int z, int x, int y) const {
+  double n = (double) (1L << z);
+  double buffer = (double) BUFFER / EXTENT;
+  // Box of the tile with its buffer in longitude and latitude, projected
+  // as the network, which keeps it a box
+  double min_x = (x - buffer) / n * 360.0 - 180.0;
+  double max_x = (x + 1 + buffer) / n * 360.0 - 180.0;
+  double min_y = tile2lat(y + 1 + buffer, n);
+  double max_y = tile2lat(y - buffer, n);
+  const LocalProjection &projection = network_.get_projection();
+  projection.forward(&min_x, &min_y);
+  projection.forward(&max_x, &max_y);
+  std::vector<EdgeIndex> found;
+  network_.query_edges(BoostBox(Point(min_x, min_y), Point(max_x, max_y)),
+                       &found);
+  std::sort(found.begin(), found.end());
+  boost::geometry::model::box<Point> clip_box(
+      Point(-BUFFER, -BUFFER), Point(EXTENT + BUFFER, EXTENT + BUFFER));
+  const std::vector<Edge> &edges = network_.get_edges();
+  std::string features;
+  std::vector<long long> values;
+  std::unordered_map<long long, int> value_index;
+  auto get_value_index = [&](long long value) {
+    auto inserted = value_index.insert(std::make_pair(value, values.size()));
+    if (inserted.second) values.push_back(value);
+    return inserted.first->second;
+  };
+  TileLine line, simplified;
+  std::vector<TileLine> parts;
+  std::vector<uint32_t> geometry;
+  for (EdgeIndex e : found) {
+    const Edge &edge = edges[e];
+    LineStringView geom = network_.get_edge_view(e);
+    line.clear();
+    bool inside = true;
+    for (int i = 0; i < geom.get_num_points(); ++i) {
+      double px = geom.get_x(i);
+      double py = geom.get_y(i);
+      projection.inverse(&px, &py);
+      px = (lon2tile(px, n) - x) * EXTENT;
+      py = (lat2tile(py, n) - y) * EXTENT;
+      inside = inside && boost::geometry::covered_by(Point(px, py), clip_box);
+      line.push_back(Point(px, py));
+    }
+    parts.clear();
+    if (inside) {
+      parts.push_back(line);
+    } else {
+      boost::geometry::intersection(line, clip_box, parts);
+    }
+    geometry.clear();
+    int cursor_x = 0, cursor_y = 0;
+    for (const TileLine &part : parts) {
+      simplified.clear();
+      boost::geometry::simplify(part, simplified, SIMPLIFY_TOLERANCE);
+      append_line(simplified, &cursor_x, &cursor_y, &geometry);
+    }
+    if (geometry.empty()) continue;
+    std::string feature;
+    if (edge.id >= 0) {
+      append_tag(1, 0, &feature);
+      append_varint((uint64_t) edge.id, &feature);
+    }
+    std::string tags;
+    append_varint(0, &tags);
+    append_varint(get_value_index(edge.id), &tags);
+    append_varint(1, &tags);
+    append_varint(get_value_index(network_.get_node_id(edge.source)), &tags);
+    append_varint(2, &tags);
+    append_varint(get_value_index(network_.get_node_id(edge.target)), &tags);
+    append_bytes(2, tags, &feature);
+    // LINESTRING
+    append_tag(3, 0, &feature);
+    append_varint(2, &feature);
+    std::string packed;
+    for (uint32_t value : geometry) append_varint(value, &packed);
+    append_bytes(4, packed, &feature);
+    append_bytes(2, feature, &features);
+  }
+  std::string tile;
+  if (features.empty()) return tile;
+  std::string layer;
+  append_tag(15, 0, &layer);
+  append_varint(2, &layer);
+  append_bytes(1, "edges", &layer);
+  layer.append(features);
+  append_bytes(3, "id", &layer);
+  append_bytes(3, "source", &layer);
+  append_bytes(3, "target", &layer);
+  for (long long value : values) {
+    std::string encoded;
+    // int_value, two's complement for the negative values
+    append_tag(4, 0, &encoded);
+    append_varint((uint64_t) value, &encoded);
+    append_bytes(4, encoded, &layer);
+  }
+  append_tag(5, 0, &layer);
+  append_varint(EXTENT, &layer);
+  append_bytes(3, layer, &tile);
+  return tile;
+}
+
+NetworkTileStatistics NetworkTiles::get_statistics() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return statistics_;
+}
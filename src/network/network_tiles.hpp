@@ -0,0 +1,105 @@
+/**
+ * Fast map matching.
+ *
+ * Vector tiles of the edges of a network, which are served to the web
+ * maps so that they only load the edges visible
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_NETWORK_TILES_HPP
+#define FMM_NETWORK_TILES_HPP
+
+#include "network/network.hpp"
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Counters of the tile cache
+ */
+struct NetworkTileStatistics {
+  long hits = 0; /**< Tiles found in the cache */
+  long misses = 0; /**< Tiles encoded */
+  long evictions = 0; /**< Tiles evicted */
+  long tiles = 0; /**< Tiles cached */
+  long bytes = 0; /**< Bytes of the tiles cached */
+};
+
+/**
+ * Mapbox vector tiles (MVT 2.1) of the edges of a network in the web
+ * mercator tiling scheme z/x/y, with a layer "edges" holding a linestring
+ * feature per edge with the attributes id, source and target.
+ *
+ * The edges of a tile are found with the spatial index of the network.
+ * Their geometries are clipped to the tile grown by a buffer and
+ * simplified with a tolerance of half a pixel of a 256 pixels tile, so
+ * that the edges shorter than a pixel vanish at the low zoom levels. The
+ * network should be in longitude and latitude, either read as is or
+ * projected locally.
+ *
+ * The tiles encoded are cached up to a number of bytes and evicted in the
+ * order of their last use. The tiles can be requested by multiple
+ * threads, a tile missed is encoded without the lock.
+ */
+class NetworkTiles {
+ public:
+  /**
+   * Create an empty cache
+   * @param network   network, which should outlive the tiles
+   * @param max_bytes maximum bytes of the tiles cached
+   */
+  NetworkTiles(const Network &network, long max_bytes = DEFAULT_CACHE_BYTES);
+  /**
+   * Get a tile from the cache, which is encoded on a miss
+   * @param  z    zoom level
+   * @param  x    column of the tile
+   * @param  y    row of the tile, from the north
+   * @param  tile updated with the tile encoded in protobuf
+   * @return false if the tile is not in the tiling scheme
+   */
+  bool get_tile(int z, int x, int y, std::string *tile);
+  /**
+   * Encode a tile without the cache
+   * @param  z zoom level
+   * @param  x column of the tile
+   * @param  y row of the tile, from the north
+   * @return the tile encoded in protobuf, which has no layer if no edge
+   * is visible
+   */
+  std::string encode_tile(int z, int x, int y) const;
+  /**
+   * Get the counters of the cache
+   */
+  NetworkTileStatistics get_statistics() const;
+  /**
+   * Check if a tile is in the tiling scheme up to MAX_ZOOM
+   */
+  static bool is_valid_tile(int z, int x, int y);
+  static const long DEFAULT_CACHE_BYTES = 64L * 1024L * 1024L; /**<
+      Default maximum bytes of the tiles cached */
+  static const int EXTENT = 4096; /**< Coordinates across a tile */
+  static const int BUFFER = 64; /**< Coordinates of the buffer around a
+                                     tile where the edges are kept */
+  static const int MAX_ZOOM = 24; /**< Maximum zoom level */
+ private:
+  typedef std::list<std::pair<long long, std::string>> TileList;
+  const Network &network_;
+  long max_bytes_;
+  mutable std::mutex mutex_;
+  TileList tiles_; // Most recently used first
+  std::unordered_map<long long, TileList::iterator> index_;
+  NetworkTileStatistics statistics_;
+}; // NetworkTiles
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_NETWORK_TILES_HPP
@@ -0,0 +1,577 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/osm_reader.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// Reader of the fields of a protocol buffer message, which stops at the
+// first malformed field
+class ProtoReader {
+ public:
+  ProtoReader(const unsigned char *begin, const unsigned char *end) :
+      p_(begin), end_(end) {}
+  // Read the key of the next field
+  bool next(int *field, int *wire_type) {
+    if (p_ >= end_) return false;
+    uint64_t key = varint();
+    *field = (int) (key >> 3);
+    *wire_type = (int) (key & 7);
+    return !failed_;
+  }
+  uint64_t varint() {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (p_ >= end_) break;
+      unsigned char byte = *p_++;
+      value |= (uint64_t) (byte & 0x7f) << shift;
+      if (!(byte & 0x80)) return value;
+    }
+    fail();
+    return 0;
+  }
+  int64_t svarint() {
+    uint64_t value = varint();
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+  }
+  // Read a length delimited field
+  ProtoReader message() {
+    uint64_t length = varint();
+    if (failed_ || length > (uint64_t) (end_ - p_)) {
+      fail();
+      return ProtoReader(end_, end_);
+    }
+    ProtoReader reader(p_, p_ + length);
+    p_ += length;
+    return reader;
+  }
+  std::string string() {
+    ProtoReader reader = message();
+    return std::string((const char *) reader.p_, reader.end_ - reader.p_);
+  }
+  void skip(int wire_type) {
+    if (wire_type == 0) {
+      varint();
+    } else if (wire_type == 1) {
+      advance(8);
+    } else if (wire_type == 2) {
+      message();
+    } else if (wire_type == 5) {
+      advance(4);
+    } else {
+      fail();
+    }
+  }
+  const unsigned char *begin() const { return p_; }
+  const unsigned char *end() const { return end_; }
+  bool failed() const { return failed_; }
+ private:
+  void advance(long bytes) {
+    if (end_ - p_ < bytes) {
+      fail();
+    } else {
+      p_ += bytes;
+    }
+  }
+  void fail() {
+    failed_ = true;
+    p_ = end_;
+  }
+  const unsigned char *p_;
+  const unsigned char *end_;
+  bool failed_ = false;
+};
+
+// Values of a packed repeated field
+template <typename T, typename Read>
+std::vector<T> read_packed(ProtoReader reader, Read read) {
+  std::vector<T> values;
+  while (reader.begin() < reader.end() && !reader.failed()) {
+    values.push_back(read(&reader));
+  }
+  return values;
+}
+
+struct OSMNode {
+  long long id;
+  double lon;
+  double lat;
+};
+
+struct OSMWay {
+  long long id;
+  std::vector<long long> refs;
+  bool forward;
+  bool backward;
+};
+
+// Content of a primitive block
+struct OSMBlock {
+  std::vector<OSMNode> nodes;
+  std::vector<OSMWay> ways;
+  bool failed = false;
+};
+
+// Blob of the file, with its data still compressed
+struct OSMBlob {
+  bool is_data;
+  const unsigned char *data;
+  long size;
+};
+
+// Values of highway which are not roads
+bool is_excluded_highway(const std::string &value) {
+  static const char *excluded[] = {
+      "proposed", "construction", "abandoned", "platform", "raceway",
+      "razed", "bus_stop", "elevator", "rest_area", "services"};
+  for (const char *name : excluded) {
+    if (value == name) return true;
+  }
+  return false;
+}
+
+// Set the directions of a highway way from its tags
+// @return false if the way is not a road
+bool read_way_tags(const std::vector<std::string> &strings,
+                   const std::vector<uint32_t> &keys,
+                   const std::vector<uint32_t> &vals, OSMWay *way) {
+  std::string highway, oneway, junction;
+  bool area = false;
+  for (size_t i = 0; i < keys.size() && i < vals.size(); ++i) {
+    if (keys[i] >= strings.size() || vals[i] >= strings.size()) continue;
+    const std::string &key = strings[keys[i]];
+    const std::string &value = strings[vals[i]];
+    if (key == "highway") {
+      highway = value;
+    } else if (key == "oneway") {
+      oneway = value;
+    } else if (key == "junction") {
+      junction = value;
+    } else if (key == "area") {
+      area = value == "yes";
+    }
+  }
+  if (highway.empty() || area || is_excluded_highway(highway)) return false;
+  way->forward = true;
+  way->backward = true;
+  if (oneway == "yes" || oneway == "true" || oneway == "1") {
+    way->backward = false;
+  } else if (oneway == "-1" || oneway == "reverse") {
+    way->forward = false;
+  } else if (oneway != "no" && oneway != "false" && oneway != "0" &&
+      (highway == "motorway" || junction == "roundabout" ||
+       junction == "circular")) {
+    way->backward = false;
+  }
+  return true;
+}
+
+// Decompress the data of a blob
+bool read_blob(const OSMBlob &blob, std::vector<unsigned char> *buffer,
+               const unsigned char **data, long *size) {
+  ProtoReader reader(blob.data, blob.data + blob.size);
+  int field, wire_type;
+  long raw_size = -1;
+  ProtoReader zlib_data(nullptr, nullptr);
+  bool compressed = false;
+  while (reader.next(&field, &wire_type)) {
+    if (field == 1 && wire_type == 2) {
+      ProtoReader raw = reader.message();
+      *data = raw.begin();
+      *size = raw.end() - raw.begin();
+      return !reader.failed();
+    } else if (field == 2 && wire_type == 0) {
+      raw_size = (long) reader.varint();
+    } else if (field == 3 && wire_type == 2) {
+      zlib_data = reader.message();
+      compressed = true;
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  if (!compressed || raw_size < 0 || reader.failed()) return false;
+  buffer->resize(raw_size);
+  uLongf length = raw_size;
+  if (uncompress(buffer->data(), &length, zlib_data.begin(),
+                 zlib_data.end() - zlib_data.begin()) != Z_OK ||
+      (long) length != raw_size) {
+    return false;
+  }
+  *data = buffer->data();
+  *size = raw_size;
+  return true;
+}
+
+// Block parameters converting the coordinates into degrees
+struct BlockScale {
+  long long granularity = 100;
+  long long lat_offset = 0;
+  long long lon_offset = 0;
+  inline double lon(long long value) const {
+    return 1e-9 * (lon_offset + granularity * value);
+  }
+  inline double lat(long long value) const {
+    return 1e-9 * (lat_offset + granularity * value);
+  }
+};
+
+void read_dense_nodes(ProtoReader reader, const BlockScale &scale,
+                      std::vector<OSMNode> *nodes) {
+  std::vector<int64_t> ids, lats, lons;
+  int field, wire_type;
+  auto read_sint = [](ProtoReader *r) { return r->svarint(); };
+  while (reader.next(&field, &wire_type)) {
+    if (field == 1 && wire_type == 2) {
+      ids = read_packed<int64_t>(reader.message(), read_sint);
+    } else if (field == 8 && wire_type == 2) {
+      lats = read_packed<int64_t>(reader.message(), read_sint);
+    } else if (field == 9 && wire_type == 2) {
+      lons = read_packed<int64_t>(reader.message(), read_sint);
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  if (ids.size() != lats.size() || ids.size() != lons.size()) return;
+  // The values are delta encoded
+  long long id = 0, lat = 0, lon = 0;
+  for (size_t i = 0; i < ids.size(); ++i) {
+    id += ids[i];
+    lat += lats[i];
+    lon += lons[i];
+    nodes->push_back({id, scale.lon(lon), scale.lat(lat)});
+  }
+}
+
+void read_node(ProtoReader reader, const BlockScale &scale,
+               std::vector<OSMNode> *nodes) {
+  long long id = 0, lat = 0, lon = 0;
+  int field, wire_type;
+  while (reader.next(&field, &wire_type)) {
+    if (field == 1 && wire_type == 0) {
+      id = reader.svarint();
+    } else if (field == 8 && wire_type == 0) {
+      lat = reader.svarint();
+    } else if (field == 9 && wire_type == 0) {
+      lon = reader.svarint();
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  nodes->push_back({id, scale.lon(lon), scale.lat(lat)});
+}
+
+void read_way(ProtoReader reader, const std::vector<std::string> &strings,
+              std::vector<OSMWay> *ways) {
+  OSMWay way;
+  way.id = 0;
+  std::vector<uint32_t> keys, vals;
+  std::vector<int64_t> refs;
+  auto read_uint = [](ProtoReader *r) { return (uint32_t) r->varint(); };
+  int field, wire_type;
+  while (reader.next(&field, &wire_type)) {
+    if (field == 1 && wire_type == 0) {
+      way.id = (long long) reader.varint();
+    } else if (field == 2 && wire_type == 2) {
+      keys = read_packed<uint32_t>(reader.message(), read_uint);
+    } else if (field == 3 && wire_type == 2) {
+      vals = read_packed<uint32_t>(reader.message(), read_uint);
+    } else if (field == 8 && wire_type == 2) {
+      refs = read_packed<int64_t>(
+          reader.message(), [](ProtoReader *r) { return r->svarint(); });
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  if (refs.size() < 2 || !read_way_tags(strings, keys, vals, &way)) return;
+  way.refs.resize(refs.size());
+  long long ref = 0;
+  for (size_t i = 0; i < refs.size(); ++i) {
+    ref += refs[i];
+    way.refs[i] = ref;
+  }
+  ways->push_back(std::move(way));
+}
+
+void read_primitive_block(const unsigned char *data, long size,
+                          OSMBlock *block) {
+  std::vector<std::string> strings;
+  std::vector<ProtoReader> groups;
+  BlockScale scale;
+  ProtoReader reader(data, data + size);
+  int field, wire_type;
+  // The groups are read once the scale and the strings are known
+  while (reader.next(&field, &wire_type)) {
+    if (field == 1 && wire_type == 2) {
+      ProtoReader table = reader.message();
+      int table_field, table_wire_type;
+      while (table.next(&table_field, &table_wire_type)) {
+        if (table_field == 1 && table_wire_type == 2) {
+          strings.push_back(table.string());
+        } else {
+          table.skip(table_wire_type);
+        }
+      }
+    } else if (field == 2 && wire_type == 2) {
+      groups.push_back(reader.message());
+    } else if (field == 17 && wire_type == 0) {
+      scale.granularity = (long long) reader.varint();
+    } else if (field == 19 && wire_type == 0) {
+      scale.lat_offset = (long long) reader.varint();
+    } else if (field == 20 && wire_type == 0) {
+      scale.lon_offset = (long long) reader.varint();
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  block->failed = reader.failed();
+  for (ProtoReader &group : groups) {
+    while (group.next(&field, &wire_type)) {
+      if (field == 1 && wire_type == 2) {
+        read_node(group.message(), scale, &block->nodes);
+      } else if (field == 2 && wire_type == 2) {
+        read_dense_nodes(group.message(), scale, &block->nodes);
+      } else if (field == 3 && wire_type == 2) {
+        read_way(group.message(), strings, &block->ways);
+      } else {
+        group.skip(wire_type);
+      }
+    }
+    block->failed = block->failed || group.failed();
+  }
+}
+
+// Check that the features required by the file are supported
+bool read_header_block(const unsigned char *data, long size) {
+  ProtoReader reader(data, data + size);
+  int field, wire_type;
+  while (reader.next(&field, &wire_type)) {
+    if (field == 4 && wire_type == 2) {
+      std::string feature = reader.string();
+      if (feature != "OsmSchema-V0.6" && feature != "DenseNodes") {
+        SPDLOG_CRITICAL("OSM feature {} not supported", feature);
+        return false;
+      }
+    } else {
+      reader.skip(wire_type);
+    }
+  }
+  return !reader.failed();
+}
+
+// Split the blobs of the file from their headers
+bool split_blobs(const unsigned char *data, long size,
+                 std::vector<OSMBlob> *blobs) {
+  long position = 0;
+  while (position < size) {
+    if (size - position < 4) return false;
+    long header_size = (long) data[position] << 24 |
+        (long) data[position + 1] << 16 | (long) data[position + 2] << 8 |
+        (long) data[position + 3];
+    position += 4;
+    if (size - position < header_size) return false;
+    ProtoReader reader(data + position, data + position + header_size);
+    std::string type;
+    long data_size = -1;
+    int field, wire_type;
+    while (reader.next(&field, &wire_type)) {
+      if (field == 1 && wire_type == 2) {
+        type = reader.string();
+      } else if (field == 3 && wire_type == 0) {
+        data_size = (long) reader.varint();
+      } else {
+        reader.skip(wire_type);
+      }
+    }
+    position += header_size;
+    if (reader.failed() || data_size < 0 || size - position < data_size) {
+      return false;
+    }
+    if (type == "OSMData" || type == "OSMHeader") {
+      blobs->push_back({type == "OSMData", data + position, data_size});
+    }
+    position += data_size;
+  }
+  return true;
+}
+
+bool compare_node(const OSMNode &a, const OSMNode &b) {
+  return a.id < b.id;
+}
+
+// Find the coordinates of a node
+const OSMNode *find_node(const std::vector<OSMNode> &nodes, long long id) {
+  OSMNode key{id, 0, 0};
+  auto iter = std::lower_bound(nodes.begin(), nodes.end(), key,
+                               compare_node);
+  return iter != nodes.end() && iter->id == id ? &(*iter) : nullptr;
+}
+
+} // namespace
+
+bool OSMReader::is_osm_file(const std::string &filename) {
+  return filename.size() > 4 &&
+      filename.compare(filename.size() - 4, 4, ".pbf") == 0;
+}
+
+bool OSMReader::read_edges(const std::string &filename,
+                           std::vector<OSMEdge> *edges) {
+  SPDLOG_INFO("Read OSM network from file {}", filename);
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    SPDLOG_CRITICAL("Failed to open OSM file {}", filename);
+    return false;
+  }
+  struct stat stat_buf;
+  fstat(fd, &stat_buf);
+  long size = stat_buf.st_size;
+  void *addr = size > 0 ?
+      mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+  if (addr == MAP_FAILED) {
+    SPDLOG_CRITICAL("Failed to map OSM file {}", filename);
+    return false;
+  }
+  const unsigned char *data = (const unsigned char *) addr;
+  std::vector<OSMBlob> blobs;
+  bool valid = split_blobs(data, size, &blobs);
+  // The blocks are decoded in parallel, and merged in the order of the
+  // file
+  std::vector<OSMBlock> blocks(blobs.size());
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < (int) blobs.size(); ++i) {
+    std::vector<unsigned char> buffer;
+    const unsigned char *block_data;
+    long block_size;
+    if (!read_blob(blobs[i], &buffer, &block_data, &block_size)) {
+      blocks[i].failed = true;
+    } else if (blobs[i].is_data) {
+      read_primitive_block(block_data, block_size, &blocks[i]);
+    } else {
+      blocks[i].failed = !read_header_block(block_data, block_size);
+    }
+  }
+  munmap(addr, size);
+  std::vector<OSMNode> nodes;
+  std::vector<OSMWay> ways;
+  for (OSMBlock &block : blocks) {
+    valid = valid && !block.failed;
+    nodes.insert(nodes.end(), block.nodes.begin(), block.nodes.end());
+    std::move(block.ways.begin(), block.ways.end(), std::back_inserter(ways));
+    block = OSMBlock();
+  }
+  if (!valid) {
+    SPDLOG_CRITICAL("Invalid OSM PBF file {}", filename);
+    return false;
+  }
+  // The objects of a file are usually sorted by id already
+  if (!std::is_sorted(nodes.begin(), nodes.end(), compare_node)) {
+    std::sort(nodes.begin(), nodes.end(), compare_node);
+  }
+  std::stable_sort(ways.begin(), ways.end(),
+                   [](const OSMWay &a, const OSMWay &b) {
+                     return a.id < b.id;
+                   });
+  SPDLOG_INFO("Number of OSM nodes {} highway ways {}", nodes.size(),
+              ways.size());
+  // The ways are split at the nodes referenced twice and at their ends,
+  // which are the nodes of the network
+  std::vector<long long> refs;
+  for (const OSMWay &way : ways) {
+    refs.insert(refs.end(), way.refs.begin(), way.refs.end());
+  }
+  std::sort(refs.begin(), refs.end());
+  std::vector<long long> split_nodes;
+  for (size_t i = 1; i < refs.size(); ++i) {
+    if (refs[i] == refs[i - 1] &&
+        (split_nodes.empty() || split_nodes.back() != refs[i])) {
+      split_nodes.push_back(refs[i]);
+    }
+  }
+  std::vector<long long>().swap(refs);
+  for (const OSMWay &way : ways) {
+    split_nodes.push_back(way.refs.front());
+    split_nodes.push_back(way.refs.back());
+  }
+  std::sort(split_nodes.begin(), split_nodes.end());
+  split_nodes.erase(std::unique(split_nodes.begin(), split_nodes.end()),
+                    split_nodes.end());
+  auto node_id = [&](long long ref) {
+    return (NodeID) (std::lower_bound(split_nodes.begin(), split_nodes.end(),
+                                      ref) - split_nodes.begin() + 1);
+  };
+  auto is_split = [&](long long ref) {
+    return std::binary_search(split_nodes.begin(), split_nodes.end(), ref);
+  };
+  // The edges of each way are built in parallel, and numbered in the
+  // order of the ways
+  std::vector<std::vector<OSMEdge>> way_edges(ways.size());
+  std::vector<char> skipped(ways.size(), 0);
+  #pragma omp parallel for schedule(dynamic, 256)
+  for (int w = 0; w < (int) ways.size(); ++w) {
+    const OSMWay &way = ways[w];
+    std::vector<const OSMNode *> points(way.refs.size());
+    for (size_t i = 0; i < way.refs.size(); ++i) {
+      points[i] = find_node(nodes, way.refs[i]);
+      if (points[i] == nullptr) {
+        skipped[w] = 1;
+        break;
+      }
+    }
+    if (skipped[w]) continue;
+    size_t start = 0;
+    for (size_t i = 1; i < way.refs.size(); ++i) {
+      if (!is_split(way.refs[i])) continue;
+      LineString geom;
+      for (size_t j = start; j <= i; ++j) {
+        // Consecutive duplicated nodes give a single point
+        if (j > start && way.refs[j] == way.refs[j - 1]) continue;
+        geom.add_point(points[j]->lon, points[j]->lat);
+      }
+      NodeID source = node_id(way.refs[start]);
+      NodeID target = node_id(way.refs[i]);
+      start = i;
+      if (geom.get_num_points() < 2) continue;
+      if (way.forward) {
+        way_edges[w].push_back({0, source, target, geom});
+      }
+      if (way.backward) {
+        LineString reversed;
+        for (int j = geom.get_num_points() - 1; j >= 0; --j) {
+          reversed.add_point(geom.get_x(j), geom.get_y(j));
+        }
+        way_edges[w].push_back({0, target, source, std::move(reversed)});
+      }
+    }
+  }
+  long num_skipped = std::count(skipped.begin(), skipped.end(), 1);
+  if (num_skipped > 0) {
+    SPDLOG_WARN("Skip {} ways referencing nodes missing from the file",
+                num_skipped);
+  }
+  edges->clear();
+  EdgeID id = 1;
+  for (std::vector<OSMEdge> &way : way_edges) {
+    for (OSMEdge &edge : way) {
+      edge.id = id++;
+      edges->push_back(std::move(edge));
+    }
+  }
+  SPDLOG_INFO("Number of OSM edges {}", edges->size());
+  return true;
+}
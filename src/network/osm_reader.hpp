@@ -0,0 +1,69 @@
+/**
+ * Fast map matching.
+ *
+ * Reader of the road network of an OpenStreetMap PBF file, without
+ * converting it into a shapefile
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_NETWORK_OSM_READER_HPP
+#define FMM_NETWORK_OSM_READER_HPP
+
+#include "network/type.hpp"
+#include "core/geometry.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Edge of the road network of an OSM file
+ */
+struct OSMEdge {
+  EdgeID id; /**< Edge id, numbered from 1 */
+  NodeID source; /**< Source node id, numbered from 1 */
+  NodeID target; /**< Target node id, numbered from 1 */
+  CORE::LineString geom; /**< Geometry in longitude and latitude */
+};
+
+/**
+ * Reader of the road network of an OpenStreetMap PBF file.
+ *
+ * The ways tagged as highway are read, except the ones which are not
+ * roads such as the proposed, under construction or area ones. A way is
+ * split into edges at its nodes shared with other ways or with itself,
+ * and a way not tagged as oneway, explicitly or by being a motorway or a
+ * roundabout, gives an edge in each direction. A way referencing a node
+ * missing from the file is skipped.
+ *
+ * The blocks of the file are decompressed and decoded in parallel and
+ * the ways are split in parallel. The ids do not depend on the threads:
+ * the nodes at the ends of the edges are numbered in the order of their
+ * OSM id, and the edges in the order of the OSM id of their way, then
+ * along the way, with the forward edge before the backward one.
+ */
+class OSMReader {
+ public:
+  /**
+   * Read the edges of an OSM PBF file
+   * @param  filename OSM PBF file name
+   * @param  edges    updated with the edges read
+   * @return false if the file cannot be read or is not a supported OSM
+   * PBF file
+   */
+  static bool read_edges(const std::string &filename,
+                         std::vector<OSMEdge> *edges);
+  /**
+   * Check if a network file is an OSM PBF file, from its extension
+   */
+  static bool is_osm_file(const std::string &filename);
+}; // OSMReader
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_NETWORK_OSM_READER_HPP
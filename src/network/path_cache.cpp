@@ -0,0 +1,235 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/path_cache.hpp"
+#include "network/search_workspace.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace FMM;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// Pack a pair of nodes into a key
+inline unsigned long long pair_key(NodeIndex source, NodeIndex target) {
+  return ((unsigned long long) source << 32) | target;
+}
+
+// Mix a key into a well distributed 64 bit hash
+inline unsigned long long mix_key(unsigned long long h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+} // namespace
+
+PathCache::PathCache(const NetworkGraph &graph_arg, long max_rows) :
+    graph(graph_arg),
+    shard_rows(std::max<long>(max_rows / CACHE_SHARDS, 1)) {
+  SPDLOG_INFO("Create path cache with rows {}", max_rows);
+  for (int i = 0; i < CACHE_SHARDS; ++i) {
+    shards.emplace_back(new Shard());
+  }
+}
+
+double PathCache::bucket_bound(double delta) {
+  if (delta <= 0) return delta;
+  double bound = std::pow(2.0, std::ceil(4 * std::log2(delta)) / 4);
+  // Guard against the rounding of the logarithm
+  return bound < delta ? bound * std::pow(2.0, 0.25) : bound;
+}
+
+PathCache::Shard &PathCache::get_shard(unsigned long long key) const {
+  return *shards[mix_key(key) & (CACHE_SHARDS - 1)];
+}
+
+bool PathCache::look_up(NodeIndex source, NodeIndex target, double delta,
+                        double *dist) {
+  unsigned long long key = pair_key(source, target);
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto iter = shard.entries.find(key);
+  if (iter != shard.entries.end()) {
+    Entry &entry = iter->second;
+    if (entry.dist != std::numeric_limits<double>::max()) {
+      *dist = entry.dist <= delta ? entry.dist :
+              std::numeric_limits<double>::max();
+    }
+    // A pair not reached is only known within the bound searched
+    if (entry.dist != std::numeric_limits<double>::max() ||
+        entry.bound >= delta) {
+      entry.referenced = true;
+      ++shard.hits;
+      return true;
+    }
+  }
+  ++shard.misses;
+  return false;
+}
+
+bool PathCache::get_path(NodeIndex source, NodeIndex target,
+                         std::vector<EdgeIndex> *path) {
+  unsigned long long key = pair_key(source, target);
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto iter = shard.entries.find(key);
+  if (iter == shard.entries.end() ||
+      iter->second.dist == std::numeric_limits<double>::max()) {
+    ++shard.misses;
+    return false;
+  }
+  iter->second.referenced = true;
+  ++shard.hits;
+  *path = iter->second.path;
+  return true;
+}
+
+void PathCache::insert(NodeIndex source, NodeIndex target, Entry entry) {
+  unsigned long long key = pair_key(source, target);
+  Shard &shard = get_shard(key);
+  long rows = entry.path.size() + 1;
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto iter = shard.entries.find(key);
+  if (iter == shard.entries.end()) {
+    shard.entries.emplace(key, std::move(entry));
+    shard.clock.push_back(key);
+  } else {
+    // Another query may have searched the same pair, or with a smaller
+    // bound
+    shard.rows -= iter->second.path.size() + 1;
+    iter->second = std::move(entry);
+  }
+  shard.rows += rows;
+  while (shard.rows > shard_rows && shard.clock.size() > 1) {
+    if (shard.hand >= shard.clock.size()) shard.hand = 0;
+    unsigned long long victim = shard.clock[shard.hand];
+    Entry &victim_entry = shard.entries[victim];
+    if (victim == key || victim_entry.referenced) {
+      victim_entry.referenced = false;
+      ++shard.hand;
+    } else {
+      shard.rows -= victim_entry.path.size() + 1;
+      shard.entries.erase(victim);
+      shard.clock[shard.hand] = shard.clock.back();
+      shard.clock.pop_back();
+      ++shard.evictions;
+    }
+  }
+}
+
+std::vector<double> PathCache::one_to_many(
+    NodeIndex source, const std::vector<NodeIndex> &targets, double delta) {
+  const double inf = std::numeric_limits<double>::max();
+  std::vector<double> distances(targets.size(), inf);
+  std::vector<std::size_t> missing;
+  std::vector<NodeIndex> unsettled;
+  for (std::size_t i = 0; i < targets.size(); ++i) {
+    if (!look_up(source, targets[i], delta, &distances[i])) {
+      missing.push_back(i);
+      unsettled.push_back(targets[i]);
+    }
+  }
+  if (missing.empty()) return distances;
+  // The missing targets are searched together, until all of them are
+  // settled or the bound of the bucket is exceeded
+  double bound = bucket_bound(delta);
+  const CSRGraph &g = graph.get_graph();
+  SearchWorkspace &ws = SearchWorkspace::local();
+  ws.reset(graph.get_num_vertices());
+  ws.set(source, 0, source);
+  ws.push(source, 0);
+  while (!ws.empty() && !unsettled.empty()) {
+    HeapNode node = ws.top();
+    ws.pop();
+    NodeIndex u = node.index;
+    if (node.value > bound) break;
+    auto iter = std::find(unsettled.begin(), unsettled.end(), u);
+    while (iter != unsettled.end()) {
+      *iter = unsettled.back();
+      unsettled.pop_back();
+      iter = std::find(unsettled.begin(), unsettled.end(), u);
+    }
+    for (unsigned int e = g.begin(u); e < g.end(u); ++e) {
+      NodeIndex v = g.get_target(e);
+      double temp_dist = node.value + g.get_length(e);
+      if (temp_dist > bound) continue;
+      if (!ws.visited(v)) {
+        ws.set(v, temp_dist, u);
+        ws.push(v, temp_dist);
+      } else if (ws.get_distance(v) > temp_dist) {
+        ws.set(v, temp_dist, u);
+        ws.decrease_key(v, temp_dist);
+      } else {
+        continue;
+      }
+      ws.set_ends(v, PathEnds{v, g.get_index(e), g.get_index(e)});
+    }
+  }
+  // A target visited is settled, as the nodes are only visited within
+  // the bound and the search stops once the targets are settled.
+  for (std::size_t i : missing) {
+    NodeIndex t = targets[i];
+    Entry entry{inf, bound, {}, true};
+    if (ws.visited(t)) {
+      entry.dist = ws.get_distance(t);
+      if (entry.dist <= delta) distances[i] = entry.dist;
+      for (NodeIndex v = t; v != source; v = ws.get_predecessor(v)) {
+        entry.path.push_back(ws.get_ends(v).last_e);
+      }
+      std::reverse(entry.path.begin(), entry.path.end());
+    }
+    insert(source, t, std::move(entry));
+  }
+  return distances;
+}
+
+PathCacheStatistics PathCache::get_statistics() const {
+  PathCacheStatistics statistics;
+  for (const auto &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    statistics.hits += shard->hits;
+    statistics.misses += shard->misses;
+    statistics.evictions += shard->evictions;
+    statistics.pairs += shard->entries.size();
+    statistics.rows += shard->rows;
+  }
+  return statistics;
+}
+
+void PathCache::print_statistics() const {
+  PathCacheStatistics statistics = get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  SPDLOG_INFO("Path cache hits {} misses {} hit rate {} evictions {}",
+              statistics.hits, statistics.misses,
+              queries > 0 ? statistics.hits / (double) queries : 0.0,
+              statistics.evictions);
+  SPDLOG_INFO("Path cache pairs cached {} rows cached {}",
+              statistics.pairs, statistics.rows);
+}
+
+void NETWORK::append_path_cache_metrics(const PathCache &cache,
+                                        UTIL::MetricsText *text) {
+  PathCacheStatistics statistics = cache.get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  text->counter("fmm_path_cache_hits_total", "Pairs found in the path cache",
+                statistics.hits);
+  text->counter("fmm_path_cache_misses_total",
+                "Pairs searched on a miss of the path cache",
+                statistics.misses);
+  text->counter("fmm_path_cache_evictions_total",
+                "Pairs evicted from the path cache", statistics.evictions);
+  text->gauge("fmm_path_cache_rows", "Records cached by the path cache",
+              statistics.rows);
+  text->gauge("fmm_path_cache_hit_ratio",
+              "Share of the pairs found in the path cache",
+              queries > 0 ? statistics.hits / (double) queries : 0.0);
+}
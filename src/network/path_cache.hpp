@@ -0,0 +1,143 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the upper bounded shortest paths between the nodes of the
+ * network, which is shared by the trajectories matched.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_PATH_CACHE_HPP
+#define FMM_PATH_CACHE_HPP
+
+#include "network/type.hpp"
+#include "network/network_graph.hpp"
+#include "util/metrics.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Counters of a path cache
+ */
+struct PathCacheStatistics {
+  long hits = 0; /**< Pairs found in the cache */
+  long misses = 0; /**< Pairs searched */
+  long evictions = 0; /**< Pairs evicted */
+  long pairs = 0; /**< Pairs cached */
+  long rows = 0; /**< Records cached, one per pair and per edge */
+};
+
+/**
+ * Distances and paths between pairs of nodes of the network, which are
+ * searched with an upper bound on a miss and kept for the next queries.
+ *
+ * The upper bound of a search is rounded up to a bucket, growing by a
+ * factor of 2^(1/4), so that a pair not reached is also cached for the
+ * queries with a similar bound. A pair reached is exact whatever the
+ * bound of the query. The cache is split into shards locked
+ * independently, and a shard evicts its pairs with the CLOCK algorithm
+ * when it holds too many records. It can be queried by multiple threads.
+ */
+class PathCache {
+ public:
+  /**
+   * Create an empty cache
+   * @param graph    network graph, which should outlive the cache
+   * @param max_rows maximum number of records cached, where each pair
+   * and each edge of its path count as one record
+   */
+  PathCache(const NetworkGraph &graph, long max_rows = DEFAULT_CACHE_ROWS);
+  /**
+   * Distances from a source to several targets, where the pairs not
+   * cached are searched together with an upper bound
+   * @param  source  source node
+   * @param  targets target nodes
+   * @param  delta   upper bound of the distances
+   * @return distance to each target, max double if not reached within
+   * delta
+   */
+  std::vector<double> one_to_many(NodeIndex source,
+                                  const std::vector<NodeIndex> &targets,
+                                  double delta);
+  /**
+   * Get the path of a pair reached and cached
+   * @param  source source node
+   * @param  target target node
+   * @param  path   updated with the edges of the path
+   * @return true if the path is cached
+   */
+  bool get_path(NodeIndex source, NodeIndex target,
+                std::vector<EdgeIndex> *path);
+  /**
+   * Get the counters of the cache
+   */
+  PathCacheStatistics get_statistics() const;
+  /**
+   * Log the hits, misses, evictions and size of the cache
+   */
+  void print_statistics() const;
+  /**
+   * Round an upper bound up to its bucket
+   * @param  delta upper bound
+   * @return the bucket bound, not smaller than delta
+   */
+  static double bucket_bound(double delta);
+  static const long DEFAULT_CACHE_ROWS = 10000000; /**< Maximum number of
+                                                 records cached by default */
+  static const int CACHE_SHARDS = 64; /**< Number of independently locked
+                                        parts of the cache */
+ private:
+  struct Entry {
+    double dist; // distance, max double if not reached within bound
+    double bound; // upper bound of the search
+    std::vector<EdgeIndex> path; // edges of the path if reached
+    bool referenced; // cleared when the clock hand passes the entry
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<unsigned long long, Entry> entries;
+    std::vector<unsigned long long> clock; // pairs cached
+    size_t hand = 0;
+    long rows = 0;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+  };
+  /**
+   * Find the shard of a pair
+   */
+  Shard &get_shard(unsigned long long key) const;
+  /**
+   * Look up the distance of a pair within delta
+   * @return true if the pair is answered by the cache
+   */
+  bool look_up(NodeIndex source, NodeIndex target, double delta,
+               double *dist);
+  /**
+   * Insert or replace the entry of a pair, evicting other pairs if the
+   * shard is full
+   */
+  void insert(NodeIndex source, NodeIndex target, Entry entry);
+  const NetworkGraph &graph;
+  long shard_rows; // maximum number of records cached in a shard
+  std::vector<std::unique_ptr<Shard>> shards;
+}; // PathCache
+
+/**
+ * Add the counters and the hit rate of a path cache to metrics
+ * @param cache path cache queried
+ * @param text  metrics updated
+ */
+void append_path_cache_metrics(const PathCache &cache,
+                               UTIL::MetricsText *text);
+} // NETWORK
+} // FMM
+
+#endif // FMM_PATH_CACHE_HPP
@@ -0,0 +1,179 @@
+/**
+ * Fast map matching.
+ *
+ * Implementation of the partition of a network into regions
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "network/region_partition.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+double Region::distance2(double x, double y) const {
+  double dx = std::max(std::max(min_x - x, x - max_x), 0.0);
+  double dy = std::max(std::max(min_y - y, y - max_y), 0.0);
+  return dx * dx + dy * dy;
+}
+
+RegionPartition RegionPartition::create_grid(
+    const std::vector<Point> &points, int rows, int columns, double margin) {
+  RegionPartition partition;
+  if (points.empty() || rows < 1 || columns < 1) return partition;
+  double min_x = std::numeric_limits<double>::max();
+  double min_y = std::numeric_limits<double>::max();
+  double max_x = std::numeric_limits<double>::lowest();
+  double max_y = std::numeric_limits<double>::lowest();
+  for (const Point &p : points) {
+    min_x = std::min(min_x, p.get<0>());
+    min_y = std::min(min_y, p.get<1>());
+    max_x = std::max(max_x, p.get<0>());
+    max_y = std::max(max_y, p.get<1>());
+  }
+  double width = (max_x - min_x) / columns;
+  double height = (max_y - min_y) / rows;
+  for (int row = 0; row < rows; ++row) {
+    for (int column = 0; column < columns; ++column) {
+      // The outer sides are the bounds, free of rounding errors
+      double right = column + 1 == columns ?
+                     max_x : min_x + (column + 1) * width;
+      double top = row + 1 == rows ? max_y : min_y + (row + 1) * height;
+      Region region{0, min_x + column * width, min_y + row * height,
+                    right, top, margin, ""};
+      partition.add_region(region);
+    }
+  }
+  return partition;
+}
+
+bool RegionPartition::read(const std::string &filename,
+                           RegionPartition *partition) {
+  std::ifstream ifs(filename);
+  if (!ifs) {
+    SPDLOG_CRITICAL("Cannot read region file {}", filename);
+    return false;
+  }
+  std::string line;
+  // Skip the header
+  std::getline(ifs, line);
+  while (std::getline(ifs, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    std::vector<std::string> fields;
+    std::istringstream iss(line);
+    std::string field;
+    while (std::getline(iss, field, ';')) fields.push_back(field);
+    Region region{};
+    bool valid = fields.size() >= 6;
+    try {
+      if (valid) {
+        region.index = std::stoi(fields[0]);
+        region.min_x = std::stod(fields[1]);
+        region.min_y = std::stod(fields[2]);
+        region.max_x = std::stod(fields[3]);
+        region.max_y = std::stod(fields[4]);
+        region.margin = std::stod(fields[5]);
+      }
+    } catch (const std::exception &) {
+      valid = false;
+    }
+    if (!valid || region.index != partition->size() ||
+        region.min_x > region.max_x || region.min_y > region.max_y ||
+        region.margin < 0) {
+      SPDLOG_CRITICAL("Invalid region {} in {}", line, filename);
+      return false;
+    }
+    // The url may be empty
+    if (fields.size() > 6) region.url = fields[6];
+    partition->add_region(region);
+  }
+  return true;
+}
+
+bool RegionPartition::write(const std::string &filename) const {
+  std::ofstream ofs(filename);
+  if (!ofs) {
+    SPDLOG_CRITICAL("Cannot write region file {}", filename);
+    return false;
+  }
+  ofs.precision(12);
+  ofs << "index;min_x;min_y;max_x;max_y;margin;url\n";
+  for (const Region &region : regions_) {
+    ofs << region.index << ";" << region.min_x << ";" << region.min_y
+        << ";" << region.max_x << ";" << region.max_y << ";"
+        << region.margin << ";" << region.url << "\n";
+  }
+  ofs.close();
+  if (!ofs) {
+    SPDLOG_CRITICAL("Cannot write region file {}", filename);
+    return false;
+  }
+  return true;
+}
+
+void RegionPartition::add_region(const Region &region) {
+  regions_.push_back(region);
+  regions_.back().index = regions_.size() - 1;
+}
+
+int RegionPartition::locate(double x, double y) const {
+  int nearest = -1;
+  double nearest_distance = std::numeric_limits<double>::max();
+  for (const Region &region : regions_) {
+    if (region.contains(x, y)) return region.index;
+    double distance = region.distance2(x, y);
+    if (distance < nearest_distance) {
+      nearest_distance = distance;
+      nearest = region.index;
+    }
+  }
+  return nearest;
+}
+
+std::vector<RegionSpan> RegionPartition::split(
+    const LineString &geom) const {
+  std::vector<RegionSpan> spans;
+  int num_points = geom.get_num_points();
+  if (regions_.empty() || num_points == 0) return spans;
+  RegionSpan span{locate(geom.get_x(0), geom.get_y(0)), 0, 0};
+  for (int i = 1; i < num_points; ++i) {
+    double x = geom.get_x(i);
+    double y = geom.get_y(i);
+    const Region &region = regions_[span.region];
+    if (region.contains(x, y, region.margin)) {
+      span.last = i;
+      continue;
+    }
+    spans.push_back(span);
+    int next = locate(x, y);
+    const Region &next_region = regions_[next];
+    // The previous point is shared if the next region covers it
+    int first = next_region.contains(geom.get_x(i - 1), geom.get_y(i - 1),
+                                     next_region.margin) ? i - 1 : i;
+    span = RegionSpan{next, first, i};
+  }
+  spans.push_back(span);
+  return spans;
+}
+
+std::vector<NodeIndex> RegionPartition::get_sources(
+    const std::vector<Point> &points, int index) const {
+  std::vector<NodeIndex> sources;
+  const Region &region = regions_[index];
+  for (std::size_t u = 0; u < points.size(); ++u) {
+    if (region.contains(points[u].get<0>(), points[u].get<1>(),
+                        2 * region.margin)) {
+      sources.push_back(u);
+    }
+  }
+  return sources;
+}
@@ -0,0 +1,142 @@
+/**
+ * Fast map matching.
+ *
+ * Partition of a network into overlapping regions served by different
+ * nodes
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_REGION_PARTITION_HPP
+#define FMM_REGION_PARTITION_HPP
+
+#include "network/type.hpp"
+#include "core/geometry.hpp"
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Region of a partition, whose core boxes tile the network. A region
+ * is matched by the server at its url, whose UBODT covers the sources
+ * within the core box expanded by twice the margin, so that the
+ * candidates of the points within the core box expanded by the margin
+ * are routed, given a margin larger than the search radius.
+ */
+struct Region {
+  int index; /**< Index of the region in its partition */
+  double min_x; /**< Minimum x of the core box */
+  double min_y; /**< Minimum y of the core box */
+  double max_x; /**< Maximum x of the core box */
+  double max_y; /**< Maximum y of the core box */
+  double margin; /**< Overlap with the neighbouring regions */
+  std::string url; /**< Url of the server matching the region, such as
+                        http://host:8080 */
+  /**
+   * Check if a point is within the core box expanded by a distance
+   */
+  bool contains(double x, double y, double expand = 0) const {
+    return x >= min_x - expand && x <= max_x + expand &&
+        y >= min_y - expand && y <= max_y + expand;
+  }
+  /**
+   * Squared distance from a point to the core box
+   */
+  double distance2(double x, double y) const;
+};
+
+/**
+ * Points [first, last] of a trajectory matched within a region. The
+ * last point of a span is the first point of the next span if both
+ * regions cover it, where the results are stitched.
+ */
+struct RegionSpan {
+  int region; /**< Index of the region */
+  int first; /**< First point */
+  int last; /**< Last point, included */
+};
+
+/**
+ * Partition of a network into regions with overlapping margins.
+ *
+ * A trajectory is split into spans of consecutive points, each within
+ * the expanded box of the region owning its first point. A span only
+ * moves to another region when a point leaves that box, so a trajectory
+ * along a boundary stays in one region.
+ */
+class RegionPartition {
+ public:
+  /**
+   * Create a grid partition of the bounding box of points
+   * @param points  nodes of the network
+   * @param rows    rows of the grid
+   * @param columns columns of the grid
+   * @param margin  overlap of the regions
+   * @return the partition, whose urls are empty
+   */
+  static RegionPartition create_grid(const std::vector<CORE::Point> &points,
+                                     int rows, int columns, double margin);
+  /**
+   * Read a partition from a file written by write
+   * @param  filename  region file
+   * @param  partition updated with the regions read
+   * @return false if the file cannot be read or is invalid
+   */
+  static bool read(const std::string &filename, RegionPartition *partition);
+  /**
+   * Write the partition to a CSV file of
+   * index;min_x;min_y;max_x;max_y;margin;url
+   * @param  filename region file
+   * @return false if the file cannot be written
+   */
+  bool write(const std::string &filename) const;
+  /**
+   * Add a region, whose index is set to its position
+   */
+  void add_region(const Region &region);
+  /**
+   * Get the regions
+   */
+  const std::vector<Region> &get_regions() const { return regions_; }
+  /**
+   * Get a region
+   */
+  Region &get_region(int index) { return regions_[index]; }
+  /**
+   * Get the number of regions
+   */
+  int size() const { return regions_.size(); }
+  /**
+   * Find the region owning a point, whose core box contains it or is
+   * the nearest to it
+   * @return the index of the region, -1 if there is no region
+   */
+  int locate(double x, double y) const;
+  /**
+   * Split a trajectory into the spans of its regions
+   * @param  geom geometry of the trajectory
+   * @return spans in the order of the points, empty if there is no
+   * region or no point
+   */
+  std::vector<RegionSpan> split(const CORE::LineString &geom) const;
+  /**
+   * Get the nodes whose paths within the region are stored in its UBODT
+   * @param  points nodes of the network
+   * @param  index  index of the region
+   * @return the indices of the nodes within the core box of the region
+   * expanded by twice its margin
+   */
+  std::vector<NodeIndex> get_sources(const std::vector<CORE::Point> &points,
+                                     int index) const;
+ private:
+  std::vector<Region> regions_;
+};
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_REGION_PARTITION_HPP
@@ -6,6 +6,18 @@ using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 
+NodeTree::NodeTree(const std::vector<Point> &points) {
+  std::vector<NodeItem> items;
+  items.reserve(points.size());
+  for (std::size_t i = 0; i < points.size(); ++i) {
+    items.push_back(std::make_pair(points[i], (unsigned int) i));
+  }
+  // The range constructor packs the tree, which is faster to build and
+  // to query than inserting the points one by one
+  rtree = BoostNodeRtree(items.begin(), items.end());
+  size = points.size();
+};
+
 unsigned int NodeTree::insert_point(Point &p){
   unsigned int id = size;
   rtree.insert(std::make_pair(p,id));
@@ -16,19 +28,31 @@ unsigned int NodeTree::insert_point(Point &p){
 // Id is the node returned within distance of radius
 int NodeTree::query_point_radius(Point &p,double radius,
                                  unsigned int *id){
+  return nearest(p,radius,id) ? 0 : -1;
+};
+
+bool NodeTree::nearest(const Point &p, double radius, unsigned int *id,
+                       double *dist) const {
   std::vector<NodeItem> returned_values;
   rtree.query(boost::geometry::index::nearest(p,1),
               std::back_inserter(returned_values));
   if (returned_values.empty()) {
-    return -1;
+    return false;
   }
-  if (boost::geometry::distance(returned_values[0].first,p)<=radius) {
-    *id = returned_values[0].second;
-    return 0;
+  double d = boost::geometry::distance(returned_values[0].first,p);
+  if (radius >= 0 && d > radius) {
+    return false;
   }
-  return -1;
+  *id = returned_values[0].second;
+  if (dist != nullptr) *dist = d;
+  return true;
 };
 
-int NodeTree::getSize(){
+int NodeTree::getSize() const {
   return size;
 };
+
+std::size_t NodeTree::get_memory_bytes() const {
+  // Items are stored in the leaves, plus about one node per 16 items
+  return (std::size_t) size * sizeof(NodeItem) * 17 / 16;
+};
@@ -7,13 +7,15 @@
  * @version: 2017.11.11
  */
 
-#ifndef FMM_RTREE_HPP /* Currently not used */
+#ifndef FMM_RTREE_HPP
 #define FMM_RTREE_HPP
 
 #include <boost/geometry/index/rtree.hpp>
 
 #include "core/geometry.hpp"
 
+#include <vector>
+
 namespace FMM {
 namespace NETWORK{
 /**
@@ -27,10 +29,21 @@ typedef boost::geometry::index::rtree<
     NodeItem,boost::geometry::index::quadratic<16> > BoostNodeRtree;
 
 /**
- * NodeRtree wrapper for the boost node rtree.
+ * NodeRtree wrapper for the boost node rtree, which indexes the vertices
+ * of a network to snap points to their nearest node.
+ *
+ * The tree is not changed by the queries, so that it is read by any
+ * number of threads once built.
  */
 class NodeTree {
 public:
+  NodeTree() = default;
+  /**
+   * Bulk load the points into a packed rtree, the id of a point being
+   * its index in the vector
+   * @param points points to be indexed
+   */
+  explicit NodeTree(const std::vector<FMM::CORE::Point> &points);
   /**
    * Insert a point into the rtree
    * @param p point to be inserted
@@ -47,11 +60,27 @@ public:
    */
   int query_point_radius(FMM::CORE::Point &p,double radius,
                          unsigned int *id);
+  /**
+   * Find the nearest point within a radius of a given point
+   * @param p the queried point
+   * @param radius search radius, negative for no limit
+   * @param id updated with the id of the nearest point
+   * @param dist updated with the distance to the nearest point if not
+   * nullptr
+   * @return true if a point is found within the radius
+   */
+  bool nearest(const FMM::CORE::Point &p, double radius, unsigned int *id,
+               double *dist = nullptr) const;
   /**
    * Get the number of nodes in the rtree
    * @return number of nodes
    */
-  int getSize();
+  int getSize() const;
+  /**
+   * Get the approximate bytes of the rtree, estimated from its items
+   * and the nodes of 16 items at most
+   */
+  std::size_t get_memory_bytes() const;
 private:
   BoostNodeRtree rtree;
   unsigned int size=0;
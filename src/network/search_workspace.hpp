@@ -0,0 +1,243 @@
+/**
+ * Fast map matching.
+ *
+ * Reusable workspace of shortest path search
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SEARCH_WORKSPACE_HPP
+#define FMM_SEARCH_WORKSPACE_HPP
+
+#include "network/type.hpp"
+#include "network/heap.hpp"
+#include "network/graph.hpp"
+#include "util/memory.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+/**
+ * State of a shortest path search, which is reused by the searches of a
+ * thread to avoid hashing and allocating per node.
+ *
+ * The distance, predecessor and path ends of a node are stored in arrays
+ * indexed by the node. A node is visited in the current search only if its
+ * stamp equals the stamp of the search, so that starting a search takes
+ * constant time. The queue is a 4-ary heap keeping the position of each
+ * node for decrease key, which pops nodes in the same order as Heap.
+ */
+class SearchWorkspace {
+ public:
+  /**
+   * Start a new search, where no node is visited
+   * @param num_nodes expected number of nodes of the graph, the arrays
+   * also grow when a larger node is visited
+   */
+  inline void reset(unsigned int num_nodes) {
+    if (stamps.size() < num_nodes) grow(num_nodes);
+    if (++stamp == 0) {
+      std::fill(stamps.begin(), stamps.end(), 0);
+      stamp = 1;
+    }
+    visited_nodes.clear();
+    heap.clear();
+    // The queue and the visited nodes grow during the previous search
+    tracker.update(get_bytes());
+  };
+  /**
+   * Check if a node is visited in the current search
+   * @param v node index
+   * @return true if the node is visited
+   */
+  inline bool visited(NodeIndex v) const {
+    return v < stamps.size() && stamps[v] == stamp;
+  };
+  /**
+   * Visit a node or update its distance and predecessor
+   * @param v    node index
+   * @param dist distance from the source
+   * @param prev previous node on the path from the source
+   */
+  inline void set(NodeIndex v, double dist, NodeIndex prev) {
+    if (!visited(v)) {
+      if (v >= stamps.size()) grow(v + 1);
+      stamps[v] = stamp;
+      positions[v] = NOT_IN_HEAP;
+      visited_nodes.push_back(v);
+    }
+    dists[v] = dist;
+    prevs[v] = prev;
+  };
+  /**
+   * Set the path ends of a visited node
+   * @param v    node index
+   * @param ends next node and the edges at both ends of the path
+   */
+  inline void set_ends(NodeIndex v, const PathEnds &ends) {
+    path_ends[v] = ends;
+  };
+  /**
+   * Get the distance of a visited node
+   */
+  inline double get_distance(NodeIndex v) const {
+    return dists[v];
+  };
+  /**
+   * Get the predecessor of a visited node
+   */
+  inline NodeIndex get_predecessor(NodeIndex v) const {
+    return prevs[v];
+  };
+  /**
+   * Get the path ends of a visited node, which are only set by the
+   * upper bounded search
+   */
+  inline const PathEnds &get_ends(NodeIndex v) const {
+    return path_ends[v];
+  };
+  /**
+   * Get the nodes visited in the current search in the order of the
+   * first visit, starting from the source
+   */
+  inline const std::vector<NodeIndex> &get_visited() const {
+    return visited_nodes;
+  };
+  /**
+   * Insert a visited node into the queue
+   * @param v     node index
+   * @param value key of the node
+   */
+  inline void push(NodeIndex v, double value) {
+    positions[v] = heap.size();
+    heap.push_back({v, value});
+    sift_up(heap.size() - 1);
+  };
+  /**
+   * Decrease the key of a node in the queue, which is inserted if not
+   * in the queue
+   * @param v     node index
+   * @param value key of the node
+   */
+  inline void decrease_key(NodeIndex v, double value) {
+    if (positions[v] == NOT_IN_HEAP) {
+      push(v, value);
+    } else {
+      heap[positions[v]].value = value;
+      sift_up(positions[v]);
+    }
+  };
+  /**
+   * Check if a visited node is in the queue
+   */
+  inline bool contain_node(NodeIndex v) const {
+    return positions[v] != NOT_IN_HEAP;
+  };
+  /**
+   * Get the node with the minimum key in the queue
+   */
+  inline const HeapNode &top() const {
+    return heap.front();
+  };
+  /**
+   * Remove the node with the minimum key from the queue
+   */
+  inline void pop() {
+    positions[heap.front().index] = NOT_IN_HEAP;
+    HeapNode last = heap.back();
+    heap.pop_back();
+    if (!heap.empty()) {
+      heap.front() = last;
+      positions[last.index] = 0;
+      sift_down(0);
+    }
+  };
+  /**
+   * Check if the queue is empty
+   */
+  inline bool empty() const {
+    return heap.empty();
+  };
+  /**
+   * Get the workspace of the calling thread
+   * @return a workspace owned by the thread
+   */
+  static SearchWorkspace &local() {
+    static thread_local SearchWorkspace workspace;
+    return workspace;
+  };
+  /**
+   * Get the bytes of a workspace per node of the graph searched, when
+   * every node is visited and queued
+   */
+  static size_t get_node_bytes() {
+    return 2 * sizeof(unsigned int) + sizeof(double) + sizeof(NodeIndex) +
+        sizeof(PathEnds) + sizeof(NodeIndex) + sizeof(HeapNode);
+  };
+ private:
+  enum : unsigned int { NOT_IN_HEAP = 0xFFFFFFFF, ARITY = 4 };
+  inline void grow(size_t n) {
+    size_t capacity = stamps.size() * 2 > n ? stamps.size() * 2 : n;
+    stamps.resize(capacity, 0);
+    dists.resize(capacity);
+    prevs.resize(capacity);
+    path_ends.resize(capacity);
+    positions.resize(capacity, NOT_IN_HEAP);
+    tracker.update(get_bytes());
+  };
+  inline size_t get_bytes() const {
+    return UTIL::get_vector_bytes(stamps) + UTIL::get_vector_bytes(dists) +
+        UTIL::get_vector_bytes(prevs) + UTIL::get_vector_bytes(path_ends) +
+        UTIL::get_vector_bytes(positions) +
+        UTIL::get_vector_bytes(visited_nodes) +
+        UTIL::get_vector_bytes(heap);
+  };
+  inline void sift_up(size_t i) {
+    HeapNode node = heap[i];
+    while (i > 0) {
+      size_t parent = (i - 1) / ARITY;
+      if (!(node < heap[parent])) break;
+      heap[i] = heap[parent];
+      positions[heap[i].index] = i;
+      i = parent;
+    }
+    heap[i] = node;
+    positions[node.index] = i;
+  };
+  inline void sift_down(size_t i) {
+    HeapNode node = heap[i];
+    size_t n = heap.size();
+    while (true) {
+      size_t first = i * ARITY + 1;
+      if (first >= n) break;
+      size_t last = first + ARITY < n ? first + ARITY : n;
+      size_t best = first;
+      for (size_t c = first + 1; c < last; ++c) {
+        if (heap[c] < heap[best]) best = c;
+      }
+      if (!(heap[best] < node)) break;
+      heap[i] = heap[best];
+      positions[heap[i].index] = i;
+      i = best;
+    }
+    heap[i] = node;
+    positions[node.index] = i;
+  };
+  unsigned int stamp = 0; // stamp of the current search
+  std::vector<unsigned int> stamps; // stamp of the last visit of each node
+  std::vector<double> dists;
+  std::vector<NodeIndex> prevs;
+  std::vector<PathEnds> path_ends;
+  std::vector<unsigned int> positions; // position of each node in heap
+  std::vector<NodeIndex> visited_nodes;
+  std::vector<HeapNode> heap;
+  // Bytes of the workspace in the totals of the routing workspaces
+  UTIL::WorkspaceTracker tracker{UTIL::ROUTING_WORKSPACE};
+}; // SearchWorkspace
+} // NETWORK
+} // FMM
+
+#endif // FMM_SEARCH_WORKSPACE_HPP
@@ -0,0 +1,156 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/snap_cache.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+namespace {
+
+// Mix a key into a well distributed 64 bit hash
+inline unsigned long long mix_key(unsigned long long h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+} // namespace
+
+std::size_t SnapCache::KeyHash::operator()(const Key &key) const {
+  unsigned long long radius_bits;
+  std::memcpy(&radius_bits, &key.radius, sizeof(radius_bits));
+  unsigned long long h = mix_key((unsigned long long) key.x);
+  h = mix_key(h ^ (unsigned long long) key.y);
+  return mix_key(h ^ radius_bits);
+}
+
+SnapCache::SnapCache(double resolution_arg, long max_items) :
+    resolution(resolution_arg),
+    shard_items(std::max<long>(max_items / CACHE_SHARDS, 1)) {
+  SPDLOG_INFO("Create snapping cache with resolution {} items {}",
+              resolution, max_items);
+  for (int i = 0; i < CACHE_SHARDS; ++i) {
+    shards.emplace_back(new Shard());
+  }
+}
+
+SnapCache::Key SnapCache::get_key(double px, double py,
+                                  double radius) const {
+  return Key{(long long) std::floor(px / resolution),
+             (long long) std::floor(py / resolution), radius};
+}
+
+SnapCache::Shard &SnapCache::get_shard(const Key &key) const {
+  return *shards[KeyHash()(key) & (CACHE_SHARDS - 1)];
+}
+
+BoostBox SnapCache::get_query_box(double px, double py,
+                                  double radius) const {
+  Key key = get_key(px, py, radius);
+  double x1 = key.x * resolution, y1 = key.y * resolution;
+  // The margin covers the rounding of the division placing a point on
+  // the border of its cell
+  double margin = radius + resolution * 1e-6;
+  return BoostBox(Point(x1 - margin, y1 - margin),
+                  Point(x1 + resolution + margin,
+                        y1 + resolution + margin));
+}
+
+bool SnapCache::look_up(double px, double py, double radius,
+                        std::vector<EdgeIndex> *items) {
+  Key key = get_key(px, py, radius);
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto iter = shard.entries.find(key);
+  if (iter == shard.entries.end()) {
+    ++shard.misses;
+    return false;
+  }
+  iter->second.referenced = true;
+  ++shard.hits;
+  *items = iter->second.items;
+  return true;
+}
+
+void SnapCache::insert(double px, double py, double radius,
+                       const std::vector<EdgeIndex> &items) {
+  Key key = get_key(px, py, radius);
+  Shard &shard = get_shard(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  // Another point of the cell may have been inserted by another thread,
+  // with the same items
+  if (shard.entries.find(key) != shard.entries.end()) return;
+  shard.entries.emplace(key, Entry{items, true});
+  shard.clock.push_back(key);
+  shard.items += items.size() + 1;
+  while (shard.items > shard_items && shard.clock.size() > 1) {
+    if (shard.hand >= shard.clock.size()) shard.hand = 0;
+    Key victim = shard.clock[shard.hand];
+    Entry &victim_entry = shard.entries[victim];
+    if (victim == key || victim_entry.referenced) {
+      victim_entry.referenced = false;
+      ++shard.hand;
+    } else {
+      shard.items -= victim_entry.items.size() + 1;
+      shard.entries.erase(victim);
+      shard.clock[shard.hand] = shard.clock.back();
+      shard.clock.pop_back();
+      ++shard.evictions;
+    }
+  }
+}
+
+SnapCacheStatistics SnapCache::get_statistics() const {
+  SnapCacheStatistics statistics;
+  for (const auto &shard : shards) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    statistics.hits += shard->hits;
+    statistics.misses += shard->misses;
+    statistics.evictions += shard->evictions;
+    statistics.cells += shard->entries.size();
+    statistics.items += shard->items;
+  }
+  return statistics;
+}
+
+void SnapCache::print_statistics() const {
+  SnapCacheStatistics statistics = get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  SPDLOG_INFO("Snapping cache hits {} misses {} hit rate {} evictions {}",
+              statistics.hits, statistics.misses,
+              queries > 0 ? statistics.hits / (double) queries : 0.0,
+              statistics.evictions);
+  SPDLOG_INFO("Snapping cache cells cached {} items cached {}",
+              statistics.cells, statistics.items);
+}
+
+void NETWORK::append_snap_cache_metrics(const SnapCache &cache,
+                                        UTIL::MetricsText *text) {
+  SnapCacheStatistics statistics = cache.get_statistics();
+  long queries = statistics.hits + statistics.misses;
+  text->counter("fmm_snap_cache_hits_total",
+                "Points whose cell is found in the snapping cache",
+                statistics.hits);
+  text->counter("fmm_snap_cache_misses_total",
+                "Points whose cell is queried on a miss of the snapping "
+                "cache", statistics.misses);
+  text->counter("fmm_snap_cache_evictions_total",
+                "Cells evicted from the snapping cache",
+                statistics.evictions);
+  text->gauge("fmm_snap_cache_cells", "Cells cached by the snapping cache",
+              statistics.cells);
+  text->gauge("fmm_snap_cache_hit_ratio",
+              "Share of the points found in the snapping cache",
+              queries > 0 ? statistics.hits / (double) queries : 0.0);
+}
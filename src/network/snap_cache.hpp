@@ -0,0 +1,156 @@
+/**
+ * Fast map matching.
+ *
+ * Cache of the edges near the quantized locations of the points, which
+ * is shared by the trajectories matched.
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SNAP_CACHE_HPP
+#define FMM_SNAP_CACHE_HPP
+
+#include "network/type.hpp"
+#include "network/spatial_index.hpp"
+#include "util/metrics.hpp"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Counters of a snapping cache
+ */
+struct SnapCacheStatistics {
+  long hits = 0; /**< Points whose cell is found in the cache */
+  long misses = 0; /**< Points whose cell is queried in the index */
+  long evictions = 0; /**< Cells evicted */
+  long cells = 0; /**< Cells cached */
+  long items = 0; /**< Items of the index cached */
+};
+
+/**
+ * Items of the spatial index near the cells of a grid of a given
+ * resolution, for the points repeated at nearly the same location such as
+ * the depots, the bus stops and the parking lots.
+ *
+ * A cell and a search radius map to the items whose boxes intersect the
+ * cell expanded by the radius, which contain all the items within the
+ * radius of any point of the cell. The points of a cell then only
+ * project themselves on these items, so their candidates and distances
+ * are exactly the ones of a full query. The cache is split into shards
+ * locked independently, and a shard evicts its cells with the CLOCK
+ * algorithm when it holds too many items. It can be queried by multiple
+ * threads.
+ */
+class SnapCache {
+ public:
+  /**
+   * Create an empty cache
+   * @param resolution size of the cells in the unit of the network
+   * @param max_items  maximum number of items cached, where each cell
+   * and each item near it count as one
+   */
+  SnapCache(double resolution, long max_items = DEFAULT_CACHE_ITEMS);
+  /**
+   * Get the query box of the cell of a point, which is the cell expanded
+   * by the radius
+   * @param  px     x coordinate of the point
+   * @param  py     y coordinate of the point
+   * @param  radius search radius
+   * @return the box of the items cached for the cell
+   */
+  BoostBox get_query_box(double px, double py, double radius) const;
+  /**
+   * Look up the items near the cell of a point
+   * @param  px     x coordinate of the point
+   * @param  py     y coordinate of the point
+   * @param  radius search radius
+   * @param  items  updated with the items if the cell is cached
+   * @return true if the cell is cached with the radius
+   */
+  bool look_up(double px, double py, double radius,
+               std::vector<EdgeIndex> *items);
+  /**
+   * Insert the items near the cell of a point, evicting other cells if
+   * the shard is full
+   * @param px     x coordinate of the point
+   * @param py     y coordinate of the point
+   * @param radius search radius
+   * @param items  items returned by the query of get_query_box
+   */
+  void insert(double px, double py, double radius,
+              const std::vector<EdgeIndex> &items);
+  /**
+   * Get the size of the cells
+   */
+  inline double get_resolution() const {
+    return resolution;
+  };
+  /**
+   * Get the counters of the cache
+   */
+  SnapCacheStatistics get_statistics() const;
+  /**
+   * Log the hits, misses, evictions and size of the cache
+   */
+  void print_statistics() const;
+  static const long DEFAULT_CACHE_ITEMS = 10000000; /**< Maximum number of
+                                                 items cached by default */
+  static const int CACHE_SHARDS = 64; /**< Number of independently locked
+                                        parts of the cache */
+ private:
+  struct Key {
+    long long x; // column of the cell
+    long long y; // row of the cell
+    double radius; // search radius
+    inline bool operator==(const Key &other) const {
+      return x == other.x && y == other.y && radius == other.radius;
+    };
+  };
+  struct KeyHash {
+    std::size_t operator()(const Key &key) const;
+  };
+  struct Entry {
+    std::vector<EdgeIndex> items; // items near the cell
+    bool referenced; // cleared when the clock hand passes the entry
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<Key, Entry, KeyHash> entries;
+    std::vector<Key> clock; // cells cached
+    size_t hand = 0;
+    long items = 0;
+    long hits = 0;
+    long misses = 0;
+    long evictions = 0;
+  };
+  /**
+   * Get the key of the cell of a point
+   */
+  Key get_key(double px, double py, double radius) const;
+  /**
+   * Find the shard of a cell
+   */
+  Shard &get_shard(const Key &key) const;
+  double resolution;
+  long shard_items; // maximum number of items cached in a shard
+  std::vector<std::unique_ptr<Shard>> shards;
+}; // SnapCache
+
+/**
+ * Add the counters and the hit rate of a snapping cache to metrics
+ * @param cache snapping cache queried
+ * @param text  metrics updated
+ */
+void append_snap_cache_metrics(const SnapCache &cache,
+                               UTIL::MetricsText *text);
+} // NETWORK
+} // FMM
+
+#endif // FMM_SNAP_CACHE_HPP
@@ -0,0 +1,582 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "network/spatial_index.hpp"
+#include "algorithm/geom_algorithm.hpp"
+#include "algorithm/geometry_kernel.hpp"
+#include "util/debug.hpp"
+#include "util/parallel.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/geometry/index/rtree.hpp>
+#include <boost/function_output_iterator.hpp>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+namespace {
+namespace bgi = boost::geometry::index;
+
+typedef std::pair<BoostBox, EdgeIndex> Item;
+typedef bgi::rtree<Item, bgi::dynamic_quadratic> QuadraticRtree;
+typedef bgi::rtree<Item, bgi::dynamic_linear> LinearRtree;
+typedef bgi::rtree<Item, bgi::dynamic_rstar> RstarRtree;
+
+// Build an rtree by inserting the items one by one
+template <typename Tree, typename Parameters>
+std::unique_ptr<Tree> insert_items(const std::vector<Item> &items,
+                                   const Parameters &parameters) {
+  std::unique_ptr<Tree> tree(new Tree(parameters));
+  for (const Item &item : items) {
+    tree->insert(item);
+  }
+  return tree;
+}
+
+// Append the edges of a rtree intersecting a box
+template <typename Tree>
+void query_tree(const Tree &tree, const BoostBox &box,
+                std::vector<EdgeIndex> *edges) {
+  tree.query(bgi::intersects(box), boost::make_function_output_iterator(
+      [edges](const Item &item) { edges->push_back(item.second); }));
+}
+
+// Visit the edges of a rtree by distance, the nodes are expanded as the
+// iterator advances
+template <typename Tree>
+void visit_tree_nearest(const Tree &tree, const Point &point,
+                        const std::function<bool(EdgeIndex, double)> &visit) {
+  if (tree.empty()) return;
+  for (auto it = tree.qbegin(bgi::nearest(point, tree.size()));
+       it != tree.qend(); ++it) {
+    if (!visit(it->second, boost::geometry::distance(point, it->first))) {
+      return;
+    }
+  }
+}
+
+// Header of a flat rtree, followed by the first entry of each node and
+// the end of the entries, padded to 8 bytes, the min x, min y, max x and
+// max y of the entries and the items, padded to 8 bytes
+struct FlatRtreeHeader {
+  char magic[8];
+  int max_elements;
+  unsigned int padding;
+  long long num_items;
+  long long num_nodes;
+};
+const char FLAT_RTREE_MAGIC[8] = {'F', 'M', 'M', 'F', 'L', 'A', 'T', 'R'};
+
+size_t get_padded_size(size_t bytes) {
+  return (bytes + 7) / 8 * 8;
+}
+
+long long get_num_entries(long long num_nodes, long long num_items) {
+  return num_nodes > 0 ? num_nodes - 1 + num_items : 0;
+}
+
+size_t get_flat_rtree_size(long long num_nodes, long long num_items) {
+  return sizeof(FlatRtreeHeader) +
+      get_padded_size(sizeof(unsigned int) * (num_nodes + 1)) +
+      4 * sizeof(double) * get_num_entries(num_nodes, num_items) +
+      get_padded_size(sizeof(EdgeIndex) * num_items);
+}
+}
+
+struct RtreeIndex::Impl {
+  // Rtree used by the packing and quadratic algorithms
+  std::unique_ptr<QuadraticRtree> rtree;
+  std::unique_ptr<LinearRtree> linear_rtree;
+  std::unique_ptr<RstarRtree> rstar_rtree;
+  size_t num_boxes = 0;
+  size_t max_elements = 16;
+  bool packed = false;
+};
+
+RtreeIndex::RtreeIndex(const std::vector<BoostBox> &boxes,
+                       const SpatialIndexOptions &options) :
+    impl(new Impl()) {
+  SPDLOG_DEBUG("Create boost rtree with algorithm {} max elements {}",
+               options.algorithm, options.max_elements);
+  std::vector<Item> items;
+  items.reserve(boxes.size());
+  for (std::size_t i = 0; i < boxes.size(); ++i) {
+    items.push_back(std::make_pair(boxes[i], (EdgeIndex) i));
+  }
+  size_t max_elements = options.max_elements;
+  impl->num_boxes = boxes.size();
+  impl->max_elements = max_elements;
+  impl->packed = options.algorithm != LINEAR &&
+      options.algorithm != QUADRATIC && options.algorithm != RSTAR;
+  switch (options.algorithm) {
+    case LINEAR:
+      impl->linear_rtree = insert_items<LinearRtree>(
+          items, bgi::dynamic_linear(max_elements));
+      break;
+    case QUADRATIC:
+      impl->rtree = insert_items<QuadraticRtree>(
+          items, bgi::dynamic_quadratic(max_elements));
+      break;
+    case RSTAR:
+      impl->rstar_rtree = insert_items<RstarRtree>(
+          items, bgi::dynamic_rstar(max_elements));
+      break;
+    default:
+      // Bulk loading sorts the boxes into fully packed nodes, which is
+      // faster to build and to query than inserting one by one
+      impl->rtree.reset(new QuadraticRtree(
+          items.begin(), items.end(), bgi::dynamic_quadratic(max_elements)));
+  }
+  SPDLOG_DEBUG("Create boost rtree done");
+}
+
+RtreeIndex::~RtreeIndex() = default;
+
+void RtreeIndex::query(const BoostBox &box,
+                       std::vector<EdgeIndex> *edges) const {
+  if (impl->linear_rtree) {
+    query_tree(*impl->linear_rtree, box, edges);
+  } else if (impl->rstar_rtree) {
+    query_tree(*impl->rstar_rtree, box, edges);
+  } else {
+    query_tree(*impl->rtree, box, edges);
+  }
+}
+
+bool RtreeIndex::visit_nearest(
+    double x, double y,
+    const std::function<bool(EdgeIndex, double)> &visit) const {
+  Point point(x, y);
+  if (impl->linear_rtree) {
+    visit_tree_nearest(*impl->linear_rtree, point, visit);
+  } else if (impl->rstar_rtree) {
+    visit_tree_nearest(*impl->rstar_rtree, point, visit);
+  } else {
+    visit_tree_nearest(*impl->rtree, point, visit);
+  }
+  return true;
+}
+
+size_t RtreeIndex::get_memory_bytes() const {
+  // The nodes are full when packed and about 70% full when inserted,
+  // each storing max_elements + 1 elements and a few pointers
+  double fill = impl->packed ? 1.0 : 0.7;
+  double per_node = std::max(fill * impl->max_elements, 2.0);
+  size_t leaf_bytes = (impl->max_elements + 1) * sizeof(Item) +
+      4 * sizeof(void *);
+  size_t internal_bytes = (impl->max_elements + 1) *
+      (sizeof(BoostBox) + sizeof(void *)) + 4 * sizeof(void *);
+  double nodes = std::ceil(impl->num_boxes / per_node);
+  size_t bytes = (size_t) nodes * leaf_bytes;
+  while (nodes > 1) {
+    nodes = std::ceil(nodes / per_node);
+    bytes += (size_t) nodes * internal_bytes;
+  }
+  return bytes;
+}
+
+FlatRtreeIndex::FlatRtreeIndex(const std::vector<BoostBox> &boxes,
+                               int max_elements) {
+  int capacity = std::max(max_elements, 2);
+  long long num_items = boxes.size();
+  // Number of nodes of each level from the leaves to the root
+  std::vector<long long> level_nodes;
+  for (long long count = num_items; count > 0;) {
+    count = (count + capacity - 1) / capacity;
+    level_nodes.push_back(count);
+    if (count == 1) break;
+  }
+  long long num_nodes = 0;
+  for (long long nodes : level_nodes) num_nodes += nodes;
+  long long num_entries = get_num_entries(num_nodes, num_items);
+  SPDLOG_DEBUG("Create flat rtree of {} nodes in {} levels", num_nodes,
+               level_nodes.size());
+  size_t size = get_flat_rtree_size(num_nodes, num_items);
+  buffer_.assign(size / 8, 0);
+  char *data = (char *) buffer_.data();
+  FlatRtreeHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, FLAT_RTREE_MAGIC, sizeof(FLAT_RTREE_MAGIC));
+  header.max_elements = capacity;
+  header.num_items = num_items;
+  header.num_nodes = num_nodes;
+  memcpy(data, &header, sizeof(header));
+  unsigned int *node_first = (unsigned int *) (data + sizeof(header));
+  double *min_x = (double *) (data + sizeof(header) + get_padded_size(
+      sizeof(unsigned int) * (num_nodes + 1)));
+  double *min_y = min_x + num_entries;
+  double *max_x = min_y + num_entries;
+  double *max_y = max_x + num_entries;
+  EdgeIndex *items = (EdgeIndex *) (max_y + num_entries);
+  int threads = UTIL::get_parallel_threads(num_items);
+  if (num_items > 0) {
+    // The items are packed along the Hilbert curve of their centers
+    double x1 = DBL_MAX, y1 = DBL_MAX, x2 = -DBL_MAX, y2 = -DBL_MAX;
+    #pragma omp parallel for num_threads(threads) \
+        reduction(min:x1,y1) reduction(max:x2,y2)
+    for (long long i = 0; i < num_items; ++i) {
+      const BoostBox &box = boxes[i];
+      double cx = (box.min_corner().get<0>() + box.max_corner().get<0>()) / 2;
+      double cy = (box.min_corner().get<1>() + box.max_corner().get<1>()) / 2;
+      x1 = std::min(x1, cx);
+      y1 = std::min(y1, cy);
+      x2 = std::max(x2, cx);
+      y2 = std::max(y2, cy);
+    }
+    double scale = 65535.0 / std::max(std::max(x2 - x1, y2 - y1), DBL_MIN);
+    std::vector<unsigned long long> keys(num_items);
+    std::vector<EdgeIndex> order(num_items);
+    #pragma omp parallel for num_threads(threads)
+    for (long long i = 0; i < num_items; ++i) {
+      const BoostBox &box = boxes[i];
+      double cx = (box.min_corner().get<0>() + box.max_corner().get<0>()) / 2;
+      double cy = (box.min_corner().get<1>() + box.max_corner().get<1>()) / 2;
+      keys[i] = ALGORITHM::hilbert_index((unsigned int) ((cx - x1) * scale),
+                                         (unsigned int) ((cy - y1) * scale));
+      order[i] = i;
+    }
+    UTIL::parallel_stable_sort(order.begin(), order.end(),
+                               [&keys](EdgeIndex a, EdgeIndex b) {
+                                 return keys[a] < keys[b];
+                               });
+    #pragma omp parallel for num_threads(threads)
+    for (long long j = 0; j < num_items; ++j) {
+      const BoostBox &box = boxes[order[j]];
+      long long entry = num_nodes - 1 + j;
+      items[j] = order[j];
+      min_x[entry] = box.min_corner().get<0>();
+      min_y[entry] = box.min_corner().get<1>();
+      max_x[entry] = box.max_corner().get<0>();
+      max_y[entry] = box.max_corner().get<1>();
+    }
+  }
+  // Node i of a level has the children capacity * i onwards of the next
+  // level, or the items capacity * i onwards for a leaf
+  std::vector<long long> level_start(level_nodes.size());
+  long long start = 0;
+  for (int l = (int) level_nodes.size() - 1; l >= 0; --l) {
+    level_start[l] = start;
+    start += level_nodes[l];
+  }
+  for (int l = (int) level_nodes.size() - 1; l >= 0; --l) {
+    for (long long i = 0; i < level_nodes[l]; ++i) {
+      node_first[level_start[l] + i] = (l > 0) ?
+          level_start[l - 1] + capacity * i - 1 :
+          num_nodes - 1 + capacity * i;
+    }
+  }
+  node_first[num_nodes] = num_entries;
+  // The entries of a node follow its own entry, so the boxes are
+  // computed from the leaves up, with the nodes of a level in parallel
+  for (int l = 0; l < (int) level_nodes.size(); ++l) {
+    long long first_node = std::max(level_start[l], 1LL);
+    long long end_node = level_start[l] + level_nodes[l];
+    #pragma omp parallel for num_threads(threads)
+    for (long long n = first_node; n < end_node; ++n) {
+      unsigned int first = node_first[n], end = node_first[n + 1];
+      min_x[n - 1] = *std::min_element(min_x + first, min_x + end);
+      min_y[n - 1] = *std::min_element(min_y + first, min_y + end);
+      max_x[n - 1] = *std::max_element(max_x + first, max_x + end);
+      max_y[n - 1] = *std::max_element(max_y + first, max_y + end);
+    }
+  }
+  set_arrays(data, size);
+  SPDLOG_DEBUG("Create flat rtree done");
+}
+
+FlatRtreeIndex::~FlatRtreeIndex() {
+  if (map_addr_ != nullptr) munmap(map_addr_, map_size_);
+}
+
+std::unique_ptr<FlatRtreeIndex> FlatRtreeIndex::map_file(
+    const std::string &filename, long long offset, long long size,
+    int max_elements) {
+  std::unique_ptr<FlatRtreeIndex> index;
+  if (offset < 0 || size <= 0 || offset % sysconf(_SC_PAGESIZE) != 0) {
+    return index;
+  }
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) return index;
+  struct stat stat_buf;
+  void *addr = MAP_FAILED;
+  // A mapping beyond the end of the file would fault when read
+  if (fstat(fd, &stat_buf) == 0 && offset + size <= stat_buf.st_size) {
+    addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, offset);
+  }
+  close(fd);
+  if (addr == MAP_FAILED) return index;
+  index.reset(new FlatRtreeIndex());
+  index->map_addr_ = addr;
+  index->map_size_ = size;
+  if (!index->set_arrays((const char *) addr, size) ||
+      index->max_elements_ != max_elements) {
+    SPDLOG_WARN("Flat rtree in {} is invalid", filename);
+    index.reset();
+  }
+  return index;
+}
+
+bool FlatRtreeIndex::set_arrays(const char *data, size_t size) {
+  if (size < sizeof(FlatRtreeHeader)) return false;
+  FlatRtreeHeader header;
+  memcpy(&header, data, sizeof(header));
+  // The counts are bounded by the size before computing the layout
+  if (memcmp(header.magic, FLAT_RTREE_MAGIC, sizeof(FLAT_RTREE_MAGIC)) != 0 ||
+      header.max_elements < 2 || header.num_nodes < 0 ||
+      header.num_items < 0 || header.num_nodes > (long long) size ||
+      header.num_items > (long long) size ||
+      (header.num_nodes == 0) != (header.num_items == 0) ||
+      size != get_flat_rtree_size(header.num_nodes, header.num_items)) {
+    return false;
+  }
+  long long num_entries = get_num_entries(header.num_nodes,
+                                          header.num_items);
+  const unsigned int *node_first =
+      (const unsigned int *) (data + sizeof(header));
+  const double *min_x = (const double *) (data + sizeof(header) +
+      get_padded_size(sizeof(unsigned int) * (header.num_nodes + 1)));
+  const EdgeIndex *items = (const EdgeIndex *) (min_x + 4 * num_entries);
+  // The entries of a node are after the entry of the node, hence the
+  // traversal cannot loop, and are at most max elements
+  if (node_first[0] != 0 || node_first[header.num_nodes] != num_entries) {
+    return false;
+  }
+  for (long long n = 0; n < header.num_nodes; ++n) {
+    if (node_first[n] < n || node_first[n + 1] < node_first[n] ||
+        node_first[n + 1] - node_first[n] >
+            (unsigned int) header.max_elements) {
+      return false;
+    }
+  }
+  for (long long j = 0; j < header.num_items; ++j) {
+    if (items[j] >= header.num_items) return false;
+  }
+  data_ = data;
+  data_size_ = size;
+  max_elements_ = header.max_elements;
+  num_items_ = header.num_items;
+  num_nodes_ = header.num_nodes;
+  node_first_ = node_first;
+  min_x_ = min_x;
+  min_y_ = min_x + num_entries;
+  max_x_ = min_y_ + num_entries;
+  max_y_ = max_x_ + num_entries;
+  items_ = items;
+  return true;
+}
+
+void FlatRtreeIndex::query(const BoostBox &box,
+                           std::vector<EdgeIndex> *edges) const {
+  if (num_nodes_ == 0) return;
+  static thread_local std::vector<unsigned int> stack;
+  static thread_local std::vector<int> hits;
+  if (hits.size() < (size_t) max_elements_) hits.resize(max_elements_);
+  double x1 = box.min_corner().get<0>(), y1 = box.min_corner().get<1>();
+  double x2 = box.max_corner().get<0>(), y2 = box.max_corner().get<1>();
+  unsigned int first_item = num_nodes_ - 1;
+  stack.clear();
+  stack.push_back(0);
+  while (!stack.empty()) {
+    unsigned int node = stack.back();
+    stack.pop_back();
+    unsigned int first = node_first_[node];
+    int num_hits = ALGORITHM::boxes_intersect(
+        min_x_ + first, min_y_ + first, max_x_ + first, max_y_ + first,
+        node_first_[node + 1] - first, x1, y1, x2, y2, hits.data());
+    for (int h = 0; h < num_hits; ++h) {
+      unsigned int entry = first + hits[h];
+      if (entry < first_item) {
+        stack.push_back(entry + 1);
+      } else {
+        edges->push_back(items_[entry - first_item]);
+      }
+    }
+  }
+}
+
+bool FlatRtreeIndex::visit_nearest(
+    double x, double y,
+    const std::function<bool(EdgeIndex, double)> &visit) const {
+  if (num_nodes_ == 0) return true;
+  // Min heap of the entries by the distance to their boxes
+  typedef std::pair<double, unsigned int> QueueItem;
+  std::vector<QueueItem> queue;
+  std::greater<QueueItem> compare;
+  unsigned int first_item = num_nodes_ - 1;
+  auto expand = [&](unsigned int node) {
+    for (unsigned int e = node_first_[node]; e < node_first_[node + 1];
+         ++e) {
+      double dx = std::max(std::max(min_x_[e] - x, x - max_x_[e]), 0.0);
+      double dy = std::max(std::max(min_y_[e] - y, y - max_y_[e]), 0.0);
+      queue.push_back(QueueItem(std::sqrt(dx * dx + dy * dy), e));
+      std::push_heap(queue.begin(), queue.end(), compare);
+    }
+  };
+  expand(0);
+  while (!queue.empty()) {
+    std::pop_heap(queue.begin(), queue.end(), compare);
+    QueueItem item = queue.back();
+    queue.pop_back();
+    if (item.second < first_item) {
+      expand(item.second + 1);
+    } else if (!visit(items_[item.second - first_item], item.first)) {
+      break;
+    }
+  }
+  return true;
+}
+
+size_t FlatRtreeIndex::get_memory_bytes() const {
+  return data_size_;
+}
+
+GridIndex::GridIndex(const std::vector<double> &geom_x,
+                     const std::vector<double> &geom_y,
+                     const std::vector<long long> &geom_offsets,
+                     double cell_size) {
+  long long num_edges = geom_offsets.empty() ? 0 : geom_offsets.size() - 1;
+  if (geom_x.empty()) {
+    cell_offsets.assign(1, 0);
+    return;
+  }
+  double max_x, max_y;
+  min_x = max_x = geom_x[0];
+  min_y = max_y = geom_y[0];
+  for (std::size_t j = 0; j < geom_x.size(); ++j) {
+    min_x = std::min(min_x, geom_x[j]);
+    max_x = std::max(max_x, geom_x[j]);
+    min_y = std::min(min_y, geom_y[j]);
+    max_y = std::max(max_y, geom_y[j]);
+  }
+  if (cell_size <= 0) {
+    // Mean extent of the edges, so that an edge covers a few cells
+    double sum = 0;
+    for (long long e = 0; e < num_edges; ++e) {
+      long long first = geom_offsets[e], end = geom_offsets[e + 1];
+      if (first == end) continue;
+      auto x = std::minmax_element(geom_x.begin() + first,
+                                   geom_x.begin() + end);
+      auto y = std::minmax_element(geom_y.begin() + first,
+                                   geom_y.begin() + end);
+      sum += std::max(*x.second - *x.first, *y.second - *y.first);
+    }
+    cell_size = (num_edges > 0) ? sum / num_edges : 0;
+  }
+  if (cell_size <= 0) {
+    cell_size = std::max(std::max(max_x - min_x, max_y - min_y), 1.0);
+  }
+  // Enlarge the cells until the grid fits in MAX_CELLS
+  while (true) {
+    double nx = std::floor((max_x - min_x) / cell_size) + 1;
+    double ny = std::floor((max_y - min_y) / cell_size) + 1;
+    if (nx * ny <= MAX_CELLS) {
+      num_x = (int) nx;
+      num_y = (int) ny;
+      break;
+    }
+    cell_size *= 2;
+  }
+  cell_size_ = cell_size;
+  long long num_cells = (long long) num_x * num_y;
+  SPDLOG_DEBUG("Create grid index of {} x {} cells with cell size {}",
+               num_x, num_y, cell_size_);
+  // Two passes over the segments, counting and then filling the cells.
+  // The edges are visited in order, hence the last edge registered in a
+  // cell removes the duplicates of consecutive segments and the edges of
+  // a cell are sorted.
+  const EdgeIndex none = std::numeric_limits<EdgeIndex>::max();
+  std::vector<EdgeIndex> last_edge;
+  cell_offsets.assign(num_cells + 1, 0);
+  for (int pass = 0; pass < 2; ++pass) {
+    last_edge.assign(num_cells, none);
+    for (long long e = 0; e < num_edges; ++e) {
+      long long first = geom_offsets[e], end = geom_offsets[e + 1];
+      for (long long j = first; j < end; ++j) {
+        // A single point edge is registered by its point
+        long long k = (j + 1 < end) ? j + 1 : j;
+        if (k == j && j > first) break;
+        int x0, x1, y0, y1;
+        get_cell_range(std::min(geom_x[j], geom_x[k]),
+                       std::max(geom_x[j], geom_x[k]), min_x, num_x,
+                       &x0, &x1);
+        get_cell_range(std::min(geom_y[j], geom_y[k]),
+                       std::max(geom_y[j], geom_y[k]), min_y, num_y,
+                       &y0, &y1);
+        for (int y = y0; y <= y1; ++y) {
+          for (int x = x0; x <= x1; ++x) {
+            long long cell = (long long) y * num_x + x;
+            if (last_edge[cell] == (EdgeIndex) e) continue;
+            last_edge[cell] = e;
+            if (pass == 0) {
+              ++cell_offsets[cell + 1];
+            } else {
+              cell_edges[cell_offsets[cell]++] = e;
+            }
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (long long c = 0; c < num_cells; ++c) {
+        cell_offsets[c + 1] += cell_offsets[c];
+      }
+      cell_edges.resize(cell_offsets[num_cells]);
+    } else {
+      // The offsets are shifted to the end of each cell by the filling
+      for (long long c = num_cells; c > 0; --c) {
+        cell_offsets[c] = cell_offsets[c - 1];
+      }
+      cell_offsets[0] = 0;
+    }
+  }
+  SPDLOG_DEBUG("Create grid index done with {} entries", cell_edges.size());
+}
+
+void GridIndex::get_cell_range(double min, double max, double origin,
+                               int num, int *first, int *last) const {
+  double a = std::floor((min - origin) / cell_size_);
+  double b = std::floor((max - origin) / cell_size_);
+  // Clamped before the cast, as a query box may be far from the grid
+  *first = (int) std::min(std::max(a, 0.0), (double) num);
+  *last = (int) std::max(std::min(b, (double) num - 1), -1.0);
+}
+
+void GridIndex::query(const BoostBox &box,
+                      std::vector<EdgeIndex> *edges) const {
+  if (cell_edges.empty()) return;
+  int x0, x1, y0, y1;
+  get_cell_range(box.min_corner().get<0>(), box.max_corner().get<0>(),
+                 min_x, num_x, &x0, &x1);
+  get_cell_range(box.min_corner().get<1>(), box.max_corner().get<1>(),
+                 min_y, num_y, &y0, &y1);
+  if (x0 > x1 || y0 > y1) return;
+  std::size_t start = edges->size();
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      long long cell = (long long) y * num_x + x;
+      edges->insert(edges->end(), cell_edges.begin() + cell_offsets[cell],
+                    cell_edges.begin() + cell_offsets[cell + 1]);
+    }
+  }
+  // Each cell is sorted, so a single cell needs no deduplication
+  if (x0 == x1 && y0 == y1) return;
+  std::sort(edges->begin() + start, edges->end());
+  edges->erase(std::unique(edges->begin() + start, edges->end()),
+               edges->end());
+}
+
+size_t GridIndex::get_memory_bytes() const {
+  return cell_offsets.capacity() * sizeof(long long) +
+      cell_edges.capacity() * sizeof(EdgeIndex);
+}
@@ -0,0 +1,321 @@
+/**
+ * Fast map matching.
+ *
+ * Spatial index of the road edges used in candidate search
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_SPATIAL_INDEX_HPP
+#define FMM_SPATIAL_INDEX_HPP
+
+#include "network/type.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/geometry/geometries/box.hpp>
+
+namespace FMM {
+namespace NETWORK {
+/**
+ * Type of the spatial index of road edges
+ */
+enum SpatialIndexType {
+  RTREE = 0, /**< Boost rtree of the edge boxes */
+  GRID = 1, /**< Uniform grid of the edge segments */
+  FLAT_RTREE = 2 /**< Read-only rtree of the edge boxes in flat arrays */
+};
+
+/**
+ * Construction algorithm of the rtree of road edges
+ */
+enum RtreeAlgorithm {
+  PACKING = 0, /**< Bulk loaded with the packing algorithm */
+  LINEAR = 1, /**< Edges inserted one by one with the linear split */
+  QUADRATIC = 2, /**< Edges inserted one by one with the quadratic split */
+  RSTAR = 3 /**< Edges inserted one by one with the R* split and forced
+                reinsertion */
+};
+
+/**
+ * Options of the spatial index of road edges
+ */
+struct SpatialIndexOptions {
+  SpatialIndexType type = RTREE; /**< Type of the index */
+  RtreeAlgorithm algorithm = PACKING; /**< Construction algorithm of the
+      rtree, the flat rtree is always packed */
+  int max_elements = 16; /**< Maximum number of elements in a rtree node */
+  int chunk_segments = 0; /**< Maximum number of segments of the chunks
+      of an edge indexed by the rtree, where 0 indexes the whole edges.
+      A long edge then has several tight boxes instead of a large one,
+      and only its chunks near a point are projected. */
+  double cell_size = 0; /**< Cell size of the grid, where 0 means the
+                             mean extent of the edges */
+  bool nearest_search = false; /**< Search the candidates of a point with
+      the incremental nearest query of the rtree, which stops once k
+      candidates are closer than the next box, instead of projecting the
+      point on all the edges within the radius. It is only used by the
+      rtree and the flat rtree without batched queries. */
+  double initial_radius = 0; /**< Radius of the first search of a point,
+      multiplied by radius_growth until the point has min_candidates or
+      the search radius is reached, so that the points close to the
+      edges only project the edges near them. A point found with the
+      initial radius has no candidate farther than it. 0 searches with
+      the search radius directly. It is not used by the nearest search,
+      which already stops at the k nearest candidates. */
+  int min_candidates = 1; /**< Candidates of a point below which its
+      search radius grows, capped by the k candidates searched */
+  double radius_growth = 2; /**< Factor of each growth of the radius */
+  int query_batch_size = 1; /**< Number of consecutive points of a
+      trajectory whose candidates are searched with one query of the
+      index, where the edges returned are filtered for each point */
+  bool twin_edges = false; /**< Pair the twin edges of two-way roads,
+      whose geometries are the reverse of each other, so that the rtree
+      indexes each pair once and the candidates of the second edge are
+      derived from the projection on the first one. The geometry of the
+      second edge of a pair is then released from its Edge. It is not
+      used by the grid, which indexes the segments. */
+  double snap_resolution = 0; /**< Size of the cells of the snapping
+      cache, which keeps the edges near the cells where points were
+      searched, so that the points repeated at nearly the same location
+      only project themselves on these edges. 0 disables the cache. It is
+      not used by the adaptive radius. */
+  long snap_cache_items = 10000000; /**< Maximum number of edges cached
+      by the snapping cache */
+};
+
+/**
+ * Box of a edge
+ */
+typedef boost::geometry::model::box<FMM::CORE::Point> BoostBox;
+
+/**
+ * Spatial index answering the edges whose geometries may intersect a
+ * query box. The edges are identified by their indices, which is the
+ * contract used by Network::search_tr_cs_knn to compute the exact
+ * distances afterwards.
+ */
+class SpatialIndex {
+ public:
+  virtual ~SpatialIndex() = default;
+  /**
+   * Query the edges which may intersect a box
+   * @param box   query box
+   * @param edges updated with the indices of the edges found, where each
+   * edge is appended once in no specific order
+   */
+  virtual void query(const BoostBox &box,
+                     std::vector<EdgeIndex> *edges) const = 0;
+  /**
+   * Visit the edges in increasing distance from a point to their boxes,
+   * until the visitor returns false
+   * @param  x     x coordinate of the point
+   * @param  y     y coordinate of the point
+   * @param  visit called with the index of an edge and the distance to
+   * its box
+   * @return false if the index cannot visit the edges by distance
+   */
+  virtual bool visit_nearest(
+      double x, double y,
+      const std::function<bool(EdgeIndex, double)> &visit) const {
+    return false;
+  }
+  /**
+   * Get the bytes of the index
+   */
+  virtual size_t get_memory_bytes() const = 0;
+};
+
+/**
+ * Spatial index of the bounding boxes of the edges in a boost rtree
+ */
+class RtreeIndex : public SpatialIndex {
+ public:
+  /**
+   * Build the rtree
+   * @param boxes   bounding box of each edge
+   * @param options options of the rtree
+   */
+  RtreeIndex(const std::vector<BoostBox> &boxes,
+             const SpatialIndexOptions &options);
+  ~RtreeIndex() override;
+  void query(const BoostBox &box,
+             std::vector<EdgeIndex> *edges) const override;
+  /**
+   * Visit the edges with the incremental nearest query of the rtree,
+   * which only expands the nodes closer than the edges visited
+   */
+  bool visit_nearest(
+      double x, double y,
+      const std::function<bool(EdgeIndex, double)> &visit) const override;
+  /**
+   * Estimate the bytes of the nodes of the rtree, which is not exposed
+   * by boost, from the number of boxes and the node capacity
+   */
+  size_t get_memory_bytes() const override;
+ private:
+  // The rtree type depends on the algorithm, which is hidden here to
+  // keep the boost index headers away from the users of the network
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
+
+/**
+ * Read-only rtree of the edge boxes stored in flat arrays without
+ * pointers, bulk loaded along the Hilbert curve of the box centers.
+ *
+ * The nodes are numbered level by level from the root and the entries of
+ * node n are [node_first[n], node_first[n+1]). As the children of a node
+ * are consecutive nodes of the next level, entry e < num_nodes - 1 is the
+ * box of node e + 1 and the following entries are the boxes indexed. The
+ * boxes are stored as four coordinate arrays, so that all the entries of
+ * a node are tested against a query box with the SIMD kernel
+ * ALGORITHM::boxes_intersect.
+ *
+ * The arrays are stored in a single buffer which is also the serialized
+ * form of the tree, and can be mapped from a file instead of being built.
+ */
+class FlatRtreeIndex : public SpatialIndex {
+ public:
+  /**
+   * Build the tree
+   * @param boxes        bounding box of each item
+   * @param max_elements maximum number of entries of a node
+   */
+  FlatRtreeIndex(const std::vector<BoostBox> &boxes, int max_elements);
+  ~FlatRtreeIndex() override;
+  /**
+   * Map a tree serialized in a file, whose offsets and item indices are
+   * checked so that a corrupted tree cannot be traversed out of its
+   * arrays
+   * @param  filename     file name
+   * @param  offset       offset of the tree in the file, a multiple of
+   * the page size
+   * @param  size         bytes of the tree
+   * @param  max_elements maximum number of entries of a node expected
+   * @return the tree, or nullptr if it cannot be mapped or is invalid
+   */
+  static std::unique_ptr<FlatRtreeIndex> map_file(
+      const std::string &filename, long long offset, long long size,
+      int max_elements);
+  void query(const BoostBox &box,
+             std::vector<EdgeIndex> *edges) const override;
+  /**
+   * Visit the items in increasing distance to their boxes, expanding the
+   * nodes from a priority queue
+   */
+  bool visit_nearest(
+      double x, double y,
+      const std::function<bool(EdgeIndex, double)> &visit) const override;
+  size_t get_memory_bytes() const override;
+  /**
+   * Get the buffer of the tree, which is its serialized form
+   */
+  inline const char *get_data() const {
+    return data_;
+  };
+  /**
+   * Get the bytes of the buffer of the tree
+   */
+  inline size_t get_data_size() const {
+    return data_size_;
+  };
+  /**
+   * Get the number of items indexed
+   */
+  inline long long get_num_items() const {
+    return num_items_;
+  };
+  /**
+   * Get the number of nodes
+   */
+  inline long long get_num_nodes() const {
+    return num_nodes_;
+  };
+  /**
+   * Check if the tree is mapped from a file
+   */
+  inline bool is_mapped() const {
+    return map_addr_ != nullptr;
+  };
+  FlatRtreeIndex(const FlatRtreeIndex &) = delete;
+  FlatRtreeIndex &operator=(const FlatRtreeIndex &) = delete;
+ private:
+  FlatRtreeIndex() = default;
+  /**
+   * Set the arrays from a buffer, checking their offsets and indices
+   * @return false if the buffer is not a valid tree
+   */
+  bool set_arrays(const char *data, size_t size);
+  std::vector<double> buffer_; // Buffer of a tree built, in 8 byte words
+  void *map_addr_ = nullptr; // Mapping of a tree read from a file
+  size_t map_size_ = 0;
+  const char *data_ = nullptr;
+  size_t data_size_ = 0;
+  int max_elements_ = 16;
+  long long num_items_ = 0;
+  long long num_nodes_ = 0;
+  const unsigned int *node_first_ = nullptr;
+  const double *min_x_ = nullptr;
+  const double *min_y_ = nullptr;
+  const double *max_x_ = nullptr;
+  const double *max_y_ = nullptr;
+  const EdgeIndex *items_ = nullptr;
+};
+
+/**
+ * Spatial index of the edge segments in a uniform grid, where the
+ * edges of each cell are stored contiguously (compressed sparse rows).
+ *
+ * An edge is registered in every cell covered by the box of one of its
+ * segments, so a long diagonal edge does not fill the cells of its whole
+ * bounding box. A query scans the cells overlapping the box, which is a
+ * few cells when the cell size is close to the search radius.
+ */
+class GridIndex : public SpatialIndex {
+ public:
+  /**
+   * Build the grid
+   * @param geom_x       x coordinates of the packed edge geometries
+   * @param geom_y       y coordinates of the packed edge geometries
+   * @param geom_offsets first point of each edge, followed by the number
+   * of points
+   * @param cell_size    cell size, where a value not larger than 0
+   * means the mean extent of the edges
+   */
+  GridIndex(const std::vector<double> &geom_x,
+            const std::vector<double> &geom_y,
+            const std::vector<long long> &geom_offsets,
+            double cell_size);
+  void query(const BoostBox &box,
+             std::vector<EdgeIndex> *edges) const override;
+  size_t get_memory_bytes() const override;
+  /**
+   * Get the cell size used
+   */
+  inline double get_cell_size() const {
+    return cell_size_;
+  };
+  static const long long MAX_CELLS = 1LL << 24; /**< Maximum number of
+      cells, beyond which the cell size is enlarged */
+ private:
+  // Cell range of a coordinate interval clamped to the grid
+  void get_cell_range(double min, double max, double origin, int num,
+                      int *first, int *last) const;
+  double cell_size_ = 1;
+  double min_x = 0;
+  double min_y = 0;
+  int num_x = 0;
+  int num_y = 0;
+  // Edges of cell i are cell_edges[cell_offsets[i]:cell_offsets[i+1]]
+  std::vector<long long> cell_offsets;
+  std::vector<EdgeIndex> cell_edges;
+};
+} // NETWORK
+} // FMM
+
+#endif // FMM_SPATIAL_INDEX_HPP
@@ -0,0 +1,108 @@
+/**
+ * Fast map matching.
+ *
+ * Implementation of the synthetic trajectory generator
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "network/trajectory_generator.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::NETWORK;
+
+TrajectoryGenerator::TrajectoryGenerator(
+    const Network &network, const NetworkGraph &graph,
+    const TrajectoryGeneratorOptions &options, unsigned int seed) :
+    network(network), graph(graph), options(options), rng(seed) {
+}
+
+bool TrajectoryGenerator::find_route(std::vector<EdgeIndex> *path) {
+  unsigned int num_vertices = graph.get_num_vertices();
+  if (num_vertices == 0) return false;
+  std::uniform_int_distribution<unsigned int> node(0, num_vertices - 1);
+  NodeIndex source = node(rng);
+  PredecessorMap pmap;
+  DistanceMap dmap;
+  PathEndMap emap;
+  graph.single_source_upperbound_dijkstra(source, options.max_length,
+                                          &pmap, &dmap, &emap);
+  std::vector<NodeIndex> targets;
+  for (const auto &entry : dmap) {
+    if (entry.second >= options.min_length) targets.push_back(entry.first);
+  }
+  if (targets.empty()) return false;
+  // The hash map is iterated in no defined order
+  std::sort(targets.begin(), targets.end());
+  std::uniform_int_distribution<std::size_t> target(0, targets.size() - 1);
+  *path = graph.back_track(source, targets[target(rng)], pmap, emap);
+  return !path->empty();
+}
+
+bool TrajectoryGenerator::generate(int id, Trajectory *traj,
+                                   std::vector<EdgeID> *route) {
+  const int MAX_ATTEMPTS = 100;
+  std::normal_distribution<double> noise(
+      0, options.error > 0 ? options.error : 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::exponential_distribution<double> outage(
+      1.0 / std::max(options.outage_duration, 1e-9));
+  double step = options.speed * options.interval;
+  for (int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+    std::vector<EdgeIndex> path;
+    if (!find_route(&path)) continue;
+    LineString geom = network.route2geometry(path);
+    traj->id = id;
+    traj->geom.clear();
+    traj->timestamps.clear();
+    double outage_end = -1;
+    // The positions are sampled along the segments in one sweep
+    double offset = 0;
+    double segment_start = 0;
+    int segment = 0;
+    int num_segments = geom.get_num_points() - 1;
+    for (int i = 0; segment < num_segments; ++i, offset += step) {
+      double t = i * options.interval;
+      double length = 0;
+      while (segment < num_segments) {
+        double dx = geom.get_x(segment + 1) - geom.get_x(segment);
+        double dy = geom.get_y(segment + 1) - geom.get_y(segment);
+        length = std::sqrt(dx * dx + dy * dy);
+        if (segment_start + length >= offset) break;
+        segment_start += length;
+        ++segment;
+      }
+      if (segment == num_segments) break;
+      if (t > outage_end && uniform(rng) < options.outage_rate) {
+        outage_end = t + outage(rng);
+      }
+      if (t <= outage_end) continue;
+      double ratio = length > 0 ? (offset - segment_start) / length : 0;
+      double x = geom.get_x(segment) +
+          ratio * (geom.get_x(segment + 1) - geom.get_x(segment));
+      double y = geom.get_y(segment) +
+          ratio * (geom.get_y(segment + 1) - geom.get_y(segment));
+      if (options.error > 0) {
+        x += noise(rng);
+        y += noise(rng);
+      }
+      traj->geom.add_point(x, y);
+      traj->timestamps.push_back(t);
+    }
+    if (traj->geom.get_num_points() < 2) continue;
+    if (route != nullptr) {
+      route->clear();
+      for (EdgeIndex e : path) route->push_back(network.get_edge_id(e));
+    }
+    return true;
+  }
+  SPDLOG_WARN("No route found between {} and {} in {} attempts",
+              options.min_length, options.max_length, MAX_ATTEMPTS);
+  return false;
+}
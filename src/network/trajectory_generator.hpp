@@ -0,0 +1,86 @@
+/**
+ * Fast map matching.
+ *
+ * Generator of synthetic trajectories on a network
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_TRAJECTORY_GENERATOR_HPP
+#define FMM_TRAJECTORY_GENERATOR_HPP
+
+#include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "core/gps.hpp"
+
+#include <random>
+#include <vector>
+
+namespace FMM {
+namespace NETWORK {
+
+/**
+ * Options of the synthetic trajectories, whose distances are in the unit
+ * of the network
+ */
+struct TrajectoryGeneratorOptions {
+  double min_length = 1000; /**< Minimum length of a route */
+  double max_length = 5000; /**< Maximum length of a route */
+  double interval = 10; /**< Seconds between two points */
+  double speed = 10; /**< Speed along the route, per second */
+  double error = 10; /**< Standard deviation of the GPS noise added to
+                          each coordinate */
+  double outage_rate = 0; /**< Probability that an outage starts at a
+                               point, where no point is observed */
+  double outage_duration = 60; /**< Mean duration of an outage in
+                                    seconds */
+};
+
+/**
+ * Generator of synthetic trajectories, which drive along the shortest
+ * path between two random nodes of a network at a constant speed. The
+ * positions are sampled at a fixed interval with a Gaussian noise, and
+ * the points within the outages are dropped.
+ */
+class TrajectoryGenerator {
+ public:
+  /**
+   * Constructor
+   * @param network network, which should outlive the generator
+   * @param graph   graph of the network
+   * @param options options of the trajectories
+   * @param seed    seed of the random numbers, so that the trajectories
+   * are reproducible
+   */
+  TrajectoryGenerator(const Network &network, const NetworkGraph &graph,
+                      const TrajectoryGeneratorOptions &options,
+                      unsigned int seed = 0);
+  /**
+   * Generate a trajectory
+   * @param id    id of the trajectory
+   * @param traj  updated with the points and timestamps observed
+   * @param route updated with the ids of the edges driven, if not nullptr
+   * @return false if no route within the lengths is found after many
+   * attempts, as the network is too small or disconnected
+   */
+  bool generate(int id, CORE::Trajectory *traj,
+                std::vector<EdgeID> *route = nullptr);
+ private:
+  /**
+   * Find the shortest path from a random node to a random node reached
+   * within the lengths of a route
+   * @param path updated with the edges of the route
+   * @return false if no node is reached within the lengths
+   */
+  bool find_route(std::vector<EdgeIndex> *path);
+  const Network &network;
+  const NetworkGraph &graph;
+  TrajectoryGeneratorOptions options;
+  std::mt19937 rng;
+};
+
+} // NETWORK
+} // FMM
+
+#endif // FMM_TRAJECTORY_GENERATOR_HPP
@@ -14,7 +14,10 @@
 #include <list>
 #include <string>
 #include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
 #include "core/geometry.hpp"
+#include "util/parallel.hpp"
 
 namespace FMM {
 namespace NETWORK{
@@ -25,19 +28,128 @@ typedef unsigned int NodeIndex; /**< Node Index in the network, range
                                  from [0,num_vertices-1 ]*/
 typedef unsigned int EdgeIndex; /**< Edge Index in the network, range
                                  from [0,num_edges-1 ]*/
+#ifdef FMM_FLOAT_BOXES
+typedef float BoxCoord; /**< Coordinate of the segment bounding boxes */
+#else
+typedef double BoxCoord; /**< Coordinate of the segment bounding boxes */
+#endif
 
 /**
  * Vector of node id
  */
 typedef std::vector<NodeID> NodeIDVec;
+/**
+ * Map from the ids of nodes or edges to their indices.
+ *
+ * The map is stored in contiguous arrays built once from the ids of all
+ * the indices: a lookup table indexed by id when the ids are dense, or
+ * the ids sorted with their indices otherwise, which is searched by
+ * bisection. The sorted pairs of a large map are sorted in parallel.
+ */
+class IdIndexMap {
+ public:
+  /**
+   * Construct an empty map
+   */
+  IdIndexMap() = default;
+  /**
+   * Construct the map where ids[i] is mapped to i. Among duplicated ids,
+   * the first one is kept.
+   * @param ids id of each index
+   */
+  explicit IdIndexMap(const std::vector<int> &ids) : num_ids(ids.size()) {
+    if (ids.empty()) return;
+    auto range = std::minmax_element(ids.begin(), ids.end());
+    min_id = *range.first;
+    long long span = (long long) *range.second - min_id + 1;
+    // A table is at most twice the size of the sorted pairs
+    if (span <= 4 * (long long) ids.size() + 1024) {
+      const unsigned int not_found = NOT_FOUND;
+      table.assign(span, not_found);
+      for (unsigned int i = ids.size(); i-- > 0;) {
+        table[ids[i] - min_id] = i;
+      }
+      return;
+    }
+    sorted.resize(ids.size());
+    #pragma omp parallel for if(ids.size() >= UTIL::PARALLEL_MIN_SIZE)
+    for (long long i = 0; i < (long long) ids.size(); ++i) {
+      sorted[i] = {ids[i], (unsigned int) i};
+    }
+    UTIL::parallel_stable_sort(sorted.begin(), sorted.end(),
+                               [](const std::pair<int, unsigned int> &a,
+                                  const std::pair<int, unsigned int> &b) {
+                                 return a.first < b.first;
+                               });
+    sorted.erase(std::unique(sorted.begin(), sorted.end(),
+                             [](const std::pair<int, unsigned int> &a,
+                                const std::pair<int, unsigned int> &b) {
+                               return a.first == b.first;
+                             }), sorted.end());
+  };
+  /**
+   * Find the index of an id
+   * @param id    id
+   * @param index updated with the index if the id is found
+   * @return true if the id is found
+   */
+  inline bool find(int id, unsigned int *index) const {
+    if (!table.empty()) {
+      long long i = (long long) id - min_id;
+      if (i < 0 || i >= (long long) table.size() || table[i] == NOT_FOUND)
+        return false;
+      *index = table[i];
+      return true;
+    }
+    auto iter = std::lower_bound(
+        sorted.begin(), sorted.end(), id,
+        [](const std::pair<int, unsigned int> &a, int b) {
+          return a.first < b;
+        });
+    if (iter == sorted.end() || iter->first != id) return false;
+    *index = iter->second;
+    return true;
+  };
+  /**
+   * Get the index of an id
+   * @param id id
+   * @return index of the id
+   * @throw std::out_of_range if the id is not found
+   */
+  inline unsigned int at(int id) const {
+    unsigned int index;
+    if (!find(id, &index)) throw std::out_of_range("id not found");
+    return index;
+  };
+  /**
+   * Get the number of ids the map is built from
+   */
+  inline size_t size() const {
+    return num_ids;
+  };
+  /**
+   * Get the bytes of the table or the sorted pairs
+   */
+  inline size_t get_memory_bytes() const {
+    return table.capacity() * sizeof(unsigned int) +
+        sorted.capacity() * sizeof(std::pair<int, unsigned int>);
+  };
+ private:
+  static const unsigned int NOT_FOUND = 0xFFFFFFFF;
+  size_t num_ids = 0;
+  int min_id = 0;
+  std::vector<unsigned int> table; // Index of id min_id + i
+  std::vector<std::pair<int, unsigned int>> sorted;
+};
+
 /**
  * Map of node index
  */
-typedef std::unordered_map<NodeID,NodeIndex> NodeIndexMap;
+typedef IdIndexMap NodeIndexMap;
 /**
  * Map of edge index
  */
-typedef std::unordered_map<EdgeID,EdgeIndex> EdgeIndexMap;
+typedef IdIndexMap EdgeIndexMap;
 
 /**
  * Road edge class
@@ -49,7 +161,9 @@ struct Edge
   NodeIndex source; /**< source node index */
   NodeIndex target; /**< target node index */
   double length; /**< length of the edge polyline */
-  FMM::CORE::LineString geom; /**< the edge geometry */
+  FMM::CORE::LineString geom; /**< the edge geometry as read, which is
+                                  empty once the network is built, as
+                                  Network::get_edge_view reads it */
 };
 
 } // NETWORK
@@ -10,8 +10,12 @@
 #ifndef FMM_PYFMM_HPP_
 #define FMM_PYFMM_HPP_
 
+#include "core/gps.hpp"
 #include "mm/mm_type.hpp"
 
+#include <limits>
+#include <stdexcept>
+
 namespace FMM{
 /**
  * Data type for Python API
@@ -45,6 +49,135 @@ struct PyMatchResult {
   CORE::LineString mgeom; /**< Geometry of the matched path */
   CORE::LineString pgeom; /**< Point position matched for each GPS point */
 };
+
+/**
+ * Match result in contiguous arrays used by the NumPy Python API, where
+ * a geometry is stored as its coordinates with x and y interleaved
+ */
+struct PyMatchArrays {
+  int id; /**< id of a trajectory */
+  std::vector<int> opath; /**< Edge ID matched for each point */
+  std::vector<int> cpath; /**< Edge ID traversed by the matched path */
+  std::vector<int> indices; /**< index of matched edge in the cpath */
+  std::vector<double> offsets; /**< Offset of the position matched for
+                                    each point on its edge */
+  std::vector<double> mgeom; /**< Coordinates of the matched path */
+  std::vector<double> pgeom; /**< Coordinates of the position matched
+                                  for each point */
+};
+
+/**
+ * Shortest paths of od pairs in contiguous arrays used by the NumPy
+ * Python API, where the edges of the paths are flattened
+ */
+struct PyPathArrays {
+  std::vector<double> distances; /**< Distance of each od pair, infinity
+                                      if no path is found */
+  std::vector<int> offsets; /**< Position of the first edge of each path
+                                 in edges, followed by the number of
+                                 edges */
+  std::vector<int> edges; /**< Edge index of the paths concatenated */
+};
+
+#ifndef SWIG
+/**
+ * Check the od pairs given as contiguous arrays
+ * @param sources     source node of each pair
+ * @param num_sources number of sources
+ * @param targets     target node of each pair
+ * @param num_targets number of targets, which should be num_sources
+ * @param num_nodes   number of nodes of the network, which bounds the
+ * node indices if given
+ */
+inline void check_od_pairs(
+    const unsigned int *sources, int num_sources,
+    const unsigned int *targets, int num_targets,
+    unsigned int num_nodes = std::numeric_limits<unsigned int>::max()) {
+  if (num_sources != num_targets) {
+    throw std::invalid_argument("sources and targets differ in length");
+  }
+  for (int i = 0; i < num_sources; ++i) {
+    if (sources[i] >= num_nodes || targets[i] >= num_nodes) {
+      throw std::invalid_argument("node index out of the network");
+    }
+  }
+}
+
+/**
+ * Concatenate the paths of the od pairs
+ * @param  distances distance of each pair
+ * @param  paths     edges of the path of each pair
+ * @return the paths in contiguous arrays
+ */
+inline PyPathArrays to_py_paths(
+    std::vector<double> &&distances,
+    const std::vector<std::vector<NETWORK::EdgeIndex>> &paths) {
+  PyPathArrays output;
+  output.distances = std::move(distances);
+  output.offsets.reserve(paths.size() + 1);
+  output.offsets.push_back(0);
+  for (const std::vector<NETWORK::EdgeIndex> &path : paths) {
+    output.offsets.push_back(output.offsets.back() + path.size());
+  }
+  output.edges.reserve(output.offsets.back());
+  for (const std::vector<NETWORK::EdgeIndex> &path : paths) {
+    output.edges.insert(output.edges.end(), path.begin(), path.end());
+  }
+  return output;
+}
+
+/**
+ * Create a trajectory from contiguous arrays
+ * @param  coords         x and y of the points interleaved
+ * @param  num_points     number of points
+ * @param  timestamps     timestamps of the points, or nullptr
+ * @param  num_timestamps number of timestamps, 0 or num_points
+ * @return the trajectory with id 0
+ */
+inline CORE::Trajectory coords2trajectory(
+    const double *coords, int num_points,
+    const double *timestamps, int num_timestamps) {
+  if (num_timestamps > 0 && num_timestamps != num_points) {
+    throw std::invalid_argument("timestamps do not match the points");
+  }
+  CORE::Trajectory traj{0, CORE::LineString(), {}};
+  for (int i = 0; i < num_points; ++i) {
+    traj.geom.add_point(coords[2 * i], coords[2 * i + 1]);
+  }
+  if (num_timestamps > 0) {
+    traj.timestamps.assign(timestamps, timestamps + num_timestamps);
+  }
+  return traj;
+}
+
+/**
+ * Convert a result into contiguous arrays
+ * @param  result map matching result
+ * @return the arrays of the result
+ */
+inline PyMatchArrays to_py_arrays(const MM::MatchResult &result) {
+  PyMatchArrays output;
+  output.id = result.id;
+  output.opath = result.opath;
+  output.cpath = result.cpath;
+  output.indices = result.indices;
+  int N = result.mgeom.get_num_points();
+  output.mgeom.reserve(2 * N);
+  for (int i = 0; i < N; ++i) {
+    output.mgeom.push_back(result.mgeom.get_x(i));
+    output.mgeom.push_back(result.mgeom.get_y(i));
+  }
+  output.offsets.reserve(result.opt_candidate_path.size());
+  output.pgeom.reserve(2 * result.opt_candidate_path.size());
+  for (const MM::MatchedCandidate &mc : result.opt_candidate_path) {
+    output.offsets.push_back(mc.c.offset);
+    output.pgeom.push_back(boost::geometry::get<0>(mc.c.point));
+    output.pgeom.push_back(boost::geometry::get<1>(mc.c.point));
+  }
+  return output;
+}
+#endif
+
 }; // PYTHON
 }; // FMM
 
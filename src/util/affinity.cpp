@@ -0,0 +1,139 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/affinity.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+
+namespace FMM {
+namespace UTIL {
+namespace {
+
+thread_local int thread_node = 0;
+
+// Cores the process may run on, read before any thread is placed
+std::vector<int> get_process_cpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::vector<NumaNode> read_numa_nodes() {
+  std::vector<int> process_cpus = get_process_cpus();
+  std::vector<NumaNode> nodes;
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir != nullptr) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      std::string name = entry->d_name;
+      if (name.compare(0, 4, "node") != 0 || name.size() == 4 ||
+          name.find_first_not_of("0123456789", 4) != std::string::npos) {
+        continue;
+      }
+      std::ifstream ifs("/sys/devices/system/node/" + name + "/cpulist");
+      std::string line;
+      if (!std::getline(ifs, line)) continue;
+      NumaNode node{std::atoi(name.c_str() + 4), {}};
+      for (int cpu : parse_cpu_list(line)) {
+        if (std::binary_search(process_cpus.begin(), process_cpus.end(),
+                               cpu)) {
+          node.cpus.push_back(cpu);
+        }
+      }
+      if (!node.cpus.empty()) nodes.push_back(node);
+    }
+    closedir(dir);
+  }
+  std::sort(nodes.begin(), nodes.end(),
+            [](const NumaNode &a, const NumaNode &b) {
+              return a.index < b.index;
+            });
+  if (nodes.empty()) nodes.push_back(NumaNode{0, process_cpus});
+  return nodes;
+}
+
+} // namespace
+
+bool string2placement(const std::string &text, ThreadPlacement *placement) {
+  if (text == "none") {
+    *placement = PLACEMENT_NONE;
+  } else if (text == "core") {
+    *placement = PLACEMENT_CORE;
+  } else if (text == "socket") {
+    *placement = PLACEMENT_SOCKET;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::vector<int> parse_cpu_list(const std::string &text) {
+  std::vector<int> cpus;
+  std::size_t begin = 0;
+  while (begin < text.size()) {
+    std::size_t end = text.find(',', begin);
+    if (end == std::string::npos) end = text.size();
+    std::string range = text.substr(begin, end - begin);
+    while (!range.empty() && (range.back() == '\n' || range.back() == ' ')) {
+      range.pop_back();
+    }
+    std::size_t dash = range.find('-');
+    char *rest = nullptr;
+    long first = std::strtol(range.c_str(), &rest, 10);
+    long last = first;
+    if (dash != std::string::npos) {
+      if (rest != range.c_str() + dash) return {};
+      last = std::strtol(range.c_str() + dash + 1, &rest, 10);
+    }
+    if (range.empty() || *rest != '\0' || first < 0 || last < first) {
+      return {};
+    }
+    for (long cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    begin = end + 1;
+  }
+  return cpus;
+}
+
+const std::vector<NumaNode> &get_numa_nodes() {
+  static const std::vector<NumaNode> nodes = read_numa_nodes();
+  return nodes;
+}
+
+int place_thread(ThreadPlacement placement, int worker) {
+  if (placement == PLACEMENT_NONE) return 0;
+  const std::vector<NumaNode> &nodes = get_numa_nodes();
+  int node = worker % nodes.size();
+  const std::vector<int> &cpus = nodes[node].cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (placement == PLACEMENT_CORE) {
+    CPU_SET(cpus[(worker / nodes.size()) % cpus.size()], &set);
+  } else {
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+  }
+  if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+    SPDLOG_WARN("Fail to place worker {} on node {}", worker,
+                nodes[node].index);
+  }
+  thread_node = node;
+  return node;
+}
+
+int get_thread_node() {
+  return thread_node;
+}
+
+} // UTIL
+} // FMM
@@ -0,0 +1,81 @@
+/**
+ * Fast map matching.
+ *
+ * Placement of the worker threads on the cores and NUMA nodes of the host
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_AFFINITY_HPP
+#define FMM_UTIL_AFFINITY_HPP
+
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Placement of the worker threads
+ */
+enum ThreadPlacement {
+  PLACEMENT_NONE = 0, /**< Threads placed by the operating system */
+  PLACEMENT_CORE = 1, /**< Each thread pinned to a core, the threads
+                           spread over the NUMA nodes in turn */
+  PLACEMENT_SOCKET = 2 /**< Each thread bound to the cores of a NUMA node,
+                            the threads spread over the nodes in turn, so
+                            that each node runs a pool of workers moved
+                            by the operating system within the node */
+};
+
+/**
+ * Convert a string of none, core or socket to a thread placement
+ * @param  text      name of the placement
+ * @param  placement updated with the placement
+ * @return false if the name is not valid
+ */
+bool string2placement(const std::string &text, ThreadPlacement *placement);
+
+/**
+ * A NUMA node of the host with its cores
+ */
+struct NumaNode {
+  int index; /**< Index of the node */
+  std::vector<int> cpus; /**< Cores of the node usable by the process */
+};
+
+/**
+ * Parse a list of cores in the format of sysfs, such as 0-3,8,10-11
+ * @param  text list of cores
+ * @return the cores, empty if the list is not valid
+ */
+std::vector<int> parse_cpu_list(const std::string &text);
+
+/**
+ * Get the NUMA nodes of the host with a core usable by the process,
+ * read once from /sys/devices/system/node. A host without NUMA
+ * information is a single node with all the cores of the process.
+ * @return the nodes, at least one
+ */
+const std::vector<NumaNode> &get_numa_nodes();
+
+/**
+ * Place the calling thread as the worker of a pool
+ * @param  placement placement of the workers
+ * @param  worker    index of the worker in the pool
+ * @return the index in get_numa_nodes of the node of the worker, 0 if
+ * the placement is none
+ */
+int place_thread(ThreadPlacement placement, int worker);
+
+/**
+ * Get the index in get_numa_nodes of the node where the calling thread
+ * is placed, 0 if it has not been placed
+ */
+int get_thread_node();
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_AFFINITY_HPP
@@ -0,0 +1,96 @@
+/**
+ * Fast map matching.
+ *
+ * Bounded queue passing items between threads
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_BOUNDED_QUEUE_HPP
+#define FMM_UTIL_BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Queue of a bounded capacity shared by producer and consumer threads.
+ *
+ * A producer blocks while the queue is full, which bounds the memory
+ * held by the items in flight, and a consumer blocks while it is empty.
+ * Once closed, the items left are still consumed and then pop returns
+ * false.
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  /**
+   * Create an empty queue
+   * @param capacity maximum number of items queued
+   */
+  explicit BoundedQueue(std::size_t capacity) :
+      capacity_(capacity > 0 ? capacity : 1) {}
+  /**
+   * Push an item, waiting while the queue is full
+   * @param  item item moved into the queue
+   * @return false if the queue is closed, where the item is dropped
+   */
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [this] {
+      return closed_ || items_.size() < capacity_;
+    });
+    if (closed_) return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+  /**
+   * Pop an item, waiting while the queue is empty and not closed
+   * @param  item updated with the item popped
+   * @return false if the queue is closed and empty
+   */
+  bool pop(T *item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [this] {
+      return closed_ || !items_.empty();
+    });
+    if (items_.empty()) return false;
+    *item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+  /**
+   * Get the number of items queued
+   */
+  std::size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return items_.size();
+  }
+  /**
+   * Close the queue, waking up the threads waiting on it
+   */
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+ private:
+  std::size_t capacity_;
+  std::deque<T> items_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  bool closed_ = false;
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_BOUNDED_QUEUE_HPP
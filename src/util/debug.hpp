@@ -27,6 +27,14 @@ namespace UTIL{
 static const std::vector<std::string>
     LOG_LEVESLS {"0-trace","1-debug","2-info",
                  "3-warn","4-err","5-critical","6-off"};
+
+/**
+ * Write the logs to stderr instead of stdout, keeping the pattern set
+ * before, so that stdout only carries the results
+ */
+inline void log_to_stderr() {
+  spdlog::set_default_logger(spdlog::stderr_color_mt("stderr"));
+}
 }; // UTIL
 }; // FMM
 
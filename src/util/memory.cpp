@@ -0,0 +1,144 @@
+#include "util/memory.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace FMM {
+namespace UTIL {
+namespace {
+MemoryOptions memory_options;
+WorkspaceTotals workspace_totals[NUM_WORKSPACE_KINDS];
+const char *WORKSPACE_NAMES[NUM_WORKSPACE_KINDS] = {"routing", "candidate"};
+
+double to_mb(size_t bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+}
+
+void set_memory_options(const MemoryOptions &options) {
+  memory_options = options;
+}
+
+const MemoryOptions &get_memory_options() {
+  return memory_options;
+}
+
+void *allocate_large(size_t size) {
+  if (size < HUGE_PAGE_SIZE ||
+      (!memory_options.huge_pages && !memory_options.interleave)) {
+    return malloc(size);
+  }
+  void *addr = nullptr;
+  if (posix_memalign(&addr, HUGE_PAGE_SIZE, size) != 0) return nullptr;
+  advise_huge_pages(addr, size);
+  if (memory_options.interleave) {
+    // Pages are placed on the NUMA node of the thread touching them
+    // first, which takes every huge page in turn.
+    char *bytes = (char *) addr;
+    long num_pages = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE;
+#pragma omp parallel for schedule(static, 1)
+    for (long i = 0; i < num_pages; ++i) {
+      size_t offset = i * HUGE_PAGE_SIZE;
+      size_t n = size - offset < HUGE_PAGE_SIZE ? size - offset
+                                                : HUGE_PAGE_SIZE;
+      std::memset(bytes + offset, 0, n);
+    }
+  }
+  return addr;
+}
+
+void advise_huge_pages(void *addr, size_t size) {
+#ifdef MADV_HUGEPAGE
+  if (!memory_options.huge_pages || addr == nullptr) return;
+  size_t start = ((size_t) addr + HUGE_PAGE_SIZE - 1) &
+      ~(HUGE_PAGE_SIZE - 1);
+  size_t end = ((size_t) addr + size) & ~(HUGE_PAGE_SIZE - 1);
+  if (end <= start) return;
+  if (madvise((void *) start, end - start, MADV_HUGEPAGE) != 0) {
+    SPDLOG_DEBUG("Transparent huge pages are not available");
+  }
+#endif
+}
+
+long get_resident_memory() {
+  FILE *stream = fopen("/proc/self/statm", "r");
+  if (stream == nullptr) return 0;
+  long size = 0, resident = 0;
+  int read = fscanf(stream, "%ld %ld", &size, &resident);
+  fclose(stream);
+  if (read != 2) return 0;
+  return resident * sysconf(_SC_PAGESIZE);
+}
+
+void MemoryReport::add(const std::string &structure,
+                       const std::string &part, size_t bytes) {
+  parts_.push_back({structure, part, bytes});
+}
+
+size_t MemoryReport::get_total(const std::string &structure) const {
+  size_t total = 0;
+  for (const MemoryPart &part : parts_) {
+    if (structure.empty() || part.structure == structure) {
+      total += part.bytes;
+    }
+  }
+  return total;
+}
+
+void MemoryReport::print() const {
+  std::vector<std::string> structures;
+  for (const MemoryPart &part : parts_) {
+    if (std::find(structures.begin(), structures.end(), part.structure) ==
+        structures.end()) {
+      structures.push_back(part.structure);
+    }
+  }
+  for (const std::string &structure : structures) {
+    SPDLOG_INFO("Memory of {} {:.1f} MB", structure,
+                to_mb(get_total(structure)));
+    for (const MemoryPart &part : parts_) {
+      if (part.structure != structure) continue;
+      SPDLOG_INFO("  {} {:.1f} MB", part.part, to_mb(part.bytes));
+    }
+  }
+  SPDLOG_INFO("Memory of structures loaded {:.1f} MB resident {:.1f} MB",
+              to_mb(get_total()), to_mb(get_resident_memory()));
+}
+
+WorkspaceTotals &get_workspace_totals(WorkspaceKind kind) {
+  return workspace_totals[kind];
+}
+
+const char *get_workspace_name(int kind) {
+  return WORKSPACE_NAMES[kind];
+}
+
+WorkspaceTracker::WorkspaceTracker(WorkspaceKind kind) : kind_(kind) {
+  ++workspace_totals[kind_].count;
+}
+
+WorkspaceTracker::WorkspaceTracker(const WorkspaceTracker &other) :
+    kind_(other.kind_) {
+  ++workspace_totals[kind_].count;
+}
+
+WorkspaceTracker::~WorkspaceTracker() {
+  --workspace_totals[kind_].count;
+  workspace_totals[kind_].bytes -= (long long) bytes_;
+}
+
+void print_workspace_memory() {
+  for (int i = 0; i < NUM_WORKSPACE_KINDS; ++i) {
+    SPDLOG_INFO("Memory of {} workspaces {} total {:.1f} MB",
+                WORKSPACE_NAMES[i], workspace_totals[i].count.load(),
+                to_mb(workspace_totals[i].bytes.load()));
+  }
+}
+
+} // UTIL
+} // FMM
@@ -0,0 +1,196 @@
+/**
+ * Fast map matching.
+ *
+ * Allocation of large tables with huge pages and NUMA placement, and
+ * accounting of the memory of the loaded structures
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_MEMORY_HPP
+#define FMM_UTIL_MEMORY_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Options of the allocation of large tables, such as UBODT and the
+ * edges of a network
+ */
+struct MemoryOptions {
+  bool huge_pages = false; /**< If true, large tables are aligned to and
+                               advised to be backed by transparent huge
+                               pages */
+  bool interleave = false; /**< If true, the pages of large tables are
+                               first touched by all the OpenMP threads in
+                               turn, so that they are spread over the NUMA
+                               nodes where the threads are bound */
+};
+
+/**
+ * Set the options used by all the later allocations of large tables
+ * @param options memory options
+ */
+void set_memory_options(const MemoryOptions &options);
+
+/**
+ * Get the options of the allocation of large tables
+ * @return memory options
+ */
+const MemoryOptions &get_memory_options();
+
+/**
+ * Allocate a large block of memory according to the memory options.
+ * Blocks smaller than a huge page are allocated with malloc.
+ * @param size number of bytes
+ * @return pointer to the block, which is released by free, or nullptr
+ * if the allocation fails
+ */
+void *allocate_large(size_t size);
+
+/**
+ * Advise the huge pages fully covered by a block of memory to be backed
+ * by transparent huge pages, if enabled in the memory options
+ * @param addr start of the block
+ * @param size number of bytes
+ */
+void advise_huge_pages(void *addr, size_t size);
+
+/**
+ * Get the resident memory of the process, read from /proc/self/statm
+ * @return number of bytes, or 0 if it cannot be read
+ */
+long get_resident_memory();
+
+/**
+ * Memory of a part of a loaded structure
+ */
+struct MemoryPart {
+  std::string structure; /**< Structure, such as network or ubodt */
+  std::string part; /**< Part of the structure, such as edges */
+  size_t bytes; /**< Bytes allocated, including the unused capacity */
+};
+
+/**
+ * Breakdown of the memory of the structures loaded by a program, which
+ * is printed at startup and exported as metrics, so that the memory of
+ * a job is sized from its parts instead of its resident memory.
+ *
+ * The bytes are counted from the capacities of the containers, while
+ * the allocator overheads and the nodes of the rtree are estimated.
+ */
+class MemoryReport {
+ public:
+  /**
+   * Add a part of a structure
+   */
+  void add(const std::string &structure, const std::string &part,
+           size_t bytes);
+  /**
+   * Get the parts added, in the order they are added
+   */
+  const std::vector<MemoryPart> &get_parts() const {
+    return parts_;
+  };
+  /**
+   * Get the bytes of a structure, or of all if the structure is empty
+   */
+  size_t get_total(const std::string &structure = "") const;
+  /**
+   * Log the total and the parts of each structure
+   */
+  void print() const;
+ private:
+  std::vector<MemoryPart> parts_;
+};
+
+/**
+ * Get the bytes allocated by a vector, including its unused capacity
+ */
+template <typename T>
+inline size_t get_vector_bytes(const std::vector<T> &v) {
+  return v.capacity() * sizeof(T);
+}
+
+/**
+ * Estimate the bytes allocated by a hash map or set, with a pointer per
+ * bucket and a node per element holding the value, a next pointer and
+ * the cached hash
+ */
+template <typename Map>
+inline size_t get_hash_map_bytes(const Map &map) {
+  return map.bucket_count() * sizeof(void *) +
+      map.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void *));
+}
+
+/**
+ * Kind of the workspaces reused by the matching threads
+ */
+enum WorkspaceKind {
+  ROUTING_WORKSPACE = 0, /**< Dijkstra state of each node */
+  CANDIDATE_WORKSPACE = 1, /**< Candidates of a trajectory */
+  NUM_WORKSPACE_KINDS = 2
+};
+
+/**
+ * Number and bytes of the live workspaces of a kind, which grow while
+ * matching and are read by the metrics thread
+ */
+struct WorkspaceTotals {
+  std::atomic<long> count{0}; /**< Workspaces alive */
+  std::atomic<long long> bytes{0}; /**< Bytes of the workspaces */
+};
+
+/**
+ * Get the totals of the workspaces of a kind
+ */
+WorkspaceTotals &get_workspace_totals(WorkspaceKind kind);
+
+/**
+ * Get the name of a kind of workspace
+ */
+const char *get_workspace_name(int kind);
+
+/**
+ * Member of a workspace, which keeps the bytes last reported by the
+ * workspace in the totals of its kind. A copy starts with no bytes.
+ */
+class WorkspaceTracker {
+ public:
+  explicit WorkspaceTracker(WorkspaceKind kind);
+  WorkspaceTracker(const WorkspaceTracker &other);
+  WorkspaceTracker &operator=(const WorkspaceTracker &) {
+    return *this;
+  };
+  ~WorkspaceTracker();
+  /**
+   * Report the bytes of the workspace after it grows
+   */
+  inline void update(size_t bytes) {
+    if (bytes == bytes_) return;
+    get_workspace_totals(kind_).bytes +=
+        (long long) bytes - (long long) bytes_;
+    bytes_ = bytes;
+  };
+ private:
+  WorkspaceKind kind_;
+  size_t bytes_ = 0;
+};
+
+/**
+ * Log the number and bytes of the live workspaces of each kind
+ */
+void print_workspace_memory();
+
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024; /**< Size of a
+                                                  transparent huge page */
+
+} // UTIL
+} // FMM
+#endif /* FMM_UTIL_MEMORY_HPP */
@@ -0,0 +1,178 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/metrics.hpp"
+#include "util/memory.hpp"
+#include "util/debug.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+std::string format_value(double value) {
+  std::ostringstream oss;
+  oss.precision(12);
+  oss << value;
+  return oss.str();
+}
+
+} // namespace
+
+void MetricsText::family(const std::string &name, const std::string &type,
+                         const std::string &help) {
+  text_ += "# HELP " + name + " " + help + "\n";
+  text_ += "# TYPE " + name + " " + type + "\n";
+}
+
+void MetricsText::sample(const std::string &name, double value,
+                         const std::string &labels) {
+  text_ += name;
+  if (!labels.empty()) text_ += "{" + labels + "}";
+  text_ += " " + format_value(value) + "\n";
+}
+
+void MetricsText::gauge(const std::string &name, const std::string &help,
+                        double value) {
+  family(name, "gauge", help);
+  sample(name, value);
+}
+
+void MetricsText::counter(const std::string &name, const std::string &help,
+                          double value) {
+  family(name, "counter", help);
+  sample(name, value);
+}
+
+double RateMeter::update(double count) {
+  TimePoint now = std::chrono::steady_clock::now();
+  double rate = 0;
+  if (started_) {
+    double elapsed = std::chrono::duration<double>(now - time_).count();
+    if (elapsed > 0) rate = (count - count_) / elapsed;
+  }
+  started_ = true;
+  count_ = count;
+  time_ = now;
+  return rate;
+}
+
+void UTIL::append_stage_metrics(const StageStatistics &statistics,
+                                MetricsText *text) {
+  const double quantiles[] = {0.5, 0.9, 0.99};
+  const std::string name = "fmm_stage_seconds";
+  text->family(name, "summary",
+               "Time spent per trajectory in each stage of the matching");
+  for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+    const StageHistogram &histogram = statistics.histograms[i];
+    std::string stage = "stage=\"" +
+        std::string(StageProfile::get_stage_name(i)) + "\"";
+    for (double q : quantiles) {
+      text->sample(name, histogram.quantile(q),
+                   stage + ",quantile=\"" + format_value(q) + "\"");
+    }
+    text->sample(name + "_sum", statistics.totals[i], stage);
+    text->sample(name + "_count", histogram.count, stage);
+  }
+}
+
+void UTIL::append_memory_metrics(const MemoryReport &report,
+                                 MetricsText *text) {
+  text->family("fmm_structure_memory_bytes", "gauge",
+               "Memory of each part of the structures loaded");
+  for (const MemoryPart &part : report.get_parts()) {
+    text->sample("fmm_structure_memory_bytes", part.bytes,
+                 "structure=\"" + part.structure + "\",part=\"" +
+                     part.part + "\"");
+  }
+  text->family("fmm_workspaces", "gauge",
+               "Workspaces of the matching threads alive");
+  for (int i = 0; i < NUM_WORKSPACE_KINDS; ++i) {
+    text->sample("fmm_workspaces",
+                 get_workspace_totals((WorkspaceKind) i).count.load(),
+                 "workspace=\"" + std::string(get_workspace_name(i)) +
+                     "\"");
+  }
+  text->family("fmm_workspace_memory_bytes", "gauge",
+               "Memory of the workspaces of the matching threads");
+  for (int i = 0; i < NUM_WORKSPACE_KINDS; ++i) {
+    text->sample("fmm_workspace_memory_bytes",
+                 get_workspace_totals((WorkspaceKind) i).bytes.load(),
+                 "workspace=\"" + std::string(get_workspace_name(i)) +
+                     "\"");
+  }
+}
+
+MetricsExporter::MetricsExporter(const std::string &filename,
+                                 double interval) :
+    filename_(filename), interval_(interval > 0 ? interval : 1),
+    start_time_(std::chrono::steady_clock::now()) {
+}
+
+MetricsExporter::~MetricsExporter() {
+  stop();
+}
+
+void MetricsExporter::add_collector(const Collector &collector) {
+  collectors_.push_back(collector);
+}
+
+void MetricsExporter::start() {
+  SPDLOG_INFO("Write metrics to {} every {} s", filename_, interval_);
+  thread_ = std::thread([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopped_.wait_for(
+        lock, std::chrono::duration<double>(interval_),
+        [this] { return stopping_; })) {
+      lock.unlock();
+      write();
+      lock.lock();
+    }
+  });
+}
+
+void MetricsExporter::stop() {
+  if (!thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  stopped_.notify_all();
+  thread_.join();
+  write();
+}
+
+bool MetricsExporter::write() {
+  MetricsText text;
+  text.gauge("fmm_uptime_seconds", "Time since the job started",
+             std::chrono::duration<double>(
+                 std::chrono::steady_clock::now() - start_time_).count());
+  text.gauge("fmm_resident_memory_bytes", "Resident memory of the process",
+             get_resident_memory());
+  for (const Collector &collector : collectors_) {
+    collector(&text);
+  }
+  if (StageProfile::is_enabled()) {
+    append_stage_metrics(StageProfile::collect(), &text);
+  }
+  // The file is replaced at once, so that it is never read half written
+  std::string temp_file = filename_ + ".tmp";
+  {
+    std::ofstream ofs(temp_file);
+    ofs << text.str();
+    if (!ofs.good()) {
+      SPDLOG_ERROR("Fail to write metrics file {}", temp_file);
+      return false;
+    }
+  }
+  if (std::rename(temp_file.c_str(), filename_.c_str()) != 0) {
+    SPDLOG_ERROR("Fail to rename metrics file to {}", filename_);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,163 @@
+/**
+ * Fast map matching.
+ *
+ * Metrics of long running jobs exported in the Prometheus text format
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_METRICS_HPP
+#define FMM_UTIL_METRICS_HPP
+
+#include "util/memory.hpp"
+#include "util/stage_profile.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Text of metrics in the Prometheus exposition format, where a family
+ * is declared once with its type and help before its samples.
+ */
+class MetricsText {
+ public:
+  /**
+   * Declare a family of metrics
+   * @param name name of the family
+   * @param type gauge, counter or summary
+   * @param help description of the family
+   */
+  void family(const std::string &name, const std::string &type,
+              const std::string &help);
+  /**
+   * Add a sample of the last family declared
+   * @param name   name of the sample, the name of the family with an
+   * optional suffix such as _sum
+   * @param value  value of the sample
+   * @param labels labels without braces, such as stage="search"
+   */
+  void sample(const std::string &name, double value,
+              const std::string &labels = "");
+  /**
+   * Add a gauge with a single sample
+   */
+  void gauge(const std::string &name, const std::string &help,
+             double value);
+  /**
+   * Add a counter with a single sample
+   */
+  void counter(const std::string &name, const std::string &help,
+               double value);
+  /**
+   * Get the text of the metrics added
+   */
+  const std::string &str() const { return text_; }
+ private:
+  std::string text_;
+};
+
+/**
+ * Rate of a counter between two of its updates
+ */
+class RateMeter {
+ public:
+  /**
+   * Update the counter
+   * @param  count value of the counter
+   * @return increase per second since the previous update, 0 at the
+   * first one
+   */
+  double update(double count);
+ private:
+  bool started_ = false;
+  double count_ = 0;
+  TimePoint time_;
+};
+
+/**
+ * Add the time spent in each stage of the matching as a summary per
+ * stage, with the quantiles of the time per trajectory
+ * @param statistics statistics collected from the stage profile
+ * @param text       metrics updated
+ */
+void append_stage_metrics(const StageStatistics &statistics,
+                          MetricsText *text);
+
+/**
+ * Add the bytes of each part of the structures loaded, and the number
+ * and bytes of the live workspaces of each kind
+ * @param report memory of the structures
+ * @param text   metrics updated
+ */
+void append_memory_metrics(const MemoryReport &report, MetricsText *text);
+
+/**
+ * Exporter writing the metrics of a job to a text file periodically.
+ *
+ * The file follows the Prometheus text format, for the textfile
+ * collector of the node exporter, and is replaced by a rename so that
+ * it is never read half written. Each write adds the resident memory of
+ * the process, the stage profile if it is enabled, and the metrics of
+ * the collectors, which are called by the thread of the exporter and
+ * thus read the state of the job with atomics or locks. The file is
+ * written a last time when the exporter is stopped.
+ */
+class MetricsExporter {
+ public:
+  /**
+   * Function adding the metrics of a part of the job
+   */
+  typedef std::function<void(MetricsText *)> Collector;
+  /**
+   * Create an exporter
+   * @param filename file written
+   * @param interval time between two writes, in seconds
+   */
+  MetricsExporter(const std::string &filename, double interval);
+  /**
+   * Stop the exporter, which writes the file a last time
+   */
+  ~MetricsExporter();
+  MetricsExporter(const MetricsExporter &) = delete;
+  MetricsExporter &operator=(const MetricsExporter &) = delete;
+  /**
+   * Add a collector, before the exporter is started
+   */
+  void add_collector(const Collector &collector);
+  /**
+   * Start the thread writing the file
+   */
+  void start();
+  /**
+   * Stop the thread and write the file a last time
+   */
+  void stop();
+  /**
+   * Write the metrics to the file
+   * @return true if written
+   */
+  bool write();
+ private:
+  std::string filename_;
+  double interval_;
+  std::vector<Collector> collectors_;
+  TimePoint start_time_;
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stopped_;
+  bool stopping_ = false;
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_METRICS_HPP
@@ -0,0 +1,83 @@
+/**
+ * Fast map matching.
+ *
+ * Parsing of numbers in place, without a terminated string
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_NUMBER_PARSER_HPP
+#define FMM_UTIL_NUMBER_PARSER_HPP
+
+#include <cstdlib>
+#include <cstring>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Parse a double at the start of a range of characters. Plain decimals
+ * with at most 15 significant digits are converted exactly with a single
+ * division, other forms such as exponents fall back to strtod on a copy
+ * of the number.
+ *
+ * @param  begin start of the number
+ * @param  end   end of the range, which is not read beyond
+ * @param  value updated with the number parsed
+ * @return the position after the number, or nullptr if there is no number
+ */
+inline const char *parse_double(const char *begin, const char *end,
+                                double *value) {
+  static const double POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15};
+  const char *p = begin;
+  bool negative = (p < end && *p == '-');
+  if (negative) ++p;
+  unsigned long long mantissa = 0;
+  int digits = 0;
+  int decimals = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10 + (*p - '0');
+    ++digits;
+    ++p;
+  }
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10 + (*p - '0');
+      ++digits;
+      ++decimals;
+      ++p;
+    }
+  }
+  bool exponent = p < end && (*p == 'e' || *p == 'E');
+  if (digits > 0 && digits <= 15 && !exponent) {
+    double v = (double) mantissa / POW10[decimals];
+    *value = negative ? -v : v;
+    return p;
+  }
+  // The characters of the number are copied as strtod needs a
+  // terminated string
+  char buffer[64];
+  std::size_t length = 0;
+  for (p = begin; p < end && length + 1 < sizeof(buffer); ++p, ++length) {
+    char c = *p;
+    if (!((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' ||
+        c == 'e' || c == 'E')) {
+      break;
+    }
+    buffer[length] = c;
+  }
+  buffer[length] = '\0';
+  char *stop;
+  *value = std::strtod(buffer, &stop);
+  if (stop == buffer) return nullptr;
+  return begin + (stop - buffer);
+}
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_NUMBER_PARSER_HPP
@@ -0,0 +1,112 @@
+/**
+ * Fast map matching.
+ *
+ * Parallel building blocks of the construction of the network
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_PARALLEL_HPP
+#define FMM_UTIL_PARALLEL_HPP
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Size below which the helpers run on a single thread, where starting
+ * the threads costs more than the work
+ */
+const long long PARALLEL_MIN_SIZE = 1 << 16;
+
+/**
+ * Get the number of threads of a parallel region over n items
+ */
+inline int get_parallel_threads(long long n) {
+#ifdef _OPENMP
+  if (n >= PARALLEL_MIN_SIZE && !omp_in_parallel()) {
+    return std::max(omp_get_max_threads(), 1);
+  }
+#endif
+  return 1;
+}
+
+/**
+ * Replace each value by the sum of the values up to it, included. The
+ * values are split into a block per thread, whose sums are added
+ * serially before the blocks are updated in parallel.
+ * @param values values updated
+ */
+template <typename T>
+void parallel_inclusive_scan(std::vector<T> *values) {
+  long long n = values->size();
+  int threads = get_parallel_threads(n);
+  if (threads == 1) {
+    for (long long i = 1; i < n; ++i) (*values)[i] += (*values)[i - 1];
+    return;
+  }
+  long long block = (n + threads - 1) / threads;
+  std::vector<T> block_sums(threads, T());
+  #pragma omp parallel for num_threads(threads)
+  for (int b = 0; b < threads; ++b) {
+    long long first = b * block, last = std::min(n, first + block);
+    for (long long i = first + 1; i < last; ++i) {
+      (*values)[i] += (*values)[i - 1];
+    }
+    if (first < last) block_sums[b] = (*values)[last - 1];
+  }
+  for (int b = 1; b < threads; ++b) block_sums[b] += block_sums[b - 1];
+  #pragma omp parallel for num_threads(threads)
+  for (int b = 1; b < threads; ++b) {
+    long long first = b * block, last = std::min(n, first + block);
+    for (long long i = first; i < last; ++i) {
+      (*values)[i] += block_sums[b - 1];
+    }
+  }
+}
+
+/**
+ * Sort a range stably. Blocks of the range are sorted in parallel, then
+ * merged pairwise, with the merges of a round run in parallel.
+ * @param first begin of the range
+ * @param last  end of the range
+ * @param comp  comparison of the items
+ */
+template <typename Iterator, typename Compare>
+void parallel_stable_sort(Iterator first, Iterator last, Compare comp) {
+  long long n = last - first;
+  int threads = get_parallel_threads(n);
+  if (threads == 1) {
+    std::stable_sort(first, last, comp);
+    return;
+  }
+  long long block = (n + threads - 1) / threads;
+  #pragma omp parallel for num_threads(threads)
+  for (int b = 0; b < threads; ++b) {
+    long long begin = std::min(n, b * block);
+    long long end = std::min(n, begin + block);
+    std::stable_sort(first + begin, first + end, comp);
+  }
+  for (long long width = block; width < n; width *= 2) {
+    long long merges = (n + 2 * width - 1) / (2 * width);
+    #pragma omp parallel for num_threads(threads)
+    for (long long m = 0; m < merges; ++m) {
+      long long begin = m * 2 * width;
+      long long middle = std::min(n, begin + width);
+      long long end = std::min(n, begin + 2 * width);
+      std::inplace_merge(first + begin, first + middle, first + end, comp);
+    }
+  }
+}
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_PARALLEL_HPP
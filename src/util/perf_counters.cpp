@@ -0,0 +1,113 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+const char *COUNTER_NAMES[NUM_PERF_COUNTERS] = {
+    "instructions", "cycles", "cache_misses", "branch_misses",
+    "dtlb_misses"};
+
+#ifdef __linux__
+int open_counter(int counter) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (counter) {
+    case PERF_INSTRUCTIONS:
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PERF_CYCLES:
+      attr.config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PERF_CACHE_MISSES:
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case PERF_BRANCH_MISSES:
+      attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+      break;
+    default:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB |
+          (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  }
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // The calling thread on any cpu
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+} // namespace
+
+PerfCounters::PerfCounters() {
+  for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+#ifdef __linux__
+    fds_[i] = open_counter(i);
+#else
+    fds_[i] = -1;
+#endif
+  }
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+    if (fds_[i] >= 0) close(fds_[i]);
+  }
+#endif
+}
+
+bool PerfCounters::is_available(int counter) const {
+  return fds_[counter] >= 0;
+}
+
+bool PerfCounters::is_open() const {
+  for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+    if (fds_[i] >= 0) return true;
+  }
+  return false;
+}
+
+void PerfCounters::read(PerfCounterValues *values) const {
+  for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+    values->values[i] = 0;
+#ifdef __linux__
+    if (fds_[i] < 0) continue;
+    // Value, time enabled and time running
+    uint64_t data[3];
+    if (::read(fds_[i], data, sizeof(data)) != sizeof(data)) continue;
+    if (data[2] == 0) continue;
+    values->values[i] = data[2] < data[1] ?
+        (long long) ((double) data[0] * data[1] / data[2]) :
+        (long long) data[0];
+#endif
+  }
+}
+
+PerfCounters &PerfCounters::local() {
+  static thread_local PerfCounters counters;
+  return counters;
+}
+
+const char *PerfCounters::get_counter_name(int counter) {
+  return COUNTER_NAMES[counter];
+}
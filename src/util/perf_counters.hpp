@@ -0,0 +1,99 @@
+/**
+ * Fast map matching.
+ *
+ * Hardware performance counters of the calling thread, read with the
+ * perf_event interface of Linux
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_PERF_COUNTERS_HPP
+#define FMM_UTIL_PERF_COUNTERS_HPP
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Hardware event counted
+ */
+enum PerfCounter {
+  PERF_INSTRUCTIONS = 0, /**< Instructions retired */
+  PERF_CYCLES = 1, /**< Core cycles */
+  PERF_CACHE_MISSES = 2, /**< Last level cache misses */
+  PERF_BRANCH_MISSES = 3, /**< Branches mispredicted */
+  PERF_DTLB_MISSES = 4, /**< Data TLB misses of the loads */
+  NUM_PERF_COUNTERS = 5
+};
+
+/**
+ * Values of the counters, which are differences of two reads or sums of
+ * them. A counter not available stays 0.
+ */
+struct PerfCounterValues {
+  long long values[NUM_PERF_COUNTERS] = {0, 0, 0, 0, 0};
+  inline PerfCounterValues &operator+=(const PerfCounterValues &other) {
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) values[i] += other.values[i];
+    return *this;
+  };
+  inline PerfCounterValues operator-(const PerfCounterValues &other) const {
+    PerfCounterValues result;
+    for (int i = 0; i < NUM_PERF_COUNTERS; ++i) {
+      result.values[i] = values[i] - other.values[i];
+    }
+    return result;
+  };
+  inline long long operator[](int i) const {
+    return values[i];
+  };
+};
+
+/**
+ * Hardware counters of the thread which opens them, counting in user
+ * space only so that the default perf_event_paranoid level allows them.
+ *
+ * Each counter is opened on its own, so that a counter missing from the
+ * host, such as the TLB misses of a virtual machine, leaves the others.
+ * When the kernel multiplexes the counters, their values are scaled by
+ * the share of the time they ran. A read costs a system call per
+ * counter, so the counters are read around a stage rather than per
+ * record.
+ */
+class PerfCounters {
+ public:
+  /**
+   * Open the counters of the calling thread
+   */
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+  /**
+   * Check if a counter is available
+   */
+  bool is_available(int counter) const;
+  /**
+   * Check if any counter is available
+   */
+  bool is_open() const;
+  /**
+   * Read the counters since they were opened
+   * @param values updated with the counters, 0 for the ones not available
+   */
+  void read(PerfCounterValues *values) const;
+  /**
+   * Get the counters of the calling thread, opened on the first call
+   */
+  static PerfCounters &local();
+  /**
+   * Name of a counter
+   */
+  static const char *get_counter_name(int counter);
+ private:
+  int fds_[NUM_PERF_COUNTERS];
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_PERF_COUNTERS_HPP
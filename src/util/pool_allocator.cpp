@@ -0,0 +1,64 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/pool_allocator.hpp"
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+const std::size_t NUM_CLASSES = NodePool::MAX_NODE_BYTES /
+    NodePool::ALIGNMENT;
+
+// A block released, linked to the next one of its size class
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+// Free lists and the chunk being carved of a thread
+struct ThreadPool {
+  FreeBlock *free_lists[NUM_CLASSES] = {};
+  char *cursor = nullptr;
+  char *end = nullptr;
+  std::size_t chunk_bytes = 0;
+};
+
+thread_local ThreadPool pool;
+
+inline std::size_t size_class(std::size_t bytes) {
+  return (bytes + NodePool::ALIGNMENT - 1) / NodePool::ALIGNMENT - 1;
+}
+
+} // namespace
+
+void *NodePool::allocate(std::size_t bytes) {
+  std::size_t c = size_class(bytes);
+  FreeBlock *block = pool.free_lists[c];
+  if (block != nullptr) {
+    pool.free_lists[c] = block->next;
+    return block;
+  }
+  std::size_t size = (c + 1) * ALIGNMENT;
+  if ((std::size_t) (pool.end - pool.cursor) < size) {
+    // The rest of the chunk is left unused
+    pool.cursor = static_cast<char *>(::operator new(CHUNK_BYTES));
+    pool.end = pool.cursor + CHUNK_BYTES;
+    pool.chunk_bytes += CHUNK_BYTES;
+  }
+  void *p = pool.cursor;
+  pool.cursor += size;
+  return p;
+}
+
+void NodePool::deallocate(void *p, std::size_t bytes) {
+  std::size_t c = size_class(bytes);
+  FreeBlock *block = static_cast<FreeBlock *>(p);
+  block->next = pool.free_lists[c];
+  pool.free_lists[c] = block;
+}
+
+std::size_t NodePool::get_chunk_bytes() {
+  return pool.chunk_bytes;
+}
@@ -0,0 +1,96 @@
+/**
+ * Fast map matching.
+ *
+ * Allocator of the nodes of the hash maps built by the routing, from
+ * free lists kept by each thread
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_POOL_ALLOCATOR_HPP
+#define FMM_UTIL_POOL_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <new>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Pool of small blocks of memory, with a free list of each size class
+ * kept by each thread, so that the threads allocating and releasing the
+ * nodes of their maps do not contend on the global allocator.
+ *
+ * The blocks are carved from chunks which are never returned, so that a
+ * block released by another thread than the one allocating it simply
+ * joins the free list of the releasing thread. The memory of a thread is
+ * thus bounded by the peak of the nodes it held at once.
+ */
+class NodePool {
+ public:
+  /**
+   * Allocate a block from the free list of the calling thread
+   * @param  bytes size of the block, at most MAX_NODE_BYTES
+   * @return pointer to the block
+   */
+  static void *allocate(std::size_t bytes);
+  /**
+   * Release a block to the free list of the calling thread
+   * @param p     pointer to the block
+   * @param bytes size of the block given to allocate
+   */
+  static void deallocate(void *p, std::size_t bytes);
+  /**
+   * Get the bytes of the chunks allocated by the calling thread
+   */
+  static std::size_t get_chunk_bytes();
+  static const std::size_t ALIGNMENT = 16; /**< Granularity of the size
+                                                classes */
+  static const std::size_t MAX_NODE_BYTES = 128; /**< Largest block
+                                                      pooled */
+  static const std::size_t CHUNK_BYTES = 64 * 1024; /**< Bytes of a chunk */
+};
+
+/**
+ * Allocator of the standard containers taking single elements up to
+ * NodePool::MAX_NODE_BYTES from the node pool, such as the nodes of a
+ * hash map. Arrays, such as the buckets of a hash map, are allocated
+ * with operator new. All the allocators are equal.
+ */
+template <typename T>
+class PoolAllocator {
+ public:
+  typedef T value_type;
+  PoolAllocator() = default;
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U> &) {};
+  inline T *allocate(std::size_t n) {
+    if (n == 1 && sizeof(T) <= NodePool::MAX_NODE_BYTES) {
+      return static_cast<T *>(NodePool::allocate(sizeof(T)));
+    }
+    return static_cast<T *>(::operator new(n * sizeof(T)));
+  };
+  inline void deallocate(T *p, std::size_t n) {
+    if (n == 1 && sizeof(T) <= NodePool::MAX_NODE_BYTES) {
+      NodePool::deallocate(p, sizeof(T));
+    } else {
+      ::operator delete(p);
+    }
+  };
+};
+
+template <typename T, typename U>
+inline bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+  return true;
+}
+
+template <typename T, typename U>
+inline bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+  return false;
+}
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_POOL_ALLOCATOR_HPP
@@ -0,0 +1,235 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/stage_profile.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+const char *STAGE_NAMES[NUM_MATCH_STAGES] = {
+    "search", "transition_graph", "update_tg", "backtrack", "cpath",
+    "geometry", "write"};
+
+// Profiles of all the threads, which are kept after the threads exit
+std::mutex profiles_mutex;
+std::vector<std::shared_ptr<StageProfile>> profiles;
+
+std::shared_ptr<StageProfile> register_profile() {
+  std::shared_ptr<StageProfile> profile = std::make_shared<StageProfile>();
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+  profiles.push_back(profile);
+  return profile;
+}
+
+double bucket_bound(int bucket) {
+  return std::pow(2.0, bucket / 4.0) * 1e-6;
+}
+
+void write_histogram(const StageHistogram &histogram, std::ostream &os) {
+  os << "\"count\":" << histogram.count
+     << ",\"p50\":" << histogram.quantile(0.5)
+     << ",\"p99\":" << histogram.quantile(0.99)
+     << ",\"max\":" << histogram.max;
+}
+
+} // namespace
+
+std::atomic<bool> StageProfile::enabled_{false};
+std::atomic<bool> StageProfile::counters_enabled_{false};
+
+void StageHistogram::add(double seconds) {
+  double us = seconds * 1e6;
+  int bucket = 0;
+  if (us >= 1) {
+    bucket = std::min(1 + (int) (std::log2(us) * 4), NUM_BUCKETS - 1);
+  }
+  ++counts[bucket];
+  ++count;
+  max = std::max(max, seconds);
+}
+
+void StageHistogram::merge(const StageHistogram &other) {
+  for (int i = 0; i < NUM_BUCKETS; ++i) counts[i] += other.counts[i];
+  count += other.count;
+  max = std::max(max, other.max);
+}
+
+double StageHistogram::quantile(double q) const {
+  if (count == 0) return 0;
+  long target = std::max(1L, (long) std::ceil(q * count));
+  long seen = 0;
+  for (int i = 0; i < NUM_BUCKETS; ++i) {
+    seen += counts[i];
+    if (seen >= target) return std::min(bucket_bound(i), max);
+  }
+  return max;
+}
+
+void StageProfile::set_enabled(bool enabled) {
+  enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void StageProfile::set_counters_enabled(bool enabled) {
+  if (enabled && !PerfCounters::local().is_open()) {
+    SPDLOG_WARN("Hardware counters not available, check "
+                "/proc/sys/kernel/perf_event_paranoid");
+  }
+  counters_enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+StageProfile &StageProfile::local() {
+  static thread_local std::shared_ptr<StageProfile> profile =
+      register_profile();
+  return *profile;
+}
+
+void StageProfile::add(MatchStage stage, const TimePoint &begin,
+                       const TimePoint &end) {
+  double seconds = std::chrono::duration<double>(end - begin).count();
+  current_[stage] += seconds;
+  started_ = true;
+  if (StageTrace::is_enabled()) {
+    events_.push_back(TraceEvent{-1, stage, -1,
+                                 StageTrace::to_microseconds(begin),
+                                 seconds * 1e6});
+  }
+}
+
+void StageProfile::add_counters(MatchStage stage,
+                                const PerfCounterValues &counters) {
+  current_counters_[stage] += counters;
+}
+
+void StageProfile::finish_trajectory(int id) {
+  if (!started_) return;
+  double total = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+      statistics_.totals[i] += current_[i];
+      statistics_.histograms[i].add(current_[i]);
+      statistics_.counters[i] += current_counters_[i];
+      total += current_[i];
+      current_[i] = 0;
+      current_counters_[i] = PerfCounterValues();
+    }
+    statistics_.trajectory.add(total);
+    started_ = false;
+  }
+  StageTrace::commit(id, total, &events_);
+  events_.clear();
+}
+
+void StageProfile::flush() {
+  if (!started_) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+    statistics_.totals[i] += current_[i];
+    statistics_.counters[i] += current_counters_[i];
+    current_[i] = 0;
+    current_counters_[i] = PerfCounterValues();
+  }
+  started_ = false;
+  events_.clear();
+}
+
+StageStatistics StageProfile::collect() {
+  StageStatistics statistics;
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+  for (const auto &profile : profiles) {
+    std::lock_guard<std::mutex> profile_lock(profile->mutex_);
+    const StageStatistics &local = profile->statistics_;
+    for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+      statistics.totals[i] += local.totals[i];
+      statistics.histograms[i].merge(local.histograms[i]);
+      statistics.counters[i] += local.counters[i];
+    }
+    statistics.trajectory.merge(local.trajectory);
+  }
+  return statistics;
+}
+
+void StageProfile::reset() {
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+  for (const auto &profile : profiles) {
+    std::lock_guard<std::mutex> profile_lock(profile->mutex_);
+    profile->statistics_ = StageStatistics();
+    std::fill(profile->current_.begin(), profile->current_.end(), 0);
+    std::fill(profile->current_counters_.begin(),
+              profile->current_counters_.end(), PerfCounterValues());
+    profile->started_ = false;
+  }
+}
+
+const char *StageProfile::get_stage_name(int stage) {
+  return STAGE_NAMES[stage];
+}
+
+void StageProfile::print(const StageStatistics &statistics) {
+  double total = 0;
+  for (double t : statistics.totals) total += t;
+  for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+    const StageHistogram &histogram = statistics.histograms[i];
+    SPDLOG_INFO("Stage {} time {} share {} p50 {} p99 {} max {}",
+                STAGE_NAMES[i], statistics.totals[i],
+                total > 0 ? statistics.totals[i] / total : 0.0,
+                histogram.quantile(0.5), histogram.quantile(0.99),
+                histogram.max);
+    if (is_counters_enabled()) {
+      const PerfCounterValues &counters = statistics.counters[i];
+      SPDLOG_INFO("Stage {} instructions {} ipc {} cache_misses {} "
+                  "branch_misses {} dtlb_misses {}", STAGE_NAMES[i],
+                  counters[PERF_INSTRUCTIONS],
+                  counters[PERF_CYCLES] > 0 ?
+                      (double) counters[PERF_INSTRUCTIONS] /
+                          counters[PERF_CYCLES] : 0.0,
+                  counters[PERF_CACHE_MISSES], counters[PERF_BRANCH_MISSES],
+                  counters[PERF_DTLB_MISSES]);
+    }
+  }
+  const StageHistogram &trajectory = statistics.trajectory;
+  SPDLOG_INFO("Trajectories profiled {} p50 {} p99 {} max {}",
+              trajectory.count, trajectory.quantile(0.5),
+              trajectory.quantile(0.99), trajectory.max);
+}
+
+bool StageProfile::write_json(const StageStatistics &statistics,
+                              const std::string &filename) {
+  std::ofstream ofs(filename);
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write stage profile {}", filename);
+    return false;
+  }
+  ofs << "{\"stages\":{";
+  for (int i = 0; i < NUM_MATCH_STAGES; ++i) {
+    if (i > 0) ofs << ",";
+    ofs << "\"" << STAGE_NAMES[i] << "\":{\"total\":"
+        << statistics.totals[i] << ",";
+    write_histogram(statistics.histograms[i], ofs);
+    if (is_counters_enabled()) {
+      ofs << ",\"counters\":{";
+      for (int j = 0; j < NUM_PERF_COUNTERS; ++j) {
+        if (j > 0) ofs << ",";
+        ofs << "\"" << PerfCounters::get_counter_name(j) << "\":"
+            << statistics.counters[i][j];
+      }
+      ofs << "}";
+    }
+    ofs << "}";
+  }
+  ofs << "},\"trajectory\":{";
+  write_histogram(statistics.trajectory, ofs);
+  ofs << "}}\n";
+  SPDLOG_INFO("Write stage profile to {}", filename);
+  return true;
+}
@@ -0,0 +1,222 @@
+/**
+ * Fast map matching.
+ *
+ * Time spent in the stages of map matching, accumulated per thread
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_STAGE_PROFILE_HPP
+#define FMM_UTIL_STAGE_PROFILE_HPP
+
+#include "util/util.hpp"
+#include "util/perf_counters.hpp"
+#include "util/stage_trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Stage of the matching of a trajectory
+ */
+enum MatchStage {
+  STAGE_SEARCH = 0, /**< Candidate search and pruning */
+  STAGE_TRANSITION_GRAPH = 1, /**< Transition graph and emission
+                                   probabilities */
+  STAGE_UPDATE_TG = 2, /**< Transition probabilities */
+  STAGE_BACKTRACK = 3, /**< Optimal path of the transition graph */
+  STAGE_CPATH = 4, /**< Complete path */
+  STAGE_GEOMETRY = 5, /**< Geometry of the complete path */
+  STAGE_WRITE = 6, /**< Formatting and writing of the results */
+  NUM_MATCH_STAGES = 7
+};
+
+/**
+ * Distribution of the time spent on a trajectory, in buckets spaced
+ * by a quarter of a power of 2 of microseconds
+ */
+struct StageHistogram {
+  static const int NUM_BUCKETS = 160; /**< Buckets up to about 10^12 us */
+  std::vector<long> counts =
+      std::vector<long>(NUM_BUCKETS, 0); /**< Trajectories per bucket */
+  long count = 0; /**< Trajectories counted */
+  double max = 0; /**< Maximum time, in seconds */
+  /**
+   * Count the time of a trajectory
+   * @param seconds time spent
+   */
+  void add(double seconds);
+  /**
+   * Merge the counts of another histogram
+   */
+  void merge(const StageHistogram &other);
+  /**
+   * Get the upper bound of the bucket of a quantile
+   * @param  q quantile between 0 and 1
+   * @return time in seconds, 0 if nothing is counted
+   */
+  double quantile(double q) const;
+};
+
+/**
+ * Time spent in each stage, in total and per trajectory
+ */
+struct StageStatistics {
+  std::vector<double> totals =
+      std::vector<double>(NUM_MATCH_STAGES, 0); /**< Total time per stage,
+                                                     in seconds */
+  std::vector<StageHistogram> histograms =
+      std::vector<StageHistogram>(NUM_MATCH_STAGES); /**< Time per
+                                                          trajectory of
+                                                          each stage */
+  StageHistogram trajectory; /**< Time per trajectory of all the stages */
+  std::vector<PerfCounterValues> counters =
+      std::vector<PerfCounterValues>(NUM_MATCH_STAGES); /**< Hardware
+      counters per stage, only counted if the counters are enabled */
+};
+
+/**
+ * Accumulator of the time spent in the stages by a thread.
+ *
+ * The profile is disabled by default, where the timers cost a branch.
+ * Each thread accumulates the times of its current trajectory without
+ * locking, and commits them into its statistics under the lock of its
+ * profile once per trajectory, so that the profiles can be merged by
+ * collect while the threads are matching. If the trace is enabled, the
+ * stages of the current trajectory are also kept as events, committed to
+ * the trace when the trajectory is finished. If the hardware counters are
+ * enabled, the clocks read them at each lap and add them per stage.
+ */
+class StageProfile {
+ public:
+  /**
+   * Enable or disable the profiling of all the threads
+   */
+  static void set_enabled(bool enabled);
+  /**
+   * Check if the profiling is enabled
+   */
+  static bool is_enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  /**
+   * Enable or disable the hardware counters of the stages, which are
+   * only read when the profiling is enabled
+   */
+  static void set_counters_enabled(bool enabled);
+  /**
+   * Check if the hardware counters are enabled
+   */
+  static bool is_counters_enabled() {
+    return counters_enabled_.load(std::memory_order_relaxed);
+  }
+  /**
+   * Get the profile of the calling thread
+   */
+  static StageProfile &local();
+  /**
+   * Add the time spent in a stage by the current trajectory
+   * @param stage stage of the matching
+   * @param begin start of the stage
+   * @param end   end of the stage
+   */
+  void add(MatchStage stage, const TimePoint &begin, const TimePoint &end);
+  /**
+   * Add the hardware counters of a stage of the current trajectory
+   * @param stage    stage of the matching
+   * @param counters counters of the stage
+   */
+  void add_counters(MatchStage stage, const PerfCounterValues &counters);
+  /**
+   * Count the times of the current trajectory in the histograms, commit
+   * its events to the trace and start the next one
+   * @param id id of the trajectory, written in the trace
+   */
+  void finish_trajectory(int id = -1);
+  /**
+   * Add the times accumulated to the totals without counting them as a
+   * trajectory, which is used by the threads writing the results
+   */
+  void flush();
+  /**
+   * Merge the profiles of all the threads
+   */
+  static StageStatistics collect();
+  /**
+   * Clear the profiles of all the threads
+   */
+  static void reset();
+  /**
+   * Log the time spent in each stage
+   */
+  static void print(const StageStatistics &statistics);
+  /**
+   * Write the time spent in each stage as JSON
+   * @param  statistics statistics collected
+   * @param  filename   file written
+   * @return true if written
+   */
+  static bool write_json(const StageStatistics &statistics,
+                         const std::string &filename);
+  /**
+   * Name of a stage
+   */
+  static const char *get_stage_name(int stage);
+ private:
+  std::mutex mutex_;
+  StageStatistics statistics_;
+  std::vector<double> current_ =
+      std::vector<double>(NUM_MATCH_STAGES, 0);
+  std::vector<PerfCounterValues> current_counters_ =
+      std::vector<PerfCounterValues>(NUM_MATCH_STAGES);
+  std::vector<TraceEvent> events_; // stages of the current trajectory
+  bool started_ = false;
+  static std::atomic<bool> enabled_;
+  static std::atomic<bool> counters_enabled_;
+};
+
+/**
+ * A clock adding the time elapsed since its last lap to a stage of the
+ * profile of the thread, which does nothing if the profile is disabled.
+ */
+class StageClock {
+ public:
+  StageClock() : enabled_(StageProfile::is_enabled()),
+                 counters_(enabled_ && StageProfile::is_counters_enabled()) {
+    if (enabled_) last_ = std::chrono::steady_clock::now();
+    if (counters_) PerfCounters::local().read(&last_counters_);
+  }
+  /**
+   * Add the time since the last lap to a stage
+   * @param stage stage which has ended
+   */
+  void lap(MatchStage stage) {
+    if (!enabled_) return;
+    TimePoint now = std::chrono::steady_clock::now();
+    StageProfile::local().add(stage, last_, now);
+    last_ = now;
+    if (counters_) {
+      PerfCounterValues counters;
+      PerfCounters::local().read(&counters);
+      StageProfile::local().add_counters(stage, counters - last_counters_);
+      last_counters_ = counters;
+    }
+  }
+ private:
+  bool enabled_;
+  bool counters_;
+  TimePoint last_;
+  PerfCounterValues last_counters_;
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_STAGE_PROFILE_HPP
@@ -0,0 +1,159 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/stage_trace.hpp"
+#include "util/stage_profile.hpp"
+#include "util/debug.hpp"
+
+#include <fstream>
+#include <memory>
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+// Stage of the slice enclosing the stages of a trajectory
+const int TRAJECTORY_STAGE = -1;
+
+// A slot of the ring buffer, whose sequence is odd while its event is
+// written and 2 * (index + 1) once the event of an index is published
+struct Slot {
+  std::atomic<unsigned long> sequence{0};
+  TraceEvent event;
+};
+
+std::unique_ptr<Slot[]> slots;
+unsigned long mask = 0;
+std::atomic<unsigned long> head{0};
+long sample_every = 0;
+double min_seconds = 0;
+TimePoint origin = std::chrono::steady_clock::now();
+std::atomic<long> trajectories{0};
+std::atomic<long> sampled{0};
+std::atomic<int> num_threads{0};
+
+thread_local long thread_count = 0;
+thread_local int thread_index = -1;
+
+void publish(const TraceEvent &event) {
+  unsigned long index = head.fetch_add(1, std::memory_order_relaxed);
+  Slot &slot = slots[index & mask];
+  slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.event = event;
+  slot.sequence.store(2 * index + 2, std::memory_order_release);
+}
+
+} // namespace
+
+std::atomic<bool> StageTrace::enabled_{false};
+
+void StageTrace::start(long sample_every_arg, double min_seconds_arg,
+                       long capacity) {
+  enabled_.store(false, std::memory_order_relaxed);
+  unsigned long size = 1;
+  while (size < (unsigned long) capacity) size <<= 1;
+  slots.reset(new Slot[size]);
+  mask = size - 1;
+  head = 0;
+  sample_every = sample_every_arg;
+  min_seconds = min_seconds_arg;
+  origin = std::chrono::steady_clock::now();
+  trajectories = 0;
+  sampled = 0;
+  enabled_.store(true, std::memory_order_relaxed);
+  SPDLOG_INFO("Trace 1 in {} trajectories and those over {} s, keeping "
+              "{} events", sample_every, min_seconds, size);
+}
+
+void StageTrace::stop() {
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+double StageTrace::to_microseconds(const TimePoint &time) {
+  return std::chrono::duration<double, std::micro>(time - origin).count();
+}
+
+void StageTrace::commit(int trajectory, double seconds,
+                        std::vector<TraceEvent> *events) {
+  if (!is_enabled() || events->empty()) return;
+  ++trajectories;
+  bool selected = (sample_every > 0 && ++thread_count % sample_every == 0) ||
+      (min_seconds > 0 && seconds >= min_seconds);
+  if (!selected) return;
+  ++sampled;
+  if (thread_index < 0) thread_index = num_threads++;
+  TraceEvent slice{trajectory, TRAJECTORY_STAGE, thread_index,
+                   events->front().begin,
+                   events->back().begin + events->back().duration -
+                       events->front().begin};
+  publish(slice);
+  for (TraceEvent &event : *events) {
+    event.trajectory = trajectory;
+    event.thread = thread_index;
+    publish(event);
+  }
+}
+
+std::vector<TraceEvent> StageTrace::collect() {
+  std::vector<TraceEvent> events;
+  if (slots == nullptr) return events;
+  unsigned long end = head.load(std::memory_order_acquire);
+  unsigned long begin = end > mask + 1 ? end - mask - 1 : 0;
+  for (unsigned long index = begin; index < end; ++index) {
+    Slot &slot = slots[index & mask];
+    unsigned long sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence != 2 * index + 2) continue;
+    TraceEvent event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != sequence) continue;
+    events.push_back(event);
+  }
+  return events;
+}
+
+TraceStatistics StageTrace::get_statistics() {
+  TraceStatistics statistics;
+  statistics.trajectories = trajectories;
+  statistics.sampled = sampled;
+  statistics.events = head;
+  if (slots != nullptr && statistics.events > (long) mask + 1) {
+    statistics.overwritten = statistics.events - mask - 1;
+  }
+  return statistics;
+}
+
+bool StageTrace::write_json(const std::string &filename) {
+  std::ofstream ofs(filename);
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write trace {}", filename);
+    return false;
+  }
+  std::vector<TraceEvent> events = collect();
+  ofs << std::fixed;
+  ofs.precision(3);
+  ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const TraceEvent &event = events[i];
+    if (i > 0) ofs << ",";
+    ofs << "\n{\"name\":\"";
+    if (event.stage == TRAJECTORY_STAGE) {
+      ofs << "trajectory " << event.trajectory << "\",\"cat\":\"trajectory";
+    } else {
+      ofs << StageProfile::get_stage_name(event.stage) << "\",\"cat\":\"stage";
+    }
+    ofs << "\",\"ph\":\"X\",\"ts\":" << event.begin
+        << ",\"dur\":" << event.duration
+        << ",\"pid\":0,\"tid\":" << event.thread
+        << ",\"args\":{\"trajectory\":" << event.trajectory << "}}";
+  }
+  ofs << "\n]}\n";
+  TraceStatistics statistics = get_statistics();
+  SPDLOG_INFO("Write trace of {} trajectories sampled in {}, events {} "
+              "overwritten {}", statistics.sampled, statistics.trajectories,
+              statistics.events, statistics.overwritten);
+  SPDLOG_INFO("Write trace to {}", filename);
+  return true;
+}
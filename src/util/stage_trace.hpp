@@ -0,0 +1,118 @@
+/**
+ * Fast map matching.
+ *
+ * Events of the stages of sampled trajectories, written as a Chrome trace
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_STAGE_TRACE_HPP
+#define FMM_UTIL_STAGE_TRACE_HPP
+
+#include "util/util.hpp"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * A stage of the matching of a trajectory
+ */
+struct TraceEvent {
+  int trajectory; /**< Id of the trajectory */
+  int stage; /**< Stage, a MatchStage */
+  int thread; /**< Index of the thread, in the order of their first
+                   trajectory traced */
+  double begin; /**< Start time, in microseconds since the trace is
+                     configured */
+  double duration; /**< Duration, in microseconds */
+};
+
+/**
+ * Counters of a trace
+ */
+struct TraceStatistics {
+  long trajectories = 0; /**< Trajectories finished while tracing */
+  long sampled = 0; /**< Trajectories whose events are recorded */
+  long events = 0; /**< Events recorded */
+  long overwritten = 0; /**< Oldest events overwritten by newer ones */
+};
+
+/**
+ * Tracer of the stages of the trajectories sampled, 1 in N trajectories
+ * of each thread and the trajectories slower than a threshold.
+ *
+ * The stages are timed by the stage profile, which should be enabled
+ * with the trace. Each thread keeps the events of its current trajectory
+ * and commits them if the trajectory is sampled, so that the trajectories
+ * not sampled cost a branch and a clear. The events committed go into a
+ * ring buffer of a fixed capacity shared by the threads, where a slot is
+ * claimed by an atomic counter and published by its sequence number,
+ * without locking. The oldest events are overwritten when the buffer is
+ * full.
+ */
+class StageTrace {
+ public:
+  /**
+   * Start tracing, which clears the events recorded
+   * @param sample_every 1 in sample_every trajectories of a thread
+   * recorded, 0 for none
+   * @param min_seconds  trajectories slower than it recorded, 0 for none
+   * @param capacity     maximum number of events kept, rounded up to a
+   * power of 2
+   */
+  static void start(long sample_every, double min_seconds,
+                    long capacity = DEFAULT_CAPACITY);
+  /**
+   * Stop tracing, keeping the events recorded
+   */
+  static void stop();
+  /**
+   * Check if the tracing is enabled
+   */
+  static bool is_enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  /**
+   * Convert a time point to microseconds since the trace is started
+   */
+  static double to_microseconds(const TimePoint &time);
+  /**
+   * Commit the events of a trajectory finished if it is sampled
+   * @param trajectory id of the trajectory
+   * @param seconds    time spent on the trajectory
+   * @param events     events of the trajectory, whose trajectory and
+   * thread are set if committed
+   */
+  static void commit(int trajectory, double seconds,
+                     std::vector<TraceEvent> *events);
+  /**
+   * Get the events kept, oldest first, skipping the ones being written
+   */
+  static std::vector<TraceEvent> collect();
+  /**
+   * Get the counters of the trace
+   */
+  static TraceStatistics get_statistics();
+  /**
+   * Write the events kept in the Chrome trace event format, read by
+   * chrome://tracing and Perfetto, where each trajectory is a slice
+   * enclosing the slices of its stages on the track of its thread
+   * @param  filename file written
+   * @return true if written
+   */
+  static bool write_json(const std::string &filename);
+  static const long DEFAULT_CAPACITY = 1 << 20; /**< Events kept by
+                                                    default */
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_STAGE_TRACE_HPP
@@ -0,0 +1,209 @@
+//
+// Created by Can Yang on 2020/4/1.
+//
+
+#include "util/tile_profile.hpp"
+#include "util/debug.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+
+using namespace FMM;
+using namespace FMM::CORE;
+using namespace FMM::UTIL;
+
+namespace {
+
+// Profiles of all the threads, which are kept after the threads exit
+std::mutex profiles_mutex;
+std::vector<std::shared_ptr<TileProfile>> profiles;
+
+std::shared_ptr<TileProfile> register_profile() {
+  std::shared_ptr<TileProfile> profile = std::make_shared<TileProfile>();
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+  profiles.push_back(profile);
+  return profile;
+}
+
+long long make_key(long long column, long long row) {
+  return (long long) ((unsigned long long) column << 32 |
+                      (unsigned int) row);
+}
+
+void write_counters(const TileCounters &c, char delim, std::ostream &os) {
+  os << c.points << delim << c.candidates << delim << c.kept << delim
+     << c.probes << delim << c.misses << delim << c.settled << delim
+     << c.seconds;
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+      s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+} // namespace
+
+std::atomic<bool> TileProfile::enabled_{false};
+std::atomic<double> TileProfile::tile_size_{0};
+
+TileCounters &TileCounters::operator+=(const TileCounters &other) {
+  points += other.points;
+  candidates += other.candidates;
+  kept += other.kept;
+  probes += other.probes;
+  misses += other.misses;
+  settled += other.settled;
+  seconds += other.seconds;
+  return *this;
+}
+
+void TileProfile::set_tile_size(double tile_size) {
+  tile_size_.store(tile_size > 0 ? tile_size : 0);
+  enabled_.store(tile_size > 0, std::memory_order_relaxed);
+}
+
+double TileProfile::get_tile_size() {
+  return tile_size_.load();
+}
+
+TileProfile &TileProfile::local() {
+  static thread_local std::shared_ptr<TileProfile> profile =
+      register_profile();
+  return *profile;
+}
+
+void TileProfile::add(const LineString &geom,
+                      const std::vector<TileCounters> &points) {
+  double tile_size = get_tile_size();
+  if (tile_size <= 0) return;
+  int n = std::min((int) points.size(), geom.get_num_points());
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (int i = 0; i < n; ++i) {
+    long long column = (long long) std::floor(geom.get_x(i) / tile_size);
+    long long row = (long long) std::floor(geom.get_y(i) / tile_size);
+    tiles_[make_key(column, row)] += points[i];
+  }
+}
+
+std::vector<TileStatistics> TileProfile::collect() {
+  std::unordered_map<long long, TileCounters> merged;
+  {
+    std::lock_guard<std::mutex> lock(profiles_mutex);
+    for (const auto &profile : profiles) {
+      std::lock_guard<std::mutex> profile_lock(profile->mutex_);
+      for (const auto &item : profile->tiles_) {
+        merged[item.first] += item.second;
+      }
+    }
+  }
+  std::vector<TileStatistics> tiles;
+  tiles.reserve(merged.size());
+  for (const auto &item : merged) {
+    tiles.push_back(TileStatistics{item.first >> 32,
+                                   (int) (item.first & 0xffffffffLL),
+                                   item.second});
+  }
+  std::sort(tiles.begin(), tiles.end(),
+            [](const TileStatistics &a, const TileStatistics &b) {
+              return a.row < b.row || (a.row == b.row && a.column < b.column);
+            });
+  return tiles;
+}
+
+void TileProfile::reset() {
+  std::lock_guard<std::mutex> lock(profiles_mutex);
+  for (const auto &profile : profiles) {
+    std::lock_guard<std::mutex> profile_lock(profile->mutex_);
+    profile->tiles_.clear();
+  }
+}
+
+void TileProfile::print(const std::vector<TileStatistics> &tiles, int top) {
+  std::vector<const TileStatistics *> sorted;
+  double total = 0;
+  for (const TileStatistics &tile : tiles) {
+    sorted.push_back(&tile);
+    total += tile.counters.seconds;
+  }
+  int n = std::min(top, (int) sorted.size());
+  std::partial_sort(sorted.begin(), sorted.begin() + n, sorted.end(),
+                    [](const TileStatistics *a, const TileStatistics *b) {
+                      return a->counters.seconds > b->counters.seconds;
+                    });
+  double tile_size = get_tile_size();
+  SPDLOG_INFO("Tiles profiled {} of size {} time {}", tiles.size(),
+              tile_size, total);
+  for (int i = 0; i < n; ++i) {
+    const TileStatistics &tile = *sorted[i];
+    const TileCounters &c = tile.counters;
+    SPDLOG_INFO("Tile x {} y {} time {} points {} candidates {} probes {} "
+                "misses {} settled {}", tile.column * tile_size,
+                tile.row * tile_size, c.seconds, c.points, c.candidates,
+                c.probes, c.misses, c.settled);
+  }
+}
+
+bool TileProfile::write_csv(const std::vector<TileStatistics> &tiles,
+                            const std::string &filename) {
+  std::ofstream ofs(filename);
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write tile profile {}", filename);
+    return false;
+  }
+  double tile_size = get_tile_size();
+  ofs << std::setprecision(12);
+  ofs << "column;row;xmin;ymin;xmax;ymax;points;candidates;kept;probes;"
+         "misses;settled;seconds\n";
+  for (const TileStatistics &tile : tiles) {
+    ofs << tile.column << ";" << tile.row << ";"
+        << tile.column * tile_size << ";" << tile.row * tile_size << ";"
+        << (tile.column + 1) * tile_size << ";"
+        << (tile.row + 1) * tile_size << ";";
+    write_counters(tile.counters, ';', ofs);
+    ofs << "\n";
+  }
+  SPDLOG_INFO("Write tile profile to {}", filename);
+  return true;
+}
+
+bool TileProfile::write_geojson(const std::vector<TileStatistics> &tiles,
+                                const std::string &filename) {
+  std::ofstream ofs(filename);
+  if (!ofs.good()) {
+    SPDLOG_ERROR("Fail to write tile profile {}", filename);
+    return false;
+  }
+  double tile_size = get_tile_size();
+  ofs << std::setprecision(12);
+  ofs << "{\"type\":\"FeatureCollection\",\"features\":[";
+  for (std::size_t i = 0; i < tiles.size(); ++i) {
+    const TileStatistics &tile = tiles[i];
+    const TileCounters &c = tile.counters;
+    double x1 = tile.column * tile_size, y1 = tile.row * tile_size;
+    double x2 = x1 + tile_size, y2 = y1 + tile_size;
+    if (i > 0) ofs << ",";
+    ofs << "\n{\"type\":\"Feature\",\"geometry\":{\"type\":\"Polygon\","
+        << "\"coordinates\":[[[" << x1 << "," << y1 << "],[" << x2 << ","
+        << y1 << "],[" << x2 << "," << y2 << "],[" << x1 << "," << y2
+        << "],[" << x1 << "," << y1 << "]]]},\"properties\":{"
+        << "\"column\":" << tile.column << ",\"row\":" << tile.row
+        << ",\"points\":" << c.points << ",\"candidates\":" << c.candidates
+        << ",\"kept\":" << c.kept << ",\"probes\":" << c.probes
+        << ",\"misses\":" << c.misses << ",\"settled\":" << c.settled
+        << ",\"seconds\":" << c.seconds << "}}";
+  }
+  ofs << "\n]}\n";
+  SPDLOG_INFO("Write tile profile to {}", filename);
+  return true;
+}
+
+bool TileProfile::write_file(const std::vector<TileStatistics> &tiles,
+                             const std::string &filename) {
+  if (ends_with(filename, ".geojson") || ends_with(filename, ".json")) {
+    return write_geojson(tiles, filename);
+  }
+  return write_csv(tiles, filename);
+}
@@ -0,0 +1,144 @@
+/**
+ * Fast map matching.
+ *
+ * Work of the matching accumulated per tile of a grid, locating the areas
+ * where the matching is slow
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_TILE_PROFILE_HPP
+#define FMM_UTIL_TILE_PROFILE_HPP
+
+#include "core/geometry.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Counters of the matching of the points of a tile
+ */
+struct TileCounters {
+  long points = 0; /**< Points matched */
+  long candidates = 0; /**< Candidates found by the search, each projected
+                            on its edge */
+  long kept = 0; /**< Candidates kept after the pruning */
+  long probes = 0; /**< Od pairs probed in UBODT, memoized ones included */
+  long misses = 0; /**< Od pairs probed but missing in UBODT */
+  long settled = 0; /**< Nodes settled by the searches of STMATCH */
+  double seconds = 0; /**< Time spent */
+  TileCounters &operator+=(const TileCounters &other);
+};
+
+/**
+ * Counters of a tile, whose lower left corner is at column * tile_size
+ * and row * tile_size
+ */
+struct TileStatistics {
+  long long column; /**< Column of the tile */
+  long long row; /**< Row of the tile */
+  TileCounters counters; /**< Counters of the points in the tile */
+};
+
+/**
+ * Accumulator of the counters of the matching per tile of a square grid,
+ * used to find the areas where the matching is slow, such as dense
+ * grids of streets and interchanges, and to tune the radius, k and
+ * delta per region.
+ *
+ * The profile is disabled by default, where the models only check a flag.
+ * A model keeps the counters of the points of a trajectory in its
+ * workspace, and commits them to the profile of its thread once per
+ * trajectory, so that the profiles are merged by collect while the threads
+ * are matching. The work of a transition is counted at the point it
+ * enters, and the time of the search is shared by the points. The tiles
+ * are in the coordinates of the network as matched, which are metres if
+ * the network is projected.
+ */
+class TileProfile {
+ public:
+  /**
+   * Enable the profiling of all the threads with a tile size, or disable
+   * it with a size of 0
+   */
+  static void set_tile_size(double tile_size);
+  /**
+   * Check if the profiling is enabled
+   */
+  static bool is_enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+  /**
+   * Get the size of the tiles
+   */
+  static double get_tile_size();
+  /**
+   * Get the profile of the calling thread
+   */
+  static TileProfile &local();
+  /**
+   * Add the counters of the points of a trajectory to their tiles
+   * @param geom   points of the trajectory
+   * @param points counters of each point, of the size of geom or less if
+   * the matching stopped early
+   */
+  void add(const CORE::LineString &geom,
+           const std::vector<TileCounters> &points);
+  /**
+   * Merge the profiles of all the threads
+   * @return the tiles having a point, sorted by row and column
+   */
+  static std::vector<TileStatistics> collect();
+  /**
+   * Clear the profiles of all the threads
+   */
+  static void reset();
+  /**
+   * Log the tiles taking the most time
+   * @param tiles tiles collected
+   * @param top   number of tiles logged
+   */
+  static void print(const std::vector<TileStatistics> &tiles, int top = 5);
+  /**
+   * Write the tiles as CSV, with the column, row, bounds and counters of
+   * each tile
+   * @param  tiles    tiles collected
+   * @param  filename file written
+   * @return true if written
+   */
+  static bool write_csv(const std::vector<TileStatistics> &tiles,
+                        const std::string &filename);
+  /**
+   * Write the tiles as a GeoJSON feature collection of their squares,
+   * whose properties are the counters
+   * @param  tiles    tiles collected
+   * @param  filename file written
+   * @return true if written
+   */
+  static bool write_geojson(const std::vector<TileStatistics> &tiles,
+                            const std::string &filename);
+  /**
+   * Write the tiles as GeoJSON if the file name ends with .geojson or
+   * .json, otherwise as CSV
+   */
+  static bool write_file(const std::vector<TileStatistics> &tiles,
+                         const std::string &filename);
+ private:
+  std::mutex mutex_;
+  // Counters of the tile (column, row) at column << 32 | row
+  std::unordered_map<long long, TileCounters> tiles_;
+  static std::atomic<bool> enabled_;
+  static std::atomic<double> tile_size_;
+};
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_TILE_PROFILE_HPP
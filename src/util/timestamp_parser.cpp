@@ -0,0 +1,157 @@
+/**
+ * Fast map matching.
+ *
+ * Definition of the parsing of timestamps
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#include "util/timestamp_parser.hpp"
+#include "util/number_parser.hpp"
+
+using namespace FMM;
+using namespace FMM::UTIL;
+
+namespace {
+
+// Parse a fixed number of digits, false if one is missing
+bool parse_digits(const char **p, const char *end, int count, int *value) {
+  if (end - *p < count) return false;
+  int v = 0;
+  for (int i = 0; i < count; ++i) {
+    unsigned digit = (unsigned char) (*p)[i] - '0';
+    if (digit > 9) return false;
+    v = v * 10 + (int) digit;
+  }
+  *p += count;
+  *value = v;
+  return true;
+}
+
+// Days from 1970-01-01 to a date of the proleptic Gregorian calendar
+long long days_from_civil(long long y, int m, int d) {
+  y -= m <= 2;
+  long long era = (y >= 0 ? y : y - 399) / 400;
+  long long yoe = y - era * 400;
+  long long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  long long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// Parse an integer of epoch units into seconds, keeping the remainder
+// apart so that the seconds are rounded once
+const char *parse_epoch_integer(const char *begin, const char *end,
+                                long long units, double *value) {
+  const char *p = begin;
+  bool negative = p < end && *p == '-';
+  if (negative) ++p;
+  const char *digits = p;
+  long long v = 0;
+  while (p < end && *p >= '0' && *p <= '9' && p - digits < 18) {
+    v = v * 10 + (*p - '0');
+    ++p;
+  }
+  if (p == digits) return nullptr;
+  double seconds = (double) (v / units) + (double) (v % units) / units;
+  *value = negative ? -seconds : seconds;
+  return p;
+}
+
+// Parse an ISO 8601 date and time, with the separators of the extended
+// format, into seconds since the epoch
+const char *parse_iso8601(const char *begin, const char *end,
+                          double *value) {
+  static const double POW10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+  const char *p = begin;
+  int year, month, day, hour = 0, minute = 0, second = 0;
+  if (!parse_digits(&p, end, 4, &year) || p == end || *p++ != '-' ||
+      !parse_digits(&p, end, 2, &month) || p == end || *p++ != '-' ||
+      !parse_digits(&p, end, 2, &day) ||
+      month < 1 || month > 12 || day < 1 || day > 31) {
+    return nullptr;
+  }
+  double fraction = 0;
+  if (p < end && (*p == 'T' || *p == 't' || *p == ' ')) {
+    ++p;
+    if (!parse_digits(&p, end, 2, &hour) || p == end || *p++ != ':' ||
+        !parse_digits(&p, end, 2, &minute)) {
+      return nullptr;
+    }
+    if (p < end && *p == ':') {
+      ++p;
+      if (!parse_digits(&p, end, 2, &second)) return nullptr;
+      if (p < end && *p == '.') {
+        ++p;
+        // Digits beyond the nanoseconds are read and ignored
+        long long numerator = 0;
+        int decimals = 0;
+        const char *digits = p;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+          if (decimals < 9) {
+            numerator = numerator * 10 + (*p - '0');
+            ++decimals;
+          }
+        }
+        if (p == digits) return nullptr;
+        fraction = numerator / POW10[decimals];
+      }
+    }
+    if (hour > 24 || minute > 59 || second > 60) return nullptr;
+    int offset = 0;
+    if (p < end && (*p == 'Z' || *p == 'z')) {
+      ++p;
+    } else if (p < end && (*p == '+' || *p == '-')) {
+      int sign = *p++ == '-' ? -1 : 1;
+      int offset_hour, offset_minute = 0;
+      if (!parse_digits(&p, end, 2, &offset_hour)) return nullptr;
+      if (p < end && *p == ':') {
+        ++p;
+        if (!parse_digits(&p, end, 2, &offset_minute)) return nullptr;
+      } else if (p < end && *p >= '0' && *p <= '9') {
+        if (!parse_digits(&p, end, 2, &offset_minute)) return nullptr;
+      }
+      offset = sign * (offset_hour * 3600 + offset_minute * 60);
+    }
+    second -= offset;
+  }
+  long long seconds = days_from_civil(year, month, day) * 86400LL +
+      hour * 3600LL + minute * 60LL + second;
+  *value = (double) seconds + fraction;
+  return p;
+}
+
+} // namespace
+
+bool FMM::UTIL::string2timestamp_format(const std::string &name,
+                                        TimestampFormat *format) {
+  if (name == "seconds") {
+    *format = EPOCH_SECONDS;
+  } else if (name == "ms") {
+    *format = EPOCH_MILLISECONDS;
+  } else if (name == "us") {
+    *format = EPOCH_MICROSECONDS;
+  } else if (name == "iso8601") {
+    *format = ISO8601;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char *FMM::UTIL::parse_timestamp(const char *begin, const char *end,
+                                       TimestampFormat format,
+                                       double *value) {
+  switch (format) {
+    case EPOCH_MILLISECONDS:
+      return parse_epoch_integer(begin, end, 1000, value);
+    case EPOCH_MICROSECONDS:
+      return parse_epoch_integer(begin, end, 1000000, value);
+    case ISO8601:
+      return parse_iso8601(begin, end, value);
+    default:
+      return parse_double(begin, end, value);
+  }
+}
+
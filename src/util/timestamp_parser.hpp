@@ -0,0 +1,62 @@
+/**
+ * Fast map matching.
+ *
+ * Parsing of timestamps in place, as epoch numbers or ISO 8601 dates,
+ * without a terminated string
+ *
+ * @author: Can Yang
+ * @version: 2020.01.31
+ */
+
+#ifndef FMM_UTIL_TIMESTAMP_PARSER_HPP
+#define FMM_UTIL_TIMESTAMP_PARSER_HPP
+
+#include <string>
+
+namespace FMM {
+namespace UTIL {
+
+/**
+ * Format of the timestamps of a text file, which are converted into
+ * seconds since the epoch
+ */
+enum TimestampFormat {
+  EPOCH_SECONDS = 0, /**< Seconds, as any decimal number */
+  EPOCH_MILLISECONDS = 1, /**< Integer milliseconds since the epoch */
+  EPOCH_MICROSECONDS = 2, /**< Integer microseconds since the epoch */
+  ISO8601 = 3 /**< Date and time such as 2020-01-31T08:30:00.250+01:00,
+                   in UTC without a time zone */
+};
+
+/**
+ * Parse the name of a timestamp format, seconds, ms, us or iso8601
+ * @param  name   name of the format
+ * @param  format updated with the format
+ * @return false if the name is unknown
+ */
+bool string2timestamp_format(const std::string &name,
+                             TimestampFormat *format);
+
+/**
+ * Parse a timestamp at the start of a range of characters into seconds
+ * since the epoch, without allocation.
+ *
+ * An ISO 8601 timestamp is a date, optionally followed by T or a space,
+ * the time with its seconds and their fraction optional, and the time
+ * zone as Z or an offset such as +01:00, +0100 or +01. A time without a
+ * time zone is taken as UTC.
+ *
+ * @param  begin  start of the timestamp
+ * @param  end    end of the range, which is not read beyond
+ * @param  format format of the timestamp
+ * @param  value  updated with the seconds since the epoch
+ * @return the position after the timestamp, or nullptr if there is no
+ * timestamp
+ */
+const char *parse_timestamp(const char *begin, const char *end,
+                            TimestampFormat format, double *value);
+
+} // UTIL
+} // FMM
+
+#endif // FMM_UTIL_TIMESTAMP_PARSER_HPP
@@ -70,6 +70,14 @@ bool file_exists(const std::string &filename) {
   return file_exists(filename.c_str());
 }
 
+long long get_file_size(const std::string &filename) {
+  struct stat buf;
+  if (stat(filename.c_str(), &buf) != -1) {
+    return buf.st_size;
+  }
+  return -1;
+}
+
 std::vector<std::string> split_string(const std::string &str) {
   char delim = ',';
   std::vector<std::string> result;
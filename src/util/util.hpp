@@ -99,6 +99,12 @@ bool file_exists(const char *filename);
  * @return true if file exists
  */
 bool file_exists(const std::string &filename);
+/**
+ * Get the size of a file
+ * @param  filename file name
+ * @return size of the file in bytes, or -1 if it does not exist
+ */
+long long get_file_size(const std::string &filename);
 /**
  * Check if folder exists or not
  * @param  folder_name folder name
@@ -2,6 +2,8 @@
 #include "catch2/catch.hpp"
 #include "util/debug.hpp"
 #include "algorithm/geom_algorithm.hpp"
+#include "algorithm/projection_kernel.hpp"
+#include "algorithm/geometry_kernel.hpp"
 
 using namespace FMM;
 using namespace FMM::CORE;
@@ -103,4 +105,165 @@ TEST_CASE( "Algorithm are tested", "[algorithm]" ) {
       "LineString(0 0,0 1,0 2,1 1,2 1,2 0.5)");
     REQUIRE(expected_6 == result_6);
   }
+
+  SECTION( "linestring_view" ) {
+    std::vector<double> xs = {0,0,0,1,2,2};
+    std::vector<double> ys = {0,1,2,1,1,0};
+    LineStringView view(xs.data(),ys.data(),xs.size());
+    REQUIRE(view.to_linestring() == line);
+    REQUIRE(view.get_length() == Approx(line.get_length()));
+    double x1,y1,x2,y2;
+    boundingbox_geometry(view,&x1,&y1,&x2,&y2);
+    REQUIRE( x1 == 0 );
+    REQUIRE( y1 == 0 );
+    REQUIRE( x2 == 2 );
+    REQUIRE( y2 == 2 );
+    double result_dist,result_offset,proj_x,proj_y;
+    linear_referencing(1,3,view,&result_dist,&result_offset,&proj_x,&proj_y);
+    REQUIRE( result_dist == Approx(sqrt(2)));
+    REQUIRE( result_offset == 2 );
+    REQUIRE( proj_x == 0 );
+    REQUIRE( proj_y == 2 );
+    REQUIRE(cutoffseg_unique(view,1,2+sqrt(2)/2) ==
+            cutoffseg_unique(line,1,2+sqrt(2)/2));
+    REQUIRE(cutoffseg(view,0.5,0) == cutoffseg(line,0.5,0));
+    REQUIRE(cutoffseg(view,0.5,1) == cutoffseg(line,0.5,1));
+    // Precomputed cumulative lengths
+    std::vector<double> cumlen = {0,1,2,2+sqrt(2),3+sqrt(2),4+sqrt(2)};
+    LineStringView cumlen_view(xs.data(),ys.data(),xs.size(),cumlen.data());
+    REQUIRE(cumlen_view.get_length() == Approx(line.get_length()));
+    linear_referencing(1,3,cumlen_view,&result_dist,&result_offset,
+                       &proj_x,&proj_y);
+    REQUIRE( result_offset == 2 );
+    locate_point_by_offset(cumlen_view,2+sqrt(2),&proj_x,&proj_y);
+    REQUIRE( proj_x == Approx(1.0) );
+    REQUIRE( proj_y == Approx(1.0) );
+    // The binary search over the lengths finds the points of the scan
+    for (double offset : {-1.0,0.0,0.5,1.0,2.5,3+sqrt(2),10.0}) {
+      double x,y;
+      locate_point_by_offset(line,offset,&x,&y);
+      locate_point_by_offset(cumlen_view,offset,&proj_x,&proj_y);
+      REQUIRE( proj_x == Approx(x) );
+      REQUIRE( proj_y == Approx(y) );
+    }
+    REQUIRE(cutoffseg(cumlen_view,0.5,0) == cutoffseg(line,0.5,0));
+    REQUIRE(cutoffseg_unique(cumlen_view,1,2+sqrt(2)/2) ==
+            cutoffseg_unique(line,1,2+sqrt(2)/2));
+    // Cut written into an array
+    LineString cut = cutoffseg_unique(line,1,2+sqrt(2)/2);
+    int num_points = cutoffseg_unique(cumlen_view,1,2+sqrt(2)/2,nullptr);
+    REQUIRE(num_points == cut.get_num_points());
+    std::vector<Point> points(num_points);
+    cutoffseg_unique(cumlen_view,1,2+sqrt(2)/2,points.data());
+    for (int i = 0; i < num_points; ++i) {
+      REQUIRE(boost::geometry::get<0>(points[i]) == Approx(cut.get_x(i)));
+      REQUIRE(boost::geometry::get<1>(points[i]) == Approx(cut.get_y(i)));
+    }
+    std::vector<double> to_end = calc_length_to_end_vec(line);
+    std::vector<double> view_to_end = calc_length_to_end_vec(cumlen_view);
+    REQUIRE(view_to_end.size() == to_end.size());
+    for (int i = 0; i < to_end.size(); ++i) {
+      REQUIRE(view_to_end[i] == Approx(to_end[i]));
+    }
+  }
+
+  SECTION( "closest_segment" ) {
+    // More segments than the SIMD width, with a repeated point
+    LineString zigzag = wkt2linestring(
+      "LineString(0 0,1 1,2 0,2 0,3 1,4 0,5 1,6 0,7 1,8 0,9 1,10 0)");
+    std::vector<double> xs, ys;
+    for (int i = 0; i < zigzag.get_num_points(); ++i) {
+      xs.push_back(zigzag.get_x(i));
+      ys.push_back(zigzag.get_y(i));
+    }
+    LineStringView view(xs.data(),ys.data(),xs.size());
+    double dist2;
+    REQUIRE(closest_segment(8.5,0.3,xs.data(),ys.data(),xs.size(),&dist2)==9);
+    REQUIRE(dist2 == Approx(0.02));
+    for (double px = -1; px <= 11; px += 0.25) {
+      for (double py = -1; py <= 2; py += 0.5) {
+        double dist,offset,proj_x,proj_y;
+        double view_dist,view_offset,view_x,view_y;
+        linear_referencing(px,py,zigzag,&dist,&offset,&proj_x,&proj_y);
+        linear_referencing(px,py,view,&view_dist,&view_offset,
+                           &view_x,&view_y);
+        REQUIRE(view_dist == Approx(dist));
+        REQUIRE(view_offset == Approx(offset));
+        REQUIRE(view_x == Approx(proj_x));
+        REQUIRE(view_y == Approx(proj_y));
+      }
+    }
+  }
+
+  SECTION( "geometry_kernel" ) {
+    // More segments than the SIMD width, with negative coordinates
+    LineString zigzag = wkt2linestring(
+      "LineString(0 0,1 1,2 0,2 0,3 1,4 0,5 1,6 0,7 1,8 0,-9 -1,-10 -2)");
+    int n = zigzag.get_num_points();
+    std::vector<double> xs, ys;
+    for (int i = 0; i < n; ++i) {
+      xs.push_back(zigzag.get_x(i));
+      ys.push_back(zigzag.get_y(i));
+    }
+    std::vector<double> lengths(n - 1);
+    segment_lengths(xs.data(),ys.data(),n,lengths.data());
+    std::vector<double> eu_dists = cal_eu_dist(zigzag);
+    REQUIRE(eu_dists.size() == lengths.size());
+    for (int i = 0; i < n - 1; ++i) {
+      double dx = xs[i+1] - xs[i];
+      double dy = ys[i+1] - ys[i];
+      REQUIRE(lengths[i] == sqrt(dx*dx + dy*dy));
+      REQUIRE(eu_dists[i] == lengths[i]);
+    }
+    std::vector<double> min_x(n-1), min_y(n-1), max_x(n-1), max_y(n-1);
+    segment_boxes(xs.data(),ys.data(),n,min_x.data(),min_y.data(),
+                  max_x.data(),max_y.data());
+    REQUIRE(min_x[9] == -9);
+    REQUIRE(max_y[9] == 0);
+    // The segment boxes touching the query box on a border intersect it
+    std::vector<int> hits(n-1);
+    int num_hits = boxes_intersect(min_x.data(),min_y.data(),max_x.data(),
+                                   max_y.data(),n-1,2,0.5,5,2,hits.data());
+    REQUIRE(num_hits == 5);
+    REQUIRE(hits[0] == 1);
+    REQUIRE(hits[1] == 3);
+    REQUIRE(hits[2] == 4);
+    REQUIRE(hits[3] == 5);
+    REQUIRE(hits[4] == 6);
+    double x1,y1,x2,y2;
+    LineStringView view(xs.data(),ys.data(),n);
+    boundingbox_geometry(view,&x1,&y1,&x2,&y2);
+    REQUIRE( x1 == -10 );
+    REQUIRE( y1 == -2 );
+    REQUIRE( x2 == 8 );
+    REQUIRE( y2 == 1 );
+    // A box of negative coordinates
+    boundingbox_geometry(wkt2linestring("LineString(-3 -2,-1 -4)"),
+                         &x1,&y1,&x2,&y2);
+    REQUIRE( x2 == -1 );
+    REQUIRE( y2 == -2 );
+  }
+  SECTION( "hilbert_index" ) {
+    // The first cells of the curve fill a 4 by 4 block, and consecutive
+    // cells are neighbours
+    unsigned int px = 0, py = 0;
+    for (unsigned int d = 0; d < 16; ++d) {
+      bool found = false;
+      for (unsigned int x = 0; x < 4 && !found; ++x) {
+        for (unsigned int y = 0; y < 4 && !found; ++y) {
+          if (hilbert_index(x,y) != d) continue;
+          found = true;
+          if (d > 0) {
+            REQUIRE( (x > px ? x - px : px - x) +
+                     (y > py ? y - py : py - y) == 1 );
+          }
+          px = x;
+          py = y;
+        }
+      }
+      REQUIRE( found );
+    }
+    REQUIRE( hilbert_index(0,0) == 0 );
+    REQUIRE( hilbert_index(65535,0) == 65536ULL*65536ULL-1 );
+  }
 }
@@ -1,12 +1,58 @@
 #define CATCH_CONFIG_MAIN
 #include "catch2/catch.hpp"
 
+#include "capi/fmm_capi.h"
 #include "util/debug.hpp"
+#include "util/memory.hpp"
+#include "util/metrics.hpp"
+#include "util/util.hpp"
+#include "util/stage_profile.hpp"
+#include "util/tile_profile.hpp"
+#include "util/timestamp_parser.hpp"
 #include "network/network.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "network/edge_closures.hpp"
+#include "network/network_tiles.hpp"
+#include "mm/fmm/distance_matrix.hpp"
 #include "mm/fmm/fmm_algorithm.hpp"
+#include "mm/fmm/fmm_coordinator.hpp"
+#include "mm/fmm/fmm_server.hpp"
+#include "mm/fmm/fmm_stream.hpp"
+#include "mm/fmm/ubodt_gen_app.hpp"
+#include "mm/fmm/ubodt_profile.hpp"
+#include "mm/fmm/ubodt_shard.hpp"
+#include "mm/hybrid/hybrid_algorithm.hpp"
+#include "mm/stmatch/stmatch_algorithm.hpp"
+#include "mm/parameter_sweep.hpp"
 #include "mm/transition_graph.hpp"
+#include "mm/transition_kernel.hpp"
+#include "mm/composite_graph.hpp"
+#include "algorithm/probability_kernel.hpp"
 #include "core/gps.hpp"
 #include "io/gps_reader.hpp"
+#include "io/binary_trajectory.hpp"
+#include "io/match_pipeline.hpp"
+#include "io/csv_format.hpp"
+#include "io/edge_aggregate_writer.hpp"
+#include "io/edge_index.hpp"
+#include "io/http_client.hpp"
+#include "io/http_server.hpp"
+#include "io/match_state.hpp"
+#include "io/rematch_filter.hpp"
+#include "io/result_cache.hpp"
+#include "io/result_stream.hpp"
+
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <zlib.h>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
 
 using namespace FMM;
 using namespace FMM::IO;
@@ -14,6 +60,21 @@ using namespace FMM::CORE;
 using namespace FMM::NETWORK;
 using namespace FMM::MM;
 
+namespace {
+
+// Exposes the steps of STMATCH, whose routing modes are compared
+class STMATCHSteps : public STMATCH {
+ public:
+  using STMATCH::STMATCH;
+  using STMATCH::update_tg;
+  using STMATCH::build_cpath;
+  using STMATCH::layer_distances;
+  using STMATCH::shortest_path_upperbound;
+  using STMATCH::shortest_path_upperbound_multi;
+};
+
+} // namespace
+
 TEST_CASE( "fmm is tested", "[fmm]" ) {
   spdlog::set_level((spdlog::level::level_enum) 0);
   spdlog::set_pattern("[%l][%s:%-3#] %v");
@@ -33,4 +94,3585 @@ TEST_CASE( "fmm is tested", "[fmm]" ) {
     REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
     REQUIRE(expected_mgeom==result.mgeom);
   }
+  SECTION( "ubodt_flat_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    auto flat = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,FLAT);
+    REQUIRE(flat->get_num_rows()==chained->get_num_rows());
+    REQUIRE(flat->get_delta()==chained->get_delta());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = flat->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) {
+          REQUIRE(a->next_e==b->next_e);
+          REQUIRE(a->cost==b->cost);
+        }
+      }
+    }
+    FastMapMatch model(network,graph,flat);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+  }
+  SECTION( "ubodt_mmap_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(chained->write_ubodt_mmap("ubodt_test.mmap"));
+    auto mapped = UBODT::read_ubodt_file("ubodt_test.mmap");
+    REQUIRE(mapped->get_layout()==FLAT);
+    REQUIRE(mapped->get_num_rows()==chained->get_num_rows());
+    REQUIRE(mapped->get_delta()==chained->get_delta());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = mapped->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) {
+          REQUIRE(a->first_n==b->first_n);
+          REQUIRE(a->cost==b->cost);
+        }
+      }
+    }
+    std::remove("ubodt_test.mmap");
+  }
+  SECTION( "ubodt_image_writer_test" ) {
+    // Rows of 100 x 100 nodes, spread over 16 partitions of the
+    // smallest size
+    std::vector<Record> rows;
+    for (NodeIndex s = 0; s < 100; ++s) {
+      for (NodeIndex t = 0; t < 100; ++t) {
+        rows.push_back({s,t,t,s,(EdgeIndex) (s+t),s*0.5+t,nullptr});
+      }
+    }
+    for (bool compact : {false, true}) {
+      UBODTImageWriter writer("ubodt_image_test.mmap",100,compact,1);
+      REQUIRE(writer.add(std::vector<Record>(rows.begin(),
+                                             rows.begin()+5000)));
+      REQUIRE(writer.add(std::vector<Record>(rows.begin()+5000,
+                                             rows.end())));
+      REQUIRE(writer.get_num_rows()==10000);
+      REQUIRE(writer.finish());
+      REQUIRE(!UTIL::file_exists("ubodt_image_test.mmap.spill"));
+      REQUIRE(!UTIL::file_exists("ubodt_image_test.mmap.spill.0"));
+      auto mapped = UBODT::read_ubodt_mmap("ubodt_image_test.mmap");
+      REQUIRE(mapped!=nullptr);
+      REQUIRE(mapped->get_layout()==(compact ? COMPACT : FLAT));
+      REQUIRE(mapped->get_num_rows()==10000);
+      REQUIRE(mapped->get_delta()==Approx(148.5));
+      for (const Record &r : rows) {
+        double cost;
+        REQUIRE(mapped->look_up_cost(r.source,r.target,&cost));
+        REQUIRE(cost==Approx(r.cost));
+      }
+      double cost;
+      REQUIRE(!mapped->look_up_cost(100,0,&cost));
+    }
+    std::remove("ubodt_image_test.mmap");
+  }
+  SECTION( "ubodt_compact_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    auto compact = UBODT::read_ubodt_csv(
+        "../data/ubodt.txt",multiplier,COMPACT);
+    REQUIRE(compact->get_num_rows()==chained->get_num_rows());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        double a, b;
+        REQUIRE(chained->look_up_cost(s,t,&a)==compact->look_up_cost(s,t,&b));
+        if (chained->look_up(s,t)!=nullptr) {
+          REQUIRE(b==Approx(a));
+          REQUIRE_THAT(compact->look_sp_path(s,t),
+                       Catch::Equals<EdgeIndex>(chained->look_sp_path(s,t)));
+        }
+      }
+    }
+    REQUIRE(compact->write_ubodt_mmap("ubodt_test.mmap"));
+    auto mapped = UBODT::read_ubodt_file("ubodt_test.mmap");
+    REQUIRE(mapped->get_layout()==COMPACT);
+    FastMapMatch model(network,graph,mapped);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    std::remove("ubodt_test.mmap");
+  }
+  SECTION( "ubodt_split_test" ) {
+    auto flat = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,FLAT);
+    auto split = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,SPLIT);
+    REQUIRE(split->get_layout()==SPLIT);
+    REQUIRE(split->get_num_rows()==flat->get_num_rows());
+    std::vector<NodeIndex> nodes;
+    for (NodeIndex t = 0; t < multiplier; ++t) nodes.push_back(t);
+    std::vector<double> costs;
+    split->look_up_batch(nodes,nodes,&costs);
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        double a, b;
+        REQUIRE(flat->look_up_cost(s,t,&a)==split->look_up_cost(s,t,&b));
+        Record *r = flat->look_up(s,t);
+        REQUIRE((r==nullptr)==(costs[s*multiplier+t]<0));
+        if (r!=nullptr) {
+          REQUIRE(b==Approx(a));
+          REQUIRE(costs[s*multiplier+t]==b);
+          REQUIRE(split->look_up(s,t)->first_n==r->first_n);
+          REQUIRE_THAT(split->look_sp_path(s,t),
+                       Catch::Equals<EdgeIndex>(flat->look_sp_path(s,t)));
+        }
+      }
+    }
+    // The image of a split table is written as a flat table
+    REQUIRE(split->write_ubodt_mmap("ubodt_test.mmap"));
+    auto mapped = UBODT::read_ubodt_file("ubodt_test.mmap");
+    REQUIRE(mapped->get_layout()==FLAT);
+    REQUIRE(mapped->get_num_rows()==split->get_num_rows());
+    std::remove("ubodt_test.mmap");
+    FastMapMatch model(network,graph,split);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+  }
+  SECTION( "ubodt_reorder_test" ) {
+    auto flat = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,FLAT);
+    flat->enable_probe_counts(multiplier);
+    FastMapMatch model(network,graph,flat);
+    FastMapMatchConfig config{4,0.4,0.5};
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+    }
+    std::vector<long long> counts = flat->get_probe_counts();
+    REQUIRE(std::accumulate(counts.begin(),counts.end(),0LL)>0);
+    REQUIRE(UBODT::write_probe_counts(counts,"ubodt_probes.csv"));
+    std::vector<long long> read_counts;
+    REQUIRE(UBODT::read_probe_counts("ubodt_probes.csv",&read_counts));
+    read_counts.resize(counts.size(),0);
+    REQUIRE_THAT(read_counts,Catch::Equals<long long>(counts));
+    std::remove("ubodt_probes.csv");
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (auto table : {flat, chained}) {
+      auto reordered = table->reorder_by_probes(counts);
+      REQUIRE(reordered->get_layout()==table->get_layout());
+      REQUIRE(reordered->get_num_rows()==table->get_num_rows());
+      REQUIRE(reordered->get_delta()==table->get_delta());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *a = table->look_up(s,t);
+          Record *b = reordered->look_up(s,t);
+          REQUIRE((a==nullptr)==(b==nullptr));
+          if (a!=nullptr) {
+            REQUIRE(a->next_e==b->next_e);
+            REQUIRE(a->cost==b->cost);
+          }
+        }
+      }
+      FastMapMatch reordered_model(network,graph,reordered);
+      MatchResult result =
+          reordered_model.match_traj(trajectories[0],config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    }
+    auto csr = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,CSR);
+    REQUIRE(csr->reorder_by_probes(counts)==nullptr);
+  }
+  SECTION( "ubodt_parallel_csv_test" ) {
+    auto serial = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (UBODTLayout layout : {CHAINED, FLAT, COMPACT, SPLIT, CSR}) {
+      auto parallel = UBODT::read_ubodt_csv_parallel(
+          "../data/ubodt.txt",multiplier,layout);
+      REQUIRE(parallel->get_num_rows()==serial->get_num_rows());
+      REQUIRE(parallel->get_delta()==serial->get_delta());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          double a, b;
+          REQUIRE(serial->look_up_cost(s,t,&a)==
+                  parallel->look_up_cost(s,t,&b));
+          if (serial->look_up(s,t)!=nullptr) {
+            REQUIRE(b==Approx(a));
+            REQUIRE(serial->look_up(s,t)->next_e==
+                    parallel->look_up(s,t)->next_e);
+          }
+        }
+      }
+    }
+    // An empty or malformed cost is rejected, not read from the next row,
+    // and so is an empty or malformed node
+    std::string malformed_file = "ubodt_malformed_test.txt";
+    {
+      std::ofstream ofs(malformed_file);
+      ofs << "source;target;next_n;prev_n;next_e;distance\n"
+          << "0;1;1;0;3;1.5\n1;2;2;1;4;\n2;3;3;2;5;abc\n3;4;4;3;6;2e0\n"
+          << "5;6;;5;8;1.0\n6;7;7x;6;9;1.0\n4;5;5;4;7;";
+    }
+    auto parallel = UBODT::read_ubodt_csv_parallel(malformed_file,multiplier);
+    REQUIRE(parallel->get_num_rows()==2);
+    double cost;
+    REQUIRE(parallel->look_up_cost(0,1,&cost));
+    REQUIRE(cost==1.5);
+    REQUIRE(parallel->look_up_cost(3,4,&cost));
+    REQUIRE(cost==2.0);
+    REQUIRE(parallel->look_up(1,2)==nullptr);
+    REQUIRE(parallel->look_up(2,3)==nullptr);
+    REQUIRE(parallel->look_up(4,5)==nullptr);
+    REQUIRE(parallel->look_up(5,6)==nullptr);
+    REQUIRE(parallel->look_up(6,7)==nullptr);
+    std::remove(malformed_file.c_str());
+  }
+  SECTION( "ubodt_binary_test" ) {
+    auto serial = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    {
+      std::ofstream ofs("ubodt_test.bin");
+      boost::archive::binary_oarchive oa(ofs);
+      serial->for_each_record([&oa](const Record &r) {
+        oa << r.source << r.target << r.first_n << r.prev_n << r.next_e
+           << r.cost;
+      });
+    }
+    REQUIRE(UBODT::estimate_ubodt_rows("ubodt_test.bin")>=
+            serial->get_num_rows());
+    auto archive = UBODT::read_ubodt_archive("ubodt_test.bin",multiplier);
+    REQUIRE(archive->get_num_rows()==serial->get_num_rows());
+    // Only the rows between the first half of the nodes are kept
+    std::vector<char> nodes(multiplier,0);
+    std::fill(nodes.begin(),nodes.begin()+multiplier/2,1);
+    for (UBODTLayout layout : {CHAINED, FLAT, COMPACT, CSR}) {
+      for (bool parallel : {false, true}) {
+        auto binary = UBODT::read_ubodt_binary(
+            "ubodt_test.bin",multiplier,layout,nullptr,parallel);
+        auto filtered = UBODT::read_ubodt_binary(
+            "ubodt_test.bin",multiplier,layout,&nodes,parallel);
+        REQUIRE(binary->get_num_rows()==serial->get_num_rows());
+        REQUIRE(binary->get_delta()==serial->get_delta());
+        for (NodeIndex s = 0; s < multiplier; ++s) {
+          for (NodeIndex t = 0; t < multiplier; ++t) {
+            Record *expected = serial->look_up(s,t);
+            Record *r = binary->look_up(s,t);
+            REQUIRE((expected==nullptr)==(r==nullptr));
+            if (expected==nullptr) continue;
+            REQUIRE(r->next_e==expected->next_e);
+            REQUIRE(r->first_n==expected->first_n);
+            REQUIRE(r->cost==Approx(expected->cost));
+            REQUIRE((filtered->look_up(s,t)!=nullptr)==
+                    (nodes[s] && nodes[t]));
+          }
+        }
+      }
+    }
+    std::remove("ubodt_test.bin");
+  }
+  SECTION( "ubodt_gen_writer_test" ) {
+    auto full = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (std::string output : {"ubodt_gen_test.csv.gz","ubodt_gen_test.bin",
+                               "ubodt_gen_test.csv"}) {
+      for (bool use_omp : {false, true}) {
+        std::vector<std::string> args{
+            "ubodt_gen","--network","../data/network.gpkg",
+            "--no_network_cache","--delta","3","--cost_precision","3",
+            "-o",output};
+        // The parallel generation is written asynchronously
+        if (use_omp) {
+          args.push_back("--use_omp");
+          args.push_back("--async_write");
+        }
+        std::vector<char *> argv;
+        for (std::string &arg : args) argv.push_back(&arg[0]);
+        UBODTGenAppConfig config(argv.size(),argv.data());
+        REQUIRE(config.validate());
+        REQUIRE(config.is_gzip_output()==
+                UTIL::check_file_extension(output,"gz"));
+        UBODTGenApp app(config);
+        app.run();
+        auto generated = UBODT::read_ubodt_file(output,multiplier);
+        REQUIRE(generated->get_num_rows()>0);
+        generated->for_each_record([&](const Record &r) {
+          Record *expected = full->look_up(r.source,r.target);
+          REQUIRE(expected!=nullptr);
+          REQUIRE(r.cost==Approx(expected->cost).margin(5e-4));
+        });
+        std::remove(output.c_str());
+      }
+    }
+  }
+  SECTION( "ubodt_csr_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    auto csr = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,CSR);
+    REQUIRE(csr->get_num_rows()==chained->get_num_rows());
+    std::vector<NodeIndex> targets;
+    for (NodeIndex t = 0; t < multiplier; ++t) targets.push_back(t);
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      std::vector<double> costs;
+      csr->look_up_many(s,targets,&costs);
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *r = chained->look_up(s,t);
+        REQUIRE((r==nullptr)==(costs[t]<0));
+        if (r!=nullptr) {
+          REQUIRE(costs[t]==r->cost);
+          REQUIRE(csr->look_up(s,t)->next_e==r->next_e);
+        }
+      }
+    }
+    FastMapMatch model(network,graph,csr);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+  }
+  SECTION( "ubodt_bucket_test" ) {
+    REQUIRE(UBODT::find_bucket_number(1)==1);
+    REQUIRE(UBODT::find_bucket_number(1000)==1024);
+    REQUIRE(UBODT::find_bucket_number(3e10)==(1LL<<35));
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    std::vector<long> distribution = chained->get_chain_distribution();
+    long rows = 0;
+    for (size_t i = 0; i < distribution.size(); ++i)
+      rows += i * distribution[i];
+    REQUIRE(rows==chained->get_num_rows());
+    REQUIRE(chained->get_chain_distribution(1).size()>0);
+  }
+  SECTION( "ubodt_compressed_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(chained->write_ubodt_compressed("ubodt_test.ubz"));
+    for (UBODTLayout layout : {CHAINED, FLAT, CSR}) {
+      auto loaded = UBODT::read_ubodt_compressed("ubodt_test.ubz",layout);
+      REQUIRE(loaded!=nullptr);
+      REQUIRE(loaded->get_num_rows()==chained->get_num_rows());
+      REQUIRE(loaded->get_delta()==chained->get_delta());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *a = chained->look_up(s,t);
+          Record *b = loaded->look_up(s,t);
+          REQUIRE((a==nullptr)==(b==nullptr));
+          if (a!=nullptr) {
+            REQUIRE(a->first_n==b->first_n);
+            REQUIRE(a->prev_n==b->prev_n);
+            REQUIRE(a->next_e==b->next_e);
+            REQUIRE(a->cost==b->cost);
+          }
+        }
+      }
+    }
+    std::remove("ubodt_test.ubz");
+  }
+  SECTION( "ubodt_lazy_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    auto lazy = UBODT::create_lazy_ubodt(graph,chained->get_delta()+1);
+    REQUIRE(lazy->get_layout()==LAZY);
+    REQUIRE(lazy->get_num_rows()==0);
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        if (a!=nullptr) {
+          double cost;
+          REQUIRE(lazy->look_up_cost(s,t,&cost));
+          REQUIRE(cost==Approx(a->cost));
+          REQUIRE_THAT(lazy->look_sp_path(s,t),
+                       Catch::Equals<EdgeIndex>(chained->look_sp_path(s,t)));
+        }
+      }
+    }
+    REQUIRE(lazy->get_num_rows()>=chained->get_num_rows());
+    FastMapMatch model(network,graph,lazy);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    // A small cache evicts sources but still answers every query
+    auto small = UBODT::create_lazy_ubodt(graph,chained->get_delta()+1,1);
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        double a, b;
+        REQUIRE(lazy->look_up_cost(s,t,&a)==small->look_up_cost(s,t,&b));
+      }
+    }
+    REQUIRE(small->get_num_rows()<lazy->get_num_rows());
+  }
+  SECTION( "ubodt_generate_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (UBODTLayout layout : {CHAINED, FLAT, CSR}) {
+      auto generated = UBODT::generate_ubodt(graph,chained->get_delta()+1,
+                                             layout);
+      REQUIRE(generated->get_num_rows()>=chained->get_num_rows());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *a = chained->look_up(s,t);
+          if (a!=nullptr) {
+            double cost;
+            REQUIRE(generated->look_up_cost(s,t,&cost));
+            REQUIRE(cost==Approx(a->cost));
+          }
+        }
+      }
+      FastMapMatch model(network,graph,generated);
+      FastMapMatchConfig config{4,0.4,0.5};
+      MatchResult result = model.match_traj(trajectories[0],config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    }
+    // The table written is read back with the same rows
+    auto generated = UBODT::generate_ubodt(graph,chained->get_delta()+1,
+                                           FLAT);
+    REQUIRE(generated->write_ubodt_mmap("ubodt_generate_test.mmap"));
+    auto mapped = UBODT::read_ubodt_mmap("ubodt_generate_test.mmap");
+    REQUIRE(mapped!=nullptr);
+    REQUIRE(mapped->get_num_rows()==generated->get_num_rows());
+    std::remove("ubodt_generate_test.mmap");
+  }
+  SECTION( "bulk_path_query_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    std::vector<unsigned int> sources, targets;
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        sources.push_back(s);
+        targets.push_back(t);
+      }
+    }
+    int n = sources.size();
+    PYTHON::PyPathArrays looked = chained->look_sp_paths(
+        sources.data(),n,targets.data(),n,2);
+    PYTHON::PyPathArrays searched = graph.shortest_paths(
+        sources.data(),n,targets.data(),n,2);
+    REQUIRE(looked.distances.size()==n);
+    REQUIRE(looked.offsets.size()==n+1);
+    REQUIRE(looked.offsets.back()==looked.edges.size());
+    REQUIRE(searched.offsets.back()==searched.edges.size());
+    for (int i = 0; i < n; ++i) {
+      Record *r = chained->look_up(sources[i],targets[i]);
+      if (r==nullptr) continue;
+      REQUIRE(looked.distances[i]==Approx(r->cost));
+      REQUIRE(searched.distances[i]==Approx(r->cost));
+      std::vector<int> path(looked.edges.begin()+looked.offsets[i],
+                            looked.edges.begin()+looked.offsets[i+1]);
+      std::vector<EdgeIndex> expected =
+          chained->look_sp_path(sources[i],targets[i]);
+      REQUIRE_THAT(path,Catch::Equals<int>(
+          std::vector<int>(expected.begin(),expected.end())));
+    }
+    // The pairs should have as many sources as targets
+    REQUIRE_THROWS(graph.shortest_paths(sources.data(),n,targets.data(),
+                                        n-1));
+    unsigned int outside = multiplier;
+    REQUIRE_THROWS(graph.shortest_paths(&outside,1,&outside,1));
+  }
+  SECTION( "ubodt_tiled_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    // Split the rows into tiles of side length 2 by their source node
+    std::vector<unsigned int> node_tiles(multiplier);
+    std::map<std::pair<int,int>,unsigned int> cells;
+    for (NodeIndex u = 0; u < multiplier; ++u) {
+      const Point &p = network.get_vertex_point(u);
+      auto cell = std::make_pair((int) std::floor(p.get<0>()/2),
+                                 (int) std::floor(p.get<1>()/2));
+      if (cells.find(cell)==cells.end()) {
+        unsigned int tile = cells.size();
+        cells[cell] = tile;
+      }
+      node_tiles[u] = cells[cell];
+    }
+    REQUIRE(cells.size()>1);
+    std::vector<long long> tile_rows(cells.size(),0);
+    for (unsigned int tile = 0; tile < cells.size(); ++tile) {
+      UBODT table(1024,multiplier,0,FLAT);
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        if (node_tiles[s]!=tile) continue;
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *r = chained->look_up(s,t);
+          if (r!=nullptr) table.insert(*r);
+        }
+      }
+      tile_rows[tile] = table.get_num_rows();
+      if (tile_rows[tile]>0) {
+        REQUIRE(table.write_ubodt_mmap(
+            UBODT::get_tile_file("ubodt_test.tiles",tile)));
+      }
+    }
+    REQUIRE(UBODT::write_ubodt_tile_index(
+        "ubodt_test.tiles",node_tiles,tile_rows,chained->get_delta()));
+    auto tiled = UBODT::read_ubodt_tiled("ubodt_test.tiles",1);
+    REQUIRE(tiled!=nullptr);
+    REQUIRE(tiled->get_layout()==TILED);
+    REQUIRE(tiled->get_num_rows()==chained->get_num_rows());
+    REQUIRE(tiled->get_delta()==chained->get_delta());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = tiled->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) {
+          REQUIRE(a->next_e==b->next_e);
+          REQUIRE(a->cost==b->cost);
+        }
+      }
+    }
+    FastMapMatch model(network,graph,tiled);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    // The rows of the tiles not loaded yet are searched up to the delta
+    REQUIRE(UBODT::write_ubodt_tile_index(
+        "ubodt_test.tiles",node_tiles,tile_rows,chained->get_delta()+1));
+    auto progressive = UBODT::read_ubodt_tiled("ubodt_test.tiles",1);
+    REQUIRE(progressive->start_progressive_load(graph,1));
+    REQUIRE(!progressive->start_progressive_load(graph,1));
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        if (a!=nullptr) {
+          double cost;
+          REQUIRE(progressive->look_up_cost(s,t,&cost));
+          REQUIRE(cost==Approx(a->cost));
+        }
+      }
+    }
+    progressive->wait_progressive_load();
+    REQUIRE(!progressive->is_loading());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = progressive->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) REQUIRE(a->cost==b->cost);
+      }
+    }
+    REQUIRE(!chained->start_progressive_load(graph));
+    std::remove("ubodt_test.tiles");
+    for (unsigned int tile = 0; tile < cells.size(); ++tile) {
+      std::remove(UBODT::get_tile_file("ubodt_test.tiles",tile).c_str());
+    }
+  }
+  SECTION( "ubodt_unroll_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(!chained->unroll_paths());
+    for (UBODTLayout layout : {FLAT, CSR}) {
+      auto unrolled = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                            layout);
+      REQUIRE(unrolled->unroll_paths());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          REQUIRE_THAT(unrolled->look_sp_path(s,t),
+                       Catch::Equals<EdgeIndex>(chained->look_sp_path(s,t)));
+        }
+      }
+      FastMapMatch model(network,graph,unrolled);
+      FastMapMatchConfig config{4,0.4,0.5};
+      MatchResult result = model.match_traj(trajectories[0],config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    }
+  }
+  SECTION( "ubodt_metric_cost_test" ) {
+    // The id of an edge is read as its extra cost
+    Network costed("../data/network.gpkg","id","source","target",false,
+                   SpatialIndexOptions(),false,false,NetworkClip(),false,
+                   {"id"});
+    REQUIRE(costed.get_metric_index("length")==0);
+    REQUIRE(costed.get_metric_index("id")==1);
+    REQUIRE(costed.get_metric_index("time")==-1);
+    NetworkGraph costed_graph(costed);
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(!chained->build_metric_costs(costed));
+    REQUIRE(chained->get_metric_count()==1);
+    for (UBODTLayout layout : {FLAT, CSR}) {
+      auto table = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                         layout);
+      REQUIRE(table->build_metric_costs(costed));
+      REQUIRE(table->get_metric_count()==2);
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *r = table->look_up(s,t);
+          double length = -1, cost = -1;
+          REQUIRE(table->look_up_cost(s,t,0,&length)==(r!=nullptr));
+          REQUIRE(table->look_up_cost(s,t,1,&cost)==(r!=nullptr));
+          if (r==nullptr) continue;
+          REQUIRE(length==r->cost);
+          double expected = 0;
+          for (EdgeIndex e : table->look_sp_path(s,t)) {
+            expected += costed.get_edge_cost(1,e);
+          }
+          REQUIRE(cost==Approx(expected));
+        }
+      }
+      FastMapMatch model(costed,costed_graph,table);
+      REQUIRE(!model.set_metric("time"));
+      REQUIRE(model.set_metric("id"));
+      FastMapMatchConfig config{4,0.4,0.5};
+      MatchResult result = model.match_traj(trajectories[0],config);
+      REQUIRE(!result.cpath.empty());
+      REQUIRE(model.set_metric("length"));
+      result = model.match_traj(trajectories[0],config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    }
+  }
+  SECTION( "ubodt_shm_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    UBODT::remove_ubodt_shm("/fmm_ubodt_test");
+    REQUIRE(chained->publish_ubodt_shm("/fmm_ubodt_test"));
+    auto shared = UBODT::read_ubodt_file(
+        UBODT::SHM_PREFIX + "/fmm_ubodt_test");
+    REQUIRE(shared!=nullptr);
+    REQUIRE(shared->get_layout()==FLAT);
+    REQUIRE(shared->get_num_rows()==chained->get_num_rows());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = shared->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) {
+          REQUIRE(a->next_e==b->next_e);
+          REQUIRE(a->cost==b->cost);
+        }
+      }
+    }
+    REQUIRE(UBODT::remove_ubodt_shm("/fmm_ubodt_test"));
+  }
+  SECTION( "ubodt_filter_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    for (UBODTLayout layout : {CHAINED, FLAT, COMPACT, CSR}) {
+      auto filtered = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                            layout);
+      REQUIRE(filtered->build_miss_filter());
+      std::vector<NodeIndex> targets(multiplier);
+      for (NodeIndex t = 0; t < multiplier; ++t) targets[t] = t;
+      std::vector<double> costs;
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        filtered->look_up_many(s,targets,&costs);
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *a = chained->look_up(s,t);
+          Record *b = filtered->look_up(s,t);
+          REQUIRE((a==nullptr)==(b==nullptr));
+          REQUIRE((a==nullptr)==(costs[t]<0));
+        }
+      }
+      FastMapMatch model(network,graph,filtered);
+      FastMapMatchConfig config{4,0.4,0.5};
+      MatchResult result = model.match_traj(trajectories[0],config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    }
+    auto lazy = UBODT::create_lazy_ubodt(graph,3);
+    REQUIRE(!lazy->build_miss_filter());
+  }
+  SECTION( "ubodt_batch_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    std::vector<NodeIndex> sources, targets;
+    for (NodeIndex s = 0; s < multiplier; s += 2) sources.push_back(s);
+    for (NodeIndex t = 0; t < multiplier; ++t) targets.push_back(t);
+    // The pairs of the product listed one by one
+    std::vector<NodeIndex> pair_sources, pair_targets;
+    for (NodeIndex s : sources) {
+      for (NodeIndex t : targets) {
+        pair_sources.push_back(s);
+        pair_targets.push_back(t);
+      }
+    }
+    for (UBODTLayout layout : {CHAINED, FLAT, COMPACT, CSR}) {
+      for (bool filter : {false, true}) {
+        auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                           layout);
+        if (filter) REQUIRE(ubodt->build_miss_filter());
+        std::vector<double> costs, pair_costs;
+        ubodt->look_up_batch(sources,targets,&costs);
+        ubodt->look_up_pairs(pair_sources,pair_targets,&pair_costs);
+        REQUIRE(costs.size()==sources.size()*targets.size());
+        REQUIRE_THAT(pair_costs,Catch::Equals<double>(costs));
+        for (size_t i = 0; i < sources.size(); ++i) {
+          for (size_t j = 0; j < targets.size(); ++j) {
+            double cost;
+            double batched = costs[i*targets.size()+j];
+            if (chained->look_up_cost(sources[i],targets[j],&cost)) {
+              REQUIRE(batched==Approx(cost));
+            } else {
+              REQUIRE(batched<0);
+            }
+          }
+        }
+      }
+    }
+  }
+  SECTION( "ubodt_lookup_cache_test" ) {
+    long owner = UBODTLookupCache::new_owner();
+    UBODTLookupCache &cache = UBODTLookupCache::local(owner,4);
+    double cost;
+    REQUIRE(!cache.find(1,2,&cost));
+    cache.insert(1,2,3.5);
+    cache.insert(2,1,-1);
+    REQUIRE(cache.find(1,2,&cost));
+    REQUIRE(cache.find(2,1,&cost));
+    REQUIRE(cost==-1);
+    LookupCacheStatistics statistics = UBODTLookupCache::collect(owner);
+    REQUIRE(statistics.hits==2);
+    REQUIRE(statistics.misses==1);
+    // The cache is cleared when taken by another model
+    long other = UBODTLookupCache::new_owner();
+    REQUIRE(!UBODTLookupCache::local(other,4).find(1,2,&cost));
+    REQUIRE(UBODTLookupCache::collect(owner).hits==0);
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    std::vector<MatchResult> expected;
+    for (const Trajectory &trajectory : trajectories) {
+      expected.push_back(model.match_traj(trajectory,config));
+    }
+    // A small cache evicts the pairs, a large one keeps them all
+    for (int entries : {4, UBODTLookupCache::DEFAULT_ENTRIES}) {
+      FastMapMatch cached(network,graph,ubodt);
+      cached.set_lookup_cache(entries);
+      for (int round = 0; round < 2; ++round) {
+        for (size_t i = 0; i < trajectories.size(); ++i) {
+          MatchResult result = cached.match_traj(trajectories[i],config);
+          REQUIRE_THAT(result.cpath,Catch::Equals<int>(expected[i].cpath));
+          REQUIRE(result.opt_candidate_path.size()==
+                  expected[i].opt_candidate_path.size());
+          for (size_t j = 0; j < result.opt_candidate_path.size(); ++j) {
+            REQUIRE(result.opt_candidate_path[j].sp_dist==
+                    expected[i].opt_candidate_path[j].sp_dist);
+          }
+        }
+      }
+      statistics = cached.get_lookup_cache_statistics();
+      REQUIRE(statistics.misses>0);
+    }
+    // The second round of the large cache only hits
+    REQUIRE(statistics.hits>=statistics.misses);
+  }
+  SECTION( "transition_memo_test" ) {
+    TransitionMemo memo;
+    double cost;
+    REQUIRE(!memo.find(1,2,&cost));
+    memo.insert(1,2,3.5);
+    memo.insert(2,1,-1);
+    REQUIRE(memo.find(1,2,&cost));
+    REQUIRE(cost==3.5);
+    REQUIRE(memo.find(2,1,&cost));
+    REQUIRE(cost==-1);
+    REQUIRE(memo.get_hits()==2);
+    REQUIRE(memo.get_misses()==1);
+    // The pairs are cleared for the next trajectory, not the counters
+    memo.clear();
+    REQUIRE(!memo.find(1,2,&cost));
+    REQUIRE(memo.get_misses()==2);
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+    }
+    LookupCacheStatistics statistics = model.get_transition_memo_statistics();
+    REQUIRE(statistics.misses>0);
+    // The memo is only a shortcut of UBODT
+    FastMapMatch parallel(network,graph,ubodt);
+    config.parallel_viterbi = 2;
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult result = parallel.match_traj(trajectory,config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>(
+          model.match_traj(trajectory,FastMapMatchConfig{4,0.4,0.5}).cpath));
+    }
+    REQUIRE(parallel.get_transition_memo_statistics().hits==0);
+  }
+  SECTION( "ubodt_long_range_test" ) {
+    auto full = UBODT::create_lazy_ubodt(graph,3);
+    auto ubodt = UBODT::create_lazy_ubodt(graph,1.5);
+    auto hierarchy = std::make_shared<ContractionHierarchy>(
+        network,std::numeric_limits<double>::infinity(),false,false);
+    REQUIRE(!ubodt->set_long_range(hierarchy,1));
+    REQUIRE(!ubodt->has_long_range());
+    REQUIRE(ubodt->set_long_range(hierarchy,3));
+    REQUIRE(ubodt->has_long_range());
+    REQUIRE(ubodt->get_delta()==3);
+    const std::vector<Edge> &edges = network.get_edges();
+    std::vector<NodeIndex> sources, targets;
+    for (NodeIndex s = 0; s < multiplier; ++s) sources.push_back(s);
+    targets = sources;
+    std::vector<double> costs;
+    ubodt->look_up_batch(sources,targets,&costs);
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      std::vector<double> row;
+      ubodt->look_up_many(s,targets,&row);
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        double expected, cost;
+        bool found = full->look_up_cost(s,t,&expected);
+        REQUIRE(ubodt->look_up_cost(s,t,&cost)==found);
+        if (!found) {
+          REQUIRE(row[t]<0);
+          REQUIRE(costs[s*multiplier+t]<0);
+          REQUIRE(ubodt->look_sp_path(s,t).empty());
+          continue;
+        }
+        REQUIRE(cost==Approx(expected));
+        REQUIRE(row[t]==Approx(expected));
+        REQUIRE(costs[s*multiplier+t]==Approx(expected));
+        double length = 0;
+        for (EdgeIndex e : ubodt->look_sp_path(s,t)) length += edges[e].length;
+        REQUIRE(length==Approx(expected));
+      }
+    }
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+  }
+  SECTION( "ubodt_shard_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    // Split the rows into two shards by source
+    NodeIndex split = multiplier / 2;
+    std::vector<std::string> files = {"ubodt_shard_1.txt","ubodt_shard_0.txt"};
+    for (int i = 0; i < 2; ++i) {
+      UBODTShard shard;
+      shard.network_file = "../data/network.gpkg";
+      shard.delta = 3;
+      shard.num_vertices = multiplier;
+      shard.partition = 1 - i;
+      shard.num_partitions = 2;
+      shard.first_source = (i == 0) ? split : 0;
+      shard.last_source = (i == 0) ? multiplier : split;
+      shard.next_source = shard.last_source;
+      std::ofstream ofs(files[i]);
+      ofs << "source;target;next_n;prev_n;next_e;distance\n";
+      chained->for_each_record([&](const Record &r) {
+        if (r.source < shard.first_source || r.source >= shard.last_source)
+          return;
+        ofs << r.source << ";" << r.target << ";" << r.first_n << ";"
+            << r.prev_n << ";" << r.next_e << ";" << r.cost << "\n";
+        ++shard.rows;
+      });
+      ofs.close();
+      shard.bytes = UTIL::get_file_size(files[i]);
+      REQUIRE(shard.write_manifest(files[i]));
+      UBODTShard read;
+      REQUIRE(UBODTShard::read_manifest(files[i],&read));
+      REQUIRE(read.is_compatible(shard));
+      REQUIRE(read.is_complete());
+      REQUIRE(read.rows==shard.rows);
+      REQUIRE(read.bytes==shard.bytes);
+    }
+    REQUIRE(!UBODTShard::merge_shards({files[0]},"ubodt_test.mmap"));
+    REQUIRE(UBODTShard::merge_shards(files,"ubodt_test.mmap"));
+    auto merged = UBODT::read_ubodt_file("ubodt_test.mmap");
+    REQUIRE(merged->get_num_rows()==chained->get_num_rows());
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        Record *a = chained->look_up(s,t);
+        Record *b = merged->look_up(s,t);
+        REQUIRE((a==nullptr)==(b==nullptr));
+        if (a!=nullptr) REQUIRE(a->cost==b->cost);
+      }
+    }
+    REQUIRE(UBODTShard::merge_shards(files,"ubodt_test.txt"));
+    REQUIRE(UBODT::read_ubodt_csv("ubodt_test.txt",multiplier)
+                ->get_num_rows()==chained->get_num_rows());
+    for (const std::string &file : files) {
+      std::remove(file.c_str());
+      std::remove(UBODTShard::get_manifest_file(file).c_str());
+    }
+    std::remove("ubodt_test.mmap");
+    std::remove("ubodt_test.txt");
+  }
+  SECTION( "ubodt_huge_pages_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    UTIL::MemoryOptions options;
+    options.huge_pages = true;
+    options.interleave = true;
+    UTIL::set_memory_options(options);
+    for (UBODTLayout layout : {CHAINED, FLAT, CSR}) {
+      auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                         layout);
+      REQUIRE(ubodt->get_num_rows()==chained->get_num_rows());
+      for (NodeIndex s = 0; s < multiplier; ++s) {
+        for (NodeIndex t = 0; t < multiplier; ++t) {
+          Record *a = chained->look_up(s,t);
+          Record *b = ubodt->look_up(s,t);
+          REQUIRE((a==nullptr)==(b==nullptr));
+          if (a!=nullptr) REQUIRE(a->cost==b->cost);
+        }
+      }
+    }
+    void *block = UTIL::allocate_large(UTIL::HUGE_PAGE_SIZE * 2 + 1);
+    REQUIRE(block!=nullptr);
+    REQUIRE((size_t) block % UTIL::HUGE_PAGE_SIZE == 0);
+    free(block);
+    UTIL::set_memory_options(UTIL::MemoryOptions());
+  }
+  SECTION( "transition_graph_reuse_test" ) {
+    // Matching the trajectories repeatedly reuses the graph of the
+    // thread, which gives the same result as the first time
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    std::vector<C_Path> cpaths;
+    for (const Trajectory &trajectory : trajectories) {
+      cpaths.push_back(model.match_traj(trajectory,config).cpath);
+    }
+    for (int i = trajectories.size() - 1; i >= 0; --i) {
+      REQUIRE(model.match_traj(trajectories[i],config).cpath==cpaths[i]);
+    }
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&context));
+    TransitionGraph tg;
+    tg.reset(context,0.5);
+    std::vector<TGLayer> &layers = tg.get_layers();
+    REQUIRE(layers.size()==context.get_num_points());
+    for (int i = 0; i < layers.size(); ++i) {
+      REQUIRE(layers[i].size()==context.get_point_candidates(i).size());
+      REQUIRE(layers[i][0].c==context.get_point_candidates(i).begin());
+    }
+    REQUIRE(layers[0][0].cumu_prob==layers[0][0].ep);
+  }
+  SECTION( "match_workspace_test" ) {
+    // A workspace passed in gives the results of the one of the thread,
+    // and keeps its buffers between the trajectories
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchWorkspace workspace;
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult expected = model.match_traj(trajectory,config);
+      MatchResult result = model.match_traj(trajectory,config,&workspace);
+      REQUIRE(result.cpath==expected.cpath);
+      REQUIRE(result.indices==expected.indices);
+    }
+    REQUIRE(workspace.context.get_num_points()>0);
+    std::size_t capacity = workspace.tg_opath.capacity();
+    model.match_traj(trajectories[0],config,&workspace);
+    REQUIRE(workspace.tg_opath.capacity()>=capacity);
+    // A dummy graph rebuilt from other candidates is the one constructed
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(trajectories[1].geom,4,0.4,&context));
+    DummyGraph expected(context);
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&context));
+    DummyGraph dg(context);
+    REQUIRE(network.search_tr_cs_knn(trajectories[1].geom,4,0.4,&context));
+    dg.reset(context);
+    REQUIRE(dg.get_num_vertices()==expected.get_num_vertices());
+    REQUIRE(dg.get_graph().get_num_edges()==
+            expected.get_graph().get_num_edges());
+    for (const Candidate &c : context.get_candidates()) {
+      REQUIRE(dg.get_internal_index(c.index)==
+              expected.get_internal_index(c.index));
+    }
+    // The path looked up into a buffer is the one returned
+    std::vector<EdgeIndex> path;
+    ubodt->look_sp_path(0,3,&path);
+    REQUIRE(path==ubodt->look_sp_path(0,3));
+  }
+
+  SECTION( "transition_kernel_test" ) {
+    // The kernel gives the nodes updated pair by pair in both spaces and
+    // with both rules of the ties, including the skipped pairs
+    unsigned seed = 7;
+    auto next = [&seed](int n) {
+      seed = seed * 1103515245 + 12345;
+      return (int) ((seed >> 16) % n);
+    };
+    for (int run = 0; run < 400; ++run) {
+      bool log_space = run % 2 == 1;
+      bool last_tie = run % 4 >= 2;
+      std::size_t n = 1 + next(16), m = 1 + next(16);
+      std::vector<TGNode> a(n), b(m), expected(m);
+      for (TGNode &node : a) {
+        node.cumu_prob = log_space ? -next(4) : next(4) * 0.25;
+      }
+      for (std::size_t j = 0; j < m; ++j) {
+        b[j] = TGNode{nullptr, nullptr, 0.25 * (1 + next(4)), 0,
+                      log_space ? -std::numeric_limits<double>::infinity()
+                                : 0, 0};
+        expected[j] = b[j];
+      }
+      std::vector<TGNode *> expanded;
+      for (TGNode &node : a) expanded.push_back(&node);
+      std::vector<double> sp_dists(n * m);
+      std::vector<char> skipped(n * m);
+      for (std::size_t k = 0; k < n * m; ++k) {
+        sp_dists[k] = 10 + next(3) * 5;
+        skipped[k] = run % 8 < 4 && next(5) == 0;
+      }
+      double eu_dist = 10;
+      for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < m; ++j) {
+          if (skipped[i * m + j]) continue;
+          double sp_dist = sp_dists[i * m + j];
+          double tp = TransitionGraph::calc_tp(sp_dist, eu_dist);
+          TGNode *node = &expected[j];
+          double score = log_space ?
+              a[i].cumu_prob + std::log(tp) + std::log(node->ep) :
+              a[i].cumu_prob + tp * node->ep;
+          if (last_tie ? score >= node->cumu_prob :
+              score > node->cumu_prob) {
+            node->cumu_prob = score;
+            node->prev = &a[i];
+            node->tp = tp;
+            node->sp_dist = sp_dist;
+          }
+        }
+      }
+      TGLayer lb{b.data(), b.data() + m};
+      relax_layer(expanded.data(), n, lb, sp_dists.data(),
+                  run % 8 < 4 ? skipped.data() : nullptr, eu_dist,
+                  log_space, last_tie);
+      for (std::size_t j = 0; j < m; ++j) {
+        REQUIRE(b[j].cumu_prob==expected[j].cumu_prob);
+        REQUIRE(b[j].prev==expected[j].prev);
+        REQUIRE(b[j].tp==expected[j].tp);
+        REQUIRE(b[j].sp_dist==expected[j].sp_dist);
+      }
+    }
+  }
+
+  SECTION( "beam_viterbi_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    config.beam_size = 4;
+    config.beam_margin = 100;
+    REQUIRE(config.validate());
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+    config.beam_size = 1;
+    config.beam_margin = 0;
+    REQUIRE(!model.match_traj(trajectories[0],config).cpath.empty());
+    config.beam_size = -1;
+    REQUIRE(!config.validate());
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&context));
+    TransitionGraph tg;
+    tg.reset(context,0.5);
+    tg.reset_log_space();
+    REQUIRE(tg.is_log_space());
+    TGLayer &layer = tg.get_layers()[0];
+    REQUIRE(layer[0].cumu_prob==Approx(std::log(layer[0].ep)));
+    ViterbiBeam beam;
+    beam.beam_size = 1;
+    double best = tg.find_optimal_candidate(layer)->cumu_prob;
+    // Only the best node is kept, or the nodes tied with it
+    REQUIRE(tg.prune_layer(&layer,beam)>=1);
+    for (const TGNode &node : layer) {
+      REQUIRE((node.cumu_prob==best)!=TransitionGraph::is_pruned(node));
+    }
+    tg.reset(context,0.5);
+    REQUIRE(!tg.is_log_space());
+  }
+  SECTION( "parallel_viterbi_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    FastMapMatchConfig parallel_config = config;
+    parallel_config.parallel_viterbi = 1;
+    for (int beam_size : {0, 2}) {
+      config.beam_size = beam_size;
+      parallel_config.beam_size = beam_size;
+      for (const Trajectory &trajectory : trajectories) {
+        MatchResult expected = model.match_traj(trajectory,config);
+        MatchResult result = model.match_traj(trajectory,parallel_config);
+        REQUIRE(result.opath==expected.opath);
+        REQUIRE(result.cpath==expected.cpath);
+      }
+    }
+  }
+  SECTION( "parameter_sweep_test" ) {
+    ParameterSweep sweep;
+    REQUIRE(ParameterSweep::parse("k=2,4;radius=0.3,0.4;gps_error=0.5",
+                                  &sweep));
+    REQUIRE(sweep.is_enabled());
+    REQUIRE(!ParameterSweep::parse("k=2,x",&sweep));
+    REQUIRE(!ParameterSweep::parse("speed=2",&sweep));
+    REQUIRE(!ParameterSweep::parse("radius=-1",&sweep));
+    REQUIRE(ParameterSweep::parse("k=2,4;radius=0.3,0.4",&sweep));
+    std::vector<SweepSetting> settings =
+        sweep.get_settings(SweepSetting{4,0.4,0.5,30,1.5});
+    REQUIRE(settings.size()==4);
+    REQUIRE(settings[1].k==2);
+    REQUIRE(settings[1].radius==0.4);
+    REQUIRE(settings[3].gps_error==0.5);
+    REQUIRE(get_sweep_result_file("out/mr.csv",3)=="out/mr_3.csv");
+    REQUIRE(get_sweep_result_file("out.d/mr",0)=="out.d/mr_0");
+    // The candidates selected are the ones searched with the setting
+    CandidateSearchContext full;
+    CandidateSearchContext selected;
+    CandidateSearchContext expected;
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&full));
+    REQUIRE(selected.select(full,2,0.3));
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,2,0.3,
+                                     &expected));
+    REQUIRE(selected.get_offsets()==expected.get_offsets());
+    for (std::size_t i = 0; i < expected.get_candidates().size(); ++i) {
+      REQUIRE(selected.get_candidates()[i].edge==
+              expected.get_candidates()[i].edge);
+      REQUIRE(selected.get_candidates()[i].index==
+              expected.get_candidates()[i].index);
+    }
+    REQUIRE(!selected.select(full,4,1e-9));
+    REQUIRE(selected.get_missing_point()>=0);
+    // Each setting gives the result of matching with it
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    STMATCH stmatch(network,graph);
+    FastMapMatchConfig config{4,0.4,0.5};
+    STMATCHConfig stmatch_config{4,0.4,0.5,30,1.5};
+    SweepReport report(settings);
+    for (const Trajectory &trajectory : trajectories) {
+      std::vector<MatchResult> results =
+          model.match_traj_sweep(trajectory,config,settings,&report);
+      std::vector<MatchResult> stmatch_results = stmatch.match_traj_sweep(
+          trajectory,stmatch_config,settings);
+      REQUIRE(results.size()==settings.size());
+      for (std::size_t s = 0; s < settings.size(); ++s) {
+        FastMapMatchConfig setting_config{
+            settings[s].k,settings[s].radius,settings[s].gps_error};
+        MatchResult expected = model.match_traj(trajectory,setting_config);
+        REQUIRE(results[s].opath==expected.opath);
+        REQUIRE(results[s].cpath==expected.cpath);
+        STMATCHConfig stmatch_setting{
+            settings[s].k,settings[s].radius,settings[s].gps_error,30,1.5};
+        expected = stmatch.match_traj(trajectory,stmatch_setting);
+        REQUIRE(stmatch_results[s].opath==expected.opath);
+        REQUIRE(stmatch_results[s].cpath==expected.cpath);
+      }
+    }
+    REQUIRE(report.get_statistics(0).trajectories==trajectories.size());
+    REQUIRE(report.get_statistics(0).matched>0);
+  }
+  SECTION( "transition_bound_test" ) {
+    // The transition probability of a distance above the lower bound
+    // does not exceed the upper bound
+    for (double eu_dist : {0.0, 0.5, 2.0}) {
+      for (double lb : {0.0, 0.25, 1.0, 4.0}) {
+        double ub = TransitionGraph::calc_tp_upper_bound(lb,eu_dist);
+        for (double sp_dist : {lb, lb + 0.1, lb * 2 + 1, lb + 100}) {
+          REQUIRE(TransitionGraph::calc_tp(sp_dist,eu_dist)<=ub);
+        }
+      }
+    }
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&context));
+    for (const Candidate &a : context.get_candidates()) {
+      for (const Candidate &b : context.get_candidates()) {
+        if (a.edge==b.edge && a.offset<=b.offset) {
+          REQUIRE(TransitionGraph::calc_sp_lower_bound(&a,&b)<=
+                  b.offset-a.offset+1e-9);
+        }
+      }
+    }
+  }
+  SECTION( "approximate_ep_test" ) {
+    for (double x : {-700.0, -30.5, -2.0, -0.3, 0.0, 0.7, 5.0, 300.0}) {
+      REQUIRE(ALGORITHM::fast_exp(x)==Approx(std::exp(x)).epsilon(1e-8));
+    }
+    std::vector<double> dists{0, 0.1, 0.25, 0.5, 1.0, 3.0};
+    std::vector<double> probs(dists.size());
+    ALGORITHM::gaussian_probabilities(dists.data(),dists.size(),0.5,
+                                      probs.data());
+    for (int i = 0; i < dists.size(); ++i) {
+      REQUIRE(probs[i]==Approx(TransitionGraph::calc_ep(dists[i],0.5))
+                            .epsilon(1e-8));
+    }
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    FastMapMatchConfig approximate_config = config;
+    approximate_config.approximate_ep = true;
+    for (const Trajectory &trajectory : trajectories) {
+      REQUIRE(model.match_traj(trajectory,approximate_config).cpath==
+              model.match_traj(trajectory,config).cpath);
+    }
+  }
+  SECTION( "result_fields_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    FastMapMatchConfig cpath_config = config;
+    CONFIG::OutputConfig output_config;
+    output_config.write_mgeom = false;
+    cpath_config.result_fields = get_result_fields(output_config);
+    REQUIRE(!cpath_config.result_fields.candidates);
+    REQUIRE(!cpath_config.result_fields.mgeom);
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult full = model.match_traj(trajectory,config);
+      MatchResult result = model.match_traj(trajectory,cpath_config);
+      REQUIRE(result.cpath==full.cpath);
+      REQUIRE(result.indices==full.indices);
+      REQUIRE(result.opath.empty());
+      REQUIRE(result.opt_candidate_path.empty());
+      REQUIRE(result.mgeom.get_num_points()==0);
+    }
+  }
+  SECTION( "stage_profile_test" ) {
+    UTIL::StageHistogram histogram;
+    for (int i = 1; i <= 100; ++i) histogram.add(i * 1e-3);
+    REQUIRE(histogram.count==100);
+    REQUIRE(histogram.max==Approx(0.1));
+    REQUIRE(histogram.quantile(0.5)>=0.05);
+    REQUIRE(histogram.quantile(0.5)<=0.05*1.2);
+    REQUIRE(histogram.quantile(1)==Approx(0.1));
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    UTIL::StageProfile::reset();
+    UTIL::StageProfile::set_enabled(true);
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+      UTIL::StageProfile::local().finish_trajectory();
+    }
+    UTIL::StageProfile::set_enabled(false);
+    UTIL::StageStatistics statistics = UTIL::StageProfile::collect();
+    REQUIRE(statistics.trajectory.count==trajectories.size());
+    REQUIRE(statistics.totals[UTIL::STAGE_SEARCH]>0);
+    REQUIRE(statistics.histograms[UTIL::STAGE_UPDATE_TG].count==
+            trajectories.size());
+    UTIL::StageProfile::reset();
+  }
+  SECTION( "stage_profile_counters_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    UTIL::StageProfile::reset();
+    UTIL::StageProfile::set_enabled(true);
+    UTIL::StageProfile::set_counters_enabled(true);
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+      UTIL::StageProfile::local().finish_trajectory();
+    }
+    UTIL::StageProfile::set_counters_enabled(false);
+    UTIL::StageProfile::set_enabled(false);
+    UTIL::StageStatistics statistics = UTIL::StageProfile::collect();
+    const UTIL::PerfCounters &counters = UTIL::PerfCounters::local();
+    for (int i = 0; i < UTIL::NUM_MATCH_STAGES; ++i) {
+      for (int j = 0; j < UTIL::NUM_PERF_COUNTERS; ++j) {
+        // Counters not allowed by the host stay 0
+        REQUIRE(statistics.counters[i][j]>=0);
+        if (!counters.is_available(j)) {
+          REQUIRE(statistics.counters[i][j]==0);
+        }
+      }
+    }
+    if (counters.is_available(UTIL::PERF_INSTRUCTIONS)) {
+      REQUIRE(statistics.counters[UTIL::STAGE_SEARCH]
+              [UTIL::PERF_INSTRUCTIONS]>0);
+    }
+    UTIL::StageProfile::reset();
+  }
+  SECTION( "tile_profile_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    UTIL::TileProfile::reset();
+    UTIL::TileProfile::set_tile_size(1.0);
+    long total_points = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+      total_points += trajectory.geom.get_num_points();
+    }
+    UTIL::TileProfile::set_tile_size(0);
+    REQUIRE_FALSE(UTIL::TileProfile::is_enabled());
+    std::vector<UTIL::TileStatistics> tiles = UTIL::TileProfile::collect();
+    REQUIRE(!tiles.empty());
+    UTIL::TileCounters sum;
+    for (const UTIL::TileStatistics &tile : tiles) {
+      const UTIL::TileCounters &c = tile.counters;
+      REQUIRE(c.kept<=c.candidates);
+      REQUIRE(c.misses<=c.probes);
+      REQUIRE(c.settled==0);
+      sum += c;
+    }
+    REQUIRE(sum.points>0);
+    REQUIRE(sum.points<=total_points);
+    REQUIRE(sum.kept>=sum.points);
+    REQUIRE(sum.probes>0);
+    REQUIRE(sum.seconds>0);
+    UTIL::TileProfile::set_tile_size(1.0);
+    REQUIRE(UTIL::TileProfile::write_file(tiles,"tile_profile_test.csv"));
+    REQUIRE(UTIL::TileProfile::write_file(tiles,
+                                          "tile_profile_test.geojson"));
+    std::ifstream csv("tile_profile_test.csv");
+    std::string line;
+    long lines = 0;
+    while (std::getline(csv,line)) ++lines;
+    REQUIRE(lines==tiles.size()+1);
+    std::ifstream geojson("tile_profile_test.geojson");
+    std::getline(geojson,line);
+    REQUIRE(line.find("FeatureCollection")!=std::string::npos);
+    UTIL::TileProfile::set_tile_size(0);
+    UTIL::TileProfile::reset();
+    REQUIRE(UTIL::TileProfile::collect().empty());
+    std::remove("tile_profile_test.csv");
+    std::remove("tile_profile_test.geojson");
+  }
+  SECTION( "stage_trace_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    UTIL::StageProfile::set_enabled(true);
+    // Every trajectory sampled, each a slice enclosing its stages
+    UTIL::StageTrace::start(1,0);
+    for (const Trajectory &trajectory : trajectories) {
+      model.match_traj(trajectory,config);
+      UTIL::StageProfile::local().finish_trajectory(trajectory.id);
+    }
+    UTIL::TraceStatistics statistics = UTIL::StageTrace::get_statistics();
+    REQUIRE(statistics.trajectories==trajectories.size());
+    REQUIRE(statistics.sampled==trajectories.size());
+    REQUIRE(statistics.overwritten==0);
+    std::vector<UTIL::TraceEvent> events = UTIL::StageTrace::collect();
+    REQUIRE(events.size()==statistics.events);
+    REQUIRE(events[0].stage==-1);
+    REQUIRE(events[0].trajectory==trajectories[0].id);
+    for (std::size_t i = 1; i < events.size(); ++i) {
+      if (events[i].stage == -1) continue;
+      REQUIRE(events[i].duration>=0);
+      REQUIRE(events[i].begin>=0);
+    }
+    REQUIRE(UTIL::StageTrace::write_json("trace_test.json"));
+    std::ifstream ifs("trace_test.json");
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    REQUIRE(line=="{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    ifs.close();
+    std::remove("trace_test.json");
+    // Only the slow trajectories are sampled, into a small ring buffer
+    UTIL::StageTrace::start(0,1e6,4);
+    model.match_traj(trajectories[0],config);
+    UTIL::StageProfile::local().finish_trajectory(trajectories[0].id);
+    REQUIRE(UTIL::StageTrace::get_statistics().sampled==0);
+    UTIL::StageTrace::start(0,1e-12,4);
+    model.match_traj(trajectories[0],config);
+    UTIL::StageProfile::local().finish_trajectory(trajectories[0].id);
+    statistics = UTIL::StageTrace::get_statistics();
+    REQUIRE(statistics.sampled==1);
+    REQUIRE(statistics.overwritten==statistics.events-4);
+    REQUIRE(UTIL::StageTrace::collect().size()==4);
+    UTIL::StageTrace::stop();
+    UTIL::StageProfile::set_enabled(false);
+    UTIL::StageProfile::reset();
+  }
+  SECTION( "point_filter_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    // Each point repeated as a stationary vehicle
+    Trajectory traj{trajectories[0].id,LineString(),{}};
+    int N = trajectories[0].geom.get_num_points();
+    for (int i = 0; i < N; ++i) {
+      for (int j = 0; j < 3; ++j) {
+        traj.geom.add_point(trajectories[0].geom.get_point(i));
+        traj.timestamps.push_back(3 * i + j);
+      }
+    }
+    for (int mode = 0; mode < 3; ++mode) {
+      PointFilter filter;
+      if (mode == 0) filter.stationary_radius = 1e-6;
+      if (mode == 1) filter.min_distance = 1e-6;
+      if (mode == 2) filter.min_interval = 3;
+      FilteredTrajectory filtered = filter_points(traj,filter);
+      REQUIRE(filtered.points.size()==N);
+      REQUIRE(filtered.mapping.size()==3*N);
+      config.stationary_radius = filter.stationary_radius;
+      config.min_distance = filter.min_distance;
+      config.min_interval = filter.min_interval;
+      MatchResult result = model.match_traj(traj,config);
+      REQUIRE(result.cpath==expected.cpath);
+      REQUIRE(result.opath.size()==3*N);
+      REQUIRE(result.indices.size()==3*N);
+      for (int k = 0; k < 3*N; ++k) {
+        REQUIRE(result.opath[k]==expected.opath[k/3]);
+      }
+    }
+  }
+  SECTION( "coarse_to_fine_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    // A dense trajectory with 4 points interpolated between each pair
+    const LineString &geom = trajectories[0].geom;
+    Trajectory traj{trajectories[0].id,LineString(),{}};
+    int N = geom.get_num_points();
+    for (int i = 0; i + 1 < N; ++i) {
+      for (int j = 0; j < 5; ++j) {
+        traj.geom.add_point(
+            geom.get_x(i) + (geom.get_x(i+1) - geom.get_x(i)) * j / 5,
+            geom.get_y(i) + (geom.get_y(i+1) - geom.get_y(i)) * j / 5);
+      }
+    }
+    traj.geom.add_point(geom.get_point(N-1));
+    MatchResult expected = model.match_traj(traj,config);
+    REQUIRE(!expected.cpath.empty());
+    config.coarse_step = 5;
+    config.corridor_buffer = 0.1;
+    config.corridor_k = 2;
+    MatchResult result = model.match_traj(traj,config);
+    REQUIRE(result.cpath==expected.cpath);
+    REQUIRE(result.opath.size()==traj.geom.get_num_points());
+    // The corridor holds the edges of the path
+    std::vector<EdgeIndex> path, corridor;
+    for (EdgeID id : expected.cpath) path.push_back(network.get_edge_index(id));
+    network.get_corridor_edges(path,0,&corridor);
+    for (EdgeIndex e : path) {
+      REQUIRE(std::binary_search(corridor.begin(),corridor.end(),e));
+    }
+    // A trajectory too short for a coarse pass is matched in one pass
+    config.coarse_step = N;
+    result = model.match_traj(trajectories[0],config);
+    REQUIRE_THAT(result.cpath,Catch::Equals<int>({2,5,13,14,23}));
+  }
+  SECTION( "composite_graph_test" ) {
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(trajectories[0].geom,4,0.4,&context));
+    DummyGraph dg(context);
+    CompositeGraph cg(graph,dg);
+    NodeIndex num_nodes = graph.get_num_vertices() +
+        context.get_candidates().size();
+    for (const Candidate &c : context.get_candidates()) {
+      REQUIRE(dg.containNodeIndex(c.index));
+      REQUIRE(dg.containNodeIndex(c.edge->source));
+      REQUIRE(dg.get_external_index(dg.get_internal_index(c.index))==c.index);
+    }
+    REQUIRE(!dg.containNodeIndex(num_nodes));
+    // The candidates are numbered contiguously after the network nodes
+    DummyIndex first = dg.get_internal_index(
+        context.get_candidates()[0].index);
+    for (std::size_t i = 0; i < context.get_candidates().size(); ++i) {
+      REQUIRE(dg.get_internal_index(context.get_candidates()[i].index)==
+              first + i);
+    }
+    REQUIRE(dg.get_num_vertices()==first+context.get_candidates().size());
+    // A candidate leaves to the target of its edge, and a network node
+    // keeps its network edges
+    for (const Candidate &c : context.get_candidates()) {
+      bool found = false;
+      cg.for_each_out_edge(c.index,[&](const CompEdgeProperty &edge) {
+        if (edge.v==c.edge->target) {
+          found = true;
+          REQUIRE(edge.cost==Approx(c.edge->length-c.offset));
+          REQUIRE(edge.edge==c.edge->index);
+        }
+      });
+      REQUIRE(found);
+    }
+    const CSRGraph &g = graph.get_graph();
+    for (NodeIndex u = 0; u < graph.get_num_vertices(); ++u) {
+      unsigned int degree = 0;
+      cg.for_each_out_edge(u,[&](const CompEdgeProperty &edge) {
+        ++degree;
+      });
+      REQUIRE(degree>=g.end(u)-g.begin(u));
+      REQUIRE(cg.out_edges(u).size()==degree);
+    }
+  }
+  SECTION( "stmatch_multi_source_test" ) {
+    // The search of a layer gives the distances of a search per source
+    STMATCHSteps model(network,graph);
+    CandidateSearchContext context;
+    const double inf = std::numeric_limits<double>::max();
+    long reached = 0, unreached = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      if (!network.search_tr_cs_knn(trajectory.geom,4,0.4,&context)) continue;
+      DummyGraph dg(context);
+      CompositeGraph cg(graph,dg);
+      for (std::size_t i = 0; i + 1 < context.get_num_points(); ++i) {
+        std::vector<NodeIndex> sources, targets;
+        for (const Candidate &c : context.get_point_candidates(i)) {
+          sources.push_back(c.index);
+        }
+        for (const Candidate &c : context.get_point_candidates(i+1)) {
+          targets.push_back(c.index);
+        }
+        for (double delta : {0.5, 3.0}) {
+          std::vector<std::vector<double>> multi =
+              model.shortest_path_upperbound_multi(cg,sources,targets,delta);
+          REQUIRE(multi.size()==sources.size());
+          for (std::size_t k = 0; k < sources.size(); ++k) {
+            std::vector<double> single = model.shortest_path_upperbound(
+                i,cg,sources[k],targets,delta);
+            REQUIRE(multi[k].size()==single.size());
+            for (std::size_t j = 0; j < single.size(); ++j) {
+              if (single[j]==inf) {
+                REQUIRE(multi[k][j]==inf);
+                ++unreached;
+              } else {
+                REQUIRE(multi[k][j]==Approx(single[j]));
+                REQUIRE(single[j]<=delta);
+                ++reached;
+              }
+            }
+          }
+        }
+      }
+    }
+    REQUIRE(reached>0);
+    REQUIRE(unreached>0);
+  }
+  SECTION( "stmatch_kept_paths_test" ) {
+    // The paths kept by the transitions give the complete path searched
+    // again without them, up to the ties of the shortest paths
+    STMATCHSteps model(network,graph);
+    STMATCHConfig config{4,0.4,0.5,30,1.5};
+    const std::vector<Edge> &edges = network.get_edges();
+    auto path_length = [&edges](const std::vector<EdgeIndex> &path) {
+      double length = 0;
+      for (std::size_t j = 0; j < path.size(); ++j) {
+        length += edges[path[j]].length;
+        if (j > 0) {
+          REQUIRE((path[j-1]==path[j] ||
+                   edges[path[j-1]].target==edges[path[j]].source));
+        }
+      }
+      return length;
+    };
+    int matched = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      MatchWorkspace workspace;
+      CandidateSearchContext &context = workspace.context;
+      if (!network.search_tr_cs_knn(trajectory.geom,config.k,config.radius,
+                                    &context)) continue;
+      context.prune(trajectory.geom,config.k,config.get_candidate_pruning());
+      DummyGraph &dg = workspace.dg;
+      dg.reset(context);
+      CompositeGraph cg(graph,dg);
+      TransitionGraph &tg = workspace.tg;
+      tg.reset(context,config.gps_error,config.approximate_ep);
+      TransitionPaths paths;
+      paths.reset(1,context.get_candidates().size());
+      BudgetMeter meter(config.get_match_budget());
+      REQUIRE(model.update_tg(&tg,cg,trajectory,config,&meter,&workspace,
+                              &paths));
+      TGOpath tg_opath;
+      tg.backtrack(&tg_opath);
+      if (tg_opath.empty()) continue;
+      std::vector<int> kept_indices, searched_indices;
+      std::vector<EdgeIndex> kept_path, searched_path;
+      C_Path kept = model.build_cpath(tg_opath,&kept_indices,&paths,
+                                      &kept_path);
+      C_Path searched = model.build_cpath(tg_opath,&searched_indices,
+                                          nullptr,&searched_path);
+      if (searched.empty()) {
+        REQUIRE(kept.empty());
+        continue;
+      }
+      REQUIRE(kept_indices.size()==tg_opath.size());
+      REQUIRE(searched_indices.size()==tg_opath.size());
+      for (std::size_t i = 0; i < tg_opath.size(); ++i) {
+        REQUIRE(kept[kept_indices[i]]==tg_opath[i]->c->edge->id);
+        REQUIRE(searched[searched_indices[i]]==tg_opath[i]->c->edge->id);
+      }
+      REQUIRE(path_length(kept_path)==Approx(path_length(searched_path)));
+      // The matching keeps the paths of its transitions
+      MatchResult result = model.match_traj(trajectory,config);
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>(kept));
+      ++matched;
+    }
+    REQUIRE(matched>0);
+  }
+  SECTION( "stmatch_goal_directed_test" ) {
+    // The searches directed toward the targets give the distances of the
+    // plain bounded searches
+    STMATCHSteps model(network,graph);
+    CandidateSearchContext context;
+    TransitionGraph tg;
+    const double inf = std::numeric_limits<double>::max();
+    long reached = 0, unreached = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      if (!network.search_tr_cs_knn(trajectory.geom,4,0.4,&context)) continue;
+      DummyGraph dg(context);
+      CompositeGraph cg(graph,dg);
+      tg.reset(context,0.5);
+      std::vector<TGLayer> &layers = tg.get_layers();
+      for (std::size_t i = 0; i + 1 < layers.size(); ++i) {
+        std::vector<NodeIndex> targets;
+        std::vector<Point> points;
+        for (const TGNode &b : layers[i+1]) {
+          targets.push_back(b.c->index);
+          points.push_back(b.c->point);
+        }
+        for (double delta : {0.5, 3.0}) {
+          for (const TGNode &a : layers[i]) {
+            std::vector<double> plain = model.shortest_path_upperbound(
+                i,cg,a.c->index,targets,delta);
+            std::vector<double> directed = model.shortest_path_upperbound(
+                i,cg,a.c->index,targets,delta,nullptr,&points);
+            REQUIRE(directed.size()==plain.size());
+            for (std::size_t j = 0; j < plain.size(); ++j) {
+              if (plain[j]==inf) {
+                REQUIRE(directed[j]==inf);
+                ++unreached;
+              } else {
+                REQUIRE(directed[j]==Approx(plain[j]));
+                ++reached;
+              }
+            }
+          }
+          std::vector<std::vector<double>> plain = model.layer_distances(
+              i,layers[i],layers[i+1],cg,delta,false);
+          std::vector<std::vector<double>> directed = model.layer_distances(
+              i,layers[i],layers[i+1],cg,delta,false,nullptr,nullptr,0,true);
+          REQUIRE(directed.size()==plain.size());
+          for (std::size_t k = 0; k < plain.size(); ++k) {
+            REQUIRE(directed[k].size()==plain[k].size());
+            for (std::size_t j = 0; j < plain[k].size(); ++j) {
+              if (plain[k][j]==inf) {
+                REQUIRE(directed[k][j]==inf);
+              } else {
+                REQUIRE(directed[k][j]==Approx(plain[k][j]));
+              }
+            }
+          }
+        }
+      }
+    }
+    REQUIRE(reached>0);
+    REQUIRE(unreached>0);
+  }
+  SECTION( "hybrid_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    CandidateSearchContext context;
+    long pairs = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      if (!network.search_tr_cs_knn(trajectory.geom,4,0.4,&context)) continue;
+      for (std::size_t i = 0; i + 1 < context.get_num_points(); ++i) {
+        pairs += context.get_point_candidates(i).size() *
+            context.get_point_candidates(i+1).size();
+      }
+    }
+    REQUIRE(pairs>0);
+    // The bounds within the one of UBODT look up every pair as fmm does
+    FastMapMatch fmm(network,graph,ubodt);
+    FastMapMatchConfig fmm_config{4,0.4,0.5};
+    HybridMatch hybrid(network,graph,ubodt);
+    HybridMatchConfig config{4,0.4,0.5,30,1e-3};
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult expected = fmm.match_traj(trajectory,fmm_config);
+      MatchResult result = hybrid.match_traj(trajectory,config);
+      REQUIRE_THAT(result.opath,Catch::Equals<int>(expected.opath));
+      REQUIRE_THAT(result.cpath,Catch::Equals<int>(expected.cpath));
+      REQUIRE_THAT(result.indices,Catch::Equals<int>(expected.indices));
+      REQUIRE(result.mgeom==expected.mgeom);
+    }
+    HybridMatchStatistics statistics = hybrid.get_statistics();
+    REQUIRE(statistics.ubodt_pairs>0);
+    REQUIRE(statistics.ubodt_pairs+statistics.skipped_pairs==pairs);
+    REQUIRE(statistics.searched_pairs==0);
+    REQUIRE(statistics.found_pairs==0);
+    // With an UBODT of no pair, the pairs not adjacent are searched with
+    // the bound of stmatch
+    auto empty = UBODT::generate_ubodt(graph,1e-6,CHAINED);
+    STMATCH stmatch(network,graph);
+    STMATCHConfig stmatch_config{4,0.4,0.5,30,10};
+    HybridMatch searched(network,graph,empty);
+    HybridMatchConfig searched_config{4,0.4,0.5,30,10};
+    const std::vector<Edge> &edges = network.get_edges();
+    auto path_length = [&edges,&network](const C_Path &cpath) {
+      double length = 0;
+      for (EdgeID id : cpath) length += edges[network.get_edge_index(id)].length;
+      return length;
+    };
+    for (const Trajectory &trajectory : trajectories) {
+      MatchResult expected = stmatch.match_traj(trajectory,stmatch_config);
+      MatchResult result = searched.match_traj(trajectory,searched_config);
+      REQUIRE_THAT(result.opath,Catch::Equals<int>(expected.opath));
+      REQUIRE(result.cpath.size()==expected.cpath.size());
+      REQUIRE(path_length(result.cpath)==Approx(path_length(expected.cpath)));
+      for (std::size_t i = 0; i < result.opt_candidate_path.size(); ++i) {
+        REQUIRE(result.opt_candidate_path[i].sp_dist==
+                Approx(expected.opt_candidate_path[i].sp_dist));
+      }
+    }
+    statistics = searched.get_statistics();
+    REQUIRE(statistics.ubodt_pairs+statistics.skipped_pairs+
+            statistics.searched_pairs==pairs);
+    REQUIRE(statistics.skipped_pairs==0);
+    REQUIRE(statistics.searched_pairs>0);
+    REQUIRE(statistics.found_pairs>0);
+    REQUIRE(statistics.found_pairs<=statistics.searched_pairs);
+  }
+  SECTION( "ubodt_update_test" ) {
+    // A grid of two way roads, updated after one edge is removed and
+    // after one edge is added
+    auto write_network = [](const std::string &file,
+                            const std::vector<std::vector<int>> &roads) {
+      std::ofstream ofs(file);
+      ofs << "{\"type\":\"FeatureCollection\",\"features\":[";
+      for (std::size_t i = 0; i < roads.size(); ++i) {
+        int s = roads[i][1], t = roads[i][2];
+        ofs << (i > 0 ? "," : "") << "{\"type\":\"Feature\","
+            << "\"properties\":{\"id\":" << roads[i][0] << ",\"source\":"
+            << s << ",\"target\":" << t << "},\"geometry\":{\"type\":"
+            << "\"LineString\",\"coordinates\":[[" << (s-1)%3 << ","
+            << (s-1)/3 << "],[" << (t-1)%3 << "," << (t-1)/3 << "]]}}";
+      }
+      ofs << "]}";
+    };
+    std::vector<std::vector<int>> roads;
+    for (int u = 1; u <= 9; ++u) {
+      for (int v : {u + 1, u + 3}) {
+        if (v > 9 || (v == u + 1 && u % 3 == 0)) continue;
+        roads.push_back({(int) roads.size() + 1,u,v});
+        roads.push_back({(int) roads.size() + 1,v,u});
+      }
+    }
+    write_network("ubodt_update_base.geojson",roads);
+    auto run_app = [](std::vector<std::string> args) {
+      std::vector<char *> argv;
+      for (std::string &arg : args) argv.push_back(&arg[0]);
+      UBODTGenAppConfig config(argv.size(),argv.data());
+      REQUIRE(config.validate());
+      UBODTGenApp app(config);
+      app.run();
+    };
+    run_app({"ubodt_gen","--network","ubodt_update_base.geojson",
+             "--no_network_cache","--delta","2.5",
+             "-o","ubodt_update_base.mmap"});
+    // The edge from the center to its right is removed, and a diagonal
+    // edge is added from the corner to the center
+    std::vector<std::vector<int>> removed;
+    int removed_id = 0;
+    for (const std::vector<int> &road : roads) {
+      if (road[1] == 5 && road[2] == 6) {
+        removed_id = road[0];
+      } else {
+        removed.push_back(road);
+      }
+    }
+    REQUIRE(removed_id>0);
+    std::vector<std::vector<int>> added = roads;
+    added.push_back({100,1,5});
+    write_network("ubodt_update_removed.geojson",removed);
+    write_network("ubodt_update_added.geojson",added);
+    for (const auto &change : std::vector<std::pair<std::string,int>>{
+             {"ubodt_update_removed.geojson",removed_id},
+             {"ubodt_update_added.geojson",100}}) {
+      run_app({"ubodt_gen","--network",change.first,"--no_network_cache",
+               "--delta","2.5","--update","ubodt_update_base.mmap",
+               "--update_network","ubodt_update_base.geojson",
+               "--changed_edges",std::to_string(change.second),
+               "-o","ubodt_update_test.mmap"});
+      auto updated = UBODT::read_ubodt_file("ubodt_update_test.mmap");
+      REQUIRE(updated!=nullptr);
+      // The rows updated are the rows of a full regeneration, up to the
+      // ties of the shortest paths
+      Network changed(change.first);
+      NetworkGraph changed_graph(changed);
+      const std::vector<Edge> &changed_edges = changed.get_edges();
+      auto full = UBODT::generate_ubodt(changed_graph,2.5,FLAT);
+      REQUIRE(updated->get_num_rows()==full->get_num_rows());
+      full->for_each_record([&](const Record &expected) {
+        Record *r = updated->look_up(expected.source,expected.target);
+        REQUIRE(r!=nullptr);
+        REQUIRE(r->cost==Approx(expected.cost));
+        const Edge &next = changed_edges[r->next_e];
+        REQUIRE(next.source==r->source);
+        REQUIRE(next.target==r->first_n);
+        double length = 0;
+        for (EdgeIndex e : updated->look_sp_path(r->source,r->target)) {
+          length += changed_edges[e].length;
+        }
+        REQUIRE(length==Approx(expected.cost));
+      });
+      std::remove("ubodt_update_test.mmap");
+    }
+    std::remove("ubodt_update_base.mmap");
+  }
+  SECTION( "csv_format_test" ) {
+    for (double value : {0.0, 1.0, -2.5, 0.125, 1e-5, 123456.123456789,
+                         -0.000123456, 9.9999996, 1e20, 0.1}) {
+      for (int digits : {6, 12}) {
+        std::string buffer;
+        append_double(value,digits,&buffer);
+        char expected[64];
+        std::snprintf(expected,sizeof(expected),"%.*g",digits,value);
+        REQUIRE(buffer==expected);
+      }
+    }
+    std::string buffer;
+    append_fixed(0.125,2,&buffer);
+    buffer += ' ';
+    append_fixed(-3.10,3,&buffer);
+    buffer += ' ';
+    append_int(-42,&buffer);
+    REQUIRE(buffer=="0.12 -3.1 -42");
+    LineString line;
+    line.add_point(1.5,2);
+    line.add_point(123456.123456789,-0.25);
+    buffer.clear();
+    append_wkt(line,-1,&buffer);
+    REQUIRE(buffer=="LINESTRING(1.5 2,123456.123457 -0.25)");
+    buffer.clear();
+    append_wkt(line,2,&buffer);
+    REQUIRE(buffer=="LINESTRING(1.5 2,123456.12 -0.25)");
+    // The WKB in hexadecimal is read back as the same points
+    buffer.clear();
+    append_geometry(line,HEX_WKB_ENCODING,-1,&buffer);
+    REQUIRE(buffer.substr(0,18)=="010200000002000000");
+    LineString parsed;
+    REQUIRE(parse_hex_wkb_linestring(buffer.data(),
+                                     buffer.data()+buffer.size(),&parsed));
+    REQUIRE(parsed.get_num_points()==2);
+    REQUIRE(parsed.get_x(1)==line.get_x(1));
+    REQUIRE(parsed.get_y(1)==line.get_y(1));
+    // The example of the Google encoded polyline, with the latitudes
+    // as y
+    LineString google;
+    google.add_point(-120.2,38.5);
+    google.add_point(-120.95,40.7);
+    google.add_point(-126.453,43.252);
+    buffer.clear();
+    append_geometry(google,POLYLINE_ENCODING,-1,&buffer);
+    REQUIRE(buffer=="_p~iF~ps|U_ulLnnqC_mqNvxq`@");
+    buffer.clear();
+    append_geometry(google,DELTA_ENCODING,3,&buffer);
+    REQUIRE(buffer=="-120200,38500,-750,2200,-5503,2552");
+    buffer.clear();
+    append_geometry(LineString(),POLYLINE_ENCODING,-1,&buffer);
+    REQUIRE(buffer.empty());
+    GeometryEncoding encoding;
+    REQUIRE(string2geometry_encoding("delta",&encoding));
+    REQUIRE(encoding==DELTA_ENCODING);
+    REQUIRE_FALSE(string2geometry_encoding("wkb",&encoding));
+    // Binary WKB is only written by the arrow output
+    CONFIG::ResultConfig result_config;
+    result_config.file = "encoded_test.csv";
+    result_config.output_config.geometry_encoding = "polyline";
+    REQUIRE(result_config.validate());
+    result_config.output_config.geometry_encoding = "wkb";
+    REQUIRE_FALSE(result_config.validate());
+    result_config.output_config.geometry_encoding = "geojson";
+    REQUIRE_FALSE(result_config.validate());
+  }
+  SECTION( "match_pipeline_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    long total_points = 0;
+    long points_matched = 0;
+    for (const Trajectory &trajectory : trajectories) {
+      int num_points = trajectory.geom.get_num_points();
+      total_points += num_points;
+      if (!model.match_traj(trajectory,config).cpath.empty()) {
+        points_matched += num_points;
+      }
+    }
+    CONFIG::GPSConfig gps_config;
+    gps_config.file = "../data/trips.csv";
+    gps_config.id = "id";
+    gps_config.geom = "geom";
+    CONFIG::OutputConfig output_config;
+    MatchPipelineOptions options;
+    options.num_matchers = 3;
+    options.step = 1;
+    options.chunk_size = 2;
+    options.ordered = true;
+    {
+      GPSReader pipeline_reader(gps_config);
+      CSVMatchResultWriter writer("pipeline_test.csv",output_config);
+      MatchPipelineStatistics statistics = run_match_pipeline(
+          &pipeline_reader,&writer,
+          [&](const Trajectory &trajectory) {
+            return std::vector<SegmentMatchResult>{SegmentMatchResult{
+                -1,-1,model.match_traj(trajectory,config)}};
+          },options);
+      REQUIRE(statistics.trajectories==trajectories.size());
+      REQUIRE(statistics.total_points==total_points);
+      REQUIRE(statistics.points_matched==points_matched);
+      REQUIRE(statistics.busy_times.size()==3);
+    }
+    // A header line and a line per trajectory in the input order
+    std::ifstream ifs("pipeline_test.csv");
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    for (const Trajectory &trajectory : trajectories) {
+      REQUIRE(std::getline(ifs,line));
+      REQUIRE(line.substr(0,line.find(';'))==std::to_string(trajectory.id));
+    }
+    REQUIRE(!std::getline(ifs,line));
+    ifs.close();
+    std::remove("pipeline_test.csv");
+    // The trajectories chunked along the Hilbert curve are written in the
+    // input order
+    options.spatial_order = true;
+    {
+      GPSReader pipeline_reader(gps_config);
+      CSVMatchResultWriter writer("pipeline_test.csv",output_config);
+      MatchPipelineStatistics statistics = run_match_pipeline(
+          &pipeline_reader,&writer,
+          [&](const Trajectory &trajectory) {
+            return std::vector<SegmentMatchResult>{SegmentMatchResult{
+                -1,-1,model.match_traj(trajectory,config)}};
+          },options);
+      REQUIRE(statistics.trajectories==trajectories.size());
+      REQUIRE(statistics.points_matched==points_matched);
+    }
+    ifs.open("pipeline_test.csv");
+    REQUIRE(std::getline(ifs,line));
+    for (const Trajectory &trajectory : trajectories) {
+      REQUIRE(std::getline(ifs,line));
+      REQUIRE(line.substr(0,line.find(';'))==std::to_string(trajectory.id));
+    }
+    REQUIRE(!std::getline(ifs,line));
+    std::remove("pipeline_test.csv");
+    options.spatial_order = false;
+    // The writers are created by the output format
+    CONFIG::ResultConfig result_config;
+    result_config.file = "pipeline_test.csv";
+    REQUIRE(MatchResultWriter::create(result_config)!=nullptr);
+    std::remove("pipeline_test.csv");
+    result_config.format = "json";
+    REQUIRE(!result_config.validate());
+    REQUIRE(MatchResultWriter::create(result_config)==nullptr);
+    // The chunks are cut by their points with a memory budget
+    REQUIRE(get_chunk_points(options)==0);
+    options.memory_budget = 10*PIPELINE_BYTES_PER_POINT*
+        (2*PIPELINE_QUEUE_CHUNKS+2)*options.num_matchers;
+    REQUIRE(get_chunk_points(options)==10);
+    options.ordered = false;
+    {
+      GPSReader pipeline_reader(gps_config);
+      CSVMatchResultWriter writer("pipeline_test.csv",output_config);
+      MatchPipelineStatistics statistics = run_match_pipeline(
+          &pipeline_reader,&writer,
+          [&](const Trajectory &trajectory) {
+            return std::vector<SegmentMatchResult>{SegmentMatchResult{
+                -1,-1,model.match_traj(trajectory,config)}};
+          },options);
+      REQUIRE(statistics.trajectories==trajectories.size());
+      REQUIRE(statistics.points_matched==points_matched);
+    }
+    std::remove("pipeline_test.csv");
+  }
+  SECTION( "match_checkpoint_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    REQUIRE(trajectories.size() > 2);
+    CONFIG::OutputConfig output_config;
+    std::string file = "checkpoint_test.csv";
+    std::string checkpoint_file = MatchCheckpoint::checkpoint_file(file);
+    REQUIRE(checkpoint_file=="checkpoint_test.csv.checkpoint");
+    // The rows written after the checkpoint are dropped by the resume
+    {
+      CSVMatchResultWriter writer(file,output_config);
+      MatchCheckpoint checkpoint(file,&writer,3600);
+      writer.write_result(model.match_traj(trajectories[0],config));
+      writer.write_result(model.match_traj(trajectories[1],config));
+      checkpoint.update(2);
+      REQUIRE(!UTIL::file_exists(checkpoint_file));
+      REQUIRE(checkpoint.save(2));
+      writer.write_result(model.match_traj(trajectories[2],config));
+    }
+    long skipped = 0;
+    REQUIRE(MatchCheckpoint::resume(file,&skipped));
+    REQUIRE(skipped==2);
+    auto count_lines = [&file]() {
+      std::ifstream ifs(file);
+      std::string line;
+      int lines = 0;
+      while (std::getline(ifs,line)) ++lines;
+      return lines;
+    };
+    REQUIRE(count_lines()==3);
+    // A job resumed appends without a header and counts the trajectories
+    // skipped
+    CONFIG::GPSConfig gps_config;
+    gps_config.file = "../data/trips.csv";
+    gps_config.id = "id";
+    gps_config.geom = "geom";
+    {
+      GPSReader checkpoint_reader(gps_config);
+      REQUIRE(MatchCheckpoint::skip_trajectories(&checkpoint_reader,
+                                                 skipped)==2);
+      CSVMatchResultWriter writer(file,output_config,0,true);
+      MatchCheckpoint checkpoint(file,&writer,0,skipped);
+      MatchPipelineOptions options;
+      options.num_matchers = 2;
+      options.chunk_size = 1;
+      options.ordered = true;
+      options.checkpoint = &checkpoint;
+      MatchPipelineStatistics statistics = run_match_pipeline(
+          &checkpoint_reader,&writer,
+          [&](const Trajectory &trajectory) {
+            return std::vector<SegmentMatchResult>{SegmentMatchResult{
+                -1,-1,model.match_traj(trajectory,config)}};
+          },options);
+      REQUIRE(statistics.trajectories==trajectories.size()-2);
+    }
+    REQUIRE(count_lines()==trajectories.size()+1);
+    std::ifstream ifs(checkpoint_file);
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    REQUIRE(line=="trajectories "+std::to_string(trajectories.size()));
+    REQUIRE(std::getline(ifs,line));
+    REQUIRE(line=="bytes "+std::to_string(UTIL::get_file_size(file)));
+    ifs.close();
+    // A result file shorter than its checkpoint is not resumed
+    {
+      std::ofstream ofs(file);
+    }
+    REQUIRE(!MatchCheckpoint::resume(file,&skipped));
+    std::remove(file.c_str());
+    std::remove(checkpoint_file.c_str());
+  }
+  SECTION( "rematch_filter_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    CONFIG::OutputConfig output_config;
+    std::vector<MatchResult> results;
+    {
+      CSVMatchResultWriter writer("rematch_previous.csv",output_config);
+      for (const Trajectory &trajectory : trajectories) {
+        results.push_back(model.match_traj(trajectory,config));
+        writer.write_result(results.back());
+      }
+    }
+    REQUIRE(!results[0].cpath.empty());
+    std::vector<BoostBox> areas;
+    REQUIRE(RematchFilter::parse_areas("0,0,1,1;2,2,3,3",&areas));
+    REQUIRE(areas.size()==2);
+    REQUIRE(!RematchFilter::parse_areas("0,0,1",&areas));
+    // No trajectory is affected without changes
+    {
+      RematchFilter filter(network,{},{},config.radius);
+      REQUIRE(filter.read_previous("rematch_previous.csv"));
+      for (const Trajectory &trajectory : trajectories) {
+        REQUIRE(!filter.select(trajectory));
+      }
+    }
+    // An area covering the network affects all the trajectories
+    {
+      RematchFilter filter(network,{},
+                           {BoostBox(Point(-1e9,-1e9),Point(1e9,1e9))},0);
+      REQUIRE(filter.read_previous("rematch_previous.csv"));
+      for (const Trajectory &trajectory : trajectories) {
+        REQUIRE(filter.select(trajectory));
+      }
+    }
+    // A trajectory passing a changed edge is matched again and merged in
+    // place of its previous result
+    EdgeID changed = results[0].cpath[0];
+    RematchFilter filter(network,{changed},{},0);
+    REQUIRE(filter.read_previous("rematch_previous.csv"));
+    CONFIG::GPSConfig gps_config;
+    gps_config.file = "../data/trips.csv";
+    gps_config.id = "id";
+    gps_config.geom = "geom";
+    GPSReader rematch_reader(gps_config);
+    rematch_reader.set_filter([&filter](const Trajectory &trajectory) {
+      return filter.select(trajectory);
+    });
+    std::vector<int> rematched;
+    {
+      CSVMatchResultWriter writer("rematch_new.csv",output_config);
+      while (rematch_reader.has_next_trajectory()) {
+        Trajectory trajectory = rematch_reader.read_next_trajectory();
+        rematched.push_back(trajectory.id);
+        writer.write_result(model.match_traj(trajectory,config));
+      }
+    }
+    REQUIRE(!rematched.empty());
+    REQUIRE(rematched[0]==trajectories[0].id);
+    REQUIRE(filter.get_selected()==rematched.size());
+    REQUIRE(rematch_reader.get_filtered()==
+            trajectories.size()-rematched.size());
+    REQUIRE(filter.merge("rematch_previous.csv","rematch_new.csv",
+                         "rematch_merged.csv"));
+    std::ifstream ifs("rematch_merged.csv");
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    for (const Trajectory &trajectory : trajectories) {
+      REQUIRE(std::getline(ifs,line));
+      REQUIRE(line.substr(0,line.find(';'))==std::to_string(trajectory.id));
+    }
+    REQUIRE(!std::getline(ifs,line));
+    ifs.close();
+    // The results merged have the same fields
+    output_config.write_opath = true;
+    {
+      CSVMatchResultWriter writer("rematch_new.csv",output_config);
+    }
+    REQUIRE(!filter.merge("rematch_previous.csv","rematch_new.csv",
+                          "rematch_merged.csv"));
+    std::remove("rematch_previous.csv");
+    std::remove("rematch_new.csv");
+    std::remove("rematch_merged.csv");
+  }
+  SECTION( "input_shard_test" ) {
+    REQUIRE(CONFIG::ResultConfig::get_shard_file("out/mr.csv.gz",2,8)==
+            "out/mr.2-of-8.csv.gz");
+    REQUIRE(CONFIG::ResultConfig::get_shard_file("mr",0,2)=="mr.0-of-2");
+    REQUIRE(CONFIG::ResultConfig::get_shard_file("-",0,2)=="-");
+    CONFIG::GPSConfig gps_config;
+    gps_config.file = "../data/trips.csv";
+    gps_config.id = "id";
+    gps_config.geom = "geom";
+    // Each trajectory is read by exactly the shard of its id
+    int num_shards = 3;
+    std::vector<int> ids;
+    for (int shard = 0; shard < num_shards; ++shard) {
+      GPSReader shard_reader(gps_config);
+      shard_reader.set_shard(shard,num_shards);
+      while (shard_reader.has_next_trajectory()) {
+        Trajectory trajectory = shard_reader.read_next_trajectory();
+        REQUIRE(GPSReader::get_trajectory_shard(trajectory.id,num_shards)==
+                shard);
+        ids.push_back(trajectory.id);
+      }
+    }
+    std::vector<int> expected;
+    for (const Trajectory &trajectory : trajectories) {
+      expected.push_back(trajectory.id);
+    }
+    std::sort(ids.begin(),ids.end());
+    std::sort(expected.begin(),expected.end());
+    REQUIRE(ids==expected);
+  }
+  SECTION( "edge_aggregate_writer_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    CONFIG::ResultConfig result_config;
+    result_config.file = "edge_aggregate.csv";
+    result_config.format = "edges";
+    REQUIRE(result_config.validate());
+    REQUIRE(get_result_fields(result_config).timestamps);
+    REQUIRE(MatchResultWriter::create(result_config)==nullptr);
+    Trajectory trajectory = trajectories[0];
+    int points = trajectory.geom.get_num_points();
+    trajectory.timestamps.clear();
+    for (int i = 0; i < points; ++i) trajectory.timestamps.push_back(10*i);
+    std::vector<SegmentMatchResult> segments{
+        SegmentMatchResult{-1,-1,model.match_traj(trajectory,config)}};
+    copy_timestamps(trajectory,&segments);
+    const MatchResult &result = segments[0].result;
+    REQUIRE(result.timestamps==trajectory.timestamps);
+    REQUIRE(!result.cpath.empty());
+    {
+      EdgeAggregateWriter writer(result_config.file,network);
+      writer.write_result(segments[0]);
+      writer.write_result(segments[0]);
+      std::vector<EdgeTraversals> merged = writer.merge_traversals();
+      long count = 0;
+      double time = 0;
+      double first = std::numeric_limits<double>::infinity();
+      double last = -first;
+      for (const EdgeTraversals &traversals : merged) {
+        count += traversals.count;
+        time += traversals.time;
+        first = std::min(first,traversals.first);
+        last = std::max(last,traversals.last);
+      }
+      // Each result traverses the edges of its cpath from its first point
+      // to its last one
+      REQUIRE(count==2*result.cpath.size());
+      REQUIRE(time==Approx(2*10*(points-1)));
+      REQUIRE(first==Approx(0));
+      REQUIRE(last==Approx(10*(points-1)));
+    }
+    std::ifstream ifs(result_config.file);
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    REQUIRE(line=="id;count;first;last;time;distance;speed");
+    REQUIRE(std::getline(ifs,line));
+    ifs.close();
+    std::remove(result_config.file.c_str());
+  }
+  SECTION( "edge_index_writer_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    CONFIG::ResultConfig result_config;
+    result_config.file = "edge_index.bin";
+    result_config.format = "index";
+    REQUIRE(result_config.validate());
+    REQUIRE(MatchResultWriter::create(result_config)==nullptr);
+    MatchResult result = model.match_traj(trajectories[0],config);
+    const C_Path &cpath = result.cpath;
+    REQUIRE(!cpath.empty());
+    {
+      std::unique_ptr<MatchResultWriter> writer =
+          MatchResultWriter::create(result_config,false,&network);
+      REQUIRE(writer!=nullptr);
+      // The results are written in reverse order of their ids, and the
+      // segment starts at the third point
+      result.id = 7;
+      writer->write_result(result);
+      result.id = 3;
+      writer->write_result(SegmentMatchResult{2,4,result});
+    }
+    auto index = EdgeTrajectoryIndex::read_edge_index(result_config.file);
+    REQUIRE(index!=nullptr);
+    REQUIRE(index->get_num_postings()==2*cpath.size());
+    std::set<EdgeID> edges(cpath.begin(),cpath.end());
+    REQUIRE(index->get_num_edges()==edges.size());
+    for (EdgeID id : edges) {
+      REQUIRE_THAT(index->get_trajectories(id),Catch::Equals<int>({3,7}));
+    }
+    const EdgePosting *first, *last;
+    REQUIRE(index->find(cpath[0],&first,&last)>=2);
+    REQUIRE(first->trajectory==3);
+    REQUIRE(first->point==2);
+    REQUIRE((last-1)->trajectory==7);
+    REQUIRE(index->find(-1,&first,&last)==0);
+    REQUIRE(first==last);
+    index.reset();
+    std::remove(result_config.file.c_str());
+  }
+  SECTION( "match_state_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    CONFIG::ResultConfig result_config;
+    result_config.file = "match_state.bin";
+    result_config.format = "state";
+    result_config.output_config.write_segment = true;
+    REQUIRE(result_config.validate());
+    MM::ResultFields fields = get_result_fields(result_config);
+    REQUIRE(fields.candidates);
+    REQUIRE(fields.timestamps);
+    REQUIRE(!fields.mgeom);
+    std::vector<SegmentMatchResult> segments;
+    for (const Trajectory &trajectory : trajectories) {
+      segments.push_back(SegmentMatchResult{
+          -1,-1,model.match_traj(trajectory,config)});
+    }
+    {
+      std::unique_ptr<MatchResultWriter> writer =
+          MatchResultWriter::create(result_config);
+      REQUIRE(writer!=nullptr);
+      for (const SegmentMatchResult &segment : segments) {
+        writer->write_result(segment);
+      }
+    }
+    MatchStateReader reader(result_config.file);
+    REQUIRE(reader.get_num_records()==(long long) segments.size());
+    REQUIRE(reader.has_segments());
+    REQUIRE(!reader.has_partial());
+    // The results decoded, with their mgeom rebuilt, are written as the
+    // results matched
+    CONFIG::ResultConfig export_config;
+    export_config.file = "match_state.csv";
+    CONFIG::OutputConfig &output_config = export_config.output_config;
+    output_config.write_opath = true;
+    output_config.write_offset = true;
+    output_config.write_error = true;
+    output_config.write_tpath = true;
+    output_config.write_spdist = true;
+    output_config.write_pgeom = true;
+    output_config.write_ep = true;
+    output_config.write_tp = true;
+    output_config.write_length = true;
+    output_config.write_segment = true;
+    std::vector<std::string> expected(segments.size());
+    {
+      CSVMatchResultWriter writer("match_state_direct.csv",output_config);
+      for (std::size_t k = 0; k < segments.size(); ++k) {
+        SegmentMatchResult decoded;
+        REQUIRE(reader.read_record(k,network,true,&decoded));
+        writer.format_result(segments[k],&expected[k]);
+        std::string actual;
+        writer.format_result(decoded,&actual);
+        REQUIRE(actual==expected[k]);
+      }
+    }
+    REQUIRE(export_match_state(reader,network,export_config,true)==
+            (long long) segments.size());
+    std::ifstream ifs(export_config.file);
+    std::string line;
+    REQUIRE(std::getline(ifs,line));
+    for (std::size_t k = 0; k < segments.size(); ++k) {
+      REQUIRE(std::getline(ifs,line));
+      REQUIRE(line+"\n"==expected[k]);
+    }
+    REQUIRE(!std::getline(ifs,line));
+    ifs.close();
+    std::remove(result_config.file.c_str());
+    std::remove(export_config.file.c_str());
+    std::remove("match_state_direct.csv");
+  }
+  SECTION( "thread_placement_test" ) {
+    REQUIRE_THAT(UTIL::parse_cpu_list("0-2,8,10-11\n"),
+                 Catch::Equals<int>({0,1,2,8,10,11}));
+    REQUIRE(UTIL::parse_cpu_list("3-1").empty());
+    REQUIRE(UTIL::parse_cpu_list("1,x").empty());
+    UTIL::ThreadPlacement placement;
+    REQUIRE(UTIL::string2placement("socket",&placement));
+    REQUIRE(placement==UTIL::PLACEMENT_SOCKET);
+    REQUIRE(!UTIL::string2placement("numa",&placement));
+    const std::vector<UTIL::NumaNode> &nodes = UTIL::get_numa_nodes();
+    REQUIRE(!nodes.empty());
+    REQUIRE(!nodes[0].cpus.empty());
+    // The matchers are spread over the nodes in turn
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    CONFIG::GPSConfig gps_config;
+    gps_config.file = "../data/trips.csv";
+    gps_config.id = "id";
+    gps_config.geom = "geom";
+    CONFIG::OutputConfig output_config;
+    MatchPipelineOptions options;
+    options.num_matchers = 3;
+    options.chunk_size = 1;
+    options.placement = UTIL::PLACEMENT_CORE;
+    MatchPipelineStatistics statistics;
+    {
+      GPSReader pipeline_reader(gps_config);
+      CSVMatchResultWriter writer("placement_test.csv",output_config);
+      statistics = run_match_pipeline(
+          &pipeline_reader,&writer,
+          [&](const Trajectory &trajectory) {
+            return std::vector<SegmentMatchResult>{SegmentMatchResult{
+                -1,-1,model.match_traj(trajectory,config)}};
+          },options);
+    }
+    std::remove("placement_test.csv");
+    REQUIRE(statistics.matcher_nodes.size()==3);
+    long points = 0;
+    for (int i = 0; i < 3; ++i) {
+      REQUIRE(statistics.matcher_nodes[i]==i%nodes.size());
+      points += statistics.matcher_points[i];
+    }
+    REQUIRE(points==statistics.total_points);
+  }
+  SECTION( "result_cache_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    ResultCache cache(1024*1024,"test");
+    Trajectory trajectory = trajectories[0];
+    std::vector<SegmentMatchResult> segments;
+    REQUIRE(!cache.look_up(trajectory,&segments));
+    segments.push_back(SegmentMatchResult{
+        -1,-1,model.match_traj(trajectory,config)});
+    cache.insert(trajectory,segments);
+    // A duplicate reuses the results under its own id
+    Trajectory duplicate = trajectory;
+    duplicate.id = 42;
+    std::vector<SegmentMatchResult> reused;
+    REQUIRE(cache.look_up(duplicate,&reused));
+    REQUIRE(reused.size()==1);
+    REQUIRE(reused[0].result.id==42);
+    REQUIRE_THAT(reused[0].result.cpath,
+                 Catch::Equals<int>(segments[0].result.cpath));
+    // Other timestamps, coordinates or context are not duplicates
+    duplicate.timestamps.assign(trajectory.geom.get_num_points(),1);
+    REQUIRE(!cache.look_up(duplicate,&reused));
+    ResultCache other(1024*1024,"other");
+    REQUIRE(!other.look_up(trajectory,&reused));
+    ResultCacheStatistics statistics = cache.get_statistics();
+    REQUIRE(statistics.hits==1);
+    REQUIRE(statistics.misses==2);
+    REQUIRE(statistics.entries==1);
+    REQUIRE(statistics.bytes==ResultCache::estimate_bytes(segments));
+    // Partial results are not cached
+    segments[0].result.partial = true;
+    cache.insert(trajectories[1],segments);
+    REQUIRE(cache.get_statistics().entries==1);
+    // The memory of a small cache is bounded by evictions
+    long bytes = ResultCache::estimate_bytes(segments);
+    ResultCache small(3*bytes*ResultCache::CACHE_SHARDS);
+    segments[0].result.partial = false;
+    for (int i = 0; i < 1000; ++i) {
+      Trajectory shifted = trajectory;
+      shifted.timestamps.assign(trajectory.geom.get_num_points(),i);
+      small.insert(shifted,segments);
+    }
+    statistics = small.get_statistics();
+    REQUIRE(statistics.evictions>0);
+    REQUIRE(statistics.entries+statistics.evictions==1000);
+    REQUIRE(statistics.bytes<=3*bytes*ResultCache::CACHE_SHARDS);
+  }
+  SECTION( "result_stream_test" ) {
+    // A compressed file is read back as the text written
+    std::string text = "id;cpath\n1;2,3\n";
+    std::string member;
+    REQUIRE(ResultStream::compress_block(text.data(),text.size(),&member));
+    {
+      ResultStream stream("result_stream_test.csv.gz");
+      REQUIRE(stream.compressed());
+      stream.write(text.data(),text.size());
+      stream.write_compressed(member);
+      stream.write(text.data(),text.size());
+    }
+    gzFile file = gzopen("result_stream_test.csv.gz","rb");
+    REQUIRE(file!=nullptr);
+    char buffer[256];
+    int size = gzread(file,buffer,sizeof(buffer));
+    gzclose(file);
+    REQUIRE(std::string(buffer,size)==text+text+text);
+    std::remove("result_stream_test.csv.gz");
+    // An asynchronous file holds the text written once flushed
+    std::string expected;
+    {
+      AsyncFileWriter async("async_writer_test.csv",false,64);
+      for (int i = 0; i < 1000; ++i) {
+        std::string line = std::to_string(i) + ";" + text;
+        expected += line;
+        async.write(line.data(),line.size());
+        if (i == 500) {
+          async.flush();
+          REQUIRE(UTIL::get_file_size("async_writer_test.csv")==
+                  (long long) expected.size());
+        }
+      }
+      REQUIRE(async.good());
+    }
+    {
+      ResultStream stream("async_writer_test.csv",true,true);
+      stream.write(text.data(),text.size());
+    }
+    std::ifstream async_file("async_writer_test.csv");
+    std::stringstream async_text;
+    async_text << async_file.rdbuf();
+    REQUIRE(async_text.str()==expected+text);
+    REQUIRE(get_async_write_statistics().bytes>=(long long) expected.size());
+    std::remove("async_writer_test.csv");
+    // The rows are split into shards listed in a manifest
+    REQUIRE(CSVMatchResultWriter::shard_file("out/result.csv.gz",3)==
+        "out/result.00003.csv.gz");
+    REQUIRE(CSVMatchResultWriter::shard_file("result",0)=="result.00000");
+    CONFIG::OutputConfig output_config;
+    {
+      CSVMatchResultWriter writer("shard_test.csv",output_config,2);
+      MatchResult result;
+      for (int i = 0; i < 5; ++i) {
+        result.id = i;
+        writer.write_result(result);
+      }
+    }
+    std::ifstream manifest("shard_test.csv.manifest");
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(manifest,line)) lines.push_back(line);
+    REQUIRE(lines.size()==4);
+    REQUIRE(lines[1]=="shard_test.00000.csv;2");
+    REQUIRE(lines[3]=="shard_test.00002.csv;1");
+    for (int k = 0; k < 3; ++k) {
+      std::remove(CSVMatchResultWriter::shard_file("shard_test.csv",k).c_str());
+    }
+    std::remove("shard_test.csv.manifest");
+  }
+  SECTION( "csv_point_reader_test" ) {
+    {
+      std::ofstream ofs("point_reader_test.csv");
+      ofs << "id;x;y;timestamp\r\n1;0.5;1;1600000000.25\r\n"
+          << "1;1e1;2;1600000001.5\n\n2;3;4;5\n2;x;4;5\n3;-7.125;8;9";
+    }
+    CSVPointReader point_reader("point_reader_test.csv","id","x","y",
+                                "timestamp");
+    std::vector<Trajectory> points = point_reader.read_all_trajectories();
+    REQUIRE(points.size()==3);
+    REQUIRE(points[0].id==1);
+    REQUIRE(points[0].geom.get_num_points()==2);
+    REQUIRE(points[0].geom.get_x(1)==10);
+    // Timestamps are kept in double precision
+    REQUIRE(points[0].timestamps[0]==1600000000.25);
+    // The malformed row is skipped
+    REQUIRE(points[1].geom.get_num_points()==1);
+    REQUIRE(points[2].id==3);
+    REQUIRE(points[2].geom.get_x(0)==-7.125);
+    point_reader.reset_cursor();
+    REQUIRE(point_reader.read_next_trajectory().id==1);
+    point_reader.close();
+    std::remove("point_reader_test.csv");
+  }
+  SECTION( "timestamp_parser_test" ) {
+    using UTIL::parse_timestamp;
+    double value = 0;
+    std::string text = "2020-01-31T08:30:00.25+01:00";
+    const char *end = text.data()+text.size();
+    REQUIRE(parse_timestamp(text.data(),end,UTIL::ISO8601,&value)==end);
+    REQUIRE(value==1580455800.25);
+    text = "2020-01-31 07:30:00.25Z";
+    end = text.data()+text.size();
+    REQUIRE(parse_timestamp(text.data(),end,UTIL::ISO8601,&value)==end);
+    REQUIRE(value==1580455800.25);
+    // A time without a time zone is in UTC, the seconds are optional
+    text = "1969-12-31T23:59-0000";
+    end = text.data()+text.size();
+    REQUIRE(parse_timestamp(text.data(),end,UTIL::ISO8601,&value)==end);
+    REQUIRE(value==-60);
+    text = "2020-13-01";
+    REQUIRE(parse_timestamp(text.data(),text.data()+text.size(),
+                            UTIL::ISO8601,&value)==nullptr);
+    text = "1580455800250";
+    end = text.data()+text.size();
+    REQUIRE(parse_timestamp(text.data(),end,UTIL::EPOCH_MILLISECONDS,
+                            &value)==end);
+    REQUIRE(value==1580455800.25);
+    text = "1580455800250000";
+    end = text.data()+text.size();
+    REQUIRE(parse_timestamp(text.data(),end,UTIL::EPOCH_MICROSECONDS,
+                            &value)==end);
+    REQUIRE(value==1580455800.25);
+    UTIL::TimestampFormat format;
+    REQUIRE(UTIL::string2timestamp_format("iso8601",&format));
+    REQUIRE(format==UTIL::ISO8601);
+    REQUIRE(!UTIL::string2timestamp_format("iso",&format));
+    {
+      std::ofstream ofs("iso_reader_test.csv");
+      ofs << "id;x;y;timestamp\n1;0;0;2020-01-31T08:30:00Z\n"
+          << "1;1;0;2020-01-31T08:30:01.5Z\n2;1;0;1580455800\n";
+    }
+    CSVPointReader iso_reader("iso_reader_test.csv","id","x","y",
+                              "timestamp",UTIL::ISO8601);
+    std::vector<Trajectory> iso_points = iso_reader.read_all_trajectories();
+    // The epoch number is a malformed ISO 8601 timestamp
+    REQUIRE(iso_points.size()==1);
+    REQUIRE(iso_points[0].timestamps.size()==2);
+    REQUIRE(iso_points[0].timestamps[1]-iso_points[0].timestamps[0]==1.5);
+    iso_reader.close();
+    std::remove("iso_reader_test.csv");
+  }
+  SECTION( "parallel_csv_reader_test" ) {
+    {
+      std::ofstream ofs("parallel_reader_test.csv");
+      ofs << "id;x;y;timestamp\n";
+      for (int t = 0; t < 500; ++t) {
+        for (int k = 0; k <= t % 7; ++k) {
+          ofs << t << ";" << k << ".5;" << t << ";" << k << "\n";
+        }
+      }
+    }
+    CONFIG::GPSConfig point_config;
+    point_config.file = "parallel_reader_test.csv";
+    point_config.gps_point = true;
+    point_config.id = "id";
+    point_config.x = "x";
+    point_config.y = "y";
+    point_config.timestamp = "timestamp";
+    CSVPointReader sequential("parallel_reader_test.csv","id","x","y",
+                              "timestamp");
+    std::vector<Trajectory> expected = sequential.read_all_trajectories();
+    // Blocks smaller than a trajectory are extended to its last row
+    ParallelCSVReader parallel(point_config,3,64);
+    std::vector<Trajectory> parsed = parallel.read_all_trajectories();
+    REQUIRE(parsed.size()==expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      REQUIRE(parsed[i].id==expected[i].id);
+      REQUIRE(parsed[i].geom.get_num_points()==
+              expected[i].geom.get_num_points());
+      REQUIRE(parsed[i].timestamps==expected[i].timestamps);
+    }
+    parallel.close();
+    std::remove("parallel_reader_test.csv");
+    CONFIG::GPSConfig trajectory_config;
+    trajectory_config.file = "../data/trips.csv";
+    trajectory_config.id = "id";
+    trajectory_config.geom = "geom";
+    ParallelCSVReader trips(trajectory_config,2,16);
+    std::vector<Trajectory> trips_parsed = trips.read_all_trajectories();
+    REQUIRE(trips_parsed.size()==trajectories.size());
+    REQUIRE(trips_parsed.back().id==trajectories.back().id);
+  }
+  SECTION( "stream_trajectory_reader_test" ) {
+    int fds[2];
+    REQUIRE(pipe(fds)==0);
+    std::string rows = "id;geom;timestamp\r\n1;LINESTRING(0 0,1 1);1,2\r\n";
+    REQUIRE(write(fds[1],rows.data(),rows.size())==rows.size());
+    StreamTrajectoryReader stream_reader(fds[0],"id","geom","timestamp");
+    REQUIRE(stream_reader.has_next_trajectory());
+    Trajectory first = stream_reader.read_next_trajectory();
+    REQUIRE(first.id==1);
+    REQUIRE(first.timestamps.size()==2);
+    // The writer has not sent the next row yet
+    REQUIRE(!stream_reader.is_ready());
+    rows = "bad\n\n2;LINESTRING(1 1,2 2);3,4\n3;LINESTRING(5 5,6 6);1,1";
+    REQUIRE(write(fds[1],rows.data(),rows.size())==rows.size());
+    close(fds[1]);
+    REQUIRE(stream_reader.is_ready());
+    std::vector<Trajectory> rest = stream_reader.read_all_trajectories();
+    REQUIRE(rest.size()==2);
+    REQUIRE(rest[0].id==2);
+    REQUIRE(rest[1].geom.get_x(0)==5);
+    stream_reader.close();
+    close(fds[0]);
+  }
+  SECTION( "parallel_gdal_reader_test" ) {
+    GDALTrajectoryReader gdal_reader("../data/trips.shp","id","timestamp");
+    std::vector<Trajectory> expected = gdal_reader.read_all_trajectories();
+    gdal_reader.close();
+    // Blocks of a feature, so that each thread reads several of them
+    ParallelGDALReader parallel_reader("../data/trips.shp","id",
+                                       "timestamp",2,1);
+    std::vector<Trajectory> read = parallel_reader.read_all_trajectories();
+    REQUIRE(!expected.empty());
+    REQUIRE(read.size()==expected.size());
+    for (std::size_t i = 0; i < read.size(); ++i) {
+      REQUIRE(read[i].id==expected[i].id);
+      REQUIRE(read[i].geom==expected[i].geom);
+    }
+    parallel_reader.close();
+  }
+  SECTION( "binary_trajectory_test" ) {
+    for (bool compress : {false, true}) {
+      {
+        // Small blocks so that the trajectories span several of them
+        BinaryTrajectoryWriter writer("binary_test.traj",compress,64);
+        for (const Trajectory &traj : trajectories) {
+          writer.write_trajectory(traj);
+        }
+        Trajectory timed{7,LineString(),{1.5,2.5}};
+        timed.geom.add_point(0.25,1);
+        timed.geom.add_point(3,-4.125);
+        writer.write_trajectory(timed);
+        REQUIRE(writer.close());
+      }
+      BinaryTrajectoryReader reader("binary_test.traj");
+      REQUIRE(reader.get_num_trajectories()==trajectories.size()+1);
+      REQUIRE(reader.has_timestamp());
+      std::vector<Trajectory> read = reader.read_all_trajectories();
+      REQUIRE(read.size()==trajectories.size()+1);
+      for (std::size_t i = 0; i < trajectories.size(); ++i) {
+        REQUIRE(read[i].id==trajectories[i].id);
+        REQUIRE(read[i].geom==trajectories[i].geom);
+      }
+      REQUIRE(read.back().id==7);
+      REQUIRE(read.back().timestamps==std::vector<double>{1.5,2.5});
+      reader.reset_cursor();
+      TrajectorySpan span;
+      REQUIRE(reader.read_next_span(&span));
+      REQUIRE(span.id==trajectories[0].id);
+      REQUIRE(span.x[0]==trajectories[0].geom.get_x(0));
+      REQUIRE(span.y[0]==trajectories[0].geom.get_y(0));
+      reader.close();
+    }
+    std::remove("binary_test.traj");
+  }
+  SECTION( "interleaved_match_test" ) {
+    // Interleaving the trajectories or advancing them in lockstep gives
+    // the results of match_traj for any group size, with and without the
+    // beam and the point filter
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    FastMapMatchConfig beam_config{4,0.4,0.5};
+    beam_config.beam_size = 2;
+    beam_config.min_distance = 0.5;
+    for (const FastMapMatchConfig &c : {config, beam_config}) {
+      for (int group_size : {1, 3, 16}) {
+        for (bool lockstep : {false, true}) {
+          std::vector<MatchResult> results = lockstep ?
+              model.match_traj_lockstep(trajectories,c,group_size,2) :
+              model.match_traj_interleaved(trajectories,c,group_size,2);
+          REQUIRE(results.size()==trajectories.size());
+          for (int i = 0; i < trajectories.size(); ++i) {
+            MatchResult expected = model.match_traj(trajectories[i],c);
+            REQUIRE(results[i].id==expected.id);
+            REQUIRE(results[i].cpath==expected.cpath);
+            REQUIRE(results[i].opath==expected.opath);
+            REQUIRE(results[i].indices==expected.indices);
+          }
+        }
+      }
+    }
+    REQUIRE(model.match_traj_interleaved({},config).empty());
+    REQUIRE(model.match_traj_lockstep({},config).empty());
+  }
+  SECTION( "match_batch_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    std::vector<MatchResult> results =
+        model.match_traj_batch(trajectories,config,2);
+    REQUIRE(results.size()==trajectories.size());
+    for (int i = 0; i < trajectories.size(); ++i) {
+      MatchResult expected = model.match_traj(trajectories[i],config);
+      REQUIRE(results[i].id==expected.id);
+      REQUIRE(results[i].cpath==expected.cpath);
+      REQUIRE(results[i].opath==expected.opath);
+    }
+    // Arrays give the same result as the trajectory they hold
+    const LineString &geom = trajectories[0].geom;
+    std::vector<double> coords;
+    for (int i = 0; i < geom.get_num_points(); ++i) {
+      coords.push_back(geom.get_x(i));
+      coords.push_back(geom.get_y(i));
+    }
+    PYTHON::PyMatchArrays arrays = model.match_coords(
+        coords.data(),geom.get_num_points(),nullptr,0,config);
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    REQUIRE(arrays.cpath==expected.cpath);
+    REQUIRE(arrays.offsets.size()==expected.opath.size());
+    REQUIRE(arrays.mgeom.size()==2*expected.mgeom.get_num_points());
+    std::vector<double> timestamps(1,0.0);
+    REQUIRE_THROWS(model.match_coords(
+        coords.data(),geom.get_num_points(),timestamps.data(),1,config));
+    std::vector<std::string> wkts = {"LINESTRING(0 0,1 1)",
+                                     "LINESTRING(1 1,2 2)"};
+    std::vector<PYTHON::PyMatchResult> py_results =
+        model.match_wkt_batch(wkts,config);
+    REQUIRE(py_results.size()==2);
+    REQUIRE(py_results[1].id==1);
+  }
+  SECTION( "fmm_server_test" ) {
+    HttpRequest request;
+    long length = 0;
+    REQUIRE(HttpServer::parse_header(
+        "POST /match?k=4&e=20 HTTP/1.1\r\nHost: x\r\n"
+        "content-length: 12\r\nConnection: close\r\n"
+        "Authorization: Bearer abc",&request,&length));
+    REQUIRE(request.method=="POST");
+    REQUIRE(request.token=="abc");
+    REQUIRE(request.path=="/match");
+    REQUIRE(length==12);
+    REQUIRE(!request.keep_alive);
+    std::string value;
+    REQUIRE(request.get_parameter("e",&value));
+    REQUIRE(value=="20");
+    REQUIRE(!request.get_parameter("r",&value));
+    REQUIRE(!HttpServer::parse_header("GET\r\n",&request,&length));
+    FastMapMatchConfig server_config{8,300,50};
+    std::string error;
+    REQUIRE(FMMServer::parse_parameters(request,&server_config,&error));
+    REQUIRE(server_config.k==4);
+    REQUIRE(server_config.radius==300);
+    REQUIRE(server_config.gps_error==20);
+    request.query = "k=-1";
+    REQUIRE(!FMMServer::parse_parameters(request,&server_config,&error));
+    RequestPriority priority;
+    double deadline = 0;
+    REQUIRE(FMMServer::parse_schedule(request,&priority,&deadline,&error));
+    REQUIRE(priority==RequestPriority::INTERACTIVE);
+    REQUIRE(deadline==0);
+    request.query = "priority=bulk&deadline=0.5";
+    REQUIRE(FMMServer::parse_schedule(request,&priority,&deadline,&error));
+    REQUIRE(priority==RequestPriority::BULK);
+    REQUIRE(deadline==0.5);
+    request.query = "priority=urgent";
+    REQUIRE(!FMMServer::parse_schedule(request,&priority,&deadline,&error));
+    // A slot released goes to the interactive trajectories first
+    MatchScheduler scheduler(1,1);
+    REQUIRE(scheduler.admit_request(RequestPriority::BULK));
+    REQUIRE(!scheduler.admit_request(RequestPriority::BULK));
+    REQUIRE(scheduler.acquire(RequestPriority::BULK,UTIL::TimePoint::max()));
+    REQUIRE(!scheduler.acquire(RequestPriority::INTERACTIVE,
+        std::chrono::steady_clock::now()+std::chrono::milliseconds(10)));
+    std::vector<RequestPriority> order;
+    auto wait_queued = [&scheduler](long interactive, long bulk) {
+      MatchSchedulerStatistics statistics = scheduler.get_statistics();
+      while (statistics.waiting_interactive!=interactive ||
+             statistics.waiting_bulk!=bulk) {
+        std::this_thread::yield();
+        statistics = scheduler.get_statistics();
+      }
+    };
+    auto run = [&scheduler,&order](RequestPriority scheduled) {
+      scheduler.acquire(scheduled,UTIL::TimePoint::max());
+      order.push_back(scheduled);
+      scheduler.release();
+    };
+    std::thread bulk(run,RequestPriority::BULK);
+    wait_queued(0,1);
+    std::thread interactive(run,RequestPriority::INTERACTIVE);
+    wait_queued(1,1);
+    scheduler.release();
+    bulk.join();
+    interactive.join();
+    REQUIRE(order.size()==2);
+    REQUIRE(order[0]==RequestPriority::INTERACTIVE);
+    REQUIRE(order[1]==RequestPriority::BULK);
+    MatchSchedulerStatistics statistics = scheduler.get_statistics();
+    REQUIRE(statistics.running==0);
+    REQUIRE(statistics.rejected==1);
+    REQUIRE(statistics.expired==1);
+    REQUIRE(statistics.preempted==1);
+    scheduler.finish_request(RequestPriority::BULK);
+    REQUIRE(scheduler.admit_request(RequestPriority::BULK));
+    // The trajectories of a body are matched as the ones of a file
+    std::vector<Trajectory> parsed;
+    REQUIRE(FMMServer::parse_trajectories(
+        "7;LINESTRING(0 0,1 1)\r\n\nLINESTRING(1 1,2 2)\n",&parsed,&error));
+    REQUIRE(parsed.size()==2);
+    REQUIRE(parsed[0].id==7);
+    REQUIRE(parsed[1].id==1);
+    REQUIRE(parsed[1].geom.get_num_points()==2);
+    parsed.clear();
+    REQUIRE(!FMMServer::parse_trajectories("x;POINT",&parsed,&error));
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    MatchResult result = model.match_traj(trajectories[0],
+                                          FastMapMatchConfig{4,0.4,0.5});
+    std::string json;
+    FMMServer::append_result(result,-1,&json);
+    REQUIRE(json.compare(0,6,"{\"id\":")==0);
+    REQUIRE(json.find("\"cpath\":[")!=std::string::npos);
+  }
+  SECTION( "edge_closures_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    // A transition of the results passing an edge between its candidates
+    NodeIndex source = 0, target = 0;
+    EdgeIndex passed = 0;
+    bool found = false;
+    for (std::size_t t = 0; t < trajectories.size() && !found; ++t) {
+      MatchResult result = model.match_traj(trajectories[t],config);
+      for (std::size_t i = 0; i + 1 < result.indices.size() && !found; ++i) {
+        if (result.indices[i+1]-result.indices[i] < 2) continue;
+        source = result.opt_candidate_path[i].c.edge->target;
+        target = result.opt_candidate_path[i+1].c.edge->source;
+        passed = network.get_edge_index(result.cpath[result.indices[i]+1]);
+        found = true;
+      }
+    }
+    REQUIRE(found);
+    double open_cost = 0;
+    REQUIRE(ubodt->look_up_cost(source,target,&open_cost));
+    std::vector<EdgeIndex> open_path = ubodt->look_sp_path(source,target);
+    REQUIRE(std::find(open_path.begin(),open_path.end(),passed)!=
+            open_path.end());
+    std::shared_ptr<EdgeClosures> closures =
+        std::make_shared<EdgeClosures>(graph);
+    ubodt->set_closures(closures);
+    REQUIRE(!ubodt->has_closures());
+    REQUIRE(closures->search(source,target,ubodt->get_delta(),nullptr)==
+            Approx(open_cost));
+    closures->set_closed({passed});
+    REQUIRE(ubodt->has_closures());
+    REQUIRE(closures->get_closed()==std::vector<EdgeIndex>{passed});
+    // The pair is either routed around the edge or missing
+    double cost = 0;
+    std::vector<EdgeIndex> path = ubodt->look_sp_path(source,target);
+    REQUIRE(std::find(path.begin(),path.end(),passed)==path.end());
+    if (ubodt->look_up_cost(source,target,&cost)) {
+      REQUIRE(cost>=open_cost);
+      REQUIRE(!path.empty());
+    } else {
+      REQUIRE(path.empty());
+    }
+    std::vector<double> costs;
+    ubodt->look_up_pairs({source},{target},&costs);
+    REQUIRE((costs[0]<0 || costs[0]==Approx(cost)));
+    REQUIRE(closures->get_searches()>0);
+    closures->set_closed({});
+    REQUIRE(!ubodt->has_closures());
+    REQUIRE(ubodt->look_up_cost(source,target,&cost));
+    REQUIRE(cost==open_cost);
+    REQUIRE(ubodt->look_sp_path(source,target)==open_path);
+  }
+  SECTION( "fmm_server_reload_test" ) {
+    const char *args[] = {"fmm_server", "--network", "../data/network.gpkg",
+                          "--ubodt", "../data/ubodt.txt"};
+    FMMServerConfig server_config(5, (char **) args);
+    FMMServer server(server_config);
+    std::shared_ptr<const FMMServerGeneration> first =
+        server.get_generation();
+    REQUIRE(first->version==1);
+    REQUIRE(server.reload());
+    // The previous generation stays valid while it is held
+    REQUIRE(server.get_generation()->version==2);
+    REQUIRE(first->graph.get_num_vertices()==
+            server.get_generation()->graph.get_num_vertices());
+    IO::HttpRequest request;
+    request.method = "GET";
+    request.path = "/health";
+    REQUIRE(server.handle(request).body.find("\"generation\":2")!=
+            std::string::npos);
+    // Without an admin token, the server cannot be changed
+    request.method = "POST";
+    request.path = "/reload";
+    REQUIRE(server.handle(request).status==403);
+  }
+  SECTION( "network_tiles_test" ) {
+    int z, x, y;
+    REQUIRE(FMMServer::parse_tile_path("/tiles/3/2/1.mvt",&z,&x,&y));
+    REQUIRE((z==3 && x==2 && y==1));
+    REQUIRE(FMMServer::parse_tile_path("/tiles/0/0/0.pbf",&z,&x,&y));
+    REQUIRE(!FMMServer::parse_tile_path("/tiles/0/0/0.png",&z,&x,&y));
+    REQUIRE(!FMMServer::parse_tile_path("/tiles/0/0",&z,&x,&y));
+    REQUIRE(!NetworkTiles::is_valid_tile(1,2,0));
+    // The whole network is in the tile of zoom 0
+    NetworkTiles tiles(network);
+    std::string tile;
+    REQUIRE(!tiles.get_tile(1,0,2,&tile));
+    REQUIRE(tiles.get_tile(0,0,0,&tile));
+    REQUIRE(!tile.empty());
+    // Tile.layers, then Layer.version 2 and Layer.name edges
+    REQUIRE(tile[0]==0x1A);
+    REQUIRE(tile.find(std::string("\x78\x02\x0A\x05" "edges"))!=
+            std::string::npos);
+    REQUIRE(tile==tiles.encode_tile(0,0,0));
+    std::string cached;
+    REQUIRE(tiles.get_tile(0,0,0,&cached));
+    REQUIRE(cached==tile);
+    NetworkTileStatistics statistics = tiles.get_statistics();
+    REQUIRE(statistics.hits==1);
+    REQUIRE(statistics.misses==1);
+    REQUIRE(statistics.bytes==(long) tile.size());
+    // A tile far from the network has no layer
+    REQUIRE(tiles.encode_tile(4,15,15).empty());
+  }
+  SECTION( "metrics_test" ) {
+    UTIL::MetricsText text;
+    text.family("fmm_queue_depth","gauge","Chunks queued");
+    text.sample("fmm_queue_depth",3,"queue=\"input\"");
+    text.counter("fmm_points_total","Points",42);
+    REQUIRE(text.str()==
+        "# HELP fmm_queue_depth Chunks queued\n"
+        "# TYPE fmm_queue_depth gauge\n"
+        "fmm_queue_depth{queue=\"input\"} 3\n"
+        "# HELP fmm_points_total Points\n"
+        "# TYPE fmm_points_total counter\n"
+        "fmm_points_total 42\n");
+    REQUIRE(UTIL::get_resident_memory()>0);
+    // The file is written with the collectors once the exporter stops
+    MatchPipelineProgress progress;
+    progress.trajectories = 5;
+    progress.total_points = 50;
+    {
+      UTIL::MetricsExporter exporter("metrics_test.prom",3600);
+      exporter.add_collector([&progress](UTIL::MetricsText *metrics) {
+        append_pipeline_metrics(&progress,metrics);
+      });
+      exporter.start();
+    }
+    std::ifstream ifs("metrics_test.prom");
+    std::string line;
+    std::vector<std::string> lines;
+    while (std::getline(ifs,line)) lines.push_back(line);
+    REQUIRE(std::find(lines.begin(),lines.end(),"fmm_trajectories_total 5")!=
+        lines.end());
+    REQUIRE(std::find(lines.begin(),lines.end(),"fmm_points_total 50")!=
+        lines.end());
+    std::remove("metrics_test.prom");
+  }
+  SECTION( "memory_report_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    UTIL::MemoryReport report;
+    network.get_memory_usage(&report);
+    graph.get_memory_usage(&report);
+    ubodt->get_memory_usage(&report);
+    REQUIRE(report.get_total("network")>=
+            network.get_edge_count()*sizeof(Edge));
+    REQUIRE(report.get_total("graph")>0);
+    // Each record of the chained table is allocated in a slab
+    REQUIRE(report.get_total("ubodt")>=
+            ubodt->get_num_rows()*sizeof(Record));
+    REQUIRE(report.get_total()==report.get_total("network")+
+            report.get_total("graph")+report.get_total("ubodt"));
+    // A routing workspace is counted once it grows
+    long workspaces =
+        UTIL::get_workspace_totals(UTIL::ROUTING_WORKSPACE).count;
+    {
+      SearchWorkspace workspace;
+      graph.single_source_upperbound_dijkstra(0,1e9,&workspace);
+      REQUIRE(UTIL::get_workspace_totals(UTIL::ROUTING_WORKSPACE).count==
+              workspaces+1);
+      REQUIRE(UTIL::get_workspace_totals(UTIL::ROUTING_WORKSPACE).bytes>=
+              (long long) (graph.get_num_vertices()*sizeof(double)));
+    }
+    REQUIRE(UTIL::get_workspace_totals(UTIL::ROUTING_WORKSPACE).count==
+            workspaces);
+    UTIL::MetricsText text;
+    UTIL::append_memory_metrics(report,&text);
+    REQUIRE(text.str().find(
+        "fmm_structure_memory_bytes{structure=\"network\",part=\"edges\"}")!=
+            std::string::npos);
+  }
+  SECTION( "stream_matching_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    const LineString &geom = trajectories[0].geom;
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    // Without a lag expiring, the points finalized on convergence give
+    // the optimal path of the whole trajectory
+    FastMapMatchStream stream(model,config,geom.get_num_points());
+    StreamMatchResult result;
+    for (int i = 0; i < geom.get_num_points(); ++i) {
+      REQUIRE(stream.push_point(geom.get_x(i),geom.get_y(i)));
+      REQUIRE(stream.get_num_pending()<=geom.get_num_points());
+      StreamMatchResult polled = stream.poll();
+      result.opath.insert(result.opath.end(),
+                          polled.opath.begin(),polled.opath.end());
+      result.cpath.insert(result.cpath.end(),
+                          polled.cpath.begin(),polled.cpath.end());
+    }
+    stream.flush();
+    REQUIRE(stream.get_num_pending()==0);
+    StreamMatchResult polled = stream.poll();
+    result.opath.insert(result.opath.end(),
+                        polled.opath.begin(),polled.opath.end());
+    result.cpath.insert(result.cpath.end(),
+                        polled.cpath.begin(),polled.cpath.end());
+    REQUIRE(result.opath==expected.opath);
+    REQUIRE(result.cpath==expected.cpath);
+    // A lag of one point keeps at most one pending point
+    FastMapMatchStream greedy(model,config,1);
+    for (int i = 0; i < geom.get_num_points(); ++i) {
+      greedy.push_point(geom.get_x(i),geom.get_y(i));
+      REQUIRE(greedy.get_num_pending()<=1);
+    }
+    greedy.flush();
+    result = greedy.poll();
+    REQUIRE(result.opath.size()==geom.get_num_points());
+    REQUIRE(result.points.back()==geom.get_num_points()-1);
+    REQUIRE(result.indices.size()==result.opath.size());
+    REQUIRE(result.indices.back()==result.cpath.size()-1);
+  }
+  SECTION( "trajectory_split_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    config.split = true;
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    REQUIRE(!expected.cpath.empty());
+    // A trajectory without break is matched in one segment
+    std::vector<SegmentMatchResult> segments =
+        model.match_traj_segments(trajectories[0],config);
+    int N = trajectories[0].geom.get_num_points();
+    REQUIRE(segments.size()==1);
+    REQUIRE(segments[0].first==0);
+    REQUIRE(segments[0].last==N-1);
+    REQUIRE(segments[0].result.cpath==expected.cpath);
+    // A point far from the network is left out, splitting the trajectory
+    Trajectory traj{trajectories[0].id,trajectories[0].geom,{}};
+    traj.geom.add_point(1000,1000);
+    for (int i = 0; i < N; ++i) {
+      traj.geom.add_point(trajectories[0].geom.get_point(i));
+    }
+    REQUIRE(model.match_traj(traj,config).cpath.empty());
+    segments = model.match_traj_segments(traj,config);
+    REQUIRE(segments.size()==2);
+    REQUIRE(segments[0].last==N-1);
+    REQUIRE(segments[1].first==N+1);
+    REQUIRE(segments[1].last==2*N);
+    for (const SegmentMatchResult &segment : segments) {
+      REQUIRE(segment.result.id==traj.id);
+      REQUIRE(segment.result.opath==expected.opath);
+      REQUIRE(segment.result.cpath==expected.cpath);
+    }
+    // A time gap splits the trajectory before matching
+    traj = trajectories[0];
+    for (int i = 0; i < N; ++i) {
+      traj.timestamps.push_back(i < 2 ? i : i + 100);
+    }
+    config.max_time_gap = 10;
+    segments = model.match_traj_segments(traj,config);
+    REQUIRE(segments.size()==2);
+    REQUIRE(segments[0].last==1);
+    REQUIRE(segments[1].first==2);
+  }
+  SECTION( "match_budget_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    REQUIRE(!expected.partial);
+    int N = trajectories[0].geom.get_num_points();
+    REQUIRE(N > 2);
+    // A budget not reached leaves the result unchanged
+    config.max_transitions = 1000000;
+    MatchResult result = model.match_traj(trajectories[0],config);
+    REQUIRE(!result.partial);
+    REQUIRE(result.cpath==expected.cpath);
+    // The budget runs out after the first pair of points
+    config.max_transitions = 1;
+    for (int parallel_viterbi : {0, 1}) {
+      config.parallel_viterbi = parallel_viterbi;
+      result = model.match_traj(trajectories[0],config);
+      REQUIRE(result.partial);
+      REQUIRE(result.opath.size()==2);
+      REQUIRE(result.indices.size()==2);
+    }
+    CONFIG::OutputConfig output_config;
+    output_config.write_partial = true;
+    {
+      CSVMatchResultWriter writer("budget_test.csv",output_config);
+      writer.write_result(result);
+    }
+    std::ifstream file("budget_test.csv");
+    std::string header, line;
+    std::getline(file,header);
+    std::getline(file,line);
+    REQUIRE(header.substr(header.size()-8)==";partial");
+    REQUIRE(line.substr(line.size()-2)==";1");
+    std::remove("budget_test.csv");
+  }
+  SECTION( "device_ubodt_test" ) {
+    auto chained = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    std::unique_ptr<DeviceUBODT> device = DeviceUBODT::create(*chained,false);
+    REQUIRE(device!=nullptr);
+    REQUIRE(!device->on_device());
+    std::vector<NodeIndex> sources, targets;
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        sources.push_back(s);
+        targets.push_back(t);
+      }
+    }
+    std::vector<double> costs;
+    REQUIRE(device->look_up_pairs(sources,targets,&costs));
+    for (std::size_t i = 0; i < costs.size(); ++i) {
+      Record *r = chained->look_up(sources[i],targets[i]);
+      REQUIRE(costs[i]==(r==nullptr ? -1 : r->cost));
+    }
+    auto lazy = UBODT::create_lazy_ubodt(graph,chained->get_delta());
+    REQUIRE(DeviceUBODT::create(*lazy,false)==nullptr);
+    // The batch scored by the table matches as match_traj
+    FastMapMatch model(network,graph,chained);
+    FastMapMatchConfig config{4,0.4,0.5};
+    std::vector<MatchResult> results =
+        model.match_batch(trajectories,config,*device);
+    REQUIRE(results.size()==trajectories.size());
+    for (std::size_t i = 0; i < trajectories.size(); ++i) {
+      MatchResult expected = model.match_traj(trajectories[i],config);
+      REQUIRE(results[i].id==expected.id);
+      REQUIRE_THAT(results[i].cpath,Catch::Equals<int>(expected.cpath));
+      REQUIRE_THAT(results[i].indices,Catch::Equals<int>(expected.indices));
+      REQUIRE(results[i].mgeom==expected.mgeom);
+    }
+  }
+  SECTION( "ubodt_profile_test" ) {
+    UBODTProfile profile(network,graph,12);
+    FastMapMatchConfig config{4,0.4,0.5};
+    for (const Trajectory &trajectory : trajectories) {
+      profile.add_trajectory(trajectory,config);
+    }
+    profile.sample_sources(multiplier);
+    REQUIRE(profile.get_num_transitions()>0);
+    REQUIRE(profile.get_num_requests()>=profile.get_num_transitions());
+    double last_coverage = 0;
+    for (double delta : profile.get_profile_deltas()) {
+      double coverage = profile.get_transition_coverage(delta);
+      REQUIRE(coverage>=last_coverage);
+      last_coverage = coverage;
+    }
+    REQUIRE(profile.get_transition_coverage(12)==1);
+    double delta = profile.find_delta(0.9);
+    REQUIRE(delta>0);
+    REQUIRE(profile.get_transition_coverage(delta)>=0.9);
+    // All sources sampled, so the rows estimated are the rows generated
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(profile.estimate_rows(3)==ubodt->get_num_rows());
+    REQUIRE(UBODTProfile::estimate_memory(ubodt->get_num_rows(),COMPACT)<
+        UBODTProfile::estimate_memory(ubodt->get_num_rows(),FLAT));
+  }
+  SECTION( "ubodt_symmetric_test" ) {
+    const std::vector<Edge> &edges = network.get_edges();
+    for (const Edge &edge : edges) {
+      int e = graph.get_shortest_edge_index(edge.source,edge.target);
+      REQUIRE(e>=0);
+      REQUIRE(edges[e].length<=edge.length);
+    }
+    // The sample network has one way edges, whose paths differ by
+    // direction, so that the rows can not be stored once for each pair
+    REQUIRE(!graph.is_symmetric());
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(!ubodt->set_symmetric(graph));
+    REQUIRE(!ubodt->is_symmetric());
+    double cost;
+    REQUIRE(ubodt->look_up_cost(3,1,&cost));
+    REQUIRE(!ubodt->look_up_cost(1,3,&cost));
+    // A network of two way roads, whose shortest paths are unique
+    {
+      std::ofstream ofs("ubodt_symmetric_test.geojson");
+      std::vector<std::vector<double>> nodes{
+          {0,0},{1,0},{3,0},{1,1},{3,2}};
+      std::vector<std::pair<int,int>> roads{
+          {1,2},{2,3},{2,4},{3,5},{4,5}};
+      ofs << "{\"type\":\"FeatureCollection\",\"features\":[";
+      int id = 0;
+      for (const auto &road : roads) {
+        for (int d = 0; d < 2; ++d) {
+          int s = d == 0 ? road.first : road.second;
+          int t = d == 0 ? road.second : road.first;
+          ofs << (id > 0 ? "," : "") << "{\"type\":\"Feature\","
+              << "\"properties\":{\"id\":" << ++id << ",\"source\":" << s
+              << ",\"target\":" << t << "},\"geometry\":{\"type\":"
+              << "\"LineString\",\"coordinates\":[[" << nodes[s-1][0] << ","
+              << nodes[s-1][1] << "],[" << nodes[t-1][0] << ","
+              << nodes[t-1][1] << "]]}}";
+        }
+      }
+      ofs << "]}";
+    }
+    Network roads("ubodt_symmetric_test.geojson");
+    NetworkGraph roads_graph(roads);
+    REQUIRE(roads_graph.is_symmetric());
+    auto full = UBODT::generate_ubodt(roads_graph,100,CHAINED);
+    for (UBODTLayout layout : {CHAINED, FLAT, CSR}) {
+      auto symmetric = UBODT::generate_ubodt(roads_graph,100,layout,true);
+      REQUIRE(symmetric->set_symmetric(roads_graph));
+      REQUIRE(symmetric->get_num_rows()<full->get_num_rows());
+      const std::vector<Edge> &road_edges = roads.get_edges();
+      NodeIndex n = roads.get_node_count();
+      for (NodeIndex s = 0; s < n; ++s) {
+        for (NodeIndex t = 0; t < n; ++t) {
+          if (s == t) continue;
+          // The record of a pair stored from its target describes the
+          // path from its source
+          Record *expected = full->look_up(s,t);
+          Record *r = symmetric->look_up(s,t);
+          REQUIRE(r!=nullptr);
+          REQUIRE(r->source==s);
+          REQUIRE(r->target==t);
+          REQUIRE(r->first_n==expected->first_n);
+          REQUIRE(r->prev_n==expected->prev_n);
+          REQUIRE(r->next_e==expected->next_e);
+          REQUIRE(r->cost==Approx(expected->cost));
+          // The path walked through the records is the one of the table
+          std::vector<EdgeIndex> path;
+          for (NodeIndex v = s; v != t;) {
+            Record *step = symmetric->look_up(v,t);
+            REQUIRE(step!=nullptr);
+            REQUIRE(road_edges[step->next_e].source==v);
+            path.push_back(step->next_e);
+            v = step->first_n;
+          }
+          REQUIRE(path==full->look_sp_path(s,t));
+          REQUIRE(path==symmetric->look_sp_path(s,t));
+        }
+      }
+    }
+    std::remove("ubodt_symmetric_test.geojson");
+  }
+  SECTION( "ubodt_demand_test" ) {
+    // The first trajectory is the sample of the traffic
+    {
+      std::ifstream trips("../data/trips.csv");
+      std::ofstream sample("ubodt_demand_trips.csv");
+      std::string line;
+      for (int i = 0; i < 2 && std::getline(trips,line); ++i) {
+        sample << line << "\n";
+      }
+    }
+    std::vector<std::string> args{
+        "ubodt_gen","--network","../data/network.gpkg","--no_network_cache",
+        "--delta","3","--gps","ubodt_demand_trips.csv","--demand_radius","0",
+        "-k","4","-r","0.4","-o","ubodt_demand_test.mmap"};
+    std::vector<char *> argv;
+    for (std::string &arg : args) argv.push_back(&arg[0]);
+    UBODTGenAppConfig config(argv.size(),argv.data());
+    REQUIRE(config.is_demand());
+    REQUIRE(!config.is_profile());
+    REQUIRE(config.validate());
+    UBODTGenApp app(config);
+    app.run();
+    auto demand = UBODT::read_ubodt_file("ubodt_demand_test.mmap");
+    REQUIRE(demand!=nullptr);
+    auto full = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(demand->get_num_rows()>0);
+    REQUIRE(demand->get_num_rows()<=full->get_num_rows());
+    const std::vector<Edge> &edges = network.get_edges();
+    demand->for_each_record([&](const Record &r) {
+      Record *expected = full->look_up(r.source,r.target);
+      REQUIRE(expected!=nullptr);
+      REQUIRE(r.cost==Approx(expected->cost));
+      // The paths are walked through the rows of the nodes not routed
+      double length = 0;
+      for (EdgeIndex e : demand->look_sp_path(r.source,r.target)) {
+        length += edges[e].length;
+      }
+      REQUIRE(length==Approx(r.cost));
+    });
+    // The candidates of the sample are routed
+    Traj_Candidates tr_cs = network.search_tr_cs_knn(
+        trajectories[0].geom,4,0.4);
+    for (const Candidate &c : tr_cs[0]) {
+      NodeIndex u = c.edge->target;
+      full->for_each_record([&](const Record &r) {
+        if (r.source==u) REQUIRE(demand->look_up(u,r.target)!=nullptr);
+      });
+    }
+    std::remove("ubodt_demand_trips.csv");
+    std::remove("ubodt_demand_test.mmap");
+  }
+  SECTION( "ubodt_chains_test" ) {
+    ChainGraph chains(network);
+    REQUIRE(chains.get_num_junctions()<=chains.get_num_vertices());
+    // Every edge belongs to exactly one chain
+    const std::vector<Edge> &edges = network.get_edges();
+    std::vector<int> chain_edges(edges.size(),0);
+    for (unsigned int c = 0; c < chains.get_num_chains(); ++c) {
+      std::vector<EdgeIndex> path;
+      chains.append_edges(c,0,-1,&path);
+      for (EdgeIndex e : path) ++chain_edges[e];
+    }
+    for (int count : chain_edges) REQUIRE(count==1);
+    std::vector<std::string> args{
+        "ubodt_gen","--network","../data/network.gpkg","--no_network_cache",
+        "--delta","100","--compress_chains","-o","ubodt_chains_test.mmap"};
+    std::vector<char *> argv;
+    for (std::string &arg : args) argv.push_back(&arg[0]);
+    UBODTGenAppConfig config(argv.size(),argv.data());
+    REQUIRE(config.compress_chains);
+    REQUIRE(config.validate());
+    UBODTGenApp app(config);
+    app.run();
+    auto compressed = UBODT::read_ubodt_file("ubodt_chains_test.mmap");
+    REQUIRE(compressed!=nullptr);
+    REQUIRE(compressed->set_chains(std::make_shared<ChainGraph>(network)));
+    REQUIRE(compressed->has_chains());
+    // The paths from and to the nodes inside chains are the ones of the
+    // network
+    for (NodeIndex s = 0; s < multiplier; ++s) {
+      for (NodeIndex t = 0; t < multiplier; ++t) {
+        std::vector<EdgeIndex> expected = graph.shortest_path_dijkstra(s,t);
+        double dist = 0;
+        for (EdgeIndex e : expected) dist += edges[e].length;
+        double cost;
+        if (expected.empty()) {
+          REQUIRE(!compressed->look_up_cost(s,t,&cost));
+          continue;
+        }
+        REQUIRE(compressed->look_up_cost(s,t,&cost));
+        REQUIRE(cost==Approx(dist));
+        double length = 0;
+        NodeIndex u = s;
+        for (EdgeIndex e : compressed->look_sp_path(s,t)) {
+          REQUIRE(edges[e].source==u);
+          u = edges[e].target;
+          length += edges[e].length;
+        }
+        REQUIRE(u==t);
+        REQUIRE(length==Approx(dist));
+      }
+    }
+    std::remove("ubodt_chains_test.mmap");
+  }
+  SECTION( "ubodt_clip_test" ) {
+    NetworkClip clip;
+    clip.region = "0,0,2.5,5";
+    clip.margin = 0.1;
+    Network clipped("../data/network.gpkg","id","source","target",false,
+                    SpatialIndexOptions(),false,false,clip);
+    // The rows of the UBODT of the whole network are translated by ids
+    auto full = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    REQUIRE(UBODT::write_network_ids("ubodt_clip_test.txt",network));
+    std::string ids_file = UBODT::get_network_ids_file("ubodt_clip_test.txt");
+    auto table = full->clip_to_network(ids_file,clipped,CHAINED);
+    REQUIRE(table!=nullptr);
+    REQUIRE(table->get_num_rows()>0);
+    REQUIRE(table->get_num_rows()<=full->get_num_rows());
+    const std::vector<Edge> &edges = clipped.get_edges();
+    table->for_each_record([&](const Record &r) {
+      Record *expected = full->look_up(
+          network.get_node_index(clipped.get_node_id(r.source)),
+          network.get_node_index(clipped.get_node_id(r.target)));
+      REQUIRE(expected!=nullptr);
+      REQUIRE(r.cost==Approx(expected->cost));
+      double length = 0;
+      NodeIndex u = r.source;
+      for (EdgeIndex e : table->look_sp_path(r.source,r.target)) {
+        REQUIRE(edges[e].source==u);
+        u = edges[e].target;
+        length += edges[e].length;
+      }
+      REQUIRE(u==r.target);
+      REQUIRE(length==Approx(r.cost));
+    });
+    // Only the rows of the nodes clipped are read, which clip to the
+    // same table
+    std::vector<char> nodes;
+    REQUIRE(UBODT::read_clipped_nodes(ids_file,clipped,&nodes));
+    REQUIRE(nodes.size()==network.get_node_count());
+    auto serial = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier,
+                                        CHAINED,&nodes);
+    auto parallel = UBODT::read_ubodt_csv_parallel(
+        "../data/ubodt.txt",multiplier,CHAINED,&nodes);
+    REQUIRE(serial->get_num_rows()<full->get_num_rows());
+    REQUIRE(parallel->get_num_rows()==serial->get_num_rows());
+    serial->for_each_record([&](const Record &r) {
+      REQUIRE(nodes[r.source]);
+      REQUIRE(nodes[r.target]);
+    });
+    for (auto read : {serial, parallel}) {
+      auto read_clip = read->clip_to_network(ids_file,clipped,CHAINED);
+      REQUIRE(read_clip->get_num_rows()==table->get_num_rows());
+    }
+    std::remove(ids_file.c_str());
+  }
+  SECTION( "distance_matrix_test" ) {
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    auto full = UBODT::create_lazy_ubodt(graph,1e9);
+    const LineString &geom = trajectories[0].geom;
+    std::vector<Point> points;
+    for (int i = 0; i < geom.get_num_points(); ++i) {
+      points.push_back(geom.get_point(i));
+    }
+    points.push_back(Point(1e6,1e6));
+    DistanceMatrix matrix(network,graph,ubodt);
+    std::vector<Candidate> candidates = matrix.snap_points(points,0.5,true);
+    REQUIRE(candidates.back().edge==nullptr);
+    long n = candidates.size();
+    DistanceMatrixStatistics statistics;
+    // The pairs missing in UBODT are searched without a bound
+    std::vector<double> distances =
+        matrix.compute(candidates,candidates,0,true,&statistics);
+    REQUIRE(distances.size()==n*n);
+    REQUIRE(statistics.ubodt_pairs+statistics.searched_pairs<=
+        statistics.node_pairs);
+    std::vector<double> covered =
+        matrix.compute(candidates,candidates,ubodt->get_delta(),false);
+    DistanceMatrix expected_matrix(network,graph,full);
+    std::vector<double> expected =
+        expected_matrix.compute(candidates,candidates,0,false);
+    for (long i = 0; i < n; ++i) {
+      for (long j = 0; j < n; ++j) {
+        double d = distances[i*n+j];
+        if (i==n-1 || j==n-1) {
+          REQUIRE(d==-1);
+          continue;
+        }
+        if (i==j) REQUIRE(d==0);
+        REQUIRE(d==Approx(expected[i*n+j]));
+        REQUIRE((covered[i*n+j]<0 || covered[i*n+j]==Approx(d)));
+      }
+    }
+    REQUIRE(DistanceMatrix::write_matrix("od_matrix_test.bin",n,n,
+                                         distances));
+    long rows, columns;
+    std::vector<double> read;
+    REQUIRE(DistanceMatrix::read_matrix("od_matrix_test.bin",&rows,
+                                        &columns,&read));
+    REQUIRE(rows==n);
+    REQUIRE(columns==n);
+    REQUIRE(read==distances);
+    std::remove("od_matrix_test.bin");
+    // Points at the nodes are snapped to them
+    std::vector<Point> node_points(network.get_vertex_points());
+    node_points.push_back(Point(1e6,1e6));
+    std::vector<int> nodes = matrix.snap_nodes(node_points,0.5,true);
+    long k = nodes.size();
+    REQUIRE(nodes.back()==-1);
+    std::vector<double> node_distances =
+        matrix.compute_nodes(nodes,nodes,0,true);
+    for (long i = 0; i + 1 < k; ++i) {
+      REQUIRE(nodes[i]==i);
+      REQUIRE(node_distances[i*k+i]==0);
+      REQUIRE(node_distances[i*k+k-1]==-1);
+      for (long j = 0; j + 1 < k; ++j) {
+        if (i==j) continue;
+        double expected_cost = -1;
+        full->look_up_cost(i,j,&expected_cost);
+        REQUIRE(node_distances[i*k+j]==Approx(expected_cost));
+      }
+    }
+  }
+  SECTION( "wkt_parser_test" ) {
+    std::string wkt = " linestring ( 1.5 -2 , 3e2 4.25 ) ";
+    LineString line;
+    REQUIRE(parse_wkt_linestring(wkt.data(),wkt.data()+wkt.size(),&line));
+    REQUIRE(line.get_num_points()==2);
+    REQUIRE(line.get_x(0)==1.5);
+    REQUIRE(line.get_x(1)==300);
+    REQUIRE(line.get_y(1)==4.25);
+    wkt = "LINESTRING EMPTY";
+    REQUIRE(parse_wkt_linestring(wkt.data(),wkt.data()+wkt.size(),&line));
+    REQUIRE(line.get_num_points()==0);
+    wkt = "LINESTRING(1 2";
+    REQUIRE(!parse_wkt_linestring(wkt.data(),wkt.data()+wkt.size(),&line));
+    // Z values are left to boost
+    wkt = "LINESTRING Z(1 2 3,4 5 6)";
+    REQUIRE(!parse_wkt_linestring(wkt.data(),wkt.data()+wkt.size(),&line));
+    std::string hex = "010200000002000000"
+        "00000000000000000000000000000000"
+        "000000000000F03F000000000000F03F";
+    REQUIRE(parse_hex_wkb_linestring(hex.data(),hex.data()+hex.size(),&line));
+    REQUIRE(line.get_num_points()==2);
+    REQUIRE(line.get_x(1)==1);
+    REQUIRE(line.get_y(1)==1);
+    REQUIRE(!parse_hex_wkb_linestring(hex.data(),hex.data()+hex.size()-2,
+                                      &line));
+    REQUIRE(wkt2linestring("LINESTRING(0 0,1 1)").get_num_points()==2);
+  }
+  SECTION( "coordinator_test" ) {
+    HttpUrl url;
+    REQUIRE(HttpUrl::parse("http://node1:8081/fmm/",&url));
+    REQUIRE(url.host=="node1");
+    REQUIRE(url.port==8081);
+    REQUIRE(url.prefix=="/fmm");
+    REQUIRE(HttpUrl::parse("http://node1",&url));
+    REQUIRE(url.port==80);
+    REQUIRE(url.prefix.empty());
+    REQUIRE(!HttpUrl::parse("https://node1",&url));
+    REQUIRE(!HttpUrl::parse("http://node1:port",&url));
+    HttpResponse response;
+    REQUIRE(parse_http_response(
+        "HTTP/1.1 400 Bad Request\r\nContent-Length: 4\r\n\r\nbody",
+        &response));
+    REQUIRE(response.status==400);
+    REQUIRE(response.body=="body");
+    REQUIRE(!parse_http_response(
+        "HTTP/1.1 200 OK\r\nContent-Length: 9\r\n\r\nbody",&response));
+    // Results written by fmm_server are read back
+    MatchResult first{3, {}, {1,3}, {1,2,3}, {0,2},
+                      wkt2linestring("LINESTRING(0 0,1 1)"), false};
+    MatchResult second{4, {}, {3,5}, {3,4,5}, {0,2},
+                       wkt2linestring("LINESTRING(1 1,2 2)"), true};
+    std::string body = "{\"results\":[";
+    FMMServer::append_result(first,-1,&body);
+    body += ",";
+    FMMServer::append_result(second,-1,&body);
+    body += "]}";
+    std::vector<MatchResult> results;
+    REQUIRE(FMMCoordinator::parse_results(body,&results));
+    REQUIRE(results.size()==2);
+    REQUIRE(results[0].id==3);
+    REQUIRE(results[0].cpath==first.cpath);
+    REQUIRE(results[0].opath==first.opath);
+    REQUIRE(results[0].indices==first.indices);
+    REQUIRE(results[0].mgeom==first.mgeom);
+    REQUIRE(!results[0].partial);
+    REQUIRE(results[1].partial);
+    // The point shared by the spans is matched by the second one, whose
+    // first edge continues the first complete path
+    results[1].partial = false;
+    std::vector<RegionSpan> spans{{0,0,1},{1,1,2}};
+    MatchResult stitched = FMMCoordinator::stitch_results(7,spans,results);
+    REQUIRE(stitched.id==7);
+    REQUIRE(stitched.opath==O_Path{1,3,5});
+    REQUIRE(stitched.cpath==C_Path{1,2,3,4,5});
+    REQUIRE(stitched.indices==std::vector<int>{0,2,4});
+    REQUIRE(stitched.mgeom==wkt2linestring("LINESTRING(0 0,1 1,2 2)"));
+    REQUIRE(!stitched.partial);
+    results[1].cpath.clear();
+    REQUIRE(FMMCoordinator::stitch_results(7,spans,results).cpath.empty());
+  }
+  SECTION( "capi_test" ) {
+    fmm_network *cnetwork = nullptr;
+    REQUIRE(fmm_network_load("missing.gpkg",nullptr,nullptr,nullptr,
+                             &cnetwork)==FMM_ERROR);
+    REQUIRE(std::string(fmm_last_error()).size()>0);
+    REQUIRE(fmm_network_load("../data/network.gpkg",nullptr,nullptr,nullptr,
+                             &cnetwork)==FMM_OK);
+    REQUIRE(fmm_network_edge_count(cnetwork)==network.get_edge_count());
+    fmm_ubodt *cubodt = nullptr;
+    REQUIRE(fmm_ubodt_load("../data/ubodt.txt",&cubodt)==FMM_OK);
+    fmm_model *cmodel = nullptr;
+    REQUIRE(fmm_model_create_fmm(cnetwork,cubodt,0,0.4,0.5,&cmodel)==
+            FMM_INVALID_ARGUMENT);
+    REQUIRE(fmm_model_create_fmm(cnetwork,cubodt,4,0.4,0.5,&cmodel)==
+            FMM_OK);
+    auto ubodt = UBODT::read_ubodt_csv("../data/ubodt.txt",multiplier);
+    FastMapMatch model(network,graph,ubodt);
+    FastMapMatchConfig config{4,0.4,0.5};
+    const LineString &geom = trajectories[0].geom;
+    int N = geom.get_num_points();
+    std::vector<double> coords;
+    for (int i = 0; i < N; ++i) {
+      coords.push_back(geom.get_x(i));
+      coords.push_back(geom.get_y(i));
+    }
+    MatchResult expected = model.match_traj(trajectories[0],config);
+    REQUIRE(!expected.cpath.empty());
+    // The sizes are returned when the buffers are too small
+    std::vector<int> opath(N), cpath;
+    std::vector<double> mgeom;
+    fmm_result result{};
+    result.opath = opath.data();
+    result.cpath = cpath.data();
+    result.mgeom = mgeom.data();
+    REQUIRE(fmm_match(cmodel,coords.data(),nullptr,N,&result)==
+            FMM_BUFFER_TOO_SMALL);
+    REQUIRE(result.cpath_size==expected.cpath.size());
+    REQUIRE(result.mgeom_size==expected.mgeom.get_num_points());
+    cpath.resize(result.cpath_size);
+    mgeom.resize(2 * result.mgeom_size);
+    result.cpath = cpath.data();
+    result.cpath_capacity = cpath.size();
+    result.mgeom = mgeom.data();
+    result.mgeom_capacity = result.mgeom_size;
+    REQUIRE(fmm_match(cmodel,coords.data(),nullptr,N,&result)==FMM_OK);
+    REQUIRE(result.num_matched==expected.opath.size());
+    opath.resize(result.num_matched);
+    REQUIRE(opath==expected.opath);
+    REQUIRE(cpath==expected.cpath);
+    REQUIRE(mgeom[0]==expected.mgeom.get_x(0));
+    fmm_model_free(cmodel);
+    REQUIRE(fmm_model_create_stmatch(cnetwork,4,0.4,0.5,30,1.5,&cmodel)==
+            FMM_OK);
+    // Only the sizes of the fields skipped are returned
+    result = fmm_result{};
+    REQUIRE(fmm_match(cmodel,coords.data(),nullptr,N,&result)==FMM_OK);
+    REQUIRE(result.cpath_size>0);
+    fmm_model_free(cmodel);
+    fmm_ubodt_free(cubodt);
+    fmm_network_free(cnetwork);
+  }
 }
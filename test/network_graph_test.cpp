@@ -2,6 +2,12 @@
 #include "catch2/catch.hpp"
 #include "util/debug.hpp"
 #include "network/network_graph.hpp"
+#include "network/contraction_hierarchy.hpp"
+#include "network/landmarks.hpp"
+#include "network/path_cache.hpp"
+
+#include <cstdio>
+#include <limits>
 
 using namespace FMM;
 using namespace FMM::CORE;
@@ -28,6 +34,225 @@ TEST_CASE( "Network graph is tested", "[network_graph]" ) {
     REQUIRE(dmap.find(network.get_node_index(3))==dmap.end());
   }
 
+  SECTION( "single_source_upperbound_dijkstra_path_ends" ) {
+    NodeIndex source = network.get_node_index(2);
+    double delta = 5.1;
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    PathEndMap emap;
+    ng.single_source_upperbound_dijkstra(source,delta,&pmap,&dmap,&emap);
+    REQUIRE(emap.size()==pmap.size()-1);
+    REQUIRE(emap.find(source)==emap.end());
+    for (auto iter = emap.begin(); iter != emap.end(); ++iter) {
+      std::vector<EdgeIndex> path =
+          ng.back_track(source,iter->first,pmap,emap);
+      REQUIRE(iter->second.first_e==path.front());
+      REQUIRE(iter->second.last_e==path.back());
+      REQUIRE(iter->second.first_n==network.get_edges()[path.front()].target);
+      double length = 0;
+      for (EdgeIndex e : path) length += network.get_edges()[e].length;
+      REQUIRE(length==Approx(dmap.at(iter->first)));
+    }
+  }
+
+  SECTION( "search_workspace" ) {
+    NodeIndex source = network.get_node_index(2);
+    double delta = 5.1;
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    PathEndMap emap;
+    ng.single_source_upperbound_dijkstra(source,delta,&pmap,&dmap,&emap);
+    SearchWorkspace ws;
+    // Run twice to check that a reused workspace is reset
+    ng.single_source_upperbound_dijkstra(network.get_node_index(11),delta,&ws);
+    ng.single_source_upperbound_dijkstra(source,delta,&ws);
+    REQUIRE(ws.get_visited().size()==dmap.size());
+    REQUIRE(ws.get_visited().front()==source);
+    for (NodeIndex v : ws.get_visited()) {
+      REQUIRE(dmap.at(v)==ws.get_distance(v));
+      REQUIRE(pmap.at(v)==ws.get_predecessor(v));
+    }
+    REQUIRE(!ws.visited(network.get_node_index(3)));
+    std::vector<EdgeIndex> dijkstra = ng.shortest_path_dijkstra(
+      source,network.get_node_index(4));
+    std::vector<EdgeIndex> astar = ng.shortest_path_astar(
+      source,network.get_node_index(4));
+    REQUIRE(dijkstra==astar);
+    REQUIRE(dijkstra==ng.back_track(source,network.get_node_index(4),
+                                    pmap,emap));
+  }
+
+  SECTION( "contraction_hierarchy" ) {
+    double delta = 5.1;
+    ContractionHierarchy ch(network,delta);
+    for (NodeIndex s = 0; s < network.get_node_count(); ++s) {
+      PredecessorMap pmap, ch_pmap;
+      DistanceMap dmap, ch_dmap;
+      PathEndMap emap, ch_emap;
+      ng.single_source_upperbound_dijkstra(s,delta,&pmap,&dmap,&emap);
+      ch.single_source_upperbound(s,delta,&ch_pmap,&ch_dmap,&ch_emap);
+      REQUIRE(ch_dmap.size()==dmap.size());
+      REQUIRE(ch_emap.size()==emap.size());
+      for (auto iter = dmap.begin(); iter != dmap.end(); ++iter) {
+        REQUIRE(ch_dmap.at(iter->first)==Approx(iter->second));
+      }
+      // The ends should belong to a path of the same length
+      for (auto iter = ch_emap.begin(); iter != ch_emap.end(); ++iter) {
+        const Edge &first = network.get_edges()[iter->second.first_e];
+        const Edge &last = network.get_edges()[iter->second.last_e];
+        REQUIRE(first.source==s);
+        REQUIRE(first.target==iter->second.first_n);
+        REQUIRE(last.target==iter->first);
+        REQUIRE(last.source==ch_pmap.at(iter->first));
+      }
+    }
+  }
+
+  SECTION( "contraction_hierarchy_query" ) {
+    ContractionHierarchy ch(network,std::numeric_limits<double>::infinity(),
+                            false,false);
+    REQUIRE(!ch.has_buckets());
+    REQUIRE(ch.write_hierarchy_file("ch_test.bin"));
+    auto loaded = ContractionHierarchy::read_hierarchy_file(
+        "ch_test.bin",network);
+    REQUIRE(loaded!=nullptr);
+    REQUIRE(loaded->get_num_shortcuts()==ch.get_num_shortcuts());
+    std::remove("ch_test.bin");
+    int N = network.get_node_count();
+    std::vector<NodeIndex> targets;
+    for (NodeIndex t = 0; t < N; ++t) targets.push_back(t);
+    double delta = 4;
+    std::vector<std::vector<double>> matrix =
+        loaded->many_to_many(targets,targets,delta);
+    for (NodeIndex s = 0; s < N; ++s) {
+      PredecessorMap pmap;
+      DistanceMap dmap;
+      ng.single_source_upperbound_dijkstra(s,delta,&pmap,&dmap);
+      std::vector<double> row = loaded->one_to_many(s,targets,delta);
+      for (NodeIndex t = 0; t < N; ++t) {
+        REQUIRE(row[t]==matrix[s][t]);
+        auto iter = dmap.find(t);
+        if (iter == dmap.end()) {
+          REQUIRE(row[t]==std::numeric_limits<double>::max());
+        } else {
+          REQUIRE(row[t]==Approx(iter->second));
+        }
+        // The path unpacked should be a connected path of the distance
+        std::vector<EdgeIndex> dijkstra = ng.shortest_path_dijkstra(s,t);
+        std::vector<EdgeIndex> path;
+        double dist = loaded->shortest_path(s,t,&path);
+        if (s != t && dijkstra.empty()) {
+          REQUIRE(dist<0);
+          continue;
+        }
+        double length = 0;
+        NodeIndex u = s;
+        for (EdgeIndex e : path) {
+          const Edge &edge = network.get_edges()[e];
+          REQUIRE(edge.source==u);
+          u = edge.target;
+          length += edge.length;
+        }
+        REQUIRE(u==t);
+        double expected = 0;
+        for (EdgeIndex e : dijkstra) expected += network.get_edges()[e].length;
+        REQUIRE(dist==Approx(expected));
+        REQUIRE(length==Approx(expected));
+      }
+    }
+  }
+
+  SECTION( "landmarks" ) {
+    Landmarks landmarks(ng,4);
+    REQUIRE(landmarks.get_num_landmarks()==4);
+    int N = network.get_node_count();
+    double infinity = std::numeric_limits<double>::infinity();
+    bool tighter = false;
+    for (NodeIndex s = 0; s < N; ++s) {
+      PredecessorMap pmap;
+      DistanceMap dmap;
+      ng.single_source_upperbound_dijkstra(s,infinity,&pmap,&dmap);
+      for (auto iter = dmap.begin(); iter != dmap.end(); ++iter) {
+        double bound = landmarks.lower_bound(s,iter->first);
+        REQUIRE(bound<=iter->second);
+        if (bound > ng.calc_heuristic_dist(ng.get_vertex_point(s),
+                                           ng.get_vertex_point(iter->first)))
+          tighter = true;
+      }
+    }
+    REQUIRE(tighter);
+    ng.set_landmarks(&landmarks);
+    for (NodeIndex s = 0; s < N; ++s) {
+      for (NodeIndex t = 0; t < N; ++t) {
+        std::vector<EdgeIndex> dijkstra = ng.shortest_path_dijkstra(s,t);
+        std::vector<EdgeIndex> astar = ng.shortest_path_astar(s,t);
+        double a = 0, b = 0;
+        for (EdgeIndex e : dijkstra) a += network.get_edges()[e].length;
+        for (EdgeIndex e : astar) b += network.get_edges()[e].length;
+        REQUIRE(a==Approx(b));
+      }
+    }
+    ng.set_landmarks(nullptr);
+  }
+
+  SECTION( "path_cache" ) {
+    PathCache cache(ng);
+    int N = network.get_node_count();
+    std::vector<NodeIndex> targets;
+    for (NodeIndex t = 0; t < N; ++t) targets.push_back(t);
+    double delta = 4;
+    REQUIRE(PathCache::bucket_bound(delta)>=delta);
+    REQUIRE(PathCache::bucket_bound(3.9)==PathCache::bucket_bound(delta));
+    for (int round = 0; round < 2; ++round) {
+      for (NodeIndex s = 0; s < N; ++s) {
+        PredecessorMap pmap;
+        DistanceMap dmap;
+        ng.single_source_upperbound_dijkstra(s,delta,&pmap,&dmap);
+        std::vector<double> row = cache.one_to_many(s,targets,delta);
+        for (NodeIndex t = 0; t < N; ++t) {
+          auto iter = dmap.find(t);
+          if (iter == dmap.end()) {
+            REQUIRE(row[t]==std::numeric_limits<double>::max());
+            continue;
+          }
+          REQUIRE(row[t]==Approx(iter->second));
+          // The path cached should be a connected path of the distance
+          std::vector<EdgeIndex> path;
+          REQUIRE(cache.get_path(s,t,&path));
+          double length = 0;
+          NodeIndex u = s;
+          for (EdgeIndex e : path) {
+            const Edge &edge = network.get_edges()[e];
+            REQUIRE(edge.source==u);
+            u = edge.target;
+            length += edge.length;
+          }
+          REQUIRE(u==t);
+          REQUIRE(length==Approx(row[t]));
+        }
+      }
+    }
+    PathCacheStatistics statistics = cache.get_statistics();
+    REQUIRE(statistics.pairs>0);
+    REQUIRE(statistics.evictions==0);
+    // The second round is answered by the cache
+    REQUIRE(statistics.misses<=N*N);
+    REQUIRE(statistics.hits>=N*N);
+    // A pair not reached is searched again with a larger bound
+    std::vector<double> row = cache.one_to_many(0,targets,1000);
+    PredecessorMap pmap;
+    DistanceMap dmap;
+    ng.single_source_upperbound_dijkstra(0,1000,&pmap,&dmap);
+    for (NodeIndex t = 0; t < N; ++t) {
+      REQUIRE((dmap.find(t)!=dmap.end())==
+              (row[t]!=std::numeric_limits<double>::max()));
+    }
+    PathCache small(ng,PathCache::CACHE_SHARDS);
+    for (NodeIndex s = 0; s < N; ++s) small.one_to_many(s,targets,delta);
+    REQUIRE(small.get_statistics().evictions>0);
+    REQUIRE(small.get_statistics().pairs<=PathCache::CACHE_SHARDS);
+  }
+
   SECTION( "get_edge_index" ) {
     REQUIRE(network.get_edge_id(ng.get_edge_index(
       network.get_node_index(11),network.get_node_index(12),1
@@ -37,4 +262,79 @@ TEST_CASE( "Network graph is tested", "[network_graph]" ) {
     ) == -1);
   }
 
+  SECTION( "csr_graph" ) {
+    const CSRGraph &g = ng.get_graph();
+    CSRGraph rg = ng.get_reverse_graph();
+    REQUIRE(g.get_num_vertices()==ng.get_num_vertices());
+    REQUIRE((int) g.get_num_edges()==network.get_edge_count());
+    REQUIRE(rg.get_num_edges()==g.get_num_edges());
+    REQUIRE(rg.is_reverse());
+    std::vector<int> in_degree(g.get_num_vertices(),0);
+    for (const Edge &e : network.get_edges()) {
+      bool found = false;
+      for (unsigned int i = g.begin(e.source); i < g.end(e.source); ++i) {
+        if (g.get_index(i)==e.index) {
+          found = true;
+          REQUIRE(g.get_target(i)==e.target);
+          REQUIRE(g.get_length(i)==e.length);
+        }
+      }
+      REQUIRE(found);
+      found = false;
+      for (unsigned int i = rg.begin(e.target); i < rg.end(e.target); ++i) {
+        if (rg.get_index(i)==e.index) {
+          found = true;
+          REQUIRE(rg.get_target(i)==e.source);
+        }
+      }
+      REQUIRE(found);
+      ++in_degree[e.target];
+    }
+    for (NodeIndex u = 0; u < rg.get_num_vertices(); ++u) {
+      REQUIRE((int) (rg.end(u)-rg.begin(u))==in_degree[u]);
+    }
+    // A large graph is built in parallel, where the arcs of a node still
+    // keep their order
+    unsigned int num_vertices = 50000;
+    std::vector<EdgeProperty> edges;
+    for (unsigned int i = 0; i < 4 * UTIL::PARALLEL_MIN_SIZE; ++i) {
+      edges.push_back({(i * 7919u) % num_vertices,
+                       (i * 104729u) % num_vertices, i, i * 0.5});
+    }
+    for (bool reverse : {false, true}) {
+      CSRGraph large(num_vertices,edges,reverse);
+      REQUIRE(large.get_num_edges()==edges.size());
+      std::vector<unsigned int> next(num_vertices);
+      for (NodeIndex u = 0; u < num_vertices; ++u) next[u] = large.begin(u);
+      for (const EdgeProperty &e : edges) {
+        NodeIndex u = reverse ? e.target : e.source;
+        unsigned int i = next[u]++;
+        REQUIRE(i<large.end(u));
+        REQUIRE(large.get_index(i)==e.index);
+        REQUIRE(large.get_target(i)==(reverse ? e.source : e.target));
+        REQUIRE(large.get_length(i)==e.length);
+      }
+    }
+  }
+
+  SECTION( "node_pool" ) {
+    // A block released is the next one allocated of its size class
+    void *a = UTIL::NodePool::allocate(24);
+    void *b = UTIL::NodePool::allocate(32);
+    REQUIRE(a!=b);
+    REQUIRE((size_t) a % UTIL::NodePool::ALIGNMENT == 0);
+    UTIL::NodePool::deallocate(a,24);
+    REQUIRE(UTIL::NodePool::allocate(20)==a);
+    UTIL::NodePool::deallocate(a,24);
+    UTIL::NodePool::deallocate(b,32);
+    REQUIRE(UTIL::NodePool::get_chunk_bytes()>=UTIL::NodePool::CHUNK_BYTES);
+    // The maps of the routing keep their content with pooled nodes
+    PredecessorMap pmap;
+    for (NodeIndex v = 0; v < 1000; ++v) pmap.insert({v,v+1});
+    pmap.erase(500);
+    REQUIRE(pmap.size()==999);
+    REQUIRE(pmap.at(999)==1000);
+    REQUIRE(pmap.find(500)==pmap.end());
+  }
+
 }
@@ -2,8 +2,13 @@
 #include "catch2/catch.hpp"
 #include "util/debug.hpp"
 #include "network/network.hpp"
+#include "network/network_graph.hpp"
+#include "network/region_partition.hpp"
+#include "util/util.hpp"
 #include "algorithm/geom_algorithm.hpp"
 
+#include <fstream>
+
 using namespace FMM;
 using namespace FMM::CORE;
 using namespace FMM::ALGORITHM;
@@ -48,4 +53,880 @@ TEST_CASE( "Network is tested", "[network]" ) {
     trcs = network.search_tr_cs_knn(line,3,0.05);
     REQUIRE(trcs.size()==0);
   }
+
+  SECTION( "rtree_algorithm" ) {
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    Traj_Candidates expected = network.search_tr_cs_knn(line,3,0.15);
+    for (const std::string &name : {"packing","linear","quadratic","rstar"}) {
+      SpatialIndexOptions options;
+      REQUIRE(Network::string2rtree_algorithm(name,&options.algorithm));
+      options.max_elements = 4;
+      Network other("../data/network.gpkg","id","source","target",false,
+                    options);
+      Traj_Candidates trcs = other.search_tr_cs_knn(line,3,0.15);
+      REQUIRE(trcs.size()==expected.size());
+      for (int i = 0; i < trcs.size(); ++i) {
+        REQUIRE(trcs[i].size()==expected[i].size());
+        for (int j = 0; j < trcs[i].size(); ++j) {
+          REQUIRE(trcs[i][j].edge->index==expected[i][j].edge->index);
+        }
+      }
+    }
+    RtreeAlgorithm algorithm;
+    REQUIRE_FALSE(Network::string2rtree_algorithm("str",&algorithm));
+  }
+
+  SECTION( "candidate_search_context" ) {
+    CandidateSearchContext context;
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    for (int k : {1, 3, 100}) {
+      Traj_Candidates expected = network.search_tr_cs_knn(line,k,0.15);
+      REQUIRE(network.search_tr_cs_knn(line,k,0.15,&context));
+      REQUIRE(context.get_num_points()==expected.size());
+      for (int i = 0; i < expected.size(); ++i) {
+        CandidateSpan cs = context.get_point_candidates(i);
+        REQUIRE(cs.size()==expected[i].size());
+        for (int j = 0; j < cs.size(); ++j) {
+          REQUIRE(cs[j].index==expected[i][j].index);
+          REQUIRE(cs[j].edge==expected[i][j].edge);
+          REQUIRE(cs[j].dist==expected[i][j].dist);
+          REQUIRE(cs[j].offset==expected[i][j].offset);
+        }
+      }
+      REQUIRE(context.to_traj_candidates().size()==expected.size());
+    }
+    // A point without candidate empties the context
+    REQUIRE_FALSE(network.search_tr_cs_knn(line,3,0.05,&context));
+    REQUIRE(context.empty());
+    REQUIRE(context.get_candidates().empty());
+  }
+
+  SECTION( "grid_index" ) {
+    SpatialIndexOptions options;
+    REQUIRE(Network::string2spatial_index_type("grid",&options.type));
+    // Points inside, on the border and outside of the network
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    for (double cell_size : {0.0, 0.05, 0.4, 100.0}) {
+      options.cell_size = cell_size;
+      Network other("../data/network.gpkg","id","source","target",false,
+                    options);
+      for (double radius : {0.1, 0.5, 2.0}) {
+        for (int i = 0; i < line.get_num_points(); ++i) {
+          LineString point;
+          point.add_point(line.get_x(i),line.get_y(i));
+          Traj_Candidates expected = network.search_tr_cs_knn(point,100,
+                                                              radius);
+          Traj_Candidates trcs = other.search_tr_cs_knn(point,100,radius);
+          REQUIRE(trcs.size()==expected.size());
+          if (trcs.empty()) continue;
+          REQUIRE(trcs[0].size()==expected[0].size());
+          for (int j = 0; j < trcs[0].size(); ++j) {
+            REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+          }
+        }
+      }
+    }
+    SpatialIndexType type;
+    REQUIRE(Network::string2spatial_index_type("rtree",&type));
+    REQUIRE(type==RTREE);
+    REQUIRE_FALSE(Network::string2spatial_index_type("str",&type));
+  }
+
+  SECTION( "rtree_chunks" ) {
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    for (int chunk_segments : {1, 2, 1000}) {
+      for (int batch_size : {1, 7}) {
+        SpatialIndexOptions options;
+        options.chunk_segments = chunk_segments;
+        options.query_batch_size = batch_size;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        for (double radius : {0.1, 0.5, 2.0}) {
+          // The chunks of an edge are merged into one candidate
+          for (int i = 0; i < line.get_num_points(); ++i) {
+            LineString point;
+            point.add_point(line.get_x(i),line.get_y(i));
+            Traj_Candidates expected = network.search_tr_cs_knn(point,100,
+                                                                radius);
+            Traj_Candidates trcs = other.search_tr_cs_knn(point,100,radius);
+            REQUIRE(trcs.size()==expected.size());
+            if (trcs.empty()) continue;
+            REQUIRE(trcs[0].size()==expected[0].size());
+            for (int j = 0; j < trcs[0].size(); ++j) {
+              REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+              REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+              REQUIRE(trcs[0][j].offset==Approx(expected[0][j].offset));
+            }
+          }
+        }
+        // The edges queried are unique
+        std::vector<EdgeIndex> edges;
+        other.query_edges(BoostBox(Point(-10,-10),Point(10,10)),&edges);
+        REQUIRE(edges.size()==other.get_edge_count());
+      }
+    }
+  }
+
+  SECTION( "nearest_search" ) {
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    for (int chunk_segments : {0, 1}) {
+      for (const std::string &name : {"packing","rstar"}) {
+        SpatialIndexOptions options;
+        REQUIRE(Network::string2rtree_algorithm(name,&options.algorithm));
+        options.nearest_search = true;
+        options.chunk_segments = chunk_segments;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        // The k nearest candidates are the ones of the full search
+        for (std::size_t k : {1, 3, 100}) {
+          for (double radius : {0.1, 0.5, 2.0}) {
+            for (int i = 0; i < line.get_num_points(); ++i) {
+              LineString point;
+              point.add_point(line.get_x(i),line.get_y(i));
+              Traj_Candidates expected = network.search_tr_cs_knn(point,k,
+                                                                  radius);
+              Traj_Candidates trcs = other.search_tr_cs_knn(point,k,radius);
+              REQUIRE(trcs.size()==expected.size());
+              if (trcs.empty()) continue;
+              REQUIRE(trcs[0].size()==expected[0].size());
+              for (int j = 0; j < trcs[0].size(); ++j) {
+                REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+                REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+                REQUIRE(trcs[0][j].offset==Approx(expected[0][j].offset));
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  SECTION( "twin_edges" ) {
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    for (int chunk_segments : {0, 1}) {
+      for (bool nearest : {false, true}) {
+        SpatialIndexOptions options;
+        options.twin_edges = true;
+        options.chunk_segments = chunk_segments;
+        options.nearest_search = nearest;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        // The two-way roads of the network are drawn twice
+        int twins = 0;
+        for (EdgeIndex e = 0; e < other.get_edge_count(); ++e) {
+          EdgeIndex twin = other.get_edge_twin(e);
+          if (twin == Network::NO_TWIN) continue;
+          ++twins;
+          const Edge &edge = other.get_edges()[e];
+          REQUIRE(other.get_edge_twin(twin)==e);
+          REQUIRE(other.get_edges()[twin].source==edge.target);
+          LineString geom = other.get_edge_geom(edge.id);
+          LineString twin_geom =
+              other.get_edge_geom(other.get_edge_id(twin));
+          int n = geom.get_num_points();
+          REQUIRE(twin_geom.get_num_points()==n);
+          for (int i = 0; i < n; ++i) {
+            REQUIRE(geom.get_x(i)==twin_geom.get_x(n-1-i));
+            REQUIRE(geom.get_y(i)==twin_geom.get_y(n-1-i));
+          }
+        }
+        REQUIRE(twins==24);
+        // The candidates of the twins are the ones of the full search
+        for (double radius : {0.1, 0.5, 2.0}) {
+          for (int i = 0; i < line.get_num_points(); ++i) {
+            LineString point;
+            point.add_point(line.get_x(i),line.get_y(i));
+            Traj_Candidates expected = network.search_tr_cs_knn(point,100,
+                                                                radius);
+            Traj_Candidates trcs = other.search_tr_cs_knn(point,100,radius);
+            REQUIRE(trcs.size()==expected.size());
+            if (trcs.empty()) continue;
+            REQUIRE(trcs[0].size()==expected[0].size());
+            for (int j = 0; j < trcs[0].size(); ++j) {
+              REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+              REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+              REQUIRE(trcs[0][j].offset==
+                      Approx(expected[0][j].offset).margin(1e-9));
+            }
+          }
+        }
+        std::vector<EdgeIndex> edges;
+        other.query_edges(BoostBox(Point(-10,-10),Point(10,10)),&edges);
+        std::sort(edges.begin(),edges.end());
+        REQUIRE(std::unique(edges.begin(),edges.end())==edges.end());
+        REQUIRE(edges.size()==other.get_edge_count());
+      }
+    }
+  }
+
+  SECTION( "flat_rtree" ) {
+    // Boxes of a grid with some overlapping, queried against a scan
+    std::vector<BoostBox> boxes;
+    for (int i = 0; i < 300; ++i) {
+      double x = (i * 37) % 101, y = (i * 53) % 97;
+      boxes.push_back(BoostBox(Point(x,y),Point(x+(i%7),y+(i%5))));
+    }
+    for (int max_elements : {4, 16, 1000}) {
+      FlatRtreeIndex index(boxes,max_elements);
+      REQUIRE(index.get_num_items()==boxes.size());
+      REQUIRE(index.get_memory_bytes()==index.get_data_size());
+      for (double q = -5; q < 100; q += 13) {
+        BoostBox box(Point(q,q/2),Point(q+9,q/2+20));
+        std::vector<EdgeIndex> edges;
+        index.query(box,&edges);
+        std::sort(edges.begin(),edges.end());
+        std::vector<EdgeIndex> expected;
+        for (EdgeIndex i = 0; i < boxes.size(); ++i) {
+          if (boost::geometry::intersects(box,boxes[i])) expected.push_back(i);
+        }
+        REQUIRE(edges==expected);
+      }
+      // The items are visited by distance
+      double last = 0;
+      int visited = 0;
+      index.visit_nearest(50,50,[&](EdgeIndex item, double dist) {
+        REQUIRE(dist>=last);
+        REQUIRE(dist==Approx(boost::geometry::distance(Point(50,50),
+                                                       boxes[item])));
+        last = dist;
+        return ++visited < 100;
+      });
+      REQUIRE(visited==100);
+    }
+    FlatRtreeIndex empty(std::vector<BoostBox>(),16);
+    std::vector<EdgeIndex> edges;
+    empty.query(BoostBox(Point(0,0),Point(1,1)),&edges);
+    REQUIRE(edges.empty());
+    // The candidates are the ones of the boost rtree
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    SpatialIndexOptions options;
+    REQUIRE(Network::string2spatial_index_type("flat",&options.type));
+    REQUIRE(options.type==FLAT_RTREE);
+    for (int chunk_segments : {0, 1}) {
+      for (bool nearest : {false, true}) {
+        options.chunk_segments = chunk_segments;
+        options.nearest_search = nearest;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        for (double radius : {0.1, 0.5, 2.0}) {
+          for (int i = 0; i < line.get_num_points(); ++i) {
+            LineString point;
+            point.add_point(line.get_x(i),line.get_y(i));
+            Traj_Candidates expected = network.search_tr_cs_knn(point,3,
+                                                                radius);
+            Traj_Candidates trcs = other.search_tr_cs_knn(point,3,radius);
+            REQUIRE(trcs.size()==expected.size());
+            if (trcs.empty()) continue;
+            REQUIRE(trcs[0].size()==expected[0].size());
+            for (int j = 0; j < trcs[0].size(); ++j) {
+              REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+              REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+            }
+          }
+        }
+      }
+    }
+    // The flat rtree is written into the network cache and mapped
+    std::string cache_file = Network::get_cache_file("../data/network.gpkg");
+    std::remove(cache_file.c_str());
+    options = SpatialIndexOptions();
+    options.type = FLAT_RTREE;
+    options.max_elements = 4;
+    Network written("../data/network.gpkg","id","source","target",true,
+                    options);
+    for (int max_elements : {4, 8}) {
+      options.max_elements = max_elements;
+      Network cached("../data/network.gpkg","id","source","target",true,
+                     options);
+      LineString query = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+      Traj_Candidates expected = network.search_tr_cs_knn(query,3,0.15);
+      Traj_Candidates trcs = cached.search_tr_cs_knn(query,3,0.15);
+      REQUIRE(trcs.size()==expected.size());
+      for (int i = 0; i < trcs.size(); ++i) {
+        REQUIRE(trcs[i].size()==expected[i].size());
+        for (int j = 0; j < trcs[i].size(); ++j) {
+          REQUIRE(trcs[i][j].edge->index==expected[i][j].edge->index);
+        }
+      }
+    }
+    // A tree beyond the end of the file is not mapped
+    REQUIRE(FlatRtreeIndex::map_file(cache_file,65536,
+                                     UTIL::get_file_size(cache_file),4)==nullptr);
+    std::remove(cache_file.c_str());
+  }
+
+  SECTION( "adaptive_radius" ) {
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    for (int chunk_segments : {0, 1}) {
+      for (int batch_size : {1, 7}) {
+        SpatialIndexOptions options;
+        options.chunk_segments = chunk_segments;
+        options.query_batch_size = batch_size;
+        options.initial_radius = 0.05;
+        options.min_candidates = 3;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        // With k minimum candidates, the k nearest ones are found within
+        // the radius grown
+        for (int i = 0; i < line.get_num_points(); ++i) {
+          LineString point;
+          point.add_point(line.get_x(i),line.get_y(i));
+          Traj_Candidates expected = network.search_tr_cs_knn(point,3,2.0);
+          Traj_Candidates trcs = other.search_tr_cs_knn(point,3,2.0);
+          REQUIRE(trcs.size()==expected.size());
+          if (trcs.empty()) continue;
+          REQUIRE(trcs[0].size()==expected[0].size());
+          for (int j = 0; j < trcs[0].size(); ++j) {
+            REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+            REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+          }
+        }
+        CandidateSearchStatistics statistics = other.get_search_statistics();
+        REQUIRE(statistics.points>0);
+        REQUIRE(statistics.expanded_points>0);
+        REQUIRE(statistics.expanded_points<=statistics.points);
+        REQUIRE(statistics.expansions>=statistics.expanded_points);
+        REQUIRE(statistics.full_radius_points<=statistics.expanded_points);
+      }
+    }
+    // A point close to an edge keeps the candidates of the initial radius
+    SpatialIndexOptions options;
+    options.initial_radius = 0.15;
+    Network other("../data/network.gpkg","id","source","target",false,
+                  options);
+    LineString point;
+    point.add_point(2.1,1.9);
+    Traj_Candidates trcs = other.search_tr_cs_knn(point,8,2.0);
+    REQUIRE(trcs.size()==1);
+    REQUIRE(trcs[0].size()==network.search_tr_cs_knn(point,8,0.15)[0].size());
+    REQUIRE(other.get_search_statistics().expanded_points==0);
+    REQUIRE(network.get_search_statistics().points==0);
+  }
+
+  SECTION( "candidate_pruning" ) {
+    LineString line = wkt2linestring(
+      "LineString(2.1 1.9,2.1 2.8,2.15 2.8,2.2 2.8)");
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(line,8,2.0,&context));
+    Traj_Candidates expected = context.to_traj_candidates();
+    CandidatePruning pruning;
+    pruning.gps_error = 0.1;
+    // Disabled options keep all the candidates
+    std::size_t num_candidates = context.get_candidates().size();
+    context.prune(line,8,pruning);
+    REQUIRE(context.get_candidates().size()==num_candidates);
+    pruning.min_ep_ratio = 0.5;
+    pruning.max_dist_ratio = 3;
+    pruning.adaptive_k_spacing = 0.5;
+    context.prune(line,8,pruning);
+    REQUIRE(context.get_num_points()==expected.size());
+    NodeIndex index = network.get_node_count();
+    for (int i = 0; i < expected.size(); ++i) {
+      CandidateSpan cs = context.get_point_candidates(i);
+      REQUIRE_FALSE(cs.empty());
+      REQUIRE(cs.size()<=expected[i].size());
+      REQUIRE(cs[0].edge==expected[i][0].edge);
+      double d0 = cs[0].dist;
+      for (int j = 0; j < cs.size(); ++j) {
+        REQUIRE(cs[j].edge==expected[i][j].edge);
+        REQUIRE(cs[j].index==index++);
+        REQUIRE(cs[j].dist<=3*std::max(d0,0.1)+1e-9);
+        double ep_ratio = exp(-0.5*(cs[j].dist*cs[j].dist-d0*d0)/0.01);
+        REQUIRE(ep_ratio>=0.5-1e-9);
+      }
+    }
+    // The points 0.05 apart keep at most ceil(8*0.05/0.5) candidates
+    REQUIRE(context.get_point_candidates(2).size()<=1);
+  }
+
+  SECTION( "heading_candidate_pruning" ) {
+    // The points head north along the edges at x = 2
+    LineString line = wkt2linestring("LineString(2.1 1.1,2.1 1.9,2.1 2.7)");
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(line,8,2.0,&context));
+    Traj_Candidates expected = context.to_traj_candidates();
+    CandidatePruning pruning;
+    pruning.max_heading_diff = 45;
+    context.prune(line,8,pruning);
+    REQUIRE(context.get_num_points()==expected.size());
+    REQUIRE(context.get_candidates().size()<
+            expected[0].size()+expected[1].size()+expected[2].size());
+    for (int i = 0; i < expected.size(); ++i) {
+      CandidateSpan cs = context.get_point_candidates(i);
+      REQUIRE_FALSE(cs.empty());
+      for (int j = 0; j < cs.size(); ++j) {
+        double dx, dy;
+        if (cs.size()>1 &&
+            network.get_edge_direction(cs[j].edge->index,cs[j].offset,
+                                       &dx,&dy)) {
+          REQUIRE(dy>=std::cos(M_PI/4)-1e-9);
+        }
+      }
+    }
+    // A heading shorter than the minimum distance keeps the candidates
+    REQUIRE(network.search_tr_cs_knn(line,8,2.0,&context));
+    pruning.min_heading_distance = 10;
+    context.prune(line,8,pruning);
+    for (int i = 0; i < expected.size(); ++i) {
+      REQUIRE(context.get_point_candidates(i).size()==expected[i].size());
+    }
+  }
+
+  SECTION( "batched_candidate_search" ) {
+    LineString line;
+    for (double x = 0.5; x < 4.5; x += 0.2) {
+      line.add_point(x,3.5-0.5*x);
+    }
+    for (const std::string &index : {"rtree", "grid"}) {
+      SpatialIndexOptions options;
+      REQUIRE(Network::string2spatial_index_type(index,&options.type));
+      for (int batch_size : {2, 7, 100}) {
+        options.query_batch_size = batch_size;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        for (double radius : {0.1, 0.5}) {
+          Traj_Candidates expected = network.search_tr_cs_knn(line,4,radius);
+          Traj_Candidates trcs = other.search_tr_cs_knn(line,4,radius);
+          REQUIRE(trcs.size()==expected.size());
+          for (int i = 0; i < trcs.size(); ++i) {
+            REQUIRE(trcs[i].size()==expected[i].size());
+            for (int j = 0; j < trcs[i].size(); ++j) {
+              REQUIRE(trcs[i][j].edge->index==expected[i][j].edge->index);
+              REQUIRE(trcs[i][j].offset==expected[i][j].offset);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  SECTION( "snap_cache" ) {
+    // Points repeated around a few locations, as at a depot
+    LineString line;
+    for (int i = 0; i < 40; ++i) {
+      double x = i % 2 == 0 ? 2.0 : 0.7;
+      line.add_point(x+0.01*(i%5),1.5-0.3*x+0.01*(i%3));
+    }
+    for (const std::string &index : {"rtree", "grid"}) {
+      for (int chunk_segments : {0, 1}) {
+        SpatialIndexOptions options;
+        REQUIRE(Network::string2spatial_index_type(index,&options.type));
+        options.chunk_segments = chunk_segments;
+        options.snap_resolution = 0.5;
+        Network other("../data/network.gpkg","id","source","target",false,
+                      options);
+        REQUIRE(other.get_snap_cache()!=nullptr);
+        for (double radius : {0.1, 0.5}) {
+          for (int i = 0; i < line.get_num_points(); ++i) {
+            LineString point;
+            point.add_point(line.get_x(i),line.get_y(i));
+            Traj_Candidates expected =
+                network.search_tr_cs_knn(point,4,radius);
+            Traj_Candidates trcs = other.search_tr_cs_knn(point,4,radius);
+            REQUIRE(trcs.size()==expected.size());
+            if (trcs.empty()) continue;
+            REQUIRE(trcs[0].size()==expected[0].size());
+            for (int j = 0; j < trcs[0].size(); ++j) {
+              REQUIRE(trcs[0][j].edge->index==expected[0][j].edge->index);
+              REQUIRE(trcs[0][j].dist==Approx(expected[0][j].dist));
+              REQUIRE(trcs[0][j].offset==Approx(expected[0][j].offset));
+            }
+          }
+        }
+        // The cells of the two locations are queried once per radius
+        SnapCacheStatistics statistics =
+            other.get_snap_cache()->get_statistics();
+        REQUIRE(statistics.misses==4);
+        REQUIRE(statistics.hits==2*line.get_num_points()-4);
+        REQUIRE(statistics.cells==4);
+      }
+    }
+    REQUIRE(network.get_snap_cache()==nullptr);
+  }
+
+  SECTION( "id_index_map" ) {
+    // Dense ids stored in a table, sparse ids stored sorted
+    for (int step : {1, 1000000}) {
+      std::vector<int> ids = {3*step, -step, 7*step, 3*step, 0};
+      IdIndexMap map(ids);
+      REQUIRE(map.size()==5);
+      REQUIRE(map.at(3*step)==0);
+      REQUIRE(map.at(-step)==1);
+      REQUIRE(map.at(7*step)==2);
+      REQUIRE(map.at(0)==4);
+      unsigned int index;
+      REQUIRE_FALSE(map.find(2*step,&index));
+      REQUIRE_FALSE(map.find(8*step,&index));
+      REQUIRE_THROWS_AS(map.at(5*step),std::out_of_range);
+    }
+    // The pairs of a large map are sorted in parallel, keeping the first
+    // of the duplicated ids
+    std::vector<int> ids;
+    for (int i = 0; i < 2 * UTIL::PARALLEL_MIN_SIZE; ++i) {
+      ids.push_back((i % 50000) * 40000);
+    }
+    IdIndexMap large(ids);
+    for (int i = 0; i < 50000; ++i) {
+      REQUIRE(large.at(i * 40000)==i);
+    }
+    IdIndexMap empty;
+    unsigned int index;
+    REQUIRE_FALSE(empty.find(0,&index));
+  }
+
+  SECTION( "reorder_network" ) {
+    Network reordered("../data/network.gpkg","id","source","target",false,
+                      SpatialIndexOptions(),true);
+    REQUIRE(reordered.get_node_count()==network.get_node_count());
+    REQUIRE(reordered.get_edge_count()==network.get_edge_count());
+    const std::vector<Edge> &edges = reordered.get_edges();
+    for (int i = 0; i < edges.size(); ++i) {
+      REQUIRE(edges[i].index==i);
+      if (i > 0) REQUIRE(edges[i-1].source<=edges[i].source);
+      const Edge &edge = network.get_edges()[network.get_edge_index(
+          edges[i].id)];
+      REQUIRE(reordered.get_edge_index(edges[i].id)==i);
+      REQUIRE(reordered.get_node_id(edges[i].source)==
+              network.get_node_id(edge.source));
+      REQUIRE(reordered.get_node_id(edges[i].target)==
+              network.get_node_id(edge.target));
+      LineString geom = network.get_edge_geom(edge.id);
+      REQUIRE(reordered.get_edge_geom(edges[i].id)==geom);
+    }
+    for (NodeIndex u = 0; u < reordered.get_node_count(); ++u) {
+      NodeIndex v = network.get_node_index(reordered.get_node_id(u));
+      REQUIRE(reordered.get_node_index(reordered.get_node_id(u))==u);
+      REQUIRE(boost::geometry::equals(reordered.get_vertex_point(u),
+                                      network.get_vertex_point(v)));
+    }
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    Traj_Candidates expected = network.search_tr_cs_knn(line,3,0.15);
+    Traj_Candidates trcs = reordered.search_tr_cs_knn(line,3,0.15);
+    REQUIRE(trcs.size()==expected.size());
+    for (int i = 0; i < trcs.size(); ++i) {
+      REQUIRE(trcs[i].size()==expected[i].size());
+    }
+  }
+
+  SECTION( "project_network" ) {
+    std::string cache_file = Network::get_cache_file("../data/network.gpkg");
+    std::remove(cache_file.c_str());
+    Network projected("../data/network.gpkg","id","source","target",true,
+                      SpatialIndexOptions(),false,true);
+    const LocalProjection &projection = projected.get_projection();
+    REQUIRE(projection.is_enabled());
+    REQUIRE_FALSE(network.get_projection().is_enabled());
+    // Edge 5 goes one degree north
+    const Edge &edge = projected.get_edges()[projected.get_edge_index(5)];
+    REQUIRE(edge.length == Approx(LocalProjection::EARTH_RADIUS * M_PI / 180));
+    Point p = projected.get_node_geom_from_idx(projected.get_node_index(6));
+    double x = boost::geometry::get<0>(p);
+    double y = boost::geometry::get<1>(p);
+    projection.inverse(&x, &y);
+    REQUIRE(x == Approx(3.0));
+    REQUIRE(y == Approx(2.0));
+    // The projection is read from the cache
+    Network cached("../data/network.gpkg","id","source","target",true,
+                   SpatialIndexOptions(),false,true);
+    REQUIRE(cached.get_projection().get_origin_x() ==
+            projection.get_origin_x());
+    REQUIRE(cached.get_projection().get_origin_y() ==
+            projection.get_origin_y());
+    REQUIRE(cached.get_edges()[edge.index].length == edge.length);
+    // A cache of a projected network is not used without projection
+    Network unprojected("../data/network.gpkg","id","source","target",true);
+    REQUIRE_FALSE(unprojected.get_projection().is_enabled());
+    REQUIRE(unprojected.get_edges()[edge.index].length == Approx(1.0));
+    std::remove(cache_file.c_str());
+  }
+
+  SECTION( "clip_network" ) {
+    std::string cache_file = Network::get_cache_file("../data/network.gpkg");
+    std::remove(cache_file.c_str());
+    NetworkClip clip;
+    clip.region = "0,0,2.5,5";
+    clip.margin = 0.1;
+    Network clipped("../data/network.gpkg","id","source","target",true,
+                    SpatialIndexOptions(),false,false,clip);
+    REQUIRE(clipped.is_clipped());
+    REQUIRE_FALSE(network.is_clipped());
+    REQUIRE(clipped.get_edge_count()>0);
+    REQUIRE(clipped.get_edge_count()<network.get_edge_count());
+    // The cache file stores the whole network
+    REQUIRE_FALSE(UTIL::file_exists(cache_file));
+    for (const Edge &edge : clipped.get_edges()) {
+      const Edge &e = network.get_edges()[network.get_edge_index(edge.id)];
+      REQUIRE(e.length==edge.length);
+      REQUIRE(network.get_node_id(e.source)==
+              clipped.get_node_id(edge.source));
+      REQUIRE(network.get_node_id(e.target)==
+              clipped.get_node_id(edge.target));
+    }
+    clip.region = "POLYGON((0 0,2.5 0,2.5 5,0 5,0 0))";
+    clip.margin = 0;
+    Network polygon("../data/network.gpkg","id","source","target",false,
+                    SpatialIndexOptions(),false,false,clip);
+    REQUIRE(polygon.get_edge_count()>0);
+    REQUIRE(polygon.get_edge_count()<=clipped.get_edge_count());
+  }
+
+  SECTION( "osm_network" ) {
+    // Two ways crossing at node 2, one of them oneway, a way continuing
+    // the first one, a building and a way referencing a missing node
+    Network osm("../data/roads.osm.pbf");
+    REQUIRE(osm.get_edge_count()==8);
+    REQUIRE(osm.get_node_count()==6);
+    // The edges of the oneway way are numbered after the two ways of
+    // lower OSM id, and have no backward edge
+    const Edge &oneway = osm.get_edges()[osm.get_edge_index(5)];
+    REQUIRE(osm.get_node_id(oneway.source)==4);
+    REQUIRE(osm.get_node_id(oneway.target)==2);
+    LineStringView oneway_geom = osm.get_edge_view(oneway.index);
+    REQUIRE(oneway_geom.get_num_points()==2);
+    REQUIRE(oneway_geom.get_x(0)==Approx(1.0));
+    REQUIRE(oneway_geom.get_y(0)==Approx(1.0));
+    REQUIRE(osm.get_edges()[osm.get_edge_index(6)].source==oneway.target);
+    // A two way road gives an edge in each direction
+    const Edge &forward = osm.get_edges()[osm.get_edge_index(1)];
+    const Edge &backward = osm.get_edges()[osm.get_edge_index(2)];
+    REQUIRE(forward.source==backward.target);
+    REQUIRE(forward.target==backward.source);
+    REQUIRE(forward.length==Approx(backward.length));
+  }
+
+  SECTION( "compressed_geometry" ) {
+    SpatialIndexOptions options;
+    options.chunk_segments = 1;
+    Network chunked("../data/network.gpkg","id","source","target",false,
+                    options);
+    Network compressed("../data/network.gpkg","id","source","target",false,
+                       options,false,false,NetworkClip(),true);
+    // The decoded edges are the ones of the packed store
+    for (int pass = 0; pass < 2; ++pass) {
+      for (EdgeIndex e = 0; e < network.get_edge_count(); ++e) {
+        LineStringView expected = network.get_edge_view(e);
+        LineStringView view = compressed.get_edge_view(e);
+        REQUIRE(view.get_num_points()==expected.get_num_points());
+        for (int i = 0; i < view.get_num_points(); ++i) {
+          REQUIRE(view.get_x(i)==expected.get_x(i));
+          REQUIRE(view.get_y(i)==expected.get_y(i));
+          REQUIRE(view.get_cumlen_data()[i]==expected.get_cumlen_data()[i]);
+        }
+      }
+    }
+    EdgeID id = network.get_edge_id(3);
+    REQUIRE(compressed.get_edge_geom(id).get_num_points()==
+            network.get_edge_geom(id).get_num_points());
+    std::vector<EdgeIndex> path = {0, 1, 2};
+    LineString expected_path =
+        network.complete_path_to_geometry(path, 0.1, 0.2);
+    LineString path_geom =
+        compressed.complete_path_to_geometry(path, 0.1, 0.2);
+    REQUIRE(path_geom.get_num_points()==expected_path.get_num_points());
+    for (int i = 0; i < path_geom.get_num_points(); ++i) {
+      REQUIRE(path_geom.get_x(i)==expected_path.get_x(i));
+      REQUIRE(path_geom.get_y(i)==expected_path.get_y(i));
+    }
+    REQUIRE(compressed.route2geometry(path).get_num_points()==
+            network.route2geometry(path).get_num_points());
+    LineString line;
+    for (double x = -0.5; x < 5.5; x += 0.37) {
+      line.add_point(x,4.0-0.6*x);
+    }
+    Traj_Candidates expected = chunked.search_tr_cs_knn(line,4,1.0);
+    Traj_Candidates trcs = compressed.search_tr_cs_knn(line,4,1.0);
+    REQUIRE(trcs.size()==expected.size());
+    for (int i = 0; i < trcs.size(); ++i) {
+      REQUIRE(trcs[i].size()==expected[i].size());
+      for (int j = 0; j < trcs[i].size(); ++j) {
+        REQUIRE(trcs[i][j].edge->index==expected[i][j].edge->index);
+        REQUIRE(trcs[i][j].offset==expected[i][j].offset);
+        REQUIRE(trcs[i][j].dist==expected[i][j].dist);
+      }
+    }
+  }
+
+  SECTION( "network_cache" ) {
+    std::string cache_file = Network::get_cache_file("../data/network.gpkg");
+    std::remove(cache_file.c_str());
+    Network written("../data/network.gpkg","id","source","target",true);
+    REQUIRE(UTIL::file_exists(cache_file));
+    Network cached("../data/network.gpkg","id","source","target",true);
+    REQUIRE(cached.get_node_count()==network.get_node_count());
+    REQUIRE(cached.get_edge_count()==network.get_edge_count());
+    for (const Edge &edge : network.get_edges()) {
+      const Edge &e = cached.get_edges()[edge.index];
+      REQUIRE(e.id==edge.id);
+      REQUIRE(e.source==edge.source);
+      REQUIRE(e.target==edge.target);
+      REQUIRE(e.length==edge.length);
+      LineString geom = network.get_edge_geom(edge.id);
+      REQUIRE(cached.get_edge_geom(e.id)==geom);
+      REQUIRE(cached.get_edge_index(edge.id)==edge.index);
+    }
+    for (NodeIndex i = 0; i < network.get_node_count(); ++i) {
+      REQUIRE(cached.get_node_id(i)==network.get_node_id(i));
+      REQUIRE(cached.get_node_index(network.get_node_id(i))==i);
+    }
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    Traj_Candidates expected = network.search_tr_cs_knn(line,3,0.15);
+    Traj_Candidates trcs = cached.search_tr_cs_knn(line,3,0.15);
+    REQUIRE(trcs.size()==expected.size());
+    for (int i = 0; i < trcs.size(); ++i) {
+      REQUIRE(trcs[i].size()==expected[i].size());
+      for (int j = 0; j < trcs[i].size(); ++j) {
+        REQUIRE(trcs[i][j].edge->index==expected[i][j].edge->index);
+        REQUIRE(trcs[i][j].dist==expected[i][j].dist);
+      }
+    }
+    // A cache of other field names is not used
+    std::string id_name = "source";
+    Network renamed("../data/network.gpkg",id_name,"source","target",true);
+    REQUIRE(renamed.get_edge_id(0)==
+            network.get_node_id(network.get_edges()[0].source));
+    std::remove(cache_file.c_str());
+  }
+
+  SECTION( "node_snapping" ) {
+    const std::vector<Point> &points = network.get_vertex_points();
+    std::vector<double> coords;
+    for (NodeIndex i = 0; i < points.size(); ++i) {
+      NodeIndex node;
+      double dist;
+      Point p(points[i].get<0>() + 0.01, points[i].get<1>());
+      REQUIRE(network.snap_to_node(p,0.05,&node,&dist));
+      REQUIRE(node==i);
+      REQUIRE(dist==Approx(0.01));
+      REQUIRE_FALSE(network.snap_to_node(p,0.005,&node));
+      coords.push_back(p.get<0>());
+      coords.push_back(p.get<1>());
+    }
+    coords.push_back(1e6);
+    coords.push_back(1e6);
+    std::vector<int> nodes =
+        network.snap_nodes(coords.data(),coords.size() / 2,0.05);
+    REQUIRE(nodes.size()==points.size() + 1);
+    for (NodeIndex i = 0; i < points.size(); ++i) REQUIRE(nodes[i]==i);
+    REQUIRE(nodes.back()==-1);
+    // Without a radius the farthest point still finds a node
+    NodeIndex node;
+    REQUIRE(network.snap_to_node(Point(1e6,1e6),-1,&node));
+  }
+
+  SECTION( "edge_mask" ) {
+    LineString line = wkt2linestring("LineString(2.1 1.9,2.1 2.8)");
+    Traj_Candidates trcs = network.search_tr_cs_knn(line,3,0.15);
+    REQUIRE(trcs.size()==2);
+    EdgeIndex masked = trcs[0][0].edge->index;
+    std::vector<EdgeIndex> allowed;
+    for (EdgeIndex e = 0; e < network.get_edge_count(); ++e) {
+      if (e != masked) allowed.push_back(e);
+    }
+    std::shared_ptr<const EdgeMask> mask = std::make_shared<EdgeMask>(
+        network.get_edge_count(), allowed);
+    REQUIRE(mask->get_num_allowed()==network.get_edge_count()-1);
+    REQUIRE_FALSE(mask->is_allowed(masked));
+    // The view only has the arcs of the edges allowed
+    NetworkGraph full(network);
+    NetworkGraph view(network, mask);
+    REQUIRE(view.get_num_vertices()==full.get_num_vertices());
+    REQUIRE(view.get_graph().get_num_edges()==
+        full.get_graph().get_num_edges()-1);
+    for (unsigned int i = 0; i < view.get_graph().get_num_edges(); ++i) {
+      REQUIRE(view.get_graph().get_index(i)!=masked);
+    }
+    // The candidates of the edges masked are skipped
+    CandidateSearchContext context;
+    REQUIRE(network.search_tr_cs_knn(line,3,0.15,&context,nullptr,
+                                     view.get_edge_mask()));
+    Traj_Candidates masked_trcs = context.to_traj_candidates();
+    REQUIRE(masked_trcs[0].size()==trcs[0].size()-1);
+    for (const Point_Candidates &pcs : masked_trcs) {
+      for (const Candidate &c : pcs) {
+        REQUIRE(c.edge->index!=masked);
+      }
+    }
+    // The ids read out of the network are skipped
+    std::string mask_file = "edge_mask_test.txt";
+    {
+      std::ofstream ofs(mask_file);
+      ofs << network.get_edge_id(masked) << ",100000\n";
+    }
+    std::shared_ptr<EdgeMask> read = EdgeMask::read_edge_ids(mask_file,
+                                                             network);
+    REQUIRE(read!=nullptr);
+    REQUIRE(read->get_num_allowed()==1);
+    REQUIRE(read->is_allowed(masked));
+    {
+      std::ofstream ofs(mask_file);
+      ofs << "a1\n";
+    }
+    REQUIRE(EdgeMask::read_edge_ids(mask_file,network)==nullptr);
+    std::remove(mask_file.c_str());
+  }
+
+  SECTION( "region_partition" ) {
+    RegionPartition partition = RegionPartition::create_grid(
+        network.get_vertex_points(),1,2,0.5);
+    REQUIRE(partition.size()==2);
+    const Region &left = partition.get_regions()[0];
+    const Region &right = partition.get_regions()[1];
+    REQUIRE(left.max_x==right.min_x);
+    double middle = left.max_x;
+    REQUIRE(partition.locate(middle-0.1,left.min_y)==0);
+    REQUIRE(partition.locate(middle+0.1,left.min_y)==1);
+    // A point outside of the network belongs to the nearest region
+    REQUIRE(partition.locate(right.max_x+100,right.max_y+100)==1);
+    // The sources cover the core box and twice the margin
+    std::vector<NodeIndex> sources = partition.get_sources(
+        network.get_vertex_points(),0);
+    for (NodeIndex u : sources) {
+      REQUIRE(network.get_vertex_point(u).get<0>()<=middle+1.0);
+    }
+    REQUIRE(sources.size()<network.get_node_count());
+    // Within the margin, a trajectory stays in its region
+    LineString line;
+    line.add_point(middle-1.0,1);
+    line.add_point(middle+0.3,1);
+    line.add_point(middle-0.2,1);
+    line.add_point(middle+0.8,1);
+    line.add_point(middle+1.0,1);
+    std::vector<RegionSpan> spans = partition.split(line);
+    REQUIRE(spans.size()==2);
+    REQUIRE(spans[0].region==0);
+    REQUIRE(spans[0].first==0);
+    REQUIRE(spans[0].last==2);
+    // The point before the switch is shared, as the right margin covers it
+    REQUIRE(spans[1].region==1);
+    REQUIRE(spans[1].first==2);
+    REQUIRE(spans[1].last==4);
+    std::string region_file = "region_partition_test.csv";
+    partition.get_region(1).url = "http://localhost:8081";
+    REQUIRE(partition.write(region_file));
+    RegionPartition read;
+    REQUIRE(RegionPartition::read(region_file,&read));
+    REQUIRE(read.size()==2);
+    REQUIRE(read.get_regions()[1].url=="http://localhost:8081");
+    REQUIRE(read.get_regions()[0].url.empty());
+    REQUIRE(read.get_regions()[1].margin==0.5);
+    std::remove(region_file.c_str());
+  }
 }